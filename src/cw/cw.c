@@ -29,6 +29,17 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <fcntl.h>
+#endif
 
 #if defined(HAVE_STRING_H)
 # include <string.h> /* FreeBSD 12.1 */
@@ -52,22 +63,89 @@
 /*---------------------------------------------------------------------*/
 
 
+/* State of parsing of input stream. */
+typedef enum { NONE, COMBINATION, COMMENT, NESTED_COMMENT } parse_state_t;
+
+
+enum {
+  /* Bulk input: size of stdio buffer of input stream. */
+  CW_BULK_INPUT_BUFFER_SIZE = 64 * 1024,
+
+  /*
+   * Bulk input: max count of plain characters queued with one call to
+   * cw_send_string().  Even the longest characters need less than 16 tones,
+   * so a run fits in free half of tone queue.
+   */
+  CW_BULK_RUN_SIZE = 64
+};
+
+
+/*
+ * One stream of input, played on one generator: standard input in
+ * normal mode, or a connection from client in server mode.
+ */
+typedef struct {
+  cw_context_t *context;   /* Generator (and its settings) used for this stream */
+  FILE *input;
+  FILE *echo_stream;       /* stdout, or client's socket */
+  FILE *message_stream;    /* stderr, or client's socket */
+
+  /*
+   * Copies of flags from program's configuration, may be changed by embedded
+   * commands independently in each stream.
+   */
+  bool do_echo;
+  bool do_errors;
+  bool do_commands;
+  bool do_combinations;
+  bool do_comments;
+
+  /*
+   * Kept between calls to parse_stream(), because in server mode the function
+   * is called for each line received from client.
+   */
+  parse_state_t state;
+
+  /*
+   * Client's streams don't wait for tones to be played (this would block the
+   * other clients), and a quit command only ends the client's session.
+   */
+  bool is_client;
+  bool is_quit;
+
+  /*
+   * Bulk input: runs of plain characters are collected here and queued at
+   * once, without waiting for each character to be sounded.  'run' holds
+   * characters to send, 'run_echo' the original characters to echo.
+   */
+  bool is_bulk;
+  char run[CW_BULK_RUN_SIZE + 1];
+  char run_echo[CW_BULK_RUN_SIZE + 1];
+  int run_len;
+} cw_session_t;
+
+
 /* Forward declarations for printf-like functions with checkable arguments. */
 #if __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 95)
-static void write_to_echo_stream (const char *format, ...)
-    __attribute__ ((__format__ (__printf__, 1, 2)));
-static void write_to_message_stream (const char *format, ...)
-    __attribute__ ((__format__ (__printf__, 1, 2)));
-static void write_to_cw_sender (const char *format, ...)
-    __attribute__ ((__format__ (__printf__, 1, 2)));
+static void write_to_echo_stream (cw_session_t *session, const char *format, ...)
+    __attribute__ ((__format__ (__printf__, 2, 3)));
+static void write_to_message_stream (cw_session_t *session, const char *format, ...)
+    __attribute__ ((__format__ (__printf__, 2, 3)));
+static void write_to_cw_sender (cw_session_t *session, const char *format, ...)
+    __attribute__ ((__format__ (__printf__, 2, 3)));
 #endif
 
 static void signal_handler(int signal_number);
 static void cw_atexit(void);
+static void session_init(cw_session_t *session, cw_context_t *context, FILE *input, FILE *echo_stream, FILE *message_stream);
+static void make_room_in_tone_queue(cw_session_t *session);
+static void flush_bulk_run(cw_session_t *session);
+static int server_run(const char *address);
 
 static cw_config_t *config = NULL; /* program-specific configuration */
 static bool generator = false;     /* have we created a generator? */
-static bool g_is_running = false;
+static volatile bool g_is_running = false;
+static int g_server_wakeup_fd = -1; /* eventfd waking up server's loop on signal */
 
 
 
@@ -89,29 +167,29 @@ extern cw_debug_t cw_debug_object;
  * is not set; writes are synchronously flushed.
  */
 static void
-write_to_echo_stream (const char *format, ...)
+write_to_echo_stream (cw_session_t *session, const char *format, ...)
 {
-  if (config->do_echo)
+  if (session->do_echo)
     {
       va_list ap;
 
       va_start (ap, format);
-      vfprintf (stdout, format, ap);
-      fflush (stdout);
+      vfprintf (session->echo_stream, format, ap);
+      fflush (session->echo_stream);
       va_end (ap);
     }
 }
 
 static void
-write_to_message_stream (const char *format, ...)
+write_to_message_stream (cw_session_t *session, const char *format, ...)
 {
-  if (config->do_errors)
+  if (session->do_errors)
     {
       va_list ap;
 
       va_start (ap, format);
-      vfprintf (stderr, format, ap);
-      fflush (stderr);
+      vfprintf (session->message_stream, format, ap);
+      fflush (session->message_stream);
       va_end (ap);
     }
 }
@@ -124,7 +202,7 @@ write_to_message_stream (const char *format, ...)
  * output 'stream'.
  */
 static void
-write_to_cw_sender (const char *format, ...)
+write_to_cw_sender (cw_session_t *session, const char *format, ...)
 {
   va_list ap;
   char buffer[128];
@@ -137,17 +215,27 @@ write_to_cw_sender (const char *format, ...)
   vsnprintf (buffer, sizeof (buffer), format, ap);
   va_end (ap);
 
-  /* Sound the buffer, and wait for the send to complete. */
-  if (!cw_send_string (buffer))
+  /*
+   * Sound the buffer, and wait for the send to complete.  Client's tone queue
+   * may be full, this is reported to the client.
+   */
+  if (!cw_context_send_string (session->context, buffer))
     {
+      if (session->is_client)
+        {
+          write_to_message_stream (session, "%c%c", CW_STATUS_ERR, CW_CMD_CWQUERY);
+          return;
+        }
       perror ("cw_send_string");
-      cw_flush_tone_queue ();
+      cw_context_flush_tone_queue (session->context);
       abort ();
     }
-  if (!cw_wait_for_tone_queue_critical (1))
+  if (session->is_client)
+    return;
+  if (!cw_context_wait_for_tone_queue_critical (session->context, 1))
     {
       perror ("cw_wait_for_tone_queue_critical");
-      cw_flush_tone_queue ();
+      cw_context_flush_tone_queue (session->context);
       abort ();
     }
 }
@@ -164,52 +252,52 @@ write_to_cw_sender (const char *format, ...)
  * and the query character have already been read and recognized.
  */
 static void
-parse_stream_query (FILE *stream)
+parse_stream_query (cw_session_t *session)
 {
   int c, value;
 
-  c = toupper (getc_unlocked (stream));
+  c = toupper (getc_unlocked (session->input));
   switch (c)
     {
     case EOF:
       return;
     default:
-      write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_QUERY, c);
+      write_to_message_stream (session, "%c%c%c", CW_STATUS_ERR, CW_CMD_QUERY, c);
       return;
     case CW_CMDV_FREQUENCY:
-      value = cw_get_frequency ();
+      value = cw_context_get_frequency (session->context);
       break;
     case CW_CMDV_VOLUME:
-      value = cw_get_volume ();
+      value = cw_context_get_volume (session->context);
       break;
     case CW_CMDV_SPEED:
-      value = cw_get_send_speed ();
+      value = cw_context_get_send_speed (session->context);
       break;
     case CW_CMDV_GAP:
-      value = cw_get_gap ();
+      value = cw_context_get_gap (session->context);
       break;
     case CW_CMDV_WEIGHTING:
-      value = cw_get_weighting ();
+      value = cw_context_get_weighting (session->context);
       break;
     case CW_CMDV_ECHO:
-      value = config->do_echo;
+      value = session->do_echo;
       break;
     case CW_CMDV_ERRORS:
-      value = config->do_errors;
+      value = session->do_errors;
       break;
     case CW_CMDV_COMMANDS:
-      value = config->do_commands;
+      value = session->do_commands;
       break;
     case CW_CMDV_COMBINATIONS:
-      value = config->do_combinations;
+      value = session->do_combinations;
       break;
     case CW_CMDV_COMMENTS:
-      value = config->do_comments;
+      value = session->do_comments;
       break;
     }
 
   /* Write the value obtained above to the message stream. */
-  write_to_message_stream ("%c%c%d", CW_STATUS_OK, c, value);
+  write_to_message_stream (session, "%c%c%d", CW_STATUS_OK, c, value);
 }
 
 
@@ -220,57 +308,57 @@ parse_stream_query (FILE *stream)
  * character and the cwquery character have already been read and recognized.
  */
 static void
-parse_stream_cwquery (FILE *stream)
+parse_stream_cwquery (cw_session_t *session)
 {
   int c, value;
   const char *format;
 
-  c = toupper (getc_unlocked (stream));
+  c = toupper (getc_unlocked (session->input));
   switch (c)
     {
     case EOF:
       return;
     default:
-      write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_CWQUERY, c);
+      write_to_message_stream (session, "%c%c%c", CW_STATUS_ERR, CW_CMD_CWQUERY, c);
       return;
     case CW_CMDV_FREQUENCY:
-      value = cw_get_frequency ();
+      value = cw_context_get_frequency (session->context);
       format = _("%d HZ ");
       break;
     case CW_CMDV_VOLUME:
-      value = cw_get_volume ();
+      value = cw_context_get_volume (session->context);
       format = _("%d PERCENT ");
       break;
     case CW_CMDV_SPEED:
-      value = cw_get_send_speed ();
+      value = cw_context_get_send_speed (session->context);
       format = _("%d WPM ");
       break;
     case CW_CMDV_GAP:
-      value = cw_get_gap ();
+      value = cw_context_get_gap (session->context);
       format = _("%d DOTS ");
       break;
     case CW_CMDV_WEIGHTING:
-      value = cw_get_weighting ();
+      value = cw_context_get_weighting (session->context);
       format = _("%d PERCENT ");
       break;
     case CW_CMDV_ECHO:
-      value = config->do_echo;
+      value = session->do_echo;
       format = _("ECHO %s ");
       break;
     case CW_CMDV_ERRORS:
-      value = config->do_errors;
+      value = session->do_errors;
       format = _("ERRORS %s ");
       break;
     case CW_CMDV_COMMANDS:
-      value = config->do_commands;
+      value = session->do_commands;
       format = _("COMMANDS %s ");
       break;
     case CW_CMDV_COMBINATIONS:
-      value = config->do_combinations;
+      value = session->do_combinations;
       format = _("COMBINATIONS %s ");
       break;
     case CW_CMDV_COMMENTS:
-      value = config->do_comments;
+      value = session->do_comments;
       format = _("COMMENTS %s ");
       break;
     }
@@ -282,14 +370,14 @@ parse_stream_cwquery (FILE *stream)
     case CW_CMDV_SPEED:
     case CW_CMDV_GAP:
     case CW_CMDV_WEIGHTING:
-      write_to_cw_sender (format, value);
+      write_to_cw_sender (session, format, value);
       break;
     case CW_CMDV_ECHO:
     case CW_CMDV_ERRORS:
     case CW_CMDV_COMMANDS:
     case CW_CMDV_COMBINATIONS:
     case CW_CMDV_COMMENTS:
-      write_to_cw_sender (format, value ? _("ON") : _("OFF"));
+      write_to_cw_sender (session, format, value ? _("ON") : _("OFF"));
       break;
     }
 }
@@ -303,15 +391,15 @@ parse_stream_cwquery (FILE *stream)
  * in as the first argument.
  */
 static void
-parse_stream_parameter (int c, FILE *stream)
+parse_stream_parameter (cw_session_t *session, int c)
 {
   int value;
-  int (*value_handler) (int);
+  int (*value_handler) (cw_context_t *, int);
 
   /* Parse and check the new parameter value. */
-  if (fscanf (stream, "%d;", &value) != 1)
+  if (fscanf (session->input, "%d;", &value) != 1)
     {
-      write_to_message_stream ("%c%c", CW_STATUS_ERR, c);
+      write_to_message_stream (session, "%c%c", CW_STATUS_ERR, c);
       return;
     }
 
@@ -323,34 +411,41 @@ parse_stream_parameter (int c, FILE *stream)
     default:
       return;
     case CW_CMDV_FREQUENCY:
-      value_handler = cw_set_frequency;
+      value_handler = cw_context_set_frequency;
       break;
     case CW_CMDV_VOLUME:
-      value_handler = cw_set_volume;
+      /*
+       * Volume is applied when sound is generated, not when tones are
+       * queued.  When rendering to file, let the queue drain (which takes
+       * little time) so that the change lands where it is in the text.
+       */
+      if (config->render_output)
+        cw_context_wait_for_tone_queue (session->context);
+      value_handler = cw_context_set_volume;
       break;
     case CW_CMDV_SPEED:
-      value_handler = cw_set_send_speed;
+      value_handler = cw_context_set_send_speed;
       break;
     case CW_CMDV_GAP:
-      value_handler = cw_set_gap;
+      value_handler = cw_context_set_gap;
       break;
     case CW_CMDV_WEIGHTING:
-      value_handler = cw_set_weighting;
+      value_handler = cw_context_set_weighting;
       break;
     case CW_CMDV_ECHO:
-      config->do_echo = value;
+      session->do_echo = value;
       break;
     case CW_CMDV_ERRORS:
-      config->do_errors = value;
+      session->do_errors = value;
       break;
     case CW_CMDV_COMMANDS:
-      config->do_commands = value;
+      session->do_commands = value;
       break;
     case CW_CMDV_COMBINATIONS:
-      config->do_combinations = value;
+      session->do_combinations = value;
       break;
     case CW_CMDV_COMMENTS:
-      config->do_comments = value;
+      session->do_comments = value;
       break;
     }
 
@@ -360,15 +455,15 @@ parse_stream_parameter (int c, FILE *stream)
    */
   if (value_handler)
     {
-      if (!(*value_handler) (value))
+      if (!(*value_handler) (session->context, value))
         {
-          write_to_message_stream ("%c%c", CW_STATUS_ERR, c);
+          write_to_message_stream (session, "%c%c", CW_STATUS_ERR, c);
           return;
         }
     }
 
-  /* Confirm the new value with a stderr message. */
-  write_to_message_stream ("%c%c%d", CW_STATUS_OK, c, value);
+  /* Confirm the new value with a message. */
+  write_to_message_stream (session, "%c%c%d", CW_STATUS_OK, c, value);
 }
 
 
@@ -379,17 +474,17 @@ parse_stream_parameter (int c, FILE *stream)
  * character has already been read and recognized.
  */
 static void
-parse_stream_command (FILE *stream)
+parse_stream_command (cw_session_t *session)
 {
   int c;
 
-  c = toupper (getc_unlocked (stream));
+  c = toupper (getc_unlocked (session->input));
   switch (c)
     {
     case EOF:
       return;
     default:
-      write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_ESCAPE, c);
+      write_to_message_stream (session, "%c%c%c", CW_STATUS_ERR, CW_CMD_ESCAPE, c);
       return;
     case CW_CMDV_FREQUENCY:
     case CW_CMDV_VOLUME:
@@ -401,17 +496,23 @@ parse_stream_command (FILE *stream)
     case CW_CMDV_COMMANDS:
     case CW_CMDV_COMBINATIONS:
     case CW_CMDV_COMMENTS:
-      parse_stream_parameter (c, stream);
+      parse_stream_parameter (session, c);
       break;
     case CW_CMD_QUERY:
-      parse_stream_query (stream);
+      parse_stream_query (session);
       break;
     case CW_CMD_CWQUERY:
-      parse_stream_cwquery (stream);
+      parse_stream_cwquery (session);
       break;
     case CW_CMDV_QUIT:
-      cw_flush_tone_queue ();
-      write_to_echo_stream ("%c", '\n');
+      cw_context_flush_tone_queue (session->context);
+      write_to_echo_stream (session, "%c", '\n');
+      if (session->is_client)
+        {
+          /* Only the client's session ends, the server keeps running. */
+          session->is_quit = true;
+          return;
+        }
       exit (EXIT_SUCCESS);
     }
 }
@@ -429,43 +530,125 @@ parse_stream_command (FILE *stream)
  * character.
  */
 static void
-send_cw_character (int c, int is_partial)
+send_cw_character (cw_session_t *session, int c, int is_partial)
 {
   int character, status;
 
   /* Convert all whitespace into a single space. */
   character = isspace (c) ? ' ' : c;
 
+  if (session->is_bulk)
+    {
+      if (!is_partial && cw_character_is_valid (character))
+        {
+          /* Just collect the character, it will be sent with its run. */
+          session->run[session->run_len] = (char) character;
+          session->run_echo[session->run_len] = (char) c;
+          session->run_len++;
+          if (session->run_len == CW_BULK_RUN_SIZE)
+            flush_bulk_run (session);
+          return;
+        }
+
+      /*
+       * Keep order of sounds, echo and messages: send what has been collected
+       * so far before the partial or invalid character.
+       */
+      flush_bulk_run (session);
+      make_room_in_tone_queue (session);
+    }
+
   /* Send the character to the CW sender. */
-  status = is_partial ? cw_send_character_partial (character)
-                      : cw_send_character (character);
+  status = is_partial ? cw_context_send_character_partial (session->context, character)
+                      : cw_context_send_character (session->context, character);
   if (!status)
     {
-      if (errno != ENOENT)
+      /*
+       * Client's tone queue may be full (EAGAIN) if the client sends faster
+       * than the characters are played; report this to the client.
+       */
+      if (errno != ENOENT && !session->is_client)
         {
           perror ("cw_send_character[_partial]");
-          cw_flush_tone_queue ();
+          cw_context_flush_tone_queue (session->context);
           abort ();
         }
       else
         {
-          write_to_message_stream ("%c%c", CW_STATUS_ERR, character);
+          write_to_message_stream (session, "%c%c", CW_STATUS_ERR, character);
           return;
         }
     }
 
-  /* Wait for the character to complete. */
-  if (!cw_wait_for_tone_queue_critical (1))
+  /*
+   * Wait for the character to complete.  Client's characters are only
+   * queued, the server can't block on one of its clients.
+   */
+  if (!session->is_client && !session->is_bulk
+      && !cw_context_wait_for_tone_queue_critical (session->context, 1))
     {
       perror ("cw_wait_for_tone_queue_critical");
-      cw_flush_tone_queue ();
+      cw_context_flush_tone_queue (session->context);
       abort ();
     }
 
   /* Echo the original character after sending it. */
-  write_to_echo_stream ("%c", c);
+  write_to_echo_stream (session, "%c", c);
+
+
+}
 
 
+/*
+ * make_room_in_tone_queue()
+ *
+ * Bulk input: if the tone queue is more than half full, wait until the
+ * generator plays it down to a quarter of its capacity, so that the next
+ * run of characters fits in the queue.  Waiting for a low level of the queue
+ * instead of for each character keeps the count of wake-ups low.
+ */
+static void
+make_room_in_tone_queue (cw_session_t *session)
+{
+  const int capacity = cw_context_get_tone_queue_capacity (session->context);
+
+  if (cw_context_get_tone_queue_length (session->context) <= capacity / 2)
+    return;
+
+  if (!cw_context_wait_for_tone_queue_critical (session->context, capacity / 4))
+    {
+      perror ("cw_wait_for_tone_queue_critical");
+      cw_context_flush_tone_queue (session->context);
+      abort ();
+    }
+}
+
+
+/*
+ * flush_bulk_run()
+ *
+ * Bulk input: queue collected run of plain characters with a single call,
+ * and echo them.  The echo runs ahead of the sound.
+ */
+static void
+flush_bulk_run (cw_session_t *session)
+{
+  if (session->run_len == 0)
+    return;
+
+  session->run[session->run_len] = '\0';
+  session->run_echo[session->run_len] = '\0';
+  session->run_len = 0;
+
+  make_room_in_tone_queue (session);
+  if (!cw_context_send_string (session->context, session->run))
+    {
+      perror ("cw_send_string");
+      cw_context_flush_tone_queue (session->context);
+      abort ();
+    }
+
+  write_to_echo_stream (session, "%s", session->run_echo);
 }
 
 
@@ -476,10 +659,9 @@ send_cw_character (int c, int is_partial)
  * controls in them.  Returns on end of file.
  */
 static void
-parse_stream (FILE *stream)
+parse_stream (cw_session_t *session)
 {
   int c;
-  enum { NONE, COMBINATION, COMMENT, NESTED_COMMENT } state = NONE;
 
   /*
    * Cycle round states depending on input characters.  Comments may be
@@ -490,29 +672,37 @@ parse_stream (FILE *stream)
    * stdin in signal handler (to signal termination of the loop) won't be
    * possible: fclose() will just hang because stdin will be locked.
    */
-  for (c = getc_unlocked (stream); g_is_running && !feof (stream); c = getc_unlocked (stream))
+  for (c = getc_unlocked (session->input);
+       g_is_running && !session->is_quit && !feof (session->input);
+       c = getc_unlocked (session->input))
     {
-      switch (state)
+      switch (session->state)
         {
         case NONE:
           /*
            * Start a comment or combination, handle a command escape, or send
            * the character if none of these checks apply.
            */
-          if (config->do_comments && c == CW_COMMENT_START)
+          if (session->do_comments && c == CW_COMMENT_START)
             {
-              state = COMMENT;
-              write_to_echo_stream ("%c", c);
+              flush_bulk_run (session);
+              session->state = COMMENT;
+              write_to_echo_stream (session, "%c", c);
             }
-          else if (config->do_combinations && c == CW_COMBINATION_START)
+          else if (session->do_combinations && c == CW_COMBINATION_START)
             {
-              state = COMBINATION;
-              write_to_echo_stream ("%c", c);
+              flush_bulk_run (session);
+              session->state = COMBINATION;
+              write_to_echo_stream (session, "%c", c);
+            }
+          else if (session->do_commands && c == CW_CMD_ESCAPE)
+            {
+              /* Commands apply to characters that follow them. */
+              flush_bulk_run (session);
+              parse_stream_command (session);
             }
-          else if (config->do_commands && c == CW_CMD_ESCAPE)
-            parse_stream_command (stream);
           else
-            send_cw_character (c, false);
+            send_cw_character (session, c, false);
           break;
 
         case COMBINATION:
@@ -521,18 +711,22 @@ parse_stream (FILE *stream)
            * handle a command escape, or send the character if none of these
            * checks apply.
            */
-          if (config->do_comments && c == CW_COMMENT_START)
+          if (session->do_comments && c == CW_COMMENT_START)
             {
-              state = NESTED_COMMENT;
-              write_to_echo_stream ("%c", c);
+              session->state = NESTED_COMMENT;
+              write_to_echo_stream (session, "%c", c);
             }
           else if (c == CW_COMBINATION_END)
             {
-              state = NONE;
-              write_to_echo_stream ("%c", c);
+              flush_bulk_run (session);
+              session->state = NONE;
+              write_to_echo_stream (session, "%c", c);
+            }
+          else if (session->do_commands && c == CW_CMD_ESCAPE)
+            {
+              flush_bulk_run (session);
+              parse_stream_command (session);
             }
-          else if (config->do_commands && c == CW_CMD_ESCAPE)
-            parse_stream_command (stream);
           else
             {
               /*
@@ -542,9 +736,9 @@ parse_stream (FILE *stream)
                */
               int lookahead;
 
-              lookahead = getc_unlocked (stream);
-              ungetc (lookahead, stream);
-              send_cw_character (c, lookahead != CW_COMBINATION_END);
+              lookahead = getc_unlocked (session->input);
+              ungetc (lookahead, session->input);
+              send_cw_character (session, c, lookahead != CW_COMBINATION_END);
             }
           break;
 
@@ -556,14 +750,526 @@ parse_stream (FILE *stream)
            * comment and comment end seen, reset state.
            */
           if (c == CW_COMMENT_END)
-            state = (state == NESTED_COMMENT) ? COMBINATION : NONE;
-          write_to_echo_stream ("%c", c);
+            session->state = (session->state == NESTED_COMMENT) ? COMBINATION : NONE;
+          write_to_echo_stream (session, "%c", c);
           break;
         }
     }
+
+  /* Queue what is left of the last run. */
+  flush_bulk_run (session);
+}
+
+
+
+
+/*
+ * session_init()
+ *
+ * Prepare state of parsing of a stream, with flags taken from program's
+ * configuration.
+ */
+static void
+session_init (cw_session_t *session, cw_context_t *context,
+              FILE *input, FILE *echo_stream, FILE *message_stream)
+{
+  memset (session, 0, sizeof (*session));
+
+  session->context = context;
+  session->input = input;
+  session->echo_stream = echo_stream;
+  session->message_stream = message_stream;
+
+  session->do_echo = config->do_echo;
+  session->do_errors = config->do_errors;
+  session->do_commands = config->do_commands;
+  session->do_combinations = config->do_combinations;
+  session->do_comments = config->do_comments;
+
+  session->state = NONE;
+}
+
+
+
+
+/*---------------------------------------------------------------------*/
+/*  Server mode                                                        */
+/*---------------------------------------------------------------------*/
+
+#if defined(__linux__)
+
+
+enum {
+	/* Maximal count of clients served at the same time. */
+	CW_SERVER_CLIENTS_MAX = 64,
+
+	/* Input from client is parsed line by line. Longer lines are
+	   parsed in chunks of this size. */
+	CW_SERVER_LINE_SIZE = 1024,
+
+	/* Period of checking whether disconnected clients have
+	   finished playing their tones [ms]. */
+	CW_SERVER_DRAIN_PERIOD = 100
+};
+
+
+/* Connection from one client, with generator of its own. */
+typedef struct {
+	int fd;
+	FILE *output;       /* Echo and messages sent back to client. */
+	cw_session_t session;
+
+	char line[CW_SERVER_LINE_SIZE];
+	size_t line_len;
+
+	/* Client has disconnected, but its generator is still playing
+	   queued characters. */
+	bool is_draining;
+} cw_client_t;
+
+
+static cw_client_t *g_clients[CW_SERVER_CLIENTS_MAX];
+
+
+static int server_open_listener(const char *address, bool *is_unix);
+static void server_accept_client(int epoll_fd, int listen_fd);
+static void server_read_client(int epoll_fd, cw_client_t *client);
+static void server_parse_line(cw_client_t *client, size_t len);
+static int server_drain_clients(void);
+static void client_delete(int epoll_fd, cw_client_t **client);
+static int client_context_apply_config(cw_context_t *context);
+
+
+
+
+/**
+   \brief Open listening socket for given address
+
+   \p address is a path of Unix socket if it contains '/', otherwise it
+   is [HOST:]PORT of TCP socket. Default HOST is "localhost", use e.g.
+   "0.0.0.0:PORT" to accept connections from other machines.
+
+   \param address - address to listen on
+   \param is_unix - [out] is the socket a Unix socket?
+
+   \return file descriptor of listening socket on success
+   \return -1 on failure
+*/
+int server_open_listener(const char *address, bool *is_unix)
+{
+	*is_unix = NULL != strchr(address, '/');
+
+	if (*is_unix) {
+		struct sockaddr_un sun;
+		memset(&sun, 0, sizeof (sun));
+		sun.sun_family = AF_UNIX;
+		if (strlen(address) >= sizeof (sun.sun_path)) {
+			fprintf(stderr, _("%s: path of Unix socket is too long: %s\n"), config->program_name, address);
+			return -1;
+		}
+		snprintf(sun.sun_path, sizeof (sun.sun_path), "%s", address);
+
+		/* Remove stale socket left by previous instance of the server. */
+		struct stat st;
+		if (0 == stat(address, &st) && S_ISSOCK(st.st_mode)) {
+			unlink(address);
+		}
+
+		const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			fprintf(stderr, _("%s: socket(): %s\n"), config->program_name, strerror(errno));
+			return -1;
+		}
+		if (0 != bind(fd, (struct sockaddr *) &sun, sizeof (sun)) || 0 != listen(fd, 16)) {
+			fprintf(stderr, _("%s: can't listen on %s: %s\n"), config->program_name, address, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+
+	char host[256] = "localhost";
+	const char *port = strrchr(address, ':');
+	if (NULL != port) {
+		const size_t host_len = (size_t) (port - address);
+		if (host_len >= sizeof (host)) {
+			fprintf(stderr, _("%s: host name is too long: %s\n"), config->program_name, address);
+			return -1;
+		}
+		memcpy(host, address, host_len);
+		host[host_len] = '\0';
+		port++;
+	} else {
+		port = address;
+	}
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *result = NULL;
+	const int rv = getaddrinfo('\0' == host[0] ? NULL : host, port, &hints, &result);
+	if (0 != rv) {
+		fprintf(stderr, _("%s: can't resolve %s: %s\n"), config->program_name, address, gai_strerror(rv));
+		return -1;
+	}
+
+	int fd = -1;
+	for (struct addrinfo *ai = result; NULL != ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		const int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+		if (0 == bind(fd, ai->ai_addr, ai->ai_addrlen) && 0 == listen(fd, 16)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+
+	if (fd < 0) {
+		fprintf(stderr, _("%s: can't listen on %s: %s\n"), config->program_name, address, strerror(errno));
+	}
+	return fd;
+}
+
+
+
+
+/**
+   \brief Set parameters of client's generator from program's configuration
+*/
+int client_context_apply_config(cw_context_t *context)
+{
+	if (!cw_context_set_frequency(context, config->frequency)
+	    || !cw_context_set_volume(context, config->volume)
+	    || !cw_context_set_send_speed(context, config->send_speed)
+	    || !cw_context_set_gap(context, config->gap)
+	    || !cw_context_set_weighting(context, config->weighting)) {
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   \brief Accept new connection, and create a generator for it
+*/
+void server_accept_client(int epoll_fd, int listen_fd)
+{
+	const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			fprintf(stderr, _("%s: accept(): %s\n"), config->program_name, strerror(errno));
+		}
+		return;
+	}
+
+	int slot = -1;
+	for (int i = 0; i < CW_SERVER_CLIENTS_MAX; i++) {
+		if (NULL == g_clients[i]) {
+			slot = i;
+			break;
+		}
+	}
+	if (slot < 0) {
+		fprintf(stderr, _("%s: too many clients, rejecting connection\n"), config->program_name);
+		close(fd);
+		return;
+	}
+
+	cw_client_t *client = calloc(1, sizeof (cw_client_t));
+	if (NULL == client) {
+		close(fd);
+		return;
+	}
+	client->fd = fd;
+
+	/* Output stream has its own descriptor, so that closing the
+	   stream doesn't close the socket behind the back of the loop. */
+	const int output_fd = dup(fd);
+	client->output = output_fd < 0 ? NULL : fdopen(output_fd, "w");
+	if (NULL == client->output) {
+		if (output_fd >= 0) {
+			close(output_fd);
+		}
+		close(fd);
+		free(client);
+		return;
+	}
+
+	cw_context_t *context = cw_context_new();
+	const char *device = '\0' == config->gen_conf.sound_device[0] ? NULL : config->gen_conf.sound_device;
+	if (NULL == context
+	    || !cw_context_generator_new(context, config->gen_conf.sound_system, device)
+	    || !client_context_apply_config(context)
+	    || !cw_context_generator_start(context)) {
+
+		fprintf(stderr, _("%s: failed to create generator for new client\n"), config->program_name);
+		fprintf(client->output, "%c\n", CW_STATUS_ERR);
+		cw_context_delete(&context);
+		fclose(client->output);
+		close(fd);
+		free(client);
+		return;
+	}
+	session_init(&client->session, context, NULL, client->output, client->output);
+	client->session.is_client = true;
+
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+	if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+		fprintf(stderr, _("%s: epoll_ctl(): %s\n"), config->program_name, strerror(errno));
+		client_delete(-1, &client);
+		return;
+	}
+
+	g_clients[slot] = client;
+	return;
+}
+
+
+
+
+/**
+   \brief Parse first \p len bytes of client's line buffer
+*/
+void server_parse_line(cw_client_t *client, size_t len)
+{
+	/* Let the existing stream parser read the line as if it was a
+	   file. */
+	FILE *input = fmemopen(client->line, len, "r");
+	if (NULL == input) {
+		return;
+	}
+	client->session.input = input;
+	parse_stream(&client->session);
+	client->session.input = NULL;
+	fclose(input);
+
+	/* Errors of writing to client (e.g. full socket buffer) are not
+	   fatal, the client just misses some echo or messages. */
+	clearerr(client->output);
+
+	memmove(client->line, client->line + len, client->line_len - len);
+	client->line_len -= len;
+	return;
+}
+
+
+
+
+/**
+   \brief Read data available on client's connection, and parse complete lines
+*/
+void server_read_client(int epoll_fd, cw_client_t *client)
+{
+	bool is_eof = false;
+
+	while (!client->session.is_quit) {
+		const ssize_t n = read(client->fd, client->line + client->line_len, sizeof (client->line) - client->line_len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN) {
+				is_eof = true;
+			}
+			break;
+		} else if (n == 0) {
+			is_eof = true;
+			break;
+		}
+		client->line_len += (size_t) n;
+
+		/* Parse all complete lines, or the whole buffer if it
+		   is full and still has no end of line. */
+		for (;;) {
+			const char *eol = memchr(client->line, '\n', client->line_len);
+			if (NULL != eol) {
+				server_parse_line(client, (size_t) (eol - client->line) + 1);
+			} else if (client->line_len == sizeof (client->line)) {
+				server_parse_line(client, client->line_len);
+			} else {
+				break;
+			}
+			if (client->session.is_quit) {
+				break;
+			}
+		}
+	}
+
+	if (client->session.is_quit) {
+		/* Quit command has already flushed client's tone queue. */
+		client_delete(epoll_fd, &client);
+
+	} else if (is_eof) {
+		/* Last line of input doesn't have to end with end of line. */
+		if (client->line_len > 0) {
+			server_parse_line(client, client->line_len);
+		}
+
+		/* Let the generator play what the client has sent before
+		   disconnecting. */
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+		close(client->fd);
+		client->fd = -1;
+		client->is_draining = true;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Delete clients that have disconnected and whose tone queues are empty
+
+   \return count of clients that are still draining their tone queues
+*/
+int server_drain_clients(void)
+{
+	int n_draining = 0;
+	for (int i = 0; i < CW_SERVER_CLIENTS_MAX; i++) {
+		if (NULL == g_clients[i] || !g_clients[i]->is_draining) {
+			continue;
+		}
+		if (cw_context_is_tone_busy(g_clients[i]->session.context)) {
+			n_draining++;
+		} else {
+			client_delete(-1, &g_clients[i]);
+		}
+	}
+	return n_draining;
+}
+
+
+
+
+/**
+   \brief Close client's connection, delete its generator and free the client
+*/
+void client_delete(int epoll_fd, cw_client_t **client)
+{
+	/* \p client may point to slot in g_clients that is cleared below. */
+	cw_client_t *deleted = *client;
+	*client = NULL;
+
+	for (int i = 0; i < CW_SERVER_CLIENTS_MAX; i++) {
+		if (g_clients[i] == deleted) {
+			g_clients[i] = NULL;
+		}
+	}
+
+	if (deleted->fd >= 0) {
+		if (epoll_fd >= 0) {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, deleted->fd, NULL);
+		}
+		close(deleted->fd);
+	}
+	fclose(deleted->output);
+
+	cw_context_t *context = deleted->session.context;
+	cw_context_delete(&context);
+
+	free(deleted);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Serve clients connecting to given address, until a signal is received
+
+   Each client has its own generator, and its own copy of flags
+   controlling echo, messages, commands, combinations and comments.
+   Echo and messages are sent back to the client.
+
+   \param address - address to listen on, see server_open_listener()
+
+   \return EXIT_SUCCESS or EXIT_FAILURE
+*/
+int server_run(const char *address)
+{
+	bool is_unix = false;
+	const int listen_fd = server_open_listener(address, &is_unix);
+	if (listen_fd < 0) {
+		return EXIT_FAILURE;
+	}
+
+	const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	g_server_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epoll_fd < 0 || g_server_wakeup_fd < 0) {
+		fprintf(stderr, _("%s: can't set up event loop: %s\n"), config->program_name, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, g_server_wakeup_fd, &event);
+	event.data.ptr = &g_clients; /* Marker of listening socket. */
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+	int n_draining = 0;
+	while (g_is_running) {
+		struct epoll_event events[16];
+		const int n = epoll_wait(epoll_fd, events, sizeof (events) / sizeof (events[0]),
+					 n_draining > 0 ? CW_SERVER_DRAIN_PERIOD : -1);
+		if (n < 0 && errno != EINTR) {
+			fprintf(stderr, _("%s: epoll_wait(): %s\n"), config->program_name, strerror(errno));
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if (NULL == events[i].data.ptr) {
+				/* Woken up by signal handler. */
+				continue;
+			} else if (&g_clients == events[i].data.ptr) {
+				server_accept_client(epoll_fd, listen_fd);
+			} else {
+				server_read_client(epoll_fd, (cw_client_t *) events[i].data.ptr);
+			}
+		}
+
+		n_draining = server_drain_clients();
+	}
+
+	for (int i = 0; i < CW_SERVER_CLIENTS_MAX; i++) {
+		if (NULL != g_clients[i]) {
+			client_delete(epoll_fd, &g_clients[i]);
+		}
+	}
+	close(listen_fd);
+	if (is_unix) {
+		unlink(address);
+	}
+	close(epoll_fd);
+
+	return EXIT_SUCCESS;
 }
 
 
+#else /* #if defined(__linux__) */
+
+
+int server_run(__attribute__((unused)) const char *address)
+{
+	fprintf(stderr, _("%s: server mode is not supported on this platform\n"), config->program_name);
+	return EXIT_FAILURE;
+}
+
+
+#endif /* #if defined(__linux__) */
+
+
 
 
 static void signal_handler(int signal_number)
@@ -574,6 +1280,15 @@ static void signal_handler(int signal_number)
 	   loop. Ultimately this will lead to exiting of program. */
 	g_is_running = false;
 
+	if (g_server_wakeup_fd >= 0) {
+		/* In server mode the loop is waiting in epoll_wait(). */
+		const uint64_t one = 1;
+		if (write(g_server_wakeup_fd, &one, sizeof (one)) < 0) {
+			; /* Nothing to do in signal handler. */
+		}
+		return;
+	}
+
 	/* This is needed because if initially there are no characters
 	   available to consume by fgetc() in parse_stream(), the
 	   'for' loop in that function will be stuck at initial
@@ -588,6 +1303,9 @@ static void signal_handler(int signal_number)
 /**
    \brief Parse command line args, then produce CW output until end of file
 
+   In server mode (--server option) serve clients until a signal is
+   received.
+
    \param argc
    \param argv
 */
@@ -649,22 +1367,61 @@ int main (int argc, char *const argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (config->server_address) {
+		/* The generator has served its purpose of picking a
+		   working sound system and device. Each client will
+		   get a generator of its own. */
+		cw_generator_delete();
+		generator = false;
+
+		/* Disconnected client must not terminate the server. */
+		signal(SIGPIPE, SIG_IGN);
+	}
+
 	/* Set up signal handlers to exit on a range of signals. */
 	static const int SIGNALS[] = { SIGHUP, SIGINT, SIGQUIT, SIGPIPE, SIGTERM, 0 };
 	for (int i = 0; SIGNALS[i]; i++) {
+		if (SIGNALS[i] == SIGPIPE && config->server_address) {
+			continue;
+		}
 		if (!cw_register_signal_handler(SIGNALS[i], signal_handler)) {
 			fprintf(stderr, _("%s: can't register signal: %s\n"), config->program_name, strerror(errno));
 			return EXIT_FAILURE;
 		}
 	}
 
+	if (config->server_address) {
+		g_is_running = true;
+		return server_run(config->server_address);
+	}
+
 	/* Start producing sine wave (amplitude of the wave will be
 	   zero as long as there are no characters to process). */
 	cw_generator_start();
 	g_is_running = true;
 
+	/* Samples written to stdout must not be mixed with echo. */
+	FILE *echo_stream = stdout;
+	if (config->gen_conf.sound_system == CW_AUDIO_FILE
+	    && 0 == strcmp(config->gen_conf.sound_device, "-")) {
+		echo_stream = stderr;
+	}
+
 	/* Send stdin stream to CW parsing. */
-	parse_stream(stdin);
+	cw_session_t session;
+	session_init(&session, cw_context_get_default(), stdin, echo_stream, stderr);
+	if (config->bulk_input) {
+		/* Read input in large chunks. */
+		setvbuf(stdin, NULL, _IOFBF, CW_BULK_INPUT_BUFFER_SIZE);
+		session.is_bulk = true;
+	}
+	parse_stream(&session);
+
+	/* In bulk mode the queue may still hold a lot of text, don't
+	   make user listen to all of it after interrupting the program. */
+	if (session.is_bulk && !g_is_running) {
+		cw_flush_tone_queue();
+	}
 
 	/* Await final tone completion before exiting. */
 	cw_wait_for_tone_queue();
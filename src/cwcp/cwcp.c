@@ -21,15 +21,20 @@
 
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include <limits.h>
 #include <ctype.h>
 #include <curses.h>
 #include <errno.h>
+#include <pthread.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -45,6 +50,8 @@
 #include "cw_copyright.h"
 #include "dictionary.h"
 #include "memory.h"
+#include "cw_pileup.h"
+#include "cw_practice.h"
 
 
 
@@ -61,6 +68,9 @@ static bool do_colors = true;
 static bool beginning_of_buffer = true;
 /* Current sending state, active or idle. */
 static bool is_sending_active = false;
+/* Practice text of current dictionary mode, generated ahead of time
+   by background thread. */
+static cw_practice_t *g_practice = NULL;
 
 
 /* Width of parameter windows, displayed at the bottom of window.
@@ -69,6 +79,21 @@ static bool is_sending_active = false;
  */
 #define CWCP_PARAM_WIDTH (15 + 1)
 
+/* Period of updates of screen [us]: changes of windows are sent to
+   terminal at most 30 times per second. */
+enum { CWCP_FRAME_PERIOD = 1000000 / 30 };
+
+/* Period of polling in main loop [us], used only when there is no
+   descriptor to wait on: for libcw's tone queue if its descriptor is
+   not available, and for pileup. At 60WPM, a dot is 20ms, so polling
+   for the maximum library speed needs a 10ms (10,000usec) period. */
+enum { CWCP_POLL_PERIOD = 10000 };
+
+/* Descriptors waited on in main loop together with stdin, -1 if not
+   available. */
+static int g_signal_fd = -1; /* Termination signals. */
+static int g_timer_fd = -1;  /* Ticks every minute of practice. */
+
 
 static cw_config_t *config = NULL; /* program-specific configuration */
 static bool generator = false;     /* have we created a generator? */
@@ -84,12 +109,19 @@ static WINDOW *screen  = NULL,
 	*gap_window    = NULL, *gap_subwindow    = NULL,
 	*timer_window  = NULL, *timer_subwindow  = NULL;
 
+/* Changes of windows waiting to be sent to terminal. */
+static struct {
+	bool is_pending;
+	struct timespec last; /* Time of last update of screen. */
+} g_screen_update = { .is_pending = false, .last = { 0, 0 } };
+
 static void cwcp_atexit(void);
 
 static int  timer_get_total_practice_time(void);
 static bool timer_set_total_practice_time(int practice_time);
 static void timer_start(void);
 static bool timer_is_expired(void);
+static void timer_handle_tick(void);
 static void timer_window_update(int elapsed, int total);
 
 static void speed_update(void);
@@ -98,7 +130,7 @@ static void volume_update(void);
 static void gap_update(void);
 
 
-typedef enum { M_DICTIONARY, M_KEYBOARD, M_EXIT } mode_type_t;
+typedef enum { M_DICTIONARY, M_KEYBOARD, M_PILEUP, M_EXIT } mode_type_t;
 
 static void mode_initialize(void);
 static void mode_clean(void);
@@ -116,7 +148,7 @@ static bool mode_is_sending_active(void);
    dictionary, and data on how to send for the mode. */
 struct mode_s {
 	const char *description;       /* Text mode description */
-	mode_type_t type;              /* Mode type; {M_DICTIONARY|M_KEYBOARD|M_EXIT} */
+	mode_type_t type;              /* Mode type; {M_DICTIONARY|M_KEYBOARD|M_PILEUP|M_EXIT} */
 	const cw_dictionary_t *dict;   /* Dictionary, if type is dictionary */
 };
 
@@ -144,10 +176,18 @@ static void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning_
 static void queue_transfer_character_to_libcw(void);
 static void queue_delete_character(void);
 
+static bool pileup_start(void);
+static void pileup_stop(void);
+static void pileup_poll(void);
+static void pileup_keying_callback(void *arg, int key_state);
+
 static void ui_refresh_main_window(void);
+static void ui_mark_for_update(WINDOW *window);
+static void ui_update_screen(bool is_forced);
 static void ui_display_state(const char *state);
 static void ui_clear_main_window(void);
-static void ui_poll_user_input(int fd, int usecs);
+static bool ui_poll_user_input(int fd);
+static int  ui_get_screen_update_timeout(void);
 static void ui_update_mode_selection(int old_mode, int current_mode);
 static void ui_handle_event(int c);
 
@@ -157,6 +197,7 @@ static WINDOW *ui_init_window(int lines, int columns, int begin_y, int begin_x,
 static void    ui_init_display(int lines, int columns, int begin_y, int begin_x, const char *header, WINDOW **window, WINDOW **subwindow);
 static WINDOW *ui_init_screen(void);
 
+static bool signals_initialize(const int *signals);
 static void signal_handler(int signal_number);
 
 static void state_change_to_active(void);
@@ -229,7 +270,7 @@ void queue_display_add_character(void)
 	/* Append the last queued character to the text display. */
 	if (queue_get_length() > 0) {
 		waddch(text_subwindow, toupper(queue_data[queue_tail]));
-		wrefresh(text_subwindow);
+		ui_mark_for_update(text_subwindow);
 	}
 
 	return;
@@ -263,7 +304,7 @@ void queue_display_delete_character(void)
 		wmove(text_subwindow, y, x);
 		waddch(text_subwindow, ' ');
 		wmove(text_subwindow, y, x);
-		wrefresh(text_subwindow);
+		ui_mark_for_update(text_subwindow);
 	}
 
 	return;
@@ -304,7 +345,7 @@ void queue_display_highlight_character(bool is_highlight)
 		       is_highlight ? winch(text_subwindow) | A_REVERSE
 			: winch(text_subwindow) & ~A_REVERSE);
 		wmove(text_subwindow, saved_y, saved_x);
-		wrefresh(text_subwindow);
+		ui_mark_for_update(text_subwindow);
 	}
 
 	return;
@@ -483,6 +524,14 @@ void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning)
 		queue_enqueue_character(' ');
 	}
 
+	if (g_practice && cw_practice_get_dictionary(g_practice) == mode->dict) {
+		/* Ready-made group, no waiting for dictionary. */
+		char group[CW_PRACTICE_GROUP_SIZE];
+		cw_practice_get_group(g_practice, group, sizeof (group));
+		queue_enqueue_string(group);
+		return;
+	}
+
 	/* Size of group of letters that will be printed together
 	   to main window of cwcp. '1' for dictionaries consisting
 	   of multi-character words (so you get single words separated
@@ -539,7 +588,8 @@ void queue_transfer_character_to_libcw(void)
 	}
 
 	if (g_current_mode->type == M_DICTIONARY
-	    || g_current_mode->type == M_KEYBOARD) {
+	    || g_current_mode->type == M_KEYBOARD
+	    || g_current_mode->type == M_PILEUP) {
 
 		queue_dequeue_character();
 	}
@@ -551,6 +601,160 @@ void queue_transfer_character_to_libcw(void)
 
 
 
+/*---------------------------------------------------------------------*/
+/*  Pileup                                                             */
+/*---------------------------------------------------------------------*/
+
+/* Stations of pileup are played by libcw's mixer, and react to
+   operator's keying received through the keying callback of the
+   generator. */
+static cw_pileup_t *g_pileup = NULL;
+static int g_pileup_n_worked = 0;
+/* Keying callback is called by generator's thread: protect the
+   pointer to pileup from being deleted under the callback's feet. */
+static pthread_mutex_t g_pileup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Callsigns drawn from dictionary of callsigns. */
+enum { PILEUP_CALLSIGNS_MAX = 200 };
+static const char *g_pileup_callsigns[PILEUP_CALLSIGNS_MAX];
+
+
+
+
+
+/**
+   \brief Create and start pileup
+
+   Callsigns of stations are taken from dictionary described as
+   "Callsigns" (e.g. loaded with -f option), or from built-in list of
+   callsigns if there is no such dictionary. Speeds of stations are
+   close to current sending speed.
+
+   \return true if pileup has been started
+   \return false otherwise
+*/
+bool pileup_start(void)
+{
+	cw_pileup_config_t conf;
+	cw_pileup_config_init(&conf);
+
+	for (const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	     dict;
+	     dict = cw_dictionaries_iterate(dict)) {
+
+		if (0 == strcasecmp(cw_dictionary_get_description(dict), "Callsigns")) {
+			for (int i = 0; i < PILEUP_CALLSIGNS_MAX; i++) {
+				g_pileup_callsigns[i] = cw_dictionary_get_random_word(dict);
+			}
+			conf.callsigns = g_pileup_callsigns;
+			conf.n_callsigns = PILEUP_CALLSIGNS_MAX;
+			break;
+		}
+	}
+
+	const int speed = cw_get_send_speed();
+	conf.operator_speed = speed;
+	conf.speed_min = speed - 4 < CW_SPEED_MIN ? CW_SPEED_MIN : speed - 4;
+	conf.speed_max = speed + 6 > CW_SPEED_MAX ? CW_SPEED_MAX : speed + 6;
+
+	cw_pileup_t *pileup = cw_pileup_new(&config->gen_conf, &conf);
+	if (!pileup) {
+		return false;
+	}
+	if (CW_SUCCESS != cw_pileup_start(pileup)) {
+		cw_pileup_delete(&pileup);
+		return false;
+	}
+	cw_pileup_cq(pileup, cw_pileup_now());
+	g_pileup_n_worked = 0;
+
+	pthread_mutex_lock(&g_pileup_mutex);
+	g_pileup = pileup;
+	pthread_mutex_unlock(&g_pileup_mutex);
+	cw_register_keying_callback(pileup_keying_callback, NULL);
+
+	return true;
+}
+
+
+
+
+
+/**
+   \brief Stop and delete pileup, if it exists
+*/
+void pileup_stop(void)
+{
+	if (!g_pileup) {
+		return;
+	}
+
+	cw_register_keying_callback(NULL, NULL);
+
+	pthread_mutex_lock(&g_pileup_mutex);
+	cw_pileup_t *pileup = g_pileup;
+	g_pileup = NULL;
+	pthread_mutex_unlock(&g_pileup_mutex);
+
+	cw_pileup_stop(pileup);
+	cw_pileup_delete(&pileup);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Let stations of pileup react to operator
+
+   Display count of worked stations when it changes.
+*/
+void pileup_poll(void)
+{
+	if (!g_pileup) {
+		return;
+	}
+
+	cw_pileup_poll(g_pileup, cw_pileup_now(), NULL, 0);
+
+	const int n_worked = cw_pileup_get_n_worked(g_pileup);
+	if (n_worked != g_pileup_n_worked) {
+		g_pileup_n_worked = n_worked;
+
+		char state[64];
+		snprintf(state, sizeof (state), _("Worked: %d(F9 or Esc to exit)"), n_worked);
+		ui_display_state(state);
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Pass state of operator's key to pileup
+
+   Called by libcw's generator, see cw_register_keying_callback().
+*/
+void pileup_keying_callback(__attribute__((unused)) void *arg, int key_state)
+{
+	pthread_mutex_lock(&g_pileup_mutex);
+	if (g_pileup) {
+		cw_pileup_key_event(g_pileup, CW_KEY_STATE_CLOSED == key_state, cw_pileup_now());
+	}
+	pthread_mutex_unlock(&g_pileup_mutex);
+
+	return;
+}
+
+
+
+
+
 /*---------------------------------------------------------------------*/
 /*  Practice timer                                                     */
 /*---------------------------------------------------------------------*/
@@ -605,6 +809,14 @@ bool timer_set_total_practice_time(int practice_time)
 void timer_start(void)
 {
 	timer_practice_start = time(NULL);
+
+	/* Wake up main loop every minute of practice, to update
+	   timer's display and to stop on expiry. */
+	if (-1 != g_timer_fd) {
+		const struct itimerspec spec = { .it_interval = { .tv_sec = 60 }, .it_value = { .tv_sec = 60 } };
+		timerfd_settime(g_timer_fd, 0, &spec, NULL);
+	}
+
 	return;
 }
 
@@ -632,6 +844,34 @@ bool timer_is_expired(void)
 
 
 
+/**
+   \brief Handle a minute of practice time
+
+   Called when descriptor of practice timer ticks. Without the
+   descriptor, the timer is checked only when libcw's tone queue needs
+   more characters, see queue_transfer_character_to_libcw().
+*/
+void timer_handle_tick(void)
+{
+	uint64_t expirations = 0;
+	if (sizeof (expirations) != read(g_timer_fd, &expirations, sizeof (expirations))) {
+		return;
+	}
+
+	if (is_sending_active
+	    && g_current_mode->type == M_DICTIONARY
+	    && timer_is_expired()) {
+
+		state_change_to_idle();
+	}
+
+	return;
+}
+
+
+
+
+
 /**
    \brief Update value of time spent on practicing
 
@@ -647,14 +887,24 @@ bool timer_is_expired(void)
 void timer_window_update(int elapsed, int total)
 {
 	static int el = 0;
+	static int displayed_el = -1;
+	static int displayed_total = -1;
 	if (elapsed >= 0) {
 		el = elapsed;
 	}
 
+	/* The function is called on every poll of the sender, but the
+	   values change only once a minute. */
+	if (el == displayed_el && total == displayed_total) {
+		return;
+	}
+	displayed_el = el;
+	displayed_total = total;
+
 	char buffer[CWCP_PARAM_WIDTH];
 	snprintf(buffer, CWCP_PARAM_WIDTH, total == 1 ? _("%2d/%2d min ") : _("%2d/%2d mins"), el, total);
 	mvwaddstr(timer_subwindow, 0, 2, buffer);
-	wrefresh(timer_subwindow);
+	ui_mark_for_update(timer_subwindow);
 
 	return;
 }
@@ -697,12 +947,16 @@ void mode_initialize(void)
 		modes[count++].dict = dict;
 	}
 
-	/* Add keyboard, exit, and null sentinel. */
-	modes = safe_realloc(modes, sizeof (*modes) * (count + 3));
+	/* Add keyboard, pileup, exit, and null sentinel. */
+	modes = safe_realloc(modes, sizeof (*modes) * (count + 4));
 	modes[count].description = _("Keyboard");
 	modes[count].type = M_KEYBOARD;
 	modes[count++].dict = NULL;
 
+	modes[count].description = _("Pileup");
+	modes[count].type = M_PILEUP;
+	modes[count++].dict = NULL;
+
 	modes[count].description = _("Exit (F12)");
 	modes[count].type = M_EXIT;
 	modes[count++].dict = NULL;
@@ -841,6 +1095,11 @@ void state_change_to_active(void)
 		return;
 	}
 
+	if (g_current_mode->type == M_PILEUP && !pileup_start()) {
+		ui_display_state(_("Can't start pileup(F9)"));
+		return;
+	}
+
 	cw_start_beep();
 
 	is_sending_active = true;
@@ -851,6 +1110,13 @@ void state_change_to_active(void)
 		ui_clear_main_window();
 		timer_start();
 
+		/* Start generating practice text of the mode before it
+		   is needed. */
+		cw_practice_delete(&g_practice);
+		if (g_current_mode->type == M_DICTIONARY) {
+			g_practice = cw_practice_new(g_current_mode->dict);
+		}
+
 		/* Don't allow a space at the beginning of buffer. */
 		beginning_of_buffer = true;
 
@@ -879,12 +1145,13 @@ void state_change_to_idle(void)
 
 	ui_display_state(_("Start(F9)"));
 	touchwin(text_subwindow);
-	wnoutrefresh(text_subwindow);
-	doupdate();
+	ui_mark_for_update(text_subwindow);
 
 	/* Remove everything in the outgoing character queue. */
 	queue_discard_contents();
 
+	pileup_stop();
+
 	cw_end_beep();
 
 	return;
@@ -1122,7 +1389,8 @@ void ui_initialize(void)
 	}
 	wrefresh(text_subwindow);
 	idlok(text_subwindow, true);
-	immedok(text_subwindow, true);
+	/* No immedok(): changes are collected and sent to terminal in
+	   frames, see ui_update_screen(). */
 	scrollok(text_subwindow, true);
 
 	int lines = 3;
@@ -1453,7 +1721,7 @@ void speed_update(void)
 	char buffer[CWCP_PARAM_WIDTH];
 	snprintf(buffer, CWCP_PARAM_WIDTH, _("%2d WPM"), cw_get_send_speed());
 	mvwaddstr(speed_subwindow, 0, 4, buffer);
-	wrefresh(speed_subwindow);
+	ui_mark_for_update(speed_subwindow);
 	return;
 }
 
@@ -1466,7 +1734,7 @@ void frequency_update(void)
 	char buffer[CWCP_PARAM_WIDTH];
 	snprintf(buffer, CWCP_PARAM_WIDTH, _("%4d Hz"), cw_get_frequency());
 	mvwaddstr(tone_subwindow, 0, 3, buffer);
-	wrefresh(tone_subwindow);
+	ui_mark_for_update(tone_subwindow);
 	return;
 }
 
@@ -1479,7 +1747,7 @@ void volume_update(void)
 	char buffer[CWCP_PARAM_WIDTH];
 	snprintf(buffer, CWCP_PARAM_WIDTH, _("%3d %%"), cw_get_volume());
 	mvwaddstr(volume_subwindow, 0, 4, buffer);
-	wrefresh(volume_subwindow);
+	ui_mark_for_update(volume_subwindow);
 	return;
 }
 
@@ -1493,7 +1761,7 @@ void gap_update(void)
 	int value = cw_get_gap();
 	snprintf(buffer, CWCP_PARAM_WIDTH, value == 1 ? _("%2d dot ") : _("%2d dots"), value);
 	mvwaddstr(gap_subwindow, 0, 3, buffer);
-	wrefresh(gap_subwindow);
+	ui_mark_for_update(gap_subwindow);
 	return;
 }
 
@@ -1518,7 +1786,8 @@ void ui_handle_event(int c)
 	   the current sending mode is from the keyboard, then make an
 	   effort to either queue the character for sending, or delete
 	   the most recently queued. */
-	if (mode_is_sending_active() && mode_current_is_type(M_KEYBOARD)) {
+	if (mode_is_sending_active()
+	    && (mode_current_is_type(M_KEYBOARD) || mode_current_is_type(M_PILEUP))) {
 		if (c == KEY_BACKSPACE || c == KEY_DC) {
 			queue_delete_character();
 			return;
@@ -1538,44 +1807,174 @@ void ui_handle_event(int c)
 
 
 /**
-   \brief Check for keyboard input from user
+   \brief Wait for keyboard input from user
+
+   Sleeps in one poll() over \p fd and descriptors of other events
+   that need handling in the meantime: low level of libcw's tone
+   queue, minute of practice, and termination signals. Returns when
+   data is available to getch(), so that it will not block, or when
+   the program should terminate.
 
-   Calls our sender polling function at regular intervals, and returns only
-   when data is available to getch(), so that it will not block.
+   On every wakeup check if we need to update queue of elements to
+   play/display, and if so, do update the queue.
 
-   Opportunistically on every poll check if we need to update queue
-   of elements to play/display, and if so, do update the queue.
+   Pileup has no descriptor: its stations fade and reply as time
+   passes, so while it is active the function wakes up every
+   CWCP_POLL_PERIOD. So it does if descriptor of tone queue is not
+   available.
 
-   \param fd - file to pool for new keys from the user
-   \param usecs - pooling interval
+   \param fd - file to poll for new keys from the user
+
+   \return true if there is data to read from \p fd
+   \return false if the program should terminate
 */
-void ui_poll_user_input(int fd, int usecs)
+bool ui_poll_user_input(int fd)
 {
-	int fd_count;
-
-	/* Poll until the select indicates data on the file descriptor. */
-	do {
-		fd_set read_set;
-		struct timeval timeout;
-
-		/* Set up a the file descriptor set and timeout information. */
-		FD_ZERO(&read_set);
-		FD_SET(fd, &read_set);
-		timeout.tv_sec = usecs / 1000000;
-		timeout.tv_usec = usecs % 1000000;
-
-		/* Wait until timeout, data, or a signal.
-		   If a signal interrupts select, we can just treat it as
-		   another timeout. */
-		fd_count = select(fd + 1, &read_set, NULL, NULL, &timeout);
-		if (fd_count == -1 && errno != EINTR) {
-			perror("select");
+	enum { FD_INPUT, FD_SIGNAL, FD_TIMER, FD_TONE_QUEUE, FD_COUNT };
+	struct pollfd fds[FD_COUNT] = {
+		[FD_INPUT]      = { .fd = fd,                           .events = POLLIN },
+		[FD_SIGNAL]     = { .fd = g_signal_fd,                  .events = POLLIN },
+		[FD_TIMER]      = { .fd = g_timer_fd,                   .events = POLLIN },
+		[FD_TONE_QUEUE] = { .fd = cw_get_tone_queue_event_fd(), .events = POLLIN },
+	};
+
+	/* Empty tone queue doesn't signal its descriptor, so start
+	   sending requested by previous key here. */
+	queue_transfer_character_to_libcw();
+
+	/* Show results of handling of previous key without waiting for
+	   next frame. */
+	ui_update_screen(true);
+
+	bool is_input = false;
+	while (g_is_running && !is_input) {
+		int timeout = ui_get_screen_update_timeout();
+		if (-1 == fds[FD_TONE_QUEUE].fd || g_pileup) {
+			const int period = CWCP_POLL_PERIOD / 1000;
+			if (-1 == timeout || timeout > period) {
+				timeout = period;
+			}
+		}
+
+		/* Negative descriptors are ignored by poll(). */
+		if (-1 == poll(fds, FD_COUNT, timeout)) {
+			if (EINTR == errno) {
+				/* Signal handled by registered handler, or
+				   SIGWINCH. */
+				continue;
+			}
+			perror("poll");
 			exit(EXIT_FAILURE);
 		}
 
-		/* Make this call on timeouts and on reads; it's just easier. */
+		if (fds[FD_SIGNAL].revents & POLLIN) {
+			struct signalfd_siginfo info;
+			if (sizeof (info) == read(g_signal_fd, &info, sizeof (info))) {
+				signal_handler((int) info.ssi_signo);
+			}
+			continue;
+		}
+		if (fds[FD_TIMER].revents & POLLIN) {
+			timer_handle_tick();
+		}
+		if (fds[FD_TONE_QUEUE].revents & POLLIN) {
+			uint64_t counter = 0;
+			if (sizeof (counter) != read(fds[FD_TONE_QUEUE].fd, &counter, sizeof (counter))) {
+				; /* Spurious wakeup, checking the queue anyway. */
+			}
+		}
+		/* Hangup and error are passed to getch() too. */
+		is_input = 0 != fds[FD_INPUT].revents;
+
+		/* Make these calls on every wakeup; it's just easier. */
 		queue_transfer_character_to_libcw();
-	} while (fd_count != 1);
+		pileup_poll();
+
+		ui_update_screen(false);
+	}
+
+	return is_input;
+}
+
+
+
+
+
+/**
+   \brief Get time until pending changes of windows are sent to terminal
+
+   \return timeout for poll() [ms], -1 if no changes are pending
+*/
+int ui_get_screen_update_timeout(void)
+{
+	if (!g_screen_update.is_pending) {
+		return -1;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const long long elapsed = (now.tv_sec - g_screen_update.last.tv_sec) * 1000000LL
+		+ (now.tv_nsec - g_screen_update.last.tv_nsec) / 1000;
+	if (elapsed >= CWCP_FRAME_PERIOD) {
+		return 0;
+	}
+
+	/* Round up, so that the frame period has passed on wakeup. */
+	return (int) ((CWCP_FRAME_PERIOD - elapsed + 999) / 1000);
+}
+
+
+
+
+
+/**
+   \brief Mark window as changed
+
+   Contents of the window are copied to curses' virtual screen, but
+   are not sent to terminal until ui_update_screen(). This way any
+   number of changes made between two frames costs one write to
+   terminal.
+
+   \param window - changed window
+*/
+void ui_mark_for_update(WINDOW *window)
+{
+	wnoutrefresh(window);
+	g_screen_update.is_pending = true;
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Send pending changes of windows to terminal
+
+   Changes are sent at most once per frame (CWCP_FRAME_PERIOD), unless
+   \p is_forced is true, e.g. when the user has pressed a key and
+   expects to see its effect right away.
+
+   \param is_forced - send the changes even if frame period has not passed
+*/
+void ui_update_screen(bool is_forced)
+{
+	if (!g_screen_update.is_pending) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const long long elapsed = (now.tv_sec - g_screen_update.last.tv_sec) * 1000000LL
+		+ (now.tv_nsec - g_screen_update.last.tv_nsec) / 1000;
+	if (!is_forced && elapsed < CWCP_FRAME_PERIOD) {
+		return;
+	}
+
+	doupdate();
+	g_screen_update.is_pending = false;
+	g_screen_update.last = now;
 
 	return;
 }
@@ -1588,7 +1987,7 @@ void ui_clear_main_window(void)
 {
 	werase(text_subwindow);
 	wmove(text_subwindow, 0, 0);
-	wrefresh(text_subwindow);
+	ui_mark_for_update(text_subwindow);
 
 	return;
 }
@@ -1614,8 +2013,7 @@ void ui_display_state(const char *state)
 {
 	box(text_window, 0, 0);
 	mvwaddstr(text_window, 0, 1, state);
-	wnoutrefresh(text_window);
-	doupdate();
+	ui_mark_for_update(text_window);
 
 	return;
 }
@@ -1646,7 +2044,7 @@ void ui_update_mode_selection(int old_mode, int current_mode)
 		current_mode, 1,
 		mode_get_description(current_mode));
 
-      wrefresh(mode_subwindow);
+      ui_mark_for_update(mode_subwindow);
 
       return;
 }
@@ -1655,6 +2053,49 @@ void ui_update_mode_selection(int old_mode, int current_mode)
 
 
 
+/**
+   \brief Set up handling of signals that terminate the program
+
+   The signals are blocked and received through a descriptor waited
+   on in main loop, so they don't interrupt system calls. Call the
+   function before any thread is started, so that the threads block
+   the signals too. If the descriptor can't be created, handlers are
+   registered instead.
+
+   \param signals - zero-terminated list of signals
+
+   \return true on success
+   \return false otherwise
+*/
+bool signals_initialize(const int *signals)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	for (int i = 0; signals[i]; i++) {
+		sigaddset(&set, signals[i]);
+	}
+
+	if (0 == pthread_sigmask(SIG_BLOCK, &set, NULL)) {
+		g_signal_fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+		if (-1 != g_signal_fd) {
+			return true;
+		}
+		pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	}
+
+	for (int i = 0; signals[i]; i++) {
+		if (!cw_register_signal_handler(signals[i], signal_handler)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+
+
 /**
    \brief Signal handler for signals, to clear up on kill
 */
@@ -1735,22 +2176,22 @@ int main(int argc, char **argv)
 		getchar();
 	}
 
+	static const int SIGNALS[] = { SIGHUP, SIGINT, SIGQUIT, SIGPIPE, SIGTERM, 0 };
+	/* Set up handling of signals to clear up and exit on a range
+	   of signals. Sound systems may start threads when generator
+	   is created, so do it first. */
+	if (!signals_initialize(SIGNALS)) {
+		fprintf(stderr, _("%s: can't register signal: %s\n"), config->program_name, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
 	generator = cw_generator_new_from_config(config);
 	if (!generator) {
 		fprintf(stderr, "%s: failed to create generator\n", config->program_name);
 		return EXIT_FAILURE;
 	}
 	timer_set_total_practice_time(config->practice_time);
-
-
-	static const int SIGNALS[] = { SIGHUP, SIGINT, SIGQUIT, SIGPIPE, SIGTERM, 0 };
-	/* Set up signal handlers to clear up and exit on a range of signals. */
-	for (int i = 0; SIGNALS[i]; i++) {
-		if (!cw_register_signal_handler(SIGNALS[i], signal_handler)) {
-			fprintf(stderr, _("%s: can't register signal: %s\n"), config->program_name, strerror(errno));
-			return EXIT_FAILURE;
-		}
-	}
+	g_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
 
 	/* Build our table of modes from dictionaries, augmented with
 	   keyboard and any other local modes. */
@@ -1758,14 +2199,15 @@ int main(int argc, char **argv)
 
 	/* Initialize the curses user interface, then catch and action
 	   every keypress we see.  Before calling getch, wait until
-	   data is available on stdin, polling the libcw sender.  At
-	   60WPM, a dot is 20ms, so polling for the maximum library
-	   speed needs a 10ms (10,000usec) timeout. */
+	   data is available on stdin, feeding the libcw sender when
+	   its tone queue signals low level. */
 	ui_initialize();
 	cw_generator_start();
+	cw_register_tone_queue_low_callback(NULL, NULL, 1);
 	while (g_is_running) {
-		ui_poll_user_input(fileno(stdin), 10000);
-		ui_handle_event(getch());
+		if (ui_poll_user_input(fileno(stdin))) {
+			ui_handle_event(getch());
+		}
 	}
 
 	cw_wait_for_tone_queue();
@@ -1787,6 +2229,7 @@ void cwcp_atexit(void)
 		cw_generator_delete();
 	}
 
+	cw_practice_delete(&g_practice);
 	mode_clean();
 
 	cw_dictionaries_unload();
@@ -1795,5 +2238,14 @@ void cwcp_atexit(void)
 		cw_config_delete(&config);
 	}
 
+	if (-1 != g_timer_fd) {
+		close(g_timer_fd);
+		g_timer_fd = -1;
+	}
+	if (-1 != g_signal_fd) {
+		close(g_signal_fd);
+		g_signal_fd = -1;
+	}
+
 	return;
 }
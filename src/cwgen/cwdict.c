@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "i18n.h"
+#include "cw_cmdline.h"
+#include "cw_copyright.h"
+#include "dictionary.h"
+
+
+
+
+/**
+   cwdict - compile dictionaries of cwcp and xcwcp
+
+   The program reads dictionaries from text (ini-style) file or from
+   compiled file, and writes them to compiled file (or, with -t
+   option, to text file). Compiled file is mapped into memory by
+   programs reading it, so large word lists are loaded without any
+   parsing.
+*/
+
+
+
+
+static const char *all_options = "o:|output,t|text,h|help,v|version";
+
+static void cwdict_print_usage(const char *program_name);
+static void cwdict_print_help(const char *program_name);
+
+
+
+
+/**
+   \brief Print out a brief message directing the user to the help function
+
+   \param program_name - program's name
+*/
+void cwdict_print_usage(const char *program_name)
+{
+	const char *format = has_longopts()
+		? _("Try '%s --help' for more information.\n")
+		: _("Try '%s -h' for more information.\n");
+
+	fprintf(stderr, format, program_name);
+	return;
+}
+
+
+
+
+/**
+   \brief Print out a brief page of help information
+
+   \param program_name - program's name
+*/
+void cwdict_print_help(const char *program_name)
+{
+	if (!has_longopts()) {
+		fprintf(stderr, "%s", _("Long format of options is not supported on your system\n\n"));
+	}
+
+	printf(_("Usage: %s [options...] INPUT\n\n"), program_name);
+	printf("%s", _("  read dictionaries from text or compiled INPUT file\n\n"));
+	printf("%s", _("  -o, --output=FILE      write compiled dictionaries to FILE\n"));
+	printf("%s", _("  -t, --text             write text file instead of compiled file\n"));
+	printf("%s", _("  -h, --help             print this message\n"));
+	printf("%s", _("  -v, --version          output version information and exit\n\n"));
+
+	exit(EXIT_SUCCESS);
+}
+
+
+
+
+/**
+   \brief Parse the command line options, then convert the dictionaries
+*/
+int main(int argc, char **argv)
+{
+	const char *program_name = cw_program_basename(argv[0]);
+	const char *output = NULL;
+	bool is_text = false;
+
+	/* Set locale and message catalogs. */
+	i18n_initialize();
+
+	int option;
+	char *argument;
+	while (get_option(argc, argv, all_options, &option, &argument)) {
+		switch (option) {
+		case 'o':
+			output = argument;
+			break;
+
+		case 't':
+			is_text = true;
+			break;
+
+		case 'h':
+			cwdict_print_help(program_name);
+			/* Fallthrough. */
+		case 'v':
+			printf(_("%s version %s\n%s\n"),
+			       program_name, PACKAGE_VERSION, _(CW_COPYRIGHT));
+			exit(EXIT_SUCCESS);
+
+		case '?':
+		default:
+			cwdict_print_usage(program_name);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (get_optind() != argc - 1 || !output) {
+		cwdict_print_usage(program_name);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!cw_dictionaries_read(argv[argc - 1])) {
+		return EXIT_FAILURE;
+	}
+
+	const bool success = is_text
+		? cw_dictionaries_write(output)
+		: cw_dictionaries_write_compiled(output);
+	cw_dictionaries_unload();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
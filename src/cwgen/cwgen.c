@@ -26,6 +26,8 @@
 #include <assert.h>
 #include <stdint.h>
 #include <inttypes.h> /* SCNu64 in sscanf() */
+#include <limits.h> /* INT_MAX */
+#include <unistd.h> /* write(), getpid() */
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -53,6 +55,8 @@
 #define MIN_LIMIT              0   /* Lowest character count limit allowed. */
 #define INITIAL_LIMIT          0   /* Default character count limit. */
 
+#define CWGEN_OUTPUT_BLOCK_SIZE (64 * 1024) /* Size of blocks of output written with one write(). */
+
 
 static const char *const DEFAULT_CHARSET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
@@ -67,6 +71,10 @@ struct cwgen_config {
 	uint64_t n_chars_max;  /* Maximal number of characters (excluding spaces) to generate in whole set of groups; may be zero - no limit. */
 
 	char *charset;         /* Set of chars to be used to generate groups. */
+	char *words_file;      /* Word list with frequencies; if set, groups are words picked from the list. */
+
+	bool has_seed;         /* Has the seed been given in command line? */
+	uint64_t seed;         /* Seed of pseudo-random number generator; the same seed gives the same groups. */
 } g_config = {
 	.program_name   = (char *) NULL,
 
@@ -76,13 +84,18 @@ struct cwgen_config {
         .n_repeats      = INITIAL_REPEAT,
         .n_chars_max    = INITIAL_LIMIT,
 
-	.charset        = (char *) NULL
+	.charset        = (char *) NULL,
+	.words_file     = (char *) NULL,
+
+	.has_seed       = false,
+	.seed           = 0
 };
 
 
-static const char *all_options = "g:|groups,n:|groupsize,r:|repeat,x:|limit,c:|charset,h|help,v|version";
+static const char *all_options = "g:|groups,n:|groupsize,r:|repeat,x:|limit,c:|charset,s:|seed,w:|words,h|help,v|version";
 
 static void cwgen_generate_characters(struct cwgen_config *config);
+static void cwgen_generate_words(struct cwgen_config *config);
 static void cwgen_print_usage(const char *program_name);
 static void cwgen_print_help(const char *program_name);
 static void cwgen_parse_command_line(int argc, char **argv, struct cwgen_config *config);
@@ -91,6 +104,239 @@ static void cwgen_free_config(struct cwgen_config *config);
 
 
 
+/* State of xoshiro256** pseudo-random number generator. */
+typedef struct {
+	uint64_t s[4];
+} cwgen_prng_t;
+
+
+
+
+/**
+   \brief Get next value from splitmix64 sequence
+
+   Used only to expand a seed into state of xoshiro256** generator, as
+   recommended by authors of the generator.
+
+   \param x - state of splitmix64 sequence
+
+   \return next value in the sequence
+*/
+static uint64_t cwgen_splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+
+
+/**
+   \brief Seed pseudo-random number generator
+
+   \param prng - generator to seed
+   \param seed - seed; the same seed produces the same sequence
+*/
+static void cwgen_prng_seed(cwgen_prng_t *prng, uint64_t seed)
+{
+	for (int i = 0; i < 4; i++) {
+		prng->s[i] = cwgen_splitmix64(&seed);
+	}
+}
+
+
+
+
+static inline uint64_t cwgen_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+
+
+
+/**
+   \brief Get next 64-bit value from xoshiro256** generator
+
+   \param prng - generator
+
+   \return pseudo-random value
+*/
+static inline uint64_t cwgen_prng_next(cwgen_prng_t *prng)
+{
+	uint64_t *s = prng->s;
+	const uint64_t result = cwgen_rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = cwgen_rotl(s[3], 45);
+
+	return result;
+}
+
+
+
+
+/**
+   \brief Get pseudo-random value in range [0, n)
+
+   Values that would make the result biased towards lower numbers (the
+   remainder of 2^64 divided by n) are rejected, so every value in the
+   range is equally probable.
+
+   \param prng - generator
+   \param n - size of range, greater than zero
+
+   \return pseudo-random value from the range
+*/
+static inline uint64_t cwgen_prng_below(cwgen_prng_t *prng, uint64_t n)
+{
+	/* (2^64 - n) % n == 2^64 % n */
+	const uint64_t threshold = (0 - n) % n;
+	uint64_t x;
+	do {
+		x = cwgen_prng_next(prng);
+	} while (x < threshold);
+
+	return x % n;
+}
+
+
+
+
+/**
+   \brief Write whole buffer to stdout
+
+   \param config - program's configuration variable
+   \param buffer - data to write
+   \param size - size of data
+*/
+static void cwgen_write_output(struct cwgen_config *config, const char *buffer, size_t size)
+{
+	while (size) {
+		const ssize_t n = write(STDOUT_FILENO, buffer, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* Reader of a pipe has quit, e.g. "cwgen | head". */
+			if (errno != EPIPE) {
+				fprintf(stderr, "%s: failed to write output: %s\n", config->program_name, strerror(errno));
+			}
+			exit(EXIT_FAILURE);
+		}
+		buffer += n;
+		size -= (size_t) n;
+	}
+}
+
+
+
+
+/* Output of generated groups, collected in blocks. */
+typedef struct {
+	struct cwgen_config *config;
+	char *buffer;
+	size_t len;
+	uint64_t chars;        /* Count of characters (excluding spaces) output so far. */
+} cwgen_output_t;
+
+
+
+
+/**
+   \brief Prepare output of groups
+
+   \param output - output to prepare
+   \param config - program's configuration variable
+   \param group_size_max - length of longest group that will be output
+*/
+static void cwgen_output_init(cwgen_output_t *output, struct cwgen_config *config, size_t group_size_max)
+{
+	output->config = config;
+	/* Large enough to always hold one more group and its
+	   trailing space, or the final newline. */
+	output->buffer = (char *) malloc(CWGEN_OUTPUT_BLOCK_SIZE + group_size_max + 1);
+	if (!output->buffer) {
+		fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
+		exit(EXIT_FAILURE);
+	}
+	output->len = 0;
+	output->chars = 0;
+}
+
+
+
+
+/**
+   \brief Output a group
+
+   The group is always output at least once, then repeated for the
+   desired repeat count. Output stops at any set limit on printed
+   characters.
+
+   \param output - output of groups
+   \param group - characters of group
+   \param group_size - count of characters in group
+
+   \return true if more groups can be output
+   \return false if limit of characters has been reached
+*/
+static bool cwgen_output_group(cwgen_output_t *output, const char *group, int group_size)
+{
+	const uint64_t n_chars_max = output->config->n_chars_max;
+
+	int repeat = 0;
+	do {
+		int n = group_size;
+		if (n_chars_max && n_chars_max - output->chars < (uint64_t) n) {
+			n = (int) (n_chars_max - output->chars);
+		}
+		memcpy(output->buffer + output->len, group, (size_t) n);
+		output->len += (size_t) n;
+		output->buffer[output->len++] = ' ';
+		output->chars += (uint64_t) n;
+
+		if (output->len >= CWGEN_OUTPUT_BLOCK_SIZE) {
+			cwgen_write_output(output->config, output->buffer, output->len);
+			output->len = 0;
+		}
+
+		if (n_chars_max && output->chars >= n_chars_max) {
+			return false;
+		}
+
+	} while (repeat++ < output->config->n_repeats);
+
+	return true;
+}
+
+
+
+
+/**
+   \brief Finish output: write final newline and remaining data
+
+   \param output - output of groups
+*/
+static void cwgen_output_finish(cwgen_output_t *output)
+{
+	output->buffer[output->len++] = '\n';
+	cwgen_write_output(output->config, output->buffer, output->len);
+
+	free(output->buffer);
+	output->buffer = NULL;
+}
+
+
+
+
 /**
    \brief Generate random characters on stdout
 
@@ -98,26 +344,15 @@ static void cwgen_free_config(struct cwgen_config *config);
    to the requested number of groups.  Characters are selected from the
    set given at random.
 
+   Output is collected in a large buffer and written with one write()
+   per block, so the function can produce large sets of groups quickly.
+
    \param config - program's configuration variable
 */
 void cwgen_generate_characters(struct cwgen_config *config)
 {
-	static bool is_initialized = false;
-
-	/* On first (usually only) call, seed the random number generator. */
-	if (!is_initialized) {
-
-		/* Previously the initializator used value returned by
-		time(). Consecutive calls of the program within one
-		second resulted in the same generated string - not
-		very random. To improve randomness, I've switched to
-		gettimeofday(). */
-		struct timeval t;
-		gettimeofday(&t, NULL);
-
-		srandom(t.tv_usec);
-		is_initialized = true;
-	}
+	cwgen_prng_t prng;
+	cwgen_prng_seed(&prng, config->seed);
 
 	/* Allocate the buffer for repeating groups. */
 	char *buffer = (char *) malloc(config->group_size_max);
@@ -126,53 +361,269 @@ void cwgen_generate_characters(struct cwgen_config *config)
 		exit(EXIT_FAILURE);
 	}
 
+	cwgen_output_t output;
+	cwgen_output_init(&output, config, (size_t) config->group_size_max);
+
 	/* Generate groups up to the number requested or to the character limit. */
-	int charset_length = strlen(config->charset);
-	uint64_t chars = 0;
+	const uint64_t charset_length = strlen(config->charset);
+	const uint64_t group_sizes = (uint64_t) (config->group_size_max - config->group_size_min + 1);
 
 	for (int group = 0; group < config->n_groups; group++) {
 
 		/* Randomize the group size between min and max inclusive. */
-		int group_size = config->group_size_min + random() % (config->group_size_max - config->group_size_min + 1);
+		int group_size = config->group_size_min;
+		if (group_sizes > 1) {
+			group_size += (int) cwgen_prng_below(&prng, group_sizes);
+		}
 
 		/* Create random group. */
 		for (int i = 0; i < group_size; i++) {
-			buffer[i] = config->charset[random() % charset_length];
+			buffer[i] = config->charset[cwgen_prng_below(&prng, charset_length)];
 		}
 
-		/* Repeatedly print the group as requested.
-		   It's always printed at least once, then repeated
-		   for the desired repeat count.  Break altogether if
-		   we hit any set limit on printed characters. */
-		int repeat = 0;
-		do {
-			for (int i = 0; i < group_size; i++) {
+		if (!cwgen_output_group(&output, buffer, group_size)) {
+			break;
+		}
+	}
 
-				putchar(buffer[i]);
-				fflush(stdout);
+	cwgen_output_finish(&output);
+	free(buffer);
 
-				chars++;
+	return;
+}
 
-				if (config->n_chars_max && chars >= config->n_chars_max) {
-					break;
-				}
-			}
 
-			putchar(' ');
-			fflush(stdout);
 
-			if (config->n_chars_max && chars >= config->n_chars_max) {
-				break;
+
+/* List of words with Walker's alias table for weighted sampling. */
+typedef struct {
+	char *text;            /* Words, each terminated with NUL. */
+	size_t *offsets;       /* Offset of each word in 'text'. */
+	int *lengths;
+	double *weights;       /* Frequencies from word list; replaced with probabilities of alias table. */
+	size_t *aliases;
+	size_t count;
+	size_t length_max;
+} cwgen_words_t;
+
+
+
+
+/**
+   \brief Read list of words with their frequencies
+
+   Each line of the file contains a word, optionally followed by
+   whitespace and frequency of the word (as printed by word_freq.awk).
+   A word without frequency has frequency 1. Empty lines are skipped.
+
+   \param config - program's configuration variable
+   \param words - list to fill
+*/
+static void cwgen_words_read(struct cwgen_config *config, cwgen_words_t *words)
+{
+	FILE *file = fopen(config->words_file, "r");
+	if (!file) {
+		fprintf(stderr, _("%s: failed to open word list %s: %s\n"), config->program_name, config->words_file, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	memset(words, 0, sizeof (*words));
+	size_t text_len = 0;
+	size_t text_capacity = 0;
+	size_t capacity = 0;
+
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned long line_number = 0;
+	while (getline(&line, &line_size, file) != -1) {
+		line_number++;
+
+		const char *word = line + strspn(line, " \t");
+		const size_t len = strcspn(word, " \t\r\n");
+		if (!len) {
+			continue;
+		}
+		if (len > INT_MAX) {
+			fprintf(stderr, _("%s: %s:%lu: word is too long\n"), config->program_name, config->words_file, line_number);
+			exit(EXIT_FAILURE);
+		}
+
+		double weight = 1.0;
+		const char *rest = word + len;
+		rest += strspn(rest, " \t");
+		if (*rest && *rest != '\r' && *rest != '\n') {
+			char *end = NULL;
+			weight = strtod(rest, &end);
+			if (end == rest || !(weight >= 0.0)) {
+				fprintf(stderr, _("%s: %s:%lu: invalid frequency\n"), config->program_name, config->words_file, line_number);
+				exit(EXIT_FAILURE);
 			}
+		}
 
-		} while (repeat++ < config->n_repeats);
+		if (words->count == capacity) {
+			capacity = capacity ? 2 * capacity : 1024;
+			words->offsets = (size_t *) realloc(words->offsets, capacity * sizeof (words->offsets[0]));
+			words->lengths = (int *) realloc(words->lengths, capacity * sizeof (words->lengths[0]));
+			words->weights = (double *) realloc(words->weights, capacity * sizeof (words->weights[0]));
+			if (!words->offsets || !words->lengths || !words->weights) {
+				fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (text_len + len + 1 > text_capacity) {
+			text_capacity = 2 * (text_capacity + len + 1);
+			words->text = (char *) realloc(words->text, text_capacity);
+			if (!words->text) {
+				fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		memcpy(words->text + text_len, word, len);
+		words->text[text_len + len] = '\0';
+		words->offsets[words->count] = text_len;
+		words->lengths[words->count] = (int) len;
+		words->weights[words->count] = weight;
+		words->count++;
+		text_len += len + 1;
+
+		if (len > words->length_max) {
+			words->length_max = len;
+		}
+	}
+	free(line);
+	fclose(file);
+
+	if (!words->count) {
+		fprintf(stderr, _("%s: word list %s is empty\n"), config->program_name, config->words_file);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+
+
+/**
+   \brief Build Walker's alias table for list of words
+
+   Vose's variant of the algorithm is used. After the call, word i is
+   picked by choosing column i uniformly and then keeping i with
+   probability weights[i], or taking aliases[i] otherwise.
+
+   \param config - program's configuration variable
+   \param words - list of words with frequencies in 'weights'
+*/
+static void cwgen_words_build_alias_table(struct cwgen_config *config, cwgen_words_t *words)
+{
+	const size_t n = words->count;
 
-		if (config->n_chars_max && chars >= config->n_chars_max) {
+	double sum = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		sum += words->weights[i];
+	}
+	if (!(sum > 0.0)) {
+		fprintf(stderr, _("%s: all frequencies in word list %s are zero\n"), config->program_name, config->words_file);
+		exit(EXIT_FAILURE);
+	}
+
+	words->aliases = (size_t *) malloc(n * sizeof (words->aliases[0]));
+	/* Work lists of columns with scaled weight below and above 1. */
+	size_t *small = (size_t *) malloc(n * sizeof (small[0]));
+	size_t *large = (size_t *) malloc(n * sizeof (large[0]));
+	if (!words->aliases || !small || !large) {
+		fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t n_small = 0;
+	size_t n_large = 0;
+	for (size_t i = 0; i < n; i++) {
+		words->weights[i] = words->weights[i] * (double) n / sum;
+		words->aliases[i] = i;
+		if (words->weights[i] < 1.0) {
+			small[n_small++] = i;
+		} else {
+			large[n_large++] = i;
+		}
+	}
+
+	while (n_small && n_large) {
+		const size_t s = small[--n_small];
+		const size_t l = large[n_large - 1];
+
+		words->aliases[s] = l;
+		words->weights[l] -= 1.0 - words->weights[s];
+		if (words->weights[l] < 1.0) {
+			n_large--;
+			small[n_small++] = l;
+		}
+	}
+	/* Leftovers differ from 1 only by rounding errors. */
+	while (n_large) {
+		words->weights[large[--n_large]] = 1.0;
+	}
+	while (n_small) {
+		words->weights[small[--n_small]] = 1.0;
+	}
+
+	free(small);
+	free(large);
+}
+
+
+
+
+static void cwgen_words_free(cwgen_words_t *words)
+{
+	free(words->text);
+	free(words->offsets);
+	free(words->lengths);
+	free(words->weights);
+	free(words->aliases);
+	memset(words, 0, sizeof (*words));
+}
+
+
+
+
+/**
+   \brief Generate random words on stdout
+
+   Words from word list are picked at random, each with probability
+   proportional to its frequency given in the list, so that statistics
+   of generated text follow the statistics of the source of the list.
+   Each word is one group; repeat count and limit of characters are
+   applied as for groups of random characters.
+
+   \param config - program's configuration variable
+*/
+static void cwgen_generate_words(struct cwgen_config *config)
+{
+	cwgen_words_t words;
+	cwgen_words_read(config, &words);
+	cwgen_words_build_alias_table(config, &words);
+
+	cwgen_prng_t prng;
+	cwgen_prng_seed(&prng, config->seed);
+
+	cwgen_output_t output;
+	cwgen_output_init(&output, config, words.length_max);
+
+	for (int group = 0; group < config->n_groups; group++) {
+		size_t i = (size_t) cwgen_prng_below(&prng, words.count);
+		/* Top 53 bits make a uniformly distributed double in [0, 1). */
+		const double u = (double) (cwgen_prng_next(&prng) >> 11) * (1.0 / 9007199254740992.0);
+		if (u >= words.weights[i]) {
+			i = words.aliases[i];
+		}
+
+		if (!cwgen_output_group(&output, words.text + words.offsets[i], words.lengths[i])) {
 			break;
 		}
 	}
 
-	free(buffer);
+	cwgen_output_finish(&output);
+	cwgen_words_free(&words);
 
 	return;
 }
@@ -225,6 +676,12 @@ static void cwgen_print_help(const char *program_name)
 	printf(_("                         [default %s]\n"), DEFAULT_CHARSET);
 	printf(_("  -x, --limit=LIMIT      stop after LIMIT characters [default %d]\n"), INITIAL_LIMIT);
 	printf("%s", _("                         a LIMIT of zero indicates no set limit\n"));
+	printf("%s", _("  -w, --words=FILE       send words from FILE instead of groups of chars,\n"));
+	printf("%s", _("                         each line of FILE is a word and its frequency\n"));
+	printf("%s", _("                         (e.g. output of word_freq.awk); words are picked\n"));
+	printf("%s", _("                         at random according to their frequencies\n"));
+	printf("%s", _("  -s, --seed=SEED        seed random generator with SEED, the same SEED\n"));
+	printf("%s", _("                         produces the same groups [default: random]\n"));
 	printf("%s", _("  -h, --help             print this message\n"));
 	printf("%s", _("  -v, --version          output version information and exit\n\n"));
 
@@ -319,6 +776,25 @@ void cwgen_parse_command_line(int argc, char **argv, struct cwgen_config *config
 			}
 			break;
 
+		case 'w':
+			assert(!config->words_file);
+			config->words_file = strdup(argument);
+			if (!config->words_file) {
+				fprintf(stderr, _("%s: failed to allocate memory\n"), config->program_name);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 's':
+			if (sscanf(argument, "%" SCNu64, &(config->seed)) != 1
+			    || strstr(argument, "-")) {
+
+				fprintf(stderr, _("%s: invalid seed value: %s\n"), config->program_name, argument);
+				exit(EXIT_FAILURE);
+			}
+			config->has_seed = true;
+			break;
+
 		case 'h':
 			cwgen_print_help(config->program_name);
 			/* Fallthrough. */
@@ -373,9 +849,23 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Generate the character groups as requested. */
-	cwgen_generate_characters(&g_config);
-	putchar('\n');
+	if (!g_config.has_seed) {
+		/* Previously the seed was a value returned by time().
+		   Consecutive calls of the program within one second
+		   resulted in the same generated string - not very
+		   random. Microseconds and process ID make it unique
+		   enough. */
+		struct timeval t;
+		gettimeofday(&t, NULL);
+		g_config.seed = ((uint64_t) t.tv_sec * 1000000 + (uint64_t) t.tv_usec) ^ ((uint64_t) getpid() << 40);
+	}
+
+	/* Generate the character groups or words as requested. */
+	if (g_config.words_file) {
+		cwgen_generate_words(&g_config);
+	} else {
+		cwgen_generate_characters(&g_config);
+	}
 
 	cwgen_free_config(&g_config);
 
@@ -399,6 +889,10 @@ void cwgen_free_config(struct cwgen_config *config)
 		free(config->charset);
 		config->charset = (char *) NULL;
 	}
+	if (config->words_file) {
+		free(config->words_file);
+		config->words_file = (char *) NULL;
+	}
 
 	if (config->program_name) {
 		free(config->program_name);
@@ -385,7 +385,7 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("Sound system options:\n"));
 			fprintf(stderr, "%s", _("  -s, --system=SYSTEM\n"));
 			fprintf(stderr, "%s", _("        generate sound using SYSTEM sound system\n"));
-			fprintf(stderr, "%s", _("        SYSTEM: {null|console|oss|alsa|pulseaudio|soundcard}\n"));
+			fprintf(stderr, "%s", _("        SYSTEM: {null|console|oss|alsa|pulseaudio|soundcard|file|jack|rtp}\n"));
 			fprintf(stderr, "%s", _("        'null': don't use any sound output\n"));
 			fprintf(stderr, "%s", _("        'console': use system console/buzzer\n"));
 			fprintf(stderr, "%s", _("               this output may require root privileges\n"));
@@ -393,16 +393,22 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("        'alsa' use ALSA output\n"));
 			fprintf(stderr, "%s", _("        'pulseaudio' use PulseAudio output\n"));
 			fprintf(stderr, "%s", _("        'soundcard': use either PulseAudio, OSS or ALSA\n"));
+			fprintf(stderr, "%s", _("        'file': write WAV samples to file (\"-\" for stdout)\n"));
+			fprintf(stderr, "%s", _("        'jack': use JACK (or PipeWire's JACK) output\n"));
+			fprintf(stderr, "%s", _("        'rtp': send RTP stream (L16) over UDP\n"));
 			fprintf(stderr, "%s", _("        default sound system: 'pulseaudio'->'oss'->'alsa'\n"));
 		}
 		fprintf(stderr, "%s", _("  -d, --device=DEVICE\n"));
 		fprintf(stderr, "%s", _("        use DEVICE as output device instead of default one;\n"));
-		fprintf(stderr, "%s", _("        optional for {console|oss|alsa|pulseaudio};\n"));
+		fprintf(stderr, "%s", _("        optional for {console|oss|alsa|pulseaudio|file|jack|rtp};\n"));
 		fprintf(stderr, "%s", _("        default devices are:\n"));
 		fprintf(stderr,       _("        'console': \"%s\"\n"), CW_DEFAULT_CONSOLE_DEVICE);
 		fprintf(stderr,       _("        'oss': \"%s\"\n"), CW_DEFAULT_OSS_DEVICE);
 		fprintf(stderr,       _("        'alsa': \"%s\"\n"), CW_DEFAULT_ALSA_DEVICE);
 		fprintf(stderr,       _("        'pulseaudio': %s\n"), CW_DEFAULT_PA_DEVICE);
+		fprintf(stderr,       _("        'file': \"%s\"\n"), CW_DEFAULT_FILE_DEVICE);
+		fprintf(stderr,       _("        'jack': %s (physical playback ports)\n"), CW_DEFAULT_JACK_DEVICE);
+		fprintf(stderr,       _("        'rtp': \"%s\" (comma-separated host:port list)\n"), CW_DEFAULT_RTP_DEVICE);
 
 		if (config->has_feature_libcw_test_specific) {
 			fprintf(stderr, "%s", _("  -X, --test-alsa-device=device\n"));
@@ -444,6 +450,7 @@ void cw_print_help(cw_config_t *config)
 	    || config->has_feature_practice_time
 	    || config->has_feature_infile
 	    || config->has_feature_outfile
+	    || config->has_feature_scrollback
 	    || config->has_feature_cw_specific) {
 
 		fprintf(stderr, "%s", _("Other options:\n"));
@@ -454,6 +461,8 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("  -c, --nocommands       disable executing embedded commands\n"));
 			fprintf(stderr, "%s", _("  -o, --nocombinations   disallow [...] combinations\n"));
 			fprintf(stderr, "%s", _("  -p, --nocomments       disallow {...} comments\n"));
+			fprintf(stderr, "%s", _("  -b, --bulk             queue input without waiting for each character\n"));
+			fprintf(stderr, "%s", _("                         to be sounded; echo runs ahead of sound\n"));
 		}
 		if (config->has_feature_practice_time) {
 			fprintf(stderr, "%s", _("  -T, --time=TIME        set initial practice time (in minutes)\n"));
@@ -466,10 +475,22 @@ void cw_print_help(cw_config_t *config)
 		if (config->has_feature_outfile) {
 			fprintf(stderr, "%s", _("  -F, --outfile=FILE     write current practice words to FILE\n"));
 		}
+		if (config->has_feature_scrollback) {
+			fprintf(stderr, "%s", _("  -B, --scrollback=LINES keep at most LINES lines of text in main display\n"));
+			fprintf(stderr,       _("                         valid values: %d - %d\n"), CW_SCROLLBACK_LINES_MIN, CW_SCROLLBACK_LINES_MAX);
+			fprintf(stderr,       _("                         default value: %d\n"), CW_SCROLLBACK_LINES_INITIAL);
+		}
 		/* TODO: this probably should be inside of "if (config->has_feature_infile)". */
 		if (config->has_feature_cw_specific) {
 			fprintf(stderr, "%s", _("                         default file: stdin\n"));
 		}
+		if (config->has_feature_cw_specific) {
+			fprintf(stderr, "%s", _("  -l, --server=ADDRESS   serve clients connecting to ADDRESS instead of\n"));
+			fprintf(stderr, "%s", _("                         reading stdin; ADDRESS is [HOST:]PORT of TCP\n"));
+			fprintf(stderr, "%s", _("                         socket, or path of Unix socket\n"));
+			fprintf(stderr, "%s", _("  -O, --output=FILE      render sound to WAV FILE (\"-\" for stdout) as\n"));
+			fprintf(stderr, "%s", _("                         fast as possible instead of playing it\n"));
+		}
 		fprintf(stderr, "\n");
 	}
 
@@ -477,7 +498,10 @@ void cw_print_help(cw_config_t *config)
 	    || config->has_feature_test_loops
 	    || config->has_feature_test_name
 	    || config->has_feature_test_quick_only
-	    || config->has_feature_test_random_seed) {
+	    || config->has_feature_test_random_seed
+	    || config->has_feature_test_virtual_time
+	    || config->has_feature_test_resources
+	    || config->has_feature_test_jobs) {
 
 		fprintf(stderr, "%s", _("Options specific to test programs (unstable):\n"));
 
@@ -509,6 +533,21 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("  -D, --test-random-seed\n"));
 			fprintf(stderr, "%s", _("        use given seed for randomization\n"));
 		}
+		if (config->has_feature_test_virtual_time) {
+			fprintf(stderr, "%s", _("  -U, --test-virtual-time\n"));
+			fprintf(stderr, "%s", _("        run on virtual clock: tones of Null sound system,\n"));
+			fprintf(stderr, "%s", _("        timers and sleeps don't wait in real time\n"));
+		}
+		if (config->has_feature_test_resources) {
+			fprintf(stderr, "%s", _("  -R, --test-resources=FILE\n"));
+			fprintf(stderr, "%s", _("        measure CPU, memory and context switches of each test function\n"));
+			fprintf(stderr, "%s", _("        (and of generator threads) and save them as JSON to FILE\n"));
+		}
+		if (config->has_feature_test_jobs) {
+			fprintf(stderr, "%s", _("  -j, --test-jobs=N\n"));
+			fprintf(stderr, "%s", _("        execute each pair of test set and sound system in separate\n"));
+			fprintf(stderr, "%s", _("        worker process, with up to N workers running at a time\n"));
+		}
 
 		fprintf(stderr, "\n");
 	}
@@ -566,10 +605,16 @@ char * cw_config_get_supported_feature_cmdline_options(const cw_config_t * confi
 
 	if (config->has_feature_cw_specific) {
 		append_option(buffer, size, &n, "e|noecho,m|nomessages,c|nocommands,o|nocombinations,p|nocomments");
+		append_option(buffer, size, &n, "l:|server");
+		append_option(buffer, size, &n, "b|bulk");
+		append_option(buffer, size, &n, "O:|output");
 	}
 	if (config->has_feature_ui_colors) {
 		append_option(buffer, size, &n, "c:|colours,c:|colors,m|mono");
 	}
+	if (config->has_feature_scrollback) {
+		append_option(buffer, size, &n, "B:|scrollback");
+	}
 
 	if (config->has_feature_libcw_test_specific) {
 		append_option(buffer, size, &n, "S:|test-systems");
@@ -588,6 +633,15 @@ char * cw_config_get_supported_feature_cmdline_options(const cw_config_t * confi
 	if (config->has_feature_test_random_seed) {
 		append_option(buffer, size, &n, "D:|test-random-seed");
 	}
+	if (config->has_feature_test_virtual_time) {
+		append_option(buffer, size, &n, "U|test-virtual-time");
+	}
+	if (config->has_feature_test_resources) {
+		append_option(buffer, size, &n, "R:|test-resources");
+	}
+	if (config->has_feature_test_jobs) {
+		append_option(buffer, size, &n, "j:|test-jobs");
+	}
 
 	if (true) {
 		append_option(buffer, size, &n, "h|help,V|version");
@@ -662,6 +716,18 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 			   || !strcmp(optarg, "s")) {
 
 			config->gen_conf.sound_system = CW_AUDIO_SOUNDCARD;
+		} else if (!strcmp(optarg, "file")
+			   || !strcmp(optarg, "f")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_FILE;
+		} else if (!strcmp(optarg, "jack")
+			   || !strcmp(optarg, "j")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_JACK;
+		} else if (!strcmp(optarg, "rtp")
+			   || !strcmp(optarg, "r")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_RTP;
 		} else {
 			fprintf(stderr, "%s: invalid sound system (option 's'): %s\n", config->program_name, optarg);
 			return CW_FAILURE;
@@ -761,6 +827,18 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 			break;
 		}
 
+	case 'B':
+		{
+			int lines = atoi(optarg);
+			if (lines < CW_SCROLLBACK_LINES_MIN || lines > CW_SCROLLBACK_LINES_MAX) {
+				fprintf(stderr, "%s: scrollback out of range: %d\n", config->program_name, lines);
+				return CW_FAILURE;
+			} else {
+				config->scrollback_lines = lines;
+			}
+			break;
+		}
+
 	case 'f':
 		if (optarg && strlen(optarg)) {
 			config->input_file = strdup(optarg);
@@ -785,6 +863,40 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 		config->do_echo = false;
 		break;
 
+	case 'b':
+		config->bulk_input = true;
+		break;
+
+	case 'O':
+		if (optarg && strlen(optarg)) {
+			const size_t len_max = sizeof (config->gen_conf.sound_device) - 1;
+			if (strlen(optarg) >= len_max) {
+				fprintf(stderr, "%s: file name can't be longer than %zd characters\n", config->program_name, len_max);
+				return CW_FAILURE;
+			}
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", optarg);
+			config->gen_conf.sound_system = CW_AUDIO_FILE;
+			config->gen_conf.file_format = CW_FILE_FORMAT_WAV;
+			config->gen_conf.file_realtime = false;
+			config->render_output = true;
+			/* Nobody listens to the sound, so there is no
+			   reason to wait for each character. */
+			config->bulk_input = true;
+		} else {
+			fprintf(stderr, "%s: no file specified for option -O\n", config->program_name);
+			return CW_FAILURE;
+		}
+		break;
+
+	case 'l':
+		if (optarg && strlen(optarg)) {
+			config->server_address = strdup(optarg);
+		} else {
+			fprintf(stderr, "%s: no address specified for option -l\n", config->program_name);
+			return CW_FAILURE;
+		}
+		break;
+
 	case 'm':
 		config->do_errors = false;
 		break;
@@ -954,6 +1066,18 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 		config->test_random_seed = atol(optarg);
 		break;
 
+	case 'U':
+		config->test_virtual_time = true;
+		break;
+
+	case 'R':
+		snprintf(config->test_resources_file, sizeof (config->test_resources_file), "%s", optarg);
+		break;
+
+	case 'j':
+		config->test_jobs = atoi(optarg);
+		break;
+
 	default: /* '?' */
 		cw_print_usage(config->program_name);
 		return CW_FAILURE;
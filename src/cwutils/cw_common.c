@@ -73,6 +73,20 @@ int cw_generator_new_from_config(cw_config_t *config)
 {
 	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
 
+	/* Probing a sound system may take long time (e.g. waiting for
+	   PulseAudio server), so when sound system is to be selected
+	   automatically, the candidates are probed concurrently. They
+	   are still tried in order of preference below. */
+	const enum cw_audio_systems candidates[] = { CW_AUDIO_PA, CW_AUDIO_OSS, CW_AUDIO_ALSA, CW_AUDIO_CONSOLE };
+	bool possible[] = { false, false, false, false };
+	const bool is_probed = config->gen_conf.sound_system == CW_AUDIO_NONE
+		|| config->gen_conf.sound_system == CW_AUDIO_SOUNDCARD;
+	if (is_probed) {
+		/* Console is not a candidate for SOUNDCARD. */
+		const size_t n_candidates = config->gen_conf.sound_system == CW_AUDIO_NONE ? 4 : 3;
+		cw_probe_sound_systems(config->gen_conf.sound_device, candidates, possible, n_candidates, CW_PROBE_SOUND_SYSTEMS_TIMEOUT);
+	}
+
 	if (config->gen_conf.sound_system == CW_AUDIO_NULL) {
 		/* For Null sound system I'm not calling
 		   cw_gen_pick_device_name_internal() because this pseudo
@@ -105,7 +119,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_PA,
 						 picked_device_name, sizeof (picked_device_name));
 
-		if (cw_is_pa_possible(picked_device_name)) {
+		if (is_probed ? possible[0] : cw_is_pa_possible(picked_device_name)) {
 
 			config->gen_conf.sound_system = CW_AUDIO_PA;
 			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
@@ -137,7 +151,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_OSS,
 						 picked_device_name, sizeof (picked_device_name));
 
-		if (cw_is_oss_possible(picked_device_name)) {
+		if (is_probed ? possible[1] : cw_is_oss_possible(picked_device_name)) {
 
 			config->gen_conf.sound_system = CW_AUDIO_OSS;
 			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
@@ -168,7 +182,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_ALSA,
 						 picked_device_name, sizeof (picked_device_name));
 
-		if (cw_is_alsa_possible(picked_device_name)) {
+		if (is_probed ? possible[2] : cw_is_alsa_possible(picked_device_name)) {
 
 			config->gen_conf.sound_system = CW_AUDIO_ALSA;
 			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
@@ -198,7 +212,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_CONSOLE,
 						 picked_device_name, sizeof (picked_device_name));
 
-		if (cw_is_console_possible(picked_device_name)) {
+		if (is_probed ? possible[3] : cw_is_console_possible(picked_device_name)) {
 
 			config->gen_conf.sound_system = CW_AUDIO_CONSOLE;
 			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
@@ -221,6 +235,90 @@ int cw_generator_new_from_config(cw_config_t *config)
 		/* fall through to try with next sound system type */
 	}
 
+	if (config->gen_conf.sound_system == CW_AUDIO_FILE) {
+
+		/* File sound system is never selected automatically, user
+		   has to ask for it explicitly. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_FILE,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_file_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open file output '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: file output is not available with file '%s'\n",
+				config->program_name, picked_device_name);
+		}
+	}
+
+	if (config->gen_conf.sound_system == CW_AUDIO_JACK) {
+
+		/* Like File, JACK sound system is never selected
+		   automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_JACK,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_jack_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open JACK output with port '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: JACK output is not available with port '%s'\n",
+				config->program_name, picked_device_name);
+		}
+	}
+
+	if (config->gen_conf.sound_system == CW_AUDIO_RTP) {
+
+		/* Like File, RTP sound system is never selected
+		   automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_RTP,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_rtp_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open RTP output to '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: RTP output is not available with destinations '%s'\n",
+				config->program_name, picked_device_name);
+		}
+	}
+
 	/* there is no next sound system type to try */
 	return CW_FAILURE;
 }
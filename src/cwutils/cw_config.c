@@ -67,20 +67,25 @@ cw_config_t * cw_config_new(const char * program_name)
 	}
 
 	config->gen_conf.sound_system = CW_AUDIO_NONE;
+	config->gen_conf.file_fd = -1;
 	config->send_speed = CW_SPEED_INITIAL;
 	config->frequency = CW_FREQUENCY_INITIAL;
 	config->volume = CW_VOLUME_INITIAL;
 	config->gap = CW_GAP_INITIAL;
 	config->weighting = CW_WEIGHTING_INITIAL;
 	config->practice_time = CW_PRACTICE_TIME_INITIAL;
+	config->scrollback_lines = CW_SCROLLBACK_LINES_INITIAL;
 	config->input_file = NULL;
 	config->output_file = NULL;
+	config->server_address = NULL;
 
 	config->do_echo = true;
 	config->do_errors = true;
 	config->do_commands = true;
 	config->do_combinations = true;
 	config->do_comments = true;
+	config->bulk_input = false;
+	config->render_output = false;
 
 	return config;
 }
@@ -104,6 +109,10 @@ void cw_config_delete(cw_config_t ** config)
 			free((*config)->output_file);
 			(*config)->output_file = NULL;
 		}
+		if ((*config)->server_address) {
+			free((*config)->server_address);
+			(*config)->server_address = NULL;
+		}
 		free(*config);
 		*config = NULL;
 	}
@@ -121,11 +130,11 @@ int cw_config_is_valid(cw_config_t * config)
 	if ('\0' != config->gen_conf.sound_device[0]) {
 		if (config->gen_conf.sound_system == CW_AUDIO_SOUNDCARD) {
 			fprintf(stderr, "libcw: a device has been specified for 'soundcard' sound system\n");
-			fprintf(stderr, "libcw: a device can be specified only for 'console', 'oss', 'alsa' or 'pulseaudio'\n");
+			fprintf(stderr, "libcw: a device can be specified only for 'console', 'oss', 'alsa', 'pulseaudio', 'file', 'jack' or 'rtp'\n");
 			return false;
 		} else if (config->gen_conf.sound_system == CW_AUDIO_NULL) {
 			fprintf(stderr, "libcw: a device has been specified for 'null' sound system\n");
-			fprintf(stderr, "libcw: a device can be specified only for 'console', 'oss', 'alsa' or 'pulseaudio'\n");
+			fprintf(stderr, "libcw: a device can be specified only for 'console', 'oss', 'alsa', 'pulseaudio', 'file', 'jack' or 'rtp'\n");
 			return false;
 		} else {
 			; /* sound_system is one that accepts custom "sound device" */
@@ -134,5 +143,21 @@ int cw_config_is_valid(cw_config_t * config)
 		; /* no custom "sound device" specified, a default will be used */
 	}
 
+	if (config->server_address && config->input_file) {
+		fprintf(stderr, "%s: input file can't be used in server mode\n", config->program_name);
+		return false;
+	}
+
+	if (config->render_output) {
+		if (config->gen_conf.sound_system != CW_AUDIO_FILE) {
+			fprintf(stderr, "%s: output file can be used only with 'file' sound system\n", config->program_name);
+			return false;
+		}
+		if (config->server_address) {
+			fprintf(stderr, "%s: output file can't be used in server mode\n", config->program_name);
+			return false;
+		}
+	}
+
 	return true;
 }
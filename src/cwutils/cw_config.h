@@ -48,6 +48,11 @@ extern "C" {
 #define CW_PRACTICE_TIME_INITIAL   15
 #define CW_PRACTICE_TIME_STEP       1
 
+/* Limits of count of lines of text kept in main display of xcwcp. */
+#define CW_SCROLLBACK_LINES_MIN        10
+#define CW_SCROLLBACK_LINES_MAX    100000
+#define CW_SCROLLBACK_LINES_INITIAL  2000
+
 
 
 
@@ -83,8 +88,10 @@ typedef struct cw_config_t {
 	int gap;
 	int weighting;
 	int practice_time;
+	int scrollback_lines;     /* xcwcp program: limit of lines of text kept in main display. */
 	char * input_file;
 	char * output_file;
+	char * server_address;    /* cw program: [HOST:]PORT of TCP socket or path of Unix socket to serve clients on. */
 
 	bool has_feature_sound_system;           /* Parameters of sound system: sound system type (e.g. ALSA) and device. */
 	bool has_feature_generator;              /* Generator and its basic parameters: tone (frequency), speed, volume. */
@@ -95,12 +102,16 @@ typedef struct cw_config_t {
 
 	bool has_feature_cw_specific;            /* Does the program have features specific to cw program (i.e. is this program the cw program)? */
 	bool has_feature_ui_colors;              /* Can we control color theme of UI (cwcp-specific). */
+	bool has_feature_scrollback;             /* Can we limit count of lines kept in main display (xcwcp-specific). */
 
 	bool has_feature_test_loops;             /* Does the test program allow specifying count of loops executed in each test function? */
 	bool has_feature_test_name;              /* Does the test program allow specifying single one test function to be executed? */
 	bool has_feature_test_quick_only;        /* Does the test program allow selection of tests that can be executed in short time? */
 	bool has_feature_libcw_test_specific;
 	bool has_feature_test_random_seed;       /* Does the test allow passing random seed through command line arg? */
+	bool has_feature_test_virtual_time;      /* Does the test program allow running tests on virtual clock? */
+	bool has_feature_test_resources;         /* Does the test program allow saving measurements of resources used by tests? */
+	bool has_feature_test_jobs;              /* Does the test program allow executing test sets in parallel worker processes? */
 
 	/*
 	 * Program-specific state variables, settable from the command line, or from
@@ -115,6 +126,8 @@ typedef struct cw_config_t {
 	bool do_commands;       /* Execute embedded commands */
 	bool do_combinations;   /* Execute [...] combinations */
 	bool do_comments;       /* Allow {...} as comments */
+	bool bulk_input;        /* Read input in large chunks and queue runs of characters without waiting for each one */
+	bool render_output;     /* Render sound to file (-O option) as fast as possible, no real-time pacing */
 
 
 	/* These fields are used in libcw tests only. */
@@ -123,6 +136,9 @@ typedef struct cw_config_t {
 	char test_function_name[128];    /* Execute only a test function with this name. */
 	int test_loops;                  /* How many times tested function should be executed in a a single test function? */
 	bool test_quick_only;            /* Execute tests that are flagged as 'quick enough to make <make check> target run in short time'. */
+	bool test_virtual_time;          /* Run the library on virtual clock instead of real time. */
+	char test_resources_file[256];   /* Measure resources used by each test function and save them as JSON to this file. */
+	int test_jobs;                   /* How many worker processes execute test sets in parallel? Values smaller than 2 mean "execute everything in main process". */
 	/* Some tests use lrand48() or mrand48(). Use this specific seed
 	   instead of some default value to seed randomness. */
 	long int test_random_seed;
@@ -0,0 +1,1233 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2022  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation; either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc., 51
+  Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libcw.h>
+#include <libcw2.h>
+
+#include "cw_pileup.h"
+
+
+
+
+/* Max count of tones of one transmission of a station. */
+#define CW_PILEUP_TONES_MAX 512
+
+/* Size of buffer for text sent by station in one transmission. */
+#define CW_PILEUP_TEXT_SIZE 64
+
+/* Size of buffer for word received from operator. */
+#define CW_PILEUP_WORD_SIZE 32
+
+/* Initial capacity of buffer of operator's key events. */
+#define CW_PILEUP_EVENTS_CAPACITY 64
+
+/* Range of periods of fading of signal of station [ms]. */
+#define CW_PILEUP_QSB_PERIOD_MIN  3000
+#define CW_PILEUP_QSB_PERIOD_MAX 12000
+
+/* Dot duration at 1 wpm (PARIS timing) [us]. */
+#define CW_PILEUP_DOT_DURATION_1WPM 1200000
+
+#define CW_PILEUP_NSECS_PER_MSEC 1000000LL
+
+
+
+
+typedef enum {
+	/* Station doesn't transmit and waits for operator. */
+	CW_PILEUP_STATION_IDLE,
+	/* Station will transmit its text when it's its turn. */
+	CW_PILEUP_STATION_PENDING,
+	/* Tones of text are being played. */
+	CW_PILEUP_STATION_SENDING
+} cw_pileup_station_state_t;
+
+
+
+
+typedef struct {
+	char callsign[CW_PILEUP_CALLSIGN_SIZE];
+
+	/* Channel of mixer. */
+	cw_gen_t * gen;
+
+	int speed;      /* [wpm] */
+	int frequency;  /* [Hz] */
+	int volume;     /* [%], volume without fading */
+	int qsb_period; /* [ms] */
+	int qsb_phase;  /* [ms] */
+	int delay;      /* Delay of reply after end of operator's transmission [ms]. */
+
+	/* Volume currently set in the channel. */
+	int current_volume;
+
+	cw_pileup_station_state_t state;
+
+	/* Station has called in current round. */
+	bool has_called;
+
+	/* Station has received report from operator. */
+	bool is_worked;
+
+	char text[CW_PILEUP_TEXT_SIZE];
+} cw_pileup_station_t;
+
+
+
+
+struct cw_pileup_t {
+	cw_pileup_config_t conf;
+
+	cw_mixer_t * mixer;
+	cw_pileup_station_t * stations;
+
+	/* Receiver decoding operator's keying. */
+	cw_rec_t * rec;
+
+	/* Key events of operator, added by cw_pileup_key_event()
+	   (usually from a thread of generator calling keying callback),
+	   consumed by cw_pileup_poll(). */
+	pthread_mutex_t events_mutex;
+	cw_rec_event_t * events;
+	size_t n_events;
+	size_t events_capacity;
+	bool is_key_closed;
+
+	/* Timestamp of last activity of operator: call of
+	   cw_pileup_cq() or end of last Mark [ns]. */
+	int64_t last_activity;
+
+	/* Timestamp of last event given to receiver [ns]. */
+	int64_t last_rec_timestamp;
+
+	/* Word received from operator so far. */
+	char word[CW_PILEUP_WORD_SIZE];
+	size_t word_len;
+
+	/* Output buffer of cw_pileup_poll(). */
+	char * received;
+	size_t received_size;
+	size_t received_len;
+
+	/* Time passed to current call of cw_pileup_poll() [ns]. */
+	int64_t now;
+
+	int n_worked;
+
+	uint32_t random_state;
+};
+
+
+
+
+static const char * const cw_pileup_callsigns[] = {
+	"DL1ABC", "SP5XYZ", "G4KLM", "F6DEF", "I2QRS", "EA3TUV", "OK1WX", "HA5NOP",
+	"ON4GHI", "PA3JKL", "OH2MNO", "SM6PQR", "LA9STU", "OZ7VWX", "YO3YZA", "LZ2BCD",
+	"S51EFG", "9A2HIJ", "UR5KLM", "YL2NOP", "LY3QRS", "ES5TUV", "OE1WXY", "HB9ZAB",
+	"K1CDE", "W2FGH", "N3IJK", "AA4LMN", "VE3OPQ", "JA1RST", "VK2UVW", "ZL1XYZ",
+	"PY2ABD", "LU5EFH", "ZS6IJL", "UA3MNP", "R9QRT", "4X4UVX", "SV1YZB", "CT1CDF"
+};
+
+
+
+
+static uint32_t cw_pileup_random(cw_pileup_t * pileup);
+static int cw_pileup_random_in_range(cw_pileup_t * pileup, int min, int max);
+static void cw_pileup_station_init(cw_pileup_t * pileup, cw_pileup_station_t * station);
+static void cw_pileup_station_transmit(cw_pileup_station_t * station, const char * text);
+static void cw_pileup_station_silence(cw_pileup_station_t * station);
+static int cw_pileup_station_text_to_tones(cw_pileup_t * pileup, const cw_pileup_station_t * station, cw_gen_tone_t * tones, int capacity);
+static void cw_pileup_station_update(cw_pileup_t * pileup, cw_pileup_station_t * station);
+static int cw_pileup_station_qsb_volume(const cw_pileup_t * pileup, const cw_pileup_station_t * station);
+static void cw_pileup_rec_callback(void * arg, int64_t timestamp, char character, bool is_error);
+static void cw_pileup_handle_word(cw_pileup_t * pileup, const char * word);
+static bool cw_pileup_word_is_one_of(const char * word, const char * const * list);
+static int cw_pileup_hamming_distance(const char * a, const char * b);
+
+
+
+
+/**
+   \brief Set default values in configuration of pileup
+
+   Default pileup has a dozen stations with callsigns from
+   cw_pileup_default_callsigns(), calling at 22-32 wpm in 400-900 Hz
+   with moderate fading and jitter.
+
+   \param conf - configuration to initialize
+*/
+void cw_pileup_config_init(cw_pileup_config_t * conf)
+{
+	memset(conf, 0, sizeof (cw_pileup_config_t));
+
+	conf->n_stations = 12;
+	conf->callsigns = cw_pileup_default_callsigns(&conf->n_callsigns);
+	conf->speed_min = 22;
+	conf->speed_max = 32;
+	conf->frequency_min = 400;
+	conf->frequency_max = 900;
+	conf->volume_min = 2;
+	conf->volume_max = 8;
+	conf->qsb_depth = 50;
+	conf->jitter = 10;
+	conf->activity = 60;
+	conf->delay_max = 800;
+	conf->operator_speed = 0;
+	conf->seed = (unsigned int) time(NULL);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Get built-in list of callsigns
+
+   The list can be used when there is no dictionary of callsigns.
+
+   \param n_callsigns - count of callsigns in returned list
+
+   \return list of callsigns
+*/
+const char * const * cw_pileup_default_callsigns(int * n_callsigns)
+{
+	*n_callsigns = (int) (sizeof (cw_pileup_callsigns) / sizeof (cw_pileup_callsigns[0]));
+	return cw_pileup_callsigns;
+}
+
+
+
+
+/**
+   \brief Create new pileup
+
+   Mixer with one channel per station is opened with \p gen_conf.
+   Stations don't call until cw_pileup_cq() is called.
+
+   On invalid configuration the function returns NULL and sets errno
+   to EINVAL.
+
+   \param gen_conf - configuration of sound device
+   \param conf - configuration of pileup
+
+   \return new pileup on success
+   \return NULL on failure
+*/
+cw_pileup_t * cw_pileup_new(const cw_gen_config_t * gen_conf, const cw_pileup_config_t * conf)
+{
+	if (conf->n_stations < 1 || conf->n_stations > CW_MIXER_N_CHANNELS_MAX
+	    || NULL == conf->callsigns || conf->n_callsigns < 1
+	    || conf->speed_min < CW_SPEED_MIN || conf->speed_max > CW_SPEED_MAX || conf->speed_min > conf->speed_max
+	    || conf->frequency_min < CW_FREQUENCY_MIN || conf->frequency_max > CW_FREQUENCY_MAX || conf->frequency_min > conf->frequency_max
+	    || conf->volume_min < CW_VOLUME_MIN || conf->volume_max > CW_VOLUME_MAX || conf->volume_min > conf->volume_max
+	    || conf->qsb_depth < 0 || conf->qsb_depth > 100
+	    || conf->jitter < 0 || conf->jitter > 50
+	    || conf->activity < 0 || conf->activity > 100
+	    || conf->delay_max < 0
+	    || (0 != conf->operator_speed && (conf->operator_speed < CW_SPEED_MIN || conf->operator_speed > CW_SPEED_MAX))) {
+
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_pileup_t * pileup = (cw_pileup_t *) calloc(1, sizeof (cw_pileup_t));
+	if (NULL == pileup) {
+		return NULL;
+	}
+	pileup->conf = *conf;
+	pileup->random_state = 0 == conf->seed ? 1 : (uint32_t) conf->seed;
+	pthread_mutex_init(&pileup->events_mutex, NULL);
+
+	pileup->events_capacity = CW_PILEUP_EVENTS_CAPACITY;
+	pileup->events = (cw_rec_event_t *) malloc(pileup->events_capacity * sizeof (cw_rec_event_t));
+	pileup->stations = (cw_pileup_station_t *) calloc((size_t) conf->n_stations, sizeof (cw_pileup_station_t));
+	if (NULL == pileup->events || NULL == pileup->stations) {
+		cw_pileup_delete(&pileup);
+		return NULL;
+	}
+
+	pileup->rec = cw_rec_new();
+	if (NULL == pileup->rec) {
+		cw_pileup_delete(&pileup);
+		return NULL;
+	}
+	if (0 == conf->operator_speed) {
+		cw_rec_enable_adaptive_mode(pileup->rec);
+	} else {
+		cw_rec_disable_adaptive_mode(pileup->rec);
+		cw_rec_set_speed(pileup->rec, conf->operator_speed);
+	}
+
+	pileup->mixer = cw_mixer_new(gen_conf, conf->n_stations);
+	if (NULL == pileup->mixer) {
+		cw_pileup_delete(&pileup);
+		return NULL;
+	}
+
+	for (int i = 0; i < conf->n_stations; i++) {
+		cw_pileup_station_t * station = &pileup->stations[i];
+		station->gen = cw_mixer_get_channel(pileup->mixer, i);
+		cw_pileup_station_init(pileup, station);
+	}
+
+	return pileup;
+}
+
+
+
+
+/**
+   \brief Delete pileup
+
+   Mixer is stopped if it has been started. Pointer to \p pileup is
+   set to NULL.
+
+   \param pileup - pointer to pileup to delete
+*/
+void cw_pileup_delete(cw_pileup_t ** pileup)
+{
+	if (NULL == pileup || NULL == *pileup) {
+		return;
+	}
+
+	if ((*pileup)->mixer) {
+		cw_mixer_stop((*pileup)->mixer);
+		cw_mixer_delete(&(*pileup)->mixer);
+	}
+	cw_rec_delete(&(*pileup)->rec);
+	free((*pileup)->stations);
+	free((*pileup)->events);
+	pthread_mutex_destroy(&(*pileup)->events_mutex);
+
+	free(*pileup);
+	*pileup = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   \brief Start playing the pileup
+
+   \param pileup - pileup to start
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+cw_ret_t cw_pileup_start(cw_pileup_t * pileup)
+{
+	return cw_mixer_start(pileup->mixer);
+}
+
+
+
+
+/**
+   \brief Stop playing the pileup
+
+   \param pileup - pileup to stop
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+cw_ret_t cw_pileup_stop(cw_pileup_t * pileup)
+{
+	return cw_mixer_stop(pileup->mixer);
+}
+
+
+
+
+/**
+   \brief Start new round of calls
+
+   This is what happens when operator sends "CQ" or "TU": stations
+   that have been worked go away and are replaced by new stations,
+   and stations that are active (see cw_pileup_config_t::activity)
+   call the operator.
+
+   \param pileup - pileup
+   \param now - current time [ns]
+*/
+void cw_pileup_cq(cw_pileup_t * pileup, int64_t now)
+{
+	pileup->last_activity = now;
+
+	for (int i = 0; i < pileup->conf.n_stations; i++) {
+		cw_pileup_station_t * station = &pileup->stations[i];
+		cw_pileup_station_silence(station);
+		if (station->is_worked) {
+			cw_pileup_station_init(pileup, station);
+		}
+		station->has_called = false;
+
+		if (cw_pileup_random_in_range(pileup, 1, 100) <= pileup->conf.activity) {
+			station->has_called = true;
+			cw_pileup_station_transmit(station, station->callsign);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Add key event of operator
+
+   The function can be called from any thread, e.g. from keying
+   callback of generator used by operator.
+
+   \param pileup - pileup
+   \param is_closed - new state of operator's key
+   \param timestamp - timestamp of the event [ns]
+*/
+void cw_pileup_key_event(cw_pileup_t * pileup, bool is_closed, int64_t timestamp)
+{
+	pthread_mutex_lock(&pileup->events_mutex);
+
+	if (is_closed == pileup->is_key_closed) {
+		/* Repeated state of key is not an event. */
+		pthread_mutex_unlock(&pileup->events_mutex);
+		return;
+	}
+
+	if (pileup->n_events == pileup->events_capacity) {
+		const size_t capacity = 2 * pileup->events_capacity;
+		cw_rec_event_t * events = (cw_rec_event_t *) realloc(pileup->events, capacity * sizeof (cw_rec_event_t));
+		if (NULL == events) {
+			pthread_mutex_unlock(&pileup->events_mutex);
+			return;
+		}
+		pileup->events = events;
+		pileup->events_capacity = capacity;
+	}
+
+	pileup->events[pileup->n_events].type = is_closed ? CW_REC_EVENT_MARK_BEGIN : CW_REC_EVENT_MARK_END;
+	pileup->events[pileup->n_events].timestamp = timestamp;
+	pileup->n_events++;
+	pileup->is_key_closed = is_closed;
+
+	pthread_mutex_unlock(&pileup->events_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Receive operator's keying and let stations react to it
+
+   Call the function periodically (e.g. every 10 ms). Characters
+   received from operator since previous call are reported in \p
+   received (' ' for inter-word-space), and stations react to each
+   complete word. Stations whose turn it is start transmitting, and
+   fading of signals is updated.
+
+   \param pileup - pileup
+   \param now - current time [ns]
+   \param received - buffer for received characters, may be NULL
+   \param size - size of \p received, including terminating NUL
+
+   \return count of characters put in \p received
+*/
+int cw_pileup_poll(cw_pileup_t * pileup, int64_t now, char * received, size_t size)
+{
+	pthread_mutex_lock(&pileup->events_mutex);
+	/* Last slot is for poll event. */
+	cw_rec_event_t events[CW_PILEUP_EVENTS_CAPACITY + 1];
+	size_t n_events = pileup->n_events < CW_PILEUP_EVENTS_CAPACITY ? pileup->n_events : CW_PILEUP_EVENTS_CAPACITY;
+	memcpy(events, pileup->events, n_events * sizeof (cw_rec_event_t));
+	memmove(pileup->events, pileup->events + n_events, (pileup->n_events - n_events) * sizeof (cw_rec_event_t));
+	pileup->n_events -= n_events;
+	const bool is_key_closed = pileup->is_key_closed;
+	pthread_mutex_unlock(&pileup->events_mutex);
+
+	/* Timestamps given to receiver must not decrease. */
+	for (size_t i = 0; i < n_events; i++) {
+		if (events[i].timestamp < pileup->last_rec_timestamp) {
+			events[i].timestamp = pileup->last_rec_timestamp;
+		}
+		pileup->last_rec_timestamp = events[i].timestamp;
+	}
+	if (n_events > 0 && pileup->last_activity < pileup->last_rec_timestamp) {
+		pileup->last_activity = pileup->last_rec_timestamp;
+	}
+	if (now < pileup->last_rec_timestamp) {
+		now = pileup->last_rec_timestamp;
+	}
+	events[n_events].type = CW_REC_EVENT_POLL;
+	events[n_events].timestamp = now;
+	n_events++;
+	pileup->last_rec_timestamp = now;
+
+	pileup->now = now;
+	pileup->received = received;
+	pileup->received_size = size;
+	pileup->received_len = 0;
+	if (CW_SUCCESS != cw_rec_process_events(pileup->rec, events, n_events, cw_pileup_rec_callback, pileup)) {
+		/* Garbled keying. Start receiving from scratch. */
+		cw_rec_reset_state(pileup->rec);
+		pileup->word_len = 0;
+	}
+	if (received && size > 0) {
+		received[pileup->received_len] = '\0';
+	}
+
+	for (int i = 0; i < pileup->conf.n_stations; i++) {
+		cw_pileup_station_t * station = &pileup->stations[i];
+
+		if (CW_PILEUP_STATION_PENDING == station->state
+		    && !is_key_closed
+		    && now - pileup->last_activity >= station->delay * CW_PILEUP_NSECS_PER_MSEC) {
+
+			cw_gen_tone_t tones[CW_PILEUP_TONES_MAX];
+			const int n_tones = cw_pileup_station_text_to_tones(pileup, station, tones, CW_PILEUP_TONES_MAX);
+			cw_gen_enqueue_tones(station->gen, tones, (size_t) n_tones);
+			station->state = CW_PILEUP_STATION_SENDING;
+
+		} else if (CW_PILEUP_STATION_SENDING == station->state
+			   && 0 == cw_gen_get_queue_length(station->gen)) {
+
+			station->state = CW_PILEUP_STATION_IDLE;
+		}
+
+		cw_pileup_station_update(pileup, station);
+	}
+
+	return (int) pileup->received_len;
+}
+
+
+
+
+/**
+   \brief Get count of stations worked by operator
+
+   \param pileup - pileup
+
+   \return count of worked stations
+*/
+int cw_pileup_get_n_worked(const cw_pileup_t * pileup)
+{
+	return pileup->n_worked;
+}
+
+
+
+
+/**
+   \brief Get count of stations calling in current round
+
+   \param pileup - pileup
+
+   \return count of stations that have called and haven't been worked
+*/
+int cw_pileup_get_n_calling(const cw_pileup_t * pileup)
+{
+	int n = 0;
+	for (int i = 0; i < pileup->conf.n_stations; i++) {
+		if (pileup->stations[i].has_called && !pileup->stations[i].is_worked) {
+			n++;
+		}
+	}
+	return n;
+}
+
+
+
+
+/**
+   \brief Get current time for functions of pileup
+
+   \return current time of monotonic clock [ns]
+*/
+int64_t cw_pileup_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 * CW_PILEUP_NSECS_PER_MSEC + ts.tv_nsec;
+}
+
+
+
+
+/* xorshift32: good enough for simulation, and the same seed always
+   gives the same pileup. */
+static uint32_t cw_pileup_random(cw_pileup_t * pileup)
+{
+	uint32_t x = pileup->random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pileup->random_state = x;
+	return x;
+}
+
+
+
+
+static int cw_pileup_random_in_range(cw_pileup_t * pileup, int min, int max)
+{
+	return min + (int) (cw_pileup_random(pileup) % (uint32_t) (max - min + 1));
+}
+
+
+
+
+/**
+   \brief Give station random callsign and parameters
+
+   \param pileup - pileup
+   \param station - station to initialize
+*/
+static void cw_pileup_station_init(cw_pileup_t * pileup, cw_pileup_station_t * station)
+{
+	const cw_pileup_config_t * conf = &pileup->conf;
+
+	/* Callsign not used by other stations, if possible. */
+	for (int attempt = 0; attempt < 2 * conf->n_callsigns; attempt++) {
+		const char * callsign = conf->callsigns[cw_pileup_random_in_range(pileup, 0, conf->n_callsigns - 1)];
+		bool is_used = false;
+		for (int i = 0; i < conf->n_stations; i++) {
+			if (&pileup->stations[i] != station && 0 == strcmp(pileup->stations[i].callsign, callsign)) {
+				is_used = true;
+				break;
+			}
+		}
+		snprintf(station->callsign, sizeof (station->callsign), "%s", callsign);
+		if (!is_used) {
+			break;
+		}
+	}
+
+	station->speed = cw_pileup_random_in_range(pileup, conf->speed_min, conf->speed_max);
+	station->frequency = cw_pileup_random_in_range(pileup, conf->frequency_min, conf->frequency_max);
+	station->volume = cw_pileup_random_in_range(pileup, conf->volume_min, conf->volume_max);
+	station->qsb_period = cw_pileup_random_in_range(pileup, CW_PILEUP_QSB_PERIOD_MIN, CW_PILEUP_QSB_PERIOD_MAX);
+	station->qsb_phase = cw_pileup_random_in_range(pileup, 0, station->qsb_period - 1);
+	station->delay = cw_pileup_random_in_range(pileup, 0, conf->delay_max);
+
+	station->state = CW_PILEUP_STATION_IDLE;
+	station->has_called = false;
+	station->is_worked = false;
+	station->text[0] = '\0';
+
+	station->current_volume = station->volume;
+	cw_gen_set_volume(station->gen, station->volume);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Make station transmit text when it's its turn
+
+   Anything the station is transmitting now is discarded.
+
+   \param station - station
+   \param text - text to transmit
+*/
+static void cw_pileup_station_transmit(cw_pileup_station_t * station, const char * text)
+{
+	cw_gen_flush_queue(station->gen);
+	snprintf(station->text, sizeof (station->text), "%s", text);
+	station->state = CW_PILEUP_STATION_PENDING;
+
+	return;
+}
+
+
+
+
+static void cw_pileup_station_silence(cw_pileup_station_t * station)
+{
+	cw_gen_flush_queue(station->gen);
+	station->state = CW_PILEUP_STATION_IDLE;
+
+	return;
+}
+
+
+
+
+/**
+   \brief Convert text of station into tones
+
+   Durations of Marks and Spaces follow speed of the station, each of
+   them randomly stretched or shrunk by up to
+   cw_pileup_config_t::jitter percent.
+
+   \param pileup - pileup
+   \param station - station
+   \param tones - output array of tones
+   \param capacity - capacity of \p tones
+
+   \return count of tones put in \p tones
+*/
+static int cw_pileup_station_text_to_tones(cw_pileup_t * pileup, const cw_pileup_station_t * station, cw_gen_tone_t * tones, int capacity)
+{
+	const int dot = CW_PILEUP_DOT_DURATION_1WPM / station->speed;
+	const int jitter = pileup->conf.jitter;
+	int n = 0;
+
+	for (const char * c = station->text; *c && n < capacity; c++) {
+		if (' ' == *c) {
+			/* Inter-character-space (3 dots) has already been
+			   added after previous character. */
+			const int duration = 4 * dot * cw_pileup_random_in_range(pileup, 100 - jitter, 100 + jitter) / 100;
+			tones[n++] = (cw_gen_tone_t) { .frequency = 0, .duration = duration, .is_first = false };
+			continue;
+		}
+
+		char * representation = cw_character_to_representation(*c);
+		if (NULL == representation) {
+			continue;
+		}
+		const size_t len = strlen(representation);
+		if (n + 2 * (int) len > capacity) {
+			free(representation);
+			break;
+		}
+		for (size_t i = 0; i < len; i++) {
+			const int mark = ('.' == representation[i] ? 1 : 3) * dot;
+			const int space = (i == len - 1 ? 3 : 1) * dot;
+			tones[n++] = (cw_gen_tone_t) {
+				.frequency = station->frequency,
+				.duration = mark * cw_pileup_random_in_range(pileup, 100 - jitter, 100 + jitter) / 100,
+				.is_first = 0 == i };
+			tones[n++] = (cw_gen_tone_t) {
+				.frequency = 0,
+				.duration = space * cw_pileup_random_in_range(pileup, 100 - jitter, 100 + jitter) / 100,
+				.is_first = false };
+		}
+		free(representation);
+	}
+
+	return n;
+}
+
+
+
+
+/**
+   \brief Get volume of station with fading
+
+   Fading is a triangle wave: volume goes from full to reduced by
+   cw_pileup_config_t::qsb_depth percent and back within period of
+   fading of the station.
+
+   \param pileup - pileup
+   \param station - station
+
+   \return volume of the station at current time [%]
+*/
+static int cw_pileup_station_qsb_volume(const cw_pileup_t * pileup, const cw_pileup_station_t * station)
+{
+	const int64_t t = pileup->now / CW_PILEUP_NSECS_PER_MSEC + station->qsb_phase;
+	const int position = (int) (t % station->qsb_period);
+	/* 100 at edges of period, 0 in the middle. */
+	int level = 2 * position - station->qsb_period;
+	level = (level < 0 ? -level : level) * 100 / station->qsb_period;
+
+	const int attenuation = pileup->conf.qsb_depth * (100 - level) / 100;
+	return station->volume * (100 - attenuation) / 100;
+}
+
+
+
+
+static void cw_pileup_station_update(cw_pileup_t * pileup, cw_pileup_station_t * station)
+{
+	const int volume = cw_pileup_station_qsb_volume(pileup, station);
+	if (volume != station->current_volume) {
+		cw_gen_set_volume(station->gen, volume);
+		station->current_volume = volume;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Receive a character from operator
+
+   Callback of receiver, see cw_rec_process_events().
+*/
+static void cw_pileup_rec_callback(void * arg, __attribute__((unused)) int64_t timestamp, char character, bool is_error)
+{
+	cw_pileup_t * pileup = (cw_pileup_t *) arg;
+
+	if (pileup->received && pileup->received_len + 1 < pileup->received_size) {
+		pileup->received[pileup->received_len++] = is_error ? '#' : character;
+	}
+
+	if (' ' == character) {
+		pileup->word[pileup->word_len] = '\0';
+		if (pileup->word_len > 0) {
+			cw_pileup_handle_word(pileup, pileup->word);
+		}
+		pileup->word_len = 0;
+	} else if (is_error) {
+		/* Word with unknown character doesn't match anything. */
+		pileup->word_len = 0;
+	} else if (pileup->word_len + 1 < sizeof (pileup->word)) {
+		pileup->word[pileup->word_len++] = character;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Let stations react to word sent by operator
+
+   \param pileup - pileup
+   \param word - word received from operator (upper case)
+*/
+static void cw_pileup_handle_word(cw_pileup_t * pileup, const char * word)
+{
+	static const char * const new_round[] = { "CQ", "QRZ", "QRZ?", "TEST", "TU", NULL };
+	static const char * const repeat[] = { "?", "AGN", "AGN?", NULL };
+
+	if (cw_pileup_word_is_one_of(word, new_round)) {
+		cw_pileup_cq(pileup, pileup->now);
+		return;
+	}
+
+	if (cw_pileup_word_is_one_of(word, repeat)) {
+		for (int i = 0; i < pileup->conf.n_stations; i++) {
+			cw_pileup_station_t * station = &pileup->stations[i];
+			if (station->has_called && !station->is_worked) {
+				cw_pileup_station_transmit(station, station->callsign);
+			}
+		}
+		return;
+	}
+
+	const char * question = strchr(word, '?');
+	if (question) {
+		/* Part of callsign: only matching stations call again. */
+		char part[CW_PILEUP_WORD_SIZE] = { 0 };
+		memcpy(part, word, (size_t) (question - word));
+		for (int i = 0; i < pileup->conf.n_stations; i++) {
+			cw_pileup_station_t * station = &pileup->stations[i];
+			if (!station->has_called || station->is_worked) {
+				continue;
+			}
+			if (strstr(station->callsign, part)) {
+				cw_pileup_station_transmit(station, station->callsign);
+			} else {
+				cw_pileup_station_silence(station);
+			}
+		}
+		return;
+	}
+
+	for (int i = 0; i < pileup->conf.n_stations; i++) {
+		cw_pileup_station_t * station = &pileup->stations[i];
+		if (station->has_called && !station->is_worked && 0 == strcmp(station->callsign, word)) {
+			/* Operator got the callsign right: report, and
+			   everybody else waits for next round. */
+			for (int j = 0; j < pileup->conf.n_stations; j++) {
+				cw_pileup_station_silence(&pileup->stations[j]);
+			}
+			station->is_worked = true;
+			pileup->n_worked++;
+			cw_pileup_station_transmit(station, "TU 5NN");
+			return;
+		}
+	}
+
+	for (int i = 0; i < pileup->conf.n_stations; i++) {
+		cw_pileup_station_t * station = &pileup->stations[i];
+		if (station->has_called && !station->is_worked && 1 == cw_pileup_hamming_distance(station->callsign, word)) {
+			/* Almost right: station corrects the operator. */
+			char text[CW_PILEUP_TEXT_SIZE];
+			snprintf(text, sizeof (text), "%s %s", station->callsign, station->callsign);
+			for (int j = 0; j < pileup->conf.n_stations; j++) {
+				cw_pileup_station_silence(&pileup->stations[j]);
+			}
+			cw_pileup_station_transmit(station, text);
+			return;
+		}
+	}
+
+	/* Other words (e.g. report sent after callsign) are ignored. */
+	return;
+}
+
+
+
+
+static bool cw_pileup_word_is_one_of(const char * word, const char * const * list)
+{
+	for (int i = 0; list[i]; i++) {
+		if (0 == strcmp(word, list[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+/* Count of positions at which characters differ. -1 for strings of
+   different lengths. */
+static int cw_pileup_hamming_distance(const char * a, const char * b)
+{
+	if (strlen(a) != strlen(b)) {
+		return -1;
+	}
+	int distance = 0;
+	for (; *a; a++, b++) {
+		if (*a != *b) {
+			distance++;
+		}
+	}
+	return distance;
+}
+
+
+
+
+#ifdef CW_PILEUP_UNIT_TESTS
+
+
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libcw_debug.h"
+
+
+
+
+static unsigned int test_cw_pileup_new(void);
+static unsigned int test_cw_pileup_words(void);
+static unsigned int test_cw_pileup_tones(void);
+
+static void test_cw_pileup_send(cw_pileup_t * pileup, const char * text, int64_t * now, char * received, size_t size);
+static cw_pileup_t * test_cw_pileup_create(int fd, int n_stations);
+
+
+typedef unsigned int (*cw_pileup_test_function_t)(void);
+
+static cw_pileup_test_function_t cw_pileup_unit_tests[] = {
+	test_cw_pileup_new,
+	test_cw_pileup_words,
+	test_cw_pileup_tones,
+	NULL
+};
+
+
+
+
+int main(void)
+{
+	fprintf(stderr, "unit tests for \"pileup\" functions\n\n");
+
+	int i = 0;
+	while (cw_pileup_unit_tests[i]) {
+		cw_pileup_unit_tests[i]();
+		i++;
+	}
+
+	/* "make check" facility requires this message to be
+	   printed on stdout; don't localize it */
+	fprintf(stdout, "\npileup: test result: success\n\n");
+
+	return 0;
+}
+
+
+
+
+/* Pileup playing into raw file, with all stations calling after CQ. */
+static cw_pileup_t * test_cw_pileup_create(int fd, int n_stations)
+{
+	cw_gen_config_t gen_conf = { 0 };
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	gen_conf.file_fd = fd;
+	gen_conf.file_format = CW_FILE_FORMAT_RAW;
+
+	cw_pileup_config_t conf;
+	cw_pileup_config_init(&conf);
+	conf.n_stations = n_stations;
+	conf.activity = 100;
+	conf.operator_speed = 20;
+	conf.seed = 12345;
+
+	return cw_pileup_new(&gen_conf, &conf);
+}
+
+
+
+
+/* Key \p text at 20 wpm as operator would do, and poll pileup until
+   the last word has been received. Received characters are appended
+   to \p received, if it's not NULL. */
+static void test_cw_pileup_send(cw_pileup_t * pileup, const char * text, int64_t * now, char * received, size_t size)
+{
+	const int64_t dot = (CW_PILEUP_DOT_DURATION_1WPM / 20) * 1000LL;
+	char buffer[CW_PILEUP_WORD_SIZE];
+
+	for (const char * c = text; *c; c++) {
+		char * representation = cw_character_to_representation(*c);
+		cw_assert (representation, "no representation of '%c'", *c);
+		for (const char * mark = representation; *mark; mark++) {
+			cw_pileup_key_event(pileup, true, *now);
+			*now += ('.' == *mark ? 1 : 3) * dot;
+			cw_pileup_key_event(pileup, false, *now);
+			*now += dot;
+		}
+		free(representation);
+		*now += 2 * dot;
+		cw_pileup_poll(pileup, *now, buffer, sizeof (buffer));
+		if (received) {
+			strncat(received, buffer, size - strlen(received) - 1);
+		}
+	}
+	/* Inter-word-space ends the word. */
+	*now += 10 * dot;
+	cw_pileup_poll(pileup, *now, buffer, sizeof (buffer));
+	if (received) {
+		strncat(received, buffer, size - strlen(received) - 1);
+	}
+
+	return;
+}
+
+
+
+
+static unsigned int test_cw_pileup_new(void)
+{
+	fprintf(stderr, "pileup: cw_pileup_new():");
+
+	cw_gen_config_t gen_conf = { 0 };
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	gen_conf.file_fd = open("/dev/null", O_WRONLY);
+	gen_conf.file_format = CW_FILE_FORMAT_RAW;
+	cw_assert (gen_conf.file_fd >= 0, "failed to open /dev/null");
+
+	cw_pileup_config_t conf;
+	cw_pileup_config_init(&conf);
+
+	conf.n_stations = 0;
+	cw_assert (NULL == cw_pileup_new(&gen_conf, &conf) && EINVAL == errno, "accepted zero stations");
+	conf.n_stations = CW_MIXER_N_CHANNELS_MAX + 1;
+	cw_assert (NULL == cw_pileup_new(&gen_conf, &conf) && EINVAL == errno, "accepted too many stations");
+	conf.n_stations = 10;
+	conf.speed_min = 30;
+	conf.speed_max = 20;
+	cw_assert (NULL == cw_pileup_new(&gen_conf, &conf) && EINVAL == errno, "accepted inverted speed range");
+	conf.speed_min = 20;
+	conf.speed_max = 30;
+	conf.callsigns = NULL;
+	cw_assert (NULL == cw_pileup_new(&gen_conf, &conf) && EINVAL == errno, "accepted missing callsigns");
+
+	/* Hundreds of stations cost only memory of channels of mixer. */
+	cw_pileup_config_init(&conf);
+	conf.n_stations = CW_MIXER_N_CHANNELS_MAX;
+	cw_pileup_t * pileup = cw_pileup_new(&gen_conf, &conf);
+	cw_assert (pileup, "failed to create pileup with %d stations", conf.n_stations);
+	cw_assert (0 == cw_pileup_get_n_worked(pileup), "worked stations in new pileup");
+	cw_assert (0 == cw_pileup_get_n_calling(pileup), "calling stations in new pileup");
+	cw_pileup_delete(&pileup);
+	cw_assert (NULL == pileup, "pointer not reset by delete");
+
+	close(gen_conf.file_fd);
+
+	fprintf(stderr, " passed\n");
+
+	return 0;
+}
+
+
+
+
+static unsigned int test_cw_pileup_words(void)
+{
+	fprintf(stderr, "pileup: reactions to words:");
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cw_assert (fd >= 0, "failed to open /dev/null");
+	cw_pileup_t * pileup = test_cw_pileup_create(fd, 5);
+	cw_assert (pileup, "failed to create pileup");
+
+	int64_t now = 1000 * 1000 * CW_PILEUP_NSECS_PER_MSEC;
+	cw_pileup_cq(pileup, now);
+	cw_assert (5 == cw_pileup_get_n_calling(pileup), "unexpected count of calling stations: %d", cw_pileup_get_n_calling(pileup));
+
+	/* Stations wait for their delays before calling. */
+	cw_pileup_poll(pileup, now, NULL, 0);
+	now += (pileup->conf.delay_max + 1) * CW_PILEUP_NSECS_PER_MSEC;
+	cw_pileup_poll(pileup, now, NULL, 0);
+	for (int i = 0; i < 5; i++) {
+		cw_assert (CW_PILEUP_STATION_SENDING == pileup->stations[i].state, "station %d is not sending", i);
+		cw_assert (cw_gen_get_queue_length(pileup->stations[i].gen) > 0, "no tones of station %d", i);
+	}
+
+	/* Partial callsign: only a matching station repeats. */
+	cw_pileup_station_t * target = &pileup->stations[2];
+	char part[3] = { target->callsign[0], target->callsign[1], '\0' };
+	int n_matching = 0;
+	for (int i = 0; i < 5; i++) {
+		if (strstr(pileup->stations[i].callsign, part)) {
+			n_matching++;
+		}
+	}
+	char text[CW_PILEUP_WORD_SIZE];
+	snprintf(text, sizeof (text), "%s?", part);
+	test_cw_pileup_send(pileup, text, &now, NULL, 0);
+	/* Station with short delay may have already started its reply. */
+	int n_replying = 0;
+	for (int i = 0; i < 5; i++) {
+		if (CW_PILEUP_STATION_IDLE != pileup->stations[i].state) {
+			n_replying++;
+		} else {
+			cw_assert (0 == cw_gen_get_queue_length(pileup->stations[i].gen), "non-matching station %d still sends", i);
+		}
+	}
+	cw_assert (n_replying == n_matching, "unexpected count of matching stations: %d != %d", n_replying, n_matching);
+
+	/* Callsign with one wrong character: station repeats its call twice. */
+	snprintf(text, sizeof (text), "%s", target->callsign);
+	text[strlen(text) - 1] = 'Q' == text[strlen(text) - 1] ? 'X' : 'Q';
+	test_cw_pileup_send(pileup, text, &now, NULL, 0);
+	cw_assert (CW_PILEUP_STATION_IDLE != target->state, "station didn't correct operator");
+	cw_assert (0 == strncmp(target->text, target->callsign, strlen(target->callsign))
+		   && strlen(target->text) == 2 * strlen(target->callsign) + 1, "unexpected correction \"%s\"", target->text);
+
+	/* Full callsign: station is worked, and replies with report. */
+	test_cw_pileup_send(pileup, target->callsign, &now, NULL, 0);
+	cw_assert (1 == cw_pileup_get_n_worked(pileup), "station not worked");
+	cw_assert (target->is_worked, "target station not worked");
+	cw_assert (0 == strcmp(target->text, "TU 5NN"), "unexpected reply \"%s\"", target->text);
+	cw_assert (4 == cw_pileup_get_n_calling(pileup), "unexpected count of calling stations: %d", cw_pileup_get_n_calling(pileup));
+
+	/* "TU" starts new round: worked station is replaced. */
+	char worked_callsign[CW_PILEUP_CALLSIGN_SIZE];
+	snprintf(worked_callsign, sizeof (worked_callsign), "%s", target->callsign);
+	test_cw_pileup_send(pileup, "TU", &now, NULL, 0);
+	cw_assert (!target->is_worked, "worked station not replaced");
+	cw_assert (5 == cw_pileup_get_n_calling(pileup), "unexpected count of calling stations: %d", cw_pileup_get_n_calling(pileup));
+
+	/* Characters received from operator are reported, and all
+	   callers repeat after "AGN". */
+	char received[CW_PILEUP_WORD_SIZE] = { 0 };
+	test_cw_pileup_send(pileup, "AGN", &now, received, sizeof (received));
+	cw_assert (0 == strcmp(received, "AGN "), "unexpected received text \"%s\"", received);
+	for (int i = 0; i < 5; i++) {
+		cw_assert (CW_PILEUP_STATION_IDLE != pileup->stations[i].state, "station %d doesn't repeat", i);
+	}
+
+	cw_pileup_delete(&pileup);
+	close(fd);
+
+	fprintf(stderr, " passed\n");
+
+	return 0;
+}
+
+
+
+
+static unsigned int test_cw_pileup_tones(void)
+{
+	fprintf(stderr, "pileup: tones of stations:");
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cw_assert (fd >= 0, "failed to open /dev/null");
+	cw_pileup_t * pileup = test_cw_pileup_create(fd, 1);
+	cw_assert (pileup, "failed to create pileup");
+
+	cw_pileup_station_t * station = &pileup->stations[0];
+	snprintf(station->text, sizeof (station->text), "EE E");
+
+	/* Without jitter durations follow speed exactly. */
+	pileup->conf.jitter = 0;
+	cw_gen_tone_t tones[CW_PILEUP_TONES_MAX];
+	int n = cw_pileup_station_text_to_tones(pileup, station, tones, CW_PILEUP_TONES_MAX);
+	const int dot = CW_PILEUP_DOT_DURATION_1WPM / station->speed;
+	cw_assert (7 == n, "unexpected count of tones: %d", n);
+	cw_assert (tones[0].frequency == station->frequency && tones[0].duration == dot && tones[0].is_first, "unexpected Mark");
+	cw_assert (0 == tones[1].frequency && tones[1].duration == 3 * dot, "unexpected inter-character-space");
+	cw_assert (0 == tones[4].frequency && tones[4].duration == 4 * dot, "unexpected inter-word-space");
+
+	/* With jitter durations are randomized within limits. */
+	pileup->conf.jitter = 20;
+	n = cw_pileup_station_text_to_tones(pileup, station, tones, CW_PILEUP_TONES_MAX);
+	cw_assert (7 == n, "unexpected count of tones: %d", n);
+	bool is_jittered = false;
+	for (int i = 0; i < n; i++) {
+		if (tones[i].frequency) {
+			cw_assert (tones[i].duration >= dot * 80 / 100 && tones[i].duration <= dot * 120 / 100,
+				   "duration of Mark out of range: %d", tones[i].duration);
+			is_jittered = is_jittered || tones[i].duration != dot;
+		}
+	}
+	cw_assert (is_jittered, "durations not randomized");
+
+	/* Fading stays within depth. */
+	for (int64_t t = 0; t < 20000; t += 250) {
+		pileup->now = t * CW_PILEUP_NSECS_PER_MSEC;
+		const int volume = cw_pileup_station_qsb_volume(pileup, station);
+		cw_assert (volume <= station->volume && volume >= station->volume * (100 - pileup->conf.qsb_depth) / 100 - 1,
+			   "volume out of range: %d", volume);
+	}
+
+	cw_pileup_delete(&pileup);
+	close(fd);
+
+	fprintf(stderr, " passed\n");
+
+	return 0;
+}
+
+
+
+
+#endif /* #ifdef CW_PILEUP_UNIT_TESTS */
@@ -0,0 +1,138 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_CW_PILEUP
+#define H_CW_PILEUP
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libcw2.h>
+
+
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+
+
+
+/*
+  Simulator of contest pileup.
+
+  Many virtual stations, each with its own callsign, speed, pitch,
+  signal strength, fading (QSB) and timing jitter, call the operator
+  at the same time. Each station is a channel of libcw's mixer, so
+  all of them are played through one sound device by one thread.
+
+  Operator's keying is decoded by receiver, and stations react to
+  words received from the operator:
+  - "CQ", "QRZ", "QRZ?", "TEST" or "TU": new round of calls,
+  - "?", "AGN" or "AGN?": stations that have called repeat their calls,
+  - part of callsign with "?" (e.g. "DL?"): only stations with
+    callsigns containing the part repeat their calls,
+  - full callsign: the station replies with report and is counted as
+    worked, other stations stop calling,
+  - callsign with one wrong character: the station repeats its call.
+
+  Stations reply only after the operator has stopped keying, each
+  after its own delay.
+
+  Timestamps are in nanoseconds of monotonic clock, see
+  cw_pileup_now().
+*/
+
+
+
+
+/* Size of buffer for callsign of a station, including terminating NUL. */
+#define CW_PILEUP_CALLSIGN_SIZE 16
+
+
+
+
+typedef struct {
+	/* Count of stations in pileup, 1 - CW_MIXER_N_CHANNELS_MAX. */
+	int n_stations;
+
+	/* Callsigns of stations are picked from this list. The list
+	   must exist as long as the pileup. When a station has been
+	   worked, it is replaced by a station with another callsign. */
+	const char * const * callsigns;
+	int n_callsigns;
+
+	int speed_min;     /* [wpm] */
+	int speed_max;     /* [wpm] */
+	int frequency_min; /* [Hz] */
+	int frequency_max; /* [Hz] */
+	int volume_min;    /* [%] */
+	int volume_max;    /* [%] */
+
+	/* Depth of fading of signals [%]. Zero for no fading. */
+	int qsb_depth;
+
+	/* Random deviation of duration of each Mark and Space [%]. Zero
+	   for perfect timing. */
+	int jitter;
+
+	/* Probability that station calls in new round [%]. */
+	int activity;
+
+	/* Maximal delay of reply of station after end of operator's
+	   transmission [ms]. */
+	int delay_max;
+
+	/* Speed of operator [wpm], used by receiver. Zero for receiver
+	   adapting to operator's speed. */
+	int operator_speed;
+
+	/* Seed of pseudo-random values. The same seed gives the same
+	   pileup. */
+	unsigned int seed;
+} cw_pileup_config_t;
+
+
+
+
+typedef struct cw_pileup_t cw_pileup_t;
+
+
+
+
+void          cw_pileup_config_init(cw_pileup_config_t * conf);
+const char * const * cw_pileup_default_callsigns(int * n_callsigns);
+
+cw_pileup_t * cw_pileup_new(const cw_gen_config_t * gen_conf, const cw_pileup_config_t * conf);
+void          cw_pileup_delete(cw_pileup_t ** pileup);
+
+cw_ret_t      cw_pileup_start(cw_pileup_t * pileup);
+cw_ret_t      cw_pileup_stop(cw_pileup_t * pileup);
+
+void          cw_pileup_cq(cw_pileup_t * pileup, int64_t now);
+void          cw_pileup_key_event(cw_pileup_t * pileup, bool is_closed, int64_t timestamp);
+int           cw_pileup_poll(cw_pileup_t * pileup, int64_t now, char * received, size_t size);
+
+int           cw_pileup_get_n_worked(const cw_pileup_t * pileup);
+int           cw_pileup_get_n_calling(const cw_pileup_t * pileup);
+int64_t       cw_pileup_now(void);
+
+
+
+
+#if defined(__cplusplus)
+}
+#endif
+
+
+
+
+#endif /* #ifndef H_CW_PILEUP */
@@ -0,0 +1,413 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2022  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation; either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc., 51
+  Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libcw.h>
+
+#include "cw_practice.h"
+
+
+
+
+struct cw_practice_s {
+	const cw_dictionary_t *dict;
+
+	/* Ring buffer of NUL-terminated groups. Producer writes at
+	   tail, consumer reads at head. Both indices only grow, and are
+	   taken modulo CW_PRACTICE_BUFFER_SIZE. */
+	char buffer[CW_PRACTICE_BUFFER_SIZE];
+	size_t head;
+	size_t tail;
+
+	/* Producer waits on the semaphore when the buffer is full, and
+	   sets the flag before waiting. Consumer posts the semaphore
+	   only if it has cleared the flag. */
+	sem_t space;
+	bool is_producer_waiting;
+	bool quit;
+
+	pthread_t thread_id;
+};
+
+
+
+
+static void *cw_practice_thread_fn(void *arg);
+static size_t cw_practice_generate_group(const cw_dictionary_t *dict, char *group, size_t size);
+static bool cw_practice_put_group(cw_practice_t *practice, const char *group, size_t len);
+
+
+
+
+/**
+   \brief Create practice text producer and start its thread
+
+   The buffer is filled before the function returns, so the first
+   groups are available at once.
+
+   \param dict - dictionary from which to take words; must exist as long as the producer
+
+   \return new producer on success
+   \return NULL on failure
+*/
+cw_practice_t *cw_practice_new(const cw_dictionary_t *dict)
+{
+	cw_practice_t *practice = (cw_practice_t *) calloc(1, sizeof (cw_practice_t));
+	if (NULL == practice) {
+		fprintf(stderr, "cw_practice: calloc(): %s\n", strerror(errno));
+		return NULL;
+	}
+	practice->dict = dict;
+
+	if (0 != sem_init(&practice->space, 0, 0)) {
+		fprintf(stderr, "cw_practice: sem_init(): %s\n", strerror(errno));
+		free(practice);
+		return NULL;
+	}
+
+	char group[CW_PRACTICE_GROUP_SIZE];
+	for (;;) {
+		const size_t len = cw_practice_generate_group(dict, group, sizeof (group));
+		if (!cw_practice_put_group(practice, group, len)) {
+			break;
+		}
+	}
+
+	if (0 != pthread_create(&practice->thread_id, NULL, cw_practice_thread_fn, practice)) {
+		fprintf(stderr, "cw_practice: pthread_create() failed\n");
+		sem_destroy(&practice->space);
+		free(practice);
+		return NULL;
+	}
+
+	return practice;
+}
+
+
+
+
+/**
+   \brief Stop thread of practice text producer and delete the producer
+
+   \param practice - pointer to producer to delete (may point to NULL)
+*/
+void cw_practice_delete(cw_practice_t **practice)
+{
+	if (NULL == practice || NULL == *practice) {
+		return;
+	}
+
+	__atomic_store_n(&(*practice)->quit, true, __ATOMIC_RELEASE);
+	sem_post(&(*practice)->space);
+	pthread_join((*practice)->thread_id, NULL);
+
+	sem_destroy(&(*practice)->space);
+	free(*practice);
+	*practice = NULL;
+
+	return;
+}
+
+
+
+
+const cw_dictionary_t *cw_practice_get_dictionary(const cw_practice_t *practice)
+{
+	return practice->dict;
+}
+
+
+
+
+/**
+   \brief Get next group of practice text
+
+   The function never waits for the producer: if the producer has
+   fallen behind, the group is generated directly.
+
+   \param practice - producer
+   \param group - buffer for group
+   \param size - size of \p group
+
+   \return length of group placed in \p group
+*/
+size_t cw_practice_get_group(cw_practice_t *practice, char *group, size_t size)
+{
+	if (0 == size) {
+		return 0;
+	}
+
+	size_t head = practice->head;
+	const size_t tail = __atomic_load_n(&practice->tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return cw_practice_generate_group(practice->dict, group, size);
+	}
+
+	size_t len = 0;
+	char c;
+	while ('\0' != (c = practice->buffer[head++ % CW_PRACTICE_BUFFER_SIZE])) {
+		if (len < size - 1) {
+			group[len++] = c;
+		}
+	}
+	group[len] = '\0';
+
+	__atomic_store_n(&practice->head, head, __ATOMIC_RELEASE);
+
+	if (__atomic_exchange_n(&practice->is_producer_waiting, false, __ATOMIC_SEQ_CST)) {
+		sem_post(&practice->space);
+	}
+
+	return len;
+}
+
+
+
+
+/**
+   \brief Put group at tail of ring buffer
+
+   \return true if the group has been put in buffer
+   \return false if there is not enough space in buffer
+*/
+bool cw_practice_put_group(cw_practice_t *practice, const char *group, size_t len)
+{
+	const size_t tail = practice->tail;
+	const size_t head = __atomic_load_n(&practice->head, __ATOMIC_ACQUIRE);
+	if (CW_PRACTICE_BUFFER_SIZE - (tail - head) < len + 1) {
+		return false;
+	}
+
+	for (size_t i = 0; i <= len; i++) {
+		practice->buffer[(tail + i) % CW_PRACTICE_BUFFER_SIZE] = group[i];
+	}
+	__atomic_store_n(&practice->tail, tail + len + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+
+
+/**
+   \brief Put random words of dictionary in buffer for group
+
+   Characters that can't be sent are skipped.
+
+   \return length of group
+*/
+size_t cw_practice_generate_group(const cw_dictionary_t *dict, char *group, size_t size)
+{
+	size_t len = 0;
+	const int group_size = cw_dictionary_get_group_size(dict);
+	for (int i = 0; i < group_size; i++) {
+		const char *word = cw_dictionary_get_random_word(dict);
+		for (int j = 0; '\0' != word[j] && len < size - 1; j++) {
+			const char c = (char) toupper(word[j]);
+			if (' ' != c && cw_character_is_valid(c)) {
+				group[len++] = c;
+			}
+		}
+	}
+	group[len] = '\0';
+
+	return len;
+}
+
+
+
+
+/**
+   \brief Thread function of producer
+
+   Keep the buffer full, sleep while it is full.
+*/
+void *cw_practice_thread_fn(void *arg)
+{
+	cw_practice_t *practice = (cw_practice_t *) arg;
+
+	char group[CW_PRACTICE_GROUP_SIZE];
+	size_t len = cw_practice_generate_group(practice->dict, group, sizeof (group));
+
+	while (!__atomic_load_n(&practice->quit, __ATOMIC_ACQUIRE)) {
+		if (cw_practice_put_group(practice, group, len)) {
+			len = cw_practice_generate_group(practice->dict, group, sizeof (group));
+			continue;
+		}
+
+		/* Buffer is full. Announce that we are going to wait, and
+		   check again: consumer may have taken a group before
+		   seeing the flag. */
+		__atomic_store_n(&practice->is_producer_waiting, true, __ATOMIC_SEQ_CST);
+		if (cw_practice_put_group(practice, group, len)) {
+			if (!__atomic_exchange_n(&practice->is_producer_waiting, false, __ATOMIC_SEQ_CST)) {
+				/* Consumer has cleared the flag and will post (or
+				   has posted) the semaphore. */
+				while (0 != sem_wait(&practice->space) && EINTR == errno) {
+					;
+				}
+			}
+			len = cw_practice_generate_group(practice->dict, group, sizeof (group));
+			continue;
+		}
+
+		while (0 != sem_wait(&practice->space) && EINTR == errno) {
+			;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+#ifdef CW_PRACTICE_UNIT_TESTS
+
+
+
+
+#include "libcw_debug.h"
+
+
+
+
+static unsigned int test_cw_practice_groups(void);
+static unsigned int test_cw_practice_consumer(void);
+
+
+typedef unsigned int (*cw_practice_test_function_t)(void);
+
+static cw_practice_test_function_t cw_practice_unit_tests[] = {
+	test_cw_practice_groups,
+	test_cw_practice_consumer,
+	NULL
+};
+
+
+
+
+int main(void)
+{
+	fprintf(stderr, "unit tests for \"practice\" functions\n\n");
+
+	int i = 0;
+	while (cw_practice_unit_tests[i]) {
+		cw_practice_unit_tests[i]();
+		i++;
+	}
+
+	cw_dictionaries_unload();
+
+	/* "make check" facility requires this message to be
+	   printed on stdout; don't localize it */
+	fprintf(stdout, "\npractice: test result: success\n\n");
+
+	return 0;
+}
+
+
+
+
+/* Groups of every default dictionary are made of valid, uppercase
+   characters, and groups of single-character dictionaries have
+   size of group of the dictionary. */
+unsigned int test_cw_practice_groups(void)
+{
+	fprintf(stderr, "practice: cw_practice_get_group():");
+
+	for (const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL); dict; dict = cw_dictionaries_iterate(dict)) {
+		cw_practice_t *practice = cw_practice_new(dict);
+		cw_assert (practice, "failed to create producer for \"%s\"", cw_dictionary_get_description(dict));
+		cw_assert (dict == cw_practice_get_dictionary(practice), "wrong dictionary");
+
+		const bool is_single_character = 1 == strlen(cw_dictionary_get_random_word(dict));
+		for (int i = 0; i < 100; i++) {
+			char group[CW_PRACTICE_GROUP_SIZE];
+			const size_t len = cw_practice_get_group(practice, group, sizeof (group));
+			cw_assert (len == strlen(group), "wrong length of group");
+			if (is_single_character) {
+				cw_assert ((int) len == cw_dictionary_get_group_size(dict), "wrong size of group \"%s\"", group);
+			}
+			for (size_t j = 0; j < len; j++) {
+				cw_assert (cw_character_is_valid(group[j]) && ' ' != group[j], "invalid character in group \"%s\"", group);
+				cw_assert (toupper(group[j]) == group[j], "lowercase character in group \"%s\"", group);
+			}
+		}
+
+		/* Small buffer gets truncated group. */
+		char small[2];
+		const size_t small_len = cw_practice_get_group(practice, small, sizeof (small));
+		cw_assert (small_len == strlen(small) && small_len <= 1, "group not truncated");
+
+		cw_practice_delete(&practice);
+		cw_assert (NULL == practice, "producer not deleted");
+	}
+
+	fprintf(stderr, " passed\n");
+
+	return 0;
+}
+
+
+
+
+/* Consumer taking groups many times faster than they are played,
+   i.e. more than the size of ring buffer: the producer keeps up, and
+   nothing is lost or corrupted on the way. */
+unsigned int test_cw_practice_consumer(void)
+{
+	fprintf(stderr, "practice: consumer:");
+
+	const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	cw_practice_t *practice = cw_practice_new(dict);
+	cw_assert (practice, "failed to create producer");
+
+	const int group_size = cw_dictionary_get_group_size(dict);
+	size_t total = 0;
+	for (int i = 0; i < 100000; i++) {
+		char group[CW_PRACTICE_GROUP_SIZE];
+		const size_t len = cw_practice_get_group(practice, group, sizeof (group));
+		cw_assert ((int) len == group_size, "wrong size of group %d: \"%s\"", i, group);
+		total += len;
+	}
+	cw_assert (total > CW_PRACTICE_BUFFER_SIZE, "too few characters taken");
+
+	cw_practice_delete(&practice);
+
+	fprintf(stderr, " passed\n");
+
+	return 0;
+}
+
+
+
+
+#endif /* #ifdef CW_PRACTICE_UNIT_TESTS */
@@ -0,0 +1,73 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_CW_PRACTICE
+#define H_CW_PRACTICE
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dictionary.h"
+
+
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+
+
+
+/*
+  Producer of practice text for dictionary modes of cwcp and xcwcp.
+
+  Groups of random words of dictionary (see
+  cw_dictionary_get_group_size()) are generated ahead of time by a
+  background thread, into a single-producer, single-consumer ring
+  buffer without locks. The consuming thread (UI thread that refills
+  generator when its tone queue is low) only copies ready-made groups,
+  and never waits for the producer.
+
+  Groups contain only valid, uppercase characters, and no spaces
+  between them.
+*/
+
+
+
+
+/* Size of ring buffer of groups, including terminating NULs. */
+#define CW_PRACTICE_BUFFER_SIZE 4096
+
+/* Size of buffer for one group, including terminating NUL. Longer
+   groups are truncated. */
+#define CW_PRACTICE_GROUP_SIZE 256
+
+
+
+
+typedef struct cw_practice_s cw_practice_t;
+
+cw_practice_t *cw_practice_new(const cw_dictionary_t *dict);
+void cw_practice_delete(cw_practice_t **practice);
+
+const cw_dictionary_t *cw_practice_get_dictionary(const cw_practice_t *practice);
+size_t cw_practice_get_group(cw_practice_t *practice, char *group, size_t size);
+
+
+
+
+#if defined(__cplusplus)
+}
+#endif
+
+
+
+
+#endif /* #ifndef H_CW_PRACTICE */
@@ -1,10 +1,19 @@
 #include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 
 
 
+#include <libcw_data.h>
+#include <libcw_detector.h>
 #include <libcw_gen.h>
 #include <libcw_utils.h>
 
@@ -19,7 +28,7 @@
 static int  cw_rec_tester_compare_input_and_received(cw_rec_tester_t * tester);
 static void cw_rec_tester_normalize_input_and_received(cw_rec_tester_t * tester);
 
-static void test_callback_func(void * arg, int key_state);
+static void test_callback_func(void * arg, int key_state, int64_t timestamp);
 static void low_tone_queue_callback(void * arg);
 
 static void * cw_rec_tester_receiver_input_generator_fn(void * arg_tester);
@@ -28,6 +37,8 @@ static void cw_rec_tester_init_text_buffers(cw_rec_tester_t * tester, size_t len
 
 static void cw_rec_tester_display_differences(const cw_rec_tester_t * tester);
 
+static size_t cw_rec_tester_edit_distance(const char * a, const char * b);
+
 
 
 
@@ -355,6 +366,7 @@ void cw_rec_tester_configure(cw_rec_tester_t * tester, cw_easy_receiver_t * easy
 	cw_gen_config_t gen_conf = {
 		  .sound_system = CW_AUDIO_NULL
 		, .sound_device = { 0 }
+		, .file_fd = -1
 	};
 
 	tester->gen = cw_gen_new(&gen_conf);
@@ -362,7 +374,7 @@ void cw_rec_tester_configure(cw_rec_tester_t * tester, cw_easy_receiver_t * easy
 	cw_tq_register_low_level_callback_internal(tester->gen->tq, low_tone_queue_callback, tester, 5);
 
 	cw_key_register_generator(&tester->key, tester->gen);
-	cw_gen_register_value_tracking_callback_internal(tester->gen, test_callback_func, (void *) easy_rec);
+	cw_gen_register_timed_value_tracking_callback(tester->gen, test_callback_func, (void *) easy_rec);
 	//cw_key_register_keying_callback(&key, test_callback_func, (void *) easy_rec);
 
 	if (use_ranger) {
@@ -376,16 +388,18 @@ void cw_rec_tester_configure(cw_rec_tester_t * tester, cw_easy_receiver_t * easy
 
 
 
-static void test_callback_func(void * arg, int key_state)
+static void test_callback_func(void * arg, int key_state, int64_t timestamp)
 {
 	/* Inform libcw receiver about new state of straight key ("sk").
 
 	   libcw receiver will process the new state and we will later
-	   try to poll a character or space from it. */
+	   try to poll a character or space from it. The state changes
+	   at the time when it's heard, not when generator dequeues a
+	   tone. */
 
 	cw_easy_receiver_t * easy_rec = (cw_easy_receiver_t *) arg;
 	//fprintf(stderr, "Callback function, key state = %d\n", key_state);
-	cw_easy_receiver_sk_event(easy_rec, key_state);
+	cw_easy_receiver_sk_timed_event(easy_rec, key_state, timestamp);
 }
 
 
@@ -556,3 +570,1248 @@ int cw_rec_tester_on_space(cw_rec_tester_t * tester, cw_rec_data_t * erd, struct
 
 
 
+
+/*
+  Pool of threads processing independent items (cells of sweep, files
+  of corpus). Items are taken in order of their indices, so each item
+  is processed exactly once, by any of the threads.
+*/
+
+
+
+
+typedef struct {
+	cw_rec_tester_pool_fn_t fn;
+	void * arg;
+	size_t n_items;
+
+	size_t next_item; /* Index of next item to process, accessed atomically. */
+	int result;       /* 0, or -1 if any item has failed, accessed atomically. */
+} cw_rec_tester_pool_t;
+
+
+
+
+static void * cw_rec_tester_pool_thread_fn(void * arg);
+
+
+
+
+/**
+   @brief Call @p fn for items from zero to @p n_items - 1 in a pool of threads
+
+   @param[in] fn function processing one item
+   @param[in] arg argument passed to @p fn
+   @param[in] n_items count of items
+   @param[in] n_threads size of pool; 0: count of online CPUs
+
+   @return 0 if all items have been processed successfully
+   @return -1 otherwise
+*/
+int cw_rec_tester_run_pool(cw_rec_tester_pool_fn_t fn, void * arg, size_t n_items, int n_threads)
+{
+	cw_rec_tester_pool_t pool = {
+		.fn = fn,
+		.arg = arg,
+		.n_items = n_items,
+		.next_item = 0,
+		.result = 0
+	};
+
+	long n = n_threads;
+	if (n <= 0) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (n > (long) n_items) {
+		n = (long) n_items;
+	}
+
+	pthread_t * threads = NULL;
+	long n_started = 0;
+	if (n > 1) {
+		threads = (pthread_t *) malloc((size_t) n * sizeof (pthread_t));
+		for (; threads && n_started < n; n_started++) {
+			if (0 != pthread_create(&threads[n_started], NULL, cw_rec_tester_pool_thread_fn, &pool)) {
+				break;
+			}
+		}
+	}
+
+	/* Calling thread is a worker too, so all items get processed
+	   even if no thread could be started. */
+	cw_rec_tester_pool_thread_fn(&pool);
+
+	for (long i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	return pool.result;
+}
+
+
+
+
+static void * cw_rec_tester_pool_thread_fn(void * arg)
+{
+	cw_rec_tester_pool_t * pool = (cw_rec_tester_pool_t *) arg;
+
+	while (true) {
+		const size_t i = __atomic_fetch_add(&pool->next_item, 1, __ATOMIC_RELAXED);
+		if (i >= pool->n_items) {
+			break;
+		}
+		if (0 != pool->fn(pool->arg, i)) {
+			__atomic_store_n(&pool->result, -1, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/*
+  Offline sweep of receiver parameters.
+
+  Each cell of the grid gets its own receiver and its own timeline of
+  key events. The timeline is built from durations calculated the way
+  a generator calculates them, randomly stretched or shrunk by
+  "noise" percents, and is decoded with cw_rec_process_events() in one
+  pass, so no time is spent on waiting for a generator.
+*/
+
+
+
+
+/* Durations of elements of keyed text [us]. Spaces are in addition
+   to inter-mark-space that follows each mark. */
+typedef struct {
+	int dot;
+	int dash;
+	int ims;
+	int ics;
+	int iws;
+} cw_rec_tester_sweep_durations_t;
+
+
+
+
+typedef struct {
+	const cw_rec_tester_sweep_config_t * config;
+	const char * text;
+	cw_rec_tester_sweep_cell_t * cells;
+} cw_rec_tester_sweep_pool_t;
+
+
+
+
+typedef struct {
+	char * text;
+	size_t len;
+	size_t capacity;
+} cw_rec_tester_sweep_output_t;
+
+
+
+
+static void cw_rec_tester_sweep_calculate_durations(cw_rec_tester_sweep_durations_t * durations, int speed, int weighting, int gap);
+static int64_t cw_rec_tester_sweep_jitter(int duration, int noise, unsigned short xsubi[3]);
+static int cw_rec_tester_sweep_cell(const cw_rec_tester_sweep_config_t * config, const char * text, size_t index, cw_rec_tester_sweep_cell_t * cell);
+static void cw_rec_tester_sweep_callback(void * callback_arg, int64_t timestamp, char character, bool is_error);
+static int cw_rec_tester_sweep_pool_fn(void * arg, size_t index);
+
+
+
+
+size_t cw_rec_tester_sweep_n_cells(const cw_rec_tester_sweep_config_t * config)
+{
+	return config->n_speeds * config->n_tolerances * config->n_noises * config->n_adaptive_modes;
+}
+
+
+
+
+int cw_rec_tester_sweep(const cw_rec_tester_sweep_config_t * config, cw_rec_tester_sweep_cell_t * cells, size_t n_cells)
+{
+	if (n_cells != cw_rec_tester_sweep_n_cells(config) || 0 == n_cells) {
+		fprintf(stderr, "[EE] Sweep: invalid count of cells %zd\n", n_cells);
+		return -1;
+	}
+	if (config->weighting < CW_WEIGHTING_MIN || config->weighting > CW_WEIGHTING_MAX
+	    || config->gap < CW_GAP_MIN || config->gap > CW_GAP_MAX) {
+		fprintf(stderr, "[EE] Sweep: invalid weighting %d or gap %d\n", config->weighting, config->gap);
+		return -1;
+	}
+	for (size_t i = 0; i < config->n_noises; i++) {
+		if (config->noises[i] < 0 || config->noises[i] >= 100) {
+			fprintf(stderr, "[EE] Sweep: invalid noise %d\n", config->noises[i]);
+			return -1;
+		}
+	}
+
+	/* BASIC_SET_LONG is defined in cw_rec_tester_init_text_buffers(). */
+	cw_rec_tester_sweep_pool_t pool = {
+		.config = config,
+		.text = config->text ? config->text : BASIC_SET_LONG BASIC_SET_LONG,
+		.cells = cells
+	};
+
+	return cw_rec_tester_run_pool(cw_rec_tester_sweep_pool_fn, &pool, n_cells, config->n_threads);
+}
+
+
+
+
+void cw_rec_tester_sweep_print(FILE * file, const cw_rec_tester_sweep_cell_t * cells, size_t n_cells)
+{
+	fprintf(file, "speed  tolerance  noise  adaptive   sent  received  errors  CER [%%]  keyed [s]  decoded [ms]  throughput [chars/s]\n");
+	for (size_t i = 0; i < n_cells; i++) {
+		const cw_rec_tester_sweep_cell_t * cell = &cells[i];
+		fprintf(file, "%5d  %9d  %5d  %8s  %5zd  %8zd  %6zd  %7.2f  %9.1f  %12.3f  %20.0f\n",
+			cell->speed, cell->tolerance, cell->noise, cell->adaptive ? "yes" : "no",
+			cell->n_sent, cell->n_received, cell->n_errors,
+			(double) cell->error_rate_percent,
+			cell->keying_duration, cell->decode_duration * 1000.0, cell->throughput);
+	}
+}
+
+
+
+
+static int cw_rec_tester_sweep_pool_fn(void * arg, size_t index)
+{
+	cw_rec_tester_sweep_pool_t * pool = (cw_rec_tester_sweep_pool_t *) arg;
+	return cw_rec_tester_sweep_cell(pool->config, pool->text, index, &pool->cells[index]);
+}
+
+
+
+
+/**
+   @brief Calculate durations of elements the way generator does it
+
+   See cw_gen_sync_parameters_internal(). Inter-word-space is not
+   extended past seven units (plus Farnsworth adjustment).
+*/
+static void cw_rec_tester_sweep_calculate_durations(cw_rec_tester_sweep_durations_t * durations, int speed, int weighting, int gap)
+{
+	cw_gen_durations_t gen_durations;
+	cw_gen_calculate_durations_internal(&gen_durations, speed, weighting);
+
+	const int unit_duration = gen_durations.unit_duration;
+	const int additional_space_duration = gap * unit_duration;
+	const int adjustment_space_duration = (7 * additional_space_duration) / 3;
+
+	durations->dot = gen_durations.dot_duration;
+	durations->dash = 3 * gen_durations.dot_duration;
+	durations->ims = unit_duration - (28 * gen_durations.weighting_duration) / 22;
+	durations->ics = 3 * unit_duration - durations->ims + additional_space_duration;
+	durations->iws = 4 * unit_duration + adjustment_space_duration;
+}
+
+
+
+
+/**
+   @brief Randomize duration by up to +/- @p noise percents
+
+   @return randomized duration [ns]
+*/
+static int64_t cw_rec_tester_sweep_jitter(int duration, int noise, unsigned short xsubi[3])
+{
+	const double factor = 1.0 + (noise / 100.0) * (2.0 * erand48(xsubi) - 1.0);
+	return (int64_t) (duration * factor * 1000.0);
+}
+
+
+
+
+static void cw_rec_tester_sweep_callback(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	(void) timestamp;
+	(void) is_error;
+	cw_rec_tester_sweep_output_t * output = (cw_rec_tester_sweep_output_t *) callback_arg;
+	if (output->len < output->capacity - 1) {
+		output->text[output->len++] = (char) tolower(character);
+		output->text[output->len] = '\0';
+	}
+}
+
+
+
+
+/**
+   @brief Key text with parameters of one cell of the grid, receive it, and compare results
+
+   Timeline of a cell depends only on speed and noise of the cell (and
+   on seed), so cells that differ only in receiver's parameters are
+   compared on the same input.
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_rec_tester_sweep_cell(const cw_rec_tester_sweep_config_t * config, const char * text, size_t index, cw_rec_tester_sweep_cell_t * cell)
+{
+	/* Cells are ordered by speed, then tolerance, then noise, then
+	   adaptive mode. */
+	size_t i = index;
+	const bool adaptive = config->adaptive_modes[i % config->n_adaptive_modes];
+	i /= config->n_adaptive_modes;
+	const int noise = config->noises[i % config->n_noises];
+	i /= config->n_noises;
+	const int tolerance = config->tolerances[i % config->n_tolerances];
+	i /= config->n_tolerances;
+	const int speed = config->speeds[i];
+
+	memset(cell, 0, sizeof (*cell));
+	cell->speed = speed;
+	cell->tolerance = tolerance;
+	cell->noise = noise;
+	cell->adaptive = adaptive;
+
+	cw_rec_tester_sweep_durations_t durations;
+	cw_rec_tester_sweep_calculate_durations(&durations, speed, config->weighting, config->gap);
+
+	const size_t text_len = strlen(text);
+	char * sent = (char *) malloc(text_len + 1);
+	cw_rec_event_t * events = (cw_rec_event_t *) malloc((2 * CW_DATA_MAX_REPRESENTATION_LENGTH * text_len + 1) * sizeof (cw_rec_event_t));
+	cw_rec_tester_sweep_output_t output = { .text = (char *) malloc(2 * text_len + 2), .len = 0, .capacity = 2 * text_len + 2 };
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == sent || NULL == events || NULL == output.text || NULL == rec) {
+		fprintf(stderr, "[EE] Sweep: failed to allocate resources of cell %zd\n", index);
+		free(sent);
+		free(events);
+		free(output.text);
+		cw_rec_delete(&rec);
+		return -1;
+	}
+	output.text[0] = '\0';
+
+	unsigned short xsubi[3] = {
+		(unsigned short) config->seed,
+		(unsigned short) (config->seed >> 16) ^ (unsigned short) speed,
+		(unsigned short) noise
+	};
+
+	/* Synthesize timeline. Unknown characters are skipped, and
+	   sequences of spaces are keyed as a single inter-word-space.
+	   Start at non-zero time, like a monotonic clock would. */
+	size_t n_sent = 0;
+	size_t n_events = 0;
+	int64_t t = (int64_t) 1000 * 1000 * 1000;
+	const int64_t start = t;
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			if (n_sent > 0 && ' ' != sent[n_sent - 1]) {
+				sent[n_sent++] = ' ';
+				t += cw_rec_tester_sweep_jitter(durations.iws, noise, xsubi);
+			}
+			continue;
+		}
+		const char * representation = cw_character_to_representation_internal(*c);
+		if (NULL == representation) {
+			continue;
+		}
+		sent[n_sent++] = (char) tolower(*c);
+		for (const char * mark = representation; *mark; mark++) {
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_BEGIN, t };
+			t += cw_rec_tester_sweep_jitter(CW_DOT_REPRESENTATION == *mark ? durations.dot : durations.dash, noise, xsubi);
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_END, t };
+			t += cw_rec_tester_sweep_jitter(durations.ims, noise, xsubi);
+		}
+		t += cw_rec_tester_sweep_jitter(durations.ics, noise, xsubi);
+	}
+	while (n_sent > 0 && ' ' == sent[n_sent - 1]) {
+		n_sent--;
+	}
+	sent[n_sent] = '\0';
+	/* Poll long after last mark to receive last character. */
+	events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_POLL, t + 10 * (int64_t) durations.dash * 1000 };
+
+	cw_rec_set_speed(rec, speed);
+	cw_rec_set_tolerance(rec, tolerance);
+	cw_rec_set_gap(rec, config->gap);
+	if (adaptive) {
+		cw_rec_enable_adaptive_mode(rec);
+	} else {
+		cw_rec_disable_adaptive_mode(rec);
+	}
+
+	struct timespec cpu_begin;
+	struct timespec cpu_end;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+	const cw_ret_t cwret = cw_rec_process_events(rec, events, n_events, cw_rec_tester_sweep_callback, &output);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+
+	/* Receiver reports inter-word-space after last character. */
+	while (output.len > 0 && ' ' == output.text[output.len - 1]) {
+		output.text[--output.len] = '\0';
+	}
+
+	cell->n_sent = n_sent;
+	cell->n_received = output.len;
+	cell->n_errors = cw_rec_tester_edit_distance(sent, output.text);
+	cell->error_rate_percent = n_sent ? 100.0F * (float) cell->n_errors / (float) n_sent : 0.0F;
+	cell->keying_duration = (double) (t - start) / (1000.0 * 1000.0 * 1000.0);
+	cell->decode_duration = (double) (cpu_end.tv_sec - cpu_begin.tv_sec)
+		+ (double) (cpu_end.tv_nsec - cpu_begin.tv_nsec) / (1000.0 * 1000.0 * 1000.0);
+	cell->throughput = cell->decode_duration > 0.0 ? (double) output.len / cell->decode_duration : 0.0;
+
+	cw_rec_delete(&rec);
+	free(output.text);
+	free(events);
+	free(sent);
+
+	if (CW_SUCCESS != cwret) {
+		fprintf(stderr, "[EE] Sweep: failed to process events of cell %zd\n", index);
+		return -1;
+	}
+	return 0;
+}
+
+
+
+
+/**
+   @brief Calculate Levenshtein distance between two strings
+
+   Unlike cw_rec_tester_compare_input_and_received(), a missed or an
+   extra character counts as one error, and doesn't shift all
+   following characters out of alignment.
+*/
+static size_t cw_rec_tester_edit_distance(const char * a, const char * b)
+{
+	const size_t len_a = strlen(a);
+	const size_t len_b = strlen(b);
+
+	size_t * row = (size_t *) malloc((len_b + 1) * sizeof (size_t));
+	if (NULL == row) {
+		return len_a > len_b ? len_a : len_b;
+	}
+	for (size_t j = 0; j <= len_b; j++) {
+		row[j] = j;
+	}
+
+	for (size_t i = 1; i <= len_a; i++) {
+		size_t diagonal = row[0];
+		row[0] = i;
+		for (size_t j = 1; j <= len_b; j++) {
+			const size_t above = row[j];
+			const size_t substitution = diagonal + (a[i - 1] == b[j - 1] ? 0 : 1);
+			const size_t deletion = above + 1;
+			const size_t insertion = row[j - 1] + 1;
+
+			size_t best = substitution < deletion ? substitution : deletion;
+			best = best < insertion ? best : insertion;
+			row[j] = best;
+			diagonal = above;
+		}
+	}
+
+	const size_t distance = row[len_b];
+	free(row);
+	return distance;
+}
+
+
+
+
+/*
+  Regression corpus of receiver.
+
+  Every recording of corpus is converted to a timeline of beginnings
+  and ends of marks (sound goes through a tone detector first), and
+  the timeline is decoded with cw_rec_process_events(). During spaces
+  the timeline is polled every config::poll_interval, like a receiver
+  polled by client code, so the time at which a character is reported
+  is close to what a live receiver would show.
+*/
+
+
+
+
+/* Timeline is polled this long after end of last mark, to receive
+   last character of recording [ns]. */
+#define CW_REC_TESTER_CORPUS_FLUSH_DURATION ((int64_t) 5 * 1000 * 1000 * 1000)
+
+/* Timelines of sound recordings start at this time [ns]. */
+#define CW_REC_TESTER_CORPUS_START ((int64_t) 1000 * 1000 * 1000)
+
+
+
+
+typedef struct {
+	cw_rec_event_t * events;
+	size_t n_events;
+	size_t capacity;
+
+	size_t n_edges;        /* Count of beginnings and ends of marks. */
+	bool is_mark;
+	int64_t mark_end;      /* End of last mark [ns]. */
+	int64_t first;         /* Timestamp of first edge [ns]. */
+	int64_t poll_interval; /* [ns] */
+} cw_rec_tester_timeline_t;
+
+
+
+
+typedef struct {
+	char * text;
+	size_t len;
+	size_t capacity;
+
+	/* Latency is measured in separate pass over timeline, in which
+	   events are passed to receiver one by one, so time at which a
+	   character is reported is known. */
+	bool measure_latency;
+	int64_t now;           /* Timestamp of event being processed [ns]. */
+	double latency_sum;    /* [ns] */
+	size_t n_characters;
+} cw_rec_tester_corpus_output_t;
+
+
+
+
+typedef struct {
+	const cw_rec_tester_corpus_config_t * config;
+	cw_rec_tester_corpus_file_t * files;
+} cw_rec_tester_corpus_pool_t;
+
+
+
+
+static int  cw_rec_tester_corpus_filter(const struct dirent * entry);
+static int  cw_rec_tester_corpus_pool_fn(void * arg, size_t index);
+static int  cw_rec_tester_corpus_file(const cw_rec_tester_corpus_config_t * config, cw_rec_tester_corpus_file_t * file);
+static int  cw_rec_tester_corpus_load_keylog(const char * path, cw_rec_tester_timeline_t * timeline);
+static int  cw_rec_tester_corpus_load_wav(const cw_rec_tester_corpus_config_t * config, const char * path, cw_rec_tester_timeline_t * timeline, double * recording_duration);
+static int  cw_rec_tester_corpus_load_baseline(const char * path, cw_rec_tester_corpus_file_t * files, size_t n_files);
+static void cw_rec_tester_corpus_callback(void * callback_arg, int64_t timestamp, char character, bool is_error);
+static char * cw_rec_tester_corpus_read_text(const char * path);
+static void cw_rec_tester_normalize_text(char * text);
+static size_t cw_rec_tester_word_edit_distance(const char * a, const char * b, size_t * n_words_a);
+static size_t cw_rec_tester_split_words(const char * text, const char *** words);
+static int  cw_rec_tester_timeline_append(cw_rec_tester_timeline_t * timeline, cw_rec_event_type_t type, int64_t timestamp);
+static int  cw_rec_tester_timeline_add_edge(cw_rec_tester_timeline_t * timeline, bool is_mark, int64_t timestamp);
+static int  cw_rec_tester_timeline_finish(cw_rec_tester_timeline_t * timeline);
+static double cw_rec_tester_cpu_seconds(const struct timespec * begin, const struct timespec * end);
+
+
+
+
+int cw_rec_tester_corpus(const cw_rec_tester_corpus_config_t * config, cw_rec_tester_corpus_file_t ** files, size_t * n_files)
+{
+	*files = NULL;
+	*n_files = 0;
+
+	if (NULL == config->directory || config->poll_interval <= 0) {
+		fprintf(stderr, "[EE] Corpus: invalid directory or poll interval %d\n", config->poll_interval);
+		return -1;
+	}
+
+	struct dirent ** entries = NULL;
+	const int n_entries = scandir(config->directory, &entries, cw_rec_tester_corpus_filter, alphasort);
+	if (n_entries < 0) {
+		fprintf(stderr, "[EE] Corpus: can't read directory '%s': %s\n", config->directory, strerror(errno));
+		return -1;
+	}
+
+	cw_rec_tester_corpus_file_t * result = (cw_rec_tester_corpus_file_t *) calloc((size_t) n_entries + 1, sizeof (cw_rec_tester_corpus_file_t));
+	size_t n = 0;
+	for (int i = 0; i < n_entries; i++) {
+		const char * name = entries[i]->d_name;
+		const size_t len = strlen(name);
+		const char * dot = strrchr(name, '.');
+		char text_path[PATH_MAX];
+		snprintf(text_path, sizeof (text_path), "%s/%.*s.txt", config->directory, (int) (dot - name), name);
+
+		if (NULL == result || len >= CW_REC_TESTER_CORPUS_NAME_SIZE) {
+			fprintf(stderr, "[WW] Corpus: skipping '%s'\n", name);
+		} else if (0 != access(text_path, R_OK)) {
+			fprintf(stderr, "[WW] Corpus: no expected text for '%s', skipping\n", name);
+		} else {
+			memcpy(result[n++].name, name, len + 1);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	if (NULL == result) {
+		fprintf(stderr, "[EE] Corpus: failed to allocate results\n");
+		return -1;
+	}
+	if (0 == n) {
+		fprintf(stderr, "[EE] Corpus: no recordings in '%s'\n", config->directory);
+		free(result);
+		return -1;
+	}
+
+	if (NULL != config->baseline
+	    && 0 != cw_rec_tester_corpus_load_baseline(config->baseline, result, n)) {
+		free(result);
+		return -1;
+	}
+
+	cw_rec_tester_corpus_pool_t pool = {
+		.config = config,
+		.files = result
+	};
+	/* Failures of individual recordings are reported in results. */
+	cw_rec_tester_run_pool(cw_rec_tester_corpus_pool_fn, &pool, n, config->n_threads);
+
+	*files = result;
+	*n_files = n;
+	return 0;
+}
+
+
+
+
+size_t cw_rec_tester_corpus_print(FILE * file, const cw_rec_tester_corpus_file_t * files, size_t n_files)
+{
+	size_t n_failed = 0;
+	size_t n_sent = 0;
+	size_t n_errors = 0;
+	size_t n_words = 0;
+	size_t n_word_errors = 0;
+	size_t n_events = 0;
+	double decode_duration = 0.0;
+
+	fprintf(file, "# recording                chars  errors  CER [%%]  words  WER [%%]  latency [ms]  events    events/s  dCER [%%]  speed  result\n");
+	for (size_t i = 0; i < n_files; i++) {
+		const cw_rec_tester_corpus_file_t * f = &files[i];
+
+		char delta[16] = "-";
+		char speed[16] = "-";
+		if (f->loaded && f->has_baseline) {
+			snprintf(delta, sizeof (delta), "%+.2f", (double) (f->error_rate_percent - f->baseline_error_rate_percent));
+			if (f->baseline_events_per_second > 0.0) {
+				snprintf(speed, sizeof (speed), "%.2fx", f->events_per_second / f->baseline_events_per_second);
+			}
+		}
+		fprintf(file, "%-26s %5zd  %6zd  %7.2f  %5zd  %7.2f  %12.1f  %6zd  %10.0f  %8s  %5s  %s\n",
+			f->name, f->n_sent, f->n_errors, (double) f->error_rate_percent,
+			f->n_words, (double) f->word_error_rate_percent,
+			f->latency * 1000.0, f->n_events, f->events_per_second,
+			delta, speed,
+			f->loaded ? (f->passed ? "pass" : "FAIL") : "ERROR");
+
+		n_failed += f->passed ? 0 : 1;
+		n_sent += f->n_sent;
+		n_errors += f->n_errors;
+		n_words += f->n_words;
+		n_word_errors += f->n_word_errors;
+		n_events += f->n_events;
+		decode_duration += f->decode_duration;
+	}
+	fprintf(file, "# %zd recordings, %zd failed, CER %.2f%%, WER %.2f%%, %.0f events/s\n",
+		n_files, n_failed,
+		n_sent ? 100.0 * (double) n_errors / (double) n_sent : 0.0,
+		n_words ? 100.0 * (double) n_word_errors / (double) n_words : 0.0,
+		decode_duration > 0.0 ? (double) n_events / decode_duration : 0.0);
+
+	return n_failed;
+}
+
+
+
+
+static int cw_rec_tester_corpus_filter(const struct dirent * entry)
+{
+	const char * dot = strrchr(entry->d_name, '.');
+	return NULL != dot && dot != entry->d_name
+		&& (0 == strcmp(dot, ".cwkl") || 0 == strcmp(dot, ".wav"));
+}
+
+
+
+
+static int cw_rec_tester_corpus_pool_fn(void * arg, size_t index)
+{
+	cw_rec_tester_corpus_pool_t * pool = (cw_rec_tester_corpus_pool_t *) arg;
+	return cw_rec_tester_corpus_file(pool->config, &pool->files[index]);
+}
+
+
+
+
+/**
+   @brief Receive one recording of corpus and compare results with expected text
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_rec_tester_corpus_file(const cw_rec_tester_corpus_config_t * config, cw_rec_tester_corpus_file_t * file)
+{
+	file->loaded = false;
+	file->passed = false;
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof (path), "%s/%s", config->directory, file->name);
+	const char * dot = strrchr(file->name, '.');
+	char text_path[PATH_MAX];
+	snprintf(text_path, sizeof (text_path), "%s/%.*s.txt", config->directory, (int) (dot - file->name), file->name);
+
+	char * expected = cw_rec_tester_corpus_read_text(text_path);
+	if (NULL == expected) {
+		return -1;
+	}
+
+	cw_rec_tester_timeline_t timeline = { .poll_interval = (int64_t) config->poll_interval * 1000, .first = -1 };
+	struct timespec cpu_begin;
+	struct timespec cpu_end;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+	int rv = 0;
+	if (0 == strcmp(dot, ".wav")) {
+		rv = cw_rec_tester_corpus_load_wav(config, path, &timeline, &file->recording_duration);
+	} else {
+		rv = cw_rec_tester_corpus_load_keylog(path, &timeline);
+		file->recording_duration = timeline.first >= 0 ? (double) (timeline.mark_end - timeline.first) / 1e9 : 0.0;
+	}
+	if (0 == rv) {
+		rv = cw_rec_tester_timeline_finish(&timeline);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+	file->load_duration = cw_rec_tester_cpu_seconds(&cpu_begin, &cpu_end);
+	if (0 != rv) {
+		free(timeline.events);
+		free(expected);
+		return -1;
+	}
+
+	/* Receiver may report a few more characters than expected, and
+	   one space after each of them. */
+	const size_t capacity = 2 * (strlen(expected) + timeline.n_edges) + 2;
+	cw_rec_tester_corpus_output_t output = {
+		.text = (char *) malloc(capacity),
+		.len = 0,
+		.capacity = capacity,
+		.measure_latency = false
+	};
+	/* One receiver (or decoder) for measurement of throughput, and
+	   one for measurement of latency. */
+	const bool use_viterbi = config->beam_width > 0;
+	cw_rec_t * recs[2] = { NULL, NULL };
+	cw_viterbi_t * vits[2] = { NULL, NULL };
+	bool failure = NULL == output.text;
+	for (int i = 0; i < 2; i++) {
+		if (use_viterbi) {
+			vits[i] = cw_viterbi_new();
+			failure = failure
+				|| NULL == vits[i]
+				|| CW_SUCCESS != cw_viterbi_set_speed(vits[i], config->speed)
+				|| CW_SUCCESS != cw_viterbi_set_beam_width(vits[i], config->beam_width);
+		} else {
+			recs[i] = cw_rec_new();
+			failure = failure || NULL == recs[i];
+			if (NULL != recs[i]) {
+				cw_rec_set_speed(recs[i], config->speed);
+				cw_rec_set_tolerance(recs[i], config->tolerance);
+				if (config->adaptive) {
+					cw_rec_enable_adaptive_mode(recs[i]);
+				} else {
+					cw_rec_disable_adaptive_mode(recs[i]);
+				}
+			}
+		}
+	}
+	if (failure) {
+		fprintf(stderr, "[EE] Corpus: failed to allocate resources of '%s'\n", file->name);
+		free(output.text);
+		for (int i = 0; i < 2; i++) {
+			cw_rec_delete(&recs[i]);
+			cw_viterbi_delete(&vits[i]);
+		}
+		free(timeline.events);
+		free(expected);
+		return -1;
+	}
+	output.text[0] = '\0';
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+	cw_ret_t cwret = use_viterbi
+		? cw_viterbi_process_events(vits[0], timeline.events, timeline.n_events, cw_rec_tester_corpus_callback, &output)
+		: cw_rec_process_events(recs[0], timeline.events, timeline.n_events, cw_rec_tester_corpus_callback, &output);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+
+	output.measure_latency = true;
+	for (size_t i = 0; CW_SUCCESS == cwret && i < timeline.n_events; i++) {
+		output.now = timeline.events[i].timestamp;
+		cwret = use_viterbi
+			? cw_viterbi_process_events(vits[1], &timeline.events[i], 1, cw_rec_tester_corpus_callback, &output)
+			: cw_rec_process_events(recs[1], &timeline.events[i], 1, cw_rec_tester_corpus_callback, &output);
+	}
+	for (int i = 0; i < 2; i++) {
+		cw_rec_delete(&recs[i]);
+		cw_viterbi_delete(&vits[i]);
+	}
+
+	if (CW_SUCCESS != cwret) {
+		fprintf(stderr, "[EE] Corpus: failed to decode '%s'\n", file->name);
+		free(output.text);
+		free(timeline.events);
+		free(expected);
+		return -1;
+	}
+
+	cw_rec_tester_normalize_text(output.text);
+
+	file->n_sent = strlen(expected);
+	file->n_errors = cw_rec_tester_edit_distance(expected, output.text);
+	file->error_rate_percent = file->n_sent ? 100.0F * (float) file->n_errors / (float) file->n_sent : 0.0F;
+	file->n_word_errors = cw_rec_tester_word_edit_distance(expected, output.text, &file->n_words);
+	file->word_error_rate_percent = file->n_words ? 100.0F * (float) file->n_word_errors / (float) file->n_words : 0.0F;
+
+	file->n_events = timeline.n_edges;
+	file->decode_duration = cw_rec_tester_cpu_seconds(&cpu_begin, &cpu_end);
+	file->events_per_second = file->decode_duration > 0.0 ? (double) timeline.n_edges / file->decode_duration : 0.0;
+	file->latency = output.n_characters ? output.latency_sum / (double) output.n_characters / 1e9 : 0.0;
+
+	file->loaded = true;
+	file->passed = file->error_rate_percent <= config->max_error_rate_percent
+		&& (!file->has_baseline
+		    || file->error_rate_percent <= file->baseline_error_rate_percent + config->max_regression_percent);
+
+	free(output.text);
+	free(timeline.events);
+	free(expected);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Convert changes of keying log to timeline
+
+   Changes of straight key are used; if there are none, changes of
+   generator are used. Paddles are ignored, as they would need a
+   keyer.
+*/
+static int cw_rec_tester_corpus_load_keylog(const char * path, cw_rec_tester_timeline_t * timeline)
+{
+	cw_keylog_source_t source = CW_KEYLOG_SOURCE_STRAIGHT_KEY;
+	for (int pass = 0; pass < 2; pass++) {
+		cw_keylog_t * keylog = cw_keylog_new_reader(path);
+		if (NULL == keylog) {
+			fprintf(stderr, "[EE] Corpus: can't open keying log '%s': %s\n", path, strerror(errno));
+			return -1;
+		}
+
+		cw_keylog_event_t event;
+		bool has_generator = false;
+		while (CW_SUCCESS == cw_keylog_read(keylog, &event)) {
+			if (event.source == source) {
+				/* Repeated values are skipped by the function. */
+				if (0 != cw_rec_tester_timeline_add_edge(timeline, CW_KEY_VALUE_CLOSED == event.value, event.timestamp)) {
+					cw_keylog_delete(&keylog);
+					return -1;
+				}
+			} else if (CW_KEYLOG_SOURCE_GENERATOR == event.source) {
+				has_generator = true;
+			}
+		}
+		const int error = errno;
+		cw_keylog_delete(&keylog);
+		if (ENODATA != error) {
+			fprintf(stderr, "[EE] Corpus: damaged keying log '%s'\n", path);
+			return -1;
+		}
+
+		if (timeline->n_edges > 0 || !has_generator) {
+			break;
+		}
+		source = CW_KEYLOG_SOURCE_GENERATOR;
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Convert sound to timeline with tone detector
+
+   WAV file must have canonical header, as written by File sound
+   system. Each block of detector is processed separately, and change
+   of detector's decision is put on timeline at middle of the block,
+   the way cw_detector_process() passes it to a receiver.
+*/
+static int cw_rec_tester_corpus_load_wav(const cw_rec_tester_corpus_config_t * config, const char * path, cw_rec_tester_timeline_t * timeline, double * recording_duration)
+{
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		fprintf(stderr, "[EE] Corpus: can't open '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	uint8_t head[44];
+	if (sizeof (head) != fread(head, 1, sizeof (head), file)
+	    || 0 != memcmp(head + 0, "RIFF", 4)
+	    || 0 != memcmp(head + 8, "WAVE", 4)
+	    || 0 != memcmp(head + 12, "fmt ", 4)
+	    || 1 != (head[20] | head[21] << 8)     /* PCM. */
+	    || 1 != (head[22] | head[23] << 8)     /* Mono. */
+	    || 16 != (head[34] | head[35] << 8)    /* 16 bits. */
+	    || 0 != memcmp(head + 36, "data", 4)) {
+
+		fprintf(stderr, "[EE] Corpus: unsupported format of WAV file '%s'\n", path);
+		fclose(file);
+		return -1;
+	}
+	const int sample_rate = (int) ((uint32_t) head[24] | (uint32_t) head[25] << 8 | (uint32_t) head[26] << 16 | (uint32_t) head[27] << 24);
+
+	cw_detector_t * detector = cw_detector_new_internal(sample_rate, config->frequency, NULL);
+	if (NULL == detector
+	    || CW_SUCCESS != cw_detector_set_afc_range(detector, config->afc_range)) {
+		fprintf(stderr, "[EE] Corpus: can't create tone detector for '%s' (sample rate %d)\n", path, sample_rate);
+		cw_detector_delete(&detector);
+		fclose(file);
+		return -1;
+	}
+	const size_t block_n_samples = (size_t) detector->block_n_samples;
+	const int64_t half_block = (int64_t) block_n_samples * 1000 * 1000 * 1000 / sample_rate / 2;
+
+	uint8_t bytes[8192];
+	int16_t samples[4096];
+	size_t n_pending = 0; /* Samples of incomplete block, kept at the beginning of samples[]. */
+	int64_t n_samples = 0;
+	int rv = 0;
+	size_t n_bytes = 0;
+	while (0 == rv && 0 != (n_bytes = fread(bytes, 1, sizeof (bytes), file))) {
+		const size_t n = n_bytes / 2;
+		for (size_t i = 0; i < n; i++) {
+			samples[n_pending++] = (int16_t) (uint16_t) (bytes[2 * i] | bytes[2 * i + 1] << 8);
+			if (n_pending < block_n_samples && n_pending < sizeof (samples) / sizeof (samples[0])) {
+				continue;
+			}
+			const bool was_mark = detector->is_mark;
+			cw_detector_process(detector, samples, n_pending, 0 == n_samples ? CW_REC_TESTER_CORPUS_START : -1);
+			n_samples += (int64_t) n_pending;
+			n_pending = 0;
+			if (was_mark != detector->is_mark) {
+				rv = cw_rec_tester_timeline_add_edge(timeline, detector->is_mark, cw_detector_get_timestamp(detector) - half_block);
+			}
+		}
+	}
+	n_samples += (int64_t) n_pending;
+	*recording_duration = (double) n_samples / sample_rate;
+
+	if (0 == rv && detector->is_mark) {
+		rv = cw_rec_tester_timeline_add_edge(timeline, false, cw_detector_get_timestamp(detector));
+	}
+
+	cw_detector_delete(&detector);
+	fclose(file);
+
+	return rv;
+}
+
+
+
+
+/**
+   @brief Read CERs and speeds of recordings from output of earlier run
+
+   See cw_rec_tester_corpus_print(). Recordings that are not in the
+   baseline are not compared with it.
+*/
+static int cw_rec_tester_corpus_load_baseline(const char * path, cw_rec_tester_corpus_file_t * files, size_t n_files)
+{
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		fprintf(stderr, "[EE] Corpus: can't open baseline '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	char line[1024];
+	while (NULL != fgets(line, sizeof (line), file)) {
+		if ('#' == line[0]) {
+			continue;
+		}
+		char name[CW_REC_TESTER_CORPUS_NAME_SIZE];
+		size_t n_sent = 0;
+		size_t n_errors = 0;
+		float error_rate_percent = 0.0F;
+		size_t n_words = 0;
+		float word_error_rate_percent = 0.0F;
+		double latency = 0.0;
+		size_t n_events = 0;
+		double events_per_second = 0.0;
+		if (9 != sscanf(line, "%255s %zu %zu %f %zu %f %lf %zu %lf", name, &n_sent, &n_errors, &error_rate_percent,
+				&n_words, &word_error_rate_percent, &latency, &n_events, &events_per_second)) {
+			continue;
+		}
+		for (size_t i = 0; i < n_files; i++) {
+			if (0 == strcmp(name, files[i].name)) {
+				files[i].has_baseline = true;
+				files[i].baseline_error_rate_percent = error_rate_percent;
+				files[i].baseline_events_per_second = events_per_second;
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	return 0;
+}
+
+
+
+
+static void cw_rec_tester_corpus_callback(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	(void) is_error;
+	cw_rec_tester_corpus_output_t * output = (cw_rec_tester_corpus_output_t *) callback_arg;
+	if (output->measure_latency) {
+		/* @p timestamp is end of last mark of character. */
+		if (' ' != character) {
+			output->latency_sum += (double) (output->now - timestamp);
+			output->n_characters++;
+		}
+	} else if (output->len < output->capacity - 1) {
+		output->text[output->len++] = (char) tolower(character);
+		output->text[output->len] = '\0';
+	}
+}
+
+
+
+
+/**
+   @brief Read expected text of recording
+
+   @return normalized text, to be freed with free()
+   @return NULL on failure
+*/
+static char * cw_rec_tester_corpus_read_text(const char * path)
+{
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		fprintf(stderr, "[EE] Corpus: can't open '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char * text = size >= 0 ? (char *) malloc((size_t) size + 1) : NULL;
+	if (NULL == text) {
+		fclose(file);
+		return NULL;
+	}
+	const size_t n = fread(text, 1, (size_t) size, file);
+	text[n] = '\0';
+	fclose(file);
+
+	cw_rec_tester_normalize_text(text);
+	return text;
+}
+
+
+
+
+/**
+   @brief Convert text to lower case, with single spaces between words
+
+   Leading and trailing white space is removed.
+*/
+static void cw_rec_tester_normalize_text(char * text)
+{
+	size_t len = 0;
+	for (const char * c = text; *c; c++) {
+		if (isspace((unsigned char) *c)) {
+			if (len > 0 && ' ' != text[len - 1]) {
+				text[len++] = ' ';
+			}
+		} else {
+			text[len++] = (char) tolower((unsigned char) *c);
+		}
+	}
+	while (len > 0 && ' ' == text[len - 1]) {
+		len--;
+	}
+	text[len] = '\0';
+}
+
+
+
+
+/**
+   @brief Calculate Levenshtein distance between sequences of words of two texts
+
+   Texts must be normalized, see cw_rec_tester_normalize_text().
+
+   @param[in] a first text
+   @param[in] b second text
+   @param[out] n_words_a count of words in @p a
+*/
+static size_t cw_rec_tester_word_edit_distance(const char * a, const char * b, size_t * n_words_a)
+{
+	const char ** words_a = NULL;
+	const char ** words_b = NULL;
+	const size_t len_a = cw_rec_tester_split_words(a, &words_a);
+	const size_t len_b = cw_rec_tester_split_words(b, &words_b);
+	*n_words_a = len_a;
+
+	size_t * row = (size_t *) malloc((len_b + 1) * sizeof (size_t));
+	if (NULL == row || (len_a && NULL == words_a) || (len_b && NULL == words_b)) {
+		free(row);
+		free(words_a);
+		free(words_b);
+		return len_a > len_b ? len_a : len_b;
+	}
+	for (size_t j = 0; j <= len_b; j++) {
+		row[j] = j;
+	}
+
+	for (size_t i = 1; i <= len_a; i++) {
+		size_t diagonal = row[0];
+		row[0] = i;
+		const size_t word_len = strcspn(words_a[i - 1], " ");
+		for (size_t j = 1; j <= len_b; j++) {
+			const size_t above = row[j];
+			const bool same = word_len == strcspn(words_b[j - 1], " ")
+				&& 0 == strncmp(words_a[i - 1], words_b[j - 1], word_len);
+			const size_t substitution = diagonal + (same ? 0 : 1);
+			const size_t deletion = above + 1;
+			const size_t insertion = row[j - 1] + 1;
+
+			size_t best = substitution < deletion ? substitution : deletion;
+			best = best < insertion ? best : insertion;
+			row[j] = best;
+			diagonal = above;
+		}
+	}
+
+	const size_t distance = row[len_b];
+	free(row);
+	free(words_a);
+	free(words_b);
+	return distance;
+}
+
+
+
+
+/**
+   @brief Find beginnings of words of normalized text
+
+   @p words is allocated by the function (NULL for text without words).
+
+   @return count of words
+*/
+static size_t cw_rec_tester_split_words(const char * text, const char *** words)
+{
+	size_t n = 0;
+	for (const char * c = text; *c; c++) {
+		if (' ' != *c && (c == text || ' ' == *(c - 1))) {
+			n++;
+		}
+	}
+
+	*words = n ? (const char **) malloc(n * sizeof (const char *)) : NULL;
+	if (NULL == *words) {
+		return n;
+	}
+	size_t i = 0;
+	for (const char * c = text; *c; c++) {
+		if (' ' != *c && (c == text || ' ' == *(c - 1))) {
+			(*words)[i++] = c;
+		}
+	}
+	return n;
+}
+
+
+
+
+static int cw_rec_tester_timeline_append(cw_rec_tester_timeline_t * timeline, cw_rec_event_type_t type, int64_t timestamp)
+{
+	if (timeline->n_events == timeline->capacity) {
+		const size_t capacity = timeline->capacity ? 2 * timeline->capacity : 4096;
+		cw_rec_event_t * events = (cw_rec_event_t *) realloc(timeline->events, capacity * sizeof (cw_rec_event_t));
+		if (NULL == events) {
+			fprintf(stderr, "[EE] Corpus: failed to allocate timeline of %zd events\n", capacity);
+			return -1;
+		}
+		timeline->events = events;
+		timeline->capacity = capacity;
+	}
+	timeline->events[timeline->n_events++] = (cw_rec_event_t) { type, timestamp };
+	return 0;
+}
+
+
+
+
+/**
+   @brief Put beginning or end of mark on timeline
+
+   Space before a mark is polled every poll interval. Repeated values
+   are ignored, and timestamps are kept from decreasing.
+*/
+static int cw_rec_tester_timeline_add_edge(cw_rec_tester_timeline_t * timeline, bool is_mark, int64_t timestamp)
+{
+	if (is_mark == timeline->is_mark) {
+		return 0;
+	}
+	if (timeline->n_events > 0 && timestamp < timeline->events[timeline->n_events - 1].timestamp) {
+		timestamp = timeline->events[timeline->n_events - 1].timestamp;
+	}
+	if (timeline->first < 0) {
+		timeline->first = timestamp;
+	}
+
+	if (is_mark) {
+		if (timeline->n_edges > 0) {
+			for (int64_t t = timeline->mark_end + timeline->poll_interval; t < timestamp; t += timeline->poll_interval) {
+				if (0 != cw_rec_tester_timeline_append(timeline, CW_REC_EVENT_POLL, t)) {
+					return -1;
+				}
+			}
+		}
+	} else {
+		timeline->mark_end = timestamp;
+	}
+	timeline->is_mark = is_mark;
+	timeline->n_edges++;
+
+	return cw_rec_tester_timeline_append(timeline, is_mark ? CW_REC_EVENT_MARK_BEGIN : CW_REC_EVENT_MARK_END, timestamp);
+}
+
+
+
+
+/**
+   @brief Close timeline: end last mark, and poll long enough to receive last character
+*/
+static int cw_rec_tester_timeline_finish(cw_rec_tester_timeline_t * timeline)
+{
+	if (timeline->is_mark
+	    && 0 != cw_rec_tester_timeline_add_edge(timeline, false, timeline->events[timeline->n_events - 1].timestamp)) {
+		return -1;
+	}
+	if (0 == timeline->n_edges) {
+		return 0;
+	}
+	const int64_t end = timeline->mark_end + CW_REC_TESTER_CORPUS_FLUSH_DURATION;
+	for (int64_t t = timeline->mark_end + timeline->poll_interval; t < end; t += timeline->poll_interval) {
+		if (0 != cw_rec_tester_timeline_append(timeline, CW_REC_EVENT_POLL, t)) {
+			return -1;
+		}
+	}
+	return cw_rec_tester_timeline_append(timeline, CW_REC_EVENT_POLL, end);
+}
+
+
+
+
+static double cw_rec_tester_cpu_seconds(const struct timespec * begin, const struct timespec * end)
+{
+	return (double) (end->tv_sec - begin->tv_sec) + (double) (end->tv_nsec - begin->tv_nsec) / (1000.0 * 1000.0 * 1000.0);
+}
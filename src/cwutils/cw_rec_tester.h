@@ -5,6 +5,7 @@
 
 
 #include <stdint.h>
+#include <stdio.h>
 #include "../libcw/libcw_key.h"
 #include "test_framework_tools.h"
 
@@ -114,6 +115,182 @@ int cw_rec_tester_on_space(cw_rec_tester_t * tester, cw_rec_data_t * erd, struct
 
 
 
+/**
+   Grid of parameters of offline sweep of receiver, see
+   cw_rec_tester_sweep(). Each combination of speed, tolerance, noise
+   and adaptive mode is one cell of the grid.
+*/
+typedef struct cw_rec_tester_sweep_config_t {
+	const int * speeds;      /* [wpm] */
+	size_t n_speeds;
+	const int * tolerances;  /* [percents] */
+	size_t n_tolerances;
+	const int * noises;      /* Jitter of durations of marks and spaces [percents]. */
+	size_t n_noises;
+	const bool * adaptive_modes;
+	size_t n_adaptive_modes;
+
+	int weighting;           /* Weighting of marks, 50 is neutral. */
+	int gap;                 /* Farnsworth gap [dots]. */
+	const char * text;       /* Text to key. NULL: built-in long text. */
+	unsigned int seed;       /* Seed of jitter. */
+	int n_threads;           /* Size of thread pool. 0: count of online CPUs. */
+} cw_rec_tester_sweep_config_t;
+
+
+
+
+/**
+   Result of receiving keyed text in one cell of sweep's grid.
+*/
+typedef struct cw_rec_tester_sweep_cell_t {
+	int speed;
+	int tolerance;
+	int noise;
+	bool adaptive;
+
+	size_t n_sent;              /* Count of characters keyed (including spaces). */
+	size_t n_received;          /* Count of characters received (including spaces). */
+	size_t n_errors;            /* Edit distance between sent and received text. */
+	float error_rate_percent;   /* Character error rate: n_errors / n_sent [percents]. */
+
+	double keying_duration;     /* Duration of keyed timeline [s]. */
+	double decode_duration;     /* CPU time spent by receiver on the timeline [s]. */
+	double throughput;          /* Received characters per second of CPU time. */
+} cw_rec_tester_sweep_cell_t;
+
+
+
+
+size_t cw_rec_tester_sweep_n_cells(const cw_rec_tester_sweep_config_t * config);
+
+/**
+   @brief Measure accuracy of receiver over a grid of parameters
+
+   Offline counterpart of cw_rec_tester_start_test_code(): instead of
+   playing text with a generator in real time, timelines of key events
+   are synthesized directly (with jitter, weighting and Farnsworth
+   gap) and decoded with cw_rec_process_events(). Cells of the grid
+   are distributed over a pool of threads, and results don't depend
+   on size of the pool.
+
+   @p cells must have space for cw_rec_tester_sweep_n_cells() items.
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_rec_tester_sweep(const cw_rec_tester_sweep_config_t * config, cw_rec_tester_sweep_cell_t * cells, size_t n_cells);
+
+void cw_rec_tester_sweep_print(FILE * file, const cw_rec_tester_sweep_cell_t * cells, size_t n_cells);
+
+
+
+
+/**
+   Function processing item number @p index in a pool of threads, see
+   cw_rec_tester_run_pool().
+
+   @return 0 on success
+   @return -1 on failure
+*/
+typedef int (* cw_rec_tester_pool_fn_t)(void * arg, size_t index);
+
+int cw_rec_tester_run_pool(cw_rec_tester_pool_fn_t fn, void * arg, size_t n_items, int n_threads);
+
+
+
+
+/* Size of name of recording in corpus (without directory). */
+#define CW_REC_TESTER_CORPUS_NAME_SIZE 256
+
+
+
+
+/**
+   Configuration of run of receiver over a corpus of reference
+   recordings, see cw_rec_tester_corpus().
+*/
+typedef struct cw_rec_tester_corpus_config_t {
+	const char * directory;        /* Directory with recordings and expected texts. */
+	int speed;                     /* Initial speed of receiver [wpm]. */
+	int tolerance;                 /* [percents] */
+	bool adaptive;
+	int frequency;                 /* Frequency of tone in sound recordings [Hz]. */
+	int afc_range;                 /* Range of AFC of tone detector [Hz], 0: disabled. */
+	int poll_interval;             /* Interval of polling of receiver during spaces [us]. */
+	float max_error_rate_percent;  /* Highest acceptable CER of a recording [percents]. */
+	const char * baseline;         /* Results of earlier run to compare with, or NULL. */
+	float max_regression_percent;  /* Highest acceptable increase of CER over baseline [percentage points]. */
+	int n_threads;                 /* Size of thread pool. 0: count of online CPUs. */
+	int beam_width;                /* Non-zero: decode with probabilistic decoder (cw_viterbi_t) of this beam width instead of receiver. */
+} cw_rec_tester_corpus_config_t;
+
+
+
+
+/**
+   Result of receiving one recording of corpus.
+*/
+typedef struct cw_rec_tester_corpus_file_t {
+	char name[CW_REC_TESTER_CORPUS_NAME_SIZE]; /* Name of recording, without directory. */
+	bool loaded;                  /* Recording and its expected text have been read and decoded. */
+
+	size_t n_sent;                /* Count of characters of expected text (including spaces). */
+	size_t n_errors;              /* Edit distance between expected and received text. */
+	float error_rate_percent;     /* Character error rate [percents]. */
+	size_t n_words;               /* Count of words of expected text. */
+	size_t n_word_errors;         /* Edit distance between words of expected and received text. */
+	float word_error_rate_percent;
+
+	size_t n_events;              /* Count of beginnings and ends of marks. */
+	double recording_duration;    /* Duration of recording [s]. */
+	double load_duration;         /* CPU time spent on reading recording and on detecting tone in sound [s]. */
+	double decode_duration;       /* CPU time spent by receiver [s]. */
+	double events_per_second;     /* Events decoded per second of CPU time. */
+	double latency;               /* Mean time from end of last mark of character to its reception [s]. */
+
+	bool has_baseline;
+	float baseline_error_rate_percent;
+	double baseline_events_per_second;
+
+	bool passed;
+} cw_rec_tester_corpus_file_t;
+
+
+
+
+/**
+   @brief Receive all recordings of a corpus
+
+   Corpus is a directory of reference recordings: keying logs
+   (NAME.cwkl, see cw_keylog_new_writer()) or sound (NAME.wav, mono
+   16-bit PCM), each with expected text in NAME.txt. Recordings are
+   received in a pool of threads, each with its own receiver.
+
+   A recording passes if its CER is not above
+   config::max_error_rate_percent, and (if there is a baseline entry
+   for it) not higher than baseline's CER by more than
+   config::max_regression_percent.
+
+   @p files is allocated by the function, free it with free().
+
+   @return 0 if all recordings have been examined (whether they passed or not)
+   @return -1 on failure
+*/
+int cw_rec_tester_corpus(const cw_rec_tester_corpus_config_t * config, cw_rec_tester_corpus_file_t ** files, size_t * n_files);
+
+/**
+   @brief Print results of cw_rec_tester_corpus()
+
+   Output can be used as baseline of later runs.
+
+   @return count of recordings that haven't passed
+*/
+size_t cw_rec_tester_corpus_print(FILE * file, const cw_rec_tester_corpus_file_t * files, size_t n_files);
+
+
+
+
 #if defined(__cplusplus)
 }
 #endif
@@ -21,9 +21,13 @@
 
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <libcw.h>
 
@@ -32,6 +36,19 @@
 
 
 
+#define CW_EASY_RECEIVER_ATOMIC_LOAD(m_var)          __atomic_load_n(&(m_var), __ATOMIC_ACQUIRE)
+#define CW_EASY_RECEIVER_ATOMIC_STORE(m_var, m_val)  __atomic_store_n(&(m_var), (m_val), __ATOMIC_RELEASE)
+
+
+
+
+static void cw_easy_receiver_process_event(cw_easy_receiver_t * easy_rec, const cw_easy_receiver_event_t * event);
+static void cw_easy_receiver_push_event(cw_easy_receiver_t * easy_rec, int key_state, const struct timeval * timestamp);
+static void cw_easy_receiver_timestamp_to_timeval(int64_t timestamp, struct timeval * tv);
+
+
+
+
 cw_easy_receiver_t * cw_easy_receiver_new(void)
 {
 	return (cw_easy_receiver_t *) calloc(1, sizeof (cw_easy_receiver_t));
@@ -82,6 +99,19 @@ void cw_easy_receiver_sk_event(cw_easy_receiver_t * easy_rec, bool is_down)
 
 
 
+void cw_easy_receiver_sk_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, int64_t timestamp)
+{
+	/* Like cw_easy_receiver_sk_event(), but the key has been
+	   keyed at given time, not now. */
+	cw_easy_receiver_timestamp_to_timeval(timestamp, &easy_rec->main_timer);
+	cw_notify_straight_key_event(is_down);
+
+	return;
+}
+
+
+
+
 void cw_easy_receiver_ik_left_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles)
 {
 	easy_rec->is_left_down = is_down;
@@ -141,6 +171,43 @@ void cw_easy_receiver_ik_right_event(cw_easy_receiver_t * easy_rec, bool is_down
 
 
 
+void cw_easy_receiver_ik_left_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles, int64_t timestamp)
+{
+	/* Like cw_easy_receiver_ik_left_event(), but the paddle has
+	   been pressed or released at given time, not now. */
+	easy_rec->is_left_down = is_down;
+	if (easy_rec->is_left_down && !easy_rec->is_right_down) {
+		cw_easy_receiver_timestamp_to_timeval(timestamp, &easy_rec->main_timer);
+	}
+
+	is_reverse_paddles
+		? cw_notify_keyer_dash_paddle_event(is_down)
+		: cw_notify_keyer_dot_paddle_event(is_down);
+	return;
+}
+
+
+
+
+void cw_easy_receiver_ik_right_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles, int64_t timestamp)
+{
+	/* Like cw_easy_receiver_ik_right_event(), but the paddle has
+	   been pressed or released at given time, not now. */
+	easy_rec->is_right_down = is_down;
+	if (easy_rec->is_right_down && !easy_rec->is_left_down) {
+		cw_easy_receiver_timestamp_to_timeval(timestamp, &easy_rec->main_timer);
+	}
+
+	is_reverse_paddles
+		? cw_notify_keyer_dot_paddle_event(is_down)
+		: cw_notify_keyer_dash_paddle_event(is_down);
+	return;
+}
+
+
+
+
+
 /**
    \brief Handler for the keying callback from the CW library
    indicating that the state of a key has changed.
@@ -155,18 +222,187 @@ void cw_easy_receiver_ik_right_event(cw_easy_receiver_t * easy_rec, bool is_down
    a separate task. Key and receiver are separate concepts. This
    function connects them.
 
-   This function, called on key state changes, calls receiver
-   functions to ensure that receiver does "receive" the key state
-   changes.
+   This function, called on key state changes, ensures that receiver
+   does "receive" the key state changes.
 
-   This function is called in signal handler context, and it takes
-   care to call only functions that are safe within that context.  In
-   particular, it goes out of its way to deliver results by setting
-   flags that are later handled by receive polling.
+   This function only queues the key state change, with current value
+   of easy receiver's main timer, in easy receiver's ring of events.
+   The events are passed to receiver by
+   cw_easy_receiver_process_events(), in the thread that polls the
+   easy receiver. The function doesn't block and doesn't take any
+   locks, so it can be called from generator's thread or from a
+   signal handler. Only one thread may call it at a time.
 */
 void cw_easy_receiver_handle_libcw_keying_event(void * easy_receiver, int key_state)
 {
 	cw_easy_receiver_t * easy_rec = (cw_easy_receiver_t *) easy_receiver;
+	cw_easy_receiver_push_event(easy_rec, key_state, &easy_rec->main_timer);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Handler for timed value tracking callback of libcw's generator
+
+   Like cw_easy_receiver_handle_libcw_keying_event(), but the key
+   state change is queued with the time at which it is heard, as
+   estimated by generator, see
+   cw_gen_register_timed_value_tracking_callback(). Durations of
+   marks and spaces seen by receiver are then not distorted by depth
+   of generator's and sound device's buffers.
+
+   \param easy_receiver easy receiver
+   \param key_state new state of key
+   \param timestamp time at which the new state is heard (CLOCK_MONOTONIC) [ns]
+*/
+void cw_easy_receiver_handle_libcw_timed_keying_event(void * easy_receiver, int key_state, int64_t timestamp)
+{
+	cw_easy_receiver_t * easy_rec = (cw_easy_receiver_t *) easy_receiver;
+
+	struct timeval tv = { 0 };
+	cw_easy_receiver_timestamp_to_timeval(timestamp, &tv);
+	cw_easy_receiver_push_event(easy_rec, key_state, &tv);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Convert timestamp of libcw's generator to wall clock time
+
+   Receiver works with wall clock timestamps (see
+   cw_easy_receiver_poll()), generator's timestamps are taken from
+   monotonic clock.
+
+   \param timestamp timestamp from monotonic clock [ns]
+   \param tv wall clock time corresponding to \p timestamp
+*/
+static void cw_easy_receiver_timestamp_to_timeval(int64_t timestamp, struct timeval * tv)
+{
+	struct timespec monotonic = { 0 };
+	struct timespec realtime = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &monotonic);
+	clock_gettime(CLOCK_REALTIME, &realtime);
+	const int64_t offset = ((int64_t) realtime.tv_sec - (int64_t) monotonic.tv_sec) * 1000000000 + (realtime.tv_nsec - monotonic.tv_nsec);
+	const int64_t usecs = (timestamp + offset) / 1000;
+
+	tv->tv_sec = (time_t) (usecs / 1000000);
+	tv->tv_usec = (suseconds_t) (usecs % 1000000);
+
+	return;
+}
+
+
+
+
+/**
+   \brief Queue key state change in easy receiver's ring of events
+
+   \param easy_rec easy receiver
+   \param key_state new state of key
+   \param timestamp time of the change
+*/
+static void cw_easy_receiver_push_event(cw_easy_receiver_t * easy_rec, int key_state, const struct timeval * timestamp)
+{
+	const unsigned int head = easy_rec->events_head; /* Written only by us. */
+	const unsigned int tail = CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->events_tail);
+	if (head - tail >= CW_EASY_RECEIVER_EVENTS_CAPACITY) {
+		/* Consumer doesn't keep up. Let it know that it has
+		   lost track of the key. */
+		__atomic_fetch_add(&easy_rec->events_dropped, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	cw_easy_receiver_event_t * event = &easy_rec->events[head & (CW_EASY_RECEIVER_EVENTS_CAPACITY - 1)];
+	event->key_state = key_state;
+	event->timestamp = *timestamp;
+
+	/* Publish the event. */
+	CW_EASY_RECEIVER_ATOMIC_STORE(easy_rec->events_head, head + 1);
+
+	if (CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->has_event_fd)) {
+		/* Wake up the consumer. write() to eventfd is safe in
+		   signal handler, too. */
+		const uint64_t one = 1;
+		if (sizeof (one) != write(easy_rec->event_fd, &one, sizeof (one))) {
+			; /* Counter is saturated, descriptor is readable anyway. */
+		}
+	}
+
+	return;
+}
+
+
+
+
+void cw_easy_receiver_process_events(cw_easy_receiver_t * easy_rec)
+{
+	const unsigned int dropped = CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->events_dropped);
+	if (dropped != easy_rec->events_dropped_seen) {
+		/* Some key events have been lost, so receiver's notion
+		   of marks and spaces is broken. Start from scratch. */
+		easy_rec->events_dropped_seen = dropped;
+		easy_rec->libcw_receive_errno = ENOSPC;
+		cw_clear_receive_buffer();
+		easy_rec->is_pending_iws = false;
+	}
+
+	/* Events timestamped by generator may describe changes of
+	   key that will be heard in near future. Receiver can't be
+	   polled at time earlier than its last event, so such events
+	   are left in the ring for later. */
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	unsigned int tail = easy_rec->events_tail; /* Written only by us. */
+	const unsigned int head = CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->events_head);
+	while (tail != head) {
+		if (timercmp(&easy_rec->events[tail & (CW_EASY_RECEIVER_EVENTS_CAPACITY - 1)].timestamp, &now, >)) {
+			break;
+		}
+		cw_easy_receiver_process_event(easy_rec, &easy_rec->events[tail & (CW_EASY_RECEIVER_EVENTS_CAPACITY - 1)]);
+		tail++;
+		/* Return the slot to producer. */
+		CW_EASY_RECEIVER_ATOMIC_STORE(easy_rec->events_tail, tail);
+	}
+
+	return;
+}
+
+
+
+
+int cw_easy_receiver_get_event_fd(cw_easy_receiver_t * easy_rec)
+{
+	if (!easy_rec->has_event_fd) {
+		const int fd = cw_get_receive_event_fd();
+		if (-1 == fd) {
+			return -1;
+		}
+		easy_rec->event_fd = fd;
+		CW_EASY_RECEIVER_ATOMIC_STORE(easy_rec->has_event_fd, true);
+	}
+
+	return easy_rec->event_fd;
+}
+
+
+
+
+/**
+   \brief Pass single key event to libcw's receiver
+
+   Called in the thread that polls the easy receiver.
+*/
+static void cw_easy_receiver_process_event(cw_easy_receiver_t * easy_rec, const cw_easy_receiver_event_t * event)
+{
+	const int key_state = event->key_state;
+
 	/* Ignore calls where the key state matches our tracked key
 	   state.  This avoids possible problems where this event
 	   handler is redirected between application instances; we
@@ -201,16 +437,16 @@ void cw_easy_receiver_handle_libcw_keying_event(void * easy_receiver, int key_st
 	   see if the library has registered any receive error. */
 	if (key_state) {
 		/* Key down. */
-		//fprintf(stderr, "start receive tone: %10ld . %10ld\n", easy_rec->main_timer->tv_sec, easy_rec->main_timer->tv_usec);
-		if (!cw_start_receive_tone(&easy_rec->main_timer)) {
+		//fprintf(stderr, "start receive tone: %10ld . %10ld\n", event->timestamp.tv_sec, event->timestamp.tv_usec);
+		if (!cw_start_receive_tone(&event->timestamp)) {
 			// TODO: Perhaps this should be counted as test error
 			perror("cw_start_receive_tone");
 			return;
 		}
 	} else {
 		/* Key up. */
-		//fprintf(stderr, "end receive tone:   %10ld . %10ld\n", easy_rec->main_timer->tv_sec, easy_rec->main_timer->tv_usec);
-		if (!cw_end_receive_tone(&easy_rec->main_timer)) {
+		//fprintf(stderr, "end receive tone:   %10ld . %10ld\n", event->timestamp.tv_sec, event->timestamp.tv_usec);
+		if (!cw_end_receive_tone(&event->timestamp)) {
 			/* Handle receive error detected on tone end.
 			   For ENOMEM and ENOENT we set the error in a
 			   class flag, and display the appropriate
@@ -347,6 +583,8 @@ bool cw_easy_receiver_poll_character(cw_easy_receiver_t * easy_rec, cw_rec_data_
 	   Additionally using reveiver.easy_rec->main_timer here would mess up time
 	   intervals measured by receiver.easy_rec->main_timer, and that would
 	   interfere with recognizing dots and dashes. */
+	cw_easy_receiver_process_events(easy_rec);
+
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
 	//fprintf(stderr, "poll_receive_char:  %10ld : %10ld\n", timer.tv_sec, timer.tv_usec);
@@ -428,6 +666,8 @@ bool cw_easy_receiver_poll_space(cw_easy_receiver_t * easy_rec, cw_rec_data_t *
 	   Don't use receiver.easy_rec->main_timer - it is used eclusively for
 	   marking initial "key down" events. Use local throw-away
 	   timer. */
+	cw_easy_receiver_process_events(easy_rec);
+
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
 	//fprintf(stderr, "poll_space(): %10ld : %10ld\n", timer.tv_sec, timer.tv_usec);
@@ -492,6 +732,10 @@ bool cw_easy_receiver_is_pending_inter_word_space(const cw_easy_receiver_t * eas
 
 void cw_easy_receiver_clear(cw_easy_receiver_t * easy_rec)
 {
+	/* Discard key events that haven't been processed yet. */
+	CW_EASY_RECEIVER_ATOMIC_STORE(easy_rec->events_tail, CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->events_head));
+	easy_rec->events_dropped_seen = CW_EASY_RECEIVER_ATOMIC_LOAD(easy_rec->events_dropped);
+
 	cw_clear_receive_buffer();
 	easy_rec->is_pending_iws = false;
 	easy_rec->libcw_receive_errno = 0;
@@ -5,6 +5,7 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 
@@ -18,6 +19,23 @@ extern "C"
 
 
 
+/* Capacity of easy receiver's ring of key events. Must be a power of
+   two. */
+#define CW_EASY_RECEIVER_EVENTS_CAPACITY 256
+
+
+
+
+/* Key event (beginning or end of mark), queued in easy receiver's
+   ring. */
+typedef struct cw_easy_receiver_event_t {
+	int key_state;
+	struct timeval timestamp;
+} cw_easy_receiver_event_t;
+
+
+
+
 struct cw_easy_receiver_t {
 	/* Timer for measuring length of dots and dashes.
 
@@ -58,6 +76,31 @@ struct cw_easy_receiver_t {
 	bool get_representation;
 
 	void * rec_tester;
+
+	/* Single-producer, single-consumer ring of key events, placed
+	   in front of libcw's receiver.
+
+	   The producer is the thread that delivers key events to
+	   cw_easy_receiver_handle_libcw_keying_event() (UI thread,
+	   generator's thread, GPIO handler). It only pushes timestamped
+	   events. The consumer is the thread that polls the easy
+	   receiver. It passes the events to libcw's receiver in
+	   cw_easy_receiver_process_events(), so libcw's receiver is
+	   used by only one thread.
+
+	   The indices are free-running counters, accessed with atomic
+	   builtins. Zero-initialized ring is empty. */
+	cw_easy_receiver_event_t events[CW_EASY_RECEIVER_EVENTS_CAPACITY];
+	unsigned int events_head;    /* Written only by producer. */
+	unsigned int events_tail;    /* Written only by consumer. */
+	unsigned int events_dropped; /* Count of events dropped by producer because the ring was full. */
+	unsigned int events_dropped_seen; /* Value of events_dropped already handled by consumer. */
+
+	/* Descriptor signalled by producer after queueing an event, see
+	   cw_easy_receiver_get_event_fd(). Valid only if has_event_fd
+	   is set. */
+	int event_fd;
+	bool has_event_fd;
 };
 typedef struct cw_easy_receiver_t cw_easy_receiver_t;
 
@@ -107,6 +150,14 @@ void cw_easy_receiver_clear(cw_easy_receiver_t * easy_rec);
 */
 void cw_easy_receiver_sk_event(cw_easy_receiver_t * easy_rec, bool is_down);
 
+/**
+   \brief Handle straight key event that happens at given time
+
+   \param is_down
+   \param timestamp time of the event in monotonic clock (CLOCK_MONOTONIC), e.g. from cw_gen_register_timed_value_tracking_callback() [ns]
+*/
+void cw_easy_receiver_sk_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, int64_t timestamp);
+
 /**
    \brief Handle event on left paddle of iambic keyer
 
@@ -123,11 +174,45 @@ void cw_easy_receiver_ik_left_event(cw_easy_receiver_t * easy_rec, bool is_down,
 */
 void cw_easy_receiver_ik_right_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles);
 
+/**
+   \brief Handle events on paddles of iambic keyer that happen at given time
+
+   \param is_down
+   \param is_reverse_paddles
+   \param timestamp time of the event in monotonic clock (CLOCK_MONOTONIC) [ns]
+*/
+void cw_easy_receiver_ik_left_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles, int64_t timestamp);
+void cw_easy_receiver_ik_right_timed_event(cw_easy_receiver_t * easy_rec, bool is_down, bool is_reverse_paddles, int64_t timestamp);
+
 
 
 
 /* CW library keying event handler. */
 void cw_easy_receiver_handle_libcw_keying_event(void * easy_receiver, int key_state);
+void cw_easy_receiver_handle_libcw_timed_keying_event(void * easy_receiver, int key_state, int64_t timestamp);
+
+/**
+   \brief Pass queued key events to libcw's receiver
+
+   Called by the polling functions of easy receiver. Must be called
+   only from the thread that polls the easy receiver. Events with
+   timestamps in the future are left in the ring until they happen.
+*/
+void cw_easy_receiver_process_events(cw_easy_receiver_t * easy_rec);
+
+/**
+   \brief Get descriptor that becomes readable when easy receiver should be polled
+
+   The descriptor is receiver's descriptor from libcw (see
+   cw_get_receive_event_fd()), additionally signalled when a key
+   event has been queued, so that the event is passed to libcw's
+   receiver without delay. Read the descriptor's counter before
+   polling.
+
+   \return file descriptor on success
+   \return -1 on failure
+*/
+int cw_easy_receiver_get_event_fd(cw_easy_receiver_t * easy_rec);
 
 
 
@@ -24,6 +24,11 @@
 #include <ctype.h>
 #include <time.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -80,6 +85,12 @@
    Comments in file are allowed (and skipped): lines starting with ';'
    or '#' characters are considered to be comments.
 
+   Dictionaries can also be stored in a compiled file (see
+   cw_dictionaries_write_compiled()). Such a file is mapped into
+   memory as it is, without parsing, so large word lists are loaded
+   instantly and memory pages of the file are shared by all processes
+   using it. cw_dictionaries_read() recognizes both kinds of files.
+
    Usually an application uses several dictionaries, and a file can also
    store few dictionaries.
 
@@ -89,13 +100,14 @@
    cw_dictionaries_iterate().
 
    The module implements functions providing following functionality:
-   \li loading dictionaries from text file to memory,
+   \li loading dictionaries from text file or compiled file to memory,
    \li removing dictionaries from memory,
-   \li writing current dictionaries from memory to text file,
+   \li writing current dictionaries from memory to text file or compiled file,
    \li iterating over list of dictionaries in memory,
    \li getting description of a specified dictionary,
    \li getting 'group size' information about given dictionary,
-   \li getting a random word from given dictionary.
+   \li getting a random word from given dictionary,
+   \li correcting received words with a trie of words of dictionaries.
 */
 
 
@@ -106,6 +118,7 @@ static bool cw_dictionary_parse_is_comment(const char *line);
 static bool cw_dictionary_parse_is_section(const char *line, char **name_ptr);
 
 static cw_dictionary_t *cw_dictionaries_create_from_stream(FILE *stream, const char *file);
+static cw_dictionary_t *cw_dictionaries_create_from_compiled(int fd, const char *file);
 static cw_dictionary_t *cw_dictionaries_create_default(void);
 
 static char *cw_dictionary_check_line(const char *line);
@@ -121,7 +134,9 @@ enum { MAX_LINE = 8192 };
 /* Aggregate dictionary data into a structure. */
 struct cw_dictionary_s {
 	const char *description;      /* Dictionary description */
-	const char *const *wordlist;  /* Dictionary word list */
+	const char *const *wordlist;  /* Dictionary word list, NULL for dictionary from compiled file */
+	const uint32_t *word_offsets; /* Dictionary from compiled file: offsets of words in 'words_data' */
+	const char *words_data;       /* Dictionary from compiled file: words, each terminated with NUL */
 	int wordlist_length;          /* Length of word list */
 	int group_size;               /* Size of a group */
 
@@ -135,6 +150,49 @@ struct cw_dictionary_s {
 /* Head of a list storing currently loaded dictionaries. */
 static cw_dictionary_t *dictionaries_head = NULL;
 
+/* Mapping of compiled file with currently loaded dictionaries, if any. */
+static void *dictionaries_map = NULL;
+static size_t dictionaries_map_size = 0;
+
+
+/*
+  Layout of compiled file. All integers are 32-bit, in byte order of
+  machine that wrote the file (a file written on a machine with
+  different byte order is rejected). All offsets are offsets in
+  string data at the end of the file.
+
+  header
+  dictionary records[dicts_count]
+  offsets of words[words_count]  (words of all dictionaries, in order of dictionaries)
+  string data[data_size]         (descriptions and words, each terminated with NUL)
+*/
+static const char CW_DICTIONARY_COMPILED_MAGIC[8] = { 'C', 'W', 'D', 'I', 'C', 'T', '\0', '\n' };
+enum { CW_DICTIONARY_COMPILED_VERSION = 1 };
+enum { CW_DICTIONARY_COMPILED_BYTE_ORDER = 0x01020304 };
+
+typedef struct {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t dicts_count;
+	uint32_t words_count;
+	uint32_t data_size;
+	uint32_t reserved;
+} cw_dictionary_compiled_header_t;
+
+typedef struct {
+	uint32_t description; /* Offset of description. */
+	uint32_t first_word;  /* Index of first word in table of offsets of words. */
+	uint32_t words_count;
+	uint32_t group_size;
+} cw_dictionary_compiled_record_t;
+
+
+static inline const char *cw_dictionary_get_word(const cw_dictionary_t *dict, int index)
+{
+	return dict->wordlist ? dict->wordlist[index] : dict->words_data + dict->word_offsets[index];
+}
+
 
 /*---------------------------------------------------------------------*/
 /*  Dictionary implementation                                          */
@@ -172,6 +230,8 @@ static dictionary *dictionary_new(dictionary *tail,
 	dictionary *dict = safe_malloc(sizeof (*dict));
 	dict->description = description;
 	dict->wordlist = wordlist;
+	dict->word_offsets = NULL;
+	dict->words_data = NULL;
 	dict->wordlist_length = words;
 	dict->group_size = is_multicharacter ? 1 : 5;
 	dict->next = NULL;
@@ -243,6 +303,12 @@ void cw_dictionaries_unload(void)
 
 	dictionaries_head = NULL;
 
+	if (dictionaries_map) {
+		munmap(dictionaries_map, dictionaries_map_size);
+		dictionaries_map = NULL;
+		dictionaries_map_size = 0;
+	}
+
 	return;
 }
 
@@ -625,13 +691,35 @@ bool cw_dictionaries_read(const char *file)
 		return false;
 	}
 
+	/* Compiled file is recognized by its magic. */
+	char magic[sizeof (CW_DICTIONARY_COMPILED_MAGIC)] = { 0 };
+	const bool is_compiled = sizeof (magic) == fread(magic, 1, sizeof (magic), stream)
+		&& 0 == memcmp(magic, CW_DICTIONARY_COMPILED_MAGIC, sizeof (magic));
+	rewind(stream);
+
+	/* The mapping is created before current dictionaries are
+	   unloaded, so keep it aside until then. */
+	void *old_map = dictionaries_map;
+	size_t old_map_size = dictionaries_map_size;
+	dictionaries_map = NULL;
+	dictionaries_map_size = 0;
+
 	/* If we can generate a dictionary list, free any currently
 	   allocated one and store the details of what we loaded into
 	   module variables. */
-	cw_dictionary_t *head = cw_dictionaries_create_from_stream(stream, file);
+	cw_dictionary_t *head = is_compiled
+		? cw_dictionaries_create_from_compiled(fileno(stream), file)
+		: cw_dictionaries_create_from_stream(stream, file);
+
+	void *new_map = dictionaries_map;
+	size_t new_map_size = dictionaries_map_size;
+	dictionaries_map = old_map;
+	dictionaries_map_size = old_map_size;
 	if (head) {
 		cw_dictionaries_unload();
 		dictionaries_head = head;
+		dictionaries_map = new_map;
+		dictionaries_map_size = new_map_size;
 	}
 
 	/* Close stream and return true if we loaded a dictionary. */
@@ -726,8 +814,9 @@ bool cw_dictionaries_write(const char *file)
 
 		int chars = 0;
 		for (int i = 0; i < dict->wordlist_length; i++) {
-			fprintf(stream, " %s", dict->wordlist[i]);
-			chars += strlen(dict->wordlist[i]) + 1;
+			const char *word = cw_dictionary_get_word(dict, i);
+			fprintf(stream, " %s", word);
+			chars += strlen(word) + 1;
 			if (chars > 72) {
 				fprintf(stream, "\n");
 				chars = 0;
@@ -753,6 +842,235 @@ int dictionary_write(const char *file)
 
 
 
+/**
+   \brief Create a dictionary list from compiled file
+
+   Map a compiled file (see cw_dictionaries_write_compiled()) into
+   memory and create list of dictionaries that refer to data in the
+   mapping. On success the mapping is stored in module variables, so
+   that cw_dictionaries_unload() can remove it.
+
+   This is a lower level function, to be used by cw_dictionaries_read().
+
+   \param fd - file descriptor of open compiled file
+   \param file - human-readable name of the file
+
+   \return head of list of loaded dictionaries on success
+   \return NULL if loading fails.
+*/
+cw_dictionary_t *cw_dictionaries_create_from_compiled(int fd, const char *file)
+{
+	struct stat st;
+	if (-1 == fstat(fd, &st)) {
+		fprintf(stderr, "%s: stat error: %s\n", file, strerror(errno));
+		return NULL;
+	}
+	if ((uint64_t) st.st_size < sizeof (cw_dictionary_compiled_header_t)
+	    || (uint64_t) st.st_size > UINT32_MAX) {
+		fprintf(stderr, "%s: invalid size of compiled dictionary file\n", file);
+		return NULL;
+	}
+
+	const size_t size = (size_t) st.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "%s: mmap error: %s\n", file, strerror(errno));
+		return NULL;
+	}
+
+	/* Validate the file before trusting any offset found in it. */
+	const cw_dictionary_compiled_header_t *header = map;
+	const uint64_t records_size = (uint64_t) header->dicts_count * sizeof (cw_dictionary_compiled_record_t);
+	const uint64_t offsets_size = (uint64_t) header->words_count * sizeof (uint32_t);
+	const char *error = NULL;
+	if (header->byte_order != CW_DICTIONARY_COMPILED_BYTE_ORDER) {
+		error = "compiled dictionary file has been written on machine with different byte order";
+	} else if (header->version != CW_DICTIONARY_COMPILED_VERSION) {
+		error = "unsupported version of compiled dictionary file";
+	} else if (sizeof (*header) + records_size + offsets_size + header->data_size != size
+		   || 0 == header->dicts_count
+		   || 0 == header->data_size) {
+		error = "invalid layout of compiled dictionary file";
+	}
+
+	const cw_dictionary_compiled_record_t *records = (const void *) (header + 1);
+	const uint32_t *offsets = (const void *) (records + header->dicts_count);
+	const char *data = (const void *) (offsets + header->words_count);
+
+	if (!error && data[header->data_size - 1] != '\0') {
+		error = "unterminated string data in compiled dictionary file";
+	}
+	for (uint32_t i = 0; !error && i < header->words_count; i++) {
+		if (offsets[i] >= header->data_size) {
+			error = "invalid offset of word in compiled dictionary file";
+		}
+	}
+	for (uint32_t i = 0; !error && i < header->dicts_count; i++) {
+		const cw_dictionary_compiled_record_t *record = &records[i];
+		if (record->description >= header->data_size
+		    || 0 == record->words_count
+		    || record->words_count > INT32_MAX
+		    || record->first_word > header->words_count
+		    || record->words_count > header->words_count - record->first_word
+		    || record->group_size < 1 || record->group_size > INT32_MAX) {
+
+			error = "invalid dictionary record in compiled dictionary file";
+		}
+	}
+	if (error) {
+		fprintf(stderr, "%s: %s\n", file, error);
+		munmap(map, size);
+		return NULL;
+	}
+
+	/* Only the small per-dictionary nodes are allocated, words stay
+	   in the mapping. */
+	dictionary *head = NULL;
+	dictionary *tail = NULL;
+	for (uint32_t i = 0; i < header->dicts_count; i++) {
+		dictionary *dict = safe_malloc(sizeof (*dict));
+		memset(dict, 0, sizeof (*dict));
+		dict->description = data + records[i].description;
+		dict->word_offsets = offsets + records[i].first_word;
+		dict->words_data = data;
+		dict->wordlist_length = (int) records[i].words_count;
+		dict->group_size = (int) records[i].group_size;
+
+		if (tail) {
+			tail->next = dict;
+		} else {
+			head = dict;
+		}
+		tail = dict;
+	}
+
+	dictionaries_map = map;
+	dictionaries_map_size = size;
+
+	return head;
+}
+
+
+
+
+
+/**
+   \brief Write current dictionaries to given compiled file
+
+   Write the currently loaded (or default) dictionaries out to a given
+   file in compiled format, which can be read with
+   cw_dictionaries_read() faster than text file.
+
+   \param file - file to write to
+
+   \return true on success
+   \return false if writing fails
+*/
+bool cw_dictionaries_write_compiled(const char *file)
+{
+	if (!dictionaries_head) {
+		dictionaries_head = cw_dictionaries_create_default();
+	}
+
+	cw_dictionary_compiled_header_t header;
+	memset(&header, 0, sizeof (header));
+	memcpy(header.magic, CW_DICTIONARY_COMPILED_MAGIC, sizeof (header.magic));
+	header.byte_order = CW_DICTIONARY_COMPILED_BYTE_ORDER;
+	header.version = CW_DICTIONARY_COMPILED_VERSION;
+
+	/* Count dictionaries, words and size of string data. */
+	uint64_t data_size = 0;
+	uint64_t words_count = 0;
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		header.dicts_count++;
+		data_size += strlen(dict->description) + 1;
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			data_size += strlen(cw_dictionary_get_word(dict, i)) + 1;
+		}
+		words_count += (uint64_t) dict->wordlist_length;
+	}
+	if (data_size + words_count * 4 + header.dicts_count * sizeof (cw_dictionary_compiled_record_t) + sizeof (header) > UINT32_MAX) {
+		fprintf(stderr, "%s: dictionaries are too large for compiled file\n", file);
+		return false;
+	}
+	header.words_count = (uint32_t) words_count;
+	header.data_size = (uint32_t) data_size;
+
+	cw_dictionary_compiled_record_t *records = safe_malloc(header.dicts_count * sizeof (records[0]));
+	uint32_t *offsets = safe_malloc((words_count ? words_count : 1) * sizeof (offsets[0]));
+	char *data = safe_malloc(data_size);
+
+	/* Fill tables and string data. */
+	uint32_t d = 0;
+	uint32_t w = 0;
+	size_t data_len = 0;
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next, d++) {
+		records[d].description = (uint32_t) data_len;
+		records[d].first_word = w;
+		records[d].words_count = (uint32_t) dict->wordlist_length;
+		records[d].group_size = (uint32_t) dict->group_size;
+
+		const size_t len = strlen(dict->description) + 1;
+		memcpy(data + data_len, dict->description, len);
+		data_len += len;
+
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			const char *word = cw_dictionary_get_word(dict, i);
+			const size_t word_len = strlen(word) + 1;
+			offsets[w++] = (uint32_t) data_len;
+			memcpy(data + data_len, word, word_len);
+			data_len += word_len;
+		}
+	}
+
+	/* Processes using the old file have it mapped into memory, so
+	   the file must not be modified in place. New file is written
+	   next to it, and then replaces it. */
+	const size_t tmp_size = strlen(file) + sizeof (".XXXXXX");
+	char *tmp_file = safe_malloc(tmp_size);
+	snprintf(tmp_file, tmp_size, "%s.XXXXXX", file);
+
+	bool success = false;
+	const int fd = mkstemp(tmp_file);
+	FILE *stream = -1 == fd ? NULL : fdopen(fd, "wb");
+	if (!stream) {
+		fprintf(stderr, "%s: open error: %s\n", tmp_file, strerror(errno));
+		if (-1 != fd) {
+			close(fd);
+			unlink(tmp_file);
+		}
+	} else {
+		success = 1 == fwrite(&header, sizeof (header), 1, stream)
+			&& header.dicts_count == fwrite(records, sizeof (records[0]), header.dicts_count, stream)
+			&& header.words_count == fwrite(offsets, sizeof (offsets[0]), header.words_count, stream)
+			&& data_size == fwrite(data, 1, data_size, stream);
+		/* mkstemp() creates file readable only by its owner. */
+		if (0 != fchmod(fd, 0644) || 0 != fclose(stream)) {
+			success = false;
+		}
+		if (!success) {
+			fprintf(stderr, "%s: write error: %s\n", tmp_file, strerror(errno));
+		} else if (0 != rename(tmp_file, file)) {
+			fprintf(stderr, "%s: rename error: %s\n", file, strerror(errno));
+			success = false;
+		}
+		if (!success) {
+			unlink(tmp_file);
+		}
+	}
+	free(tmp_file);
+
+	free(records);
+	free(offsets);
+	free(data);
+
+	return success;
+}
+
+
+
+
+
 /**
    \brief Get description of a given dictionary
 
@@ -805,24 +1123,62 @@ int get_dictionary_group_size(const dictionary *dict)
 
 
 
+/**
+   \brief Get next pseudo-random value
+
+   The function may be called from many threads at the same time: the
+   state is a counter advanced with one atomic operation, and each
+   value of the counter is turned into a pseudo-random value with
+   finalizer of splitmix64 generator.
+
+   \return pseudo-random value
+*/
+static uint64_t cw_dictionary_random(void)
+{
+	static const uint64_t increment = 0x9e3779b97f4a7c15ULL;
+	static uint64_t state = 0;
+
+	/* On the first call, seed the generator. */
+	uint64_t current = __atomic_load_n(&state, __ATOMIC_RELAXED);
+	if (!current) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		const uint64_t seed = ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec) ^ ((uint64_t) getpid() << 40);
+		/* If another thread has seeded the state in the meantime,
+		   its seed is used. */
+		__atomic_compare_exchange_n(&state, &current, seed | 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	uint64_t z = __atomic_add_fetch(&state, increment, __ATOMIC_RELAXED);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+
+
+
 /**
    \brief Get a random word from given dictionary
 
+   The function is thread-safe.
+
    \param dict - dictionary to query
 
    \return a string
 */
 const char *cw_dictionary_get_random_word(const cw_dictionary_t *dict)
 {
-	static bool is_initialized = false;
-
-	/* On the first call, seed the random number generator. */
-	if (!is_initialized) {
-		srand(time(NULL));
-		is_initialized = true;
-	}
-
-	return dict->wordlist[rand() % dict->wordlist_length];
+	/* Reject values that would make lower indices more probable. */
+	const uint64_t n = (uint64_t) dict->wordlist_length;
+	const uint64_t threshold = (0 - n) % n;
+	uint64_t x;
+	do {
+		x = cw_dictionary_random();
+	} while (x < threshold);
+
+	return cw_dictionary_get_word(dict, (int) (x % n));
 }
 
 
@@ -843,18 +1199,433 @@ const char *get_dictionary_random_word(const dictionary *dict)
 
 
 
+/*---------------------------------------------------------------------*/
+/*  Trie of words, for correction of received words                    */
+/*---------------------------------------------------------------------*/
+
+/*
+  A received word is corrected by searching the trie for a word with
+  the smallest cost of edits turning the word's Morse code into the
+  observed Morse code.
+
+  The trie is built over Morse code of words, not over their letters:
+  symbols on edges of the trie are dots, dashes and inter-character
+  spaces. This way the search can take into account the errors that
+  receiver actually makes when it misjudges durations of marks and
+  spaces: a dot received as a dash, a lost or extra mark, and an
+  inter-mark-space taken for inter-character-space (or the other way
+  round) which splits or merges characters. Misjudged space is the
+  most frequent error, so it is the cheapest one.
+
+  Nodes are kept in a single array and refer to children by index, so
+  the trie is compact and is searched without chasing pointers all
+  over the memory.
+*/
+
+/* Symbols on edges of trie. */
+enum {
+	CW_TRIE_DOT,
+	CW_TRIE_DASH,
+	CW_TRIE_GAP,     /* Inter-character space. */
+	CW_TRIE_SYMBOLS
+};
+
+typedef struct {
+	int child[CW_TRIE_SYMBOLS]; /* Index of child node, zero if none (root is never a child). */
+	int word;                   /* Offset of word ending at this node in trie's text, -1 if none. */
+} cw_dictionary_trie_node_t;
+
+struct cw_dictionary_trie_s {
+	cw_dictionary_trie_node_t *nodes; /* nodes[0] is the root. */
+	int nodes_count;
+	int nodes_capacity;
+
+	char *text;                       /* Words, each terminated with NUL. */
+	size_t text_length;
+	size_t text_capacity;
+
+	int words_count;
+	int max_depth;                    /* Length of the longest path from root. */
+};
+
+
+static int  cw_dictionary_trie_symbol_cost(int symbol);
+static int  cw_dictionary_trie_add_node(cw_dictionary_trie_t *trie);
+static void cw_dictionary_trie_add_word(cw_dictionary_trie_t *trie, const char *word);
+static void cw_dictionary_trie_search(const cw_dictionary_trie_t *trie, int node, int depth,
+				      const int *observed, int observed_length, int *rows, int max_cost,
+				      int *best_cost, int *best_word);
+
+
+
+
+
+/* Cost of inserting or deleting given symbol. */
+int cw_dictionary_trie_symbol_cost(int symbol)
+{
+	return symbol == CW_TRIE_GAP ? CW_DICTIONARY_TRIE_COST_GAP : CW_DICTIONARY_TRIE_COST_MARK;
+}
+
+
+
+
+
+int cw_dictionary_trie_add_node(cw_dictionary_trie_t *trie)
+{
+	if (trie->nodes_count == trie->nodes_capacity) {
+		trie->nodes_capacity = trie->nodes_capacity ? trie->nodes_capacity * 2 : 1024;
+		trie->nodes = safe_realloc(trie->nodes, trie->nodes_capacity * sizeof (trie->nodes[0]));
+	}
+
+	cw_dictionary_trie_node_t *node = &trie->nodes[trie->nodes_count];
+	for (int s = 0; s < CW_TRIE_SYMBOLS; s++) {
+		node->child[s] = 0;
+	}
+	node->word = -1;
+
+	return trie->nodes_count++;
+}
+
+
+
+
+
+/*
+  Add Morse code of given word to the trie. Words with characters
+  that have no Morse code are skipped. Words that differ only in case
+  of letters have the same Morse code, the first one is kept.
+*/
+void cw_dictionary_trie_add_word(cw_dictionary_trie_t *trie, const char *word)
+{
+	if (!word[0]) {
+		return;
+	}
+
+	/* Check the whole word before modifying the trie. */
+	for (const char *c = word; *c; c++) {
+		if (!cw_character_is_valid(*c) || *c == ' ') {
+			return;
+		}
+	}
+
+	int node = 0;
+	int depth = 0;
+	for (const char *c = word; *c; c++) {
+		char *representation = cw_character_to_representation(toupper((unsigned char) *c));
+		if (!representation) {
+			/* Unlikely, the character has been checked above. */
+			return;
+		}
+
+		for (const char *element = representation; ; element++) {
+			int symbol;
+			if (*element == CW_DOT_REPRESENTATION) {
+				symbol = CW_TRIE_DOT;
+			} else if (*element == CW_DASH_REPRESENTATION) {
+				symbol = CW_TRIE_DASH;
+			} else if (!*element && c[1]) {
+				symbol = CW_TRIE_GAP;
+			} else {
+				break;
+			}
+
+			if (!trie->nodes[node].child[symbol]) {
+				/* Adding a node may move the array, don't
+				   keep pointers into it. */
+				const int child = cw_dictionary_trie_add_node(trie);
+				trie->nodes[node].child[symbol] = child;
+			}
+			node = trie->nodes[node].child[symbol];
+			depth++;
+
+			if (!*element) {
+				break;
+			}
+		}
+		free(representation);
+	}
+
+	if (trie->nodes[node].word != -1) {
+		return;
+	}
+
+	const size_t length = strlen(word) + 1;
+	if (trie->text_length + length > trie->text_capacity) {
+		trie->text_capacity = (trie->text_capacity + length) * 2;
+		trie->text = safe_realloc(trie->text, trie->text_capacity);
+	}
+	for (size_t i = 0; i < length; i++) {
+		trie->text[trie->text_length + i] = (char) toupper((unsigned char) word[i]);
+	}
+	trie->nodes[node].word = (int) trie->text_length;
+	trie->text_length += length;
+
+	trie->words_count++;
+	if (depth > trie->max_depth) {
+		trie->max_depth = depth;
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Create trie of words of dictionaries
+
+   Words are converted to upper case. Words containing characters that
+   can't be sent in Morse code are skipped.
+
+   \param dict - dictionary to take words from, or NULL to take words from all dictionaries (see cw_dictionaries_iterate())
+
+   \return new trie, delete it with cw_dictionary_trie_delete()
+*/
+cw_dictionary_trie_t *cw_dictionary_trie_new(const cw_dictionary_t *dict)
+{
+	cw_dictionary_trie_t *trie = safe_malloc(sizeof (*trie));
+	memset(trie, 0, sizeof (*trie));
+	cw_dictionary_trie_add_node(trie); /* Root. */
+
+	for (const cw_dictionary_t *d = dict ? dict : cw_dictionaries_iterate(NULL);
+	     d;
+	     d = dict ? NULL : cw_dictionaries_iterate(d)) {
+
+		for (int i = 0; i < d->wordlist_length; i++) {
+			cw_dictionary_trie_add_word(trie, cw_dictionary_get_word(d, i));
+		}
+	}
+
+	return trie;
+}
+
+
+
+
+
+/**
+   \brief Delete trie of words
+
+   \param trie - pointer to trie to delete, the trie is set to NULL
+*/
+void cw_dictionary_trie_delete(cw_dictionary_trie_t **trie)
+{
+	if (!trie || !*trie) {
+		return;
+	}
+
+	free((*trie)->nodes);
+	free((*trie)->text);
+	free(*trie);
+	*trie = NULL;
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Get count of words in trie
+
+   \param trie - trie to query
+
+   \return count of distinct words in trie
+*/
+int cw_dictionary_trie_get_words_count(const cw_dictionary_trie_t *trie)
+{
+	return trie->words_count;
+}
+
+
+
+
+
+/*
+  Depth-first search of trie for a word with cost of edits not larger
+  than @max_cost, with one row of edit-distance matrix per level of
+  trie.
+
+  rows[depth * (observed_length + 1) + j] is the smallest cost of
+  turning the path from root to the current node (of length @depth)
+  into first j symbols of observed sequence. Every insertion and
+  deletion costs at least one, so only cells with |j - depth| <=
+  @max_cost are calculated; cells just outside of that band are set
+  to a value larger than @max_cost. Subtrees whose row has no cost
+  smaller than @best_cost are skipped.
+*/
+void cw_dictionary_trie_search(const cw_dictionary_trie_t *trie, int node, int depth,
+			       const int *observed, int observed_length, int *rows, int max_cost,
+			       int *best_cost, int *best_word)
+{
+	const int *row = rows + depth * (observed_length + 1);
+	int *next_row = rows + (depth + 1) * (observed_length + 1);
+	const int beyond = max_cost + 1;
+
+	const int next_depth = depth + 1;
+	const int lo = next_depth - max_cost > 1 ? next_depth - max_cost : 1;
+	const int hi = next_depth + max_cost < observed_length ? next_depth + max_cost : observed_length;
+
+	for (int symbol = 0; symbol < CW_TRIE_SYMBOLS; symbol++) {
+		const int child = trie->nodes[node].child[symbol];
+		if (!child) {
+			continue;
+		}
+
+		const int deletion = cw_dictionary_trie_symbol_cost(symbol);
+		next_row[0] = next_depth <= max_cost ? row[0] + deletion : beyond;
+		if (lo > 1) {
+			next_row[lo - 1] = beyond;
+		}
+		int row_min = next_row[0];
+		for (int j = lo; j <= hi; j++) {
+			const int o = observed[j - 1];
+			int substitution;
+			if (o == symbol) {
+				substitution = 0;
+			} else if (o != CW_TRIE_GAP && symbol != CW_TRIE_GAP) {
+				/* Dot received as dash or vice versa. */
+				substitution = CW_DICTIONARY_TRIE_COST_MARK;
+			} else {
+				substitution = deletion + cw_dictionary_trie_symbol_cost(o);
+			}
+
+			int cost = row[j - 1] + substitution;
+			if (row[j] + deletion < cost) {
+				cost = row[j] + deletion;
+			}
+			if (next_row[j - 1] + cw_dictionary_trie_symbol_cost(o) < cost) {
+				cost = next_row[j - 1] + cw_dictionary_trie_symbol_cost(o);
+			}
+			next_row[j] = cost;
+			if (cost < row_min) {
+				row_min = cost;
+			}
+		}
+		if (hi < observed_length) {
+			next_row[hi + 1] = beyond;
+		}
+
+		if (trie->nodes[child].word != -1 && hi == observed_length && next_row[observed_length] < *best_cost) {
+			*best_cost = next_row[observed_length];
+			*best_word = trie->nodes[child].word;
+		}
+
+		if (row_min < *best_cost && next_depth < trie->max_depth) {
+			cw_dictionary_trie_search(trie, child, next_depth, observed, observed_length, rows, max_cost, best_cost, best_word);
+		}
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Find a word that best matches received Morse code
+
+   \p representations is a received word: representations of received
+   characters (made of dots and dashes) separated with spaces,
+   e.g. "-.-. --.-". Representations that don't correspond to any
+   character (receive errors) are allowed.
+
+   The function looks for a word in \p trie with the smallest cost of
+   edits turning its Morse code into \p representations. Changing a
+   dot into a dash (or vice versa), and inserting or deleting a mark
+   costs CW_DICTIONARY_TRIE_COST_MARK. Inserting or deleting
+   inter-character space costs CW_DICTIONARY_TRIE_COST_GAP. Among
+   words with the same cost, the function returns one of them.
+
+   \param trie - trie to search
+   \param representations - received word
+   \param max_cost - maximal acceptable cost of edits
+   \param cost - cost of edits for returned word (may be NULL)
+
+   \return word with the smallest cost of edits, not larger than \p max_cost
+   \return NULL if there is no such word, or if \p representations is invalid
+*/
+const char *cw_dictionary_trie_correct(const cw_dictionary_trie_t *trie, const char *representations, int max_cost, int *cost)
+{
+	/* Convert received word into sequence of symbols. Runs of
+	   spaces count as single inter-character space. */
+	const size_t length = strlen(representations);
+	int *observed = safe_malloc((length + 1) * sizeof (observed[0]));
+	int observed_length = 0;
+	for (const char *c = representations; *c; c++) {
+		if (*c == CW_DOT_REPRESENTATION) {
+			observed[observed_length++] = CW_TRIE_DOT;
+		} else if (*c == CW_DASH_REPRESENTATION) {
+			observed[observed_length++] = CW_TRIE_DASH;
+		} else if (*c == ' ') {
+			if (observed_length && observed[observed_length - 1] != CW_TRIE_GAP) {
+				observed[observed_length++] = CW_TRIE_GAP;
+			}
+		} else {
+			free(observed);
+			return NULL;
+		}
+	}
+	if (observed_length && observed[observed_length - 1] == CW_TRIE_GAP) {
+		observed_length--;
+	}
+	if (!observed_length) {
+		free(observed);
+		return NULL;
+	}
+
+	/* Row for root: all observed symbols are inserted. */
+	int *rows = safe_malloc((size_t) (trie->max_depth + 1) * (observed_length + 1) * sizeof (rows[0]));
+	rows[0] = 0;
+	for (int j = 1; j <= observed_length; j++) {
+		rows[j] = rows[j - 1] + cw_dictionary_trie_symbol_cost(observed[j - 1]);
+	}
+
+	/* Search with increasing limit of cost. Most received words
+	   need few edits or none, and search with small limit visits
+	   only a small part of the trie. */
+	int best_cost = 0;
+	int best_word = -1;
+	for (int limit = 0; limit <= max_cost && best_word == -1; limit++) {
+		best_cost = limit + 1;
+		cw_dictionary_trie_search(trie, 0, 0, observed, observed_length, rows, limit, &best_cost, &best_word);
+	}
+
+	free(rows);
+	free(observed);
+
+	if (best_word == -1) {
+		return NULL;
+	}
+	if (cost) {
+		*cost = best_cost;
+	}
+	return trie->text + best_word;
+}
+
+
+
+
+
 #ifdef CW_DICTIONARY_UNIT_TESTS
 
 
 
 
 static unsigned int test_cw_dictionary_check_line(void);
+static unsigned int test_cw_dictionary_trie_correct(void);
+static unsigned int test_cw_dictionary_compiled(void);
 
 
 typedef unsigned int (*cw_dict_test_function_t)(void);
 
 static cw_dict_test_function_t cw_dict_unit_tests[] = {
 	test_cw_dictionary_check_line,
+	test_cw_dictionary_trie_correct,
+	test_cw_dictionary_compiled,
 	NULL
 };
 
@@ -960,4 +1731,160 @@ unsigned int test_cw_dictionary_check_line(void)
 
 
 
+
+
+unsigned int test_cw_dictionary_trie_correct(void)
+{
+	fprintf(stderr, "\ndictionary: cw_dictionary_trie_correct():");
+
+	char data[] = "[ Test ]\nparis CQ TEST test QRZ SP5ABC\nDE\n";
+	FILE *stream = fmemopen(data, strlen(data), "r");
+	cw_assert (stream, "failed to open stream with dictionary");
+	cw_dictionary_t *dict = cw_dictionaries_create_from_stream(stream, "test");
+	fclose(stream);
+	cw_assert (dict, "failed to create dictionary");
+
+	cw_dictionary_trie_t *trie = cw_dictionary_trie_new(dict);
+	cw_assert (trie, "failed to create trie");
+
+	/* "TEST" and "test" have the same Morse code. */
+	cw_assert (cw_dictionary_trie_get_words_count(trie) == 6,
+		   "unexpected count of words in trie: %d", cw_dictionary_trie_get_words_count(trie));
+
+	struct {
+		const char *representations;
+		int max_cost;
+		const char *expected_word;  /* NULL if no word is expected. */
+		int expected_cost;
+	} test_data[] = {
+		/* Received without errors. */
+		{ ".--. .- .-. .. ...",       0, "PARIS",  0 },
+		{ "  -.. .  ",                0, "DE",     0 },
+
+		/* One inter-character space too short: "PARIS" received as "P" + unknown character + ... */
+		{ ".--..- .-. .. ...",        4, "PARIS",  CW_DICTIONARY_TRIE_COST_GAP },
+
+		/* One inter-mark space too long: "Q" split into "M" + "A". */
+		{ "-.-. -- .-",               4, "CQ",     CW_DICTIONARY_TRIE_COST_GAP },
+
+		/* Dash received as dot: "CQ" received as "CZ". */
+		{ "-.-. --..",                4, "CQ",     CW_DICTIONARY_TRIE_COST_MARK },
+
+		/* Two elements received wrong: "QRZ" received as "QKZ". */
+		{ "--.- -.- --..",            4, "QRZ",    2 * CW_DICTIONARY_TRIE_COST_MARK },
+		{ "--.- -.- --..",            3, NULL,     0 },
+
+		/* Nothing similar in dictionary. */
+		{ "...---... ...---...",      4, NULL,     0 },
+
+		/* Invalid input. */
+		{ "",                         4, NULL,     0 },
+		{ ".-x",                      4, NULL,     0 },
+
+		{ NULL,                       0, NULL,     0 } /* Guard. */
+	};
+
+	for (int i = 0; test_data[i].representations; i++) {
+		int cost = -1;
+		const char *word = cw_dictionary_trie_correct(trie, test_data[i].representations, test_data[i].max_cost, &cost);
+		if (test_data[i].expected_word) {
+			cw_assert (word && !strcmp(word, test_data[i].expected_word),
+				   "test #%d: unexpected word '%s' for '%s'", i, word ? word : "(null)", test_data[i].representations);
+			cw_assert (cost == test_data[i].expected_cost,
+				   "test #%d: unexpected cost %d", i, cost);
+		} else {
+			cw_assert (!word, "test #%d: unexpected word '%s' for '%s'", i, word, test_data[i].representations);
+		}
+	}
+
+	cw_dictionary_trie_delete(&trie);
+	cw_assert (!trie, "trie not deleted");
+
+	/* Free the test dictionary. */
+	cw_dictionary_t *saved_head = dictionaries_head;
+	dictionaries_head = dict;
+	cw_dictionaries_unload();
+	dictionaries_head = saved_head;
+
+	fprintf(stderr, "dictionary: cw_dictionary_trie_correct() passed\n");
+
+	return 0;
+}
+
+
+
+unsigned int test_cw_dictionary_compiled(void)
+{
+	fprintf(stderr, "\ndictionary: compiled dictionaries:");
+
+	char text_path[] = "/tmp/cw_dictionary_test_XXXXXX";
+	int fd = mkstemp(text_path);
+	cw_assert (fd != -1, "failed to create temporary file");
+	const char text[] = "[ Digits ]\n1 2 3\n[ Words ]\nparis CQ\nDE QRZ\n";
+	cw_assert (write(fd, text, strlen(text)) == (ssize_t) strlen(text), "failed to write temporary file");
+	close(fd);
+
+	char compiled_path[] = "/tmp/cw_dictionary_test_XXXXXX";
+	fd = mkstemp(compiled_path);
+	cw_assert (fd != -1, "failed to create temporary file");
+	close(fd);
+
+	/* Text file -> compiled file -> dictionaries in memory. */
+	cw_assert (cw_dictionaries_read(text_path), "failed to read text file");
+	cw_assert (cw_dictionaries_write_compiled(compiled_path), "failed to write compiled file");
+	cw_assert (cw_dictionaries_read(compiled_path), "failed to read compiled file");
+	cw_assert (dictionaries_map, "compiled file has not been mapped");
+
+	const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	cw_assert (dict && !strcmp(cw_dictionary_get_description(dict), "Digits"), "unexpected first dictionary");
+	cw_assert (cw_dictionary_get_group_size(dict) == 5, "unexpected group size %d", cw_dictionary_get_group_size(dict));
+	cw_assert (dict->wordlist_length == 3, "unexpected count of words %d", dict->wordlist_length);
+
+	dict = cw_dictionaries_iterate(dict);
+	cw_assert (dict && !strcmp(cw_dictionary_get_description(dict), "Words"), "unexpected second dictionary");
+	cw_assert (cw_dictionary_get_group_size(dict) == 1, "unexpected group size %d", cw_dictionary_get_group_size(dict));
+	const char *expected[] = { "paris", "CQ", "DE", "QRZ" };
+	cw_assert (dict->wordlist_length == 4, "unexpected count of words %d", dict->wordlist_length);
+	for (int i = 0; i < 4; i++) {
+		cw_assert (!strcmp(cw_dictionary_get_word(dict, i), expected[i]), "unexpected word #%d", i);
+	}
+	cw_assert (!cw_dictionaries_iterate(dict), "unexpected third dictionary");
+
+	/* Every word should be picked now and then. */
+	bool is_picked[4] = { false };
+	for (int i = 0; i < 1000; i++) {
+		const char *word = cw_dictionary_get_random_word(dict);
+		int j = 0;
+		while (j < 4 && strcmp(word, expected[j])) {
+			j++;
+		}
+		cw_assert (j < 4, "unexpected random word '%s'", word);
+		is_picked[j] = true;
+	}
+	for (int i = 0; i < 4; i++) {
+		cw_assert (is_picked[i], "word #%d has never been picked", i);
+	}
+
+	/* Corrupted file must be rejected, and must not replace
+	   dictionaries loaded so far. */
+	fd = open(text_path, O_WRONLY | O_TRUNC);
+	cw_assert (fd != -1, "failed to open temporary file");
+	cw_assert (write(fd, CW_DICTIONARY_COMPILED_MAGIC, sizeof (CW_DICTIONARY_COMPILED_MAGIC)) == (ssize_t) sizeof (CW_DICTIONARY_COMPILED_MAGIC), "failed to write temporary file");
+	close(fd);
+	cw_assert (!cw_dictionaries_read(text_path), "truncated compiled file has been accepted");
+	cw_assert (!strcmp(cw_dictionary_get_description(cw_dictionaries_iterate(NULL)), "Digits"), "dictionaries have been replaced");
+
+	cw_dictionaries_unload();
+	cw_assert (!dictionaries_map, "compiled file has not been unmapped");
+
+	unlink(text_path);
+	unlink(compiled_path);
+
+	fprintf(stderr, "dictionary: compiled dictionaries passed\n");
+
+	return 0;
+}
+
+
+
 #endif /* #ifdef CW_DICTIONARY_UNIT_TESTS */
@@ -32,6 +32,7 @@ typedef struct cw_dictionary_s cw_dictionary_t;
 extern bool cw_dictionaries_read(const char *file);
 extern void cw_dictionaries_unload(void);
 extern bool cw_dictionaries_write(const char *file);
+extern bool cw_dictionaries_write_compiled(const char *file);
 
 extern const cw_dictionary_t *cw_dictionaries_iterate(const cw_dictionary_t *dict);
 
@@ -40,6 +41,19 @@ extern int         cw_dictionary_get_group_size(const cw_dictionary_t *dict);
 extern const char *cw_dictionary_get_random_word(const cw_dictionary_t *dict);
 
 
+/* Trie of words of dictionaries, for correction of received words. */
+typedef struct cw_dictionary_trie_s cw_dictionary_trie_t;
+
+/* Costs of edits of Morse code, see cw_dictionary_trie_correct(). */
+enum { CW_DICTIONARY_TRIE_COST_MARK = 2 };
+enum { CW_DICTIONARY_TRIE_COST_GAP = 1 };
+
+extern cw_dictionary_trie_t *cw_dictionary_trie_new(const cw_dictionary_t *dict);
+extern void        cw_dictionary_trie_delete(cw_dictionary_trie_t **trie);
+extern int         cw_dictionary_trie_get_words_count(const cw_dictionary_trie_t *trie);
+extern const char *cw_dictionary_trie_correct(const cw_dictionary_trie_t *trie, const char *representations, int max_cost, int *cost);
+
+
 
 /* Everything below is deprecated. */
 typedef struct cw_dictionary_s dictionary;
@@ -21,8 +21,12 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <dirent.h>
+#endif
 
 
 
@@ -35,6 +39,11 @@
 
 static void resource_meas_do_measurement(resource_meas * meas);
 static void * resouce_meas_thread(void * arg);
+#if defined(__linux__)
+static void resource_meas_gen_threads(resource_meas * meas, long long * cpu_time, long * voluntary, long * involuntary);
+static bool resource_meas_read_thread(pid_t tid, resource_meas_thread * thread);
+static long resource_meas_current_rss_kb(void);
+#endif
 
 
 
@@ -42,7 +51,12 @@ void * resouce_meas_thread(void * arg)
 {
 	resource_meas * meas = (resource_meas *) arg;
 	while (1) {
+		/* Reading /proc files involves cancellation points, and
+		   cancelling the thread in the middle of it would leak
+		   file descriptors. */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 		resource_meas_do_measurement(meas);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 		usleep(1000 * meas->meas_interval_msecs);
 	}
 
@@ -57,6 +71,9 @@ void resource_meas_start(resource_meas * meas, int meas_interval_msecs)
 	memset(meas, 0, sizeof (*meas));
 	meas->meas_interval_msecs = meas_interval_msecs;
 
+	getrusage(RUSAGE_SELF, &meas->rusage_start);
+	gettimeofday(&meas->timestamp_start, NULL);
+
 	pthread_mutex_init(&meas->mutex, NULL);
 	pthread_attr_init(&meas->thread_attr);
 	pthread_create(&meas->thread_id, &meas->thread_attr, resouce_meas_thread, meas);
@@ -67,12 +84,10 @@ void resource_meas_start(resource_meas * meas, int meas_interval_msecs)
 
 void resource_meas_stop(resource_meas * meas)
 {
-	pthread_mutex_lock(&meas->mutex);
-
 	pthread_cancel(meas->thread_id);
+	pthread_join(meas->thread_id, NULL);
 	pthread_attr_destroy(&meas->thread_attr);
 
-	pthread_mutex_unlock(&meas->mutex);
 	pthread_mutex_destroy(&meas->mutex);
 }
 
@@ -101,6 +116,18 @@ int resource_meas_get_maximal_cpu_usage(resource_meas * meas)
 
 
 
+void resource_meas_get_report(resource_meas * meas, resource_meas_report_t * report)
+{
+	pthread_mutex_lock(&meas->mutex);
+	*report = meas->report;
+	report->current_cpu_usage = meas->current_cpu_usage;
+	report->maximal_cpu_usage = meas->maximal_cpu_usage;
+	pthread_mutex_unlock(&meas->mutex);
+}
+
+
+
+
 void resource_meas_do_measurement(resource_meas * meas)
 {
 	getrusage(RUSAGE_SELF, &meas->rusage_curr);
@@ -117,9 +144,23 @@ void resource_meas_do_measurement(resource_meas * meas)
 	meas->resource_usage = meas->summary_cpu_usage.tv_sec * 1000000 + meas->summary_cpu_usage.tv_usec;
 	meas->meas_duration = meas->timestamp_diff.tv_sec * 1000000 + meas->timestamp_diff.tv_usec;
 
+	const bool is_first = 0 == meas->timestamp_prev.tv_sec && 0 == meas->timestamp_prev.tv_usec;
 	meas->rusage_prev = meas->rusage_curr;
 	meas->timestamp_prev = meas->timestamp_curr;
 
+	/* Generator threads: usage in period since previous measurement. */
+	long long gen_cpu_time = 0;
+	long gen_voluntary = 0;
+	long gen_involuntary = 0;
+	long rss_kb = 0;
+#if defined(__linux__)
+	resource_meas_gen_threads(meas, &gen_cpu_time, &gen_voluntary, &gen_involuntary);
+	rss_kb = resource_meas_current_rss_kb();
+#endif
+
+	struct timeval since_start;
+	timersub(&meas->timestamp_curr, &meas->timestamp_start, &since_start);
+
 	pthread_mutex_lock(&meas->mutex);
 	{
 		meas->current_cpu_usage = meas->resource_usage * 100.0 / (meas->meas_duration * 1.0);
@@ -135,6 +176,36 @@ void resource_meas_do_measurement(resource_meas * meas)
 		if (meas->current_cpu_usage > LIBCW_TEST_MEAS_CPU_OK_THRESHOLD_PERCENT) {
 			fprintf(stderr, "[EE] High current CPU usage: "CWTEST_CPU_FMT"\n", meas->current_cpu_usage);
 		}
+
+		resource_meas_report_t * report = &meas->report;
+		report->meas_duration_msecs = since_start.tv_sec * 1000 + since_start.tv_usec / 1000;
+
+		report->n_gen_threads = meas->n_gen_threads_seen;
+		report->gen_voluntary_ctx_switches += gen_voluntary;
+		report->gen_involuntary_ctx_switches += gen_involuntary;
+		if (!is_first && meas->meas_duration > 0) {
+			/* First measurement has no previous one. */
+			report->current_gen_cpu_usage = (int) (gen_cpu_time * 100 / meas->meas_duration);
+			report->current_gen_wakeups_per_sec = (int) (gen_voluntary * 1000000LL / meas->meas_duration);
+			if (report->current_gen_cpu_usage > report->maximal_gen_cpu_usage) {
+				report->maximal_gen_cpu_usage = report->current_gen_cpu_usage;
+			}
+			if (report->current_gen_wakeups_per_sec > report->maximal_gen_wakeups_per_sec) {
+				report->maximal_gen_wakeups_per_sec = report->current_gen_wakeups_per_sec;
+			}
+		}
+		if (report->meas_duration_msecs > 0) {
+			report->average_gen_wakeups_per_sec = (int) (report->gen_voluntary_ctx_switches * 1000 / report->meas_duration_msecs);
+		}
+
+		report->current_rss_kb = rss_kb;
+		if (rss_kb > report->maximal_rss_kb) {
+			report->maximal_rss_kb = rss_kb;
+		}
+		report->peak_rss_kb = meas->rusage_curr.ru_maxrss; /* [kB] on Linux. */
+
+		report->voluntary_ctx_switches = meas->rusage_curr.ru_nvcsw - meas->rusage_start.ru_nvcsw;
+		report->involuntary_ctx_switches = meas->rusage_curr.ru_nivcsw - meas->rusage_start.ru_nivcsw;
 	}
 	pthread_mutex_unlock(&meas->mutex);
 
@@ -151,6 +222,168 @@ void resource_meas_do_measurement(resource_meas * meas)
 
 
 
+#if defined(__linux__)
+
+
+
+
+/**
+   @brief Measure generator threads existing at the moment
+
+   Generator threads are found by their names. Usage of resources by
+   the threads since previous measurement is returned through
+   arguments. A thread that started after previous measurement
+   contributes all of its usage.
+
+   Usage of a thread that ended between two measurements is lost since
+   previous measurement.
+*/
+static void resource_meas_gen_threads(resource_meas * meas, long long * cpu_time, long * voluntary, long * involuntary)
+{
+	DIR * dir = opendir("/proc/self/task");
+	if (NULL == dir) {
+		return;
+	}
+
+	resource_meas_thread threads[RESOURCE_MEAS_THREADS_MAX];
+	int n_threads = 0;
+
+	struct dirent * entry = NULL;
+	while (NULL != (entry = readdir(dir)) && n_threads < RESOURCE_MEAS_THREADS_MAX) {
+		const pid_t tid = (pid_t) atoi(entry->d_name);
+		if (tid <= 0) {
+			continue; /* "." and "..". */
+		}
+
+		resource_meas_thread thread = { 0 };
+		if (!resource_meas_read_thread(tid, &thread)) {
+			continue; /* Not a generator thread, or the thread has just ended. */
+		}
+
+		resource_meas_thread prev = { 0 };
+		bool is_new = true;
+		for (int i = 0; i < meas->n_gen_threads_curr; i++) {
+			if (meas->gen_threads[i].tid == tid) {
+				prev = meas->gen_threads[i];
+				is_new = false;
+				break;
+			}
+		}
+		if (is_new) {
+			meas->n_gen_threads_seen++;
+		}
+
+		*cpu_time += thread.cpu_time - prev.cpu_time;
+		*voluntary += thread.voluntary_ctx_switches - prev.voluntary_ctx_switches;
+		*involuntary += thread.involuntary_ctx_switches - prev.involuntary_ctx_switches;
+
+		threads[n_threads++] = thread;
+	}
+	closedir(dir);
+
+	memcpy(meas->gen_threads, threads, sizeof (threads[0]) * (size_t) n_threads);
+	meas->n_gen_threads_curr = n_threads;
+}
+
+
+
+
+/**
+   @brief Read usage of resources by thread @p tid if it is a generator thread
+
+   @return true if @p tid is a generator thread and its data has been read
+   @return false otherwise
+*/
+static bool resource_meas_read_thread(pid_t tid, resource_meas_thread * thread)
+{
+	char path[64];
+	char line[128];
+
+	snprintf(path, sizeof (path), "/proc/self/task/%d/comm", (int) tid);
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		return false;
+	}
+	const bool is_gen = NULL != fgets(line, sizeof (line), file) && 0 == strncmp(line, "deq ", strlen("deq "));
+	fclose(file);
+	if (!is_gen) {
+		return false;
+	}
+
+	thread->tid = tid;
+
+	/* First field of schedstat: time spent on CPU [ns]. Fall back
+	   to utime + stime [clock ticks] of stat. */
+	snprintf(path, sizeof (path), "/proc/self/task/%d/schedstat", (int) tid);
+	file = fopen(path, "r");
+	unsigned long long on_cpu = 0;
+	if (NULL != file && 1 == fscanf(file, "%llu", &on_cpu)) {
+		thread->cpu_time = (long long) (on_cpu / 1000);
+	} else {
+		snprintf(path, sizeof (path), "/proc/self/task/%d/stat", (int) tid);
+		FILE * stat_file = fopen(path, "r");
+		char buffer[512] = { 0 };
+		if (NULL != stat_file && NULL != fgets(buffer, sizeof (buffer), stat_file)) {
+			/* utime and stime are fields 14 and 15; name of
+			   thread (field 2) may contain spaces. */
+			const char * fields = strrchr(buffer, ')');
+			unsigned long utime = 0;
+			unsigned long stime = 0;
+			if (fields && 2 == sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime)) {
+				thread->cpu_time = (long long) (utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+			}
+		}
+		if (NULL != stat_file) {
+			fclose(stat_file);
+		}
+	}
+	if (NULL != file) {
+		fclose(file);
+	}
+
+	snprintf(path, sizeof (path), "/proc/self/task/%d/status", (int) tid);
+	file = fopen(path, "r");
+	if (NULL != file) {
+		while (NULL != fgets(line, sizeof (line), file)) {
+			sscanf(line, "voluntary_ctxt_switches: %ld", &thread->voluntary_ctx_switches);
+			sscanf(line, "nonvoluntary_ctxt_switches: %ld", &thread->involuntary_ctx_switches);
+		}
+		fclose(file);
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Get current resident set size of the process
+
+   @return RSS [kB], or zero on errors
+*/
+static long resource_meas_current_rss_kb(void)
+{
+	FILE * file = fopen("/proc/self/statm", "r");
+	if (NULL == file) {
+		return 0;
+	}
+	long size = 0;
+	long resident = 0;
+	const int n = fscanf(file, "%ld %ld", &size, &resident);
+	fclose(file);
+
+	return 2 == n ? resident * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
+
+
+
+
 void cwtest_param_ranger_init(cwtest_param_ranger_t * ranger, int min, int max, int step, int initial_value)
 {
 	ranger->range_min = min;
@@ -23,6 +23,53 @@
 
 
 
+/* Capacity of table of generator threads tracked by resource meas. */
+#define RESOURCE_MEAS_THREADS_MAX 16
+
+
+
+
+/* Usage of resources by one generator thread, as of last measurement. */
+typedef struct {
+	pid_t tid;
+	long long cpu_time;    /* [us] */
+	long voluntary_ctx_switches;
+	long involuntary_ctx_switches;
+} resource_meas_thread;
+
+
+
+
+/* Summary of measurements, see resource_meas_get_report(). */
+typedef struct {
+	int current_cpu_usage;          /* [%] Whole process. */
+	int maximal_cpu_usage;          /* [%] Whole process. */
+
+	int n_gen_threads;              /* Generator threads seen during measurement. */
+	int current_gen_cpu_usage;      /* [%] All generator threads together. */
+	int maximal_gen_cpu_usage;      /* [%] All generator threads together. */
+
+	long current_rss_kb;
+	long maximal_rss_kb;            /* Highest RSS seen during measurement. */
+	long peak_rss_kb;               /* Highest RSS of process since it has been started. */
+
+	long voluntary_ctx_switches;    /* Whole process, since start of measurement. */
+	long involuntary_ctx_switches;  /* Whole process, since start of measurement. */
+	long gen_voluntary_ctx_switches;
+	long gen_involuntary_ctx_switches;
+
+	/* Generator threads going to sleep and waking up (voluntary
+	   context switches) per second. */
+	int current_gen_wakeups_per_sec;
+	int maximal_gen_wakeups_per_sec;
+	int average_gen_wakeups_per_sec;
+
+	long meas_duration_msecs;       /* Time since start of measurement. */
+} resource_meas_report_t;
+
+
+
+
 typedef struct {
 
 	/* At what intervals the measurement should be taken. */
@@ -51,6 +98,16 @@ typedef struct {
 	int current_cpu_usage; /* Last calculated value of CPU usage. */
 	int maximal_cpu_usage; /* Maximum detected during measurements run. */
 
+	/* Generator threads are recognized by their names ("deq
+	   <label>", see cw_gen_dequeue_and_generate_internal()), and
+	   measured through their TIDs in /proc. Linux only. */
+	resource_meas_thread gen_threads[RESOURCE_MEAS_THREADS_MAX];
+	int n_gen_threads_curr;
+	int n_gen_threads_seen;
+	struct rusage rusage_start;
+	struct timeval timestamp_start;
+	resource_meas_report_t report;
+
 } resource_meas;
 
 
@@ -95,6 +152,18 @@ int resource_meas_get_maximal_cpu_usage(resource_meas * meas);
 
 
 
+/**
+   @brief Get all results of measurements
+
+   Besides CPU usage of whole process the report contains CPU usage,
+   context switches and wakeups of generator threads, and RSS of the
+   process. Values that can't be measured on given platform are zero.
+*/
+void resource_meas_get_report(resource_meas * meas, resource_meas_report_t * report);
+
+
+
+
 /**
    Direction in which values returned by calls to _get_next() will go:
    will they increase, will they decrease or will they stay on
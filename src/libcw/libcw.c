@@ -29,6 +29,7 @@
 #include <string.h>
 
 #include "libcw.h"
+#include "libcw_context.h"
 #include "libcw_debug.h"
 #include "libcw_gen.h"
 #include "libcw_key.h"
@@ -38,88 +39,6 @@
 
 
 
-/* Main container for data related to generating audible Morse code.
-   This is a global variable in legacy library. New library code
-   (with API declared in libcw2.h) will not use global generator
-   variable. */
-cw_gen_t *cw_generator = NULL;
-
-
-
-
-
-/* From libcw_debug.c. */
-extern cw_debug_t cw_debug_object;
-extern cw_debug_t cw_debug_object_ev;
-extern cw_debug_t cw_debug_object_dev;
-
-
-
-
-
-static cw_rec_t cw_receiver = {
-
-	.state = RS_IDLE,
-
-
-	.speed                      = CW_SPEED_INITIAL,
-	.tolerance                  = CW_TOLERANCE_INITIAL,
-	.gap                        = CW_GAP_INITIAL,
-	.is_adaptive_receive_mode   = CW_REC_ADAPTIVE_MODE_INITIAL,
-	.noise_spike_threshold      = CW_REC_NOISE_THRESHOLD_INITIAL,
-
-
-	/* TODO: this variable is not set in
-	   cw_rec_reset_parameters_internal(). Why is it
-	   separated from the four main variables? Is it because it is
-	   a derivative of speed? But speed is a derivative of this
-	   variable in adaptive speed mode. */
-	.adaptive_speed_threshold = CW_REC_SPEED_THRESHOLD_INITIAL,
-
-	.parameters_in_sync = false,
-
-	.label = "global rec", /* Single global receiver available in libcw library, used by legacy API. */
-};
-
-
-
-
-
-CW_STATIC_FUNC volatile cw_key_t cw_key = {
-	.gen = NULL,
-
-
-	.rec = &cw_receiver,
-
-
-	.sk = {
-		.key_value = CW_KEY_STATE_OPEN
-	},
-
-
-	.ik = {
-		.graph_state = KS_IDLE,
-		.key_value = CW_KEY_VALUE_OPEN,
-
-		.dot_paddle_value = CW_KEY_VALUE_OPEN,
-		.dash_paddle_value = CW_KEY_VALUE_OPEN,
-
-		.dot_latch = false,
-		.dash_latch = false,
-
-		.curtis_mode_b = false,
-		.curtis_b_latch = false,
-
-		.lock = false,
-	},
-
-	.label = "global key", /* Single global key available in libcw library, used by legacy API. */
-};
-
-
-
-
-
 /* ******************************************************************** */
 /*                              Generator                               */
 /* ******************************************************************** */
@@ -151,11 +70,7 @@ CW_STATIC_FUNC volatile cw_key_t cw_key = {
 */
 int cw_generator_new(int audio_system, const char *device)
 {
-	cw_gen_config_t gen_conf = { .sound_system = audio_system };
-	if (NULL != device) {
-		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", device);
-	}
-	return cw_generator_new_internal(&gen_conf);
+	return cw_context_generator_new(&cw_default_context, audio_system, device);
 }
 
 
@@ -179,20 +94,7 @@ int cw_generator_new(int audio_system, const char *device)
 */
 int cw_generator_new_internal(const cw_gen_config_t * gen_conf)
 {
-	cw_generator = cw_gen_new(gen_conf);
-	if (NULL == cw_generator) {
-		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
-			      "libcw: can't create generator");
-		return CW_FAILURE;
-	} else {
-		cw_gen_set_label(cw_generator, "global gen"); /* Single global generator available in libcw library, used by legacy API. */
-
-		/* For some (all?) applications a key needs to have
-		   some generator associated with it. */
-		cw_key_register_generator(&cw_key, cw_generator);
-
-		return CW_SUCCESS;
-	}
+	return cw_context_generator_new_internal(&cw_default_context, gen_conf);
 }
 
 
@@ -208,8 +110,7 @@ int cw_generator_new_internal(const cw_gen_config_t * gen_conf)
 */
 void cw_generator_delete(void)
 {
-	cw_gen_delete(&cw_generator);
-
+	cw_context_generator_delete(&cw_default_context);
 	return;
 }
 
@@ -230,7 +131,7 @@ void cw_generator_delete(void)
 */
 int cw_generator_start(void)
 {
-	return cw_gen_start(cw_generator);
+	return cw_context_generator_start(&cw_default_context);
 }
 
 
@@ -250,8 +151,7 @@ int cw_generator_start(void)
 */
 void cw_generator_stop(void)
 {
-	cw_gen_stop(cw_generator);
-
+	cw_context_generator_stop(&cw_default_context);
 	return;
 }
 
@@ -264,9 +164,7 @@ void cw_generator_stop(void)
 */
 void cw_generator_delete_internal(void)
 {
-	if (cw_generator) {
-		cw_gen_delete(&cw_generator);
-	}
+	cw_context_generator_delete_internal(&cw_default_context);
 
 	return;
 }
@@ -294,8 +192,7 @@ void cw_generator_delete_internal(void)
 */
 int cw_set_send_speed(int new_value)
 {
-	int rv = cw_gen_set_speed(cw_generator, new_value);
-	return rv;
+	return cw_context_set_send_speed(&cw_default_context, new_value);
 }
 
 
@@ -321,8 +218,7 @@ int cw_set_send_speed(int new_value)
 */
 int cw_set_frequency(int new_value)
 {
-	int rv = cw_gen_set_frequency(cw_generator, new_value);
-	return rv;
+	return cw_context_set_frequency(&cw_default_context, new_value);
 }
 
 
@@ -351,8 +247,7 @@ int cw_set_frequency(int new_value)
 */
 int cw_set_volume(int new_value)
 {
-	int rv = cw_gen_set_volume(cw_generator, new_value);
-	return rv;
+	return cw_context_set_volume(&cw_default_context, new_value);
 }
 
 
@@ -376,15 +271,7 @@ int cw_set_volume(int new_value)
 */
 int cw_set_gap(int new_value)
 {
-	int rv = cw_gen_set_gap(cw_generator, new_value);
-	if (rv != CW_FAILURE) {
-		/* Ideally generator and receiver should have their
-		   own, separate cw_set_gap() functions. Unfortunately
-		   this is not the case so gap should be set
-		   here for receiver as well. */
-		rv = cw_rec_set_gap(&cw_receiver, new_value);
-	}
-	return rv;
+	return cw_context_set_gap(&cw_default_context, new_value);
 }
 
 
@@ -405,8 +292,7 @@ int cw_set_gap(int new_value)
 */
 int cw_set_weighting(int new_value)
 {
-	int rv = cw_gen_set_weighting(cw_generator, new_value);
-	return rv;
+	return cw_context_set_weighting(&cw_default_context, new_value);
 }
 
 
@@ -420,7 +306,7 @@ int cw_set_weighting(int new_value)
 */
 int cw_get_send_speed(void)
 {
-	return cw_gen_get_speed(cw_generator);
+	return cw_context_get_send_speed(&cw_default_context);
 }
 
 
@@ -437,7 +323,7 @@ int cw_get_send_speed(void)
 */
 int cw_get_frequency(void)
 {
-	return cw_gen_get_frequency(cw_generator);
+	return cw_context_get_frequency(&cw_default_context);
 }
 
 
@@ -454,7 +340,7 @@ int cw_get_frequency(void)
 */
 int cw_get_volume(void)
 {
-	return cw_gen_get_volume(cw_generator);
+	return cw_context_get_volume(&cw_default_context);
 }
 
 
@@ -468,7 +354,7 @@ int cw_get_volume(void)
 */
 int cw_get_gap(void)
 {
-	return cw_gen_get_gap(cw_generator);
+	return cw_context_get_gap(&cw_default_context);
 }
 
 
@@ -482,7 +368,7 @@ int cw_get_gap(void)
 */
 int cw_get_weighting(void)
 {
-	return cw_gen_get_weighting(cw_generator);
+	return cw_context_get_weighting(&cw_default_context);
 }
 
 
@@ -511,12 +397,7 @@ void cw_get_send_parameters(int *dot_usecs, int *dash_usecs,
 			    int *end_of_character_usecs, int *end_of_word_usecs,
 			    int *additional_usecs, int *adjustment_usecs)
 {
-	cw_gen_get_timing_parameters_internal(cw_generator,
-					      dot_usecs, dash_usecs,
-					      end_of_element_usecs,
-					      end_of_character_usecs, end_of_word_usecs,
-					      additional_usecs, adjustment_usecs);
-
+	cw_context_get_send_parameters(&cw_default_context, dot_usecs, dash_usecs, end_of_element_usecs, end_of_character_usecs, end_of_word_usecs, additional_usecs, adjustment_usecs);
 	return;
 }
 
@@ -536,8 +417,7 @@ void cw_get_send_parameters(int *dot_usecs, int *dash_usecs,
 */
 int cw_send_dot(void)
 {
-	const bool is_first_mark = false; /* cw_send_dot() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
-	return cw_gen_enqueue_mark_internal(cw_generator, CW_DOT_REPRESENTATION, is_first_mark);
+	return cw_context_send_dot(&cw_default_context);
 }
 
 
@@ -556,8 +436,7 @@ int cw_send_dot(void)
 */
 int cw_send_dash(void)
 {
-	const bool is_first_mark = false; /* cw_send_dash() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
-	return cw_gen_enqueue_mark_internal(cw_generator, CW_DASH_REPRESENTATION, is_first_mark);
+	return cw_context_send_dash(&cw_default_context);
 }
 
 
@@ -574,7 +453,7 @@ int cw_send_dash(void)
 */
 int cw_send_character_space(void)
 {
-	return cw_gen_enqueue_2u_ics_internal(cw_generator);
+	return cw_context_send_character_space(&cw_default_context);
 }
 
 
@@ -592,7 +471,7 @@ int cw_send_character_space(void)
 */
 int cw_send_word_space(void)
 {
-	return cw_gen_enqueue_iws_internal(cw_generator);
+	return cw_context_send_word_space(&cw_default_context);
 }
 
 
@@ -620,7 +499,7 @@ int cw_send_word_space(void)
 */
 int cw_send_representation(const char *representation)
 {
-	return cw_gen_enqueue_representation(cw_generator, representation);
+	return cw_context_send_representation(&cw_default_context, representation);
 }
 
 
@@ -643,7 +522,7 @@ int cw_send_representation(const char *representation)
 */
 int cw_send_representation_partial(const char *representation)
 {
-	return cw_gen_enqueue_representation_no_ics(cw_generator, representation);
+	return cw_context_send_representation_partial(&cw_default_context, representation);
 }
 
 
@@ -677,7 +556,7 @@ int cw_send_representation_partial(const char *representation)
 */
 int cw_send_character(char c)
 {
-	return cw_gen_enqueue_character(cw_generator, c);
+	return cw_context_send_character(&cw_default_context, c);
 }
 
 
@@ -711,7 +590,7 @@ int cw_send_character(char c)
 */
 int cw_send_character_partial(char c)
 {
-	return cw_gen_enqueue_character_no_ics(cw_generator, c);
+	return cw_context_send_character_partial(&cw_default_context, c);
 }
 
 
@@ -747,7 +626,7 @@ int cw_send_character_partial(char c)
 */
 int cw_send_string(const char *string)
 {
-	return cw_gen_enqueue_string(cw_generator, string);
+	return cw_context_send_string(&cw_default_context, string);
 }
 
 
@@ -764,13 +643,7 @@ int cw_send_string(const char *string)
 */
 void cw_reset_send_receive_parameters(void)
 {
-	cw_gen_reset_parameters_internal(cw_generator);
-	cw_rec_reset_parameters_internal(&cw_receiver);
-
-	/* Reset requires resynchronization. */
-	cw_gen_sync_parameters_internal(cw_generator);
-	cw_rec_sync_parameters_internal(&cw_receiver);
-
+	cw_context_reset_send_receive_parameters(&cw_default_context);
 	return;
 }
 
@@ -787,7 +660,7 @@ void cw_reset_send_receive_parameters(void)
 */
 const char *cw_get_console_device(void)
 {
-	return cw_generator->picked_device_name;
+	return cw_context_get_console_device(&cw_default_context);
 }
 
 
@@ -803,7 +676,7 @@ const char *cw_get_console_device(void)
 */
 const char *cw_get_soundcard_device(void)
 {
-	return cw_generator->picked_device_name;
+	return cw_context_get_soundcard_device(&cw_default_context);
 }
 
 
@@ -820,7 +693,7 @@ const char *cw_get_soundcard_device(void)
 */
 const char *cw_generator_get_audio_system_label(void)
 {
-	return cw_get_audio_system_label(cw_generator->sound_system);
+	return cw_context_generator_get_audio_system_label(&cw_default_context);
 }
 
 
@@ -847,7 +720,7 @@ const char *cw_generator_get_audio_system_label(void)
 */
 int cw_generator_remove_last_character(void)
 {
-	return cw_gen_remove_last_character(cw_generator);
+	return cw_context_generator_remove_last_character(&cw_default_context);
 }
 
 
@@ -892,11 +765,31 @@ int cw_generator_remove_last_character(void)
 */
 int cw_register_tone_queue_low_callback(void (*callback_func)(void*), void *callback_arg, int level)
 {
-	if (level < 0) {
-		errno = EINVAL; /* cw_tq_register_low_level_callback_internal() won't recognize negative level. */
-		return CW_FAILURE;
-	}
-	return cw_tq_register_low_level_callback_internal(cw_generator->tq, callback_func, callback_arg, level);
+	return cw_context_register_tone_queue_low_callback(&cw_default_context, callback_func, callback_arg, level);
+}
+
+
+
+
+
+
+/**
+   \brief Get descriptor that becomes readable on events in tone queue
+
+   The descriptor (eventfd) is signalled when length of tone queue
+   falls to level set with cw_register_tone_queue_low_callback()
+   (\p callback_func may be NULL), and when the last tone from the
+   queue has been played. Read its 8-byte counter before checking the
+   queue. Don't close the descriptor.
+
+   errno is set to ENOSYS when the descriptors are not supported.
+
+   \return file descriptor on success
+   \return -1 on failure
+*/
+int cw_get_tone_queue_event_fd(void)
+{
+	return cw_context_get_tone_queue_event_fd(&cw_default_context);
 }
 
 
@@ -917,7 +810,7 @@ int cw_register_tone_queue_low_callback(void (*callback_func)(void*), void *call
 */
 bool cw_is_tone_busy(void)
 {
-	return cw_tq_is_nonempty_internal(cw_generator->tq);
+	return cw_context_is_tone_busy(&cw_default_context);
 }
 
 
@@ -932,7 +825,7 @@ bool cw_is_tone_busy(void)
 */
 int cw_wait_for_tone(void)
 {
-	return cw_tq_wait_for_end_of_current_tone_internal(cw_generator->tq);
+	return cw_context_wait_for_tone(&cw_default_context);
 }
 
 
@@ -952,7 +845,7 @@ int cw_wait_for_tone(void)
 */
 int cw_wait_for_tone_queue(void)
 {
-	return cw_tq_wait_for_level_internal(cw_generator->tq, 0);
+	return cw_context_wait_for_tone_queue(&cw_default_context);
 }
 
 
@@ -982,11 +875,81 @@ int cw_wait_for_tone_queue(void)
 */
 int cw_wait_for_tone_queue_critical(int level)
 {
-	if (level < 0) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
-	return cw_tq_wait_for_level_internal(cw_generator->tq, (size_t) level);
+	return cw_context_wait_for_tone_queue_critical(&cw_default_context, level);
+}
+
+
+
+
+
+/**
+   \brief Start waiting for the current tone to complete, without blocking
+
+   Non-blocking variant of cw_wait_for_tone(). The function returns
+   immediately. When the tone completes, \p callback_func (if not NULL)
+   is called with \p callback_arg, and descriptor returned through
+   \p fd (if \p fd is not NULL) becomes readable. The descriptor must
+   be closed by caller. See cw_gen_wait_for_queue_level_async() for
+   details.
+
+   \param callback_func - function to call on completion, may be NULL
+   \param callback_arg - argument of callback_func
+   \param fd - descriptor signalled on completion, may be NULL
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+int cw_wait_for_tone_async(void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_context_wait_for_tone_async(&cw_default_context, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Start waiting for the tone queue to drain, without blocking
+
+   Non-blocking variant of cw_wait_for_tone_queue(). See
+   cw_wait_for_tone_async() for description of completion.
+
+   \param callback_func - function to call on completion, may be NULL
+   \param callback_arg - argument of callback_func
+   \param fd - descriptor signalled on completion, may be NULL
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+int cw_wait_for_tone_queue_async(void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_context_wait_for_tone_queue_async(&cw_default_context, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Start waiting for the tone queue to drain to given level, without blocking
+
+   Non-blocking variant of cw_wait_for_tone_queue_critical(). See
+   cw_wait_for_tone_async() for description of completion.
+
+   If \p level is negative, function sets errno to EINVAL and returns
+   CW_FAILURE.
+
+   \param level - low level in queue, at which the wait completes
+   \param callback_func - function to call on completion, may be NULL
+   \param callback_arg - argument of callback_func
+   \param fd - descriptor signalled on completion, may be NULL
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+int cw_wait_for_tone_queue_critical_async(int level, void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_context_wait_for_tone_queue_critical_async(&cw_default_context, level, callback_func, callback_arg, fd);
 }
 
 
@@ -1001,7 +964,7 @@ int cw_wait_for_tone_queue_critical(int level)
 */
 bool cw_is_tone_queue_full(void)
 {
-	return cw_tq_is_full_internal(cw_generator->tq);
+	return cw_context_is_tone_queue_full(&cw_default_context);
 }
 
 
@@ -1013,7 +976,7 @@ bool cw_is_tone_queue_full(void)
 */
 int cw_get_tone_queue_capacity(void)
 {
-	return (int) cw_tq_capacity_internal(cw_generator->tq);
+	return cw_context_get_tone_queue_capacity(&cw_default_context);
 }
 
 
@@ -1025,7 +988,7 @@ int cw_get_tone_queue_capacity(void)
 */
 int cw_get_tone_queue_length(void)
 {
-	return (int) cw_tq_length_internal(cw_generator->tq);
+	return cw_context_get_tone_queue_length(&cw_default_context);
 }
 
 
@@ -1040,14 +1003,7 @@ int cw_get_tone_queue_length(void)
 */
 void cw_flush_tone_queue(void)
 {
-	/* This function locks and unlocks mutex. */
-	cw_tq_flush_internal(cw_generator->tq);
-
-	/* Force silence on the speaker anyway, and stop any background
-	   soundcard tone generation. */
-	cw_gen_silence_internal(cw_generator);
-	//cw_finalization_schedule_internal();
-
+	cw_context_flush_tone_queue(&cw_default_context);
 	return;
 }
 
@@ -1062,15 +1018,7 @@ void cw_flush_tone_queue(void)
 */
 void cw_reset_tone_queue(void)
 {
-	cw_tq_flush_internal(cw_generator->tq);
-
-	/* Silence sound and stop any background soundcard tone generation. */
-	cw_gen_silence_internal(cw_generator);
-	//cw_finalization_schedule_internal();
-
-	cw_debug_msg ((&cw_debug_object), CW_DEBUG_TONE_QUEUE, CW_DEBUG_INFO,
-		      "libcw: tone queue: reset");
-
+	cw_context_reset_tone_queue(&cw_default_context);
 	return;
 }
 
@@ -1096,21 +1044,7 @@ void cw_reset_tone_queue(void)
 */
 int cw_queue_tone(int usecs, int frequency)
 {
-	/* Check the arguments given for realistic values.  This test
-	   is left here for legacy reasons. Don't change it. */
-	if (usecs < 0
-	    || frequency < CW_FREQUENCY_MIN
-	    || frequency > CW_FREQUENCY_MAX) {
-
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
-
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, frequency, usecs, CW_SLOPE_MODE_STANDARD_SLOPES);
-	int rv = cw_tq_enqueue_internal(cw_generator->tq, &tone);
-
-	return rv;
+	return cw_context_queue_tone(&cw_default_context, usecs, frequency);
 }
 
 
@@ -1142,7 +1076,7 @@ int cw_queue_tone(int usecs, int frequency)
 */
 int cw_set_receive_speed(int new_value)
 {
-	return cw_rec_set_speed(&cw_receiver, new_value);
+	return cw_context_set_receive_speed(&cw_default_context, new_value);
 }
 
 
@@ -1156,7 +1090,7 @@ int cw_set_receive_speed(int new_value)
 */
 int cw_get_receive_speed(void)
 {
-	return (int) cw_rec_get_speed(&cw_receiver);
+	return cw_context_get_receive_speed(&cw_default_context);
 }
 
 
@@ -1177,7 +1111,7 @@ int cw_get_receive_speed(void)
 */
 int cw_set_tolerance(int new_value)
 {
-	return cw_rec_set_tolerance(&cw_receiver, new_value);
+	return cw_context_set_tolerance(&cw_default_context, new_value);
 }
 
 
@@ -1191,7 +1125,7 @@ int cw_set_tolerance(int new_value)
 */
 int cw_get_tolerance(void)
 {
-	return cw_rec_get_tolerance(&cw_receiver);
+	return cw_context_get_tolerance(&cw_default_context);
 }
 
 
@@ -1232,18 +1166,7 @@ void cw_get_receive_parameters(int *dot_usecs, int *dash_usecs,
 			       int *end_of_character_ideal_usecs,
 			       int *adaptive_threshold)
 {
-	cw_rec_get_parameters_internal(&cw_receiver,
-				       dot_usecs, dash_usecs,
-				       dot_min_usecs, dot_max_usecs,
-				       dash_min_usecs, dash_max_usecs,
-				       end_of_element_min_usecs,
-				       end_of_element_max_usecs,
-				       end_of_element_ideal_usecs,
-				       end_of_character_min_usecs,
-				       end_of_character_max_usecs,
-				       end_of_character_ideal_usecs,
-				       adaptive_threshold);
-
+	cw_context_get_receive_parameters(&cw_default_context, dot_usecs, dash_usecs, dot_min_usecs, dot_max_usecs, dash_min_usecs, dash_max_usecs, end_of_element_min_usecs, end_of_element_max_usecs, end_of_element_ideal_usecs, end_of_character_min_usecs, end_of_character_max_usecs, end_of_character_ideal_usecs, adaptive_threshold);
 	return;
 }
 
@@ -1272,7 +1195,7 @@ void cw_get_receive_parameters(int *dot_usecs, int *dash_usecs,
 */
 int cw_set_noise_spike_threshold(int new_value)
 {
-	return cw_rec_set_noise_spike_threshold(&cw_receiver, new_value);
+	return cw_context_set_noise_spike_threshold(&cw_default_context, new_value);
 }
 
 
@@ -1288,7 +1211,7 @@ int cw_set_noise_spike_threshold(int new_value)
 */
 int cw_get_noise_spike_threshold(void)
 {
-	return cw_rec_get_noise_spike_threshold(&cw_receiver);
+	return cw_context_get_noise_spike_threshold(&cw_default_context);
 }
 
 
@@ -1315,21 +1238,7 @@ int cw_get_noise_spike_threshold(void)
 void cw_get_receive_statistics(double *dot_sd, double *dash_sd,
 			       double *element_end_sd, double *character_end_sd)
 {
-	float dot_sd_f = 0.0F;
-	float dash_sd_f = 0.0F;
-	float element_end_sd_f = 0.0F;
-	float character_end_sd_f = 0.0F;
-
-	cw_rec_get_statistics_internal(&cw_receiver,
-				       &dot_sd_f,
-				       &dash_sd_f,
-				       &element_end_sd_f,
-				       &character_end_sd_f);
-
-	*dot_sd           = (double) dot_sd_f;
-	*dash_sd          = (double) dash_sd_f;
-	*element_end_sd   = (double) element_end_sd_f;
-	*character_end_sd = (double) character_end_sd_f;
+	cw_context_get_receive_statistics(&cw_default_context, dot_sd, dash_sd, element_end_sd, character_end_sd);
 	return;
 }
 
@@ -1345,8 +1254,7 @@ void cw_get_receive_statistics(double *dot_sd, double *dash_sd,
 */
 void cw_reset_receive_statistics(void)
 {
-	cw_rec_reset_statistics(&cw_receiver);
-
+	cw_context_reset_receive_statistics(&cw_default_context);
 	return;
 }
 
@@ -1369,7 +1277,7 @@ void cw_reset_receive_statistics(void)
 */
 void cw_enable_adaptive_receive(void)
 {
-	cw_rec_set_adaptive_mode_internal(&cw_receiver, true);
+	cw_context_enable_adaptive_receive(&cw_default_context);
 	return;
 }
 
@@ -1384,7 +1292,7 @@ void cw_enable_adaptive_receive(void)
 */
 void cw_disable_adaptive_receive(void)
 {
-	cw_rec_set_adaptive_mode_internal(&cw_receiver, false);
+	cw_context_disable_adaptive_receive(&cw_default_context);
 	return;
 }
 
@@ -1403,7 +1311,7 @@ void cw_disable_adaptive_receive(void)
 */
 bool cw_get_adaptive_receive_state(void)
 {
-	return cw_rec_get_adaptive_mode(&cw_receiver);
+	return cw_context_get_adaptive_receive_state(&cw_default_context);
 }
 
 
@@ -1432,7 +1340,7 @@ bool cw_get_adaptive_receive_state(void)
 */
 int cw_start_receive_tone(const struct timeval *timestamp)
 {
-	return cw_rec_mark_begin(&cw_receiver, timestamp);
+	return cw_context_start_receive_tone(&cw_default_context, timestamp);
 }
 
 
@@ -1466,7 +1374,7 @@ int cw_start_receive_tone(const struct timeval *timestamp)
 */
 int cw_end_receive_tone(const struct timeval *timestamp)
 {
-	return cw_rec_mark_end(&cw_receiver, timestamp);
+	return cw_context_end_receive_tone(&cw_default_context, timestamp);
 }
 
 
@@ -1504,7 +1412,7 @@ int cw_end_receive_tone(const struct timeval *timestamp)
 */
 int cw_receive_buffer_dot(const struct timeval *timestamp)
 {
-	return cw_rec_add_mark(&cw_receiver, timestamp, CW_DOT_REPRESENTATION);
+	return cw_context_receive_buffer_dot(&cw_default_context, timestamp);
 }
 
 
@@ -1523,7 +1431,7 @@ int cw_receive_buffer_dot(const struct timeval *timestamp)
 */
 int cw_receive_buffer_dash(const struct timeval *timestamp)
 {
-	return cw_rec_add_mark(&cw_receiver, timestamp, CW_DASH_REPRESENTATION);
+	return cw_context_receive_buffer_dash(&cw_default_context, timestamp);
 }
 
 
@@ -1577,12 +1485,7 @@ int cw_receive_representation(const struct timeval *timestamp,
 			      /* out */ bool *is_end_of_word,
 			      /* out */ bool *is_error)
 {
-	int rv = cw_rec_poll_representation(&cw_receiver,
-					  timestamp,
-					  representation,
-					  is_end_of_word,
-					  is_error);
-	return rv;
+	return cw_context_receive_representation(&cw_default_context, timestamp, representation, is_end_of_word, is_error);
 }
 
 
@@ -1631,8 +1534,7 @@ int cw_receive_character(const struct timeval *timestamp,
 			 /* out */ bool *is_end_of_word,
 			 /* out */ bool *is_error)
 {
-	int rv = cw_rec_poll_character(&cw_receiver, timestamp, c, is_end_of_word, is_error);
-	return rv;
+	return cw_context_receive_character(&cw_default_context, timestamp, c, is_end_of_word, is_error);
 }
 
 
@@ -1655,13 +1557,7 @@ int cw_receive_character(const struct timeval *timestamp,
 */
 void cw_clear_receive_buffer(void)
 {
-	/* In 3.5.1 this was implemented by cw_rec_clear_buffer_internal() like this: */
-
-	memset(cw_receiver.representation, 0, sizeof (cw_receiver.representation));
-	cw_receiver.representation_ind = 0;
-
-	cw_rec_set_state_internal(&cw_receiver, RS_IDLE);
-
+	cw_context_clear_receive_buffer(&cw_default_context);
 	return;
 }
 
@@ -1694,7 +1590,30 @@ int cw_get_receive_buffer_capacity(void)
 */
 int cw_get_receive_buffer_length(void)
 {
-	return cw_rec_get_buffer_length_internal(&cw_receiver);
+	return cw_context_get_receive_buffer_length(&cw_default_context);
+}
+
+
+
+
+
+
+/**
+   \brief Get descriptor that becomes readable when a character is received
+
+   The descriptor (eventfd) is signalled as soon as
+   cw_receive_character() can return a character, and again when it
+   can return end of word. Read its 8-byte counter before polling the
+   receiver. Don't close the descriptor.
+
+   errno is set to ENOSYS when the descriptors are not supported.
+
+   \return file descriptor on success
+   \return -1 on failure
+*/
+int cw_get_receive_event_fd(void)
+{
+	return cw_context_get_receive_event_fd(&cw_default_context);
 }
 
 
@@ -1713,14 +1632,7 @@ int cw_get_receive_buffer_length(void)
 */
 void cw_reset_receive(void)
 {
-	/* In 3.5.1 this was implemented by cw_rec_reset_internal() like this: */
-
-	memset(cw_receiver.representation, 0, sizeof (cw_receiver.representation));
-	cw_receiver.representation_ind = 0;
-	cw_rec_set_state_internal(&cw_receiver, RS_IDLE);
-
-	cw_rec_reset_statistics(&cw_receiver);
-
+	cw_context_reset_receive(&cw_default_context);
 	return;
 }
 
@@ -1757,7 +1669,7 @@ void cw_reset_receive(void)
 */
 void cw_register_keying_callback(void (*callback_func)(void*, int), void *callback_arg)
 {
-	cw_gen_register_value_tracking_callback_internal(cw_generator, callback_func, callback_arg);
+	cw_context_register_keying_callback(&cw_default_context, callback_func, callback_arg);
 	return;
 }
 
@@ -1780,7 +1692,7 @@ void cw_register_keying_callback(void (*callback_func)(void*, int), void *callba
 */
 void cw_iambic_keyer_register_timer(struct timeval *timer)
 {
-	cw_key_ik_register_timer_internal(&cw_key, timer);
+	cw_context_iambic_keyer_register_timer(&cw_default_context, timer);
 	return;
 }
 
@@ -1801,7 +1713,7 @@ void cw_iambic_keyer_register_timer(struct timeval *timer)
 */
 void cw_enable_iambic_curtis_mode_b(void)
 {
-	cw_key_ik_enable_curtis_mode_b(&cw_key);
+	cw_context_enable_iambic_curtis_mode_b(&cw_default_context);
 	return;
 }
 
@@ -1814,7 +1726,7 @@ void cw_enable_iambic_curtis_mode_b(void)
 */
 void cw_disable_iambic_curtis_mode_b(void)
 {
-	cw_key_ik_disable_curtis_mode_b(&cw_key);
+	cw_context_disable_iambic_curtis_mode_b(&cw_default_context);
 	return;
 }
 
@@ -1827,7 +1739,7 @@ void cw_disable_iambic_curtis_mode_b(void)
 */
 int cw_get_iambic_curtis_mode_b_state(void)
 {
-	return (int) cw_key_ik_get_curtis_mode_b(&cw_key);
+	return cw_context_get_iambic_curtis_mode_b_state(&cw_default_context);
 }
 
 
@@ -1859,7 +1771,7 @@ int cw_get_iambic_curtis_mode_b_state(void)
 */
 int cw_notify_keyer_paddle_event(int dot_paddle_state, int dash_paddle_state)
 {
-	return cw_key_ik_notify_paddle_event(&cw_key, dot_paddle_state, dash_paddle_state);
+	return cw_context_notify_keyer_paddle_event(&cw_default_context, dot_paddle_state, dash_paddle_state);
 }
 
 
@@ -1879,7 +1791,7 @@ int cw_notify_keyer_paddle_event(int dot_paddle_state, int dash_paddle_state)
 */
 int cw_notify_keyer_dot_paddle_event(int dot_paddle_state)
 {
-	return cw_notify_keyer_paddle_event(dot_paddle_state, cw_key.ik.dash_paddle_value);
+	return cw_context_notify_keyer_dot_paddle_event(&cw_default_context, dot_paddle_state);
 }
 
 
@@ -1891,7 +1803,7 @@ int cw_notify_keyer_dot_paddle_event(int dot_paddle_state)
 */
 int cw_notify_keyer_dash_paddle_event(int dash_paddle_state)
 {
-	return cw_notify_keyer_paddle_event(cw_key.ik.dot_paddle_value, dash_paddle_state);
+	return cw_context_notify_keyer_dash_paddle_event(&cw_default_context, dash_paddle_state);
 }
 
 
@@ -1906,7 +1818,7 @@ int cw_notify_keyer_dash_paddle_event(int dash_paddle_state)
 */
 void cw_get_keyer_paddles(int *dot_paddle_state, int *dash_paddle_state)
 {
-	cw_key_ik_get_paddles(&cw_key, (cw_key_value_t *) dot_paddle_state, (cw_key_value_t *) dash_paddle_state);
+	cw_context_get_keyer_paddles(&cw_default_context, dot_paddle_state, dash_paddle_state);
 	return;
 }
 
@@ -1927,7 +1839,7 @@ void cw_get_keyer_paddles(int *dot_paddle_state, int *dash_paddle_state)
 */
 void cw_get_keyer_paddle_latches(int *dot_paddle_latch_state, int *dash_paddle_latch_state)
 {
-	cw_key_ik_get_paddle_latches_internal(&cw_key, dot_paddle_latch_state, dash_paddle_latch_state);
+	cw_context_get_keyer_paddle_latches(&cw_default_context, dot_paddle_latch_state, dash_paddle_latch_state);
 	return;
 }
 
@@ -1943,7 +1855,7 @@ void cw_get_keyer_paddle_latches(int *dot_paddle_latch_state, int *dash_paddle_l
 */
 bool cw_is_keyer_busy(void)
 {
-	return cw_key_ik_is_busy_internal(&cw_key);
+	return cw_context_is_keyer_busy(&cw_default_context);
 }
 
 
@@ -1960,8 +1872,7 @@ bool cw_is_keyer_busy(void)
 */
 int cw_wait_for_keyer_element(void)
 {
-	/* TODO: update function description: errno and return values. */
-	return cw_key_ik_wait_for_end_of_current_element(&cw_key);
+	return cw_context_wait_for_keyer_element(&cw_default_context);
 }
 
 
@@ -1976,7 +1887,29 @@ int cw_wait_for_keyer_element(void)
 */
 int cw_wait_for_keyer(void)
 {
-	return cw_key_ik_wait_for_keyer(&cw_key);
+	return cw_context_wait_for_keyer(&cw_default_context);
+}
+
+
+
+
+
+/**
+   \brief Start waiting for the current keyer cycle to complete, without blocking
+
+   Non-blocking variant of cw_wait_for_keyer(). See
+   cw_wait_for_tone_async() for description of completion.
+
+   \param callback_func - function to call on completion, may be NULL
+   \param callback_arg - argument of callback_func
+   \param fd - descriptor signalled on completion, may be NULL
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+int cw_wait_for_keyer_async(void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_context_wait_for_keyer_async(&cw_default_context, callback_func, callback_arg, fd);
 }
 
 
@@ -1992,7 +1925,7 @@ int cw_wait_for_keyer(void)
 */
 void cw_reset_keyer(void)
 {
-	cw_key_ik_reset_internal(&cw_key);
+	cw_context_reset_keyer(&cw_default_context);
 	return;
 }
 
@@ -2036,6 +1969,11 @@ void cw_straight_key_clock_internal(void)
 
 
 
+
+
+
+
+
 /**
    \brief Inform the library that the straight key has changed state
 
@@ -2050,7 +1988,7 @@ void cw_straight_key_clock_internal(void)
 */
 int cw_notify_straight_key_event(int key_state)
 {
-	return cw_key_sk_set_value(&cw_key, key_state);
+	return cw_context_notify_straight_key_event(&cw_default_context, key_state);
 }
 
 
@@ -2067,9 +2005,7 @@ int cw_notify_straight_key_event(int key_state)
 */
 int cw_get_straight_key_state(void)
 {
-	cw_key_value_t key_value = CW_KEY_VALUE_OPEN;
-	cw_key_sk_get_value(&cw_key, &key_value);
-	return (int) key_value;
+	return cw_context_get_straight_key_state(&cw_default_context);
 }
 
 
@@ -2087,7 +2023,7 @@ int cw_get_straight_key_state(void)
 */
 bool cw_is_straight_key_busy(void)
 {
-	return CW_KEY_STATE_CLOSED == cw_get_straight_key_state();
+	return cw_context_is_straight_key_busy(&cw_default_context);
 }
 
 
@@ -2101,6 +2037,6 @@ bool cw_is_straight_key_busy(void)
 */
 void cw_reset_straight_key(void)
 {
-	cw_key_sk_reset_internal(&cw_key);
+	cw_context_reset_straight_key(&cw_default_context);
 	return;
 }
@@ -48,7 +48,10 @@ enum cw_audio_systems {
 	CW_AUDIO_OSS,
 	CW_AUDIO_ALSA,
 	CW_AUDIO_PA,        /* PulseAudio */
-	CW_AUDIO_SOUNDCARD  /* OSS, ALSA or PulseAudio (PA) */
+	CW_AUDIO_SOUNDCARD, /* OSS, ALSA or PulseAudio (PA) */
+	CW_AUDIO_FILE,      /* WAV or raw PCM file (or file descriptor) */
+	CW_AUDIO_JACK,      /* JACK (or PipeWire through its JACK interface) */
+	CW_AUDIO_RTP        /* RTP stream sent over UDP */
 };
 
 enum {
@@ -68,6 +71,9 @@ typedef int16_t cw_sample_t;
 #define CW_DEFAULT_OSS_DEVICE       "/dev/audio"
 #define CW_DEFAULT_ALSA_DEVICE      "default"
 #define CW_DEFAULT_PA_DEVICE        "( default )"
+#define CW_DEFAULT_FILE_DEVICE      "cw_output.wav"
+#define CW_DEFAULT_JACK_DEVICE      "( default )"
+#define CW_DEFAULT_RTP_DEVICE       "127.0.0.1:5004"
 
 
 /* Limits on values of CW send and timing parameters */
@@ -296,6 +302,9 @@ extern bool cw_is_console_possible(const char *device_name);
 extern bool cw_is_oss_possible(const char *device_name);
 extern bool cw_is_alsa_possible(const char *device_name);
 extern bool cw_is_pa_possible(const char *device_name);
+extern bool cw_is_file_possible(const char *device_name);
+extern bool cw_is_jack_possible(const char *device_name);
+extern bool cw_is_rtp_possible(const char *device_name);
 
 
 
@@ -318,10 +327,14 @@ extern void cw_iambic_keyer_register_timer(struct timeval *timer);
 /* Tone queue */
 extern int cw_register_tone_queue_low_callback(void (*callback_func) (void*),
                                                 void *callback_arg, int level);
+extern int  cw_get_tone_queue_event_fd(void);
 extern bool cw_is_tone_busy(void);
 extern int  cw_wait_for_tone(void);
 extern int  cw_wait_for_tone_queue(void);
 extern int  cw_wait_for_tone_queue_critical(int level);
+extern int  cw_wait_for_tone_async(void (*callback_func)(void*), void *callback_arg, int *fd);
+extern int  cw_wait_for_tone_queue_async(void (*callback_func)(void*), void *callback_arg, int *fd);
+extern int  cw_wait_for_tone_queue_critical_async(int level, void (*callback_func)(void*), void *callback_arg, int *fd);
 extern bool cw_is_tone_queue_full(void);
 extern int  cw_get_tone_queue_capacity(void);
 extern int  cw_get_tone_queue_length(void);
@@ -390,6 +403,7 @@ extern void cw_clear_receive_buffer(void);
 
 extern int cw_get_receive_buffer_capacity(void);
 extern int cw_get_receive_buffer_length(void);
+extern int cw_get_receive_event_fd(void);
 extern void cw_reset_receive(void);
 
 
@@ -409,6 +423,7 @@ extern void cw_get_keyer_paddle_latches(int *dot_paddle_latch_state,
 extern bool cw_is_keyer_busy(void);
 extern int cw_wait_for_keyer_element(void);
 extern int cw_wait_for_keyer(void);
+extern int cw_wait_for_keyer_async(void (*callback_func)(void*), void *callback_arg, int *fd);
 extern void cw_reset_keyer(void);
 
 
@@ -421,6 +436,130 @@ extern void cw_reset_straight_key(void);
 
 
 
+/* Contexts
+
+   A context groups generator, receiver and key used by legacy
+   API. Functions declared above operate on default context (see
+   cw_context_get_default()). Each of them has a cw_context_*()
+   variant that operates on context given as first argument, so that
+   one process can run many independent sessions. */
+typedef struct cw_context_struct cw_context_t;
+
+extern cw_context_t * cw_context_new(void);
+extern void cw_context_delete(cw_context_t ** context);
+extern cw_context_t * cw_context_get_default(void);
+extern int cw_context_generator_new(cw_context_t * context, int audio_system, const char *device);
+extern void cw_context_generator_delete(cw_context_t * context);
+extern int cw_context_generator_start(cw_context_t * context);
+extern void cw_context_generator_stop(cw_context_t * context);
+extern int cw_context_set_send_speed(cw_context_t * context, int new_value);
+extern int cw_context_set_frequency(cw_context_t * context, int new_value);
+extern int cw_context_set_volume(cw_context_t * context, int new_value);
+extern int cw_context_set_gap(cw_context_t * context, int new_value);
+extern int cw_context_set_weighting(cw_context_t * context, int new_value);
+extern int cw_context_get_send_speed(cw_context_t * context);
+extern int cw_context_get_frequency(cw_context_t * context);
+extern int cw_context_get_volume(cw_context_t * context);
+extern int cw_context_get_gap(cw_context_t * context);
+extern int cw_context_get_weighting(cw_context_t * context);
+extern void cw_context_get_send_parameters(cw_context_t * context, int *dot_usecs, int *dash_usecs,
+                                           int *end_of_element_usecs, int *end_of_character_usecs,
+                                           int *end_of_word_usecs, int *additional_usecs,
+                                           int *adjustment_usecs);
+extern int cw_context_send_dot(cw_context_t * context);
+extern int cw_context_send_dash(cw_context_t * context);
+extern int cw_context_send_character_space(cw_context_t * context);
+extern int cw_context_send_word_space(cw_context_t * context);
+extern int cw_context_send_representation(cw_context_t * context, const char *representation);
+extern int cw_context_send_representation_partial(cw_context_t * context, const char *representation);
+extern int cw_context_send_character(cw_context_t * context, char c);
+extern int cw_context_send_character_partial(cw_context_t * context, char c);
+extern int cw_context_send_string(cw_context_t * context, const char *string);
+extern void cw_context_reset_send_receive_parameters(cw_context_t * context);
+extern const char * cw_context_get_console_device(cw_context_t * context);
+extern const char * cw_context_get_soundcard_device(cw_context_t * context);
+extern const char * cw_context_generator_get_audio_system_label(cw_context_t * context);
+extern int cw_context_generator_remove_last_character(cw_context_t * context);
+extern int cw_context_register_tone_queue_low_callback(cw_context_t * context,
+                                                       void (*callback_func)(void*),
+                                                       void *callback_arg, int level);
+extern int cw_context_get_tone_queue_event_fd(cw_context_t * context);
+extern bool cw_context_is_tone_busy(cw_context_t * context);
+extern int cw_context_wait_for_tone(cw_context_t * context);
+extern int cw_context_wait_for_tone_queue(cw_context_t * context);
+extern int cw_context_wait_for_tone_queue_critical(cw_context_t * context, int level);
+extern int cw_context_wait_for_tone_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd);
+extern int cw_context_wait_for_tone_queue_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd);
+extern int cw_context_wait_for_tone_queue_critical_async(cw_context_t * context, int level, void (*callback_func)(void*), void *callback_arg, int *fd);
+extern bool cw_context_is_tone_queue_full(cw_context_t * context);
+extern int cw_context_get_tone_queue_capacity(cw_context_t * context);
+extern int cw_context_get_tone_queue_length(cw_context_t * context);
+extern void cw_context_flush_tone_queue(cw_context_t * context);
+extern void cw_context_reset_tone_queue(cw_context_t * context);
+extern int cw_context_queue_tone(cw_context_t * context, int usecs, int frequency);
+extern int cw_context_set_receive_speed(cw_context_t * context, int new_value);
+extern int cw_context_get_receive_speed(cw_context_t * context);
+extern int cw_context_set_tolerance(cw_context_t * context, int new_value);
+extern int cw_context_get_tolerance(cw_context_t * context);
+extern void cw_context_get_receive_parameters(cw_context_t * context, int *dot_usecs,
+                                              int *dash_usecs, int *dot_min_usecs,
+                                              int *dot_max_usecs, int *dash_min_usecs,
+                                              int *dash_max_usecs, int *end_of_element_min_usecs,
+                                              int *end_of_element_max_usecs,
+                                              int *end_of_element_ideal_usecs,
+                                              int *end_of_character_min_usecs,
+                                              int *end_of_character_max_usecs,
+                                              int *end_of_character_ideal_usecs,
+                                              int *adaptive_threshold);
+extern int cw_context_set_noise_spike_threshold(cw_context_t * context, int new_value);
+extern int cw_context_get_noise_spike_threshold(cw_context_t * context);
+extern void cw_context_get_receive_statistics(cw_context_t * context, double *dot_sd,
+                                              double *dash_sd, double *element_end_sd,
+                                              double *character_end_sd);
+extern void cw_context_reset_receive_statistics(cw_context_t * context);
+extern void cw_context_enable_adaptive_receive(cw_context_t * context);
+extern void cw_context_disable_adaptive_receive(cw_context_t * context);
+extern bool cw_context_get_adaptive_receive_state(cw_context_t * context);
+extern int cw_context_start_receive_tone(cw_context_t * context, const struct timeval *timestamp);
+extern int cw_context_end_receive_tone(cw_context_t * context, const struct timeval *timestamp);
+extern int cw_context_receive_buffer_dot(cw_context_t * context, const struct timeval *timestamp);
+extern int cw_context_receive_buffer_dash(cw_context_t * context, const struct timeval *timestamp);
+extern int cw_context_receive_representation(cw_context_t * context,
+                                             const struct timeval *timestamp, char *representation,
+                                             bool *is_end_of_word, bool *is_error);
+extern int cw_context_receive_character(cw_context_t * context, const struct timeval *timestamp,
+                                        char *c, bool *is_end_of_word, bool *is_error);
+extern void cw_context_clear_receive_buffer(cw_context_t * context);
+extern int cw_context_get_receive_buffer_length(cw_context_t * context);
+extern int cw_context_get_receive_event_fd(cw_context_t * context);
+extern void cw_context_reset_receive(cw_context_t * context);
+extern void cw_context_register_keying_callback(cw_context_t * context, void (*callback_func)(void*,
+                                                int), void *callback_arg);
+extern void cw_context_iambic_keyer_register_timer(cw_context_t * context, struct timeval *timer);
+extern void cw_context_enable_iambic_curtis_mode_b(cw_context_t * context);
+extern void cw_context_disable_iambic_curtis_mode_b(cw_context_t * context);
+extern int cw_context_get_iambic_curtis_mode_b_state(cw_context_t * context);
+extern int cw_context_notify_keyer_paddle_event(cw_context_t * context, int dot_paddle_state,
+                                                int dash_paddle_state);
+extern int cw_context_notify_keyer_dot_paddle_event(cw_context_t * context, int dot_paddle_state);
+extern int cw_context_notify_keyer_dash_paddle_event(cw_context_t * context, int dash_paddle_state);
+extern void cw_context_get_keyer_paddles(cw_context_t * context, int *dot_paddle_state,
+                                         int *dash_paddle_state);
+extern void cw_context_get_keyer_paddle_latches(cw_context_t * context, int *dot_paddle_latch_state,
+                                                int *dash_paddle_latch_state);
+extern bool cw_context_is_keyer_busy(cw_context_t * context);
+extern int cw_context_wait_for_keyer_element(cw_context_t * context);
+extern int cw_context_wait_for_keyer(cw_context_t * context);
+extern int cw_context_wait_for_keyer_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd);
+extern void cw_context_reset_keyer(cw_context_t * context);
+extern int cw_context_notify_straight_key_event(cw_context_t * context, int key_state);
+extern int cw_context_get_straight_key_state(cw_context_t * context);
+extern bool cw_context_is_straight_key_busy(cw_context_t * context);
+extern void cw_context_reset_straight_key(cw_context_t * context);
+
+
+
+
 /* deprecated functions */
 extern int cw_check_representation(const char *representation)                   __attribute__ ((deprecated));   /* Use cw_representation_is_valid(). */
 extern int cw_lookup_representation(const char *representation, char *character) __attribute__ ((deprecated));   /* Use cw_representation_to_character(). */
@@ -51,6 +51,14 @@ extern "C"
 #define CW_SOUND_SYSTEM_FIRST CW_AUDIO_NULL
 #define CW_SOUND_SYSTEM_LAST  CW_AUDIO_PA
 
+/* Count of sound systems that can be probed with one call to
+   cw_probe_sound_systems(). */
+#define CW_PROBE_SOUND_SYSTEMS_MAX 8
+
+/* Time after which slow probe of sound system (e.g. of PulseAudio
+   server that doesn't respond) is treated as a failure [ms]. */
+#define CW_PROBE_SOUND_SYSTEMS_TIMEOUT 2000
+
 
 
 
@@ -62,12 +70,290 @@ typedef struct cw_key_struct cw_key_t;
 struct cw_rec_struct;
 typedef struct cw_rec_struct cw_rec_t;
 
+struct cw_detector_struct;
+typedef struct cw_detector_struct cw_detector_t;
+
+struct cw_skimmer_struct;
+typedef struct cw_skimmer_struct cw_skimmer_t;
+
+struct cw_iq_struct;
+typedef struct cw_iq_struct cw_iq_t;
+
+struct cw_capture_struct;
+typedef struct cw_capture_struct cw_capture_t;
+
+struct cw_input_struct;
+typedef struct cw_input_struct cw_input_t;
+
+struct cw_keying_struct;
+typedef struct cw_keying_struct cw_keying_t;
+
+struct cw_netkey_struct;
+typedef struct cw_netkey_struct cw_netkey_t;
+
+struct cw_keylog_struct;
+typedef struct cw_keylog_struct cw_keylog_t;
+
+struct cw_mixer_struct;
+typedef struct cw_mixer_struct cw_mixer_t;
+
+struct cw_tap_struct;
+typedef struct cw_tap_struct cw_tap_t;
+
+struct cw_sched_struct;
+typedef struct cw_sched_struct cw_sched_t;
+
+struct cw_viterbi_struct;
+typedef struct cw_viterbi_struct cw_viterbi_t;
+
+struct cw_ensemble_struct;
+typedef struct cw_ensemble_struct cw_ensemble_t;
+
+struct cw_pool_struct;
+typedef struct cw_pool_struct cw_pool_t;
+
+struct cw_shmq_struct;
+typedef struct cw_shmq_struct cw_shmq_t;
+
+struct cw_metrics_struct;
+typedef struct cw_metrics_struct cw_metrics_t;
+
 typedef enum cw_audio_systems cw_sound_system_t;
 
+/* Maximal count of channels of sound device, see
+   cw_gen_config_t::sound_channels. */
+enum { CW_SOUND_CHANNELS_MAX = 8 };
+
+/* Size of name of shared tone queue, see cw_gen_config_t::tq_shared_name. */
+enum { CW_SHMQ_NAME_SIZE = 64 };
+
+/* Format of samples written by generator to sound system, see
+   cw_gen_config_t::sample_format. */
+typedef enum cw_sample_format_t {
+	CW_SAMPLE_FORMAT_S16 = 0, /* Signed 16-bit integer. */
+	CW_SAMPLE_FORMAT_S32,     /* Signed 32-bit integer. */
+	CW_SAMPLE_FORMAT_FLOAT    /* 32-bit float, full scale is -1.0 to 1.0. */
+} cw_sample_format_t;
+
+/* Format of file written by CW_AUDIO_FILE sound system. In both cases
+   samples are little-endian, in format given by
+   cw_gen_config_t::sample_format. */
+typedef enum cw_file_format_t {
+	CW_FILE_FORMAT_WAV = 0, /* RIFF/WAVE header followed by PCM data. */
+	CW_FILE_FORMAT_RAW      /* PCM data only, no header. */
+} cw_file_format_t;
+
+/* Payload of packets sent by CW_AUDIO_RTP sound system. Both use
+   dynamic payload type 96. */
+typedef enum cw_rtp_payload_t {
+	CW_RTP_PAYLOAD_L16 = 0, /* Linear PCM, signed 16-bit, network byte order (RFC 3551). */
+	CW_RTP_PAYLOAD_OPUS     /* Opus (RFC 7587), at 48000 Hz. */
+} cw_rtp_payload_t;
+
+/* Alphabet of characters sent by generator and recognized by
+   receiver, in addition to ASCII characters of main table. See
+   cw_gen_set_alphabet() and cw_rec_set_alphabet(). */
+typedef enum cw_alphabet_t {
+	CW_ALPHABET_ITU = 0,        /* ASCII characters of main table only. */
+	CW_ALPHABET_CYRILLIC,       /* Russian letters. */
+	CW_ALPHABET_GREEK,          /* Greek letters. */
+	CW_ALPHABET_WABUN,          /* Japanese katakana. */
+	CW_ALPHABET_LATIN_EXTENDED, /* Latin letters with diacritics. */
+	CW_ALPHABET_COUNT
+} cw_alphabet_t;
+
 typedef struct cw_gen_config_t {
 	cw_sound_system_t sound_system;
 	char sound_device[LIBCW_SOUND_DEVICE_NAME_SIZE];
 	long unsigned int alsa_period_size; /* "long unsigned" follows type of snd_pcm_uframes_t. */
+	/* Used only by CW_AUDIO_ALSA sound system: calculate samples
+	   directly in mmapped ring buffer of sound card instead of copying
+	   them with snd_pcm_writei(). If device doesn't support mmap
+	   access, regular access is used. */
+	bool alsa_mmap;
+	/* Used only by CW_AUDIO_ALSA sound system, when 'alsa_period_size'
+	   is zero. If non-zero, this is a latency (duration of ring buffer
+	   of sound card, in microseconds) that the library should try to
+	   achieve, e.g. for sidetone of straight key. Smallest configuration
+	   not causing underruns is found when sound device is opened, and
+	   the latency is increased if underruns happen during playback. */
+	unsigned int alsa_target_latency;
+
+	/* Used only by CW_AUDIO_PA sound system: requested latency of
+	   PulseAudio stream, in microseconds. Zero means library's
+	   default (10 ms). */
+	unsigned int pa_target_latency;
+
+	/* Used only by CW_AUDIO_OSS sound system. If non-zero,
+	   fragments of sound device are configured so that duration of
+	   device's buffer is close to (not larger than) this latency, in
+	   microseconds, and generator writes one fragment at a time.
+	   With 'oss_nonblocking' set, the device is opened in
+	   non-blocking mode, and generator waits for free space in
+	   device's buffer with poll(), with a time-out, instead of
+	   blocking in write(). */
+	unsigned int oss_target_latency;
+	bool oss_nonblocking;
+
+	/* Used only by CW_AUDIO_FILE sound system. 'sound_device' is a path
+	   to output file ("-" means standard output). If 'file_fd' is zero
+	   or positive, samples are written to that already open file
+	   descriptor instead, and 'sound_device' is ignored. Set
+	   'file_fd' to -1 when it is not used: zero is a valid descriptor
+	   (e.g. of standard input redirected to a file). Samples are
+	   written as fast as generator can produce them, unless
+	   'file_realtime' is set, in which case writes are paced to follow
+	   wall clock, like a real sound device would do.
+	   'file_sample_rate' is sample rate of the file; zero means 48000
+	   Hz. Generator synthesizes samples directly at this rate, so
+	   samples are never resampled. Rates lower than 8000 Hz are
+	   rejected. */
+	int file_fd;
+	cw_file_format_t file_format;
+	bool file_realtime;
+	unsigned int file_sample_rate;
+
+	/* Used only by CW_AUDIO_RTP sound system. 'sound_device' is a
+	   comma-separated list of destinations of the stream, each
+	   "host:port" or "[IPv6 address]:port", unicast or multicast.
+	   Each packet carries 'rtp_packet_duration' microseconds of
+	   sound; zero means 20 ms. Shorter packets lower the latency at
+	   the cost of more overhead. Opus accepts only durations of its
+	   frames (2.5, 5, 10, 20, 40 or 60 ms). 'rtp_sample_rate' is
+	   sample rate of L16 payload, zero means 16000 Hz; Opus payload
+	   is always generated at 48000 Hz. Packets are sent at pace of
+	   the sample clock. */
+	cw_rtp_payload_t rtp_payload;
+	unsigned int rtp_packet_duration;
+	unsigned int rtp_sample_rate;
+
+	/* Client code guarantees that tones are enqueued to generator's
+	   tone queue from only one thread at a time. This allows the queue
+	   to work in lock-free single-producer/single-consumer mode, in
+	   which generator's thread doesn't need to take queue's mutex for
+	   every dequeued tone. Don't set this flag if generator is used
+	   with iambic keyer or straight key: these enqueue tones from
+	   their own threads. */
+	bool tq_single_producer;
+
+	/* Capacity of generator's tone queue, in tones. Zero means default
+	   capacity (roughly 5 minutes of Morse code at 12 WPM). The
+	   capacity can't be larger than 1000000 tones.
+
+	   With tq_lazy_allocation set, memory for the tones is allocated
+	   in small steps, as the queue is being filled, up to the
+	   capacity. This is useful for programs running many generators
+	   with large capacities that are rarely used in full. */
+	size_t tq_capacity;
+	bool tq_lazy_allocation;
+
+	/* Merge consecutive tones with the same frequency and without
+	   slopes (e.g. spaces at the end of a word) into single entry in
+	   generator's tone queue. This makes the queue hold fewer tones,
+	   so don't set this flag if client code relies on count of tones
+	   in the queue (e.g. with low water mark callback). */
+	bool tq_coalesce_tones;
+
+	/* Name of shared tone queue created by another process with
+	   cw_shmq_new(). If the name is not empty, the generator is a
+	   proxy of generator of that process: tones and characters
+	   enqueued to the generator are written to shared memory and
+	   played by the other process, and length of queue and waiting
+	   functions follow the shared queue. Frequency and timing
+	   parameters of the proxy are used, volume and sound are those of
+	   the other process. Sound system must be CW_AUDIO_NULL. See
+	   "Shared tone queue" section below. */
+	char tq_shared_name[CW_SHMQ_NAME_SIZE];
+
+	/* Generator works in "pull" mode: it doesn't have its own thread
+	   writing samples to sound system. Instead, client code's own
+	   audio engine (e.g. audio callback of SDL, PortAudio or Qt
+	   Multimedia) gets samples with cw_gen_fill_buffer(). Sound system
+	   must be CW_AUDIO_NULL. 'pull_sample_rate' is sample rate used by
+	   the audio engine; zero means sample rate of Null sound system. */
+	bool pull_mode;
+	unsigned int pull_sample_rate;
+
+	/* Real-time properties of generator's thread. 'thread_sched_policy'
+	   is SCHED_FIFO or SCHED_RR (see <sched.h>), with
+	   'thread_sched_priority' in range valid for the policy. Zero
+	   (SCHED_OTHER) keeps default scheduling. 'thread_cpu_set' is a mask
+	   of CPUs (bit N = CPU N) that the thread should be pinned to; zero
+	   means no pinning. Pinning is supported only on Linux. The
+	   properties have no effect in pull mode, where generator doesn't
+	   have its own thread.
+
+	   With 'lock_memory' set, generator's buffer of samples, table of
+	   slope amplitudes and sine table are locked in memory with
+	   mlock(), so that generating samples never causes page faults.
+	   Generator's memory is unlocked by cw_gen_delete(). The sine
+	   table is shared by all generators and stays locked until end
+	   of process.
+
+	   Lack of privileges (e.g. CAP_SYS_NICE or RLIMIT_MEMLOCK) is not
+	   an error: generator works with default properties, and client
+	   code can check what has been applied with
+	   cw_gen_get_realtime_status(). */
+	int thread_sched_policy;
+	int thread_sched_priority;
+	uint64_t thread_cpu_set;
+	bool lock_memory;
+
+	/* Low-latency keying for straight key. Normally generator writes
+	   samples to sound system in buffers of fixed size (e.g. ALSA's
+	   period), so sidetone can start and stop up to one buffer late
+	   after key has been pressed or released. With this flag set,
+	   while the key is held in one state, samples are written in
+	   small sub-blocks, and a change of key's state is heard from the
+	   next sub-block. This brings keying latency close to latency of
+	   sound device, at the cost of more frequent writes. Not used in
+	   pull mode. */
+	bool low_latency_keying;
+
+	/* Count of channels of sound device, up to
+	   CW_SOUND_CHANNELS_MAX. Samples are written to the device
+	   interleaved, and generated sound is routed to the channels with
+	   volumes set by cw_gen_set_sound_channel_volumes(). Zero means
+	   one channel (mono). More than one channel is supported by OSS,
+	   ALSA, PulseAudio and File sound systems, and not in pull
+	   mode. */
+	int sound_channels;
+
+	/* Format of samples written to sound device. Sound servers and
+	   professional sound cards often work with 32-bit integer or
+	   float samples, and would otherwise convert every buffer of
+	   16-bit samples written by generator. Samples are converted by
+	   generator while they are routed to channels of sound device,
+	   and mixer (see cw_mixer_new()) writes sum of its channels
+	   without clipping it to 16 bits. Supported by OSS (if the
+	   system's OSS has the format), ALSA, PulseAudio and File sound
+	   systems; ignored by Null and Console, which don't write
+	   samples. JACK, RTP and pull mode accept only
+	   CW_SAMPLE_FORMAT_S16. Samples returned by
+	   cw_gen_fill_buffer() and cw_gen_render_to_buffer() are always
+	   16-bit. */
+	cw_sample_format_t sample_format;
+
+	/* Call client's low water callback (see
+	   cw_gen_register_low_level_callback()) and value tracking
+	   callback (used e.g. by keying callbacks) from a separate
+	   dispatch thread, not from the thread generating sound. Slow
+	   client code in the callbacks then can't cause underruns of
+	   sound device. The callbacks are called a bit after the
+	   events; use cw_gen_get_callback_timestamp() in a callback to
+	   get exact time of its event. */
+	bool callbacks_in_dispatch_thread;
+
+	/* Idle mode of generator's thread, for devices running on
+	   battery. When tone queue has been empty (or has held only
+	   silence of straight key that stays up) for 'idle_timeout'
+	   microseconds, generator stops writing silence and lets the
+	   sound system pause the stream (ALSA stops the PCM, PulseAudio
+	   corks the stream), so that sound card and CPU can go to
+	   low-power states. The stream is resumed on the next enqueued
+	   tone. Zero means that idle mode is disabled. Not used in pull
+	   mode and by generators driven by scheduler. */
+	unsigned int idle_timeout;
 } cw_gen_config_t;
 
 
@@ -183,6 +469,85 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen);
 
 
 
+/**
+   @brief Prepare generator for reuse
+
+   Bring generator to the state of a freshly created generator, without
+   reopening its sound device and without freeing its memory:
+   - tones are removed from tone queue, and generator's sound sink is
+     silenced,
+   - client's callbacks, text source, key, keying output and keying log
+     are unregistered,
+   - speed, frequency, volume, gap, weighting, slopes, volumes of
+     sound channels, alphabet and label get their initial values,
+   - latency statistics are reset.
+
+   A started generator stays started (a paused one is resumed), and a
+   stopped generator stays stopped. Counters of writes to sound system (cw_gen_get_stats())
+   describe sound device and are not reset.
+
+   The function is used by pool of generators (see cw_pool_new()),
+   and can be used by client code that recycles generators itself.
+
+   @exception EINVAL @p gen is NULL
+
+   @param[in] gen generator to reset
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_reset(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Pause started generator
+
+   Fast alternative to cw_gen_stop(): tones are removed from tone queue
+   and generator goes silent, but thread of generator is not ended, and
+   sound device is neither closed nor reconfigured. The thread waits
+   with its sound sink paused until cw_gen_resume() or cw_gen_stop() is
+   called. Generator in pull mode, or driven by scheduler, gives only
+   silence while paused.
+
+   Tones enqueued while generator is paused are played after the
+   generator is resumed, so client code shouldn't wait for tone queue
+   of paused generator. Time of a pause is counted as idle time in
+   cw_gen_get_stats().
+
+   Pausing a paused generator is not an error.
+
+   @exception EINVAL @p gen is NULL or is not started
+
+   @param[in] gen generator to pause
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_pause(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Resume generator paused with cw_gen_pause()
+
+   The function returns right away: it only wakes up thread of the
+   generator. Resuming a generator that is not paused is not an error.
+
+   @exception EINVAL @p gen is NULL or is not started
+
+   @param[in] gen generator to resume
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_resume(cw_gen_t * gen);
+
+
+
+
 /**
    @brief Set label (name) of given generator instance
 
@@ -260,6 +625,11 @@ cw_ret_t cw_gen_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_durati
    See libcw.h/CW_SPEED_{INITIAL|MIN|MAX} for initial/minimal/maximal value
    of send speed.
 
+   New speed has effect also on characters that are already in tone queue:
+   durations of their Marks and Spaces are calculated when generator
+   dequeues them. Tones enqueued with cw_gen_enqueue_tones() keep their
+   durations.
+
    @exception EINVAL @p new_value is out of range.
 
    @internal
@@ -287,6 +657,9 @@ cw_ret_t cw_gen_set_speed(cw_gen_t * gen, int new_value);
    See libcw.h/CW_FREQUENCY_{INITIAL|MIN|MAX} for initial/minimal/maximal
    value of frequency.
 
+   Like with cw_gen_set_speed(), new frequency has effect also on Marks of
+   characters that are already in tone queue.
+
    @exception EINVAL @p new_value is out of range.
 
    @internal
@@ -335,6 +708,150 @@ cw_ret_t cw_gen_set_volume(cw_gen_t * gen, int new_value);
 
 
 
+/**
+   @brief Route sound of generator to channels of sound device
+
+   Set volume [%] with which sound of generator is written to each
+   channel of sound device (see cw_gen_config_t::sound_channels). The
+   volumes are applied on top of generator's volume. E.g. { 100, 0 }
+   puts the sound only in left channel of stereo device, and { 70, 30
+   } pans it a bit to the left. Volumes of channels beyond @p
+   n_volumes are set to zero. By default all channels have volume of
+   100%.
+
+   Channels of mixer (see cw_mixer_get_channel()) are routed to
+   channels of mixer's sound device in the same way.
+
+   @exception EINVAL @p gen or @p volumes is NULL, @p n_volumes is not
+   in range 1 - CW_SOUND_CHANNELS_MAX, or a volume is out of range
+   CW_VOLUME_MIN - CW_VOLUME_MAX.
+
+   @param[in] gen generator
+   @param[in] volumes volumes of channels of sound device, starting from first (left) channel
+   @param[in] n_volumes count of items in @p volumes
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_sound_channel_volumes(cw_gen_t * gen, const int * volumes, int n_volumes);
+
+
+
+
+/**
+   @brief Get count of channels of generator's sound device
+
+   @param[in] gen generator
+
+   @return count of channels, see cw_gen_config_t::sound_channels
+*/
+int cw_gen_get_sound_channels(const cw_gen_t * gen);
+
+
+
+
+/* Limits of fields of cw_impairments_t. */
+enum { CW_IMPAIRMENT_LEVEL_MAX = 100 };              /* [%] */
+enum { CW_IMPAIRMENT_NOISE_BANDWIDTH_MIN = 50 };     /* [Hz] */
+enum { CW_IMPAIRMENT_NOISE_BANDWIDTH_MAX = 3000 };   /* [Hz] */
+enum { CW_IMPAIRMENT_QSB_PERIOD_MIN = 500 };         /* [ms] */
+enum { CW_IMPAIRMENT_QSB_PERIOD_MAX = 120000 };      /* [ms] */
+enum { CW_IMPAIRMENT_QRN_RATE_MAX = 600 };           /* [crashes per minute] */
+enum { CW_IMPAIRMENT_CHIRP_DEPTH_MAX = 500 };        /* [Hz] */
+enum { CW_IMPAIRMENT_CHIRP_DURATION_MAX = 500 };     /* [ms] */
+
+
+
+
+/**
+   @brief Impairments of radio channel added to sound of generator
+
+   See cw_gen_set_impairments(). Zero in all fields means no
+   impairments.
+*/
+typedef struct cw_impairments_t {
+	/* Noise of band, added to generator's sound also between
+	   Marks. Level is in percents of full scale, bandwidth is width
+	   of band of noise around generator's frequency (as if heard
+	   through receiver's CW filter). Zero bandwidth means white
+	   noise. */
+	int noise_level;
+	int noise_bandwidth;  /* [Hz] */
+
+	/* QSB: slow fading of generator's sound (not of the noise).
+	   Depth is attenuation at the bottom of fade, in percents of
+	   volume. */
+	int qsb_depth;
+	int qsb_period;  /* [ms] */
+
+	/* QRN: static crashes, short bursts of noise at random moments
+	   (on average 'qrn_rate' crashes per minute), with peak level
+	   up to 'qrn_level' percents of full scale. The crashes are
+	   band-limited like the noise. */
+	int qrn_rate;
+	int qrn_level;
+
+	/* Chirp of transmitter: frequency of each Mark starts shifted
+	   by 'chirp_depth' Hz (up, or down if negative) and returns to
+	   generator's frequency within 'chirp_duration' ms. */
+	int chirp_depth;     /* [Hz] */
+	int chirp_duration;  /* [ms] */
+
+	/* Seed of random numbers of noise, crashes and phase of QSB. The
+	   same seed gives the same noise. Zero picks a different seed
+	   for every generator. */
+	uint32_t seed;
+} cw_impairments_t;
+
+
+
+
+/**
+   @brief Add impairments of radio channel to sound of generator
+
+   The impairments are calculated by generator in the same pass over
+   buffer as samples of tones, so they cost much less than processing
+   the sound afterwards, and can be used with every channel of mixer
+   (e.g. with different fading of every station of a pileup).
+
+   Noise and crashes are heard while generator is generating tones
+   (including spaces between characters and words), and, in pull
+   mode, also while its tone queue is empty. Chirp is applied by
+   CW_GEN_OSCILLATOR_TABLE oscillator (the default one).
+
+   The impairments may be changed while generator is running; the
+   change is heard from next fragment of calculated samples.
+
+   @exception EINVAL @p gen or @p impairments is NULL, or a field of @p
+   impairments is out of range (see CW_IMPAIRMENT_*)
+
+   @param[in] gen generator
+   @param[in] impairments impairments to add, all zero to remove them
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_impairments(cw_gen_t * gen, const cw_impairments_t * impairments);
+
+
+
+
+/**
+   @brief Get impairments of radio channel added to sound of generator
+
+   @exception EINVAL @p gen or @p impairments is NULL
+
+   @param[in] gen generator
+   @param[out] impairments current impairments
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_impairments(cw_gen_t * gen, cw_impairments_t * impairments);
+
+
+
+
 /**
    @brief Set sending gap of generator
 
@@ -651,6 +1168,46 @@ cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string);
 
 
 
+/**
+   @brief Tone to be enqueued in generator with cw_gen_enqueue_tones()
+*/
+typedef struct cw_gen_tone_t {
+	int frequency;   /* Frequency of tone [Hz]. Zero for silence. */
+	int duration;    /* Duration of tone [microseconds]. */
+	bool is_first;   /* Is this the first tone of a character? See cw_gen_remove_last_character(). */
+} cw_gen_tone_t;
+
+
+
+
+/**
+   @brief Enqueue an array of tones in generator
+
+   All @p n_tones tones from @p tones are added to generator's tone queue at
+   once, with generator's queue being locked (and generator being notified
+   about new tones) only once. This is cheaper than enqueueing the tones one
+   by one.
+
+   Either all tones are enqueued, or none of them is. Tones with non-zero
+   frequency are generated with generator's current slopes. Tones with zero
+   duration are ignored.
+
+   @exception EINVAL one of @p tones has invalid frequency or duration
+   @exception EAGAIN there is not enough space in generator's tone queue for all the tones
+   @exception ENOMEM failed to allocate memory
+
+   @param[in] gen generator to use
+   @param[in] tones array of tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_tones(cw_gen_t * gen, const cw_gen_tone_t * tones, size_t n_tones);
+
+
+
+
 /**
    @brief Wait for generator's tone queue to drain until only as many tones as given in @p level remain queued
 
@@ -735,6 +1292,75 @@ cw_ret_t cw_gen_remove_last_character(cw_gen_t * gen);
 
 
 
+/**
+   @brief Remove last word from queue of already enqueued characters
+
+   Characters enqueued after last inter-word-space (' ') that is followed
+   by other characters are removed, together with inter-word-spaces that
+   follow them. The word is removed only if none of its tones has been
+   played yet.
+
+   This function may be useful if user presses Ctrl+Backspace in UI.
+
+   @exception ENOENT there is no word that could be removed
+
+   @param[in] gen generator from which to remove the last word
+
+   @return CW_SUCCESS if function managed to remove a last word before it has been played
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_gen_remove_last_word(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Skip the rest of character that is being played
+
+   Tones of current character that haven't been played yet are removed
+   from queue, and generator continues with next enqueued character.
+
+   @exception ENOENT no enqueued character is being played
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_skip_current_character(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get character that is being played by generator
+
+   @p offset is the position of the character in text enqueued in
+   generator since its creation, counting ' ' characters: first character
+   enqueued with cw_gen_enqueue_character() or cw_gen_enqueue_string() has
+   offset zero. Characters removed with cw_gen_remove_last_character() or
+   cw_gen_remove_last_word() don't count. The function can be used to
+   highlight text in UI as it is being played, without registering a
+   callback.
+
+   The character is the one whose tones are being generated by
+   generator. Sound system may still be playing previous character from
+   its buffers.
+
+   @exception ENOENT no enqueued character is being played (e.g. queue is empty)
+
+   @param[in] gen generator
+   @param[out] character character that is being played, ' ' for inter-word-space (may be NULL)
+   @param[out] offset position of the character in enqueued text (may be NULL)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_playing_position(const cw_gen_t * gen, char * character, size_t * offset);
+
+
+
+
 /**
    @brief Get string with generator's sound device path/name
 
@@ -774,6 +1400,36 @@ int cw_gen_get_sound_system(const cw_gen_t * gen);
 
 
 
+/**
+   @brief Check availability of many sound systems at once
+
+   Each of @p sound_systems is checked with its cw_is_*_possible()
+   function (e.g. cw_is_pa_possible()) in a separate thread, so total
+   time of the check is the time of slowest check, not the sum of the
+   times. Result of check of @p sound_systems[i] is put in @p
+   possible[i].
+
+   A check that doesn't complete in @p timeout milliseconds is
+   treated as failed (its thread is left running until the check
+   completes). Until then the sound system is reported as not
+   possible by next calls to this function.
+
+   @exception EINVAL invalid arguments, or more than CW_PROBE_SOUND_SYSTEMS_MAX sound systems
+
+   @param[in] device_name name of device passed to cw_is_*_possible() functions, may be NULL
+   @param[in] sound_systems sound systems to check
+   @param[out] possible results of checks
+   @param[in] n count of items in @p sound_systems and @p possible
+   @param[in] timeout maximal time of waiting for results, e.g. CW_PROBE_SOUND_SYSTEMS_TIMEOUT [ms]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_probe_sound_systems(const char * device_name, const enum cw_audio_systems * sound_systems, bool * possible, size_t n, int timeout);
+
+
+
+
 /**
    @brief Get length of tone queue of the generator
 
@@ -816,144 +1472,1086 @@ cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callbac
 
 
 /**
-   @brief Wait for the current tone to complete
+   @brief Source of text pulled by generator, see cw_gen_register_text_source()
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   @param[in] source_arg pointer registered together with the function
 
-   @param[in] gen generator to wait on
+   @return next character of text to send
+   @return '\0' (or negative value) at end of text
+*/
+typedef int (* cw_gen_text_source_t)(void * source_arg);
 
-   @return CW_SUCCESS
+/**
+   @brief Register a source of text to be sent by generator
+
+   Instead of pushing a long text into tone queue in chunks, client
+   code can let the generator pull characters of the text just in
+   time: whenever the queue is about to run out of tones, generator
+   calls @p source_func and enqueues the returned character (with
+   cw_gen_enqueue_character()). Only a few tones are queued at any
+   moment, so memory doesn't grow with the length of the text, and
+   changes of speed, gap etc. take effect right away instead of after
+   everything that has been queued so far.
+
+   The first characters are pulled by this function, and the rest by
+   generator's thread (or by whatever drives the generator in pull
+   mode). Calls of @p source_func are never concurrent. Characters that
+   can't be sent in Morse code are skipped.
+
+   When @p source_func returns end of text, the source is unregistered
+   and the generator plays what is left in the queue. Wait for end of
+   the text with cw_gen_wait_for_queue_level(gen, 0). Pass NULL
+   @p source_func to unregister the source earlier. cw_gen_flush_queue()
+   doesn't unregister the source.
+
+   Don't enqueue other characters or tones while the source is
+   registered: they would be mixed with characters of the text.
+
+   @param[in,out] gen generator
+   @param[in] source_func source of text, or NULL
+   @param[in] source_arg pointer to be passed to @p source_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen);
+cw_ret_t cw_gen_register_text_source(cw_gen_t * gen, cw_gen_text_source_t source_func, void * source_arg);
 
 
 
 
 /**
-   @brief See if generator's tone queue is full
+   @brief Get time of event reported by callback
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   Call the function from body of low water callback or value
+   tracking callback. If the callbacks are called from dispatch
+   thread (see cw_gen_config_t::callbacks_in_dispatch_thread), the
+   function returns time at which the event has happened in
+   generator's thread, not time of the (later) call of the callback.
+   Otherwise the event is happening right now, and the function
+   returns current time.
 
-   @return true if the queue is full
-   @return false otherwise
+   Timestamps are taken from monotonic clock (CLOCK_MONOTONIC).
+
+   @param[in] gen generator
+
+   @return timestamp of event [ns]
 */
-bool cw_gen_is_queue_full(cw_gen_t const * gen);
+int64_t cw_gen_get_callback_timestamp(const cw_gen_t * gen);
 
 
 
 
-typedef void (* cw_gen_value_tracking_callback_t)(void * callback_arg, int state);
-void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_value_tracking_callback_t callback_func, void * callback_arg);
+/**
+   @brief Get descriptor that becomes readable on events in generator's tone queue
+
+   The descriptor (Linux eventfd) is signalled when length of the tone
+   queue falls to level registered with
+   cw_gen_register_low_level_callback() (the callback itself may be
+   NULL), and when generator has finished playing the last tone from
+   the queue. Event-driven client code can watch the descriptor in its
+   main loop instead of polling the generator with a timer. Read the
+   8-byte counter from the descriptor to reset it before checking the
+   generator.
 
+   The descriptor is non-blocking, is created on first call, and is
+   closed by cw_gen_delete().
 
+   @exception ENOSYS event descriptors are not supported on this platform
 
+   @param[in,out] gen generator
 
-/* **************** Key **************** */
+   @return file descriptor on success
+   @return -1 on failure
+*/
+int cw_gen_get_event_fd(cw_gen_t * gen);
 
 
 
 
-/*
-  For straight key this is a value of a single (and the only) element of a
-  key.
+/**
+   @brief Wait for the current tone to complete
 
-  For a iambic keyer and other key types this a value of one of two paddles.
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
 
-  A state of key's internal graph (state machine) can have values that have
-  _STATE_ in their names. I'm making here a distinction between "value" and
-  "state", reserving word "state" for state of the internal graph (state
-  machine).
+   @param[in] gen generator to wait on
+
+   @return CW_SUCCESS
 */
-typedef enum {
-	CW_KEY_VALUE_OPEN = CW_KEY_STATE_OPEN,      /* Space, no sound. */
-	CW_KEY_VALUE_CLOSED = CW_KEY_STATE_CLOSED,  /* Mark, sound. */
-} cw_key_value_t;
+cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen);
 
 
 
 
-cw_key_t * cw_key_new(void);
-void cw_key_delete(cw_key_t ** key);
+/* Function called on completion of asynchronous wait, see
+   cw_gen_wait_for_queue_level_async(). */
+typedef void (* cw_wait_callback_t)(void * callback_arg);
 
 
 
 
 /**
-   @brief Set label (name) of given key instance
+   @brief Start waiting for generator's tone queue to drain to given level, without blocking
+
+   Non-blocking equivalent of cw_gen_wait_for_queue_level(), for
+   event-driven client code. The function registers a one-shot wait
+   and returns. When length of the queue falls to @p level, the wait
+   completes: @p callback (if not NULL) is called with @p callback_arg,
+   and descriptor returned through @p fd (if @p fd is not NULL) becomes
+   readable. If the condition is already true, the wait completes
+   before the function returns.
+
+   The callback is called with no locks of the library held, by the
+   thread that has made the condition true (usually generator's
+   thread), or by dispatch thread if generator has been created with
+   cw_gen_config_t::callbacks_in_dispatch_thread. It should return
+   quickly.
+
+   The descriptor is a new, non-blocking Linux eventfd owned by caller,
+   who must close it. A single-threaded event loop can watch
+   descriptors of many generators and keys.
+
+   Waits that haven't completed when generator is deleted are dropped:
+   their callbacks are not called and their descriptors are not
+   signalled.
+
+   @exception EINVAL @p gen is NULL, or both @p callback and @p fd are NULL
+   @exception ENOTSUP generator is a proxy of shared tone queue
+   @exception ENOSYS @p fd is not NULL, and descriptors are not supported on this platform
 
-   The label can be used by client code to distinguish different
-   instances of keys. The label is used in library's debug
-   messages.
+   @param[in] gen generator on which to wait
+   @param[in] level level in queue, at which the wait completes
+   @param[in] callback function to call on completion, may be NULL
+   @param[in] callback_arg argument of @p callback
+   @param[out] fd descriptor that becomes readable on completion, may be NULL
 
-   @p key can't be NULL.
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_wait_for_queue_level_async(cw_gen_t * gen, size_t level, cw_wait_callback_t callback, void * callback_arg, int * fd);
 
-   @p label can't be NULL.
 
-   @p label can be an empty string: key's label will become empty
-   string.
 
-   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
-   be truncated and
-   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
+
+/**
+   @brief Start waiting for the current tone to complete, without blocking
+
+   Non-blocking equivalent of cw_gen_wait_for_end_of_current_tone().
+   See cw_gen_wait_for_queue_level_async() for description of
+   completion of the wait.
+
+   @exception EINVAL @p gen is NULL, or both @p callback and @p fd are NULL
+   @exception ENOTSUP generator is a proxy of shared tone queue
+   @exception ENOSYS @p fd is not NULL, and descriptors are not supported on this platform
+
+   @param[in] gen generator on which to wait
+   @param[in] callback function to call on completion, may be NULL
+   @param[in] callback_arg argument of @p callback
+   @param[out] fd descriptor that becomes readable on completion, may be NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_wait_for_end_of_current_tone_async(cw_gen_t * gen, cw_wait_callback_t callback, void * callback_arg, int * fd);
+
+
+
+
+/**
+   @brief See if generator's tone queue is full
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @return true if the queue is full
+   @return false otherwise
+*/
+bool cw_gen_is_queue_full(cw_gen_t const * gen);
+
+
+
+
+typedef void (* cw_gen_value_tracking_callback_t)(void * callback_arg, int state);
+typedef void (* cw_gen_timed_value_tracking_callback_t)(void * callback_arg, int state, int64_t timestamp);
+void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_value_tracking_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Register callback receiving changes of generator's value together with their timestamps
+
+   Generator's value changes when a tone is dequeued from tone queue,
+   so a callback registered with
+   cw_gen_register_value_tracking_callback_internal() is called some
+   time before the tone is heard: the tone still has to go through
+   generator's buffer and through buffer of sound device. This
+   callback gets, in @p timestamp, an estimation of time at which the
+   change of value is heard. The estimation is calculated from
+   position of first sample of the tone in stream of samples, and from
+   delay of sound device reported by sound system (ALSA, PulseAudio
+   and JACK report it), so receivers fed from the callback can
+   measure durations of marks and spaces regardless of depth of
+   buffers.
+
+   Timestamps are taken from monotonic clock (CLOCK_MONOTONIC) [ns].
+   They may be in the future.
+
+   The callback can be registered together with callback registered
+   with cw_gen_register_value_tracking_callback_internal(). Passing
+   NULL @p callback_func removes previously registered callback.
+
+   @exception EINVAL @p gen is NULL
+
+   @param[in] gen generator for which to register a callback
+   @param[in] callback_func callback function to be called on changes of generator value
+   @param[in] callback_arg first argument to callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_register_timed_value_tracking_callback(cw_gen_t * gen, cw_gen_timed_value_tracking_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Render tones from generator's tone queue into PCM samples
+
+   The function takes all tones from generator's tone queue, calculates their
+   samples, and copies up to @p size samples to @p buffer. Samples that
+   didn't fit into @p buffer are kept by generator and are returned by next
+   call to this function, so the function can be called repeatedly (e.g.
+   after enqueueing each portion of text) until it returns zero samples
+   through @p n_samples.
+
+   The tones are rendered as fast as possible, without any pacing to real
+   time, so a generator created with CW_AUDIO_NULL sound system can be used to
+   render text to PCM data much faster than it would be played. Samples are
+   in mono, 16-bit signed format, with sample rate of generator's sound
+   system.
+
+   The generator must not be started with cw_gen_start().
+
+   @exception EBUSY generator has been started
+   @exception ENOMEM failed to allocate memory for rendered samples
+
+   @param[in] gen generator
+   @param[out] buffer buffer for rendered samples, owned by caller
+   @param[in] size size of @p buffer [samples]
+   @param[out] n_samples count of samples copied to @p buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_render_to_buffer(cw_gen_t * gen, cw_sample_t * buffer, size_t size, size_t * n_samples);
+
+
+
+
+/**
+   @brief Render a string into PCM samples
+
+   Enqueue all characters of @p string in generator, and render all tones
+   from generator's queue into a newly allocated buffer. Any samples
+   already rendered but not yet retrieved with cw_gen_render_to_buffer()
+   are placed at the beginning of the buffer.
+
+   The buffer is returned through @p buffer and is owned by caller. It
+   should be deallocated with free().
+
+   The generator must not be started with cw_gen_start().
+
+   @exception ENOENT @p string is invalid (one or more characters in the
+   string is not a valid Morse character)
+   @exception EBUSY generator has been started
+   @exception ENOMEM failed to allocate memory for rendered samples
+
+   @param[in] gen generator
+   @param[in] string string to render
+   @param[out] buffer pointer to newly allocated buffer with samples
+   @param[out] n_samples count of samples in @p buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_render_string(cw_gen_t * gen, const char * string, cw_sample_t ** buffer, size_t * n_samples);
+
+
+
+
+/**
+   @brief Get next samples from generator working in pull mode
+
+   To be called by client code's audio engine (e.g. from its audio
+   callback) each time the engine needs next @p n_samples samples of
+   generator created with cw_gen_config_t::pull_mode. The function
+   dequeues tones from generator's tone queue and calculates their
+   samples right into @p samples. A tone may span many calls to the
+   function.
+
+   The function never blocks: when tone queue is empty, or when
+   generator is not started, it puts silence into @p samples.
+
+   In pull mode cw_gen_stop() doesn't wait for client code to pull
+   remaining samples: sound is cut at the moment of stopping.
+
+   Samples are in mono, 16-bit signed format, with sample rate
+   specified by cw_gen_config_t::pull_sample_rate.
+
+   @exception EINVAL @p gen or @p samples is NULL, or @p gen doesn't work in pull mode
+
+   @param[in] gen generator
+   @param[out] samples buffer for samples, owned by caller
+   @param[in] n_samples count of samples to put into @p samples
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_fill_buffer(cw_gen_t * gen, cw_sample_t * samples, size_t n_samples);
+
+
+
+
+/**
+   @brief Histogram of latencies
+
+   All values are in microseconds. Bucket zero counts latencies shorter
+   than 1 us. Bucket i (for i > 0) counts latencies in range
+   [2^(i-1), 2^i) us. The last bucket counts also all longer latencies.
+*/
+#define CW_LATENCY_HISTOGRAM_N_BUCKETS 32
+typedef struct cw_latency_histogram_t {
+	uint64_t count;    /* Count of measurements. */
+	uint64_t sum;      /* Sum of all measured latencies [us]. */
+	uint64_t max;      /* The longest measured latency [us]. */
+	uint64_t buckets[CW_LATENCY_HISTOGRAM_N_BUCKETS];
+} cw_latency_histogram_t;
+
+
+
+
+/**
+   @brief Latency statistics of generator
+
+   See cw_gen_get_latency_stats().
+*/
+typedef struct cw_gen_latency_stats_t {
+	/* Time between enqueueing a tone and dequeueing it by generator. */
+	cw_latency_histogram_t queue;
+
+	/* Time between dequeueing a tone by generator and handing a buffer
+	   with first samples of the tone to sound system. For every buffer
+	   only the earliest tone starting in the buffer is measured. Not
+	   measured for Null and Console sound systems, which don't use
+	   buffers of samples. */
+	cw_latency_histogram_t device;
+
+	/* Time between enqueueing a tone and handing a buffer with first
+	   samples of the tone to sound system (i.e. sum of the two latencies
+	   above, measured for the same tones as ::device). */
+	cw_latency_histogram_t total;
+
+	/* The largest count of tones in generator's tone queue, and the
+	   capacity of the queue. */
+	size_t tq_length_max;
+	size_t tq_capacity;
+
+	/* Time between handing samples to sound system and playing them,
+	   in microseconds, as last reported by sound system. Zero if
+	   sound system doesn't report it (only PulseAudio does). */
+	int64_t sound_device_latency;
+
+	/* Lateness of generator's thread waking up at end of a tone,
+	   after the tone's absolute deadline. Measured only for Null and
+	   Console sound systems, which time the tones with a clock
+	   instead of a sound device. Small lateness is compensated by
+	   shortening next tone, so it doesn't accumulate. */
+	cw_latency_histogram_t pacing;
+
+	/* Count of times when generator has emptied its tone queue. The
+	   queue is emptied at the end of every transmission; if client
+	   code keeps the queue filled (e.g. with low water mark callback),
+	   any other emptying means that generator was starved of tones. */
+	unsigned int n_tq_emptied;
+
+	/* Sum of durations of dequeued tones [us], and count of samples
+	   calculated for them (zero for Null and Console sound systems,
+	   which don't use samples). Difference between the two (converted
+	   with sample rate) is drift of durations of tones caused by
+	   rounding to whole samples. */
+	int64_t tones_duration;
+	uint64_t n_tones_samples;
+} cw_gen_latency_stats_t;
+
+
+
+
+/**
+   @brief Get latency statistics of generator
+
+   The statistics are collected from moment of creation of generator, or
+   from last call to cw_gen_reset_latency_stats().
+
+   The statistics are copied without blocking generator's thread, so
+   the function may be called often (e.g. by exporter of metrics, see
+   cw_metrics_write()).
+
+   @exception EINVAL @p gen or @p stats is NULL
+
+   @param[in] gen generator
+   @param[out] stats statistics of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_latency_stats(cw_gen_t * gen, cw_gen_latency_stats_t * stats);
+
+
+
+
+/**
+   @brief Reset latency statistics of generator
+
+   @param[in] gen generator
+*/
+void cw_gen_reset_latency_stats(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get current latency of generator's output
+
+   The latency is time after which a sample calculated now will be
+   heard: current delay of sound device (samples written to the
+   device, but not played yet), plus duration of samples waiting in
+   generator's buffer to be written to the device.
+
+   Delay of device is asked from sound system at the time of the call
+   (ALSA, PulseAudio, OSS). For other sound systems last latency
+   reported by sound system is used (see
+   cw_gen_latency_stats_t::sound_device_latency), and it is zero for
+   sound systems without sound device.
+
+   @exception EINVAL @p gen or @p usecs is NULL
+
+   @param[in] gen generator
+   @param[out] usecs latency of generator's output [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_output_latency(cw_gen_t * gen, int64_t * usecs);
+
+
+
+
+/**
+   @brief Counters of writes of generator to sound system
+
+   See cw_gen_get_stats(). The counters are never reset; they only
+   grow during life time of generator.
+*/
+typedef struct cw_gen_stats_t {
+	/* Underruns of sound device reported by sound system (ALSA and
+	   PulseAudio report them), and restarts of sound device after an
+	   underrun or after a failed write. Sound device may also run
+	   out of samples when generator stops writing because its tone
+	   queue has been emptied; PulseAudio reports this as underrun. */
+	uint64_t n_xruns;
+	uint64_t n_recoveries;
+
+	/* Writes in which sound system has accepted only a part of
+	   buffer, and all failed writes (including the short writes and
+	   writes failed because of underrun). */
+	uint64_t n_short_writes;
+	uint64_t n_write_errors;
+
+	/* Buffers and samples successfully written to sound system (or
+	   pulled by client code from generator in pull mode). Compared
+	   with time elapsed, count of samples shows drift of clock of
+	   sound device. */
+	uint64_t n_buffers_written;
+	uint64_t n_samples_written;
+
+	/* Time spent by generator's thread in (blocking) writes to sound
+	   system [us]. */
+	uint64_t write_blocked_time;
+
+	/* Time spent by generator's thread in idle mode (see
+	   cw_gen_config_t::idle_timeout), and outside of idle mode,
+	   since first start of the thread [us]. Count of entries into
+	   idle mode. */
+	uint64_t idle_time;
+	uint64_t active_time;
+	uint64_t n_idle_periods;
+} cw_gen_stats_t;
+
+
+
+
+/**
+   @brief Get counters of writes of generator to sound system
+
+   The counters are updated atomically, without locking, so the
+   function may be called often (e.g. by exporter of metrics of a
+   long-running program). Values of different counters may come from
+   slightly different moments.
+
+   @exception EINVAL @p gen or @p stats is NULL
+
+   @param[in] gen generator
+   @param[out] stats counters of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_stats(cw_gen_t * gen, cw_gen_stats_t * stats);
+
+
+
+
+/**
+   @brief Status of real-time properties of generator
+
+   See cw_gen_config_t::thread_sched_policy and cw_gen_get_realtime_status().
+
+   For each property there is a flag telling if it has been applied,
+   and errno value telling why it has not been applied. errno value is
+   zero if the property has been applied or if it wasn't requested.
+*/
+typedef struct cw_gen_realtime_status_t {
+	bool sched_applied;
+	int sched_errno;
+
+	bool cpu_affinity_applied;
+	int cpu_affinity_errno;
+
+	bool memory_locked;
+	int memory_lock_errno;
+} cw_gen_realtime_status_t;
+
+
+
+
+/**
+   @brief Get status of real-time properties of generator
+
+   Scheduling and CPU affinity are applied by generator's thread when
+   the thread starts, so call this function after cw_gen_start().
+
+   @exception EINVAL @p gen or @p status is NULL
+
+   @param[in] gen generator
+   @param[out] status status of real-time properties of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_realtime_status(cw_gen_t * gen, cw_gen_realtime_status_t * status);
+
+
+
+
+/* **************** Key **************** */
+
+
+
+
+/*
+  For straight key this is a value of a single (and the only) element of a
+  key.
+
+  For a iambic keyer and other key types this a value of one of two paddles.
+
+  A state of key's internal graph (state machine) can have values that have
+  _STATE_ in their names. I'm making here a distinction between "value" and
+  "state", reserving word "state" for state of the internal graph (state
+  machine).
+*/
+typedef enum {
+	CW_KEY_VALUE_OPEN = CW_KEY_STATE_OPEN,      /* Space, no sound. */
+	CW_KEY_VALUE_CLOSED = CW_KEY_STATE_CLOSED,  /* Mark, sound. */
+} cw_key_value_t;
+
+
+
+
+cw_key_t * cw_key_new(void);
+void cw_key_delete(cw_key_t ** key);
+
+
+
+
+/**
+   @brief Prepare key for reuse
+
+   Bring key to the state of a freshly created key: unregister its
+   generator, receiver and keying log, open the straight key and
+   paddles, reset state of iambic keyer and Curtis mode B, and clear
+   key's label.
+
+   @param[in] key key to reset
+*/
+void cw_key_reset(cw_key_t * key);
+
+
+
+
+/**
+   @brief Set label (name) of given key instance
+
+   The label can be used by client code to distinguish different
+   instances of keys. The label is used in library's debug
+   messages.
+
+   @p key can't be NULL.
+
+   @p label can't be NULL.
+
+   @p label can be an empty string: key's label will become empty
+   string.
+
+   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
+   be truncated and
+   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
    logged. This is not treated as error: function will not return
    `CW_FAILURE` because of that.
 
-   @param[in] key key for which to set label
-   @param[in] label new label to set for given @p key
+   @param[in] key key for which to set label
+   @param[in] label new label to set for given @p key
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise (e.g. @p key or @p label is NULL)
+*/
+cw_ret_t cw_key_set_label(cw_key_t * key, const char * label);
+
+
+
+
+/**
+   @brief Get label (name) of given key instance
+
+   @p key and @p label can't be NULL.
+
+   @p label should be a buffer of size at least
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
+
+   @p size should have value equal to size of @p label char buffer.
+
+   @p size is not validated: it could be smaller than
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
+   get only as many characters of key's label as he asked for.
+
+   @param[in] key key from which to get label
+   @param[out] label output buffer
+   @param[in] size total size of output buffer @p label
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (e.g. @p key or @p label is NULL)
+*/
+cw_ret_t cw_key_get_label(const cw_key_t * key, char * label, size_t size);
+
+
+
+
+void cw_key_register_generator(volatile cw_key_t * key, cw_gen_t * gen);
+void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec);
+
+void cw_key_ik_enable_curtis_mode_b(volatile cw_key_t * key);
+void cw_key_ik_disable_curtis_mode_b(volatile cw_key_t * key);
+bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t * key);
+cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value);
+cw_ret_t cw_key_ik_notify_dash_paddle_event(volatile cw_key_t * key, cw_key_value_t dash_paddle_value);
+cw_ret_t cw_key_ik_notify_dot_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value);
+void cw_key_ik_get_paddles(const volatile cw_key_t * key, cw_key_value_t * dot_paddle_value, cw_key_value_t * dash_paddle_value);
+cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key);
+cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key);
+cw_ret_t cw_key_ik_wait_for_keyer_async(volatile cw_key_t * key, cw_wait_callback_t callback, void * callback_arg, int * fd);
+
+cw_ret_t cw_key_sk_get_value(const volatile cw_key_t * key, cw_key_value_t * key_value);
+cw_ret_t cw_key_sk_set_value(volatile cw_key_t * key, cw_key_value_t key_value);
+
+
+
+
+/* **************** Key input **************** */
+
+
+
+
+/*
+  Key input delivers changes of hardware key (straight key or paddles
+  of iambic keyer) directly to a cw_key_t, without going through event
+  loop of client code. The key may be connected to modem control lines
+  of serial port (CTS, DSR), may be a key of Linux input (evdev)
+  device, or a line of Linux GPIO chip (/dev/gpiochipN).
+
+  All sources are handled by a single thread of key input, waiting on
+  all of them with epoll. Changes on straight key line are also passed
+  to receiver registered with the key, with timestamps of the changes
+  (see cw_rec_mark_begin_ns()). While key input is running, client
+  code must not change a value of the key by itself.
+
+  Key input is available only on Linux. On other systems
+  cw_input_new() fails with errno set to ENOSYS.
+*/
+typedef enum {
+	CW_INPUT_LINE_NONE = -1,          /* Source's line is not used. */
+	CW_INPUT_LINE_STRAIGHT_KEY = 0,
+	CW_INPUT_LINE_DOT_PADDLE,
+	CW_INPUT_LINE_DASH_PADDLE
+} cw_input_line_t;
+
+/* Called in thread of key input after each change of value of a line.
+   @p timestamp is a timestamp of the change [ns] (see
+   cw_rec_mark_begin_ns()). */
+typedef void (* cw_input_callback_t)(void * callback_arg, cw_input_line_t line, cw_key_value_t value, int64_t timestamp);
+
+cw_input_t * cw_input_new(cw_key_t * key);
+void         cw_input_delete(cw_input_t ** input);
+
+cw_ret_t cw_input_add_serial(cw_input_t * input, const char * path, cw_input_line_t cts_line, cw_input_line_t dsr_line);
+cw_ret_t cw_input_add_evdev(cw_input_t * input, const char * path, int key_code, cw_input_line_t line);
+cw_ret_t cw_input_add_gpio(cw_input_t * input, const char * path, unsigned int offset, bool active_low, cw_input_line_t line);
+cw_ret_t cw_input_register_callback(cw_input_t * input, cw_input_callback_t callback_func, void * callback_arg);
+
+cw_ret_t cw_input_start(cw_input_t * input);
+cw_ret_t cw_input_stop(cw_input_t * input);
+
+
+
+
+/* **************** Keying output **************** */
+
+
+
+
+/*
+  Keying output keys a transmitter with state of generator (the same
+  state that is reported to value tracking callback). The transmitter
+  is keyed through RTS or DTR line of serial port, a line of Linux
+  GPIO chip, or a data pin of parallel port (Linux ppdev).
+
+  Changes of state are made by a separate thread of keying output (a
+  real-time thread if process has privileges for this), at absolute
+  deadlines: time at which the sidetone is heard (time of dequeueing
+  of a tone plus latency of sound device), plus configurable offset.
+  Negative offset keys the transmitter ahead of the sidetone, but not
+  earlier than the tone is dequeued.
+
+  Keying output must be deleted before its generator.
+
+  Keying output is available only on Linux. On other systems
+  cw_keying_new() fails with errno set to ENOSYS.
+*/
+enum { CW_KEYING_OFFSET_MAX = 1000000 }; /* [us] */
+
+typedef enum {
+	CW_KEYING_SERIAL_RTS,
+	CW_KEYING_SERIAL_DTR
+} cw_keying_serial_line_t;
+
+cw_keying_t * cw_keying_new(cw_gen_t * gen);
+void          cw_keying_delete(cw_keying_t ** keying);
+
+cw_ret_t cw_keying_open_serial(cw_keying_t * keying, const char * path, cw_keying_serial_line_t line, bool active_low);
+cw_ret_t cw_keying_open_gpio(cw_keying_t * keying, const char * path, unsigned int offset, bool active_low);
+cw_ret_t cw_keying_open_parport(cw_keying_t * keying, const char * path, int data_pin, bool active_low);
+
+cw_ret_t cw_keying_set_offset(cw_keying_t * keying, int offset);
+int      cw_keying_get_offset(const cw_keying_t * keying);
+
+cw_ret_t cw_keying_start(cw_keying_t * keying);
+cw_ret_t cw_keying_stop(cw_keying_t * keying);
+
+
+
+
+/* **************** Network keying **************** */
+
+
+
+
+/*
+  Network keying replays keying of remote operator, received over UDP,
+  on a cw_key_t (as straight key), and on receiver registered with the
+  key. It's meant for Internet CW clubs (MOPP, CWCom and similar),
+  where keying should stay rhythmically intact.
+
+  Sender reports changes of its key with timestamps of its own clock.
+  Each datagram carries the most recent changes (the newest one and
+  some of the preceding ones, so that a lost datagram doesn't lose
+  changes):
+
+    offset  size  field
+    0       2     "CW"
+    2       1     version of format (CW_NETKEY_VERSION)
+    3       1     count of changes N (1 - CW_NETKEY_EVENTS_MAX)
+    4       4     sequence number of first change in datagram;
+                  changes are numbered consecutively by sender
+    8       4*N   changes, oldest first: bit 31 is set if change
+                  closes the key, bits 0-30 are sender's time of the
+                  change [us], modulo 2^31
+
+  Multi-byte fields are big-endian.
+
+  Changes pass through a jitter buffer. A change is replayed at
+  sender's time of the change plus constant offset: the smallest
+  recently seen transit time (which includes difference between the
+  clocks), plus playout delay. The delay follows measured jitter of
+  network (four times the interarrival jitter of RFC 3550) within
+  configured range, but it is changed only when the key is idle, so
+  that changes within one "talkspurt" keep their relative timing. A
+  change that arrives after its playout time is replayed right away,
+  and delays rest of the talkspurt by the same amount.
+
+  While network keying is running, client code must not change a
+  value of the key by itself.
+
+  Network keying is available only on Linux. On other systems
+  cw_netkey_new() fails with errno set to ENOSYS.
+*/
+#define CW_NETKEY_VERSION 1
+enum { CW_NETKEY_EVENTS_MAX = 32 };
+
+typedef struct {
+	unsigned int n_datagrams; /* Valid datagrams. */
+	unsigned int n_invalid;   /* Malformed datagrams. */
+	unsigned int n_events;    /* Changes received for the first time. */
+	unsigned int n_lost;      /* Changes that were never received. */
+	unsigned int n_late;      /* Changes received after their playout time. */
+	int jitter;               /* Interarrival jitter [us]. */
+	int delay;                /* Current playout delay [us]. */
+} cw_netkey_stats_t;
+
+/* Called in thread of network keying after each replayed change of
+   the key. @p timestamp is the time at which the change was scheduled
+   [ns] (see cw_rec_mark_begin_ns()). */
+typedef void (* cw_netkey_callback_t)(void * callback_arg, cw_key_value_t value, int64_t timestamp);
+
+cw_netkey_t * cw_netkey_new(cw_key_t * key);
+void          cw_netkey_delete(cw_netkey_t ** netkey);
+
+cw_ret_t cw_netkey_bind(cw_netkey_t * netkey, const char * address);
+int      cw_netkey_get_port(const cw_netkey_t * netkey);
+cw_ret_t cw_netkey_set_delay_range(cw_netkey_t * netkey, int delay_min, int delay_max);
+cw_ret_t cw_netkey_register_callback(cw_netkey_t * netkey, cw_netkey_callback_t callback_func, void * callback_arg);
+
+cw_ret_t cw_netkey_start(cw_netkey_t * netkey);
+cw_ret_t cw_netkey_stop(cw_netkey_t * netkey);
+cw_ret_t cw_netkey_get_stats(cw_netkey_t * netkey, cw_netkey_stats_t * stats);
+
+
+
+
+/* **************** Mixer **************** */
+
+
+
+
+/*
+  Mixer plays many independent channels of Morse code (e.g. a
+  simulated pileup of stations calling at different pitches) through
+  one sound device, with one thread.
+
+  Each channel is a generator returned by cw_mixer_get_channel().
+  Client code enqueues characters, strings or tones to the generator,
+  and sets its frequency, speed, volume etc. with regular cw_gen_*()
+  functions. The generator of channel is owned by mixer: it must not
+  be started, stopped or deleted by client code.
+
+  Samples of all channels are summed, and the sum is clipped to range
+  of samples. With many channels played at the same time client code
+  should lower volumes of the channels to avoid clipping.
+
+  If sound device has more than one channel (see
+  cw_gen_config_t::sound_channels), each channel of mixer can be
+  panned or routed to specific channels of the device with
+  cw_gen_set_sound_channel_volumes().
+*/
+enum { CW_MIXER_N_CHANNELS_MAX = 256 };
+
+cw_mixer_t * cw_mixer_new(const cw_gen_config_t * gen_conf, int n_channels);
+void         cw_mixer_delete(cw_mixer_t ** mixer);
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE otherwise (e.g. @p key or @p label is NULL)
+cw_gen_t *   cw_mixer_get_channel(cw_mixer_t * mixer, int channel);
+int          cw_mixer_get_n_channels(const cw_mixer_t * mixer);
+
+cw_ret_t     cw_mixer_start(cw_mixer_t * mixer);
+cw_ret_t     cw_mixer_stop(cw_mixer_t * mixer);
+
+
+
+
+/* **************** Taps **************** */
+
+
+
+
+/*
+  Tap plays samples of a generator on one more sound sink (e.g. a
+  second sound card, a WAV file and an RTP stream at the same time),
+  without calculating the samples again.
+
+  Each buffer calculated by generator is handed by reference to all
+  taps of the generator. Each tap has its own queue of buffers and its
+  own thread that writes the buffers to the tap's sink. A slow sink
+  never stalls the generator: when queue of a tap is full, the buffer
+  is dropped for that tap only, and counted in
+  cw_tap_stats_t::n_dropped.
+
+  Taps are added before the generator is started, and are deleted
+  together with the generator. Sink must use the same sample rate as
+  the generator, and neither of them can work in pull mode.
 */
-cw_ret_t cw_key_set_label(cw_key_t * key, const char * label);
+enum { CW_GEN_TAPS_MAX = 8 };
 
+typedef struct {
+	uint64_t n_buffers;  /* Buffers written to sink. */
+	uint64_t n_dropped;  /* Buffers dropped because queue of tap was full. */
+	uint64_t n_errors;   /* Failed writes to sink. */
+} cw_tap_stats_t;
 
+cw_tap_t * cw_gen_add_tap(cw_gen_t * gen, const cw_gen_config_t * sink_conf);
+cw_ret_t   cw_tap_get_stats(const cw_tap_t * tap, cw_tap_stats_t * stats);
 
 
-/**
-   @brief Get label (name) of given key instance
 
-   @p key and @p label can't be NULL.
 
-   @p label should be a buffer of size at least
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
+/* **************** Scheduler **************** */
 
-   @p size should have value equal to size of @p label char buffer.
 
-   @p size is not validated: it could be smaller than
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
-   get only as many characters of key's label as he asked for.
 
-   @param[in] key key from which to get label
-   @param[out] label output buffer
-   @param[in] size total size of output buffer @p label
+
+/*
+  Scheduler drives many generators with a small, shared pool of
+  worker threads, so that cost of a generator is its memory, not a
+  thread of its own.
+
+  Generator started with cw_gen_start_with_sched() instead of
+  cw_gen_start() doesn't have its own thread. Workers of scheduler
+  generate and write one buffer of samples of a generator at a time,
+  always picking the generator whose next buffer is due first.
+  Client code enqueues tones and characters, and stops the generator
+  with cw_gen_stop(), just like with any other generator.
+
+  Writes done by workers must not block, so only generators with File
+  sound system can be scheduled. Generators working in pull mode and
+  channels of mixer don't have threads anyway.
+
+  All scheduled generators should be stopped before the scheduler is
+  deleted.
+*/
+enum { CW_SCHED_N_WORKERS_MAX = 64 };
+
+cw_sched_t * cw_sched_new(int n_workers);
+void         cw_sched_delete(cw_sched_t ** sched);
+int          cw_sched_get_n_gens(cw_sched_t * sched);
+
+
+
+
+/**
+   @brief Start generator driven by workers of scheduler
+
+   See description of scheduler above. The generator must have File
+   sound system, and must not be started yet.
+
+   @exception EINVAL @p gen or @p sched is NULL, or sound system of @p gen can't be scheduled
+   @exception EBUSY @p gen has been already started
+
+   @param[in] gen generator to start
+   @param[in] sched scheduler that will drive the generator
 
    @return CW_SUCCESS on success
-   @return CW_FAILURE on failure (e.g. @p key or @p label is NULL)
+   @return CW_FAILURE on failure
 */
-cw_ret_t cw_key_get_label(const cw_key_t * key, char * label, size_t size);
+cw_ret_t cw_gen_start_with_sched(cw_gen_t * gen, cw_sched_t * sched);
 
 
 
 
-void cw_key_register_generator(volatile cw_key_t * key, cw_gen_t * gen);
-void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec);
+/* **************** Pool **************** */
+
+
+
+
+/*
+  Pool keeps generators, receivers and keys returned by client code,
+  and hands them out again instead of creating new ones. Objects are
+  reset (see cw_gen_reset(), cw_rec_reset(), cw_key_reset()) when they
+  are returned, and a generator keeps its memory, its sound device
+  and, if the pool has been created with 'start_gens' set, its
+  thread. Getting an object from a non-empty pool costs a few
+  microseconds.
+
+  All generators of a pool have the same configuration, given to
+  cw_pool_new(). Client code must not use an object after returning
+  it to the pool: put functions set client's pointer to NULL.
+*/
+enum { CW_POOL_CAPACITY_MAX = 1024 };
+
+cw_pool_t * cw_pool_new(const cw_gen_config_t * gen_conf, int capacity, bool start_gens);
+void        cw_pool_delete(cw_pool_t ** pool);
+void        cw_pool_get_counts(cw_pool_t * pool, int * n_gens, int * n_recs, int * n_keys);
+
+cw_gen_t * cw_pool_get_gen(cw_pool_t * pool);
+cw_ret_t   cw_pool_put_gen(cw_pool_t * pool, cw_gen_t ** gen);
+cw_rec_t * cw_pool_get_rec(cw_pool_t * pool);
+cw_ret_t   cw_pool_put_rec(cw_pool_t * pool, cw_rec_t ** rec);
+cw_key_t * cw_pool_get_key(cw_pool_t * pool);
+cw_ret_t   cw_pool_put_key(cw_pool_t * pool, cw_key_t ** key);
 
-void cw_key_ik_enable_curtis_mode_b(volatile cw_key_t * key);
-void cw_key_ik_disable_curtis_mode_b(volatile cw_key_t * key);
-bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t * key);
-cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value);
-cw_ret_t cw_key_ik_notify_dash_paddle_event(volatile cw_key_t * key, cw_key_value_t dash_paddle_value);
-cw_ret_t cw_key_ik_notify_dot_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value);
-void cw_key_ik_get_paddles(const volatile cw_key_t * key, cw_key_value_t * dot_paddle_value, cw_key_value_t * dash_paddle_value);
-cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key);
-cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key);
 
-cw_ret_t cw_key_sk_get_value(const volatile cw_key_t * key, cw_key_value_t * key_value);
-cw_ret_t cw_key_sk_set_value(volatile cw_key_t * key, cw_key_value_t key_value);
+
+
+/* **************** Shared tone queue **************** */
+
+
+
+
+/*
+  Shared tone queue lets one process (e.g. a daemon with real-time
+  priority and exclusive access to sound device and keying hardware)
+  play tones enqueued by other, unprivileged processes, without
+  sockets and without round-trips between the processes.
+
+  The daemon creates the queue for its generator with cw_shmq_new()
+  and starts it with cw_shmq_start(). The queue is a ring of tones in
+  POSIX shared memory (/dev/shm/<name>). Client process creates a
+  proxy generator with cw_gen_config_t::tq_shared_name set to the same
+  name, and uses it as any other generator: cw_gen_enqueue_character(),
+  cw_gen_enqueue_string(), cw_gen_wait_for_queue_level(),
+  cw_gen_flush_queue() etc. Tones are written by client directly into
+  shared memory; thread of the queue in the daemon moves them to
+  daemon's generator a few at a time, so that a flush from client
+  also drops tones that haven't been played yet. Many clients may
+  connect to one queue, their enqueues are serialized.
+
+  Processes wait for each other on futexes in the shared memory, so
+  the queue is available only on Linux. On other systems cw_shmq_new()
+  and creation of proxy generator fail with errno set to ENOSYS.
+
+  Access to the queue is controlled by permissions of the shared
+  memory object, created with mode 0666 modified by umask of the
+  daemon. Removing, skipping or locating characters and low water
+  callbacks of proxy generator work only on its local (always empty)
+  queue.
+
+  While the queue is started, the daemon should not enqueue tones to
+  its generator by itself.
+*/
+enum { CW_SHMQ_CAPACITY_MAX = 1000000 };
+
+cw_shmq_t * cw_shmq_new(cw_gen_t * gen, const char * name, int capacity);
+void        cw_shmq_delete(cw_shmq_t ** shmq);
+
+cw_ret_t    cw_shmq_start(cw_shmq_t * shmq);
+cw_ret_t    cw_shmq_stop(cw_shmq_t * shmq);
 
 
 
@@ -970,6 +2568,23 @@ void       cw_rec_delete(cw_rec_t ** rec);
 
 
 
+/**
+   @brief Prepare receiver for reuse
+
+   Bring receiver to the state of a freshly created receiver: its
+   parameters, state, statistics, averages, alphabet and label get
+   their initial values, output callback is unregistered, and
+   descriptor returned by cw_rec_get_event_fd() is closed.
+
+   Receiver must not be used by other threads during the reset.
+
+   @param[in] rec receiver to reset
+*/
+void cw_rec_reset(cw_rec_t * rec);
+
+
+
+
 /**
    @brief Set label (name) of given receiver instance
 
@@ -1088,9 +2703,531 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 /* Helper receive functions. */
 cw_ret_t cw_rec_poll_representation(cw_rec_t * rec, const struct timeval * timestamp, char * representation, bool * is_end_of_word, bool * is_error);
 
+
+
+
+/*
+  Variants of the receiver's functions that take timestamps as
+  nanoseconds of monotonic clock (clock_gettime(CLOCK_MONOTONIC)), e.g.
+  timestamps provided by sound or input subsystems. The clock is not
+  affected by changes of system time, so a jump of wall clock (e.g.
+  caused by NTP) can't break decoding of a character.
+
+  The timestamps can't be NULL/omitted: client code must always
+  provide them. Negative timestamp results in failure with errno set to
+  EINVAL. Don't mix calls to these functions with calls to their
+  struct timeval counterparts on the same receiver: the two kinds of
+  timestamps come from different clocks.
+*/
+cw_ret_t cw_rec_mark_begin_ns(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_mark_end_ns(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_add_mark_ns(cw_rec_t * rec, int64_t timestamp, char mark);
+cw_ret_t cw_rec_poll_representation_ns(cw_rec_t * rec, int64_t timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+cw_ret_t cw_rec_poll_character_ns(cw_rec_t * rec, int64_t timestamp, char * character, bool * is_end_of_word, bool * is_error);
+
+
+
+
+
+/*
+  Batch processing of a recorded timeline of key events, e.g. for
+  offline decoding of keying logs. cw_rec_process_events() feeds all
+  events to receiver in one pass, and reports decoded characters
+  through callback, without any calls to poll functions.
+
+  Timestamps of events are in nanoseconds (see cw_rec_*_ns()
+  functions above), and must not decrease. CW_REC_EVENT_POLL event
+  only tells receiver what time it is, without changing state of key:
+  put it at the end of timeline to receive the last character (and
+  inter-word-space) of the timeline.
+
+  A character split between two arrays of events is received
+  correctly: receiver keeps its state between calls.
+*/
+typedef enum {
+	CW_REC_EVENT_MARK_BEGIN,
+	CW_REC_EVENT_MARK_END,
+	CW_REC_EVENT_POLL
+} cw_rec_event_type_t;
+
+typedef struct {
+	cw_rec_event_type_t type;
+	int64_t timestamp; /* [ns] */
+} cw_rec_event_t;
+
+/* @p timestamp is a timestamp of end of last Mark of character [ns].
+   @p character is ' ' for inter-word-space. */
+typedef void (* cw_rec_output_callback_t)(void * callback_arg, int64_t timestamp, char character, bool is_error);
+
+cw_ret_t cw_rec_process_events(cw_rec_t * rec, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg);
+
+/*
+  Pull-style alternative to polling one character at a time:
+  cw_rec_poll_characters_ns() returns all characters (and
+  inter-word-spaces) that became final as of given time. After first
+  call of the function, receiver doesn't have to be polled between
+  characters: beginning of a Mark completes the previous character,
+  which waits in receiver for next call.
+*/
+typedef struct {
+	int64_t timestamp; /* End of last Mark of character [ns]. */
+	char character;    /* ' ' for inter-word-space. */
+	bool is_error;
+} cw_rec_output_t;
+
+cw_ret_t cw_rec_poll_characters_ns(cw_rec_t * rec, int64_t timestamp, cw_rec_output_t * outputs, size_t capacity, size_t * n_outputs);
+
+/*
+  Push-style alternative to polling: the callback is called by
+  receiver's own timer as soon as a character (or inter-word-space)
+  is complete, so client code can sleep until there is data. Pass
+  NULL to unregister.
+*/
+cw_ret_t cw_rec_register_output_callback(cw_rec_t * rec, cw_rec_output_callback_t callback_func, void * callback_arg);
+
+/*
+  Descriptor (Linux eventfd) that becomes readable when a character
+  (or inter-word-space) is complete, for event-driven main loops of
+  client code that poll the receiver. Returns -1 on failure.
+*/
+int cw_rec_get_event_fd(cw_rec_t * rec);
+
 void cw_rec_enable_adaptive_mode(cw_rec_t * rec);
 void cw_rec_disable_adaptive_mode(cw_rec_t * rec);
 
+/*
+  Snapshot of receiver's state: parameters, adaptive tracking of
+  speed, timing statistics and partially received representation, in
+  a portable byte format. Restoring a snapshot lets a receiver pick
+  up reception (or a known speed of a signal) where another receiver
+  left it, without re-adapting to the speed. Label, output callback
+  and event descriptor of a receiver are not part of the snapshot.
+*/
+enum { CW_REC_SNAPSHOT_SIZE_MAX = 2048 };
+
+cw_ret_t cw_rec_snapshot(cw_rec_t * rec, uint8_t * buffer, size_t size, size_t * n_bytes);
+cw_ret_t cw_rec_restore(cw_rec_t * rec, const uint8_t * buffer, size_t n_bytes);
+
+
+
+
+/* **************** Probabilistic decoder **************** */
+
+
+
+
+/*
+  Alternative to receiver for sloppy (e.g. hand-sent) or noisy timing
+  of Marks and Spaces. Instead of classifying each Mark and Space by
+  fixed ranges of durations, decoder keeps up to "beam width" most
+  likely interpretations of the whole sequence of Marks and Spaces
+  (Viterbi search over states of characters), and reports a character
+  when the interpretations agree on it. Work per Mark or Space is
+  bounded by beam width, and a character is reported at latest when
+  the word ends or when a few more characters have been keyed after
+  it.
+
+  Decoder takes the same timelines of key events as
+  cw_rec_process_events(), and reports characters through the same
+  callback. Speed of received Marks is tracked; speed set with
+  cw_viterbi_set_speed() is only the initial estimate.
+
+  Decoder isn't thread-safe: it should be used by one thread.
+*/
+
+/* Limits of count of paths (hypotheses) kept by decoder between
+   events. Work done per event is proportional to the count. */
+enum { CW_VITERBI_BEAM_WIDTH_MIN = 1 };
+enum { CW_VITERBI_BEAM_WIDTH_MAX = 32 };
+enum { CW_VITERBI_BEAM_WIDTH_INITIAL = 16 };
+
+cw_viterbi_t * cw_viterbi_new(void);
+void           cw_viterbi_delete(cw_viterbi_t ** vit);
+void           cw_viterbi_reset_state(cw_viterbi_t * vit);
+
+cw_ret_t cw_viterbi_set_speed(cw_viterbi_t * vit, int new_value);
+float    cw_viterbi_get_speed(const cw_viterbi_t * vit);
+cw_ret_t cw_viterbi_set_beam_width(cw_viterbi_t * vit, int new_value);
+cw_ret_t cw_viterbi_set_noise_spike_threshold(cw_viterbi_t * vit, int new_value);
+
+cw_ret_t cw_viterbi_process_events(cw_viterbi_t * vit, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg);
+
+
+
+
+/* **************** Ensemble decoding **************** */
+
+
+
+
+/*
+  Several decoders - receivers with different parameters (e.g.
+  tolerance, adaptive or fixed speed) and probabilistic decoders -
+  decoding one timeline of key events together. Events are checked
+  and cleaned up once (repeated beginnings or ends of Mark are
+  dropped), and then passed to all members in blocks.
+
+  Members report characters with timestamps of ends of their last
+  Marks, so characters of different members that end at the same
+  time can be compared. Ensemble reports text word by word: when a
+  majority (by weight) of members has reported an inter-word-space
+  at the same time, the words reported by members since the previous
+  such space are compared, and the word reported by the largest
+  weight of members wins. Ties go to the word with fewer errors, and
+  then to the member added first.
+
+  Members are owned by client code, and must not be used by client
+  code while they belong to ensemble. The ensemble takes the same
+  timelines and callback as cw_rec_process_events(), and isn't
+  thread-safe.
+*/
+
+enum { CW_ENSEMBLE_MEMBERS_MAX = 8 };
+
+cw_ensemble_t * cw_ensemble_new(void);
+void            cw_ensemble_delete(cw_ensemble_t ** ens);
+void            cw_ensemble_reset_state(cw_ensemble_t * ens);
+
+cw_ret_t cw_ensemble_add_receiver(cw_ensemble_t * ens, cw_rec_t * rec, int weight);
+cw_ret_t cw_ensemble_add_viterbi(cw_ensemble_t * ens, cw_viterbi_t * vit, int weight);
+
+cw_ret_t cw_ensemble_process_events(cw_ensemble_t * ens, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg);
+
+
+
+
+/* **************** Alphabets **************** */
+
+
+
+
+/*
+  Characters of alphabet (cw_alphabet_t) are Unicode code points.
+  Generator takes them from UTF-8 strings, and receiver returns them
+  as code points. Letters of alphabet take precedence over ASCII
+  characters of main table with the same representations (e.g. ".-"
+  is received as U+0410 CYRILLIC CAPITAL LETTER A in Cyrillic
+  alphabet), and all other ASCII characters of main table (digits,
+  punctuation, procedural characters) are still valid. Lowercase
+  letters are sent as uppercase ones.
+
+  Alphabets are compiled into constant lookup tables at build time,
+  so selecting alphabet of generator or receiver only selects tables.
+  Functions taking single-byte characters (cw_gen_enqueue_string(),
+  cw_rec_poll_character() etc.) are not affected by alphabet.
+*/
+
+const char * cw_alphabet_code_point_to_representation(cw_alphabet_t alphabet, uint32_t code_point);
+uint32_t cw_alphabet_representation_to_code_point(cw_alphabet_t alphabet, const char * representation);
+int cw_alphabet_get_character_count(cw_alphabet_t alphabet);
+
+cw_ret_t cw_gen_set_alphabet(cw_gen_t * gen, cw_alphabet_t alphabet);
+cw_alphabet_t cw_gen_get_alphabet(const cw_gen_t * gen);
+cw_ret_t cw_gen_enqueue_utf8_string(cw_gen_t * gen, const char * string);
+
+cw_ret_t cw_rec_set_alphabet(cw_rec_t * rec, cw_alphabet_t alphabet);
+cw_alphabet_t cw_rec_get_alphabet(const cw_rec_t * rec);
+cw_ret_t cw_rec_poll_code_point_ns(cw_rec_t * rec, int64_t timestamp, uint32_t * code_point, bool * is_end_of_word, bool * is_error);
+
+
+
+
+/* **************** Keying log **************** */
+
+
+
+
+/*
+  Keying log records changes of straight key, of paddles of iambic
+  keyer and of generator's value to a compact binary file, so that a
+  keying session can be replayed later, exactly as it was keyed.
+
+  File starts with 8 bytes of header ("CWKL", version of format, three
+  zero bytes). Each change is a single unsigned LEB128 varint:
+
+    bit 0:     1 if the change closes the key
+    bits 1-2:  source of change (cw_keylog_source_t)
+    bits 3-:   zigzag-encoded difference between timestamp of the
+               change and timestamp of previous change [us]
+
+  A change that follows previous one within 131 ms (i.e. most changes
+  of keying faster than 10 WPM) takes three bytes.
+
+  Changes of generator are recorded with time at which they are heard
+  (see cw_gen_register_timed_value_tracking_callback()), so they may
+  come slightly out of order with changes of key.
+
+  Keying log that is being replayed feeds changes of one source
+  (straight key or generator) to a receiver, either in real time or as
+  fast as possible (see cw_rec_process_events()). Characters
+  recognized by the receiver are passed to a callback.
+*/
+typedef enum {
+	CW_KEYLOG_SOURCE_STRAIGHT_KEY = 0,
+	CW_KEYLOG_SOURCE_DOT_PADDLE,
+	CW_KEYLOG_SOURCE_DASH_PADDLE,
+	CW_KEYLOG_SOURCE_GENERATOR
+} cw_keylog_source_t;
+
+typedef struct {
+	int64_t timestamp; /* [ns], with resolution of 1 us. */
+	cw_keylog_source_t source;
+	cw_key_value_t value;
+} cw_keylog_event_t;
+
+cw_keylog_t * cw_keylog_new_writer(const char * path);
+cw_keylog_t * cw_keylog_new_reader(const char * path);
+void          cw_keylog_delete(cw_keylog_t ** keylog);
+
+cw_ret_t cw_keylog_record(cw_keylog_t * keylog, cw_keylog_source_t source, cw_key_value_t value, int64_t timestamp);
+cw_ret_t cw_keylog_attach_key(cw_keylog_t * keylog, cw_key_t * key);
+cw_ret_t cw_keylog_attach_generator(cw_keylog_t * keylog, cw_gen_t * gen);
+cw_ret_t cw_keylog_flush(cw_keylog_t * keylog);
+
+cw_ret_t cw_keylog_read(cw_keylog_t * keylog, cw_keylog_event_t * event);
+cw_ret_t cw_keylog_replay(cw_keylog_t * keylog, cw_rec_t * rec, cw_keylog_source_t source, bool realtime, cw_rec_output_callback_t callback_func, void * callback_arg);
+
+
+
+
+/* **************** Tone detector **************** */
+
+
+
+
+/*
+  Tone detector finds marks and spaces of given tone in PCM sound
+  (mono, signed 16-bit samples), and passes beginnings and ends of
+  the marks, timestamped in nanoseconds, to a receiver. Receiver is
+  not owned by detector.
+
+  Poll the receiver for characters using cw_detector_get_timestamp()
+  as a timestamp of "now".
+*/
+cw_detector_t * cw_detector_new(int sample_rate, int frequency, cw_rec_t * rec);
+void            cw_detector_delete(cw_detector_t ** detector);
+void            cw_detector_reset(cw_detector_t * detector);
+
+cw_ret_t cw_detector_set_block_duration(cw_detector_t * detector, int block_duration);
+cw_ret_t cw_detector_set_thresholds(cw_detector_t * detector, int mark_threshold, int space_threshold);
+
+/*
+  Automatic frequency control: follow a tone that is up to 'range' Hz
+  away from detector's frequency (0 disables AFC). Frequency of the
+  tone, e.g. for reporting pitch of a polled character, is returned by
+  cw_detector_get_frequency().
+*/
+cw_ret_t cw_detector_set_afc_range(cw_detector_t * detector, int range);
+int      cw_detector_get_frequency(const cw_detector_t * detector);
+
+cw_ret_t cw_detector_process(cw_detector_t * detector, const int16_t * samples, size_t n_samples, int64_t timestamp);
+int64_t  cw_detector_get_timestamp(const cw_detector_t * detector);
+
+
+
+
+/* **************** Skimmer **************** */
+
+
+
+
+/*
+  Skimmer decodes all CW signals found in a passband of PCM sound (mono,
+  signed 16-bit samples). Each signal gets its own receiver working in
+  adaptive mode. Decoded characters are reported as events.
+*/
+typedef struct {
+	int frequency;     /* Frequency of signal [Hz]. */
+	int64_t timestamp; /* Time of detection of character [ns]. */
+	char character;    /* ' ' for inter-word-space. */
+	bool is_error;     /* Receiver couldn't recognize the character. */
+} cw_skimmer_event_t;
+
+cw_skimmer_t * cw_skimmer_new(int sample_rate, int low_frequency, int high_frequency, int n_workers);
+void           cw_skimmer_delete(cw_skimmer_t ** skimmer);
+
+cw_ret_t cw_skimmer_process(cw_skimmer_t * skimmer, const int16_t * samples, size_t n_samples, int64_t timestamp);
+int      cw_skimmer_get_events(cw_skimmer_t * skimmer, cw_skimmer_event_t * events, int capacity);
+int      cw_skimmer_get_n_channels(const cw_skimmer_t * skimmer);
+
+/*
+  CPU budget of skimmer. When processing of sound takes longer than
+  'budget' percent of duration of the sound, the skimmer first lowers
+  overlap of frames of its filterbank, then drops the weakest or least
+  confident channels and stops admitting new ones. The skimmer
+  recovers gradually when the load eases. There is no budget (zero)
+  by default.
+
+  Costs are times of processing per second of sound [us/s], averaged
+  over recent batches of frames.
+*/
+typedef struct {
+	int cost;            /* Total cost: filterbank and channels. */
+	int filterbank_cost;
+	int channels_cost;
+	int budget;          /* [us/s], zero if there is no budget. */
+	int overlap;         /* Overlap of frames of filterbank [%]. */
+	int channels_limit;  /* Max. count of channels admitted by skimmer. */
+	int n_dropped;       /* Count of channels dropped because of overload. */
+} cw_skimmer_load_t;
+
+typedef struct {
+	int frequency;       /* Frequency of channel's signal [Hz]. */
+	int cost;            /* [us/s] */
+} cw_skimmer_channel_cost_t;
+
+cw_ret_t cw_skimmer_set_cpu_budget(cw_skimmer_t * skimmer, int budget);
+void     cw_skimmer_get_load(const cw_skimmer_t * skimmer, cw_skimmer_load_t * load);
+int      cw_skimmer_get_channel_costs(const cw_skimmer_t * skimmer, cw_skimmer_channel_cost_t * costs, int capacity);
+
+
+
+
+/* **************** IQ front-end **************** */
+
+
+
+
+/*
+  IQ front-end receives CW signals directly from complex samples of SDR
+  receiver (interleaved I/Q, signed 16-bit). Each channel shifts its
+  signal to 0 Hz, decimates it (CIC + half-band filter) and passes its
+  envelope through a tone detector to a receiver. A skimmer can be fed
+  with real audio made from a part of IQ spectrum. Frequencies are
+  offsets from center of IQ spectrum. Receivers and skimmers are not
+  owned by front-end.
+
+  Poll receivers of channels for characters using cw_iq_get_timestamp()
+  as a timestamp of "now".
+*/
+cw_iq_t * cw_iq_new(int sample_rate, int decimation);
+void      cw_iq_delete(cw_iq_t ** iq);
+
+cw_ret_t cw_iq_add_channel(cw_iq_t * iq, int frequency, cw_rec_t * rec);
+cw_ret_t cw_iq_attach_skimmer(cw_iq_t * iq, int center_frequency, cw_skimmer_t * skimmer);
+int      cw_iq_get_output_sample_rate(const cw_iq_t * iq);
+
+cw_ret_t cw_iq_process(cw_iq_t * iq, const int16_t * iq_samples, size_t n_frames, int64_t timestamp);
+int64_t  cw_iq_get_timestamp(const cw_iq_t * iq);
+
+
+
+
+/* **************** Sound capture **************** */
+
+
+
+
+/*
+  Sound capture reads PCM sound (mono, signed 16-bit samples) from
+  ALSA or PulseAudio device (e.g. microphone, or line-out of radio),
+  or from a File (raw samples or WAV file written by CW_AUDIO_FILE
+  sound system; "-" is standard input). Samples are read in capture's
+  own thread, in small blocks of 'period_duration' microseconds (zero
+  means library's default, 5 ms), and every block is passed to
+  attached tone detector and then to registered callback.
+
+  @p timestamp of a block is a time of its first sample [ns] (see
+  cw_rec_mark_begin_ns()), compensated for samples still waiting in
+  buffer of sound device. Samples of File are timestamped as if they
+  were being captured, starting at time of cw_capture_new(), but they
+  are read as fast as possible.
+
+  Detector is called from capture's thread, so while capture is
+  running, only the receiver of detector (receiver is thread-safe) may
+  be used by client code. Use cw_rec_register_output_callback() or
+  poll the receiver with current time of monotonic clock.
+*/
+typedef void (* cw_capture_callback_t)(void * callback_arg, const int16_t * samples, size_t n_samples, int64_t timestamp);
+
+cw_capture_t * cw_capture_new(cw_sound_system_t sound_system, const char * device, int sample_rate, int period_duration);
+void           cw_capture_delete(cw_capture_t ** capture);
+
+int      cw_capture_get_sample_rate(const cw_capture_t * capture);
+cw_ret_t cw_capture_attach_detector(cw_capture_t * capture, cw_detector_t * detector);
+cw_ret_t cw_capture_register_callback(cw_capture_t * capture, cw_capture_callback_t callback_func, void * callback_arg);
+
+cw_ret_t cw_capture_start(cw_capture_t * capture);
+cw_ret_t cw_capture_stop(cw_capture_t * capture);
+bool     cw_capture_is_running(const cw_capture_t * capture);
+
+
+
+
+/* **************** Tracing **************** */
+
+
+
+
+/*
+  Tracing records events of library (enqueueing and dequeueing of
+  tones, writes to sound device, changes of value of keys,
+  identification of marks by receiver) with timestamps in nanoseconds
+  of library's monotonic clock. Every thread records into its own
+  fixed-size ring buffer, without locks; when a ring is full, oldest
+  records are overwritten. When tracing is disabled, cost of a trace
+  point is a single test of a flag.
+
+  Recorded events can be exported as JSON in Chrome's trace event
+  format, which can be viewed in chrome://tracing or in Perfetto UI.
+  Export is exact when tracing is disabled; during tracing the oldest
+  records of busy threads may be overwritten while being exported.
+
+  Client code can add its own events to the same timeline with
+  cw_trace_user_event(). They are exported as "user event <id>".
+*/
+void     cw_trace_enable(void);
+void     cw_trace_disable(void);
+bool     cw_trace_is_enabled(void);
+void     cw_trace_clear(void);
+void     cw_trace_user_event(int32_t id);
+cw_ret_t cw_trace_export_chrome_json(const char * path);
+
+
+
+
+/* **************** Metrics **************** */
+
+
+
+
+/*
+  Counters of all generators (with their tone queues), receivers and
+  keys existing in process, as text in Prometheus exposition format.
+  Objects are registered when they are created and unregistered when
+  they are deleted. Labels "gen", "rec" and "key" are unique numbers
+  of objects, label "label" is the object's label.
+
+  The counters are read without locks taken by threads of generators
+  and keys, so exporting them (even often) doesn't delay sound or
+  keying. The counters only grow (until the object is deleted or
+  reset); rates are up to the scraping side. Latencies are histograms
+  in seconds.
+
+  cw_metrics_write() works like snprintf(): it returns length of the
+  whole text, and writes at most @p size bytes (including terminating
+  NUL) to @p buffer.
+
+  Exporter of metrics serves the text over HTTP (GET of any path) to
+  one client at a time, from its own thread. @p address of
+  cw_metrics_bind() is "host:port", "[address]:port", ":port" (all
+  local addresses; port 0 picks a free port, see
+  cw_metrics_get_port()), or "unix:/path" for a Unix socket (e.g. for
+  "curl --unix-socket /path http://localhost/metrics"). The exporter
+  is available only on Linux. On other systems cw_metrics_new() fails
+  with errno set to ENOSYS.
+*/
+int cw_metrics_write(char * buffer, size_t size);
+
+cw_metrics_t * cw_metrics_new(void);
+void           cw_metrics_delete(cw_metrics_t ** metrics);
+
+cw_ret_t cw_metrics_bind(cw_metrics_t * metrics, const char * address);
+int      cw_metrics_get_port(const cw_metrics_t * metrics);
+
+cw_ret_t cw_metrics_start(cw_metrics_t * metrics);
+cw_ret_t cw_metrics_stop(cw_metrics_t * metrics);
+
 
 
 
@@ -27,13 +27,19 @@
 
 
 
+#include "config.h"
+
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 
 
 #include "libcw_alsa.h"
+#include "libcw_capture.h"
 #include "libcw_debug.h"
 #include "libcw_rec.h"
 
@@ -43,6 +49,16 @@
 #define MSG_PREFIX "libcw/alsa: "
 #define CW_ALSA_SW_PARAMS_CONFIG  0
 
+/* Count of periods in ring buffer of sound card. */
+#define CW_ALSA_N_PERIODS_DEFAULT    4
+#define CW_ALSA_N_PERIODS_AUTO_TUNE  2  /* Initial value in auto-tune mode. */
+#define CW_ALSA_N_PERIODS_MAX        8
+
+/* Parameters of auto-tune mode (cw_gen_config_t::alsa_target_latency). */
+#define CW_ALSA_AUTO_TUNE_PROBE_DURATION  200000 /* [microseconds] How long to test each configuration when sound device is opened. */
+#define CW_ALSA_AUTO_TUNE_MAX_ATTEMPTS    8      /* How many configurations to test when sound device is opened. */
+#define CW_ALSA_AUTO_TUNE_XRUNS_THRESHOLD 3      /* Count of underruns during playback after which the latency is increased. */
+
 
 
 
@@ -106,6 +122,7 @@ struct cw_alsa_handle_t {
 	int (* snd_pcm_drop)(snd_pcm_t * pcm);
 	int (* snd_pcm_drain)(snd_pcm_t * pcm);
 	snd_pcm_sframes_t (* snd_pcm_writei)(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size);
+	snd_pcm_sframes_t (* snd_pcm_readi)(snd_pcm_t * pcm, void * buffer, snd_pcm_uframes_t size); /* Used by sound capture. */
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
 	int (* snd_config_update_free_global)(void);
 #endif
@@ -116,6 +133,22 @@ struct cw_alsa_handle_t {
 
 
 
+	/* Functions used when samples are calculated directly in mmapped
+	   ring buffer of sound card (alsa_data.mmap == true). */
+	int (* snd_pcm_mmap_begin)(snd_pcm_t * pcm, const snd_pcm_channel_area_t ** areas, snd_pcm_uframes_t * offset, snd_pcm_uframes_t * frames);
+	snd_pcm_sframes_t (* snd_pcm_mmap_commit)(snd_pcm_t * pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+	snd_pcm_sframes_t (* snd_pcm_mmap_writei)(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size);
+	snd_pcm_sframes_t (* snd_pcm_avail_update)(snd_pcm_t * pcm);
+	snd_pcm_state_t (* snd_pcm_state)(snd_pcm_t * pcm);
+	int (* snd_pcm_start)(snd_pcm_t * pcm);
+	int (* snd_pcm_wait)(snd_pcm_t * pcm, int timeout);
+
+	/* Used to get latency of sound device (count of frames written
+	   but not yet played) for clocking of iambic keyer. */
+	int (* snd_pcm_delay)(snd_pcm_t * pcm, snd_pcm_sframes_t * delayp);
+
+
+
 	/* Allocate 'hw params' variable. */
 	int (* snd_pcm_hw_params_malloc)(snd_pcm_hw_params_t ** ptr);
 
@@ -130,6 +163,10 @@ struct cw_alsa_handle_t {
 	   configuration space and snd_pcm_prepare it."  */
 	int (* snd_pcm_hw_params)(snd_pcm_t * pcm, snd_pcm_hw_params_t * hw_params);
 
+	/* "Remove PCM hardware configuration and free associated
+	   resources". Used before installing new configuration. */
+	int (* snd_pcm_hw_free)(snd_pcm_t * pcm);
+
 
 
 	int (* snd_pcm_hw_params_set_format)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params, snd_pcm_format_t val);
@@ -185,6 +222,11 @@ struct cw_alsa_handle_t {
 	int (* snd_pcm_hw_params_get_rate_min)(const snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
 	int (* snd_pcm_hw_params_get_rate_max)(const snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
 
+	/* Enable or disable resampling done by alsa-lib (by "plug"
+	   plugin) when application asks for rate not supported by
+	   hardware. */
+	int (* snd_pcm_hw_params_set_rate_resample)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params, unsigned int val);
+
 
 
 #if CW_ALSA_SW_PARAMS_CONFIG
@@ -238,18 +280,32 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, const char * where);
 static void cw_alsa_test_hw_period_sizes(cw_gen_t * gen);
 static void cw_alsa_get_intended_period_size_internal(const cw_gen_t * gen, snd_pcm_uframes_t config_period_size, snd_pcm_uframes_t * intended_period_size);
+static cw_ret_t cw_alsa_reinstall_hw_params_internal(cw_gen_t * gen, snd_pcm_uframes_t period_size);
+static cw_ret_t cw_alsa_increase_latency_internal(cw_gen_t * gen, bool period_may_change);
+static int      cw_alsa_probe_xruns_internal(cw_gen_t * gen);
+static void     cw_alsa_auto_tune_internal(cw_gen_t * gen);
 
 #if CW_ALSA_SW_PARAMS_CONFIG
 static cw_ret_t cw_alsa_set_sw_params_internal(cw_gen_t * gen, snd_pcm_sw_params_t * sw_params);
 static void cw_alsa_print_sw_params_internal(snd_pcm_sw_params_t * sw_params, const char * where);
 #endif
 
+static cw_ret_t cw_alsa_load_library_internal(void);
 static int      cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle);
 static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_sample_t * cw_alsa_get_buffer_from_sound_device_internal(cw_gen_t * gen);
 static cw_ret_t cw_alsa_debug_evaluate_write_internal(cw_gen_t * gen, int snd_rv);
 static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void     cw_alsa_close_sound_device_internal(cw_gen_t * gen);
 static cw_ret_t cw_alsa_on_empty_queue(cw_gen_t * gen);
+static cw_ret_t cw_alsa_on_idle(cw_gen_t * gen);
+static cw_ret_t cw_alsa_on_resume(cw_gen_t * gen);
+static cw_ret_t cw_alsa_get_device_delay(cw_gen_t * gen, int64_t * delay);
+static void     cw_alsa_mmap_cancel_internal(cw_gen_t * gen);
+
+static cw_ret_t cw_alsa_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration);
+static void     cw_alsa_close_capture_internal(cw_capture_t * capture);
+static int      cw_alsa_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp);
 
 
 
@@ -287,18 +343,7 @@ bool cw_is_alsa_possible(const char * device_name)
 	   accessible on this machine, and this should not be logged as
 	   error. */
 
-	const char * library_name = "libasound.so.2";
-	if (CW_SUCCESS != cw_dlopen_internal(library_name, &cw_alsa.lib_handle)) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: can't access ALSA library '%s'", library_name);
-		return false;
-	}
-
-	int rv = cw_alsa_handle_load_internal(&cw_alsa);
-	if (0 != rv) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: failed to resolve ALSA symbol #%d, can't correctly load ALSA library", rv);
-		dlclose(cw_alsa.lib_handle);
+	if (CW_SUCCESS != cw_alsa_load_library_internal()) {
 		return false;
 	}
 
@@ -357,7 +402,11 @@ cw_ret_t cw_alsa_init_gen_internal(cw_gen_t * gen)
 	gen->open_and_configure_sound_device = cw_alsa_open_and_configure_sound_device_internal;
 	gen->close_sound_device              = cw_alsa_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_alsa_write_buffer_to_sound_device_internal;
+	gen->get_buffer_from_sound_device    = cw_alsa_get_buffer_from_sound_device_internal;
 	gen->on_empty_queue                  = cw_alsa_on_empty_queue;
+	gen->on_idle                         = cw_alsa_on_idle;
+	gen->on_resume                       = cw_alsa_on_resume;
+	gen->get_device_delay                = cw_alsa_get_device_delay;
 
 	return CW_SUCCESS;
 }
@@ -385,13 +434,37 @@ static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	   Size of correct and current data in the buffer is the same as
 	   ALSA's period, so there should be no underruns. TODO: write a
 	   check for this in this function. */
-	const int snd_rv = cw_alsa.snd_pcm_writei(gen->alsa_data.pcm_handle, gen->buffer, gen->buffer_n_samples);
+	int snd_rv = 0;
+	if (gen->alsa_data.mmap_in_progress) {
+		/* Samples have been calculated directly in ring buffer
+		   of sound card, we only need to tell ALSA about it. */
+		gen->alsa_data.mmap_in_progress = false;
+		snd_rv = (int) cw_alsa.snd_pcm_mmap_commit(gen->alsa_data.pcm_handle, gen->alsa_data.mmap_offset, gen->buffer_write_n_samples);
+		if (snd_rv > 0 && SND_PCM_STATE_PREPARED == cw_alsa.snd_pcm_state(gen->alsa_data.pcm_handle)) {
+			/* With mmap access the playback isn't started
+			   automatically on first commit. */
+			cw_alsa.snd_pcm_start(gen->alsa_data.pcm_handle);
+		}
+	} else if (gen->alsa_data.mmap) {
+		/* Sound card's memory was not available when generator
+		   started to calculate the samples (see
+		   cw_alsa_get_buffer_from_sound_device_internal()). */
+		snd_rv = (int) cw_alsa.snd_pcm_mmap_writei(gen->alsa_data.pcm_handle, cw_gen_frames_internal(gen), gen->buffer_write_n_samples);
+	} else {
+		snd_rv = (int) cw_alsa.snd_pcm_writei(gen->alsa_data.pcm_handle, cw_gen_frames_internal(gen), gen->buffer_write_n_samples);
+	}
 	const cw_ret_t cw_ret = cw_alsa_debug_evaluate_write_internal(gen, snd_rv);
 
+	snd_pcm_sframes_t delay = 0;
+	if (snd_rv > 0 && 0 == cw_alsa.snd_pcm_delay(gen->alsa_data.pcm_handle, &delay) && delay >= 0) {
+		/* Samples written so far but not yet heard by user. */
+		cw_gen_latency_set_sound_device_latency_internal(gen, (int64_t) delay * CW_USECS_PER_SEC / gen->sample_rate);
+	}
+
 #if 0
 	/* Verbose debug code. */
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
-		      MSG_PREFIX "write: written %d/%d samples", snd_rv, gen->buffer_n_samples);
+		      MSG_PREFIX "write: written %d/%d samples", snd_rv, gen->buffer_write_n_samples);
 #endif
 	return cw_ret;
 }
@@ -399,6 +472,90 @@ static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Get area of mmapped ring buffer of ALSA sound device, into which generator should calculate next buffer of samples
+
+   The function waits until there is at least one period of free space
+   in ring buffer of sound card. If the free space in the ring buffer
+   is not contiguous (the area would wrap around end of the buffer),
+   NULL is returned and samples will be calculated in gen->buffer and
+   copied by cw_alsa_write_buffer_to_sound_device_internal().
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+
+   @return pointer to memory of sound card for gen->buffer_n_samples samples
+   @return NULL if generator should use gen->buffer
+*/
+static cw_sample_t * cw_alsa_get_buffer_from_sound_device_internal(cw_gen_t * gen)
+{
+	if (!gen->alsa_data.mmap || NULL != gen->frames) {
+		/* Generator calculates mono 16-bit samples, interleaved
+		   samples of many channels or samples in other format
+		   are prepared separately in gen->frames. */
+		return NULL;
+	}
+
+	const snd_pcm_channel_area_t * areas = NULL;
+	snd_pcm_uframes_t offset = 0;
+	snd_pcm_uframes_t frames = gen->buffer_n_samples;
+
+	if (!gen->alsa_data.mmap_in_progress) {
+		while (true) {
+			const snd_pcm_sframes_t avail = cw_alsa.snd_pcm_avail_update(gen->alsa_data.pcm_handle);
+			if (avail < 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+					      MSG_PREFIX "mmap: avail update: %s / %ld", cw_alsa.snd_strerror((int) avail), (long) avail);
+				cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+				return NULL;
+			}
+			if (avail >= gen->buffer_n_samples) {
+				break;
+			}
+
+			if (SND_PCM_STATE_PREPARED == cw_alsa.snd_pcm_state(gen->alsa_data.pcm_handle)) {
+				/* Ring buffer is full, but playback has not been started yet. */
+				cw_alsa.snd_pcm_start(gen->alsa_data.pcm_handle);
+			} else {
+				const int snd_rv = cw_alsa.snd_pcm_wait(gen->alsa_data.pcm_handle, 1000);
+				if (snd_rv < 0) {
+					cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+						      MSG_PREFIX "mmap: wait: %s / %d", cw_alsa.snd_strerror(snd_rv), snd_rv);
+					cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+					return NULL;
+				}
+			}
+		}
+	}
+
+	/* When called with mmap already in progress, this returns the
+	   same area again. */
+	const int snd_rv = cw_alsa.snd_pcm_mmap_begin(gen->alsa_data.pcm_handle, &areas, &offset, &frames);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "mmap: begin: %s / %d", cw_alsa.snd_strerror(snd_rv), snd_rv);
+		return NULL;
+	}
+	if (frames < (snd_pcm_uframes_t) gen->buffer_n_samples
+	    || areas[0].step != 8 * sizeof (cw_sample_t)
+	    || areas[0].first % 8) {
+
+		/* Contiguous area is too small (it wraps around end
+		   of ring buffer), or layout of the area is not what
+		   we expect. Calculate the samples in gen->buffer,
+		   they will be written with snd_pcm_mmap_writei(). */
+		gen->alsa_data.mmap_in_progress = false;
+		return NULL;
+	}
+
+	gen->alsa_data.mmap_offset = offset;
+	gen->alsa_data.mmap_in_progress = true;
+
+	return (cw_sample_t *) ((uint8_t *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8);
+}
+
+
+
+
 /**
    @brief Open and configure ALSA handle stored in given generator
 
@@ -446,6 +603,12 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 		return CW_FAILURE;
 	}
 
+	gen->alsa_data.mmap = gen_conf->alsa_mmap;
+	gen->alsa_data.mmap_in_progress = false;
+	gen->alsa_data.auto_tune = 0 == gen_conf->alsa_period_size && 0 != gen_conf->alsa_target_latency;
+	gen->alsa_data.target_latency = gen_conf->alsa_target_latency;
+	gen->alsa_data.n_periods = gen->alsa_data.auto_tune ? CW_ALSA_N_PERIODS_AUTO_TUNE : CW_ALSA_N_PERIODS_DEFAULT;
+	gen->alsa_data.n_xruns = 0;
 	if (CW_SUCCESS != cw_alsa_set_hw_params_internal(gen, hw_params, gen_conf->alsa_period_size)) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: can't set ALSA hw params");
@@ -488,6 +651,11 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 		gen->buffer_n_samples = period_size;
 	}
 
+	if (gen->alsa_data.auto_tune) {
+		/* This may modify gen->buffer_n_samples. */
+		cw_alsa_auto_tune_internal(gen);
+	}
+
 #if CW_DEV_RAW_SINK
 	gen->dev_raw_sink = open("/tmp/cw_file.alsa.raw",
 				 O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK,
@@ -556,6 +724,8 @@ static cw_ret_t cw_alsa_on_empty_queue(cw_gen_t * gen)
 {
 	int snd_rv = 0;
 
+	cw_alsa_mmap_cancel_internal(gen);
+
 	snd_rv = cw_alsa.snd_pcm_drain(gen->alsa_data.pcm_handle);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
@@ -579,6 +749,109 @@ static cw_ret_t cw_alsa_on_empty_queue(cw_gen_t * gen)
 
 
 
+/**
+   @brief Stop ALSA PCM when generator enters idle mode
+
+   Samples that are already in ring buffer are played, and then the
+   PCM is left stopped (in SETUP state), so that sound card doesn't
+   run until cw_alsa_on_resume() is called.
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_on_idle(cw_gen_t * gen)
+{
+	cw_alsa_mmap_cancel_internal(gen);
+
+	const int snd_rv = cw_alsa.snd_pcm_drain(gen->alsa_data.pcm_handle);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "idle: drain() returns error: %s/%d",
+			      cw_alsa.snd_strerror(snd_rv), snd_rv);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Prepare ALSA PCM stopped by cw_alsa_on_idle() for new samples
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_on_resume(cw_gen_t * gen)
+{
+	const int snd_rv = cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "resume: prepare() returns error: %s/%d",
+			      cw_alsa.snd_strerror(snd_rv), snd_rv);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get current delay of ALSA PCM
+
+   snd_pcm_delay() fails when PCM is not running: after underrun, or
+   when it has been stopped in idle mode. Nothing is waiting to be
+   played then, so the delay is zero.
+
+   @param[in] gen generator with opened ALSA PCM handle
+   @param[out] delay delay of PCM [microseconds]
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t cw_alsa_get_device_delay(cw_gen_t * gen, int64_t * delay)
+{
+	snd_pcm_sframes_t n_frames = 0;
+	if (0 != cw_alsa.snd_pcm_delay(gen->alsa_data.pcm_handle, &n_frames) || n_frames < 0) {
+		n_frames = 0;
+	}
+	*delay = (int64_t) n_frames * CW_USECS_PER_SEC / gen->sample_rate;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop calculating samples in mmapped ring buffer of sound card
+
+   Generator may have calculated some samples of current buffer in
+   ring buffer of sound card. Drain/prepare will invalidate the area,
+   so move the samples to generator's own buffer.
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+*/
+static void cw_alsa_mmap_cancel_internal(cw_gen_t * gen)
+{
+	if (gen->alsa_data.mmap_in_progress) {
+		memcpy(gen->buffer, gen->buffer_target, gen->buffer_sub_start * sizeof (cw_sample_t));
+		gen->buffer_target = gen->buffer;
+		gen->alsa_data.mmap_in_progress = false;
+	}
+
+	return;
+}
+
+
+
+
 /**
    @brief Handle value returned by ALSA's write function (snd_pcm_writei())
 
@@ -600,18 +873,32 @@ static cw_ret_t cw_alsa_debug_evaluate_write_internal(cw_gen_t * gen, int snd_rv
 	if (snd_rv == -EPIPE) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "write: underrun");
-		cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+		cw_gen_stats_add_xruns_internal(gen, 1);
+		if (gen->alsa_data.auto_tune
+		    && ++gen->alsa_data.n_xruns >= CW_ALSA_AUTO_TUNE_XRUNS_THRESHOLD) {
+
+			/* Current configuration can't be sustained.
+			   Size of generator's buffer can't change at this
+			   point, so only count of periods is increased. */
+			cw_alsa_increase_latency_internal(gen, false);
+		}
+		if (0 == cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle)) { /* Reset sound sink. */
+			cw_gen_stats_add_recovery_internal(gen);
+		}
 		return CW_FAILURE;
 
 	} else if (snd_rv < 0) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "write: writei: %s / %d", cw_alsa.snd_strerror(snd_rv), snd_rv);
-		cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+		if (0 == cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle)) { /* Reset sound sink. */
+			cw_gen_stats_add_recovery_internal(gen);
+		}
 		return CW_FAILURE;
 
-	} else if (snd_rv != gen->buffer_n_samples) {
+	} else if (snd_rv != gen->buffer_write_n_samples) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
-			      MSG_PREFIX "short write, expected to write %d bytes, written %d bytes", gen->buffer_n_samples, snd_rv);
+			      MSG_PREFIX "short write, expected to write %d bytes, written %d bytes", gen->buffer_write_n_samples, snd_rv);
+		cw_gen_stats_add_short_write_internal(gen, snd_rv);
 		return CW_FAILURE;
 	} else {
 		return CW_SUCCESS;
@@ -652,7 +939,20 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 
 
 	/* Set the sample format */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_format(gen->alsa_data.pcm_handle, hw_params, CW_ALSA_SAMPLE_FORMAT);
+	snd_pcm_format_t format = CW_ALSA_SAMPLE_FORMAT;
+	switch (gen->sample_format) {
+	case CW_SAMPLE_FORMAT_S32:
+		format = SND_PCM_FORMAT_S32;
+		break;
+	case CW_SAMPLE_FORMAT_FLOAT:
+		format = SND_PCM_FORMAT_FLOAT;
+		break;
+	case CW_SAMPLE_FORMAT_S16:
+	default:
+		format = CW_ALSA_SAMPLE_FORMAT;
+		break;
+	}
+	snd_rv = cw_alsa.snd_pcm_hw_params_set_format(gen->alsa_data.pcm_handle, hw_params, format);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "set hw params: can't set sample format: %s", cw_alsa.snd_strerror(snd_rv));
@@ -661,7 +961,17 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 
 
 	/* Set PCM access type */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_access(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (gen->alsa_data.mmap) {
+		snd_rv = cw_alsa.snd_pcm_hw_params_set_access(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+		if (0 != snd_rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "set hw params: can't set mmap access type, falling back to regular access: %s", cw_alsa.snd_strerror(snd_rv));
+			gen->alsa_data.mmap = false;
+		}
+	}
+	if (!gen->alsa_data.mmap) {
+		snd_rv = cw_alsa.snd_pcm_hw_params_set_access(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	}
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "set hw params: can't set access type: %s", cw_alsa.snd_strerror(snd_rv));
@@ -669,7 +979,7 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 	}
 
 	/* Set number of channels */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_channels(gen->alsa_data.pcm_handle, hw_params, CW_AUDIO_CHANNELS);
+	snd_rv = cw_alsa.snd_pcm_hw_params_set_channels(gen->alsa_data.pcm_handle, hw_params, (unsigned int) gen->n_sound_channels);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "set hw params: can't set number of channels: %s", cw_alsa.snd_strerror(snd_rv));
@@ -780,6 +1090,15 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
    Function sets sample rate in @p hw_params, and also sets it in given @p
    gen.
 
+   The function prefers sample rates that are native to the device:
+   resampling done by alsa-lib is disabled for the time of selecting the
+   rate, so that snd_pcm_hw_params_set_rate_near() can return only rates
+   supported by hardware. The generator then synthesizes samples directly at
+   that rate, and no CPU time or latency is spent on conversion of rate of
+   samples. Only if the device doesn't support any of rates from
+   cw_supported_sample_rates[], the resampling is enabled again and the
+   selection is repeated.
+
    @param[in] gen generator with opened ALSA PCM handle, for which HW parameters should be configured
    @param[in] hw_params allocated hw params data structure to be used by this function
 
@@ -795,26 +1114,37 @@ static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_p
 	bool success = false;
 	int snd_rv = 0;
 
-	/* Start from high sample rate. For some reason trying to set a lower
-	   rate first resulted in problems with these two tests:
-	    - test_cw_gen_state_callback
-	    - test_cw_gen_forever_internal
+	/* First pass: only rates native to the device. Second pass:
+	   any rate, with resampling done by alsa-lib. */
+	for (unsigned int resample = 0; resample <= 1 && !success; resample++) {
+		snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_resample(gen->alsa_data.pcm_handle, hw_params, resample);
+		if (0 != snd_rv) {
+			/* Not fatal, the rate may be still found. */
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "set hw params: can't set rate resampling to %u: %s", resample, cw_alsa.snd_strerror(snd_rv));
+		}
 
-	   On the other hand lower sample rates seems to mean wider range of
-	   supported period sizes. */
-	for (int i = 0; cw_supported_sample_rates[i]; i++) {
-		unsigned int rate = cw_supported_sample_rates[i];
-		int dir = 0; /* Reset to zero before each ALSA API call. */
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_near(gen->alsa_data.pcm_handle, hw_params, &rate, &dir);
-		if (0 == snd_rv) {
-			if (rate != cw_supported_sample_rates[i]) {
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "imprecise sample rate:");
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "asked for: %u", cw_supported_sample_rates[i]);
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "got:       %u", rate);
+		/* Start from high sample rate. For some reason trying to set a lower
+		   rate first resulted in problems with these two tests:
+		   - test_cw_gen_state_callback
+		   - test_cw_gen_forever_internal
+
+		   On the other hand lower sample rates seems to mean wider range of
+		   supported period sizes. */
+		for (int i = 0; cw_supported_sample_rates[i]; i++) {
+			unsigned int rate = cw_supported_sample_rates[i];
+			int dir = 0; /* Reset to zero before each ALSA API call. */
+			snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_near(gen->alsa_data.pcm_handle, hw_params, &rate, &dir);
+			if (0 == snd_rv) {
+				if (rate != cw_supported_sample_rates[i]) {
+					cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "imprecise sample rate:");
+					cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "asked for: %u", cw_supported_sample_rates[i]);
+					cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "got:       %u", rate);
+				}
+				success = true;
+				gen->sample_rate = rate;
+				break;
 			}
-			success = true;
-			gen->sample_rate = rate;
-			break;
 		}
 	}
 
@@ -953,8 +1283,11 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 	  Initially it was set to 3, but that produced too many ALSA
 	  buffer underruns on my oldest test machine. Changing to 2
 	  made things worse. Increasing it to 4 improved situation.
+
+	  In auto-tune mode the count starts at 2, and is increased only
+	  if underruns are detected.
 	*/
-	const int n_periods = 4;
+	const unsigned int n_periods = gen->alsa_data.n_periods;
 	snd_pcm_uframes_t intended_buffer_size = actual_period_size * n_periods;
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "Will try to set intended buffer size %lu", intended_buffer_size);
@@ -972,7 +1305,7 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 	cw_alsa.snd_pcm_hw_params_set_periods(gen->alsa_data.pcm_handle, hw_params, n_periods, dir);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't set periods: %s / %d", cw_alsa.snd_strerror(snd_rv), n_periods);
+			      MSG_PREFIX "set hw params: can't set periods: %s / %u", cw_alsa.snd_strerror(snd_rv), n_periods);
 		return CW_FAILURE;
 	}
 
@@ -1175,6 +1508,38 @@ static void cw_alsa_print_sw_params_internal(snd_pcm_sw_params_t * sw_params, co
 
 
 
+/**
+   @brief Open ALSA library and resolve its symbols
+
+   On success library handle and function symbols are stored in global
+   cw_alsa variable.
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_alsa_load_library_internal(void)
+{
+	const char * library_name = "libasound.so.2";
+	if (CW_SUCCESS != cw_dlopen_internal(library_name, &cw_alsa.lib_handle)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "load library: can't access ALSA library '%s'", library_name);
+		return CW_FAILURE;
+	}
+
+	int rv = cw_alsa_handle_load_internal(&cw_alsa);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "load library: failed to resolve ALSA symbol #%d, can't correctly load ALSA library", rv);
+		dlclose(cw_alsa.lib_handle);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Resolve/get symbols from ALSA library
 
@@ -1206,6 +1571,8 @@ static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 	if (!alsa_handle->snd_pcm_drain)           return -(__LINE__);
 	*(void **) &(alsa_handle->snd_pcm_writei)  = dlsym(alsa_handle->lib_handle, "snd_pcm_writei");
 	if (!alsa_handle->snd_pcm_writei)          return -5;
+	*(void **) &(alsa_handle->snd_pcm_readi)   = dlsym(alsa_handle->lib_handle, "snd_pcm_readi");
+	if (!alsa_handle->snd_pcm_readi)           return -(__LINE__);
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
 	*(void **) &(alsa_handle->snd_config_update_free_global)  = dlsym(alsa_handle->lib_handle, "snd_config_update_free_global");
 	if (!alsa_handle->snd_config_update_free_global)          return -6;
@@ -1214,6 +1581,23 @@ static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 	*(void **) &(alsa_handle->snd_strerror) = dlsym(alsa_handle->lib_handle, "snd_strerror");
 	if (!alsa_handle->snd_strerror)         return -10;
 
+	*(void **) &(alsa_handle->snd_pcm_mmap_begin)   = dlsym(alsa_handle->lib_handle, "snd_pcm_mmap_begin");
+	if (!alsa_handle->snd_pcm_mmap_begin)           return -11;
+	*(void **) &(alsa_handle->snd_pcm_mmap_commit)  = dlsym(alsa_handle->lib_handle, "snd_pcm_mmap_commit");
+	if (!alsa_handle->snd_pcm_mmap_commit)          return -12;
+	*(void **) &(alsa_handle->snd_pcm_mmap_writei)  = dlsym(alsa_handle->lib_handle, "snd_pcm_mmap_writei");
+	if (!alsa_handle->snd_pcm_mmap_writei)          return -13;
+	*(void **) &(alsa_handle->snd_pcm_avail_update) = dlsym(alsa_handle->lib_handle, "snd_pcm_avail_update");
+	if (!alsa_handle->snd_pcm_avail_update)         return -14;
+	*(void **) &(alsa_handle->snd_pcm_state)        = dlsym(alsa_handle->lib_handle, "snd_pcm_state");
+	if (!alsa_handle->snd_pcm_state)                return -15;
+	*(void **) &(alsa_handle->snd_pcm_start)        = dlsym(alsa_handle->lib_handle, "snd_pcm_start");
+	if (!alsa_handle->snd_pcm_start)                return -16;
+	*(void **) &(alsa_handle->snd_pcm_wait)         = dlsym(alsa_handle->lib_handle, "snd_pcm_wait");
+	if (!alsa_handle->snd_pcm_wait)                 return -17;
+	*(void **) &(alsa_handle->snd_pcm_delay)        = dlsym(alsa_handle->lib_handle, "snd_pcm_delay");
+	if (!alsa_handle->snd_pcm_delay)                return -18;
+
 	*(void **) &(alsa_handle->snd_pcm_hw_params_malloc) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_malloc");
 	if (!alsa_handle->snd_pcm_hw_params_malloc)         return -20;
 	*(void **) &(alsa_handle->snd_pcm_hw_params_free)   = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_free");
@@ -1222,6 +1606,8 @@ static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 	if (!alsa_handle->snd_pcm_hw_params_any)            return -22;
 	*(void **) &(alsa_handle->snd_pcm_hw_params)        = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params");
 	if (!alsa_handle->snd_pcm_hw_params)                return -23;
+	*(void **) &(alsa_handle->snd_pcm_hw_free)          = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_free");
+	if (!alsa_handle->snd_pcm_hw_free)                  return -24;
 
 	*(void **) &(alsa_handle->snd_pcm_hw_params_set_format)   = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_format");
 	if (!alsa_handle->snd_pcm_hw_params_set_format)           return -31;
@@ -1271,6 +1657,8 @@ static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 	if (!alsa_handle->snd_pcm_hw_params_get_rate_min)          return -62;
 	*(void **) &(alsa_handle->snd_pcm_hw_params_get_rate_max)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_rate_max");
 	if (!alsa_handle->snd_pcm_hw_params_get_rate_max)          return -63;
+	*(void **) &(alsa_handle->snd_pcm_hw_params_set_rate_resample) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_rate_resample");
+	if (!alsa_handle->snd_pcm_hw_params_set_rate_resample)         return -64;
 
 
 #if CW_ALSA_SW_PARAMS_CONFIG
@@ -1318,7 +1706,9 @@ void cw_alsa_drop_internal(cw_gen_t * gen)
    @brief Calculate period size that we would like to try to set in ALSA
 
    If @p config_period_size is zero, the function will try to calculate the
-   period size using duration of a shortest possible dot as basis.
+   period size using duration of a shortest possible dot as basis. In
+   auto-tune mode the period size is calculated from target latency and
+   current count of periods in ring buffer.
 
    If @p config_period_size is not zero (i.e. client code requested specific
    period size), the value will be used instead.
@@ -1334,7 +1724,19 @@ void cw_alsa_drop_internal(cw_gen_t * gen)
 */
 static void cw_alsa_get_intended_period_size_internal(const cw_gen_t * gen, snd_pcm_uframes_t config_period_size, snd_pcm_uframes_t * intended_period_size)
 {
-	if (0 == config_period_size) {
+	if (0 == config_period_size && gen->alsa_data.auto_tune) {
+		/* Ring buffer of sound card should hold samples for
+		   duration equal to target latency. */
+		const uint64_t n_frames = (uint64_t) gen->sample_rate * gen->alsa_data.target_latency / 1000000;
+		*intended_period_size = n_frames / gen->alsa_data.n_periods;
+		if (0 == *intended_period_size) {
+			*intended_period_size = 1;
+		}
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "auto-tune: intended period size for target latency %u [us] = %lu [samples]",
+			      gen->alsa_data.target_latency, *intended_period_size);
+
+	} else if (0 == config_period_size) {
 		/* Period size has not been specified in config or command
 		   line. Calculate it. */
 
@@ -1374,6 +1776,411 @@ static void cw_alsa_get_intended_period_size_internal(const cw_gen_t * gen, snd_
 
 
 
+/**
+   @brief Install new hw parameters in ALSA PCM handle of generator
+
+   Whole configuration is done again, with current count of periods
+   (gen->alsa_data.n_periods) and with given @p period_size. Pending
+   samples are dropped. Period size that has been really configured is
+   saved in gen->buffer_n_samples.
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+   @param[in] period_size period size that we would like to have configured
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_reinstall_hw_params_internal(cw_gen_t * gen, snd_pcm_uframes_t period_size)
+{
+	cw_alsa.snd_pcm_drop(gen->alsa_data.pcm_handle);
+	cw_alsa.snd_pcm_hw_free(gen->alsa_data.pcm_handle);
+
+	snd_pcm_hw_params_t * hw_params = NULL;
+	int snd_rv = cw_alsa.snd_pcm_hw_params_malloc(&hw_params);
+	if (0 != snd_rv || NULL == hw_params) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reinstall: can't allocate memory for ALSA hw params: %s", cw_alsa.snd_strerror(snd_rv));
+		return CW_FAILURE;
+	}
+
+	if (CW_SUCCESS != cw_alsa_set_hw_params_internal(gen, hw_params, period_size)) {
+		cw_alsa.snd_pcm_hw_params_free(hw_params);
+		return CW_FAILURE;
+	}
+
+	snd_pcm_uframes_t actual_period_size = 0;
+	int dir = 0;
+	snd_rv = cw_alsa.snd_pcm_hw_params_get_period_size(hw_params, &actual_period_size, &dir);
+	cw_alsa.snd_pcm_hw_params_free(hw_params);
+	/* See comment in cw_alsa_open_and_configure_sound_device_internal(). */
+	gen->buffer_n_samples = snd_rv > 1 ? snd_rv : (int) actual_period_size;
+
+	snd_rv = cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reinstall: can't prepare ALSA handler: %s", cw_alsa.snd_strerror(snd_rv));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Reconfigure ALSA PCM handle of generator to have larger latency
+
+   First the count of periods in ring buffer is increased. If it has
+   already reached its maximum and @p period_may_change is true, the
+   period size is doubled instead.
+
+   Period size must not change once generator's buffer has been
+   allocated, so during playback @p period_may_change must be false.
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+   @param[in] period_may_change whether period size may be changed
+
+   @return CW_SUCCESS if latency has been increased
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_increase_latency_internal(cw_gen_t * gen, bool period_may_change)
+{
+	const unsigned int old_n_periods = gen->alsa_data.n_periods;
+	const int old_period_size = gen->buffer_n_samples;
+	snd_pcm_uframes_t period_size = (snd_pcm_uframes_t) old_period_size;
+
+	if (gen->alsa_data.n_periods < CW_ALSA_N_PERIODS_MAX) {
+		gen->alsa_data.n_periods++;
+	} else if (period_may_change) {
+		gen->alsa_data.n_periods = CW_ALSA_N_PERIODS_AUTO_TUNE;
+		period_size *= 2;
+	} else {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "auto-tune: can't increase latency any further");
+		return CW_FAILURE;
+	}
+	gen->alsa_data.n_xruns = 0;
+
+	cw_ret_t cwret = cw_alsa_reinstall_hw_params_internal(gen, period_size);
+	if (CW_SUCCESS == cwret && !period_may_change && gen->buffer_n_samples != old_period_size) {
+		/* ALSA has changed period size behind our back. */
+		cwret = CW_FAILURE;
+	}
+
+	if (CW_SUCCESS != cwret) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "auto-tune: failed to increase latency, restoring previous configuration");
+		gen->alsa_data.n_periods = old_n_periods;
+		cw_alsa_reinstall_hw_params_internal(gen, (snd_pcm_uframes_t) old_period_size);
+		return CW_FAILURE;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "auto-tune: period size = %d, periods = %u, latency = %"PRIu64" [us]",
+		      gen->buffer_n_samples, gen->alsa_data.n_periods,
+		      (uint64_t) gen->buffer_n_samples * gen->alsa_data.n_periods * 1000000 / gen->sample_rate);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Play silence with current configuration of ALSA PCM handle, count underruns
+
+   Silence is played for CW_ALSA_AUTO_TUNE_PROBE_DURATION microseconds
+   (plus the time needed to fill ring buffer). Samples remaining in
+   ring buffer are dropped afterwards.
+
+   @param[in/out] gen generator with opened and prepared ALSA PCM handle
+
+   @return count of underruns (or other write errors)
+*/
+static int cw_alsa_probe_xruns_internal(cw_gen_t * gen)
+{
+	/* Zero bytes are silence in all sample formats. */
+	void * silence = calloc((size_t) gen->buffer_n_samples * (size_t) gen->n_sound_channels, gen->sample_size);
+	if (NULL == silence) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return 0;
+	}
+
+	const uint64_t n_writes = (uint64_t) gen->sample_rate * CW_ALSA_AUTO_TUNE_PROBE_DURATION / 1000000 / gen->buffer_n_samples
+		+ gen->alsa_data.n_periods;
+	int n_xruns = 0;
+	for (uint64_t i = 0; i < n_writes; i++) {
+		snd_pcm_sframes_t snd_rv = 0;
+		if (gen->alsa_data.mmap) {
+			snd_rv = cw_alsa.snd_pcm_mmap_writei(gen->alsa_data.pcm_handle, silence, gen->buffer_n_samples);
+		} else {
+			snd_rv = cw_alsa.snd_pcm_writei(gen->alsa_data.pcm_handle, silence, gen->buffer_n_samples);
+		}
+		if (snd_rv < 0) {
+			n_xruns++;
+			cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+		}
+	}
+	free(silence);
+
+	/* Don't let the silence delay first real samples. */
+	cw_alsa.snd_pcm_drop(gen->alsa_data.pcm_handle);
+	cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+
+	return n_xruns;
+}
+
+
+
+
+/**
+   @brief Find smallest configuration of ALSA PCM handle that can be used without underruns
+
+   Starting with configuration based on target latency, test the
+   configuration with cw_alsa_probe_xruns_internal() and increase the
+   latency until no underruns are detected, or until count of attempts
+   reaches CW_ALSA_AUTO_TUNE_MAX_ATTEMPTS. Last tested configuration
+   is left installed.
+
+   Function may modify gen->buffer_n_samples, so it must be called
+   before generator's buffer is allocated.
+
+   @param[in/out] gen generator with opened ALSA PCM handle
+*/
+static void cw_alsa_auto_tune_internal(cw_gen_t * gen)
+{
+	for (int attempt = 0; attempt < CW_ALSA_AUTO_TUNE_MAX_ATTEMPTS; attempt++) {
+		const int n_xruns = cw_alsa_probe_xruns_internal(gen);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "auto-tune: period size = %d, periods = %u: %d underruns",
+			      gen->buffer_n_samples, gen->alsa_data.n_periods, n_xruns);
+		if (0 == n_xruns) {
+			return;
+		}
+		if (CW_SUCCESS != cw_alsa_increase_latency_internal(gen, true)) {
+			break;
+		}
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+		      MSG_PREFIX "auto-tune: failed to find configuration without underruns, using period size = %d, periods = %u",
+		      gen->buffer_n_samples, gen->alsa_data.n_periods);
+	return;
+}
+
+
+
+
+/**
+   @brief Configure given @p capture variable to capture sound from ALSA device
+
+   @param[in,out] capture capture structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_alsa_init_capture_internal(cw_capture_t * capture)
+{
+	capture->sound_system = CW_AUDIO_ALSA;
+	capture->open_device  = cw_alsa_open_capture_internal;
+	capture->close_device = cw_alsa_close_capture_internal;
+	capture->read_device  = cw_alsa_read_capture_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Open and configure ALSA PCM handle for capture
+
+   Ring buffer of sound card is configured to hold CW_CAPTURE_N_PERIODS
+   periods of @p period_duration each, so that samples can be read
+   soon after they have been captured. ALSA may configure sample rate
+   and period size slightly different than requested.
+
+   Capturing is started by first read (default start threshold of
+   capture stream), so ring buffer doesn't overflow between opening of
+   device and start of capture's thread.
+
+   @param[in,out] capture capture with picked device name
+   @param[in] sample_rate requested sample rate
+   @param[in] period_duration requested duration of period [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_alsa_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration)
+{
+	if (CW_SUCCESS != cw_alsa_load_library_internal()) {
+		return CW_FAILURE;
+	}
+
+	int snd_rv = cw_alsa.snd_pcm_open(&capture->alsa_pcm_handle,
+					  capture->picked_device_name, /* name */
+					  SND_PCM_STREAM_CAPTURE,      /* stream (playback/capture) */
+					  0);                          /* mode, 0 | SND_PCM_NONBLOCK | SND_PCM_ASYNC */
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open capture: can't open ALSA device '%s': %s", capture->picked_device_name, cw_alsa.snd_strerror(snd_rv));
+		capture->alsa_pcm_handle = NULL;
+		dlclose(cw_alsa.lib_handle);
+		return CW_FAILURE;
+	}
+
+	snd_pcm_hw_params_t * hw_params = NULL;
+	snd_rv = cw_alsa.snd_pcm_hw_params_malloc(&hw_params);
+	if (0 != snd_rv || NULL == hw_params) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open capture: can't allocate memory for ALSA hw params: %s", cw_alsa.snd_strerror(snd_rv));
+		cw_alsa_close_capture_internal(capture);
+		return CW_FAILURE;
+	}
+
+	unsigned int rate = (unsigned int) sample_rate;
+	snd_pcm_uframes_t period_size = (snd_pcm_uframes_t) ((uint64_t) rate * (uint64_t) period_duration / CW_USECS_PER_SEC);
+	if (0 == period_size) {
+		period_size = 1;
+	}
+	snd_pcm_uframes_t buffer_size = period_size * CW_CAPTURE_N_PERIODS;
+	int dir = 0;
+
+	const char * step = NULL;
+	if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_any(capture->alsa_pcm_handle, hw_params))) {
+		step = "get configuration space";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_access(capture->alsa_pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED))) {
+		step = "set access";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_format(capture->alsa_pcm_handle, hw_params, CW_ALSA_SAMPLE_FORMAT))) {
+		step = "set sample format";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_channels(capture->alsa_pcm_handle, hw_params, 1))) {
+		step = "set count of channels";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_near(capture->alsa_pcm_handle, hw_params, &rate, &dir))) {
+		step = "set sample rate";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_period_size_near(capture->alsa_pcm_handle, hw_params, &period_size, &dir))) {
+		step = "set period size";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params_set_buffer_size_near(capture->alsa_pcm_handle, hw_params, &buffer_size))) {
+		step = "set buffer size";
+	} else if (0 != (snd_rv = cw_alsa.snd_pcm_hw_params(capture->alsa_pcm_handle, hw_params))) {
+		step = "install hw params";
+	} else {
+		/* See comment about old version of get_period_size() in
+		   cw_alsa_open_and_configure_sound_device_internal(). */
+		snd_rv = cw_alsa.snd_pcm_hw_params_get_period_size(hw_params, &period_size, &dir);
+		if (snd_rv > 1) {
+			period_size = (snd_pcm_uframes_t) snd_rv;
+		}
+		cw_alsa.snd_pcm_hw_params_get_rate(hw_params, &rate, &dir);
+		snd_rv = 0;
+	}
+	cw_alsa.snd_pcm_hw_params_free(hw_params);
+	if (NULL != step) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open capture: can't %s: %s", step, cw_alsa.snd_strerror(snd_rv));
+		cw_alsa_close_capture_internal(capture);
+		return CW_FAILURE;
+	}
+
+	snd_rv = cw_alsa.snd_pcm_prepare(capture->alsa_pcm_handle);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open capture: can't prepare ALSA handler: %s", cw_alsa.snd_strerror(snd_rv));
+		cw_alsa_close_capture_internal(capture);
+		return CW_FAILURE;
+	}
+
+	capture->sample_rate = (int) rate;
+	capture->period_n_samples = (int) period_size;
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "open capture: sample rate = %u, period size = %lu, buffer size = %lu [samples]",
+		      rate, period_size, buffer_size);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close ALSA PCM handle of capture
+
+   @param[in,out] capture capture with opened ALSA PCM handle
+*/
+static void cw_alsa_close_capture_internal(cw_capture_t * capture)
+{
+	if (NULL != capture->alsa_pcm_handle) {
+		cw_alsa.snd_pcm_drop(capture->alsa_pcm_handle);
+		cw_alsa.snd_pcm_close(capture->alsa_pcm_handle);
+		capture->alsa_pcm_handle = NULL;
+#if WITH_ALSA_FREE_GLOBAL_CONFIG
+		cw_alsa.snd_config_update_free_global();
+#endif
+	}
+
+	/* Release reference taken by cw_alsa_load_library_internal(). */
+	dlclose(cw_alsa.lib_handle);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Read captured samples from ALSA PCM handle
+
+   On overrun (capture's thread didn't read the samples fast enough)
+   the PCM handle is prepared again, and the read is repeated: the
+   samples that have been lost make a gap in timestamps, so timeline
+   of tone detector stays correct.
+
+   Timestamp of first sample is calculated from current time and from
+   count of samples that are now in ring buffer of sound card (read
+   samples and samples that have been captured after them).
+
+   @param[in,out] capture capture with opened ALSA PCM handle
+   @param[out] samples buffer for samples
+   @param[in] n_samples size of @p samples
+   @param[out] timestamp timestamp of first read sample [ns]
+
+   @return count of read samples
+   @return -1 on error
+*/
+static int cw_alsa_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp)
+{
+	snd_pcm_sframes_t n_read = cw_alsa.snd_pcm_readi(capture->alsa_pcm_handle, samples, (snd_pcm_uframes_t) n_samples);
+	if (n_read < 0) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "read capture: %s", cw_alsa.snd_strerror((int) n_read));
+		const int snd_rv = cw_alsa.snd_pcm_prepare(capture->alsa_pcm_handle);
+		if (0 != snd_rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "read capture: can't prepare ALSA handler: %s", cw_alsa.snd_strerror(snd_rv));
+			return -1;
+		}
+		n_read = cw_alsa.snd_pcm_readi(capture->alsa_pcm_handle, samples, (snd_pcm_uframes_t) n_samples);
+		if (n_read < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "read capture: %s", cw_alsa.snd_strerror((int) n_read));
+			return -1;
+		}
+	}
+	const int64_t now = cw_clock_now_internal();
+
+	snd_pcm_sframes_t delay = 0;
+	if (0 != cw_alsa.snd_pcm_delay(capture->alsa_pcm_handle, &delay) || delay < 0) {
+		delay = 0;
+	}
+	*timestamp = now - ((int64_t) (n_read + delay) * CW_NSECS_PER_SEC) / capture->sample_rate;
+
+	return (int) n_read;
+}
+
+
+
+
 #else /* #ifdef LIBCW_WITH_ALSA */
 
 
@@ -1408,4 +2215,14 @@ void cw_alsa_drop_internal(__attribute__((unused)) cw_gen_t * gen)
 
 
 
+cw_ret_t cw_alsa_init_capture_internal(__attribute__((unused)) cw_capture_t * capture)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return CW_FAILURE;
+}
+
+
+
+
 #endif /* #ifdef LIBCW_WITH_ALSA */
@@ -19,10 +19,29 @@
 
 
 
+#include <stdbool.h>
+
 #include <alsa/asoundlib.h>
 
 typedef struct cw_alsa_data_struct {
 	snd_pcm_t * pcm_handle; /* Output handle for sound data. */
+
+	/* Samples are calculated directly in mmapped ring buffer of
+	   sound card (SND_PCM_ACCESS_MMAP_INTERLEAVED). */
+	bool mmap;
+	/* Area of ring buffer has been obtained with snd_pcm_mmap_begin(),
+	   but not yet committed. */
+	bool mmap_in_progress;
+	snd_pcm_uframes_t mmap_offset;
+
+	/* Count of periods in ring buffer of sound card. */
+	unsigned int n_periods;
+
+	/* Automatic selection of smallest period/buffer size that doesn't
+	   cause underruns (see cw_gen_config_t::alsa_target_latency). */
+	bool auto_tune;
+	unsigned int target_latency; /* [microseconds] */
+	int n_xruns;                 /* Underruns since last change of configuration. */
 } cw_alsa_data_t;
 
 
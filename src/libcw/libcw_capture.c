@@ -0,0 +1,445 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_capture.c
+
+   @brief Sound capture. Read PCM sound from sound device, feed it to
+   tone detector.
+
+   Capture's thread reads one period of samples at a time from sound
+   device, blocking in sound system's read function, so the thread is
+   paced by the device. The periods are short (5 ms by default) and
+   ring buffer of device holds only CW_CAPTURE_N_PERIODS of them, so a
+   sample reaches tone detector a few milliseconds after it has been
+   captured.
+
+   Sound systems implement three functions: open, read and close (see
+   cw_capture_t). The read function returns a timestamp of first of
+   read samples. The timestamp is calculated from current time of
+   monotonic clock and from count of samples that have been captured,
+   but not yet read (delay of device), so jitter of scheduling of
+   capture's thread doesn't move the marks found by detector.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_capture.h"
+#include "libcw_debug.h"
+#include "libcw_detector.h"
+#include "libcw_gen.h"
+
+
+
+
+#define MSG_PREFIX "libcw/capture: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void * cw_capture_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create new sound capture
+
+   Sound device is opened by the function, but capturing doesn't start
+   until cw_capture_start() is called. Sound device may configure
+   sample rate different than @p sample_rate (and File sound system
+   uses sample rate from header of WAV file): use
+   cw_capture_get_sample_rate() to create a tone detector for the
+   capture.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL. If support for the sound system has been disabled at
+   compile time, errno is set to ENODEV.
+
+   @param[in] sound_system CW_AUDIO_ALSA, CW_AUDIO_PA or CW_AUDIO_FILE
+   @param[in] device name of sound device (path of file for CW_AUDIO_FILE); NULL or empty string for default device
+   @param[in] sample_rate requested sample rate [Hz], zero for default rate
+   @param[in] period_duration requested duration of block of samples [microseconds], zero for default duration
+
+   @return freshly allocated capture on success
+   @return NULL pointer on failure
+*/
+cw_capture_t * cw_capture_new(cw_sound_system_t sound_system, const char * device, int sample_rate, int period_duration)
+{
+	if (0 == sample_rate) {
+		sample_rate = CW_CAPTURE_SAMPLE_RATE_DEFAULT;
+	}
+	if (0 == period_duration) {
+		period_duration = CW_CAPTURE_PERIOD_DURATION_DEFAULT;
+	}
+	if ((CW_AUDIO_ALSA != sound_system && CW_AUDIO_PA != sound_system && CW_AUDIO_FILE != sound_system)
+	    || sample_rate < CW_CAPTURE_SAMPLE_RATE_MIN || sample_rate > CW_CAPTURE_SAMPLE_RATE_MAX
+	    || period_duration < CW_CAPTURE_PERIOD_DURATION_MIN || period_duration > CW_CAPTURE_PERIOD_DURATION_MAX) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid sound system %d, sample rate %d or period duration %d",
+			      sound_system, sample_rate, period_duration);
+		errno = EINVAL;
+		return (cw_capture_t *) NULL;
+	}
+
+	cw_capture_t * capture = (cw_capture_t *) calloc(1, sizeof (cw_capture_t));
+	if (NULL == capture) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_capture_t *) NULL;
+	}
+	capture->file_fd = -1;
+
+	cw_ret_t cwret = CW_FAILURE;
+	if (CW_AUDIO_ALSA == sound_system) {
+		cwret = cw_alsa_init_capture_internal(capture);
+	} else if (CW_AUDIO_PA == sound_system) {
+		cwret = cw_pa_init_capture_internal(capture);
+	} else {
+		cwret = cw_file_init_capture_internal(capture);
+	}
+	if (CW_SUCCESS != cwret) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: sound system %s can't be used for capture",
+			      cw_get_audio_system_label(sound_system));
+		cw_capture_delete(&capture);
+		errno = ENODEV;
+		return (cw_capture_t *) NULL;
+	}
+
+	cw_gen_pick_device_name_internal(device, sound_system,
+					 capture->picked_device_name, sizeof (capture->picked_device_name));
+
+	if (CW_SUCCESS != capture->open_device(capture, sample_rate, period_duration)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: failed to open %s device '%s' for capture",
+			      cw_get_audio_system_label(sound_system), capture->picked_device_name);
+		cw_capture_delete(&capture);
+		return (cw_capture_t *) NULL;
+	}
+	capture->device_is_open = true;
+
+	capture->buffer = (int16_t *) calloc((size_t) capture->period_n_samples, sizeof (int16_t));
+	if (NULL == capture->buffer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_capture_delete(&capture);
+		return (cw_capture_t *) NULL;
+	}
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "new: capturing from %s device '%s', sample rate = %d, period = %d samples",
+		      cw_get_audio_system_label(sound_system), capture->picked_device_name,
+		      capture->sample_rate, capture->period_n_samples);
+
+	return capture;
+}
+
+
+
+
+/**
+   @brief Delete sound capture
+
+   Capture is stopped and its sound device is closed. Attached
+   detector is not deleted. Pointer to @p capture is set to NULL.
+
+   @param[in] capture pointer to capture to delete
+*/
+void cw_capture_delete(cw_capture_t ** capture)
+{
+	if (NULL == capture || NULL == *capture) {
+		return;
+	}
+
+	cw_capture_stop(*capture);
+
+	if ((*capture)->device_is_open) {
+		(*capture)->close_device(*capture);
+	}
+	free((*capture)->buffer);
+
+	free(*capture);
+	*capture = (cw_capture_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get sample rate of captured sound
+
+   @param[in] capture capture
+
+   @return sample rate configured by sound device [Hz]
+   @return zero for NULL @p capture
+*/
+int cw_capture_get_sample_rate(const cw_capture_t * capture)
+{
+	if (NULL == capture) {
+		return 0;
+	}
+	return capture->sample_rate;
+}
+
+
+
+
+/**
+   @brief Attach tone detector to sound capture
+
+   Every block of captured samples is passed to the detector. Detector
+   is not owned by capture. Pass NULL to detach the detector.
+
+   @exception EINVAL @p capture is NULL, or sample rate of @p detector is different than sample rate of capture
+   @exception EBUSY capture is running
+
+   @param[in] capture capture
+   @param[in] detector detector
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_capture_attach_detector(cw_capture_t * capture, cw_detector_t * detector)
+{
+	if (NULL == capture || (NULL != detector && detector->sample_rate != capture->sample_rate)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (capture->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	capture->detector = detector;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Register function to be called with every block of captured samples
+
+   The callback is called in capture's thread, after the block has been
+   passed to attached detector. It should return quickly, otherwise
+   ring buffer of sound device overflows. Pass NULL to unregister.
+
+   @exception EINVAL @p capture is NULL
+   @exception EBUSY capture is running
+
+   @param[in] capture capture
+   @param[in] callback_func callback function
+   @param[in] callback_arg argument passed to the callback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_capture_register_callback(cw_capture_t * capture, cw_capture_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == capture) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (capture->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	capture->callback_func = callback_func;
+	capture->callback_arg = callback_arg;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Start capturing sound
+
+   @exception EINVAL @p capture is NULL
+   @exception EBUSY capture has been already started
+
+   @param[in] capture capture
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_capture_start(cw_capture_t * capture)
+{
+	if (NULL == capture) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (capture->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	capture->thread_quit = false;
+	capture->thread_done = false;
+	const int rv = pthread_create(&capture->thread, NULL, cw_capture_thread_internal, capture);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		errno = rv;
+		return CW_FAILURE;
+	}
+	capture->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop capturing sound
+
+   Function waits for capture's thread to finish its current read.
+   Samples that haven't been read from sound device are not passed to
+   detector.
+
+   @exception EINVAL @p capture is NULL
+
+   @param[in] capture capture
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_capture_stop(cw_capture_t * capture)
+{
+	if (NULL == capture) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!capture->thread_running) {
+		return CW_SUCCESS;
+	}
+
+	capture->thread_quit = true;
+	pthread_join(capture->thread, NULL);
+	capture->thread_running = false;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if capture is reading samples
+
+   Capture stops by itself at the end of stream (e.g. at the end of
+   File) or on error of sound device. cw_capture_stop() still has to be
+   called in such case.
+
+   @param[in] capture capture
+
+   @return true if capture has been started and is still reading samples
+   @return false otherwise
+*/
+bool cw_capture_is_running(const cw_capture_t * capture)
+{
+	if (NULL == capture) {
+		return false;
+	}
+	return capture->thread_running && !capture->thread_done;
+}
+
+
+
+
+/**
+   @brief Thread function of capture
+
+   @param[in] arg capture (cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_capture_thread_internal(void * arg)
+{
+	cw_capture_t * capture = (cw_capture_t *) arg;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "capture", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "capture");
+#endif
+
+	while (!capture->thread_quit) {
+		int64_t timestamp = 0;
+		const int n_samples = capture->read_device(capture, capture->buffer, capture->period_n_samples, &timestamp);
+		if (n_samples < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "thread: failed to read from %s device",
+				      cw_get_audio_system_label(capture->sound_system));
+			break;
+		}
+		if (0 == n_samples) {
+			/* End of stream. */
+			break;
+		}
+
+		if (NULL != capture->detector) {
+			cw_detector_process(capture->detector, capture->buffer, (size_t) n_samples, timestamp);
+		}
+		if (NULL != capture->callback_func) {
+			capture->callback_func(capture->callback_arg, capture->buffer, (size_t) n_samples, timestamp);
+		}
+	}
+	capture->thread_done = true;
+
+	return NULL;
+}
@@ -0,0 +1,129 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_CAPTURE
+#define H_LIBCW_CAPTURE
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+#ifdef LIBCW_WITH_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#ifdef LIBCW_WITH_PULSEAUDIO
+#include "libcw_pa.h"
+#endif
+
+
+
+
+/* Default duration of one block of captured samples (and of period of
+   sound device) [microseconds]. */
+enum { CW_CAPTURE_PERIOD_DURATION_DEFAULT = 5000 };
+enum { CW_CAPTURE_PERIOD_DURATION_MIN = 1000 };
+enum { CW_CAPTURE_PERIOD_DURATION_MAX = 100000 };
+
+/* Sample rate used when client code doesn't ask for specific one, and
+   range of accepted rates [Hz]. */
+enum { CW_CAPTURE_SAMPLE_RATE_DEFAULT = 48000 };
+enum { CW_CAPTURE_SAMPLE_RATE_MIN = 8000 };
+enum { CW_CAPTURE_SAMPLE_RATE_MAX = 192000 };
+
+/* Count of periods in ring buffer of sound device. */
+enum { CW_CAPTURE_N_PERIODS = 4 };
+
+/* Size of canonical header of WAV file, as written by File sound
+   system. */
+enum { CW_CAPTURE_FILE_HEAD_SIZE = 44 };
+
+
+
+
+struct cw_capture_struct {
+	cw_sound_system_t sound_system;
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE];
+	bool device_is_open;
+
+	/* Sample rate and size of period, as configured by sound
+	   device. */
+	int sample_rate;
+	int period_n_samples;
+
+	/* One period of samples read from sound device. */
+	int16_t * buffer;
+
+	/* Functions of sound system. */
+
+	/* Open sound device for capture, with requested sample rate and
+	   duration of period [microseconds]. Set sample rate and size of
+	   period in capture. */
+	cw_ret_t (* open_device)(cw_capture_t * capture, int sample_rate, int period_duration);
+	void (* close_device)(cw_capture_t * capture);
+	/* Read at most @p n_samples samples, blocking until some samples
+	   are available. Return count of read samples (zero at the end of
+	   stream, -1 on error) and timestamp of first of them [ns]. */
+	int (* read_device)(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp);
+
+#ifdef LIBCW_WITH_ALSA
+	snd_pcm_t * alsa_pcm_handle;
+#endif
+#ifdef LIBCW_WITH_PULSEAUDIO
+	cw_pa_data_t pa_data;
+	/* Fragment of record stream obtained with pa_stream_peek(),
+	   consumed by one or more reads. */
+	const uint8_t * pa_fragment;
+	size_t pa_fragment_n_bytes;
+	size_t pa_fragment_offset;
+#endif
+
+	/* File sound system. Timestamps of samples are counted from
+	   time of opening of the file. First bytes of file are read
+	   when looking for WAV header; if there is no header, the bytes
+	   are samples of raw file, to be returned by first read. */
+	int file_fd;
+	bool file_fd_is_owned;
+	uint8_t file_head[CW_CAPTURE_FILE_HEAD_SIZE];
+	size_t file_head_n_bytes;
+	int64_t file_start;
+	int64_t file_n_samples;
+
+	/* Consumers of captured samples, called in capture's thread. */
+	cw_detector_t * detector;
+	cw_capture_callback_t callback_func;
+	void * callback_arg;
+
+	pthread_t thread;
+	bool thread_running;
+	volatile bool thread_quit;
+	/* Thread has finished reading (end of stream, or error). */
+	volatile bool thread_done;
+};
+
+
+
+
+cw_ret_t cw_alsa_init_capture_internal(cw_capture_t * capture);
+cw_ret_t cw_pa_init_capture_internal(cw_capture_t * capture);
+cw_ret_t cw_file_init_capture_internal(cw_capture_t * capture);
+
+
+
+
+#endif /* #ifndef H_LIBCW_CAPTURE */
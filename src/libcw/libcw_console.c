@@ -405,7 +405,7 @@ static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const c
 
 	if (cw_value == gen->console.cw_value) {
 		/* Simulate blocking write() and let buzzer keep doing what it is doing. */
-		cw_usleep_internal(tone->duration);
+		cw_gen_pace_tone_internal(gen, tone->duration);
 		return CW_SUCCESS;
 	} else {
 		gen->console.cw_value = cw_value;
@@ -413,7 +413,7 @@ static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const c
 
 	const int rv = cw_console_kiocsound_wrapper_internal(gen, gen->console.cw_value);
 	/* Simulate blocking write() because cw_console_kiocsound_wrapper_internal() is not blocking. */
-	cw_usleep_internal(tone->duration);
+	cw_gen_pace_tone_internal(gen, tone->duration);
 
 	cw_ret_t cwret = CW_SUCCESS;
 	switch (tone->slope_mode) {
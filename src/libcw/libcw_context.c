@@ -0,0 +1,1823 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+/**
+   \file libcw_context.c
+
+   \brief Contexts of legacy API
+
+   A context groups generator, receiver and key that are used by
+   functions of legacy API. Functions declared in libcw.h operate on
+   default context, their cw_context_*() variants operate on context
+   passed as first argument. A process can have many contexts, and
+   each of them is independent from the others.
+*/
+
+
+
+#include "config.h"
+
+#include <errno.h> /* EINVAL on FreeBSD */
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcw.h"
+#include "libcw_context.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_key.h"
+#include "libcw_rec.h"
+#include "libcw_utils.h"
+
+
+
+
+/* Generator of default context. This is a global variable in legacy
+   library, it is referenced directly by libcw_signal.c. */
+cw_gen_t *cw_generator = NULL;
+
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+
+static cw_rec_t cw_receiver = {
+
+	.state = RS_IDLE,
+	.representation_hash = 1, /* Sentinel bit, see cw_representation_to_hash_internal(). */
+
+
+	.speed                      = CW_SPEED_INITIAL,
+	.tolerance                  = CW_TOLERANCE_INITIAL,
+	.gap                        = CW_GAP_INITIAL,
+	.is_adaptive_receive_mode   = CW_REC_ADAPTIVE_MODE_INITIAL,
+	.noise_spike_threshold      = CW_REC_NOISE_THRESHOLD_INITIAL,
+
+
+	/* TODO: this variable is not set in
+	   cw_rec_reset_parameters_internal(). Why is it
+	   separated from the four main variables? Is it because it is
+	   a derivative of speed? But speed is a derivative of this
+	   variable in adaptive speed mode. */
+	.adaptive_speed_threshold = CW_REC_SPEED_THRESHOLD_INITIAL,
+
+	.parameters_in_sync = false,
+
+	.label = "global rec", /* Single global receiver available in libcw library, used by legacy API. */
+
+	/* Legacy API doesn't register output callback, so the mutex
+	   doesn't have to be recursive. */
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.output_timer_id = -1,
+};
+
+
+
+
+
+CW_STATIC_FUNC volatile cw_key_t cw_key = {
+	.gen = NULL,
+
+
+	.rec = &cw_receiver,
+
+
+	.sk = {
+		.key_value = CW_KEY_VALUE_OPEN
+	},
+
+
+	.ik = {
+		.graph_state = KS_IDLE,
+		.key_value = CW_KEY_VALUE_OPEN,
+
+		.dot_paddle_value = CW_KEY_VALUE_OPEN,
+		.dash_paddle_value = CW_KEY_VALUE_OPEN,
+
+		.dot_latch = false,
+		.dash_latch = false,
+
+		.curtis_mode_b = false,
+		.curtis_b_latch = false,
+
+		.lock = false,
+	},
+
+	.label = "global key", /* Single global key available in libcw library, used by legacy API. */
+};
+
+
+
+
+
+/* Default context, used by functions of legacy API. */
+cw_context_t cw_default_context = {
+	.gen = NULL,
+	.rec = &cw_receiver,
+	.key = &cw_key,
+	.is_default = true,
+};
+
+
+
+
+
+/**
+   \brief Create new context
+
+   Allocate new context with its own receiver and key. The context
+   doesn't have a generator yet, use cw_context_generator_new() to
+   create one.
+
+   Delete the context with cw_context_delete().
+
+   \return pointer to new context on success
+   \return NULL on failure
+*/
+cw_context_t * cw_context_new(void)
+{
+	cw_context_t * context = (cw_context_t *) calloc(1, sizeof (cw_context_t));
+	if (NULL == context) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      "libcw: can't allocate context");
+		return NULL;
+	}
+
+	context->rec = cw_rec_new();
+	context->own_key = cw_key_new();
+	context->key = context->own_key;
+	if (NULL == context->rec || NULL == context->own_key) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      "libcw: can't create receiver or key of context");
+		cw_context_delete(&context);
+		return NULL;
+	}
+	cw_rec_set_label(context->rec, "context rec");
+	cw_key_set_label(context->own_key, "context key");
+	cw_key_register_receiver(context->key, context->rec);
+
+	return context;
+}
+
+
+
+
+/**
+   \brief Delete context
+
+   Stop and delete generator of the context (if any), delete its
+   receiver and key, and deallocate the context. \p *context is set
+   to NULL.
+
+   Default context can't be deleted, the function ignores it.
+
+   \param context - pointer to context to delete
+*/
+void cw_context_delete(cw_context_t ** context)
+{
+	if (NULL == context || NULL == *context) {
+		return;
+	}
+	if ((*context)->is_default) {
+		return;
+	}
+
+	if ((*context)->gen) {
+		cw_gen_stop((*context)->gen);
+		cw_context_generator_delete(*context);
+	}
+	cw_key_delete(&(*context)->own_key);
+	cw_rec_delete(&(*context)->rec);
+
+	free(*context);
+	*context = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   \brief Get default context
+
+   Default context is the context used by functions of legacy API
+   that don't take a context argument.
+
+   \return pointer to default context
+*/
+cw_context_t * cw_context_get_default(void)
+{
+	return &cw_default_context;
+}
+
+
+
+
+/**
+   \brief Create new generator of given context from given config
+
+   \param context - context in which to create generator
+   \param gen_conf - configuration for generator
+
+   \return CW_SUCCESS on success
+   \return CW_FAILURE on failure
+*/
+int cw_context_generator_new_internal(cw_context_t * context, const cw_gen_config_t * gen_conf)
+{
+	context->gen = cw_gen_new(gen_conf);
+	if (context->is_default) {
+		cw_generator = context->gen;
+	}
+	if (NULL == context->gen) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      "libcw: can't create generator");
+		return CW_FAILURE;
+	} else {
+		if (context->is_default) {
+			cw_gen_set_label(context->gen, "global gen"); /* Single global generator available in libcw library, used by legacy API. */
+		} else {
+			cw_gen_set_label(context->gen, "context gen");
+		}
+
+		/* For some (all?) applications a key needs to have
+		   some generator associated with it. */
+		cw_key_register_generator(context->key, context->gen);
+
+		return CW_SUCCESS;
+	}
+}
+
+
+
+
+/**
+   \brief Delete generator of given context, if the generator exists
+
+   \param context - context in which to delete generator
+*/
+void cw_context_generator_delete_internal(cw_context_t * context)
+{
+	if (context->gen) {
+		cw_context_generator_delete(context);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Context variant of cw_generator_new()
+
+   See cw_generator_new() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_generator_new(cw_context_t * context, int audio_system, const char *device)
+{
+	cw_gen_config_t gen_conf = { .sound_system = audio_system, .file_fd = -1 };
+	if (NULL != device) {
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", device);
+	}
+	return cw_context_generator_new_internal(context, &gen_conf);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_generator_delete()
+
+   See cw_generator_delete() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_generator_delete(cw_context_t * context)
+{
+	/* Don't leave key with dangling pointer to generator. */
+	if (NULL != context->gen && context->key->gen == context->gen) {
+		context->key->gen = NULL;
+	}
+	cw_gen_delete(&context->gen);
+	if (context == &cw_default_context) {
+		cw_generator = NULL;
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_generator_start()
+
+   See cw_generator_start() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_generator_start(cw_context_t * context)
+{
+	return cw_gen_start(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_generator_stop()
+
+   See cw_generator_stop() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_generator_stop(cw_context_t * context)
+{
+	cw_gen_stop(context->gen);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_send_speed()
+
+   See cw_set_send_speed() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_send_speed(cw_context_t * context, int new_value)
+{
+	int rv = cw_gen_set_speed(context->gen, new_value);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_frequency()
+
+   See cw_set_frequency() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_frequency(cw_context_t * context, int new_value)
+{
+	int rv = cw_gen_set_frequency(context->gen, new_value);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_volume()
+
+   See cw_set_volume() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_volume(cw_context_t * context, int new_value)
+{
+	int rv = cw_gen_set_volume(context->gen, new_value);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_gap()
+
+   See cw_set_gap() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_gap(cw_context_t * context, int new_value)
+{
+	int rv = cw_gen_set_gap(context->gen, new_value);
+	if (rv != CW_FAILURE) {
+		/* Ideally generator and receiver should have their
+		   own, separate cw_set_gap() functions. Unfortunately
+		   this is not the case so gap should be set
+		   here for receiver as well. */
+		rv = cw_rec_set_gap(context->rec, new_value);
+	}
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_weighting()
+
+   See cw_set_weighting() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_weighting(cw_context_t * context, int new_value)
+{
+	int rv = cw_gen_set_weighting(context->gen, new_value);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_send_speed()
+
+   See cw_get_send_speed() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_send_speed(cw_context_t * context)
+{
+	return cw_gen_get_speed(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_frequency()
+
+   See cw_get_frequency() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_frequency(cw_context_t * context)
+{
+	return cw_gen_get_frequency(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_volume()
+
+   See cw_get_volume() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_volume(cw_context_t * context)
+{
+	return cw_gen_get_volume(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_gap()
+
+   See cw_get_gap() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_gap(cw_context_t * context)
+{
+	return cw_gen_get_gap(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_weighting()
+
+   See cw_get_weighting() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_weighting(cw_context_t * context)
+{
+	return cw_gen_get_weighting(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_send_parameters()
+
+   See cw_get_send_parameters() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_get_send_parameters(cw_context_t * context, int *dot_usecs, int *dash_usecs,
+			    int *end_of_element_usecs,
+			    int *end_of_character_usecs, int *end_of_word_usecs,
+			    int *additional_usecs, int *adjustment_usecs)
+{
+	cw_gen_get_timing_parameters_internal(context->gen,
+					      dot_usecs, dash_usecs,
+					      end_of_element_usecs,
+					      end_of_character_usecs, end_of_word_usecs,
+					      additional_usecs, adjustment_usecs);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_dot()
+
+   See cw_send_dot() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_dot(cw_context_t * context)
+{
+	const bool is_first_mark = false; /* cw_send_dot() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
+	return cw_gen_enqueue_mark_internal(context->gen, CW_DOT_REPRESENTATION, is_first_mark);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_dash()
+
+   See cw_send_dash() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_dash(cw_context_t * context)
+{
+	const bool is_first_mark = false; /* cw_send_dash() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
+	return cw_gen_enqueue_mark_internal(context->gen, CW_DASH_REPRESENTATION, is_first_mark);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_character_space()
+
+   See cw_send_character_space() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_character_space(cw_context_t * context)
+{
+	return cw_gen_enqueue_2u_ics_internal(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_word_space()
+
+   See cw_send_word_space() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_word_space(cw_context_t * context)
+{
+	return cw_gen_enqueue_iws_internal(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_representation()
+
+   See cw_send_representation() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_representation(cw_context_t * context, const char *representation)
+{
+	return cw_gen_enqueue_representation(context->gen, representation);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_representation_partial()
+
+   See cw_send_representation_partial() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_representation_partial(cw_context_t * context, const char *representation)
+{
+	return cw_gen_enqueue_representation_no_ics(context->gen, representation);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_character()
+
+   See cw_send_character() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_character(cw_context_t * context, char c)
+{
+	return cw_gen_enqueue_character(context->gen, c);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_character_partial()
+
+   See cw_send_character_partial() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_character_partial(cw_context_t * context, char c)
+{
+	return cw_gen_enqueue_character_no_ics(context->gen, c);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_send_string()
+
+   See cw_send_string() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_send_string(cw_context_t * context, const char *string)
+{
+	return cw_gen_enqueue_string(context->gen, string);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_send_receive_parameters()
+
+   See cw_reset_send_receive_parameters() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_send_receive_parameters(cw_context_t * context)
+{
+	cw_gen_reset_parameters_internal(context->gen);
+	cw_rec_reset_parameters_internal(context->rec);
+
+	/* Reset requires resynchronization. */
+	cw_gen_sync_parameters_internal(context->gen);
+	cw_rec_sync_parameters_internal(context->rec);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_console_device()
+
+   See cw_get_console_device() for details.
+
+   \param context - context to operate on
+*/
+const char *cw_context_get_console_device(cw_context_t * context)
+{
+	return context->gen->picked_device_name;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_soundcard_device()
+
+   See cw_get_soundcard_device() for details.
+
+   \param context - context to operate on
+*/
+const char *cw_context_get_soundcard_device(cw_context_t * context)
+{
+	return context->gen->picked_device_name;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_generator_get_audio_system_label()
+
+   See cw_generator_get_audio_system_label() for details.
+
+   \param context - context to operate on
+*/
+const char *cw_context_generator_get_audio_system_label(cw_context_t * context)
+{
+	return cw_get_audio_system_label(context->gen->sound_system);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_generator_remove_last_character()
+
+   See cw_generator_remove_last_character() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_generator_remove_last_character(cw_context_t * context)
+{
+	return cw_gen_remove_last_character(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_register_tone_queue_low_callback()
+
+   See cw_register_tone_queue_low_callback() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_register_tone_queue_low_callback(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int level)
+{
+	if (level < 0) {
+		errno = EINVAL; /* cw_tq_register_low_level_callback_internal() won't recognize negative level. */
+		return CW_FAILURE;
+	}
+
+	return cw_tq_register_low_level_callback_internal(context->gen->tq, callback_func, callback_arg, level);
+}
+
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_tone_queue_event_fd()
+
+   See cw_get_tone_queue_event_fd() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_tone_queue_event_fd(cw_context_t * context)
+{
+	return cw_gen_get_event_fd(context->gen);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_is_tone_busy()
+
+   See cw_is_tone_busy() for details.
+
+   \param context - context to operate on
+*/
+bool cw_context_is_tone_busy(cw_context_t * context)
+{
+	return cw_tq_is_nonempty_internal(context->gen->tq);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone()
+
+   See cw_wait_for_tone() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone(cw_context_t * context)
+{
+	return cw_tq_wait_for_end_of_current_tone_internal(context->gen->tq);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone_queue()
+
+   See cw_wait_for_tone_queue() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone_queue(cw_context_t * context)
+{
+	return cw_tq_wait_for_level_internal(context->gen->tq, 0);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone_queue_critical()
+
+   See cw_wait_for_tone_queue_critical() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone_queue_critical(cw_context_t * context, int level)
+{
+	if (level < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_tq_wait_for_level_internal(context->gen->tq, (size_t) level);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone_async()
+
+   See cw_wait_for_tone_async() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_gen_wait_for_end_of_current_tone_async(context->gen, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone_queue_async()
+
+   See cw_wait_for_tone_queue_async() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone_queue_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_gen_wait_for_queue_level_async(context->gen, 0, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_tone_queue_critical_async()
+
+   See cw_wait_for_tone_queue_critical_async() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_tone_queue_critical_async(cw_context_t * context, int level, void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	if (level < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_gen_wait_for_queue_level_async(context->gen, (size_t) level, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_is_tone_queue_full()
+
+   See cw_is_tone_queue_full() for details.
+
+   \param context - context to operate on
+*/
+bool cw_context_is_tone_queue_full(cw_context_t * context)
+{
+	return cw_tq_is_full_internal(context->gen->tq);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_tone_queue_capacity()
+
+   See cw_get_tone_queue_capacity() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_tone_queue_capacity(cw_context_t * context)
+{
+	return (int) cw_tq_capacity_internal(context->gen->tq);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_tone_queue_length()
+
+   See cw_get_tone_queue_length() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_tone_queue_length(cw_context_t * context)
+{
+	return (int) cw_tq_length_internal(context->gen->tq);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_flush_tone_queue()
+
+   See cw_flush_tone_queue() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_flush_tone_queue(cw_context_t * context)
+{
+	/* This function locks and unlocks mutex. */
+	cw_tq_flush_internal(context->gen->tq);
+
+	/* Force silence on the speaker anyway, and stop any background
+	   soundcard tone generation. */
+	cw_gen_silence_internal(context->gen);
+	//cw_finalization_schedule_internal();
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_tone_queue()
+
+   See cw_reset_tone_queue() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_tone_queue(cw_context_t * context)
+{
+	cw_tq_flush_internal(context->gen->tq);
+
+	/* Silence sound and stop any background soundcard tone generation. */
+	cw_gen_silence_internal(context->gen);
+	//cw_finalization_schedule_internal();
+
+	cw_debug_msg ((&cw_debug_object), CW_DEBUG_TONE_QUEUE, CW_DEBUG_INFO,
+		      "libcw: tone queue: reset");
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_queue_tone()
+
+   See cw_queue_tone() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_queue_tone(cw_context_t * context, int usecs, int frequency)
+{
+	/* Check the arguments given for realistic values.  This test
+	   is left here for legacy reasons. Don't change it. */
+	if (usecs < 0
+	    || frequency < CW_FREQUENCY_MIN
+	    || frequency > CW_FREQUENCY_MAX) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, frequency, usecs, CW_SLOPE_MODE_STANDARD_SLOPES);
+	int rv = cw_tq_enqueue_internal(context->gen->tq, &tone);
+
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_receive_speed()
+
+   See cw_set_receive_speed() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_receive_speed(cw_context_t * context, int new_value)
+{
+	return cw_rec_set_speed(context->rec, new_value);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_receive_speed()
+
+   See cw_get_receive_speed() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_receive_speed(cw_context_t * context)
+{
+	return (int) cw_rec_get_speed(context->rec);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_tolerance()
+
+   See cw_set_tolerance() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_tolerance(cw_context_t * context, int new_value)
+{
+	return cw_rec_set_tolerance(context->rec, new_value);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_tolerance()
+
+   See cw_get_tolerance() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_tolerance(cw_context_t * context)
+{
+	return cw_rec_get_tolerance(context->rec);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_receive_parameters()
+
+   See cw_get_receive_parameters() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_get_receive_parameters(cw_context_t * context, int *dot_usecs, int *dash_usecs,
+			       int *dot_min_usecs, int *dot_max_usecs,
+			       int *dash_min_usecs, int *dash_max_usecs,
+			       int *end_of_element_min_usecs,
+			       int *end_of_element_max_usecs,
+			       int *end_of_element_ideal_usecs,
+			       int *end_of_character_min_usecs,
+			       int *end_of_character_max_usecs,
+			       int *end_of_character_ideal_usecs,
+			       int *adaptive_threshold)
+{
+	cw_rec_get_parameters_internal(context->rec,
+				       dot_usecs, dash_usecs,
+				       dot_min_usecs, dot_max_usecs,
+				       dash_min_usecs, dash_max_usecs,
+				       end_of_element_min_usecs,
+				       end_of_element_max_usecs,
+				       end_of_element_ideal_usecs,
+				       end_of_character_min_usecs,
+				       end_of_character_max_usecs,
+				       end_of_character_ideal_usecs,
+				       adaptive_threshold);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_set_noise_spike_threshold()
+
+   See cw_set_noise_spike_threshold() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_set_noise_spike_threshold(cw_context_t * context, int new_value)
+{
+	return cw_rec_set_noise_spike_threshold(context->rec, new_value);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_noise_spike_threshold()
+
+   See cw_get_noise_spike_threshold() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_noise_spike_threshold(cw_context_t * context)
+{
+	return cw_rec_get_noise_spike_threshold(context->rec);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_receive_statistics()
+
+   See cw_get_receive_statistics() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_get_receive_statistics(cw_context_t * context, double *dot_sd, double *dash_sd,
+			       double *element_end_sd, double *character_end_sd)
+{
+	float dot_sd_f = 0.0F;
+	float dash_sd_f = 0.0F;
+	float element_end_sd_f = 0.0F;
+	float character_end_sd_f = 0.0F;
+
+	cw_rec_get_statistics_internal(context->rec,
+				       &dot_sd_f,
+				       &dash_sd_f,
+				       &element_end_sd_f,
+				       &character_end_sd_f);
+
+	*dot_sd           = (double) dot_sd_f;
+	*dash_sd          = (double) dash_sd_f;
+	*element_end_sd   = (double) element_end_sd_f;
+	*character_end_sd = (double) character_end_sd_f;
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_receive_statistics()
+
+   See cw_reset_receive_statistics() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_receive_statistics(cw_context_t * context)
+{
+	cw_rec_reset_statistics(context->rec);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_enable_adaptive_receive()
+
+   See cw_enable_adaptive_receive() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_enable_adaptive_receive(cw_context_t * context)
+{
+	cw_rec_set_adaptive_mode_internal(context->rec, true);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_disable_adaptive_receive()
+
+   See cw_disable_adaptive_receive() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_disable_adaptive_receive(cw_context_t * context)
+{
+	cw_rec_set_adaptive_mode_internal(context->rec, false);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_adaptive_receive_state()
+
+   See cw_get_adaptive_receive_state() for details.
+
+   \param context - context to operate on
+*/
+bool cw_context_get_adaptive_receive_state(cw_context_t * context)
+{
+	return cw_rec_get_adaptive_mode(context->rec);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_start_receive_tone()
+
+   See cw_start_receive_tone() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_start_receive_tone(cw_context_t * context, const struct timeval *timestamp)
+{
+	return cw_rec_mark_begin(context->rec, timestamp);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_end_receive_tone()
+
+   See cw_end_receive_tone() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_end_receive_tone(cw_context_t * context, const struct timeval *timestamp)
+{
+	return cw_rec_mark_end(context->rec, timestamp);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_receive_buffer_dot()
+
+   See cw_receive_buffer_dot() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_receive_buffer_dot(cw_context_t * context, const struct timeval *timestamp)
+{
+	return cw_rec_add_mark(context->rec, timestamp, CW_DOT_REPRESENTATION);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_receive_buffer_dash()
+
+   See cw_receive_buffer_dash() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_receive_buffer_dash(cw_context_t * context, const struct timeval *timestamp)
+{
+	return cw_rec_add_mark(context->rec, timestamp, CW_DASH_REPRESENTATION);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_receive_representation()
+
+   See cw_receive_representation() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_receive_representation(cw_context_t * context, const struct timeval *timestamp,
+			      /* out */ char *representation,
+			      /* out */ bool *is_end_of_word,
+			      /* out */ bool *is_error)
+{
+	int rv = cw_rec_poll_representation(context->rec,
+					  timestamp,
+					  representation,
+					  is_end_of_word,
+					  is_error);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_receive_character()
+
+   See cw_receive_character() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_receive_character(cw_context_t * context, const struct timeval *timestamp,
+			 /* out */ char *c,
+			 /* out */ bool *is_end_of_word,
+			 /* out */ bool *is_error)
+{
+	int rv = cw_rec_poll_character(context->rec, timestamp, c, is_end_of_word, is_error);
+	return rv;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_clear_receive_buffer()
+
+   See cw_clear_receive_buffer() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_clear_receive_buffer(cw_context_t * context)
+{
+	/* In 3.5.1 this was implemented by cw_rec_clear_buffer_internal() like this: */
+
+	memset(context->rec->representation, 0, sizeof (context->rec->representation));
+	context->rec->representation_ind = 0;
+	context->rec->representation_hash = 1;
+
+	cw_rec_set_state_internal(context->rec, RS_IDLE);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_receive_buffer_length()
+
+   See cw_get_receive_buffer_length() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_receive_buffer_length(cw_context_t * context)
+{
+	return cw_rec_get_buffer_length_internal(context->rec);
+}
+
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_receive_event_fd()
+
+   See cw_get_receive_event_fd() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_receive_event_fd(cw_context_t * context)
+{
+	return cw_rec_get_event_fd(context->rec);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_receive()
+
+   See cw_reset_receive() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_receive(cw_context_t * context)
+{
+	/* In 3.5.1 this was implemented by cw_rec_reset_internal() like this: */
+
+	memset(context->rec->representation, 0, sizeof (context->rec->representation));
+	context->rec->representation_ind = 0;
+	context->rec->representation_hash = 1;
+	cw_rec_set_state_internal(context->rec, RS_IDLE);
+
+	cw_rec_reset_statistics(context->rec);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_register_keying_callback()
+
+   See cw_register_keying_callback() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_register_keying_callback(cw_context_t * context, void (*callback_func)(void*, int), void *callback_arg)
+{
+	cw_gen_register_value_tracking_callback_internal(context->gen, callback_func, callback_arg);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_iambic_keyer_register_timer()
+
+   See cw_iambic_keyer_register_timer() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_iambic_keyer_register_timer(cw_context_t * context, struct timeval *timer)
+{
+	cw_key_ik_register_timer_internal(context->key, timer);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_enable_iambic_curtis_mode_b()
+
+   See cw_enable_iambic_curtis_mode_b() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_enable_iambic_curtis_mode_b(cw_context_t * context)
+{
+	cw_key_ik_enable_curtis_mode_b(context->key);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_disable_iambic_curtis_mode_b()
+
+   See cw_disable_iambic_curtis_mode_b() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_disable_iambic_curtis_mode_b(cw_context_t * context)
+{
+	cw_key_ik_disable_curtis_mode_b(context->key);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_iambic_curtis_mode_b_state()
+
+   See cw_get_iambic_curtis_mode_b_state() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_iambic_curtis_mode_b_state(cw_context_t * context)
+{
+	return (int) cw_key_ik_get_curtis_mode_b(context->key);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_notify_keyer_paddle_event()
+
+   See cw_notify_keyer_paddle_event() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_notify_keyer_paddle_event(cw_context_t * context, int dot_paddle_state, int dash_paddle_state)
+{
+	return cw_key_ik_notify_paddle_event(context->key, dot_paddle_state, dash_paddle_state);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_notify_keyer_dot_paddle_event()
+
+   See cw_notify_keyer_dot_paddle_event() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_notify_keyer_dot_paddle_event(cw_context_t * context, int dot_paddle_state)
+{
+	return cw_context_notify_keyer_paddle_event(context, dot_paddle_state, context->key->ik.dash_paddle_value);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_notify_keyer_dash_paddle_event()
+
+   See cw_notify_keyer_dash_paddle_event() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_notify_keyer_dash_paddle_event(cw_context_t * context, int dash_paddle_state)
+{
+	return cw_context_notify_keyer_paddle_event(context, context->key->ik.dot_paddle_value, dash_paddle_state);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_keyer_paddles()
+
+   See cw_get_keyer_paddles() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_get_keyer_paddles(cw_context_t * context, int *dot_paddle_state, int *dash_paddle_state)
+{
+	cw_key_ik_get_paddles(context->key, (cw_key_value_t *) dot_paddle_state, (cw_key_value_t *) dash_paddle_state);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_keyer_paddle_latches()
+
+   See cw_get_keyer_paddle_latches() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_get_keyer_paddle_latches(cw_context_t * context, int *dot_paddle_latch_state, int *dash_paddle_latch_state)
+{
+	cw_key_ik_get_paddle_latches_internal(context->key, dot_paddle_latch_state, dash_paddle_latch_state);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_is_keyer_busy()
+
+   See cw_is_keyer_busy() for details.
+
+   \param context - context to operate on
+*/
+bool cw_context_is_keyer_busy(cw_context_t * context)
+{
+	return cw_key_ik_is_busy_internal(context->key);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_keyer_element()
+
+   See cw_wait_for_keyer_element() for details.
+
+   The wait can't fail: the function doesn't set errno.
+
+   \param context - context to operate on
+
+   \return CW_SUCCESS
+*/
+int cw_context_wait_for_keyer_element(cw_context_t * context)
+{
+	return cw_key_ik_wait_for_end_of_current_element(context->key);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_keyer()
+
+   See cw_wait_for_keyer() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_keyer(cw_context_t * context)
+{
+	return cw_key_ik_wait_for_keyer(context->key);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_wait_for_keyer_async()
+
+   See cw_wait_for_keyer_async() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_wait_for_keyer_async(cw_context_t * context, void (*callback_func)(void*), void *callback_arg, int *fd)
+{
+	return cw_key_ik_wait_for_keyer_async(context->key, callback_func, callback_arg, fd);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_keyer()
+
+   See cw_reset_keyer() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_keyer(cw_context_t * context)
+{
+	cw_key_ik_reset_internal(context->key);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_notify_straight_key_event()
+
+   See cw_notify_straight_key_event() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_notify_straight_key_event(cw_context_t * context, int key_state)
+{
+	return cw_key_sk_set_value(context->key, key_state);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_get_straight_key_state()
+
+   See cw_get_straight_key_state() for details.
+
+   \param context - context to operate on
+*/
+int cw_context_get_straight_key_state(cw_context_t * context)
+{
+	cw_key_value_t key_value = CW_KEY_VALUE_OPEN;
+	cw_key_sk_get_value(context->key, &key_value);
+	return (int) key_value;
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_is_straight_key_busy()
+
+   See cw_is_straight_key_busy() for details.
+
+   \param context - context to operate on
+*/
+bool cw_context_is_straight_key_busy(cw_context_t * context)
+{
+	return CW_KEY_STATE_CLOSED == cw_context_get_straight_key_state(context);
+}
+
+
+
+
+
+/**
+   \brief Context variant of cw_reset_straight_key()
+
+   See cw_reset_straight_key() for details.
+
+   \param context - context to operate on
+*/
+void cw_context_reset_straight_key(cw_context_t * context)
+{
+	cw_key_sk_reset_internal(context->key);
+	return;
+}
@@ -0,0 +1,51 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_CONTEXT
+#define H_LIBCW_CONTEXT
+
+
+
+
+#include <stdbool.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+struct cw_context_struct {
+	cw_gen_t * gen;
+	cw_rec_t * rec;
+	volatile cw_key_t * key;
+
+	/* Key allocated by cw_context_new(). NULL in default context. */
+	cw_key_t * own_key;
+
+	/* Default context uses global receiver and key, and can't be
+	   deleted. */
+	bool is_default;
+};
+
+
+
+
+extern cw_context_t cw_default_context;
+
+
+
+
+int cw_context_generator_new_internal(cw_context_t * context, const cw_gen_config_t * gen_conf);
+void cw_context_generator_delete_internal(cw_context_t * context);
+
+
+
+
+#endif /* #ifndef H_LIBCW_CONTEXT */
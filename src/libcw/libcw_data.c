@@ -38,6 +38,8 @@
 
 
 
+#include "config.h"
+
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h> /* UCHAR_MAX */
@@ -79,10 +81,11 @@ static __attribute__((constructor)) void cw_data_constructor_internal(void);
   representing Dot.  The table ends with a NULL entry.
 
   Notice that ASCII characters are stored as uppercase characters.
+
+  Lookup tables for this table are generated at build time by
+  libdata.awk, so any change to format of the table must be
+  reflected in the script.
 */
-static size_t g_main_table_maximum_representation_length;
-static int g_main_table_characters_count;
-static const cw_entry_t * g_main_table_fast_lookup[UCHAR_MAX];  /* Fast lookup table */
 const cw_entry_t CW_TABLE[] = { /* TODO: make it accessible through function only, and add static keyword. */
 	/* ASCII 7bit letters */
 	{'A', ".-"  },  {'B', "-..."},  {'C', "-.-."},
@@ -137,6 +140,20 @@ const cw_entry_t CW_TABLE[] = { /* TODO: make it accessible through function onl
 
 
 
+/* Constant lookup tables for CW_TABLE: g_main_table_fast_lookup[]
+   (character -> entry) and g_representation_lookup[] (hash of
+   representation -> entry), generated from CW_TABLE at build time.
+   They need no initialization at run time and can be used from any
+   thread. */
+#include "libcw_data_tables.h"
+
+#if CW_DATA_MAIN_TABLE_MAXIMUM_REPRESENTATION_LENGTH > CW_DATA_MAX_REPRESENTATION_LENGTH
+#error "Representations in CW_TABLE are too long to be hashed"
+#endif
+
+
+
+
 /**
    @brief Return the number of characters present in main character lookup table
 
@@ -165,7 +182,7 @@ int cw_get_character_count(void)
 		}
 	}
 #endif
-	return g_main_table_characters_count;
+	return CW_DATA_MAIN_TABLE_CHARACTERS_COUNT;
 }
 
 
@@ -242,7 +259,7 @@ int cw_get_maximum_representation_length(void)
 		}
 	}
 #endif
-	return (int) g_main_table_maximum_representation_length;
+	return CW_DATA_MAIN_TABLE_MAXIMUM_REPRESENTATION_LENGTH;
 }
 
 
@@ -294,9 +311,8 @@ const char * cw_character_to_representation_internal(int character)
 	character = toupper(character);
 
 	/* Now use the table to lookup the table entry.  Unknown characters
-	   return NULL, courtesy of the fact that explicitly uninitialized
-	   static variables are initialized to zero, so lookup[x] is NULL
-	   if it's not assigned to in the above loop. */
+	   return NULL, because entries that are not explicitly initialized
+	   in the generated table are NULL. */
 	const cw_entry_t * cw_entry = g_main_table_fast_lookup[(unsigned char) character];
 
 	/* Lookups code may be called frequently, so first do a rough
@@ -353,8 +369,8 @@ int cw_lookup_character(char character, char * representation)
 	const char * looked_up = cw_character_to_representation_internal(character);
 	if (looked_up) {
 		if (representation) {
-			strncpy(representation, looked_up, g_main_table_maximum_representation_length);
-			representation[g_main_table_maximum_representation_length] = '\0';
+			strncpy(representation, looked_up, CW_DATA_MAIN_TABLE_MAXIMUM_REPRESENTATION_LENGTH);
+			representation[CW_DATA_MAIN_TABLE_MAXIMUM_REPRESENTATION_LENGTH] = '\0';
 		}
 		return CW_SUCCESS;
 	}
@@ -492,6 +508,35 @@ unsigned int cw_representation_to_hash_internal(const char * representation)
 
 
 
+/**
+   @brief Return character corresponding to given hash of representation
+
+   Counterpart of cw_representation_to_character_internal() for code
+   that builds the hash of a representation incrementally (see
+   cw_representation_to_hash_internal() for the algorithm), e.g. the
+   receiver. No string handling is involved.
+
+   Representations that can't be hashed (longer than
+   CW_DATA_MAX_REPRESENTATION_LENGTH) can't be found by this
+   function.
+
+   @param[in] hash hash of representation
+
+   @return zero if there is no character for given hash
+   @return non-zero character corresponding to given hash otherwise
+*/
+int cw_representation_hash_to_character_internal(unsigned int hash)
+{
+	if (hash < CW_DATA_MIN_REPRESENTATION_HASH || hash > CW_DATA_MAX_REPRESENTATION_HASH) {
+		return 0;
+	}
+
+	return g_representation_lookup[hash] ? g_representation_lookup[hash]->character : 0;
+}
+
+
+
+
 /**
    @brief Return character corresponding to given representation
 
@@ -511,65 +556,15 @@ unsigned int cw_representation_to_hash_internal(const char * representation)
 */
 int cw_representation_to_character_internal(const char * representation)
 {
-	static const cw_entry_t * lookup[UCHAR_MAX];  /* Fast lookup table */
-	static bool is_complete = true;               /* Set to false if there are any
-							 lookup table entries not in
-							 the fast lookup table */
-	static bool is_initialized = false;
-
-	/* If this is the first call, set up the fast lookup table to give direct
-	   access to the CW table for a hashed representation. */
-	if (!is_initialized) {
-		/* TODO: move the initialization to cw_data_constructor_internal(). */
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-			      MSG_PREFIX "initialize hash lookup table");
-		is_complete = CW_SUCCESS == cw_data_init_r2c_hash_table_internal(lookup);
-		is_initialized = true;
-	}
-
 	/* Hash the representation to get an index for the fast lookup. */
 	/* TODO: shouldn't this be uint8_t? */
-	unsigned int hash = cw_representation_to_hash_internal(representation);
-
-	const cw_entry_t * cw_entry = NULL;
-	/* If the hashed lookup table is complete, we can simply believe any
-	   hash value that came back.  That is, we just use what is at the index
-	   "hash", since this is either the entry we want, or NULL. */
-	if (is_complete) {
-		cw_entry = lookup[hash];
-	} else {
-		/* Impossible, since test_cw_representation_to_hash_internal()
-		   passes without problems for all valid representations.
+	const unsigned int hash = cw_representation_to_hash_internal(representation);
 
-		   Debug message is already displayed in
-		   cw_data_init_r2c_hash_table_internal(). */
-
-		/* The lookup table is incomplete, but it doesn't have
-		   to be that we are missing entry for this particular
-		   hash.
-
-		   Try to find the entry in lookup table anyway, maybe
-		   it exists.
-
-		   TODO: create tests to find situation where lookup
-		   table is incomplete. */
-		if (hash && lookup[hash] && lookup[hash]->representation
-		    && strcmp(lookup[hash]->representation, representation) == 0) {
-			/* Found it in an incomplete table. */
-			cw_entry = lookup[hash];
-		} else {
-			/* We have no choice but to search the table entry
-			   by entry, sequentially, from top to bottom. */
-			for (cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-				if (0 == strcmp(cw_entry->representation, representation)) {
-					break;
-				}
-			}
-
-			/* If we got to the end of the table, prepare to return zero. */
-			cw_entry = cw_entry->character ? cw_entry : NULL;
-		}
-	}
+	/* The lookup table is complete (libdata.awk fails otherwise), so
+	   we can simply believe any hash value that came back.  Invalid
+	   representations have zero hash, and entry at zero index is
+	   NULL. */
+	const cw_entry_t * cw_entry = g_representation_lookup[hash];
 
 
 	/* Lookups code may be called frequently, so first do a rough
@@ -640,89 +635,6 @@ int cw_representation_to_character_direct_internal(const char * representation)
 
 
 
-/**
-   @brief Initialize representation-to-character lookup table
-
-   Initialize @p table with values from CW_TABLE (of type cw_entry_t).
-   The table is indexed with hashed representations of cw_entry_t->representation
-   strings.
-
-   @p table must be large enough to store all entries, caller must
-   make sure that the condition is met.
-
-   On failure function returns CW_FAILURE.
-   On success the function returns CW_SUCCESS. Successful execution of
-   the function is when all representations from CW_TABLE have valid
-   hashes, and all entries from CW_TABLE have been put into @p table.
-
-   First condition of function's success, mentioned above, should be
-   always true because the CW_TABLE has been created once and it
-   doesn't change, and all representations in the table are valid.
-   Second condition of function's success, mentioned above, should be
-   also always true because first condition is always true.
-
-   The initialization may fail under one condition: if the lookup
-   functions should operate on non-standard character table, other
-   than CW_TABLE. For now it's impossible, because there is no way for
-   client code to provide its own table of CW characters.
-
-   @internal
-   @reviewed 2020-07-26
-   @endinternal
-
-   @param[in] table lookup table to be initialized
-
-   @return CW_SUCCESS on success
-   @return CW_FAILURE otherwise
-*/
-cw_ret_t cw_data_init_r2c_hash_table_internal(const cw_entry_t * table[])
-{
-	/* For each main table entry, create a hash entry.  If the
-	   hashing of any entry fails, note that the table is not
-	   complete and ignore that entry for now (for the current
-	   main table (CW_TABLE) this should not happen).  The hashed
-	   table speeds up representation-to-character lookups by a factor of
-	   5-10.
-
-	   NOTICE: Notice that the lookup table will be marked as
-	   incomplete only if one or more representations in CW_TABLE
-	   aren't valid (i.e. they are made of anything more than '.'
-	   or '-'). This wouldn't be a logic error, this would be an
-	   error with invalid input. Such invalid input shouldn't
-	   happen in properly built characters table.
-
-	   So perhaps returning "false" tells us more about input
-	   CW_TABLE than about lookup table.
-
-	   Other possibility to consider is that "is_complete = false"
-	   when length of representation is longer than
-	   CW_DATA_MAX_REPRESENTATION_LENGTH Dots/Dashes. There is an
-	   assumption that no representation in input CW_TABLE is
-	   longer than CW_DATA_MAX_REPRESENTATION_LENGTH
-	   dots/dashes. */
-
-	bool is_complete = true;
-	for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-		/* TODO: uint8_t instead of unsigned int. */
-		unsigned int hash = cw_representation_to_hash_internal(cw_entry->representation);
-		if (hash) {
-			table[hash] = cw_entry;
-		} else {
-			is_complete = false;
-		}
-	}
-
-	if (!is_complete) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_WARNING,
-			      MSG_PREFIX "hash lookup table incomplete");
-	}
-
-	return is_complete ? CW_SUCCESS : CW_FAILURE;
-}
-
-
-
-
 /**
    @brief Check if representation of a character is valid
 
@@ -1382,6 +1294,400 @@ int cw_check_string(const char * string)
 
 
 
+/* ******************************************************************** */
+/*                         Section:Alphabets                            */
+/* ******************************************************************** */
+
+
+
+
+/*
+  Tables of alphabets. Characters are Unicode code points of
+  uppercase letters. Just like for CW_TABLE, lookup tables for these
+  tables are generated at build time by libdata.awk. If several
+  characters of alphabet have the same representation, the first of
+  them is the one that is received.
+*/
+
+static const cw_alphabet_entry_t CW_TABLE_CYRILLIC[] = {
+	{0x0410, ".-"   },  {0x0411, "-..." },  {0x0412, ".--"  },  /* А Б В */
+	{0x0413, "--."  },  {0x0414, "-.."  },  {0x0415, "."    },  /* Г Д Е */
+	{0x0416, "...-" },  {0x0417, "--.." },  {0x0418, ".."   },  /* Ж З И */
+	{0x0419, ".---" },  {0x041A, "-.-"  },  {0x041B, ".-.." },  /* Й К Л */
+	{0x041C, "--"   },  {0x041D, "-."   },  {0x041E, "---"  },  /* М Н О */
+	{0x041F, ".--." },  {0x0420, ".-."  },  {0x0421, "..."  },  /* П Р С */
+	{0x0422, "-"    },  {0x0423, "..-"  },  {0x0424, "..-." },  /* Т У Ф */
+	{0x0425, "...." },  {0x0426, "-.-." },  {0x0427, "---." },  /* Х Ц Ч */
+	{0x0428, "----" },  {0x0429, "--.-" },  {0x042A, "--.--"},  /* Ш Щ Ъ */
+	{0x042B, "-.--" },  {0x042C, "-..-" },  {0x042D, "..-.."},  /* Ы Ь Э */
+	{0x042E, "..--" },  {0x042F, ".-.-" },                      /* Ю Я */
+	{0x0401, "."    },  /* Ё, sent as Е */
+
+	{0, NULL} /* Guard. */
+};
+
+static const cw_alphabet_entry_t CW_TABLE_GREEK[] = {
+	{0x0391, ".-"   },  {0x0392, "-..." },  {0x0393, "--."  },  /* Α Β Γ */
+	{0x0394, "-.."  },  {0x0395, "."    },  {0x0396, "--.." },  /* Δ Ε Ζ */
+	{0x0397, "...." },  {0x0398, "-.-." },  {0x0399, ".."   },  /* Η Θ Ι */
+	{0x039A, "-.-"  },  {0x039B, ".-.." },  {0x039C, "--"   },  /* Κ Λ Μ */
+	{0x039D, "-."   },  {0x039E, "-..-" },  {0x039F, "---"  },  /* Ν Ξ Ο */
+	{0x03A0, ".--." },  {0x03A1, ".-."  },  {0x03A3, "..."  },  /* Π Ρ Σ */
+	{0x03A4, "-"    },  {0x03A5, "-.--" },  {0x03A6, "..-." },  /* Τ Υ Φ */
+	{0x03A7, "----" },  {0x03A8, "--.-" },  {0x03A9, ".--"  },  /* Χ Ψ Ω */
+
+	{0, NULL} /* Guard. */
+};
+
+static const cw_alphabet_entry_t CW_TABLE_WABUN[] = {
+	{0x30A4, ".-"    },  {0x30ED, ".-.-"  },  {0x30CF, "-..."  },  /* イ ロ ハ */
+	{0x30CB, "-.-."  },  {0x30DB, "-.."   },  {0x30D8, "."     },  /* ニ ホ ヘ */
+	{0x30C8, "..-.." },  {0x30C1, "..-."  },  {0x30EA, "--."   },  /* ト チ リ */
+	{0x30CC, "...."  },  {0x30EB, "-.--." },  {0x30F2, ".---"  },  /* ヌ ル ヲ */
+	{0x30EF, "-.-"   },  {0x30AB, ".-.."  },  {0x30E8, "--"    },  /* ワ カ ヨ */
+	{0x30BF, "-."    },  {0x30EC, "---"   },  {0x30BD, "---."  },  /* タ レ ソ */
+	{0x30C4, ".--."  },  {0x30CD, "--.-"  },  {0x30CA, ".-."   },  /* ツ ネ ナ */
+	{0x30E9, "..."   },  {0x30E0, "-"     },  {0x30A6, "..-"   },  /* ラ ム ウ */
+	{0x30F0, ".-..-" },  {0x30CE, "..--"  },  {0x30AA, ".-..." },  /* ヰ ノ オ */
+	{0x30AF, "...-"  },  {0x30E4, ".--"   },  {0x30DE, "-..-"  },  /* ク ヤ マ */
+	{0x30B1, "-.--"  },  {0x30D5, "--.."  },  {0x30B3, "----"  },  /* ケ フ コ */
+	{0x30A8, "-.---" },  {0x30C6, ".-.--" },  {0x30A2, "--.--" },  /* エ テ ア */
+	{0x30B5, "-.-.-" },  {0x30AD, "-.-.." },  {0x30E6, "-..--" },  /* サ キ ユ */
+	{0x30E1, "-...-" },  {0x30DF, "..-.-" },  {0x30B7, "--.-." },  /* メ ミ シ */
+	{0x30F1, ".--.." },  {0x30D2, "--..-" },  {0x30E2, "-..-." },  /* ヱ ヒ モ */
+	{0x30BB, ".---." },  {0x30B9, "---.-" },  {0x30F3, ".-.-." },  /* セ ス ン */
+
+	{0x309B, ".."     },  /* Dakuten */
+	{0x309C, "..--."  },  /* Handakuten */
+	{0x30FC, ".--.-"  },  /* Long vowel mark */
+	{0x3001, ".-.-.-" },  /* Ideographic comma */
+
+	{0, NULL} /* Guard. */
+};
+
+static const cw_alphabet_entry_t CW_TABLE_LATIN_EXTENDED[] = {
+	{0x00C4, ".-.-"   },  /* A with diaeresis */
+	{0x00C1, ".--.-"  },  /* A with acute */
+	{0x00C7, "-.-.."  },  /* C with cedilla */
+	{0x00D0, "..--."  },  /* Eth */
+	{0x00C9, "..-.."  },  /* E with acute */
+	{0x00C8, ".-..-"  },  /* E with grave */
+	{0x011C, "--.-."  },  /* G with circumflex */
+	{0x0134, ".---."  },  /* J with circumflex */
+	{0x00D1, "--.--"  },  /* N with tilde */
+	{0x00D6, "---."   },  /* O with diaeresis */
+	{0x0160, "----"   },  /* S with caron */
+	{0x015A, "...-..." }, /* S with acute */
+	{0x015C, "...-."  },  /* S with circumflex */
+	{0x00DE, ".--.."  },  /* Thorn */
+	{0x00DC, "..--"   },  /* U with diaeresis */
+	{0x0179, "--..-." },  /* Z with acute */
+	{0x017B, "--..-"  },  /* Z with dot above */
+
+	/* Characters sent with representations of characters above. */
+	{0x00C0, ".--.-"  },  /* A with grave */
+	{0x00C5, ".--.-"  },  /* A with ring above */
+	{0x00C6, ".-.-"   },  /* AE */
+	{0x0104, ".-.-"   },  /* A with ogonek */
+	{0x0106, "-.-.."  },  /* C with acute */
+	{0x0108, "-.-.."  },  /* C with circumflex */
+	{0x0118, "..-.."  },  /* E with ogonek */
+	{0x0124, "----"   },  /* H with circumflex */
+	{0x0141, ".-..-"  },  /* L with stroke */
+	{0x0143, "--.--"  },  /* N with acute */
+	{0x00D3, "---."   },  /* O with acute */
+	{0x00D8, "---."   },  /* O with stroke */
+	{0x015E, "----"   },  /* S with cedilla */
+	{0x016C, "..--"   },  /* U with breve */
+
+	{0, NULL} /* Guard. */
+};
+
+
+
+
+static const cw_alphabet_entry_t * const g_alphabet_entries[CW_ALPHABET_COUNT] = {
+	[CW_ALPHABET_ITU]            = NULL,
+	[CW_ALPHABET_CYRILLIC]       = CW_TABLE_CYRILLIC,
+	[CW_ALPHABET_GREEK]          = CW_TABLE_GREEK,
+	[CW_ALPHABET_WABUN]          = CW_TABLE_WABUN,
+	[CW_ALPHABET_LATIN_EXTENDED] = CW_TABLE_LATIN_EXTENDED,
+};
+
+static const cw_alphabet_tables_t * const g_alphabet_tables[CW_ALPHABET_COUNT] = {
+	[CW_ALPHABET_ITU]            = NULL,
+	[CW_ALPHABET_CYRILLIC]       = &g_cyrillic_tables,
+	[CW_ALPHABET_GREEK]          = &g_greek_tables,
+	[CW_ALPHABET_WABUN]          = &g_wabun_tables,
+	[CW_ALPHABET_LATIN_EXTENDED] = &g_latin_extended_tables,
+};
+
+
+
+
+/**
+   @brief Get lookup tables of given alphabet
+
+   @param[in] alphabet alphabet
+
+   @return lookup tables of alphabet
+   @return NULL for CW_ALPHABET_ITU or invalid alphabet
+*/
+const cw_alphabet_tables_t * cw_alphabet_tables_internal(cw_alphabet_t alphabet)
+{
+	if ((int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		return NULL;
+	}
+	return g_alphabet_tables[alphabet];
+}
+
+
+
+
+/**
+   @brief Convert given code point to uppercase
+
+   Only blocks of Unicode used by alphabets (Basic Latin, Latin-1
+   Supplement, Latin Extended-A, Greek, Cyrillic) are handled. Other
+   code points are returned unchanged.
+
+   @param[in] code_point code point to convert
+
+   @return code point of uppercase character
+*/
+uint32_t cw_code_point_to_upper_internal(uint32_t code_point)
+{
+	if (code_point < 0x80) {
+		return (uint32_t) toupper((int) code_point);
+	} else if (code_point >= 0xE0 && code_point <= 0xFE && code_point != 0xF7) {
+		return code_point - 0x20;
+	} else if (code_point >= 0x100 && code_point <= 0x17E) {
+		/* In parts of the block lowercase letters have odd code
+		   points, in other parts they have even ones. */
+		const bool lower_is_odd = code_point < 0x139 || (code_point > 0x148 && code_point < 0x179);
+		if (code_point == 0x138 || code_point == 0x149) {
+			return code_point; /* Kra and apostrophe N have no uppercase. */
+		}
+		return ((code_point & 1U) == lower_is_odd) ? code_point - 1 : code_point;
+	} else if (code_point == 0x3C2) {
+		return 0x3A3; /* Final sigma. */
+	} else if (code_point >= 0x3B1 && code_point <= 0x3C9) {
+		return code_point - 0x20;
+	} else if (code_point >= 0x430 && code_point <= 0x44F) {
+		return code_point - 0x20;
+	} else if (code_point >= 0x450 && code_point <= 0x45F) {
+		return code_point - 0x50;
+	} else {
+		return code_point;
+	}
+}
+
+
+
+
+/**
+   @brief Return code point corresponding to given hash of representation
+
+   Counterpart of cw_representation_hash_to_character_internal() for
+   alphabets. Letter of alphabet is returned if there is one for the
+   @p hash, otherwise ASCII character of main table is returned.
+
+   @param[in] tables lookup tables of alphabet (may be NULL)
+   @param[in] hash hash of representation
+
+   @return zero if there is no character for given hash
+   @return code point of character corresponding to given hash otherwise
+*/
+uint32_t cw_alphabet_hash_to_code_point_internal(const cw_alphabet_tables_t * tables, unsigned int hash)
+{
+	if (hash < CW_DATA_MIN_REPRESENTATION_HASH || hash > CW_DATA_MAX_REPRESENTATION_HASH) {
+		return 0;
+	}
+
+	if (NULL != tables && 0 != tables->hash_to_code_point[hash]) {
+		return tables->hash_to_code_point[hash];
+	}
+
+	/* Non-ASCII characters of main table are bytes of ISO 8859
+	   charsets, not code points. */
+	const int character = cw_representation_hash_to_character_internal(hash);
+	return (character > 0 && character < 0x80) ? (uint32_t) character : 0;
+}
+
+
+
+
+/**
+   @brief Return representation of given code point
+
+   Counterpart of cw_character_to_representation_internal() for
+   alphabets. Lowercase letters are looked up as uppercase ones.
+
+   @param[in] tables lookup tables of alphabet (may be NULL)
+   @param[in] code_point code point to look up
+
+   @return pointer to static string with representation of character on success
+   @return NULL if @p code_point has no representation
+*/
+const char * cw_alphabet_code_point_to_representation_internal(const cw_alphabet_tables_t * tables, uint32_t code_point)
+{
+	if (code_point < 0x80) {
+		/* Tables of alphabets have no ASCII characters. */
+		return cw_character_to_representation_internal((int) code_point);
+	}
+	if (NULL == tables) {
+		return NULL;
+	}
+
+	code_point = cw_code_point_to_upper_internal(code_point);
+	const cw_alphabet_slot_t * slot = &tables->slots[code_point % tables->n_slots];
+	if (0 == slot->code_point || code_point != slot->code_point) {
+		return NULL;
+	}
+	return g_hash_representations[slot->hash];
+}
+
+
+
+
+/**
+   @brief Return code point corresponding to given representation
+
+   Counterpart of cw_representation_to_character_direct_internal() for
+   alphabets: function traverses table of alphabet and main table
+   without using lookup tables. The function has been created for
+   libcw tests, for verification of lookup tables.
+
+   @param[in] alphabet alphabet
+   @param[in] representation representation of a character to look up
+
+   @return zero if there is no character for given representation
+   @return code point of character corresponding to given representation otherwise
+*/
+uint32_t cw_alphabet_representation_to_code_point_direct_internal(cw_alphabet_t alphabet, const char * representation)
+{
+	if ((int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		return 0;
+	}
+
+	if (NULL != g_alphabet_entries[alphabet]) {
+		for (const cw_alphabet_entry_t * entry = g_alphabet_entries[alphabet]; entry->code_point; entry++) {
+			if (0 == strcmp(entry->representation, representation)) {
+				return entry->code_point;
+			}
+		}
+	}
+
+	const int character = cw_representation_to_character_direct_internal(representation);
+	return (character > 0 && character < 0x80) ? (uint32_t) character : 0;
+}
+
+
+
+
+/**
+   @brief Decode first character of UTF-8 string
+
+   Overlong encodings, surrogates and code points above U+10FFFF are
+   rejected.
+
+   @param[in] string UTF-8 string, not empty
+   @param[out] code_point decoded code point
+
+   @return count of bytes of decoded character on success
+   @return zero if @p string doesn't start with valid UTF-8 character
+*/
+int cw_utf8_decode_internal(const char * string, uint32_t * code_point)
+{
+	const unsigned char * s = (const unsigned char *) string;
+
+	int length;
+	uint32_t cp;
+	uint32_t min;
+	if (s[0] < 0x80) {
+		*code_point = s[0];
+		return 1;
+	} else if ((s[0] & 0xE0) == 0xC0) {
+		length = 2;
+		cp = s[0] & 0x1FU;
+		min = 0x80;
+	} else if ((s[0] & 0xF0) == 0xE0) {
+		length = 3;
+		cp = s[0] & 0x0FU;
+		min = 0x800;
+	} else if ((s[0] & 0xF8) == 0xF0) {
+		length = 4;
+		cp = s[0] & 0x07U;
+		min = 0x10000;
+	} else {
+		return 0;
+	}
+
+	for (int i = 1; i < length; i++) {
+		if ((s[i] & 0xC0) != 0x80) {
+			return 0; /* Also catches terminating NUL. */
+		}
+		cp = (cp << 6) | (s[i] & 0x3FU);
+	}
+
+	if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+		return 0;
+	}
+
+	*code_point = cp;
+	return length;
+}
+
+
+
+
+const char * cw_alphabet_code_point_to_representation(cw_alphabet_t alphabet, uint32_t code_point)
+{
+	if ((int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	const char * representation = cw_alphabet_code_point_to_representation_internal(g_alphabet_tables[alphabet], code_point);
+	if (NULL == representation) {
+		errno = ENOENT;
+	}
+	return representation;
+}
+
+
+
+
+uint32_t cw_alphabet_representation_to_code_point(cw_alphabet_t alphabet, const char * representation)
+{
+	if ((int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT || NULL == representation) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const unsigned int hash = cw_representation_to_hash_internal(representation);
+	const uint32_t code_point = cw_alphabet_hash_to_code_point_internal(g_alphabet_tables[alphabet], hash);
+	if (0 == code_point) {
+		errno = ENOENT;
+	}
+	return code_point;
+}
+
+
+
+
+int cw_alphabet_get_character_count(cw_alphabet_t alphabet)
+{
+	if ((int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		errno = EINVAL;
+		return 0;
+	}
+	return NULL == g_alphabet_tables[alphabet] ? 0 : g_alphabet_tables[alphabet]->characters_count;
+}
+
+
+
+
 // @cond LIBCW_INTERNAL
 
 /**
@@ -1403,25 +1709,6 @@ void cw_data_constructor_internal(void)
 
 
 
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-		      MSG_PREFIX "initializing main fast lookup table");
-	for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-
-		/* Initialize lookup table for main characters. */
-		g_main_table_fast_lookup[(unsigned char) cw_entry->character] = cw_entry;
-
-		/* Calculate the length of the longest representation in main lookup table. */
-		const size_t length = strlen(cw_entry->representation);
-		if (length > g_main_table_maximum_representation_length) {
-			g_main_table_maximum_representation_length = length;
-		}
-
-		/* Calculate count of characters in main lookup table. */
-		g_main_table_characters_count++;
-	}
-
-
-
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
 		      MSG_PREFIX "initialize prosign fast lookup table");
 	for (const cw_prosign_entry_t * entry = g_prosign_table; entry->character; entry++) {
@@ -38,16 +38,52 @@ typedef struct cw_entry_struct {
 
 
 
+/* Entry of table of alphabet: Unicode code point of (uppercase)
+   character and its representation. */
+typedef struct cw_alphabet_entry_struct {
+	const uint32_t code_point;
+	const char *const representation;
+} cw_alphabet_entry_t;
+
+/* Slot of table of code points of alphabet, indexed with code point
+   modulo size of the table. */
+typedef struct cw_alphabet_slot_struct {
+	uint16_t code_point;  /* Zero for empty slot. */
+	uint8_t hash;         /* Hash of representation of the code point. */
+} cw_alphabet_slot_t;
+
+/* Lookup tables of alphabet, generated at build time by libdata.awk. */
+typedef struct cw_alphabet_tables_struct {
+	const uint16_t * hash_to_code_point;  /* CW_DATA_MAX_REPRESENTATION_HASH + 1 items. */
+	const cw_alphabet_slot_t * slots;
+	uint16_t n_slots;
+	uint16_t characters_count;
+} cw_alphabet_tables_t;
+
+
+
+
 
 /* Functions handling representation of a character.
    Representation looks like this: ".-" for "a", "--.." for "z", etc. */
-cw_ret_t cw_data_init_r2c_hash_table_internal(const cw_entry_t * table[]);
 int cw_representation_to_character_internal(const char * representation);
 int cw_representation_to_character_direct_internal(const char * representation);
 unsigned int cw_representation_to_hash_internal(const char * representation); /* TODO: uint8_t return value (or maybe uint16_t?). */
+int cw_representation_hash_to_character_internal(unsigned int hash);
 const char * cw_character_to_representation_internal(int character);
 const char * cw_lookup_procedural_character_internal(int character, bool * is_usually_expanded);
 
+/* Functions handling characters of alphabets (see cw_alphabet_t).
+   Lookups with NULL tables (CW_ALPHABET_ITU) and lookups of
+   characters missing in alphabet fall back to ASCII characters of
+   main table. */
+const cw_alphabet_tables_t * cw_alphabet_tables_internal(cw_alphabet_t alphabet);
+uint32_t cw_alphabet_hash_to_code_point_internal(const cw_alphabet_tables_t * tables, unsigned int hash);
+const char * cw_alphabet_code_point_to_representation_internal(const cw_alphabet_tables_t * tables, uint32_t code_point);
+uint32_t cw_alphabet_representation_to_code_point_direct_internal(cw_alphabet_t alphabet, const char * representation);
+uint32_t cw_code_point_to_upper_internal(uint32_t code_point);
+int cw_utf8_decode_internal(const char * string, uint32_t * code_point);
+
 
 
 
@@ -326,8 +326,7 @@ void cw_dev_debug_print_generator_setup_internal(const cw_gen_t * gen)
 	fprintf(stderr, "picked sound device:  \"%s\"\n",  gen->picked_device_name);
 	fprintf(stderr, "sample rate:          %u Hz\n",  gen->sample_rate);
 
-	/* Temporarily disabled because gen->pa_data.ba is missing. */
-#if 0 // def LIBCW_WITH_PULSEAUDIO
+#ifdef LIBCW_WITH_PULSEAUDIO
 	if (gen->sound_system == CW_AUDIO_PA) {
 		fprintf(stderr, "PulseAudio latency:   %llu us\n", (unsigned long long int) gen->pa_data.latency_usecs);
 
@@ -366,6 +365,16 @@ void cw_dev_debug_print_generator_setup_internal(const cw_gen_t * gen)
 	}
 #endif // #ifdef LIBCW_WITH_PULSEAUDIO
 
+#ifdef LIBCW_WITH_JACK
+	if (gen->sound_system == CW_AUDIO_JACK) {
+		fprintf(stderr, "JACK latency:         %u frames\n", (unsigned int) gen->jack_data.latency_n_frames);
+	}
+#endif
+
+	if (gen->sound_system == CW_AUDIO_RTP) {
+		fprintf(stderr, "RTP destinations:     %d\n", gen->rtp_data.n_sockets);
+	}
+
 	fprintf(stderr, "send speed:           %d wpm\n", gen->send_speed);
 	fprintf(stderr, "volume:               %d %%\n",  gen->volume_percent);
 	fprintf(stderr, "frequency:            %d Hz\n",  gen->frequency);
@@ -88,16 +88,31 @@ uint32_t cw_get_debug_flags(void)              __attribute__ ((deprecated));
 
 
 
+/*
+  Lowest level of debug messages compiled into the code. Defined by
+  configure's --with-debug-level option. Calls of cw_debug_msg() with
+  constant level lower than this are removed by compiler, so release
+  builds don't pay for test of debug object's level and flags.
+
+  Code that doesn't include config.h gets all messages compiled in.
+*/
+#if !defined(LIBCW_DEBUG_LEVEL_MIN)
+#define LIBCW_DEBUG_LEVEL_MIN 0 /* CW_DEBUG_DEBUG */
+#endif
+
+
+
+
 #define cw_debug_msg(debug_object, flag, debug_level, ...) {	\
-	if ((debug_level) >= (debug_object)->level) {		\
-		if ((debug_object)->flags & (uint32_t) (flag)) {		\
-			fprintf(stderr, "%s ", (debug_object)->level_labels[(debug_level)]); \
-			if ((debug_level) == CW_DEBUG_DEBUG || (debug_level) == CW_DEBUG_ERROR) { \
-				fprintf(stderr, "%s: %d: ", __func__, __LINE__); \
-			}						\
-			fprintf(stderr, __VA_ARGS__);			\
-			fprintf(stderr, "\n");				\
+	if ((debug_level) >= LIBCW_DEBUG_LEVEL_MIN			\
+	    && __builtin_expect((debug_level) >= (debug_object)->level \
+				&& ((debug_object)->flags & (uint32_t) (flag)), 0)) { \
+		fprintf(stderr, "%s ", (debug_object)->level_labels[(debug_level)]); \
+		if ((debug_level) == CW_DEBUG_DEBUG || (debug_level) == CW_DEBUG_ERROR) { \
+			fprintf(stderr, "%s: %d: ", __func__, __LINE__); \
 		}							\
+		fprintf(stderr, __VA_ARGS__);				\
+		fprintf(stderr, "\n");					\
 	}								\
 }
 
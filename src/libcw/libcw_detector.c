@@ -0,0 +1,755 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_detector.c
+
+   @brief Tone detector. Detect marks and spaces in PCM sound, feed them
+   to receiver.
+
+   Client code passes blocks of PCM samples (16 bit, mono) of arbitrary
+   size to the detector. The samples are split into Goertzel blocks of
+   fixed duration, and for each Goertzel block the detector calculates
+   magnitude of configured tone frequency.
+
+   The magnitudes are passed through an envelope follower that tracks
+   peak level of tone and noise floor. A mark begins when the magnitude
+   crosses "mark threshold" (placed between noise floor and peak level),
+   and ends when the magnitude drops below "space threshold". The two
+   thresholds make a hysteresis that prevents chattering on noisy
+   signal.
+
+   Beginnings and ends of marks are timestamped with time of middle of
+   Goertzel block in which the transition has been detected, and are
+   passed to receiver with cw_rec_mark_begin_ns() and
+   cw_rec_mark_end_ns(). Client code gets received characters by polling
+   the receiver, using cw_detector_get_timestamp() as "now".
+
+   The Goertzel recurrence costs one multiplication and two additions per
+   sample; block-level processing (magnitude, envelope follower) runs a
+   few hundred times per second. At 48 kHz this is a tiny fraction of a
+   percent of a CPU core.
+
+   Optional automatic frequency control (AFC) follows a tone that is
+   not exactly on detector's frequency, or that drifts. In every
+   CW_DETECTOR_AFC_INTERVAL-th block two additional Goertzel filters,
+   placed half of detector's bandwidth below and above tracked
+   frequency, measure the tone. During marks the difference of their
+   magnitudes moves the tracked frequency toward the tone. This adds
+   2 / CW_DETECTOR_AFC_INTERVAL to cost of the recurrence.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t, PRId64 */
+#include <math.h>  /* sqrtf(), cosf() */
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_detector.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/detector: "
+
+
+
+
+/* Time constants of envelope follower [us]. Peak level falls slowly
+   to noise floor during long spaces. Noise floor falls quickly, and
+   rises slowly during spaces and very slowly during marks. */
+enum { CW_DETECTOR_PEAK_DECAY_TIME = 2000000 };
+enum { CW_DETECTOR_NOISE_FALL_TIME = 20000 };
+enum { CW_DETECTOR_NOISE_TRACK_TIME = 200000 };
+enum { CW_DETECTOR_NOISE_RISE_TIME = 5000000 };
+
+/* Squelch: don't detect marks when peak level is less than this many
+   times above noise floor (12 dB), or less than this absolute amplitude
+   (in units of 16-bit samples). Random peaks of noise-only signal stay
+   below the ratio. */
+#define CW_DETECTOR_SQUELCH_RATIO      4.0f
+#define CW_DETECTOR_SQUELCH_AMPLITUDE  16.0f
+
+/* Fraction of measured offset of tone by which AFC moves tracked
+   frequency in single step. */
+#define CW_DETECTOR_AFC_GAIN  0.5f
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void    cw_detector_sync_parameters_internal(cw_detector_t * detector);
+static void    cw_detector_sync_coefficients_internal(cw_detector_t * detector);
+static void    cw_detector_afc_internal(cw_detector_t * detector, float lower, float upper);
+static int64_t cw_detector_sample_timestamp_internal(const cw_detector_t * detector, int64_t sample);
+
+
+
+
+/**
+   @brief Create new tone detector
+
+   Detector detects tone of given @p frequency in PCM sound with given
+   @p sample_rate, and passes timestamped beginnings and ends of marks
+   to @p rec.
+
+   Detector doesn't take ownership of @p rec: the receiver must be
+   deleted by client code, after deleting the detector.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] sample_rate sample rate of input sound [Hz]
+   @param[in] frequency frequency of tone to detect [Hz]
+   @param[in] rec receiver to feed with marks and spaces
+
+   @return freshly allocated detector on success
+   @return NULL pointer on failure
+*/
+cw_detector_t * cw_detector_new(int sample_rate, int frequency, cw_rec_t * rec)
+{
+	if (NULL == rec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid argument: rec = NULL");
+		errno = EINVAL;
+		return (cw_detector_t *) NULL;
+	}
+
+	return cw_detector_new_internal(sample_rate, frequency, rec);
+}
+
+
+
+
+/**
+   @brief Create new tone detector, optionally without receiver
+
+   Like cw_detector_new(), but @p rec may be NULL. Detector without
+   receiver only tracks presence of tone (see cw_detector_t::is_mark),
+   and client code handles the transitions by itself.
+
+   @param[in] sample_rate sample rate of input sound [Hz]
+   @param[in] frequency frequency of tone to detect [Hz]
+   @param[in] rec receiver to feed with marks and spaces (may be NULL)
+
+   @return freshly allocated detector on success
+   @return NULL pointer on failure
+*/
+cw_detector_t * cw_detector_new_internal(int sample_rate, int frequency, cw_rec_t * rec)
+{
+	if (sample_rate < CW_DETECTOR_SAMPLE_RATE_MIN
+	    || sample_rate > CW_DETECTOR_SAMPLE_RATE_MAX
+	    || frequency <= 0
+	    || frequency >= sample_rate / 2) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid argument: sample rate = %d, frequency = %d",
+			      sample_rate, frequency);
+		errno = EINVAL;
+		return (cw_detector_t *) NULL;
+	}
+
+	cw_detector_t * detector = (cw_detector_t *) calloc(1, sizeof (cw_detector_t));
+	if (NULL == detector) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_detector_t *) NULL;
+	}
+
+	detector->rec = rec;
+	detector->sample_rate = sample_rate;
+	detector->frequency = frequency;
+	detector->afc_frequency = (float) frequency;
+	detector->block_duration = CW_DETECTOR_BLOCK_DURATION_INITIAL;
+	detector->mark_threshold = CW_DETECTOR_MARK_THRESHOLD_INITIAL;
+	detector->space_threshold = CW_DETECTOR_SPACE_THRESHOLD_INITIAL;
+
+	cw_detector_sync_parameters_internal(detector);
+	cw_detector_reset(detector);
+
+	return detector;
+}
+
+
+
+
+/**
+   @brief Delete tone detector
+
+   @param[in,out] detector pointer to detector
+*/
+void cw_detector_delete(cw_detector_t ** detector)
+{
+	cw_assert (detector, MSG_PREFIX "delete: 'detector' argument can't be NULL\n");
+
+	if (NULL == detector) { /* Graceful handling of invalid argument. */
+		return;
+	}
+	if (NULL == *detector) {
+		return;
+	}
+
+	free(*detector);
+	*detector = (cw_detector_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Reset state of detector
+
+   Forget current Goertzel block, levels of envelope follower, frequency
+   tracked by AFC, and the timeline of samples. Parameters of detector
+   are not changed.
+
+   If detector is in the middle of a mark, the receiver is not
+   notified about end of the mark; reset state of the receiver too.
+
+   @param[in,out] detector detector to reset
+*/
+void cw_detector_reset(cw_detector_t * detector)
+{
+	detector->s1 = 0.0f;
+	detector->s2 = 0.0f;
+	detector->l1 = 0.0f;
+	detector->l2 = 0.0f;
+	detector->u1 = 0.0f;
+	detector->u2 = 0.0f;
+	detector->block_i = 0;
+
+	detector->afc_frequency = (float) detector->frequency;
+	cw_detector_sync_coefficients_internal(detector);
+
+	detector->envelope = 0.0f;
+	detector->peak = 0.0f;
+	detector->noise = 0.0f;
+	detector->n_blocks = 0;
+
+	detector->is_mark = false;
+
+	detector->n_samples = 0;
+	detector->anchor_sample = 0;
+	detector->anchor_timestamp = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set duration of Goertzel block
+
+   Longer blocks give narrower bandwidth of detector (better rejection
+   of noise and of neighbouring signals) but worse time resolution.
+   Bandwidth is roughly (1000000 / @p block_duration) Hz. Initial value
+   is CW_DETECTOR_BLOCK_DURATION_INITIAL (4 ms, 250 Hz). Block should
+   be a few times shorter than a dot.
+
+   errno is set to EINVAL if @p block_duration is out of range
+   [CW_DETECTOR_BLOCK_DURATION_MIN, CW_DETECTOR_BLOCK_DURATION_MAX].
+
+   @param[in,out] detector detector
+   @param[in] block_duration duration of block [us]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_detector_set_block_duration(cw_detector_t * detector, int block_duration)
+{
+	if (block_duration < CW_DETECTOR_BLOCK_DURATION_MIN
+	    || block_duration > CW_DETECTOR_BLOCK_DURATION_MAX) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	detector->block_duration = block_duration;
+	cw_detector_sync_parameters_internal(detector);
+
+	/* Drop incomplete block: it was collected with old block size. */
+	detector->s1 = 0.0f;
+	detector->s2 = 0.0f;
+	detector->l1 = 0.0f;
+	detector->l2 = 0.0f;
+	detector->u1 = 0.0f;
+	detector->u2 = 0.0f;
+	detector->block_i = 0;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Set thresholds of hysteresis
+
+   Thresholds are expressed in percents of distance between noise floor
+   (0%) and peak level (100%) of tone's envelope. Mark begins when
+   envelope rises above @p mark_threshold, and ends when envelope falls
+   below @p space_threshold.
+
+   errno is set to EINVAL unless
+   0 < @p space_threshold <= @p mark_threshold < 100.
+
+   @param[in,out] detector detector
+   @param[in] mark_threshold threshold of beginning of mark [%]
+   @param[in] space_threshold threshold of end of mark [%]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_detector_set_thresholds(cw_detector_t * detector, int mark_threshold, int space_threshold)
+{
+	if (space_threshold <= 0
+	    || mark_threshold >= 100
+	    || space_threshold > mark_threshold) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	detector->mark_threshold = mark_threshold;
+	detector->space_threshold = space_threshold;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Set range of automatic frequency control
+
+   With non-zero @p range the detector follows a tone that is up to
+   @p range Hz below or above detector's frequency. Zero @p range
+   disables AFC (initial state). Tracked frequency is reset to
+   detector's frequency.
+
+   errno is set to EINVAL if @p range is negative, or if tracked
+   frequency could get out of range (0, sample rate / 2).
+
+   @param[in,out] detector detector
+   @param[in] range range of tracking around detector's frequency [Hz]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_detector_set_afc_range(cw_detector_t * detector, int range)
+{
+	if (range < 0
+	    || range >= detector->frequency
+	    || detector->frequency + range >= detector->sample_rate / 2) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	detector->afc_range = range;
+	detector->afc_frequency = (float) detector->frequency;
+	cw_detector_sync_coefficients_internal(detector);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get frequency of tone
+
+   With AFC enabled this is the frequency tracked by AFC, so client code
+   can report pitch of signal together with each character polled from
+   receiver. Otherwise this is detector's frequency.
+
+   @param[in] detector detector
+
+   @return frequency of tone [Hz]
+*/
+int cw_detector_get_frequency(const cw_detector_t * detector)
+{
+	return (int) lrintf(detector->afc_frequency);
+}
+
+
+
+
+/**
+   @brief Get timestamp of end of sound processed so far
+
+   The timestamp is the time of the sample that will be passed to
+   detector next. Use it as "now" when polling the receiver for
+   characters.
+
+   @param[in] detector detector
+
+   @return timestamp [ns]
+*/
+int64_t cw_detector_get_timestamp(const cw_detector_t * detector)
+{
+	return cw_detector_sample_timestamp_internal(detector, detector->n_samples);
+}
+
+
+
+
+/**
+   @brief Process block of PCM samples
+
+   Pass @p n_samples samples of mono, 16-bit PCM sound to the detector.
+   The samples don't have to be aligned to Goertzel blocks: incomplete
+   block is kept by detector until next call.
+
+   @p timestamp is time of first sample in @p samples, in nanoseconds
+   of a monotonic clock (e.g. clock_gettime(CLOCK_MONOTONIC), or a
+   timestamp provided by sound system). Pass negative value to have the
+   detector continue its own timeline of samples (first sample ever
+   processed by detector has timestamp equal to zero).
+
+   Marks and spaces found in the sound are pushed to receiver as they
+   are detected. Errors reported by receiver (e.g. for marks shorter
+   than receiver's noise spike threshold) don't make this function
+   fail.
+
+   @param[in,out] detector detector
+   @param[in] samples PCM samples
+   @param[in] n_samples count of samples in @p samples
+   @param[in] timestamp timestamp of first sample [ns]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (errno is set to EINVAL if @p samples is NULL)
+*/
+cw_ret_t cw_detector_process(cw_detector_t * detector, const int16_t * samples, size_t n_samples, int64_t timestamp)
+{
+	if (NULL == samples) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (timestamp >= 0) {
+		detector->anchor_sample = detector->n_samples;
+		detector->anchor_timestamp = timestamp;
+	}
+
+	const int block_n_samples = detector->block_n_samples;
+	float s1 = detector->s1;
+	float s2 = detector->s2;
+	int block_i = detector->block_i;
+
+	size_t i = 0;
+	while (i < n_samples) {
+		/* AFC may have changed the coefficient at the end of
+		   previous block. */
+		const float coefficient = detector->coefficient;
+		const bool is_afc_block = detector->afc_range > 0
+			&& 0 == detector->n_blocks % CW_DETECTOR_AFC_INTERVAL;
+
+		/* Run the recurrence over the part of block that is
+		   available in this call. The loops are kept free of
+		   branches and function calls. */
+		size_t n = (size_t) (block_n_samples - block_i);
+		if (n > n_samples - i) {
+			n = n_samples - i;
+		}
+		const int16_t * x = samples + i;
+		if (is_afc_block) {
+			const float coefficient_lower = detector->coefficient_lower;
+			const float coefficient_upper = detector->coefficient_upper;
+			float l1 = detector->l1;
+			float l2 = detector->l2;
+			float u1 = detector->u1;
+			float u2 = detector->u2;
+			for (size_t j = 0; j < n; j++) {
+				const float sample = (float) x[j];
+				const float s0 = sample + coefficient * s1 - s2;
+				s2 = s1;
+				s1 = s0;
+				const float l0 = sample + coefficient_lower * l1 - l2;
+				l2 = l1;
+				l1 = l0;
+				const float u0 = sample + coefficient_upper * u1 - u2;
+				u2 = u1;
+				u1 = u0;
+			}
+			detector->l1 = l1;
+			detector->l2 = l2;
+			detector->u1 = u1;
+			detector->u2 = u2;
+		} else {
+			for (size_t j = 0; j < n; j++) {
+				const float s0 = (float) x[j] + coefficient * s1 - s2;
+				s2 = s1;
+				s1 = s0;
+			}
+		}
+		i += n;
+		block_i += (int) n;
+		detector->n_samples += (int64_t) n;
+
+		if (block_i == block_n_samples) {
+			const float power = s1 * s1 + s2 * s2 - coefficient * s1 * s2;
+			/* Amplitude of tone, in units of input samples. */
+			const float magnitude = 2.0f * sqrtf(power > 0.0f ? power : 0.0f) / (float) block_n_samples;
+
+			/* Timestamp of the middle of the block. */
+			const int64_t block_timestamp = cw_detector_sample_timestamp_internal(detector, detector->n_samples - block_n_samples / 2);
+			cw_detector_process_magnitude_internal(detector, magnitude, block_timestamp);
+
+			if (is_afc_block) {
+				const float l1 = detector->l1;
+				const float l2 = detector->l2;
+				const float u1 = detector->u1;
+				const float u2 = detector->u2;
+				const float power_lower = l1 * l1 + l2 * l2 - detector->coefficient_lower * l1 * l2;
+				const float power_upper = u1 * u1 + u2 * u2 - detector->coefficient_upper * u1 * u2;
+				cw_detector_afc_internal(detector,
+							 sqrtf(power_lower > 0.0f ? power_lower : 0.0f),
+							 sqrtf(power_upper > 0.0f ? power_upper : 0.0f));
+				detector->l1 = 0.0f;
+				detector->l2 = 0.0f;
+				detector->u1 = 0.0f;
+				detector->u2 = 0.0f;
+			}
+
+			s1 = 0.0f;
+			s2 = 0.0f;
+			block_i = 0;
+		}
+	}
+
+	detector->s1 = s1;
+	detector->s2 = s2;
+	detector->block_i = block_i;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Update envelope follower with magnitude of a block, detect transitions
+
+   Besides being used for detector's own Goertzel blocks, the function
+   can be used to pass to detector magnitudes of tone calculated by other
+   means (e.g. by a bin of FFT filterbank). Detector's duration of block
+   should then be set to interval between consecutive magnitudes.
+
+   @param[in,out] detector detector
+   @param[in] magnitude magnitude of tone in the block
+   @param[in] timestamp timestamp of the block, used for transitions [ns]
+*/
+void cw_detector_process_magnitude_internal(cw_detector_t * detector, float magnitude, int64_t timestamp)
+{
+	/* Light smoothing of magnitude. */
+	detector->envelope = 0.5f * (detector->envelope + magnitude);
+	const float envelope = detector->envelope;
+
+	if (0 == detector->n_blocks++) {
+		/* Start from level of first block instead of from zero, so
+		   that initial noise isn't taken for a mark. Sound is
+		   expected to begin with a space. */
+		detector->peak = envelope;
+		detector->noise = envelope;
+	}
+
+	/* Peak: instant attack, slow decay toward noise floor. */
+	if (envelope > detector->peak) {
+		detector->peak = envelope;
+	} else {
+		detector->peak -= (detector->peak - detector->noise) * detector->peak_decay;
+	}
+
+	/* Noise floor. */
+	if (envelope < detector->noise) {
+		detector->noise += (envelope - detector->noise) * detector->noise_fall;
+	} else if (detector->is_mark) {
+		detector->noise += (envelope - detector->noise) * detector->noise_rise;
+	} else {
+		detector->noise += (envelope - detector->noise) * detector->noise_track;
+	}
+
+	const float span = detector->peak - detector->noise;
+	const bool squelched = detector->peak < CW_DETECTOR_SQUELCH_AMPLITUDE
+		|| detector->peak < CW_DETECTOR_SQUELCH_RATIO * detector->noise;
+
+	bool is_mark = detector->is_mark;
+	if (is_mark) {
+		is_mark = envelope >= detector->noise + span * (float) detector->space_threshold / 100.0f;
+	} else {
+		is_mark = !squelched && envelope > detector->noise + span * (float) detector->mark_threshold / 100.0f;
+	}
+
+	if (is_mark == detector->is_mark) {
+		return;
+	}
+	detector->is_mark = is_mark;
+
+	if (NULL == detector->rec) {
+		return;
+	}
+
+	cw_ret_t cwret = CW_SUCCESS;
+	if (is_mark) {
+		cwret = cw_rec_mark_begin_ns(detector->rec, timestamp);
+	} else {
+		cwret = cw_rec_mark_end_ns(detector->rec, timestamp);
+	}
+	if (CW_SUCCESS != cwret) {
+		/* E.g. a noise spike. Receiver handles it by itself. */
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_DEBUG,
+			      MSG_PREFIX "receiver rejected mark %s at %"PRId64": errno = %d",
+			      is_mark ? "begin" : "end", timestamp, errno);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Recalculate values derived from parameters of detector
+
+   @param[in,out] detector detector
+*/
+void cw_detector_sync_parameters_internal(cw_detector_t * detector)
+{
+	detector->block_n_samples = (int) (((int64_t) detector->sample_rate * detector->block_duration) / CW_USECS_PER_SEC);
+	if (detector->block_n_samples < 1) {
+		detector->block_n_samples = 1;
+	}
+
+	/* Half of bandwidth of Goertzel block. */
+	detector->afc_offset = 500000.0f / (float) detector->block_duration;
+	cw_detector_sync_coefficients_internal(detector);
+
+	detector->peak_decay = (float) detector->block_duration / (float) CW_DETECTOR_PEAK_DECAY_TIME;
+	detector->noise_fall = (float) detector->block_duration / (float) CW_DETECTOR_NOISE_FALL_TIME;
+	if (detector->noise_fall > 1.0f) {
+		detector->noise_fall = 1.0f;
+	}
+	detector->noise_track = (float) detector->block_duration / (float) CW_DETECTOR_NOISE_TRACK_TIME;
+	detector->noise_rise = (float) detector->block_duration / (float) CW_DETECTOR_NOISE_RISE_TIME;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get timestamp of given sample
+
+   @param[in] detector detector
+   @param[in] sample index of sample on detector's timeline
+
+   @return timestamp of the sample [ns]
+*/
+int64_t cw_detector_sample_timestamp_internal(const cw_detector_t * detector, int64_t sample)
+{
+	const int64_t delta = sample - detector->anchor_sample;
+	return detector->anchor_timestamp + (delta * CW_NSECS_PER_SEC) / detector->sample_rate;
+}
+
+
+
+
+/**
+   @brief Recalculate coefficients of Goertzel filters from tracked frequency
+
+   @param[in,out] detector detector
+*/
+void cw_detector_sync_coefficients_internal(cw_detector_t * detector)
+{
+	const float omega_per_hz = 2.0f * (float) M_PI / (float) detector->sample_rate;
+	detector->coefficient = 2.0f * cosf(omega_per_hz * detector->afc_frequency);
+	detector->coefficient_lower = 2.0f * cosf(omega_per_hz * (detector->afc_frequency - detector->afc_offset));
+	detector->coefficient_upper = 2.0f * cosf(omega_per_hz * (detector->afc_frequency + detector->afc_offset));
+
+	return;
+}
+
+
+
+
+/**
+   @brief Move tracked frequency toward the tone
+
+   Magnitudes of side filters are equal when the tone is at tracked
+   frequency. Their normalized difference changes roughly linearly from
+   -1 to 1 when the tone moves from lower to upper side filter, and so
+   is an estimate of offset of the tone in units of afc_offset.
+
+   Offset is measured only during marks: in spaces the side filters
+   see just noise.
+
+   @param[in,out] detector detector
+   @param[in] lower magnitude of lower side filter
+   @param[in] upper magnitude of upper side filter
+*/
+void cw_detector_afc_internal(cw_detector_t * detector, float lower, float upper)
+{
+	if (!detector->is_mark || lower + upper <= 0.0f) {
+		return;
+	}
+
+	const float offset = (upper - lower) / (upper + lower) * detector->afc_offset;
+	float frequency = detector->afc_frequency + CW_DETECTOR_AFC_GAIN * offset;
+
+	const float low = (float) (detector->frequency - detector->afc_range);
+	const float high = (float) (detector->frequency + detector->afc_range);
+	if (frequency < low) {
+		frequency = low;
+	} else if (frequency > high) {
+		frequency = high;
+	}
+
+	detector->afc_frequency = frequency;
+	cw_detector_sync_coefficients_internal(detector);
+
+	return;
+}
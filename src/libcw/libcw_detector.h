@@ -0,0 +1,107 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_DETECTOR
+#define H_LIBCW_DETECTOR
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Limits of detector's parameters. */
+enum { CW_DETECTOR_SAMPLE_RATE_MIN = 4000 };
+enum { CW_DETECTOR_SAMPLE_RATE_MAX = 192000 };
+enum { CW_DETECTOR_BLOCK_DURATION_MIN = 500 };     /* [us] */
+enum { CW_DETECTOR_BLOCK_DURATION_MAX = 50000 };   /* [us] */
+enum { CW_DETECTOR_BLOCK_DURATION_INITIAL = 4000 }; /* [us] */
+enum { CW_DETECTOR_MARK_THRESHOLD_INITIAL = 60 };  /* [%] */
+enum { CW_DETECTOR_SPACE_THRESHOLD_INITIAL = 40 }; /* [%] */
+
+/* AFC measures offset of tone in every N-th block. */
+enum { CW_DETECTOR_AFC_INTERVAL = 8 };
+
+
+
+
+struct cw_detector_struct {
+
+	/* Receiver to which detected marks and spaces are pushed. May be
+	   NULL for detector created with cw_detector_new_internal(). */
+	cw_rec_t * rec;
+
+	int sample_rate;    /* [Hz] */
+	int frequency;      /* Frequency of detected tone [Hz]. */
+	int block_duration; /* Duration of a single Goertzel block [us]. */
+
+	/* Hysteresis, in percents of distance between noise floor
+	   and peak level of envelope. */
+	int mark_threshold;
+	int space_threshold;
+
+	/* Derived from parameters above. */
+	int block_n_samples;
+	float coefficient;  /* 2 * cos(2 * pi * afc_frequency / sample_rate) */
+	float peak_decay;   /* Per-block decay of peak level. */
+	float noise_fall;   /* Per-block fall of noise floor. */
+	float noise_track;  /* Per-block tracking of noise floor during spaces. */
+	float noise_rise;   /* Per-block tracking of noise floor during marks. */
+
+	/* Automatic frequency control. Tracked frequency of tone is kept
+	   within afc_range from nominal frequency. AFC is disabled when
+	   afc_range is zero. */
+	int afc_range;           /* [Hz] */
+	float afc_frequency;     /* Tracked frequency of tone [Hz]. */
+	float afc_offset;        /* Distance of side filters from tracked frequency [Hz]. */
+	float coefficient_lower; /* Coefficients of side filters. */
+	float coefficient_upper;
+
+	/* State of Goertzel filter for current (incomplete) block. */
+	float s1;
+	float s2;
+	int block_i;
+
+	/* State of side Goertzel filters of AFC, used only in every
+	   CW_DETECTOR_AFC_INTERVAL-th block. */
+	float l1;
+	float l2;
+	float u1;
+	float u2;
+
+	/* Envelope follower. */
+	float envelope;
+	float peak;
+	float noise;
+	int64_t n_blocks;   /* Number of blocks processed since reset. */
+
+	/* Current decision: is there a mark? */
+	bool is_mark;
+
+	/* Timeline of input samples. Timestamp of sample number N is
+	   anchor_timestamp + (N - anchor_sample) / sample_rate. */
+	int64_t n_samples;        /* Number of samples processed so far. */
+	int64_t anchor_sample;
+	int64_t anchor_timestamp; /* [ns] */
+};
+
+
+
+
+cw_detector_t * cw_detector_new_internal(int sample_rate, int frequency, cw_rec_t * rec);
+void cw_detector_process_magnitude_internal(cw_detector_t * detector, float magnitude, int64_t timestamp);
+
+
+
+
+#endif /* #ifndef H_LIBCW_DETECTOR */
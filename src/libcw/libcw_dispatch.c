@@ -0,0 +1,419 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+
+
+
+/**
+   @file libcw_dispatch.c
+
+   @brief Dispatch thread calling client's callbacks of generator.
+
+   Low water callback of tone queue and value tracking callback of
+   generator (the one used for keying callbacks) are called by the
+   thread that dequeues tones and generates sound. Expensive client
+   code in the callbacks delays writing of next samples, and the
+   sound device underruns.
+
+   With cw_gen_config_t::callbacks_in_dispatch_thread, the sound
+   thread only posts a small notification (type, value, timestamp) to
+   a lock-free queue, and a separate dispatch thread calls the
+   callbacks. Posting never blocks and never allocates memory. If
+   client's callbacks are so slow that the queue fills up,
+   notifications are dropped (and counted) rather than blocking the
+   sound thread.
+
+   The queue is the bounded multi-producer queue known from Dmitry
+   Vyukov's design: every slot has a sequence number telling whether
+   the slot is free for a producer at given position or holds data
+   for the consumer.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw_debug.h"
+#include "libcw_dispatch.h"
+#include "libcw_gen.h"
+#include "libcw_signal.h"
+#include "libcw_tq.h"
+
+
+
+
+#define MSG_PREFIX "libcw/dispatch: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void * cw_dispatch_thread_internal(void * arg);
+static cw_dispatch_slot_t * cw_dispatch_reserve_internal(cw_dispatch_t * dispatch, size_t * pos_out);
+static void cw_dispatch_publish_internal(cw_dispatch_t * dispatch, cw_dispatch_slot_t * slot, size_t pos);
+static bool cw_dispatch_take_internal(cw_dispatch_t * dispatch, cw_dispatch_slot_t * slot);
+static void cw_dispatch_call_internal(cw_dispatch_t * dispatch, const cw_dispatch_slot_t * slot);
+
+
+
+
+/**
+   @brief Create dispatch thread for generator
+
+   @param[in] gen generator whose callbacks will be called by the thread
+
+   @return dispatch on success
+   @return NULL pointer on failure
+*/
+cw_dispatch_t * cw_dispatch_new_internal(cw_gen_t * gen)
+{
+	cw_dispatch_t * dispatch = (cw_dispatch_t *) calloc(1, sizeof (cw_dispatch_t));
+	if (NULL == dispatch) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_dispatch_t *) NULL;
+	}
+	dispatch->gen = gen;
+	for (size_t i = 0; i < CW_DISPATCH_CAPACITY; i++) {
+		dispatch->slots[i].sequence = i;
+	}
+
+	if (0 != sem_init(&dispatch->sem, 0, 0)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sem_init(): %s", strerror(errno));
+		free(dispatch);
+		return (cw_dispatch_t *) NULL;
+	}
+
+	const int rv = pthread_create(&dispatch->thread, NULL, cw_dispatch_thread_internal, dispatch);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "pthread_create(): %s", strerror(rv));
+		cw_dispatch_delete_internal(&dispatch);
+		errno = rv;
+		return (cw_dispatch_t *) NULL;
+	}
+	dispatch->thread_created = true;
+
+	return dispatch;
+}
+
+
+
+
+/**
+   @brief Stop dispatch thread and delete the dispatch
+
+   Notifications that are still queued are dispatched before the
+   thread exits.
+
+   @param[in] dispatch pointer to dispatch to delete
+*/
+void cw_dispatch_delete_internal(cw_dispatch_t ** dispatch)
+{
+	if (NULL == dispatch || NULL == *dispatch) {
+		return;
+	}
+
+	if ((*dispatch)->thread_created) {
+		__atomic_store_n(&(*dispatch)->quit, true, __ATOMIC_RELEASE);
+		sem_post(&(*dispatch)->sem);
+		pthread_join((*dispatch)->thread, NULL);
+	}
+	if ((*dispatch)->n_dropped > 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "%zu notifications have been dropped", (*dispatch)->n_dropped);
+	}
+	sem_destroy(&(*dispatch)->sem);
+
+	free(*dispatch);
+	*dispatch = (cw_dispatch_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Post notification to dispatch thread
+
+   The function can be called from many threads at once. It doesn't
+   block.
+
+   @param[in] dispatch dispatch
+   @param[in] type type of notification
+   @param[in] value new value of generator (for CW_DISPATCH_VALUE)
+   @param[in] timestamp time of the event [ns]
+   @param[in] sound_timestamp time at which new value of generator is heard [ns] (for CW_DISPATCH_VALUE)
+
+   @return true if notification has been queued
+   @return false if the queue is full and notification has been dropped
+*/
+bool cw_dispatch_post_internal(cw_dispatch_t * dispatch, cw_dispatch_type_t type, int value, int64_t timestamp, int64_t sound_timestamp)
+{
+	size_t pos = 0;
+	cw_dispatch_slot_t * slot = cw_dispatch_reserve_internal(dispatch, &pos);
+	if (NULL == slot) {
+		return false;
+	}
+
+	slot->type = type;
+	slot->value = value;
+	slot->timestamp = timestamp;
+	slot->sound_timestamp = sound_timestamp;
+	cw_dispatch_publish_internal(dispatch, slot, pos);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Post callback of completed asynchronous wait to dispatch thread
+
+   The function can be called from many threads at once. It doesn't
+   block.
+
+   @param[in] dispatch dispatch
+   @param[in] callback callback of completed wait
+   @param[in] callback_arg argument of @p callback
+   @param[in] timestamp time of completion [ns]
+
+   @return true if notification has been queued
+   @return false if the queue is full and notification has been dropped
+*/
+bool cw_dispatch_post_completion_internal(cw_dispatch_t * dispatch, cw_wait_callback_t callback, void * callback_arg, int64_t timestamp)
+{
+	size_t pos = 0;
+	cw_dispatch_slot_t * slot = cw_dispatch_reserve_internal(dispatch, &pos);
+	if (NULL == slot) {
+		return false;
+	}
+
+	slot->type = CW_DISPATCH_COMPLETION;
+	slot->timestamp = timestamp;
+	slot->callback = callback;
+	slot->callback_arg = callback_arg;
+	cw_dispatch_publish_internal(dispatch, slot, pos);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Reserve slot in queue of notifications
+
+   @param[in] dispatch dispatch
+   @param[out] pos_out position of reserved slot
+
+   @return reserved slot
+   @return NULL if the queue is full
+*/
+static cw_dispatch_slot_t * cw_dispatch_reserve_internal(cw_dispatch_t * dispatch, size_t * pos_out)
+{
+	size_t pos = __atomic_load_n(&dispatch->tail, __ATOMIC_RELAXED);
+	cw_dispatch_slot_t * slot = NULL;
+	while (true) {
+		slot = &dispatch->slots[pos & (CW_DISPATCH_CAPACITY - 1)];
+		const size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		const intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+		if (0 == diff) {
+			/* Slot is free: try to reserve it. On failure
+			   'pos' is updated to current tail. */
+			if (__atomic_compare_exchange_n(&dispatch->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* Consumer hasn't freed the slot yet: queue is full. */
+			__atomic_fetch_add(&dispatch->n_dropped, 1, __ATOMIC_RELAXED);
+			return (cw_dispatch_slot_t *) NULL;
+		} else {
+			/* Other producer has taken the slot. */
+			pos = __atomic_load_n(&dispatch->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	*pos_out = pos;
+
+	return slot;
+}
+
+
+
+
+/**
+   @brief Make filled slot visible to dispatch thread
+
+   @param[in] dispatch dispatch
+   @param[in] slot slot reserved with cw_dispatch_reserve_internal()
+   @param[in] pos position of the slot
+*/
+static void cw_dispatch_publish_internal(cw_dispatch_t * dispatch, cw_dispatch_slot_t * slot, size_t pos)
+{
+	__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&dispatch->sem);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Take oldest notification from queue
+
+   Only dispatch thread calls this function.
+
+   @param[in] dispatch dispatch
+   @param[out] slot copy of the notification
+
+   @return true if a notification has been taken
+   @return false if queue is empty
+*/
+static bool cw_dispatch_take_internal(cw_dispatch_t * dispatch, cw_dispatch_slot_t * slot)
+{
+	const size_t pos = dispatch->head;
+	cw_dispatch_slot_t * queued = &dispatch->slots[pos & (CW_DISPATCH_CAPACITY - 1)];
+	const size_t sequence = __atomic_load_n(&queued->sequence, __ATOMIC_ACQUIRE);
+	if (sequence != pos + 1) {
+		/* Empty, or producer hasn't finished writing the slot. */
+		return false;
+	}
+
+	*slot = *queued;
+	__atomic_store_n(&queued->sequence, pos + CW_DISPATCH_CAPACITY, __ATOMIC_RELEASE);
+	dispatch->head = pos + 1;
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Call client's callback for notification
+
+   Callbacks registered at the moment of the call are used, so a
+   callback unregistered after the event has happened is not called.
+
+   @param[in] dispatch dispatch
+   @param[in] slot notification
+*/
+static void cw_dispatch_call_internal(cw_dispatch_t * dispatch, const cw_dispatch_slot_t * slot)
+{
+	cw_gen_t * gen = dispatch->gen;
+	dispatch->current_timestamp = slot->timestamp;
+
+	switch (slot->type) {
+	case CW_DISPATCH_LOW_WATER:
+		{
+			cw_queue_low_callback_t callback_func = gen->tq->low_water_callback;
+			void * callback_arg = gen->tq->low_water_callback_arg;
+			if (callback_func) {
+				callback_func(callback_arg);
+			}
+		}
+		break;
+	case CW_DISPATCH_VALUE:
+		{
+			cw_gen_value_tracking_callback_t callback_func = gen->value_tracking.value_tracking_callback_func;
+			void * callback_arg = gen->value_tracking.value_tracking_callback_arg;
+			if (callback_func) {
+				callback_func(callback_arg, slot->value);
+			}
+
+			cw_gen_timed_value_tracking_callback_t timed_callback_func = gen->value_tracking.timed_callback_func;
+			void * timed_callback_arg = gen->value_tracking.timed_callback_arg;
+			if (timed_callback_func) {
+				timed_callback_func(timed_callback_arg, slot->value, slot->sound_timestamp);
+			}
+		}
+		break;
+	case CW_DISPATCH_COMPLETION:
+		slot->callback(slot->callback_arg);
+		break;
+	default:
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "unexpected type of notification %d", slot->type);
+		break;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread function of dispatch
+
+   @param[in] arg dispatch (cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_dispatch_thread_internal(void * arg)
+{
+	cw_dispatch_t * dispatch = (cw_dispatch_t *) arg;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "dispatch", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "dispatch");
+#endif
+
+	cw_virtual_clock_thread_begin_internal();
+
+	while (true) {
+		cw_virtual_clock_wait_begin_internal();
+		while (0 != sem_wait(&dispatch->sem) && EINTR == errno) {
+			;
+		}
+		cw_virtual_clock_wait_end_internal();
+
+		/* Take everything that is ready. Notifications are
+		   filled in order in which producers finish, not in
+		   order of their slots, so some posts find nothing to
+		   take: their notifications have been taken before
+		   or will be taken on later post. */
+		cw_dispatch_slot_t slot;
+		while (cw_dispatch_take_internal(dispatch, &slot)) {
+			cw_dispatch_call_internal(dispatch, &slot);
+		}
+
+		if (__atomic_load_n(&dispatch->quit, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+	}
+
+	cw_virtual_clock_thread_end_internal();
+
+	return NULL;
+}
@@ -0,0 +1,100 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_DISPATCH
+#define H_LIBCW_DISPATCH
+
+
+
+
+#include <inttypes.h> /* int64_t */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Capacity of queue of notifications. Must be a power of two. */
+#define CW_DISPATCH_CAPACITY 256
+
+
+
+
+typedef enum {
+	/* Length of tone queue has fallen to low water mark. */
+	CW_DISPATCH_LOW_WATER,
+	/* Value of generator has changed. */
+	CW_DISPATCH_VALUE,
+	/* Asynchronous wait has been completed. */
+	CW_DISPATCH_COMPLETION
+} cw_dispatch_type_t;
+
+
+
+
+typedef struct {
+	/* Position of the slot in queue, see cw_dispatch_post_internal(). */
+	size_t sequence;
+
+	cw_dispatch_type_t type;
+	int value;          /* New value, for CW_DISPATCH_VALUE. */
+	int64_t timestamp;  /* Time of the event in producer's thread [ns]. */
+	int64_t sound_timestamp; /* Time at which new value is heard [ns], for CW_DISPATCH_VALUE. */
+
+	/* Callback of completed wait, for CW_DISPATCH_COMPLETION. */
+	cw_wait_callback_t callback;
+	void * callback_arg;
+} cw_dispatch_slot_t;
+
+
+
+
+/* Dispatch thread calling client's callbacks of a generator, so that
+   threads generating sound never run client's code. */
+typedef struct cw_dispatch_t {
+	cw_gen_t * gen;
+
+	/* Bounded lock-free queue of notifications: many producers
+	   (generator's thread, and threads of keys), one consumer
+	   (dispatch thread). */
+	cw_dispatch_slot_t slots[CW_DISPATCH_CAPACITY];
+	size_t head;  /* Used only by consumer. */
+	size_t tail;  /* Reserved by producers with compare-and-swap. */
+
+	/* Posted once per notification, and on quit. sem_post() never
+	   blocks, unlike locking a mutex. */
+	sem_t sem;
+
+	pthread_t thread;
+	bool thread_created;
+	volatile bool quit;
+
+	/* Timestamp of notification of callback that is being called
+	   now, see cw_gen_get_callback_timestamp(). */
+	int64_t current_timestamp;
+
+	/* Notifications dropped because the queue was full. */
+	size_t n_dropped;
+} cw_dispatch_t;
+
+
+
+
+cw_dispatch_t * cw_dispatch_new_internal(cw_gen_t * gen);
+void            cw_dispatch_delete_internal(cw_dispatch_t ** dispatch);
+bool            cw_dispatch_post_internal(cw_dispatch_t * dispatch, cw_dispatch_type_t type, int value, int64_t timestamp, int64_t sound_timestamp);
+bool            cw_dispatch_post_completion_internal(cw_dispatch_t * dispatch, cw_wait_callback_t callback, void * callback_arg, int64_t timestamp);
+
+
+
+
+#endif /* #ifndef H_LIBCW_DISPATCH */
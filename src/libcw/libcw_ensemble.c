@@ -0,0 +1,595 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_ensemble.c
+
+   @brief Ensemble decoding: several decoders over one timeline of key events.
+
+   Each member (receiver or probabilistic decoder) gets the same
+   cleaned-up events, and reports characters into its own queue in
+   the ensemble. Timestamp of a character is timestamp of end of its
+   last Mark, and all members see the same Marks, so members that
+   split the timeline into characters and words in the same way
+   report the same timestamps.
+
+   Queues are resolved word by word. A timestamp at which a majority
+   (by weight) of members has reported an inter-word-space is a
+   boundary of word. Once a majority of members can't report anything
+   more up to a boundary (they have reported an inter-word-space at
+   or after it), characters of each member between the previous
+   boundary and this one form the member's version of the word, and
+   the version with the largest weight of members behind it is
+   reported to client code.
+
+   A member that splits the timeline differently from the majority
+   still takes part in the vote with whatever it has reported
+   between the boundaries, and a member that reports nothing at all
+   doesn't hold back the others.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_ensemble.h"
+#include "libcw_rec.h"
+#include "libcw_viterbi.h"
+
+
+
+
+#define MSG_PREFIX "libcw/ensemble: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static cw_ret_t cw_ensemble_add_member_internal(cw_ensemble_t * ens, cw_ensemble_member_type_t type, cw_rec_t * rec, cw_viterbi_t * vit, int weight);
+static void cw_ensemble_process_block_internal(cw_ensemble_t * ens, size_t n_events);
+static void cw_ensemble_member_callback_internal(void * callback_arg, int64_t timestamp, char character, bool is_error);
+static void cw_ensemble_resolve_internal(cw_ensemble_t * ens);
+static int64_t cw_ensemble_next_boundary_internal(const cw_ensemble_t * ens, int64_t previous, int64_t horizon);
+static void cw_ensemble_vote_internal(cw_ensemble_t * ens, int64_t boundary);
+static int cw_ensemble_member_word_length_internal(const cw_ensemble_member_t * member, int64_t boundary);
+
+
+
+
+/**
+   @brief Create new ensemble
+
+   Ensemble has no members. Add them with cw_ensemble_add_receiver()
+   and cw_ensemble_add_viterbi().
+
+   @return freshly allocated ensemble on success
+   @return NULL pointer on failure
+*/
+cw_ensemble_t * cw_ensemble_new(void)
+{
+	cw_ensemble_t * ens = (cw_ensemble_t *) calloc(1, sizeof (cw_ensemble_t));
+	if (NULL == ens) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: calloc()");
+		return (cw_ensemble_t *) NULL;
+	}
+
+	cw_ensemble_reset_state(ens);
+
+	return ens;
+}
+
+
+
+
+/**
+   @brief Delete ensemble
+
+   Members of the ensemble are not deleted: they are owned by client
+   code.
+
+   @param[in,out] ens pointer to ensemble, set to NULL on return
+*/
+void cw_ensemble_delete(cw_ensemble_t ** ens)
+{
+	if (NULL == ens || NULL == *ens) {
+		return;
+	}
+
+	free(*ens);
+	*ens = (cw_ensemble_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Reset state of ensemble and of its members
+
+   Characters reported by members and not resolved yet are dropped,
+   and state of each member is reset (see cw_rec_reset_state() and
+   cw_viterbi_reset_state()).
+
+   @param[in,out] ens ensemble
+*/
+void cw_ensemble_reset_state(cw_ensemble_t * ens)
+{
+	for (int i = 0; i < ens->n_members; i++) {
+		cw_ensemble_member_t * member = &ens->members[i];
+		if (CW_ENSEMBLE_MEMBER_RECEIVER == member->type) {
+			cw_rec_reset_state(member->rec);
+		} else {
+			cw_viterbi_reset_state(member->vit);
+		}
+		member->n_outputs = 0;
+		member->done_until = -1;
+	}
+
+	ens->is_key_down = false;
+	ens->last_timestamp = 0;
+	ens->resolved_until = -1;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add receiver to ensemble
+
+   Receiver keeps its parameters (speed, tolerance, adaptive mode
+   etc.). Its state is reset.
+
+   @exception EINVAL @p rec is NULL or @p weight is not positive
+   @exception ENOMEM ensemble already has CW_ENSEMBLE_MEMBERS_MAX members
+
+   @param[in,out] ens ensemble
+   @param[in] rec receiver
+   @param[in] weight weight of receiver's votes
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_ensemble_add_receiver(cw_ensemble_t * ens, cw_rec_t * rec, int weight)
+{
+	if (NULL == rec) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_rec_reset_state(rec);
+	return cw_ensemble_add_member_internal(ens, CW_ENSEMBLE_MEMBER_RECEIVER, rec, NULL, weight);
+}
+
+
+
+
+/**
+   @brief Add probabilistic decoder to ensemble
+
+   Decoder keeps its parameters (speed, beam width etc.). Its state is
+   reset.
+
+   @exception EINVAL @p vit is NULL or @p weight is not positive
+   @exception ENOMEM ensemble already has CW_ENSEMBLE_MEMBERS_MAX members
+
+   @param[in,out] ens ensemble
+   @param[in] vit decoder
+   @param[in] weight weight of decoder's votes
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_ensemble_add_viterbi(cw_ensemble_t * ens, cw_viterbi_t * vit, int weight)
+{
+	if (NULL == vit) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_viterbi_reset_state(vit);
+	return cw_ensemble_add_member_internal(ens, CW_ENSEMBLE_MEMBER_VITERBI, NULL, vit, weight);
+}
+
+
+
+
+static cw_ret_t cw_ensemble_add_member_internal(cw_ensemble_t * ens, cw_ensemble_member_type_t type, cw_rec_t * rec, cw_viterbi_t * vit, int weight)
+{
+	if (weight <= 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (ens->n_members == CW_ENSEMBLE_MEMBERS_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "add member: ensemble is full");
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	cw_ensemble_member_t * member = &ens->members[ens->n_members++];
+	member->type = type;
+	member->rec = rec;
+	member->vit = vit;
+	member->weight = weight;
+	member->n_outputs = 0;
+	member->done_until = -1;
+	member->ensemble = ens;
+
+	ens->total_weight += weight;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Decode a timeline of key events with all members of ensemble
+
+   Counterpart of cw_rec_process_events(): events and callback have
+   the same meaning. Beginning of a Mark while key is already closed,
+   and end of a Mark while key is open, are ignored.
+
+   Words are passed to @p callback_func when a majority of members has
+   recognized their ends, so put CW_REC_EVENT_POLL event with timestamp
+   well after the last Mark at the end of timeline to receive the last
+   word.
+
+   @exception EINVAL invalid type of event, negative or decreasing timestamp
+
+   @param[in,out] ens ensemble
+   @param[in] events array of events
+   @param[in] n_events count of items in @p events
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS if all events have been processed
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_ensemble_process_events(cw_ensemble_t * ens, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == events || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	ens->callback_func = callback_func;
+	ens->callback_arg = callback_arg;
+
+	cw_ret_t cwret = CW_SUCCESS;
+	size_t n_block = 0;
+	for (size_t i = 0; i < n_events; i++) {
+		const cw_rec_event_t * event = &events[i];
+
+		if (event->timestamp < 0 || event->timestamp < ens->last_timestamp) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "process events: invalid timestamp of event #%zu: %"PRId64,
+				      i, event->timestamp);
+			cwret = CW_FAILURE;
+			break;
+		}
+
+		if (CW_REC_EVENT_MARK_BEGIN == event->type) {
+			if (ens->is_key_down) {
+				continue;
+			}
+			ens->is_key_down = true;
+		} else if (CW_REC_EVENT_MARK_END == event->type) {
+			if (!ens->is_key_down) {
+				continue;
+			}
+			ens->is_key_down = false;
+		} else if (CW_REC_EVENT_POLL != event->type) {
+			cwret = CW_FAILURE;
+			break;
+		}
+
+		ens->last_timestamp = event->timestamp;
+		ens->block[n_block++] = *event;
+		if (CW_ENSEMBLE_BLOCK_SIZE == n_block) {
+			cw_ensemble_process_block_internal(ens, n_block);
+			n_block = 0;
+		}
+	}
+	cw_ensemble_process_block_internal(ens, n_block);
+
+	ens->callback_func = NULL;
+	ens->callback_arg = NULL;
+
+	if (CW_SUCCESS != cwret) {
+		errno = EINVAL;
+	}
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Pass block of cleaned-up events to all members, resolve their reports
+
+   @param[in,out] ens ensemble
+   @param[in] n_events count of events in block
+*/
+static void cw_ensemble_process_block_internal(cw_ensemble_t * ens, size_t n_events)
+{
+	if (0 == n_events) {
+		return;
+	}
+
+	for (int i = 0; i < ens->n_members; i++) {
+		cw_ensemble_member_t * member = &ens->members[i];
+		cw_ret_t cwret = CW_SUCCESS;
+		if (CW_ENSEMBLE_MEMBER_RECEIVER == member->type) {
+			cwret = cw_rec_process_events(member->rec, ens->block, n_events, cw_ensemble_member_callback_internal, member);
+		} else {
+			cwret = cw_viterbi_process_events(member->vit, ens->block, n_events, cw_ensemble_member_callback_internal, member);
+		}
+		if (CW_SUCCESS != cwret) {
+			/* Events have been checked, so this should not
+			   happen. Don't let one member stop the others. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "process events: member #%d failed to process events", i);
+		}
+	}
+
+	cw_ensemble_resolve_internal(ens);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Put character reported by member into member's queue
+
+   @param[in] callback_arg member of ensemble
+   @param[in] timestamp end of last Mark of character [ns]
+   @param[in] character character, or ' ' for inter-word-space
+   @param[in] is_error error flag reported by member
+*/
+static void cw_ensemble_member_callback_internal(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	cw_ensemble_member_t * member = (cw_ensemble_member_t *) callback_arg;
+	cw_ensemble_t * ens = member->ensemble;
+
+	if (timestamp <= ens->resolved_until) {
+		/* Member is late, its version of the word has
+		   already been outvoted. */
+		return;
+	}
+
+	if (CW_ENSEMBLE_QUEUE_CAPACITY == member->n_outputs) {
+		cw_ensemble_resolve_internal(ens);
+	}
+	if (CW_ENSEMBLE_QUEUE_CAPACITY == member->n_outputs) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "member's queue is full, dropping oldest character");
+		memmove(member->outputs, member->outputs + 1, (CW_ENSEMBLE_QUEUE_CAPACITY - 1) * sizeof (member->outputs[0]));
+		member->n_outputs--;
+	}
+
+	member->outputs[member->n_outputs++] = (cw_rec_output_t) { .timestamp = timestamp, .character = character, .is_error = is_error };
+	if (' ' == character) {
+		member->done_until = timestamp;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Report words on which majority of members has finished
+
+   @param[in,out] ens ensemble
+*/
+static void cw_ensemble_resolve_internal(cw_ensemble_t * ens)
+{
+	/* Horizon: latest timestamp up to which a majority of members
+	   has reported everything. */
+	int64_t horizon = -1;
+	int64_t previous_candidate = INT64_MAX;
+	for (;;) {
+		/* Largest done_until below previous candidate. */
+		int64_t candidate = -1;
+		for (int i = 0; i < ens->n_members; i++) {
+			const int64_t done_until = ens->members[i].done_until;
+			if (done_until < previous_candidate && done_until > candidate) {
+				candidate = done_until;
+			}
+		}
+		if (candidate <= ens->resolved_until) {
+			break;
+		}
+		int weight = 0;
+		for (int i = 0; i < ens->n_members; i++) {
+			weight += ens->members[i].done_until >= candidate ? ens->members[i].weight : 0;
+		}
+		if (2 * weight > ens->total_weight) {
+			horizon = candidate;
+			break;
+		}
+		previous_candidate = candidate;
+	}
+
+	int64_t boundary = -1;
+	while (-1 != (boundary = cw_ensemble_next_boundary_internal(ens, ens->resolved_until, horizon))) {
+		cw_ensemble_vote_internal(ens, boundary);
+		ens->resolved_until = boundary;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Find earliest boundary of word after @p previous
+
+   @param[in] ens ensemble
+   @param[in] previous boundary of previous word [ns]
+   @param[in] horizon latest possible boundary [ns]
+
+   @return timestamp of inter-word-space reported by majority of members [ns]
+   @return -1 if there is no such inter-word-space
+*/
+static int64_t cw_ensemble_next_boundary_internal(const cw_ensemble_t * ens, int64_t previous, int64_t horizon)
+{
+	int64_t boundary = -1;
+	for (int i = 0; i < ens->n_members; i++) {
+		const cw_ensemble_member_t * member = &ens->members[i];
+		for (int o = 0; o < member->n_outputs; o++) {
+			const int64_t timestamp = member->outputs[o].timestamp;
+			if (' ' != member->outputs[o].character
+			    || timestamp <= previous || timestamp > horizon
+			    || (-1 != boundary && timestamp >= boundary)) {
+				continue;
+			}
+
+			int weight = 0;
+			for (int j = 0; j < ens->n_members; j++) {
+				const cw_ensemble_member_t * other = &ens->members[j];
+				for (int p = 0; p < other->n_outputs && other->outputs[p].timestamp <= timestamp; p++) {
+					if (' ' == other->outputs[p].character && timestamp == other->outputs[p].timestamp) {
+						weight += other->weight;
+						break;
+					}
+				}
+			}
+			if (2 * weight > ens->total_weight) {
+				boundary = timestamp;
+			}
+		}
+	}
+
+	return boundary;
+}
+
+
+
+
+/**
+   @brief Choose version of word ending at @p boundary, report it
+
+   Characters up to @p boundary are removed from queues of all
+   members.
+
+   @param[in,out] ens ensemble
+   @param[in] boundary timestamp of inter-word-space ending the word [ns]
+*/
+static void cw_ensemble_vote_internal(cw_ensemble_t * ens, int64_t boundary)
+{
+	int lengths[CW_ENSEMBLE_MEMBERS_MAX] = { 0 };
+	for (int i = 0; i < ens->n_members; i++) {
+		lengths[i] = cw_ensemble_member_word_length_internal(&ens->members[i], boundary);
+	}
+
+	int winner = 0;
+	int winner_weight = -1;
+	int winner_errors = 0;
+	for (int i = 0; i < ens->n_members; i++) {
+		const cw_ensemble_member_t * member = &ens->members[i];
+		int weight = 0;
+		for (int j = 0; j < ens->n_members; j++) {
+			const cw_ensemble_member_t * other = &ens->members[j];
+			bool is_same = lengths[i] == lengths[j];
+			for (int c = 0; is_same && c < lengths[i]; c++) {
+				is_same = member->outputs[c].character == other->outputs[c].character;
+			}
+			weight += is_same ? other->weight : 0;
+		}
+		int errors = 0;
+		for (int c = 0; c < lengths[i]; c++) {
+			errors += member->outputs[c].is_error ? 1 : 0;
+		}
+		if (weight > winner_weight || (weight == winner_weight && errors < winner_errors)) {
+			winner = i;
+			winner_weight = weight;
+			winner_errors = errors;
+		}
+	}
+
+	const cw_ensemble_member_t * member = &ens->members[winner];
+	for (int c = 0; c < lengths[winner]; c++) {
+		const cw_rec_output_t * output = &member->outputs[c];
+		ens->callback_func(ens->callback_arg, output->timestamp, output->character, output->is_error);
+	}
+	if (0 == lengths[winner] || ' ' != member->outputs[lengths[winner] - 1].character) {
+		/* Winner splits the timeline differently, but majority
+		   has recognized end of word here. */
+		ens->callback_func(ens->callback_arg, boundary, ' ', false);
+	}
+
+	for (int i = 0; i < ens->n_members; i++) {
+		cw_ensemble_member_t * other = &ens->members[i];
+		other->n_outputs -= lengths[i];
+		memmove(other->outputs, other->outputs + lengths[i], (size_t) other->n_outputs * sizeof (other->outputs[0]));
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get count of characters of member up to @p boundary
+
+   @param[in] member member of ensemble
+   @param[in] boundary timestamp [ns]
+
+   @return count of characters in member's queue with timestamps not later than @p boundary
+*/
+static int cw_ensemble_member_word_length_internal(const cw_ensemble_member_t * member, int64_t boundary)
+{
+	int length = 0;
+	while (length < member->n_outputs && member->outputs[length].timestamp <= boundary) {
+		length++;
+	}
+	return length;
+}
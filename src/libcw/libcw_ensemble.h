@@ -0,0 +1,87 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_ENSEMBLE
+#define H_LIBCW_ENSEMBLE
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Count of characters reported by a member and not yet resolved by
+   ensemble. A member that lags this far behind the others loses its
+   oldest characters. */
+enum { CW_ENSEMBLE_QUEUE_CAPACITY = 128 };
+
+/* Count of events passed to members at once. Members process each
+   block one after another, while the block is still in cache. */
+enum { CW_ENSEMBLE_BLOCK_SIZE = 64 };
+
+
+
+
+typedef enum {
+	CW_ENSEMBLE_MEMBER_RECEIVER,
+	CW_ENSEMBLE_MEMBER_VITERBI
+} cw_ensemble_member_type_t;
+
+
+
+
+typedef struct {
+	cw_ensemble_member_type_t type;
+	cw_rec_t * rec;       /* Owned by client code. */
+	cw_viterbi_t * vit;   /* Owned by client code. */
+	int weight;
+
+	/* Characters reported by member and not resolved yet, in order
+	   of timestamps. */
+	cw_rec_output_t outputs[CW_ENSEMBLE_QUEUE_CAPACITY];
+	int n_outputs;
+
+	/* Timestamp of last inter-word-space reported by member: the
+	   member won't report any more characters with this or earlier
+	   timestamp. -1 if there was none. [ns] */
+	int64_t done_until;
+
+	cw_ensemble_t * ensemble;
+} cw_ensemble_member_t;
+
+
+
+
+struct cw_ensemble_struct {
+	cw_ensemble_member_t members[CW_ENSEMBLE_MEMBERS_MAX];
+	int n_members;
+	int total_weight;
+
+	/* State of shared parsing of key events. */
+	bool is_key_down;
+	int64_t last_timestamp; /* [ns] */
+	cw_rec_event_t block[CW_ENSEMBLE_BLOCK_SIZE];
+
+	/* Characters with this or earlier timestamp have been
+	   resolved and reported to client code. [ns] */
+	int64_t resolved_until;
+
+	/* Client's callback, valid during cw_ensemble_process_events(). */
+	cw_rec_output_callback_t callback_func;
+	void * callback_arg;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_ENSEMBLE */
@@ -0,0 +1,772 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_file.c
+
+   @brief File sound sink.
+
+   Samples produced by generator are written to a file (or to already
+   open file descriptor) as WAV or as raw PCM. By default the samples are
+   written as fast as generator can produce them, so rendering of long
+   texts is limited only by CPU and by I/O. Optionally the writes can be
+   paced to follow wall clock, which is useful when the file descriptor
+   is a pipe read by some real-time consumer.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(HAVE_STRING_H)
+# include <string.h>
+#endif
+
+
+
+
+#include "libcw_capture.h"
+#include "libcw_debug.h"
+#include "libcw_file.h"
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/file: "
+
+
+
+
+/* Captured samples are always mono, signed, 16 bits. Samples written
+   by generator are in format selected by cw_gen_config_t::sample_format. */
+#define CW_FILE_BYTES_PER_SAMPLE 2
+
+/* Size of canonical WAV header for PCM data. */
+#define CW_FILE_WAV_HEADER_SIZE 44
+
+/* Value of RIFF and data chunk sizes used when final size of data is not
+   known (when writing to non-seekable descriptor). */
+#define CW_FILE_WAV_UNKNOWN_SIZE 0xFFFFFFFFU
+
+/* Count of samples passed by generator to the sink in one call. */
+#define CW_FILE_BUFFER_N_SAMPLES 1024
+
+/* Default sample rate of the file. The sink accepts any rate, so we
+   don't have to negotiate anything, just pick a common value. */
+#define CW_FILE_SAMPLE_RATE 48000
+
+/* Lowest accepted sample rate, dictated by value of CW_FREQUENCY_MAX. */
+#define CW_FILE_SAMPLE_RATE_MIN 8000
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static cw_ret_t cw_file_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_file_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_file_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_file_write_all_internal(int fd, const uint8_t * data, size_t n_bytes);
+static cw_ret_t cw_file_flush_internal(cw_gen_t * gen);
+static cw_ret_t cw_file_write_wav_header_internal(cw_gen_t * gen, uint32_t data_size);
+static void     cw_file_pace_internal(cw_gen_t * gen, int n_samples);
+static void     cw_file_put_le16_internal(uint8_t * dest, uint16_t value);
+static void     cw_file_put_le32_internal(uint8_t * dest, uint32_t value);
+static uint16_t cw_file_get_le16_internal(const uint8_t * src);
+static uint32_t cw_file_get_le32_internal(const uint8_t * src);
+
+static cw_ret_t cw_file_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration);
+static void     cw_file_close_capture_internal(cw_capture_t * capture);
+static int      cw_file_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp);
+static ssize_t  cw_file_read_all_internal(int fd, uint8_t * data, size_t n_bytes);
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with File sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with file system (doesn't try to open the file).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_file_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_FILE;
+	gen->open_and_configure_sound_device = cw_file_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_file_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_file_write_buffer_to_sound_device_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if it is possible to write to given file
+
+   "-" (standard output) and paths to files that don't exist yet are
+   considered to be writable. Final verdict is given by open(), called
+   when generator is being created.
+
+   @param[in] device_name path to file (may be NULL or empty, then a default
+   path is used)
+
+   @return true if it's possible to write to the file
+   @return false otherwise
+*/
+bool cw_is_file_possible(const char * device_name)
+{
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	cw_gen_pick_device_name_internal(device_name, CW_AUDIO_FILE,
+					 picked_device_name, sizeof (picked_device_name));
+
+	if (0 == strcmp(picked_device_name, "-")) {
+		return true;
+	}
+
+	if (0 == access(picked_device_name, W_OK)) {
+		return true;
+	}
+	if (ENOENT == errno) {
+		/* File will be created. */
+		return true;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "is possible: can't write to '%s': %s", picked_device_name, strerror(errno));
+	return false;
+}
+
+
+
+
+/**
+   @brief Open output file for given generator
+
+   @param[in] gen generator for which to open the file
+   @param[in] gen_conf configuration of generator: path or file descriptor, format, pacing
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_file_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (gen->sound_device_is_open) {
+		/* Ignore the call if the device is already open. */
+		return CW_SUCCESS;
+	}
+
+	if (gen_conf->file_format != CW_FILE_FORMAT_WAV && gen_conf->file_format != CW_FILE_FORMAT_RAW) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: invalid file format %d", gen_conf->file_format);
+		return CW_FAILURE;
+	}
+	if (0 != gen_conf->file_sample_rate && gen_conf->file_sample_rate < CW_FILE_SAMPLE_RATE_MIN) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: invalid sample rate %u", gen_conf->file_sample_rate);
+		return CW_FAILURE;
+	}
+	gen->file_data.format = gen_conf->file_format;
+	gen->file_data.realtime = gen_conf->file_realtime;
+
+	if (gen_conf->file_fd >= 0) {
+		gen->file_data.fd = gen_conf->file_fd;
+		gen->file_data.fd_is_owned = false;
+		snprintf(gen->picked_device_name, sizeof (gen->picked_device_name), "fd:%d", gen_conf->file_fd);
+	} else {
+		cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+						 gen->picked_device_name, sizeof (gen->picked_device_name));
+		if (0 == strcmp(gen->picked_device_name, "-")) {
+			gen->file_data.fd = STDOUT_FILENO;
+			gen->file_data.fd_is_owned = false;
+		} else {
+			gen->file_data.fd = open(gen->picked_device_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (-1 == gen->file_data.fd) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "open: open(%s): '%s'", gen->picked_device_name, strerror(errno));
+				return CW_FAILURE;
+			}
+			gen->file_data.fd_is_owned = true;
+		}
+	}
+
+	/* Regular file can be rewound at the end and have its WAV header
+	   updated. Pipe, socket or terminal can't. */
+	struct stat st;
+	gen->file_data.header_offset = lseek(gen->file_data.fd, 0, SEEK_CUR);
+	gen->file_data.is_seekable = -1 != gen->file_data.header_offset
+		&& 0 == fstat(gen->file_data.fd, &st)
+		&& S_ISREG(st.st_mode);
+
+	gen->file_data.write_buffer = (uint8_t *) malloc(CW_FILE_WRITE_BUFFER_SIZE);
+	if (NULL == gen->file_data.write_buffer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "malloc()");
+		if (gen->file_data.fd_is_owned) {
+			close(gen->file_data.fd);
+		}
+		gen->file_data.fd = -1;
+		return CW_FAILURE;
+	}
+	gen->file_data.write_buffer_n_bytes = 0;
+	gen->file_data.n_data_bytes = 0;
+	gen->file_data.pacing_n_samples = 0;
+
+	gen->sample_rate = 0 != gen_conf->file_sample_rate ? gen_conf->file_sample_rate : CW_FILE_SAMPLE_RATE;
+	gen->buffer_n_samples = CW_FILE_BUFFER_N_SAMPLES;
+
+	if (CW_FILE_FORMAT_WAV == gen->file_data.format) {
+		if (CW_SUCCESS != cw_file_write_wav_header_internal(gen, CW_FILE_WAV_UNKNOWN_SIZE)) {
+			free(gen->file_data.write_buffer);
+			gen->file_data.write_buffer = NULL;
+			if (gen->file_data.fd_is_owned) {
+				close(gen->file_data.fd);
+			}
+			gen->file_data.fd = -1;
+			return CW_FAILURE;
+		}
+	}
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close output file of given generator
+
+   Pending samples are written to the file. If the file is seekable and
+   the format is WAV, header of the file is updated with final size of
+   data.
+
+   @param[in] gen generator for which to close its file
+*/
+static void cw_file_close_sound_device_internal(cw_gen_t * gen)
+{
+	if (-1 == gen->file_data.fd) {
+		gen->sound_device_is_open = false;
+		return;
+	}
+
+	cw_file_flush_internal(gen);
+
+	if (CW_FILE_FORMAT_WAV == gen->file_data.format && gen->file_data.is_seekable) {
+		const uint64_t max = CW_FILE_WAV_UNKNOWN_SIZE - (CW_FILE_WAV_HEADER_SIZE - 8);
+		const uint32_t data_size = gen->file_data.n_data_bytes > max ? (uint32_t) max : (uint32_t) gen->file_data.n_data_bytes;
+		const off_t end = lseek(gen->file_data.fd, 0, SEEK_CUR);
+		if (-1 != lseek(gen->file_data.fd, gen->file_data.header_offset, SEEK_SET)) {
+			cw_file_write_wav_header_internal(gen, data_size);
+			lseek(gen->file_data.fd, end, SEEK_SET);
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "close: can't update WAV header: %s", strerror(errno));
+		}
+	}
+
+	if (gen->file_data.fd_is_owned) {
+		close(gen->file_data.fd);
+	}
+	gen->file_data.fd = -1;
+
+	free(gen->file_data.write_buffer);
+	gen->file_data.write_buffer = NULL;
+
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write generated samples to file configured and opened for generator
+
+   Samples are accumulated in large buffer and are written to the
+   file when the buffer fills up. In real-time mode the samples are
+   written immediately, and the function waits until the samples
+   would have been played by a real sound device.
+
+   @param[in] gen generator that will write to file
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_file_write_buffer_to_sound_device_internal(cw_gen_t * gen)
+{
+	assert (gen);
+	assert (gen->sound_system == CW_AUDIO_FILE);
+
+	/* Each frame has one sample per channel. */
+	const int n_samples = gen->buffer_write_n_samples * gen->n_sound_channels;
+	const size_t n_bytes = gen->sample_size * (size_t) n_samples;
+	if (gen->file_data.write_buffer_n_bytes + n_bytes > CW_FILE_WRITE_BUFFER_SIZE) {
+		if (CW_SUCCESS != cw_file_flush_internal(gen)) {
+			return CW_FAILURE;
+		}
+	}
+
+	/* File is little-endian regardless of byte order of host. */
+	const void * frames = cw_gen_frames_internal(gen);
+	uint8_t * dest = gen->file_data.write_buffer + gen->file_data.write_buffer_n_bytes;
+	switch (gen->sample_format) {
+	case CW_SAMPLE_FORMAT_S32: {
+		const int32_t * samples = (const int32_t *) frames;
+		for (int i = 0; i < n_samples; i++) {
+			cw_file_put_le32_internal(dest + 4 * i, (uint32_t) samples[i]);
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_FLOAT: {
+		const float * samples = (const float *) frames;
+		for (int i = 0; i < n_samples; i++) {
+			uint32_t bits = 0;
+			memcpy(&bits, &samples[i], sizeof (bits));
+			cw_file_put_le32_internal(dest + 4 * i, bits);
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_S16:
+	default: {
+		const cw_sample_t * samples = (const cw_sample_t *) frames;
+		for (int i = 0; i < n_samples; i++) {
+			cw_file_put_le16_internal(dest + CW_FILE_BYTES_PER_SAMPLE * i, (uint16_t) samples[i]);
+		}
+		break;
+	}
+	}
+	gen->file_data.write_buffer_n_bytes += n_bytes;
+
+	if (gen->file_data.realtime) {
+		if (CW_SUCCESS != cw_file_flush_internal(gen)) {
+			return CW_FAILURE;
+		}
+		if (NULL == gen->scheduling.sched) {
+			/* Scheduler paces generator by itself. */
+			cw_file_pace_internal(gen, gen->buffer_write_n_samples);
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write all pending samples to the file
+
+   @param[in] gen generator with pending samples
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_file_flush_internal(cw_gen_t * gen)
+{
+	if (0 == gen->file_data.write_buffer_n_bytes) {
+		return CW_SUCCESS;
+	}
+
+	const size_t n_bytes = gen->file_data.write_buffer_n_bytes;
+	gen->file_data.write_buffer_n_bytes = 0;
+
+	if (CW_SUCCESS != cw_file_write_all_internal(gen->file_data.fd, gen->file_data.write_buffer, n_bytes)) {
+		return CW_FAILURE;
+	}
+	gen->file_data.n_data_bytes += n_bytes;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write whole contents of buffer to file descriptor
+
+   The function handles short writes and interrupted writes.
+
+   @param[in] fd file descriptor to write to
+   @param[in] data data to write
+   @param[in] n_bytes count of bytes in @p data
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_file_write_all_internal(int fd, const uint8_t * data, size_t n_bytes)
+{
+	while (n_bytes > 0) {
+		const ssize_t rv = write(fd, data, n_bytes);
+		if (-1 == rv) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: %s", strerror(errno));
+			return CW_FAILURE;
+		}
+		data += rv;
+		n_bytes -= (size_t) rv;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write WAV header at current position in file
+
+   @param[in] gen generator with open file
+   @param[in] data_size size of data chunk, or CW_FILE_WAV_UNKNOWN_SIZE if the size is not known yet
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_file_write_wav_header_internal(cw_gen_t * gen, uint32_t data_size)
+{
+	const uint32_t riff_size = CW_FILE_WAV_UNKNOWN_SIZE == data_size
+		? CW_FILE_WAV_UNKNOWN_SIZE
+		: data_size + (CW_FILE_WAV_HEADER_SIZE - 8);
+
+	uint8_t header[CW_FILE_WAV_HEADER_SIZE] = { 0 };
+	memcpy(header + 0, "RIFF", 4);
+	cw_file_put_le32_internal(header + 4, riff_size);
+	memcpy(header + 8, "WAVE", 4);
+
+	memcpy(header + 12, "fmt ", 4);
+	const unsigned int bytes_per_sample = (unsigned int) gen->sample_size;
+	cw_file_put_le32_internal(header + 16, 16);                                      /* Size of fmt chunk. */
+	cw_file_put_le16_internal(header + 20, CW_SAMPLE_FORMAT_FLOAT == gen->sample_format ? 3 : 1); /* IEEE float or PCM. */
+	cw_file_put_le16_internal(header + 22, (uint16_t) gen->n_sound_channels);
+	cw_file_put_le32_internal(header + 24, gen->sample_rate);
+	cw_file_put_le32_internal(header + 28, gen->sample_rate * (unsigned int) gen->n_sound_channels * bytes_per_sample); /* Byte rate. */
+	cw_file_put_le16_internal(header + 32, (uint16_t) ((unsigned int) gen->n_sound_channels * bytes_per_sample));       /* Block align. */
+	cw_file_put_le16_internal(header + 34, (uint16_t) (8 * bytes_per_sample));      /* Bits per sample. */
+
+	memcpy(header + 36, "data", 4);
+	cw_file_put_le32_internal(header + 40, data_size);
+
+	return cw_file_write_all_internal(gen->file_data.fd, header, sizeof (header));
+}
+
+
+
+
+/**
+   @brief Wait until samples written so far would have been played
+
+   Time is measured from first write, so that errors of individual sleeps
+   don't accumulate.
+
+   @param[in] gen generator writing to file
+   @param[in] n_samples count of samples that have just been written
+*/
+static void cw_file_pace_internal(cw_gen_t * gen, int n_samples)
+{
+	if (0 == gen->file_data.pacing_n_samples) {
+		cw_clock_get_timeval_internal(&gen->file_data.pacing_start);
+	}
+	gen->file_data.pacing_n_samples += (uint64_t) n_samples;
+
+	const uint64_t target_usecs = (gen->file_data.pacing_n_samples * 1000000) / gen->sample_rate;
+
+	struct timeval now;
+	cw_clock_get_timeval_internal(&now);
+	const int64_t elapsed_usecs = (int64_t) (now.tv_sec - gen->file_data.pacing_start.tv_sec) * 1000000
+		+ (int64_t) (now.tv_usec - gen->file_data.pacing_start.tv_usec);
+
+	if ((int64_t) target_usecs > elapsed_usecs) {
+		cw_usleep_internal((int) (target_usecs - elapsed_usecs));
+	}
+
+	return;
+}
+
+
+
+
+static void cw_file_put_le16_internal(uint8_t * dest, uint16_t value)
+{
+	dest[0] = (uint8_t) (value & 0xFFU);
+	dest[1] = (uint8_t) ((value >> 8) & 0xFFU);
+}
+
+
+
+
+static void cw_file_put_le32_internal(uint8_t * dest, uint32_t value)
+{
+	dest[0] = (uint8_t) (value & 0xFFU);
+	dest[1] = (uint8_t) ((value >> 8) & 0xFFU);
+	dest[2] = (uint8_t) ((value >> 16) & 0xFFU);
+	dest[3] = (uint8_t) ((value >> 24) & 0xFFU);
+}
+
+
+
+
+static uint16_t cw_file_get_le16_internal(const uint8_t * src)
+{
+	return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+
+
+
+static uint32_t cw_file_get_le32_internal(const uint8_t * src)
+{
+	return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+
+
+
+/**
+   @brief Configure given @p capture variable to read samples from File
+
+   @param[in,out] capture capture structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_file_init_capture_internal(cw_capture_t * capture)
+{
+	assert (capture);
+
+	capture->sound_system = CW_AUDIO_FILE;
+	capture->open_device  = cw_file_open_capture_internal;
+	capture->close_device = cw_file_close_capture_internal;
+	capture->read_device  = cw_file_read_capture_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Open input file of capture
+
+   File starting with canonical WAV header (mono, 16-bit PCM), as
+   written by generator, is read with sample rate from the header.
+   Any other file is read as raw samples (mono, signed 16-bit,
+   little-endian) with @p sample_rate.
+
+   @param[in,out] capture capture with path of file
+   @param[in] sample_rate sample rate of raw file
+   @param[in] period_duration duration of block of samples [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_file_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration)
+{
+	if (0 == strcmp(capture->picked_device_name, "-")) {
+		capture->file_fd = STDIN_FILENO;
+		capture->file_fd_is_owned = false;
+	} else {
+		capture->file_fd = open(capture->picked_device_name, O_RDONLY);
+		if (-1 == capture->file_fd) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open capture: open(%s): '%s'", capture->picked_device_name, strerror(errno));
+			return CW_FAILURE;
+		}
+		capture->file_fd_is_owned = true;
+	}
+
+	const ssize_t n_bytes = cw_file_read_all_internal(capture->file_fd, capture->file_head, sizeof (capture->file_head));
+	if (n_bytes < 0) {
+		cw_file_close_capture_internal(capture);
+		return CW_FAILURE;
+	}
+	capture->file_head_n_bytes = (size_t) n_bytes;
+
+	const uint8_t * head = capture->file_head;
+	if (CW_FILE_WAV_HEADER_SIZE == capture->file_head_n_bytes
+	    && 0 == memcmp(head + 0, "RIFF", 4)
+	    && 0 == memcmp(head + 8, "WAVE", 4)) {
+
+		if (0 != memcmp(head + 12, "fmt ", 4)
+		    || 1 != cw_file_get_le16_internal(head + 20)                             /* PCM. */
+		    || 1 != cw_file_get_le16_internal(head + 22)                             /* Mono. */
+		    || 8 * CW_FILE_BYTES_PER_SAMPLE != cw_file_get_le16_internal(head + 34)  /* 16 bits. */
+		    || 0 != memcmp(head + 36, "data", 4)) {
+
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open capture: unsupported format of WAV file '%s'", capture->picked_device_name);
+			cw_file_close_capture_internal(capture);
+			return CW_FAILURE;
+		}
+		const uint32_t header_sample_rate = cw_file_get_le32_internal(head + 24);
+		if (header_sample_rate < CW_CAPTURE_SAMPLE_RATE_MIN || header_sample_rate > CW_CAPTURE_SAMPLE_RATE_MAX) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open capture: invalid sample rate %u in WAV file '%s'", header_sample_rate, capture->picked_device_name);
+			cw_file_close_capture_internal(capture);
+			return CW_FAILURE;
+		}
+		sample_rate = (int) header_sample_rate;
+		/* Header is not a part of samples. */
+		capture->file_head_n_bytes = 0;
+	}
+
+	capture->sample_rate = sample_rate;
+	capture->period_n_samples = (int) ((int64_t) sample_rate * period_duration / CW_USECS_PER_SEC);
+	if (capture->period_n_samples < 1) {
+		capture->period_n_samples = 1;
+	}
+	capture->file_start = cw_clock_now_internal();
+	capture->file_n_samples = 0;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close input file of capture
+
+   @param[in,out] capture capture with opened file
+*/
+static void cw_file_close_capture_internal(cw_capture_t * capture)
+{
+	if (capture->file_fd_is_owned && -1 != capture->file_fd) {
+		close(capture->file_fd);
+	}
+	capture->file_fd = -1;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Read samples from input file of capture
+
+   Timestamps of samples follow sample rate of file, starting at time
+   of opening of the file.
+
+   @param[in,out] capture capture with opened file
+   @param[out] samples buffer for samples
+   @param[in] n_samples size of @p samples
+   @param[out] timestamp timestamp of first read sample [ns]
+
+   @return count of read samples
+   @return zero at the end of file
+   @return -1 on error
+*/
+static int cw_file_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp)
+{
+	uint8_t * bytes = (uint8_t *) samples;
+	const size_t capacity = (size_t) n_samples * CW_FILE_BYTES_PER_SAMPLE;
+	size_t n_bytes = 0;
+
+	if (capture->file_head_n_bytes > 0) {
+		n_bytes = capture->file_head_n_bytes < capacity ? capture->file_head_n_bytes : capacity;
+		memcpy(bytes, capture->file_head, n_bytes);
+		memmove(capture->file_head, capture->file_head + n_bytes, capture->file_head_n_bytes - n_bytes);
+		capture->file_head_n_bytes -= n_bytes;
+	}
+
+	const ssize_t rv = cw_file_read_all_internal(capture->file_fd, bytes + n_bytes, capacity - n_bytes);
+	if (rv < 0) {
+		return -1;
+	}
+	n_bytes += (size_t) rv;
+
+	/* Incomplete sample at the end of file is dropped. */
+	const int n_read = (int) (n_bytes / CW_FILE_BYTES_PER_SAMPLE);
+	for (int i = 0; i < n_read; i++) {
+		/* In place: sample i is made of bytes 2i and 2i + 1. */
+		samples[i] = (int16_t) cw_file_get_le16_internal(bytes + i * CW_FILE_BYTES_PER_SAMPLE);
+	}
+
+	*timestamp = capture->file_start + (capture->file_n_samples * CW_NSECS_PER_SEC) / capture->sample_rate;
+	capture->file_n_samples += n_read;
+
+	return n_read;
+}
+
+
+
+
+/**
+   @brief Read from file until buffer is full or end of file is reached
+
+   @param[in] fd file descriptor
+   @param[out] data buffer for data
+   @param[in] n_bytes size of @p data
+
+   @return count of read bytes (smaller than @p n_bytes only at the end of file)
+   @return -1 on error
+*/
+static ssize_t cw_file_read_all_internal(int fd, uint8_t * data, size_t n_bytes)
+{
+	size_t n_read = 0;
+	while (n_read < n_bytes) {
+		const ssize_t rv = read(fd, data + n_read, n_bytes - n_read);
+		if (rv > 0) {
+			n_read += (size_t) rv;
+		} else if (0 == rv) {
+			break;
+		} else if (EINTR != errno) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "read: '%s'", strerror(errno));
+			return -1;
+		}
+	}
+	return (ssize_t) n_read;
+}
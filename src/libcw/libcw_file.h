@@ -0,0 +1,69 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_FILE
+#define H_LIBCW_FILE
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "libcw2.h"
+
+
+
+
+/* Size of buffer in which samples are accumulated before being written to
+   file with single write() call. */
+#define CW_FILE_WRITE_BUFFER_SIZE (64 * 1024)
+
+
+
+
+typedef struct cw_file_data_struct {
+	int fd;
+	bool fd_is_owned;   /* Was the descriptor opened by libcw (and should it be closed by libcw)? */
+
+	cw_file_format_t format;
+	bool realtime;
+
+	/* Offset of WAV header in the file, and flag saying if we can go
+	   back to the offset and update the header with final size of
+	   data. */
+	off_t header_offset;
+	bool is_seekable;
+
+	/* Samples (already converted to little-endian) waiting to be
+	   written to file. */
+	uint8_t * write_buffer;
+	size_t write_buffer_n_bytes;
+
+	/* Count of bytes of samples written to file so far. */
+	uint64_t n_data_bytes;
+
+	/* Used for real-time pacing: time of first write, and count of
+	   samples passed to the sink since then. */
+	struct timeval pacing_start;
+	uint64_t pacing_n_samples;
+} cw_file_data_t;
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_file_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_FILE */
@@ -68,10 +68,12 @@
 #include <errno.h>
 #include <inttypes.h> /* uint32_t */
 #include <math.h>
+#include <sched.h> /* SCHED_FIFO, SCHED_RR, cpu_set_t */
 #include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h> /* mlock() */
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -95,12 +97,20 @@
 #include "libcw_console.h"
 #include "libcw_data.h"
 #include "libcw_debug.h"
+#include "libcw_dispatch.h"
+#include "libcw_file.h"
 #include "libcw_gen.h"
 #include "libcw_gen_internal.h"
+#include "libcw_keying.h"
+#include "libcw_keylog.h"
+#include "libcw_metrics.h"
 #include "libcw_null.h"
 #include "libcw_oss.h"
 #include "libcw_rec.h"
+#include "libcw_sched.h"
+#include "libcw_shmq.h"
 #include "libcw_signal.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -120,6 +130,143 @@ static const float CW_PI = 3.14159265358979323846F;
 
 
 
+/*
+  Sine table used by CW_GEN_OSCILLATOR_TABLE engine.
+
+  Top CW_SINE_TABLE_INDEX_BITS bits of 32-bit phase accumulator are used as
+  index into the table, the remaining bits are used as fraction for linear
+  interpolation between two neighbouring cells. The table has one
+  additional (guard) cell, equal to cell zero, so that interpolation never
+  needs to wrap around.
+
+  With 4096 cells the error of interpolated value is below 3e-7, i.e. far
+  below resolution of 16-bit samples.
+
+  In fixed-point build the cells are Q15 numbers, and only top 15 bits of
+  the fraction are used for interpolation.
+*/
+#define CW_SINE_TABLE_INDEX_BITS        12
+#define CW_SINE_TABLE_SIZE              (1U << CW_SINE_TABLE_INDEX_BITS)
+#define CW_SINE_TABLE_FRACTION_BITS     (32 - CW_SINE_TABLE_INDEX_BITS)
+#define CW_SINE_TABLE_FRACTION_MASK     ((1U << CW_SINE_TABLE_FRACTION_BITS) - 1)
+#ifdef LIBCW_FIXED_POINT
+static int16_t cw_sine_table[CW_SINE_TABLE_SIZE + 1];
+#else
+static float cw_sine_table[CW_SINE_TABLE_SIZE + 1];
+#endif
+static pthread_once_t cw_sine_table_once = PTHREAD_ONCE_INIT;
+
+/* The sine table is shared by all generators, so it is locked in
+   memory once, for the whole process, by first generator with
+   cw_gen_config_t::lock_memory. */
+static pthread_once_t cw_sine_table_lock_once = PTHREAD_ONCE_INIT;
+static int cw_sine_table_lock_errno = 0;
+
+
+
+
+/*
+  Unit-amplitude sine wave calculated by oscillator, and multiplication
+  of the wave by envelope of a tone.
+
+  In fixed-point build the wave is a Q15 number (1.0 is
+  CW_GEN_WAVE_ONE), slope amplitudes are Q15 numbers too (see
+  cw_gen_amplitude_t), and generator's volume is an integer gain, so
+  samples are calculated with integer multiplications and shifts only.
+  Products of two Q15 numbers (or of a Q15 number and a gain of up to
+  CW_AUDIO_VOLUME_RANGE) fit in 32 bits.
+*/
+#ifdef LIBCW_FIXED_POINT
+typedef int32_t cw_gen_wave_t;
+#define CW_GEN_WAVE_ONE  32767
+#define CW_GEN_SLOPE_GAIN(amplitude, gain)          ((int32_t) (((int32_t) (amplitude) * (gain)) >> 15))
+#define CW_GEN_SLOPE_SAMPLE(amplitude, gain, wave)  ((cw_sample_t) ((CW_GEN_SLOPE_GAIN((amplitude), (gain)) * (wave)) >> 15))
+#define CW_GEN_PLATEAU_SAMPLE(gain, wave)           ((cw_sample_t) (((gain) * (wave)) >> 15))
+#else
+typedef float cw_gen_wave_t;
+#define CW_GEN_SLOPE_GAIN(amplitude, gain)          ((amplitude) * (gain))
+#define CW_GEN_SLOPE_SAMPLE(amplitude, gain, wave)  (((float) (int) CW_GEN_SLOPE_GAIN((amplitude), (gain))) * (wave))
+#define CW_GEN_PLATEAU_SAMPLE(gain, wave)           ((gain) * (wave))
+#endif
+
+
+
+
+/* Process-wide cache of tables of slope amplitudes, shared by all
+   generators. See cw_gen_slope_table_t. */
+static cw_gen_slope_table_t * cw_gen_slope_tables = NULL;
+static pthread_mutex_t cw_gen_slope_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+/* Lateness of end of tone (in microseconds) up to which Null and
+   Console sound systems compensate it by shortening next tone. After
+   longer stalls the timing is restarted from current time, to avoid
+   cutting next tones short. */
+#define CW_GEN_PACING_MAX_LATENESS  20000
+
+
+
+
+/* Count of tones into which inter-word-space is split, see
+   cw_gen_batch_add_iws_internal(). */
+#define CW_GEN_IWS_N_PARTS  2
+
+
+
+
+/* Count of attempts to copy latency statistics without mutex, see
+   cw_gen_latency_snapshot_internal(). */
+#define CW_GEN_LATENCY_SNAPSHOT_ATTEMPTS  8
+
+
+
+
+/* Size of buffer allocated for offline rendering by generators that
+   don't have their own buffer (i.e. by Null and Console generators). */
+#define CW_GEN_RENDER_BUFFER_N_SAMPLES    1024
+
+/* Count of samples calculated at once by cw_gen_fill_buffer(). This
+   also dictates duration of tone that silences generator. */
+#define CW_GEN_PULL_CHUNK_N_SAMPLES        256
+
+/* Size of sub-block of generator's buffer in low-latency keying mode,
+   see cw_gen_config_t::low_latency_keying. 32 samples is below 1 ms
+   at typical sample rates. */
+#define CW_GEN_KEYING_SUB_BLOCK_N_SAMPLES  32
+
+
+
+
+/* Samples of a subarea of generator's buffer are calculated in blocks
+   of this size. The value determines size of a temporary buffer on
+   stack. */
+#define CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES  256
+
+
+
+
+/* Function calculating @p n consecutive samples of a tone, specialized
+   for one layout of tone's envelope. See cw_gen_select_kernel_internal(). */
+typedef void (* cw_gen_kernel_t)(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out, int n);
+
+
+
+
+/* Tones of characters enqueued with cw_gen_enqueue_*() functions are
+   first collected in a batch, and then the whole batch is added to tone
+   queue with single call to cw_tq_enqueue_batch_internal(). */
+#define CW_GEN_TONES_BATCH_CAPACITY  256
+
+typedef struct {
+	cw_tone_t tones[CW_GEN_TONES_BATCH_CAPACITY];
+	size_t n_tones;
+} cw_gen_tones_batch_t;
+
+
+
+
 /* From libcw_debug.c. */
 extern cw_debug_t cw_debug_object;
 extern cw_debug_t cw_debug_object_ev;
@@ -156,10 +303,68 @@ const unsigned int cw_supported_sample_rates[] = {
 
 
 static cw_ret_t cw_gen_value_tracking_internal(cw_gen_t * gen, const cw_tone_t * tone, cw_queue_state_t queue_state);
-static void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, volatile cw_key_t * key, cw_key_value_t value);
+static void cw_gen_tone_dequeued_internal(cw_gen_t * gen, cw_tone_t * tone, const cw_tone_t * prev_tone, cw_queue_state_t queue_state);
+static void cw_gen_timing_publish_internal(cw_gen_t * gen);
+static void cw_gen_tone_calculate_samples_internal(cw_gen_t * gen, cw_tone_t * tone, const cw_tone_t * prev_tone, bool is_empty_tone);
+static void cw_gen_tone_played_internal(cw_gen_t * gen, const cw_tone_t * tone, cw_tone_t * prev_tone, bool may_sleep);
+static void cw_gen_wait_for_tone_internal(cw_gen_t * gen);
+static void cw_gen_idle_timer_callback_internal(void * arg);
+static void cw_gen_idle_timer_start_internal(cw_gen_t * gen);
+static void cw_gen_idle_timer_cancel_internal(cw_gen_t * gen);
+static bool cw_gen_idle_silence_has_timed_out_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static void cw_gen_idle_wait_for_tone_internal(cw_gen_t * gen);
+static void cw_gen_pause_wait_internal(cw_gen_t * gen);
+static void cw_gen_idle_enter_internal(cw_gen_t * gen);
+static void cw_gen_idle_leave_internal(cw_gen_t * gen);
+static void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, volatile cw_key_t * key, cw_key_value_t value, int64_t timestamp);
+static int64_t cw_gen_sound_timestamp_internal(const cw_gen_t * gen);
+static void cw_gen_sound_clock_set_anchor_internal(cw_gen_t * gen);
 static void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
 static void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
-static void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
+static bool cw_gen_tone_samples_size_is_valid_internal(const cw_gen_t * gen, const cw_tone_t * tone);
+static const cw_gen_char_tones_t * cw_gen_char_tones_lookup_internal(cw_gen_t * gen, char character);
+static bool cw_gen_batch_is_above_high_water_mark_internal(cw_gen_t * gen, const cw_gen_tones_batch_t * batch);
+static void cw_gen_init_sine_table_internal(void);
+static cw_gen_slope_table_t * cw_gen_slope_table_acquire_internal(int shape, int n_amplitudes);
+static void cw_gen_slope_table_release_internal(cw_gen_slope_table_t * table);
+static void cw_gen_slope_table_calculate_internal(cw_gen_slope_table_t * table);
+static cw_ret_t cw_gen_set_realtime_config_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static size_t cw_gen_round_to_pages_internal(size_t size);
+static void * cw_gen_calloc_pages_internal(size_t size);
+static void cw_gen_lock_memory_internal(cw_gen_t * gen, void * addr, size_t size);
+static void cw_gen_unlock_memory_internal(cw_gen_t * gen);
+static void cw_gen_lock_sine_table_internal(void);
+static void cw_gen_set_memory_lock_status_internal(cw_gen_t * gen, int errno_val);
+static int cw_gen_slope_table_lock_internal(cw_gen_slope_table_t * table);
+static void cw_gen_calculate_sine_wave_sinf_internal(const cw_gen_t * gen, int frequency, int t0, cw_gen_wave_t * wave, int n);
+static void cw_gen_normalize_phase_offset_internal(cw_gen_t * gen, int frequency, int t);
+static void cw_gen_calculate_sine_wave_table_internal(cw_gen_t * gen, uint32_t increment, int32_t step, cw_gen_wave_t * wave, int n);
+static inline void cw_gen_apply_envelope_internal(const cw_gen_t * gen, const cw_tone_t * tone, const cw_gen_wave_t * wave, cw_sample_t * out, int n, bool has_rising_slope, bool has_falling_slope) __attribute__((always_inline));
+static inline void cw_gen_synthesize_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out, int n, bool has_rising_slope, bool has_falling_slope) __attribute__((always_inline));
+static cw_gen_kernel_t cw_gen_select_kernel_internal(const cw_tone_t * tone);
+static int cw_gen_calculate_samples_internal(cw_gen_t * gen, cw_tone_t * tone, cw_gen_kernel_t kernel);
+static uint32_t cw_gen_phase_increment_internal(const cw_gen_t * gen, int frequency);
+static bool cw_gen_pcm_cache_is_applicable_internal(const cw_gen_t * gen, const cw_tone_t * tone);
+static const cw_sample_t * cw_gen_pcm_cache_lookup_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static void cw_latency_histogram_add_internal(cw_latency_histogram_t * histogram, int64_t latency);
+static void cw_gen_latency_update_begin_internal(cw_gen_t * gen);
+static void cw_gen_latency_update_end_internal(cw_gen_t * gen);
+static void cw_gen_latency_add_dequeued_internal(cw_gen_t * gen, cw_tone_t * tone);
+static void cw_gen_latency_add_buffer_internal(cw_gen_t * gen);
+static void cw_gen_latency_add_tone_internal(cw_gen_t * gen, const cw_tone_t * tone, cw_queue_state_t queue_state);
+static cw_ret_t cw_gen_render_append_internal(cw_gen_t * gen, const cw_sample_t * samples, size_t n_samples);
+static cw_ret_t cw_gen_render_write_buffer_internal(cw_gen_t * gen);
+static cw_ret_t cw_gen_render_queue_internal(cw_gen_t * gen);
+static cw_ret_t cw_gen_batch_flush_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch);
+static cw_ret_t cw_gen_batch_add_tone_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, const cw_tone_t * tone);
+static cw_ret_t cw_gen_batch_add_mark_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, char mark, bool is_first);
+static cw_ret_t cw_gen_batch_add_2u_ics_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch);
+static cw_ret_t cw_gen_batch_add_iws_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch);
+static cw_ret_t cw_gen_batch_add_representation_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, const char * representation);
+static cw_ret_t cw_gen_batch_add_valid_character_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, char character, bool add_ics);
+static int cw_gen_pull_tones_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples);
+static void cw_gen_text_source_pull_internal(cw_gen_t * gen);
+static void cw_gen_text_source_fill_internal(cw_gen_t * gen);
 
 
 
@@ -174,7 +379,10 @@ static const char * default_sound_devices[] = {
 	CW_DEFAULT_OSS_DEVICE,
 	CW_DEFAULT_ALSA_DEVICE,
 	CW_DEFAULT_PA_DEVICE,
-	(char *) NULL }; /* just in case someone decided to index the table with CW_AUDIO_SOUNDCARD */
+	(char *) NULL,   /* just in case someone decided to index the table with CW_AUDIO_SOUNDCARD */
+	CW_DEFAULT_FILE_DEVICE,
+	CW_DEFAULT_JACK_DEVICE,
+	CW_DEFAULT_RTP_DEVICE };
 
 
 
@@ -253,6 +461,8 @@ char * cw_gen_get_sound_system_label_internal(const cw_gen_t * gen, char * buffe
 cw_ret_t cw_gen_start(cw_gen_t * gen)
 {
 	gen->phase_offset = 0.0F;
+	gen->phase_accumulator = 0;
+	gen->paused = false;
 
 #ifdef GENERATOR_CLIENT_THREAD
 	/* This generator exists in client's application thread.
@@ -264,7 +474,10 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 	    && gen->sound_system != CW_AUDIO_CONSOLE
 	    && gen->sound_system != CW_AUDIO_OSS
 	    && gen->sound_system != CW_AUDIO_ALSA
-	    && gen->sound_system != CW_AUDIO_PA) {
+	    && gen->sound_system != CW_AUDIO_PA
+	    && gen->sound_system != CW_AUDIO_FILE
+	    && gen->sound_system != CW_AUDIO_JACK
+	    && gen->sound_system != CW_AUDIO_RTP) {
 
 		gen->do_dequeue_and_generate = false;
 
@@ -278,6 +491,21 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 	gen->do_dequeue_and_generate = true;
 
 
+	if (gen->pull.enabled) {
+		/* Sound server will be calling
+		   cw_gen_pull_samples_internal() from its own thread.
+		   No need for generator's thread. */
+		CW_TONE_INIT(&gen->pull.tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+		CW_TONE_INIT(&gen->pull.prev_tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+		gen->pull.tone_in_progress = false;
+		gen->pull.active = true;
+#ifdef LIBCW_WITH_DEV
+		cw_dev_debug_print_generator_setup_internal(gen);
+#endif
+		return CW_SUCCESS;
+	}
+
+
 #if LIBCW_GEN_DEBUG_THREAD_TIMING
 	/* Debug code to measure how long it takes to create thread. */
 	struct timeval before;
@@ -318,7 +546,7 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 		/* FIXME: For some yet unknown reason we have to put
 		   usleep() here, otherwise a generator may
 		   work incorrectly */
-		usleep(100000);
+		cw_usleep_internal(100000);
 #ifdef LIBCW_WITH_DEV
 		cw_dev_debug_print_generator_setup_internal(gen);
 #endif
@@ -329,6 +557,48 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 
 
 
+cw_ret_t cw_gen_start_with_sched(cw_gen_t * gen, cw_sched_t * sched)
+{
+	if (NULL == gen || NULL == sched || gen->sound_system != CW_AUDIO_FILE) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "generator can't be driven by scheduler");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (gen->do_dequeue_and_generate) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	gen->phase_offset = 0.0F;
+	gen->phase_accumulator = 0;
+
+	/* Samples are generated with the same code as in pull mode,
+	   but into generator's own buffer. */
+	CW_TONE_INIT(&gen->pull.tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+	CW_TONE_INIT(&gen->pull.prev_tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+	gen->pull.tone_in_progress = false;
+	gen->scheduling.paced = gen->file_data.realtime;
+	gen->scheduling.idle = true;
+	gen->scheduling.sched = sched;
+	gen->do_dequeue_and_generate = true;
+	gen->pull.active = true;
+
+	if (CW_SUCCESS != cw_sched_add_gen_internal(sched, gen)) {
+		gen->pull.active = false;
+		gen->do_dequeue_and_generate = false;
+		gen->scheduling.sched = (cw_sched_t *) NULL;
+		return CW_FAILURE;
+	}
+#ifdef LIBCW_WITH_DEV
+	cw_dev_debug_print_generator_setup_internal(gen);
+#endif
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Silence the generator
 
@@ -363,7 +633,7 @@ cw_ret_t cw_gen_silence_internal(cw_gen_t * gen)
 		return CW_SUCCESS;
 	}
 
-	if (!gen->thread.running) {
+	if (!gen->thread.running && !gen->pull.active) {
 		/* Silencing a generator means enqueueing and generating
 		   a tone with zero frequency.  We shouldn't do this
 		   when a "dequeue-and-generate-a-tone" function is not
@@ -372,6 +642,17 @@ cw_ret_t cw_gen_silence_internal(cw_gen_t * gen)
 		return CW_SUCCESS;
 	}
 
+	if (gen->pull.active && gen->pull.by_client_code) {
+		/* Client code's audio engine may have been already
+		   stopped, or this may be the thread that pulls samples
+		   with cw_gen_fill_buffer(). Don't wait for a silencing
+		   tone to be pulled. Sound will be cut by
+		   cw_gen_stop(). */
+		cw_tq_flush_internal(gen->tq);
+		cw_gen_value_tracking_set_value_internal(gen, gen->key, CW_KEY_VALUE_OPEN, cw_clock_now_internal());
+		return CW_SUCCESS;
+	}
+
 #if 1
 	/* Tell 'dequeue and generate' thread function to go silent.
 
@@ -439,10 +720,13 @@ cw_ret_t cw_gen_silence_internal(cw_gen_t * gen)
 	if (gen->sound_system == CW_AUDIO_NULL
 	    || gen->sound_system == CW_AUDIO_OSS
 	    || gen->sound_system == CW_AUDIO_ALSA
-	    || gen->sound_system == CW_AUDIO_PA) {
+	    || gen->sound_system == CW_AUDIO_PA
+	    || gen->sound_system == CW_AUDIO_FILE
+	    || gen->sound_system == CW_AUDIO_JACK
+	    || gen->sound_system == CW_AUDIO_RTP) {
 
 		/* Allow some time for playing the last tone. */
-		usleep(2 * tone.duration);
+		cw_usleep_internal(2 * tone.duration);
 
 	} else if (gen->sound_system == CW_AUDIO_CONSOLE) {
 		/* Sine wave generation should have been stopped
@@ -483,11 +767,64 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 	cw_assert (gen_conf->sound_system != CW_AUDIO_NONE, MSG_PREFIX "can't create generator with sound system '%s'", cw_get_audio_system_label(gen_conf->sound_system));
 
-	cw_gen_t * gen = (cw_gen_t *) calloc(1, sizeof (cw_gen_t));
+	if (gen_conf->sound_channels < 0 || gen_conf->sound_channels > CW_SOUND_CHANNELS_MAX
+	    || (gen_conf->sound_channels > 1 && gen_conf->pull_mode)) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid count of sound channels %d", gen_conf->sound_channels);
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	if (0 == cw_sample_format_size_internal(gen_conf->sample_format)
+	    || (CW_SAMPLE_FORMAT_S16 != gen_conf->sample_format
+		&& (gen_conf->pull_mode || gen_conf->sound_system == CW_AUDIO_JACK || gen_conf->sound_system == CW_AUDIO_RTP))) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid sample format %d", gen_conf->sample_format);
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	if ('\0' != gen_conf->tq_shared_name[0]
+	    && (CW_AUDIO_NULL != gen_conf->sound_system || gen_conf->pull_mode)) {
+
+		/* Proxy of shared tone queue doesn't play anything itself. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "proxy of shared tone queue needs Null sound system");
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	if (gen_conf->idle_timeout > INT_MAX) {
+		/* Timer used for idle mode takes int. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid idle timeout %u", gen_conf->idle_timeout);
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	/* Page-aligned, so that the memory can be locked and unlocked
+	   without affecting other data, see
+	   cw_gen_lock_memory_internal(). */
+	cw_gen_t * gen = (cw_gen_t *) cw_gen_calloc_pages_internal(sizeof (cw_gen_t));
 	if (NULL == gen) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "calloc()");
 		return (cw_gen_t *) NULL;
 	}
+	pthread_mutex_init(&gen->latency.mutex, NULL);
+	pthread_mutex_init(&gen->realtime.status_mutex, NULL);
+	pthread_mutex_init(&gen->value_tracking.keying_mutex, NULL);
+	pthread_mutex_init(&gen->text_source.mutex, NULL);
+	cw_impair_init_internal(&gen->impair);
+
+	if (gen_conf->callbacks_in_dispatch_thread) {
+		gen->dispatch = cw_dispatch_new_internal(gen);
+		if (NULL == gen->dispatch) {
+			cw_gen_delete(&gen);
+			return (cw_gen_t *) NULL;
+		}
+	}
 
 
 
@@ -500,6 +837,31 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		} else {
 			/* Sometimes tq needs to access a key associated with generator. */
 			gen->tq->gen = gen;
+			cw_tq_set_spsc_mode_internal(gen->tq, gen_conf->tq_single_producer);
+			cw_tq_set_coalescing_internal(gen->tq, gen_conf->tq_coalesce_tones);
+		}
+
+		if (0 != gen_conf->tq_capacity || gen_conf->tq_lazy_allocation) {
+			const size_t capacity = 0 != gen_conf->tq_capacity ? gen_conf->tq_capacity : CW_TONE_QUEUE_CAPACITY_DEFAULT;
+			if (CW_SUCCESS != cw_tq_configure_capacity_internal(gen->tq, capacity, gen_conf->tq_lazy_allocation)) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+					      MSG_PREFIX "new: failed to configure capacity %zu of tone queue", capacity);
+				cw_gen_delete(&gen);
+				return (cw_gen_t *) NULL;
+			}
+		}
+
+		if ('\0' != gen_conf->tq_shared_name[0]) {
+			/* The array in config may be not terminated. */
+			char name[CW_SHMQ_NAME_SIZE];
+			snprintf(name, sizeof (name), "%s", gen_conf->tq_shared_name);
+			gen->tq->shmq_producer = cw_shmq_connect_internal(name);
+			if (NULL == gen->tq->shmq_producer) {
+				const int saved_errno = errno;
+				cw_gen_delete(&gen);
+				errno = saved_errno;
+				return (cw_gen_t *) NULL;
+			}
 		}
 	}
 
@@ -543,14 +905,43 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		gen->buffer_n_samples = -1;
 		gen->buffer_sub_start = 0;
 		gen->buffer_sub_stop  = 0;
+		gen->buffer_write_n_samples = 0;
+		gen->low_latency_keying = gen_conf->low_latency_keying;
+		gen->idle.timeout = gen_conf->idle_timeout;
+		gen->idle.timer_id = -1;
+
+		gen->n_sound_channels = 0 != gen_conf->sound_channels ? gen_conf->sound_channels : 1;
+		for (int i = 0; i < CW_SOUND_CHANNELS_MAX; i++) {
+			gen->sound_channel_volumes[i] = CW_VOLUME_MAX;
+		}
+		gen->sample_format = gen_conf->sample_format;
+		gen->sample_size = cw_sample_format_size_internal(gen->sample_format);
+		gen->frames = NULL;
 
 		gen->sample_rate = 0;
 		gen->phase_offset = -1;
 
+		/* Oscillator. */
+		pthread_once(&cw_sine_table_once, cw_gen_init_sine_table_internal);
+		gen->oscillator = CW_GEN_OSCILLATOR_TABLE;
+		gen->phase_accumulator = 0;
+
+		/* Cache of pre-rendered tones. calloc() has already
+		   set entries to zero. Generation zero is reserved for
+		   never rendered entries. */
+		gen->pcm_cache.enabled = true;
+		gen->pcm_cache.generation = 1;
+
+		/* Table of compiled characters. Entries are allocated
+		   on first use; generation zero means "never
+		   compiled". */
+		gen->char_tones.generation = 1;
+
 
 		/* Tone parameters. */
 		gen->tone_slope.duration = CW_AUDIO_SLOPE_DURATION;
 		gen->tone_slope.shape = CW_TONE_SLOPE_SHAPE_RAISED_COSINE;
+		gen->tone_slope.table = NULL;
 		gen->tone_slope.amplitudes = NULL;
 		gen->tone_slope.n_amplitudes = 0;
 
@@ -580,6 +971,12 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 		/* TODO: doesn't this duplicate gen->thread.running flag? */
 		gen->do_dequeue_and_generate = false;
+
+		if (CW_SUCCESS != cw_gen_set_realtime_config_internal(gen, gen_conf)) {
+			cw_gen_delete(&gen);
+			errno = EINVAL;
+			return (cw_gen_t *) NULL;
+		}
 	}
 
 
@@ -592,6 +989,9 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		gen->console.sound_sink_fd = -1;
 		gen->console.cw_value = CW_KEY_VALUE_OPEN;
 
+		/* Sound system - file. */
+		gen->file_data.fd = -1;
+
 		/* Sound system - OSS. */
 #ifdef LIBCW_WITH_OSS
 		gen->oss_data.sound_sink_fd = -1;
@@ -607,7 +1007,16 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 		/* Sound system - PulseAudio. */
 #ifdef LIBCW_WITH_PULSEAUDIO
-		gen->pa_data.simple = NULL;
+		gen->pa_data.mainloop = NULL;
+		gen->pa_data.context = NULL;
+		gen->pa_data.stream = NULL;
+#endif
+
+		/* Sound system - JACK. */
+#ifdef LIBCW_WITH_JACK
+		gen->jack_data.client = NULL;
+		gen->jack_data.port = NULL;
+		gen->jack_data.samples = NULL;
 #endif
 
 		cw_ret_t cwret = cw_gen_new_open_internal(gen, gen_conf);
@@ -625,7 +1034,7 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 			; /* The two types of sound output don't require audio buffer. */
 		} else {
-			gen->buffer = (cw_sample_t *) calloc(gen->buffer_n_samples, sizeof (cw_sample_t));
+			gen->buffer = (cw_sample_t *) cw_gen_calloc_pages_internal((size_t) gen->buffer_n_samples * sizeof (cw_sample_t));
 			if (!gen->buffer) {
 				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
 					      MSG_PREFIX "calloc()");
@@ -634,6 +1043,54 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 			}
 		}
 
+		if (gen->n_sound_channels > 1) {
+			if (NULL == gen->buffer || gen->pull.enabled) {
+				/* Null and Console don't play samples, JACK
+				   has one mono port. */
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "sound system '%s' supports only one sound channel",
+					      cw_get_audio_system_label(gen->sound_system));
+				cw_gen_delete(&gen);
+				errno = EINVAL;
+				return (cw_gen_t *) NULL;
+			}
+		}
+		if (CW_SAMPLE_FORMAT_S16 != gen->sample_format && gen->pull.enabled) {
+			/* Sound system has been picked automatically, and
+			   it is JACK. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "sound system '%s' supports only 16-bit samples",
+				      cw_get_audio_system_label(gen->sound_system));
+			cw_gen_delete(&gen);
+			errno = EINVAL;
+			return (cw_gen_t *) NULL;
+		}
+		if (NULL != gen->buffer && (gen->n_sound_channels > 1 || CW_SAMPLE_FORMAT_S16 != gen->sample_format)) {
+			gen->frames = cw_gen_calloc_pages_internal((size_t) gen->buffer_n_samples * (size_t) gen->n_sound_channels * gen->sample_size);
+			if (NULL == gen->frames) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "calloc()");
+				cw_gen_delete(&gen);
+				return (cw_gen_t *) NULL;
+			}
+		}
+
+		if (gen_conf->pull_mode) {
+			if (gen->sound_system != CW_AUDIO_NULL) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+					      MSG_PREFIX "pull mode is supported only with %s sound system",
+					      cw_get_audio_system_label(CW_AUDIO_NULL));
+				cw_gen_delete(&gen);
+				return (cw_gen_t *) NULL;
+			}
+			gen->pull.enabled = true;
+			gen->pull.by_client_code = true;
+			gen->buffer_n_samples = CW_GEN_PULL_CHUNK_N_SAMPLES;
+			if (0 != gen_conf->pull_sample_rate) {
+				gen->sample_rate = gen_conf->pull_sample_rate;
+			}
+		}
+
 		/* Set slope that late, because it uses value of sample rate.
 		   The sample rate value is set in
 		   cw_gen_new_open_internal(). */
@@ -644,6 +1101,20 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 			cw_gen_delete(&gen);
 			return (cw_gen_t *) NULL;
 		}
+
+		if (gen->realtime.lock_memory) {
+			/* Table of slope amplitudes is locked by
+			   cw_gen_set_tone_slope(). */
+			if (gen->buffer) {
+				cw_gen_lock_memory_internal(gen, gen->buffer, (size_t) gen->buffer_n_samples * sizeof (cw_sample_t));
+			}
+			if (gen->frames) {
+				cw_gen_lock_memory_internal(gen, gen->frames, (size_t) gen->buffer_n_samples * (size_t) gen->n_sound_channels * gen->sample_size);
+			}
+			pthread_once(&cw_sine_table_lock_once, cw_gen_lock_sine_table_internal);
+			cw_gen_set_memory_lock_status_internal(gen, cw_sine_table_lock_errno);
+			cw_gen_lock_memory_internal(gen, gen, sizeof (cw_gen_t));
+		}
 	}
 
 	/* Tracking of generator's value. */
@@ -651,11 +1122,18 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		gen->value_tracking.value = CW_KEY_VALUE_OPEN;
 		gen->value_tracking.value_tracking_callback_func = NULL;
 		gen->value_tracking.value_tracking_callback_arg = NULL;
+		gen->value_tracking.timed_callback_func = NULL;
+		gen->value_tracking.timed_callback_arg = NULL;
+		gen->value_tracking.keying = NULL;
+		gen->value_tracking.keylog = NULL;
 	}
 #if 0
 	/* Part of old inter-thread comm. Disabled on 2020-09-01. */
 	cw_sigalrm_install_top_level_handler_internal();
 #endif
+
+	cw_metrics_register_internal(CW_METRICS_OBJECT_GEN, gen);
+
 	return gen;
 }
 
@@ -670,6 +1148,8 @@ void cw_gen_delete(cw_gen_t **gen)
 		return;
 	}
 
+	cw_metrics_unregister_internal(*gen);
+
 	if ((*gen)->do_dequeue_and_generate) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
 			      MSG_PREFIX "you forgot to call cw_gen_stop()");
@@ -682,10 +1162,16 @@ void cw_gen_delete(cw_gen_t **gen)
 
 	   FIXME: magic number. I think that we can come up
 	   with algorithm for calculating the value. */
-	usleep(500);
+	cw_usleep_internal(500);
+
+	cw_tap_delete_all_internal(*gen);
+
+	cw_gen_unlock_memory_internal(*gen);
 
 	free((*gen)->buffer);
 	(*gen)->buffer = NULL;
+	free((*gen)->frames);
+	(*gen)->frames = NULL;
 
 	if ((*gen)->close_sound_device) {
 		(*gen)->close_sound_device(*gen);
@@ -698,13 +1184,49 @@ void cw_gen_delete(cw_gen_t **gen)
 	free((*gen)->library_client.name);
 	(*gen)->library_client.name = NULL;
 
-	free((*gen)->tone_slope.amplitudes);
+	cw_gen_slope_table_release_internal((*gen)->tone_slope.table);
+	(*gen)->tone_slope.table = NULL;
 	(*gen)->tone_slope.amplitudes = NULL;
 
+	for (int i = 0; i < CW_GEN_PCM_CACHE_CAPACITY; i++) {
+		free((*gen)->pcm_cache.entries[i].samples);
+		(*gen)->pcm_cache.entries[i].samples = NULL;
+	}
+
+	for (int i = 0; i <= UCHAR_MAX; i++) {
+		free((*gen)->char_tones.entries[i]);
+		(*gen)->char_tones.entries[i] = NULL;
+	}
+
+	free((*gen)->render.samples);
+	(*gen)->render.samples = NULL;
+
+	pthread_mutex_destroy(&(*gen)->latency.mutex);
+
+	pthread_mutex_lock(&(*gen)->value_tracking.keying_mutex);
+	if (NULL != (*gen)->value_tracking.keying) {
+		/* Client code should have deleted keying output first. */
+		(*gen)->value_tracking.keying->gen = NULL;
+		(*gen)->value_tracking.keying = NULL;
+	}
+	if (NULL != (*gen)->value_tracking.keylog) {
+		(*gen)->value_tracking.keylog->gen = NULL;
+		(*gen)->value_tracking.keylog = NULL;
+	}
+	pthread_mutex_unlock(&(*gen)->value_tracking.keying_mutex);
+	pthread_mutex_destroy(&(*gen)->value_tracking.keying_mutex);
+	pthread_mutex_destroy(&(*gen)->text_source.mutex);
+	cw_impair_destroy_internal(&(*gen)->impair);
+
+	/* Generator doesn't post anything anymore. */
+	cw_dispatch_delete_internal(&(*gen)->dispatch);
+
 	cw_tq_delete_internal(&(*gen)->tq);
 
 	(*gen)->sound_system = CW_AUDIO_NONE;
 
+	pthread_mutex_destroy(&(*gen)->realtime.status_mutex);
+
 	free(*gen);
 	*gen = NULL;
 
@@ -756,7 +1278,9 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 
 	cw_tq_flush_internal(gen->tq);
 
-	if (CW_SUCCESS != cw_gen_silence_internal(gen)) {
+	/* Paused generator has been silenced by cw_gen_pause(), and
+	   its thread wouldn't play the silencing tone anyway. */
+	if (!gen->paused && CW_SUCCESS != cw_gen_silence_internal(gen)) {
 		return CW_FAILURE;
 	}
 
@@ -764,6 +1288,26 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 		      MSG_PREFIX "setting gen->do_dequeue_and_generate to false");
 
 	gen->do_dequeue_and_generate = false;
+	gen->paused = false;
+
+	if (gen->pull.active) {
+		/* From now on sound server's callback will be getting
+		   only silence from the generator. */
+		gen->pull.active = false;
+
+		if (NULL != gen->scheduling.sched) {
+			/* Wait for worker of scheduler to finish with the
+			   generator. */
+			cw_sched_remove_gen_internal(gen->scheduling.sched, gen);
+			gen->scheduling.sched = (cw_sched_t *) NULL;
+		}
+
+		if (gen->key) {
+			cw_key_ik_reset_state_internal(gen->key);
+			cw_key_sk_reset_state_internal(gen->key);
+		}
+		return CW_SUCCESS;
+	}
 
 	if (!gen->thread.running) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_INFO, MSG_PREFIX "EXIT: seems that thread function was not started at all");
@@ -820,67 +1364,210 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 
 
 
-/**
-   @brief Wrapper for pthread_join() and debug code
-
-   @internal
-   @reviewed 2020-08-04
-   @endinternal
-
-   @param[in] gen generator for which to join its thread
-
-   @return CW_SUCCESS if joining succeeded
-   @return CW_FAILURE otherwise
-*/
-cw_ret_t cw_gen_join_thread_internal(cw_gen_t * gen)
+cw_ret_t cw_gen_reset(cw_gen_t * gen)
 {
-	/* TODO: this comment may no longer be true and necessary.
-	   Sleep a bit to postpone closing a device.  This way we can
-	   avoid a situation when "do_dequeue_and_generate" is set to false
-	   and device is being closed while a new buffer is being
-	   prepared, and while write() tries to write this new buffer
-	   to already closed device.
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reset: generator is NULL");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-	   Without this sleep(), writei() from ALSA library may
-	   return "File descriptor in bad state" error - this
-	   happened when writei() tried to write to closed ALSA
-	   handle.
+	/* Client's callbacks go first, so that they aren't called
+	   for tones removed below. */
+	cw_gen_register_low_level_callback(gen, NULL, NULL, 0);
+	cw_gen_register_value_tracking_callback_internal(gen, NULL, NULL);
+	cw_gen_register_timed_value_tracking_callback(gen, NULL, NULL);
+	cw_gen_register_text_source(gen, NULL, NULL);
 
-	   The delay also allows the generator function thread to stop
-	   generating tone (or for tone queue to get out of CW_TQ_EMPTY state
-	   (TODO: verify this comment, does it describe correct tq state?)
-	   and exit before we resort to killing generator function thread. */
-	cw_usleep_internal(1 * CW_USECS_PER_SEC);
+	/* Running generator keeps running: remove its tones and let it
+	   go silent, just like cw_gen_stop() does. */
+	cw_tq_flush_internal(gen->tq);
+	if (gen->paused) {
+		/* Already silent. */
+		cw_gen_resume(gen);
+	} else if (CW_SUCCESS != cw_gen_silence_internal(gen)) {
+		return CW_FAILURE;
+	}
 
+	pthread_mutex_lock(&gen->value_tracking.keying_mutex);
+	if (NULL != gen->value_tracking.keying) {
+		gen->value_tracking.keying->gen = NULL;
+		gen->value_tracking.keying = NULL;
+	}
+	if (NULL != gen->value_tracking.keylog) {
+		gen->value_tracking.keylog->gen = NULL;
+		gen->value_tracking.keylog = NULL;
+	}
+	pthread_mutex_unlock(&gen->value_tracking.keying_mutex);
 
-#if LIBCW_GEN_DEBUG_THREAD_TIMING
-	/* Debug code to measure how long it takes to join threads. */
-	struct timeval before;
-	struct timeval after;
-	gettimeofday(&before, NULL);
-#endif
+	if (NULL != gen->key) {
+		/* Unregister, see cw_key_register_generator(). */
+		gen->key->gen = NULL;
+		gen->key = NULL;
+	}
 
+	/* Setters take care of caches of tones and of snapshot of
+	   timing used by generator's thread. Slope's table of
+	   amplitudes is shared, so it is acquired without computing
+	   it again. */
+	cw_gen_set_speed(gen, CW_SPEED_INITIAL);
+	cw_gen_set_frequency(gen, CW_FREQUENCY_INITIAL);
+	cw_gen_set_volume(gen, CW_VOLUME_INITIAL);
+	cw_gen_set_gap(gen, CW_GAP_INITIAL);
+	cw_gen_set_weighting(gen, CW_WEIGHTING_INITIAL);
+	if (CW_SUCCESS != cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, CW_AUDIO_SLOPE_DURATION)) {
+		return CW_FAILURE;
+	}
+	int volumes[CW_SOUND_CHANNELS_MAX];
+	for (int i = 0; i < CW_SOUND_CHANNELS_MAX; i++) {
+		volumes[i] = CW_VOLUME_MAX;
+	}
+	cw_gen_set_sound_channel_volumes(gen, volumes, CW_SOUND_CHANNELS_MAX);
+	cw_gen_set_alphabet(gen, CW_ALPHABET_ITU);
+	cw_gen_set_label(gen, "");
+
+	cw_gen_reset_latency_stats(gen);
+	gen->pcm_cache.n_hits = 0;
+	gen->pcm_cache.n_misses = 0;
+
+	if (!gen->do_dequeue_and_generate) {
+		/* Samples rendered offline and not retrieved by
+		   previous user. Memory of the buffer is kept. */
+		gen->render.n_samples = 0;
+		gen->render.read_pos = 0;
+		gen->render.failed = false;
+	}
 
-	int rv = pthread_join(gen->thread.id, NULL);
+	return CW_SUCCESS;
+}
 
 
-#if LIBCW_GEN_DEBUG_THREAD_TIMING
-	/* Debug code to measure how long it takes to join threads. */
-	gettimeofday(&after, NULL);
-	const int delta = cw_timestamp_compare_internal(&before, &after);
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
-		      MSG_PREFIX "generator thread timing: joining thread took %d us", delta);
-#endif
 
 
-	if (rv == 0) {
-		gen->thread.running = false;
+cw_ret_t cw_gen_pause(cw_gen_t * gen)
+{
+	if (NULL == gen || !gen->do_dequeue_and_generate) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "pause: generator is NULL or not started");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (gen->paused) {
 		return CW_SUCCESS;
-	} else {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR, MSG_PREFIX "failed to join threads: '%s'", strerror(rv));
+	}
+
+	/* Just like in cw_gen_stop(): remaining tones are removed and
+	   a key in "down" state goes "up". */
+	cw_tq_flush_internal(gen->tq);
+	if (CW_SUCCESS != cw_gen_silence_internal(gen)) {
 		return CW_FAILURE;
 	}
-}
+
+	/* Thread of generator may be waiting for tones. Wake it up so
+	   that it notices the pause and parks itself. */
+	pthread_mutex_lock(&gen->tq->wait_mutex);
+	gen->paused = true;
+	pthread_cond_broadcast(&gen->tq->wait_var);
+	pthread_mutex_unlock(&gen->tq->wait_mutex);
+
+	if (gen->key) {
+		cw_key_ik_reset_state_internal(gen->key);
+		cw_key_sk_reset_state_internal(gen->key);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_resume(cw_gen_t * gen)
+{
+	if (NULL == gen || !gen->do_dequeue_and_generate) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "resume: generator is NULL or not started");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!gen->paused) {
+		return CW_SUCCESS;
+	}
+
+	pthread_mutex_lock(&gen->tq->wait_mutex);
+	gen->paused = false;
+	pthread_cond_broadcast(&gen->tq->wait_var);
+	pthread_mutex_unlock(&gen->tq->wait_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Wrapper for pthread_join() and debug code
+
+   @internal
+   @reviewed 2020-08-04
+   @endinternal
+
+   @param[in] gen generator for which to join its thread
+
+   @return CW_SUCCESS if joining succeeded
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_gen_join_thread_internal(cw_gen_t * gen)
+{
+	/* TODO: this comment may no longer be true and necessary.
+	   Sleep a bit to postpone closing a device.  This way we can
+	   avoid a situation when "do_dequeue_and_generate" is set to false
+	   and device is being closed while a new buffer is being
+	   prepared, and while write() tries to write this new buffer
+	   to already closed device.
+
+	   Without this sleep(), writei() from ALSA library may
+	   return "File descriptor in bad state" error - this
+	   happened when writei() tried to write to closed ALSA
+	   handle.
+
+	   The delay also allows the generator function thread to stop
+	   generating tone (or for tone queue to get out of CW_TQ_EMPTY state
+	   (TODO: verify this comment, does it describe correct tq state?)
+	   and exit before we resort to killing generator function thread. */
+	cw_usleep_internal(1 * CW_USECS_PER_SEC);
+
+
+#if LIBCW_GEN_DEBUG_THREAD_TIMING
+	/* Debug code to measure how long it takes to join threads. */
+	struct timeval before;
+	struct timeval after;
+	gettimeofday(&before, NULL);
+#endif
+
+
+	cw_virtual_clock_wait_begin_internal();
+	int rv = pthread_join(gen->thread.id, NULL);
+	cw_virtual_clock_wait_end_internal();
+
+
+#if LIBCW_GEN_DEBUG_THREAD_TIMING
+	/* Debug code to measure how long it takes to join threads. */
+	gettimeofday(&after, NULL);
+	const int delta = cw_timestamp_compare_internal(&before, &after);
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "generator thread timing: joining thread took %d us", delta);
+#endif
+
+
+	if (rv == 0) {
+		gen->thread.running = false;
+		return CW_SUCCESS;
+	} else {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR, MSG_PREFIX "failed to join threads: '%s'", strerror(rv));
+		return CW_FAILURE;
+	}
+}
 
 
 
@@ -917,6 +1604,17 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 	   the three in separate 'if' clauses, I can check all other
 	   values of sound system as well. */
 
+	/* Probing a sound system may take long time (e.g. waiting for
+	   PulseAudio server), so candidates for SOUNDCARD are probed
+	   concurrently. They are still tried in order of preference. */
+	const enum cw_audio_systems soundcard_systems[] = { CW_AUDIO_PA, CW_AUDIO_OSS, CW_AUDIO_ALSA };
+	bool soundcard_possible[] = { false, false, false };
+	if (gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
+		cw_probe_sound_systems(gen_conf->sound_device, soundcard_systems, soundcard_possible,
+				       sizeof (soundcard_systems) / sizeof (soundcard_systems[0]), CW_PROBE_SOUND_SYSTEMS_TIMEOUT);
+	}
+	const bool is_soundcard = gen_conf->sound_system == CW_AUDIO_SOUNDCARD;
+
 
 	if (gen_conf->sound_system == CW_AUDIO_NULL) {
 
@@ -929,7 +1627,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 	if (gen_conf->sound_system == CW_AUDIO_PA
 	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
 
-		if (cw_is_pa_possible(gen_conf->sound_device)) {
+		if (is_soundcard ? soundcard_possible[0] : cw_is_pa_possible(gen_conf->sound_device)) {
 			cw_pa_init_gen_internal(gen);
 			return gen->open_and_configure_sound_device(gen, gen_conf);
 		}
@@ -938,7 +1636,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 	if (gen_conf->sound_system == CW_AUDIO_OSS
 	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
 
-		if (cw_is_oss_possible(gen_conf->sound_device)) {
+		if (is_soundcard ? soundcard_possible[1] : cw_is_oss_possible(gen_conf->sound_device)) {
 			cw_oss_init_gen_internal(gen);
 			return gen->open_and_configure_sound_device(gen, gen_conf);
 		}
@@ -947,7 +1645,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 	if (gen_conf->sound_system == CW_AUDIO_ALSA
 	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
 
-		if (cw_is_alsa_possible(gen_conf->sound_device)) {
+		if (is_soundcard ? soundcard_possible[2] : cw_is_alsa_possible(gen_conf->sound_device)) {
 			cw_alsa_init_gen_internal(gen);
 			return gen->open_and_configure_sound_device(gen, gen_conf);
 		}
@@ -961,6 +1659,30 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 		}
 	}
 
+	if (gen_conf->sound_system == CW_AUDIO_FILE) {
+
+		if (gen_conf->file_fd >= 0 || cw_is_file_possible(gen_conf->sound_device)) {
+			cw_file_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
+	if (gen_conf->sound_system == CW_AUDIO_JACK) {
+
+		if (cw_is_jack_possible(gen_conf->sound_device)) {
+			cw_jack_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
+	if (gen_conf->sound_system == CW_AUDIO_RTP) {
+
+		if (cw_is_rtp_possible(gen_conf->sound_device)) {
+			cw_rtp_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
 	/* There is no next sound system type to try. */
 	return CW_FAILURE;
 }
@@ -1008,6 +1730,10 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 	pthread_set_name_np(pthread_self(), name);
 #endif
 
+	cw_gen_apply_thread_realtime_internal(gen);
+	cw_virtual_clock_thread_begin_internal();
+	__atomic_store_n(&gen->idle.active_since, cw_clock_now_internal(), __ATOMIC_RELAXED);
+
 	/* Tone dequeued in previous call to cw_tq_dequeue_internal(). */
 	cw_tone_t prev_tone = { 0 };
 
@@ -1016,6 +1742,12 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 	CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
 
 	while (gen->do_dequeue_and_generate) {
+		if (gen->paused) {
+			cw_gen_pause_wait_internal(gen);
+			continue;
+		}
+
+		cw_gen_text_source_pull_internal(gen);
 		const cw_queue_state_t queue_state = cw_tq_dequeue_internal(gen->tq, &tone);
 		if (CW_TQ_EMPTY == queue_state) {
 
@@ -1023,6 +1755,10 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 				      MSG_PREFIX "Detected empty queue");
 
 			cw_gen_value_tracking_internal(gen, &tone, queue_state);
+
+			/* Next tone will come after unknown time of
+			   idling, don't pace it relative to last tone. */
+			gen->pacing.deadline = 0;
 #if 1
 			if (gen->on_empty_queue) {
 				if (CW_SUCCESS != gen->on_empty_queue(gen)) {
@@ -1032,37 +1768,7 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 			}
 #endif
 
-			/* We won't get here while there are some
-			   accumulated tones in queue, because
-			   cw_tq_dequeue_internal() will be handling
-			   them just fine without any need for
-			   synchronization or wait().  Only after the
-			   queue has been completely drained, we will
-			   be forced to wait() here.
-
-			   It's much better to wait only sometimes
-			   after cw_tq_dequeue_internal() than wait
-			   always before cw_tq_dequeue_internal().
-
-			   We are waiting for kick from enqueue()
-			   function informing that a new tone appeared
-			   in tone queue.
-
-			   The kick may also come from cw_gen_stop()
-			   that gently asks this function to stop
-			   idling and nicely return. */
-
-			/* The 'while' loop handles spurious wakeups of
-			   pthread_cond_wait() and also ensures that the
-			   wait() function is called only when a wait is
-			   necessary. TODO: make sure that getting
-			   gen->tq->state doesn't require locking a tq
-			   mutex. */
-			pthread_mutex_lock(&(gen->tq->wait_mutex));
-			while (CW_TQ_EMPTY == gen->tq->state && gen->do_dequeue_and_generate) {
-				pthread_cond_wait(&gen->tq->wait_var, &gen->tq->wait_mutex);
-			}
-			pthread_mutex_unlock(&(gen->tq->wait_mutex));
+			cw_gen_wait_for_tone_internal(gen);
 
 #if 0
 			/* Original implementation using signals. */ /* This code has been disabled some time before 2017-01-19. */
@@ -1075,140 +1781,29 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 
 		const bool is_empty_tone = CW_TQ_EMPTY == queue_state;
 
-		cw_gen_value_tracking_internal(gen, &tone, queue_state);
-
-#ifdef IAMBIC_KEY_HAS_TIMER
-		/* Also look at call to cw_key_ik_update_graph_state_internal()
-		   made below. Both calls are about updating some internals of
-		   key. This one is done before blocking write, the other is
-		   done after blocking write. */
-		if (gen->key) {
-			cw_key_ik_increment_timer_internal(gen->key, tone.duration);
+		if (cw_gen_idle_silence_has_timed_out_internal(gen, &tone)) {
+			/* Straight key stays up, and the queue holds
+			   only its silent 'forever' tone. Stop writing
+			   the silence until something else comes. */
+			cw_gen_idle_wait_for_tone_internal(gen);
+			continue;
 		}
-#endif
-
+		cw_gen_idle_leave_internal(gen);
 
-#ifdef LIBCW_WITH_DEV
-		cw_debug_ev (&cw_debug_object_ev, 0, tone.frequency ? CW_DEBUG_EVENT_TONE_HIGH : CW_DEBUG_EVENT_TONE_LOW);
-#endif
+		cw_gen_tone_dequeued_internal(gen, &tone, &prev_tone, queue_state);
 
 		/* This is a blocking write. */
 		if (gen->sound_system == CW_AUDIO_NULL || gen->sound_system == CW_AUDIO_CONSOLE) {
 			cw_assert (NULL != gen->write_tone_to_sound_device, "'gen->write_tone_to_sound_device' pointer is NULL");
+			cw_gen_latency_add_tone_internal(gen, &tone, queue_state);
 			gen->write_tone_to_sound_device(gen, &tone);
 		} else {
-			if (gen->silencing_initialized) {
-				/* Don't play a tone that has been just
-				   dequeued. Instead prepare a tone that will
-				   silence current source sink. Use current
-				   tone ('tone' variable) as starting
-				   point/basis for this silencing tone. */
-				CW_TONE_COPY(&tone, &prev_tone);
-				cw_gen_silencing_tone_calculate_samples_size_internal(gen, &tone);
-			} else if (is_empty_tone) {
-				/* No valid tone dequeued from tone
-				   queue. 'tone' argument doesn't represent a
-				   valid tone. We need samples to complete
-				   filling buffer, but they have to be empty
-				   samples. */
-				cw_gen_empty_tone_calculate_samples_size_internal(gen, &tone);
-			} else {
-				/* Valid tone dequeued from tone queue and
-				   nothing prohibits us from playing it (we
-				   aren't in 'silencing' phase). Use the tone
-				   to calculate samples in buffer. */
-				cw_gen_tone_calculate_samples_size_internal(gen, &tone);
-			}
-
+			cw_gen_tone_calculate_samples_internal(gen, &tone, &prev_tone, is_empty_tone);
+			cw_gen_latency_add_tone_internal(gen, &tone, queue_state);
 			cw_gen_write_to_soundcard_internal(gen, &tone);
 		}
 
-		if (prev_tone.is_forever && tone.is_forever) {
-			/*
-			  Don't notify about dequeueing two consecutive
-			  'forever' tones. For any listener this is still the
-			  same tone.
-
-			  TODO: make the check more precise. What if first
-			  'forever' tone is silent and the next is
-			  non-silent, or if they have two different
-			  frequencies?
-			*/
-			; /* NOOP */
-		} else {
-#ifdef GENERATOR_CLIENT_THREAD
-			fprintf(stderr, MSG_PREFIX "      sending signal on dequeue, target thread id = %ld\n", gen->library_client.thread_id);
-#endif
-			pthread_mutex_lock(&gen->tq->wait_mutex);
-			pthread_cond_broadcast(&gen->tq->wait_var);
-			pthread_mutex_unlock(&gen->tq->wait_mutex);
-		}
-
-#ifdef GENERATOR_CLIENT_THREAD
-		/* Original implementation using signals. */
-		/* This code has been disabled some time before 2017-01-19. */
-
-		/*
-		  When sending text from text input, the signal:
-		   - allows client code to observe moment when state of tone
-		     queue is "low/critical"; client code then can add more
-		     characters to the queue; the observation is done using
-		     cw_tq_wait_for_level_internal();
-
-		   - allows client code to observe any dequeue event
-		     by waiting for signal in
-		     cw_tq_wait_for_end_of_current_tone_internal();
-		*/
-		pthread_kill(gen->library_client.thread_id, SIGALRM);
-#endif
-
-		/* Generator may be used by iambic keyer to measure periods
-		   of time (durations of Mark and Space). This is achieved by
-		   enqueueing Marks and Spaces by keyer in generator. A
-		   soundcard playing samples is surprisingly good at
-		   measuring time intervals.
-
-		   At this point the generator has finished generating
-		   a tone of specified duration. A duration of Mark or
-		   Space has elapsed. Inform iambic keyer that the
-		   tone it has enqueued has elapsed. The keyer may
-		   want to change state of its internal state machine.
-
-		   (Whether iambic keyer has enqueued any tones or
-		   not, and whether it is waiting for the
-		   notification, is a different story. We will let the
-		   iambic keyer function called below to decide what
-		   to do with the notification. If keyer is in idle
-		   state, it will ignore the notification.)
-
-		   Notice that this mechanism is needed only for
-		   iambic keyer. Inner workings of straight key are
-		   much more simple, the straight key doesn't need to
-		   use generator as a timer. */
-		if (CW_FAILURE == cw_key_ik_update_graph_state_internal(gen->key)) {
-			/* just try again, once */
-			usleep(1000);
-			cw_key_ik_update_graph_state_internal(gen->key);
-		}
-
-		if (gen->silencing_initialized) {
-			/* We are in silencing phase. A last tone (silencing
-			   tone) has been played, and we shouldn't play
-			   anything else. Discard tones remaining in
-			   queue.
-
-			   Remember that we are in silencing phase, which may
-			   or may not mean that generator is being
-			   stopped and deleted. */
-			cw_tq_flush_internal(gen->tq);
-			gen->silencing_initialized = false;
-		}
-
-#ifdef LIBCW_WITH_DEV
-		cw_debug_ev (&cw_debug_object_ev, 0, tone.frequency ? CW_DEBUG_EVENT_TONE_LOW : CW_DEBUG_EVENT_TONE_HIGH);
-#endif
-		/* And finally, at the very end... */
-		CW_TONE_COPY(&prev_tone, &tone);
+		cw_gen_tone_played_internal(gen, &tone, &prev_tone, true);
 
 	} /* while (gen->do_dequeue_and_generate) */
 
@@ -1238,6 +1833,11 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 	pthread_kill(gen->library_client.thread_id, SIGALRM);
 #endif
 
+	cw_gen_idle_leave_internal(gen);
+	const int64_t active_since = __atomic_exchange_n(&gen->idle.active_since, 0, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&gen->stats.active_time, (uint64_t) (cw_clock_now_internal() - active_since) / 1000, __ATOMIC_RELAXED);
+
+	cw_virtual_clock_thread_end_internal();
 	gen->thread.running = false;
 	return NULL;
 }
@@ -1246,392 +1846,405 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 
 
 /**
-   @brief Calculate a fragment of sine wave
+   @brief Wait in generator's thread for tones to appear in empty tone queue
 
-   Calculate a fragment of sine wave, as many samples as can be fitted in
-   generator buffer's subarea.
+   If idle mode is enabled, generator enters idle mode when the queue
+   stays empty for cw_gen_config_t::idle_timeout.
 
-   The function calculates values of (gen->buffer_sub_stop - gen->buffer_sub_start + 1)
-   samples and puts them into gen->buffer[], starting from
-   gen->buffer[gen->buffer_sub_start].
+   @param[in] gen generator
+*/
+static void cw_gen_wait_for_tone_internal(cw_gen_t * gen)
+{
+	/* We won't get here while there are some accumulated tones
+	   in queue, because cw_tq_dequeue_internal() will be handling
+	   them just fine without any need for synchronization or
+	   wait().  Only after the queue has been completely drained,
+	   we will be forced to wait() here.
+
+	   It's much better to wait only sometimes after
+	   cw_tq_dequeue_internal() than wait always before
+	   cw_tq_dequeue_internal().
+
+	   We are waiting for kick from enqueue() function informing
+	   that a new tone appeared in tone queue.
+
+	   The kick may also come from cw_gen_stop() that gently asks
+	   this function to stop idling and nicely return, or from
+	   timer of idle mode. */
+	cw_gen_idle_timer_start_internal(gen);
+
+	bool timed_out = false;
+	do {
+		if (timed_out) {
+			/* No locks held: pausing sound sink may take
+			   a while. */
+			cw_gen_idle_enter_internal(gen);
+		}
 
-   The function takes into account all state variables from gen,
-   so initial phase of new fragment of sine wave in the buffer matches
-   ending phase of a sine wave generated in previous call.
+		/* The 'while' loop handles spurious wakeups of
+		   pthread_cond_wait() and also ensures that the
+		   wait() function is called only when a wait is
+		   necessary. TODO: make sure that getting
+		   gen->tq->state doesn't require locking a tq
+		   mutex. */
+		pthread_mutex_lock(&(gen->tq->wait_mutex));
+		cw_virtual_clock_wait_begin_internal();
+		while (CW_TQ_EMPTY == gen->tq->state && gen->do_dequeue_and_generate && !gen->paused && !gen->idle.timer_expired) {
+			pthread_cond_wait(&gen->tq->wait_var, &gen->tq->wait_mutex);
+		}
+		timed_out = gen->idle.timer_expired && CW_TQ_EMPTY == gen->tq->state && gen->do_dequeue_and_generate && !gen->paused;
+		gen->idle.timer_expired = false;
+		cw_virtual_clock_wait_end_internal();
+		pthread_mutex_unlock(&(gen->tq->wait_mutex));
+	} while (timed_out);
 
-   @internal
-   @reviewed 2020-08-04
-   @endinternal
+	cw_gen_idle_timer_cancel_internal(gen);
 
-   @param[in] gen generator that generates sine wave
-   @param[in,out] tone specification of samples that should be calculated
+	return;
+}
 
-   @return number of calculated samples
+
+
+
+/**
+   @brief Callback of timer of idle mode
+
+   Called by clock thread of timer service when tone queue of
+   generator has been empty for cw_gen_config_t::idle_timeout.
+
+   @param[in] arg generator (cast to (void *))
 */
-int cw_gen_calculate_sine_wave_internal(cw_gen_t * gen, cw_tone_t * tone)
+static void cw_gen_idle_timer_callback_internal(void * arg)
 {
-	assert (gen->buffer_sub_stop <= gen->buffer_n_samples);
+	cw_gen_t * gen = (cw_gen_t *) arg;
 
-	/* We need two separate iterators to correctly generate sine wave:
-	    -- i -- for iterating through output buffer (generator
-	            buffer's subarea), it can travel between buffer
-	            cells delimited by start and stop (inclusive);
-	    -- t -- for calculating phase of a sine wave; 't' always has to
-	            start from zero for every calculated subarea (i.e. for
-		    every call of this function);
-
-	  Initial/starting phase of generated fragment is always retained
-	  in gen->phase_offset, it is the only "memory" of previously
-	  calculated fragment of sine wave (to be precise: it stores phase
-	  of last sample in previously calculated fragment).
-	  Therefore iterator used to calculate phase of sine wave can't have
-	  the memory too. Therefore it has to always start from zero for
-	  every new fragment of sine wave. Therefore a separate t. */
-
-	float phase = 0.0F;
-	int t = 0;
-
-	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; i++) {
-		phase = (2.0F * CW_PI
-			 * (float) (tone->frequency * t)
-			 / (float) gen->sample_rate)
-			+ gen->phase_offset;
-		const int amplitude = cw_gen_calculate_sample_amplitude_internal(gen, tone);
+	pthread_mutex_lock(&gen->tq->wait_mutex);
+	gen->idle.timer_expired = true;
+	pthread_cond_broadcast(&gen->tq->wait_var);
+	pthread_mutex_unlock(&gen->tq->wait_mutex);
 
-		gen->buffer[i] = ((float) amplitude) * sinf(phase);
+	return;
+}
 
-		tone->sample_iterator++;
 
-		t++;
-	}
 
-	phase = (2.0F * CW_PI
-		 * (float) (tone->frequency * t)
-		 / (float) gen->sample_rate)
-		+ gen->phase_offset;
 
-	/* "phase" is now phase of the first sample in next fragment to be
-	   calculated.
-	   However, for long fragments this can be a large value, well
-	   beyond <0; 2*Pi) range.
-	   The value of phase may further accumulate in different
-	   calculations, and at some point it may overflow. This would
-	   result in an audible click.
+/**
+   @brief Start timer of idle mode if the mode is enabled
 
-	   Let's bring back the phase from beyond <0; 2*Pi) range into the
-	   <0; 2*Pi) range, in other words lets "normalize" it. Or, in yet
-	   other words, lets apply modulo operation to the phase.
+   If the timer can't be started, generator just doesn't go into idle
+   mode.
 
-	   The normalized phase will be used as a phase offset for next
-	   fragment (during next function call). It will be added phase of
-	   every sample calculated in next function call. */
+   @param[in] gen generator
+*/
+static void cw_gen_idle_timer_start_internal(cw_gen_t * gen)
+{
+	if (0 == gen->idle.timeout || gen->idle.is_idle) {
+		return;
+	}
 
-	/* TODO: check if n_periods can be a float. We could avoid the casts. */
-	const int n_periods = (int) floorf(phase / (2.0F * CW_PI));
-	gen->phase_offset = phase - (float) n_periods * 2.0F * CW_PI;
+	pthread_mutex_lock(&gen->tq->wait_mutex);
+	gen->idle.timer_expired = false;
+	pthread_mutex_unlock(&gen->tq->wait_mutex);
+
+	gen->idle.timer_id = cw_timer_start_internal((int) gen->idle.timeout, cw_gen_idle_timer_callback_internal, gen);
+	if (-1 == gen->idle.timer_id) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "can't start timer of idle mode: %s", strerror(errno));
+	}
 
-	return t;
+	return;
 }
 
 
 
 
 /**
-   @brief Calculate value of a single sample of sine wave
+   @brief Cancel timer of idle mode
 
-   This function calculates an amplitude (a value) of a single sample
-   in sine wave PCM data.
+   When the function returns, callback of the timer is not running,
+   and won't be called.
 
-   Actually "calculation" is a bit too big word. The function just
-   makes a decision which of precalculated values to return. There are
-   no complicated arithmetical calculations being made each time the
-   function is called, so the execution time should be pretty small.
+   @param[in] gen generator
+*/
+static void cw_gen_idle_timer_cancel_internal(cw_gen_t * gen)
+{
+	if (-1 == gen->idle.timer_id) {
+		return;
+	}
 
-   The precalcuated values depend on some factors, so the values
-   should be re-calculated each time these factors change. See
-   cw_gen_set_tone_slope() for list of these factors.
+	cw_timer_cancel_internal(gen->idle.timer_id);
+	cw_timer_wait_for_callbacks_internal(gen);
+	gen->idle.timer_id = -1;
 
-   A generator contains some of information needed to get an amplitude of
-   every sample in a sine wave - this is why this function needs @p gen.  If
-   tone's slopes are non-rectangular, the duration of slopes is defined in
-   generator. If a tone is non-silent, the volume is also defined in
-   generator.
+	return;
+}
 
-   However, decision tree for getting the amplitude also depends on some
-   parameters that are strictly bound to tone, such as what is the shape of
-   slopes for a given tone - this is why we have @p tone.  The @p tone also
-   stores iterator of samples - this is how we know for which sample in a
-   tone to calculate the amplitude.
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
 
-   @param[in] gen generator used to generate a sine wave
-   @param[in] tone tone being generated
 
-   @return value of a sample of sine wave, a non-negative number
-*/
-int cw_gen_calculate_sample_amplitude_internal(cw_gen_t * gen, const cw_tone_t * tone)
-{
-#if 0   /* Blunt algorithm for calculating amplitude. For debug purposes only. */
+/**
+   @brief Check if silent 'forever' tones have been played for longer than timeout of idle mode
 
-	return tone->frequency ? gen->volume_abs : 0;
+   Straight key that stays up leaves silent 'forever' tone in tone
+   queue, and generator would write its silence until the key is
+   pressed again.
 
-#else
+   @param[in] gen generator
+   @param[in] tone tone that has been just dequeued
 
-	if (tone->frequency <= 0) {
-		return 0;
+   @return true if generator should enter idle mode instead of playing @p tone
+   @return false otherwise
+*/
+static bool cw_gen_idle_silence_has_timed_out_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (0 == gen->idle.timeout || !tone->is_forever || 0 != tone->frequency) {
+		gen->idle.silence_start = 0;
+		return false;
 	}
 
+	const int64_t now = cw_clock_now_internal();
+	if (0 == gen->idle.silence_start) {
+		gen->idle.silence_start = now;
+		return false;
+	}
 
-	float amplitude = 0.0F;
-
-	/* Every tone, regardless of slope mode (CW_SLOPE_MODE_*), has
-	   three components. It has rising slope + plateau + falling
-	   slope.
+	return now - gen->idle.silence_start >= (int64_t) gen->idle.timeout * 1000;
+}
 
-	   There can be four variants of rising and falling slope
-	   length, just as there are four CW_SLOPE_MODE_* values.
 
-	   There can be also tones with zero-length plateau, and there
-	   can be also tones with zero-length slopes. */
 
-	if (tone->sample_iterator < tone->rising_slope_n_samples) {
-		/* Beginning of tone, rising slope. */
-		const int i = tone->sample_iterator;
-		amplitude = gen->tone_slope.amplitudes[i];
-		assert (amplitude >= 0);
 
-	} else if (tone->sample_iterator >= tone->rising_slope_n_samples
-		   && tone->sample_iterator < tone->n_samples - tone->falling_slope_n_samples) {
+/**
+   @brief Enter idle mode and wait for tone that follows silent 'forever' tone
 
-		/* Middle of tone, plateau, constant amplitude. */
-		amplitude = (float) gen->volume_abs;
-		assert (amplitude >= 0);
+   The 'forever' tone stays in tone queue until another tone is
+   enqueued after it, or until the queue is flushed.
 
-	} else if (tone->sample_iterator >= tone->n_samples - tone->falling_slope_n_samples) {
-		/* Falling slope. */
-		const cw_sample_iter_t i = tone->n_samples - tone->sample_iterator - 1;
-		assert (i >= 0);
-		amplitude = gen->tone_slope.amplitudes[i];
-		assert (amplitude >= 0);
+   @param[in] gen generator
+*/
+static void cw_gen_idle_wait_for_tone_internal(cw_gen_t * gen)
+{
+	cw_gen_idle_enter_internal(gen);
 
-	} else {
-		cw_assert (0, MSG_PREFIX "->sample_iterator out of bounds:\n"
-			   "tone->sample_iterator: %ld\n"
-			   "tone->n_samples: %"PRId64"\n"
-			   "tone->rising_slope_n_samples: %d\n"
-			   "tone->falling_slope_n_samples: %d\n",
-			   tone->sample_iterator,
-			   tone->n_samples,
-			   tone->rising_slope_n_samples,
-			   tone->falling_slope_n_samples);
+	pthread_mutex_lock(&(gen->tq->wait_mutex));
+	cw_virtual_clock_wait_begin_internal();
+	const uint64_t n_enqueued = gen->tq->n_enqueued;
+	while (1 == gen->tq->len && n_enqueued == gen->tq->n_enqueued && gen->do_dequeue_and_generate && !gen->paused) {
+		pthread_cond_wait(&gen->tq->wait_var, &gen->tq->wait_mutex);
 	}
+	cw_virtual_clock_wait_end_internal();
+	pthread_mutex_unlock(&(gen->tq->wait_mutex));
 
-	assert (amplitude >= 0.0F);
-	return (int) amplitude;
-#endif
+	gen->idle.silence_start = 0;
+
+	return;
 }
 
 
 
 
 /**
-   @brief Set parameters describing slopes of tones generated by generator
+   @brief Wait in thread of paused generator until it is resumed or stopped
 
-   Most of variables related to slope of tones is in @p tone, but there are
-   still some variables that are generator-specific, as they are common for
-   all tones.  This function sets two of these generator-specific variables.
+   Generator goes into idle mode for the time of the pause, so its
+   sound sink is paused (but not closed), and time of the pause is
+   counted as idle time in generator's statistics.
 
-   A: If you pass to function conflicting values of @p slope_shape and
-   @p slope_duration, the function will return CW_FAILURE. These
-   conflicting values are rectangular slope shape and larger than zero
-   slope length. You just can't have rectangular slopes that have
-   non-zero length.
+   @param[in] gen generator
+*/
+static void cw_gen_pause_wait_internal(cw_gen_t * gen)
+{
+	cw_gen_idle_enter_internal(gen);
 
-   B: If you pass to function '\-1' as value of both @p slope_shape and
-   @p slope_duration, the function won't change any of the related two
-   generator's parameters.
+	pthread_mutex_lock(&(gen->tq->wait_mutex));
+	cw_virtual_clock_wait_begin_internal();
+	while (gen->paused && gen->do_dequeue_and_generate) {
+		pthread_cond_wait(&gen->tq->wait_var, &gen->tq->wait_mutex);
+	}
+	cw_virtual_clock_wait_end_internal();
+	pthread_mutex_unlock(&(gen->tq->wait_mutex));
 
-   C1: If you pass to function '\-1' as value of either @p slope_shape or
-   @p slope_duration, the function will attempt to set only this generator's
-   parameter that is different than '\-1'.
+	return;
+}
 
-   C2: However, if selected slope shape is rectangular, function will
-   set generator's slope length to zero, even if value of \p
-   slope_duration is '\-1'.
 
-   D: Notice that the function allows non-rectangular slope shape with
-   zero length of the slopes. The slopes will be non-rectangular, but
-   just unusually short.
 
-   @internal TODO: Seriously, these rules (A-D) for setting a slope are too complicated. Simplify them. Accept only a small subset of valid/sane values. Perhaps split the function into two separate functions: for setting slope shape and slope duration. @endinternal
 
-   The function should be called every time one of following
-   parameters change:
+/**
+   @brief Put generator into idle mode
 
-   @li shape of slope,
-   @li duration of slope,
-   @li generator's sample rate,
-   @li generator's volume.
+   Sound system is asked to pause its stream.
 
-   There are four supported shapes of slopes:
-   @li linear (the only one supported by libcw until version 4.1.1),
-   @li raised cosine (supposedly the most desired shape),
-   @li sine,
-   @li rectangular.
+   @param[in] gen generator
+*/
+static void cw_gen_idle_enter_internal(cw_gen_t * gen)
+{
+	if (gen->idle.is_idle) {
+		return;
+	}
 
-   Use CW_TONE_SLOPE_SHAPE_* symbolic names as values of @p slope_shape.
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "entering idle mode");
 
-   FIXME: first argument of this public function is gen, but no
-   function provides access to generator variable.
+	if (gen->on_idle) {
+		if (CW_SUCCESS != gen->on_idle(gen)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "pausing of sound sink in idle mode has failed");
+		}
+	}
+	gen->idle.is_idle = true;
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+	/* Next tone will come after unknown time of idling, don't
+	   pace it relative to last tone. */
+	gen->pacing.deadline = 0;
 
-   @param[in] gen generator for which to set tone slope parameters
-   @param[in] slope_shape shape of slope: linear, raised cosine, sine, rectangular
-   @param[in] slope_duration duration of slope [microseconds]
+	const int64_t now = cw_clock_now_internal();
+	const int64_t active_since = __atomic_exchange_n(&gen->idle.active_since, 0, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&gen->stats.active_time, (uint64_t) (now - active_since) / 1000, __ATOMIC_RELAXED);
+	__atomic_store_n(&gen->idle.idle_since, now, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&gen->stats.n_idle_periods, 1, __ATOMIC_RELAXED);
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
-*/
-int cw_generator_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
-{
-	return cw_gen_set_tone_slope(gen, slope_shape, slope_duration);
+	return;
 }
 
 
 
 
 /**
-   See comment for cw_generator_set_tone_slope()
+   @brief Take generator out of idle mode
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+   Sound system is asked to resume its stream. The function does
+   nothing if generator is not in idle mode.
+
+   @param[in] gen generator
 */
-cw_ret_t cw_gen_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+static void cw_gen_idle_leave_internal(cw_gen_t * gen)
 {
-	assert (gen);
-
-	/* Handle conflicting values of arguments. */
-	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR
-	    && slope_duration > 0) {
-
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-			      MSG_PREFIX "requested a rectangular slope shape, but also requested slope duration > 0");
-
-		return CW_FAILURE;
+	if (!gen->idle.is_idle) {
+		return;
 	}
 
-	/* Assign new values from arguments. */
-	if (slope_shape != -1) {
-		gen->tone_slope.shape = slope_shape;
-	}
-	if (slope_duration != -1) {
-		gen->tone_slope.duration = slope_duration;
+	if (gen->on_resume) {
+		if (CW_SUCCESS != gen->on_resume(gen)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "resuming of sound sink after idle mode has failed");
+		}
 	}
+	gen->idle.is_idle = false;
 
+	const int64_t now = cw_clock_now_internal();
+	const int64_t idle_since = __atomic_exchange_n(&gen->idle.idle_since, 0, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&gen->stats.idle_time, (uint64_t) (now - idle_since) / 1000, __ATOMIC_RELAXED);
+	__atomic_store_n(&gen->idle.active_since, now, __ATOMIC_RELAXED);
 
-	/* Override of slope duration. */
-	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
-		/* TODO: what's going on here? Why do we set this to zero? */
-		gen->tone_slope.duration = 0;
-	}
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "leaving idle mode after %.3f s", (double) (now - idle_since) / CW_NSECS_PER_SEC);
+
+	return;
+}
 
 
-	int slope_n_samples = ((gen->sample_rate / 100) * gen->tone_slope.duration) / 10000;
-	cw_assert (slope_n_samples >= 0, MSG_PREFIX "negative slope_n_samples: %d", slope_n_samples);
 
 
-	/* Reallocate the table of slope amplitudes only when necessary.
+/**
+   @brief Handle a tone that has been just dequeued from generator's tone queue
 
-	   In practice the function will be called foremost when user changes
-	   volume of tone, and then the function may be called several times
-	   in a row if volume is changed in steps. In such situation the size
-	   of amplitudes table doesn't change.
+   Update latency statistics and value of generator, and inform key
+   about the tone. To be called for each tone dequeued from tone queue,
+   before samples of the tone are generated.
 
-	   TODO: do we really need to change type/duration of slopes when
-	   volume changes? Perhaps a call to
-	   cw_gen_recalculate_slope_amplitudes_internal() would be enough? */
+   @param[in] gen generator
+   @param[in,out] tone tone dequeued just now
+   @param[in] prev_tone tone dequeued previously
+   @param[in] queue_state state of queue after dequeueing @p tone
+*/
+static void cw_gen_tone_dequeued_internal(cw_gen_t * gen, cw_tone_t * tone, const cw_tone_t * prev_tone, cw_queue_state_t queue_state)
+{
+	if (CW_TQ_EMPTY != queue_state) {
+		cw_gen_tone_resolve_elements_internal(gen, tone);
+	}
 
-	if (gen->tone_slope.n_amplitudes != slope_n_samples) {
+	if (!(prev_tone->is_forever && tone->is_forever)) {
+		/* Consecutive dequeues of the same 'forever' tone
+		   are not new tones. */
+		cw_gen_latency_add_dequeued_internal(gen, tone);
+		CW_TRACE(CW_TRACE_EVENT_TQ_DEQUEUE, tone->duration);
+	}
 
-		 /* Remember that slope_n_samples may be zero. In that
-		    case realloc() would equal to free(). We don't
-		    want to have NULL ->amplitudes, so don't modify
-		    ->amplitudes for zero-duration slopes.  Since with
-		    zero-duration slopes we won't be referring to
-		    ->amplitudes[], it is ok that the table will not
-		    be up-to-date. */
+	cw_gen_value_tracking_internal(gen, tone, queue_state);
 
-		if (slope_n_samples > 0) {
-			gen->tone_slope.amplitudes = realloc(gen->tone_slope.amplitudes, sizeof(float) * slope_n_samples);
-			if (!gen->tone_slope.amplitudes) {
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-					      MSG_PREFIX "failed to realloc() table of slope amplitudes");
-				return CW_FAILURE;
-			}
-		}
+#ifdef IAMBIC_KEY_HAS_TIMER
+	/* Also look at call to cw_key_ik_update_graph_state_internal()
+	   made in cw_gen_tone_played_internal(). Both calls are about updating some internals of
+	   key. This one is done before blocking write, the other is
+	   done after blocking write.
 
-		gen->tone_slope.n_amplitudes = slope_n_samples;
+	   Keyer is clocked with count of samples of the tone, not with
+	   tone's duration: the count is exactly what will be played. */
+	if (gen->key) {
+		cw_key_ik_increment_timer_internal(gen->key, tone->n_samples, gen->sample_rate);
 	}
+#endif
 
-	cw_gen_recalculate_slope_amplitudes_internal(gen);
 
-	return CW_SUCCESS;
+#ifdef LIBCW_WITH_DEV
+	cw_debug_ev (&cw_debug_object_ev, 0, tone->frequency ? CW_DEBUG_EVENT_TONE_HIGH : CW_DEBUG_EVENT_TONE_LOW);
+#endif
 }
 
 
 
 
 /**
-   @brief Recalculate amplitudes of PCM samples that form tone's slopes
+   @brief Resolve symbolic duration of a tone that has been just dequeued
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+   Duration of a tone with symbolic duration is calculated from current
+   snapshot of generator's timing parameters, and a Mark gets current
+   frequency of generator. This is how changes of generator's parameters
+   have effect on tones that have been enqueued before the change.
 
-   TODO: consider writing unit test code for the function.
+   Count of samples, pre-calculated for tones of compiled characters, is
+   reset if the duration has changed since the tone has been enqueued.
 
    @param[in] gen generator
+   @param[in,out] tone dequeued tone
 */
-void cw_gen_recalculate_slope_amplitudes_internal(cw_gen_t * gen)
+void cw_gen_tone_resolve_elements_internal(cw_gen_t * gen, cw_tone_t * tone)
 {
-	/* The values in amplitudes[] change from zero to max (at
-	   least for any sane slope shape), so naturally they can be
-	   used in forming rising slope. However they can be used in
-	   forming falling slope as well - just iterate the table from
-	   end to beginning. */
-	for (int i = 0; i < gen->tone_slope.n_amplitudes; i++) {
-
-		if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_LINEAR) {
-			gen->tone_slope.amplitudes[i] = (float) (i * gen->volume_abs) / (float) gen->tone_slope.n_amplitudes;
-
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_SINE) {
-			const float radian = (float) i * (CW_PI / 2.0F) / (float) gen->tone_slope.n_amplitudes;
-			const float y = sinf(radian);
-			gen->tone_slope.amplitudes[i] = y * (float) gen->volume_abs;
+	if (0 == tone->elements) {
+		return;
+	}
 
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RAISED_COSINE) {
-			const float radian = (float) i * CW_PI / (float) gen->tone_slope.n_amplitudes;
-			const float y = (1 - ((1 + cosf(radian)) / 2));
-			gen->tone_slope.amplitudes[i] = y * (float) gen->volume_abs;
+	/* Read the snapshot without locks. Retry when client code's
+	   thread has been updating it while we were reading it. */
+	uint32_t sequence = 0;
+	int frequency = 0;
+	int durations[CW_TONE_ELEMENT_MAX] = { 0 };
+	do {
+		sequence = __atomic_load_n(&gen->timing.sequence, __ATOMIC_ACQUIRE);
+		frequency = __atomic_load_n(&gen->timing.frequency, __ATOMIC_RELAXED);
+		for (int i = 0; i < CW_TONE_ELEMENT_MAX; i++) {
+			durations[i] = __atomic_load_n(&gen->timing.durations[i], __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequence & 1U) || sequence != __atomic_load_n(&gen->timing.sequence, __ATOMIC_RELAXED));
 
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
-			/* CW_TONE_SLOPE_SHAPE_RECTANGULAR is covered
-			   before entering this "for" loop. */
-			/* TODO: to avoid treating
-			   CW_TONE_SLOPE_SHAPE_RECTANGULAR as special case,
-			   add the calculation here. */
-			cw_assert (0, MSG_PREFIX "we shouldn't be here, calculating rectangular slopes");
+	int64_t duration = 0;
+	for (unsigned int i = 0; i < CW_TONE_ELEMENT_MAX; i++) {
+		const uint32_t count = (tone->elements >> (i * CW_TONE_ELEMENT_BITS)) & CW_TONE_ELEMENT_COUNT_MAX;
+		duration += (int64_t) count * durations[i];
+	}
+	if (duration > INT_MAX) {
+		duration = INT_MAX;
+	}
 
-		} else {
-			cw_assert (0, MSG_PREFIX "unsupported slope shape %d", gen->tone_slope.shape);
-		}
+	if (tone->frequency > 0) {
+		tone->frequency = frequency;
+	}
+	if (duration != tone->duration) {
+		tone->duration = (int) duration;
+		tone->n_samples = 0; /* Will be re-calculated. */
 	}
 
 	return;
@@ -1641,716 +2254,3559 @@ void cw_gen_recalculate_slope_amplitudes_internal(cw_gen_t * gen)
 
 
 /**
-   @brief Write tone to soundcard
-
-   @internal
-   @reviewed 2020-10-13
-   @endinternal
+   @brief Calculate count of samples of a tone that has been just dequeued
 
-   @param[in] gen
-   @param[in] tone tone dequeued from queue (if dequeueing was successful); must always be non-NULL
+   In silencing phase @p tone is replaced with a silencing tone based on
+   @p prev_tone.
 
-   @return 0
+   @param[in] gen generator
+   @param[in,out] tone tone dequeued just now
+   @param[in] prev_tone tone dequeued previously
+   @param[in] is_empty_tone whether @p tone is not a valid tone from tone queue
 */
-int cw_gen_write_to_soundcard_internal(cw_gen_t * gen, cw_tone_t * tone)
+static void cw_gen_tone_calculate_samples_internal(cw_gen_t * gen, cw_tone_t * tone, const cw_tone_t * prev_tone, bool is_empty_tone)
 {
-	cw_assert (NULL != tone, MSG_PREFIX "'tone' argument should always be non-NULL");
-
-	/* Total number of samples to write in a loop below. */
-	int64_t samples_to_write = tone->n_samples;
+	if (gen->silencing_initialized) {
+		/* Don't play a tone that has been just
+		   dequeued. Instead prepare a tone that will
+		   silence current source sink. Use current
+		   tone ('tone' variable) as starting
+		   point/basis for this silencing tone. */
+		CW_TONE_COPY(tone, prev_tone);
+		tone->enqueue_time = 0; /* Not a tone from queue, don't measure its latency. */
+		tone->dequeue_time = 0;
+		cw_gen_silencing_tone_calculate_samples_size_internal(gen, tone);
+	} else if (is_empty_tone) {
+		/* No valid tone dequeued from tone
+		   queue. 'tone' argument doesn't represent a
+		   valid tone. We need samples to complete
+		   filling buffer, but they have to be empty
+		   samples. */
+		cw_gen_empty_tone_calculate_samples_size_internal(gen, tone);
+	} else {
+		/* Valid tone dequeued from tone queue and
+		   nothing prohibits us from playing it (we
+		   aren't in 'silencing' phase). Use the tone
+		   to calculate samples in buffer. Tones of
+		   compiled characters come with the values
+		   already calculated. */
+		if (!cw_gen_tone_samples_size_is_valid_internal(gen, tone)) {
+			cw_gen_tone_calculate_samples_size_internal(gen, tone);
+		}
+	}
+}
 
-#define LIBCW_WRITE_LOOP_DEBUG_LEVEL 0
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-	/* Debug code. */
-	int n_loops = 0;
-	const float n_loops_expected = floorf(1.0 * samples_to_write / gen->buffer_n_samples); /* In reality number of loops executed is sometimes n_loops_expected, but mostly it's n_loops_expected+1. */
-	fprintf(stderr, MSG_PREFIX "entering loop (~%.1f iterations expected), tone->frequency = %d, buffer->n_samples = %d, samples_to_write = %"PRId64"\n",
-		(double) n_loops_expected, tone->frequency, gen->buffer_n_samples, samples_to_write);
-#endif
 
-	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "%lld samples, %d us, %d Hz", tone->n_samples, tone->duration, gen->frequency);
-	while (samples_to_write > 0) {
 
-		const int64_t free_space = gen->buffer_n_samples - gen->buffer_sub_start;
-		if (samples_to_write > free_space) {
-			/* There will be some tone samples left for
-			   next iteration of this loop.  But buffer in
-			   this iteration will be ready to be pushed
-			   to sound sink. */
-			gen->buffer_sub_stop = gen->buffer_n_samples - 1;
-		} else if (samples_to_write == free_space) {
-			/* How nice, end of tone samples aligns with
-			   end of buffer (last sample of tone will be
-			   placed in last cell of buffer).
 
-			   But the result is the same - a full buffer
-			   ready to be pushed to sound sink. */
-			gen->buffer_sub_stop = gen->buffer_n_samples - 1;
-		} else {
-			/* There will be too few samples to fill a
-			   buffer. We can't send an under-filled buffer to
-			   sound sink. We will have to get more
-			   samples to fill the buffer completely. */
-			gen->buffer_sub_stop = gen->buffer_sub_start + samples_to_write - 1;
-		}
+/**
+   @brief Handle a tone that has been completely generated
 
-		/* How many samples of sound buffer's subarea will be
-		   calculated in a given cycle of "calculate sine
-		   wave" code, i.e. in current iteration of the 'while' loop? */
-		const int buffer_sub_n_samples = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+   Notify waiting client code and key about end of tone, finish
+   silencing phase, and remember @p tone as previous tone.
 
+   @param[in] gen generator
+   @param[in] tone tone that has been generated
+   @param[in,out] prev_tone tone that has been generated before @p tone, will be overwritten with @p tone
+   @param[in] may_sleep whether the function may sleep (it may not when called from a sound server's real-time callback)
+*/
+static void cw_gen_tone_played_internal(cw_gen_t * gen, const cw_tone_t * tone, cw_tone_t * prev_tone, bool may_sleep)
+{
+#ifdef GENERATOR_CLIENT_THREAD
+	/* Original implementation using signals. */
+	/* This code has been disabled some time before 2017-01-19. */
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-		/* Debug code. */
-		++n_loops;
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 1
-		/* Debug code. */
-		fprintf(stderr, MSG_PREFIX "       loop #%d, buffer_sub_n_samples = %d\n", n_loops, buffer_sub_n_samples);
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
-			      MSG_PREFIX
-			      "sub start: %d, sub stop: %d, sub size: %d / %"PRIu64,
-			      gen->buffer_sub_start, gen->buffer_sub_stop, buffer_sub_n_samples, samples_to_write);
-#endif
+	/*
+	  When sending text from text input, the signal:
+	   - allows client code to observe moment when state of tone
+	     queue is "low/critical"; client code then can add more
+	     characters to the queue; the observation is done using
+	     cw_tq_wait_for_level_internal();
+
+	   - allows client code to observe any dequeue event
+	     by waiting for signal in
+	     cw_tq_wait_for_end_of_current_tone_internal();
+	*/
+	pthread_kill(gen->library_client.thread_id, SIGALRM);
 #endif
 
+	/* Generator may be used by iambic keyer to measure periods
+	   of time (durations of Mark and Space). This is achieved by
+	   enqueueing Marks and Spaces by keyer in generator. A
+	   soundcard playing samples is surprisingly good at
+	   measuring time intervals.
+
+	   At this point the generator has finished generating
+	   a tone of specified duration. A duration of Mark or
+	   Space has elapsed. Inform iambic keyer that the
+	   tone it has enqueued has elapsed. The keyer may
+	   want to change state of its internal state machine.
+
+	   (Whether iambic keyer has enqueued any tones or
+	   not, and whether it is waiting for the
+	   notification, is a different story. We will let the
+	   iambic keyer function called below to decide what
+	   to do with the notification. If keyer is in idle
+	   state, it will ignore the notification.)
+
+	   Notice that this mechanism is needed only for
+	   iambic keyer. Inner workings of straight key are
+	   much more simple, the straight key doesn't need to
+	   use generator as a timer. */
+	if (CW_FAILURE == cw_key_ik_update_graph_state_internal(gen->key) && may_sleep) {
+		/* just try again, once */
+		usleep(1000);
+		cw_key_ik_update_graph_state_internal(gen->key);
+	}
 
-		const int calculated = cw_gen_calculate_sine_wave_internal(gen, tone);
-		cw_assert (calculated == buffer_sub_n_samples, MSG_PREFIX "calculated wrong number of samples: %d != %d", calculated, buffer_sub_n_samples);
+	/* Iambic keyer's waiting functions wait on tq's wait_var for a
+	   change of keyer's state, so notify them after the keyer has
+	   been updated above. Waiters for tq's level or end of tone have
+	   already been woken up by dequeue. */
+	if (prev_tone->is_forever && tone->is_forever) {
+		/*
+		  Don't notify about dequeueing two consecutive
+		  'forever' tones. For any listener this is still the
+		  same tone.
+
+		  TODO: make the check more precise. What if first
+		  'forever' tone is silent and the next is
+		  non-silent, or if they have two different
+		  frequencies?
+		*/
+		; /* NOOP */
+	} else {
+#ifdef GENERATOR_CLIENT_THREAD
+		fprintf(stderr, MSG_PREFIX "      sending signal on dequeue, target thread id = %ld\n", gen->library_client.thread_id);
+#endif
+		cw_tq_broadcast_internal(gen->tq);
+	}
 
-		if (gen->buffer_sub_stop == gen->buffer_n_samples - 1) {
+	if (gen->silencing_initialized) {
+		/* We are in silencing phase. A last tone (silencing
+		   tone) has been played, and we shouldn't play
+		   anything else. Discard tones remaining in
+		   queue.
+
+		   Remember that we are in silencing phase, which may
+		   or may not mean that generator is being
+		   stopped and deleted. */
+		cw_tq_flush_internal(gen->tq);
+		gen->silencing_initialized = false;
+	}
 
-			/* We have a buffer full of samples. The
-			   buffer is ready to be pushed to sound
-			   sink. */
-			gen->write_buffer_to_sound_device(gen);
-#if CW_DEV_RAW_SINK
-			cw_dev_debug_raw_sink_write_internal(gen);
+#ifdef LIBCW_WITH_DEV
+	cw_debug_ev (&cw_debug_object_ev, 0, tone->frequency ? CW_DEBUG_EVENT_TONE_LOW : CW_DEBUG_EVENT_TONE_HIGH);
 #endif
-			gen->buffer_sub_start = 0;
-			gen->buffer_sub_stop = 0;
-		} else {
-			/* #needmoresamples
-			   There is still some space left in the
-			   buffer, go fetch new tone from tone
-			   queue. */
+	/* And finally, at the very end... */
+	CW_TONE_COPY(prev_tone, tone);
+}
 
-			gen->buffer_sub_start = gen->buffer_sub_stop + 1;
 
-			cw_assert (gen->buffer_sub_start <= gen->buffer_n_samples - 1,
-				   MSG_PREFIX "sub start out of range: sub start = %d, buffer n samples = %d",
-				   gen->buffer_sub_start, gen->buffer_n_samples);
-		}
 
-		samples_to_write -= buffer_sub_n_samples;
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-		/* Debug code. */
-		if (samples_to_write < 0) {
-			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "samples left = %"PRId64, samples_to_write);
-		}
-#endif
+/**
+   @brief Generate samples for sound system working in pull mode
 
-	} /* while (samples_to_write > 0) { */
+   Function is called by sound system from sound server's callback
+   (e.g. JACK's process callback) each time the server needs next @p
+   n_samples samples. The function dequeues tones from generator's tone
+   queue and calculates their samples right into @p samples provided
+   by the server, without involving generator's thread.
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-	/* Debug code. */
-	fprintf(stderr, MSG_PREFIX "left loop, %d iterations executed from %.1f iterations planned, samples left = %d\n",
-		n_loops, (double) n_loops_expected, (int) samples_to_write);
-#endif
+   A tone may be longer than @p n_samples samples. Generation of such
+   tone is continued in next call to the function.
 
-	return 0;
+   When tone queue is empty, or when generator is not started, the
+   function puts silence into @p samples.
+
+   The function never waits for new tones in tone queue, but it takes
+   mutex of tone queue to dequeue a tone (see description of
+   libcw_jack.c), so it is not lock-free.
+
+   @param[in] gen generator
+   @param[out] samples memory into which to put samples
+   @param[in] n_samples count of samples to put into @p samples, not larger than gen->buffer_n_samples
+*/
+void cw_gen_pull_samples_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples)
+{
+	if (!gen->pull.active || !gen->do_dequeue_and_generate || gen->paused) {
+		memset(samples, 0, sizeof (cw_sample_t) * (size_t) n_samples);
+		return;
+	}
+	cw_assert (n_samples <= gen->buffer_n_samples, MSG_PREFIX "count of samples too large: %d > %d", n_samples, gen->buffer_n_samples);
+
+	/* The samples will be heard after latency of sound server. */
+	cw_gen_sound_clock_set_anchor_internal(gen);
+	cw_gen_pull_tones_internal(gen, samples, n_samples);
+
+	cw_gen_latency_add_buffer_internal(gen);
+	cw_gen_stats_add_write_internal(gen, CW_SUCCESS, n_samples, 0);
+
+	return;
 }
 
 
 
 
 /**
-   @brief Construct empty tone with correct/needed values of samples count
-
-   The function sets values tone->..._n_samples fields of empty @p
-   tone based on information from @p gen (i.e. looking on how many
-   samples of silence need to be "created").  The sample count values
-   are set in a way that allows filling remainder of generator's
-   buffer with silence.
+   @brief Dequeue tones and calculate their samples into given memory
 
-   After this point tone duration should not be used - it's the samples count that is correct.
+   Tones that don't fit in @p n_samples samples are continued in next
+   call. When tone queue becomes empty, rest of @p samples is filled
+   with silence.
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+   @param[in] gen generator
+   @param[out] samples memory into which to put samples
+   @param[in] n_samples count of samples to put into @p samples
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples count.
+   @return count of samples of tones put into @p samples (samples of silence that follow them are not counted)
 */
-void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+static int cw_gen_pull_tones_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples)
 {
-	/* All tones have been already dequeued from tone queue.
-
-	   @p tone does not represent a valid tone to generate. At
-	   first sight there is no need to write anything to
-	   soundcard. But...
+	cw_tone_t * tone = &gen->pull.tone;
+	cw_tone_t * prev_tone = &gen->pull.prev_tone;
+	int n_filled = 0;
+
+	gen->buffer_target = samples;
+
+	while (n_filled < n_samples) {
+		if (!gen->pull.tone_in_progress) {
+			/* Position of the tone in buffer, for timestamp of
+			   generator's value. */
+			gen->buffer_sub_start = n_filled;
+			cw_gen_text_source_pull_internal(gen);
+			const cw_queue_state_t queue_state = cw_tq_dequeue_internal(gen->tq, tone);
+			if (CW_TQ_EMPTY == queue_state) {
+				/* No sound until client code enqueues
+				   new tones. Don't wait for them. */
+				cw_gen_value_tracking_internal(gen, tone, queue_state);
+				memset(samples + n_filled, 0, sizeof (cw_sample_t) * (size_t) (n_samples - n_filled));
+				/* Noise of channel is heard also when
+				   nothing is being sent. */
+				cw_impair_sync_internal(&gen->impair, gen->frequency, gen->sample_rate);
+				if (gen->impair.active) {
+					cw_impair_apply_internal(&gen->impair, samples + n_filled, n_samples - n_filled);
+				}
+				break;
+			}
 
-	   It may happen that during previous call to the function
-	   there were too few samples in a tone to completely fill a
-	   buffer (see #needmoresamples tag below).
+			cw_gen_tone_dequeued_internal(gen, tone, prev_tone, queue_state);
+			gen->buffer_sub_stop = 0; /* Silencing tone is calculated from here. */
+			cw_gen_tone_calculate_samples_internal(gen, tone, prev_tone, false);
+			cw_gen_latency_add_tone_internal(gen, tone, queue_state);
+			gen->pull.tone_in_progress = true;
 
-	   We need to fill the buffer until it is full and ready to be
-	   sent to sound sink.
+			/* The tone starts in current buffer. */
+			if (0 != tone->dequeue_time && 0 == gen->latency.buffer_dequeue_time) {
+				gen->latency.buffer_enqueue_time = tone->enqueue_time;
+				gen->latency.buffer_dequeue_time = tone->dequeue_time;
+			}
+		}
 
-	   Since there are no new tones for which we could generate
-	   samples, we need to generate silence samples.
+		const cw_sample_iter_t remaining = tone->n_samples - tone->sample_iterator;
+		const int n = remaining < n_samples - n_filled ? (int) remaining : n_samples - n_filled;
+		if (n > 0) {
+			gen->buffer_sub_start = n_filled;
+			gen->buffer_sub_stop = n_filled + n - 1;
+			n_filled += cw_gen_calculate_sine_wave_internal(gen, tone);
+		}
 
-	   Padding the buffer with silence seems to be a good idea (it
-	   will work regardless of value (Mark/Space) of last valid
-	   tone). We just need to know how many samples of the silence
-	   to produce.
+		if (tone->sample_iterator >= tone->n_samples) {
+			/* Sound server's thread must not sleep. */
+			cw_gen_tone_played_internal(gen, tone, prev_tone, false);
+			gen->pull.tone_in_progress = false;
+		}
+	}
 
-	   Number of these samples will be stored in
-	   samples_to_write. */
+	gen->buffer_target = NULL;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
 
-	/* We don't have a valid tone, so let's construct a fake one
-	   for purposes of padding. */
+	return n_filled;
+}
 
-	/* Required length of padding space is from end of last buffer
-	   subarea to end of buffer. */
-	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);;
 
-	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
-	tone->frequency = 0;   /* This fake tone is a piece of silence. */
 
-	/* The silence tone used for padding doesn't require any
-	   slopes. A slope falling to silence has been already
-	   provided by last non-fake and non-silent tone. */
-	tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
-	tone->rising_slope_n_samples = 0;
-	tone->falling_slope_n_samples = 0;
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
+cw_ret_t cw_gen_fill_buffer(cw_gen_t * gen, cw_sample_t * samples, size_t n_samples)
+{
+	if (NULL == gen || NULL == samples || !gen->pull.by_client_code) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-	//fprintf(stderr, "++++ count of samples in empty tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	/* Count of samples requested by client code is not limited,
+	   but cw_gen_pull_samples_internal() calculates at most
+	   gen->buffer_n_samples samples at once. */
+	size_t n_filled = 0;
+	while (n_filled < n_samples) {
+		size_t n = n_samples - n_filled;
+		if (n > (size_t) gen->buffer_n_samples) {
+			n = (size_t) gen->buffer_n_samples;
+		}
+		cw_gen_pull_samples_internal(gen, samples + n_filled, (int) n);
+		n_filled += n;
+	}
 
-	return;
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Calculate tone suitable for silencing a generator
+   @brief Generate and write one buffer of samples of generator driven by scheduler
 
-   Calculate a @p tone variable that, when passed to generator's write()
-   function, will silence a generator.
+   Function is called by worker of scheduler (see libcw_sched.c) when
+   buffer of @p gen is due. The function doesn't wait for anything:
+   it doesn't wait for tones, and it doesn't pace writes to real time.
+   Instead it tells the scheduler when next buffer is due.
 
-   @internal
-   @reviewed 2020-10-13
-   @endinternal
+   @param[in] gen generator
+   @param[in] deadline time at which current buffer was due [ns]
+   @param[in] now current time [ns]
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples
+   @return time at which next buffer is due [ns]
 */
-void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+int64_t cw_gen_sched_step_internal(cw_gen_t * gen, int64_t deadline, int64_t now)
 {
-	/* Make sure that we fill a buffer to the end (i.e. calculate as many
-	   samples as there are from current position in the buffer to the
-	   end of the buffer). Otherwise a buffer underrun may occur. */
-	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);
-
-	/* Also make sure that a tone is long enough for it to be heard
-	   (otherwise it may be perceived as click). */
-	tone->n_samples += (5 * gen->buffer_n_samples);
-
-	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
-
-	/* Length of a single slope. */
-	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
-	slope_n_samples *= gen->tone_slope.duration;
-	slope_n_samples /= 10000;
+	const int n_samples = gen->buffer_n_samples;
+	const int64_t buffer_duration = ((int64_t) n_samples * CW_NSECS_PER_SEC) / gen->sample_rate;
 
-	switch (tone->slope_mode) {
-	case CW_SLOPE_MODE_NO_SLOPES:
-	case CW_SLOPE_MODE_RISING_SLOPE:
-		/* Previous tone has ended with full level. Let the silencing
-		   tone fall from the full level to zero. */
-		tone->slope_mode = CW_SLOPE_MODE_FALLING_SLOPE;
-		break;
-	case CW_SLOPE_MODE_FALLING_SLOPE:
-	case CW_SLOPE_MODE_STANDARD_SLOPES:
-		/* Level of previous slope has already fallen to zero. Keep
-		   the level at zero. */
-	default:
-		tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
-		tone->frequency = 0;
-		break;
+	int n_filled = 0;
+	if (gen->pull.active && gen->do_dequeue_and_generate && !gen->paused) {
+		n_filled = cw_gen_pull_tones_internal(gen, gen->buffer, n_samples);
+	}
+	if (0 == n_filled) {
+		/* Nothing to play. Look at tone queue again after time of
+		   one buffer. */
+		gen->scheduling.idle = true;
+		return now + buffer_duration;
 	}
-	tone->rising_slope_n_samples = 0;
-	tone->falling_slope_n_samples = slope_n_samples;
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
+	gen->buffer_write_n_samples = n_samples;
+	if (NULL != gen->frames) {
+		cw_gen_route_samples_internal(gen->buffer, n_samples,
+					      gen->sound_channel_volumes, gen->n_sound_channels, gen->sample_format, gen->frames);
+	}
+	cw_gen_latency_add_buffer_internal(gen);
+	const int64_t write_begin = cw_clock_now_internal();
+	CW_TRACE(CW_TRACE_EVENT_WRITE_BEGIN, n_samples);
+	const cw_ret_t write_ret = gen->write_buffer_to_sound_device(gen);
+	CW_TRACE(CW_TRACE_EVENT_WRITE_END, write_ret);
+	cw_gen_stats_add_write_internal(gen, write_ret, n_samples, cw_clock_now_internal() - write_begin);
+	if (CW_SUCCESS == write_ret) {
+		cw_gen_sound_clock_set_anchor_internal(gen);
+	}
 
-	//fprintf(stderr, "++++ count of samples in silencing tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	if (!gen->scheduling.paced) {
+		/* Next buffer right away, after buffers of generators
+		   that have been waiting longer. */
+		gen->scheduling.idle = false;
+		return now;
+	}
 
-	return;
+	/* Pace relative to start of playing after idling. Late buffers
+	   are caught up, like in cw_file_pace_internal(). */
+	const int64_t start = gen->scheduling.idle ? now : deadline;
+	gen->scheduling.idle = false;
+	return start + buffer_duration;
 }
 
 
 
 
 /**
-   @brief Recalculate non-empty tone parameters from microseconds into samples
+   @brief Calculate a fragment of sine wave
 
-   The function sets tone->..._n_samples fields of non-empty @p tone
-   based on other information from @p tone and from @p gen.
+   Calculate a fragment of sine wave, as many samples as can be fitted in
+   generator buffer's subarea.
 
-   After this point tone duration should not be used - it's the samples count that is correct.
+   The function calculates values of (gen->buffer_sub_stop - gen->buffer_sub_start + 1)
+   samples and puts them into gen->buffer[] (or into memory provided by
+   sound system, see gen->get_buffer_from_sound_device), starting from
+   index gen->buffer_sub_start.
+
+   The function takes into account all state variables from gen,
+   so initial phase of new fragment of sine wave in the buffer matches
+   ending phase of a sine wave generated in previous call.
+
+   Samples of tones that can be cached are copied from generator's cache
+   of pre-rendered tones (see cw_gen_pcm_cache_lookup_internal()).
 
    @internal
-   @reviewed 2020-08-05
+   @reviewed 2020-08-04
    @endinternal
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples count.
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+
+   @return number of calculated samples
 */
-void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+int cw_gen_calculate_sine_wave_internal(cw_gen_t * gen, cw_tone_t * tone)
 {
-	/* 100 * 10000 = 1.000.000 usecs per second. */
-	tone->n_samples = gen->sample_rate / 100;
-	tone->n_samples *= tone->duration;
-	tone->n_samples /= 10000;
+	return cw_gen_calculate_samples_internal(gen, tone, cw_gen_select_kernel_internal(tone));
+}
 
-	//fprintf(stderr, MSG_PREFIX "length of regular tone = %d [samples]\n", tone->n_samples);
 
-	/* Length of a single slope (rising or falling). */
-	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
-	slope_n_samples *= gen->tone_slope.duration;
-	slope_n_samples /= 10000;
 
-	if (tone->slope_mode == CW_SLOPE_MODE_RISING_SLOPE) {
-		tone->rising_slope_n_samples = slope_n_samples;
-		tone->falling_slope_n_samples = 0;
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_FALLING_SLOPE) {
-		tone->rising_slope_n_samples = 0;
-		tone->falling_slope_n_samples = slope_n_samples;
+/**
+   @brief Calculate a fragment of sine wave with given kernel
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES) {
-		tone->rising_slope_n_samples = slope_n_samples;
-		tone->falling_slope_n_samples = slope_n_samples;
+   See cw_gen_calculate_sine_wave_internal(). The kernel is selected by
+   caller once per tone, with cw_gen_select_kernel_internal().
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_NO_SLOPES) {
-		tone->rising_slope_n_samples = 0;
-		tone->falling_slope_n_samples = 0;
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+   @param[in] kernel kernel selected for @p tone
 
-	} else {
-		cw_assert (0, MSG_PREFIX "unknown tone slope mode %d", tone->slope_mode);
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_samples_internal(cw_gen_t * gen, cw_tone_t * tone, cw_gen_kernel_t kernel)
+{
+	assert (gen->buffer_sub_stop <= gen->buffer_n_samples);
+
+	const int n = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+	cw_sample_t * buffer = NULL != gen->buffer_target ? gen->buffer_target : gen->buffer;
+
+	cw_impair_sync_internal(&gen->impair, gen->frequency, gen->sample_rate);
+
+	if (cw_gen_pcm_cache_is_applicable_internal(gen, tone)) {
+		cw_assert (tone->sample_iterator + n <= tone->n_samples,
+			   MSG_PREFIX "subarea beyond end of tone: %"PRId64" + %d > %"PRId64,
+			   tone->sample_iterator, n, tone->n_samples);
+
+		/* Phase of sine wave of a cacheable tone always starts
+		   at zero. */
+		const uint32_t increment = cw_gen_phase_increment_internal(gen, tone->frequency);
+		gen->phase_accumulator = increment * (uint32_t) tone->sample_iterator;
+
+		const cw_sample_t * cached = cw_gen_pcm_cache_lookup_internal(gen, tone);
+		if (NULL != cached) {
+			memcpy(buffer + gen->buffer_sub_start, cached + tone->sample_iterator, n * sizeof (cw_sample_t));
+			if (gen->impair.active) {
+				cw_impair_apply_internal(&gen->impair, buffer + gen->buffer_sub_start, n);
+			}
+			tone->sample_iterator += n;
+			gen->phase_accumulator = increment * (uint32_t) tone->sample_iterator;
+			return n;
+		}
+		/* Failed to get the tone from cache. Fall back to regular
+		   synthesis. */
 	}
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
+	kernel(gen, tone, buffer + gen->buffer_sub_start, n);
 
-#if 0
-	/* Debug code. */
-	if (tone->is_forever) {
-		fprintf(stderr, "++++ count of samples in forever tone '%c' = %d\n", tone->debug_id, tone->n_samples);
-	} else {
-		fprintf(stderr, "++++ count of samples in regular tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	/* Silence doesn't advance phase of sine wave. Next tone
+	   continues the wave from where previous non-silent tone
+	   ended, and starts with rising slope anyway. */
+	if (gen->oscillator == CW_GEN_OSCILLATOR_SINF && tone->frequency > 0) {
+		cw_gen_normalize_phase_offset_internal(gen, tone->frequency, n);
 	}
-#endif
 
-	return;
+	return n;
 }
 
 
 
 
-cw_ret_t cw_gen_set_speed(cw_gen_t * gen, int new_value)
+/**
+   @brief Calculate @p n consecutive samples of a tone
+
+   The samples are processed in blocks of up to
+   CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES samples. For each block the
+   oscillator first calculates a unit-amplitude sine wave, and then
+   cw_gen_apply_envelope_internal() multiplies it by envelope of the
+   tone. Neither of the two steps makes per-sample decisions, so the
+   loops are simple enough to be vectorized by compiler.
+
+   The function is always inlined into kernels defined with
+   CW_GEN_KERNEL(), where @p has_rising_slope and @p has_falling_slope
+   are constants, so code for slopes that the tone doesn't have is
+   removed by compiler.
+
+   Phase of sine wave of sinf() oscillator is not normalized by this
+   function, caller must call cw_gen_normalize_phase_offset_internal().
+
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone tone being generated, with non-zero frequency
+   @param[out] out buffer for samples
+   @param[in] n count of samples to calculate
+   @param[in] has_rising_slope whether @p tone has rising slope
+   @param[in] has_falling_slope whether @p tone has falling slope
+*/
+static inline void cw_gen_synthesize_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out, int n, bool has_rising_slope, bool has_falling_slope)
+{
+	cw_gen_wave_t wave[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES];
+
+	for (int t = 0; t < n; ) {
+		int block_n = n - t;
+		if (block_n > CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES) {
+			block_n = CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES;
+		}
+
+		if (gen->oscillator == CW_GEN_OSCILLATOR_SINF) {
+			cw_gen_calculate_sine_wave_sinf_internal(gen, tone->frequency, t, wave, block_n);
+		} else {
+			uint32_t increment = cw_gen_phase_increment_internal(gen, tone->frequency);
+			int32_t step = 0;
+			if (gen->impair.chirp_n_samples > 0) {
+				if (0 == tone->sample_iterator && has_rising_slope) {
+					/* Key down: start of Mark. */
+					gen->impair.chirp_t = 0;
+				}
+				cw_impair_chirp_internal(&gen->impair, &increment, &step, block_n);
+			}
+			cw_gen_calculate_sine_wave_table_internal(gen, increment, step, wave, block_n);
+		}
+		cw_gen_apply_envelope_internal(gen, tone, wave, out + t, block_n, has_rising_slope, has_falling_slope);
+		if (gen->impair.active) {
+			cw_impair_apply_internal(&gen->impair, out + t, block_n);
+		}
+
+		tone->sample_iterator += block_n;
+		t += block_n;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Kernel for silent tones
+
+   Amplitude of every sample is zero, and phase of sine wave doesn't
+   advance, so the samples are just cleared (and then noise of
+   channel is added to them, if any).
+
+   @param[in] gen generator
+   @param[in,out] tone tone being generated
+   @param[out] out buffer for samples
+   @param[in] n count of samples to calculate
+*/
+static void cw_gen_kernel_silence_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out, int n)
+{
+	memset(out, 0, n * sizeof (cw_sample_t));
+	if (gen->impair.active) {
+		cw_impair_apply_internal(&gen->impair, out, n);
+	}
+	tone->sample_iterator += n;
+
+	return;
+}
+
+
+
+
+/* Define kernel for non-silent tones with given slopes. */
+#define CW_GEN_KERNEL(name, has_rising_slope, has_falling_slope)	\
+	static void cw_gen_kernel_ ## name ## _internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out, int n) \
+	{								\
+		cw_gen_synthesize_internal(gen, tone, out, n, (has_rising_slope), (has_falling_slope)); \
+	}
+
+/* Both slopes (CW_SLOPE_MODE_STANDARD_SLOPES). */
+CW_GEN_KERNEL(standard, true, true)
+/* Only rising slope (CW_SLOPE_MODE_RISING_SLOPE). */
+CW_GEN_KERNEL(rising, true, false)
+/* Only falling slope (CW_SLOPE_MODE_FALLING_SLOPE). */
+CW_GEN_KERNEL(falling, false, true)
+/* No slopes: CW_SLOPE_MODE_NO_SLOPES, or rectangular slope shape. The
+   envelope is a single constant gain. */
+CW_GEN_KERNEL(plateau, false, false)
+
+
+
+
+/**
+   @brief Select kernel calculating samples of given tone
+
+   Silence, slope mode and shape of slopes don't change during a tone,
+   so the decision is made once per tone. The decision is made on
+   counts of samples in tone's slopes, so rectangular slopes (that have
+   no samples) use the same kernel as tones without slopes.
+
+   @param[in] tone tone to generate
+
+   @return kernel to be passed to cw_gen_calculate_samples_internal()
+*/
+static cw_gen_kernel_t cw_gen_select_kernel_internal(const cw_tone_t * tone)
+{
+	if (tone->frequency <= 0) {
+		return cw_gen_kernel_silence_internal;
+	}
+
+	const bool has_rising_slope = tone->rising_slope_n_samples > 0;
+	const bool has_falling_slope = tone->falling_slope_n_samples > 0;
+	if (has_rising_slope && has_falling_slope) {
+		return cw_gen_kernel_standard_internal;
+	} else if (has_rising_slope) {
+		return cw_gen_kernel_rising_internal;
+	} else if (has_falling_slope) {
+		return cw_gen_kernel_falling_internal;
+	} else {
+		return cw_gen_kernel_plateau_internal;
+	}
+}
+
+
+
+
+/**
+   @brief Calculate a fragment of unit-amplitude sine wave using sinf()
+
+   Original implementation of sine wave generator: sinf() is called for
+   each sample, and phase of the sine wave is kept in gen->phase_offset.
+
+   We need two separate iterators to correctly generate sine wave:
+    -- i -- for iterating through output buffer;
+    -- t -- for calculating phase of a sine wave; 't' always has to
+            start from zero for every calculated subarea of generator's
+            buffer (i.e. for every call of
+            cw_gen_calculate_sine_wave_internal()). @p t0 is value of
+            't' for first sample in @p wave.
+
+   Initial/starting phase of generated fragment is always retained in
+   gen->phase_offset, it is the only "memory" of previously calculated
+   fragment of sine wave. The phase offset is updated by
+   cw_gen_normalize_phase_offset_internal() after whole subarea has been
+   calculated.
+
+   In fixed-point build the engine is kept only as a reference for
+   tests, and values of sinf() are converted to Q15.
+
+   @param[in] gen generator that generates sine wave
+   @param[in] frequency frequency of sine wave
+   @param[in] t0 value of phase iterator for first sample
+   @param[out] wave buffer for calculated samples
+   @param[in] n count of samples to calculate
+*/
+static void cw_gen_calculate_sine_wave_sinf_internal(const cw_gen_t * gen, int frequency, int t0, cw_gen_wave_t * wave, int n)
+{
+	for (int i = 0; i < n; i++) {
+		const float phase = (2.0F * CW_PI
+				     * (float) (frequency * (t0 + i))
+				     / (float) gen->sample_rate)
+			+ gen->phase_offset;
+#ifdef LIBCW_FIXED_POINT
+		wave[i] = (cw_gen_wave_t) lrintf(sinf(phase) * (float) CW_GEN_WAVE_ONE);
+#else
+		wave[i] = sinf(phase);
+#endif
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update phase offset after calculating a fragment with sinf() oscillator
+
+   @param[in] gen generator that generates sine wave
+   @param[in] frequency frequency of sine wave
+   @param[in] t count of samples calculated in the fragment
+*/
+static void cw_gen_normalize_phase_offset_internal(cw_gen_t * gen, int frequency, int t)
+{
+	const float phase = (2.0F * CW_PI
+			     * (float) (frequency * t)
+			     / (float) gen->sample_rate)
+		+ gen->phase_offset;
+
+	/* "phase" is now phase of the first sample in next fragment to be
+	   calculated.
+	   However, for long fragments this can be a large value, well
+	   beyond <0; 2*Pi) range.
+	   The value of phase may further accumulate in different
+	   calculations, and at some point it may overflow. This would
+	   result in an audible click.
+
+	   Let's bring back the phase from beyond <0; 2*Pi) range into the
+	   <0; 2*Pi) range, in other words lets "normalize" it. Or, in yet
+	   other words, lets apply modulo operation to the phase.
+
+	   The normalized phase will be used as a phase offset for next
+	   fragment (during next function call). It will be added phase of
+	   every sample calculated in next function call. */
+
+	/* TODO: check if n_periods can be a float. We could avoid the casts. */
+	const int n_periods = (int) floorf(phase / (2.0F * CW_PI));
+	gen->phase_offset = phase - (float) n_periods * 2.0F * CW_PI;
+
+	return;
+}
+
+
+
+
+#ifdef LIBCW_FIXED_POINT
+/**
+   @brief Get value of sine for given phase, in Q15 format
+
+   Fixed-point variant of interpolation done by
+   CW_GEN_OSCILLATOR_TABLE engine. Full range of @p phase corresponds
+   to full period of sine wave.
+
+   @param[in] phase phase of sine wave
+
+   @return value of sine, in range -CW_GEN_WAVE_ONE to CW_GEN_WAVE_ONE
+*/
+static inline cw_gen_wave_t cw_gen_sine_q15_internal(uint32_t phase)
+{
+	const uint32_t index = phase >> CW_SINE_TABLE_FRACTION_BITS;
+	const int32_t fraction = (int32_t) ((phase & CW_SINE_TABLE_FRACTION_MASK) >> (CW_SINE_TABLE_FRACTION_BITS - 15));
+	const int32_t a = cw_sine_table[index];
+	const int32_t b = cw_sine_table[index + 1];
+
+	return a + (((b - a) * fraction) >> 15);
+}
+#endif
+
+
+
+
+/**
+   @brief Calculate a fragment of unit-amplitude sine wave using phase accumulator and sine table
+
+   Phase of sine wave is kept in 32-bit unsigned integer
+   gen->phase_accumulator, where full range of the integer corresponds to
+   full period of sine wave. Phase increment per sample is calculated
+   by caller once per fragment (see cw_gen_phase_increment_internal()),
+   so there are no per-sample trigonometric calls or divisions, and
+   there is no need to normalize the phase: the wrap-around of the
+   accumulator does it for free.
+
+   The increment may change linearly during the fragment by @p step
+   per sample; this is used to sweep frequency of chirp (see
+   cw_impair_chirp_internal()).
+
+   Value of sine for a given phase is taken from cw_sine_table[], with
+   linear interpolation between neighbouring table cells.
+
+   @param[in] gen generator that generates sine wave
+   @param[in] increment phase increment of first sample
+   @param[in] step change of phase increment per sample
+   @param[out] wave buffer for calculated samples
+   @param[in] n count of samples to calculate
+*/
+#ifdef LIBCW_FIXED_POINT
+static void cw_gen_calculate_sine_wave_table_internal(cw_gen_t * gen, uint32_t increment, int32_t step, cw_gen_wave_t * wave, int n)
+{
+
+	uint32_t phase = gen->phase_accumulator;
+
+	for (int i = 0; i < n; i++) {
+		wave[i] = cw_gen_sine_q15_internal(phase);
+		phase += increment;
+		increment += (uint32_t) step;
+	}
+
+	gen->phase_accumulator = phase;
+
+	return;
+}
+#else
+static void cw_gen_calculate_sine_wave_table_internal(cw_gen_t * gen, uint32_t increment, int32_t step, cw_gen_wave_t * wave, int n)
+{
+	const float fraction_scale = 1.0F / (float) (1U << CW_SINE_TABLE_FRACTION_BITS);
+
+	uint32_t phase = gen->phase_accumulator;
+
+	for (int i = 0; i < n; i++) {
+		const uint32_t index = phase >> CW_SINE_TABLE_FRACTION_BITS;
+		const float fraction = (float) (phase & CW_SINE_TABLE_FRACTION_MASK) * fraction_scale;
+		wave[i] = cw_sine_table[index] + (cw_sine_table[index + 1] - cw_sine_table[index]) * fraction;
+
+		phase += increment;
+		increment += (uint32_t) step;
+	}
+
+	gen->phase_accumulator = phase;
+
+	return;
+}
+#endif
+
+
+
+
+/**
+   @brief Get per-sample increment of phase accumulator for given frequency
+
+   @param[in] gen generator
+   @param[in] frequency frequency of sine wave
+
+   @return increment of phase accumulator
+*/
+static uint32_t cw_gen_phase_increment_internal(const cw_gen_t * gen, int frequency)
+{
+	if (frequency <= 0) {
+		return 0;
+	}
+	/* frequency <= CW_FREQUENCY_MAX and sample rate >= 8000, so the
+	   increment always fits in 32 bits. */
+	return (uint32_t) ((((uint64_t) frequency << 32U) + gen->sample_rate / 2) / gen->sample_rate);
+}
+
+
+
+
+/**
+   @brief Multiply unit-amplitude sine wave by envelope of a tone
+
+   Envelope of every tone consists of three parts: rising slope, plateau
+   and falling slope (each of them may have zero length). Boundaries of
+   the three parts are calculated once per call, and then each part is
+   handled by its own simple loop: slope table multiply, constant gain
+   multiply, and reversed slope table multiply.
+
+   The function gives the same results as calling
+   cw_gen_calculate_sample_amplitude_internal() for every sample.
+
+   In fixed-point build @p wave is in Q15 format, and the gain is
+   integer, see CW_GEN_SLOPE_SAMPLE().
+
+   @p has_rising_slope and @p has_falling_slope must match counts of
+   samples in slopes of @p tone. They are constants in each kernel (see
+   CW_GEN_KERNEL()), so loops of missing slopes are not compiled in.
+
+   @param[in] gen generator that generates sine wave
+   @param[in] tone tone being generated, tone->sample_iterator is index of first sample in @p wave
+   @param[in] wave unit-amplitude sine wave
+   @param[out] out buffer for samples of tone
+   @param[in] n count of samples in @p wave and @p out
+   @param[in] has_rising_slope whether @p tone has rising slope
+   @param[in] has_falling_slope whether @p tone has falling slope
+*/
+static inline void cw_gen_apply_envelope_internal(const cw_gen_t * gen, const cw_tone_t * tone, const cw_gen_wave_t * wave, cw_sample_t * out, int n, bool has_rising_slope, bool has_falling_slope)
+{
+	const cw_gen_amplitude_t * amplitudes = gen->tone_slope.amplitudes;
+#ifdef LIBCW_FIXED_POINT
+	const int32_t gain = gen->volume_abs;
+#else
+	const float gain = (float) gen->volume_abs;
+#endif
+	const cw_sample_iter_t first = tone->sample_iterator;
+	const cw_sample_iter_t plateau_start = has_rising_slope ? tone->rising_slope_n_samples : 0;
+	const cw_sample_iter_t falling_start = tone->n_samples - (has_falling_slope ? tone->falling_slope_n_samples : 0);
+	int k = 0;
+
+	/* Beginning of tone, rising slope. */
+	if (has_rising_slope && first < plateau_start) {
+		int len = (int) (plateau_start - first);
+		if (len > n) {
+			len = n;
+		}
+		const cw_gen_amplitude_t * rising = amplitudes + first;
+		for (int j = 0; j < len; j++) {
+			out[j] = CW_GEN_SLOPE_SAMPLE(rising[j], gain, wave[j]);
+		}
+		k = len;
+	}
+
+	/* Middle of tone, plateau, constant amplitude. */
+	if (k < n && first + k < falling_start) {
+		int len = (int) (falling_start - (first + k));
+		if (len > n - k) {
+			len = n - k;
+		}
+		for (int j = k; j < k + len; j++) {
+			out[j] = CW_GEN_PLATEAU_SAMPLE(gain, wave[j]);
+		}
+		k += len;
+	}
+
+	/* Falling slope. Slope amplitudes are used in reversed order. */
+	if (has_falling_slope && k < n) {
+		const cw_sample_iter_t last = tone->n_samples - 1 - (first + k);
+		cw_assert (last - (n - k - 1) >= 0, MSG_PREFIX "sample iterator out of bounds: %"PRId64" / %"PRId64, first + n - 1, tone->n_samples);
+		const cw_gen_amplitude_t * falling = amplitudes + last;
+		for (int j = 0; j < n - k; j++) {
+			out[k + j] = CW_GEN_SLOPE_SAMPLE(falling[-j], gain, wave[k + j]);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if samples of given tone can be taken from cache of pre-rendered tones
+
+   @param[in] gen generator
+   @param[in] tone tone to check
+
+   @return true if the tone can be cached
+   @return false otherwise
+*/
+static bool cw_gen_pcm_cache_is_applicable_internal(const cw_gen_t * gen, const cw_tone_t * tone)
+{
+	return gen->pcm_cache.enabled
+		&& gen->oscillator == CW_GEN_OSCILLATOR_TABLE
+		&& tone->frequency > 0
+		&& 0 == gen->impair.chirp_n_samples /* Chirp changes frequency of Mark. */
+		&& tone->slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES
+		&& !tone->is_forever
+		&& tone->n_samples > 0
+		&& tone->n_samples <= CW_GEN_PCM_CACHE_N_SAMPLES_MAX;
+}
+
+
+
+
+/**
+   @brief Get pre-rendered samples of given tone
+
+   If the tone is not in the cache yet, the function renders all samples
+   of the tone into one of cache's entries.
+
+   @param[in] gen generator
+   @param[in] tone tone for which to get samples
+
+   @return pointer to samples of the tone (from first sample of the tone)
+   @return NULL on failure
+*/
+static const cw_sample_t * cw_gen_pcm_cache_lookup_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	const unsigned int generation = gen->pcm_cache.generation;
+
+	for (int i = 0; i < CW_GEN_PCM_CACHE_CAPACITY; i++) {
+		const cw_gen_pcm_cache_entry_t * entry = &gen->pcm_cache.entries[i];
+		if (entry->generation == generation
+		    && entry->frequency == tone->frequency
+		    && entry->volume_abs == gen->volume_abs
+		    && entry->slope_mode == tone->slope_mode
+		    && entry->n_samples == tone->n_samples
+		    && entry->rising_slope_n_samples == tone->rising_slope_n_samples
+		    && entry->falling_slope_n_samples == tone->falling_slope_n_samples) {
+
+			gen->pcm_cache.n_hits++;
+			return entry->samples;
+		}
+	}
+
+	gen->pcm_cache.n_misses++;
+
+	cw_gen_pcm_cache_entry_t * entry = &gen->pcm_cache.entries[gen->pcm_cache.next_entry];
+	gen->pcm_cache.next_entry = (gen->pcm_cache.next_entry + 1) % CW_GEN_PCM_CACHE_CAPACITY;
+
+	if (entry->capacity < tone->n_samples) {
+		cw_sample_t * samples = (cw_sample_t *) realloc(entry->samples, tone->n_samples * sizeof (cw_sample_t));
+		if (NULL == samples) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "realloc()");
+			return NULL;
+		}
+		entry->samples = samples;
+		entry->capacity = tone->n_samples;
+	}
+
+	/* Render whole tone, starting with zero phase. */
+	cw_tone_t rendered;
+	CW_TONE_COPY(&rendered, tone);
+	rendered.sample_iterator = 0;
+	const uint32_t phase_accumulator = gen->phase_accumulator;
+	gen->phase_accumulator = 0;
+	/* Cache keeps clean tones, impairments of channel are added
+	   to samples copied from cache. */
+	const bool impair_active = gen->impair.active;
+	gen->impair.active = false;
+	const cw_gen_kernel_t kernel = cw_gen_select_kernel_internal(&rendered);
+	kernel(gen, &rendered, entry->samples, (int) tone->n_samples);
+	gen->impair.active = impair_active;
+	gen->phase_accumulator = phase_accumulator;
+
+	entry->frequency = tone->frequency;
+	entry->volume_abs = gen->volume_abs;
+	entry->slope_mode = tone->slope_mode;
+	entry->n_samples = tone->n_samples;
+	entry->rising_slope_n_samples = tone->rising_slope_n_samples;
+	entry->falling_slope_n_samples = tone->falling_slope_n_samples;
+	/* If the cache has been invalidated during rendering, the
+	   entry will be already outdated. That's fine, it will be
+	   rendered again on next lookup. */
+	entry->generation = generation;
+
+	return entry->samples;
+}
+
+
+
+
+/**
+   @brief Invalidate all entries in cache of pre-rendered tones
+
+   The function should be called whenever a parameter that has impact on
+   samples of tones, but is not a part of key of cache's entry (e.g. shape
+   of slopes), is changed.
+
+   @param[in] gen generator
+*/
+void cw_gen_pcm_cache_invalidate_internal(cw_gen_t * gen)
+{
+	unsigned int generation = gen->pcm_cache.generation + 1;
+	if (0 == generation) {
+		/* Zero is reserved for entries that were never rendered. */
+		generation = 1;
+	}
+	gen->pcm_cache.generation = generation;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enable or disable cache of pre-rendered tones
+
+   The cache is enabled by default.
+
+   @param[in] gen generator
+   @param[in] enabled new state of the cache
+*/
+void cw_gen_set_pcm_cache_internal(cw_gen_t * gen, bool enabled)
+{
+	cw_gen_pcm_cache_invalidate_internal(gen);
+	gen->pcm_cache.enabled = enabled;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add a latency measurement to histogram
+
+   @param[in,out] histogram histogram to update
+   @param[in] latency measured latency [us]
+*/
+static void cw_latency_histogram_add_internal(cw_latency_histogram_t * histogram, int64_t latency)
+{
+	if (latency < 0) {
+		/* Shouldn't happen with monotonic clock. */
+		latency = 0;
+	}
+
+	int bucket = 0;
+	while (bucket < CW_LATENCY_HISTOGRAM_N_BUCKETS - 1 && latency >= ((int64_t) 1 << bucket)) {
+		bucket++;
+	}
+
+	histogram->count++;
+	histogram->sum += (uint64_t) latency;
+	if ((uint64_t) latency > histogram->max) {
+		histogram->max = (uint64_t) latency;
+	}
+	histogram->buckets[bucket]++;
+}
+
+
+
+
+/**
+   @brief Begin update of latency statistics of generator
+
+   Updates are serialized by mutex. Sequence counter is odd during the
+   update, so readers without the mutex know that their copy may be
+   inconsistent.
+
+   @param[in] gen generator
+*/
+static void cw_gen_latency_update_begin_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->latency.mutex);
+	__atomic_store_n(&gen->latency.seq, gen->latency.seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+
+
+/**
+   @brief End update of latency statistics of generator
+
+   @param[in] gen generator
+*/
+static void cw_gen_latency_update_end_internal(cw_gen_t * gen)
+{
+	__atomic_store_n(&gen->latency.seq, gen->latency.seq + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&gen->latency.mutex);
+}
+
+
+
+
+/**
+   @brief Get consistent copy of latency statistics of generator
+
+   The copy is taken without the mutex, so reader never delays
+   generator's thread. The copy is retried if it has overlapped with
+   an update. Only if updates keep overlapping, reader waits for the
+   mutex.
+
+   @param[in] gen generator
+   @param[out] stats copy of statistics
+*/
+void cw_gen_latency_snapshot_internal(cw_gen_t * gen, cw_gen_latency_stats_t * stats)
+{
+	for (int i = 0; i < CW_GEN_LATENCY_SNAPSHOT_ATTEMPTS; i++) {
+		const unsigned int seq = __atomic_load_n(&gen->latency.seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			/* Update in progress. */
+			continue;
+		}
+		memcpy(stats, &gen->latency.stats, sizeof (*stats));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (seq == __atomic_load_n(&gen->latency.seq, __ATOMIC_RELAXED)) {
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&gen->latency.mutex);
+	*stats = gen->latency.stats;
+	pthread_mutex_unlock(&gen->latency.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update latency statistics with a tone that has been just dequeued
+
+   The function sets dequeue time of @p tone.
+
+   @param[in] gen generator
+   @param[in,out] tone tone dequeued from generator's tone queue
+*/
+static void cw_gen_latency_add_dequeued_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	if (0 == tone->enqueue_time) {
+		return;
+	}
+	tone->dequeue_time = cw_monotonic_usecs_internal();
+
+	cw_gen_latency_update_begin_internal(gen);
+	cw_latency_histogram_add_internal(&gen->latency.stats.queue, tone->dequeue_time - tone->enqueue_time);
+	cw_gen_latency_update_end_internal(gen);
+}
+
+
+
+
+/**
+   @brief Update latency statistics with a buffer that is about to be written to sound system
+
+   @param[in] gen generator
+*/
+static void cw_gen_latency_add_buffer_internal(cw_gen_t * gen)
+{
+	if (0 == gen->latency.buffer_dequeue_time) {
+		/* No tone starts in this buffer. */
+		return;
+	}
+	const int64_t now = cw_monotonic_usecs_internal();
+
+	cw_gen_latency_update_begin_internal(gen);
+	cw_latency_histogram_add_internal(&gen->latency.stats.device, now - gen->latency.buffer_dequeue_time);
+	cw_latency_histogram_add_internal(&gen->latency.stats.total, now - gen->latency.buffer_enqueue_time);
+	cw_gen_latency_update_end_internal(gen);
+
+	gen->latency.buffer_enqueue_time = 0;
+	gen->latency.buffer_dequeue_time = 0;
+}
+
+
+
+
+/**
+   @brief Update counters with result of writing a buffer to sound system
+
+   @param[in] gen generator
+   @param[in] cwret value returned by function writing the buffer
+   @param[in] n_samples count of samples in the buffer
+   @param[in] blocked_time time spent in the function writing the buffer [ns]
+*/
+void cw_gen_stats_add_write_internal(cw_gen_t * gen, cw_ret_t cwret, int n_samples, int64_t blocked_time)
+{
+	if (CW_SUCCESS == cwret) {
+		__atomic_add_fetch(&gen->stats.n_buffers_written, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&gen->stats.n_samples_written, (uint64_t) n_samples, __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&gen->stats.n_write_errors, 1, __ATOMIC_RELAXED);
+	}
+	if (blocked_time > 0) {
+		__atomic_add_fetch(&gen->stats.write_blocked_time, (uint64_t) (blocked_time / 1000), __ATOMIC_RELAXED);
+	}
+}
+
+
+
+
+/**
+   @brief Update counters with underruns of sound device
+
+   To be called by sound systems that can detect underruns. The
+   function may be called from thread of sound system.
+
+   @param[in] gen generator
+   @param[in] n_xruns count of underruns detected by sound system
+*/
+void cw_gen_stats_add_xruns_internal(cw_gen_t * gen, unsigned int n_xruns)
+{
+	__atomic_add_fetch(&gen->stats.n_xruns, (uint64_t) n_xruns, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Update counters with restart of sound device after underrun or failed write
+
+   @param[in] gen generator
+*/
+void cw_gen_stats_add_recovery_internal(cw_gen_t * gen)
+{
+	__atomic_add_fetch(&gen->stats.n_recoveries, 1, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Update counters with a write in which only a part of buffer has been accepted by sound system
+
+   The write is also counted as failed write by generator.
+
+   @param[in] gen generator
+   @param[in] n_samples count of samples accepted by sound system
+*/
+void cw_gen_stats_add_short_write_internal(cw_gen_t * gen, int n_samples)
+{
+	__atomic_add_fetch(&gen->stats.n_short_writes, 1, __ATOMIC_RELAXED);
+	if (n_samples > 0) {
+		__atomic_add_fetch(&gen->stats.n_samples_written, (uint64_t) n_samples, __ATOMIC_RELAXED);
+	}
+}
+
+
+
+
+/**
+   @brief Update statistics with a tone that has been just dequeued and prepared for playing
+
+   @param[in] gen generator
+   @param[in] tone tone with calculated count of samples (not used by Null and Console sound systems)
+   @param[in] queue_state state of queue after dequeueing @p tone
+*/
+static void cw_gen_latency_add_tone_internal(cw_gen_t * gen, const cw_tone_t * tone, cw_queue_state_t queue_state)
+{
+	cw_gen_latency_update_begin_internal(gen);
+	if (CW_TQ_JUST_EMPTIED == queue_state) {
+		gen->latency.stats.n_tq_emptied++;
+	}
+	gen->latency.stats.tones_duration += tone->duration;
+	if (gen->sound_system != CW_AUDIO_NULL && gen->sound_system != CW_AUDIO_CONSOLE) {
+		gen->latency.stats.n_tones_samples += (uint64_t) tone->n_samples;
+	}
+	cw_gen_latency_update_end_internal(gen);
+}
+
+
+
+
+/**
+   @brief Update latency statistics with latency of sound device reported by sound system
+
+   To be called by sound systems that can get the latency from the
+   sound server/device.
+
+   @param[in] gen generator
+   @param[in] latency latency of sound device [microseconds]
+*/
+void cw_gen_latency_set_sound_device_latency_internal(cw_gen_t * gen, int64_t latency)
+{
+	cw_gen_latency_update_begin_internal(gen);
+	gen->latency.stats.sound_device_latency = latency;
+	cw_gen_latency_update_end_internal(gen);
+}
+
+
+
+
+/**
+   @brief Get latency of sound device, as last reported by sound system
+
+   @param[in] gen generator
+
+   @return latency of sound device [microseconds], zero if sound system doesn't report it
+*/
+int64_t cw_gen_latency_get_sound_device_latency_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->latency.mutex);
+	const int64_t latency = gen->latency.stats.sound_device_latency;
+	pthread_mutex_unlock(&gen->latency.mutex);
+	return latency;
+}
+
+
+
+
+/**
+   @brief Wait until end of a tone, for sound systems without sound device
+
+   Null and Console sound systems simulate blocking write of a tone
+   by sleeping for duration of the tone. Relative sleeps would
+   accumulate drift (time spent between sleeps, and lateness of every
+   wakeup), which would distort timing of long transmissions and of
+   iambic keyer using the generator as a timer. Instead, the function
+   sleeps until absolute deadline, and the deadline of each tone is
+   calculated from deadline of previous tone.
+
+   Lateness of the wakeup is added to generator's latency statistics.
+
+   @param[in] gen generator
+   @param[in] duration duration of tone [microseconds]
+*/
+void cw_gen_pace_tone_internal(cw_gen_t * gen, int duration)
+{
+	const int64_t now = cw_monotonic_usecs_internal();
+	if (0 == gen->pacing.deadline || now - gen->pacing.deadline > CW_GEN_PACING_MAX_LATENESS) {
+		/* First tone after idling, or the thread has stalled. */
+		gen->pacing.deadline = now;
+	}
+	gen->pacing.deadline += duration;
+
+	cw_clock_sleep_until_internal(gen->pacing.deadline * 1000);
+
+	const int64_t lateness = cw_monotonic_usecs_internal() - gen->pacing.deadline;
+	cw_gen_latency_update_begin_internal(gen);
+	cw_latency_histogram_add_internal(&gen->latency.stats.pacing, lateness);
+	cw_gen_latency_update_end_internal(gen);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_get_latency_stats(cw_gen_t * gen, cw_gen_latency_stats_t * stats)
+{
+	if (NULL == gen || NULL == stats) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_latency_snapshot_internal(gen, stats);
+
+	stats->tq_length_max = cw_tq_get_length_max_internal(gen->tq);
+	stats->tq_capacity = cw_tq_capacity_internal(gen->tq);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_get_output_latency(cw_gen_t * gen, int64_t * usecs)
+{
+	if (NULL == gen || NULL == usecs) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Sound sink stays open for whole lifetime of generator. */
+	int64_t device_delay = 0;
+	if (NULL == gen->get_device_delay || CW_SUCCESS != gen->get_device_delay(gen, &device_delay)) {
+		device_delay = cw_gen_latency_get_sound_device_latency_internal(gen);
+	}
+
+	/* Samples calculated, but not written to sound sink yet. */
+	int64_t buffered = 0;
+	if (gen->sample_rate > 0) {
+		const int n_samples = __atomic_load_n(&gen->buffer_sub_start, __ATOMIC_RELAXED);
+		buffered = (int64_t) n_samples * CW_USECS_PER_SEC / gen->sample_rate;
+	}
+
+	*usecs = device_delay + buffered;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_get_stats(cw_gen_t * gen, cw_gen_stats_t * stats)
+{
+	if (NULL == gen || NULL == stats) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	stats->n_xruns            = __atomic_load_n(&gen->stats.n_xruns, __ATOMIC_RELAXED);
+	stats->n_recoveries       = __atomic_load_n(&gen->stats.n_recoveries, __ATOMIC_RELAXED);
+	stats->n_short_writes     = __atomic_load_n(&gen->stats.n_short_writes, __ATOMIC_RELAXED);
+	stats->n_write_errors     = __atomic_load_n(&gen->stats.n_write_errors, __ATOMIC_RELAXED);
+	stats->n_buffers_written  = __atomic_load_n(&gen->stats.n_buffers_written, __ATOMIC_RELAXED);
+	stats->n_samples_written  = __atomic_load_n(&gen->stats.n_samples_written, __ATOMIC_RELAXED);
+	stats->write_blocked_time = __atomic_load_n(&gen->stats.write_blocked_time, __ATOMIC_RELAXED);
+
+	/* Include current period of generator's thread. */
+	const int64_t now = cw_clock_now_internal();
+	const int64_t idle_since = __atomic_load_n(&gen->idle.idle_since, __ATOMIC_RELAXED);
+	const int64_t active_since = __atomic_load_n(&gen->idle.active_since, __ATOMIC_RELAXED);
+	stats->idle_time          = __atomic_load_n(&gen->stats.idle_time, __ATOMIC_RELAXED);
+	stats->active_time        = __atomic_load_n(&gen->stats.active_time, __ATOMIC_RELAXED);
+	stats->n_idle_periods     = __atomic_load_n(&gen->stats.n_idle_periods, __ATOMIC_RELAXED);
+	if (0 != idle_since && now > idle_since) {
+		stats->idle_time += (uint64_t) (now - idle_since) / 1000;
+	}
+	if (0 != active_since && now > active_since) {
+		stats->active_time += (uint64_t) (now - active_since) / 1000;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_reset_latency_stats(cw_gen_t * gen)
+{
+	cw_gen_latency_update_begin_internal(gen);
+	memset(&gen->latency.stats, 0, sizeof (gen->latency.stats));
+	cw_gen_latency_update_end_internal(gen);
+
+	cw_tq_reset_length_max_internal(gen->tq);
+}
+
+
+
+
+/**
+   @brief Validate and store real-time properties from generator's configuration
+
+   @param[in] gen generator
+   @param[in] gen_conf configuration of generator
+
+   @return CW_SUCCESS if the properties are valid
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_gen_set_realtime_config_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (SCHED_FIFO == gen_conf->thread_sched_policy || SCHED_RR == gen_conf->thread_sched_policy) {
+		const int min = sched_get_priority_min(gen_conf->thread_sched_policy);
+		const int max = sched_get_priority_max(gen_conf->thread_sched_policy);
+		if (gen_conf->thread_sched_priority < min || gen_conf->thread_sched_priority > max) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "scheduling priority %d out of range %d - %d",
+				      gen_conf->thread_sched_priority, min, max);
+			return CW_FAILURE;
+		}
+	} else if (SCHED_OTHER != gen_conf->thread_sched_policy) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "unsupported scheduling policy %d", gen_conf->thread_sched_policy);
+		return CW_FAILURE;
+	}
+
+	gen->realtime.sched_policy = gen_conf->thread_sched_policy;
+	gen->realtime.sched_priority = gen_conf->thread_sched_priority;
+	gen->realtime.cpu_set = gen_conf->thread_cpu_set;
+	gen->realtime.lock_memory = gen_conf->lock_memory;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Apply requested scheduling and CPU affinity to current thread
+
+   To be called by generator's thread (or by thread of mixer that owns
+   the generator) at its beginning. Failures (most probably caused by
+   lack of privileges) are recorded in generator's real-time status and
+   reported, but the thread continues with default properties.
+
+   @param[in] gen generator
+*/
+void cw_gen_apply_thread_realtime_internal(cw_gen_t * gen)
+{
+	if (SCHED_OTHER != gen->realtime.sched_policy) {
+		struct sched_param param = { 0 };
+		param.sched_priority = gen->realtime.sched_priority;
+		const int rv = pthread_setschedparam(pthread_self(), gen->realtime.sched_policy, &param);
+		pthread_mutex_lock(&gen->realtime.status_mutex);
+		gen->realtime.status.sched_applied = 0 == rv;
+		gen->realtime.status.sched_errno = rv;
+		pthread_mutex_unlock(&gen->realtime.status_mutex);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to set real-time scheduling of generator's thread: %s; using default scheduling",
+				      strerror(rv));
+		}
+	}
+
+	if (0 != gen->realtime.cpu_set) {
+#if defined(__linux__) && defined(CPU_SETSIZE)
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		for (int i = 0; i < 64 && i < CPU_SETSIZE; i++) {
+			if (gen->realtime.cpu_set & (UINT64_C(1) << i)) {
+				CPU_SET(i, &cpu_set);
+			}
+		}
+		const int rv = pthread_setaffinity_np(pthread_self(), sizeof (cpu_set), &cpu_set);
+#else
+		const int rv = ENOSYS;
+#endif
+		pthread_mutex_lock(&gen->realtime.status_mutex);
+		gen->realtime.status.cpu_affinity_applied = 0 == rv;
+		gen->realtime.status.cpu_affinity_errno = rv;
+		pthread_mutex_unlock(&gen->realtime.status_mutex);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to set CPU affinity of generator's thread: %s",
+				      strerror(rv));
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Round size of memory up to whole pages
+
+   @param[in] size size of memory [bytes]
+
+   @return size rounded up to multiple of size of page
+*/
+static size_t cw_gen_round_to_pages_internal(size_t size)
+{
+	const long page_size = sysconf(_SC_PAGESIZE);
+	const size_t page = page_size > 0 ? (size_t) page_size : 4096;
+
+	return (size + page - 1) / page * page;
+}
+
+
+
+
+/**
+   @brief Allocate zeroed memory that occupies its own whole pages
+
+   Memory that may be locked with cw_gen_lock_memory_internal() is
+   allocated with this function, so that unlocking it doesn't unlock
+   other data. The memory is deallocated with free().
+
+   @param[in] size size of memory [bytes]
+
+   @return pointer to memory on success
+   @return NULL on failure
+*/
+static void * cw_gen_calloc_pages_internal(size_t size)
+{
+	const long page_size = sysconf(_SC_PAGESIZE);
+	const size_t page = page_size > 0 ? (size_t) page_size : 4096;
+	const size_t rounded = cw_gen_round_to_pages_internal(size);
+
+	void * memory = NULL;
+	if (0 != posix_memalign(&memory, page, rounded)) {
+		return NULL;
+	}
+	memset(memory, 0, rounded);
+
+	return memory;
+}
+
+
+
+
+/**
+   @brief Lock given memory area of generator in memory
+
+   The area must have been allocated with
+   cw_gen_calloc_pages_internal(). It is unlocked by
+   cw_gen_unlock_memory_internal() before it is deallocated:
+   deallocation with free() doesn't return pages to system, so they
+   would stay locked and count against RLIMIT_MEMLOCK of the process.
+
+   Failure is recorded in generator's real-time status and reported,
+   but is not treated as an error.
+
+   @param[in] gen generator
+   @param[in] addr beginning of memory area
+   @param[in] size size of memory area, as passed to cw_gen_calloc_pages_internal()
+*/
+static void cw_gen_lock_memory_internal(cw_gen_t * gen, void * addr, size_t size)
+{
+	const size_t rounded = cw_gen_round_to_pages_internal(size);
+	const int n = gen->realtime.n_locked_areas;
+	cw_assert (n < (int) (sizeof (gen->realtime.locked_areas) / sizeof (gen->realtime.locked_areas[0])),
+		   MSG_PREFIX "too many locked areas: %d", n);
+
+	if (0 == mlock(addr, rounded)) {
+		gen->realtime.locked_areas[n].addr = addr;
+		gen->realtime.locked_areas[n].size = rounded;
+		gen->realtime.n_locked_areas++;
+		cw_gen_set_memory_lock_status_internal(gen, 0);
+	} else {
+		cw_gen_set_memory_lock_status_internal(gen, errno);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Unlock memory areas locked with cw_gen_lock_memory_internal()
+
+   @param[in] gen generator
+*/
+static void cw_gen_unlock_memory_internal(cw_gen_t * gen)
+{
+	for (int i = 0; i < gen->realtime.n_locked_areas; i++) {
+		munlock(gen->realtime.locked_areas[i].addr, gen->realtime.locked_areas[i].size);
+	}
+	gen->realtime.n_locked_areas = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Lock sine table in memory
+
+   The function should be called only once, through pthread_once(). The
+   table is static data that is never deallocated, so it is never
+   unlocked either.
+*/
+static void cw_gen_lock_sine_table_internal(void)
+{
+	if (0 != mlock(cw_sine_table, sizeof (cw_sine_table))) {
+		cw_sine_table_lock_errno = errno;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Record result of locking of one of generator's memory areas
+
+   The status reports success only if all areas have been locked.
+
+   @param[in] gen generator
+   @param[in] errno_val zero on success, errno set by mlock() otherwise
+*/
+static void cw_gen_set_memory_lock_status_internal(cw_gen_t * gen, int errno_val)
+{
+	pthread_mutex_lock(&gen->realtime.status_mutex);
+	if (0 == errno_val) {
+		if (0 == gen->realtime.status.memory_lock_errno) {
+			gen->realtime.status.memory_locked = true;
+		}
+	} else {
+		gen->realtime.status.memory_locked = false;
+		gen->realtime.status.memory_lock_errno = errno_val;
+	}
+	pthread_mutex_unlock(&gen->realtime.status_mutex);
+
+	if (0 != errno_val) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "failed to lock generator's memory: %s", strerror(errno_val));
+	}
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_get_realtime_status(cw_gen_t * gen, cw_gen_realtime_status_t * status)
+{
+	if (NULL == gen || NULL == status) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&gen->realtime.status_mutex);
+	*status = gen->realtime.status;
+	pthread_mutex_unlock(&gen->realtime.status_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Fill sine table used by CW_GEN_OSCILLATOR_TABLE engine
+
+   The table is shared by all generators. The function should be called
+   only once, through pthread_once().
+*/
+static void cw_gen_init_sine_table_internal(void)
+{
+	for (unsigned int i = 0; i < CW_SINE_TABLE_SIZE; i++) {
+#ifdef LIBCW_FIXED_POINT
+		cw_sine_table[i] = (int16_t) lrint(sin((2.0 * M_PI * i) / CW_SINE_TABLE_SIZE) * CW_GEN_WAVE_ONE);
+#else
+		cw_sine_table[i] = (float) sin((2.0 * M_PI * i) / CW_SINE_TABLE_SIZE);
+#endif
+	}
+	cw_sine_table[CW_SINE_TABLE_SIZE] = cw_sine_table[0];
+
+	return;
+}
+
+
+
+
+/**
+   @brief Select engine used by generator to calculate sine wave
+
+   The phase of currently generated sine wave is carried over to the newly
+   selected engine, so the switch doesn't introduce a discontinuity in
+   generated wave.
+
+   @param[in] gen generator
+   @param[in] oscillator engine to use
+
+   @exception EINVAL @p oscillator is invalid
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_oscillator_internal(cw_gen_t * gen, cw_gen_oscillator_t oscillator)
+{
+	const double phase_range = 4294967296.0; /* 2^32. */
+
+	switch (oscillator) {
+	case CW_GEN_OSCILLATOR_TABLE:
+		if (gen->oscillator != CW_GEN_OSCILLATOR_TABLE && gen->phase_offset >= 0.0F) {
+			gen->phase_accumulator = (uint32_t) fmod(((double) gen->phase_offset / (2.0 * M_PI)) * phase_range, phase_range);
+		}
+		break;
+	case CW_GEN_OSCILLATOR_SINF:
+		if (gen->oscillator != CW_GEN_OSCILLATOR_SINF) {
+			gen->phase_offset = (float) ((gen->phase_accumulator / phase_range) * 2.0 * M_PI);
+		}
+		break;
+	default:
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	gen->oscillator = oscillator;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+#ifdef LIBCW_UNIT_TESTS
+/**
+   @brief Calculate value of a single sample of sine wave
+
+   This function calculates an amplitude (a value) of a single sample
+   in sine wave PCM data.
+
+   Actually "calculation" is a bit too big word. The function just
+   makes a decision which of precalculated values to return. There are
+   no complicated arithmetical calculations being made each time the
+   function is called, so the execution time should be pretty small.
+
+   The precalcuated values depend on some factors, so the values
+   should be re-calculated each time these factors change. See
+   cw_gen_set_tone_slope() for list of these factors.
+
+   A generator contains some of information needed to get an amplitude of
+   every sample in a sine wave - this is why this function needs @p gen.  If
+   tone's slopes are non-rectangular, the duration of slopes is defined in
+   generator. If a tone is non-silent, the volume is also defined in
+   generator.
+
+   However, decision tree for getting the amplitude also depends on some
+   parameters that are strictly bound to tone, such as what is the shape of
+   slopes for a given tone - this is why we have @p tone.  The @p tone also
+   stores iterator of samples - this is how we know for which sample in a
+   tone to calculate the amplitude.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   Generator doesn't call this function for every sample anymore (see
+   cw_gen_apply_envelope_internal()), but the function is kept as
+   reference implementation for unit tests.
+
+   @param[in] gen generator used to generate a sine wave
+   @param[in] tone tone being generated
+
+   @return value of a sample of sine wave, a non-negative number
+*/
+int cw_gen_calculate_sample_amplitude_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+#if 0   /* Blunt algorithm for calculating amplitude. For debug purposes only. */
+
+	return tone->frequency ? gen->volume_abs : 0;
+
+#else
+
+	if (tone->frequency <= 0) {
+		return 0;
+	}
+
+
+	float amplitude = 0.0F;
+
+	/* Every tone, regardless of slope mode (CW_SLOPE_MODE_*), has
+	   three components. It has rising slope + plateau + falling
+	   slope.
+
+	   There can be four variants of rising and falling slope
+	   length, just as there are four CW_SLOPE_MODE_* values.
+
+	   There can be also tones with zero-length plateau, and there
+	   can be also tones with zero-length slopes. */
+
+	if (tone->sample_iterator < tone->rising_slope_n_samples) {
+		/* Beginning of tone, rising slope. */
+		const int i = tone->sample_iterator;
+#ifdef LIBCW_FIXED_POINT
+		amplitude = (float) CW_GEN_SLOPE_GAIN(gen->tone_slope.amplitudes[i], gen->volume_abs);
+#else
+		amplitude = gen->tone_slope.amplitudes[i] * (float) gen->volume_abs;
+#endif
+		assert (amplitude >= 0);
+
+	} else if (tone->sample_iterator >= tone->rising_slope_n_samples
+		   && tone->sample_iterator < tone->n_samples - tone->falling_slope_n_samples) {
+
+		/* Middle of tone, plateau, constant amplitude. */
+		amplitude = (float) gen->volume_abs;
+		assert (amplitude >= 0);
+
+	} else if (tone->sample_iterator >= tone->n_samples - tone->falling_slope_n_samples) {
+		/* Falling slope. */
+		const cw_sample_iter_t i = tone->n_samples - tone->sample_iterator - 1;
+		assert (i >= 0);
+#ifdef LIBCW_FIXED_POINT
+		amplitude = (float) CW_GEN_SLOPE_GAIN(gen->tone_slope.amplitudes[i], gen->volume_abs);
+#else
+		amplitude = gen->tone_slope.amplitudes[i] * (float) gen->volume_abs;
+#endif
+		assert (amplitude >= 0);
+
+	} else {
+		cw_assert (0, MSG_PREFIX "->sample_iterator out of bounds:\n"
+			   "tone->sample_iterator: %ld\n"
+			   "tone->n_samples: %"PRId64"\n"
+			   "tone->rising_slope_n_samples: %d\n"
+			   "tone->falling_slope_n_samples: %d\n",
+			   tone->sample_iterator,
+			   tone->n_samples,
+			   tone->rising_slope_n_samples,
+			   tone->falling_slope_n_samples);
+	}
+
+	assert (amplitude >= 0.0F);
+	return (int) amplitude;
+#endif
+}
+#endif /* #ifdef LIBCW_UNIT_TESTS */
+
+
+
+
+/**
+   @brief Set parameters describing slopes of tones generated by generator
+
+   Most of variables related to slope of tones is in @p tone, but there are
+   still some variables that are generator-specific, as they are common for
+   all tones.  This function sets two of these generator-specific variables.
+
+   A: If you pass to function conflicting values of @p slope_shape and
+   @p slope_duration, the function will return CW_FAILURE. These
+   conflicting values are rectangular slope shape and larger than zero
+   slope length. You just can't have rectangular slopes that have
+   non-zero length.
+
+   B: If you pass to function '\-1' as value of both @p slope_shape and
+   @p slope_duration, the function won't change any of the related two
+   generator's parameters.
+
+   C1: If you pass to function '\-1' as value of either @p slope_shape or
+   @p slope_duration, the function will attempt to set only this generator's
+   parameter that is different than '\-1'.
+
+   C2: However, if selected slope shape is rectangular, function will
+   set generator's slope length to zero, even if value of \p
+   slope_duration is '\-1'.
+
+   D: Notice that the function allows non-rectangular slope shape with
+   zero length of the slopes. The slopes will be non-rectangular, but
+   just unusually short.
+
+   @internal TODO: Seriously, these rules (A-D) for setting a slope are too complicated. Simplify them. Accept only a small subset of valid/sane values. Perhaps split the function into two separate functions: for setting slope shape and slope duration. @endinternal
+
+   The function should be called every time one of following
+   parameters change:
+
+   @li shape of slope,
+   @li duration of slope,
+   @li generator's sample rate,
+   @li generator's volume.
+
+   There are four supported shapes of slopes:
+   @li linear (the only one supported by libcw until version 4.1.1),
+   @li raised cosine (supposedly the most desired shape),
+   @li sine,
+   @li rectangular.
+
+   Use CW_TONE_SLOPE_SHAPE_* symbolic names as values of @p slope_shape.
+
+   FIXME: first argument of this public function is gen, but no
+   function provides access to generator variable.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   @param[in] gen generator for which to set tone slope parameters
+   @param[in] slope_shape shape of slope: linear, raised cosine, sine, rectangular
+   @param[in] slope_duration duration of slope [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+int cw_generator_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+{
+	return cw_gen_set_tone_slope(gen, slope_shape, slope_duration);
+}
+
+
+
+
+/**
+   See comment for cw_generator_set_tone_slope()
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+*/
+cw_ret_t cw_gen_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+{
+	assert (gen);
+
+	/* Handle conflicting values of arguments. */
+	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR
+	    && slope_duration > 0) {
+
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "requested a rectangular slope shape, but also requested slope duration > 0");
+
+		return CW_FAILURE;
+	}
+
+	/* Assign new values from arguments. */
+	if (slope_shape != -1) {
+		gen->tone_slope.shape = slope_shape;
+	}
+	if (slope_duration != -1) {
+		gen->tone_slope.duration = slope_duration;
+	}
+
+
+	/* Override of slope duration. */
+	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
+		/* TODO: what's going on here? Why do we set this to zero? */
+		gen->tone_slope.duration = 0;
+	}
+
+
+	int slope_n_samples = ((gen->sample_rate / 100) * gen->tone_slope.duration) / 10000;
+	cw_assert (slope_n_samples >= 0, MSG_PREFIX "negative slope_n_samples: %d", slope_n_samples);
+
+
+	/* Get another shared table of slope amplitudes only when shape or
+	   size of slope has changed. Volume of tones is applied separately
+	   and doesn't affect the table. */
+	const cw_gen_slope_table_t * current = gen->tone_slope.table;
+	if (gen->tone_slope.n_amplitudes != slope_n_samples
+	    || (NULL != current && current->shape != gen->tone_slope.shape)) {
+
+		/* Zero-duration slopes don't refer to ->amplitudes[],
+		   so they don't need any table. */
+		cw_gen_slope_table_t * table = NULL;
+		if (slope_n_samples > 0) {
+			table = cw_gen_slope_table_acquire_internal(gen->tone_slope.shape, slope_n_samples);
+			if (NULL == table) {
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to get table of slope amplitudes");
+				return CW_FAILURE;
+			}
+			if (gen->realtime.lock_memory) {
+				cw_gen_set_memory_lock_status_internal(gen, cw_gen_slope_table_lock_internal(table));
+			}
+		}
+
+		cw_gen_slope_table_release_internal(gen->tone_slope.table);
+		gen->tone_slope.table = table;
+		gen->tone_slope.amplitudes = table ? table->amplitudes : NULL;
+		gen->tone_slope.n_amplitudes = slope_n_samples;
+	}
+
+	cw_gen_pcm_cache_invalidate_internal(gen);
+	cw_gen_char_tones_invalidate_internal(gen);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get shared table of slope amplitudes with given shape and size
+
+   The table is taken from process-wide cache of tables. If there is no
+   such table in the cache yet, it is calculated and added to the cache.
+
+   Caller becomes one of users of the table, and must give the table back
+   with cw_gen_slope_table_release_internal().
+
+   @param[in] shape shape of slope
+   @param[in] n_amplitudes count of samples in slope, larger than zero
+
+   @return table on success
+   @return NULL on failure to allocate the table
+*/
+static cw_gen_slope_table_t * cw_gen_slope_table_acquire_internal(int shape, int n_amplitudes)
+{
+	pthread_mutex_lock(&cw_gen_slope_tables_mutex);
+
+	cw_gen_slope_table_t * table = cw_gen_slope_tables;
+	while (NULL != table && (table->shape != shape || table->n_amplitudes != n_amplitudes)) {
+		table = table->next;
+	}
+
+	if (NULL == table) {
+		/* Page-aligned, so that the table can be locked and
+		   unlocked without affecting other data. */
+		table = cw_gen_calloc_pages_internal(sizeof (cw_gen_slope_table_t) + sizeof (cw_gen_amplitude_t) * (size_t) n_amplitudes);
+		if (NULL != table) {
+			table->shape = shape;
+			table->n_amplitudes = n_amplitudes;
+			table->n_users = 0;
+			table->is_locked = false;
+			cw_gen_slope_table_calculate_internal(table);
+
+			table->next = cw_gen_slope_tables;
+			cw_gen_slope_tables = table;
+		}
+	}
+
+	if (NULL != table) {
+		table->n_users++;
+	}
+
+	pthread_mutex_unlock(&cw_gen_slope_tables_mutex);
+
+	return table;
+}
+
+
+
+
+/**
+   @brief Give back a table taken with cw_gen_slope_table_acquire_internal()
+
+   The table is removed from the cache and deallocated when its last user
+   gives it back.
+
+   @param[in] table table to give back, may be NULL
+*/
+static void cw_gen_slope_table_release_internal(cw_gen_slope_table_t * table)
+{
+	if (NULL == table) {
+		return;
+	}
+
+	pthread_mutex_lock(&cw_gen_slope_tables_mutex);
+
+	table->n_users--;
+	if (0 == table->n_users) {
+		cw_gen_slope_table_t ** link = &cw_gen_slope_tables;
+		while (*link != table) {
+			link = &(*link)->next;
+		}
+		*link = table->next;
+		if (table->is_locked) {
+			munlock(table, cw_gen_round_to_pages_internal(sizeof (cw_gen_slope_table_t) + sizeof (cw_gen_amplitude_t) * (size_t) table->n_amplitudes));
+		}
+		free(table);
+	}
+
+	pthread_mutex_unlock(&cw_gen_slope_tables_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Lock table of slope amplitudes in memory
+
+   The table is shared by generators, so it is locked once, and is
+   unlocked when it is deallocated by
+   cw_gen_slope_table_release_internal().
+
+   @param[in] table table taken with cw_gen_slope_table_acquire_internal()
+
+   @return zero on success
+   @return errno set by mlock() on failure
+*/
+static int cw_gen_slope_table_lock_internal(cw_gen_slope_table_t * table)
+{
+	int errno_val = 0;
+
+	pthread_mutex_lock(&cw_gen_slope_tables_mutex);
+	if (!table->is_locked) {
+		if (0 == mlock(table, cw_gen_round_to_pages_internal(sizeof (cw_gen_slope_table_t) + sizeof (cw_gen_amplitude_t) * (size_t) table->n_amplitudes))) {
+			table->is_locked = true;
+		} else {
+			errno_val = errno;
+		}
+	}
+	pthread_mutex_unlock(&cw_gen_slope_tables_mutex);
+
+	return errno_val;
+}
+
+
+
+
+/**
+   @brief Calculate amplitudes of PCM samples that form tone's slopes
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   In fixed-point build the amplitudes are calculated with integer
+   arithmetic: sine and raised cosine shapes are taken from the sine
+   table of CW_GEN_OSCILLATOR_TABLE engine (raised cosine
+   (1 - cos(x)) / 2 is equal to sin(x / 2) squared).
+
+   @param[in] table table with shape and count of amplitudes already set
+*/
+#ifdef LIBCW_FIXED_POINT
+static void cw_gen_slope_table_calculate_internal(cw_gen_slope_table_t * table)
+{
+	/* Quarter of period of sine wave in units of phase. */
+	const uint64_t quarter = UINT64_C(1) << 30U;
+	const int64_t n = table->n_amplitudes;
+
+	for (int i = 0; i < table->n_amplitudes; i++) {
+
+		if (table->shape == CW_TONE_SLOPE_SHAPE_LINEAR) {
+			table->amplitudes[i] = (cw_gen_amplitude_t) (((int64_t) i * CW_GEN_AMPLITUDE_ONE) / n);
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_SINE) {
+			const uint32_t phase = (uint32_t) ((quarter * (uint64_t) i) / (uint64_t) n);
+			table->amplitudes[i] = (cw_gen_amplitude_t) cw_gen_sine_q15_internal(phase);
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_RAISED_COSINE) {
+			const uint32_t phase = (uint32_t) ((quarter * (uint64_t) i) / (uint64_t) n);
+			const int32_t sine = cw_gen_sine_q15_internal(phase);
+			table->amplitudes[i] = (cw_gen_amplitude_t) ((sine * sine) >> 15);
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
+			/* CW_TONE_SLOPE_SHAPE_RECTANGULAR is covered
+			   before entering this "for" loop. */
+			cw_assert (0, MSG_PREFIX "we shouldn't be here, calculating rectangular slopes");
+
+		} else {
+			cw_assert (0, MSG_PREFIX "unsupported slope shape %d", table->shape);
+		}
+	}
+
+	return;
+}
+#else
+static void cw_gen_slope_table_calculate_internal(cw_gen_slope_table_t * table)
+{
+	/* The values in amplitudes[] change from zero to one (at
+	   least for any sane slope shape), so naturally they can be
+	   used in forming rising slope. However they can be used in
+	   forming falling slope as well - just iterate the table from
+	   end to beginning. */
+	for (int i = 0; i < table->n_amplitudes; i++) {
+
+		if (table->shape == CW_TONE_SLOPE_SHAPE_LINEAR) {
+			table->amplitudes[i] = (float) i / (float) table->n_amplitudes;
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_SINE) {
+			const float radian = (float) i * (CW_PI / 2.0F) / (float) table->n_amplitudes;
+			table->amplitudes[i] = sinf(radian);
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_RAISED_COSINE) {
+			const float radian = (float) i * CW_PI / (float) table->n_amplitudes;
+			table->amplitudes[i] = (1 - ((1 + cosf(radian)) / 2));
+
+		} else if (table->shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
+			/* CW_TONE_SLOPE_SHAPE_RECTANGULAR is covered
+			   before entering this "for" loop. */
+			/* TODO: to avoid treating
+			   CW_TONE_SLOPE_SHAPE_RECTANGULAR as special case,
+			   add the calculation here. */
+			cw_assert (0, MSG_PREFIX "we shouldn't be here, calculating rectangular slopes");
+
+		} else {
+			cw_assert (0, MSG_PREFIX "unsupported slope shape %d", table->shape);
+		}
+	}
+
+	return;
+}
+#endif
+
+
+
+
+/**
+   @brief Write tone to soundcard
+
+   @internal
+   @reviewed 2020-10-13
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone dequeued from queue (if dequeueing was successful); must always be non-NULL
+
+   @return 0
+*/
+int cw_gen_write_to_soundcard_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	cw_assert (NULL != tone, MSG_PREFIX "'tone' argument should always be non-NULL");
+
+	/* Total number of samples to write in a loop below. */
+	int64_t samples_to_write = tone->n_samples;
+
+	/* Shape of envelope doesn't change during a tone. */
+	const cw_gen_kernel_t kernel = cw_gen_select_kernel_internal(tone);
+
+#define LIBCW_WRITE_LOOP_DEBUG_LEVEL 0
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+	/* Debug code. */
+	int n_loops = 0;
+	const float n_loops_expected = floorf(1.0 * samples_to_write / gen->buffer_n_samples); /* In reality number of loops executed is sometimes n_loops_expected, but mostly it's n_loops_expected+1. */
+	fprintf(stderr, MSG_PREFIX "entering loop (~%.1f iterations expected), tone->frequency = %d, buffer->n_samples = %d, samples_to_write = %"PRId64"\n",
+		(double) n_loops_expected, tone->frequency, gen->buffer_n_samples, samples_to_write);
+#endif
+
+	/* The tone starts in current buffer. Remember it for latency
+	   statistics, unless an earlier tone also starts in the buffer. */
+	if (0 != tone->dequeue_time && 0 == gen->latency.buffer_dequeue_time) {
+		gen->latency.buffer_enqueue_time = tone->enqueue_time;
+		gen->latency.buffer_dequeue_time = tone->dequeue_time;
+	}
+
+	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "%lld samples, %d us, %d Hz", tone->n_samples, tone->duration, gen->frequency);
+	while (samples_to_write > 0) {
+
+		if (0 == gen->buffer_sub_start) {
+			/* Beginning of new buffer. */
+			gen->buffer_target = NULL;
+			if (NULL != gen->get_buffer_from_sound_device && NULL == gen->fanout) {
+				/* With taps the samples must be calculated
+				   in gen->buffer, which is shared with the
+				   taps. */
+				gen->buffer_target = gen->get_buffer_from_sound_device(gen);
+			}
+		}
+
+		int64_t free_space = gen->buffer_n_samples - gen->buffer_sub_start;
+		if (gen->low_latency_keying && tone->is_forever) {
+			/* Straight key is held in one state. Don't fill
+			   the rest of the buffer with more of the same:
+			   write the buffer at next sub-block boundary, so
+			   that tones enqueued on next key event start
+			   right after the sub-block. */
+			const int64_t to_boundary = CW_GEN_KEYING_SUB_BLOCK_N_SAMPLES - (gen->buffer_sub_start % CW_GEN_KEYING_SUB_BLOCK_N_SAMPLES);
+			if (to_boundary < free_space) {
+				free_space = to_boundary;
+			}
+		}
+		/* Index of last sample of buffer that will be written to sound system. */
+		const int buffer_last = gen->buffer_sub_start + (int) free_space - 1;
+
+		if (samples_to_write > free_space) {
+			/* There will be some tone samples left for
+			   next iteration of this loop.  But buffer in
+			   this iteration will be ready to be pushed
+			   to sound sink. */
+			gen->buffer_sub_stop = buffer_last;
+		} else if (samples_to_write == free_space) {
+			/* How nice, end of tone samples aligns with
+			   end of buffer (last sample of tone will be
+			   placed in last cell of buffer).
+
+			   But the result is the same - a full buffer
+			   ready to be pushed to sound sink. */
+			gen->buffer_sub_stop = buffer_last;
+		} else {
+			/* There will be too few samples to fill a
+			   buffer. We can't send an under-filled buffer to
+			   sound sink. We will have to get more
+			   samples to fill the buffer completely. */
+			gen->buffer_sub_stop = gen->buffer_sub_start + samples_to_write - 1;
+		}
+
+		/* How many samples of sound buffer's subarea will be
+		   calculated in a given cycle of "calculate sine
+		   wave" code, i.e. in current iteration of the 'while' loop? */
+		const int buffer_sub_n_samples = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+		/* Debug code. */
+		++n_loops;
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 1
+		/* Debug code. */
+		fprintf(stderr, MSG_PREFIX "       loop #%d, buffer_sub_n_samples = %d\n", n_loops, buffer_sub_n_samples);
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+			      MSG_PREFIX
+			      "sub start: %d, sub stop: %d, sub size: %d / %"PRIu64,
+			      gen->buffer_sub_start, gen->buffer_sub_stop, buffer_sub_n_samples, samples_to_write);
+#endif
+#endif
+
+
+		const int calculated = cw_gen_calculate_samples_internal(gen, tone, kernel);
+		cw_assert (calculated == buffer_sub_n_samples, MSG_PREFIX "calculated wrong number of samples: %d != %d", calculated, buffer_sub_n_samples);
+
+		if (gen->buffer_sub_stop == buffer_last) {
+
+			/* We have a buffer full of samples. The
+			   buffer is ready to be pushed to sound
+			   sink. */
+			gen->buffer_write_n_samples = buffer_last + 1;
+			if (NULL != gen->frames) {
+				/* Samples are never calculated in memory of
+				   sound device when there are frames. */
+				cw_gen_route_samples_internal(gen->buffer, gen->buffer_write_n_samples,
+							      gen->sound_channel_volumes, gen->n_sound_channels, gen->sample_format, gen->frames);
+			}
+			cw_gen_latency_add_buffer_internal(gen);
+			const int64_t write_begin = cw_clock_now_internal();
+			CW_TRACE(CW_TRACE_EVENT_WRITE_BEGIN, gen->buffer_write_n_samples);
+			const cw_ret_t write_ret = gen->write_buffer_to_sound_device(gen);
+			CW_TRACE(CW_TRACE_EVENT_WRITE_END, write_ret);
+			cw_gen_stats_add_write_internal(gen, write_ret, gen->buffer_write_n_samples, cw_clock_now_internal() - write_begin);
+			if (CW_SUCCESS == write_ret) {
+				cw_gen_sound_clock_set_anchor_internal(gen);
+			}
+#if CW_DEV_RAW_SINK
+			cw_dev_debug_raw_sink_write_internal(gen);
+#endif
+			if (NULL != gen->fanout && gen->do_dequeue_and_generate) {
+				cw_tap_publish_internal(gen);
+			}
+			gen->buffer_sub_start = 0;
+			gen->buffer_sub_stop = 0;
+			gen->buffer_target = NULL;
+		} else {
+			/* #needmoresamples
+			   There is still some space left in the
+			   buffer, go fetch new tone from tone
+			   queue. */
+
+			gen->buffer_sub_start = gen->buffer_sub_stop + 1;
+
+			cw_assert (gen->buffer_sub_start <= gen->buffer_n_samples - 1,
+				   MSG_PREFIX "sub start out of range: sub start = %d, buffer n samples = %d",
+				   gen->buffer_sub_start, gen->buffer_n_samples);
+		}
+
+		samples_to_write -= buffer_sub_n_samples;
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+		/* Debug code. */
+		if (samples_to_write < 0) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "samples left = %"PRId64, samples_to_write);
+		}
+#endif
+
+	} /* while (samples_to_write > 0) { */
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+	/* Debug code. */
+	fprintf(stderr, MSG_PREFIX "left loop, %d iterations executed from %.1f iterations planned, samples left = %d\n",
+		n_loops, (double) n_loops_expected, (int) samples_to_write);
+#endif
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Get samples that sound system should write to sound device
+
+   @param[in] gen generator
+
+   @return interleaved samples of all channels of sound device in format of the device, if generator has them
+   @return generator's buffer otherwise
+*/
+const void * cw_gen_frames_internal(cw_gen_t * gen)
+{
+	return NULL != gen->frames ? gen->frames : gen->buffer;
+}
+
+
+
+
+/**
+   @brief Route mono samples to interleaved channels of sound device
+
+   Sample of each channel is the mono sample scaled by volume of the
+   channel, written in @p format. Volume of 100% copies the sample
+   exactly; in other formats the 16-bit sample is scaled to full range
+   of the format.
+
+   @param[in] samples mono samples
+   @param[in] n_samples count of samples in @p samples
+   @param[in] volumes volumes of channels [%]
+   @param[in] n_channels count of channels (and of items in @p volumes)
+   @param[in] format format of samples in @p frames
+   @param[out] frames interleaved samples, @p n_samples * @p n_channels items
+*/
+void cw_gen_route_samples_internal(const cw_sample_t * samples, int n_samples, const int * volumes, int n_channels, cw_sample_format_t format, void * frames)
+{
+	for (int c = 0; c < n_channels; c++) {
+		/* Q15 fixed point, 32768 is 100%. */
+		const int32_t gain = (volumes[c] * 32768) / CW_VOLUME_MAX;
+		switch (format) {
+		case CW_SAMPLE_FORMAT_S32: {
+			int32_t * out = (int32_t *) frames + c;
+			for (int i = 0; i < n_samples; i++) {
+				out[i * n_channels] = ((samples[i] * gain) >> 15) * 65536;
+			}
+			break;
+		}
+		case CW_SAMPLE_FORMAT_FLOAT: {
+			float * out = (float *) frames + c;
+			for (int i = 0; i < n_samples; i++) {
+				out[i * n_channels] = (float) (samples[i] * gain) * (1.0F / (32768.0F * 32768.0F));
+			}
+			break;
+		}
+		case CW_SAMPLE_FORMAT_S16:
+		default: {
+			cw_sample_t * out = (cw_sample_t *) frames + c;
+			for (int i = 0; i < n_samples; i++) {
+				out[i * n_channels] = (cw_sample_t) ((samples[i] * gain) >> 15);
+			}
+			break;
+		}
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Get size of one sample in given format
+
+   @param[in] format format of sample
+
+   @return size of sample in bytes
+   @return zero if @p format is invalid
+*/
+size_t cw_sample_format_size_internal(cw_sample_format_t format)
+{
+	switch (format) {
+	case CW_SAMPLE_FORMAT_S16:
+		return sizeof (int16_t);
+	case CW_SAMPLE_FORMAT_S32:
+		return sizeof (int32_t);
+	case CW_SAMPLE_FORMAT_FLOAT:
+		return sizeof (float);
+	default:
+		return 0;
+	}
+}
+
+
+
+
+/**
+   @brief Construct empty tone with correct/needed values of samples count
+
+   The function sets values tone->..._n_samples fields of empty @p
+   tone based on information from @p gen (i.e. looking on how many
+   samples of silence need to be "created").  The sample count values
+   are set in a way that allows filling remainder of generator's
+   buffer with silence.
+
+   After this point tone duration should not be used - it's the samples count that is correct.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples count.
+*/
+void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	/* All tones have been already dequeued from tone queue.
+
+	   @p tone does not represent a valid tone to generate. At
+	   first sight there is no need to write anything to
+	   soundcard. But...
+
+	   It may happen that during previous call to the function
+	   there were too few samples in a tone to completely fill a
+	   buffer (see #needmoresamples tag below).
+
+	   We need to fill the buffer until it is full and ready to be
+	   sent to sound sink.
+
+	   Since there are no new tones for which we could generate
+	   samples, we need to generate silence samples.
+
+	   Padding the buffer with silence seems to be a good idea (it
+	   will work regardless of value (Mark/Space) of last valid
+	   tone). We just need to know how many samples of the silence
+	   to produce.
+
+	   Number of these samples will be stored in
+	   samples_to_write. */
+
+	/* We don't have a valid tone, so let's construct a fake one
+	   for purposes of padding. */
+
+	/* Required length of padding space is from end of last buffer
+	   subarea to end of buffer. */
+	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);;
+
+	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
+	tone->frequency = 0;   /* This fake tone is a piece of silence. */
+
+	/* The silence tone used for padding doesn't require any
+	   slopes. A slope falling to silence has been already
+	   provided by last non-fake and non-silent tone. */
+	tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
+	tone->rising_slope_n_samples = 0;
+	tone->falling_slope_n_samples = 0;
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+	//fprintf(stderr, "++++ count of samples in empty tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate tone suitable for silencing a generator
+
+   Calculate a @p tone variable that, when passed to generator's write()
+   function, will silence a generator.
+
+   @internal
+   @reviewed 2020-10-13
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples
+*/
+void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	/* Make sure that we fill a buffer to the end (i.e. calculate as many
+	   samples as there are from current position in the buffer to the
+	   end of the buffer). Otherwise a buffer underrun may occur. */
+	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);
+
+	/* Also make sure that a tone is long enough for it to be heard
+	   (otherwise it may be perceived as click). */
+	tone->n_samples += (5 * gen->buffer_n_samples);
+
+	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
+
+	/* Length of a single slope. */
+	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
+	slope_n_samples *= gen->tone_slope.duration;
+	slope_n_samples /= 10000;
+
+	switch (tone->slope_mode) {
+	case CW_SLOPE_MODE_NO_SLOPES:
+	case CW_SLOPE_MODE_RISING_SLOPE:
+		/* Previous tone has ended with full level. Let the silencing
+		   tone fall from the full level to zero. */
+		tone->slope_mode = CW_SLOPE_MODE_FALLING_SLOPE;
+		break;
+	case CW_SLOPE_MODE_FALLING_SLOPE:
+	case CW_SLOPE_MODE_STANDARD_SLOPES:
+		/* Level of previous slope has already fallen to zero. Keep
+		   the level at zero. */
+	default:
+		tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
+		tone->frequency = 0;
+		break;
+	}
+	tone->rising_slope_n_samples = 0;
+	tone->falling_slope_n_samples = slope_n_samples;
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+	//fprintf(stderr, "++++ count of samples in silencing tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Recalculate non-empty tone parameters from microseconds into samples
+
+   The function sets tone->..._n_samples fields of non-empty @p tone
+   based on other information from @p tone and from @p gen.
+
+   After this point tone duration should not be used - it's the samples count that is correct.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples count.
+*/
+void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	/* 100 * 10000 = 1.000.000 usecs per second. */
+	tone->n_samples = gen->sample_rate / 100;
+	tone->n_samples *= tone->duration;
+	tone->n_samples /= 10000;
+
+	//fprintf(stderr, MSG_PREFIX "length of regular tone = %d [samples]\n", tone->n_samples);
+
+	/* Length of a single slope (rising or falling). */
+	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
+	slope_n_samples *= gen->tone_slope.duration;
+	slope_n_samples /= 10000;
+
+	if (tone->slope_mode == CW_SLOPE_MODE_RISING_SLOPE) {
+		tone->rising_slope_n_samples = slope_n_samples;
+		tone->falling_slope_n_samples = 0;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_FALLING_SLOPE) {
+		tone->rising_slope_n_samples = 0;
+		tone->falling_slope_n_samples = slope_n_samples;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES) {
+		tone->rising_slope_n_samples = slope_n_samples;
+		tone->falling_slope_n_samples = slope_n_samples;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_NO_SLOPES) {
+		tone->rising_slope_n_samples = 0;
+		tone->falling_slope_n_samples = 0;
+
+	} else {
+		cw_assert (0, MSG_PREFIX "unknown tone slope mode %d", tone->slope_mode);
+	}
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+#if 0
+	/* Debug code. */
+	if (tone->is_forever) {
+		fprintf(stderr, "++++ count of samples in forever tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	} else {
+		fprintf(stderr, "++++ count of samples in regular tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	}
+#endif
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if count of samples in a tone has already been calculated
+
+   Tones taken from table of compiled characters have their count of
+   samples and slope samples calculated at the moment of compilation. The
+   function checks that the values are present and that they still match
+   generator's current slope (the slope may have been changed after the tone
+   was enqueued).
+
+   @param[in] gen generator
+   @param[in] tone tone to check
+
+   @return true if values in the tone can be used without recalculation
+   @return false otherwise
+*/
+static bool cw_gen_tone_samples_size_is_valid_internal(const cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (tone->n_samples <= 0 || 0 != tone->sample_iterator) {
+		return false;
+	}
+
+	const cw_sample_iter_t slope_n_samples = gen->tone_slope.n_amplitudes;
+	switch (tone->slope_mode) {
+	case CW_SLOPE_MODE_STANDARD_SLOPES:
+		return tone->rising_slope_n_samples == slope_n_samples && tone->falling_slope_n_samples == slope_n_samples;
+	case CW_SLOPE_MODE_NO_SLOPES:
+		return 0 == tone->rising_slope_n_samples && 0 == tone->falling_slope_n_samples;
+	case CW_SLOPE_MODE_RISING_SLOPE:
+		return tone->rising_slope_n_samples == slope_n_samples && 0 == tone->falling_slope_n_samples;
+	case CW_SLOPE_MODE_FALLING_SLOPE:
+		return 0 == tone->rising_slope_n_samples && tone->falling_slope_n_samples == slope_n_samples;
+	default:
+		return false;
+	}
+}
+
+
+
+
+cw_ret_t cw_gen_set_speed(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_SPEED_MIN || new_value > CW_SPEED_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (new_value != gen->send_speed) {
+		gen->send_speed = new_value;
+
+		/* Changes of send speed require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_frequency(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_FREQUENCY_MIN || new_value > CW_FREQUENCY_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	} else {
+		if (new_value != gen->frequency) {
+			gen->frequency = new_value;
+			/* Compiled characters use old frequency. */
+			cw_gen_char_tones_invalidate_internal(gen);
+			/* Marks that are already in tone queue will use
+			   the new frequency. */
+			cw_gen_timing_publish_internal(gen);
+		}
+		return CW_SUCCESS;
+	}
+}
+
+
+
+
+cw_ret_t cw_gen_set_volume(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_VOLUME_MIN || new_value > CW_VOLUME_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	} else {
+		gen->volume_percent = new_value;
+		gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+
+		/* Nothing to recalculate: volume is applied to shared
+		   slope table as separate gain, and entries of cache of
+		   pre-rendered tones are keyed by volume. */
+
+		return CW_SUCCESS;
+	}
+}
+
+
+
+
+cw_ret_t cw_gen_set_sound_channel_volumes(cw_gen_t * gen, const int * volumes, int n_volumes)
+{
+	if (NULL == gen || NULL == volumes || n_volumes < 1 || n_volumes > CW_SOUND_CHANNELS_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	for (int i = 0; i < n_volumes; i++) {
+		if (volumes[i] < CW_VOLUME_MIN || volumes[i] > CW_VOLUME_MAX) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+	}
+
+	/* Generator's thread reads the volumes when routing each
+	   buffer. A buffer routed during the update may have old
+	   volumes in some channels and new in others, which is not
+	   audible. */
+	for (int i = 0; i < CW_SOUND_CHANNELS_MAX; i++) {
+		gen->sound_channel_volumes[i] = i < n_volumes ? volumes[i] : 0;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_gap(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_GAP_MIN || new_value > CW_GAP_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (new_value != gen->gap) {
+		gen->gap = new_value;
+		/* Changes of gap require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_weighting(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_WEIGHTING_MIN || new_value > CW_WEIGHTING_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (new_value != gen->weighting) {
+		gen->weighting = new_value;
+
+		/* Changes of weighting require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_gen_get_speed(const cw_gen_t * gen)
+{
+	return gen->send_speed;
+}
+
+
+
+
+int cw_gen_get_frequency(const cw_gen_t * gen)
+{
+	return gen->frequency;
+}
+
+
+
+
+int cw_gen_get_volume(const cw_gen_t * gen)
+{
+	return gen->volume_percent;
+}
+
+
+
+
+int cw_gen_get_sound_channels(const cw_gen_t * gen)
+{
+	return gen->n_sound_channels;
+}
+
+
+
+
+cw_ret_t cw_gen_set_impairments(cw_gen_t * gen, const cw_impairments_t * impairments)
+{
+	if (NULL == gen || NULL == impairments) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "NULL argument");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_impair_set_internal(&gen->impair, impairments);
+}
+
+
+
+
+cw_ret_t cw_gen_get_impairments(cw_gen_t * gen, cw_impairments_t * impairments)
+{
+	if (NULL == gen || NULL == impairments) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_impair_get_internal(&gen->impair, impairments);
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_gen_get_gap(const cw_gen_t * gen)
+{
+	return gen->gap;
+}
+
+
+
+
+int cw_gen_get_weighting(const cw_gen_t * gen)
+{
+	return gen->weighting;
+}
+
+
+
+
+/**
+   @brief Get timing parameters for sending
+
+   Return the low-level timing parameters calculated from the speed,
+   gap, tolerance, and weighting set.  Units of returned parameter
+   values are microseconds.
+
+   Use NULL for the pointer argument to any parameter value not required.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen
+   @param[out] dot_duration
+   @param[out] dash_duration
+   @param[out] ims_duration duration of inter-mark-space
+   @param[out] ics_duration duration of inter-character-space
+   @param[out] iws_duration duration of inter-word-space
+   @param[out] additional_space_duration
+   @param[out] adjustment_space_duration
+*/
+void cw_gen_get_timing_parameters_internal(cw_gen_t * gen,
+					   int * dot_duration,
+					   int * dash_duration,
+					   int * ims_duration,
+					   int * ics_duration,
+					   int * iws_duration,
+					   int * additional_space_duration,
+					   int * adjustment_space_duration)
+{
+	cw_gen_sync_parameters_internal(gen);
+
+	if (dot_duration)   { *dot_duration = gen->dot_duration; }
+	if (dash_duration)  { *dash_duration = gen->dash_duration; }
+
+	if (ims_duration)   { *ims_duration = gen->ims_duration; }
+	if (ics_duration)   { *ics_duration = gen->ics_duration; }
+	if (iws_duration)   { *iws_duration = gen->iws_duration; }
+
+	if (additional_space_duration)    { *additional_space_duration = gen->additional_space_duration; }
+	if (adjustment_space_duration)    { *adjustment_space_duration = gen->adjustment_space_duration; }
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enqueue a mark (Dot or Dash)
+
+   Low level primitive to enqueue a tone for mark of the given type, followed
+   by the standard inter-mark-space.
+
+   Function sets errno to EINVAL if an argument is invalid, and
+   returns CW_FAILURE.
+
+   Function also returns CW_FAILURE if adding the element to queue of
+   tones failed.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator to be used to enqueue a mark and inter-mark-space
+   @param[in] mark mark to send: Dot (CW_DOT_REPRESENTATION) or Dash (CW_DASH_REPRESENTATION)
+   @param[in] is_first is it a first mark in a character?
+
+   @return CW_FAILURE on failure
+   @return CW_SUCCESS on success
+*/
+cw_ret_t cw_gen_enqueue_mark_internal(cw_gen_t * gen, char mark, bool is_first)
+{
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_mark_internal(gen, &batch, mark, is_first)) {
+		return CW_FAILURE;
+	}
+	return cw_gen_batch_flush_internal(gen, &batch);
+}
+
+
+
+
+/**
+   @brief Add tones of a mark (Dot or Dash) and of inter-mark-space to batch
+
+   @exception EINVAL @p mark is invalid
+
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+   @param[in] mark mark to add: Dot (CW_DOT_REPRESENTATION) or Dash (CW_DASH_REPRESENTATION)
+   @param[in] is_first is it a first mark in a character?
+
+   @return CW_FAILURE on failure
+   @return CW_SUCCESS on success
+*/
+static cw_ret_t cw_gen_batch_add_mark_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, char mark, bool is_first)
+{
+	/* Synchronize low-level timings if required. */
+	cw_gen_sync_parameters_internal(gen);
+	/* TODO: do we need to synchronize here receiver as well? */
+
+	/* Send either a dot or a dash mark, depending on representation. */
+	cw_tone_t tone;
+	if (mark == CW_DOT_REPRESENTATION) {
+		CW_TONE_INIT(&tone, gen->frequency, gen->dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_DOT, 1);
+	} else if (mark == CW_DASH_REPRESENTATION) {
+		CW_TONE_INIT(&tone, gen->frequency, gen->dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_DASH, 1);
+	} else {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	tone.is_first = is_first;
+	if (CW_SUCCESS != cw_gen_batch_add_tone_internal(gen, batch, &tone)) {
+		return CW_FAILURE;
+	}
+
+	/* Send the inter-mark-space. */
+	CW_TONE_INIT(&tone, 0, gen->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
+	tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_IMS, 1);
+	return cw_gen_batch_add_tone_internal(gen, batch, &tone);
+}
+
+
+
+
+/**
+   @brief Enqueue 2-Unit inter-character-space
+
+   The function enqueues space of length 2 Units. The function is intended to
+   be used after inter-mark-space has already been enqueued.
+
+   In such situation standard inter-mark-space (one Unit) and two
+   Units enqueued by this function form a full standard
+   inter-character-space (three Units).
+
+   Inter-character adjustment space is added at the end.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator in which to enqueue the space
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_2u_ics_internal(cw_gen_t * gen)
 {
-	if (new_value < CW_SPEED_MIN || new_value > CW_SPEED_MAX) {
-		errno = EINVAL;
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_2u_ics_internal(gen, &batch)) {
 		return CW_FAILURE;
 	}
+	return cw_gen_batch_flush_internal(gen, &batch);
+}
 
-	if (new_value != gen->send_speed) {
-		gen->send_speed = new_value;
 
-		/* Changes of send speed require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
-	}
 
-	return CW_SUCCESS;
-}
 
+/**
+   @brief Add 2-Unit inter-character-space to batch
 
+   See cw_gen_enqueue_2u_ics_internal() for more information.
 
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
 
-cw_ret_t cw_gen_set_frequency(cw_gen_t * gen, int new_value)
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_batch_add_2u_ics_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch)
 {
-	if (new_value < CW_FREQUENCY_MIN || new_value > CW_FREQUENCY_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	} else {
-		gen->frequency = new_value;
-		return CW_SUCCESS;
-	}
+	/* Synchronize low-level timing parameters. */
+	cw_gen_sync_parameters_internal(gen);
+
+	/* Enqueue standard inter-character-space, plus any additional inter-character gap. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, gen->ics_duration + gen->additional_space_duration, CW_SLOPE_MODE_NO_SLOPES);
+	tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_ICS, 1);
+	return cw_gen_batch_add_tone_internal(gen, batch, &tone);
 }
 
 
 
 
-cw_ret_t cw_gen_set_volume(cw_gen_t * gen, int new_value)
-{
-	if (new_value < CW_VOLUME_MIN || new_value > CW_VOLUME_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	} else {
-		gen->volume_percent = new_value;
-		gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+/**
+   @brief Enqueue space character (' ') in generator, to be sent using Morse code
 
-		cw_gen_set_tone_slope(gen, -1, -1);
+   The function should be used to enqueue a regular ' ' character.
 
-		return CW_SUCCESS;
-	}
-}
+   The function enqueues space of length 5 Units. The function is intended to
+   be used after inter-mark-space and inter-character-space have already been
+   enqueued.
+
+   In such situation standard inter-mark-space (one Unit) and
+   inter-character-space (two Units) and regular space (five units) form a
+   full standard inter-word-space (seven Units).
+
+   TODO: review this description again. This function alone doesn't send
+   space character, it sends a part of what can be seen as inter-word-space.
 
+   Inter-word adjustment space is added at the end.
 
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
 
+   @param[in] gen generator in which to enqueue the space
 
-cw_ret_t cw_gen_set_gap(cw_gen_t * gen, int new_value)
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen)
 {
-	if (new_value < CW_GAP_MIN || new_value > CW_GAP_MAX) {
-		errno = EINVAL;
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_iws_internal(gen, &batch)) {
 		return CW_FAILURE;
 	}
-
-	if (new_value != gen->gap) {
-		gen->gap = new_value;
-		/* Changes of gap require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
+	if (CW_SUCCESS != cw_gen_batch_flush_internal(gen, &batch)) {
+		return CW_FAILURE;
 	}
 
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "enqueued iw space, tq len = %zu",
+		      cw_tq_length_internal(gen->tq));
+
 	return CW_SUCCESS;
 }
 
 
 
 
-cw_ret_t cw_gen_set_weighting(cw_gen_t * gen, int new_value)
+/**
+   @brief Add tones of inter-word-space to batch
+
+   See cw_gen_enqueue_iws_internal() for more information.
+
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_batch_add_iws_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch)
 {
-	if (new_value < CW_WEIGHTING_MIN || new_value > CW_WEIGHTING_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+	/* Synchronize low-level timing parameters. */
+	cw_gen_sync_parameters_internal(gen);
 
-	if (new_value != gen->weighting) {
-		gen->weighting = new_value;
+	/* Send silence for the word delay period, plus any adjustment
+	   that may be needed at end of word. Make it in two tones,
+	   and here is why.
 
-		/* Changes of weighting require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
-	}
+	   Let's say that 'tone queue low watermark' is one element
+	   (i.e. one tone).
 
-	return CW_SUCCESS;
-}
+	   In order for tone queue to recognize that a 'low tone
+	   queue' callback needs to be called, the level in tq needs
+	   to drop from 2 to 1.
 
+	   Almost every queued character guarantees that there will be
+	   at least two tones, e.g for 'E' it is dash + following
+	   space. But what about a ' ' character?
 
+	   If we enqueue ' ' character as single tone, there is only one
+	   tone in tone queue, and the tone queue manager can't
+	   recognize when the level drops from 2 to 1 (and thus the
+	   'low level' callback won't be called).
 
+	   If we enqueue ' ' character as two separate tones (as we do
+	   this in this function), the tone queue manager can
+	   recognize level dropping from 2 to 1. Then the passing of
+	   critical level can be noticed, and "low level" callback can
+	   be called.
 
-int cw_gen_get_speed(const cw_gen_t * gen)
-{
-	return gen->send_speed;
-}
+	   BUT: Sometimes the first tone is dequeued before/during the
+	   second one is enqueued, and we can't recognize 2->1 event.
+	   (This is less likely now that tones of a space are added to
+	   tone queue in one batch, but a batch may still be split if it
+	   is full.)
 
+	   So, to be super-sure that there is a recognizable event of
+	   passing tone queue level from 2 to 1, we split the inter-word-space
+	   into N parts and enqueue them. This way we have N + 1
+	   tones per space, and client applications that rely on low
+	   level threshold == 1 can correctly work when enqueueing
+	   spaces.
 
+	   At 60 wpm duration of gen->iws_duration is 100000 [us], so
+	   it's large enough to safely divide it by small integer
+	   value. */
 
+	cw_tone_t tone;
+#if 0
+	/* This section is incorrect. Enable this section only for
+	   tests.  This section "implements" a bug that was present in
+	   libcw until version 6.4.1 and that is now tested by
+	   src/libcw/tests/libcw_test_tq_short_space.c */
+	const int n = 1; /* No division. Old situation causing an error in
+		      client applications. */
+#else
+	const int n = CW_GEN_IWS_N_PARTS; /* "small integer value" - used to have more tones per inter-word-space. */
+#endif
+	CW_TONE_INIT(&tone, 0, gen->iws_duration / n, CW_SLOPE_MODE_NO_SLOPES);
+	tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_IWS_PART, 1);
+	for (int i = 0; i < n; i++) {
+		/* First tone starts ' ' character in tone queue's index
+		   of characters. */
+		tone.character = 0 == i ? ' ' : '\0';
+		if (CW_SUCCESS != cw_gen_batch_add_tone_internal(gen, batch, &tone)) {
+			return CW_FAILURE;
+		}
+	}
 
-int cw_gen_get_frequency(const cw_gen_t * gen)
-{
-	return gen->frequency;
+	CW_TONE_INIT(&tone, 0, gen->adjustment_space_duration, CW_SLOPE_MODE_NO_SLOPES);
+	tone.elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_IWS_ADJUSTMENT, 1);
+	return cw_gen_batch_add_tone_internal(gen, batch, &tone);
 }
 
 
 
 
-int cw_gen_get_volume(const cw_gen_t * gen)
+cw_ret_t cw_gen_enqueue_representation(cw_gen_t * gen, const char * representation)
 {
-	return gen->volume_percent;
-}
-
+	if (!cw_representation_is_valid(representation)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_representation_internal(gen, &batch, representation)) {
+		return CW_FAILURE;
+	}
 
+	/* This function will add additional 2 Units. Together with 1 Unit of
+	   inter-mark-space added after last Mark, it will form a full 3-Unit
+	   inter-character-space. */
+	if (CW_SUCCESS != cw_gen_batch_add_2u_ics_internal(gen, &batch)) {
+		return CW_FAILURE;
+	}
 
-int cw_gen_get_gap(const cw_gen_t * gen)
-{
-	return gen->gap;
+	return cw_gen_batch_flush_internal(gen, &batch);
 }
 
 
 
 
-int cw_gen_get_weighting(const cw_gen_t * gen)
+cw_ret_t cw_gen_enqueue_representation_no_ics(cw_gen_t * gen, const char * representation)
 {
-	return gen->weighting;
+	if (!cw_representation_is_valid(representation)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_representation_internal(gen, &batch, representation)) {
+		return CW_FAILURE;
+	}
+
+	/* No inter-character-space added here. */
+
+	return cw_gen_batch_flush_internal(gen, &batch);
 }
 
 
 
 
 /**
-   @brief Get timing parameters for sending
+   @brief Add tones of marks from given representation to batch
 
-   Return the low-level timing parameters calculated from the speed,
-   gap, tolerance, and weighting set.  Units of returned parameter
-   values are microseconds.
+   *Every* mark (Dot/Dash) from the @p representation is followed by a
+   standard inter-mark-space. Inter-character-space is not added at the end.
 
-   Use NULL for the pointer argument to any parameter value not required.
+   @p representation must be valid.
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
+   @exception EAGAIN there is not enough space in tone queue to enqueue @p representation.
 
-   @param[in] gen
-   @param[out] dot_duration
-   @param[out] dash_duration
-   @param[out] ims_duration duration of inter-mark-space
-   @param[out] ics_duration duration of inter-character-space
-   @param[out] iws_duration duration of inter-word-space
-   @param[out] additional_space_duration
-   @param[out] adjustment_space_duration
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+   @param[in] representation representation of character
+
+   @return CW_FAILURE on failure
+   @return CW_SUCCESS on success
 */
-void cw_gen_get_timing_parameters_internal(cw_gen_t * gen,
-					   int * dot_duration,
-					   int * dash_duration,
-					   int * ims_duration,
-					   int * ics_duration,
-					   int * iws_duration,
-					   int * additional_space_duration,
-					   int * adjustment_space_duration)
+static cw_ret_t cw_gen_batch_add_representation_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, const char * representation)
 {
-	cw_gen_sync_parameters_internal(gen);
-
-	if (dot_duration)   { *dot_duration = gen->dot_duration; }
-	if (dash_duration)  { *dash_duration = gen->dash_duration; }
+	/* Before we let this representation loose on tone generation,
+	   we'd really like to know that all of its tones will get queued
+	   up successfully.  The right way to do this is to calculate the
+	   number of tones in our representation, then check that the space
+	   exists in the tone queue. However, since the queue is comfortably
+	   long, we can get away with just looking for a high water mark.
 
-	if (ims_duration)   { *ims_duration = gen->ims_duration; }
-	if (ics_duration)   { *ics_duration = gen->ics_duration; }
-	if (iws_duration)   { *iws_duration = gen->iws_duration; }
+	   TODO: do the check the proper way.
+	*/
+	if (cw_gen_batch_is_above_high_water_mark_internal(gen, batch)) {
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
 
-	if (additional_space_duration)    { *additional_space_duration = gen->additional_space_duration; }
-	if (adjustment_space_duration)    { *adjustment_space_duration = gen->adjustment_space_duration; }
+	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
+	for (int i = 0; representation[i] != '\0'; i++) {
+		const bool is_first = i == 0;
+		if (CW_SUCCESS != cw_gen_batch_add_mark_internal(gen, batch, representation[i], is_first)) {
+			return CW_FAILURE;
+		}
+	}
 
-	return;
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Enqueue a mark (Dot or Dash)
+   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
 
-   Low level primitive to enqueue a tone for mark of the given type, followed
-   by the standard inter-mark-space.
+   _valid_character_ in function's name means that the function expects the
+   character @p character to be valid (@p character should be validated by
+   caller before passing it to the function).
 
-   Function sets errno to EINVAL if an argument is invalid, and
-   returns CW_FAILURE.
+   no_ics in function's name means that the inter-character-space is not
+   appended at the end of Marks and Spaces enqueued in generator (but the
+   last inter-mark-space is).
 
-   Function also returns CW_FAILURE if adding the element to queue of
-   tones failed.
+   @exception ENOENT @p character is not a valid character.
 
    @internal
    @reviewed 2020-08-06
    @endinternal
 
-   @param[in] gen generator to be used to enqueue a mark and inter-mark-space
-   @param[in] mark mark to send: Dot (CW_DOT_REPRESENTATION) or Dash (CW_DASH_REPRESENTATION)
-   @param[in] is_first is it a first mark in a character?
+   @param[in] gen generator to be used to enqueue character
+   @param[in] character character to enqueue
 
-   @return CW_FAILURE on failure
    @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_enqueue_mark_internal(cw_gen_t * gen, char mark, bool is_first)
+cw_ret_t cw_gen_enqueue_valid_character_no_ics_internal(cw_gen_t * gen, char character)
 {
-	cw_ret_t status = CW_FAILURE;
-
-	/* Synchronize low-level timings if required. */
-	cw_gen_sync_parameters_internal(gen);
-	/* TODO: do we need to synchronize here receiver as well? */
-
-	/* Send either a dot or a dash mark, depending on representation. */
-	if (mark == CW_DOT_REPRESENTATION) {
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, gen->frequency, gen->dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		tone.is_first = is_first;
-		status = cw_tq_enqueue_internal(gen->tq, &tone);
-	} else if (mark == CW_DASH_REPRESENTATION) {
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, gen->frequency, gen->dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		tone.is_first = is_first;
-		status = cw_tq_enqueue_internal(gen->tq, &tone);
-	} else {
-		errno = EINVAL;
-		status = CW_FAILURE;
-	}
-
-	if (CW_SUCCESS != status) {
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "no generator available");
 		return CW_FAILURE;
 	}
 
-	/* Send the inter-mark-space. */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, gen->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
-	if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_valid_character_internal(gen, &batch, character, false)) {
 		return CW_FAILURE;
-	} else {
-		return CW_SUCCESS;
 	}
+
+	return cw_gen_batch_flush_internal(gen, &batch);
 }
 
 
 
 
 /**
-   @brief Enqueue 2-Unit inter-character-space
-
-   The function enqueues space of length 2 Units. The function is intended to
-   be used after inter-mark-space has already been enqueued.
+   @brief Add tones of a given valid ASCII character to batch
 
-   In such situation standard inter-mark-space (one Unit) and two
-   Units enqueued by this function form a full standard
-   inter-character-space (three Units).
-
-   Inter-character adjustment space is added at the end.
+   Inter-character-space is added after last inter-mark-space of the
+   character only if @p add_ics is true.
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
+   @exception ENOENT @p character is not a valid character.
+   @exception EAGAIN there is not enough space in tone queue to enqueue @p character.
 
-   @param[in] gen generator in which to enqueue the space
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+   @param[in] character character to add
+   @param[in] add_ics whether to add inter-character-space at the end of character
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_enqueue_2u_ics_internal(cw_gen_t * gen)
+static cw_ret_t cw_gen_batch_add_valid_character_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, char character, bool add_ics)
 {
-	/* Synchronize low-level timing parameters. */
-	cw_gen_sync_parameters_internal(gen);
+	/* ' ' character (i.e. inter-word-space) is a special case. */
+	if (character == ' ') {
+		if (CW_SUCCESS != cw_gen_batch_add_iws_internal(gen, batch)) {
+			return CW_FAILURE;
+		}
+	} else {
+		if (cw_gen_batch_is_above_high_water_mark_internal(gen, batch)) {
+			errno = EAGAIN;
+			return CW_FAILURE;
+		}
 
-	/* Enqueue standard inter-character-space, plus any additional inter-character gap. */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, gen->ics_duration + gen->additional_space_duration, CW_SLOPE_MODE_NO_SLOPES);
-	return cw_tq_enqueue_internal(gen->tq, &tone);
-}
+		/* Every Mark in compiled character is followed by
+		   inter-mark-space, so there is 1 Unit of inter-mark-space at
+		   the end. */
+		const cw_gen_char_tones_t * entry = cw_gen_char_tones_lookup_internal(gen, character);
+		if (NULL == entry) {
+			return CW_FAILURE;
+		}
+		for (int i = 0; i < entry->n_tones; i++) {
+			cw_tone_t tone;
+			CW_TONE_COPY(&tone, &entry->tones[i]);
+			if (0 == i) {
+				/* Let tone queue put the character in its
+				   index of characters. */
+				tone.character = character;
+			}
+			if (CW_SUCCESS != cw_gen_batch_add_tone_internal(gen, batch, &tone)) {
+				return CW_FAILURE;
+			}
+		}
+	}
 
+	if (add_ics) {
+		/* This function will add additional 2 Units. Together with
+		   previous 1 Unit, it will form a full 3-Unit
+		   inter-character-space. */
+		if (CW_SUCCESS != cw_gen_batch_add_2u_ics_internal(gen, batch)) {
+			return CW_FAILURE;
+		}
+	}
 
+	return CW_SUCCESS;
+}
 
 
-/**
-   @brief Enqueue space character (' ') in generator, to be sent using Morse code
 
-   The function should be used to enqueue a regular ' ' character.
 
-   The function enqueues space of length 5 Units. The function is intended to
-   be used after inter-mark-space and inter-character-space have already been
-   enqueued.
+/**
+   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
 
-   In such situation standard inter-mark-space (one Unit) and
-   inter-character-space (two Units) and regular space (five units) form a
-   full standard inter-word-space (seven Units).
+   After enqueueing last Mark (Dot or Dash) comprising a character, an
+   inter-mark-space is enqueued.  Inter-character-space is enqueued
+   after that last inter-mark-space.
 
-   TODO: review this description again. This function alone doesn't send
-   space character, it sends a part of what can be seen as inter-word-space.
+   _valid_character_ in function's name means that the function expects the
+   character @p character to be valid (@p character should be validated by
+   caller before passing it to the function).
 
-   Inter-word adjustment space is added at the end.
+   @exception ENOENT @p character is not a valid character.
 
    @internal
-   @reviewed 2020-08-06
+   @reviewed 2020-08-23
    @endinternal
 
-   @param[in] gen generator in which to enqueue the space
+   @param[in] gen generator to be used to enqueue character
+   @param[in] character character to enqueue
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen)
+cw_ret_t cw_gen_enqueue_valid_character_internal(cw_gen_t * gen, char character)
 {
-	/* Synchronize low-level timing parameters. */
-	cw_gen_sync_parameters_internal(gen);
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "no generator available");
+		return CW_FAILURE;
+	}
 
-	/* Send silence for the word delay period, plus any adjustment
-	   that may be needed at end of word. Make it in two tones,
-	   and here is why.
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	if (CW_SUCCESS != cw_gen_batch_add_valid_character_internal(gen, &batch, character, true)) {
+		return CW_FAILURE;
+	}
 
-	   Let's say that 'tone queue low watermark' is one element
-	   (i.e. one tone).
+	return cw_gen_batch_flush_internal(gen, &batch);
+}
 
-	   In order for tone queue to recognize that a 'low tone
-	   queue' callback needs to be called, the level in tq needs
-	   to drop from 2 to 1.
 
-	   Almost every queued character guarantees that there will be
-	   at least two tones, e.g for 'E' it is dash + following
-	   space. But what about a ' ' character?
 
-	   If we enqueue ' ' character as single tone, there is only one
-	   tone in tone queue, and the tone queue manager can't
-	   recognize when the level drops from 2 to 1 (and thus the
-	   'low level' callback won't be called).
 
-	   If we enqueue ' ' character as two separate tones (as we do
-	   this in this function), the tone queue manager can
-	   recognize level dropping from 2 to 1. Then the passing of
-	   critical level can be noticed, and "low level" callback can
-	   be called.
+cw_ret_t cw_gen_enqueue_character(cw_gen_t * gen, char character)
+{
+	if (!cw_character_is_valid(character)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
 
-	   BUT: Sometimes the first tone is dequeued before/during the
-	   second one is enqueued, and we can't recognize 2->1 event.
+	/* This function adds inter-character-space at the end of character. */
+	if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, character)) {
+		return CW_FAILURE;
+	}
 
-	   So, to be super-sure that there is a recognizable event of
-	   passing tone queue level from 2 to 1, we split the inter-word-space
-	   into N parts and enqueue them. This way we have N + 1
-	   tones per space, and client applications that rely on low
-	   level threshold == 1 can correctly work when enqueueing
-	   spaces.
+	return CW_SUCCESS;
+}
 
-	   At 60 wpm duration of gen->iws_duration is 100000 [us], so
-	   it's large enough to safely divide it by small integer
-	   value. */
 
-	int enqueued = 0;
 
-	cw_tone_t tone;
-#if 0
-	/* This section is incorrect. Enable this section only for
-	   tests.  This section "implements" a bug that was present in
-	   libcw until version 6.4.1 and that is now tested by
-	   src/libcw/tests/libcw_test_tq_short_space.c */
-	const int n = 1; /* No division. Old situation causing an error in
-		      client applications. */
-#else
-	const int n = 2; /* "small integer value" - used to have more tones per inter-word-space. */
-#endif
-	CW_TONE_INIT(&tone, 0, gen->iws_duration / n, CW_SLOPE_MODE_NO_SLOPES);
-	for (int i = 0; i < n; i++) {
-		if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
-			return CW_FAILURE;
-		}
-		enqueued++;
-	}
 
-	CW_TONE_INIT(&tone, 0, gen->adjustment_space_duration, CW_SLOPE_MODE_NO_SLOPES);
-	if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
+cw_ret_t cw_gen_enqueue_character_no_ics(cw_gen_t * gen, char character)
+{
+	if (!cw_character_is_valid(character)) {
+		errno = ENOENT;
 		return CW_FAILURE;
 	}
-	enqueued++;
 
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
-		      MSG_PREFIX "enqueued %d tones per iw space, tq len = %zu",
-		      enqueued, cw_tq_length_internal(gen->tq));
+	/* This function doesn't add inter-character-space at the end of character. */
+	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
+		return CW_FAILURE;
+	}
 
 	return CW_SUCCESS;
 }
@@ -2358,117 +5814,199 @@ cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen)
 
 
 
-cw_ret_t cw_gen_enqueue_representation(cw_gen_t * gen, const char * representation)
+cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string)
 {
-	if (!cw_representation_is_valid(representation)) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
-
-	/* Before we let this representation loose on tone generation,
-	   we'd really like to know that all of its tones will get queued
-	   up successfully.  The right way to do this is to calculate the
-	   number of tones in our representation, then check that the space
-	   exists in the tone queue. However, since the queue is comfortably
-	   long, we can get away with just looking for a high water mark.  */
-	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
-		errno = EAGAIN;
+	/* Check that the string is composed of valid characters. */
+	if (!cw_string_is_valid(string)) {
+		errno = ENOENT;
 		return CW_FAILURE;
 	}
 
-	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
-	for (int i = 0; representation[i] != '\0'; i++) {
-		const bool is_first = i == 0;
-		if (CW_SUCCESS != cw_gen_enqueue_mark_internal(gen, representation[i], is_first)) {
+	/* Send every character in the string. Tones of characters are
+	   collected in a batch, so that tone queue is locked (and generator
+	   is woken up) once per batch instead of once per tone. */
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	for (int i = 0; string[i] != '\0'; i++) {
+		/* This function adds inter-character-space at the end of character. */
+		if (CW_SUCCESS != cw_gen_batch_add_valid_character_internal(gen, &batch, string[i], true)) {
+			/* Enqueue characters that have been fully
+			   added to batch before the failure, but keep
+			   errno of the failure. */
+			const int saved_errno = errno;
+			cw_gen_batch_flush_internal(gen, &batch);
+			errno = saved_errno;
 			return CW_FAILURE;
 		}
 	}
 
-	/* This function will add additional 2 Units. Together with 1 Unit of
-	   inter-mark-space added after last Mark, it will form a full 3-Unit
-	   inter-character-space. */
-	if (CW_SUCCESS != cw_gen_enqueue_2u_ics_internal(gen)) {
+	return cw_gen_batch_flush_internal(gen, &batch);
+}
+
+
+
+
+cw_ret_t cw_gen_set_alphabet(cw_gen_t * gen, cw_alphabet_t alphabet)
+{
+	if (NULL == gen || (int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		errno = EINVAL;
 		return CW_FAILURE;
 	}
 
+	gen->alphabet = alphabet;
 	return CW_SUCCESS;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_representation_no_ics(cw_gen_t * gen, const char * representation)
+cw_alphabet_t cw_gen_get_alphabet(const cw_gen_t * gen)
 {
-	if (!cw_representation_is_valid(representation)) {
+	return gen->alphabet;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_utf8_string(cw_gen_t * gen, const char * string)
+{
+	if (NULL == gen || NULL == string) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	const cw_alphabet_tables_t * tables = cw_alphabet_tables_internal(gen->alphabet);
+
+	/* Check that the string is composed of valid characters, so
+	   that nothing is enqueued if it isn't. */
+	for (int i = 0; string[i] != '\0'; ) {
+		uint32_t code_point = 0;
+		const int length = cw_utf8_decode_internal(string + i, &code_point);
+		if (0 == length) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		if (code_point != ' ' && NULL == cw_alphabet_code_point_to_representation_internal(tables, code_point)) {
+			errno = ENOENT;
+			return CW_FAILURE;
+		}
+		i += length;
+	}
 
-	/* Before we let this representation loose on tone generation,
-	   we'd really like to know that all of its tones will get queued
-	   up successfully.  The right way to do this is to calculate the
-	   number of tones in our representation, then check that the space
-	   exists in the tone queue. However, since the queue is comfortably
-	   long, we can get away with just looking for a high water mark.
+	cw_gen_tones_batch_t batch = { .n_tones = 0 };
+	for (int i = 0; string[i] != '\0'; ) {
+		uint32_t code_point = 0;
+		i += cw_utf8_decode_internal(string + i, &code_point);
+
+		cw_ret_t cwret;
+		if (code_point < 0x80) {
+			/* ASCII characters (and ' ') take the same path as
+			   in cw_gen_enqueue_string(). */
+			cwret = cw_gen_batch_add_valid_character_internal(gen, &batch, (char) code_point, true);
+		} else {
+			const char * representation = cw_alphabet_code_point_to_representation_internal(tables, code_point);
+			cwret = cw_gen_batch_add_representation_internal(gen, &batch, representation);
+			if (CW_SUCCESS == cwret) {
+				cwret = cw_gen_batch_add_2u_ics_internal(gen, &batch);
+			}
+		}
+
+		if (CW_SUCCESS != cwret) {
+			/* Enqueue characters that have been fully added to
+			   batch before the failure, but keep errno of the
+			   failure. */
+			const int saved_errno = errno;
+			cw_gen_batch_flush_internal(gen, &batch);
+			errno = saved_errno;
+			return CW_FAILURE;
+		}
+	}
+
+	return cw_gen_batch_flush_internal(gen, &batch);
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_tones(cw_gen_t * gen, const cw_gen_tone_t * tones, size_t n_tones)
+{
+	if (NULL == gen || (NULL == tones && n_tones > 0)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (0 == n_tones) {
+		return CW_SUCCESS;
+	}
 
-	   TODO: do the check the proper way.
-	   TODO: wrap this check into a function and reuse it in cw_gen_enqueue_representation()
-	*/
-	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
-		errno = EAGAIN;
+	cw_tone_t * tq_tones = (cw_tone_t *) malloc(n_tones * sizeof (cw_tone_t));
+	if (NULL == tq_tones) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "enqueue tones: malloc()");
+		errno = ENOMEM;
 		return CW_FAILURE;
 	}
 
-	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
-	for (int i = 0; representation[i] != '\0'; i++) {
-		const bool is_first = i == 0;
-		if (CW_SUCCESS != cw_gen_enqueue_mark_internal(gen, representation[i], is_first)) {
-			return CW_FAILURE;
-		}
+	for (size_t i = 0; i < n_tones; i++) {
+		/* Silent tones don't need slopes. */
+		const cw_tone_slope_mode_t slope_mode = tones[i].frequency > 0 ? CW_SLOPE_MODE_STANDARD_SLOPES : CW_SLOPE_MODE_NO_SLOPES;
+		CW_TONE_INIT(&tq_tones[i], tones[i].frequency, tones[i].duration, slope_mode);
+		tq_tones[i].is_first = tones[i].is_first;
 	}
 
-	/* No inter-character-space added here. */
+	const cw_ret_t cwret = cw_tq_enqueue_batch_internal(gen->tq, tq_tones, n_tones);
+	free(tq_tones);
 
-	return CW_SUCCESS;
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
+   @brief Check if tone queue with tones from batch would reach high water mark
 
-   _valid_character_ in function's name means that the function expects the
-   character @p character to be valid (@p character should be validated by
-   caller before passing it to the function).
+   Tones already collected in the batch will occupy the queue as well, so
+   they are counted too.
 
-   no_ics in function's name means that the inter-character-space is not
-   appended at the end of Marks and Spaces enqueued in generator (but the
-   last inter-mark-space is).
+   @param[in] gen generator
+   @param[in] batch batch of tones
 
-   @exception ENOENT @p character is not a valid character.
+   @return true if high water mark is reached
+   @return false otherwise
+*/
+static bool cw_gen_batch_is_above_high_water_mark_internal(cw_gen_t * gen, const cw_gen_tones_batch_t * batch)
+{
+	return cw_tq_length_internal(gen->tq) + batch->n_tones >= gen->tq->high_water_mark;
+}
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
 
-   @param[in] gen generator to be used to enqueue character
-   @param[in] character character to enqueue
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
+
+/**
+   @brief Get tones of given character, compiled for current parameters of generator
+
+   The tones of the character are compiled on first use of the character,
+   and after any change of generator's parameters that has impact on the
+   tones (see cw_gen_char_tones_invalidate_internal()). Otherwise this is
+   just a table lookup.
+
+   @p character must be a valid character.
+
+   @exception ENOENT @p character is not a valid character
+   @exception ENOMEM failed to allocate entry for the character
+
+   @param[in] gen generator
+   @param[in] character character for which to get tones
+
+   @return pointer to compiled tones of @p character on success
+   @return NULL on failure
 */
-cw_ret_t cw_gen_enqueue_valid_character_no_ics_internal(cw_gen_t * gen, char character)
+static const cw_gen_char_tones_t * cw_gen_char_tones_lookup_internal(cw_gen_t * gen, char character)
 {
-	if (NULL == gen) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-			      MSG_PREFIX "no generator available");
-		return CW_FAILURE;
-	}
+	/* This may invalidate the table. */
+	cw_gen_sync_parameters_internal(gen);
 
-	/* ' ' character (i.e. inter-word-space) is a special case. */
-	if (character == ' ') {
-		return cw_gen_enqueue_iws_internal(gen);
+	const unsigned char index = (unsigned char) character;
+	cw_gen_char_tones_t * entry = gen->char_tones.entries[index];
+	if (NULL != entry && entry->generation == gen->char_tones.generation) {
+		return entry;
 	}
 
 	const char * representation = cw_character_to_representation_internal(character);
@@ -2479,92 +6017,89 @@ cw_ret_t cw_gen_enqueue_valid_character_no_ics_internal(cw_gen_t * gen, char cha
 	/* ... but fail gracefully anyway. */
 	if (NULL == representation) {
 		errno = ENOENT;
-		return CW_FAILURE;
+		return NULL;
 	}
-
-	if (CW_SUCCESS != cw_gen_enqueue_representation_no_ics(gen, representation)) {
-		return CW_FAILURE;
+	cw_assert (strlen(representation) <= CW_DATA_MAX_REPRESENTATION_LENGTH, MSG_PREFIX "representation of '%c' is too long", character);
+
+	if (NULL == entry) {
+		entry = (cw_gen_char_tones_t *) calloc(1, sizeof (cw_gen_char_tones_t));
+		if (NULL == entry) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "calloc()");
+			errno = ENOMEM;
+			return NULL;
+		}
+		gen->char_tones.entries[index] = entry;
 	}
 
-	/* No inter-character-space here. */
+	entry->n_tones = 0;
+	for (int i = 0; representation[i] != '\0'; i++) {
+		cw_tone_t * tone = &entry->tones[entry->n_tones++];
+		const bool is_dot = representation[i] == CW_DOT_REPRESENTATION;
+		const int duration = is_dot ? gen->dot_duration : gen->dash_duration;
+		CW_TONE_INIT(tone, gen->frequency, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone->elements = CW_TONE_ELEMENTS(is_dot ? CW_TONE_ELEMENT_DOT : CW_TONE_ELEMENT_DASH, 1);
+		tone->is_first = 0 == i;
+		cw_gen_tone_calculate_samples_size_internal(gen, tone);
+
+		tone = &entry->tones[entry->n_tones++];
+		CW_TONE_INIT(tone, 0, gen->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
+		tone->elements = CW_TONE_ELEMENTS(CW_TONE_ELEMENT_IMS, 1);
+		cw_gen_tone_calculate_samples_size_internal(gen, tone);
+	}
+	entry->generation = gen->char_tones.generation;
 
-	return CW_SUCCESS;
+	return entry;
 }
 
 
 
 
 /**
-   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
-
-   After enqueueing last Mark (Dot or Dash) comprising a character, an
-   inter-mark-space is enqueued.  Inter-character-space is enqueued
-   after that last inter-mark-space.
-
-   _valid_character_ in function's name means that the function expects the
-   character @p character to be valid (@p character should be validated by
-   caller before passing it to the function).
-
-   @exception ENOENT @p character is not a valid character.
-
-   @internal
-   @reviewed 2020-08-23
-   @endinternal
+   @brief Invalidate all entries in table of compiled characters
 
-   @param[in] gen generator to be used to enqueue character
-   @param[in] character character to enqueue
+   The function should be called whenever a parameter of generator that
+   has impact on tones of characters is changed.
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
+   @param[in] gen generator
 */
-cw_ret_t cw_gen_enqueue_valid_character_internal(cw_gen_t * gen, char character)
+void cw_gen_char_tones_invalidate_internal(cw_gen_t * gen)
 {
-	/* This function will add 1 Unit of inter-mark-space at the end. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
-		return CW_FAILURE;
-	}
-
-	/* This function will add additional 2 Units. Together with previous
-	   1 Unit, it will form a full 3-Unit inter-character-space. */
-	if (CW_SUCCESS != cw_gen_enqueue_2u_ics_internal(gen)) {
-		return CW_FAILURE;
+	unsigned int generation = gen->char_tones.generation + 1;
+	if (0 == generation) {
+		/* Zero is reserved for entries that were never compiled. */
+		generation = 1;
 	}
+	gen->char_tones.generation = generation;
 
-	return CW_SUCCESS;
+	return;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_character(cw_gen_t * gen, char character)
-{
-	if (!cw_character_is_valid(character)) {
-		errno = ENOENT;
-		return CW_FAILURE;
-	}
-
-	/* This function adds inter-character-space at the end of character. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, character)) {
-		return CW_FAILURE;
-	}
-
-	return CW_SUCCESS;
-}
-
+/**
+   @brief Add a tone to batch
 
+   If the batch is full, tones collected in the batch are enqueued in
+   generator's tone queue before @p tone is added to the batch.
 
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+   @param[in] tone tone to add
 
-cw_ret_t cw_gen_enqueue_character_no_ics(cw_gen_t * gen, char character)
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_batch_add_tone_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch, const cw_tone_t * tone)
 {
-	if (!cw_character_is_valid(character)) {
-		errno = ENOENT;
-		return CW_FAILURE;
+	if (batch->n_tones == CW_GEN_TONES_BATCH_CAPACITY) {
+		if (CW_SUCCESS != cw_gen_batch_flush_internal(gen, batch)) {
+			return CW_FAILURE;
+		}
 	}
 
-	/* This function doesn't add inter-character-space at the end of character. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
-		return CW_FAILURE;
-	}
+	CW_TONE_COPY(&batch->tones[batch->n_tones], tone);
+	batch->n_tones++;
 
 	return CW_SUCCESS;
 }
@@ -2572,23 +6107,25 @@ cw_ret_t cw_gen_enqueue_character_no_ics(cw_gen_t * gen, char character)
 
 
 
-cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string)
-{
-	/* Check that the string is composed of valid characters. */
-	if (!cw_string_is_valid(string)) {
-		errno = ENOENT;
-		return CW_FAILURE;
-	}
+/**
+   @brief Enqueue in generator's tone queue all tones collected in batch
 
-	/* Send every character in the string. */
-	for (int i = 0; string[i] != '\0'; i++) {
-		/* This function adds inter-character-space at the end of character. */
-		if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, string[i])) {
-			return CW_FAILURE;
-		}
-	}
+   The batch is empty after the call, regardless of result of the call.
 
-	return CW_SUCCESS;
+   @exception EINVAL invalid values of one of tones in batch
+   @exception EAGAIN there is not enough space in tone queue for tones from batch
+
+   @param[in] gen generator
+   @param[in,out] batch batch of tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_batch_flush_internal(cw_gen_t * gen, cw_gen_tones_batch_t * batch)
+{
+	const cw_ret_t cwret = cw_tq_enqueue_batch_internal(gen->tq, batch->tones, batch->n_tones);
+	batch->n_tones = 0;
+	return cwret;
 }
 
 
@@ -2643,6 +6180,9 @@ void cw_gen_sync_parameters_internal(cw_gen_t * gen)
 		return;
 	}
 
+	cw_gen_pcm_cache_invalidate_internal(gen);
+	cw_gen_char_tones_invalidate_internal(gen);
+
 	/*
 	  Set the length of a Dot to be a Unit with any weighting
 	  adjustment, and the length of a Dash as three Dot lengths.
@@ -2720,6 +6260,47 @@ void cw_gen_sync_parameters_internal(cw_gen_t * gen)
 	/* Generator parameters are now in sync. */
 	gen->parameters_in_sync = true;
 
+	cw_gen_timing_publish_internal(gen);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Publish generator's timing parameters and frequency for generator's thread
+
+   The snapshot is updated without locks, as a sequence lock with single
+   writer (client code's thread). Generator's thread uses the snapshot to
+   resolve symbolic durations of tones (see
+   cw_gen_tone_resolve_elements_internal()), so new values have effect
+   on next dequeued tone, including tones that are already in the queue.
+
+   @param[in] gen generator
+*/
+static void cw_gen_timing_publish_internal(cw_gen_t * gen)
+{
+	const int durations[CW_TONE_ELEMENT_MAX] = {
+		[CW_TONE_ELEMENT_DOT]            = gen->dot_duration,
+		[CW_TONE_ELEMENT_DASH]           = gen->dash_duration,
+		[CW_TONE_ELEMENT_IMS]            = gen->ims_duration,
+		[CW_TONE_ELEMENT_ICS]            = gen->ics_duration + gen->additional_space_duration,
+		[CW_TONE_ELEMENT_IWS_PART]       = gen->iws_duration / CW_GEN_IWS_N_PARTS,
+		[CW_TONE_ELEMENT_IWS_ADJUSTMENT] = gen->adjustment_space_duration,
+	};
+
+	const uint32_t sequence = __atomic_load_n(&gen->timing.sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&gen->timing.sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&gen->timing.frequency, gen->frequency, __ATOMIC_RELAXED);
+	for (int i = 0; i < CW_TONE_ELEMENT_MAX; i++) {
+		__atomic_store_n(&gen->timing.durations[i], durations[i], __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&gen->timing.sequence, sequence + 2, __ATOMIC_RELEASE);
+
 	return;
 }
 
@@ -2913,26 +6494,154 @@ cw_ret_t cw_gen_enqueue_symbol_no_ims_internal(cw_gen_t * gen, char symbol)
 
 
 
-cw_ret_t cw_gen_wait_for_queue_level(cw_gen_t * gen, size_t level)
-{
-	return cw_tq_wait_for_level_internal(gen->tq, level);
+cw_ret_t cw_gen_wait_for_queue_level(cw_gen_t * gen, size_t level)
+{
+	return cw_tq_wait_for_level_internal(gen->tq, level);
+}
+
+
+
+
+void cw_gen_flush_queue(cw_gen_t * gen)
+{
+	/* This function locks and unlocks mutex. */
+	cw_tq_flush_internal(gen->tq);
+
+	/* TODO: we probably want to have these two functions
+	   separated. Function called cw_gen_flush_queue() probably shouldn't
+	   also silence generator. */
+
+	/* Force silence on the speaker anyway, and stop any background
+	   soundcard tone generation. */
+	cw_gen_silence_internal(gen);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_remove_last_character(cw_gen_t * gen)
+{
+	return cw_tq_remove_last_character_internal(gen->tq);
+}
+
+
+
+
+cw_ret_t cw_gen_remove_last_word(cw_gen_t * gen)
+{
+	return cw_tq_remove_last_word_internal(gen->tq);
+}
+
+
+
+
+cw_ret_t cw_gen_skip_current_character(cw_gen_t * gen)
+{
+	return cw_tq_skip_current_character_internal(gen->tq);
+}
+
+
+
+
+cw_ret_t cw_gen_get_playing_position(const cw_gen_t * gen, char * character, size_t * offset)
+{
+	return cw_tq_get_playing_position_internal(gen->tq, character, offset);
+}
+
+
+
+
+cw_ret_t cw_gen_get_sound_device(cw_gen_t const * gen, char * buffer, size_t size)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+	snprintf(buffer, size, "%s", gen->picked_device_name);
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_gen_get_sound_system(cw_gen_t const * gen)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+	return gen->sound_system;
+}
+
+
+
+
+size_t cw_gen_get_queue_length(cw_gen_t const * gen)
+{
+	return cw_tq_length_internal(gen->tq);
+}
+
+
+
+
+cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level)
+{
+	return cw_tq_register_low_level_callback_internal(gen->tq, callback_func, callback_arg, level);
+}
+
+
+
+
+int64_t cw_gen_get_callback_timestamp(const cw_gen_t * gen)
+{
+	if (gen->dispatch) {
+		return gen->dispatch->current_timestamp;
+	}
+	return cw_clock_now_internal();
+}
+
+
+
+
+cw_ret_t cw_gen_register_text_source(cw_gen_t * gen, cw_gen_text_source_t source_func, void * source_arg)
+{
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "register text source: generator is NULL");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&gen->text_source.mutex);
+	gen->text_source.source_arg = source_arg;
+	__atomic_store_n(&gen->text_source.source_func, source_func, __ATOMIC_RELEASE);
+	/* Generator's thread may be waiting for tones in empty queue:
+	   give it something to dequeue. */
+	cw_gen_text_source_fill_internal(gen);
+	pthread_mutex_unlock(&gen->text_source.mutex);
+
+	return CW_SUCCESS;
 }
 
 
 
 
-void cw_gen_flush_queue(cw_gen_t * gen)
-{
-	/* This function locks and unlocks mutex. */
-	cw_tq_flush_internal(gen->tq);
+/**
+   @brief Pull characters from text source if tone queue is running out of tones
 
-	/* TODO: we probably want to have these two functions
-	   separated. Function called cw_gen_flush_queue() probably shouldn't
-	   also silence generator. */
+   Called by whoever dequeues tones from generator's queue, right
+   before dequeueing a tone. If client code is registering a source
+   at the moment, the function doesn't wait: the registration fills
+   the queue itself.
 
-	/* Force silence on the speaker anyway, and stop any background
-	   soundcard tone generation. */
-	cw_gen_silence_internal(gen);
+   @param[in,out] gen generator
+*/
+static void cw_gen_text_source_pull_internal(cw_gen_t * gen)
+{
+	if (NULL == __atomic_load_n(&gen->text_source.source_func, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	if (0 != pthread_mutex_trylock(&gen->text_source.mutex)) {
+		return;
+	}
+	cw_gen_text_source_fill_internal(gen);
+	pthread_mutex_unlock(&gen->text_source.mutex);
 
 	return;
 }
@@ -2940,52 +6649,81 @@ void cw_gen_flush_queue(cw_gen_t * gen)
 
 
 
-cw_ret_t cw_gen_remove_last_character(cw_gen_t * gen)
-{
-	return cw_tq_remove_last_character_internal(gen->tq);
-}
-
+/**
+   @brief Enqueue characters from text source until a few tones are queued
 
+   Two tones (last Mark of a character and following space) are
+   enough to keep generator busy until next dequeue.
 
+   Caller must hold gen->text_source.mutex.
 
-cw_ret_t cw_gen_get_sound_device(cw_gen_t const * gen, char * buffer, size_t size)
+   @param[in,out] gen generator
+*/
+static void cw_gen_text_source_fill_internal(cw_gen_t * gen)
 {
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
-	snprintf(buffer, size, "%s", gen->picked_device_name);
-	return CW_SUCCESS;
+	while (NULL != gen->text_source.source_func
+	       && cw_tq_length_internal(gen->tq) < 2) {
+
+		const int character = gen->text_source.source_func(gen->text_source.source_arg);
+		if (character <= 0 || character > UCHAR_MAX) {
+			/* End of text. */
+			gen->text_source.source_arg = NULL;
+			__atomic_store_n(&gen->text_source.source_func, NULL, __ATOMIC_RELEASE);
+			break;
+		}
+
+		if (CW_SUCCESS != cw_gen_enqueue_character(gen, (char) character)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "text source: skipping character 0x%02x", character);
+			if (ENOENT != errno) {
+				/* Queue is full or useless. Try again on
+				   next dequeue. */
+				break;
+			}
+		}
+	}
+
+	return;
 }
 
 
 
 
-int cw_gen_get_sound_system(cw_gen_t const * gen)
+int cw_gen_get_event_fd(cw_gen_t * gen)
 {
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
-	return gen->sound_system;
+	return cw_tq_get_event_fd_internal(gen->tq);
 }
 
 
 
 
-size_t cw_gen_get_queue_length(cw_gen_t const * gen)
+cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen)
 {
-	return cw_tq_length_internal(gen->tq);
+	return cw_tq_wait_for_end_of_current_tone_internal(gen->tq);
 }
 
 
 
 
-cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level)
+cw_ret_t cw_gen_wait_for_queue_level_async(cw_gen_t * gen, size_t level, cw_wait_callback_t callback, void * callback_arg, int * fd)
 {
-	return cw_tq_register_low_level_callback_internal(gen->tq, callback_func, callback_arg, level);
+	if (NULL == gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_tq_wait_async_internal(gen->tq, CW_TQ_WAIT_LEVEL, level, NULL, callback, callback_arg, fd);
 }
 
 
 
 
-cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen)
+cw_ret_t cw_gen_wait_for_end_of_current_tone_async(cw_gen_t * gen, cw_wait_callback_t callback, void * callback_arg, int * fd)
 {
-	return cw_tq_wait_for_end_of_current_tone_internal(gen->tq);
+	if (NULL == gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_tq_wait_async_internal(gen->tq, CW_TQ_WAIT_TONE_END, 0, NULL, callback, callback_arg, fd);
 }
 
 
@@ -3094,7 +6832,7 @@ static cw_ret_t cw_gen_value_tracking_internal(cw_gen_t * gen, const cw_tone_t *
 		cw_assert (0, MSG_PREFIX "unexpected state of tone queue: %d", queue_state);
 		break;
 	}
-	cw_gen_value_tracking_set_value_internal(gen, gen->key, value);
+	cw_gen_value_tracking_set_value_internal(gen, gen->key, value, cw_gen_sound_timestamp_internal(gen));
 
 	return CW_SUCCESS;
 }
@@ -3119,8 +6857,9 @@ static cw_ret_t cw_gen_value_tracking_internal(cw_gen_t * gen, const cw_tone_t *
    @param[in] gen generator for which to set new value
    @param[in] key TODO: document
    @param[in] value value of generator to be set
+   @param[in] timestamp time at which the new value will be heard [ns]
 */
-void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, __attribute__((unused)) volatile cw_key_t * key, cw_key_value_t value)
+void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, __attribute__((unused)) volatile cw_key_t * key, cw_key_value_t value, int64_t timestamp)
 {
 	//cw_assert (NULL != key, MSG_PREFIX "gen track value: key is NULL");
 
@@ -3185,14 +6924,37 @@ void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, __attribute__((unu
 		}
 	}
 #endif
+	pthread_mutex_lock(&gen->value_tracking.keying_mutex);
+	if (NULL != gen->value_tracking.keying) {
+		cw_keying_push_internal(gen->value_tracking.keying, value);
+	}
+	if (NULL != gen->value_tracking.keylog) {
+		cw_keylog_record(gen->value_tracking.keylog, CW_KEYLOG_SOURCE_GENERATOR, value, timestamp);
+	}
+	pthread_mutex_unlock(&gen->value_tracking.keying_mutex);
+
 #if 1
 	if (gen->value_tracking.value_tracking_callback_func) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_KEYING, CW_DEBUG_INFO,
 			      MSG_PREFIX "set gen value: about to call value tracking callback, generator value = %d\n", gen->value_tracking.value);
 
-		(*gen->value_tracking.value_tracking_callback_func)(gen->value_tracking.value_tracking_callback_arg, gen->value_tracking.value);
+		if (gen->dispatch) {
+			cw_dispatch_post_internal(gen->dispatch, CW_DISPATCH_VALUE, gen->value_tracking.value, cw_clock_now_internal(), timestamp);
+		} else {
+			(*gen->value_tracking.value_tracking_callback_func)(gen->value_tracking.value_tracking_callback_arg, gen->value_tracking.value);
+		}
 	}
 #endif
+	if (gen->value_tracking.timed_callback_func) {
+		if (gen->dispatch) {
+			if (!gen->value_tracking.value_tracking_callback_func) {
+				/* Otherwise already posted above. */
+				cw_dispatch_post_internal(gen->dispatch, CW_DISPATCH_VALUE, gen->value_tracking.value, cw_clock_now_internal(), timestamp);
+			}
+		} else {
+			(*gen->value_tracking.timed_callback_func)(gen->value_tracking.timed_callback_arg, gen->value_tracking.value, timestamp);
+		}
+	}
 	return;
 }
 
@@ -3234,6 +6996,89 @@ void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_val
 
 
 
+cw_ret_t cw_gen_register_timed_value_tracking_callback(cw_gen_t * gen, cw_gen_timed_value_tracking_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "register timed value tracking callback: generator is NULL");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	gen->value_tracking.timed_callback_func = callback_func;
+	gen->value_tracking.timed_callback_arg = callback_arg;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Estimate time at which next sample calculated by generator will be heard
+
+   The next sample is the one that will be put at position
+   gen->buffer_sub_start of generator's buffer. Samples before it
+   still have to be written to sound system, and samples written
+   before are still in buffer of sound device.
+
+   For sound system that keeps up with playing (there are samples in
+   buffer of sound device), the time is calculated from time at which
+   position of last write is heard. If sound device has played
+   everything and is idling, the sample will be heard as soon as its
+   buffer is written.
+
+   Null and Console sound systems don't have any buffers, a tone is
+   heard at the time when previous tone ends.
+
+   @param[in] gen generator
+
+   @return timestamp [ns]
+*/
+static int64_t cw_gen_sound_timestamp_internal(const cw_gen_t * gen)
+{
+	const int64_t now = cw_clock_now_internal();
+
+	if (gen->sound_system == CW_AUDIO_NULL || gen->sound_system == CW_AUDIO_CONSOLE) {
+		if (0 == gen->pacing.deadline || now / 1000 - gen->pacing.deadline > CW_GEN_PACING_MAX_LATENESS) {
+			return now;
+		}
+		return gen->pacing.deadline * 1000;
+	}
+
+	const int64_t pending = ((int64_t) gen->buffer_sub_start * CW_NSECS_PER_SEC) / gen->sample_rate;
+	int64_t timestamp = now + pending;
+	if (gen->sound_clock.anchor_time + pending > timestamp) {
+		timestamp = gen->sound_clock.anchor_time + pending;
+	}
+
+	return timestamp;
+}
+
+
+
+
+/**
+   @brief Remember time at which sample following samples written so far will be heard
+
+   To be called right after samples have been written to sound
+   system, or (in pull mode) right before samples are pulled by sound
+   server. Sound systems report in latency of sound device the
+   samples that have been written but not yet heard.
+
+   @param[in] gen generator
+*/
+static void cw_gen_sound_clock_set_anchor_internal(cw_gen_t * gen)
+{
+	const int64_t device_latency = cw_gen_latency_get_sound_device_latency_internal(gen) * 1000;
+	gen->sound_clock.anchor_time = cw_clock_now_internal() + device_latency;
+
+	return;
+}
+
+
+
+
 /**
    @brief Pick a device name for given sound system
 
@@ -3279,7 +7124,9 @@ cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name,
 
 	case CW_AUDIO_CONSOLE:
 	case CW_AUDIO_OSS:
-		/* For above 2 sound systems the Unix open() function doesn't
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_RTP:
+		/* For above sound systems the Unix open() function doesn't
 		   do any special interpretation of NULL pointer argument or
 		   empty string argument. We have to provide explicit device
 		   name or path. So behaviour is the same as for ALSA. */
@@ -3322,6 +7169,25 @@ cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name,
 		cwret = CW_SUCCESS;
 		break;
 
+	case CW_AUDIO_JACK:
+		/* Device name is a name of JACK input port (e.g.
+		   "system:playback_1") to which libcw's output port will be
+		   connected. */
+		if (NULL == alternative_device_name
+		    || '\0' == alternative_device_name[0]
+		    || 0 == strcmp(alternative_device_name, default_sound_devices[sound_system])) {
+
+			/* Empty: code that will call JACK API will connect
+			   libcw's port to all physical playback ports. */
+			snprintf(picked_device_name, size, "%s", "");
+		} else {
+			/* Use non-default port name provided by client
+			   code. */
+			snprintf(picked_device_name, size, "%s", alternative_device_name);
+		}
+		cwret = CW_SUCCESS;
+		break;
+
 	case CW_AUDIO_SOUNDCARD:
 		/* This function should never be called for SOUNDCARD sound
 		   device. It should be called for specific sound systems
@@ -3358,3 +7224,231 @@ void cw_gen_calculate_durations_internal(cw_gen_durations_t * durations, int spe
 
 
 
+
+
+
+
+/**
+   @brief Append samples to generator's buffer of rendered samples
+
+   @param[in] gen generator
+   @param[in] samples samples to append
+   @param[in] n_samples count of samples to append
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_render_append_internal(cw_gen_t * gen, const cw_sample_t * samples, size_t n_samples)
+{
+	const size_t needed = gen->render.n_samples + n_samples;
+	if (needed > gen->render.capacity) {
+		size_t capacity = gen->render.capacity ? gen->render.capacity : 16 * CW_GEN_RENDER_BUFFER_N_SAMPLES;
+		while (capacity < needed) {
+			capacity *= 2;
+		}
+		cw_sample_t * new_samples = (cw_sample_t *) realloc(gen->render.samples, capacity * sizeof (cw_sample_t));
+		if (NULL == new_samples) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "realloc()");
+			gen->render.failed = true;
+			return CW_FAILURE;
+		}
+		gen->render.samples = new_samples;
+		gen->render.capacity = capacity;
+	}
+
+	memcpy(gen->render.samples + gen->render.n_samples, samples, n_samples * sizeof (cw_sample_t));
+	gen->render.n_samples += n_samples;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Replacement of sound system's "write buffer" function, used during offline rendering
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_render_write_buffer_internal(cw_gen_t * gen)
+{
+	return cw_gen_render_append_internal(gen, gen->buffer, (size_t) gen->buffer_write_n_samples);
+}
+
+
+
+
+/**
+   @brief Render all tones from generator's queue into generator's buffer of rendered samples
+
+   This is the same tone queue -> cw_gen_write_to_soundcard_internal()
+   path that is used by generator's thread, but with the sound system
+   replaced by growable gen->render.samples buffer, and without any
+   pacing to real time.
+
+   @exception EBUSY generator is running
+   @exception ENOMEM failed to allocate memory for samples
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_render_queue_internal(cw_gen_t * gen)
+{
+	if (gen->do_dequeue_and_generate || gen->thread.running) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't render tones of generator that has been started");
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	if (0 == gen->sample_rate) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (NULL == gen->buffer) {
+		/* Null and Console generators don't have their own buffer. */
+		gen->buffer = (cw_sample_t *) calloc(CW_GEN_RENDER_BUFFER_N_SAMPLES, sizeof (cw_sample_t));
+		if (NULL == gen->buffer) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "calloc()");
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		gen->buffer_n_samples = CW_GEN_RENDER_BUFFER_N_SAMPLES;
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = 0;
+	}
+
+	cw_ret_t (* write_buffer_to_sound_device)(cw_gen_t * gen) = gen->write_buffer_to_sound_device;
+	cw_sample_t * (* get_buffer_from_sound_device)(cw_gen_t * gen) = gen->get_buffer_from_sound_device;
+	gen->write_buffer_to_sound_device = cw_gen_render_write_buffer_internal;
+	gen->get_buffer_from_sound_device = NULL;
+	gen->render.failed = false;
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+
+	while (true) {
+		cw_gen_text_source_pull_internal(gen);
+		const size_t len_before = cw_tq_length_internal(gen->tq);
+		if (CW_TQ_EMPTY == cw_tq_dequeue_internal(gen->tq, &tone)) {
+			break;
+		}
+
+		if (!cw_gen_tone_samples_size_is_valid_internal(gen, &tone)) {
+			cw_gen_tone_calculate_samples_size_internal(gen, &tone);
+		}
+		cw_gen_write_to_soundcard_internal(gen, &tone);
+
+		if (tone.is_forever && 1 == len_before) {
+			/* Last "forever" tone is never removed from queue
+			   by dequeue function. It would last forever,
+			   so render it only once. */
+			cw_tq_flush_internal(gen->tq);
+		}
+	}
+
+	/* Last, partially filled buffer. */
+	if (gen->buffer_sub_start > 0) {
+		cw_gen_render_append_internal(gen, gen->buffer, (size_t) gen->buffer_sub_start);
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = 0;
+	}
+
+	gen->write_buffer_to_sound_device = write_buffer_to_sound_device;
+	gen->get_buffer_from_sound_device = get_buffer_from_sound_device;
+
+	if (gen->render.failed) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_render_to_buffer(cw_gen_t * gen, cw_sample_t * buffer, size_t size, size_t * n_samples)
+{
+	*n_samples = 0;
+
+	if (CW_SUCCESS != cw_gen_render_queue_internal(gen)) {
+		return CW_FAILURE;
+	}
+
+	size_t available = gen->render.n_samples - gen->render.read_pos;
+	if (available > size) {
+		available = size;
+	}
+	if (available > 0) {
+		memcpy(buffer, gen->render.samples + gen->render.read_pos, available * sizeof (cw_sample_t));
+		gen->render.read_pos += available;
+	}
+	if (gen->render.read_pos == gen->render.n_samples) {
+		/* Everything has been retrieved, start from beginning
+		   of the buffer. */
+		gen->render.read_pos = 0;
+		gen->render.n_samples = 0;
+	}
+
+	*n_samples = available;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_render_string(cw_gen_t * gen, const char * string, cw_sample_t ** buffer, size_t * n_samples)
+{
+	*buffer = NULL;
+	*n_samples = 0;
+
+	if (!cw_string_is_valid(string)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	for (size_t i = 0; string[i] != '\0'; i++) {
+		if (CW_SUCCESS == cw_gen_enqueue_character(gen, string[i])) {
+			continue;
+		}
+		if (EAGAIN != errno) {
+			return CW_FAILURE;
+		}
+
+		/* Tone queue is full. Move its tones into buffer of
+		   rendered samples, and try again. */
+		if (CW_SUCCESS != cw_gen_render_queue_internal(gen)) {
+			return CW_FAILURE;
+		}
+		if (CW_SUCCESS != cw_gen_enqueue_character(gen, string[i])) {
+			return CW_FAILURE;
+		}
+	}
+
+	if (CW_SUCCESS != cw_gen_render_queue_internal(gen)) {
+		return CW_FAILURE;
+	}
+
+	/* Pass ownership of not yet retrieved samples to caller. */
+	const size_t available = gen->render.n_samples - gen->render.read_pos;
+	if (gen->render.read_pos > 0) {
+		memmove(gen->render.samples, gen->render.samples + gen->render.read_pos, available * sizeof (cw_sample_t));
+	}
+	*buffer = gen->render.samples;
+	*n_samples = available;
+
+	gen->render.samples = NULL;
+	gen->render.capacity = 0;
+	gen->render.n_samples = 0;
+	gen->render.read_pos = 0;
+
+	return CW_SUCCESS;
+}
@@ -9,15 +9,31 @@
 
 
 
+#include "config.h"
+
+
+
+
+#include <limits.h>   /* UCHAR_MAX */
+
+
+
+
 #include "libcw.h"
 #include "libcw2.h"
 
 #include "cw_config.h"
 #include "libcw_alsa.h"
 #include "libcw_console.h"
+#include "libcw_data.h"
+#include "libcw_file.h"
+#include "libcw_impair.h"
+#include "libcw_jack.h"
 #include "libcw_key.h"
 #include "libcw_oss.h"
 #include "libcw_pa.h"
+#include "libcw_rtp.h"
+#include "libcw_tap.h"
 #include "libcw_tq.h"
 
 
@@ -52,6 +68,113 @@ enum { CW_SYMBOL_SPACE = ' ' };
 
 
 
+/* Engines used by generator to calculate samples of sine wave. */
+typedef enum cw_gen_oscillator_t {
+	/* Integer phase accumulator + linearly interpolated sine table.
+	   This is the default engine. */
+	CW_GEN_OSCILLATOR_TABLE = 0,
+
+	/* Original engine: sinf() is called for every sample. Kept so
+	   that output of the two engines can be compared in tests. */
+	CW_GEN_OSCILLATOR_SINF
+} cw_gen_oscillator_t;
+
+
+
+
+/* Count of entries in generator's cache of pre-rendered tones. Enough
+   for a dot and a dash, plus a few spare entries for tones of slightly
+   different lengths produced e.g. by keyers. */
+#define CW_GEN_PCM_CACHE_CAPACITY           4
+
+/* Tones longer than this are not cached. The value is enough to cache a
+   dash at lowest speed and highest weighting, at 48kHz sample rate. */
+#define CW_GEN_PCM_CACHE_N_SAMPLES_MAX      (1 << 17)
+
+
+
+
+/* Single entry in generator's cache of pre-rendered tones. */
+typedef struct cw_gen_pcm_cache_entry_t {
+	/* Key of the entry: parameters of a tone that, together with
+	   generator's slope table, fully describe samples of the tone. */
+	int frequency;
+	int volume_abs;
+	cw_tone_slope_mode_t slope_mode;
+	cw_sample_iter_t n_samples;
+	cw_sample_iter_t rising_slope_n_samples;
+	cw_sample_iter_t falling_slope_n_samples;
+
+	/* Generation of cache at the moment of rendering of the
+	   entry. Entries from older generations are invalid. */
+	unsigned int generation;
+
+	/* Samples of the tone, and size of the allocated buffer. */
+	cw_sample_t * samples;
+	cw_sample_iter_t capacity;
+} cw_gen_pcm_cache_entry_t;
+
+
+
+
+/* Amplitude of a sample of tone's slope, before generator's volume is
+   applied. In fixed-point build this is a Q15 number (CW_GEN_AMPLITUDE_ONE
+   corresponds to 1.0), so that samples can be calculated without floating
+   point arithmetic. */
+#ifdef LIBCW_FIXED_POINT
+typedef uint16_t cw_gen_amplitude_t;
+#define CW_GEN_AMPLITUDE_ONE  32768
+#else
+typedef float cw_gen_amplitude_t;
+#define CW_GEN_AMPLITUDE_ONE  1.0F
+#endif
+
+
+
+
+/* Table of amplitudes of PCM samples that form tone's slope.
+
+   Tables are kept in process-wide cache and are shared by all generators
+   that use slopes of the same shape and the same count of samples. The
+   amplitudes are in range 0.0-1.0 (0-CW_GEN_AMPLITUDE_ONE), generator's
+   volume is applied as a separate gain, so change of volume doesn't
+   require new table. */
+typedef struct cw_gen_slope_table_t {
+	int shape;
+	int n_amplitudes;
+
+	/* Count of generators using the table. Protected by mutex of
+	   the cache. */
+	int n_users;
+
+	/* The table has been locked in memory for a generator with
+	   cw_gen_config_t::lock_memory, and is unlocked when it is
+	   deallocated. Protected by mutex of the cache. */
+	bool is_locked;
+
+	struct cw_gen_slope_table_t * next;
+
+	cw_gen_amplitude_t amplitudes[];
+} cw_gen_slope_table_t;
+
+
+
+
+/* Tones of a single character (Marks, each followed by inter-mark-space),
+   compiled for current parameters of generator. Count of samples and of
+   slope samples is already calculated for each tone. */
+typedef struct cw_gen_char_tones_t {
+	/* Generation of table of characters at the moment of compilation
+	   of the entry. Entries from older generations are invalid. */
+	unsigned int generation;
+
+	int n_tones;
+	cw_tone_t tones[2 * CW_DATA_MAX_REPRESENTATION_LENGTH];
+} cw_gen_char_tones_t;
+
+
+
+
 typedef struct cw_gen_durations_t {
 	int unit_duration;
 	int weighting_duration;
@@ -116,6 +239,18 @@ struct cw_gen_struct {
 	int additional_space_duration; /* Duration of additional space at the end of a character. [us] */
 	int adjustment_space_duration; /* Duration of adjustment space at the end of a word. [us] */
 
+	/* Snapshot of timing parameters and of frequency, published by
+	   client code's thread for generator's thread, which uses it to
+	   resolve symbolic durations of dequeued tones (see
+	   cw_tone_t::elements). Odd value of ->sequence means that the
+	   snapshot is being updated. See
+	   cw_gen_timing_publish_internal(). */
+	struct {
+		uint32_t sequence;
+		int frequency;
+		int durations[CW_TONE_ELEMENT_MAX]; /* [us] */
+	} timing;
+
 
 
 
@@ -153,6 +288,12 @@ struct cw_gen_struct {
 	   probably audible clicks. */
 	cw_sample_t * buffer;
 
+	/* Memory into which samples of current buffer are being
+	   calculated. Usually this is ::buffer, but sound system may
+	   provide its own memory (see ::get_buffer_from_sound_device).
+	   NULL means ::buffer. */
+	cw_sample_t * buffer_target;
+
 	/* Size of data buffer, in samples.
 
 	   The size may be restricted (min,max) by current sound system
@@ -170,6 +311,27 @@ struct cw_gen_struct {
 	   type). */
 	int buffer_n_samples;
 
+	/* Count of channels of sound device. gen->buffer always holds
+	   mono 16-bit samples. With more than one channel, or with
+	   'sample_format' other than CW_SAMPLE_FORMAT_S16, the samples
+	   are routed to channels of sound device with
+	   'sound_channel_volumes' [%], into interleaved 'frames'
+	   (buffer_n_samples * n_sound_channels samples in
+	   'sample_format', 'sample_size' bytes each), and sound system
+	   writes 'frames' instead of gen->buffer. Otherwise 'frames' is
+	   NULL. See cw_gen_frames_internal(). */
+	int n_sound_channels;
+	int sound_channel_volumes[CW_SOUND_CHANNELS_MAX];
+	cw_sample_format_t sample_format;
+	size_t sample_size;
+	void * frames;
+
+	/* Taps that play gen->buffer on more sound sinks, see
+	   cw_gen_add_tap(). NULL if generator has no taps. With taps,
+	   gen->buffer points to samples of a shared block that is
+	   replaced after each full buffer is written. */
+	cw_gen_fanout_t * fanout;
+
 
 	/* We need two indices to gen->buffer, indicating beginning
 	   and end of a subarea in the buffer.  The subarea is not
@@ -206,6 +368,19 @@ struct cw_gen_struct {
 	int buffer_sub_start;
 	int buffer_sub_stop;
 
+	/* Count of samples at the beginning of gen->buffer that are
+	   ready to be written by ->write_buffer_to_sound_device(). This
+	   is usually gen->buffer_n_samples, but in low-latency keying
+	   mode a buffer may be written before it is full. */
+	int buffer_write_n_samples;
+
+	/* Write the buffer to sound system at boundaries of
+	   CW_GEN_KEYING_SUB_BLOCK_N_SAMPLES samples while a "forever" tone
+	   of straight key is generated, so that a key event doesn't have
+	   to wait for the rest of the buffer. See
+	   cw_gen_config_t::low_latency_keying. */
+	bool low_latency_keying;
+
 	/* Set to the same value of sample rate as configured on sound
 	   sink. */
 	unsigned int sample_rate;
@@ -215,6 +390,136 @@ struct cw_gen_struct {
 	   function calculating consecutive fragments of sine wave. */
 	float phase_offset;
 
+	/* Engine calculating samples of sine wave. */
+	cw_gen_oscillator_t oscillator;
+
+	/* Phase of sine wave used by CW_GEN_OSCILLATOR_TABLE engine. Full
+	   range of the variable (2^32) corresponds to 2*Pi. Overflow of
+	   the accumulator is the modulo operation on phase, so the phase
+	   never needs to be normalized. */
+	uint32_t phase_accumulator;
+
+	/* Cache of pre-rendered tones.
+
+	   With constant speed, frequency, volume and slopes, every dot
+	   generated by generator has exactly the same samples as all
+	   previous dots (and every dash has the same samples as all
+	   previous dashes). Such tones are rendered only once and then
+	   copied from the cache.
+
+	   To make this possible, phase of sine wave is reset to zero at
+	   the beginning of every cached tone. Only tones with standard
+	   slopes are cached: they start and end with zero amplitude, so
+	   the reset of phase is inaudible.
+
+	   The cache is invalidated by incrementing ::generation. This is
+	   done by client code's thread, while entries are read and written
+	   only by generator's thread. */
+	struct {
+		bool enabled;
+		volatile unsigned int generation;
+		cw_gen_pcm_cache_entry_t entries[CW_GEN_PCM_CACHE_CAPACITY];
+		int next_entry; /* Entry to be replaced on next cache miss. */
+
+		unsigned int n_hits;
+		unsigned int n_misses;
+	} pcm_cache;
+
+	/* Table of characters compiled into ready-made sequences of tones,
+	   see cw_gen_char_tones_lookup_internal(). An entry is allocated
+	   on first use of given character, and is compiled again if it is
+	   older than ::generation. The generation is incremented when
+	   timing parameters, frequency or slopes of generator change. The
+	   table is used only by client code's thread. */
+	struct {
+		cw_gen_char_tones_t * entries[UCHAR_MAX + 1];
+		unsigned int generation;
+	} char_tones;
+
+	/* Alphabet of strings enqueued with cw_gen_enqueue_utf8_string(). */
+	cw_alphabet_t alphabet;
+
+	/* Offline rendering, see cw_gen_render_to_buffer(). Samples
+	   rendered from tone queue, but not yet retrieved by client
+	   code. */
+	struct {
+		cw_sample_t * samples;
+		size_t capacity;   /* Size of ::samples [samples]. */
+		size_t n_samples;  /* Count of rendered samples in ::samples. */
+		size_t read_pos;   /* Index of first sample not yet retrieved by client code. */
+		bool failed;       /* Some samples couldn't be added to ::samples. */
+	} render;
+
+	/* Latency statistics, see cw_gen_get_latency_stats(). Updated by
+	   generator's thread, read by client code's thread. Updates of
+	   ::stats are serialized by ::mutex, and make ::seq odd while they
+	   are in progress, so that readers can take a consistent copy
+	   without the mutex (see cw_gen_latency_snapshot_internal()). */
+	struct {
+		pthread_mutex_t mutex;
+		unsigned int seq;
+		cw_gen_latency_stats_t stats;
+
+		/* Enqueue and dequeue times of the earliest tone that
+		   starts in the buffer that is currently being filled with
+		   samples. Zero if no such tone has been dequeued yet. */
+		int64_t buffer_enqueue_time;
+		int64_t buffer_dequeue_time;
+	} latency;
+
+	/* Impairments of radio channel added to samples, see
+	   cw_gen_set_impairments(). */
+	cw_impair_t impair;
+
+	/* Estimation of time at which samples are heard by user, see
+	   cw_gen_sound_timestamp_internal(). Used only by the thread
+	   that generates samples. */
+	struct {
+		/* Time at which first sample following the samples
+		   written so far will be heard, as estimated at the
+		   last write [ns]. Zero if nothing has been written
+		   yet. */
+		int64_t anchor_time;
+	} sound_clock;
+
+	/* Counters of writes to sound system, see cw_gen_get_stats().
+	   Updated with atomic operations by generator's thread (and by
+	   thread of sound system, e.g. PulseAudio's mainloop). */
+	cw_gen_stats_t stats;
+
+	/* Timing of tones by sound systems that don't have sound device
+	   measuring time for them (Null and Console), see
+	   cw_gen_pace_tone_internal(). */
+	struct {
+		/* Time of monotonic clock at which current tone should
+		   end [us]. Zero if there is no current tone (generator
+		   has been idle). */
+		int64_t deadline;
+	} pacing;
+
+	/* Idle mode of generator's thread, see
+	   cw_gen_config_t::idle_timeout. Used by generator's thread,
+	   except for ::timer_expired, which is set by callback of timer
+	   while holding wait_mutex of tone queue, and for ::active_since
+	   and ::idle_since, which are read by cw_gen_get_stats() with
+	   atomic operations. */
+	struct {
+		unsigned int timeout; /* [us], zero if idle mode is disabled. */
+		int timer_id;         /* Timer started on empty tone queue, -1 if not started. */
+		bool timer_expired;
+		bool is_idle;
+
+		/* Time of dequeue of first of consecutive silent
+		   'forever' tones [ns]. Zero if last dequeued tone
+		   wasn't such tone. */
+		int64_t silence_start;
+
+		/* Start of current active or idle period [ns]. Zero if
+		   generator is not in such period. */
+		int64_t active_since;
+		int64_t idle_since;
+	} idle;
+
 
 
 	/* Tone parameters. */
@@ -240,22 +545,26 @@ struct cw_gen_struct {
 		/* Linear/raised cosine/sine/rectangle. */
 		int shape;
 
-		/* Table of amplitudes of every PCM sample of tone's
-		   slope.
+		/* Shared table of slope amplitudes, NULL for slopes
+		   with zero samples. */
+		cw_gen_slope_table_t * table;
+
+		/* Amplitudes of every PCM sample of tone's slope,
+		   ->table->amplitudes[] (or NULL).
 
-		   The values in amplitudes[] change from zero to max
+		   The values in amplitudes[] change from zero to one
 		   (at least for any sane slope shape), so naturally
 		   they can be used in forming rising slope. However
 		   they can be used in forming falling slope as well -
 		   just iterate the table from end to beginning.
 
-		   TODO: it seems that amplitudes can be
-		   integers. Investigate it. */
-		float * amplitudes;
+		   The values must be multiplied by generator's
+		   volume. */
+		const cw_gen_amplitude_t * amplitudes;
 
 		/* This is a secondary parameter, derived from
-		   ->duration. n_amplitudes is useful when iterating over
-		   ->amplitudes[] or reallocing the ->amplitudes[]. */
+		   ->duration and sample rate. n_amplitudes is useful
+		   when iterating over ->amplitudes[]. */
 		int n_amplitudes;
 	} tone_slope;
 
@@ -314,6 +623,103 @@ struct cw_gen_struct {
 		bool running;
 	} thread;
 
+	/* State of generator working in pull mode.
+
+	   In pull mode the generator doesn't have its own thread.
+	   Sound server (e.g. JACK) calls cw_gen_pull_samples_internal()
+	   from its own (real-time) callback, and the function dequeues
+	   tones and calculates samples right into memory provided by
+	   the server. */
+	struct {
+		/* Set by sound system that works in pull mode, in its
+		   init function, or when client code asks for pull
+		   mode in generator's configuration. */
+		bool enabled;
+
+		/* Samples are pulled by client code with
+		   cw_gen_fill_buffer(), not by sound system. Client code
+		   may stop pulling at any time, so generator can't wait
+		   for the pulls. */
+		bool by_client_code;
+
+		/* Generator has been started and not stopped yet. */
+		volatile bool active;
+
+		/* Tone that is being generated. A tone may span many
+		   calls to cw_gen_pull_samples_internal(). */
+		cw_tone_t tone;
+		bool tone_in_progress;
+
+		/* Tone generated before ::tone. */
+		cw_tone_t prev_tone;
+	} pull;
+
+	/* Dispatch thread calling client's callbacks, see
+	   cw_gen_config_t::callbacks_in_dispatch_thread. NULL if
+	   callbacks are called directly. */
+	struct cw_dispatch_t * dispatch;
+
+	/* Source of text registered with
+	   cw_gen_register_text_source(). */
+	struct {
+		/* Serializes calls to ::source_func and enqueueing of
+		   pulled characters: client code registers the source
+		   (and pulls first characters) in its own thread. */
+		pthread_mutex_t mutex;
+
+		cw_gen_text_source_t source_func;
+		void * source_arg;
+	} text_source;
+
+	/* State of generator driven by worker threads of scheduler
+	   (see cw_gen_start_with_sched()). Such generator uses ::pull
+	   to generate samples into its own buffer, and has no thread.
+
+	   ::deadline and ::busy are protected by mutex of scheduler. */
+	struct {
+		/* Scheduler driving the generator. NULL if generator is
+		   not scheduled. */
+		cw_sched_t * sched;
+
+		/* Time at which next buffer of the generator is due [ns],
+		   see cw_clock_now_internal(). */
+		int64_t deadline;
+
+		/* A worker is generating samples of the generator. */
+		bool busy;
+
+		/* Buffers are due at pace of real time. */
+		bool paced;
+
+		/* Nothing has been played in last step. */
+		bool idle;
+	} scheduling;
+
+	/* Real-time properties of generator, requested in generator's
+	   configuration. Scheduling and CPU affinity are applied by
+	   generator's thread itself, memory is locked in cw_gen_new() and
+	   cw_gen_set_tone_slope(). */
+	struct {
+		int sched_policy;
+		int sched_priority;
+		uint64_t cpu_set;
+		bool lock_memory;
+
+		/* Generator's own page-aligned memory locked with
+		   mlock(), to be unlocked in cw_gen_delete(). */
+		struct {
+			void * addr;
+			size_t size;
+		} locked_areas[3];
+		int n_locked_areas;
+
+		/* Status is written by generator's thread and by
+		   thread of client code, and read by
+		   cw_gen_get_realtime_status(). */
+		pthread_mutex_t status_mutex;
+		cw_gen_realtime_status_t status;
+	} realtime;
+
 	/* start/stop flag.
 	   Set to true before running dequeue_and_play thread
 	   function.
@@ -321,6 +727,13 @@ struct cw_gen_struct {
 	   dequeue_and_generate thread function. */
 	bool do_dequeue_and_generate;
 
+	/* Generator has been paused with cw_gen_pause(). Thread of
+	   generator waits in cw_gen_pause_wait_internal() with its
+	   sound sink paused but open; generator in pull mode (or
+	   scheduled one) gives only silence. Set by client's thread
+	   while holding wait_mutex of tone queue. */
+	volatile bool paused;
+
 	bool silencing_initialized;
 
 
@@ -360,6 +773,24 @@ struct cw_gen_struct {
 	cw_ret_t (* write_buffer_to_sound_device)(cw_gen_t * gen);
 	cw_ret_t (* write_tone_to_sound_device)(cw_gen_t * gen, const cw_tone_t * tone);
 
+	/**
+	   @brief Get memory of sound device into which next buffer of samples will be calculated
+
+	   Called when generator starts calculating samples of new buffer
+	   (of size ::buffer_n_samples). Sound system may return a pointer
+	   to its own memory (e.g. mmapped ring buffer of sound card), so
+	   that samples don't have to be copied from ::buffer by
+	   ::write_buffer_to_sound_device.
+
+	   A sound system may not set this function pointer.
+
+	   @param[in/out] gen generator with opened sound sink
+
+	   @return pointer to memory for buffer_n_samples samples
+	   @return NULL if generator should use ::buffer
+	*/
+	cw_sample_t * (* get_buffer_from_sound_device)(cw_gen_t * gen);
+
 	/**
 	   @brief Do some housekeeping of sound sink when tone queue goes completely empty
 
@@ -372,6 +803,48 @@ struct cw_gen_struct {
 	*/
 	cw_ret_t (* on_empty_queue)(cw_gen_t * gen);
 
+	/**
+	   @brief Pause sound sink when generator enters idle mode
+
+	   See cw_gen_config_t::idle_timeout. A sound system may not set
+	   this function pointer.
+
+	   @param[in/out] gen generator with opened sound sink
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE on failure
+	*/
+	cw_ret_t (* on_idle)(cw_gen_t * gen);
+
+	/**
+	   @brief Resume sound sink paused by on_idle() before next samples are written
+
+	   A sound system may not set this function pointer.
+
+	   @param[in/out] gen generator with opened sound sink
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE on failure
+	*/
+	cw_ret_t (* on_resume)(cw_gen_t * gen);
+
+	/**
+	   @brief Get current delay of sound sink
+
+	   Delay is duration of samples that have been written to sound
+	   sink, but have not been played yet. The function is called
+	   from client's thread by cw_gen_get_output_latency(), while
+	   generator's thread may be writing to the sound sink. A sound
+	   system may not set this function pointer.
+
+	   @param[in] gen generator with opened sound sink
+	   @param[out] delay delay of sound sink [microseconds]
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE on failure
+	*/
+	cw_ret_t (* get_device_delay)(cw_gen_t * gen, int64_t * delay);
+
 	/*
 	  Current value of generator, as dictated by value of the tone
 	  that has been most recently dequeued. Value tracking
@@ -390,6 +863,23 @@ struct cw_gen_struct {
 
 		cw_gen_value_tracking_callback_t value_tracking_callback_func;
 		void * value_tracking_callback_arg;
+
+		/* Callback that also gets time at which the value is
+		   heard, see cw_gen_register_timed_value_tracking_callback(). */
+		cw_gen_timed_value_tracking_callback_t timed_callback_func;
+		void * timed_callback_arg;
+
+		/* Keying output keyed with the value (see
+		   libcw_keying.c). The mutex protects the pointer:
+		   keying output can be started and stopped while the
+		   generator is running. */
+		cw_keying_t * keying;
+		pthread_mutex_t keying_mutex;
+
+		/* Keying log recording the value, with time at which
+		   it's heard (see libcw_keylog.c). Protected by
+		   keying_mutex. */
+		cw_keylog_t * keylog;
 	} value_tracking;
 
 
@@ -398,6 +888,12 @@ struct cw_gen_struct {
 
 	cw_console_data_t console;
 
+	/* Data used by File sound system. */
+	cw_file_data_t file_data;
+
+	/* Data used by RTP. */
+	cw_rtp_data_t rtp_data;
+
 #ifdef LIBCW_WITH_OSS
 	/* Data used by OSS. */
 	cw_oss_data_t oss_data;
@@ -413,6 +909,11 @@ struct cw_gen_struct {
 	cw_pa_data_t pa_data;
 #endif
 
+#ifdef LIBCW_WITH_JACK
+	/* Data used by JACK. */
+	cw_jack_data_t jack_data;
+#endif
+
 };
 
 
@@ -450,6 +951,24 @@ void cw_generator_delete_internal(void);
 void cw_gen_reset_parameters_internal(cw_gen_t * gen);
 void cw_gen_sync_parameters_internal(cw_gen_t * gen);
 void cw_gen_calculate_durations_internal(cw_gen_durations_t * durations, int speed, int weighting);
+cw_ret_t cw_gen_set_oscillator_internal(cw_gen_t * gen, cw_gen_oscillator_t oscillator);
+void cw_gen_set_pcm_cache_internal(cw_gen_t * gen, bool enabled);
+void cw_gen_pcm_cache_invalidate_internal(cw_gen_t * gen);
+void cw_gen_char_tones_invalidate_internal(cw_gen_t * gen);
+void cw_gen_latency_set_sound_device_latency_internal(cw_gen_t * gen, int64_t latency);
+int64_t cw_gen_latency_get_sound_device_latency_internal(cw_gen_t * gen);
+void cw_gen_latency_snapshot_internal(cw_gen_t * gen, cw_gen_latency_stats_t * stats);
+void cw_gen_stats_add_write_internal(cw_gen_t * gen, cw_ret_t cwret, int n_samples, int64_t blocked_time);
+void cw_gen_stats_add_xruns_internal(cw_gen_t * gen, unsigned int n_xruns);
+void cw_gen_stats_add_recovery_internal(cw_gen_t * gen);
+void cw_gen_stats_add_short_write_internal(cw_gen_t * gen, int n_samples);
+void cw_gen_pace_tone_internal(cw_gen_t * gen, int duration);
+void cw_gen_apply_thread_realtime_internal(cw_gen_t * gen);
+const void * cw_gen_frames_internal(cw_gen_t * gen);
+void cw_gen_route_samples_internal(const cw_sample_t * samples, int n_samples, const int * volumes, int n_channels, cw_sample_format_t format, void * frames);
+size_t cw_sample_format_size_internal(cw_sample_format_t format);
+void cw_gen_pull_samples_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples);
+int64_t cw_gen_sched_step_internal(cw_gen_t * gen, int64_t deadline, int64_t now);
 
 cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name, enum cw_audio_systems sound_system, char * picked_device_name, size_t size);
 
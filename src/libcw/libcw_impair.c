@@ -0,0 +1,678 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_impair.c
+
+   @brief Impairments of radio channel: noise, QSB, QRN and chirp.
+
+   Generator calls cw_impair_apply_internal() on every block of
+   samples right after the block has been calculated (while it's still
+   in cache), and cw_impair_chirp_internal() before its oscillator
+   calculates a block of a Mark.
+
+   Processing of samples uses only integer arithmetic (the library
+   may be built with LIBCW_FIXED_POINT); floating point is used only
+   to calculate coefficients when impairments or generator's frequency
+   change.
+
+   Noise is calculated in three steps over a block of samples. First
+   CW_IMPAIR_NOISE_LANES independent xorshift32 generators produce
+   white noise, one sample per generator, which compiler turns into
+   vector instructions. Then a scalar loop adds crashes and limits
+   band of the noise with two-pole resonator (both are recurrences, so
+   they can't be vectorized). Finally the noise is added to samples
+   faded by QSB, in a loop that again can be vectorized.
+
+   Interference of other stations (QRM) is not simulated here: mixer
+   of generators (see cw_mixer_new()) already plays many stations at
+   once, each of them with its own impairments.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_impair.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/impair: "
+
+/* Time constant of decay of crash [ms]. */
+#define CW_IMPAIR_QRN_DECAY_TIME 10.0F
+
+/* Full scale of gains and of sine of oscillator, Q15. */
+#define CW_IMPAIR_ONE 32768
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static const float CW_IMPAIR_PI = 3.14159265358979323846F;
+
+
+
+
+static bool     cw_impair_is_valid_internal(const cw_impairments_t * impairments);
+static void     cw_impair_seed_internal(cw_impair_t * impair, uint32_t seed);
+static uint32_t cw_impair_random_internal(cw_impair_t * impair);
+static void     cw_impair_calculate_coefficients_internal(cw_impair_t * impair);
+static void     cw_impair_fill_noise_internal(cw_impair_t * impair, int32_t * noise, int n);
+static void     cw_impair_shape_noise_internal(cw_impair_t * impair, int32_t * noise, int n);
+static int32_t  cw_impair_qsb_gain_internal(const cw_impair_t * impair, uint32_t phase);
+static int64_t  cw_impair_chirp_offset_internal(const cw_impair_t * impair, int t);
+static void     cw_impair_apply_block_internal(cw_impair_t * impair, cw_sample_t * samples, int n);
+
+
+
+
+/**
+   @brief Initialize impairments of generator: no impairments
+
+   @param[out] impair impairments to initialize
+*/
+void cw_impair_init_internal(cw_impair_t * impair)
+{
+	memset(impair, 0, sizeof (cw_impair_t));
+	pthread_mutex_init(&impair->mutex, NULL);
+	return;
+}
+
+
+
+
+/**
+   @brief Release resources of impairments of generator
+
+   @param[in] impair impairments
+*/
+void cw_impair_destroy_internal(cw_impair_t * impair)
+{
+	pthread_mutex_destroy(&impair->mutex);
+	return;
+}
+
+
+
+
+/**
+   @brief Check ranges of fields of impairments
+
+   @param[in] impairments impairments to check
+
+   @return true if all fields are in range
+   @return false otherwise
+*/
+static bool cw_impair_is_valid_internal(const cw_impairments_t * impairments)
+{
+	const cw_impairments_t * imp = impairments;
+
+	if (imp->noise_level < 0 || imp->noise_level > CW_IMPAIRMENT_LEVEL_MAX) {
+		return false;
+	}
+	if (imp->noise_bandwidth != 0
+	    && (imp->noise_bandwidth < CW_IMPAIRMENT_NOISE_BANDWIDTH_MIN || imp->noise_bandwidth > CW_IMPAIRMENT_NOISE_BANDWIDTH_MAX)) {
+		return false;
+	}
+	if (imp->qsb_depth < 0 || imp->qsb_depth > CW_IMPAIRMENT_LEVEL_MAX) {
+		return false;
+	}
+	if ((imp->qsb_depth > 0 || imp->qsb_period != 0)
+	    && (imp->qsb_period < CW_IMPAIRMENT_QSB_PERIOD_MIN || imp->qsb_period > CW_IMPAIRMENT_QSB_PERIOD_MAX)) {
+		/* Fading without period makes no sense. */
+		return false;
+	}
+	if (imp->qrn_rate < 0 || imp->qrn_rate > CW_IMPAIRMENT_QRN_RATE_MAX) {
+		return false;
+	}
+	if (imp->qrn_level < 0 || imp->qrn_level > CW_IMPAIRMENT_LEVEL_MAX) {
+		return false;
+	}
+	if (imp->chirp_depth < -CW_IMPAIRMENT_CHIRP_DEPTH_MAX || imp->chirp_depth > CW_IMPAIRMENT_CHIRP_DEPTH_MAX) {
+		return false;
+	}
+	if (imp->chirp_duration < 0 || imp->chirp_duration > CW_IMPAIRMENT_CHIRP_DURATION_MAX) {
+		return false;
+	}
+	return true;
+}
+
+
+
+
+/**
+   @brief Set new impairments, to be taken by generator's thread
+
+   Generator's thread picks up the impairments in
+   cw_impair_sync_internal() before calculating next fragment of
+   samples.
+
+   @exception EINVAL a field of @p impairments is out of range
+
+   @param[in] impair impairments of generator
+   @param[in] impairments new impairments
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_impair_set_internal(cw_impair_t * impair, const cw_impairments_t * impairments)
+{
+	if (!cw_impair_is_valid_internal(impairments)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid impairments");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&impair->mutex);
+	impair->pending = *impairments;
+	__atomic_add_fetch(&impair->pending_seq, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&impair->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get impairments most recently set by client code
+
+   @param[in] impair impairments of generator
+   @param[out] impairments current impairments
+*/
+void cw_impair_get_internal(cw_impair_t * impair, cw_impairments_t * impairments)
+{
+	pthread_mutex_lock(&impair->mutex);
+	*impairments = impair->pending;
+	pthread_mutex_unlock(&impair->mutex);
+	return;
+}
+
+
+
+
+/**
+   @brief Take new impairments and recalculate coefficients if needed
+
+   Called by generator's thread before calculating a fragment of
+   samples. Cheap if nothing has changed: one atomic load and two
+   comparisons.
+
+   @param[in] impair impairments of generator
+   @param[in] frequency current frequency of generator
+   @param[in] sample_rate sample rate of generator
+*/
+void cw_impair_sync_internal(cw_impair_t * impair, int frequency, int sample_rate)
+{
+	const unsigned int seq = __atomic_load_n(&impair->pending_seq, __ATOMIC_ACQUIRE);
+	if (seq != impair->applied_seq) {
+		pthread_mutex_lock(&impair->mutex);
+		impair->params = impair->pending;
+		impair->applied_seq = impair->pending_seq;
+		pthread_mutex_unlock(&impair->mutex);
+
+		uint32_t seed = impair->params.seed;
+		if (0 == seed) {
+			seed = (uint32_t) cw_monotonic_usecs_internal() ^ (uint32_t) (uintptr_t) impair;
+		}
+		cw_impair_seed_internal(impair, seed);
+
+	} else if (frequency == impair->frequency && sample_rate == impair->sample_rate) {
+		return;
+	}
+
+	impair->frequency = frequency;
+	impair->sample_rate = sample_rate;
+	cw_impair_calculate_coefficients_internal(impair);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Seed generators of random numbers
+
+   States of generators are derived from @p seed with mixing function
+   of splitmix32, so that similar seeds give unrelated noise.
+
+   @param[in] impair impairments of generator
+   @param[in] seed seed
+*/
+static void cw_impair_seed_internal(cw_impair_t * impair, uint32_t seed)
+{
+	for (int i = 0; i <= CW_IMPAIR_NOISE_LANES; i++) {
+		uint32_t x = seed + 0x9e3779b9U * (uint32_t) (i + 1);
+		x = (x ^ (x >> 16)) * 0x85ebca6bU;
+		x = (x ^ (x >> 13)) * 0xc2b2ae35U;
+		x = x ^ (x >> 16);
+		if (0 == x) {
+			/* xorshift32 never leaves zero state. */
+			x = 1;
+		}
+		if (i < CW_IMPAIR_NOISE_LANES) {
+			impair->lanes[i] = x;
+		} else {
+			impair->random = x;
+		}
+	}
+
+	impair->qsb_phase = cw_impair_random_internal(impair);
+	impair->qrn_countdown = 0;
+	impair->qrn_amplitude = 0;
+	impair->y1 = 0;
+	impair->y2 = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get next random number for moments and sizes of crashes
+
+   @param[in] impair impairments of generator
+
+   @return random number
+*/
+static uint32_t cw_impair_random_internal(cw_impair_t * impair)
+{
+	uint32_t x = impair->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	impair->random = x;
+	return x;
+}
+
+
+
+
+/**
+   @brief Calculate coefficients of impairments for current parameters,
+   frequency and sample rate
+
+   @param[in] impair impairments of generator
+*/
+static void cw_impair_calculate_coefficients_internal(cw_impair_t * impair)
+{
+	const cw_impairments_t * params = &impair->params;
+	const int sample_rate = impair->sample_rate;
+	if (sample_rate <= 0) {
+		impair->active = false;
+		return;
+	}
+	const float fs = (float) sample_rate;
+
+
+	impair->noise_gain = params->noise_level * CW_IMPAIR_ONE / CW_IMPAIRMENT_LEVEL_MAX;
+
+
+	/* Two-pole resonator at generator's frequency, with gain
+	   normalized so that power of noise doesn't depend on
+	   bandwidth. */
+	impair->has_resonator = params->noise_bandwidth > 0 && impair->frequency > 0 && 2 * impair->frequency < sample_rate;
+	if (impair->has_resonator) {
+		const float r = expf(-CW_IMPAIR_PI * (float) params->noise_bandwidth / fs);
+		const float a1 = 2.0F * r * cosf(2.0F * CW_IMPAIR_PI * (float) impair->frequency / fs);
+		const float a2 = r * r;
+		const float b0 = sqrtf((1.0F - a2) * ((1.0F + a2) * (1.0F + a2) - a1 * a1) / (1.0F + a2));
+
+		impair->a1 = (int32_t) lrintf(a1 * 16384.0F);
+		impair->a2 = (int32_t) lrintf(a2 * 16384.0F);
+		impair->b0 = (int32_t) lrintf(b0 * 16384.0F);
+	} else {
+		impair->y1 = 0;
+		impair->y2 = 0;
+	}
+
+
+	if (params->qsb_depth > 0) {
+		const uint64_t period = (uint64_t) params->qsb_period * (uint64_t) sample_rate / 1000;
+		impair->qsb_increment = (uint32_t) ((UINT64_C(1) << 32) / period);
+		impair->qsb_depth = params->qsb_depth * CW_IMPAIR_ONE / CW_IMPAIRMENT_LEVEL_MAX;
+	} else {
+		impair->qsb_increment = 0;
+		impair->qsb_depth = 0;
+	}
+
+
+	if (params->qrn_rate > 0 && params->qrn_level > 0) {
+		impair->qrn_interval = (int64_t) sample_rate * 60 / params->qrn_rate;
+		impair->qrn_peak = params->qrn_level * (CW_IMPAIR_ONE - 1) / CW_IMPAIRMENT_LEVEL_MAX;
+		impair->qrn_decay = (int32_t) lrintf(expf(-1000.0F / (CW_IMPAIR_QRN_DECAY_TIME * fs)) * (float) CW_IMPAIR_ONE);
+		if (impair->qrn_countdown <= 0 || impair->qrn_countdown > 2 * impair->qrn_interval) {
+			impair->qrn_countdown = 1 + (int64_t) (cw_impair_random_internal(impair) % (uint32_t) (2 * impair->qrn_interval));
+		}
+	} else {
+		impair->qrn_interval = 0;
+		impair->qrn_peak = 0;
+		impair->qrn_amplitude = 0;
+	}
+
+
+	if (params->chirp_depth != 0 && params->chirp_duration > 0) {
+		impair->chirp_increment = ((int64_t) params->chirp_depth * (INT64_C(1) << 32)) / sample_rate;
+		impair->chirp_n_samples = params->chirp_duration * sample_rate / 1000;
+	} else {
+		impair->chirp_increment = 0;
+		impair->chirp_n_samples = 0;
+	}
+	/* Current Mark (if any) is not chirped, the next one will be. */
+	impair->chirp_t = impair->chirp_n_samples;
+
+
+	impair->active = impair->noise_gain > 0
+		|| impair->qsb_depth > 0
+		|| impair->qrn_peak > 0
+		|| impair->chirp_n_samples > 0;
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "impairments: noise %d%%/%d Hz, qsb %d%%/%d ms, qrn %d/min/%d%%, chirp %d Hz/%d ms",
+		      params->noise_level, params->noise_bandwidth,
+		      params->qsb_depth, params->qsb_period,
+		      params->qrn_rate, params->qrn_level,
+		      params->chirp_depth, params->chirp_duration);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate white noise, uniformly distributed in full range of Q15
+
+   Each of CW_IMPAIR_NOISE_LANES generators calculates every
+   CW_IMPAIR_NOISE_LANES-th sample, so the inner loop has no
+   dependencies between iterations and is vectorized by compiler.
+
+   @p noise must have room for @p n rounded up to multiple of
+   CW_IMPAIR_NOISE_LANES.
+
+   @param[in] impair impairments of generator
+   @param[out] noise noise
+   @param[in] n count of samples of noise
+*/
+static void cw_impair_fill_noise_internal(cw_impair_t * impair, int32_t * noise, int n)
+{
+	uint32_t lanes[CW_IMPAIR_NOISE_LANES];
+	memcpy(lanes, impair->lanes, sizeof (lanes));
+
+	for (int i = 0; i < n; i += CW_IMPAIR_NOISE_LANES) {
+		for (int l = 0; l < CW_IMPAIR_NOISE_LANES; l++) {
+			uint32_t x = lanes[l];
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			lanes[l] = x;
+			noise[i + l] = (int32_t) (x >> 16) - CW_IMPAIR_ONE;
+		}
+	}
+
+	memcpy(impair->lanes, lanes, sizeof (lanes));
+	return;
+}
+
+
+
+
+/**
+   @brief Scale white noise, add crashes and limit band of noise
+
+   @param[in] impair impairments of generator
+   @param[in/out] noise white noise on input, final noise on output
+   @param[in] n count of samples of noise
+*/
+static void cw_impair_shape_noise_internal(cw_impair_t * impair, int32_t * noise, int n)
+{
+	const int32_t gain = impair->noise_gain;
+	const bool has_qrn = impair->qrn_peak > 0;
+	const bool has_resonator = impair->has_resonator;
+	const int64_t b0 = impair->b0;
+	const int64_t a1 = impair->a1;
+	const int64_t a2 = impair->a2;
+
+	int64_t countdown = impair->qrn_countdown;
+	int32_t amplitude = impair->qrn_amplitude;
+	int32_t y1 = impair->y1;
+	int32_t y2 = impair->y2;
+
+	for (int i = 0; i < n; i++) {
+		int32_t x = (noise[i] * gain) >> 15;
+
+		if (has_qrn) {
+			if (--countdown <= 0) {
+				/* New crash, with peak between 1/4 and full
+				   level, after random interval of 0-2 mean
+				   intervals. */
+				const uint32_t r = cw_impair_random_internal(impair);
+				amplitude = impair->qrn_peak / 4 + (int32_t) ((uint64_t) (r >> 16) * (uint64_t) (impair->qrn_peak - impair->qrn_peak / 4) >> 16);
+				countdown = 1 + (int64_t) (cw_impair_random_internal(impair) % (uint32_t) (2 * impair->qrn_interval));
+			}
+			if (amplitude > 0) {
+				x += (noise[i] * amplitude) >> 15;
+				amplitude = (amplitude * impair->qrn_decay) >> 15;
+			}
+		}
+
+		if (has_resonator) {
+			const int32_t y = (int32_t) ((b0 * x + a1 * y1 - a2 * y2) >> 14);
+			y2 = y1;
+			y1 = y;
+			x = y;
+		}
+
+		noise[i] = x;
+	}
+
+	impair->qrn_countdown = countdown;
+	impair->qrn_amplitude = amplitude;
+	impair->y1 = y1;
+	impair->y2 = y2;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get gain of QSB at given phase of fading
+
+   Gain goes smoothly (smoothstep of triangle wave) from full volume
+   at phase zero to full volume reduced by depth of QSB at half of
+   period, and back.
+
+   @param[in] impair impairments of generator
+   @param[in] phase phase of fading
+
+   @return gain, Q15
+*/
+static int32_t cw_impair_qsb_gain_internal(const cw_impair_t * impair, uint32_t phase)
+{
+	const uint32_t triangle = phase < (UINT32_C(1) << 31) ? phase : (uint32_t) 0 - phase;
+	const int64_t x = triangle >> 16; /* 0 - CW_IMPAIR_ONE. */
+	const int64_t smooth = ((x * x) >> 15) * (3 * CW_IMPAIR_ONE - 2 * x) >> 15;
+	return CW_IMPAIR_ONE - (int32_t) ((impair->qsb_depth * smooth) >> 15);
+}
+
+
+
+
+/**
+   @brief Add impairments to block of samples
+
+   @param[in] impair impairments of generator
+   @param[in/out] samples samples
+   @param[in] n count of samples, not larger than CW_IMPAIR_BLOCK_N_SAMPLES
+*/
+static void cw_impair_apply_block_internal(cw_impair_t * impair, cw_sample_t * samples, int n)
+{
+	int32_t noise[CW_IMPAIR_BLOCK_N_SAMPLES];
+	const bool has_noise = impair->noise_gain > 0 || impair->qrn_peak > 0;
+	if (has_noise) {
+		cw_impair_fill_noise_internal(impair, noise, n);
+		cw_impair_shape_noise_internal(impair, noise, n);
+	} else {
+		memset(noise, 0, sizeof (noise[0]) * (size_t) n);
+	}
+
+	/* Gain of QSB changes slowly, so it is calculated at both ends
+	   of block and interpolated linearly. Gain is Q30 here. */
+	int32_t gain_start = CW_IMPAIR_ONE;
+	int32_t gain_end = CW_IMPAIR_ONE;
+	if (impair->qsb_depth > 0) {
+		gain_start = cw_impair_qsb_gain_internal(impair, impair->qsb_phase);
+		impair->qsb_phase += impair->qsb_increment * (uint32_t) n;
+		gain_end = cw_impair_qsb_gain_internal(impair, impair->qsb_phase);
+	}
+	const int32_t step = (gain_end - gain_start) * CW_IMPAIR_ONE / n;
+	const int32_t gain = gain_start * CW_IMPAIR_ONE;
+
+	for (int i = 0; i < n; i++) {
+		const int32_t g = (gain + step * i) >> 15;
+		int32_t value = ((samples[i] * g) >> 15) + noise[i];
+		if (value > INT16_MAX) {
+			value = INT16_MAX;
+		} else if (value < INT16_MIN) {
+			value = INT16_MIN;
+		}
+		samples[i] = (cw_sample_t) value;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add impairments to samples calculated by generator
+
+   Noise and crashes are added, and the samples are faded by QSB. The
+   function doesn't check if there is anything to add, caller should
+   check cw_impair_t::active.
+
+   @param[in] impair impairments of generator
+   @param[in/out] samples samples
+   @param[in] n count of samples
+*/
+void cw_impair_apply_internal(cw_impair_t * impair, cw_sample_t * samples, int n)
+{
+	if (impair->noise_gain == 0 && impair->qrn_peak == 0 && impair->qsb_depth == 0) {
+		/* Only chirp is enabled. */
+		return;
+	}
+
+	for (int i = 0; i < n; i += CW_IMPAIR_BLOCK_N_SAMPLES) {
+		const int block_n = n - i < CW_IMPAIR_BLOCK_N_SAMPLES ? n - i : CW_IMPAIR_BLOCK_N_SAMPLES;
+		cw_impair_apply_block_internal(impair, samples + i, block_n);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get shift of phase increment of oscillator caused by chirp
+
+   Shift decreases from full depth of chirp at start of Mark to zero
+   at the end of chirp, with square of remaining time, like frequency
+   of a transmitter whose oscillator is pulled at key down.
+
+   @param[in] impair impairments of generator
+   @param[in] t time since start of Mark [samples]
+
+   @return shift of phase increment
+*/
+static int64_t cw_impair_chirp_offset_internal(const cw_impair_t * impair, int t)
+{
+	if (t >= impair->chirp_n_samples) {
+		return 0;
+	}
+	const int64_t u = ((int64_t) (impair->chirp_n_samples - t) << 15) / impair->chirp_n_samples; /* Q15. */
+	return (impair->chirp_increment * ((u * u) >> 15)) >> 15;
+}
+
+
+
+
+/**
+   @brief Apply chirp to phase increment of oscillator for next block of
+   samples
+
+   Start of a Mark is signalled to the function by setting
+   cw_impair_t::chirp_t to zero.
+
+   @param[in] impair impairments of generator
+   @param[in/out] increment phase increment of oscillator, increment at start of block on output
+   @param[out] step change of phase increment per sample in the block
+   @param[in] n count of samples in the block
+*/
+void cw_impair_chirp_internal(cw_impair_t * impair, uint32_t * increment, int32_t * step, int n)
+{
+	*step = 0;
+	const int t0 = impair->chirp_t;
+	if (t0 >= impair->chirp_n_samples) {
+		return;
+	}
+	const int t1 = t0 + n < impair->chirp_n_samples ? t0 + n : impair->chirp_n_samples;
+
+	const int64_t start = cw_impair_chirp_offset_internal(impair, t0);
+	const int64_t end = cw_impair_chirp_offset_internal(impair, t1);
+
+	*increment += (uint32_t) start;
+	*step = (int32_t) ((end - start) / n);
+	impair->chirp_t = t1;
+
+	return;
+}
@@ -0,0 +1,110 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_IMPAIR
+#define H_LIBCW_IMPAIR
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Count of independent generators of random numbers of noise. Noise
+   of consecutive samples is taken from consecutive generators, so
+   the loop calculating it can be vectorized by compiler. */
+enum { CW_IMPAIR_NOISE_LANES = 8 };
+
+/* Count of samples processed at once, with noise kept in array on
+   stack. Multiple of CW_IMPAIR_NOISE_LANES. */
+enum { CW_IMPAIR_BLOCK_N_SAMPLES = 256 };
+
+
+
+
+/* Impairments of radio channel of generator, see
+   cw_gen_set_impairments(). All fields except of ::pending are used
+   only by thread generating samples. */
+typedef struct {
+	/* Impairments set by client code, protected by ::mutex. Taken
+	   by generator when ::pending_seq differs from ::applied_seq. */
+	pthread_mutex_t mutex;
+	cw_impairments_t pending;
+	unsigned int pending_seq;
+	unsigned int applied_seq;
+
+	/* Impairments currently added to samples. */
+	cw_impairments_t params;
+	/* At least one of the impairments is enabled. */
+	bool active;
+
+	/* Frequency and sample rate for which coefficients have been
+	   calculated. */
+	int frequency;
+	int sample_rate;
+
+	/* xorshift32 generators of noise. */
+	uint32_t lanes[CW_IMPAIR_NOISE_LANES];
+	/* Generator of random moments of crashes. */
+	uint32_t random;
+
+	/* Gain of noise, Q15. */
+	int32_t noise_gain;
+
+	/* Two-pole resonator limiting band of noise, coefficients in
+	   Q14. Disabled for white noise. */
+	bool has_resonator;
+	int32_t b0;
+	int32_t a1;
+	int32_t a2;
+	int32_t y1;
+	int32_t y2;
+
+	/* Phase of QSB (full range of integer is one period of fading),
+	   and depth of fading, Q15. */
+	uint32_t qsb_phase;
+	uint32_t qsb_increment;
+	int32_t qsb_depth;
+
+	/* Crashes: samples until next crash, mean interval between
+	   crashes [samples], current and peak amplitude and per-sample
+	   decay of amplitude (Q15). */
+	int64_t qrn_countdown;
+	int64_t qrn_interval;
+	int32_t qrn_amplitude;
+	int32_t qrn_peak;
+	int32_t qrn_decay;
+
+	/* Chirp: shift of phase increment of oscillator at start of Mark,
+	   duration of chirp, and samples since start of current Mark. */
+	int64_t chirp_increment;
+	int chirp_n_samples;
+	int chirp_t;
+} cw_impair_t;
+
+
+
+
+void cw_impair_init_internal(cw_impair_t * impair);
+void cw_impair_destroy_internal(cw_impair_t * impair);
+cw_ret_t cw_impair_set_internal(cw_impair_t * impair, const cw_impairments_t * impairments);
+void cw_impair_get_internal(cw_impair_t * impair, cw_impairments_t * impairments);
+void cw_impair_sync_internal(cw_impair_t * impair, int frequency, int sample_rate);
+void cw_impair_apply_internal(cw_impair_t * impair, cw_sample_t * samples, int n);
+void cw_impair_chirp_internal(cw_impair_t * impair, uint32_t * increment, int32_t * step, int n);
+
+
+
+
+#endif /* #ifndef H_LIBCW_IMPAIR */
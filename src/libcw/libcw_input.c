@@ -0,0 +1,870 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_input.c
+
+   @brief Key input. Deliver changes of hardware key directly to key.
+
+   Client code adds to key input one or more sources: serial ports
+   (modem control lines CTS and DSR), Linux input devices (a key of
+   evdev device) or lines of Linux GPIO chip. Each line of a source is
+   connected to straight key, or to dot or dash paddle of iambic keyer.
+
+   A single thread waits on all sources with epoll, and passes changes
+   of lines to the key (cw_key_sk_set_value(),
+   cw_key_ik_notify_dot_paddle_event(),
+   cw_key_ik_notify_dash_paddle_event()) as soon as kernel reports
+   them. Going around event loop of client code (and around its UI
+   toolkit) removes most of latency between the key and the keyer.
+
+   Evdev and GPIO events are timestamped by kernel with monotonic
+   clock. Changes of modem control lines of serial port are not
+   reported by file descriptor, so the lines are sampled every
+   CW_INPUT_SERIAL_POLL_PERIOD microseconds by a timerfd added to the
+   same epoll set, and the changes are timestamped with time of the
+   sample.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/gpio.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_input.h"
+#include "libcw_key.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/input: "
+
+
+
+
+/* Values of epoll_event.data.u32 that are not indices of sources. */
+enum { CW_INPUT_EPOLL_WAKEUP = CW_INPUT_SOURCES_MAX };
+enum { CW_INPUT_EPOLL_TIMER  = CW_INPUT_SOURCES_MAX + 1 };
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+static bool     cw_input_is_valid_line_internal(cw_input_line_t line, bool none_allowed);
+static cw_ret_t cw_input_add_source_internal(cw_input_t * input, const cw_input_source_t * source);
+static cw_ret_t cw_input_setup_internal(cw_input_t * input);
+static void     cw_input_sync_source_internal(cw_input_t * input, cw_input_source_t * source, int64_t timestamp);
+static void     cw_input_sample_serial_internal(cw_input_t * input, cw_input_source_t * source, int64_t timestamp);
+static void     cw_input_read_evdev_internal(cw_input_t * input, cw_input_source_t * source);
+static void     cw_input_read_gpio_internal(cw_input_t * input, cw_input_source_t * source);
+static void *   cw_input_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create new key input
+
+   Changes of lines of sources of the key input will be delivered to
+   @p key. The key must have a generator registered (see
+   cw_key_register_generator()) before key input is started.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] key key controlled by key input
+
+   @return freshly allocated key input on success
+   @return NULL pointer on failure
+*/
+cw_input_t * cw_input_new(cw_key_t * key)
+{
+	if (NULL == key) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: NULL key");
+		errno = EINVAL;
+		return (cw_input_t *) NULL;
+	}
+
+	cw_input_t * input = (cw_input_t *) calloc(1, sizeof (cw_input_t));
+	if (NULL == input) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_input_t *) NULL;
+	}
+
+	input->key = key;
+	for (int i = 0; i < 3; i++) {
+		input->values[i] = CW_KEY_VALUE_OPEN;
+	}
+	input->epoll_fd = -1;
+	input->wakeup_fd = -1;
+	input->timer_fd = -1;
+
+	return input;
+}
+
+
+
+
+/**
+   @brief Delete key input
+
+   Key input is stopped if it's running, and all its sources are
+   closed. Pointer to @p input is set to NULL.
+
+   @param[in] input pointer to key input to delete
+*/
+void cw_input_delete(cw_input_t ** input)
+{
+	if (NULL == input || NULL == *input) {
+		return;
+	}
+
+	cw_input_stop(*input);
+
+	for (int i = 0; i < (*input)->n_sources; i++) {
+		close((*input)->sources[i].fd);
+	}
+
+	free(*input);
+	*input = (cw_input_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add serial port as a source of key input
+
+   Key (or paddles) should connect an asserted output line of the port
+   (DTR or RTS, both are asserted by the function) with input line
+   CTS or DSR. Pass CW_INPUT_LINE_NONE for a line that isn't used.
+
+   Sources can be added only when key input is not running.
+
+   @param[in] input key input
+   @param[in] path path to serial port device (e.g. "/dev/ttyUSB0")
+   @param[in] cts_line line of key connected to CTS
+   @param[in] dsr_line line of key connected to DSR
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_add_serial(cw_input_t * input, const char * path, cw_input_line_t cts_line, cw_input_line_t dsr_line)
+{
+	if (NULL == input || NULL == path
+	    || !cw_input_is_valid_line_internal(cts_line, true)
+	    || !cw_input_is_valid_line_internal(dsr_line, true)
+	    || (CW_INPUT_LINE_NONE == cts_line && CW_INPUT_LINE_NONE == dsr_line)) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_input_source_t source = { 0 };
+	source.type = CW_INPUT_SOURCE_SERIAL;
+	source.lines[0] = cts_line;
+	source.lines[1] = dsr_line;
+
+	source.fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (-1 == source.fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	/* Provide voltage for key's contacts. */
+	int bits = TIOCM_DTR | TIOCM_RTS;
+	if (-1 == ioctl(source.fd, TIOCMBIS, &bits)
+	    || -1 == ioctl(source.fd, TIOCMGET, &source.modem_bits)) {
+
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "%s is not a serial port: %s", path, strerror(errno));
+		close(source.fd);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	return cw_input_add_source_internal(input, &source);
+}
+
+
+
+
+/**
+   @brief Add key of Linux input device as a source of key input
+
+   @p key_code is a code of key (KEY_* or BTN_* from
+   linux/input-event-codes.h). Other keys of the device are ignored,
+   and the device is not grabbed: the other keys still work for other
+   programs. To use two keys of one device (e.g. for two paddles), add
+   the device twice.
+
+   Sources can be added only when key input is not running.
+
+   @param[in] input key input
+   @param[in] path path to input device (e.g. "/dev/input/event3")
+   @param[in] key_code code of key of the device
+   @param[in] line line of key that the key of the device is connected to
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_add_evdev(cw_input_t * input, const char * path, int key_code, cw_input_line_t line)
+{
+	if (NULL == input || NULL == path
+	    || key_code < 0 || key_code > KEY_MAX
+	    || !cw_input_is_valid_line_internal(line, false)) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_input_source_t source = { 0 };
+	source.type = CW_INPUT_SOURCE_EVDEV;
+	source.lines[0] = line;
+	source.lines[1] = CW_INPUT_LINE_NONE;
+	source.key_code = key_code;
+
+	source.fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (-1 == source.fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	/* Timestamps of events must come from the same clock as
+	   timestamps used by receiver. */
+	int clock_id = CLOCK_MONOTONIC;
+	if (-1 == ioctl(source.fd, EVIOCSCLOCKID, &clock_id)) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "%s is not an input device: %s", path, strerror(errno));
+		close(source.fd);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	return cw_input_add_source_internal(input, &source);
+}
+
+
+
+
+/**
+   @brief Add line of Linux GPIO chip as a source of key input
+
+   The line is requested as input with detection of both edges. Pass
+   true as @p active_low for contacts that short the line to ground;
+   in that case the line also gets a pull-up bias.
+
+   Sources can be added only when key input is not running. The
+   function fails with errno set to ENOSYS if libcw has been compiled
+   without support for GPIO character device (uAPI v2).
+
+   @param[in] input key input
+   @param[in] path path to GPIO chip (e.g. "/dev/gpiochip0")
+   @param[in] offset offset of line of the chip
+   @param[in] active_low whether closed key gives low level on the line
+   @param[in] line line of key that GPIO line is connected to
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_add_gpio(cw_input_t * input, const char * path, unsigned int offset, bool active_low, cw_input_line_t line)
+{
+	if (NULL == input || NULL == path
+	    || !cw_input_is_valid_line_internal(line, false)) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	const int chip_fd = open(path, O_RDWR | O_CLOEXEC);
+	if (-1 == chip_fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof (request));
+	request.offsets[0] = offset;
+	request.num_lines = 1;
+	snprintf(request.consumer, sizeof (request.consumer), "libcw");
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	if (active_low) {
+		request.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	}
+
+	const int rv = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+	const int saved_errno = errno;
+	close(chip_fd);
+	if (-1 == rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't request line %u of %s: %s", offset, path, strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	cw_input_source_t source = { 0 };
+	source.type = CW_INPUT_SOURCE_GPIO;
+	source.fd = request.fd;
+	source.lines[0] = line;
+	source.lines[1] = CW_INPUT_LINE_NONE;
+
+	return cw_input_add_source_internal(input, &source);
+#else
+	(void) offset;
+	(void) active_low;
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+		      MSG_PREFIX "GPIO is not supported");
+	errno = ENOSYS;
+	return CW_FAILURE;
+#endif
+}
+
+
+
+
+/**
+   @brief Register callback called on each change of a line
+
+   The callback is called in thread of key input, after the change
+   has been delivered to the key. Pass NULL to unregister.
+
+   @param[in] input key input
+   @param[in] callback_func callback function
+   @param[in] callback_arg argument passed to the callback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_register_callback(cw_input_t * input, cw_input_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == input || input->thread_running) {
+		errno = NULL == input ? EINVAL : EBUSY;
+		return CW_FAILURE;
+	}
+
+	input->callback_func = callback_func;
+	input->callback_arg = callback_arg;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Start thread of key input
+
+   Current values of all lines are delivered to the key, and then the
+   thread waits for changes of the lines.
+
+   @param[in] input key input
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_start(cw_input_t * input)
+{
+	if (NULL == input || 0 == input->n_sources) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (input->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	if (CW_SUCCESS != cw_input_setup_internal(input)) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: %s", strerror(saved_errno));
+		cw_input_stop(input);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+	input->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop thread of key input
+
+   Sources stay open, and key input can be started again. Lines of the
+   key are left in their current state.
+
+   @param[in] input key input
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_input_stop(cw_input_t * input)
+{
+	if (NULL == input) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (input->thread_running) {
+		const uint64_t one = 1;
+		if (sizeof (one) != write(input->wakeup_fd, &one, sizeof (one))) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "stop: can't wake up thread: %s", strerror(errno));
+		}
+		pthread_join(input->thread, NULL);
+		input->thread_running = false;
+	}
+
+	int * fds[] = { &input->timer_fd, &input->wakeup_fd, &input->epoll_fd };
+	for (size_t i = 0; i < sizeof (fds) / sizeof (fds[0]); i++) {
+		if (-1 != *fds[i]) {
+			close(*fds[i]);
+			*fds[i] = -1;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Deliver new value of a line to key of key input
+
+   Repeated values of a line are not delivered.
+
+   @param[in] input key input
+   @param[in] line line of key
+   @param[in] value new value of the line
+   @param[in] timestamp time of change of the line [ns]
+*/
+void cw_input_set_value_internal(cw_input_t * input, cw_input_line_t line, cw_key_value_t value, int64_t timestamp)
+{
+	if (CW_INPUT_LINE_NONE == line || input->values[line] == value) {
+		return;
+	}
+	input->values[line] = value;
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
+		      MSG_PREFIX "line %d: value %d at %" PRId64 " [ns]", line, value, timestamp);
+
+	switch (line) {
+	case CW_INPUT_LINE_STRAIGHT_KEY:
+		cw_key_sk_set_value(input->key, value);
+		if (NULL != input->key->rec) {
+			if (CW_KEY_VALUE_CLOSED == value) {
+				cw_rec_mark_begin_ns(input->key->rec, timestamp);
+			} else {
+				cw_rec_mark_end_ns(input->key->rec, timestamp);
+			}
+		}
+		break;
+	case CW_INPUT_LINE_DOT_PADDLE:
+		cw_key_ik_notify_dot_paddle_event(input->key, value);
+		break;
+	case CW_INPUT_LINE_DASH_PADDLE:
+		cw_key_ik_notify_dash_paddle_event(input->key, value);
+		break;
+	case CW_INPUT_LINE_NONE:
+	default:
+		return;
+	}
+
+	if (NULL != input->callback_func) {
+		input->callback_func(input->callback_arg, line, value, timestamp);
+	}
+
+	return;
+}
+
+
+
+
+static bool cw_input_is_valid_line_internal(cw_input_line_t line, bool none_allowed)
+{
+	return (none_allowed && CW_INPUT_LINE_NONE == line)
+		|| CW_INPUT_LINE_STRAIGHT_KEY == line
+		|| CW_INPUT_LINE_DOT_PADDLE == line
+		|| CW_INPUT_LINE_DASH_PADDLE == line;
+}
+
+
+
+
+/**
+   @brief Append source to key input
+
+   On failure the source's file descriptor is closed.
+*/
+static cw_ret_t cw_input_add_source_internal(cw_input_t * input, const cw_input_source_t * source)
+{
+	if (input->thread_running || input->n_sources >= CW_INPUT_SOURCES_MAX) {
+		close(source->fd);
+		errno = input->thread_running ? EBUSY : ENOSPC;
+		return CW_FAILURE;
+	}
+
+	input->sources[input->n_sources++] = *source;
+	if (CW_INPUT_SOURCE_SERIAL == source->type) {
+		input->n_serial_sources++;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Create descriptors used by thread of key input, sync lines of key, and start the thread
+
+   On failure some of descriptors may stay open, cw_input_stop()
+   closes them.
+*/
+static cw_ret_t cw_input_setup_internal(cw_input_t * input)
+{
+	input->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	input->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (-1 == input->epoll_fd || -1 == input->wakeup_fd) {
+		return CW_FAILURE;
+	}
+
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN;
+	event.data.u32 = CW_INPUT_EPOLL_WAKEUP;
+	if (-1 == epoll_ctl(input->epoll_fd, EPOLL_CTL_ADD, input->wakeup_fd, &event)) {
+		return CW_FAILURE;
+	}
+
+	if (input->n_serial_sources > 0) {
+		input->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (-1 == input->timer_fd) {
+			return CW_FAILURE;
+		}
+		struct itimerspec spec = { 0 };
+		spec.it_interval.tv_nsec = CW_INPUT_SERIAL_POLL_PERIOD * 1000;
+		spec.it_value.tv_nsec = CW_INPUT_SERIAL_POLL_PERIOD * 1000;
+		if (-1 == timerfd_settime(input->timer_fd, 0, &spec, NULL)) {
+			return CW_FAILURE;
+		}
+		event.data.u32 = CW_INPUT_EPOLL_TIMER;
+		if (-1 == epoll_ctl(input->epoll_fd, EPOLL_CTL_ADD, input->timer_fd, &event)) {
+			return CW_FAILURE;
+		}
+	}
+
+	const int64_t now = cw_clock_now_internal();
+	for (int i = 0; i < input->n_sources; i++) {
+		cw_input_source_t * source = &input->sources[i];
+		if (CW_INPUT_SOURCE_SERIAL != source->type) {
+			event.data.u32 = (uint32_t) i;
+			if (-1 == epoll_ctl(input->epoll_fd, EPOLL_CTL_ADD, source->fd, &event)) {
+				return CW_FAILURE;
+			}
+		}
+		cw_input_sync_source_internal(input, source, now);
+	}
+
+	const int rv = pthread_create(&input->thread, NULL, cw_input_thread_internal, input);
+	if (0 != rv) {
+		errno = rv;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Read current state of source's lines and deliver it to key
+*/
+static void cw_input_sync_source_internal(cw_input_t * input, cw_input_source_t * source, int64_t timestamp)
+{
+	switch (source->type) {
+	case CW_INPUT_SOURCE_SERIAL:
+		cw_input_sample_serial_internal(input, source, timestamp);
+		break;
+
+	case CW_INPUT_SOURCE_EVDEV: {
+		unsigned char keys[KEY_MAX / 8 + 1];
+		memset(keys, 0, sizeof (keys));
+		if (-1 != ioctl(source->fd, EVIOCGKEY(sizeof (keys)), keys)) {
+			const bool is_pressed = keys[source->key_code / 8] & (1 << (source->key_code % 8));
+			cw_input_set_value_internal(input, source->lines[0], is_pressed ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN, timestamp);
+		}
+		break;
+	}
+
+	case CW_INPUT_SOURCE_GPIO: {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+		struct gpio_v2_line_values values = { 0 };
+		values.mask = 1;
+		if (-1 != ioctl(source->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values)) {
+			cw_input_set_value_internal(input, source->lines[0], (values.bits & 1) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN, timestamp);
+		}
+#endif
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return;
+}
+
+
+
+
+static void cw_input_sample_serial_internal(cw_input_t * input, cw_input_source_t * source, int64_t timestamp)
+{
+	int bits = 0;
+	if (-1 == ioctl(source->fd, TIOCMGET, &bits)) {
+		return;
+	}
+	source->modem_bits = bits;
+
+	cw_input_set_value_internal(input, source->lines[0], (bits & TIOCM_CTS) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN, timestamp);
+	cw_input_set_value_internal(input, source->lines[1], (bits & TIOCM_DSR) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN, timestamp);
+
+	return;
+}
+
+
+
+
+static void cw_input_read_evdev_internal(cw_input_t * input, cw_input_source_t * source)
+{
+	struct input_event events[16];
+	ssize_t n_bytes = 0;
+	while ((n_bytes = read(source->fd, events, sizeof (events))) > 0) {
+		const size_t n_events = (size_t) n_bytes / sizeof (events[0]);
+		for (size_t i = 0; i < n_events; i++) {
+			const struct input_event * ev = &events[i];
+			/* Value 2 is auto-repeat of pressed key. */
+			if (EV_KEY != ev->type || source->key_code != ev->code || 2 == ev->value) {
+				continue;
+			}
+			const int64_t timestamp = (int64_t) ev->input_event_sec * 1000000000 + (int64_t) ev->input_event_usec * 1000;
+			cw_input_set_value_internal(input, source->lines[0], ev->value ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN, timestamp);
+		}
+	}
+
+	return;
+}
+
+
+
+
+static void cw_input_read_gpio_internal(cw_input_t * input, cw_input_source_t * source)
+{
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	struct gpio_v2_line_event events[16];
+	ssize_t n_bytes = 0;
+	while ((n_bytes = read(source->fd, events, sizeof (events))) > 0) {
+		const size_t n_events = (size_t) n_bytes / sizeof (events[0]);
+		for (size_t i = 0; i < n_events; i++) {
+			/* Edges are reported in terms of logical value of
+			   the line, so active-low lines don't need to be
+			   handled here. */
+			const cw_key_value_t value = GPIO_V2_LINE_EVENT_RISING_EDGE == events[i].id ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+			cw_input_set_value_internal(input, source->lines[0], value, (int64_t) events[i].timestamp_ns);
+		}
+	}
+#else
+	(void) input;
+	(void) source;
+#endif
+
+	return;
+}
+
+
+
+
+static void * cw_input_thread_internal(void * arg)
+{
+	cw_input_t * input = (cw_input_t *) arg;
+
+	while (true) {
+		struct epoll_event events[CW_INPUT_SOURCES_MAX + 2];
+		const int n = epoll_wait(input->epoll_fd, events, CW_INPUT_SOURCES_MAX + 2, -1);
+		if (-1 == n) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "epoll_wait(): %s", strerror(errno));
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			const uint32_t id = events[i].data.u32;
+			if (CW_INPUT_EPOLL_WAKEUP == id) {
+				return NULL;
+			}
+
+			if (CW_INPUT_EPOLL_TIMER == id) {
+				uint64_t expirations = 0;
+				if (sizeof (expirations) != read(input->timer_fd, &expirations, sizeof (expirations))) {
+					continue;
+				}
+				const int64_t now = cw_clock_now_internal();
+				for (int s = 0; s < input->n_sources; s++) {
+					if (CW_INPUT_SOURCE_SERIAL == input->sources[s].type) {
+						cw_input_sample_serial_internal(input, &input->sources[s], now);
+					}
+				}
+				continue;
+			}
+
+			cw_input_source_t * source = &input->sources[id];
+			if (CW_INPUT_SOURCE_EVDEV == source->type) {
+				cw_input_read_evdev_internal(input, source);
+			} else {
+				cw_input_read_gpio_internal(input, source);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_input_t * cw_input_new(__attribute__((unused)) cw_key_t * key)
+{
+	errno = ENOSYS;
+	return (cw_input_t *) NULL;
+}
+
+void cw_input_delete(__attribute__((unused)) cw_input_t ** input)
+{
+	return;
+}
+
+cw_ret_t cw_input_add_serial(__attribute__((unused)) cw_input_t * input, __attribute__((unused)) const char * path, __attribute__((unused)) cw_input_line_t cts_line, __attribute__((unused)) cw_input_line_t dsr_line)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_input_add_evdev(__attribute__((unused)) cw_input_t * input, __attribute__((unused)) const char * path, __attribute__((unused)) int key_code, __attribute__((unused)) cw_input_line_t line)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_input_add_gpio(__attribute__((unused)) cw_input_t * input, __attribute__((unused)) const char * path, __attribute__((unused)) unsigned int offset, __attribute__((unused)) bool active_low, __attribute__((unused)) cw_input_line_t line)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_input_register_callback(__attribute__((unused)) cw_input_t * input, __attribute__((unused)) cw_input_callback_t callback_func, __attribute__((unused)) void * callback_arg)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_input_start(__attribute__((unused)) cw_input_t * input)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_input_stop(__attribute__((unused)) cw_input_t * input)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+void cw_input_set_value_internal(__attribute__((unused)) cw_input_t * input, __attribute__((unused)) cw_input_line_t line, __attribute__((unused)) cw_key_value_t value, __attribute__((unused)) int64_t timestamp)
+{
+	return;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
@@ -0,0 +1,90 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_INPUT
+#define H_LIBCW_INPUT
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+enum { CW_INPUT_SOURCES_MAX = 8 };
+
+/* Modem control lines of serial ports can't be waited for with epoll,
+   so they are sampled with this period [us]. */
+enum { CW_INPUT_SERIAL_POLL_PERIOD = 250 };
+
+
+
+
+typedef enum {
+	CW_INPUT_SOURCE_SERIAL,
+	CW_INPUT_SOURCE_EVDEV,
+	CW_INPUT_SOURCE_GPIO
+} cw_input_source_type_t;
+
+
+
+
+typedef struct {
+	cw_input_source_type_t type;
+	int fd;
+
+	/* Serial port: lines connected to CTS and DSR. Evdev and GPIO
+	   sources have only one line. */
+	cw_input_line_t lines[2];
+
+	/* Evdev: code of key (KEY_*). */
+	int key_code;
+
+	/* Serial port: last sampled state of modem control lines
+	   (TIOCM_* bits). */
+	int modem_bits;
+} cw_input_source_t;
+
+
+
+
+struct cw_input_struct {
+	cw_key_t * key;
+
+	cw_input_source_t sources[CW_INPUT_SOURCES_MAX];
+	int n_sources;
+	int n_serial_sources;
+
+	/* Current value of each line (straight key, dot paddle, dash paddle). */
+	cw_key_value_t values[3];
+
+	cw_input_callback_t callback_func;
+	void * callback_arg;
+
+	int epoll_fd;
+	int wakeup_fd;  /* eventfd used to stop the thread. */
+	int timer_fd;   /* timerfd for sampling of serial ports. */
+
+	pthread_t thread;
+	bool thread_running;
+};
+
+
+
+
+void cw_input_set_value_internal(cw_input_t * input, cw_input_line_t line, cw_key_value_t value, int64_t timestamp);
+
+
+
+
+#endif /* #ifndef H_LIBCW_INPUT */
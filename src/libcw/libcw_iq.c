@@ -0,0 +1,680 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_iq.c
+
+   @brief IQ front-end. Receive CW signals directly from complex (IQ)
+   samples of SDR receiver.
+
+   Client code passes interleaved I/Q frames (signed 16 bit) sampled at
+   a high rate (e.g. 192 kHz of rtl-sdr or Airspy). Each signal of
+   interest gets its own chain:
+
+   - NCO: complex mixer that shifts frequency of the signal to 0 Hz,
+   - CIC decimator of order 3, decimating by (decimation / 2),
+   - half-band FIR filter, decimating by 2 and removing aliases of
+     CIC (CIC droop is not compensated, it is negligible for CW),
+   - either a channel: integrate-and-dump envelope detector feeding
+     magnitudes to a tone detector (and through it to a receiver),
+   - or a skimmer: a half-band filter and a quarter-rate shift that
+     convert complex signal to real audio for cw_skimmer_t.
+
+   Mixer and FIR filters work on blocks of frames, with real and
+   imaginary parts kept in separate arrays, so that their inner loops
+   can be vectorized by compiler. Integrators of CIC are inherently
+   serial, but they cost only a few integer additions per frame.
+
+   Timestamps passed to detectors and skimmers are corrected for group
+   delay of the chain.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_detector.h"
+#include "libcw_iq.h"
+#include "libcw_skimmer.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/iq: "
+
+
+
+
+/* Mixed samples are scaled before conversion to integers of CIC, to
+   keep fractional bits. */
+#define CW_IQ_CIC_SCALE 256.0f
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_iq_chain_t * cw_iq_new_chain_internal(cw_iq_t * iq, int frequency);
+static void    cw_iq_process_chain_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_frames);
+static int     cw_iq_mix_and_decimate_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_frames);
+static void    cw_iq_feed_detector_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_outputs);
+static void    cw_iq_feed_skimmer_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_outputs);
+static int64_t cw_iq_frame_timestamp_internal(const cw_iq_t * iq, int64_t frame);
+
+
+
+
+/**
+   @brief Create new IQ front-end
+
+   Front-end accepts IQ frames with given @p sample_rate, and decimates
+   signals by @p decimation. @p decimation must be even, and must
+   divide @p sample_rate. Resulting output sample rate (e.g. 8000 Hz
+   for 192000 Hz and decimation of 24) must be in range supported by
+   tone detector and skimmer (4000 - 192000 Hz).
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] sample_rate sample rate of IQ frames [Hz]
+   @param[in] decimation decimation factor
+
+   @return freshly allocated IQ front-end on success
+   @return NULL pointer on failure
+*/
+cw_iq_t * cw_iq_new(int sample_rate, int decimation)
+{
+	if (sample_rate <= 0
+	    || sample_rate > CW_IQ_SAMPLE_RATE_MAX
+	    || decimation < 2
+	    || decimation > CW_IQ_DECIMATION_MAX
+	    || 0 != decimation % 2
+	    || 0 != sample_rate % decimation
+	    || sample_rate / decimation < CW_DETECTOR_SAMPLE_RATE_MIN
+	    || sample_rate / decimation > CW_DETECTOR_SAMPLE_RATE_MAX) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid argument: sample rate = %d, decimation = %d",
+			      sample_rate, decimation);
+		errno = EINVAL;
+		return (cw_iq_t *) NULL;
+	}
+
+	cw_iq_t * iq = (cw_iq_t *) calloc(1, sizeof (cw_iq_t));
+	if (NULL == iq) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_iq_t *) NULL;
+	}
+
+	iq->sample_rate = sample_rate;
+	iq->decimation = decimation;
+	iq->cic_decimation = decimation / 2;
+	iq->output_sample_rate = sample_rate / decimation;
+
+	const int r = iq->cic_decimation;
+	iq->cic_gain = 1.0f / (CW_IQ_CIC_SCALE * (float) r * (float) r * (float) r);
+
+	/* CIC output is produced after last of its R input frames. Group
+	   delay of CIC is N * (R - 1) / 2 input frames, and of half-band
+	   filter is (taps - 1) / 2 samples of CIC output. */
+	iq->output_offset = (r - 1) - ((CW_IQ_HALFBAND_TAPS - 1) * r + CW_IQ_CIC_ORDER * (r - 1)) / 2;
+
+	/* Half-band filter: Blackman-windowed sinc with cutoff at 1/4
+	   of sample rate. */
+	const int middle = (CW_IQ_HALFBAND_TAPS - 1) / 2;
+	float sum = 0.0f;
+	int n_taps = 0;
+	for (int i = 0; i < CW_IQ_HALFBAND_TAPS; i++) {
+		const int d = i - middle;
+		if (0 != d && 0 == d % 2) {
+			continue;
+		}
+		const double x = 2.0 * M_PI * i / (CW_IQ_HALFBAND_TAPS - 1);
+		const double window = 0.42 - 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+		const double sinc = 0 == d ? 0.5 : sin(M_PI * d / 2.0) / (M_PI * d);
+		iq->halfband_taps[n_taps] = (float) (sinc * window);
+		iq->halfband_offsets[n_taps] = i;
+		sum += iq->halfband_taps[n_taps];
+		n_taps++;
+	}
+	for (int i = 0; i < CW_IQ_HALFBAND_NONZERO_TAPS; i++) {
+		iq->halfband_taps[i] /= sum;
+	}
+
+	return iq;
+}
+
+
+
+
+/**
+   @brief Delete IQ front-end
+
+   Tone detectors created by the front-end are deleted too. Receivers
+   and skimmers are not owned by the front-end.
+
+   @param[in,out] iq pointer to IQ front-end
+*/
+void cw_iq_delete(cw_iq_t ** iq)
+{
+	cw_assert (iq, MSG_PREFIX "delete: 'iq' argument can't be NULL\n");
+
+	if (NULL == iq) { /* Graceful handling of invalid argument. */
+		return;
+	}
+	if (NULL == *iq) {
+		return;
+	}
+
+	for (int i = 0; i < (*iq)->n_chains; i++) {
+		cw_detector_delete(&(*iq)->chains[i]->detector);
+		free((*iq)->chains[i]);
+	}
+
+	free(*iq);
+	*iq = (cw_iq_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add channel that receives a signal with given frequency
+
+   Signal at @p frequency (offset from center of IQ spectrum, negative
+   for signals below the center) is shifted to 0 Hz, decimated, and
+   its envelope is passed to a tone detector feeding @p rec. Bandwidth
+   of the channel is set by block duration of the detector (250 Hz).
+
+   Front-end doesn't take ownership of @p rec: the receiver must be
+   deleted by client code, after deleting the front-end.
+
+   errno is set to EINVAL on invalid argument, and to ENOMEM if there
+   is no more room for chains in front-end (at most CW_IQ_CHAINS_MAX
+   channels and skimmers).
+
+   @param[in,out] iq IQ front-end
+   @param[in] frequency frequency of signal, relative to center of IQ spectrum [Hz]
+   @param[in] rec receiver to feed with marks and spaces
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_iq_add_channel(cw_iq_t * iq, int frequency, cw_rec_t * rec)
+{
+	if (NULL == rec
+	    || frequency <= -iq->sample_rate / 2
+	    || frequency >= iq->sample_rate / 2) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_iq_chain_t * chain = cw_iq_new_chain_internal(iq, frequency);
+	if (NULL == chain) {
+		return CW_FAILURE;
+	}
+
+	/* Frequency of detector is not used: magnitudes are provided
+	   by the chain. */
+	chain->detector = cw_detector_new(iq->output_sample_rate, iq->output_sample_rate / 4, rec);
+	if (NULL == chain->detector) {
+		iq->n_chains--;
+		free(chain);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Attach skimmer to IQ front-end
+
+   Part of IQ spectrum around @p center_frequency is converted to real
+   audio at output sample rate, and passed to @p skimmer. Signal at
+   frequency F of IQ spectrum appears in the audio at frequency
+   F - @p center_frequency + (output sample rate / 4). Only audio
+   between about 1/8 and 3/8 of output sample rate is free of images,
+   so passband of skimmer should be kept in that range.
+
+   Sample rate of @p skimmer must be equal to output sample rate of
+   the front-end. Front-end doesn't take ownership of @p skimmer.
+
+   errno is set to EINVAL on invalid argument, and to ENOMEM if there
+   is no more room for chains in front-end.
+
+   @param[in,out] iq IQ front-end
+   @param[in] center_frequency frequency of center of skimmer's audio, relative to center of IQ spectrum [Hz]
+   @param[in] skimmer skimmer to feed with audio
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_iq_attach_skimmer(cw_iq_t * iq, int center_frequency, cw_skimmer_t * skimmer)
+{
+	if (NULL == skimmer
+	    || skimmer->sample_rate != iq->output_sample_rate
+	    || center_frequency <= -iq->sample_rate / 2
+	    || center_frequency >= iq->sample_rate / 2) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_iq_chain_t * chain = cw_iq_new_chain_internal(iq, center_frequency);
+	if (NULL == chain) {
+		return CW_FAILURE;
+	}
+	chain->skimmer = skimmer;
+	chain->selector.n = CW_IQ_HALFBAND_TAPS - 1;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get sample rate of decimated signals
+
+   @param[in] iq IQ front-end
+
+   @return output sample rate [Hz]
+*/
+int cw_iq_get_output_sample_rate(const cw_iq_t * iq)
+{
+	return iq->output_sample_rate;
+}
+
+
+
+
+/**
+   @brief Get timestamp of end of signal processed so far
+
+   The timestamp is the time of the end of decimated signal that has
+   been passed to receivers, i.e. time of next IQ frame minus delay of
+   decimation chain. Use it as "now" when polling receivers of channels
+   for characters.
+
+   @param[in] iq IQ front-end
+
+   @return timestamp [ns]
+*/
+int64_t cw_iq_get_timestamp(const cw_iq_t * iq)
+{
+	return cw_iq_frame_timestamp_internal(iq, iq->n_frames + iq->output_offset);
+}
+
+
+
+
+/**
+   @brief Process block of IQ frames
+
+   Pass @p n_frames frames of interleaved I and Q samples (signed, 16
+   bit) to all channels and skimmers of the front-end.
+
+   @p timestamp is time of first frame in @p iq_samples [ns]. Pass
+   negative value to have the front-end continue its own timeline (see
+   cw_detector_process()).
+
+   @param[in,out] iq IQ front-end
+   @param[in] iq_samples interleaved I and Q samples
+   @param[in] n_frames count of frames (pairs of samples) in @p iq_samples
+   @param[in] timestamp timestamp of first frame [ns]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (errno is set to EINVAL if @p iq_samples is NULL)
+*/
+cw_ret_t cw_iq_process(cw_iq_t * iq, const int16_t * iq_samples, size_t n_frames, int64_t timestamp)
+{
+	if (NULL == iq_samples) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (timestamp >= 0) {
+		iq->anchor_frame = iq->n_frames;
+		iq->anchor_timestamp = timestamp;
+	}
+
+	size_t i = 0;
+	while (i < n_frames) {
+		int n = CW_IQ_BLOCK_FRAMES;
+		if ((size_t) n > n_frames - i) {
+			n = (int) (n_frames - i);
+		}
+
+		const int16_t * x = iq_samples + 2 * i;
+		for (int k = 0; k < n; k++) {
+			iq->in_re[k] = (float) x[2 * k];
+			iq->in_im[k] = (float) x[2 * k + 1];
+		}
+
+		for (int c = 0; c < iq->n_chains; c++) {
+			cw_iq_process_chain_internal(iq, iq->chains[c], n);
+		}
+
+		iq->n_frames += n;
+		i += (size_t) n;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Allocate new chain and add it to front-end
+
+   @param[in,out] iq IQ front-end
+   @param[in] frequency frequency shifted by NCO to 0 Hz [Hz]
+
+   @return new chain on success
+   @return NULL on failure
+*/
+static cw_iq_chain_t * cw_iq_new_chain_internal(cw_iq_t * iq, int frequency)
+{
+	if (CW_IQ_CHAINS_MAX == iq->n_chains) {
+		errno = ENOMEM;
+		return (cw_iq_chain_t *) NULL;
+	}
+
+	cw_iq_chain_t * chain = (cw_iq_chain_t *) calloc(1, sizeof (cw_iq_chain_t));
+	if (NULL == chain) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_iq_chain_t *) NULL;
+	}
+
+	chain->frequency = frequency;
+	chain->step = 2.0 * M_PI * frequency / iq->sample_rate;
+	for (int k = 0; k < CW_IQ_BLOCK_FRAMES; k++) {
+		chain->rotator_re[k] = (float) cos(chain->step * k);
+		chain->rotator_im[k] = (float) -sin(chain->step * k);
+	}
+
+	/* First output of half-band filter is calculated from first
+	   input sample and zeroed history. */
+	chain->decimator.n = CW_IQ_HALFBAND_TAPS - 1;
+
+	/* New chain starts working with next block of frames. */
+	chain->n_outputs = iq->n_frames / iq->decimation;
+	chain->n_audio = chain->n_outputs;
+
+	iq->chains[iq->n_chains++] = chain;
+
+	return chain;
+}
+
+
+
+
+/**
+   @brief Pass block of complex samples through half-band filter
+
+   Append @p n_in samples to @p fir, and calculate as many outputs as
+   possible, taking every @p step-th output. Outputs are calculated
+   tap by tap for all samples at once, so that the innermost loop runs
+   over contiguous samples.
+
+   @return count of samples put in @p out_re and @p out_im
+*/
+static inline __attribute__((always_inline)) int cw_iq_halfband_internal(const cw_iq_t * iq, cw_iq_fir_t * fir, const float * in_re, const float * in_im, int n_in, int step, float * out_re, float * out_im)
+{
+	memcpy(fir->re + fir->n, in_re, (size_t) n_in * sizeof (float));
+	memcpy(fir->im + fir->n, in_im, (size_t) n_in * sizeof (float));
+	const int n = fir->n + n_in;
+	const int n_out = n >= CW_IQ_HALFBAND_TAPS ? 1 + (n - CW_IQ_HALFBAND_TAPS) / step : 0;
+
+	for (int j = 0; j < n_out; j++) {
+		out_re[j] = 0.0f;
+		out_im[j] = 0.0f;
+	}
+	for (int t = 0; t < CW_IQ_HALFBAND_NONZERO_TAPS; t++) {
+		const float h = iq->halfband_taps[t];
+		const float * x_re = fir->re + iq->halfband_offsets[t];
+		const float * x_im = fir->im + iq->halfband_offsets[t];
+		for (int j = 0; j < n_out; j++) {
+			out_re[j] += h * x_re[j * step];
+			out_im[j] += h * x_im[j * step];
+		}
+	}
+
+	const int consumed = n_out * step;
+	memmove(fir->re, fir->re + consumed, (size_t) (n - consumed) * sizeof (float));
+	memmove(fir->im, fir->im + consumed, (size_t) (n - consumed) * sizeof (float));
+	fir->n = n - consumed;
+
+	return n_out;
+}
+
+
+
+
+/**
+   @brief Process current block of frames of front-end with given chain
+*/
+static void cw_iq_process_chain_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_frames)
+{
+	const int n_outputs = cw_iq_mix_and_decimate_internal(iq, chain, n_frames);
+	if (0 == n_outputs) {
+		return;
+	}
+
+	if (chain->detector) {
+		cw_iq_feed_detector_internal(iq, chain, n_outputs);
+	} else {
+		cw_iq_feed_skimmer_internal(iq, chain, n_outputs);
+	}
+	chain->n_outputs += n_outputs;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Shift frequency of current block of frames, and decimate it
+
+   Decimated samples are put in iq->out_re and iq->out_im.
+
+   @return count of decimated samples
+*/
+static int cw_iq_mix_and_decimate_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_frames)
+{
+	/* NCO: multiply frames by exp(-j * (phase + step * k)). Phase
+	   of block is calculated from scratch for every block, so
+	   rounding errors don't accumulate. */
+	const float p_re = (float) cos(chain->phase);
+	const float p_im = (float) -sin(chain->phase);
+	for (int k = 0; k < n_frames; k++) {
+		const float c_re = p_re * chain->rotator_re[k] - p_im * chain->rotator_im[k];
+		const float c_im = p_re * chain->rotator_im[k] + p_im * chain->rotator_re[k];
+		iq->mix_re[k] = iq->in_re[k] * c_re - iq->in_im[k] * c_im;
+		iq->mix_im[k] = iq->in_re[k] * c_im + iq->in_im[k] * c_re;
+	}
+	chain->phase = fmod(chain->phase + chain->step * n_frames, 2.0 * M_PI);
+
+	/* CIC decimator. Decimated samples are stored in place of
+	   mixed ones. */
+	const int r = iq->cic_decimation;
+	int n_cic = 0;
+	for (int k = 0; k < n_frames; k++) {
+		uint64_t v_re = (uint64_t) (int64_t) lrintf(iq->mix_re[k] * CW_IQ_CIC_SCALE);
+		uint64_t v_im = (uint64_t) (int64_t) lrintf(iq->mix_im[k] * CW_IQ_CIC_SCALE);
+		for (int s = 0; s < CW_IQ_CIC_ORDER; s++) {
+			chain->integrator_re[s] += v_re;
+			chain->integrator_im[s] += v_im;
+			v_re = chain->integrator_re[s];
+			v_im = chain->integrator_im[s];
+		}
+		if (++chain->cic_i < r) {
+			continue;
+		}
+		chain->cic_i = 0;
+		for (int s = 0; s < CW_IQ_CIC_ORDER; s++) {
+			const uint64_t prev_re = chain->comb_re[s];
+			const uint64_t prev_im = chain->comb_im[s];
+			chain->comb_re[s] = v_re;
+			chain->comb_im[s] = v_im;
+			v_re -= prev_re;
+			v_im -= prev_im;
+		}
+		iq->mix_re[n_cic] = (float) (int64_t) v_re * iq->cic_gain;
+		iq->mix_im[n_cic] = (float) (int64_t) v_im * iq->cic_gain;
+		n_cic++;
+	}
+
+	return cw_iq_halfband_internal(iq, &chain->decimator, iq->mix_re, iq->mix_im, n_cic, 2, iq->out_re, iq->out_im);
+}
+
+
+
+
+/**
+   @brief Pass magnitudes of decimated signal to detector of channel
+
+   Magnitude is amplitude of mean of complex samples in a block of
+   detector's duration. Signal shifted to 0 Hz adds up coherently,
+   signals farther than ~1/(block duration) from 0 Hz cancel out.
+*/
+static void cw_iq_feed_detector_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_outputs)
+{
+	cw_detector_t * detector = chain->detector;
+	const int block_n_samples = detector->block_n_samples;
+
+	for (int j = 0; j < n_outputs; j++) {
+		chain->block_re += iq->out_re[j];
+		chain->block_im += iq->out_im[j];
+		if (++chain->block_i < block_n_samples) {
+			continue;
+		}
+
+		const float magnitude = hypotf(chain->block_re, chain->block_im) / (float) block_n_samples;
+		/* Middle of the block. */
+		const int64_t output = chain->n_outputs + j + 1 - block_n_samples / 2;
+		const int64_t timestamp = cw_iq_frame_timestamp_internal(iq, output * iq->decimation + iq->output_offset);
+		cw_detector_process_magnitude_internal(detector, magnitude, timestamp);
+
+		chain->block_re = 0.0f;
+		chain->block_im = 0.0f;
+		chain->block_i = 0;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Convert decimated signal to real audio and pass it to skimmer
+
+   Negative half of spectrum is removed by half-band filter (cutoff at
+   1/4 of output sample rate), and the rest is shifted up by 1/4 of
+   output sample rate (multiplication by j^n) so that it occupies
+   frequencies between 0 and 1/2 of sample rate. Real part of the
+   result is the audio.
+*/
+static void cw_iq_feed_skimmer_internal(cw_iq_t * iq, cw_iq_chain_t * chain, int n_outputs)
+{
+	const int n_audio = cw_iq_halfband_internal(iq, &chain->selector, iq->out_re, iq->out_im, n_outputs, 1, iq->audio_re, iq->audio_im);
+
+	for (int j = 0; j < n_audio; j++) {
+		float sample = 0.0f;
+		switch ((chain->n_audio + j) % 4) {
+		case 0:
+			sample = iq->audio_re[j];
+			break;
+		case 1:
+			sample = -iq->audio_im[j];
+			break;
+		case 2:
+			sample = -iq->audio_re[j];
+			break;
+		default:
+			sample = iq->audio_im[j];
+			break;
+		}
+		if (sample > 32767.0f) {
+			sample = 32767.0f;
+		} else if (sample < -32768.0f) {
+			sample = -32768.0f;
+		}
+		iq->audio[j] = (int16_t) lrintf(sample);
+	}
+
+	/* Audio is delayed by half-band filter by (taps - 1) / 2
+	   samples. */
+	const int64_t frame = (chain->n_audio - (CW_IQ_HALFBAND_TAPS - 1) / 2) * iq->decimation + iq->output_offset;
+	const int64_t timestamp = cw_iq_frame_timestamp_internal(iq, frame);
+	cw_skimmer_process(chain->skimmer, iq->audio, (size_t) n_audio, timestamp >= 0 ? timestamp : -1);
+	chain->n_audio += n_audio;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get timestamp of given IQ frame
+
+   @param[in] iq IQ front-end
+   @param[in] frame index of frame (may be negative)
+
+   @return timestamp [ns]
+*/
+int64_t cw_iq_frame_timestamp_internal(const cw_iq_t * iq, int64_t frame)
+{
+	const int64_t delta = frame - iq->anchor_frame;
+	return iq->anchor_timestamp + (delta * CW_NSECS_PER_SEC) / iq->sample_rate;
+}
@@ -0,0 +1,137 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_IQ
+#define H_LIBCW_IQ
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+enum { CW_IQ_CHAINS_MAX = 32 };
+enum { CW_IQ_SAMPLE_RATE_MAX = 10000000 };
+enum { CW_IQ_DECIMATION_MAX = 512 };
+
+/* Input is processed in blocks of at most this many frames. */
+enum { CW_IQ_BLOCK_FRAMES = 256 };
+
+/* Order of CIC decimator. */
+enum { CW_IQ_CIC_ORDER = 3 };
+
+/* Half-band filter: length is 4k+3, so that both end taps are
+   non-zero. Every second tap (except for center one) is zero, and
+   only non-zero taps are stored. */
+enum { CW_IQ_HALFBAND_TAPS = 47 };
+enum { CW_IQ_HALFBAND_NONZERO_TAPS = (CW_IQ_HALFBAND_TAPS + 1) / 2 + 1 };
+
+
+
+
+/* State of FIR filter working on complex samples. Samples waiting to
+   be filtered (including history) are kept in separate, contiguous
+   arrays of real and imaginary parts. */
+typedef struct {
+	float re[CW_IQ_HALFBAND_TAPS + CW_IQ_BLOCK_FRAMES];
+	float im[CW_IQ_HALFBAND_TAPS + CW_IQ_BLOCK_FRAMES];
+	int n; /* Count of samples in the arrays. */
+} cw_iq_fir_t;
+
+
+
+
+/* Single frequency shift + decimation chain, ending either with tone
+   detector or with skimmer. */
+typedef struct {
+	/* Frequency shifted to 0 Hz, relative to center of IQ
+	   spectrum [Hz]. */
+	int frequency;
+
+	/* NCO. Rotator holds exp(-j * step * k) for k in block, phase
+	   is a phase of first frame of next block. */
+	float rotator_re[CW_IQ_BLOCK_FRAMES];
+	float rotator_im[CW_IQ_BLOCK_FRAMES];
+	double step;  /* [radians per frame] */
+	double phase; /* [radians] */
+
+	/* CIC decimator. Integrators wrap around (modular arithmetic),
+	   combs remove the wrap-around. */
+	uint64_t integrator_re[CW_IQ_CIC_ORDER];
+	uint64_t integrator_im[CW_IQ_CIC_ORDER];
+	uint64_t comb_re[CW_IQ_CIC_ORDER];
+	uint64_t comb_im[CW_IQ_CIC_ORDER];
+	int cic_i;
+
+	/* Half-band decimator, and count of samples produced by it
+	   (at output sample rate) since creation of chain. */
+	cw_iq_fir_t decimator;
+	int64_t n_outputs;
+
+	/* Channel: owned detector, fed by integrate-and-dump envelope
+	   detector. */
+	cw_detector_t * detector;
+	float block_re;
+	float block_im;
+	int block_i;
+
+	/* Skimmer (not owned): half-band filter that selects positive
+	   half of spectrum before shifting it to real audio. */
+	cw_skimmer_t * skimmer;
+	cw_iq_fir_t selector;
+	int64_t n_audio;
+} cw_iq_chain_t;
+
+
+
+
+struct cw_iq_struct {
+	int sample_rate;        /* Rate of IQ frames [Hz]. */
+	int decimation;
+	int cic_decimation;     /* decimation / 2, the rest is done by half-band filter. */
+	int output_sample_rate; /* [Hz] */
+
+	float cic_gain;
+
+	/* Position of output sample of decimation chain on timeline
+	   of input, relative to (output index * decimation), accounting
+	   for group delay of the chain [frames]. */
+	int output_offset;
+
+	float halfband_taps[CW_IQ_HALFBAND_NONZERO_TAPS];
+	int halfband_offsets[CW_IQ_HALFBAND_NONZERO_TAPS];
+
+	cw_iq_chain_t * chains[CW_IQ_CHAINS_MAX];
+	int n_chains;
+
+	/* Timeline of input frames, see cw_detector_t. */
+	int64_t n_frames;
+	int64_t anchor_frame;
+	int64_t anchor_timestamp; /* [ns] */
+
+	/* Working buffers for single block. */
+	float in_re[CW_IQ_BLOCK_FRAMES];
+	float in_im[CW_IQ_BLOCK_FRAMES];
+	float mix_re[CW_IQ_BLOCK_FRAMES];
+	float mix_im[CW_IQ_BLOCK_FRAMES];
+	float out_re[CW_IQ_BLOCK_FRAMES];
+	float out_im[CW_IQ_BLOCK_FRAMES];
+	float audio_re[CW_IQ_BLOCK_FRAMES];
+	float audio_im[CW_IQ_BLOCK_FRAMES];
+	int16_t audio[CW_IQ_BLOCK_FRAMES];
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_IQ */
@@ -0,0 +1,595 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_jack.c
+
+   @brief JACK sound system.
+
+   PipeWire provides JACK API too (pipewire-jack), so this sound
+   system can be used with PipeWire as well.
+
+   Unlike other sound systems, this one doesn't push samples to sound
+   server from generator's thread. The generator works in pull mode:
+   JACK server calls libcw's process callback from its real-time
+   thread, and the callback gets samples from generator with
+   cw_gen_pull_samples_internal(). The samples are calculated right
+   from generator's tone queue, without any intermediate thread or
+   buffer queue.
+
+   Known limitation: the process callback is not lock-free. Dequeueing
+   a tone takes mutex of tone queue, which is also taken by threads
+   enqueueing tones (client code, keyers) and waiting for the queue.
+   If such thread holds the mutex when JACK server calls the callback,
+   the callback waits for it, and the server may report an xrun. With
+   cw_gen_config_t::tq_single_producer the mutex is taken only when
+   some thread waits for the queue, but state callbacks and tracking
+   of generator's value are still called from the callback.
+*/
+
+
+
+
+#include <stdbool.h>
+
+
+
+
+#include "config.h"
+#include "libcw_debug.h"
+#include "libcw_jack.h"
+
+
+
+
+#define MSG_PREFIX "libcw/jack: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#ifdef LIBCW_WITH_JACK
+
+
+
+
+#include <assert.h>
+#include <dlfcn.h> /* dlopen() and related symbols */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw_gen.h"
+#include "libcw_jack.h"
+#include "libcw_utils.h"
+
+
+
+
+typedef struct cw_jack_lib_handle_t {
+
+	/* Returned by cw_dlopen_internal(). Kept for lifetime of
+	   process, see g_cw_jack_lib_handle. */
+	void * lib_handle;
+
+	jack_client_t  *(* jack_client_open)(const char * client_name, jack_options_t options, jack_status_t * status, ...);
+	int             (* jack_client_close)(jack_client_t * client);
+	int             (* jack_activate)(jack_client_t * client);
+	int             (* jack_deactivate)(jack_client_t * client);
+	int             (* jack_set_process_callback)(jack_client_t * client, JackProcessCallback process_callback, void * arg);
+	jack_nframes_t  (* jack_get_sample_rate)(jack_client_t * client);
+	jack_nframes_t  (* jack_get_buffer_size)(jack_client_t * client);
+
+	jack_port_t    *(* jack_port_register)(jack_client_t * client, const char * port_name, const char * port_type, unsigned long flags, unsigned long buffer_size);
+	void           *(* jack_port_get_buffer)(jack_port_t * port, jack_nframes_t n_frames);
+	const char     *(* jack_port_name)(const jack_port_t * port);
+	void            (* jack_port_get_latency_range)(jack_port_t * port, jack_latency_callback_mode_t mode, jack_latency_range_t * range);
+
+	const char    **(* jack_get_ports)(jack_client_t * client, const char * port_name_pattern, const char * type_name_pattern, unsigned long flags);
+	int             (* jack_connect)(jack_client_t * client, const char * source_port, const char * destination_port);
+	void            (* jack_free)(void * ptr);
+} cw_jack_lib_handle_t;
+
+
+
+
+/* JACK library is loaded and its symbols are resolved once per
+   process, and are shared by all generators. Library cache of
+   cw_dlopen_internal() keeps the library loaded anyway, so the
+   handle is never closed: a generator that is deleted must not
+   pull the symbols from under other generators. */
+static cw_jack_lib_handle_t g_cw_jack_lib_handle;
+static pthread_mutex_t g_cw_jack_lib_handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+static cw_ret_t     cw_jack_load_library_internal(void);
+static int          cw_jack_dlsym_internal(cw_jack_lib_handle_t * cw_jack);
+static int          cw_jack_process_cb(jack_nframes_t n_frames, void * arg);
+static cw_ret_t     cw_jack_connect_ports_internal(cw_gen_t * gen);
+static cw_ret_t     cw_jack_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void         cw_jack_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t     cw_jack_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+
+
+
+
+static const char * CW_JACK_CLIENT_NAME = "libcw";
+static const char * CW_JACK_PORT_NAME = "output";
+
+
+
+
+/**
+   @brief Check if it is possible to open JACK output with given device name
+
+   Function first tries to load JACK library, and then tries to open a
+   client on JACK server (the function doesn't start the server if it
+   isn't running). The client is closed before returning.
+
+   @param[in] device_name name of JACK input port to which libcw would connect its output port; if NULL then the function will use library-default device name.
+
+   @return true if opening JACK client succeeded
+   @return false if opening JACK client failed
+*/
+bool cw_is_jack_possible(const char * device_name)
+{
+	if (CW_SUCCESS != cw_jack_load_library_internal()) {
+		return false;
+	}
+
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	cw_gen_pick_device_name_internal(device_name, CW_AUDIO_JACK,
+					 picked_device_name, sizeof (picked_device_name));
+
+	jack_status_t status = 0;
+	jack_client_t * client = g_cw_jack_lib_handle.jack_client_open(CW_JACK_CLIENT_NAME, JackNoStartServer, &status);
+	if (NULL == client) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "is possible: can't open client on JACK server, status = 0x%x", (unsigned int) status);
+		return false;
+	}
+	g_cw_jack_lib_handle.jack_client_close(client);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Load JACK library and resolve its symbols, if not done yet
+
+   On success the symbols are available in g_cw_jack_lib_handle
+   until end of process.
+
+   @return CW_SUCCESS if symbols of JACK library are available
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_jack_load_library_internal(void)
+{
+	pthread_mutex_lock(&g_cw_jack_lib_handle_mutex);
+	if (NULL != g_cw_jack_lib_handle.lib_handle) {
+		pthread_mutex_unlock(&g_cw_jack_lib_handle_mutex);
+		return CW_SUCCESS;
+	}
+
+	const char * const library_name[] = {
+		"libjack.so.0",
+		"libjack.so",
+		NULL,
+	};
+	cw_jack_lib_handle_t lib = { 0 };
+	for (int i = 0; NULL != library_name[i]; i++) {
+		if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &lib.lib_handle)) {
+			break;
+		}
+	}
+	if (NULL == lib.lib_handle) {
+		pthread_mutex_unlock(&g_cw_jack_lib_handle_mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "load library: can't open JACK 'libjack' library");
+		return CW_FAILURE;
+	}
+
+	const int rv = cw_jack_dlsym_internal(&lib);
+	if (rv < 0) {
+		dlclose(lib.lib_handle);
+		pthread_mutex_unlock(&g_cw_jack_lib_handle_mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "load library: failed to resolve JACK symbol #%d, can't correctly load JACK library", rv);
+		return CW_FAILURE;
+	}
+
+	g_cw_jack_lib_handle = lib;
+	pthread_mutex_unlock(&g_cw_jack_lib_handle_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with JACK sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with sound system (doesn't try to open or configure it).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_jack_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_JACK;
+	gen->open_and_configure_sound_device = cw_jack_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_jack_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_jack_write_buffer_to_sound_device_internal;
+
+	/* Samples are pulled by JACK server, generator won't need its
+	   own thread. */
+	gen->pull.enabled = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write generated samples to JACK sound device
+
+   JACK sound system gets samples through cw_jack_process_cb(). This
+   function shouldn't be called.
+
+   @param[in] gen generator
+
+   @return CW_FAILURE
+*/
+static cw_ret_t cw_jack_write_buffer_to_sound_device_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+		      MSG_PREFIX "write: JACK sound system works in pull mode, write function should not be called");
+	return CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Process callback called by JACK server in its real-time thread
+
+   Get @p n_frames samples from generator and put them, converted to
+   floats, into buffer of libcw's output port.
+
+   The callback doesn't wait for generator or for tones in generator's
+   tone queue. If there are no tones, the callback outputs silence. It
+   may still block briefly on mutex of tone queue, see description of
+   this file.
+
+   @param[in] n_frames count of frames requested by server
+   @param[in] arg generator
+
+   @return 0
+*/
+static int cw_jack_process_cb(jack_nframes_t n_frames, void * arg)
+{
+	cw_gen_t * gen = (cw_gen_t *) arg;
+	cw_jack_data_t * jack = &gen->jack_data;
+
+	jack_default_audio_sample_t * out = (jack_default_audio_sample_t *) g_cw_jack_lib_handle.jack_port_get_buffer(jack->port, n_frames);
+
+	if (n_frames > jack->n_samples) {
+		/* Size of server's buffer has been increased after we
+		   have opened the client. We can't allocate memory
+		   here. */
+		memset(out, 0, sizeof (jack_default_audio_sample_t) * n_frames);
+		return 0;
+	}
+
+	cw_gen_pull_samples_internal(gen, jack->samples, (int) n_frames);
+
+	for (jack_nframes_t i = 0; i < n_frames; i++) {
+		out[i] = (jack_default_audio_sample_t) jack->samples[i] / 32768.0F;
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Connect libcw's output port to input port(s)
+
+   If generator's picked device name is empty, the output port is
+   connected to all physical playback ports. Otherwise it is connected
+   to a port with the picked name.
+
+   Failure to connect is not fatal: user can connect the port with
+   other tools.
+
+   @param[in] gen generator with open JACK client
+
+   @return CW_SUCCESS if the output port has been connected to at least one input port
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_jack_connect_ports_internal(cw_gen_t * gen)
+{
+	cw_jack_data_t * jack = &gen->jack_data;
+	const char * source = g_cw_jack_lib_handle.jack_port_name(jack->port);
+
+	if ('\0' != gen->picked_device_name[0]) {
+		if (0 != g_cw_jack_lib_handle.jack_connect(jack->client, source, gen->picked_device_name)) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "open device: can't connect to port '%s'", gen->picked_device_name);
+			return CW_FAILURE;
+		}
+		return CW_SUCCESS;
+	}
+
+	const char ** ports = g_cw_jack_lib_handle.jack_get_ports(jack->client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+	if (NULL == ports) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "open device: no physical playback ports");
+		return CW_FAILURE;
+	}
+
+	int n_connected = 0;
+	for (int i = 0; NULL != ports[i]; i++) {
+		if (0 == g_cw_jack_lib_handle.jack_connect(jack->client, source, ports[i])) {
+			n_connected++;
+		} else {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "open device: can't connect to port '%s'", ports[i]);
+		}
+	}
+	g_cw_jack_lib_handle.jack_free(ports);
+
+	return n_connected > 0 ? CW_SUCCESS : CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Resolve/get symbols from JACK library
+
+   Function resolves/gets addresses of few JACK functions used by
+   libcw and stores them in @p cw_jack variable.
+
+   On failure the function returns negative value, different for every
+   symbol that the funciton failed to resolve. Function stops and returns
+   on first failure.
+
+   @param[in,out] cw_jack libcw jack data structure with library handle to opened JACK library
+
+   @return 0 on success
+   @return negative value on failure
+*/
+static int cw_jack_dlsym_internal(cw_jack_lib_handle_t * cw_jack)
+{
+	*(void **) &(cw_jack->jack_client_open)            = dlsym(cw_jack->lib_handle, "jack_client_open");
+	if (!cw_jack->jack_client_open)                    return -(__LINE__);
+	*(void **) &(cw_jack->jack_client_close)           = dlsym(cw_jack->lib_handle, "jack_client_close");
+	if (!cw_jack->jack_client_close)                   return -(__LINE__);
+	*(void **) &(cw_jack->jack_activate)               = dlsym(cw_jack->lib_handle, "jack_activate");
+	if (!cw_jack->jack_activate)                       return -(__LINE__);
+	*(void **) &(cw_jack->jack_deactivate)             = dlsym(cw_jack->lib_handle, "jack_deactivate");
+	if (!cw_jack->jack_deactivate)                     return -(__LINE__);
+	*(void **) &(cw_jack->jack_set_process_callback)   = dlsym(cw_jack->lib_handle, "jack_set_process_callback");
+	if (!cw_jack->jack_set_process_callback)           return -(__LINE__);
+	*(void **) &(cw_jack->jack_get_sample_rate)        = dlsym(cw_jack->lib_handle, "jack_get_sample_rate");
+	if (!cw_jack->jack_get_sample_rate)                return -(__LINE__);
+	*(void **) &(cw_jack->jack_get_buffer_size)        = dlsym(cw_jack->lib_handle, "jack_get_buffer_size");
+	if (!cw_jack->jack_get_buffer_size)                return -(__LINE__);
+
+	*(void **) &(cw_jack->jack_port_register)          = dlsym(cw_jack->lib_handle, "jack_port_register");
+	if (!cw_jack->jack_port_register)                  return -(__LINE__);
+	*(void **) &(cw_jack->jack_port_get_buffer)        = dlsym(cw_jack->lib_handle, "jack_port_get_buffer");
+	if (!cw_jack->jack_port_get_buffer)                return -(__LINE__);
+	*(void **) &(cw_jack->jack_port_name)              = dlsym(cw_jack->lib_handle, "jack_port_name");
+	if (!cw_jack->jack_port_name)                      return -(__LINE__);
+	*(void **) &(cw_jack->jack_port_get_latency_range) = dlsym(cw_jack->lib_handle, "jack_port_get_latency_range");
+	if (!cw_jack->jack_port_get_latency_range)         return -(__LINE__);
+
+	*(void **) &(cw_jack->jack_get_ports)              = dlsym(cw_jack->lib_handle, "jack_get_ports");
+	if (!cw_jack->jack_get_ports)                      return -(__LINE__);
+	*(void **) &(cw_jack->jack_connect)                = dlsym(cw_jack->lib_handle, "jack_connect");
+	if (!cw_jack->jack_connect)                        return -(__LINE__);
+	*(void **) &(cw_jack->jack_free)                   = dlsym(cw_jack->lib_handle, "jack_free");
+	if (!cw_jack->jack_free)                           return -(__LINE__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Open and configure JACK client for given generator
+
+   Function opens a client on JACK server, registers output port,
+   activates the client and connects the output port to playback
+   port(s).
+
+   Size of generator's buffer is set to size of server's buffer
+   (count of frames in single call of process callback).
+
+   @param[in,out] gen generator for which to open and configure sound system handle
+   @param[in] gen_conf
+
+   @return CW_FAILURE on errors
+   @return CW_SUCCESS on success
+*/
+static cw_ret_t cw_jack_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (gen->sound_device_is_open) {
+		/* Ignore the call if the device is already open. */
+		return CW_SUCCESS;
+	}
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	cw_jack_data_t * jack = &gen->jack_data;
+
+	jack_status_t status = 0;
+	const char * client_name = gen->library_client.name ? gen->library_client.name : CW_JACK_CLIENT_NAME;
+	jack->client = g_cw_jack_lib_handle.jack_client_open(client_name, JackNoStartServer, &status);
+	if (NULL == jack->client) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't open client on JACK server, status = 0x%x", (unsigned int) status);
+		return CW_FAILURE;
+	}
+
+	jack->port = g_cw_jack_lib_handle.jack_port_register(jack->client, CW_JACK_PORT_NAME, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+	if (NULL == jack->port) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't register output port");
+		cw_jack_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	jack->n_samples = g_cw_jack_lib_handle.jack_get_buffer_size(jack->client);
+	jack->samples = (cw_sample_t *) calloc(jack->n_samples, sizeof (cw_sample_t));
+	if (NULL == jack->samples) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: calloc()");
+		cw_jack_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	gen->buffer_n_samples = (int) jack->n_samples;
+	gen->sample_rate = g_cw_jack_lib_handle.jack_get_sample_rate(jack->client);
+
+	/* Until the generator is started, process callback will be
+	   getting silence from generator. */
+	if (0 != g_cw_jack_lib_handle.jack_set_process_callback(jack->client, cw_jack_process_cb, gen)) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't set process callback");
+		cw_jack_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	if (0 != g_cw_jack_lib_handle.jack_activate(jack->client)) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't activate client");
+		cw_jack_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Ports can be connected only after activation of client. */
+	cw_jack_connect_ports_internal(gen);
+
+	jack_latency_range_t range = { 0 };
+	g_cw_jack_lib_handle.jack_port_get_latency_range(jack->port, JackPlaybackLatency, &range);
+	jack->latency_n_frames = range.max;
+	cw_gen_latency_set_sound_device_latency_internal(gen, (int64_t) (jack->latency_n_frames + jack->n_samples) * CW_USECS_PER_SEC / gen->sample_rate);
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close JACK client of given generator
+
+   Function can be called for partially opened client (e.g. when
+   cw_jack_open_and_configure_sound_device_internal() fails).
+
+   @param[in,out] gen generator for which to close its sound device
+*/
+static void cw_jack_close_sound_device_internal(cw_gen_t * gen)
+{
+	cw_jack_data_t * jack = &gen->jack_data;
+
+	if (jack->client) {
+		/* After deactivation the process callback won't be
+		   called again, so we can safely free the memory used
+		   by the callback. */
+		g_cw_jack_lib_handle.jack_deactivate(jack->client);
+		g_cw_jack_lib_handle.jack_client_close(jack->client);
+		jack->client = NULL;
+		jack->port = NULL;
+	} else {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "close device: called the function for NULL JACK client");
+	}
+
+	free(jack->samples);
+	jack->samples = NULL;
+	jack->n_samples = 0;
+
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+#else /* #ifdef LIBCW_WITH_JACK */
+
+
+
+
+bool cw_is_jack_possible(__attribute__((unused)) const char * device_name)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return false;
+}
+
+
+
+
+cw_ret_t cw_jack_init_gen_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return CW_FAILURE;
+}
+
+
+
+
+#endif /* #ifdef LIBCW_WITH_JACK */
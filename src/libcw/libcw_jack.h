@@ -0,0 +1,50 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_JACK
+#define H_LIBCW_JACK
+
+
+
+
+#include "config.h"
+
+
+
+
+#ifdef LIBCW_WITH_JACK
+
+#include <jack/jack.h>
+
+#include "libcw.h"
+
+typedef struct cw_jack_data_struct {
+	jack_client_t * client;      /* Connection to JACK server. */
+	jack_port_t * port;          /* Output port of libcw's client. */
+
+	/* Samples pulled from generator in process callback, before
+	   conversion to JACK's float samples. */
+	cw_sample_t * samples;
+	jack_nframes_t n_samples;
+
+	jack_nframes_t latency_n_frames; /* Playback latency of connected ports, as reported by server. */
+} cw_jack_data_t;
+
+#endif /* #ifdef LIBCW_WITH_JACK */
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_jack_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_JACK */
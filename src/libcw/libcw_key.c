@@ -27,6 +27,8 @@
 
 
 
+#include "config.h"
+
 #include <errno.h>
 #include <inttypes.h> /* uint32_t */
 #include <stdbool.h>
@@ -42,8 +44,11 @@
 #include "libcw_debug.h"
 #include "libcw_gen.h"
 #include "libcw_key.h"
+#include "libcw_keylog.h"
+#include "libcw_metrics.h"
 #include "libcw_rec.h"
 #include "libcw_signal.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -145,6 +150,8 @@ static const char * cw_iambic_keyer_graph_states[] = {
 static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t * key);
 static cw_ret_t cw_key_ik_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value, char symbol);
 static cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value);
+static void cw_key_init_internal(cw_key_t * key);
+static void cw_key_unregister_internal(cw_key_t * key);
 
 
 
@@ -310,6 +317,11 @@ cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
 
 	/* Remember the new key value. */
 	key->sk.key_value = key_value;
+	CW_TRACE(CW_TRACE_EVENT_STRAIGHT_KEY_VALUE, key_value);
+	__atomic_add_fetch(&key->counters.n_sk_changes, 1, __ATOMIC_RELAXED);
+	if (NULL != key->keylog) {
+		cw_keylog_record(key->keylog, CW_KEYLOG_SOURCE_STRAIGHT_KEY, key_value, cw_clock_now_internal());
+	}
 
 	/* TODO: if you want to have a per-key callback called on each key
 	  value change, you should call it here. */
@@ -402,6 +414,10 @@ cw_ret_t cw_key_ik_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
 
 	/* Remember the new key value. */
 	key->ik.key_value = key_value;
+	CW_TRACE(CW_TRACE_EVENT_IAMBIC_KEYER_VALUE, key_value);
+	if (CW_KEY_VALUE_CLOSED == key_value) {
+		__atomic_add_fetch(&key->counters.n_ik_marks, 1, __ATOMIC_RELAXED);
+	}
 
 	/* TODO: if you want to have a per-key callback called on each key value
 	  change, you should call it here. */
@@ -752,6 +768,18 @@ cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t d
 	key->ik.dot_paddle_value = (dot_paddle_value != 0);
 	key->ik.dash_paddle_value = (dash_paddle_value != 0);
 #else
+	if (NULL != key->keylog) {
+		const int64_t now = cw_clock_now_internal();
+		if (dot_paddle_value != key->ik.dot_paddle_value) {
+			cw_keylog_record(key->keylog, CW_KEYLOG_SOURCE_DOT_PADDLE, dot_paddle_value, now);
+		}
+		if (dash_paddle_value != key->ik.dash_paddle_value) {
+			cw_keylog_record(key->keylog, CW_KEYLOG_SOURCE_DASH_PADDLE, dash_paddle_value, now);
+		}
+	}
+	if (dot_paddle_value != key->ik.dot_paddle_value || dash_paddle_value != key->ik.dash_paddle_value) {
+		__atomic_add_fetch(&key->counters.n_paddle_events, 1, __ATOMIC_RELAXED);
+	}
 	key->ik.dot_paddle_value = dot_paddle_value;
 	key->ik.dash_paddle_value = dash_paddle_value;
 #endif
@@ -832,9 +860,17 @@ static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t
 #ifdef IAMBIC_KEY_HAS_TIMER
 	if (NULL != key->ik.ik_timer) {
 		struct timeval t;
-		gettimeofday(&t, NULL); /* TODO: isn't gettimeofday() susceptible to NTP syncs? */
-		key->ik.ik_timer->tv_sec = t.tv_sec;
-		key->ik.ik_timer->tv_usec = t.tv_usec;
+		cw_clock_get_timeval_internal(&t); /* TODO: isn't gettimeofday() susceptible to NTP syncs? */
+
+		/* First mark of keying will be heard only after samples
+		   already written to sound device are played. */
+		const int64_t latency = cw_gen_latency_get_sound_device_latency_internal(key->gen);
+		const int64_t anchor = (int64_t) t.tv_sec * CW_USECS_PER_SEC + t.tv_usec + latency;
+		key->ik.ik_timer_anchor.tv_sec = anchor / CW_USECS_PER_SEC;
+		key->ik.ik_timer_anchor.tv_usec = anchor % CW_USECS_PER_SEC;
+		key->ik.ik_timer_n_samples = 0;
+
+		*key->ik.ik_timer = key->ik.ik_timer_anchor;
 	}
 #endif
 
@@ -1057,7 +1093,9 @@ cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key
 	       && key->ik.graph_state != KS_AFTER_DASH_A
 	       && key->ik.graph_state != KS_AFTER_DASH_B) {
 
+		cw_virtual_clock_wait_begin_internal();
 		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_virtual_clock_wait_end_internal();
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
 	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
@@ -1074,7 +1112,9 @@ cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key
 	       && key->ik.graph_state != KS_IN_DASH_A
 	       && key->ik.graph_state != KS_IN_DASH_B) {
 
+		cw_virtual_clock_wait_begin_internal();
 		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_virtual_clock_wait_end_internal();
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
 	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
@@ -1118,7 +1158,9 @@ cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key)
 	/* Wait for the keyer graph state to go idle. */
 	pthread_mutex_lock(&key->gen->tq->wait_mutex);
 	while (key->ik.graph_state != KS_IDLE) {
+		cw_virtual_clock_wait_begin_internal();
 		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_virtual_clock_wait_end_internal();
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
 	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
@@ -1129,6 +1171,46 @@ cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key)
 
 
 
+/**
+   @brief Start waiting for the current keyer cycle to complete, without blocking
+
+   Non-blocking equivalent of cw_key_ik_wait_for_keyer(). The wait
+   completes when keyer's graph state becomes IDLE: @p callback (if not
+   NULL) is called with @p callback_arg, and descriptor returned through
+   @p fd (if @p fd is not NULL) becomes readable. See
+   cw_gen_wait_for_queue_level_async() for details of completion.
+
+   @exception EINVAL @p key is NULL or has no generator, or both @p callback and @p fd are NULL
+   @exception EDEADLK either paddle is closed, so the keyer cycle would never end
+   @exception ENOSYS @p fd is not NULL, and descriptors are not supported on this platform
+
+   @param[in] key key on which to wait
+   @param[in] callback function to call on completion, may be NULL
+   @param[in] callback_arg argument of @p callback
+   @param[out] fd descriptor that becomes readable on completion, may be NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_wait_for_keyer_async(volatile cw_key_t * key, cw_wait_callback_t callback, void * callback_arg, int * fd)
+{
+	if (NULL == key || NULL == key->gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* See cw_key_ik_wait_for_keyer(). */
+	if (CW_KEY_VALUE_CLOSED == key->ik.dot_paddle_value || CW_KEY_VALUE_CLOSED == key->ik.dash_paddle_value) {
+		errno = EDEADLK;
+		return CW_FAILURE;
+	}
+
+	return cw_tq_wait_async_internal(key->gen->tq, CW_TQ_WAIT_KEYER_IDLE, 0, key, callback, callback_arg, fd);
+}
+
+
+
+
 /**
    @brief Reset iambic keyer data, stop generating sound on associated generator
 
@@ -1193,18 +1275,23 @@ void cw_key_ik_reset_state_internal(volatile cw_key_t * key)
    Iambic keyer has an internal timer variable. On some occasions the
    variable needs to be updated.
 
-   I thought that it needs to be updated by client application on key
-   paddle events, but it turns out that it should be also updated in
-   generator dequeue code. Not sure why.
+   The timer is updated by generator when a tone is dequeued, just
+   before the tone is written to sound device. Value of timer is
+   calculated from whole count of samples of tones dequeued since
+   keyer left KS_IDLE state, and from anchor time set when keyer left
+   the state (see cw_key_ik_update_graph_state_initial_internal()).
+   The value is therefore a time at which user will hear end of the
+   tone, not affected by rounding of durations of individual tones.
 
    @internal
    @reviewed 2020-08-02
    @endinternal
 
    @param[in] key key with timer to be updated
-   @param[in] usecs amount of increase (usually duration of a tone) for internal timer
+   @param[in] n_samples count of samples of dequeued tone
+   @param[in] sample_rate sample rate of generator
 */
-void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs)
+void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int64_t n_samples, int sample_rate)
 {
 	if (NULL == key) {
 		/* This function is called from generator thread. It
@@ -1216,7 +1303,7 @@ void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs)
 		return;
 	}
 
-	if (key->ik.graph_state != KS_IDLE && NULL != key->ik.ik_timer) {
+	if (key->ik.graph_state != KS_IDLE && NULL != key->ik.ik_timer && sample_rate > 0) {
 		/* Update timestamp that clocks iambic keyer
 		   with current time interval. This must be
 		   done only when iambic keyer is in
@@ -1225,11 +1312,14 @@ void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs)
 		   a straight key with this. */
 
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
-			      MSG_PREFIX_IK "ik increment: incrementing timer by %d [us]\n", usecs);
+			      MSG_PREFIX_IK "ik increment: incrementing timer by %lld samples\n", (long long) n_samples);
+
+		key->ik.ik_timer_n_samples += n_samples;
+		const int64_t usecs = key->ik.ik_timer_anchor.tv_usec
+			+ key->ik.ik_timer_n_samples * CW_USECS_PER_SEC / sample_rate;
 
-		key->ik.ik_timer->tv_usec += usecs % CW_USECS_PER_SEC;
-		key->ik.ik_timer->tv_sec  += usecs / CW_USECS_PER_SEC + key->ik.ik_timer->tv_usec / CW_USECS_PER_SEC;
-		key->ik.ik_timer->tv_usec %= CW_USECS_PER_SEC;
+		key->ik.ik_timer->tv_sec  = key->ik.ik_timer_anchor.tv_sec + usecs / CW_USECS_PER_SEC;
+		key->ik.ik_timer->tv_usec = usecs % CW_USECS_PER_SEC;
 	}
 
 	return;
@@ -1373,6 +1463,22 @@ cw_key_t * cw_key_new(void)
 		return (cw_key_t *) NULL;
 	}
 
+	cw_key_init_internal(key);
+	cw_metrics_register_internal(CW_METRICS_OBJECT_KEY, key);
+
+	return key;
+}
+
+
+
+
+/**
+   @brief Set initial values of fields of zeroed key
+
+   @param[in,out] key key to initialize
+*/
+static void cw_key_init_internal(cw_key_t * key)
+{
 	key->gen = (cw_gen_t *) NULL;
 	key->rec = (cw_rec_t *) NULL;
 
@@ -1395,7 +1501,28 @@ cw_key_t * cw_key_new(void)
 	key->ik.ik_timer = NULL;
 #endif
 
-	return key;
+	return;
+}
+
+
+
+
+/**
+   @brief Break links between key and objects that point to the key
+
+   @param[in,out] key key to unregister
+*/
+static void cw_key_unregister_internal(cw_key_t * key)
+{
+	if (NULL != key->gen) {
+		/* Unregister. */
+		key->gen->key = NULL;
+	}
+	if (NULL != key->keylog) {
+		key->keylog->key = NULL;
+	}
+
+	return;
 }
 
 
@@ -1422,10 +1549,8 @@ void cw_key_delete(cw_key_t ** key)
 		return;
 	}
 
-	if (NULL != (*key)->gen) {
-		/* Unregister. */
-		(*key)->gen->key = NULL;
-	}
+	cw_metrics_unregister_internal(*key);
+	cw_key_unregister_internal(*key);
 
 	free(*key);
 	*key = (cw_key_t *) NULL;
@@ -1436,6 +1561,21 @@ void cw_key_delete(cw_key_t ** key)
 
 
 
+void cw_key_reset(cw_key_t * key)
+{
+	cw_assert (NULL != key, MSG_PREFIX "key is NULL");
+
+	cw_key_unregister_internal(key);
+
+	memset(key, 0, sizeof (cw_key_t));
+	cw_key_init_internal(key);
+
+	return;
+}
+
+
+
+
 /**
    @internal
    @reviewed 2020-08-02
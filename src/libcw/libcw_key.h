@@ -10,6 +10,7 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 
@@ -120,9 +121,30 @@ struct cw_key_struct {
 #ifdef IAMBIC_KEY_HAS_TIMER
 		/* Timer for receiving of iambic keying, owned by client code. */
 		struct timeval * ik_timer;
+
+		/* The timer is derived from count of samples of tones
+		   played since keyer left KS_IDLE state. The anchor is
+		   the time at which first of these samples is heard by
+		   user: time of start of keying plus latency of sound
+		   device. */
+		struct timeval ik_timer_anchor;
+		int64_t ik_timer_n_samples;
 #endif
 	} ik;
 
+	/* Keying log recording changes of straight key and of
+	   paddles, see cw_keylog_attach_key(). */
+	cw_keylog_t * keylog;
+
+	/* Counters of keying, updated with atomic operations, so that
+	   exporter of metrics can read them without locking (see
+	   cw_metrics_write()). */
+	struct {
+		uint64_t n_sk_changes;     /* Changes of value of straight key. */
+		uint64_t n_paddle_events;  /* Changes of values of paddles. */
+		uint64_t n_ik_marks;       /* Dots and Dashes keyed by iambic keyer. */
+	} counters;
+
 	char label[LIBCW_OBJECT_INSTANCE_LABEL_SIZE];
 };
 
@@ -131,7 +153,7 @@ struct cw_key_struct {
 
 cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key);
 #ifdef IAMBIC_KEY_HAS_TIMER
-void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs);
+void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int64_t n_samples, int sample_rate);
 #endif
 void cw_key_ik_register_timer_internal(volatile cw_key_t * key, struct timeval * timer);
 
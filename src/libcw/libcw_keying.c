@@ -0,0 +1,781 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_keying.c
+
+   @brief Keying output. Key a transmitter with state of generator.
+
+   Generator thread reports changes of its state (see
+   cw_gen_value_tracking_set_value_internal()) when a tone is
+   dequeued, i.e. before the tone is written to sound device and long
+   before the tone is heard. Keying the transmitter at that moment
+   would make the transmitter lead the sidetone by latency of sound
+   device.
+
+   Instead, each change is put into a queue with a deadline: time of
+   the change plus latency of sound device (as reported by sound
+   system) plus offset configured by client code. A separate thread
+   (with real-time scheduling policy, if allowed) sleeps until the
+   deadline of the oldest event on the library's clock (the clock
+   that paces generator, see cw_clock_now_internal()), and then
+   changes state of output line. Since the
+   deadlines are absolute, jitter of wakeups doesn't accumulate, and
+   keying doesn't depend on timing of writes to sound device.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h> /* int64_t */
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/gpio.h>
+#include <linux/ppdev.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_keying.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/keying: "
+
+
+
+
+/* Priority of real-time thread of keying output if generator's
+   thread is not real-time, above priority of threads of typical sound
+   servers. */
+enum { CW_KEYING_THREAD_PRIORITY = 80 };
+
+/* Thread waiting for a deadline wakes up at least this often, to
+   notice request to stop. [ns] */
+#define CW_KEYING_POLL_NSECS (5 * 1000 * 1000)
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+static cw_ret_t cw_keying_check_closed_internal(cw_keying_t * keying);
+static void     cw_keying_close_internal(cw_keying_t * keying);
+static cw_ret_t cw_keying_write_internal(cw_keying_t * keying, cw_key_value_t value);
+static void *   cw_keying_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create new keying output
+
+   Keying output is not connected to any device yet: use one of
+   cw_keying_open_*() functions, and then start keying output with
+   cw_keying_start().
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] gen generator, state of which will key the transmitter
+
+   @return freshly allocated keying output on success
+   @return NULL pointer on failure
+*/
+cw_keying_t * cw_keying_new(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: NULL generator");
+		errno = EINVAL;
+		return (cw_keying_t *) NULL;
+	}
+
+	cw_keying_t * keying = (cw_keying_t *) calloc(1, sizeof (cw_keying_t));
+	if (NULL == keying) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_keying_t *) NULL;
+	}
+
+	keying->gen = gen;
+	keying->device_type = CW_KEYING_DEVICE_NONE;
+	keying->fd = -1;
+
+	pthread_mutex_init(&keying->mutex, NULL);
+	pthread_cond_init(&keying->cond, NULL);
+
+	return keying;
+}
+
+
+
+
+/**
+   @brief Delete keying output
+
+   Keying output is stopped (the transmitter is unkeyed), and its
+   device is closed. Pointer to @p keying is set to NULL.
+
+   @param[in] keying pointer to keying output to delete
+*/
+void cw_keying_delete(cw_keying_t ** keying)
+{
+	if (NULL == keying || NULL == *keying) {
+		return;
+	}
+
+	cw_keying_stop(*keying);
+	cw_keying_close_internal(*keying);
+
+	pthread_cond_destroy(&(*keying)->cond);
+	pthread_mutex_destroy(&(*keying)->mutex);
+
+	free(*keying);
+	*keying = (cw_keying_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Key transmitter through RTS or DTR line of serial port
+
+   @param[in] keying keying output
+   @param[in] path path to serial port device (e.g. "/dev/ttyUSB0")
+   @param[in] line output line of serial port
+   @param[in] active_low whether the line is de-asserted when transmitter is keyed
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_open_serial(cw_keying_t * keying, const char * path, cw_keying_serial_line_t line, bool active_low)
+{
+	if (NULL == keying || NULL == path
+	    || (CW_KEYING_SERIAL_RTS != line && CW_KEYING_SERIAL_DTR != line)) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (CW_SUCCESS != cw_keying_check_closed_internal(keying)) {
+		return CW_FAILURE;
+	}
+
+	const int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (-1 == fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	keying->device_type = CW_KEYING_DEVICE_SERIAL;
+	keying->fd = fd;
+	keying->active_low = active_low;
+	keying->serial_bits = CW_KEYING_SERIAL_RTS == line ? TIOCM_RTS : TIOCM_DTR;
+
+	if (CW_SUCCESS != cw_keying_write_internal(keying, CW_KEY_VALUE_OPEN)) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "%s is not a serial port: %s", path, strerror(errno));
+		cw_keying_close_internal(keying);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Key transmitter through a line of Linux GPIO chip
+
+   The function fails with errno set to ENOSYS if libcw has been
+   compiled without support for GPIO character device (uAPI v2).
+
+   @param[in] keying keying output
+   @param[in] path path to GPIO chip (e.g. "/dev/gpiochip0")
+   @param[in] offset offset of line of the chip
+   @param[in] active_low whether the line is low when transmitter is keyed
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_open_gpio(cw_keying_t * keying, const char * path, unsigned int offset, bool active_low)
+{
+	if (NULL == keying || NULL == path) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (CW_SUCCESS != cw_keying_check_closed_internal(keying)) {
+		return CW_FAILURE;
+	}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	const int chip_fd = open(path, O_RDWR | O_CLOEXEC);
+	if (-1 == chip_fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	/* Line is requested with initial value "inactive", so that
+	   transmitter isn't keyed when the line is configured. */
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof (request));
+	request.offsets[0] = offset;
+	request.num_lines = 1;
+	snprintf(request.consumer, sizeof (request.consumer), "libcw");
+	request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+	if (active_low) {
+		request.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+	}
+
+	const int rv = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+	const int saved_errno = errno;
+	close(chip_fd);
+	if (-1 == rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't request line %u of %s: %s", offset, path, strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	keying->device_type = CW_KEYING_DEVICE_GPIO;
+	keying->fd = request.fd;
+	keying->active_low = false; /* Handled by GPIO subsystem. */
+
+	return CW_SUCCESS;
+#else
+	(void) offset;
+	(void) active_low;
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+		      MSG_PREFIX "GPIO is not supported");
+	errno = ENOSYS;
+	return CW_FAILURE;
+#endif
+}
+
+
+
+
+/**
+   @brief Key transmitter through data pin of parallel port
+
+   The port is claimed through Linux ppdev driver. Other data pins of
+   the port are held low.
+
+   @param[in] keying keying output
+   @param[in] path path to parallel port device (e.g. "/dev/parport0")
+   @param[in] data_pin data pin of the port (0 for D0 - 7 for D7)
+   @param[in] active_low whether the pin is low when transmitter is keyed
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_open_parport(cw_keying_t * keying, const char * path, int data_pin, bool active_low)
+{
+	if (NULL == keying || NULL == path || data_pin < 0 || data_pin > 7) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (CW_SUCCESS != cw_keying_check_closed_internal(keying)) {
+		return CW_FAILURE;
+	}
+
+	const int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (-1 == fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+	if (-1 == ioctl(fd, PPCLAIM)) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't claim parallel port %s: %s", path, strerror(errno));
+		close(fd);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	keying->device_type = CW_KEYING_DEVICE_PARPORT;
+	keying->fd = fd;
+	keying->active_low = active_low;
+	keying->data_pin = data_pin;
+
+	if (CW_SUCCESS != cw_keying_write_internal(keying, CW_KEY_VALUE_OPEN)) {
+		const int saved_errno = errno;
+		cw_keying_close_internal(keying);
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Set offset of keying relative to sidetone
+
+   Positive @p offset delays keying of transmitter relative to the
+   moment when the sidetone is heard, negative @p offset keys the
+   transmitter earlier. The offset must be in range
+   [-CW_KEYING_OFFSET_MAX, CW_KEYING_OFFSET_MAX].
+
+   @param[in] keying keying output
+   @param[in] offset offset [us]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_set_offset(cw_keying_t * keying, int offset)
+{
+	if (NULL == keying || offset < -CW_KEYING_OFFSET_MAX || offset > CW_KEYING_OFFSET_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&keying->mutex);
+	keying->offset = offset;
+	pthread_mutex_unlock(&keying->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get offset of keying relative to sidetone
+
+   @param[in] keying keying output
+
+   @return offset [us]
+*/
+int cw_keying_get_offset(const cw_keying_t * keying)
+{
+	return keying->offset;
+}
+
+
+
+
+/**
+   @brief Start keying the transmitter with state of generator
+
+   @param[in] keying keying output with open device
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_start(cw_keying_t * keying)
+{
+	if (NULL == keying || NULL == keying->gen || CW_KEYING_DEVICE_NONE == keying->device_type) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (keying->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	keying->events_head = 0;
+	keying->events_count = 0;
+	keying->last_deadline = 0;
+	keying->thread_quit = false;
+
+	/* Deadlines of keying output must not wait for generator filling
+	   buffers of sound device. */
+	keying->sched_policy = SCHED_FIFO;
+	keying->sched_priority = CW_KEYING_THREAD_PRIORITY;
+	if (SCHED_OTHER != keying->gen->realtime.sched_policy) {
+		keying->sched_policy = keying->gen->realtime.sched_policy;
+		keying->sched_priority = keying->gen->realtime.sched_priority + 1;
+	}
+	if (keying->sched_priority > sched_get_priority_max(keying->sched_policy)) {
+		keying->sched_priority = sched_get_priority_max(keying->sched_policy);
+	}
+
+	const int rv = pthread_create(&keying->thread, NULL, cw_keying_thread_internal, keying);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		errno = rv;
+		return CW_FAILURE;
+	}
+	keying->thread_running = true;
+
+	pthread_mutex_lock(&keying->gen->value_tracking.keying_mutex);
+	keying->gen->value_tracking.keying = keying;
+	pthread_mutex_unlock(&keying->gen->value_tracking.keying_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop keying the transmitter
+
+   Events that are still waiting for their deadlines are discarded,
+   and the transmitter is unkeyed.
+
+   @param[in] keying keying output
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keying_stop(cw_keying_t * keying)
+{
+	if (NULL == keying) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!keying->thread_running) {
+		return CW_SUCCESS;
+	}
+
+	/* After this generator thread no longer pushes events. */
+	if (NULL != keying->gen) {
+		pthread_mutex_lock(&keying->gen->value_tracking.keying_mutex);
+		keying->gen->value_tracking.keying = NULL;
+		pthread_mutex_unlock(&keying->gen->value_tracking.keying_mutex);
+	}
+
+	pthread_mutex_lock(&keying->mutex);
+	keying->thread_quit = true;
+	pthread_cond_signal(&keying->cond);
+	pthread_mutex_unlock(&keying->mutex);
+
+	pthread_join(keying->thread, NULL);
+	keying->thread_running = false;
+
+	cw_keying_write_internal(keying, CW_KEY_VALUE_OPEN);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Queue change of generator's state
+
+   Called by generator thread when value of generator changes.
+
+   @param[in] keying keying output
+   @param[in] value new value of generator
+*/
+void cw_keying_push_internal(cw_keying_t * keying, cw_key_value_t value)
+{
+	const int64_t now = cw_clock_now_internal();
+	const int64_t latency = cw_gen_latency_get_sound_device_latency_internal(keying->gen);
+
+	pthread_mutex_lock(&keying->mutex);
+
+	int64_t deadline = cw_keying_deadline_internal(now, latency, keying->offset);
+	if (deadline < keying->last_deadline) {
+		/* Offset or latency has decreased. Keep order of events. */
+		deadline = keying->last_deadline;
+	}
+
+	if (keying->events_count == CW_KEYING_EVENTS_CAPACITY) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_WARNING,
+			      MSG_PREFIX "queue of events is full, dropping event");
+	} else {
+		const int tail = (keying->events_head + keying->events_count) % CW_KEYING_EVENTS_CAPACITY;
+		keying->events[tail].value = value;
+		keying->events[tail].deadline = deadline;
+		keying->events_count++;
+		keying->last_deadline = deadline;
+		pthread_cond_signal(&keying->cond);
+	}
+
+	pthread_mutex_unlock(&keying->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate deadline of change of transmitter's state
+
+   Keying can't be done before generator changed its state, so
+   negative offset larger than latency of sound device is limited.
+
+   @param[in] now time of change of generator's state [ns]
+   @param[in] latency latency of sound device [us]
+   @param[in] offset offset of keying relative to sidetone [us]
+
+   @return deadline [ns]
+*/
+int64_t cw_keying_deadline_internal(int64_t now, int64_t latency, int offset)
+{
+	const int64_t delay = latency + offset;
+	return delay > 0 ? now + delay * 1000 : now;
+}
+
+
+
+
+static cw_ret_t cw_keying_check_closed_internal(cw_keying_t * keying)
+{
+	if (keying->thread_running || CW_KEYING_DEVICE_NONE != keying->device_type) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+static void cw_keying_close_internal(cw_keying_t * keying)
+{
+	if (CW_KEYING_DEVICE_PARPORT == keying->device_type) {
+		ioctl(keying->fd, PPRELEASE);
+	}
+	if (-1 != keying->fd) {
+		close(keying->fd);
+	}
+	keying->fd = -1;
+	keying->device_type = CW_KEYING_DEVICE_NONE;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set state of output line of device
+
+   @param[in] keying keying output
+   @param[in] value CW_KEY_VALUE_CLOSED to key the transmitter
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_keying_write_internal(cw_keying_t * keying, cw_key_value_t value)
+{
+	const bool level = (CW_KEY_VALUE_CLOSED == value) != keying->active_low;
+	int rv = 0;
+
+	switch (keying->device_type) {
+	case CW_KEYING_DEVICE_SERIAL:
+		rv = ioctl(keying->fd, level ? TIOCMBIS : TIOCMBIC, &keying->serial_bits);
+		break;
+
+	case CW_KEYING_DEVICE_GPIO: {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+		struct gpio_v2_line_values values = { 0 };
+		values.mask = 1;
+		values.bits = level ? 1 : 0;
+		rv = ioctl(keying->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+#endif
+		break;
+	}
+
+	case CW_KEYING_DEVICE_PARPORT: {
+		unsigned char data = level ? (unsigned char) (1 << keying->data_pin) : 0;
+		rv = ioctl(keying->fd, PPWDATA, &data);
+		break;
+	}
+
+	case CW_KEYING_DEVICE_NONE:
+	default:
+		return CW_SUCCESS;
+	}
+
+	if (-1 == rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't set value %d of output: %s", value, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+static void * cw_keying_thread_internal(void * arg)
+{
+	cw_keying_t * keying = (cw_keying_t *) arg;
+
+	struct sched_param param = { 0 };
+	param.sched_priority = keying->sched_priority;
+	const int rv = pthread_setschedparam(pthread_self(), keying->sched_policy, &param);
+	if (0 != rv) {
+		/* Not fatal, e.g. process without CAP_SYS_NICE or
+		   RLIMIT_RTPRIO. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_WARNING,
+			      MSG_PREFIX "can't use real-time scheduling: %s", strerror(rv));
+	}
+
+	pthread_mutex_lock(&keying->mutex);
+	while (!keying->thread_quit) {
+		if (0 == keying->events_count) {
+			pthread_cond_wait(&keying->cond, &keying->mutex);
+			continue;
+		}
+
+		const cw_keying_event_t event = keying->events[keying->events_head];
+		const int64_t now = cw_clock_now_internal();
+		if (now < event.deadline) {
+			/* Deadlines of events queued in the meantime are
+			   not earlier than this one, see
+			   cw_keying_push_internal(). */
+			const int64_t wake_up = event.deadline < now + CW_KEYING_POLL_NSECS
+				? event.deadline
+				: now + CW_KEYING_POLL_NSECS;
+			pthread_mutex_unlock(&keying->mutex);
+			cw_clock_sleep_until_internal(wake_up);
+			pthread_mutex_lock(&keying->mutex);
+			continue;
+		}
+
+		keying->events_head = (keying->events_head + 1) % CW_KEYING_EVENTS_CAPACITY;
+		keying->events_count--;
+
+		pthread_mutex_unlock(&keying->mutex);
+		cw_keying_write_internal(keying, event.value);
+		pthread_mutex_lock(&keying->mutex);
+	}
+	pthread_mutex_unlock(&keying->mutex);
+
+	return NULL;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_keying_t * cw_keying_new(__attribute__((unused)) cw_gen_t * gen)
+{
+	errno = ENOSYS;
+	return (cw_keying_t *) NULL;
+}
+
+void cw_keying_delete(__attribute__((unused)) cw_keying_t ** keying)
+{
+	return;
+}
+
+cw_ret_t cw_keying_open_serial(__attribute__((unused)) cw_keying_t * keying, __attribute__((unused)) const char * path, __attribute__((unused)) cw_keying_serial_line_t line, __attribute__((unused)) bool active_low)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_keying_open_gpio(__attribute__((unused)) cw_keying_t * keying, __attribute__((unused)) const char * path, __attribute__((unused)) unsigned int offset, __attribute__((unused)) bool active_low)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_keying_open_parport(__attribute__((unused)) cw_keying_t * keying, __attribute__((unused)) const char * path, __attribute__((unused)) int data_pin, __attribute__((unused)) bool active_low)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_keying_set_offset(__attribute__((unused)) cw_keying_t * keying, __attribute__((unused)) int offset)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+int cw_keying_get_offset(__attribute__((unused)) const cw_keying_t * keying)
+{
+	return 0;
+}
+
+cw_ret_t cw_keying_start(__attribute__((unused)) cw_keying_t * keying)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_keying_stop(__attribute__((unused)) cw_keying_t * keying)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+void cw_keying_push_internal(__attribute__((unused)) cw_keying_t * keying, __attribute__((unused)) cw_key_value_t value)
+{
+	return;
+}
+
+int64_t cw_keying_deadline_internal(int64_t now, __attribute__((unused)) int64_t latency, __attribute__((unused)) int offset)
+{
+	return now;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
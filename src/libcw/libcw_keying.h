@@ -0,0 +1,85 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_KEYING
+#define H_LIBCW_KEYING
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Capacity of queue of changes of state waiting for their deadlines. */
+enum { CW_KEYING_EVENTS_CAPACITY = 64 };
+
+
+
+
+typedef enum {
+	CW_KEYING_DEVICE_NONE,
+	CW_KEYING_DEVICE_SERIAL,
+	CW_KEYING_DEVICE_GPIO,
+	CW_KEYING_DEVICE_PARPORT
+} cw_keying_device_type_t;
+
+
+
+
+typedef struct {
+	cw_key_value_t value;
+	int64_t deadline; /* [ns], monotonic clock. */
+} cw_keying_event_t;
+
+
+
+
+struct cw_keying_struct {
+	cw_gen_t * gen;
+
+	cw_keying_device_type_t device_type;
+	int fd;
+	bool active_low;
+	int serial_bits; /* TIOCM_RTS or TIOCM_DTR. */
+	int data_pin;    /* Bit of data register of parallel port. */
+
+	/* Offset of keying relative to sidetone [us]. */
+	int offset;
+
+	/* Queue of events, protected by mutex. Deadlines of events in
+	   the queue never decrease. */
+	cw_keying_event_t events[CW_KEYING_EVENTS_CAPACITY];
+	int events_head;
+	int events_count;
+	int64_t last_deadline;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; /* Uses monotonic clock. */
+	pthread_t thread;
+	int sched_policy;
+	int sched_priority;
+	bool thread_running;
+	bool thread_quit;
+};
+
+
+
+
+void    cw_keying_push_internal(cw_keying_t * keying, cw_key_value_t value);
+int64_t cw_keying_deadline_internal(int64_t now, int64_t latency, int offset);
+
+
+
+
+#endif /* #ifndef H_LIBCW_KEYING */
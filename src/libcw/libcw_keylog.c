@@ -0,0 +1,537 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_keylog.c
+
+   @brief Keying log. Record changes of key and generator to a file, replay them into receiver.
+
+   Key (cw_key_sk_set_value(), cw_key_ik_notify_paddle_event()) and
+   generator (when its value changes) pass their changes to keying
+   log attached to them. Each change is encoded as one varint, see
+   description of format in libcw2.h. Writes are buffered by stdio,
+   so recording a change costs little more than a few shifts.
+
+   Replay decodes the changes of one source, and passes them to
+   receiver with cw_rec_process_events(): in chunks of
+   CW_KEYLOG_REPLAY_CHUNK changes when replaying as fast as possible,
+   one by one at their time (relative to start of replay) when
+   replaying in real time.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_key.h"
+#include "libcw_keylog.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/keylog: "
+
+#define CW_KEYLOG_VERSION 1
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static cw_keylog_t * cw_keylog_new_internal(const char * path, bool is_writer);
+
+
+
+
+/**
+   @brief Create keying log that records changes to a file
+
+   An existing file at @p path is truncated.
+
+   @param[in] path path to the file
+
+   @return freshly allocated keying log on success
+   @return NULL pointer on failure
+*/
+cw_keylog_t * cw_keylog_new_writer(const char * path)
+{
+	cw_keylog_t * keylog = cw_keylog_new_internal(path, true);
+	if (NULL == keylog) {
+		return (cw_keylog_t *) NULL;
+	}
+
+	const uint8_t header[CW_KEYLOG_HEADER_SIZE] = { 'C', 'W', 'K', 'L', CW_KEYLOG_VERSION, 0, 0, 0 };
+	if (1 != fwrite(header, sizeof (header), 1, keylog->file)) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new writer: can't write header to '%s': %s", path, strerror(saved_errno));
+		cw_keylog_delete(&keylog);
+		errno = saved_errno;
+		return (cw_keylog_t *) NULL;
+	}
+
+	return keylog;
+}
+
+
+
+
+/**
+   @brief Create keying log that reads changes from a file
+
+   @exception EINVAL the file is not a keying log
+
+   @param[in] path path to the file
+
+   @return freshly allocated keying log on success
+   @return NULL pointer on failure
+*/
+cw_keylog_t * cw_keylog_new_reader(const char * path)
+{
+	cw_keylog_t * keylog = cw_keylog_new_internal(path, false);
+	if (NULL == keylog) {
+		return (cw_keylog_t *) NULL;
+	}
+
+	uint8_t header[CW_KEYLOG_HEADER_SIZE] = { 0 };
+	if (1 != fread(header, sizeof (header), 1, keylog->file)
+	    || 0 != memcmp(header, "CWKL", 4)
+	    || CW_KEYLOG_VERSION != header[4]) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new reader: '%s' is not a keying log", path);
+		cw_keylog_delete(&keylog);
+		errno = EINVAL;
+		return (cw_keylog_t *) NULL;
+	}
+
+	return keylog;
+}
+
+
+
+
+/**
+   @brief Delete keying log
+
+   Keying log is detached from key and generator, and its file is
+   closed (recorded changes are flushed to the file). Pointer to @p
+   keylog is set to NULL.
+
+   @param[in] keylog pointer to keying log to delete
+*/
+void cw_keylog_delete(cw_keylog_t ** keylog)
+{
+	if (NULL == keylog || NULL == *keylog) {
+		return;
+	}
+
+	cw_keylog_attach_key(*keylog, NULL);
+	cw_keylog_attach_generator(*keylog, NULL);
+
+	if (NULL != (*keylog)->file) {
+		fclose((*keylog)->file);
+	}
+	pthread_mutex_destroy(&(*keylog)->mutex);
+
+	free(*keylog);
+	*keylog = (cw_keylog_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Record a change in keying log
+
+   Key and generator attached to keying log call this function by
+   themselves. Client code may call it to record changes of its own
+   sources of keying.
+
+   @exception EINVAL keying log is not a writer, invalid source or value, negative timestamp
+
+   @param[in] keylog keying log
+   @param[in] source source of change
+   @param[in] value new value of source
+   @param[in] timestamp time of the change [ns]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keylog_record(cw_keylog_t * keylog, cw_keylog_source_t source, cw_key_value_t value, int64_t timestamp)
+{
+	if (NULL == keylog || !keylog->is_writer
+	    || source < CW_KEYLOG_SOURCE_STRAIGHT_KEY || source > CW_KEYLOG_SOURCE_GENERATOR
+	    || (CW_KEY_VALUE_OPEN != value && CW_KEY_VALUE_CLOSED != value)
+	    || timestamp < 0) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&keylog->mutex);
+
+	const int64_t timestamp_us = timestamp / 1000;
+	const int64_t delta = timestamp_us - keylog->prev_timestamp;
+	keylog->prev_timestamp = timestamp_us;
+
+	/* Zigzag encoding keeps small negative differences small. */
+	const uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+	uint64_t word = (zigzag << 3) | ((uint64_t) source << 1) | (CW_KEY_VALUE_CLOSED == value ? 1 : 0);
+
+	uint8_t bytes[10];
+	size_t n_bytes = 0;
+	do {
+		bytes[n_bytes] = (uint8_t) (word & 0x7f);
+		word >>= 7;
+		if (0 != word) {
+			bytes[n_bytes] |= 0x80;
+		}
+		n_bytes++;
+	} while (0 != word);
+
+	const size_t n_written = fwrite(bytes, 1, n_bytes, keylog->file);
+
+	pthread_mutex_unlock(&keylog->mutex);
+
+	if (n_written != n_bytes) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "record: fwrite(): %s", strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Record changes of straight key and of paddles of given key
+
+   Pass NULL @p key to stop recording changes of key that is currently
+   attached. Keying log can be attached to one key at a time.
+
+   @exception EINVAL keying log is not a writer
+
+   @param[in] keylog keying log
+   @param[in] key key to attach
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keylog_attach_key(cw_keylog_t * keylog, cw_key_t * key)
+{
+	if (NULL == keylog || (NULL != key && !keylog->is_writer)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (NULL != keylog->key) {
+		keylog->key->keylog = NULL;
+	}
+	keylog->key = key;
+	if (NULL != key) {
+		if (NULL != key->keylog) {
+			key->keylog->key = NULL;
+		}
+		key->keylog = keylog;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Record changes of value of given generator
+
+   Changes are recorded with time at which they are heard. Pass NULL
+   @p gen to stop recording changes of generator that is currently
+   attached. Keying log can be attached to one generator at a time.
+
+   @exception EINVAL keying log is not a writer
+
+   @param[in] keylog keying log
+   @param[in] gen generator to attach
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keylog_attach_generator(cw_keylog_t * keylog, cw_gen_t * gen)
+{
+	if (NULL == keylog || (NULL != gen && !keylog->is_writer)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (NULL != keylog->gen) {
+		pthread_mutex_lock(&keylog->gen->value_tracking.keying_mutex);
+		keylog->gen->value_tracking.keylog = NULL;
+		pthread_mutex_unlock(&keylog->gen->value_tracking.keying_mutex);
+	}
+	keylog->gen = gen;
+	if (NULL != gen) {
+		pthread_mutex_lock(&gen->value_tracking.keying_mutex);
+		if (NULL != gen->value_tracking.keylog) {
+			gen->value_tracking.keylog->gen = NULL;
+		}
+		gen->value_tracking.keylog = keylog;
+		pthread_mutex_unlock(&gen->value_tracking.keying_mutex);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write recorded changes to file
+
+   @param[in] keylog keying log
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keylog_flush(cw_keylog_t * keylog)
+{
+	if (NULL == keylog || !keylog->is_writer) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&keylog->mutex);
+	const int rv = fflush(keylog->file);
+	pthread_mutex_unlock(&keylog->mutex);
+
+	return 0 == rv ? CW_SUCCESS : CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Read next change from keying log
+
+   @exception ENODATA there are no more changes in the log
+   @exception EILSEQ the log is damaged (e.g. truncated in the middle of a change)
+
+   @param[in] keylog keying log opened with cw_keylog_new_reader()
+   @param[out] event the change
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_keylog_read(cw_keylog_t * keylog, cw_keylog_event_t * event)
+{
+	if (NULL == keylog || keylog->is_writer || NULL == event) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	uint64_t word = 0;
+	unsigned int shift = 0;
+	while (true) {
+		const int c = getc(keylog->file);
+		if (EOF == c) {
+			errno = 0 == shift ? ENODATA : EILSEQ;
+			return CW_FAILURE;
+		}
+		if (shift > 63) {
+			errno = EILSEQ;
+			return CW_FAILURE;
+		}
+		word |= (uint64_t) (c & 0x7f) << shift;
+		shift += 7;
+		if (0 == (c & 0x80)) {
+			break;
+		}
+	}
+
+	const uint64_t zigzag = word >> 3;
+	const int64_t delta = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+	keylog->prev_timestamp += delta;
+
+	event->timestamp = keylog->prev_timestamp * 1000;
+	event->source = (cw_keylog_source_t) ((word >> 1) & 3);
+	event->value = (word & 1) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Replay changes from keying log into receiver
+
+   Remaining changes of @p source are passed to @p rec as beginnings
+   and ends of Marks, and characters recognized by the receiver are
+   passed to @p callback_func (see cw_rec_process_events()). Changes
+   of other sources are skipped. After last change the receiver is
+   told that a long Space has passed, so that the last character and
+   inter-word-space are reported right away.
+
+   In real time replay the function sleeps until the time of each
+   change (relative to time of first change), and receiver gets
+   current times as timestamps. Otherwise the receiver gets recorded
+   timestamps, and the whole log is processed as fast as possible.
+
+   @exception EINVAL @p source is not straight key nor generator
+   @exception EILSEQ the log is damaged
+
+   @param[in] keylog keying log opened with cw_keylog_new_reader()
+   @param[in,out] rec receiver
+   @param[in] source source of changes to replay
+   @param[in] realtime whether to replay in real time
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS if all changes have been replayed
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_keylog_replay(cw_keylog_t * keylog, cw_rec_t * rec, cw_keylog_source_t source, bool realtime, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == keylog || keylog->is_writer || NULL == rec
+	    || (CW_KEYLOG_SOURCE_STRAIGHT_KEY != source && CW_KEYLOG_SOURCE_GENERATOR != source)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_event_t events[CW_KEYLOG_REPLAY_CHUNK + 1];
+	size_t n_events = 0;
+	cw_key_value_t value = CW_KEY_VALUE_OPEN;
+	int64_t first_timestamp = -1;
+	int64_t start = 0;
+	int64_t timestamp = 0;
+
+	cw_keylog_event_t event;
+	while (CW_SUCCESS == cw_keylog_read(keylog, &event)) {
+		if (source != event.source || value == event.value) {
+			continue;
+		}
+		value = event.value;
+
+		if (-1 == first_timestamp) {
+			first_timestamp = event.timestamp;
+			start = cw_clock_now_internal();
+		}
+		int64_t t = realtime ? start + (event.timestamp - first_timestamp) : event.timestamp;
+		/* Changes of generator may be recorded slightly out of
+		   order (estimate of latency of sound device changes). */
+		if (t < timestamp) {
+			t = timestamp;
+		}
+		timestamp = t;
+
+		if (realtime) {
+			cw_clock_sleep_until_internal(timestamp);
+		}
+		events[n_events].type = CW_KEY_VALUE_CLOSED == value ? CW_REC_EVENT_MARK_BEGIN : CW_REC_EVENT_MARK_END;
+		events[n_events].timestamp = timestamp;
+		n_events++;
+
+		if (realtime || CW_KEYLOG_REPLAY_CHUNK == n_events) {
+			if (CW_SUCCESS != cw_rec_process_events(rec, events, n_events, callback_func, callback_arg)) {
+				return CW_FAILURE;
+			}
+			n_events = 0;
+		}
+	}
+	if (ENODATA != errno) {
+		return CW_FAILURE;
+	}
+
+	if (CW_KEY_VALUE_CLOSED == value) {
+		/* Log ends in the middle of a Mark. */
+		events[n_events].type = CW_REC_EVENT_MARK_END;
+		events[n_events].timestamp = timestamp;
+		n_events++;
+	}
+	events[n_events].type = CW_REC_EVENT_POLL;
+	events[n_events].timestamp = timestamp + (int64_t) CW_KEYLOG_REPLAY_FLUSH_DURATION * 1000;
+	n_events++;
+
+	return cw_rec_process_events(rec, events, n_events, callback_func, callback_arg);
+}
+
+
+
+
+static cw_keylog_t * cw_keylog_new_internal(const char * path, bool is_writer)
+{
+	if (NULL == path) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: NULL path");
+		errno = EINVAL;
+		return (cw_keylog_t *) NULL;
+	}
+
+	cw_keylog_t * keylog = (cw_keylog_t *) calloc(1, sizeof (cw_keylog_t));
+	if (NULL == keylog) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_keylog_t *) NULL;
+	}
+	pthread_mutex_init(&keylog->mutex, NULL);
+	keylog->is_writer = is_writer;
+
+	keylog->file = fopen(path, is_writer ? "wb" : "rb");
+	if (NULL == keylog->file) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: can't open '%s': %s", path, strerror(saved_errno));
+		pthread_mutex_destroy(&keylog->mutex);
+		free(keylog);
+		errno = saved_errno;
+		return (cw_keylog_t *) NULL;
+	}
+
+	return keylog;
+}
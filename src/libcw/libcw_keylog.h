@@ -0,0 +1,59 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_KEYLOG
+#define H_LIBCW_KEYLOG
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Size of header of file of keying log [bytes]. */
+enum { CW_KEYLOG_HEADER_SIZE = 8 };
+
+/* Count of events passed to receiver in one call of
+   cw_rec_process_events() during replay. */
+enum { CW_KEYLOG_REPLAY_CHUNK = 256 };
+
+/* Space after last change of replayed log, long enough to end last
+   word even at lowest speed of receiver [us]. */
+enum { CW_KEYLOG_REPLAY_FLUSH_DURATION = 10000000 };
+
+
+
+
+struct cw_keylog_struct {
+	FILE * file;
+	bool is_writer;
+
+	/* Timestamp of previous change [us]. */
+	int64_t prev_timestamp;
+
+	/* Key and generator whose changes are recorded. They detach
+	   themselves from keying log when they are deleted. */
+	cw_key_t * key;
+	cw_gen_t * gen;
+
+	/* Changes of key and generator may come from different
+	   threads. */
+	pthread_mutex_t mutex;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_KEYLOG */
@@ -0,0 +1,1150 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_metrics.c
+
+   @brief Metrics. Counters of libcw objects in Prometheus text format.
+
+   Generators, receivers and keys register themselves in a registry
+   of the process when they are created, and unregister when they are
+   deleted. cw_metrics_write() takes the registry's mutex (so no
+   object is deleted while it's being read), copies counters of all
+   objects, and renders the copies as text.
+
+   Counters are read without locks of the objects: generators and
+   keys update them with atomic operations, and latency statistics of
+   generator are read through a sequence lock (see
+   cw_gen_latency_snapshot_internal()). Threads of generators and of
+   keys never wait for the exporter.
+
+   Exporter serves the text over HTTP from its own thread, one client
+   at a time. Only GET (and HEAD) requests are served, path of request
+   is not checked.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* uint64_t */
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h> /* prctl() */
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_key.h"
+#include "libcw_metrics.h"
+#include "libcw_rec.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/metrics: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Object registered for export of its metrics. */
+typedef struct cw_metrics_entry_struct {
+	cw_metrics_object_type_t type;
+	void * object;
+	/* Value of label "gen", "rec" or "key" of the object's metrics,
+	   unique during life time of process. */
+	unsigned int id;
+	struct cw_metrics_entry_struct * next;
+} cw_metrics_entry_t;
+
+
+
+
+/* Objects in order of registration. */
+static pthread_mutex_t cw_metrics_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cw_metrics_entry_t * cw_metrics_registry = NULL;
+static unsigned int cw_metrics_next_id = 1;
+
+
+
+
+/* Output of renderer. Works like series of snprintf() calls: text
+   that doesn't fit into buffer is dropped, but is counted in
+   ::len. */
+typedef struct {
+	char * buffer;
+	size_t size;
+	size_t len;
+} cw_metrics_writer_t;
+
+
+
+
+/* Copy of labels of an object, first member of all copies of
+   counters. Label of object is escaped as a value of label of
+   Prometheus metric. */
+typedef struct {
+	unsigned int id;
+	char label[2 * LIBCW_OBJECT_INSTANCE_LABEL_SIZE];
+} cw_metrics_sample_header_t;
+
+typedef struct {
+	cw_metrics_sample_header_t header;
+	cw_gen_stats_t stats;
+	cw_gen_latency_stats_t latency;
+	uint64_t n_tq_emptied;
+	uint64_t sound_device_latency;  /* [us] */
+	uint64_t tq_n_enqueued;
+	uint64_t tq_n_dequeued;
+	uint64_t tq_n_rejected;
+	uint64_t tq_len;
+	uint64_t tq_len_max;
+	uint64_t tq_capacity;
+} cw_metrics_gen_sample_t;
+
+typedef struct {
+	cw_metrics_sample_header_t header;
+	uint64_t n_dots;
+	uint64_t n_dashes;
+	uint64_t n_noise_spikes;
+	uint64_t n_unrecognized;
+	float speed;  /* [wpm] */
+} cw_metrics_rec_sample_t;
+
+typedef struct {
+	cw_metrics_sample_header_t header;
+	uint64_t n_sk_changes;
+	uint64_t n_paddle_events;
+	uint64_t n_ik_marks;
+} cw_metrics_key_sample_t;
+
+
+
+
+typedef enum {
+	CW_METRICS_VALUE_COUNT,     /* uint64_t. */
+	CW_METRICS_VALUE_DURATION,  /* uint64_t [us], exported in seconds. */
+	CW_METRICS_VALUE_FLOAT      /* float. */
+} cw_metrics_value_type_t;
+
+/* Metric with one value per object, taken from copy of counters of
+   the object. */
+typedef struct {
+	const char * name;
+	const char * type;
+	const char * help;
+	size_t offset;
+	cw_metrics_value_type_t value_type;
+} cw_metrics_field_t;
+
+/* Histogram of latencies of generator. */
+typedef struct {
+	const char * name;
+	const char * help;
+	size_t offset;
+} cw_metrics_histogram_field_t;
+
+
+
+
+static const cw_metrics_field_t cw_metrics_gen_fields[] = {
+	{ "libcw_gen_xruns_total",                 "counter", "Underruns of sound device reported by sound system.",         offsetof(cw_metrics_gen_sample_t, stats.n_xruns),            CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_recoveries_total",            "counter", "Restarts of sound device after underrun or failed write.",    offsetof(cw_metrics_gen_sample_t, stats.n_recoveries),       CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_short_writes_total",          "counter", "Writes in which sound system accepted a part of buffer.",     offsetof(cw_metrics_gen_sample_t, stats.n_short_writes),     CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_write_errors_total",          "counter", "Failed writes to sound system.",                              offsetof(cw_metrics_gen_sample_t, stats.n_write_errors),     CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_buffers_written_total",       "counter", "Buffers written to sound system.",                            offsetof(cw_metrics_gen_sample_t, stats.n_buffers_written),  CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_samples_written_total",       "counter", "Samples written to sound system.",                            offsetof(cw_metrics_gen_sample_t, stats.n_samples_written),  CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_write_blocked_seconds_total", "counter", "Time spent in blocking writes to sound system.",              offsetof(cw_metrics_gen_sample_t, stats.write_blocked_time), CW_METRICS_VALUE_DURATION },
+	{ "libcw_gen_idle_seconds_total",          "counter", "Time spent by generator's thread in idle mode.",              offsetof(cw_metrics_gen_sample_t, stats.idle_time),          CW_METRICS_VALUE_DURATION },
+	{ "libcw_gen_active_seconds_total",        "counter", "Time spent by generator's thread outside of idle mode.",      offsetof(cw_metrics_gen_sample_t, stats.active_time),        CW_METRICS_VALUE_DURATION },
+	{ "libcw_gen_idle_periods_total",          "counter", "Entries of generator's thread into idle mode.",               offsetof(cw_metrics_gen_sample_t, stats.n_idle_periods),     CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_tq_emptied_total",            "counter", "Times when generator has emptied its tone queue.",            offsetof(cw_metrics_gen_sample_t, n_tq_emptied),             CW_METRICS_VALUE_COUNT },
+	{ "libcw_gen_sound_device_latency_seconds", "gauge",  "Latency of sound device last reported by sound system.",      offsetof(cw_metrics_gen_sample_t, sound_device_latency),     CW_METRICS_VALUE_DURATION },
+	{ "libcw_tq_enqueued_total",               "counter", "Tones enqueued in tone queue.",                               offsetof(cw_metrics_gen_sample_t, tq_n_enqueued),            CW_METRICS_VALUE_COUNT },
+	{ "libcw_tq_dequeued_total",               "counter", "Tones dequeued from tone queue.",                             offsetof(cw_metrics_gen_sample_t, tq_n_dequeued),            CW_METRICS_VALUE_COUNT },
+	{ "libcw_tq_rejected_total",               "counter", "Tones not enqueued because tone queue was full.",             offsetof(cw_metrics_gen_sample_t, tq_n_rejected),            CW_METRICS_VALUE_COUNT },
+	{ "libcw_tq_length",                       "gauge",   "Count of tones in tone queue.",                               offsetof(cw_metrics_gen_sample_t, tq_len),                   CW_METRICS_VALUE_COUNT },
+	{ "libcw_tq_length_max",                   "gauge",   "The largest count of tones in tone queue.",                   offsetof(cw_metrics_gen_sample_t, tq_len_max),               CW_METRICS_VALUE_COUNT },
+	{ "libcw_tq_capacity",                     "gauge",   "Capacity of tone queue.",                                     offsetof(cw_metrics_gen_sample_t, tq_capacity),              CW_METRICS_VALUE_COUNT },
+};
+
+static const cw_metrics_histogram_field_t cw_metrics_gen_histograms[] = {
+	{ "libcw_gen_queue_latency_seconds",  "Time between enqueueing a tone and dequeueing it by generator.",          offsetof(cw_metrics_gen_sample_t, latency.queue) },
+	{ "libcw_gen_device_latency_seconds", "Time between dequeueing a tone and handing it to sound system.",          offsetof(cw_metrics_gen_sample_t, latency.device) },
+	{ "libcw_gen_total_latency_seconds",  "Time between enqueueing a tone and handing it to sound system.",          offsetof(cw_metrics_gen_sample_t, latency.total) },
+	{ "libcw_gen_pacing_latency_seconds", "Lateness of generator's thread at end of tone (Null and Console only).",  offsetof(cw_metrics_gen_sample_t, latency.pacing) },
+};
+
+static const cw_metrics_field_t cw_metrics_rec_fields[] = {
+	{ "libcw_rec_dots_total",           "counter", "Dots received.",                                  offsetof(cw_metrics_rec_sample_t, n_dots),         CW_METRICS_VALUE_COUNT },
+	{ "libcw_rec_dashes_total",         "counter", "Dashes received.",                                offsetof(cw_metrics_rec_sample_t, n_dashes),       CW_METRICS_VALUE_COUNT },
+	{ "libcw_rec_noise_spikes_total",   "counter", "Marks ignored as noise spikes.",                  offsetof(cw_metrics_rec_sample_t, n_noise_spikes), CW_METRICS_VALUE_COUNT },
+	{ "libcw_rec_unrecognized_total",   "counter", "Marks recognized neither as Dot nor as Dash.",    offsetof(cw_metrics_rec_sample_t, n_unrecognized), CW_METRICS_VALUE_COUNT },
+	{ "libcw_rec_speed_wpm",            "gauge",   "Receiving speed.",                                offsetof(cw_metrics_rec_sample_t, speed),          CW_METRICS_VALUE_FLOAT },
+};
+
+static const cw_metrics_field_t cw_metrics_key_fields[] = {
+	{ "libcw_key_sk_changes_total",     "counter", "Changes of value of straight key.",               offsetof(cw_metrics_key_sample_t, n_sk_changes),    CW_METRICS_VALUE_COUNT },
+	{ "libcw_key_paddle_events_total",  "counter", "Changes of values of paddles.",                   offsetof(cw_metrics_key_sample_t, n_paddle_events), CW_METRICS_VALUE_COUNT },
+	{ "libcw_key_ik_marks_total",       "counter", "Dots and Dashes keyed by iambic keyer.",          offsetof(cw_metrics_key_sample_t, n_ik_marks),      CW_METRICS_VALUE_COUNT },
+};
+
+
+
+
+static void cw_metrics_printf_internal(cw_metrics_writer_t * writer, const char * format, ...) __attribute__((format(printf, 2, 3)));
+static void cw_metrics_escape_label_internal(char * dest, size_t size, const char * label);
+static void cw_metrics_write_value_internal(cw_metrics_writer_t * writer, const void * sample, const cw_metrics_field_t * field);
+static void cw_metrics_write_fields_internal(cw_metrics_writer_t * writer, const char * object_name, const void * samples, size_t sample_size, int n_samples, const cw_metrics_field_t * fields, size_t n_fields);
+static void cw_metrics_write_histograms_internal(cw_metrics_writer_t * writer, const cw_metrics_gen_sample_t * samples, int n_samples);
+static void cw_metrics_take_gen_sample_internal(cw_gen_t * gen, cw_metrics_gen_sample_t * sample);
+static void cw_metrics_take_rec_sample_internal(cw_rec_t * rec, cw_metrics_rec_sample_t * sample);
+static void cw_metrics_take_key_sample_internal(cw_key_t * key, cw_metrics_key_sample_t * sample);
+static int  cw_metrics_render_internal(char * buffer, size_t size);
+
+
+
+
+/**
+   @brief Add object to registry of metrics
+
+   Called by constructors of generator, receiver and key. An object
+   that can't be registered (out of memory) works normally, its
+   metrics are just not exported.
+
+   @param[in] type type of object
+   @param[in] object object to register
+*/
+void cw_metrics_register_internal(cw_metrics_object_type_t type, void * object)
+{
+	cw_metrics_entry_t * entry = (cw_metrics_entry_t *) calloc(1, sizeof (cw_metrics_entry_t));
+	if (NULL == entry) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return;
+	}
+	entry->type = type;
+	entry->object = object;
+
+	pthread_mutex_lock(&cw_metrics_registry_mutex);
+	entry->id = cw_metrics_next_id++;
+	cw_metrics_entry_t ** tail = &cw_metrics_registry;
+	while (NULL != *tail) {
+		tail = &(*tail)->next;
+	}
+	*tail = entry;
+	pthread_mutex_unlock(&cw_metrics_registry_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Remove object from registry of metrics
+
+   Called by destructors of generator, receiver and key, before the
+   object is deinitialized. When the function returns, metrics of the
+   object are not being read, and won't be read again.
+
+   @param[in] object object to unregister
+*/
+void cw_metrics_unregister_internal(void * object)
+{
+	cw_metrics_entry_t * entry = NULL;
+
+	pthread_mutex_lock(&cw_metrics_registry_mutex);
+	for (cw_metrics_entry_t ** iter = &cw_metrics_registry; NULL != *iter; iter = &(*iter)->next) {
+		if ((*iter)->object == object) {
+			entry = *iter;
+			*iter = entry->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cw_metrics_registry_mutex);
+
+	free(entry);
+
+	return;
+}
+
+
+
+
+int cw_metrics_write(char * buffer, size_t size)
+{
+	if (NULL == buffer && 0 != size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return cw_metrics_render_internal(buffer, size);
+}
+
+
+
+
+/**
+   @brief Render metrics of all registered objects
+
+   @param[out] buffer buffer for text (may be NULL if @p size is zero)
+   @param[in] size size of @p buffer
+
+   @return length of whole text (without terminating NUL) on success
+   @return -1 on failure
+*/
+static int cw_metrics_render_internal(char * buffer, size_t size)
+{
+	cw_metrics_writer_t writer = { .buffer = buffer, .size = size, .len = 0 };
+	if (size > 0) {
+		buffer[0] = '\0';
+	}
+
+	/* Copies of counters are taken under the registry's mutex, and
+	   rendered after it is released: objects are not blocked from
+	   being deleted while the text is formatted. */
+	pthread_mutex_lock(&cw_metrics_registry_mutex);
+
+	int n_gens = 0;
+	int n_recs = 0;
+	int n_keys = 0;
+	for (const cw_metrics_entry_t * entry = cw_metrics_registry; NULL != entry; entry = entry->next) {
+		switch (entry->type) {
+		case CW_METRICS_OBJECT_GEN:
+			n_gens++;
+			break;
+		case CW_METRICS_OBJECT_REC:
+			n_recs++;
+			break;
+		case CW_METRICS_OBJECT_KEY:
+			n_keys++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	cw_metrics_gen_sample_t * gens = (cw_metrics_gen_sample_t *) calloc((size_t) n_gens + 1, sizeof (cw_metrics_gen_sample_t));
+	cw_metrics_rec_sample_t * recs = (cw_metrics_rec_sample_t *) calloc((size_t) n_recs + 1, sizeof (cw_metrics_rec_sample_t));
+	cw_metrics_key_sample_t * keys = (cw_metrics_key_sample_t *) calloc((size_t) n_keys + 1, sizeof (cw_metrics_key_sample_t));
+	if (NULL == gens || NULL == recs || NULL == keys) {
+		pthread_mutex_unlock(&cw_metrics_registry_mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		free(gens);
+		free(recs);
+		free(keys);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int i_gen = 0;
+	int i_rec = 0;
+	int i_key = 0;
+	for (const cw_metrics_entry_t * entry = cw_metrics_registry; NULL != entry; entry = entry->next) {
+		switch (entry->type) {
+		case CW_METRICS_OBJECT_GEN:
+			gens[i_gen].header.id = entry->id;
+			cw_metrics_take_gen_sample_internal((cw_gen_t *) entry->object, &gens[i_gen++]);
+			break;
+		case CW_METRICS_OBJECT_REC:
+			recs[i_rec].header.id = entry->id;
+			cw_metrics_take_rec_sample_internal((cw_rec_t *) entry->object, &recs[i_rec++]);
+			break;
+		case CW_METRICS_OBJECT_KEY:
+			keys[i_key].header.id = entry->id;
+			cw_metrics_take_key_sample_internal((cw_key_t *) entry->object, &keys[i_key++]);
+			break;
+		default:
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&cw_metrics_registry_mutex);
+
+	cw_metrics_write_fields_internal(&writer, "gen", gens, sizeof (gens[0]), n_gens,
+					 cw_metrics_gen_fields, sizeof (cw_metrics_gen_fields) / sizeof (cw_metrics_gen_fields[0]));
+	cw_metrics_write_histograms_internal(&writer, gens, n_gens);
+	cw_metrics_write_fields_internal(&writer, "rec", recs, sizeof (recs[0]), n_recs,
+					 cw_metrics_rec_fields, sizeof (cw_metrics_rec_fields) / sizeof (cw_metrics_rec_fields[0]));
+	cw_metrics_write_fields_internal(&writer, "key", keys, sizeof (keys[0]), n_keys,
+					 cw_metrics_key_fields, sizeof (cw_metrics_key_fields) / sizeof (cw_metrics_key_fields[0]));
+
+	free(gens);
+	free(recs);
+	free(keys);
+
+	if (writer.len > INT_MAX) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	return (int) writer.len;
+}
+
+
+
+
+static void cw_metrics_take_gen_sample_internal(cw_gen_t * gen, cw_metrics_gen_sample_t * sample)
+{
+	cw_metrics_escape_label_internal(sample->header.label, sizeof (sample->header.label), gen->label);
+
+	cw_gen_get_stats(gen, &sample->stats);
+	cw_gen_latency_snapshot_internal(gen, &sample->latency);
+
+	sample->n_tq_emptied = sample->latency.n_tq_emptied;
+	sample->sound_device_latency = sample->latency.sound_device_latency > 0 ? (uint64_t) sample->latency.sound_device_latency : 0;
+
+	cw_tone_queue_t * tq = gen->tq;
+	sample->tq_len_max = cw_tq_get_length_max_internal(tq);
+	sample->tq_capacity = cw_tq_capacity_internal(tq);
+	sample->tq_n_enqueued = __atomic_load_n(&tq->n_enqueued, __ATOMIC_RELAXED);
+	sample->tq_n_dequeued = __atomic_load_n(&tq->n_dequeued, __ATOMIC_RELAXED);
+	sample->tq_n_rejected = __atomic_load_n(&tq->n_rejected, __ATOMIC_RELAXED);
+	sample->tq_len = __atomic_load_n(&tq->len, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+static void cw_metrics_take_rec_sample_internal(cw_rec_t * rec, cw_metrics_rec_sample_t * sample)
+{
+	cw_metrics_escape_label_internal(sample->header.label, sizeof (sample->header.label), rec->label);
+
+	sample->n_dots = __atomic_load_n(&rec->counters.n_dots, __ATOMIC_RELAXED);
+	sample->n_dashes = __atomic_load_n(&rec->counters.n_dashes, __ATOMIC_RELAXED);
+	sample->n_noise_spikes = __atomic_load_n(&rec->counters.n_noise_spikes, __ATOMIC_RELAXED);
+	sample->n_unrecognized = __atomic_load_n(&rec->counters.n_unrecognized, __ATOMIC_RELAXED);
+	__atomic_load(&rec->speed, &sample->speed, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+static void cw_metrics_take_key_sample_internal(cw_key_t * key, cw_metrics_key_sample_t * sample)
+{
+	cw_metrics_escape_label_internal(sample->header.label, sizeof (sample->header.label), key->label);
+
+	sample->n_sk_changes = __atomic_load_n(&key->counters.n_sk_changes, __ATOMIC_RELAXED);
+	sample->n_paddle_events = __atomic_load_n(&key->counters.n_paddle_events, __ATOMIC_RELAXED);
+	sample->n_ik_marks = __atomic_load_n(&key->counters.n_ik_marks, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+static void cw_metrics_printf_internal(cw_metrics_writer_t * writer, const char * format, ...)
+{
+	char * dest = NULL;
+	size_t available = 0;
+	if (writer->len < writer->size) {
+		dest = writer->buffer + writer->len;
+		available = writer->size - writer->len;
+	}
+
+	va_list ap;
+	va_start(ap, format);
+	const int n = vsnprintf(dest, available, format, ap);
+	va_end(ap);
+
+	if (n > 0) {
+		writer->len += (size_t) n;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Escape label of object for use as value of label of metric
+
+   Backslash, double quote and new line are escaped with backslash.
+   @p size is twice the size of label, so the escaped label always
+   fits.
+*/
+static void cw_metrics_escape_label_internal(char * dest, size_t size, const char * label)
+{
+	size_t d = 0;
+	for (size_t s = 0; '\0' != label[s] && s < LIBCW_OBJECT_INSTANCE_LABEL_SIZE && d + 2 < size; s++) {
+		switch (label[s]) {
+		case '\\':
+		case '"':
+			dest[d++] = '\\';
+			dest[d++] = label[s];
+			break;
+		case '\n':
+			dest[d++] = '\\';
+			dest[d++] = 'n';
+			break;
+		default:
+			dest[d++] = label[s];
+			break;
+		}
+	}
+	dest[d] = '\0';
+
+	return;
+}
+
+
+
+
+static void cw_metrics_write_value_internal(cw_metrics_writer_t * writer, const void * sample, const cw_metrics_field_t * field)
+{
+	const char * value = (const char *) sample + field->offset;
+
+	switch (field->value_type) {
+	case CW_METRICS_VALUE_COUNT: {
+		uint64_t count = 0;
+		memcpy(&count, value, sizeof (count));
+		cw_metrics_printf_internal(writer, "%" PRIu64 "\n", count);
+		break;
+	}
+	case CW_METRICS_VALUE_DURATION: {
+		uint64_t usecs = 0;
+		memcpy(&usecs, value, sizeof (usecs));
+		cw_metrics_printf_internal(writer, "%" PRIu64 ".%06" PRIu64 "\n", usecs / CW_USECS_PER_SEC, usecs % CW_USECS_PER_SEC);
+		break;
+	}
+	case CW_METRICS_VALUE_FLOAT: {
+		float f = 0.0f;
+		memcpy(&f, value, sizeof (f));
+		cw_metrics_printf_internal(writer, "%.2f\n", (double) f);
+		break;
+	}
+	default:
+		cw_metrics_printf_internal(writer, "NaN\n");
+		break;
+	}
+
+	return;
+}
+
+
+
+
+static void cw_metrics_write_fields_internal(cw_metrics_writer_t * writer, const char * object_name, const void * samples, size_t sample_size, int n_samples, const cw_metrics_field_t * fields, size_t n_fields)
+{
+	if (0 == n_samples) {
+		return;
+	}
+
+	for (size_t f = 0; f < n_fields; f++) {
+		cw_metrics_printf_internal(writer, "# HELP %s %s\n", fields[f].name, fields[f].help);
+		cw_metrics_printf_internal(writer, "# TYPE %s %s\n", fields[f].name, fields[f].type);
+
+		for (int i = 0; i < n_samples; i++) {
+			const void * sample = (const char *) samples + (size_t) i * sample_size;
+			const cw_metrics_sample_header_t * header = (const cw_metrics_sample_header_t *) sample;
+
+			cw_metrics_printf_internal(writer, "%s{%s=\"%u\",label=\"%s\"} ", fields[f].name, object_name, header->id, header->label);
+			cw_metrics_write_value_internal(writer, sample, &fields[f]);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write latency histograms of generators
+
+   Bucket i of cw_latency_histogram_t counts latencies in range
+   [2^(i-1), 2^i) us, so with latencies measured in whole
+   microseconds cumulative count of buckets up to i is the count of
+   latencies not greater than 2^i - 1 us. It is exported with bound
+   "le" of 2^i us; the last bucket is the "+Inf" bucket.
+*/
+static void cw_metrics_write_histograms_internal(cw_metrics_writer_t * writer, const cw_metrics_gen_sample_t * samples, int n_samples)
+{
+	if (0 == n_samples) {
+		return;
+	}
+
+	const size_t n_histograms = sizeof (cw_metrics_gen_histograms) / sizeof (cw_metrics_gen_histograms[0]);
+	for (size_t h = 0; h < n_histograms; h++) {
+		const char * name = cw_metrics_gen_histograms[h].name;
+		cw_metrics_printf_internal(writer, "# HELP %s %s\n", name, cw_metrics_gen_histograms[h].help);
+		cw_metrics_printf_internal(writer, "# TYPE %s histogram\n", name);
+
+		for (int i = 0; i < n_samples; i++) {
+			const cw_metrics_sample_header_t * header = &samples[i].header;
+			const cw_latency_histogram_t * histogram = (const cw_latency_histogram_t *) ((const char *) &samples[i] + cw_metrics_gen_histograms[h].offset);
+
+			uint64_t cumulative = 0;
+			for (int b = 0; b < CW_LATENCY_HISTOGRAM_N_BUCKETS - 1; b++) {
+				cumulative += histogram->buckets[b];
+				const uint64_t bound = (uint64_t) 1 << b; /* [us] */
+				cw_metrics_printf_internal(writer, "%s_bucket{gen=\"%u\",label=\"%s\",le=\"%" PRIu64 ".%06" PRIu64 "\"} %" PRIu64 "\n",
+							   name, header->id, header->label,
+							   bound / CW_USECS_PER_SEC, bound % CW_USECS_PER_SEC, cumulative);
+			}
+			/* Count of the last bucket may be read a moment
+			   after ::count, so ::count is the "+Inf" bucket. */
+			cw_metrics_printf_internal(writer, "%s_bucket{gen=\"%u\",label=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+						   name, header->id, header->label, histogram->count);
+			cw_metrics_printf_internal(writer, "%s_sum{gen=\"%u\",label=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+						   name, header->id, header->label,
+						   histogram->sum / CW_USECS_PER_SEC, histogram->sum % CW_USECS_PER_SEC);
+			cw_metrics_printf_internal(writer, "%s_count{gen=\"%u\",label=\"%s\"} %" PRIu64 "\n",
+						   name, header->id, header->label, histogram->count);
+		}
+	}
+
+	return;
+}
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+/* Size of buffer for request of client. Headers of larger requests
+   are not read to the end. */
+enum { CW_METRICS_REQUEST_SIZE_MAX = 2048 };
+
+/* Timeout of reading request from client, and of sending response
+   [s]. A stalled client delays other clients (and stopping of
+   exporter) by at most this much. */
+enum { CW_METRICS_CLIENT_TIMEOUT = 2 };
+
+enum { CW_METRICS_LISTEN_BACKLOG = 8 };
+
+
+
+
+static void * cw_metrics_thread_internal(void * arg);
+static void   cw_metrics_serve_internal(cw_metrics_t * metrics, int fd);
+static bool   cw_metrics_send_internal(int fd, const char * data, size_t n_bytes);
+
+
+
+
+/**
+   @brief Create new exporter of metrics
+
+   @return freshly allocated exporter on success
+   @return NULL pointer on failure
+*/
+cw_metrics_t * cw_metrics_new(void)
+{
+	cw_metrics_t * metrics = (cw_metrics_t *) calloc(1, sizeof (cw_metrics_t));
+	if (NULL == metrics) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_metrics_t *) NULL;
+	}
+
+	metrics->socket_fd = -1;
+	metrics->wakeup_fd = -1;
+
+	return metrics;
+}
+
+
+
+
+/**
+   @brief Delete exporter of metrics
+
+   Exporter is stopped if it's running, and its socket is closed (and
+   removed, if it's a Unix socket). Pointer to @p metrics is set to
+   NULL.
+
+   @param[in] metrics pointer to exporter to delete
+*/
+void cw_metrics_delete(cw_metrics_t ** metrics)
+{
+	if (NULL == metrics || NULL == *metrics) {
+		return;
+	}
+
+	cw_metrics_stop(*metrics);
+
+	if (-1 != (*metrics)->socket_fd) {
+		close((*metrics)->socket_fd);
+	}
+	if ('\0' != (*metrics)->socket_path[0]) {
+		unlink((*metrics)->socket_path);
+	}
+	free((*metrics)->text);
+
+	free(*metrics);
+	*metrics = (cw_metrics_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Open listening socket of exporter of metrics
+
+   See description of @p address in libcw2.h. Socket can be opened
+   only when exporter is not running. A previously opened socket is
+   closed.
+
+   @param[in] metrics exporter of metrics
+   @param[in] address local address to listen on
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_metrics_bind(cw_metrics_t * metrics, const char * address)
+{
+	if (NULL == metrics || NULL == address) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (metrics->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	int fd = -1;
+	const char * path = NULL;
+	if (0 == strncmp(address, "unix:", strlen("unix:"))) {
+		path = address + strlen("unix:");
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof (addr));
+		if ('\0' == path[0] || strlen(path) >= sizeof (addr.sun_path) || strlen(path) >= sizeof (metrics->socket_path)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "bind: invalid path of socket '%s'", path);
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof (addr.sun_path), "%s", path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && (0 != bind(fd, (struct sockaddr *) &addr, sizeof (addr))
+				|| 0 != listen(fd, CW_METRICS_LISTEN_BACKLOG))) {
+			const int saved_errno = errno;
+			close(fd);
+			fd = -1;
+			errno = saved_errno;
+		}
+	} else {
+		struct addrinfo * result = NULL;
+		const int rv = cw_resolve_address_internal(address, SOCK_STREAM, true, &result);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "bind: can't resolve '%s': %s", address, gai_strerror(rv));
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+
+		for (struct addrinfo * ai = result; NULL != ai; ai = ai->ai_next) {
+			fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+			if (fd < 0) {
+				continue;
+			}
+			const int reuse = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+			if (0 == bind(fd, ai->ai_addr, ai->ai_addrlen)
+			    && 0 == listen(fd, CW_METRICS_LISTEN_BACKLOG)) {
+				break;
+			}
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(result);
+	}
+
+	if (-1 == fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "bind: can't listen on '%s': %s", address, strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	if (-1 != metrics->socket_fd) {
+		close(metrics->socket_fd);
+	}
+	if ('\0' != metrics->socket_path[0]) {
+		unlink(metrics->socket_path);
+	}
+	metrics->socket_fd = fd;
+	snprintf(metrics->socket_path, sizeof (metrics->socket_path), "%s", NULL == path ? "" : path);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get local port of TCP socket of exporter of metrics
+
+   @param[in] metrics exporter of metrics
+
+   @return port number on success
+   @return -1 if TCP socket is not open
+*/
+int cw_metrics_get_port(const cw_metrics_t * metrics)
+{
+	if (NULL == metrics || -1 == metrics->socket_fd || '\0' != metrics->socket_path[0]) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof (addr);
+	if (-1 == getsockname(metrics->socket_fd, (struct sockaddr *) &addr, &addr_len)) {
+		return -1;
+	}
+
+	if (AF_INET6 == addr.ss_family) {
+		return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+	} else {
+		return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+	}
+}
+
+
+
+
+/**
+   @brief Start thread of exporter of metrics
+
+   Socket must be opened with cw_metrics_bind() first.
+
+   @param[in] metrics exporter of metrics
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_metrics_start(cw_metrics_t * metrics)
+{
+	if (NULL == metrics || -1 == metrics->socket_fd) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (metrics->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	metrics->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (-1 == metrics->wakeup_fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: eventfd(): %s", strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	const int rv = pthread_create(&metrics->thread, NULL, cw_metrics_thread_internal, metrics);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		close(metrics->wakeup_fd);
+		metrics->wakeup_fd = -1;
+		errno = rv;
+		return CW_FAILURE;
+	}
+	metrics->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop thread of exporter of metrics
+
+   Socket stays open, and exporter can be started again.
+
+   @param[in] metrics exporter of metrics
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_metrics_stop(cw_metrics_t * metrics)
+{
+	if (NULL == metrics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (metrics->thread_running) {
+		const uint64_t one = 1;
+		if (sizeof (one) != write(metrics->wakeup_fd, &one, sizeof (one))) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+				      MSG_PREFIX "stop: can't wake up thread: %s", strerror(errno));
+		}
+		pthread_join(metrics->thread, NULL);
+		metrics->thread_running = false;
+	}
+
+	if (-1 != metrics->wakeup_fd) {
+		close(metrics->wakeup_fd);
+		metrics->wakeup_fd = -1;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+static void * cw_metrics_thread_internal(void * arg)
+{
+	cw_metrics_t * metrics = (cw_metrics_t *) arg;
+
+	prctl(PR_SET_NAME, "metrics", 0, 0, 0);
+
+	while (true) {
+		struct pollfd fds[2] = {
+			{ .fd = metrics->socket_fd, .events = POLLIN },
+			{ .fd = metrics->wakeup_fd, .events = POLLIN }
+		};
+		const int n = poll(fds, 2, -1);
+		if (-1 == n) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+				      MSG_PREFIX "poll(): %s", strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			const int fd = accept4(metrics->socket_fd, NULL, NULL, SOCK_CLOEXEC);
+			if (-1 != fd) {
+				cw_metrics_serve_internal(metrics, fd);
+				close(fd);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Read request of client and send response with metrics
+
+   @param[in] metrics exporter of metrics
+   @param[in] fd connected socket of client
+*/
+static void cw_metrics_serve_internal(cw_metrics_t * metrics, int fd)
+{
+	const struct timeval timeout = { .tv_sec = CW_METRICS_CLIENT_TIMEOUT, .tv_usec = 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+	/* Read the request up to empty line that ends its headers. */
+	char request[CW_METRICS_REQUEST_SIZE_MAX + 1];
+	size_t len = 0;
+	while (len < CW_METRICS_REQUEST_SIZE_MAX) {
+		const ssize_t n = recv(fd, request + len, CW_METRICS_REQUEST_SIZE_MAX - len, 0);
+		if (n <= 0) {
+			if (0 == len) {
+				return;
+			}
+			break;
+		}
+		len += (size_t) n;
+		request[len] = '\0';
+		if (NULL != strstr(request, "\r\n\r\n") || NULL != strstr(request, "\n\n")) {
+			break;
+		}
+	}
+	request[len] = '\0';
+
+	const bool is_head = 0 == strncmp(request, "HEAD ", strlen("HEAD "));
+	if (!is_head && 0 != strncmp(request, "GET ", strlen("GET "))) {
+		const char * response = "HTTP/1.0 405 Method Not Allowed\r\n"
+			"Allow: GET, HEAD\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: close\r\n"
+			"\r\n";
+		cw_metrics_send_internal(fd, response, strlen(response));
+		return;
+	}
+
+	/* Text is rendered again into larger buffer if it didn't fit
+	   (e.g. new objects have been created since last request). */
+	int text_len = 0;
+	while (true) {
+		text_len = cw_metrics_render_internal(metrics->text, metrics->text_size);
+		if (text_len < 0) {
+			const char * response = "HTTP/1.0 500 Internal Server Error\r\n"
+				"Content-Length: 0\r\n"
+				"Connection: close\r\n"
+				"\r\n";
+			cw_metrics_send_internal(fd, response, strlen(response));
+			return;
+		}
+		if ((size_t) text_len < metrics->text_size) {
+			break;
+		}
+		const size_t new_size = (size_t) text_len + (size_t) text_len / 4 + 1;
+		char * new_text = (char *) realloc(metrics->text, new_size);
+		if (NULL == new_text) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc()");
+			return;
+		}
+		metrics->text = new_text;
+		metrics->text_size = new_size;
+	}
+
+	char header[256];
+	const int header_len = snprintf(header, sizeof (header),
+					"HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+					"Content-Length: %d\r\n"
+					"Connection: close\r\n"
+					"\r\n", text_len);
+	if (!cw_metrics_send_internal(fd, header, (size_t) header_len)) {
+		return;
+	}
+	if (!is_head) {
+		cw_metrics_send_internal(fd, metrics->text, (size_t) text_len);
+	}
+
+	return;
+}
+
+
+
+
+static bool cw_metrics_send_internal(int fd, const char * data, size_t n_bytes)
+{
+	while (n_bytes > 0) {
+		const ssize_t n = send(fd, data, n_bytes, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return false;
+		}
+		data += n;
+		n_bytes -= (size_t) n;
+	}
+	return true;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_metrics_t * cw_metrics_new(void)
+{
+	errno = ENOSYS;
+	return (cw_metrics_t *) NULL;
+}
+
+void cw_metrics_delete(__attribute__((unused)) cw_metrics_t ** metrics)
+{
+	return;
+}
+
+cw_ret_t cw_metrics_bind(__attribute__((unused)) cw_metrics_t * metrics, __attribute__((unused)) const char * address)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+int cw_metrics_get_port(__attribute__((unused)) const cw_metrics_t * metrics)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+cw_ret_t cw_metrics_start(__attribute__((unused)) cw_metrics_t * metrics)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_metrics_stop(__attribute__((unused)) cw_metrics_t * metrics)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
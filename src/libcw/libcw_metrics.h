@@ -0,0 +1,65 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_METRICS
+#define H_LIBCW_METRICS
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Size of path of Unix socket of exporter (size of sun_path). */
+enum { CW_METRICS_SOCKET_PATH_SIZE = 108 };
+
+
+
+
+typedef enum {
+	CW_METRICS_OBJECT_GEN,
+	CW_METRICS_OBJECT_REC,
+	CW_METRICS_OBJECT_KEY
+} cw_metrics_object_type_t;
+
+
+
+
+struct cw_metrics_struct {
+	int socket_fd;
+	int wakeup_fd;  /* eventfd used to stop the thread. */
+
+	/* Path of Unix socket, removed when exporter is deleted. Empty
+	   for TCP socket. */
+	char socket_path[CW_METRICS_SOCKET_PATH_SIZE];
+
+	/* Text of metrics, reused between requests. Used only by
+	   exporter's thread. */
+	char * text;
+	size_t text_size;
+
+	pthread_t thread;
+	bool thread_running;
+};
+
+
+
+
+void cw_metrics_register_internal(cw_metrics_object_type_t type, void * object);
+void cw_metrics_unregister_internal(void * object);
+
+
+
+
+#endif /* #ifndef H_LIBCW_METRICS */
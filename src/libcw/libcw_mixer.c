@@ -0,0 +1,516 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_mixer.c
+
+   @brief Mixer. Many channels of Morse code played through one sound device.
+
+   Each channel of mixer is a generator working in pull mode (see
+   cw_gen_fill_buffer()), with its own tone queue and its own
+   frequency, speed, volume etc. The channels don't have threads and
+   don't open sound devices.
+
+   One more generator (mixer's output) opens the sound device, but its
+   thread is never started. Instead, mixer's thread pulls one buffer
+   of samples from every channel, sums the samples and writes the sum
+   to the device through output generator's "write buffer" function.
+   So there is only one thread and one stream of samples (one client
+   of dmix or of sound server) regardless of count of channels.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_mixer.h"
+#include "libcw_tq.h"
+#include "libcw_trace.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/mixer: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static bool   cw_mixer_is_idle_internal(const cw_mixer_t * mixer);
+static void * cw_mixer_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create new mixer
+
+   Sound device described by @p gen_conf is opened by the function.
+   Pull mode can't be requested in @p gen_conf, and the sound system
+   must be one to which samples are written: OSS, ALSA, PulseAudio or
+   File. Tone queue settings (tq_*) from @p gen_conf are used by tone
+   queues of channels, real-time settings are used by mixer's thread.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] gen_conf configuration of sound device
+   @param[in] n_channels count of channels, between 1 and CW_MIXER_N_CHANNELS_MAX
+
+   @return freshly allocated mixer on success
+   @return NULL pointer on failure
+*/
+cw_mixer_t * cw_mixer_new(const cw_gen_config_t * gen_conf, int n_channels)
+{
+	if (NULL == gen_conf || gen_conf->pull_mode
+	    || n_channels < 1 || n_channels > CW_MIXER_N_CHANNELS_MAX) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid configuration or count of channels %d", n_channels);
+		errno = EINVAL;
+		return (cw_mixer_t *) NULL;
+	}
+
+	cw_mixer_t * mixer = (cw_mixer_t *) calloc(1, sizeof (cw_mixer_t));
+	if (NULL == mixer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_mixer_t *) NULL;
+	}
+
+	mixer->output = cw_gen_new(gen_conf);
+	if (NULL == mixer->output) {
+		cw_mixer_delete(&mixer);
+		return (cw_mixer_t *) NULL;
+	}
+	if (NULL == mixer->output->buffer || mixer->output->pull.enabled) {
+		/* Null and Console sound systems don't play samples,
+		   JACK pulls samples by itself. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: sound system %s can't be used by mixer",
+			      cw_get_audio_system_label(mixer->output->sound_system));
+		cw_mixer_delete(&mixer);
+		errno = EINVAL;
+		return (cw_mixer_t *) NULL;
+	}
+
+	const size_t n_samples = (size_t) mixer->output->buffer_n_samples;
+	mixer->channel_samples = (cw_sample_t *) calloc(n_samples, sizeof (cw_sample_t));
+	mixer->sum = (int32_t *) calloc(n_samples * (size_t) mixer->output->n_sound_channels, sizeof (int32_t));
+	mixer->channels = (cw_gen_t **) calloc((size_t) n_channels, sizeof (cw_gen_t *));
+	if (NULL == mixer->channel_samples || NULL == mixer->sum || NULL == mixer->channels) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_mixer_delete(&mixer);
+		return (cw_mixer_t *) NULL;
+	}
+
+	cw_gen_config_t channel_conf = { 0 };
+	channel_conf.sound_system = CW_AUDIO_NULL;
+	channel_conf.file_fd = -1;
+	channel_conf.pull_mode = true;
+	channel_conf.pull_sample_rate = mixer->output->sample_rate;
+	channel_conf.tq_single_producer = gen_conf->tq_single_producer;
+	channel_conf.tq_capacity = gen_conf->tq_capacity;
+	channel_conf.tq_lazy_allocation = gen_conf->tq_lazy_allocation;
+	channel_conf.tq_coalesce_tones = gen_conf->tq_coalesce_tones;
+
+	for (int i = 0; i < n_channels; i++) {
+		mixer->channels[i] = cw_gen_new(&channel_conf);
+		if (NULL == mixer->channels[i]) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "new: failed to create generator of channel %d", i);
+			cw_mixer_delete(&mixer);
+			return (cw_mixer_t *) NULL;
+		}
+		mixer->n_channels++;
+	}
+
+	return mixer;
+}
+
+
+
+
+/**
+   @brief Delete mixer
+
+   Mixer is stopped, generators of its channels are deleted, and its
+   sound device is closed. Pointer to @p mixer is set to NULL.
+
+   @param[in] mixer pointer to mixer to delete
+*/
+void cw_mixer_delete(cw_mixer_t ** mixer)
+{
+	if (NULL == mixer || NULL == *mixer) {
+		return;
+	}
+
+	cw_mixer_stop(*mixer);
+
+	for (int i = 0; i < (*mixer)->n_channels; i++) {
+		cw_gen_delete(&(*mixer)->channels[i]);
+	}
+	free((*mixer)->channels);
+	free((*mixer)->channel_samples);
+	free((*mixer)->sum);
+	cw_gen_delete(&(*mixer)->output);
+
+	free(*mixer);
+	*mixer = (cw_mixer_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get generator of given channel of mixer
+
+   The generator is owned by mixer: client code may enqueue tones to
+   it and change its parameters, but must not start, stop or delete
+   it.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] mixer mixer
+   @param[in] channel index of channel, starting from zero
+
+   @return generator of channel on success
+   @return NULL pointer on failure
+*/
+cw_gen_t * cw_mixer_get_channel(cw_mixer_t * mixer, int channel)
+{
+	if (NULL == mixer || channel < 0 || channel >= mixer->n_channels) {
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	return mixer->channels[channel];
+}
+
+
+
+
+/**
+   @brief Get count of channels of mixer
+
+   @param[in] mixer mixer
+
+   @return count of channels
+   @return zero for NULL @p mixer
+*/
+int cw_mixer_get_n_channels(const cw_mixer_t * mixer)
+{
+	if (NULL == mixer) {
+		return 0;
+	}
+	return mixer->n_channels;
+}
+
+
+
+
+/**
+   @brief Start playing channels of mixer
+
+   @exception EINVAL @p mixer is NULL
+   @exception EBUSY mixer has been already started
+
+   @param[in] mixer mixer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_mixer_start(cw_mixer_t * mixer)
+{
+	if (NULL == mixer) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (mixer->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	for (int i = 0; i < mixer->n_channels; i++) {
+		if (CW_SUCCESS != cw_gen_start(mixer->channels[i])) {
+			for (int j = 0; j < i; j++) {
+				cw_gen_stop(mixer->channels[j]);
+			}
+			return CW_FAILURE;
+		}
+	}
+
+	mixer->idle = true;
+	mixer->thread_quit = false;
+	const int rv = pthread_create(&mixer->thread, NULL, cw_mixer_thread_internal, mixer);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		for (int i = 0; i < mixer->n_channels; i++) {
+			cw_gen_stop(mixer->channels[i]);
+		}
+		errno = rv;
+		return CW_FAILURE;
+	}
+	mixer->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop playing channels of mixer
+
+   Tone queues of all channels are flushed.
+
+   @param[in] mixer mixer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_mixer_stop(cw_mixer_t * mixer)
+{
+	if (NULL == mixer) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!mixer->thread_running) {
+		return CW_SUCCESS;
+	}
+
+	mixer->thread_quit = true;
+	pthread_join(mixer->thread, NULL);
+	mixer->thread_running = false;
+
+	for (int i = 0; i < mixer->n_channels; i++) {
+		cw_gen_stop(mixer->channels[i]);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Add samples of one channel to sum of samples of all channels
+
+   Mono samples of the channel are added to each of @p n_sound_channels
+   interleaved channels of sound device, scaled by volume of the
+   channel of sound device. The loops have no dependencies between
+   iterations, so compiler can vectorize them.
+
+   @param[in] samples mono samples of channel
+   @param[in] n_samples count of items in @p samples
+   @param[in] volumes volumes of channels of sound device [%]
+   @param[in] n_sound_channels count of channels of sound device (and of items in @p volumes)
+   @param[in,out] sum interleaved sum of samples, @p n_samples * @p n_sound_channels items
+*/
+void cw_mixer_mix_internal(const cw_sample_t * samples, int n_samples, const int * volumes, int n_sound_channels, int32_t * sum)
+{
+	for (int c = 0; c < n_sound_channels; c++) {
+		/* Q15 fixed point, 32768 is 100%. */
+		const int32_t gain = (volumes[c] * 32768) / CW_VOLUME_MAX;
+		int32_t * out = sum + c;
+		for (int i = 0; i < n_samples; i++) {
+			out[i * n_sound_channels] += (samples[i] * gain) >> 15;
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Convert sum of samples of all channels to samples, with clipping
+
+   The sum is clipped to range of 16-bit samples, also for 32-bit
+   integer samples (they are 16-bit samples scaled to full range).
+   Float samples are not clipped: sound server that mixes them with
+   other streams can use the headroom.
+
+   @param[in] sum sum of samples
+   @param[out] samples output samples
+   @param[in] n_samples count of items in @p sum and @p samples
+   @param[in] format format of @p samples
+*/
+void cw_mixer_clip_internal(const int32_t * sum, void * samples, int n_samples, cw_sample_format_t format)
+{
+	switch (format) {
+	case CW_SAMPLE_FORMAT_S32: {
+		int32_t * out = (int32_t *) samples;
+		for (int i = 0; i < n_samples; i++) {
+			const int32_t value = sum[i];
+			out[i] = (value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value)) * 65536;
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_FLOAT: {
+		float * out = (float *) samples;
+		for (int i = 0; i < n_samples; i++) {
+			out[i] = (float) sum[i] * (1.0F / 32768.0F);
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_S16:
+	default: {
+		cw_sample_t * out = (cw_sample_t *) samples;
+		for (int i = 0; i < n_samples; i++) {
+			const int32_t value = sum[i];
+			out[i] = (cw_sample_t) (value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value));
+		}
+		break;
+	}
+	}
+}
+
+
+
+
+/**
+   @brief Check if no channel of mixer has any tone to play
+
+   @param[in] mixer mixer
+
+   @return true if all channels are idle
+   @return false otherwise
+*/
+static bool cw_mixer_is_idle_internal(const cw_mixer_t * mixer)
+{
+	for (int i = 0; i < mixer->n_channels; i++) {
+		const cw_gen_t * channel = mixer->channels[i];
+		if (channel->pull.tone_in_progress || 0 != cw_tq_length_internal(channel->tq)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+/**
+   @brief Thread function of mixer
+
+   While at least one channel has tones to play, the function pulls
+   one buffer of samples from every channel and writes the sum of the
+   samples to sound device. The write is blocking, so the thread is
+   paced by sound device.
+
+   When all channels are idle, nothing is written to the device (just
+   like generator's thread doesn't write anything when its queue is
+   empty), and tone queues of channels are checked again after time of
+   one buffer.
+
+   @param[in] arg mixer (cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_mixer_thread_internal(void * arg)
+{
+	cw_mixer_t * mixer = (cw_mixer_t *) arg;
+	cw_gen_t * output = mixer->output;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "mixer", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "mixer");
+#endif
+
+	cw_gen_apply_thread_realtime_internal(output);
+
+	const int n_samples = output->buffer_n_samples;
+	const int n_sound_channels = output->n_sound_channels;
+	const int idle_wait = (int) (((int64_t) n_samples * CW_USECS_PER_SEC) / output->sample_rate);
+
+	while (!mixer->thread_quit) {
+		if (cw_mixer_is_idle_internal(mixer)) {
+			if (!mixer->idle && NULL != output->on_empty_queue) {
+				output->on_empty_queue(output);
+			}
+			mixer->idle = true;
+			cw_usleep_internal(idle_wait);
+			continue;
+		}
+		mixer->idle = false;
+
+		memset(mixer->sum, 0, sizeof (int32_t) * (size_t) n_samples * (size_t) n_sound_channels);
+		for (int i = 0; i < mixer->n_channels; i++) {
+			cw_gen_t * channel = mixer->channels[i];
+			cw_gen_fill_buffer(channel, mixer->channel_samples, (size_t) n_samples);
+			cw_mixer_mix_internal(mixer->channel_samples, n_samples,
+					      channel->sound_channel_volumes, n_sound_channels, mixer->sum);
+		}
+		/* With many channels of sound device, or with samples
+		   other than 16-bit, the sum is written directly as
+		   interleaved frames in format of sound device. */
+		if (NULL != output->frames) {
+			cw_mixer_clip_internal(mixer->sum, output->frames, n_samples * n_sound_channels, output->sample_format);
+		} else {
+			cw_mixer_clip_internal(mixer->sum, output->buffer, n_samples * n_sound_channels, CW_SAMPLE_FORMAT_S16);
+		}
+
+		output->buffer_write_n_samples = n_samples;
+		const int64_t write_begin = cw_clock_now_internal();
+		CW_TRACE(CW_TRACE_EVENT_WRITE_BEGIN, n_samples);
+		const cw_ret_t write_ret = output->write_buffer_to_sound_device(output);
+		CW_TRACE(CW_TRACE_EVENT_WRITE_END, write_ret);
+		cw_gen_stats_add_write_internal(output, write_ret, n_samples, cw_clock_now_internal() - write_begin);
+	}
+
+	return NULL;
+}
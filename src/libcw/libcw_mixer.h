@@ -0,0 +1,56 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_MIXER
+#define H_LIBCW_MIXER
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+struct cw_mixer_struct {
+	/* Generator that owns sound device. Its own thread is never
+	   started: mixer's thread writes mixed buffers to the device. */
+	cw_gen_t * output;
+
+	/* Generators working in pull mode, one per channel. */
+	cw_gen_t ** channels;
+	int n_channels;
+
+	/* Samples of one channel (output->buffer_n_samples items), and
+	   interleaved sum of samples of all channels
+	   (output->buffer_n_samples * output->n_sound_channels items). */
+	cw_sample_t * channel_samples;
+	int32_t * sum;
+
+	/* All channels were idle in last iteration of mixer's thread. */
+	bool idle;
+
+	pthread_t thread;
+	bool thread_running;
+	volatile bool thread_quit;
+};
+
+
+
+
+void cw_mixer_mix_internal(const cw_sample_t * samples, int n_samples, const int * volumes, int n_sound_channels, int32_t * sum);
+void cw_mixer_clip_internal(const int32_t * sum, void * samples, int n_samples, cw_sample_format_t format);
+
+
+
+
+#endif /* #ifndef H_LIBCW_MIXER */
@@ -0,0 +1,830 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_netkey.c
+
+   @brief Network keying. Replay remote keying received over UDP.
+
+   A single thread waits (with ppoll()) for datagrams on UDP socket
+   and for playout time of first change in schedule. New changes from
+   a datagram are converted from sender's clock to local monotonic
+   clock and appended to the schedule; changes whose time has come
+   are delivered to the key (cw_key_sk_set_value()) and, with their
+   scheduled timestamps, to receiver registered with the key.
+
+   Conversion between the clocks uses an offset that is constant
+   within a talkspurt: changes are shifted all by the same amount, so
+   their relative timing is kept exactly. The offset is recalculated
+   only when the key is open and the schedule is empty, from the
+   smallest transit time over last CW_NETKEY_TRANSIT_WINDOW datagrams
+   and from current estimate of jitter. Network with low jitter gets a
+   short delay, without a fixed worst-case delay.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_key.h"
+#include "libcw_netkey.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/netkey: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+static uint32_t cw_netkey_get_be32_internal(const uint8_t * src);
+static void     cw_netkey_update_transit_internal(cw_netkey_t * netkey, int64_t transit);
+static void     cw_netkey_set_value_internal(cw_netkey_t * netkey, cw_key_value_t value, int64_t timestamp);
+static void *   cw_netkey_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create new network keying
+
+   Changes received from network will be delivered to @p key. The key
+   must have a generator registered (see cw_key_register_generator())
+   before network keying is started.
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] key key controlled by network keying
+
+   @return freshly allocated network keying on success
+   @return NULL pointer on failure
+*/
+cw_netkey_t * cw_netkey_new(cw_key_t * key)
+{
+	if (NULL == key) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: NULL key");
+		errno = EINVAL;
+		return (cw_netkey_t *) NULL;
+	}
+
+	cw_netkey_t * netkey = (cw_netkey_t *) calloc(1, sizeof (cw_netkey_t));
+	if (NULL == netkey) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_netkey_t *) NULL;
+	}
+
+	netkey->key = key;
+	netkey->socket_fd = -1;
+	netkey->wakeup_fd = -1;
+	netkey->delay_min = CW_NETKEY_DELAY_MIN_DEFAULT;
+	netkey->delay_max = CW_NETKEY_DELAY_MAX_DEFAULT;
+	netkey->value = CW_KEY_VALUE_OPEN;
+	netkey->scheduled_value = CW_KEY_VALUE_OPEN;
+	pthread_mutex_init(&netkey->stats_mutex, NULL);
+
+	return netkey;
+}
+
+
+
+
+/**
+   @brief Delete network keying
+
+   Network keying is stopped if it's running, and its socket is
+   closed. Pointer to @p netkey is set to NULL.
+
+   @param[in] netkey pointer to network keying to delete
+*/
+void cw_netkey_delete(cw_netkey_t ** netkey)
+{
+	if (NULL == netkey || NULL == *netkey) {
+		return;
+	}
+
+	cw_netkey_stop(*netkey);
+
+	if (-1 != (*netkey)->socket_fd) {
+		close((*netkey)->socket_fd);
+	}
+	pthread_mutex_destroy(&(*netkey)->stats_mutex);
+
+	free(*netkey);
+	*netkey = (cw_netkey_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Open UDP socket on which network keying receives datagrams
+
+   @p address is "host:port", "[address]:port" for IPv6 addresses, or
+   ":port" for all local addresses. Port 0 picks a free port, see
+   cw_netkey_get_port().
+
+   Socket can be opened only when network keying is not running. A
+   previously opened socket is closed.
+
+   @param[in] netkey network keying
+   @param[in] address local address to bind to
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_bind(cw_netkey_t * netkey, const char * address)
+{
+	if (NULL == netkey || NULL == address) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (netkey->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	struct addrinfo * result = NULL;
+	const int rv = cw_resolve_address_internal(address, SOCK_DGRAM, true, &result);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "bind: can't resolve '%s': %s", address, gai_strerror(rv));
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	int fd = -1;
+	for (struct addrinfo * ai = result; NULL != ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		if (0 == bind(fd, ai->ai_addr, ai->ai_addrlen)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+
+	if (-1 == fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "bind: can't bind to '%s': %s", address, strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	if (-1 != netkey->socket_fd) {
+		close(netkey->socket_fd);
+	}
+	netkey->socket_fd = fd;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get local port of socket of network keying
+
+   @param[in] netkey network keying
+
+   @return port number on success
+   @return -1 if socket is not open
+*/
+int cw_netkey_get_port(const cw_netkey_t * netkey)
+{
+	if (NULL == netkey || -1 == netkey->socket_fd) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof (addr);
+	if (-1 == getsockname(netkey->socket_fd, (struct sockaddr *) &addr, &addr_len)) {
+		return -1;
+	}
+
+	if (AF_INET6 == addr.ss_family) {
+		return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+	} else {
+		return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+	}
+}
+
+
+
+
+/**
+   @brief Set range of playout delay of network keying
+
+   Playout delay follows jitter of network, but it's never shorter
+   than @p delay_min or longer than @p delay_max. Equal limits give a
+   fixed delay.
+
+   The range can be changed only when network keying is not running.
+
+   @param[in] netkey network keying
+   @param[in] delay_min minimal delay [us]
+   @param[in] delay_max maximal delay [us]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_set_delay_range(cw_netkey_t * netkey, int delay_min, int delay_max)
+{
+	if (NULL == netkey || delay_min < 0 || delay_max < delay_min || delay_max > CW_NETKEY_MARK_DURATION_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (netkey->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	netkey->delay_min = delay_min;
+	netkey->delay_max = delay_max;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Register function called after each replayed change of key
+
+   The callback can be registered only when network keying is not
+   running. Pass NULL to unregister the callback.
+
+   @param[in] netkey network keying
+   @param[in] callback_func callback function
+   @param[in] callback_arg argument passed to the callback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_register_callback(cw_netkey_t * netkey, cw_netkey_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == netkey || netkey->thread_running) {
+		errno = NULL == netkey ? EINVAL : EBUSY;
+		return CW_FAILURE;
+	}
+
+	netkey->callback_func = callback_func;
+	netkey->callback_arg = callback_arg;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Start thread of network keying
+
+   Socket must be opened with cw_netkey_bind() first.
+
+   @param[in] netkey network keying
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_start(cw_netkey_t * netkey)
+{
+	if (NULL == netkey || -1 == netkey->socket_fd) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (netkey->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	netkey->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (-1 == netkey->wakeup_fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: eventfd(): %s", strerror(saved_errno));
+		errno = saved_errno;
+		return CW_FAILURE;
+	}
+
+	const int rv = pthread_create(&netkey->thread, NULL, cw_netkey_thread_internal, netkey);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		close(netkey->wakeup_fd);
+		netkey->wakeup_fd = -1;
+		errno = rv;
+		return CW_FAILURE;
+	}
+	netkey->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop thread of network keying
+
+   Changes that are still in schedule are dropped, and the key is
+   opened if it's closed. Socket stays open, and network keying can be
+   started again.
+
+   @param[in] netkey network keying
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_stop(cw_netkey_t * netkey)
+{
+	if (NULL == netkey) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (netkey->thread_running) {
+		const uint64_t one = 1;
+		if (sizeof (one) != write(netkey->wakeup_fd, &one, sizeof (one))) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "stop: can't wake up thread: %s", strerror(errno));
+		}
+		pthread_join(netkey->thread, NULL);
+		netkey->thread_running = false;
+	}
+
+	if (-1 != netkey->wakeup_fd) {
+		close(netkey->wakeup_fd);
+		netkey->wakeup_fd = -1;
+	}
+
+	netkey->schedule_count = 0;
+	netkey->scheduled_value = CW_KEY_VALUE_OPEN;
+	if (CW_KEY_VALUE_CLOSED == netkey->value) {
+		cw_netkey_set_value_internal(netkey, CW_KEY_VALUE_OPEN, cw_clock_now_internal());
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get statistics of network keying
+
+   The statistics can be read while network keying is running.
+
+   @param[in] netkey network keying
+   @param[out] stats statistics
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_get_stats(cw_netkey_t * netkey, cw_netkey_stats_t * stats)
+{
+	if (NULL == netkey || NULL == stats) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&netkey->stats_mutex);
+	*stats = netkey->stats;
+	pthread_mutex_unlock(&netkey->stats_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Add changes from datagram to schedule of network keying
+
+   Changes that have already been received (in earlier datagrams) are
+   skipped, and so are datagrams that are not newer than the ones
+   already received.
+
+   @param[in] netkey network keying
+   @param[in] datagram contents of datagram
+   @param[in] n_bytes size of datagram
+   @param[in] arrival local time of arrival of the datagram [ns]
+*/
+void cw_netkey_process_datagram_internal(cw_netkey_t * netkey, const uint8_t * datagram, size_t n_bytes, int64_t arrival)
+{
+	pthread_mutex_lock(&netkey->stats_mutex);
+
+	const size_t n_events = n_bytes >= CW_NETKEY_HEADER_SIZE ? datagram[3] : 0;
+	if (n_bytes < CW_NETKEY_HEADER_SIZE
+	    || 'C' != datagram[0] || 'W' != datagram[1] || CW_NETKEY_VERSION != datagram[2]
+	    || 0 == n_events || n_events > CW_NETKEY_EVENTS_MAX
+	    || n_bytes != CW_NETKEY_HEADER_SIZE + n_events * CW_NETKEY_EVENT_SIZE) {
+
+		netkey->stats.n_invalid++;
+		pthread_mutex_unlock(&netkey->stats_mutex);
+		return;
+	}
+	netkey->stats.n_datagrams++;
+
+	const uint32_t first_sequence = cw_netkey_get_be32_internal(datagram + 4);
+	const uint32_t last_sequence = first_sequence + (uint32_t) n_events - 1;
+	if (netkey->has_events && (int32_t) (last_sequence - netkey->last_sequence) <= 0) {
+		/* Duplicated or reordered datagram. */
+		pthread_mutex_unlock(&netkey->stats_mutex);
+		return;
+	}
+
+	/* Changes new to the schedule, with sender's times [us]. */
+	int64_t times[CW_NETKEY_EVENTS_MAX];
+	cw_key_value_t values[CW_NETKEY_EVENTS_MAX];
+	size_t n_new = 0;
+	for (size_t i = 0; i < n_events; i++) {
+		const uint32_t sequence = first_sequence + (uint32_t) i;
+		if (netkey->has_events && (int32_t) (sequence - netkey->last_sequence) <= 0) {
+			continue;
+		}
+		if (netkey->has_events) {
+			netkey->stats.n_lost += sequence - netkey->last_sequence - 1;
+		}
+
+		const uint32_t raw = cw_netkey_get_be32_internal(datagram + CW_NETKEY_HEADER_SIZE + i * CW_NETKEY_EVENT_SIZE);
+		const uint32_t time_raw = raw & 0x7fffffff;
+		if (netkey->has_events) {
+			/* Sign-extend 31-bit difference. */
+			const uint32_t diff = (time_raw - netkey->last_sender_time_raw) & 0x7fffffff;
+			netkey->last_sender_time += diff & 0x40000000 ? (int64_t) diff - 0x80000000 : (int64_t) diff;
+		} else {
+			netkey->last_sender_time = time_raw;
+		}
+		netkey->last_sender_time_raw = time_raw;
+		netkey->last_sequence = sequence;
+		netkey->has_events = true;
+
+		times[n_new] = netkey->last_sender_time;
+		values[n_new] = (raw & 0x80000000) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+		n_new++;
+	}
+	netkey->stats.n_events += (unsigned int) n_new;
+
+	cw_netkey_update_transit_internal(netkey, arrival - netkey->last_sender_time * 1000);
+
+	if (0 == netkey->schedule_count && CW_KEY_VALUE_OPEN == netkey->scheduled_value) {
+		/* Key is idle, so the delay can be changed without breaking
+		   rhythm of keying. */
+		int64_t min_transit = netkey->transits[0];
+		for (int i = 1; i < netkey->n_transits; i++) {
+			if (netkey->transits[i] < min_transit) {
+				min_transit = netkey->transits[i];
+			}
+		}
+		int64_t delay = (4 * netkey->jitter_x16 / 16) / 1000;
+		if (delay < netkey->delay_min) {
+			delay = netkey->delay_min;
+		} else if (delay > netkey->delay_max) {
+			delay = netkey->delay_max;
+		}
+		netkey->offset = min_transit + delay * 1000;
+		netkey->delay = (int) delay;
+	}
+
+	for (size_t i = 0; i < n_new; i++) {
+		if (values[i] == netkey->scheduled_value) {
+			/* Change that should have been between this one and
+			   previous one was lost. */
+			continue;
+		}
+		int64_t time = times[i] * 1000 + netkey->offset;
+		if (time < arrival) {
+			/* Too late. Replay it now, and shift rest of the
+			   talkspurt with it. */
+			netkey->stats.n_late++;
+			netkey->offset += arrival - time;
+			netkey->delay += (int) ((arrival - time) / 1000);
+			time = arrival;
+		}
+		if (time < netkey->scheduled_time) {
+			time = netkey->scheduled_time;
+		}
+		if (netkey->schedule_count >= CW_NETKEY_SCHEDULE_CAPACITY) {
+			netkey->stats.n_lost++;
+			continue;
+		}
+
+		const int tail = (netkey->schedule_head + netkey->schedule_count) % CW_NETKEY_SCHEDULE_CAPACITY;
+		netkey->schedule[tail].time = time;
+		netkey->schedule[tail].value = values[i];
+		netkey->schedule_count++;
+		netkey->scheduled_value = values[i];
+		netkey->scheduled_time = time;
+	}
+
+	netkey->stats.jitter = (int) (netkey->jitter_x16 / 16 / 1000);
+	netkey->stats.delay = netkey->delay;
+
+	pthread_mutex_unlock(&netkey->stats_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Deliver to key all scheduled changes whose time has come
+
+   A key that has been closed for longer than
+   CW_NETKEY_MARK_DURATION_MAX, with no opening change in schedule, is
+   opened.
+
+   @param[in] netkey network keying
+   @param[in] now current local time [ns]
+*/
+void cw_netkey_replay_internal(cw_netkey_t * netkey, int64_t now)
+{
+	while (netkey->schedule_count > 0 && netkey->schedule[netkey->schedule_head].time <= now) {
+		const cw_netkey_change_t change = netkey->schedule[netkey->schedule_head];
+		netkey->schedule_head = (netkey->schedule_head + 1) % CW_NETKEY_SCHEDULE_CAPACITY;
+		netkey->schedule_count--;
+		cw_netkey_set_value_internal(netkey, change.value, change.time);
+	}
+
+	if (0 == netkey->schedule_count
+	    && CW_KEY_VALUE_CLOSED == netkey->value
+	    && now - netkey->value_time >= (int64_t) CW_NETKEY_MARK_DURATION_MAX * 1000) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_WARNING,
+			      MSG_PREFIX "no news from sender, opening key");
+		netkey->scheduled_value = CW_KEY_VALUE_OPEN;
+		netkey->scheduled_time = now;
+		cw_netkey_set_value_internal(netkey, CW_KEY_VALUE_OPEN, now);
+	}
+
+	return;
+}
+
+
+
+
+static uint32_t cw_netkey_get_be32_internal(const uint8_t * src)
+{
+	return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16) | ((uint32_t) src[2] << 8) | src[3];
+}
+
+
+
+
+/**
+   @brief Add transit time of a datagram to window of transit times, and update estimate of jitter
+
+   @param[in] netkey network keying
+   @param[in] transit local time of arrival minus sender's time of newest change in datagram [ns]
+*/
+static void cw_netkey_update_transit_internal(cw_netkey_t * netkey, int64_t transit)
+{
+	if (netkey->n_transits > 0) {
+		int64_t d = transit - netkey->prev_transit;
+		if (d < 0) {
+			d = -d;
+		}
+		netkey->jitter_x16 += d - netkey->jitter_x16 / 16;
+	}
+	netkey->prev_transit = transit;
+
+	netkey->transits[netkey->transits_head] = transit;
+	netkey->transits_head = (netkey->transits_head + 1) % CW_NETKEY_TRANSIT_WINDOW;
+	if (netkey->n_transits < CW_NETKEY_TRANSIT_WINDOW) {
+		netkey->n_transits++;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Deliver change of key to key, to its receiver and to callback
+*/
+static void cw_netkey_set_value_internal(cw_netkey_t * netkey, cw_key_value_t value, int64_t timestamp)
+{
+	netkey->value = value;
+	netkey->value_time = timestamp;
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
+		      MSG_PREFIX "value %d at %" PRId64 " [ns]", value, timestamp);
+
+	cw_key_sk_set_value(netkey->key, value);
+	if (NULL != netkey->key->rec) {
+		if (CW_KEY_VALUE_CLOSED == value) {
+			cw_rec_mark_begin_ns(netkey->key->rec, timestamp);
+		} else {
+			cw_rec_mark_end_ns(netkey->key->rec, timestamp);
+		}
+	}
+
+	if (NULL != netkey->callback_func) {
+		netkey->callback_func(netkey->callback_arg, value, timestamp);
+	}
+
+	return;
+}
+
+
+
+
+static void * cw_netkey_thread_internal(void * arg)
+{
+	cw_netkey_t * netkey = (cw_netkey_t *) arg;
+
+	while (true) {
+		/* Wait for a datagram, or until playout time of first change
+		   in schedule, or until a closed key should be opened. */
+		const int64_t now = cw_clock_now_internal();
+		int64_t deadline = -1;
+		if (netkey->schedule_count > 0) {
+			deadline = netkey->schedule[netkey->schedule_head].time;
+		} else if (CW_KEY_VALUE_CLOSED == netkey->value) {
+			deadline = netkey->value_time + (int64_t) CW_NETKEY_MARK_DURATION_MAX * 1000;
+		}
+		struct timespec timeout = { 0 };
+		if (-1 != deadline && deadline > now) {
+			timeout.tv_sec = (time_t) ((deadline - now) / 1000000000);
+			timeout.tv_nsec = (long) ((deadline - now) % 1000000000);
+		}
+
+		struct pollfd fds[2] = {
+			{ .fd = netkey->socket_fd, .events = POLLIN },
+			{ .fd = netkey->wakeup_fd, .events = POLLIN }
+		};
+		const int n = ppoll(fds, 2, -1 == deadline ? NULL : &timeout, NULL);
+		if (-1 == n) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "ppoll(): %s", strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			/* One byte more than the largest valid datagram, to
+			   recognize datagrams that are too large. */
+			uint8_t datagram[CW_NETKEY_HEADER_SIZE + CW_NETKEY_EVENTS_MAX * CW_NETKEY_EVENT_SIZE + 1];
+			ssize_t n_bytes = 0;
+			while ((n_bytes = recv(netkey->socket_fd, datagram, sizeof (datagram), 0)) >= 0) {
+				cw_netkey_process_datagram_internal(netkey, datagram, (size_t) n_bytes, cw_clock_now_internal());
+			}
+		}
+
+		cw_netkey_replay_internal(netkey, cw_clock_now_internal());
+	}
+
+	return NULL;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_netkey_t * cw_netkey_new(__attribute__((unused)) cw_key_t * key)
+{
+	errno = ENOSYS;
+	return (cw_netkey_t *) NULL;
+}
+
+void cw_netkey_delete(__attribute__((unused)) cw_netkey_t ** netkey)
+{
+	return;
+}
+
+cw_ret_t cw_netkey_bind(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) const char * address)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+int cw_netkey_get_port(__attribute__((unused)) const cw_netkey_t * netkey)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+cw_ret_t cw_netkey_set_delay_range(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) int delay_min, __attribute__((unused)) int delay_max)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_netkey_register_callback(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) cw_netkey_callback_t callback_func, __attribute__((unused)) void * callback_arg)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_netkey_start(__attribute__((unused)) cw_netkey_t * netkey)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_netkey_stop(__attribute__((unused)) cw_netkey_t * netkey)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_netkey_get_stats(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) cw_netkey_stats_t * stats)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+void cw_netkey_process_datagram_internal(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) const uint8_t * datagram, __attribute__((unused)) size_t n_bytes, __attribute__((unused)) int64_t arrival)
+{
+	return;
+}
+
+void cw_netkey_replay_internal(__attribute__((unused)) cw_netkey_t * netkey, __attribute__((unused)) int64_t now)
+{
+	return;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
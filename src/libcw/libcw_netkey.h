@@ -0,0 +1,121 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_NETKEY
+#define H_LIBCW_NETKEY
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Size of header of datagram, and size of one event in datagram
+   [bytes]. */
+enum { CW_NETKEY_HEADER_SIZE = 8 };
+enum { CW_NETKEY_EVENT_SIZE = 4 };
+
+/* Capacity of schedule of changes of key waiting to be replayed. */
+enum { CW_NETKEY_SCHEDULE_CAPACITY = 64 };
+
+/* Count of most recent datagrams over which minimal transit time is
+   tracked. The window lets the estimate follow drift of sender's
+   clock. */
+enum { CW_NETKEY_TRANSIT_WINDOW = 32 };
+
+/* Default range of playout delay [us]. */
+enum { CW_NETKEY_DELAY_MIN_DEFAULT = 20000 };
+enum { CW_NETKEY_DELAY_MAX_DEFAULT = 500000 };
+
+/* Key that stays closed this long without news from sender is opened
+   (closing change was received, opening change was lost) [us]. */
+enum { CW_NETKEY_MARK_DURATION_MAX = 3000000 };
+
+
+
+
+typedef struct {
+	int64_t time;         /* Local time of the change [ns]. */
+	cw_key_value_t value;
+} cw_netkey_change_t;
+
+
+
+
+struct cw_netkey_struct {
+	cw_key_t * key;
+
+	int socket_fd;
+	int wakeup_fd;  /* eventfd used to stop the thread. */
+
+	cw_netkey_callback_t callback_func;
+	void * callback_arg;
+
+	int delay_min; /* [us] */
+	int delay_max; /* [us] */
+
+	/* Sequence number of last received event, and sender's time of
+	   the event, unwrapped to 64 bits [us]. */
+	bool has_events;
+	uint32_t last_sequence;
+	int64_t last_sender_time;
+	uint32_t last_sender_time_raw;
+
+	/* Transit times (local time of arrival minus sender's time of
+	   newest event of datagram) of recent datagrams [ns]. They
+	   include offset between the two clocks. */
+	int64_t transits[CW_NETKEY_TRANSIT_WINDOW];
+	int n_transits;
+	int transits_head;
+	int64_t prev_transit;
+	/* Interarrival jitter, as in RFC 3550, scaled by 16 [ns]. */
+	int64_t jitter_x16;
+
+	/* Local time = sender's time + offset, constant during a
+	   talkspurt [ns]. */
+	int64_t offset;
+	int delay;         /* Playout delay included in the offset [us]. */
+
+	/* Changes waiting to be replayed, ordered by time. */
+	cw_netkey_change_t schedule[CW_NETKEY_SCHEDULE_CAPACITY];
+	int schedule_head;
+	int schedule_count;
+	/* Value of key after last scheduled change, and local time of
+	   last scheduled change [ns]. */
+	cw_key_value_t scheduled_value;
+	int64_t scheduled_time;
+
+	/* Value of key and time of last replayed change [ns]. */
+	cw_key_value_t value;
+	int64_t value_time;
+
+	/* Protects statistics and delay, read by client code while the
+	   thread is running. */
+	pthread_mutex_t stats_mutex;
+	cw_netkey_stats_t stats;
+
+	pthread_t thread;
+	bool thread_running;
+};
+
+
+
+
+void cw_netkey_process_datagram_internal(cw_netkey_t * netkey, const uint8_t * datagram, size_t n_bytes, int64_t arrival);
+void cw_netkey_replay_internal(cw_netkey_t * netkey, int64_t now);
+
+
+
+
+#endif /* #ifndef H_LIBCW_NETKEY */
@@ -151,13 +151,13 @@ static void cw_null_close_sound_device_internal(cw_gen_t * gen)
 
    @return CW_SUCCESS
 */
-static cw_ret_t cw_null_write_tone_to_sound_device_internal(__attribute__((unused)) cw_gen_t * gen, const cw_tone_t * tone)
+static cw_ret_t cw_null_write_tone_to_sound_device_internal(cw_gen_t * gen, const cw_tone_t * tone)
 {
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_NULL);
 	assert (tone->duration >= 0); /* TODO: shouldn't the condition be "tone->duration > 0"? */
 
-	cw_usleep_internal(tone->duration);
+	cw_gen_pace_tone_internal(gen, tone->duration);
 
 	return CW_SUCCESS;
 }
@@ -65,6 +65,7 @@ extern cw_debug_t cw_debug_object_dev;
 #include <fcntl.h>
 #include <limits.h>
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -87,6 +88,7 @@ extern cw_debug_t cw_debug_object_dev;
 
 
 #include "libcw_gen.h"
+#include "libcw_utils.h"
 
 
 
@@ -104,9 +106,25 @@ extern const unsigned int cw_supported_sample_rates[];
 static const unsigned int CW_OSS_SETFRAGMENT = 7U;              /* Sound fragment size, 2^7 samples. */
 static const int CW_OSS_SAMPLE_FORMAT = AFMT_S16_NE;  /* Sound format AFMT_S16_NE = signed 16 bit, native endianess; LE = Little endianess. */
 
-static cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate);
+/* Fragments configured for cw_gen_config_t::oss_target_latency: count
+   of fragments in device's buffer, and limits of size of fragment
+   (2^N bytes). */
+static const unsigned int CW_OSS_TARGET_N_FRAGMENTS = 4U;
+static const unsigned int CW_OSS_FRAGMENT_SHIFT_MIN = 4U;
+static const unsigned int CW_OSS_FRAGMENT_SHIFT_MAX = 16U;
+
+/* How long non-blocking write waits in poll() for device to accept
+   more samples before giving up [ms]. */
+static const int CW_OSS_POLL_TIMEOUT = 1000;
+
+static cw_ret_t cw_oss_open_device_ioctls_internal(int fd, int n_channels, cw_sample_format_t sample_format, unsigned int target_latency, unsigned int * sample_rate);
+static unsigned int cw_oss_fragment_parameter_internal(unsigned int target_latency, unsigned int sample_rate, int n_channels, cw_sample_format_t sample_format);
+static int cw_oss_sample_format_internal(cw_sample_format_t sample_format);
 static cw_ret_t cw_oss_get_version_internal(int fd, cw_oss_version_t * version);
 static cw_ret_t cw_oss_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_oss_write_nonblocking_internal(cw_gen_t * gen, const uint8_t * data, size_t n_bytes);
+static void cw_oss_update_latency_internal(cw_gen_t * gen);
+static cw_ret_t cw_oss_get_device_delay(cw_gen_t * gen, int64_t * delay);
 static cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void cw_oss_close_sound_device_internal(cw_gen_t * gen);
 
@@ -171,7 +189,7 @@ bool cw_is_oss_possible(const char * device_name)
 	  values from ioctl() and returns CW_FAILURE if one of ioctls()
 	  returns -1. */
 	unsigned int dummy = 0;
-	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(soundcard, &dummy);
+	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(soundcard, 1, CW_SAMPLE_FORMAT_S16, 0, &dummy);
 	close(soundcard);
 	if (cw_ret != CW_SUCCESS) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
@@ -207,6 +225,7 @@ cw_ret_t cw_oss_init_gen_internal(cw_gen_t * gen)
 	gen->open_and_configure_sound_device = cw_oss_open_and_configure_sound_device_internal;
 	gen->close_sound_device              = cw_oss_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_oss_write_buffer_to_sound_device_internal;
+	gen->get_device_delay                = cw_oss_get_device_delay;
 
 	return CW_SUCCESS;
 }
@@ -229,14 +248,149 @@ cw_ret_t cw_oss_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_OSS);
 
-	size_t n_bytes = sizeof (gen->buffer[0]) * gen->buffer_n_samples;
-	ssize_t rv = write(gen->oss_data.sound_sink_fd, gen->buffer, n_bytes);
-	if (rv != (ssize_t) n_bytes) {
+	const size_t frame_size = gen->sample_size * (size_t) gen->n_sound_channels;
+	size_t n_bytes = frame_size * gen->buffer_write_n_samples;
+	if (gen->oss_data.nonblocking) {
+		return cw_oss_write_nonblocking_internal(gen, (const uint8_t *) cw_gen_frames_internal(gen), n_bytes);
+	}
+
+	ssize_t rv = write(gen->oss_data.sound_sink_fd, cw_gen_frames_internal(gen), n_bytes);
+	if (rv >= 0 && rv < (ssize_t) n_bytes) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "write: short write, expected to write %zd bytes, written %zd bytes", n_bytes, rv);
+		cw_gen_stats_add_short_write_internal(gen, (int) (rv / (ssize_t) frame_size));
+		return CW_FAILURE;
+	} else if (rv != (ssize_t) n_bytes) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "write: %s", strerror(errno));
 		return CW_FAILURE;
 	}
 	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO, MSG_PREFIX "written %d samples", gen->buffer_n_samples);
+	cw_oss_update_latency_internal(gen);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write samples to OSS device opened in non-blocking mode
+
+   Whatever the device accepts is written right away. When device's
+   buffer is full, the function waits with poll() until a fragment has
+   been played, but not longer than CW_OSS_POLL_TIMEOUT: a device
+   that stopped playing doesn't block generator's thread forever.
+
+   @param[in] gen generator that will write to sound device
+   @param[in] data samples (frames) to write
+   @param[in] n_bytes size of @p data
+
+   @return CW_SUCCESS if all samples have been written
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_oss_write_nonblocking_internal(cw_gen_t * gen, const uint8_t * data, size_t n_bytes)
+{
+	const size_t frame_size = gen->sample_size * (size_t) gen->n_sound_channels;
+	size_t n_written = 0;
+
+	while (n_written < n_bytes) {
+		const ssize_t rv = write(gen->oss_data.sound_sink_fd, data + n_written, n_bytes - n_written);
+		if (rv > 0) {
+			n_written += (size_t) rv;
+			continue;
+		}
+		if (-1 == rv && EINTR == errno) {
+			continue;
+		}
+		if (-1 == rv && EAGAIN != errno) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: %s", strerror(errno));
+			break;
+		}
+
+		/* Device's buffer is full. */
+		struct pollfd pfd = { .fd = gen->oss_data.sound_sink_fd, .events = POLLOUT };
+		const int poll_rv = poll(&pfd, 1, CW_OSS_POLL_TIMEOUT);
+		if (-1 == poll_rv) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: poll(): %s", strerror(errno));
+			break;
+		}
+		if (0 == poll_rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: device hasn't accepted samples for %d ms", CW_OSS_POLL_TIMEOUT);
+			break;
+		}
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: poll() reports error on device: 0x%x", (unsigned int) pfd.revents);
+			break;
+		}
+	}
+
+	if (n_written < n_bytes) {
+		if (n_written > 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: short write, expected to write %zu bytes, written %zu bytes", n_bytes, n_written);
+			cw_gen_stats_add_short_write_internal(gen, (int) (n_written / frame_size));
+		}
+		return CW_FAILURE;
+	}
+	cw_oss_update_latency_internal(gen);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Pass current latency of OSS device to generator's latency statistics
+
+   Latency is duration of samples that have been written to the
+   device, but not played yet.
+
+   @param[in] gen generator with opened OSS device
+*/
+static void cw_oss_update_latency_internal(cw_gen_t * gen)
+{
+	int64_t latency = 0;
+	if (CW_SUCCESS == cw_oss_get_device_delay(gen, &latency)) {
+		cw_gen_latency_set_sound_device_latency_internal(gen, latency);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current delay of OSS device
+
+   @param[in] gen generator with opened OSS device
+   @param[out] delay delay of device [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_oss_get_device_delay(cw_gen_t * gen, int64_t * delay)
+{
+	int n_bytes = 0;
+	/* Don't let clang-tidy report warning about signed. To fix
+	   the warning we would have to introduce casting, and that
+	   would introduce runtime warnings in dmesg on FreeBSD. */
+	/* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+	if (-1 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_GETODELAY, &n_bytes) || n_bytes < 0) {
+		return CW_FAILURE;
+	}
+
+	const int64_t frame_size = (int64_t) (gen->sample_size * (size_t) gen->n_sound_channels);
+	*delay = ((int64_t) n_bytes / frame_size) * CW_USECS_PER_SEC / gen->sample_rate;
 
 	return CW_SUCCESS;
 }
@@ -269,14 +423,15 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
 	   cw_oss_open_and_configure_sound_device_internal() and is_possible() function. */
 
 	/* Open the given soundcard device file, for write only. */
-	gen->oss_data.sound_sink_fd = open(gen->picked_device_name, O_WRONLY);
+	gen->oss_data.nonblocking = gen_conf->oss_nonblocking;
+	gen->oss_data.sound_sink_fd = open(gen->picked_device_name, O_WRONLY | (gen->oss_data.nonblocking ? O_NONBLOCK : 0));
 	if (-1 == gen->oss_data.sound_sink_fd) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: open(%s): '%s'", gen->picked_device_name, strerror(errno));
 		return CW_FAILURE;
 	}
 
-	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(gen->oss_data.sound_sink_fd, &gen->sample_rate);
+	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(gen->oss_data.sound_sink_fd, gen->n_sound_channels, gen->sample_format, gen_conf->oss_target_latency, &gen->sample_rate);
 	if (cw_ret != CW_SUCCESS) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: one or more OSS ioctl() calls failed");
@@ -301,7 +456,21 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
 		return CW_FAILURE;
 	}
 
-	if ((size & 0x0000ffff) != (1U << CW_OSS_SETFRAGMENT)) {
+	if (0 != gen_conf->oss_target_latency) {
+		/* Driver may have given us fragments different than
+		   requested; whatever it is, write one fragment at a
+		   time. */
+		const int frame_size = (int) gen->sample_size * gen->n_sound_channels;
+		if (size < frame_size) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: invalid OSS fragment size %d", size);
+			close(gen->oss_data.sound_sink_fd);
+			return CW_FAILURE;
+		}
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "open: OSS fragment size = %d bytes for target latency %u us", size, gen_conf->oss_target_latency);
+		gen->buffer_n_samples = size / frame_size;
+	} else if ((size & 0x0000ffff) != (1U << CW_OSS_SETFRAGMENT)) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: OSS fragment size not set, %d", size);
 		close(gen->oss_data.sound_sink_fd);
@@ -312,8 +481,8 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
 		   "(size & 0x0000ffff)" or maybe even "2^(size & 0x0000ffff)"? */
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 			      MSG_PREFIX "open: OSS fragment size = %d", size);
+		gen->buffer_n_samples = size;
 	}
-	gen->buffer_n_samples = size;
 
 
 	cw_oss_get_version_internal(gen->oss_data.sound_sink_fd, &gen->oss_data.version);
@@ -340,13 +509,23 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
    @reviewed 2020-07-19
 
    @param[in] fd file descriptor of open OSS file;
+   @param[in] n_channels count of channels to configure
+   @param[in] sample_format format of samples to configure
+   @param[in] target_latency latency for which to configure fragments [us], zero for library's default fragments
    @param[out] sample_rate sample rate configured by ioctl calls
 
    @return CW_FAILURE on errors
    @return CW_SUCCESS on success
 */
-cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
+cw_ret_t cw_oss_open_device_ioctls_internal(int fd, int n_channels, cw_sample_format_t sample_format, unsigned int target_latency, unsigned int * sample_rate)
 {
+	const int oss_format = cw_oss_sample_format_internal(sample_format);
+	if (-1 == oss_format) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "ioctls: sample format %d not supported by OSS headers", (int) sample_format);
+		return CW_FAILURE;
+	}
+
 	int parameter = 0; /* Ignored. */
 	/* Don't let clang-tidy report warning about signed. To fix
 	   the warning we would have to introduce casting, and that
@@ -378,7 +557,7 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 	}
 #endif
 	/* Set the sample format. */
-	parameter = CW_OSS_SAMPLE_FORMAT;
+	parameter = oss_format;
 	/* Don't cast second argument of ioctl() to int, because you will get
 	   this warning in dmesg (found on FreeBSD 12.1):
 	   "ioctl sign-extension ioctl ffffffffc0045005" */
@@ -391,7 +570,7 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 			      MSG_PREFIX "ioctls: ioctl(SNDCTL_DSP_SETFMT): '%s'", strerror(errno));
 		return CW_FAILURE;
 	}
-	if (parameter != CW_OSS_SAMPLE_FORMAT) {
+	if (parameter != oss_format) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "ioctls: sample format not supported");
 		/* TODO: can't we try some other sample format? */
@@ -399,7 +578,7 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 	}
 
 	/* Set up mono/stereo mode. */
-	parameter = CW_AUDIO_CHANNELS;
+	parameter = n_channels;
 	/* Don't cast second argument of ioctl() to int, because you will get
 	   this warning in dmesg (found on FreeBSD 12.1):
 	   "ioctl sign-extension ioctl ffffffffc0045006" */
@@ -412,7 +591,7 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 			      MSG_PREFIX "ioctls: ioctl(SNDCTL_DSP_CHANNELS): '%s'", strerror(errno));
 		return CW_FAILURE;
 	}
-	if (parameter != CW_AUDIO_CHANNELS) {
+	if (parameter != n_channels) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "ioctls: number of channels not supported");
 		return CW_FAILURE;
@@ -485,7 +664,12 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 	 * support.
 	 */
 	/* parameter = 0x7fff << 16 | CW_OSS_SETFRAGMENT; */
-	parameter = 0x0032U << 16U | CW_OSS_SETFRAGMENT;
+	if (0 == target_latency) {
+		parameter = 0x0032U << 16U | CW_OSS_SETFRAGMENT;
+	} else {
+		parameter = (int) cw_oss_fragment_parameter_internal(target_latency, rate, n_channels, sample_format);
+	}
+	const unsigned int fragment_shift = (unsigned int) parameter & 0x0000ffffU;
 
 	/* Don't cast second argument of ioctl() to int, because you will get
 	   this warning in dmesg (found on FreeBSD 12.1):
@@ -513,7 +697,7 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 		return CW_FAILURE;
 	}
 
-	if (parameter != (1U << CW_OSS_SETFRAGMENT)) {
+	if (parameter != (1 << fragment_shift)) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "ioctls: OSS fragment size not set, %d", parameter);
 	}
@@ -552,6 +736,75 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 
 
 
+/**
+   @brief Calculate argument of SNDCTL_DSP_SETFRAGMENT for given latency
+
+   The argument has the format 0xMMMMSSSS: fragment size is 2^SSSS
+   bytes, and the buffer is made of MMMM fragments. Fragment size is
+   rounded down, so duration of the buffer doesn't exceed @p
+   target_latency (unless the latency is shorter than the smallest
+   fragments).
+
+   @param[in] target_latency requested duration of device's buffer [us]
+   @param[in] sample_rate sample rate of device
+   @param[in] n_channels count of interleaved channels
+   @param[in] sample_format format of samples
+
+   @return argument of SNDCTL_DSP_SETFRAGMENT ioctl
+*/
+static unsigned int cw_oss_fragment_parameter_internal(unsigned int target_latency, unsigned int sample_rate, int n_channels, cw_sample_format_t sample_format)
+{
+	const uint64_t frame_size = cw_sample_format_size_internal(sample_format) * (uint64_t) n_channels;
+	const uint64_t buffer_size = ((uint64_t) target_latency * sample_rate / CW_USECS_PER_SEC) * frame_size;
+	const uint64_t fragment_size = buffer_size / CW_OSS_TARGET_N_FRAGMENTS;
+
+	unsigned int shift = CW_OSS_FRAGMENT_SHIFT_MIN;
+	while (shift < CW_OSS_FRAGMENT_SHIFT_MAX && (1ULL << (shift + 1)) <= fragment_size) {
+		shift++;
+	}
+
+	return CW_OSS_TARGET_N_FRAGMENTS << 16U | shift;
+}
+
+
+
+
+/**
+   @brief Get OSS sample format (AFMT_*) for given libcw's sample format
+
+   32-bit formats are defined by OSS4 headers (e.g. on FreeBSD), but
+   not by old soundcard.h of Linux.
+
+   @param[in] sample_format libcw's sample format
+
+   @return OSS sample format
+   @return -1 if the format is not available
+*/
+static int cw_oss_sample_format_internal(cw_sample_format_t sample_format)
+{
+	switch (sample_format) {
+	case CW_SAMPLE_FORMAT_S16:
+		return CW_OSS_SAMPLE_FORMAT;
+	case CW_SAMPLE_FORMAT_S32:
+#ifdef AFMT_S32_NE
+		return AFMT_S32_NE;
+#else
+		return -1;
+#endif
+	case CW_SAMPLE_FORMAT_FLOAT:
+#ifdef AFMT_FLOAT
+		return AFMT_FLOAT;
+#else
+		return -1;
+#endif
+	default:
+		return -1;
+	}
+}
+
+
+
+
 /**
    @brief Close OSS device stored in given generator
 
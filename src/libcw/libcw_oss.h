@@ -9,6 +9,11 @@
 
 
 
+#include <stdbool.h>
+
+
+
+
 typedef struct cw_oss_version {
 	unsigned int x;
 	unsigned int y;
@@ -21,6 +26,10 @@ typedef struct cw_oss_version {
 typedef struct cw_oss_data_struct {
 	cw_oss_version_t version;
 	int sound_sink_fd;
+
+	/* sound_sink_fd has been opened with O_NONBLOCK, see
+	   cw_gen_config_t::oss_nonblocking. */
+	bool nonblocking;
 } cw_oss_data_t;
 
 
@@ -35,6 +35,7 @@
 
 
 #include "config.h"
+#include "libcw_capture.h"
 #include "libcw_debug.h"
 #include "libcw_pa.h"
 
@@ -61,6 +62,7 @@ extern cw_debug_t cw_debug_object_dev;
 #include <assert.h>
 #include <dlfcn.h> /* dlopen() and related symbols */
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,11 +86,47 @@ typedef struct cw_pa_lib_handle_t {
 	/* Returned by dlopen(). To be cleaned up with dlclose(). */
 	void * lib_handle;
 
-	pa_simple *(* pa_simple_new)(const char * server_name, const char * name, pa_stream_direction_t dir, const char * device_name, const char * stream_name, const pa_sample_spec * ss, const pa_channel_map * map, const pa_buffer_attr * attr, int * error);
-	void       (* pa_simple_free)(pa_simple * simples);
-	int        (* pa_simple_write)(pa_simple * simple, const void * data, size_t bytes, int * error);
-	pa_usec_t  (* pa_simple_get_latency)(pa_simple * simple, int * error);
-	int        (* pa_simple_drain)(pa_simple * simple, int * error);
+	pa_threaded_mainloop *(* pa_threaded_mainloop_new)(void);
+	void                  (* pa_threaded_mainloop_free)(pa_threaded_mainloop * mainloop);
+	int                   (* pa_threaded_mainloop_start)(pa_threaded_mainloop * mainloop);
+	void                  (* pa_threaded_mainloop_stop)(pa_threaded_mainloop * mainloop);
+	void                  (* pa_threaded_mainloop_lock)(pa_threaded_mainloop * mainloop);
+	void                  (* pa_threaded_mainloop_unlock)(pa_threaded_mainloop * mainloop);
+	void                  (* pa_threaded_mainloop_wait)(pa_threaded_mainloop * mainloop);
+	void                  (* pa_threaded_mainloop_signal)(pa_threaded_mainloop * mainloop, int wait_for_accept);
+	pa_mainloop_api      *(* pa_threaded_mainloop_get_api)(pa_threaded_mainloop * mainloop);
+
+	pa_context        *(* pa_context_new)(pa_mainloop_api * api, const char * name);
+	int                (* pa_context_connect)(pa_context * context, const char * server, pa_context_flags_t flags, const pa_spawn_api * api);
+	void               (* pa_context_disconnect)(pa_context * context);
+	void               (* pa_context_unref)(pa_context * context);
+	pa_context_state_t (* pa_context_get_state)(const pa_context * context);
+	void               (* pa_context_set_state_callback)(pa_context * context, pa_context_notify_cb_t cb, void * userdata);
+	int                (* pa_context_errno)(const pa_context * context);
+	pa_operation      *(* pa_context_get_sink_info_by_name)(pa_context * context, const char * name, pa_sink_info_cb_t cb, void * userdata);
+
+	pa_stream             *(* pa_stream_new)(pa_context * context, const char * name, const pa_sample_spec * spec, const pa_channel_map * map);
+	int                    (* pa_stream_connect_playback)(pa_stream * stream, const char * dev, const pa_buffer_attr * attr, pa_stream_flags_t flags, const pa_cvolume * volume, pa_stream * sync_stream);
+	int                    (* pa_stream_connect_record)(pa_stream * stream, const char * dev, const pa_buffer_attr * attr, pa_stream_flags_t flags);
+	int                    (* pa_stream_disconnect)(pa_stream * stream);
+	void                   (* pa_stream_unref)(pa_stream * stream);
+	pa_stream_state_t      (* pa_stream_get_state)(const pa_stream * stream);
+	void                   (* pa_stream_set_state_callback)(pa_stream * stream, pa_stream_notify_cb_t cb, void * userdata);
+	void                   (* pa_stream_set_write_callback)(pa_stream * stream, pa_stream_request_cb_t cb, void * userdata);
+	void                   (* pa_stream_set_underflow_callback)(pa_stream * stream, pa_stream_notify_cb_t cb, void * userdata);
+	size_t                 (* pa_stream_writable_size)(const pa_stream * stream);
+	int                    (* pa_stream_write)(pa_stream * stream, const void * data, size_t n_bytes, pa_free_cb_t free_cb, int64_t offset, pa_seek_mode_t seek);
+	void                   (* pa_stream_set_read_callback)(pa_stream * stream, pa_stream_request_cb_t cb, void * userdata);
+	size_t                 (* pa_stream_readable_size)(const pa_stream * stream);
+	int                    (* pa_stream_peek)(pa_stream * stream, const void ** data, size_t * n_bytes);
+	int                    (* pa_stream_drop)(pa_stream * stream);
+	int                    (* pa_stream_get_latency)(pa_stream * stream, pa_usec_t * usecs, int * negative);
+	const pa_buffer_attr  *(* pa_stream_get_buffer_attr)(const pa_stream * stream);
+	pa_operation          *(* pa_stream_drain)(pa_stream * stream, pa_stream_success_cb_t cb, void * userdata);
+	pa_operation          *(* pa_stream_cork)(pa_stream * stream, int b, pa_stream_success_cb_t cb, void * userdata);
+
+	pa_operation_state_t (* pa_operation_get_state)(const pa_operation * operation);
+	void                 (* pa_operation_unref)(pa_operation * operation);
 
 	size_t     (* pa_usec_to_bytes)(pa_usec_t t, const pa_sample_spec * spec);
 	char      *(* pa_strerror)(int error);
@@ -110,17 +148,38 @@ static cw_pa_lib_handle_t g_cw_pa_lib_handle;
 
 
 
-static pa_simple  * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, unsigned int * sample_rate, int * error);
+static cw_ret_t     cw_pa_load_library_internal(void);
+static cw_ret_t     cw_pa_connect_context_internal(cw_pa_data_t * pa, int * error);
+static cw_ret_t     cw_pa_connect_internal(cw_pa_data_t * pa, const char * picked_device_name, const char * stream_name, unsigned int target_latency, size_t minreq_n_samples, int n_channels, cw_sample_format_t sample_format, int * error);
+static cw_ret_t     cw_pa_connect_record_internal(cw_pa_data_t * pa, const char * picked_device_name, unsigned int sample_rate, size_t fragment_n_samples, int * error);
+static void         cw_pa_disconnect_internal(cw_pa_data_t * pa, bool drain);
+static void         cw_pa_context_state_cb(pa_context * context, void * userdata);
+static void         cw_pa_sink_info_cb(pa_context * context, const pa_sink_info * info, int eol, void * userdata);
+static void         cw_pa_stream_state_cb(pa_stream * stream, void * userdata);
+static void         cw_pa_stream_write_cb(pa_stream * stream, size_t n_bytes, void * userdata);
+static void         cw_pa_stream_read_cb(pa_stream * stream, size_t n_bytes, void * userdata);
+static void         cw_pa_stream_underflow_cb(pa_stream * stream, void * userdata);
+static void         cw_pa_stream_success_cb(pa_stream * stream, int success, void * userdata);
 static int          cw_pa_dlsym_internal(cw_pa_lib_handle_t * cw_pa);
 static cw_ret_t     cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void         cw_pa_close_sound_device_internal(cw_gen_t * gen);
 static cw_ret_t     cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t     cw_pa_cork_internal(cw_gen_t * gen, bool cork);
+static cw_ret_t     cw_pa_on_idle(cw_gen_t * gen);
+static cw_ret_t     cw_pa_on_resume(cw_gen_t * gen);
+static cw_ret_t     cw_pa_get_device_delay(cw_gen_t * gen, int64_t * delay);
+static cw_ret_t     cw_pa_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration);
+static void         cw_pa_close_capture_internal(cw_capture_t * capture);
+static int          cw_pa_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp);
 
 
 
 
 static const pa_sample_format_t CW_PA_SAMPLE_FORMAT = PA_SAMPLE_S16LE; /* Signed 16 bit, Little Endian */
+static const unsigned int CW_PA_SAMPLE_RATE = 44100; /* Used only when native sample rate of sink can't be found. */
+static const unsigned int CW_PA_SAMPLE_RATE_MIN = 8000; /* Lowest of cw_supported_sample_rates[]. */
 static const int CW_PA_BUFFER_N_SAMPLES = 256;
+static const unsigned int CW_PA_TARGET_LATENCY_DEFAULT = 10 * 1000; /* [microseconds] */
 
 
 
@@ -147,16 +206,55 @@ bool cw_is_pa_possible(const char * device_name)
 	   accessible on this machine, and this should not be logged as
 	   error. */
 
+	if (CW_SUCCESS != cw_pa_load_library_internal()) {
+		return false;
+	}
+
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	cw_gen_pick_device_name_internal(device_name, CW_AUDIO_PA,
+					 picked_device_name, sizeof (picked_device_name));
+
+	cw_pa_data_t pa = { 0 };
+	int error = 0;
+	if (CW_SUCCESS != cw_pa_connect_internal(&pa, picked_device_name, "cw_is_pa_possible()", CW_PA_TARGET_LATENCY_DEFAULT, CW_PA_BUFFER_N_SAMPLES, 1, CW_SAMPLE_FORMAT_S16, &error)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR, /* TODO: is this really an error? */
+			      MSG_PREFIX "is possible: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
+		if (g_cw_pa_lib_handle.lib_handle) { /* FIXME: this closing of global handle won't work well for multi-generator library. */
+			dlclose(g_cw_pa_lib_handle.lib_handle);
+		}
+		return false;
+	} else {
+		/* TODO: verify this comment: We do dlclose(g_cw_pa_lib_handle.lib_handle) in cw_pa_close_sound_device_internal(). */
+		cw_pa_disconnect_internal(&pa, false);
+		return true;
+	}
+}
+
+
+
+
+/**
+   @brief Open PulseAudio library and resolve its symbols
+
+   On success library handle and function symbols are stored in global
+   g_cw_pa_lib_handle variable.
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pa_load_library_internal(void)
+{
 	/*
 	  https://bugs.debian.org/cgi-bin/bugreport.cgi?bug=979113
 	  TODO: consider removing the unversioned library name in the future,
 	  after testing presence and usage of .so.0 on more platforms.
 	*/
 	const char * const library_name[] = {
-		"libpulse-simple.so.0",
-		"libpulse-simple.so",
+		"libpulse.so.0",
+		"libpulse.so",
 		NULL,
 	};
+	g_cw_pa_lib_handle.lib_handle = NULL;
 	int i = 0;
 	while (NULL != library_name[i]) {
 		if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &g_cw_pa_lib_handle.lib_handle)) {
@@ -166,38 +264,19 @@ bool cw_is_pa_possible(const char * device_name)
 	}
 	if (NULL == g_cw_pa_lib_handle.lib_handle) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: can't open PulseAudio 'libpulse-simple' library");
-		return false;
+			      MSG_PREFIX "load library: can't open PulseAudio 'libpulse' library");
+		return CW_FAILURE;
 	}
 
 	int rv = cw_pa_dlsym_internal(&g_cw_pa_lib_handle);
 	if (rv < 0) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: failed to resolve PulseAudio symbol #%d, can't correctly load PulseAudio library", rv);
+			      MSG_PREFIX "load library: failed to resolve PulseAudio symbol #%d, can't correctly load PulseAudio library", rv);
 		dlclose(g_cw_pa_lib_handle.lib_handle);
-		return false;
+		return CW_FAILURE;
 	}
 
-	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
-	cw_gen_pick_device_name_internal(device_name, CW_AUDIO_PA,
-					 picked_device_name, sizeof (picked_device_name));
-
-	unsigned int sample_rate = 0;
-	int error = 0;
-	pa_simple * simple = cw_pa_simple_new_internal(picked_device_name, "cw_is_pa_possible()", &sample_rate, &error);
-	if (NULL == simple) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR, /* TODO: is this really an error? */
-			      MSG_PREFIX "is possible: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
-		if (g_cw_pa_lib_handle.lib_handle) { /* FIXME: this closing of global handle won't work well for multi-generator library. */
-			dlclose(g_cw_pa_lib_handle.lib_handle);
-		}
-		return false;
-	} else {
-		/* TODO: verify this comment: We do dlclose(g_cw_pa_lib_handle.lib_handle) in cw_pa_close_sound_device_internal(). */
-		g_cw_pa_lib_handle.pa_simple_free(simple);
-		simple = NULL;
-		return true;
-	}
+	return CW_SUCCESS;
 }
 
 
@@ -223,6 +302,9 @@ cw_ret_t cw_pa_init_gen_internal(cw_gen_t * gen)
 	gen->open_and_configure_sound_device = cw_pa_open_and_configure_sound_device_internal;
 	gen->close_sound_device              = cw_pa_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_pa_write_buffer_to_sound_device_internal;
+	gen->on_idle                         = cw_pa_on_idle;
+	gen->on_resume                       = cw_pa_on_resume;
+	gen->get_device_delay                = cw_pa_get_device_delay;
 
 	return CW_SUCCESS;
 }
@@ -233,6 +315,14 @@ cw_ret_t cw_pa_init_gen_internal(cw_gen_t * gen)
 /**
    @brief Write generated samples to PulseAudio sound device configured and opened for generator
 
+   Samples are written to the stream as soon as server requests them
+   (as soon as there is free space in the stream's buffer). The
+   function waits for the requests, but it doesn't block the thread in
+   which PulseAudio callbacks are called.
+
+   After the samples have been written, current latency of the stream is
+   passed to generator's latency statistics.
+
    @reviewed 2020-07-20
 
    @param[in] gen generator that will write to sound device
@@ -245,82 +335,648 @@ static cw_ret_t cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_PA);
 
-	int error = 0;
-	size_t n_bytes = sizeof (gen->buffer[0]) * gen->buffer_n_samples;
-	int rv = g_cw_pa_lib_handle.pa_simple_write(gen->pa_data.simple, gen->buffer, n_bytes, &error);
-	if (rv < 0) {
+	cw_pa_data_t * pa = &gen->pa_data;
+	const uint8_t * data = (const uint8_t *) cw_gen_frames_internal(gen);
+	size_t n_bytes = gen->sample_size * (size_t) gen->buffer_write_n_samples * (size_t) gen->n_sound_channels;
+	cw_ret_t cwret = CW_SUCCESS;
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+	while (n_bytes > 0) {
+		if (!PA_STREAM_IS_GOOD(g_cw_pa_lib_handle.pa_stream_get_state(pa->stream))) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: stream is in bad state: %s",
+				      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+			cwret = CW_FAILURE;
+			break;
+		}
+
+		const size_t writable = g_cw_pa_lib_handle.pa_stream_writable_size(pa->stream);
+		if ((size_t) -1 == writable) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: pa_stream_writable_size() failed: %s",
+				      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+			cwret = CW_FAILURE;
+			break;
+		}
+		if (0 == writable) {
+			/* Wait for cw_pa_stream_write_cb() (or for change of
+			   stream's state). */
+			g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+			continue;
+		}
+
+		const size_t n = writable < n_bytes ? writable : n_bytes;
+		if (g_cw_pa_lib_handle.pa_stream_write(pa->stream, data, n, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: pa_stream_write() failed: %s",
+				      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+			cwret = CW_FAILURE;
+			break;
+		}
+		data += n;
+		n_bytes -= n;
+	}
+
+	if (CW_SUCCESS == cwret) {
+		/* Thanks to PA_STREAM_AUTO_TIMING_UPDATE and
+		   PA_STREAM_INTERPOLATE_TIMING this doesn't need a round
+		   trip to server. */
+		pa_usec_t usecs = 0;
+		int negative = 0;
+		if (0 == g_cw_pa_lib_handle.pa_stream_get_latency(pa->stream, &usecs, &negative)) {
+			pa->latency_usecs = negative ? 0 : usecs;
+		}
+	}
+	/* Callbacks are called with lock of mainloop held, so
+	   underflows are counted under the same lock. */
+	const unsigned int n_underflows = pa->n_underflows;
+	pa->n_underflows = 0;
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	if (n_underflows > 0) {
+		cw_gen_stats_add_xruns_internal(gen, n_underflows);
+		if (CW_SUCCESS == cwret) {
+			/* PulseAudio resumes the stream by itself as soon as
+			   new data is written. */
+			cw_gen_stats_add_recovery_internal(gen);
+		}
+	}
+	if (CW_SUCCESS == cwret) {
+		cw_gen_latency_set_sound_device_latency_internal(gen, (int64_t) pa->latency_usecs);
+	}
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Cork or uncork PulseAudio stream of generator
+
+   Corked stream doesn't consume samples, and server can suspend the
+   sink when no other stream uses it. The function waits for the
+   server to complete the operation.
+
+   @param[in] gen generator with connected stream
+   @param[in] cork whether to cork (true) or uncork (false) the stream
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_cork_internal(cw_gen_t * gen, bool cork)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+	cw_ret_t cwret = CW_SUCCESS;
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+	pa_operation * operation = g_cw_pa_lib_handle.pa_stream_cork(pa->stream, cork ? 1 : 0, cw_pa_stream_success_cb, pa->mainloop);
+	if (NULL != operation) {
+		while (PA_OPERATION_RUNNING == g_cw_pa_lib_handle.pa_operation_get_state(operation)) {
+			g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+		}
+		g_cw_pa_lib_handle.pa_operation_unref(operation);
+	} else {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "write: pa_simple_write() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
+			      MSG_PREFIX "cork: pa_stream_cork() failed: %s",
+			      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+		cwret = CW_FAILURE;
+	}
+	/* Underflow of stream that has run out of samples before
+	   being corked is not a problem. */
+	pa->n_underflows = 0;
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Cork PulseAudio stream when generator enters idle mode
+
+   @param[in] gen generator with connected stream
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_on_idle(cw_gen_t * gen)
+{
+	return cw_pa_cork_internal(gen, true);
+}
+
+
+
+
+/**
+   @brief Uncork PulseAudio stream corked by cw_pa_on_idle()
+
+   @param[in] gen generator with connected stream
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_on_resume(cw_gen_t * gen)
+{
+	return cw_pa_cork_internal(gen, false);
+}
+
+
+
+
+/**
+   @brief Get current latency of PulseAudio stream
+
+   @param[in] gen generator with connected stream
+   @param[out] delay latency of stream [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_get_device_delay(cw_gen_t * gen, int64_t * delay)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+	pa_usec_t usecs = 0;
+	int negative = 0;
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+	/* Timing info is interpolated (PA_STREAM_INTERPOLATE_TIMING),
+	   so this doesn't need a round trip to server. */
+	const int rv = g_cw_pa_lib_handle.pa_stream_get_latency(pa->stream, &usecs, &negative);
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	if (0 != rv) {
 		return CW_FAILURE;
-	} else {
-		//cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO, MSG_PREFIX "written %d samples with PulseAudio", gen->buffer_n_samples);
-		return CW_SUCCESS;
 	}
+	*delay = negative ? 0 : (int64_t) usecs;
+
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Wrapper for pa_simple_new()
+   @brief Start threaded mainloop and connect a context to default PulseAudio server
+
+   On success the function returns with lock of mainloop held by the
+   calling thread, so that a stream can be created in the context. On
+   failure everything that has been created is destroyed.
 
-   Wrapper for pa_simple_new() and related code. The code block contained
-   in the function is useful in two different places: when first probing
-   if PulseAudio output is available, and when opening PulseAudio output
-   for writing.
+   @param[out] pa data structure to be filled by the function
+   @param[out] error potential PulseAudio error code
 
-   On success the function returns pointer to PulseAudio sink open for
-   writing (playback). The function tries to set up buffering parameters
-   for minimal latency, but it doesn't try too hard.
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pa_connect_context_internal(cw_pa_data_t * pa, int * error)
+{
+	pa->mainloop = g_cw_pa_lib_handle.pa_threaded_mainloop_new();
+	if (NULL == pa->mainloop) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect context: can't create mainloop");
+		*error = PA_ERR_INTERNAL;
+		return CW_FAILURE;
+	}
 
-   The function *does not* set size of sound buffer in libcw's generator.
+	pa->context = g_cw_pa_lib_handle.pa_context_new(g_cw_pa_lib_handle.pa_threaded_mainloop_get_api(pa->mainloop), "libcw");
+	if (NULL == pa->context) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect context: can't create context");
+		*error = PA_ERR_INTERNAL;
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+	g_cw_pa_lib_handle.pa_context_set_state_callback(pa->context, cw_pa_context_state_cb, pa->mainloop);
+
+	if (g_cw_pa_lib_handle.pa_context_connect(pa->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+		*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+	if (g_cw_pa_lib_handle.pa_threaded_mainloop_start(pa->mainloop) < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect context: can't start mainloop");
+		*error = PA_ERR_INTERNAL;
+		g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+
+	/* Wait for context to be ready. */
+	while (true) {
+		const pa_context_state_t state = g_cw_pa_lib_handle.pa_context_get_state(pa->context);
+		if (PA_CONTEXT_READY == state) {
+			break;
+		}
+		if (!PA_CONTEXT_IS_GOOD(state)) {
+			*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+			g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+			cw_pa_disconnect_internal(pa, false);
+			return CW_FAILURE;
+		}
+		g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+	}
+
+	return CW_SUCCESS;
+}
 
-   @reviewed 2020-11-11
 
+
+
+/**
+   @brief Connect to PulseAudio server and create playback stream
+
+   The code block contained in the function is useful in two different
+   places: when first probing if PulseAudio output is available, and
+   when opening PulseAudio output for writing.
+
+   The function starts a threaded mainloop, connects a context to
+   default server, asks the server about native sample rate of the sink
+   (so that samples are generated at that rate and server doesn't have
+   to resample them), and connects a playback stream with explicit buffer
+   attributes: target length of the buffer (and so the latency) is @p
+   target_latency, and server requests data in chunks of @p
+   minreq_n_samples samples. With PA_STREAM_ADJUST_LATENCY the server
+   configures latency of the sink so that the total latency is close to
+   @p target_latency.
+
+   On failure everything that has been created is destroyed.
+
+   The function *does not* set size of sound buffer in libcw's generator.
+
+   @param[out] pa data structure to be filled by the function
    @param[in] picked_device_name name of PulseAudio device to be used. Non-NULL pointer only. Empty string for default device.
-   @param[in] stream_name descriptive name of client, passed to pa_simple_new
-   @param[out] sample_rate sample rate configured for sound sink
+   @param[in] stream_name descriptive name of stream
+   @param[in] target_latency requested latency of stream [microseconds]
+   @param[in] minreq_n_samples count of samples (frames) that server should request at once
+   @param[in] n_channels count of interleaved channels in the stream
+   @param[in] sample_format format of samples written to the stream
    @param[out] error potential PulseAudio error code
 
-   @return pointer to new PulseAudio sink on success
-   @return NULL on failure
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, unsigned int * sample_rate, int * error)
+static cw_ret_t cw_pa_connect_internal(cw_pa_data_t * pa, const char * picked_device_name, const char * stream_name, unsigned int target_latency, size_t minreq_n_samples, int n_channels, cw_sample_format_t sample_format, int * error)
 {
-	pa_sample_spec spec = { 0 };
-	spec.format = CW_PA_SAMPLE_FORMAT;
-	spec.rate = 44100; /* TODO: why this value is hardcoded? */
-	spec.channels = 1;
-
-	// http://www.mail-archive.com/pulseaudio-tickets@mail.0pointer.de/msg03295.html
-	pa_buffer_attr attr = { 0 };
-	attr.prebuf    = (uint32_t) -1;
-	attr.fragsize  = (uint32_t) -1;
-	/* TODO: notice that the values are smaller than in the URL above. */
-	attr.tlength   = g_cw_pa_lib_handle.pa_usec_to_bytes(10 * 1000, &spec);
-	attr.minreq    = g_cw_pa_lib_handle.pa_usec_to_bytes(0, &spec);
-	attr.maxlength = g_cw_pa_lib_handle.pa_usec_to_bytes(10 * 1000, &spec);
-	/* attr.prebuf = ; */ /* ? */
-	/* attr.fragsize = sizeof(uint32_t) -1; */ /* Not relevant to playback. */
+	switch (sample_format) {
+	case CW_SAMPLE_FORMAT_S32:
+		pa->spec.format = PA_SAMPLE_S32NE;
+		break;
+	case CW_SAMPLE_FORMAT_FLOAT:
+		pa->spec.format = PA_SAMPLE_FLOAT32NE;
+		break;
+	case CW_SAMPLE_FORMAT_S16:
+	default:
+		pa->spec.format = CW_PA_SAMPLE_FORMAT;
+		break;
+	}
+	pa->spec.rate = CW_PA_SAMPLE_RATE;
+	pa->spec.channels = (uint8_t) n_channels;
 
 	/* If 'picked_device_name' is empty, it means 'use default device
 	   name'. In that case we have to pass NULL pointer to PulseAudio
 	   API. */
 	const char * dev = ('\0' == picked_device_name[0]) ? NULL : picked_device_name;
 
-	pa_simple * simple = g_cw_pa_lib_handle.pa_simple_new(NULL,                  /* Server name (NULL for default). */
-							      "libcw",               /* Descriptive name of client (program name etc.). */
-							      PA_STREAM_PLAYBACK,    /* Stream direction. */
-							      dev,                   /* Device/sink name (NULL for default). */
-							      stream_name,           /* Stream name, descriptive name for this client (program name, song title, etc.). */
-							      &spec,                 /* Sample specification. */
-							      NULL,                  /* Channel map (NULL for default). */
-							      &attr,                 /* Buffering attributes (NULL for default). */
-							      error);                /* Error buffer (when routine returns NULL). */
+	if (CW_SUCCESS != cw_pa_connect_context_internal(pa, error)) {
+		return CW_FAILURE;
+	}
 
-	*sample_rate = spec.rate;
+	/* Use native sample rate of the sink. On failure of the query
+	   the default rate is used, so it's not an error. */
+	pa_operation * operation = g_cw_pa_lib_handle.pa_context_get_sink_info_by_name(pa->context, NULL != dev ? dev : "@DEFAULT_SINK@", cw_pa_sink_info_cb, pa);
+	if (NULL != operation) {
+		while (PA_OPERATION_RUNNING == g_cw_pa_lib_handle.pa_operation_get_state(operation)) {
+			g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+		}
+		g_cw_pa_lib_handle.pa_operation_unref(operation);
+	} else {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "connect: can't get info about sink, using default sample rate %u", pa->spec.rate);
+	}
 
-	return simple;
+	pa_buffer_attr attr = { 0 };
+	attr.maxlength = (uint32_t) -1;
+	attr.tlength   = (uint32_t) g_cw_pa_lib_handle.pa_usec_to_bytes(target_latency, &pa->spec);
+	attr.prebuf    = (uint32_t) -1;
+	attr.minreq    = (uint32_t) (minreq_n_samples * cw_sample_format_size_internal(sample_format) * (size_t) n_channels);
+	attr.fragsize  = (uint32_t) -1; /* Not relevant to playback. */
+
+	pa->stream = g_cw_pa_lib_handle.pa_stream_new(pa->context, stream_name, &pa->spec, NULL);
+	if (NULL == pa->stream) {
+		*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+		g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+	g_cw_pa_lib_handle.pa_stream_set_state_callback(pa->stream, cw_pa_stream_state_cb, pa->mainloop);
+	g_cw_pa_lib_handle.pa_stream_set_write_callback(pa->stream, cw_pa_stream_write_cb, pa->mainloop);
+	g_cw_pa_lib_handle.pa_stream_set_underflow_callback(pa->stream, cw_pa_stream_underflow_cb, pa);
+
+	const pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING;
+	if (g_cw_pa_lib_handle.pa_stream_connect_playback(pa->stream, dev, &attr, flags, NULL, NULL) < 0) {
+		*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+		g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+
+	/* Wait for stream to be ready. */
+	while (true) {
+		const pa_stream_state_t state = g_cw_pa_lib_handle.pa_stream_get_state(pa->stream);
+		if (PA_STREAM_READY == state) {
+			break;
+		}
+		if (!PA_STREAM_IS_GOOD(state)) {
+			*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+			g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+			cw_pa_disconnect_internal(pa, false);
+			return CW_FAILURE;
+		}
+		g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+	}
+
+	/* Server may have modified the attributes. */
+	const pa_buffer_attr * actual_attr = g_cw_pa_lib_handle.pa_stream_get_buffer_attr(pa->stream);
+	pa->ba = NULL != actual_attr ? *actual_attr : attr;
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "connect: sample rate = %u, tlength = %u bytes, minreq = %u bytes, prebuf = %u bytes",
+		      pa->spec.rate, pa->ba.tlength, pa->ba.minreq, pa->ba.prebuf);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Connect to PulseAudio server and create record stream
+
+   Counterpart of cw_pa_connect_internal() for sound capture. Mono
+   stream is recorded with @p sample_rate (server resamples sound of
+   the source if necessary). Server sends data in fragments of @p
+   fragment_n_samples samples, and with PA_STREAM_ADJUST_LATENCY it
+   configures latency of the source to be close to duration of the
+   fragment.
+
+   On failure everything that has been created is destroyed.
+
+   @param[out] pa data structure to be filled by the function
+   @param[in] picked_device_name name of PulseAudio source to be used. Non-NULL pointer only. Empty string for default source.
+   @param[in] sample_rate sample rate of stream
+   @param[in] fragment_n_samples count of samples (frames) in one fragment
+   @param[out] error potential PulseAudio error code
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pa_connect_record_internal(cw_pa_data_t * pa, const char * picked_device_name, unsigned int sample_rate, size_t fragment_n_samples, int * error)
+{
+	pa->spec.format = CW_PA_SAMPLE_FORMAT;
+	pa->spec.rate = sample_rate;
+	pa->spec.channels = 1;
+
+	/* See comment in cw_pa_connect_internal(). */
+	const char * dev = ('\0' == picked_device_name[0]) ? NULL : picked_device_name;
+
+	if (CW_SUCCESS != cw_pa_connect_context_internal(pa, error)) {
+		return CW_FAILURE;
+	}
+
+	pa_buffer_attr attr = { 0 };
+	attr.maxlength = (uint32_t) -1;
+	attr.tlength   = (uint32_t) -1; /* Not relevant to record. */
+	attr.prebuf    = (uint32_t) -1; /* Not relevant to record. */
+	attr.minreq    = (uint32_t) -1; /* Not relevant to record. */
+	attr.fragsize  = (uint32_t) (fragment_n_samples * sizeof (int16_t));
+
+	pa->stream = g_cw_pa_lib_handle.pa_stream_new(pa->context, "capture", &pa->spec, NULL);
+	if (NULL == pa->stream) {
+		*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+		g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+	g_cw_pa_lib_handle.pa_stream_set_state_callback(pa->stream, cw_pa_stream_state_cb, pa->mainloop);
+	g_cw_pa_lib_handle.pa_stream_set_read_callback(pa->stream, cw_pa_stream_read_cb, pa->mainloop);
+
+	const pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING;
+	if (g_cw_pa_lib_handle.pa_stream_connect_record(pa->stream, dev, &attr, flags) < 0) {
+		*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+		g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+		cw_pa_disconnect_internal(pa, false);
+		return CW_FAILURE;
+	}
+
+	/* Wait for stream to be ready. */
+	while (true) {
+		const pa_stream_state_t state = g_cw_pa_lib_handle.pa_stream_get_state(pa->stream);
+		if (PA_STREAM_READY == state) {
+			break;
+		}
+		if (!PA_STREAM_IS_GOOD(state)) {
+			*error = g_cw_pa_lib_handle.pa_context_errno(pa->context);
+			g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+			cw_pa_disconnect_internal(pa, false);
+			return CW_FAILURE;
+		}
+		g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+	}
+
+	const pa_buffer_attr * actual_attr = g_cw_pa_lib_handle.pa_stream_get_buffer_attr(pa->stream);
+	pa->ba = NULL != actual_attr ? *actual_attr : attr;
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "connect record: sample rate = %u, fragsize = %u bytes",
+		      pa->spec.rate, pa->ba.fragsize);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Disconnect from PulseAudio server, destroy stream, context and mainloop
+
+   Function can be called for partially created @p pa (e.g. when
+   cw_pa_connect_internal() fails). Calling thread must not hold the
+   lock of mainloop.
+
+   @param[in,out] pa data structure with stream to close
+   @param[in] drain whether to wait until all samples written to the stream are played
+*/
+static void cw_pa_disconnect_internal(cw_pa_data_t * pa, bool drain)
+{
+	if (NULL == pa->mainloop) {
+		return;
+	}
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+
+	if (NULL != pa->stream) {
+		if (drain && PA_STREAM_READY == g_cw_pa_lib_handle.pa_stream_get_state(pa->stream)) {
+			/* Make sure that every single sample was played. */
+			pa_operation * operation = g_cw_pa_lib_handle.pa_stream_drain(pa->stream, cw_pa_stream_success_cb, pa->mainloop);
+			if (NULL != operation) {
+				while (PA_OPERATION_RUNNING == g_cw_pa_lib_handle.pa_operation_get_state(operation)) {
+					g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+				}
+				g_cw_pa_lib_handle.pa_operation_unref(operation);
+			} else {
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "disconnect: pa_stream_drain() failed: %s",
+					      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+			}
+		}
+		g_cw_pa_lib_handle.pa_stream_disconnect(pa->stream);
+		g_cw_pa_lib_handle.pa_stream_unref(pa->stream);
+		pa->stream = NULL;
+	}
+
+	if (NULL != pa->context) {
+		g_cw_pa_lib_handle.pa_context_disconnect(pa->context);
+		g_cw_pa_lib_handle.pa_context_unref(pa->context);
+		pa->context = NULL;
+	}
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_stop(pa->mainloop);
+	g_cw_pa_lib_handle.pa_threaded_mainloop_free(pa->mainloop);
+	pa->mainloop = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio on change of state of context
+
+   @param context PulseAudio context
+   @param[in] userdata threaded mainloop
+*/
+static void cw_pa_context_state_cb(__attribute__((unused)) pa_context * context, void * userdata)
+{
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio with information about sink
+
+   Native sample rate of the sink is copied to sample specification
+   of @p userdata. Rates lower than lowest rate supported by libcw are
+   ignored.
+
+   @param context PulseAudio context
+   @param[in] info information about sink, NULL at the end of list
+   @param eol positive at the end of list, negative on error
+   @param[in,out] userdata PulseAudio data of generator
+*/
+static void cw_pa_sink_info_cb(__attribute__((unused)) pa_context * context, const pa_sink_info * info, int eol, void * userdata)
+{
+	cw_pa_data_t * pa = (cw_pa_data_t *) userdata;
+	if (0 == eol && NULL != info) {
+		if (info->sample_spec.rate >= CW_PA_SAMPLE_RATE_MIN) {
+			pa->spec.rate = info->sample_spec.rate;
+		}
+		return;
+	}
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal(pa->mainloop, 0);
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio on change of state of stream
+
+   @param stream PulseAudio stream
+   @param[in] userdata threaded mainloop
+*/
+static void cw_pa_stream_state_cb(__attribute__((unused)) pa_stream * stream, void * userdata)
+{
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio when stream is ready to accept more data
+
+   Wake up generator's thread waiting in
+   cw_pa_write_buffer_to_sound_device_internal().
+
+   @param stream PulseAudio stream
+   @param n_bytes count of bytes that can be written
+   @param[in] userdata threaded mainloop
+*/
+static void cw_pa_stream_write_cb(__attribute__((unused)) pa_stream * stream, __attribute__((unused)) size_t n_bytes, void * userdata)
+{
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio when record stream has new data
+
+   Wake up capture's thread waiting in cw_pa_read_capture_internal().
+
+   @param stream PulseAudio stream
+   @param n_bytes count of bytes that can be read
+   @param[in] userdata threaded mainloop
+*/
+static void cw_pa_stream_read_cb(__attribute__((unused)) pa_stream * stream, __attribute__((unused)) size_t n_bytes, void * userdata)
+{
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio when stream has run out of data
+
+   The underflow is added to generator's counters by generator's
+   thread, on next write to the stream.
+
+   @param stream PulseAudio stream
+   @param[in] userdata PulseAudio data of generator
+*/
+static void cw_pa_stream_underflow_cb(__attribute__((unused)) pa_stream * stream, void * userdata)
+{
+	cw_pa_data_t * pa = (cw_pa_data_t *) userdata;
+	pa->n_underflows++;
+}
+
+
+
+
+/**
+   @brief Callback called by PulseAudio when stream operation (drain, cork) is completed
+
+   @param stream PulseAudio stream
+   @param success whether the operation succeeded
+   @param[in] userdata threaded mainloop
+*/
+static void cw_pa_stream_success_cb(__attribute__((unused)) pa_stream * stream, __attribute__((unused)) int success, void * userdata)
+{
+	g_cw_pa_lib_handle.pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
 }
 
 
@@ -345,20 +1001,90 @@ static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, co
 */
 static int cw_pa_dlsym_internal(cw_pa_lib_handle_t * cw_pa)
 {
-	*(void **) &(cw_pa->pa_simple_new)         = dlsym(cw_pa->lib_handle, "pa_simple_new");
-	if (!cw_pa->pa_simple_new)         return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_free)        = dlsym(cw_pa->lib_handle, "pa_simple_free");
-	if (!cw_pa->pa_simple_free)        return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_write)       = dlsym(cw_pa->lib_handle, "pa_simple_write");
-	if (!cw_pa->pa_simple_write)       return -(__LINE__);
-	*(void **) &(cw_pa->pa_strerror)           = dlsym(cw_pa->lib_handle, "pa_strerror");
-	if (!cw_pa->pa_strerror)           return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_get_latency) = dlsym(cw_pa->lib_handle, "pa_simple_get_latency");
-	if (!cw_pa->pa_simple_get_latency) return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_drain)       = dlsym(cw_pa->lib_handle, "pa_simple_drain");
-	if (!cw_pa->pa_simple_drain)       return -(__LINE__);
-	*(void **) &(cw_pa->pa_usec_to_bytes)      = dlsym(cw_pa->lib_handle, "pa_usec_to_bytes");
-	if (!cw_pa->pa_usec_to_bytes)      return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_new)     = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_new");
+	if (!cw_pa->pa_threaded_mainloop_new)             return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_free)    = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_free");
+	if (!cw_pa->pa_threaded_mainloop_free)            return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_start)   = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_start");
+	if (!cw_pa->pa_threaded_mainloop_start)           return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_stop)    = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_stop");
+	if (!cw_pa->pa_threaded_mainloop_stop)            return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_lock)    = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_lock");
+	if (!cw_pa->pa_threaded_mainloop_lock)            return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_unlock)  = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_unlock");
+	if (!cw_pa->pa_threaded_mainloop_unlock)          return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_wait)    = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_wait");
+	if (!cw_pa->pa_threaded_mainloop_wait)            return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_signal)  = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_signal");
+	if (!cw_pa->pa_threaded_mainloop_signal)          return -(__LINE__);
+	*(void **) &(cw_pa->pa_threaded_mainloop_get_api) = dlsym(cw_pa->lib_handle, "pa_threaded_mainloop_get_api");
+	if (!cw_pa->pa_threaded_mainloop_get_api)         return -(__LINE__);
+
+	*(void **) &(cw_pa->pa_context_new)                = dlsym(cw_pa->lib_handle, "pa_context_new");
+	if (!cw_pa->pa_context_new)                        return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_connect)            = dlsym(cw_pa->lib_handle, "pa_context_connect");
+	if (!cw_pa->pa_context_connect)                    return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_disconnect)         = dlsym(cw_pa->lib_handle, "pa_context_disconnect");
+	if (!cw_pa->pa_context_disconnect)                 return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_unref)              = dlsym(cw_pa->lib_handle, "pa_context_unref");
+	if (!cw_pa->pa_context_unref)                      return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_get_state)          = dlsym(cw_pa->lib_handle, "pa_context_get_state");
+	if (!cw_pa->pa_context_get_state)                  return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_set_state_callback) = dlsym(cw_pa->lib_handle, "pa_context_set_state_callback");
+	if (!cw_pa->pa_context_set_state_callback)         return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_errno)              = dlsym(cw_pa->lib_handle, "pa_context_errno");
+	if (!cw_pa->pa_context_errno)                      return -(__LINE__);
+	*(void **) &(cw_pa->pa_context_get_sink_info_by_name) = dlsym(cw_pa->lib_handle, "pa_context_get_sink_info_by_name");
+	if (!cw_pa->pa_context_get_sink_info_by_name)      return -(__LINE__);
+
+	*(void **) &(cw_pa->pa_stream_new)                = dlsym(cw_pa->lib_handle, "pa_stream_new");
+	if (!cw_pa->pa_stream_new)                        return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_connect_playback)   = dlsym(cw_pa->lib_handle, "pa_stream_connect_playback");
+	if (!cw_pa->pa_stream_connect_playback)           return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_connect_record)     = dlsym(cw_pa->lib_handle, "pa_stream_connect_record");
+	if (!cw_pa->pa_stream_connect_record)             return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_disconnect)         = dlsym(cw_pa->lib_handle, "pa_stream_disconnect");
+	if (!cw_pa->pa_stream_disconnect)                 return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_unref)              = dlsym(cw_pa->lib_handle, "pa_stream_unref");
+	if (!cw_pa->pa_stream_unref)                      return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_get_state)          = dlsym(cw_pa->lib_handle, "pa_stream_get_state");
+	if (!cw_pa->pa_stream_get_state)                  return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_set_state_callback) = dlsym(cw_pa->lib_handle, "pa_stream_set_state_callback");
+	if (!cw_pa->pa_stream_set_state_callback)         return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_set_write_callback) = dlsym(cw_pa->lib_handle, "pa_stream_set_write_callback");
+	if (!cw_pa->pa_stream_set_write_callback)         return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_set_underflow_callback) = dlsym(cw_pa->lib_handle, "pa_stream_set_underflow_callback");
+	if (!cw_pa->pa_stream_set_underflow_callback)     return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_writable_size)      = dlsym(cw_pa->lib_handle, "pa_stream_writable_size");
+	if (!cw_pa->pa_stream_writable_size)              return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_write)              = dlsym(cw_pa->lib_handle, "pa_stream_write");
+	if (!cw_pa->pa_stream_write)                      return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_set_read_callback)  = dlsym(cw_pa->lib_handle, "pa_stream_set_read_callback");
+	if (!cw_pa->pa_stream_set_read_callback)          return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_readable_size)      = dlsym(cw_pa->lib_handle, "pa_stream_readable_size");
+	if (!cw_pa->pa_stream_readable_size)              return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_peek)               = dlsym(cw_pa->lib_handle, "pa_stream_peek");
+	if (!cw_pa->pa_stream_peek)                       return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_drop)               = dlsym(cw_pa->lib_handle, "pa_stream_drop");
+	if (!cw_pa->pa_stream_drop)                       return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_get_latency)        = dlsym(cw_pa->lib_handle, "pa_stream_get_latency");
+	if (!cw_pa->pa_stream_get_latency)                return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_get_buffer_attr)    = dlsym(cw_pa->lib_handle, "pa_stream_get_buffer_attr");
+	if (!cw_pa->pa_stream_get_buffer_attr)            return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_drain)              = dlsym(cw_pa->lib_handle, "pa_stream_drain");
+	if (!cw_pa->pa_stream_drain)                      return -(__LINE__);
+	*(void **) &(cw_pa->pa_stream_cork)               = dlsym(cw_pa->lib_handle, "pa_stream_cork");
+	if (!cw_pa->pa_stream_cork)                       return -(__LINE__);
+
+	*(void **) &(cw_pa->pa_operation_get_state)       = dlsym(cw_pa->lib_handle, "pa_operation_get_state");
+	if (!cw_pa->pa_operation_get_state)               return -(__LINE__);
+	*(void **) &(cw_pa->pa_operation_unref)           = dlsym(cw_pa->lib_handle, "pa_operation_unref");
+	if (!cw_pa->pa_operation_unref)                   return -(__LINE__);
+
+	*(void **) &(cw_pa->pa_strerror)                  = dlsym(cw_pa->lib_handle, "pa_strerror");
+	if (!cw_pa->pa_strerror)                          return -(__LINE__);
+	*(void **) &(cw_pa->pa_usec_to_bytes)             = dlsym(cw_pa->lib_handle, "pa_usec_to_bytes");
+	if (!cw_pa->pa_usec_to_bytes)                     return -(__LINE__);
 
 	return 0;
 }
@@ -387,32 +1113,48 @@ static cw_ret_t cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, c
 	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
 					 gen->picked_device_name, sizeof (gen->picked_device_name));
 
-	unsigned int sample_rate = 0;
-	int error = 0;
-	gen->pa_data.simple = cw_pa_simple_new_internal(gen->picked_device_name,
-							gen->library_client.name ? gen->library_client.name : "app",
-							&sample_rate,
-							&error);
+	const unsigned int target_latency = 0 != gen_conf->pa_target_latency ? gen_conf->pa_target_latency : CW_PA_TARGET_LATENCY_DEFAULT;
+
+	/* Generator's buffer must be small enough to fit (twice) into
+	   stream's buffer, otherwise we won't be able to keep the
+	   latency low. */
+	int buffer_n_samples = (int) ((uint64_t) CW_PA_SAMPLE_RATE * target_latency / 1000000 / 2);
+	if (buffer_n_samples > CW_PA_BUFFER_N_SAMPLES) {
+		buffer_n_samples = CW_PA_BUFFER_N_SAMPLES;
+	} else if (buffer_n_samples < 1) {
+		buffer_n_samples = 1;
+	}
 
- 	if (NULL == gen->pa_data.simple) {
+	int error = 0;
+	if (CW_SUCCESS != cw_pa_connect_internal(&gen->pa_data,
+						 gen->picked_device_name,
+						 gen->library_client.name ? gen->library_client.name : "app",
+						 target_latency,
+						 (size_t) buffer_n_samples,
+						 gen->n_sound_channels,
+						 gen->sample_format,
+						 &error)) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open device: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
-		return false;
+		return CW_FAILURE;
 	}
 
-	gen->buffer_n_samples = CW_PA_BUFFER_N_SAMPLES;
-	gen->sample_rate = sample_rate;
-	gen->pa_data.latency_usecs = g_cw_pa_lib_handle.pa_simple_get_latency(gen->pa_data.simple, &error);
-
-	if ((pa_usec_t) -1 == gen->pa_data.latency_usecs) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open device: pa_simple_get_latency() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
+	/* Size of buffer was calculated for default sample rate. Native
+	   rate of the sink may be lower. */
+	const int native_buffer_n_samples = (int) ((uint64_t) gen->pa_data.spec.rate * target_latency / 1000000 / 2);
+	if (native_buffer_n_samples < buffer_n_samples) {
+		buffer_n_samples = native_buffer_n_samples < 1 ? 1 : native_buffer_n_samples;
 	}
 
+	gen->buffer_n_samples = buffer_n_samples;
+	gen->sample_rate = gen->pa_data.spec.rate;
+	gen->pa_data.latency_usecs = 0;
+	gen->pa_data.n_underflows = 0;
+
 #if CW_DEV_RAW_SINK
 	gen->dev_raw_sink = open("/tmp/cw_file.pa.raw", O_WRONLY | O_TRUNC | O_NONBLOCK);
 #endif
-	assert (gen && gen->pa_data.simple);
+	assert (gen && gen->pa_data.stream);
 
 	gen->sound_device_is_open = true;
 
@@ -431,15 +1173,8 @@ static cw_ret_t cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, c
 */
 static void cw_pa_close_sound_device_internal(cw_gen_t * gen)
 {
-	if (gen->pa_data.simple) {
-		/* Make sure that every single sample was played */
-		int error = 0;
-		if (g_cw_pa_lib_handle.pa_simple_drain(gen->pa_data.simple, &error) < 0) {
-			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-				      MSG_PREFIX "close device: pa_simple_drain() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
-		}
-		g_cw_pa_lib_handle.pa_simple_free(gen->pa_data.simple);
-		gen->pa_data.simple = NULL;
+	if (gen->pa_data.mainloop) {
+		cw_pa_disconnect_internal(&gen->pa_data, true);
 	} else {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "close device: called the function for NULL PA sink");
@@ -463,6 +1198,183 @@ static void cw_pa_close_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Configure given @p capture variable to capture sound from PulseAudio source
+
+   @param[in,out] capture capture structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_pa_init_capture_internal(cw_capture_t * capture)
+{
+	capture->sound_system = CW_AUDIO_PA;
+	capture->open_device  = cw_pa_open_capture_internal;
+	capture->close_device = cw_pa_close_capture_internal;
+	capture->read_device  = cw_pa_read_capture_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Connect record stream of capture
+
+   @param[in,out] capture capture with picked device name
+   @param[in] sample_rate sample rate of stream
+   @param[in] period_duration requested duration of fragment of stream [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pa_open_capture_internal(cw_capture_t * capture, int sample_rate, int period_duration)
+{
+	if (CW_SUCCESS != cw_pa_load_library_internal()) {
+		return CW_FAILURE;
+	}
+
+	size_t fragment_n_samples = (size_t) ((uint64_t) sample_rate * (uint64_t) period_duration / CW_USECS_PER_SEC);
+	if (0 == fragment_n_samples) {
+		fragment_n_samples = 1;
+	}
+
+	int error = 0;
+	if (CW_SUCCESS != cw_pa_connect_record_internal(&capture->pa_data, capture->picked_device_name,
+							(unsigned int) sample_rate, fragment_n_samples, &error)) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open capture: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
+		dlclose(g_cw_pa_lib_handle.lib_handle);
+		return CW_FAILURE;
+	}
+
+	capture->sample_rate = (int) capture->pa_data.spec.rate;
+	capture->period_n_samples = (int) fragment_n_samples;
+	capture->pa_fragment = NULL;
+	capture->pa_fragment_n_bytes = 0;
+	capture->pa_fragment_offset = 0;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Disconnect record stream of capture
+
+   @param[in,out] capture capture with connected stream
+*/
+static void cw_pa_close_capture_internal(cw_capture_t * capture)
+{
+	if (capture->pa_data.mainloop) {
+		/* Fragment is released together with stream. */
+		cw_pa_disconnect_internal(&capture->pa_data, false);
+		capture->pa_fragment = NULL;
+	}
+
+	/* Release reference taken by cw_pa_load_library_internal(). */
+	dlclose(g_cw_pa_lib_handle.lib_handle);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Read captured samples from record stream
+
+   Data of record stream comes in fragments, and a fragment can't be
+   dropped partially, so function keeps current fragment between
+   calls. Holes in stream (fragments without data) are skipped.
+
+   Latency reported for record stream is a time between capture of
+   oldest sample not yet read by client (first sample of current
+   fragment) and now. Timestamps are calculated from the latency and
+   from position in the fragment.
+
+   @param[in,out] capture capture with connected stream
+   @param[out] samples buffer for samples
+   @param[in] n_samples size of @p samples
+   @param[out] timestamp timestamp of first read sample [ns]
+
+   @return count of read samples
+   @return -1 on error
+*/
+static int cw_pa_read_capture_internal(cw_capture_t * capture, int16_t * samples, int n_samples, int64_t * timestamp)
+{
+	cw_pa_data_t * pa = &capture->pa_data;
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_lock(pa->mainloop);
+
+	while (NULL == capture->pa_fragment) {
+		if (PA_STREAM_READY != g_cw_pa_lib_handle.pa_stream_get_state(pa->stream)) {
+			g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+			return -1;
+		}
+		if (0 == g_cw_pa_lib_handle.pa_stream_readable_size(pa->stream)) {
+			/* Woken up by cw_pa_stream_read_cb(). */
+			g_cw_pa_lib_handle.pa_threaded_mainloop_wait(pa->mainloop);
+			continue;
+		}
+
+		const void * data = NULL;
+		size_t n_bytes = 0;
+		if (g_cw_pa_lib_handle.pa_stream_peek(pa->stream, &data, &n_bytes) < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "read capture: pa_stream_peek() failed: %s",
+				      g_cw_pa_lib_handle.pa_strerror(g_cw_pa_lib_handle.pa_context_errno(pa->context)));
+			g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+			return -1;
+		}
+		if (NULL == data) {
+			if (n_bytes > 0) {
+				/* Hole in stream. */
+				g_cw_pa_lib_handle.pa_stream_drop(pa->stream);
+			}
+			continue;
+		}
+		capture->pa_fragment = (const uint8_t *) data;
+		capture->pa_fragment_n_bytes = n_bytes;
+		capture->pa_fragment_offset = 0;
+	}
+
+	pa_usec_t latency = 0;
+	int negative = 0;
+	if (0 != g_cw_pa_lib_handle.pa_stream_get_latency(pa->stream, &latency, &negative) || negative) {
+		latency = 0;
+	}
+	const int64_t now = cw_clock_now_internal();
+
+	size_t n_bytes = capture->pa_fragment_n_bytes - capture->pa_fragment_offset;
+	if (n_bytes > (size_t) n_samples * sizeof (int16_t)) {
+		n_bytes = (size_t) n_samples * sizeof (int16_t);
+	}
+	/* PA_SAMPLE_S16LE: samples of fragment are little-endian. */
+	const uint8_t * bytes = capture->pa_fragment + capture->pa_fragment_offset;
+	const int n_read = (int) (n_bytes / sizeof (int16_t));
+	for (int i = 0; i < n_read; i++) {
+		samples[i] = (int16_t) (bytes[2 * i] | (bytes[2 * i + 1] << 8));
+	}
+
+	const int64_t offset_n_samples = (int64_t) (capture->pa_fragment_offset / sizeof (int16_t));
+	*timestamp = now - (int64_t) latency * 1000 + (offset_n_samples * CW_NSECS_PER_SEC) / capture->sample_rate;
+
+	capture->pa_fragment_offset += n_bytes;
+	if (capture->pa_fragment_offset + sizeof (int16_t) > capture->pa_fragment_n_bytes) {
+		g_cw_pa_lib_handle.pa_stream_drop(pa->stream);
+		capture->pa_fragment = NULL;
+	}
+
+	g_cw_pa_lib_handle.pa_threaded_mainloop_unlock(pa->mainloop);
+
+	return n_read;
+}
+
+
+
+
 #else /* #ifdef LIBCW_WITH_PULSEAUDIO */
 
 
@@ -488,4 +1400,14 @@ cw_ret_t cw_pa_init_gen_internal(__attribute__((unused)) cw_gen_t * gen)
 
 
 
+cw_ret_t cw_pa_init_capture_internal(__attribute__((unused)) cw_capture_t * capture)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return CW_FAILURE;
+}
+
+
+
+
 #endif /* #ifdef LIBCW_WITH_PULSEAUDIO */
@@ -16,13 +16,16 @@
 
 #ifdef LIBCW_WITH_PULSEAUDIO
 
-#include <pulse/error.h>
-#include <pulse/simple.h>
+#include <pulse/pulseaudio.h>
 
 typedef struct cw_pa_data_struct {
-	pa_simple * simple;    /* Audio handle. */
-	pa_sample_spec spec;   /* Sample specification. */
-	pa_usec_t latency_usecs;
+	pa_threaded_mainloop * mainloop; /* Thread in which callbacks of context and stream are called. */
+	pa_context * context;            /* Connection to PulseAudio server. */
+	pa_stream * stream;              /* Playback stream. */
+	pa_sample_spec spec;             /* Sample specification. */
+	pa_buffer_attr ba;               /* Buffer attributes, as configured by server. */
+	pa_usec_t latency_usecs;         /* Latency of stream, as last reported by server. */
+	unsigned int n_underflows;       /* Underflows of stream not yet added to generator's counters. */
 } cw_pa_data_t;
 
 #endif /* #ifdef LIBCW_WITH_PULSEAUDIO */
@@ -0,0 +1,497 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+
+
+
+/**
+   @file libcw_pool.c
+
+   @brief Pool of generators, receivers and keys ready for reuse.
+
+   Creating a generator allocates its tone queue and buffers, acquires
+   table of slope, opens sound device, and starting the generator
+   creates its thread. Deleting the generator undoes all of that. A
+   server in which users connect and disconnect all the time spends
+   most of the time of a new session in these steps.
+
+   Pool keeps objects that have been returned by client code, and
+   hands them out again after they have been reset with
+   cw_gen_reset(), cw_rec_reset() or cw_key_reset(). Memory, sound
+   device, and (if pool is configured so) thread of a pooled generator
+   are kept, so getting an object from a non-empty pool costs only
+   the reset.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_pool.h"
+
+
+
+
+#define MSG_PREFIX "libcw/pool: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static bool cw_pool_gen_is_started_internal(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Create new pool
+
+   Generators created by the pool are created with copy of @p gen_conf.
+   When @p start_gens is true, the generators are handed out started,
+   and they are kept started while they wait in the pool: their
+   threads don't have to be created again.
+
+   Pool keeps at most @p capacity generators, @p capacity receivers and
+   @p capacity keys. Objects returned to full pool are deleted.
+
+   @exception EINVAL @p gen_conf is NULL or @p capacity is out of range
+
+   @param[in] gen_conf configuration of generators
+   @param[in] capacity count of objects of each type kept in pool
+   @param[in] start_gens keep generators started
+
+   @return new pool on success
+   @return NULL on failure
+*/
+cw_pool_t * cw_pool_new(const cw_gen_config_t * gen_conf, int capacity, bool start_gens)
+{
+	if (NULL == gen_conf) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: configuration of generator is NULL");
+		errno = EINVAL;
+		return (cw_pool_t *) NULL;
+	}
+	if (capacity < 1 || capacity > CW_POOL_CAPACITY_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid capacity %d", capacity);
+		errno = EINVAL;
+		return (cw_pool_t *) NULL;
+	}
+
+	cw_pool_t * pool = (cw_pool_t *) calloc(1, sizeof (cw_pool_t));
+	if (NULL == pool) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_pool_t *) NULL;
+	}
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->gen_conf = *gen_conf;
+	pool->start_gens = start_gens;
+	pool->capacity = capacity;
+
+	pool->gens = (cw_gen_t **) calloc((size_t) capacity, sizeof (cw_gen_t *));
+	pool->recs = (cw_rec_t **) calloc((size_t) capacity, sizeof (cw_rec_t *));
+	pool->keys = (cw_key_t **) calloc((size_t) capacity, sizeof (cw_key_t *));
+	if (NULL == pool->gens || NULL == pool->recs || NULL == pool->keys) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_pool_delete(&pool);
+		return (cw_pool_t *) NULL;
+	}
+
+	return pool;
+}
+
+
+
+
+/**
+   @brief Delete pool
+
+   Objects kept in the pool are deleted (generators are stopped
+   first). Objects handed out by the pool and not returned to it are
+   owned by client code, which should delete them with cw_gen_delete(),
+   cw_rec_delete() or cw_key_delete(). Pointer to @p pool is set to
+   NULL.
+
+   @param[in] pool pointer to pool to delete
+*/
+void cw_pool_delete(cw_pool_t ** pool)
+{
+	if (NULL == pool || NULL == *pool) {
+		return;
+	}
+
+	if ((*pool)->gens) {
+		for (int i = 0; i < (*pool)->n_gens; i++) {
+			if (cw_pool_gen_is_started_internal((*pool)->gens[i])) {
+				cw_gen_stop((*pool)->gens[i]);
+			}
+			cw_gen_delete(&(*pool)->gens[i]);
+		}
+		free((*pool)->gens);
+	}
+	if ((*pool)->recs) {
+		for (int i = 0; i < (*pool)->n_recs; i++) {
+			cw_rec_delete(&(*pool)->recs[i]);
+		}
+		free((*pool)->recs);
+	}
+	if ((*pool)->keys) {
+		for (int i = 0; i < (*pool)->n_keys; i++) {
+			cw_key_delete(&(*pool)->keys[i]);
+		}
+		free((*pool)->keys);
+	}
+
+	pthread_mutex_destroy(&(*pool)->mutex);
+
+	free(*pool);
+	*pool = (cw_pool_t *) NULL;
+}
+
+
+
+
+/**
+   @brief Get generator from pool
+
+   Generator that has been returned to the pool is reused. If there is
+   none, a new generator is created with pool's configuration (and
+   started if pool keeps generators started).
+
+   @exception EINVAL @p pool is NULL
+
+   @param[in] pool pool to get generator from
+
+   @return generator on success
+   @return NULL on failure
+*/
+cw_gen_t * cw_pool_get_gen(cw_pool_t * pool)
+{
+	if (NULL == pool) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "get gen: pool is NULL");
+		errno = EINVAL;
+		return (cw_gen_t *) NULL;
+	}
+
+	cw_gen_t * gen = (cw_gen_t *) NULL;
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n_gens > 0) {
+		pool->n_gens--;
+		gen = pool->gens[pool->n_gens];
+		pool->gens[pool->n_gens] = (cw_gen_t *) NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (NULL != gen) {
+		return gen;
+	}
+
+	/* Creating and starting a generator is slow, don't hold the
+	   mutex while doing it. */
+	gen = cw_gen_new(&pool->gen_conf);
+	if (NULL == gen) {
+		return (cw_gen_t *) NULL;
+	}
+	if (pool->start_gens && CW_SUCCESS != cw_gen_start(gen)) {
+		cw_gen_delete(&gen);
+		return (cw_gen_t *) NULL;
+	}
+
+	return gen;
+}
+
+
+
+
+/**
+   @brief Return generator to pool
+
+   Generator is reset with cw_gen_reset(), and is stopped or started
+   according to configuration of the pool. If the pool is full, or if
+   the generator can't be prepared for reuse, the generator is
+   deleted. In any case pointer to @p gen is set to NULL: client code
+   must not use the generator after returning it.
+
+   The generator doesn't have to come from this pool, but it should
+   have been created with the same configuration.
+
+   @exception EINVAL @p pool or @p gen is NULL
+
+   @param[in] pool pool to return generator to
+   @param[in] gen pointer to generator to return
+
+   @return CW_SUCCESS if generator has been kept in pool or deleted
+   @return CW_FAILURE on errors in arguments
+*/
+cw_ret_t cw_pool_put_gen(cw_pool_t * pool, cw_gen_t ** gen)
+{
+	if (NULL == pool || NULL == gen || NULL == *gen) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "put gen: NULL argument");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	bool reusable = true;
+	if (cw_pool_gen_is_started_internal(*gen)) {
+		if (!pool->start_gens) {
+			reusable = CW_SUCCESS == cw_gen_stop(*gen);
+		}
+	} else {
+		if (pool->start_gens) {
+			reusable = CW_SUCCESS == cw_gen_start(*gen);
+		}
+	}
+	if (reusable) {
+		reusable = CW_SUCCESS == cw_gen_reset(*gen);
+	}
+
+	if (reusable) {
+		pthread_mutex_lock(&pool->mutex);
+		if (pool->n_gens < pool->capacity) {
+			pool->gens[pool->n_gens] = *gen;
+			pool->n_gens++;
+			*gen = (cw_gen_t *) NULL;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	if (NULL != *gen) {
+		if (cw_pool_gen_is_started_internal(*gen)) {
+			cw_gen_stop(*gen);
+		}
+		cw_gen_delete(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get receiver from pool
+
+   Receiver that has been returned to the pool is reused. If there is
+   none, a new receiver is created.
+
+   @exception EINVAL @p pool is NULL
+
+   @param[in] pool pool to get receiver from
+
+   @return receiver on success
+   @return NULL on failure
+*/
+cw_rec_t * cw_pool_get_rec(cw_pool_t * pool)
+{
+	if (NULL == pool) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "get rec: pool is NULL");
+		errno = EINVAL;
+		return (cw_rec_t *) NULL;
+	}
+
+	cw_rec_t * rec = (cw_rec_t *) NULL;
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n_recs > 0) {
+		pool->n_recs--;
+		rec = pool->recs[pool->n_recs];
+		pool->recs[pool->n_recs] = (cw_rec_t *) NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (NULL == rec) {
+		rec = cw_rec_new();
+	}
+	return rec;
+}
+
+
+
+
+/**
+   @brief Return receiver to pool
+
+   Receiver is reset with cw_rec_reset(). If the pool is full, the
+   receiver is deleted. In any case pointer to @p rec is set to NULL.
+
+   @exception EINVAL @p pool or @p rec is NULL
+
+   @param[in] pool pool to return receiver to
+   @param[in] rec pointer to receiver to return
+
+   @return CW_SUCCESS if receiver has been kept in pool or deleted
+   @return CW_FAILURE on errors in arguments
+*/
+cw_ret_t cw_pool_put_rec(cw_pool_t * pool, cw_rec_t ** rec)
+{
+	if (NULL == pool || NULL == rec || NULL == *rec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "put rec: NULL argument");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_reset(*rec);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n_recs < pool->capacity) {
+		pool->recs[pool->n_recs] = *rec;
+		pool->n_recs++;
+		*rec = (cw_rec_t *) NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	cw_rec_delete(rec);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get key from pool
+
+   Key that has been returned to the pool is reused. If there is none,
+   a new key is created.
+
+   @exception EINVAL @p pool is NULL
+
+   @param[in] pool pool to get key from
+
+   @return key on success
+   @return NULL on failure
+*/
+cw_key_t * cw_pool_get_key(cw_pool_t * pool)
+{
+	if (NULL == pool) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "get key: pool is NULL");
+		errno = EINVAL;
+		return (cw_key_t *) NULL;
+	}
+
+	cw_key_t * key = (cw_key_t *) NULL;
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n_keys > 0) {
+		pool->n_keys--;
+		key = pool->keys[pool->n_keys];
+		pool->keys[pool->n_keys] = (cw_key_t *) NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (NULL == key) {
+		key = cw_key_new();
+	}
+	return key;
+}
+
+
+
+
+/**
+   @brief Return key to pool
+
+   Key is reset with cw_key_reset(). If the pool is full, the key is
+   deleted. In any case pointer to @p key is set to NULL.
+
+   @exception EINVAL @p pool or @p key is NULL
+
+   @param[in] pool pool to return key to
+   @param[in] key pointer to key to return
+
+   @return CW_SUCCESS if key has been kept in pool or deleted
+   @return CW_FAILURE on errors in arguments
+*/
+cw_ret_t cw_pool_put_key(cw_pool_t * pool, cw_key_t ** key)
+{
+	if (NULL == pool || NULL == key || NULL == *key) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "put key: NULL argument");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_key_reset(*key);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->n_keys < pool->capacity) {
+		pool->keys[pool->n_keys] = *key;
+		pool->n_keys++;
+		*key = (cw_key_t *) NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	cw_key_delete(key);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get count of objects waiting in pool for reuse
+
+   @param[in] pool pool to inspect
+   @param[out] n_gens count of generators (may be NULL)
+   @param[out] n_recs count of receivers (may be NULL)
+   @param[out] n_keys count of keys (may be NULL)
+*/
+void cw_pool_get_counts(cw_pool_t * pool, int * n_gens, int * n_recs, int * n_keys)
+{
+	if (NULL == pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	if (n_gens) {
+		*n_gens = pool->n_gens;
+	}
+	if (n_recs) {
+		*n_recs = pool->n_recs;
+	}
+	if (n_keys) {
+		*n_keys = pool->n_keys;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+
+
+
+/**
+   @brief Check if generator has been started and not stopped yet
+
+   @param[in] gen generator to check
+
+   @return true if generator is started
+   @return false otherwise
+*/
+static bool cw_pool_gen_is_started_internal(const cw_gen_t * gen)
+{
+	return gen->do_dequeue_and_generate;
+}
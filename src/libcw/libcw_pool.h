@@ -0,0 +1,50 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_POOL
+#define H_LIBCW_POOL
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+struct cw_pool_struct {
+	/* Protects all fields below. */
+	pthread_mutex_t mutex;
+
+	/* Configuration of generators created by the pool. */
+	cw_gen_config_t gen_conf;
+
+	/* Generators are kept started while they are in the pool. */
+	bool start_gens;
+
+	/* Count of objects of each type kept in the pool. */
+	int capacity;
+
+	/* Objects returned to the pool and ready for reuse. */
+	cw_gen_t ** gens;
+	int n_gens;
+
+	cw_rec_t ** recs;
+	int n_recs;
+
+	cw_key_t ** keys;
+	int n_keys;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_POOL */
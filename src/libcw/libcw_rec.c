@@ -42,11 +42,14 @@
    cw_rec_add_mark(): a function that is one level of abstraction above
    functions from first method.
 
-   Currently there is only one method of passing received data (characters)
-   from receiver to client code. This is done by client code periodically
+   There are two methods of passing received data (characters) from
+   receiver to client code. The first is client code periodically
    polling the receiver with cw_rec_poll_representation() or
    cw_rec_poll_character() (which itself is built on top of
-   cw_rec_poll_representation()).
+   cw_rec_poll_representation()). The second is a callback registered
+   with cw_rec_register_output_callback(): receiver measures Spaces
+   with its own timer, and calls the callback as soon as a character
+   or inter-word-space is complete.
 
    Duration of Marks, Spaces and few other things is in microseconds [us].
 */
@@ -60,13 +63,19 @@
 
 
 #include <errno.h>
+#include <inttypes.h> /* int64_t, PRId64 */
 #include <limits.h> /* INT_MAX, for clang. */
 #include <math.h>  /* sqrtf(), cosf() */
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/time.h> /* struct timeval */
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
 
 
 
@@ -90,8 +99,11 @@
 #include "libcw_data.h"
 #include "libcw_debug.h"
 #include "libcw_key.h"
+#include "libcw_metrics.h"
 #include "libcw_rec.h"
 #include "libcw_rec_internal.h"
+#include "libcw_signal.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -123,11 +135,60 @@ static const char * cw_receiver_states[] = {
 
 
 
+/* Duration ranges of Marks and Spaces used by compact receiver, see
+   fields with the same names in cw_rec_t. [us] */
+typedef struct {
+	int dot_duration_min;
+	int dot_duration_max;
+	int dash_duration_min;
+	int dash_duration_max;
+	int ics_duration_min;
+	int ics_duration_max;
+} cw_rec_compact_ranges_t;
+
+
+
+
 /* Functions handling averaging data structure in adaptive receiving
    mode. */
+static void cw_rec_init_internal(cw_rec_t * rec);
+static void cw_rec_release_internal(cw_rec_t * rec);
 static void cw_rec_update_average_internal(cw_rec_averaging_t * avg, int mark_duration);
 static void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mark);
+static void cw_rec_sync_adaptive_durations_internal(cw_rec_t * rec, int unit_duration);
 static void cw_rec_reset_average_internal(cw_rec_averaging_t * avg, int initial);
+static void cw_rec_acquire_speed_internal(cw_rec_t * rec, int mark_duration, char * mark);
+static bool cw_rec_acquisition_seed_internal(const int * durations, int count, int dot_duration_max, int * dot_duration, int * dash_duration);
+static float cw_rec_acquisition_speed_internal(int dot_duration, int dash_duration, int * adaptive_speed_threshold);
+static int64_t cw_rec_timeval_to_ns_internal(const struct timeval * timestamp);
+static int cw_rec_duration_internal(int64_t earlier, int64_t later);
+static cw_ret_t cw_rec_mark_begin_internal(cw_rec_t * rec, int64_t timestamp);
+static cw_ret_t cw_rec_mark_end_internal(cw_rec_t * rec, int64_t timestamp);
+static cw_ret_t cw_rec_add_mark_internal(cw_rec_t * rec, int64_t timestamp, char mark);
+static cw_ret_t cw_rec_poll_representation_internal(cw_rec_t * rec, int64_t timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+static cw_ret_t cw_rec_poll_character_internal(cw_rec_t * rec, int64_t timestamp, char * character, bool * is_end_of_word, bool * is_error);
+static cw_ret_t cw_rec_poll_code_point_internal(cw_rec_t * rec, int64_t timestamp, uint32_t * code_point, bool * is_end_of_word, bool * is_error);
+static cw_ret_t cw_rec_process_events_internal(cw_rec_t * rec, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void cw_rec_process_space_internal(cw_rec_t * rec, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void cw_rec_output_mark_begin_internal(cw_rec_t * rec, int64_t timestamp);
+static void cw_rec_drain_append_internal(void * arg, int64_t timestamp, char character, bool is_error);
+static void cw_rec_representation_append_internal(cw_rec_t * rec, char mark);
+static void cw_rec_output_arm_internal(cw_rec_t * rec, bool is_end_of_mark);
+static void cw_rec_output_timer_callback_internal(void * arg);
+static void cw_rec_output_dispatch_internal(void * arg, int64_t timestamp, char character, bool is_error);
+static void cw_rec_output_events_internal(cw_rec_t * rec);
+static void cw_rec_signal_event_internal(cw_rec_t * rec);
+static int64_t cw_rec_clock_internal(void);
+static char cw_rec_identify_duration_internal(int mark_duration, int dot_duration_min, int dot_duration_max, int dash_duration_min, int dash_duration_max);
+static unsigned int cw_rec_representation_hash_append_internal(unsigned int hash, int representation_length, char mark);
+static uint8_t * cw_rec_snapshot_put_internal(uint8_t * cursor, uint64_t value, int n_bytes);
+static uint64_t cw_rec_snapshot_get_internal(const uint8_t ** cursor, int n_bytes);
+static cw_ret_t cw_rec_snapshot_decode_internal(cw_rec_t * rec, const uint8_t * buffer, size_t n_bytes);
+static uint32_t cw_rec_compact_timestamp_internal(int64_t timestamp);
+static void cw_rec_compact_get_ranges_internal(const cw_rec_compact_t * crec, const cw_rec_t * params, cw_rec_compact_ranges_t * ranges);
+static int cw_rec_compact_duration_internal(uint32_t earlier, uint32_t later);
+static void cw_rec_compact_update_averages_internal(cw_rec_compact_t * crec, int mark_duration, char mark);
+static void cw_rec_compact_acquire_speed_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int mark_duration, char * mark);
 
 
 
@@ -156,7 +217,24 @@ cw_rec_t * cw_rec_new(void)
 		return (cw_rec_t *) NULL;
 	}
 
+	cw_rec_init_internal(rec);
+	cw_metrics_register_internal(CW_METRICS_OBJECT_REC, rec);
+
+	return rec;
+}
+
+
+
+
+/**
+   @brief Set initial values of fields of zeroed receiver
+
+   @param[in,out] rec receiver to initialize
+*/
+static void cw_rec_init_internal(cw_rec_t * rec)
+{
 	rec->state = RS_IDLE;
+	rec->representation_hash = 1; /* Sentinel bit, see cw_representation_to_hash_internal(). */
 
 	rec->speed                      = CW_SPEED_INITIAL;
 	rec->tolerance                  = CW_TOLERANCE_INITIAL;
@@ -175,7 +253,18 @@ cw_rec_t * cw_rec_new(void)
 	rec->parameters_in_sync = false;
 	cw_rec_sync_parameters_internal(rec);
 
-	return rec;
+	/* Recursive, because output callback called with the mutex
+	   locked may call receiver's functions. */
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&rec->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	rec->output_timer_id = -1;
+	rec->event_fd = -1;
+
+	return;
 }
 
 
@@ -204,6 +293,9 @@ void cw_rec_delete(cw_rec_t ** rec)
 		return;
 	}
 
+	cw_metrics_unregister_internal(*rec);
+	cw_rec_release_internal(*rec);
+
 	free(*rec);
 	*rec = (cw_rec_t *) NULL;
 
@@ -213,6 +305,51 @@ void cw_rec_delete(cw_rec_t ** rec)
 
 
 
+void cw_rec_reset(cw_rec_t * rec)
+{
+	cw_assert (rec, MSG_PREFIX "reset: 'rec' argument can't be NULL\n");
+
+	cw_rec_release_internal(rec);
+
+	memset(rec, 0, sizeof (cw_rec_t));
+	cw_rec_init_internal(rec);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Free resources of receiver, but not the receiver itself
+
+   Timer of output callback is stopped, event descriptor is closed,
+   and mutex is destroyed.
+
+   @param[in,out] rec receiver
+*/
+static void cw_rec_release_internal(cw_rec_t * rec)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const int event_fd = rec->event_fd;
+	rec->event_fd = -1;
+	pthread_mutex_unlock(&rec->mutex);
+
+	if (NULL != rec->output_callback || -1 != event_fd) {
+		/* Stop the timer. */
+		cw_rec_register_output_callback(rec, NULL, NULL);
+	}
+	if (-1 != event_fd) {
+		close(event_fd);
+	}
+	pthread_mutex_destroy(&rec->mutex);
+
+	return;
+}
+
+
+
+
 /**
    @brief Set receiver's receiving speed
 
@@ -511,6 +648,9 @@ cw_ret_t cw_rec_set_gap(cw_rec_t * rec, int new_value)
    Reset averaging data structure to initial state.
    To be used in adaptive receiving mode.
 
+   The averaged duration is reset too, so that it is valid before
+   first update of the averaging data structure.
+
    @internal
    @reviewed 2020-08-09
    @endinternal
@@ -525,6 +665,7 @@ void cw_rec_reset_average_internal(cw_rec_averaging_t * avg, int initial)
 	}
 
 	avg->sum = initial * CW_REC_AVERAGING_DURATIONS_COUNT;
+	avg->average = initial;
 	avg->cursor = 0;
 
 	return;
@@ -608,15 +749,28 @@ void cw_rec_duration_stats_update_internal(cw_rec_t * rec, stat_type_t type, int
 		ideal = rec->ics_duration_ideal;
 		break;
 	case CW_REC_STAT_NONE:
+	case CW_REC_STAT_TYPES_COUNT:
 	default:
 		ideal = duration;
 		break;
 	}
 	const int duration_delta = duration - ideal;
 
+	/* The oldest entry drops out of circular buffer, and out of
+	   running sums. */
+	cw_rec_duration_stats_point_t * point = &rec->duration_stats[rec->duration_stats_idx];
+	if (CW_REC_STAT_NONE != point->type) {
+		rec->duration_stats_sum_of_squares[point->type] -= (int64_t) point->duration_delta * point->duration_delta;
+		rec->duration_stats_count[point->type]--;
+	}
+
 	/* Add this statistic to the buffer. */
-	rec->duration_stats[rec->duration_stats_idx].type = type;
-	rec->duration_stats[rec->duration_stats_idx].duration_delta = duration_delta;
+	point->type = type;
+	point->duration_delta = duration_delta;
+	if (CW_REC_STAT_NONE != type) {
+		rec->duration_stats_sum_of_squares[type] += (int64_t) duration_delta * duration_delta;
+		rec->duration_stats_count[type]++;
+	}
 
 	rec->duration_stats_idx++;
 	rec->duration_stats_idx %= CW_REC_DURATION_STATS_CAPACITY;
@@ -656,30 +810,22 @@ cw_ret_t cw_rec_duration_stats_get_internal(const cw_rec_t * rec, stat_type_t ty
 		return CW_FAILURE;
 	}
 
+	if (type <= CW_REC_STAT_NONE || type >= CW_REC_STAT_TYPES_COUNT) {
+		*result = 0.0F;
+		return CW_SUCCESS;
+	}
+
 	/* TODO: some locking of statistics with mutex? */
 
-	/* Sum and count values for marks/spaces matching the given
-	   type.  A cleared buffer always begins refilling at zeroth
-	   mark, so to optimize we can stop on the first unoccupied
-	   slot in the circular buffer. */
-	int sum_of_squares = 0;
-	int count = 0;
-	for (int i = 0; i < CW_REC_DURATION_STATS_CAPACITY; i++) {
-		if (rec->duration_stats[i].type == type) {
-			const int duration_delta = rec->duration_stats[i].duration_delta;
-			sum_of_squares += (duration_delta * duration_delta);
-			count++;
-		} else if (rec->duration_stats[i].type == CW_REC_STAT_NONE) {
-			break;
-		} else {
-			; /* A type of statistics that we are not interested in. Continue. */
-		}
-	}
+	/* Sums of values for marks/spaces matching the given type are
+	   maintained by cw_rec_duration_stats_update_internal(). */
+	const int64_t sum_of_squares = rec->duration_stats_sum_of_squares[type];
+	const int count = rec->duration_stats_count[type];
 
 	if (0 == count) {
 		*result = 0.0F;
 	} else {
-		*result = sqrtf((float) sum_of_squares / (float) count);
+		*result = sqrtf((float) ((double) sum_of_squares / (double) count));
 	}
 	return CW_SUCCESS;
 }
@@ -758,6 +904,11 @@ void cw_rec_reset_statistics(cw_rec_t * rec)
 	}
 	rec->duration_stats_idx = 0;
 
+	for (int t = 0; t < CW_REC_STAT_TYPES_COUNT; t++) {
+		rec->duration_stats_sum_of_squares[t] = 0;
+		rec->duration_stats_count[t] = 0;
+	}
+
 	return;
 }
 
@@ -872,6 +1023,10 @@ void cw_rec_set_adaptive_mode_internal(cw_rec_t * rec, bool adaptive)
 		if (rec->is_adaptive_receive_mode) {
 			cw_rec_reset_average_internal(&rec->dot_averaging, rec->dot_duration_ideal);
 			cw_rec_reset_average_internal(&rec->dash_averaging, rec->dash_duration_ideal);
+
+			/* Incoming data may be at completely different
+			   speed, acquire it from first Marks. */
+			rec->acquisition_count = 0;
 		}
 	}
 
@@ -967,6 +1122,42 @@ bool cw_rec_get_adaptive_mode(const cw_rec_t * rec)
 */
 cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 {
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_mark_begin_internal(rec, cw_rec_timeval_to_ns_internal(timestamp));
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_rec_mark_begin_ns(cw_rec_t * rec, int64_t timestamp)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_mark_begin_internal(rec, timestamp);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Inform @p rec about beginning of a Mark
+
+   @exception ERANGE invalid state of receiver was discovered.
+   @exception EINVAL @p timestamp is negative
+
+   @param[in,out] rec receiver which to inform about beginning of Mark
+   @param[in] timestamp timestamp of "beginning of Mark" event [ns]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_mark_begin_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	cw_rec_output_mark_begin_internal(rec, timestamp);
+
 #if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
 	if (rec->is_pending_inter_word_space) {
 
@@ -1006,12 +1197,12 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
 		      MSG_PREFIX "'%s': mark_begin: receive state: %s", rec->label, cw_receiver_states[rec->state]);
 
-	/* Validate and save the timestamp, or get one and then save it.
-	   This is a timestamp of beginning of Mark. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_start, timestamp)) {
+	/* Validate and save the timestamp of beginning of Mark. */
+	if (timestamp < 0) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	rec->mark_start = timestamp;
 
 	if (RS_INTER_MARK_SPACE == rec->state) {
 		/* Measure duration of inter-mark-space that is about to end
@@ -1020,8 +1211,7 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 		   rec->mark_end is timestamp of end of previous Mark. It is
 		   set when receiver goes into inter-mark-space state by
 		   cw_rec_mark_end() or by cw_rec_add_mark(). */
-		const int space_duration = cw_timestamp_compare_internal(&rec->mark_end,
-									 &rec->mark_start);
+		const int space_duration = cw_rec_duration_internal(rec->mark_end, rec->mark_start);
 		cw_rec_duration_stats_update_internal(rec, CW_REC_STAT_INTER_MARK_SPACE, space_duration);
 
 		/* TODO: this may have been a very long space. Should
@@ -1062,6 +1252,39 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
    @return CW_FAILURE otherwise
 */
 cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_mark_end_internal(rec, cw_rec_timeval_to_ns_internal(timestamp));
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_rec_mark_end_ns(cw_rec_t * rec, int64_t timestamp)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_mark_end_internal(rec, timestamp);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Inform @p rec about end of a Mark
+
+   See cw_rec_mark_end() for list of errno values.
+
+   @param[in,out] rec receiver which to inform about end of Mark
+   @param[in] timestamp timestamp of "end of Mark" event [ns]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_mark_end_internal(cw_rec_t * rec, int64_t timestamp)
 {
 	/* The receiver state is expected to be inside of a Mark, otherwise
 	   there is nothing to end. */
@@ -1076,23 +1299,21 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 
 	/* Take a safe copy of the current end timestamp, in case we need
 	   to put it back if we decide this Mark is really just noise. */
-	struct timeval saved_end_timestamp = rec->mark_end;
+	const int64_t saved_end_timestamp = rec->mark_end;
 
-	/* Save the timestamp passed in, or get one. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_end, timestamp)) {
+	/* Save the timestamp passed in. */
+	if (timestamp < 0) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	rec->mark_end = timestamp;
 
 	/* Compare the timestamps to determine the duration of the Mark. */
-	const int mark_duration = cw_timestamp_compare_internal(&rec->mark_start,
-								&rec->mark_end);
+	const int mark_duration = cw_rec_duration_internal(rec->mark_start, rec->mark_end);
 
 #if 0
-	fprintf(stderr, "------- mark duration: %ld.%ld - %ld.%ld = %d ms\n",
-		rec->mark_end.tv_sec, rec->mark_end.tv_usec,
-		rec->mark_start.tv_sec, rec->mark_start.tv_usec,
-		mark_duration);
+	fprintf(stderr, "------- mark duration: %"PRId64" - %"PRId64" = %d us\n",
+		rec->mark_end, rec->mark_start, mark_duration);
 #endif
 
 	if (rec->noise_spike_threshold > 0
@@ -1116,6 +1337,11 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 		   came in to the routine. */
 		rec->mark_end = saved_end_timestamp;
 
+		__atomic_add_fetch(&rec->counters.n_noise_spikes, 1, __ATOMIC_RELAXED);
+
+		/* Space after previous Mark goes on. */
+		cw_rec_output_arm_internal(rec, false);
+
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
 			      MSG_PREFIX "'%s': mark_end: '%d [us]' Mark identified as spike noise (threshold = '%d [us]')",
 			      rec->label,
@@ -1135,16 +1361,25 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 	   Otherwise, it returns a Mark (Dot or Dash), for us to put
 	   in representation buffer. */
 	char mark = 0;
-	if (CW_SUCCESS != cw_rec_identify_mark_internal(rec, mark_duration, &mark)) {
+	const cw_ret_t identified = cw_rec_identify_mark_internal(rec, mark_duration, &mark);
+	CW_TRACE(CW_TRACE_EVENT_REC_MARK, CW_SUCCESS == identified ? mark : 0);
+	if (CW_SUCCESS != identified) {
+		__atomic_add_fetch(&rec->counters.n_unrecognized, 1, __ATOMIC_RELAXED);
 		errno = ENOENT;
 		return CW_FAILURE;
 	}
 
 	if (rec->is_adaptive_receive_mode) {
-		/* Update the averaging buffers so that the adaptive
-		   tracking of received Morse speed stays up to
-		   date. */
-		cw_rec_update_averages_internal(rec, mark_duration, mark);
+		if (CW_REC_ACQUISITION_DONE != rec->acquisition_count) {
+			/* Speed of incoming data is not known yet. This
+			   may also correct identification of the Mark. */
+			cw_rec_acquire_speed_internal(rec, mark_duration, &mark);
+		} else {
+			/* Update the averaging buffers so that the adaptive
+			   tracking of received Morse speed stays up to
+			   date. */
+			cw_rec_update_averages_internal(rec, mark_duration, mark);
+		}
 	} else {
 		/* Do nothing. Don't fiddle about trying to track for
 		   fixed speed receive. */
@@ -1164,7 +1399,7 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 	}
 
 	/* Add the Mark to the receiver's representation buffer. */
-	rec->representation[rec->representation_ind++] = mark;
+	cw_rec_representation_append_internal(rec, mark);
 
 	/* Until we complete the whole character (all Dots and Dashes), this
 	   will print only part of representation. */
@@ -1190,12 +1425,67 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 	   state. */
 	cw_rec_set_state_internal(rec, RS_INTER_MARK_SPACE);
 
+	cw_rec_output_arm_internal(rec, true);
+
 	return CW_SUCCESS;
 }
 
 
 
 
+/**
+   @brief Add a Mark to receiver's representation buffer
+
+   Keep the buffer NUL-terminated, and keep hash of representation up
+   to date.
+
+   @param[in,out] rec receiver
+   @param[in] mark CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION
+*/
+void cw_rec_representation_append_internal(cw_rec_t * rec, char mark)
+{
+	rec->representation[rec->representation_ind++] = mark;
+	rec->representation[rec->representation_ind] = '\0';
+
+	rec->representation_hash = cw_rec_representation_hash_append_internal(rec->representation_hash, rec->representation_ind, mark);
+
+	if (CW_DOT_REPRESENTATION == mark) {
+		__atomic_add_fetch(&rec->counters.n_dots, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&rec->counters.n_dashes, 1, __ATOMIC_RELAXED);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update hash of representation with a Mark appended to the representation
+
+   @param[in] hash hash of representation before appending the Mark
+   @param[in] representation_length length of representation with the Mark appended
+   @param[in] mark CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION
+
+   @return hash of representation with the Mark appended (zero if the representation can't be hashed)
+*/
+static unsigned int cw_rec_representation_hash_append_internal(unsigned int hash, int representation_length, char mark)
+{
+	if (0 == hash || representation_length > CW_DATA_MAX_REPRESENTATION_LENGTH) {
+		return 0;
+	} else if (CW_DASH_REPRESENTATION == mark) {
+		return (hash << 1U) | 1U;
+	} else if (CW_DOT_REPRESENTATION == mark) {
+		return hash << 1U;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
 /**
    @brief Analyze a Mark and identify it as a Dot or Dash
 
@@ -1234,11 +1524,11 @@ cw_ret_t cw_rec_identify_mark_internal(cw_rec_t * rec, int mark_duration, char *
 	/* Synchronize parameters if required */
 	cw_rec_sync_parameters_internal(rec);
 
-	/* If the duration was, within tolerance, a Dot, return Dot to
-	   the caller.  */
-	if (mark_duration >= rec->dot_duration_min
-	    && mark_duration <= rec->dot_duration_max) {
+	const char identified = cw_rec_identify_duration_internal(mark_duration,
+								  rec->dot_duration_min, rec->dot_duration_max,
+								  rec->dash_duration_min, rec->dash_duration_max);
 
+	if (CW_DOT_REPRESENTATION == identified) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
 			      MSG_PREFIX "'%s': identify: mark '%d [us]' recognized as DOT (limits: %d - %d [us])",
 			      rec->label, mark_duration, rec->dot_duration_min, rec->dot_duration_max);
@@ -1247,10 +1537,7 @@ cw_ret_t cw_rec_identify_mark_internal(cw_rec_t * rec, int mark_duration, char *
 		return CW_SUCCESS;
 	}
 
-	/* Do the same for a dash. */
-	if (mark_duration >= rec->dash_duration_min
-	    && mark_duration <= rec->dash_duration_max) {
-
+	if (CW_DASH_REPRESENTATION == identified) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
 			      MSG_PREFIX "'%s': identify: mark '%d [us]' recognized as DASH (limits: %d - %d [us])",
 			      rec->label, mark_duration, rec->dash_duration_min, rec->dash_duration_max);
@@ -1311,6 +1598,41 @@ cw_ret_t cw_rec_identify_mark_internal(cw_rec_t * rec, int mark_duration, char *
 
 
 
+/**
+   @brief Identify a Mark as a Dot or Dash, using given duration ranges
+
+   Used by cw_rec_identify_mark_internal() and by compact receiver.
+
+   @param[in] mark_duration duration of Mark to analyze [us]
+   @param[in] dot_duration_min minimal duration of Dot [us]
+   @param[in] dot_duration_max maximal duration of Dot [us]
+   @param[in] dash_duration_min minimal duration of Dash [us]
+   @param[in] dash_duration_max maximal duration of Dash [us]
+
+   @return CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION if the Mark has been identified
+   @return zero otherwise
+*/
+static char cw_rec_identify_duration_internal(int mark_duration, int dot_duration_min, int dot_duration_max, int dash_duration_min, int dash_duration_max)
+{
+	/* If the duration was, within tolerance, a Dot, return Dot to
+	   the caller.  */
+	if (mark_duration >= dot_duration_min
+	    && mark_duration <= dot_duration_max) {
+		return CW_DOT_REPRESENTATION;
+	}
+
+	/* Do the same for a dash. */
+	if (mark_duration >= dash_duration_min
+	    && mark_duration <= dash_duration_max) {
+		return CW_DASH_REPRESENTATION;
+	}
+
+	return 0;
+}
+
+
+
+
 /**
    @brief Update receiver's averaging data structures with most recent data
 
@@ -1351,36 +1673,93 @@ void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mar
 	const int avg_dash_duration = rec->dash_averaging.average;
 	rec->adaptive_speed_threshold = (avg_dash_duration - avg_dot_duration) / 2 + avg_dot_duration;
 
-	/* We are in adaptive mode. Since ->adaptive_speed_threshold
-	   has changed, we need to calculate new ->speed with sync().
-	   Low-level parameters will also be re-synchronized to new
-	   threshold/speed. */
-	rec->parameters_in_sync = false;
-	cw_rec_sync_parameters_internal(rec);
+	/* Only the speed and the durations derived from unit duration
+	   depend on the new threshold, so update just them, in closed
+	   form, instead of going through full
+	   cw_rec_sync_parameters_internal(). As in the sync function,
+	   the durations are calculated from speed from before the
+	   update. */
+	int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+	rec->speed = CW_DOT_CALIBRATION / ((float) rec->adaptive_speed_threshold / 2.0F);
 
 	if (rec->speed < CW_SPEED_MIN || rec->speed > CW_SPEED_MAX) {
-
-		/* Clamp the speed. */
+		/* Clamp the speed, and derive threshold and unit
+		   duration from the clamped speed. */
 		rec->speed = rec->speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
+		unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+		rec->adaptive_speed_threshold = 2 * unit_duration;
+		rec->speed = CW_DOT_CALIBRATION / ((float) rec->adaptive_speed_threshold / 2.0F);
+	}
 
-		/* Direct manipulation of speed in line above
-		   (clamping) requires resetting adaptive mode and
-		   re-synchronizing to calculate the new threshold,
-		   which unfortunately recalculates everything else
-		   according to fixed speed.
+	cw_rec_sync_adaptive_durations_internal(rec, unit_duration);
 
-		   So, we then have to reset adaptive mode and
-		   re-synchronize one more time, to get all other
-		   parameters back to where they should be. */
+	return;
+}
 
-		rec->is_adaptive_receive_mode = false;
-		rec->parameters_in_sync = false;
-		cw_rec_sync_parameters_internal(rec);
 
-		rec->is_adaptive_receive_mode = true;
-		rec->parameters_in_sync = false;
-		cw_rec_sync_parameters_internal(rec);
+
+
+/**
+   @brief Acquire speed of incoming Morse data from first Marks
+
+   With averages of only CW_REC_AVERAGING_DURATIONS_COUNT Marks,
+   starting from current speed, receiver in adaptive receiving mode
+   would need several characters to lock on speed of new station, and
+   its first characters would be garbage. Instead the receiver
+   collects durations of first Marks, and as soon as they can be split
+   into clusters of Dots and Dashes (see
+   cw_rec_acquisition_seed_internal()), seeds the averages, adaptive
+   threshold and speed with the clusters.
+
+   Marks of current representation (and the Mark just received:
+   @p mark) have been identified with ranges for the old speed, so
+   they are identified again with new ranges.
+
+   Until the speed is acquired the averages are not updated.
+
+   @param[in,out] rec receiver in adaptive receiving mode
+   @param[in] mark_duration duration of Mark just received [us]
+   @param[in,out] mark identified Mark just received
+*/
+void cw_rec_acquire_speed_internal(cw_rec_t * rec, int mark_duration, char * mark)
+{
+	rec->acquisition_durations[rec->acquisition_count++] = mark_duration;
+
+	int dot_duration = 0;
+	int dash_duration = 0;
+	if (!cw_rec_acquisition_seed_internal(rec->acquisition_durations, rec->acquisition_count, rec->dot_duration_max, &dot_duration, &dash_duration)) {
+		return;
+	}
+
+	cw_rec_reset_average_internal(&rec->dot_averaging, dot_duration);
+	cw_rec_reset_average_internal(&rec->dash_averaging, dash_duration);
+	rec->speed = cw_rec_acquisition_speed_internal(dot_duration, dash_duration, &rec->adaptive_speed_threshold);
+	cw_rec_sync_adaptive_durations_internal(rec, (int) floorf((float) CW_DOT_CALIBRATION / rec->speed));
+
+	/* Earlier Marks of current representation are the most recent
+	   durations before the Mark just received. Representation may
+	   have been started before the acquisition. */
+	const int n = rec->representation_ind < rec->acquisition_count - 1 ? rec->representation_ind : rec->acquisition_count - 1;
+	const int * durations = rec->acquisition_durations + (rec->acquisition_count - 1 - n);
+	for (int i = 0; i < n; i++) {
+		rec->representation[rec->representation_ind - n + i] = cw_rec_identify_duration_internal(durations[i],
+													 rec->dot_duration_min, rec->dot_duration_max,
+													 rec->dash_duration_min, rec->dash_duration_max);
 	}
+	*mark = cw_rec_identify_duration_internal(mark_duration,
+						  rec->dot_duration_min, rec->dot_duration_max,
+						  rec->dash_duration_min, rec->dash_duration_max);
+
+	rec->representation_hash = 1; /* Sentinel bit, see cw_representation_to_hash_internal(). */
+	for (int i = 0; i < rec->representation_ind; i++) {
+		rec->representation_hash = cw_rec_representation_hash_append_internal(rec->representation_hash, i + 1, rec->representation[i]);
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "'%s': acquired speed %.1f [wpm] from %d Marks (Dot %d [us], Dash %d [us])",
+		      rec->label, (double) rec->speed, rec->acquisition_count, dot_duration, dash_duration);
+
+	rec->acquisition_count = CW_REC_ACQUISITION_DONE;
 
 	return;
 }
@@ -1388,6 +1767,120 @@ void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mar
 
 
 
+/**
+   @brief Find durations of Dot and Dash in durations of first Marks
+
+   Durations are split into two clusters with 1-D 2-means: of all
+   splits of sorted durations into shorter and longer ones the split
+   with the smallest sum of squared distances from means of clusters
+   is selected. The split is accepted only when the mean of longer
+   Marks is at least twice the mean of shorter ones (the ideal ratio is
+   three), otherwise the Marks may be all Dots or all Dashes.
+
+   When CW_REC_ACQUISITION_MARKS_COUNT durations can't be split, they
+   are treated as one cluster: Dots or Dashes, depending on how their
+   mean compares with @p dot_duration_max of current speed.
+
+   @param[in] durations durations of Marks [us]
+   @param[in] count count of durations
+   @param[in] dot_duration_max maximal duration of Dot at current speed [us]
+   @param[out] dot_duration duration of Dot [us]
+   @param[out] dash_duration duration of Dash [us]
+
+   @return true if durations of Dot and Dash have been found
+   @return false otherwise
+*/
+static bool cw_rec_acquisition_seed_internal(const int * durations, int count, int dot_duration_max, int * dot_duration, int * dash_duration)
+{
+	int sorted[CW_REC_ACQUISITION_MARKS_COUNT];
+	int64_t sum = 0;
+	for (int i = 0; i < count; i++) {
+		int j = i;
+		for (; j > 0 && sorted[j - 1] > durations[i]; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = durations[i];
+		sum += durations[i];
+	}
+
+	/* Sum of squared distances from mean of cluster is sum of
+	   squares minus square of sum divided by count; sum of squares
+	   of all durations is the same for all splits, so only the
+	   second term needs to be compared. */
+	double best_score = 0.0;
+	int best_split = 0;
+	int64_t best_shorter_sum = 0;
+	int64_t shorter_sum = 0;
+	for (int split = 1; split < count; split++) {
+		shorter_sum += sorted[split - 1];
+		const int64_t longer_sum = sum - shorter_sum;
+		const double score = (double) shorter_sum * (double) shorter_sum / split
+			+ (double) longer_sum * (double) longer_sum / (count - split);
+		if (score > best_score) {
+			best_score = score;
+			best_split = split;
+			best_shorter_sum = shorter_sum;
+		}
+	}
+
+	if (best_split > 0) {
+		const int shorter = (int) (best_shorter_sum / best_split);
+		const int longer = (int) ((sum - best_shorter_sum) / (count - best_split));
+		if (longer >= 2 * shorter) {
+			*dot_duration = shorter;
+			*dash_duration = longer;
+			return true;
+		}
+	}
+
+	if (count < CW_REC_ACQUISITION_MARKS_COUNT) {
+		return false;
+	}
+
+	const int mean = (int) (sum / count);
+	if (mean <= dot_duration_max) {
+		*dot_duration = mean;
+		*dash_duration = 3 * mean;
+	} else {
+		*dot_duration = mean / 3;
+		*dash_duration = mean;
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Calculate speed from durations of Dot and Dash acquired by receiver
+
+   The threshold and speed are calculated as in
+   cw_rec_update_averages_internal(), including clamping of speed.
+
+   @param[in] dot_duration duration of Dot [us]
+   @param[in] dash_duration duration of Dash [us]
+   @param[out] adaptive_speed_threshold adaptive threshold [us]
+
+   @return speed [wpm]
+*/
+static float cw_rec_acquisition_speed_internal(int dot_duration, int dash_duration, int * adaptive_speed_threshold)
+{
+	*adaptive_speed_threshold = (dash_duration - dot_duration) / 2 + dot_duration;
+	float speed = CW_DOT_CALIBRATION / ((float) *adaptive_speed_threshold / 2.0F);
+
+	if (speed < CW_SPEED_MIN || speed > CW_SPEED_MAX) {
+		speed = speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
+		*adaptive_speed_threshold = 2 * (int) floorf((float) CW_DOT_CALIBRATION / speed);
+		speed = CW_DOT_CALIBRATION / ((float) *adaptive_speed_threshold / 2.0F);
+	}
+
+	return speed;
+}
+
+
+
+
 /**
    @brief Add Dot or Dash to receiver's representation buffer
 
@@ -1419,6 +1912,42 @@ void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mar
 */
 cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char mark)
 {
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_add_mark_internal(rec, cw_rec_timeval_to_ns_internal(timestamp), mark);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_rec_add_mark_ns(cw_rec_t * rec, int64_t timestamp, char mark)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_add_mark_internal(rec, timestamp, mark);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Add Dot or Dash to receiver's representation buffer
+
+   See cw_rec_add_mark() for details.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of "end of mark" event [ns]
+   @param[in] mark Mark to be inserted into receiver's representation buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rec_add_mark_internal(cw_rec_t * rec, int64_t timestamp, char mark)
+{
+	cw_rec_output_mark_begin_internal(rec, timestamp);
+
 	/* The receiver's state is expected to be idle or
 	   inter-mark-space in order to use this routine. */
 	if (RS_IDLE != rec->state && RS_INTER_MARK_SPACE != rec->state) {
@@ -1453,13 +1982,14 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 	   called later look at the time since the last end of Mark
 	   to determine whether we are at the end of a word, or just
 	   at the end of a character. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_end, timestamp)) {
+	if (timestamp < 0) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	rec->mark_end = timestamp;
 
 	/* Add the mark to the receiver's representation buffer. */
-	rec->representation[rec->representation_ind++] = mark;
+	cw_rec_representation_append_internal(rec, mark);
 
 	/* We just added a Mark to the receiver's buffer.  As in
 	   cw_rec_mark_end(): if the buffer is full full, then we have to do
@@ -1479,6 +2009,8 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 	   the inter-mark-space state. */
 	cw_rec_set_state_internal(rec, RS_INTER_MARK_SPACE);
 
+	cw_rec_output_arm_internal(rec, true);
+
 	return CW_SUCCESS;
 }
 
@@ -1525,7 +2057,7 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 
    @param[in,out] rec receiver
    @param[in] timestamp (may be NULL)
-   @param[out] representation representation of character from receiver's buffer
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
    @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
    @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
 
@@ -1538,7 +2070,51 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 				    bool * is_end_of_word,
 				    bool * is_error)
 {
-	if (RS_EOW_GAP == rec->state || RS_EOW_GAP_ERR == rec->state) {
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_poll_representation_internal(rec, cw_rec_timeval_to_ns_internal(timestamp), representation, is_end_of_word, is_error);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_rec_poll_representation_ns(cw_rec_t * rec,
+				       int64_t timestamp,
+				       char * representation,
+				       bool * is_end_of_word,
+				       bool * is_error)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_poll_representation_internal(rec, timestamp, representation, is_end_of_word, is_error);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Try to poll fully received representation from receiver
+
+   See cw_rec_poll_representation() for details.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp current time [ns]
+   @param[out] representation buffer for representation (char array of size CW_REC_REPRESENTATION_CAPACITY+1, may be NULL)
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a correct representation has been returned through @p representation
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_poll_representation_internal(cw_rec_t * rec,
+						    int64_t timestamp,
+						    char * representation,
+						    bool * is_end_of_word,
+						    bool * is_error)
+{
+	if (RS_EOW_GAP == rec->state || RS_EOW_GAP_ERR == rec->state) {
 
 		/* Until receiver is notified about new mark, its
 		   state won't change, and representation stored by
@@ -1585,13 +2161,12 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 	   To see which case is true, calculate duration of this Space
 	   by comparing current/given timestamp with end of last
 	   Mark. */
-	struct timeval now_timestamp;
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&now_timestamp, timestamp)) {
+	if (timestamp < 0) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
 
-	const int space_duration = cw_timestamp_compare_internal(&rec->mark_end, &now_timestamp);
+	const int space_duration = cw_rec_duration_internal(rec->mark_end, timestamp);
 	if (INT_MAX == space_duration) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
 			      MSG_PREFIX "'%s': poll: space duration == INT_MAX", rec->label);
@@ -1662,7 +2237,7 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 
    @param[in,out] rec receiver
    @param[in] space_duration duration of current inter-character-space
-   @param[out] representation representation of character from receiver's buffer
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
    @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
    @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
 */
@@ -1705,9 +2280,13 @@ void cw_rec_poll_representation_ics_internal(cw_rec_t * rec,
 		*is_error = (RS_EOC_GAP_ERR == rec->state);
 	}
 
-	/* Append representation from receiver's buffer to caller's buffer. */
-	*representation = '\0';
-	strncat(representation, rec->representation, rec->representation_ind);
+	/* Append representation from receiver's buffer to caller's
+	   buffer. Callers interested only in a character pass NULL
+	   and use receiver's hash of representation instead. */
+	if (representation) {
+		*representation = '\0';
+		strncat(representation, rec->representation, rec->representation_ind);
+	}
 
 	/* Since we are in ics state, there will be no more Dots or Dashes added to current representation. */
 	rec->representation[rec->representation_ind] = '\0';
@@ -1734,7 +2313,7 @@ void cw_rec_poll_representation_ics_internal(cw_rec_t * rec,
    @endinternal
 
    @param[in,out] rec receiver
-   @param[out] representation representation of character from receiver's buffer
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
    @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
    @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
 */
@@ -1767,9 +2346,13 @@ void cw_rec_poll_representation_iws_internal(cw_rec_t * rec,
 		*is_error = (RS_EOW_GAP_ERR == rec->state);
 	}
 
-	/* Append representation from receiver's buffer to caller's buffer. */
-	*representation = '\0';
-	strncat(representation, rec->representation, rec->representation_ind);
+	/* Append representation from receiver's buffer to caller's
+	   buffer. Callers interested only in a character pass NULL
+	   and use receiver's hash of representation instead. */
+	if (representation) {
+		*representation = '\0';
+		strncat(representation, rec->representation, rec->representation_ind);
+	}
 
 	/* Since we are in iws state, there will be no more Dots or Dashes added to current representation. */
 	rec->representation[rec->representation_ind] = '\0';
@@ -1824,6 +2407,50 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 			       char * character,
 			       bool * is_end_of_word,
 			       bool * is_error)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_poll_character_internal(rec, cw_rec_timeval_to_ns_internal(timestamp), character, is_end_of_word, is_error);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_rec_poll_character_ns(cw_rec_t * rec,
+				  int64_t timestamp,
+				  char * character,
+				  bool * is_end_of_word,
+				  bool * is_error)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_poll_character_internal(rec, timestamp, character, is_end_of_word, is_error);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Try to poll fully received character from receiver
+
+   See cw_rec_poll_character() for details.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp current time [ns]
+   @param[out] character character received by receiver
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a character has been recognized by receiver and is returned through @p character
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_poll_character_internal(cw_rec_t * rec,
+					       int64_t timestamp,
+					       char * character,
+					       bool * is_end_of_word,
+					       bool * is_error)
 {
 	/* TODO: in theory we don't need these intermediate bool
 	   variables, since is_end_of_word and is_error won't be
@@ -1831,18 +2458,18 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 	bool end_of_word = false;
 	bool error = false;
 
-	char representation[CW_REC_REPRESENTATION_CAPACITY + 1];
-
-	/* See if we can obtain a representation from receiver. */
-	cw_ret_t cwret = cw_rec_poll_representation(rec, timestamp,
-						    representation,
-						    &end_of_word, &error);
+	/* See if receiver has a complete representation. The
+	   representation itself is not needed, only its hash. */
+	cw_ret_t cwret = cw_rec_poll_representation_internal(rec, timestamp,
+							     NULL,
+							     &end_of_word, &error);
 	if (CW_SUCCESS != cwret) {
 		return CW_FAILURE;
 	}
 
-	/* Look up the representation using the lookup functions. */
-	int looked_up = cw_representation_to_character_internal(representation);
+	/* Look up the character using hash of representation, built
+	   while Marks were received. */
+	int looked_up = cw_representation_hash_to_character_internal(rec->representation_hash);
 	if (0 == looked_up) {
 		errno = ENOENT;
 		return CW_FAILURE;
@@ -1882,255 +2509,1508 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 
 
 /**
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   @brief Decode a timeline of key events
+
+   Feed receiver with beginnings and ends of Marks from @p events, in
+   one pass. Each character recognized on the timeline, and each
+   inter-word-space (as ' '), is passed to @p callback_func as soon
+   as a duration of Space after the character is known to be long
+   enough.
+
+   Receiver's state is preserved between calls, so a long timeline can
+   be processed in chunks. Use CW_REC_EVENT_POLL event at the end of
+   timeline to flush the last character.
+
+   Marks rejected as noise spikes are ignored. A Mark that can't be
+   recognized as Dot or Dash discards current (incomplete) character.
+   Representations that don't match any character are not reported.
+
+   @exception EINVAL invalid type of event, negative or decreasing timestamp
+   @exception ERANGE unexpected event (e.g. beginning of Mark during Mark)
+
+   @param[in,out] rec receiver
+   @param[in] events array of events
+   @param[in] n_events count of items in @p events
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS if all events have been processed
+   @return CW_FAILURE otherwise; characters decoded before the failing event have been already reported
 */
-void cw_rec_reset_state(cw_rec_t * rec)
+cw_ret_t cw_rec_process_events(cw_rec_t * rec, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg)
 {
-	memset(rec->representation, 0, sizeof (rec->representation));
-	rec->representation_ind = 0;
-
-#if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
-	rec->is_pending_inter_word_space = false;
-#endif
+	if (NULL == events || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-	cw_rec_set_state_internal(rec, RS_IDLE);
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_process_events_internal(rec, events, n_events, callback_func, callback_arg);
+	pthread_mutex_unlock(&rec->mutex);
 
-	return;
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Get the number of Marks (Dots/Dashes) the receiver's buffer can accommodate
+   @brief Decode a timeline of key events
 
-   The value returned by this function is the maximum number of Marks written
-   out by cw_rec_poll_representation() (not including terminating NUL).
+   See cw_rec_process_events().
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   @param[in,out] rec receiver
+   @param[in] events array of events
+   @param[in] n_events count of items in @p events
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
 
-   @return number of Marks that can be stored in receiver's representation buffer
+   @return CW_SUCCESS if all events have been processed
+   @return CW_FAILURE otherwise
 */
-int cw_rec_get_receive_buffer_capacity_internal(void)
+static cw_ret_t cw_rec_process_events_internal(cw_rec_t * rec, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg)
 {
-	return CW_REC_REPRESENTATION_CAPACITY;
+	for (size_t i = 0; i < n_events; i++) {
+		const cw_rec_event_t * event = &events[i];
+
+		if (event->timestamp < 0
+		    || (RS_MARK == rec->state && event->timestamp < rec->mark_start)
+		    || (RS_IDLE != rec->state && RS_MARK != rec->state && event->timestamp < rec->mark_end)) {
+
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "'%s': process events: invalid timestamp of event #%zu: %"PRId64,
+				      rec->label, i, event->timestamp);
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+
+		switch (event->type) {
+		case CW_REC_EVENT_MARK_BEGIN:
+			cw_rec_process_space_internal(rec, event->timestamp, callback_func, callback_arg);
+			if (RS_IDLE != rec->state && RS_INTER_MARK_SPACE != rec->state && RS_MARK != rec->state) {
+				/* Character has been already reported. */
+				cw_rec_reset_state(rec);
+			}
+			if (CW_SUCCESS != cw_rec_mark_begin_internal(rec, event->timestamp)) {
+				return CW_FAILURE;
+			}
+			break;
+
+		case CW_REC_EVENT_MARK_END:
+			if (CW_SUCCESS != cw_rec_mark_end_internal(rec, event->timestamp)) {
+				if (EAGAIN == errno) {
+					/* Noise spike, state of receiver has been restored. */
+				} else if (ENOENT == errno) {
+					cw_rec_reset_state(rec);
+				} else {
+					return CW_FAILURE;
+				}
+			}
+			break;
+
+		case CW_REC_EVENT_POLL:
+			cw_rec_process_space_internal(rec, event->timestamp, callback_func, callback_arg);
+			break;
+
+		default:
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+	}
+
+	return CW_SUCCESS;
 }
 
 
 
 
-/**
-   @brief Get number of Marks (Dots and Dashes) currently stored in receiver's representation buffer
+cw_ret_t cw_rec_set_alphabet(cw_rec_t * rec, cw_alphabet_t alphabet)
+{
+	if (NULL == rec || (int) alphabet < 0 || alphabet >= CW_ALPHABET_COUNT) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+	rec->alphabet = alphabet;
+	return CW_SUCCESS;
+}
 
-   @param[in] rec receiver from which to get current number of Marks
-*/
-int cw_rec_get_buffer_length_internal(const cw_rec_t * rec)
+
+
+
+cw_alphabet_t cw_rec_get_alphabet(const cw_rec_t * rec)
 {
-	return rec->representation_ind;
+	return rec->alphabet;
+}
+
+
+
+
+cw_ret_t cw_rec_poll_code_point_ns(cw_rec_t * rec,
+				   int64_t timestamp,
+				   uint32_t * code_point,
+				   bool * is_end_of_word,
+				   bool * is_error)
+{
+	pthread_mutex_lock(&rec->mutex);
+	const cw_ret_t cwret = cw_rec_poll_code_point_internal(rec, timestamp, code_point, is_end_of_word, is_error);
+	pthread_mutex_unlock(&rec->mutex);
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Reset receiver's essential parameters to their initial values
+   @brief Try to poll fully received character from receiver, as code point
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   Counterpart of cw_rec_poll_character_internal() that looks up the
+   character in receiver's alphabet (see cw_rec_set_alphabet()).
+
+   @exception ENOENT received representation has no character in the alphabet
 
    @param[in,out] rec receiver
+   @param[in] timestamp current time [ns]
+   @param[out] code_point code point of character received by receiver
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a character has been recognized by receiver and is returned through @p code_point
+   @return CW_FAILURE otherwise
 */
-void cw_rec_reset_parameters_internal(cw_rec_t * rec)
+static cw_ret_t cw_rec_poll_code_point_internal(cw_rec_t * rec,
+						int64_t timestamp,
+						uint32_t * code_point,
+						bool * is_end_of_word,
+						bool * is_error)
 {
-	cw_assert (NULL != rec, MSG_PREFIX "reset parameters: receiver is NULL");
+	bool end_of_word = false;
+	bool error = false;
 
-	rec->speed = CW_SPEED_INITIAL;
-	rec->tolerance = CW_TOLERANCE_INITIAL;
-	rec->is_adaptive_receive_mode = CW_REC_ADAPTIVE_MODE_INITIAL;
-	rec->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
+	cw_ret_t cwret = cw_rec_poll_representation_internal(rec, timestamp,
+							     NULL,
+							     &end_of_word, &error);
+	if (CW_SUCCESS != cwret) {
+		return CW_FAILURE;
+	}
 
-	/* FIXME: consider resetting ->gap as well. */
+	const uint32_t looked_up = cw_alphabet_hash_to_code_point_internal(cw_alphabet_tables_internal(rec->alphabet), rec->representation_hash);
+	if (0 == looked_up) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
 
-	rec->parameters_in_sync = false;
+#if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
+	/* See cw_rec_poll_character_internal(). */
+	if (!end_of_word) {
+		rec->is_pending_inter_word_space = true;
+	}
+#endif
 
-	return;
+	if (code_point) {
+		*code_point = looked_up;
+	}
+	if (is_end_of_word) {
+		*is_end_of_word = end_of_word;
+	}
+	if (is_error) {
+		*is_error = error;
+	}
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Synchronize receivers' parameters
+   @brief Classify Space that lasts until @p timestamp, report what has been received
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   Batch-mode counterpart of cw_rec_poll_character_internal(): when
+   the Space turns out to be inter-character-space, the character is
+   reported and receiver moves to RS_EOC_GAP; when the Space turns out
+   to be inter-word-space, ' ' is reported and receiver moves to
+   RS_EOW_GAP. Each of the two is reported only once.
 
    @param[in,out] rec receiver
+   @param[in] timestamp current time [ns]
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
 */
-void cw_rec_sync_parameters_internal(cw_rec_t * rec)
+void cw_rec_process_space_internal(cw_rec_t * rec, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg)
 {
-	cw_assert (NULL != rec, MSG_PREFIX "sync parameters: receiver is NULL");
-
-	/* Do nothing if we are already synchronized. */
-	if (rec->parameters_in_sync) {
+	if (RS_INTER_MARK_SPACE != rec->state
+	    && RS_EOC_GAP != rec->state
+	    && RS_EOC_GAP_ERR != rec->state) {
+		/* Nothing to report, or already reported. */
 		return;
 	}
 
-	/* First, depending on whether we are set for fixed speed or
-	   adaptive speed, calculate either the threshold from the
-	   receive speed, or the receive speed from the threshold,
-	   knowing that the threshold is always, effectively, two dot
-	   durations.  Weighting is ignored for receive parameters,
-	   although the core unit duration is recalculated for the
-	   receive speed, which may differ from the send speed. */
+	/* INT_MAX for Space longer than ~35 minutes is still a good
+	   inter-word-space. */
+	const int space_duration = cw_rec_duration_internal(rec->mark_end, timestamp);
 
-	/* FIXME: shouldn't we move the calculation of unit_duration (that
-	   depends on rec->speed) after the calculation of
-	   rec->speed? */
-	const int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+	cw_rec_sync_parameters_internal(rec);
 
-	if (rec->is_adaptive_receive_mode) {
-		rec->speed = CW_DOT_CALIBRATION	/ ((float) rec->adaptive_speed_threshold / 2.0F);
-	} else {
-		rec->adaptive_speed_threshold = 2 * unit_duration;
+	if (RS_INTER_MARK_SPACE == rec->state) {
+		if (space_duration < rec->ics_duration_min) {
+			/* Still inside of character. */
+			return;
+		}
+		cw_rec_duration_stats_update_internal(rec, CW_REC_STAT_INTER_CHARACTER_SPACE, space_duration);
+		cw_rec_set_state_internal(rec, RS_EOC_GAP);
+
+		const int character = cw_representation_hash_to_character_internal(rec->representation_hash);
+		if (0 != character) {
+			callback_func(callback_arg, rec->mark_end, (char) character, false);
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+				      MSG_PREFIX "'%s': process events: unknown representation '%s'", rec->label, rec->representation);
+		}
+	}
+
+	if (space_duration > rec->ics_duration_max) {
+		const bool is_error = RS_EOC_GAP_ERR == rec->state;
+		cw_rec_set_state_internal(rec, is_error ? RS_EOW_GAP_ERR : RS_EOW_GAP);
+		callback_func(callback_arg, rec->mark_end, ' ', is_error);
 	}
 
+	return;
+}
 
 
-	rec->dot_duration_ideal = unit_duration;
-	rec->dash_duration_ideal = 3 * unit_duration;
-	rec->ims_duration_ideal = unit_duration;
-	rec->ics_duration_ideal = 3 * unit_duration;
 
-	/* These two lines mimic calculations done in
-	   cw_gen_sync_parameters_internal().  See the function for
-	   more comments. */
-	rec->additional_delay = rec->gap * unit_duration;
-	rec->adjustment_delay = (7 * rec->additional_delay) / 3;
 
-	/* Set duration ranges of low level parameters. The duration
-	   ranges depend on whether we are required to adapt to the
-	   incoming Morse code speeds. */
-	if (rec->is_adaptive_receive_mode) {
-		/* Adaptive receiving mode. */
-		rec->dot_duration_min = 0;
-		rec->dot_duration_max = 2 * rec->dot_duration_ideal;
+/**
+   @brief Get all characters that have been received as of given time
 
-		/* Any mark longer than Dot is a Dash in adaptive
-		   receiving mode. */
+   Function returns characters (and inter-word-spaces, as ' ') that
+   became final since previous call of the function, in order in which
+   they have been received. Character that becomes final only at @p
+   timestamp (because the Space after it is already long enough) is
+   returned too, so there is no need to call cw_rec_poll_character_ns()
+   and cw_rec_reset_state().
 
-		/* FIXME: shouldn't this be '= rec->dot_duration_max + 1'?
-		   now the duration ranges for Dot and Dash overlap. */
-		rec->dash_duration_min = rec->dot_duration_max;
-		rec->dash_duration_max = INT_MAX;
+   After first call of the function receiver starts to keep completed
+   characters: beginning of a Mark completes the previous character,
+   so client code may call the function less often than once per
+   character. Receiver keeps up to CW_REC_DRAINED_CAPACITY characters;
+   when there are more of them, the oldest ones are lost.
 
-#if 0
-		int debug_ics_duration_max = rec->ics_duration_max;
-#endif
+   When there are more characters than @p capacity, the remaining
+   ones are returned by next call.
 
-		/* Make the inter-mark-space be anything up to the
-		   adaptive threshold durations - that is two Dots.  And
-		   the inter-character-space is anything longer than
-		   that, and shorter than five Dots. */
-		rec->ims_duration_min = rec->dot_duration_min;
-		rec->ims_duration_max = rec->dot_duration_max;
-		rec->ics_duration_min = rec->ims_duration_max;
-		rec->ics_duration_max = 5 * rec->dot_duration_ideal;
+   Representations that don't match any character are not returned
+   (but inter-word-space after them is returned with is_error set).
 
-#if 0
-		if (debug_ics_duration_max != rec->ics_duration_max) {
-			fprintf(stderr, "ics_duration_max changed from %d to %d --------\n", debug_ics_duration_max, rec->ics_duration_max);
-		}
-#endif
+   @exception EINVAL @p n_outputs is NULL, or @p outputs is NULL and @p capacity is not zero
 
-	} else {
-		/* Fixed speed receiving mode. */
+   @param[in,out] rec receiver
+   @param[in] timestamp current time [ns]
+   @param[out] outputs array for received characters
+   @param[in] capacity count of items in @p outputs
+   @param[out] n_outputs count of characters written to @p outputs
 
-		int tolerance = (rec->dot_duration_ideal * rec->tolerance) / 100; /* [%] */
-		rec->dot_duration_min = rec->dot_duration_ideal - tolerance;
-		rec->dot_duration_max = rec->dot_duration_ideal + tolerance;
-		rec->dash_duration_min = rec->dash_duration_ideal - tolerance;
-		rec->dash_duration_max = rec->dash_duration_ideal + tolerance;
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_poll_characters_ns(cw_rec_t * rec, int64_t timestamp, cw_rec_output_t * outputs, size_t capacity, size_t * n_outputs)
+{
+	if (NULL == n_outputs || (NULL == outputs && capacity > 0) || timestamp < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-		/* Make the inter-mark-space the same as the dot
-		   duration range. */
-		rec->ims_duration_min = rec->dot_duration_min;
-		rec->ims_duration_max = rec->dot_duration_max;
+	pthread_mutex_lock(&rec->mutex);
 
-		/* Make the inter-character-space, expected to be
-		   three dots, the same as dash duration range at the
-		   lower end, but make it the same as the dash duration
-		   range _plus_ the "Farnsworth" delay at the top of
-		   the duration range. */
-		rec->ics_duration_min = rec->dash_duration_min;
-		rec->ics_duration_max = rec->dash_duration_max
-			+ rec->additional_delay + rec->adjustment_delay;
+	rec->is_draining = true;
+	cw_rec_process_space_internal(rec, timestamp, cw_rec_drain_append_internal, rec);
 
-		/* Any space longer than ics_duration_max is by implication
-		   inter-word-space. */
+	size_t n = 0;
+	while (n < capacity && rec->drained_count > 0) {
+		outputs[n++] = rec->drained[rec->drained_head];
+		rec->drained_head = (rec->drained_head + 1) % CW_REC_DRAINED_CAPACITY;
+		rec->drained_count--;
 	}
+	*n_outputs = n;
 
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_INFO,
-		      MSG_PREFIX "'%s': sync parameters: receiver timings [us] at speed %.2f [wpm]:\n"
-		      "[II] " MSG_PREFIX "    dot:    min: %11d   max: %11d\n"
-		      "[II] " MSG_PREFIX "    dash:   min: %11d   max: %11d\n"
-		      "[II] " MSG_PREFIX "    ims:    min: %11d   max: %11d   ideal: %11d\n"
-		      "[II] " MSG_PREFIX "    ics:    min: %11d   max: %11d   ideal: %11d\n"
-		      "[II] " MSG_PREFIX "    thres:       %11d",
+	pthread_mutex_unlock(&rec->mutex);
 
-		      rec->label,
-		      (double) rec->speed, /* Casting to double to avoid compiler warning about implicit conversion from float to double. */
-		      rec->dot_duration_min, rec->dot_duration_max,
-		      rec->dash_duration_min, rec->dash_duration_max,
-		      rec->ims_duration_min, rec->ims_duration_max, rec->ims_duration_ideal,
-		      rec->ics_duration_min, rec->ics_duration_max, rec->ics_duration_ideal,
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Keep completed character for cw_rec_poll_characters_ns()
+
+   Function has signature of cw_rec_output_callback_t.
+
+   @param[in,out] arg receiver
+   @param[in] timestamp end of last Mark of character [ns]
+   @param[in] character received character, or ' '
+   @param[in] is_error whether there was an error during receiving
+*/
+static void cw_rec_drain_append_internal(void * arg, int64_t timestamp, char character, bool is_error)
+{
+	cw_rec_t * rec = (cw_rec_t *) arg;
+
+	if (CW_REC_DRAINED_CAPACITY == rec->drained_count) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "'%s': drain: buffer full, dropping oldest character", rec->label);
+		rec->drained_head = (rec->drained_head + 1) % CW_REC_DRAINED_CAPACITY;
+		rec->drained_count--;
+	}
+
+	cw_rec_output_t * output = &rec->drained[(rec->drained_head + rec->drained_count) % CW_REC_DRAINED_CAPACITY];
+	output->timestamp = timestamp;
+	output->character = character;
+	output->is_error = is_error;
+	rec->drained_count++;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Register function to be called when character or inter-word-space is received
+
+   With the callback registered, client code doesn't have to poll the
+   receiver. Receiver starts a timer at each end of Mark, and calls @p
+   callback_func as soon as the Space after the Mark turns out to be
+   inter-character-space (with received character) and, later, when
+   the Space turns out to be inter-word-space (with ' ').
+
+   The Spaces are measured with monotonic clock from the moment when
+   end of Mark has been reported to receiver, so end of Mark should be
+   reported without delay.
+
+   @p callback_func is called from thread of library's internal timer,
+   or from a thread calling cw_rec_mark_begin() (a character whose
+   timer hasn't fired yet is reported right before next Mark). The
+   receiver is locked during the call; the callback may call
+   receiver's functions, but shouldn't block. Beginning of a Mark
+   resets state of receiver that has reported a character, so there
+   is no need to call cw_rec_reset_state().
+
+   Pass NULL as @p callback_func to unregister the callback. When
+   this function returns, the old callback is not running and won't
+   be called (unless the function is called from the callback).
+
+   @exception ENOSYS library's internal timer is not available
+
+   @param[in,out] rec receiver
+   @param[in] callback_func function to be called, or NULL
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_register_output_callback(cw_rec_t * rec, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (callback_func) {
+		/* Timer service starts on first use; check now if it
+		   can be used at all. */
+		const int timer_id = cw_timer_start_internal(CW_USECS_PER_SEC, cw_rec_output_timer_callback_internal, NULL);
+		if (-1 == timer_id) {
+			errno = ENOSYS;
+			return CW_FAILURE;
+		}
+		cw_timer_cancel_internal(timer_id);
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+	rec->output_callback = callback_func;
+	rec->output_callback_arg = callback_arg;
+	if (-1 != rec->output_timer_id) {
+		cw_timer_cancel_internal(rec->output_timer_id);
+		rec->output_timer_id = -1;
+	}
+	if ((callback_func || -1 != rec->event_fd) && RS_IDLE != rec->state && RS_MARK != rec->state) {
+		/* Time of end of last Mark is unknown, measure the
+		   Space from now. */
+		cw_rec_output_arm_internal(rec, true);
+	}
+	pthread_mutex_unlock(&rec->mutex);
+
+	if (NULL == callback_func) {
+		/* Timer's callback may be already waiting for the
+		   mutex. */
+		cw_timer_wait_for_callbacks_internal(rec);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Report pending character before a new Mark
+
+   Timer of output callback may not have fired yet when next Mark
+   begins. Report what's pending, and reset the receiver if it has
+   already reported a character, so that the new Mark can start a new
+   character.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of beginning of the Mark [ns]
+*/
+void cw_rec_output_mark_begin_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	if (rec->is_draining && timestamp >= 0) {
+		/* Character completed by this Mark waits for
+		   cw_rec_poll_characters_ns(). */
+		cw_rec_process_space_internal(rec, timestamp, cw_rec_drain_append_internal, rec);
+		if (RS_IDLE != rec->state && RS_INTER_MARK_SPACE != rec->state && RS_MARK != rec->state) {
+			cw_rec_reset_state(rec);
+		}
+	}
+
+	if (NULL == rec->output_callback && -1 == rec->event_fd) {
+		return;
+	}
+
+	if (-1 != rec->output_timer_id) {
+		cw_timer_cancel_internal(rec->output_timer_id);
+		rec->output_timer_id = -1;
+	}
+	if (NULL == rec->output_callback) {
+		/* Only event descriptor: characters are taken from
+		   receiver by client code's polling. */
+		return;
+	}
+	if (timestamp >= 0) {
+		cw_rec_process_space_internal(rec, timestamp, cw_rec_output_dispatch_internal, rec);
+	}
+	if (RS_IDLE != rec->state && RS_INTER_MARK_SPACE != rec->state && RS_MARK != rec->state) {
+		cw_rec_reset_state(rec);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Start timer of output callback
+
+   The timer fires when Space that started at last end of Mark becomes
+   long enough to be classified as next type of Space.
+
+   @param[in,out] rec receiver
+   @param[in] is_end_of_mark whether end of Mark has been just reported to receiver
+*/
+void cw_rec_output_arm_internal(cw_rec_t * rec, bool is_end_of_mark)
+{
+	if (NULL == rec->output_callback && -1 == rec->event_fd) {
+		return;
+	}
+
+	const int64_t now = cw_rec_clock_internal();
+	if (is_end_of_mark) {
+		rec->output_mark_end_clock = now;
+		rec->output_event_stage = 0;
+	}
+	const int space_duration = cw_rec_duration_internal(rec->output_mark_end_clock, now);
+
+	cw_rec_sync_parameters_internal(rec);
+	int until = 0;
+	if (NULL == rec->output_callback) {
+		/* Receiver's state is changed only by client's polling,
+		   so look at what has been already signalled. */
+		if (0 == rec->output_event_stage) {
+			until = rec->ics_duration_min;
+		} else if (1 == rec->output_event_stage) {
+			until = rec->ics_duration_max + 1;
+		} else {
+			return;
+		}
+	} else if (RS_INTER_MARK_SPACE == rec->state) {
+		until = rec->ics_duration_min;
+	} else if (RS_EOC_GAP == rec->state || RS_EOC_GAP_ERR == rec->state) {
+		until = rec->ics_duration_max + 1;
+	} else {
+		return;
+	}
+
+	const int usecs = until > space_duration ? until - space_duration : 1;
+	rec->output_timer_id = cw_timer_start_internal(usecs, cw_rec_output_timer_callback_internal, rec);
+	if (-1 == rec->output_timer_id) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s': failed to start timer of output callback", rec->label);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Timer callback: report complete character or inter-word-space
+
+   Called by library's internal timer. Timer may be stale (e.g. a new
+   Mark has begun in the meantime), but cw_rec_process_space_internal()
+   reports each character and each inter-word-space only once.
+
+   @param[in] arg receiver
+*/
+void cw_rec_output_timer_callback_internal(void * arg)
+{
+	cw_rec_t * rec = (cw_rec_t *) arg;
+	if (NULL == rec) {
+		/* Timer started only to see if timers are available. */
+		return;
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+	rec->output_timer_id = -1;
+	if (rec->output_callback) {
+		/* Current time, in domain of receiver's timestamps. */
+		const int64_t elapsed = cw_rec_clock_internal() - rec->output_mark_end_clock;
+		const int64_t timestamp = rec->mark_end + elapsed;
+
+		cw_rec_process_space_internal(rec, timestamp, cw_rec_output_dispatch_internal, rec);
+		if (NULL != rec->output_callback && -1 == rec->output_timer_id) {
+			cw_rec_output_arm_internal(rec, false);
+		}
+	} else if (-1 != rec->event_fd) {
+		cw_rec_output_events_internal(rec);
+	}
+	pthread_mutex_unlock(&rec->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Pass received character to output callback and to event descriptor
+
+   @param[in] arg receiver
+   @param[in] timestamp timestamp of end of last Mark of character [ns]
+   @param[in] character received character, or ' ' for inter-word-space
+   @param[in] is_error whether receiver is in error state
+*/
+void cw_rec_output_dispatch_internal(void * arg, int64_t timestamp, char character, bool is_error)
+{
+	cw_rec_t * rec = (cw_rec_t *) arg;
+	rec->output_callback(rec->output_callback_arg, timestamp, character, is_error);
+	cw_rec_signal_event_internal(rec);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Timer callback for receiver with event descriptor but without output callback
+
+   Signal the descriptor when current Space becomes long enough for
+   client's poll to return a character, and later an inter-word-space.
+   Receiver's state is not modified.
+
+   @param[in,out] rec receiver
+*/
+void cw_rec_output_events_internal(cw_rec_t * rec)
+{
+	if (RS_IDLE == rec->state || RS_MARK == rec->state) {
+		/* Stale timer, or receiver has been reset by client code. */
+		return;
+	}
+
+	const int space_duration = cw_rec_duration_internal(rec->output_mark_end_clock, cw_rec_clock_internal());
+	cw_rec_sync_parameters_internal(rec);
+
+	const int stage_before = rec->output_event_stage;
+	if (0 == rec->output_event_stage && space_duration >= rec->ics_duration_min) {
+		rec->output_event_stage = 1;
+	}
+	if (1 == rec->output_event_stage && space_duration > rec->ics_duration_max) {
+		rec->output_event_stage = 2;
+	}
+	if (stage_before != rec->output_event_stage) {
+		cw_rec_signal_event_internal(rec);
+	}
+
+	cw_rec_output_arm_internal(rec, false);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Signal receiver's event descriptor
+
+   @param[in] rec receiver
+*/
+void cw_rec_signal_event_internal(cw_rec_t * rec)
+{
+	if (-1 == rec->event_fd) {
+		return;
+	}
+
+	const uint64_t one = 1;
+	if (sizeof (one) != write(rec->event_fd, &one, sizeof (one))) {
+		/* EAGAIN: counter is saturated, descriptor is readable anyway. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_DEBUG,
+			      MSG_PREFIX "'%s': failed to signal event descriptor", rec->label);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get descriptor that becomes readable when character is received
+
+   The descriptor (eventfd) is signalled by receiver's timer as soon
+   as a character, and later an inter-word-space, is complete. This is
+   the moment when cw_rec_poll_character() called by client code
+   starts returning data, so client code can watch the descriptor in
+   its main loop instead of polling the receiver with a timer. Read
+   the descriptor's 8-byte counter to reset it before polling.
+
+   If output callback is registered (see
+   cw_rec_register_output_callback()), the descriptor is signalled
+   after each call of the callback.
+
+   The descriptor is non-blocking, is created on first call, and is
+   closed by cw_rec_delete(). As with output callback, end of Mark
+   should be reported to receiver without delay.
+
+   @exception ENOSYS event descriptors or library's internal timer are not available
+
+   @param[in,out] rec receiver
+
+   @return file descriptor on success
+   @return -1 on failure
+*/
+int cw_rec_get_event_fd(cw_rec_t * rec)
+{
+#if defined(__linux__)
+	/* Descriptor is signalled from library's internal timer. */
+	const int timer_id = cw_timer_start_internal(CW_USECS_PER_SEC, cw_rec_output_timer_callback_internal, NULL);
+	if (-1 == timer_id) {
+		errno = ENOSYS;
+		return -1;
+	}
+	cw_timer_cancel_internal(timer_id);
+
+	pthread_mutex_lock(&rec->mutex);
+	if (-1 == rec->event_fd) {
+		rec->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (-1 == rec->event_fd) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "'%s': failed to create event descriptor: %s", rec->label, strerror(errno));
+		} else if (NULL == rec->output_callback && -1 == rec->output_timer_id
+			   && RS_IDLE != rec->state && RS_MARK != rec->state) {
+			/* Time of end of last Mark is unknown, measure the
+			   Space from now. */
+			cw_rec_output_arm_internal(rec, true);
+		}
+	}
+	const int fd = rec->event_fd;
+	pthread_mutex_unlock(&rec->mutex);
+
+	return fd;
+#else
+	(void) rec;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+
+
+
+/**
+   @brief Get current time of monotonic clock
+
+   The clock may be replaced by tests, see cw_clock_set_internal().
+
+   @return current time [ns]
+*/
+int64_t cw_rec_clock_internal(void)
+{
+	return cw_clock_now_internal();
+}
+
+
+
+
+/**
+   @brief Convert timestamp passed to receiver's timeval-based function into nanoseconds
+
+   @p timestamp is validated with cw_timestamp_validate_internal(). If
+   it is NULL, current time of wall clock is used.
+
+   @param[in] timestamp timestamp to convert (may be NULL)
+
+   @return the timestamp in nanoseconds
+   @return -1 if @p timestamp is invalid
+*/
+static int64_t cw_rec_timeval_to_ns_internal(const struct timeval * timestamp)
+{
+	struct timeval tv = { 0 };
+	if (CW_SUCCESS != cw_timestamp_validate_internal(&tv, timestamp)) {
+		return -1;
+	}
+	return (int64_t) tv.tv_sec * 1000000000 + (int64_t) tv.tv_usec * 1000;
+}
+
+
+
+
+/**
+   @brief Calculate duration between two receiver's timestamps
+
+   Like cw_timestamp_compare_internal(), the function returns INT_MAX
+   if the duration doesn't fit into int, or if @p later is earlier
+   than @p earlier.
+
+   @param[in] earlier earlier timestamp [ns]
+   @param[in] later later timestamp [ns]
+
+   @return duration between timestamps [us]
+*/
+static int cw_rec_duration_internal(int64_t earlier, int64_t later)
+{
+	const int64_t delta = (later - earlier) / 1000;
+	if (delta < 0 || delta > INT_MAX) {
+		return INT_MAX;
+	}
+	return (int) delta;
+}
+
+
+
+
+/**
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+*/
+void cw_rec_reset_state(cw_rec_t * rec)
+{
+	pthread_mutex_lock(&rec->mutex);
+
+	rec->representation[0] = '\0';
+	rec->representation_ind = 0;
+	rec->representation_hash = 1; /* Sentinel bit, see cw_representation_to_hash_internal(). */
+
+#if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
+	rec->is_pending_inter_word_space = false;
+#endif
+
+	cw_rec_set_state_internal(rec, RS_IDLE);
+
+	pthread_mutex_unlock(&rec->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get the number of Marks (Dots/Dashes) the receiver's buffer can accommodate
+
+   The value returned by this function is the maximum number of Marks written
+   out by cw_rec_poll_representation() (not including terminating NUL).
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @return number of Marks that can be stored in receiver's representation buffer
+*/
+int cw_rec_get_receive_buffer_capacity_internal(void)
+{
+	return CW_REC_REPRESENTATION_CAPACITY;
+}
+
+
+
+
+/**
+   @brief Get number of Marks (Dots and Dashes) currently stored in receiver's representation buffer
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @param[in] rec receiver from which to get current number of Marks
+*/
+int cw_rec_get_buffer_length_internal(const cw_rec_t * rec)
+{
+	return rec->representation_ind;
+}
+
+
+
+
+/**
+   @brief Reset receiver's essential parameters to their initial values
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @param[in,out] rec receiver
+*/
+void cw_rec_reset_parameters_internal(cw_rec_t * rec)
+{
+	cw_assert (NULL != rec, MSG_PREFIX "reset parameters: receiver is NULL");
+
+	rec->speed = CW_SPEED_INITIAL;
+	rec->tolerance = CW_TOLERANCE_INITIAL;
+	rec->is_adaptive_receive_mode = CW_REC_ADAPTIVE_MODE_INITIAL;
+	rec->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
+
+	/* FIXME: consider resetting ->gap as well. */
+
+	rec->parameters_in_sync = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Synchronize receivers' parameters
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @param[in,out] rec receiver
+*/
+void cw_rec_sync_parameters_internal(cw_rec_t * rec)
+{
+	cw_assert (NULL != rec, MSG_PREFIX "sync parameters: receiver is NULL");
+
+	/* Do nothing if we are already synchronized. */
+	if (rec->parameters_in_sync) {
+		return;
+	}
+
+	/* First, depending on whether we are set for fixed speed or
+	   adaptive speed, calculate either the threshold from the
+	   receive speed, or the receive speed from the threshold,
+	   knowing that the threshold is always, effectively, two dot
+	   durations.  Weighting is ignored for receive parameters,
+	   although the core unit duration is recalculated for the
+	   receive speed, which may differ from the send speed. */
+
+	/* FIXME: shouldn't we move the calculation of unit_duration (that
+	   depends on rec->speed) after the calculation of
+	   rec->speed? */
+	const int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+
+	/* Set ideal durations, delays and duration ranges of low level
+	   parameters. The duration ranges depend on whether we are
+	   required to adapt to the incoming Morse code speeds. */
+	if (rec->is_adaptive_receive_mode) {
+		/* Adaptive receiving mode. */
+		rec->speed = CW_DOT_CALIBRATION	/ ((float) rec->adaptive_speed_threshold / 2.0F);
+		cw_rec_sync_adaptive_durations_internal(rec, unit_duration);
+
+	} else {
+		/* Fixed speed receiving mode. */
+		rec->adaptive_speed_threshold = 2 * unit_duration;
+
+		rec->dot_duration_ideal = unit_duration;
+		rec->dash_duration_ideal = 3 * unit_duration;
+		rec->ims_duration_ideal = unit_duration;
+		rec->ics_duration_ideal = 3 * unit_duration;
+
+		/* These two lines mimic calculations done in
+		   cw_gen_sync_parameters_internal().  See the function for
+		   more comments. */
+		rec->additional_delay = rec->gap * unit_duration;
+		rec->adjustment_delay = (7 * rec->additional_delay) / 3;
+
+		int tolerance = (rec->dot_duration_ideal * rec->tolerance) / 100; /* [%] */
+		rec->dot_duration_min = rec->dot_duration_ideal - tolerance;
+		rec->dot_duration_max = rec->dot_duration_ideal + tolerance;
+		rec->dash_duration_min = rec->dash_duration_ideal - tolerance;
+		rec->dash_duration_max = rec->dash_duration_ideal + tolerance;
+
+		/* Make the inter-mark-space the same as the dot
+		   duration range. */
+		rec->ims_duration_min = rec->dot_duration_min;
+		rec->ims_duration_max = rec->dot_duration_max;
+
+		/* Make the inter-character-space, expected to be
+		   three dots, the same as dash duration range at the
+		   lower end, but make it the same as the dash duration
+		   range _plus_ the "Farnsworth" delay at the top of
+		   the duration range. */
+		rec->ics_duration_min = rec->dash_duration_min;
+		rec->ics_duration_max = rec->dash_duration_max
+			+ rec->additional_delay + rec->adjustment_delay;
+
+		/* Any space longer than ics_duration_max is by implication
+		   inter-word-space. */
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_INFO,
+		      MSG_PREFIX "'%s': sync parameters: receiver timings [us] at speed %.2f [wpm]:\n"
+		      "[II] " MSG_PREFIX "    dot:    min: %11d   max: %11d\n"
+		      "[II] " MSG_PREFIX "    dash:   min: %11d   max: %11d\n"
+		      "[II] " MSG_PREFIX "    ims:    min: %11d   max: %11d   ideal: %11d\n"
+		      "[II] " MSG_PREFIX "    ics:    min: %11d   max: %11d   ideal: %11d\n"
+		      "[II] " MSG_PREFIX "    thres:       %11d",
+
+		      rec->label,
+		      (double) rec->speed, /* Casting to double to avoid compiler warning about implicit conversion from float to double. */
+		      rec->dot_duration_min, rec->dot_duration_max,
+		      rec->dash_duration_min, rec->dash_duration_max,
+		      rec->ims_duration_min, rec->ims_duration_max, rec->ims_duration_ideal,
+		      rec->ics_duration_min, rec->ics_duration_max, rec->ics_duration_ideal,
 		      rec->adaptive_speed_threshold);
 
-	/* Receiver parameters are now in sync. */
-	rec->parameters_in_sync = true;
+	/* Receiver parameters are now in sync. */
+	rec->parameters_in_sync = true;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set durations of adaptive receiver derived from unit duration
+
+   Set ideal durations, delays and duration ranges of receiver in
+   adaptive receiving mode. These are the only parameters (besides
+   speed and adaptive threshold) that change when averages of Marks
+   are updated, so cw_rec_update_averages_internal() calls this
+   function directly instead of calling full
+   cw_rec_sync_parameters_internal() for each received Mark.
+
+   @param[in,out] rec receiver in adaptive receiving mode
+   @param[in] unit_duration duration of unit (Dot) [us]
+*/
+void cw_rec_sync_adaptive_durations_internal(cw_rec_t * rec, int unit_duration)
+{
+	rec->dot_duration_ideal = unit_duration;
+	rec->dash_duration_ideal = 3 * unit_duration;
+	rec->ims_duration_ideal = unit_duration;
+	rec->ics_duration_ideal = 3 * unit_duration;
+
+	/* These two lines mimic calculations done in
+	   cw_gen_sync_parameters_internal().  See the function for
+	   more comments. */
+	rec->additional_delay = rec->gap * unit_duration;
+	rec->adjustment_delay = (7 * rec->additional_delay) / 3;
+
+	rec->dot_duration_min = 0;
+	rec->dot_duration_max = 2 * rec->dot_duration_ideal;
+
+	/* Any mark longer than Dot is a Dash in adaptive receiving
+	   mode. */
+
+	/* FIXME: shouldn't this be '= rec->dot_duration_max + 1'?  now
+	   the duration ranges for Dot and Dash overlap. */
+	rec->dash_duration_min = rec->dot_duration_max;
+	rec->dash_duration_max = INT_MAX;
+
+	/* Make the inter-mark-space be anything up to the adaptive
+	   threshold durations - that is two Dots.  And the
+	   inter-character-space is anything longer than that, and
+	   shorter than five Dots. */
+	rec->ims_duration_min = rec->dot_duration_min;
+	rec->ims_duration_max = rec->dot_duration_max;
+	rec->ics_duration_min = rec->ims_duration_max;
+	rec->ics_duration_max = 5 * rec->dot_duration_ideal;
+
+	return;
+}
+
+
+
+/**
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+*/
+int cw_rec_set_label(cw_rec_t * rec, const char * label)
+{
+	if (NULL == rec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'rec' argument is NULL");
+		return CW_FAILURE;
+	}
+	if (NULL == label) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s': 'label' argument is NULL", rec->label);
+		return CW_FAILURE;
+	}
+	if (strlen(label) > (LIBCW_OBJECT_INSTANCE_LABEL_SIZE - 1)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_WARNING,
+			      MSG_PREFIX "'%s': new label '%s' too long, truncating", rec->label, label);
+		/* Not an error, just log warning. New label will be truncated. */
+	}
+
+	/* Notice that empty label is acceptable. In such case we will
+	   erase old label. */
+
+	snprintf(rec->label, sizeof (rec->label), "%s", label);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+*/
+int cw_rec_get_label(const cw_rec_t * rec, char * label, size_t size)
+{
+	if (NULL == rec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'rec' argument is NULL");
+		return CW_FAILURE;
+	}
+	if (NULL == label) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s': 'label' argument is NULL", rec->label);
+		return CW_FAILURE;
+	}
+
+	/* Notice that we don't care if size is zero. */
+
+	snprintf(label, size, "%s", rec->label);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/* Format of snapshot of receiver. The format is little-endian, and
+   version is incremented whenever the format changes. */
+#define CW_REC_SNAPSHOT_MAGIC "CWRS"
+enum { CW_REC_SNAPSHOT_VERSION = 1 };
+
+/* Size of snapshot without representation (which has variable
+   length). */
+enum { CW_REC_SNAPSHOT_FIXED_SIZE =
+       4 + 2                          /* Magic, version. */
+       + 1 + 4 + 4 + 4 + 1 + 4 + 4   /* State, essential parameters, threshold. */
+       + 8 + 8                        /* Timestamps of Mark. */
+       + 2 + 4                        /* Length and hash of representation. */
+       + 14 * 4 + 1                   /* Low-level timing parameters. */
+       + 2 * (CW_REC_AVERAGING_DURATIONS_COUNT + 1) * 4
+       + 4 + CW_REC_DURATION_STATS_CAPACITY * (1 + 4) };
+
+
+
+
+/**
+   @brief Save state of receiver
+
+   Write to @p buffer a snapshot of receiver's state: essential and
+   low-level parameters, adaptive tracking of speed, timing statistics,
+   state of receiver and partially received representation. The
+   snapshot can be passed to cw_rec_restore(), e.g. to continue
+   reception in receiver of other thread, or to restore speed of a
+   signal that has been received earlier.
+
+   Buffer of CW_REC_SNAPSHOT_SIZE_MAX bytes is always large enough.
+
+   @exception EINVAL NULL argument
+   @exception ENOSPC @p buffer is too small
+
+   @param[in] rec receiver
+   @param[out] buffer buffer for snapshot
+   @param[in] size size of @p buffer
+   @param[out] n_bytes count of bytes written to @p buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_snapshot(cw_rec_t * rec, uint8_t * buffer, size_t size, size_t * n_bytes)
+{
+	if (NULL == rec || NULL == buffer || NULL == n_bytes) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+
+	const size_t needed = CW_REC_SNAPSHOT_FIXED_SIZE + (size_t) rec->representation_ind;
+	if (size < needed) {
+		pthread_mutex_unlock(&rec->mutex);
+		errno = ENOSPC;
+		return CW_FAILURE;
+	}
+
+	uint32_t speed_bits = 0;
+	memcpy(&speed_bits, &rec->speed, sizeof (speed_bits));
+
+	memcpy(buffer, CW_REC_SNAPSHOT_MAGIC, 4);
+	uint8_t * cursor = buffer + 4;
+	cursor = cw_rec_snapshot_put_internal(cursor, CW_REC_SNAPSHOT_VERSION, 2);
+
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->state, 1);
+	cursor = cw_rec_snapshot_put_internal(cursor, speed_bits, 4);
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->tolerance, 4);
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->gap, 4);
+	cursor = cw_rec_snapshot_put_internal(cursor, rec->is_adaptive_receive_mode, 1);
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->noise_spike_threshold, 4);
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->adaptive_speed_threshold, 4);
+
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->mark_start, 8);
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->mark_end, 8);
+
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->representation_ind, 2);
+	cursor = cw_rec_snapshot_put_internal(cursor, rec->representation_hash, 4);
+	memcpy(cursor, rec->representation, (size_t) rec->representation_ind);
+	cursor += rec->representation_ind;
+
+	const int timings[14] = {
+		rec->dot_duration_ideal, rec->dot_duration_min, rec->dot_duration_max,
+		rec->dash_duration_ideal, rec->dash_duration_min, rec->dash_duration_max,
+		rec->ims_duration_ideal, rec->ims_duration_min, rec->ims_duration_max,
+		rec->ics_duration_ideal, rec->ics_duration_min, rec->ics_duration_max,
+		rec->additional_delay, rec->adjustment_delay };
+	for (int i = 0; i < 14; i++) {
+		cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) timings[i], 4);
+	}
+	cursor = cw_rec_snapshot_put_internal(cursor, rec->parameters_in_sync, 1);
+
+	const cw_rec_averaging_t * averagings[2] = { &rec->dot_averaging, &rec->dash_averaging };
+	for (int a = 0; a < 2; a++) {
+		for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+			cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) averagings[a]->buffer[i], 4);
+		}
+		cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) averagings[a]->cursor, 4);
+	}
+
+	cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->duration_stats_idx, 4);
+	for (int i = 0; i < CW_REC_DURATION_STATS_CAPACITY; i++) {
+		cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->duration_stats[i].type, 1);
+		cursor = cw_rec_snapshot_put_internal(cursor, (uint64_t) rec->duration_stats[i].duration_delta, 4);
+	}
+
+	pthread_mutex_unlock(&rec->mutex);
+
+	*n_bytes = (size_t) (cursor - buffer);
+	cw_assert (*n_bytes == needed, MSG_PREFIX "snapshot: size mismatch: %zu != %zu", *n_bytes, needed);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Restore state of receiver from snapshot
+
+   Replace state of @p rec with state saved by cw_rec_snapshot(). The
+   snapshot may come from other receiver. Label, output callback and
+   event descriptor of @p rec are not changed. Timestamps of Marks
+   are restored as they are, so reception continues on the same
+   timeline as the one of receiver from which the snapshot was taken.
+
+   @p rec is not modified if the snapshot is invalid.
+
+   @exception EINVAL NULL argument, or invalid snapshot (unknown version, truncated or corrupted data)
+   @exception ENOMEM allocation error
+
+   @param[in,out] rec receiver
+   @param[in] buffer snapshot
+   @param[in] n_bytes size of snapshot
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_restore(cw_rec_t * rec, const uint8_t * buffer, size_t n_bytes)
+{
+	if (NULL == rec || NULL == buffer) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* First validate the snapshot by decoding it into scratch
+	   receiver, so that @p rec isn't left half-restored. */
+	cw_rec_t * scratch = (cw_rec_t *) calloc(1, sizeof (cw_rec_t));
+	if (NULL == scratch) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	const cw_ret_t valid = cw_rec_snapshot_decode_internal(scratch, buffer, n_bytes);
+	free(scratch);
+	if (CW_SUCCESS != valid) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s': restore: invalid snapshot", rec->label);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&rec->mutex);
+	cw_rec_snapshot_decode_internal(rec, buffer, n_bytes);
+	/* Space after last Mark (if any) is measured by output timer
+	   from now on. */
+	cw_rec_output_arm_internal(rec, true);
+	pthread_mutex_unlock(&rec->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Decode snapshot of receiver into receiver
+
+   @p rec may be modified even if the snapshot turns out to be invalid.
+
+   @param[out] rec receiver
+   @param[in] buffer snapshot
+   @param[in] n_bytes size of snapshot
+
+   @return CW_SUCCESS if snapshot is valid
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_snapshot_decode_internal(cw_rec_t * rec, const uint8_t * buffer, size_t n_bytes)
+{
+	if (n_bytes < CW_REC_SNAPSHOT_FIXED_SIZE || 0 != memcmp(buffer, CW_REC_SNAPSHOT_MAGIC, 4)) {
+		return CW_FAILURE;
+	}
+	const uint8_t * cursor = buffer + 4;
+	if (CW_REC_SNAPSHOT_VERSION != cw_rec_snapshot_get_internal(&cursor, 2)) {
+		return CW_FAILURE;
+	}
+
+	const uint64_t state = cw_rec_snapshot_get_internal(&cursor, 1);
+	const uint32_t speed_bits = (uint32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	memcpy(&rec->speed, &speed_bits, sizeof (speed_bits));
+	rec->tolerance = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	rec->gap = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	rec->is_adaptive_receive_mode = 0 != cw_rec_snapshot_get_internal(&cursor, 1);
+	rec->noise_spike_threshold = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	rec->adaptive_speed_threshold = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	if (state > RS_EOW_GAP_ERR
+	    || !(rec->speed >= CW_SPEED_MIN && rec->speed <= CW_SPEED_MAX)
+	    || rec->tolerance < CW_TOLERANCE_MIN || rec->tolerance > CW_TOLERANCE_MAX
+	    || rec->gap < CW_GAP_MIN || rec->gap > CW_GAP_MAX
+	    || rec->noise_spike_threshold < 0
+	    || rec->adaptive_speed_threshold <= 0) {
+		return CW_FAILURE;
+	}
+	rec->state = (cw_rec_state_t) state;
+
+	rec->mark_start = (int64_t) cw_rec_snapshot_get_internal(&cursor, 8);
+	rec->mark_end = (int64_t) cw_rec_snapshot_get_internal(&cursor, 8);
+
+	const int representation_ind = (int) cw_rec_snapshot_get_internal(&cursor, 2);
+	rec->representation_hash = (unsigned int) cw_rec_snapshot_get_internal(&cursor, 4);
+	if (representation_ind > CW_REC_REPRESENTATION_CAPACITY - 1
+	    || n_bytes != CW_REC_SNAPSHOT_FIXED_SIZE + (size_t) representation_ind) {
+		return CW_FAILURE;
+	}
+	for (int i = 0; i < representation_ind; i++) {
+		const char mark = (char) *cursor++;
+		if (CW_DOT_REPRESENTATION != mark && CW_DASH_REPRESENTATION != mark) {
+			return CW_FAILURE;
+		}
+		rec->representation[i] = mark;
+	}
+	rec->representation[representation_ind] = '\0';
+	rec->representation_ind = representation_ind;
+
+	/* Speed has already been acquired by receiver that made the
+	   snapshot. */
+	rec->acquisition_count = CW_REC_ACQUISITION_DONE;
+
+	int * timings[14] = {
+		&rec->dot_duration_ideal, &rec->dot_duration_min, &rec->dot_duration_max,
+		&rec->dash_duration_ideal, &rec->dash_duration_min, &rec->dash_duration_max,
+		&rec->ims_duration_ideal, &rec->ims_duration_min, &rec->ims_duration_max,
+		&rec->ics_duration_ideal, &rec->ics_duration_min, &rec->ics_duration_max,
+		&rec->additional_delay, &rec->adjustment_delay };
+	for (int i = 0; i < 14; i++) {
+		*timings[i] = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	}
+	rec->parameters_in_sync = 0 != cw_rec_snapshot_get_internal(&cursor, 1);
+
+	cw_rec_averaging_t * averagings[2] = { &rec->dot_averaging, &rec->dash_averaging };
+	for (int a = 0; a < 2; a++) {
+		averagings[a]->sum = 0;
+		for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+			averagings[a]->buffer[i] = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+			averagings[a]->sum += averagings[a]->buffer[i];
+		}
+		averagings[a]->average = averagings[a]->sum / CW_REC_AVERAGING_DURATIONS_COUNT;
+		averagings[a]->cursor = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+		if (averagings[a]->cursor < 0 || averagings[a]->cursor >= CW_REC_AVERAGING_DURATIONS_COUNT) {
+			return CW_FAILURE;
+		}
+	}
+
+	/* Running sums of statistics are recalculated. */
+	rec->duration_stats_idx = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+	if (rec->duration_stats_idx < 0 || rec->duration_stats_idx >= CW_REC_DURATION_STATS_CAPACITY) {
+		return CW_FAILURE;
+	}
+	memset(rec->duration_stats_sum_of_squares, 0, sizeof (rec->duration_stats_sum_of_squares));
+	memset(rec->duration_stats_count, 0, sizeof (rec->duration_stats_count));
+	for (int i = 0; i < CW_REC_DURATION_STATS_CAPACITY; i++) {
+		const uint64_t type = cw_rec_snapshot_get_internal(&cursor, 1);
+		const int delta = (int32_t) cw_rec_snapshot_get_internal(&cursor, 4);
+		if (type >= CW_REC_STAT_TYPES_COUNT) {
+			return CW_FAILURE;
+		}
+		rec->duration_stats[i].type = (stat_type_t) type;
+		rec->duration_stats[i].duration_delta = delta;
+		if (CW_REC_STAT_NONE != type) {
+			rec->duration_stats_sum_of_squares[type] += (int64_t) delta * delta;
+			rec->duration_stats_count[type]++;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write little-endian integer to snapshot
+
+   @param[out] cursor position in snapshot
+   @param[in] value value to write
+   @param[in] n_bytes size of value in snapshot
+
+   @return position in snapshot after the value
+*/
+static uint8_t * cw_rec_snapshot_put_internal(uint8_t * cursor, uint64_t value, int n_bytes)
+{
+	for (int i = 0; i < n_bytes; i++) {
+		*cursor++ = (uint8_t) ((value >> (8 * i)) & 0xff);
+	}
+	return cursor;
+}
+
+
+
+
+/**
+   @brief Read little-endian integer from snapshot
+
+   Values of signed fields are sign-extended by casting the result to
+   signed type of the same size as the field.
+
+   @param[in,out] cursor position in snapshot, moved past the value
+   @param[in] n_bytes size of value in snapshot
+
+   @return the value
+*/
+static uint64_t cw_rec_snapshot_get_internal(const uint8_t ** cursor, int n_bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < n_bytes; i++) {
+		value |= (uint64_t) (*cursor)[i] << (8 * i);
+	}
+	*cursor += n_bytes;
+	return value;
+}
+
+
+
+
+/**
+   @brief Initialize compact receiver
+
+   In adaptive receiving mode the compact receiver starts at speed of
+   @p params, like cw_rec_t does when adaptive mode is enabled.
+
+   @param[out] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+*/
+void cw_rec_compact_init_internal(cw_rec_compact_t * crec, const cw_rec_t * params)
+{
+	memset(crec, 0, sizeof (cw_rec_compact_t));
+	cw_rec_compact_reset_state_internal(crec);
+
+	crec->speed = params->speed;
+	crec->adaptive_speed_threshold = params->adaptive_speed_threshold;
+	crec->dot_duration_ideal = params->dot_duration_ideal;
+	for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+		crec->dot_durations[i] = params->dot_duration_ideal;
+		crec->dash_durations[i] = params->dash_duration_ideal;
+	}
 
 	return;
 }
 
 
 
+
 /**
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   @brief Reset state of compact receiver
+
+   Like cw_rec_reset_state(): forget current representation, go to
+   idle state. Speed tracked in adaptive mode is preserved.
+
+   @param[in,out] crec compact receiver
 */
-int cw_rec_set_label(cw_rec_t * rec, const char * label)
+void cw_rec_compact_reset_state_internal(cw_rec_compact_t * crec)
 {
-	if (NULL == rec) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "'rec' argument is NULL");
+	crec->state = RS_IDLE;
+	crec->representation_length = 0;
+	crec->representation_hash = 1; /* Sentinel bit, see cw_representation_to_hash_internal(). */
+
+	return;
+}
+
+
+
+
+/**
+   @brief Inform compact receiver about beginning of a Mark
+
+   See cw_rec_mark_begin() for list of errno values.
+
+   @param[in,out] crec compact receiver
+   @param[in] timestamp timestamp of "beginning of Mark" event [ns]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_compact_mark_begin_internal(cw_rec_compact_t * crec, int64_t timestamp)
+{
+	if (RS_IDLE != crec->state && RS_INTER_MARK_SPACE != crec->state) {
+		errno = ERANGE;
 		return CW_FAILURE;
 	}
-	if (NULL == label) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "'%s': 'label' argument is NULL", rec->label);
+	if (timestamp < 0) {
+		errno = EINVAL;
 		return CW_FAILURE;
 	}
-	if (strlen(label) > (LIBCW_OBJECT_INSTANCE_LABEL_SIZE - 1)) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_WARNING,
-			      MSG_PREFIX "'%s': new label '%s' too long, truncating", rec->label, label);
-		/* Not an error, just log warning. New label will be truncated. */
-	}
-
-	/* Notice that empty label is acceptable. In such case we will
-	   erase old label. */
 
-	snprintf(rec->label, sizeof (rec->label), "%s", label);
+	crec->mark_start = cw_rec_compact_timestamp_internal(timestamp);
+	crec->state = RS_MARK;
 
 	return CW_SUCCESS;
 }
@@ -2139,26 +4019,351 @@ int cw_rec_set_label(cw_rec_t * rec, const char * label)
 
 
 /**
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   @brief Inform compact receiver about end of a Mark
+
+   See cw_rec_mark_end() for list of errno values.
+
+   @param[in,out] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+   @param[in] timestamp timestamp of "end of Mark" event [ns]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
 */
-int cw_rec_get_label(const cw_rec_t * rec, char * label, size_t size)
+cw_ret_t cw_rec_compact_mark_end_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int64_t timestamp)
 {
-	if (NULL == rec) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "'rec' argument is NULL");
+	if (RS_MARK != crec->state) {
+		errno = ERANGE;
 		return CW_FAILURE;
 	}
-	if (NULL == label) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "'%s': 'label' argument is NULL", rec->label);
+	if (timestamp < 0) {
+		errno = EINVAL;
 		return CW_FAILURE;
 	}
 
-	/* Notice that we don't care if size is zero. */
+	const uint32_t mark_end = cw_rec_compact_timestamp_internal(timestamp);
+	const int mark_duration = cw_rec_compact_duration_internal(crec->mark_start, mark_end);
 
-	snprintf(label, size, "%s", rec->label);
+	if (params->noise_spike_threshold > 0
+	    && mark_duration <= params->noise_spike_threshold) {
+		/* Noise. Revert to state from before beginning of the
+		   Mark, Space after previous Mark goes on. */
+		crec->state = 0 == crec->representation_length ? RS_IDLE : RS_INTER_MARK_SPACE;
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+	crec->mark_end = mark_end;
+
+	cw_rec_compact_ranges_t ranges;
+	cw_rec_compact_get_ranges_internal(crec, params, &ranges);
+	char mark = cw_rec_identify_duration_internal(mark_duration,
+						      ranges.dot_duration_min, ranges.dot_duration_max,
+						      ranges.dash_duration_min, ranges.dash_duration_max);
+	if (0 == mark) {
+		/* Same decision about error state as in
+		   cw_rec_identify_mark_internal(). */
+		crec->state = mark_duration > ranges.ics_duration_max ? RS_EOW_GAP_ERR : RS_EOC_GAP_ERR;
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	if (params->is_adaptive_receive_mode) {
+		if (CW_REC_ACQUISITION_DONE != crec->acquisition_count) {
+			cw_rec_compact_acquire_speed_internal(crec, params, mark_duration, &mark);
+		} else {
+			cw_rec_compact_update_averages_internal(crec, mark_duration, mark);
+		}
+	}
+
+	crec->representation_length++;
+	crec->representation_hash = (uint8_t) cw_rec_representation_hash_append_internal(crec->representation_hash, crec->representation_length, mark);
+
+	if (crec->representation_length == CW_REC_REPRESENTATION_CAPACITY - 1) {
+		crec->state = RS_EOC_GAP_ERR;
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	crec->state = RS_INTER_MARK_SPACE;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if compact receiver has received a complete representation
+
+   Compact receiver equivalent of cw_rec_poll_representation(). The
+   representation is available as hash in compact receiver, see
+   cw_representation_hash_to_character_internal(). Like in case of
+   cw_rec_t, client code should reset receiver's state after getting
+   the representation.
+
+   @param[in,out] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+   @param[in] timestamp current time [ns]
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a complete representation is available
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_compact_poll_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int64_t timestamp, bool * is_end_of_word, bool * is_error)
+{
+	if (RS_IDLE == crec->state || RS_MARK == crec->state) {
+		errno = ERANGE;
+		return CW_FAILURE;
+	}
+
+	if (RS_EOW_GAP != crec->state && RS_EOW_GAP_ERR != crec->state) {
+		/* Inter-mark-space or inter-character-space: see how long
+		   the Space is now. */
+		if (timestamp < 0) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		const int space_duration = cw_rec_compact_duration_internal(crec->mark_end, cw_rec_compact_timestamp_internal(timestamp));
+		if (INT_MAX == space_duration) {
+			errno = EAGAIN;
+			return CW_FAILURE;
+		}
+
+		cw_rec_compact_ranges_t ranges;
+		cw_rec_compact_get_ranges_internal(crec, params, &ranges);
+
+		if (space_duration >= ranges.ics_duration_min
+		    && space_duration <= ranges.ics_duration_max) {
+			if (RS_INTER_MARK_SPACE == crec->state) {
+				crec->state = RS_EOC_GAP;
+			}
+		} else if (space_duration > ranges.ics_duration_max) {
+			crec->state = RS_EOC_GAP_ERR == crec->state ? RS_EOW_GAP_ERR : RS_EOW_GAP;
+		} else {
+			/* Still inside of a character. */
+			errno = EAGAIN;
+			return CW_FAILURE;
+		}
+	}
+
+	if (is_end_of_word) {
+		*is_end_of_word = RS_EOW_GAP == crec->state || RS_EOW_GAP_ERR == crec->state;
+	}
+	if (is_error) {
+		*is_error = RS_EOC_GAP_ERR == crec->state || RS_EOW_GAP_ERR == crec->state;
+	}
 
 	return CW_SUCCESS;
 }
+
+
+
+
+/**
+   @brief Get current receive speed of compact receiver
+
+   @param[in] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+
+   @return speed tracked by @p crec in adaptive receiving mode, speed of @p params otherwise [wpm]
+*/
+float cw_rec_compact_get_speed_internal(const cw_rec_compact_t * crec, const cw_rec_t * params)
+{
+	return params->is_adaptive_receive_mode ? crec->speed : params->speed;
+}
+
+
+
+
+/**
+   @brief Get duration ranges of Marks and Spaces for compact receiver
+
+   In fixed speed mode these are ranges calculated for @p params by
+   cw_rec_sync_parameters_internal(). In adaptive mode they are
+   calculated the same way from duration tracked by @p crec.
+
+   @param[in] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+   @param[out] ranges duration ranges
+*/
+static void cw_rec_compact_get_ranges_internal(const cw_rec_compact_t * crec, const cw_rec_t * params, cw_rec_compact_ranges_t * ranges)
+{
+	if (params->is_adaptive_receive_mode) {
+		ranges->dot_duration_min = 0;
+		ranges->dot_duration_max = 2 * crec->dot_duration_ideal;
+		ranges->dash_duration_min = ranges->dot_duration_max;
+		ranges->dash_duration_max = INT_MAX;
+		ranges->ics_duration_min = ranges->dot_duration_max;
+		ranges->ics_duration_max = 5 * crec->dot_duration_ideal;
+	} else {
+		ranges->dot_duration_min = params->dot_duration_min;
+		ranges->dot_duration_max = params->dot_duration_max;
+		ranges->dash_duration_min = params->dash_duration_min;
+		ranges->dash_duration_max = params->dash_duration_max;
+		ranges->ics_duration_min = params->ics_duration_min;
+		ranges->ics_duration_max = params->ics_duration_max;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update speed tracked by compact receiver with most recent Mark
+
+   Compact receiver equivalent of cw_rec_update_averages_internal(),
+   including its clamping of speed.
+
+   @param[in,out] crec compact receiver
+   @param[in] mark_duration duration of a Mark (Dot or Dash) [us]
+   @param[in] mark CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION
+*/
+static void cw_rec_compact_update_averages_internal(cw_rec_compact_t * crec, int mark_duration, char mark)
+{
+	if (CW_DOT_REPRESENTATION == mark) {
+		crec->dot_durations[crec->dot_cursor] = mark_duration;
+		crec->dot_cursor = (crec->dot_cursor + 1) % CW_REC_AVERAGING_DURATIONS_COUNT;
+	} else {
+		crec->dash_durations[crec->dash_cursor] = mark_duration;
+		crec->dash_cursor = (crec->dash_cursor + 1) % CW_REC_AVERAGING_DURATIONS_COUNT;
+	}
+
+	int64_t dot_sum = 0;
+	int64_t dash_sum = 0;
+	for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+		dot_sum += crec->dot_durations[i];
+		dash_sum += crec->dash_durations[i];
+	}
+	const int avg_dot_duration = (int) (dot_sum / CW_REC_AVERAGING_DURATIONS_COUNT);
+	const int avg_dash_duration = (int) (dash_sum / CW_REC_AVERAGING_DURATIONS_COUNT);
+	crec->adaptive_speed_threshold = (avg_dash_duration - avg_dot_duration) / 2 + avg_dot_duration;
+
+	/* As in cw_rec_sync_parameters_internal(), ranges are calculated
+	   from speed from before the update. */
+	crec->dot_duration_ideal = (int32_t) floorf((float) CW_DOT_CALIBRATION / crec->speed);
+	crec->speed = CW_DOT_CALIBRATION / ((float) crec->adaptive_speed_threshold / 2.0F);
+
+	if (crec->speed < CW_SPEED_MIN || crec->speed > CW_SPEED_MAX) {
+		crec->speed = crec->speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
+		crec->dot_duration_ideal = (int32_t) floorf((float) CW_DOT_CALIBRATION / crec->speed);
+		crec->adaptive_speed_threshold = 2 * crec->dot_duration_ideal;
+		crec->speed = CW_DOT_CALIBRATION / ((float) crec->adaptive_speed_threshold / 2.0F);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Acquire speed of incoming Morse data from first Marks
+
+   Compact receiver equivalent of cw_rec_acquire_speed_internal().
+   Durations of first Marks are kept in the two averaging buffers,
+   and only hash of current representation can be corrected.
+
+   @param[in,out] crec compact receiver
+   @param[in] params receiver with parameters shared by compact receivers
+   @param[in] mark_duration duration of Mark just received [us]
+   @param[in,out] mark identified Mark just received
+*/
+static void cw_rec_compact_acquire_speed_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int mark_duration, char * mark)
+{
+	if (crec->acquisition_count < CW_REC_AVERAGING_DURATIONS_COUNT) {
+		crec->dot_durations[crec->acquisition_count] = mark_duration;
+	} else {
+		crec->dash_durations[crec->acquisition_count - CW_REC_AVERAGING_DURATIONS_COUNT] = mark_duration;
+	}
+	crec->acquisition_count++;
+
+	int durations[CW_REC_ACQUISITION_MARKS_COUNT];
+	for (int i = 0; i < crec->acquisition_count; i++) {
+		durations[i] = i < CW_REC_AVERAGING_DURATIONS_COUNT
+			? crec->dot_durations[i]
+			: crec->dash_durations[i - CW_REC_AVERAGING_DURATIONS_COUNT];
+	}
+
+	cw_rec_compact_ranges_t ranges;
+	cw_rec_compact_get_ranges_internal(crec, params, &ranges);
+	int dot_duration = 0;
+	int dash_duration = 0;
+	if (!cw_rec_acquisition_seed_internal(durations, crec->acquisition_count, ranges.dot_duration_max, &dot_duration, &dash_duration)) {
+		return;
+	}
+
+	for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+		crec->dot_durations[i] = dot_duration;
+		crec->dash_durations[i] = dash_duration;
+	}
+	crec->dot_cursor = 0;
+	crec->dash_cursor = 0;
+	int threshold = 0;
+	crec->speed = cw_rec_acquisition_speed_internal(dot_duration, dash_duration, &threshold);
+	crec->adaptive_speed_threshold = threshold;
+	crec->dot_duration_ideal = (int32_t) floorf((float) CW_DOT_CALIBRATION / crec->speed);
+	cw_rec_compact_get_ranges_internal(crec, params, &ranges);
+
+	/* Replace last Marks in hash of current representation with
+	   Marks identified again. */
+	const int n = crec->representation_length < crec->acquisition_count - 1 ? crec->representation_length : crec->acquisition_count - 1;
+	if (0 != crec->representation_hash) {
+		unsigned int hash = crec->representation_hash >> n;
+		for (int i = 0; i < n; i++) {
+			const char earlier = cw_rec_identify_duration_internal(durations[crec->acquisition_count - 1 - n + i],
+									       ranges.dot_duration_min, ranges.dot_duration_max,
+									       ranges.dash_duration_min, ranges.dash_duration_max);
+			hash = cw_rec_representation_hash_append_internal(hash, crec->representation_length - n + i + 1, earlier);
+		}
+		crec->representation_hash = (uint8_t) hash;
+	}
+	*mark = cw_rec_identify_duration_internal(mark_duration,
+						  ranges.dot_duration_min, ranges.dot_duration_max,
+						  ranges.dash_duration_min, ranges.dash_duration_max);
+
+	crec->acquisition_count = CW_REC_ACQUISITION_DONE;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Convert timestamp to timestamp of compact receiver
+
+   @param[in] timestamp non-negative timestamp [ns]
+
+   @return timestamp [us], modulo 2^32
+*/
+static uint32_t cw_rec_compact_timestamp_internal(int64_t timestamp)
+{
+	return (uint32_t) ((uint64_t) (timestamp / 1000) & UINT32_MAX);
+}
+
+
+
+
+/**
+   @brief Calculate duration between two timestamps of compact receiver
+
+   Like cw_rec_duration_internal(), the function returns INT_MAX if the
+   duration doesn't fit into int. Timestamps wrap around, so @p later
+   being earlier than @p earlier also results in a long duration.
+
+   @param[in] earlier earlier timestamp [us]
+   @param[in] later later timestamp [us]
+
+   @return duration between timestamps [us]
+*/
+static int cw_rec_compact_duration_internal(uint32_t earlier, uint32_t later)
+{
+	const uint32_t delta = later - earlier;
+	if (delta > INT_MAX) {
+		return INT_MAX;
+	}
+	return (int) delta;
+}
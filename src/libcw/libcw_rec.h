@@ -9,7 +9,9 @@
 
 
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h> /* struct timeval */
 
 
@@ -74,6 +76,24 @@ enum { CW_REC_DURATION_STATS_CAPACITY = 256 };
 enum { CW_REC_AVERAGING_DURATIONS_COUNT = 4 };
 
 
+/* Count of first Marks that receiver in adaptive receiving mode
+   collects to acquire speed of incoming Morse data, before it starts
+   to track the speed with averages (see
+   cw_rec_acquire_speed_internal()). Compact receiver keeps the Marks
+   in its two averaging buffers, hence the value. */
+enum { CW_REC_ACQUISITION_MARKS_COUNT = 2 * CW_REC_AVERAGING_DURATIONS_COUNT };
+
+/* Value of receiver's count of collected Marks after speed has been
+   acquired. */
+enum { CW_REC_ACQUISITION_DONE = 0xFF };
+
+
+/* Count of completed characters (and inter-word-spaces) that receiver
+   keeps for cw_rec_poll_characters_ns(). When client code doesn't
+   call the function often enough, oldest characters are lost. */
+enum { CW_REC_DRAINED_CAPACITY = 64 };
+
+
 /* Types of receiver's timing statistics.
    CW_REC_STAT_NONE must be zero so that the statistics buffer is initially empty. */
 typedef enum {
@@ -81,7 +101,8 @@ typedef enum {
 	CW_REC_STAT_DOT,                    /* Dot mark. */
 	CW_REC_STAT_DASH,                   /* Dash mark. */
 	CW_REC_STAT_INTER_MARK_SPACE,       /* Space between Dots and Dashes within one character. */
-	CW_REC_STAT_INTER_CHARACTER_SPACE   /* Space between characters within one word. */
+	CW_REC_STAT_INTER_CHARACTER_SPACE,  /* Space between characters within one word. */
+	CW_REC_STAT_TYPES_COUNT             /* Not a type, count of types. */
 } stat_type_t;
 
 
@@ -136,9 +157,13 @@ struct cw_rec_struct {
 
 
 
-	/* Retained timestamps of mark's begin and end. */
-	struct timeval mark_start;
-	struct timeval mark_end;
+	/* Retained timestamps of mark's begin and end [ns]. Depending on
+	   functions used by client code, these are either times of
+	   monotonic clock (cw_rec_mark_begin_ns() and friends), or wall
+	   clock times (cw_rec_mark_begin() and friends, taking struct
+	   timeval). */
+	int64_t mark_start;
+	int64_t mark_end;
 
 	/* Buffer for received representation (dots/dashes). This is a
 	   fixed-length buffer, filled in as tone on/off timings are
@@ -150,6 +175,17 @@ struct cw_rec_struct {
 	char representation[CW_REC_REPRESENTATION_CAPACITY + 1];
 	int representation_ind;
 
+	/* Hash of representation (see
+	   cw_representation_to_hash_internal()), updated as each Mark
+	   is added, so that a character can be looked up without
+	   hashing the string. Zero after representation became too
+	   long to be hashed. */
+	unsigned int representation_hash;
+
+	/* Alphabet of code points returned by
+	   cw_rec_poll_code_point_ns(). */
+	cw_alphabet_t alphabet;
+
 
 
 	/* Receiver's low-level timing parameters */
@@ -198,6 +234,13 @@ struct cw_rec_struct {
 	cw_rec_duration_stats_point_t duration_stats[CW_REC_DURATION_STATS_CAPACITY];
 	int duration_stats_idx;
 
+	/* Running sums of entries currently held in the buffer, for
+	   each type of statistics. Updated when an entry is added to
+	   (and another drops out of) the buffer, so that statistics are
+	   available without scanning the buffer. */
+	int64_t duration_stats_sum_of_squares[CW_REC_STAT_TYPES_COUNT];
+	int duration_stats_count[CW_REC_STAT_TYPES_COUNT];
+
 
 
 	/* Data structures for calculating averaged duration of dots and
@@ -206,6 +249,39 @@ struct cw_rec_struct {
 	cw_rec_averaging_t dot_averaging;
 	cw_rec_averaging_t dash_averaging;
 
+	/* Durations of first Marks received in adaptive receiving mode,
+	   used to acquire speed of incoming data before the averages
+	   take over. acquisition_count is CW_REC_ACQUISITION_DONE
+	   once the speed has been acquired. [us] */
+	int acquisition_durations[CW_REC_ACQUISITION_MARKS_COUNT];
+	int acquisition_count;
+
+	/* Push-style reporting of received characters, see
+	   cw_rec_register_output_callback(). The mutex (recursive)
+	   serializes calls from client code with calls from timer. */
+	pthread_mutex_t mutex;
+	cw_rec_output_callback_t output_callback;
+	void * output_callback_arg;
+	int output_timer_id;            /* -1 if timer is not running. */
+	int64_t output_mark_end_clock;  /* Monotonic time of call reporting last end of Mark [ns]. */
+
+	/* eventfd signalled when character or inter-word-space is
+	   complete, see cw_rec_get_event_fd(). -1 until the descriptor
+	   is requested by client code. Without output callback the
+	   descriptor only tells client code when to poll the receiver,
+	   and output_event_stage tells which of the two Spaces has been
+	   signalled: 0 - none, 1 - inter-character-space, 2 - both. */
+	int event_fd;
+	int output_event_stage;
+
+	/* Characters completed since last call to
+	   cw_rec_poll_characters_ns(), in circular buffer. Receiver
+	   starts to collect them on first call to the function. */
+	bool is_draining;
+	cw_rec_output_t drained[CW_REC_DRAINED_CAPACITY];
+	int drained_head;
+	int drained_count;
+
 #define REC_HAS_PENDING_INTER_WORD_SPACE_FLAG 0
 #if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
 	/* Flag indicating if receive polling has received a
@@ -214,12 +290,89 @@ struct cw_rec_struct {
 	bool is_pending_inter_word_space;
 #endif
 
+	/* Counters of Marks received by receiver, updated with atomic
+	   operations, so that exporter of metrics can read them without
+	   locking (see cw_metrics_write()). */
+	struct {
+		uint64_t n_dots;
+		uint64_t n_dashes;
+		uint64_t n_noise_spikes;
+		uint64_t n_unrecognized;  /* Neither Dot nor Dash. */
+	} counters;
+
 	char label[LIBCW_OBJECT_INSTANCE_LABEL_SIZE];
 };
 
 
 
 
+/* Compact receiver: state of receiver for decoders that run many
+   receivers at once (e.g. skimmer with hundreds or thousands of
+   channels). It takes a few dozen bytes instead of kilobytes of
+   cw_rec_t, so that states of all channels can stay in cache.
+
+   Only the state of reception is kept per compact receiver. Essential
+   parameters (tolerance, gap, noise spike threshold, adaptive mode,
+   and speed in fixed speed mode) are shared: they are taken from a
+   regular receiver, passed to cw_rec_compact_*() functions. The
+   functions don't modify the regular receiver, so it can be shared by
+   many threads.
+
+   Differences from cw_rec_t:
+   - instead of representation string only its hash is kept (see
+     cw_representation_to_hash_internal()),
+   - no timing statistics are collected,
+   - no output callback,
+   - timestamps are kept as 32-bit counters of microseconds that wrap
+     around: Space longer than about 35 minutes is not measured
+     (client code should reset the receiver earlier).
+
+   Marks and Spaces are identified with the same duration ranges as
+   in cw_rec_t, and in adaptive receiving mode speed is acquired and
+   tracked in the same way. */
+typedef struct {
+	uint32_t mark_start; /* [us] */
+	uint32_t mark_end;   /* [us] */
+
+	/* Adaptive receiving mode only, see fields with the same names
+	   in cw_rec_t. */
+	float speed;                      /* [wpm] */
+	int32_t adaptive_speed_threshold; /* [us] */
+	int32_t dot_duration_ideal;       /* Duration used to calculate ranges of Marks and Spaces. [us] */
+
+	/* Circular buffers of durations of recent Marks, for averaging
+	   in adaptive receiving mode. Until speed is acquired the two
+	   buffers hold durations of first Marks instead, and
+	   acquisition_count counts them (see field with the same name
+	   in cw_rec_t). [us] */
+	int32_t dot_durations[CW_REC_AVERAGING_DURATIONS_COUNT];
+	int32_t dash_durations[CW_REC_AVERAGING_DURATIONS_COUNT];
+	uint8_t dot_cursor;
+	uint8_t dash_cursor;
+	uint8_t acquisition_count;
+
+	uint8_t state; /* cw_rec_state_t */
+
+	/* Count of Marks in current representation, and hash of the
+	   representation. Representations longer than
+	   CW_DATA_MAX_REPRESENTATION_LENGTH have hash equal to zero. */
+	uint8_t representation_length;
+	uint8_t representation_hash;
+} cw_rec_compact_t;
+
+
+
+
+void     cw_rec_compact_init_internal(cw_rec_compact_t * crec, const cw_rec_t * params);
+void     cw_rec_compact_reset_state_internal(cw_rec_compact_t * crec);
+cw_ret_t cw_rec_compact_mark_begin_internal(cw_rec_compact_t * crec, int64_t timestamp);
+cw_ret_t cw_rec_compact_mark_end_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int64_t timestamp);
+cw_ret_t cw_rec_compact_poll_internal(cw_rec_compact_t * crec, const cw_rec_t * params, int64_t timestamp, bool * is_end_of_word, bool * is_error);
+float    cw_rec_compact_get_speed_internal(const cw_rec_compact_t * crec, const cw_rec_t * params);
+
+
+
+
 /* Other helper functions. */
 void cw_rec_reset_parameters_internal(cw_rec_t * rec);
 void cw_rec_sync_parameters_internal(cw_rec_t * rec);
@@ -0,0 +1,654 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_rtp.c
+
+   @brief RTP network sound sink.
+
+   Samples produced by generator are sent over UDP as RTP stream
+   (RFC 3550), to one or more destinations (unicast or multicast).
+   Payload of packets is either L16 (RFC 3551: linear PCM, signed
+   16-bit, network byte order), or Opus (RFC 7587).
+
+   Generator's buffer holds exactly one packet of samples, so each
+   write to this sound system produces one packet: the samples go
+   from generator's buffer straight into payload of packet (or into
+   Opus encoder), and RTP header and payload are passed to kernel
+   with one sendmsg(), without assembling the packet in yet another
+   buffer.
+
+   There is no sound device that would block the writes, so packets
+   are paced by the sample clock: after a packet is sent, generator
+   sleeps until the absolute time at which the samples of the packet
+   have been played (see cw_gen_pace_tone_internal()).
+
+   libopus is loaded with dlopen(), like libraries of other sound
+   systems. L16 payload doesn't need any library.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(HAVE_STRING_H)
+# include <string.h>
+#endif
+
+#ifdef LIBCW_WITH_OPUS
+#include <dlfcn.h> /* dlopen() and related symbols */
+#include <opus/opus.h>
+#endif
+
+
+
+
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_rtp.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/rtp: "
+
+
+
+
+/* Payload type of both payloads. Names of payloads, their clock rates
+   and counts of channels are given only in session description
+   (SDP), e.g.:
+
+   m=audio 5004 RTP/AVP 96
+   a=rtpmap:96 L16/16000/1
+   or
+   a=rtpmap:96 opus/48000/2 */
+#define CW_RTP_PAYLOAD_TYPE 96
+
+/* Default sample rate of L16 payload. Generator produces tones of up
+   to CW_FREQUENCY_MAX Hz, so lowest accepted rate is twice that. */
+#define CW_RTP_SAMPLE_RATE_L16     16000
+#define CW_RTP_SAMPLE_RATE_MIN      8000
+#define CW_RTP_SAMPLE_RATE_MAX    192000
+
+/* Opus always works at RTP clock rate of 48000 Hz (RFC 7587). */
+#define CW_RTP_SAMPLE_RATE_OPUS    48000
+
+/* Default duration of packet, and range of accepted durations [us]. */
+#define CW_RTP_PACKET_DURATION        20000
+#define CW_RTP_PACKET_DURATION_MIN     1000
+#define CW_RTP_PACKET_DURATION_MAX   120000
+
+#define CW_RTP_BYTES_PER_SAMPLE 2
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#ifdef LIBCW_WITH_OPUS
+typedef struct cw_opus_lib_handle_t {
+
+	/* Returned by cw_dlopen_internal(). Kept for lifetime of
+	   process, see g_cw_opus_lib_handle. */
+	void * lib_handle;
+
+	OpusEncoder * (* opus_encoder_create)(opus_int32 fs, int channels, int application, int * error);
+	opus_int32    (* opus_encode)(OpusEncoder * st, const opus_int16 * pcm, int frame_size, unsigned char * data, opus_int32 max_data_bytes);
+	void          (* opus_encoder_destroy)(OpusEncoder * st);
+} cw_opus_lib_handle_t;
+
+/* libopus is loaded and its symbols are resolved once per process,
+   and are shared by encoders of all generators. Library cache of
+   cw_dlopen_internal() keeps the library loaded anyway, so the
+   handle is never closed. */
+static cw_opus_lib_handle_t g_cw_opus_lib_handle;
+static pthread_mutex_t g_cw_opus_lib_handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static cw_ret_t cw_rtp_opus_load_library_internal(void);
+static cw_ret_t cw_rtp_opus_open_internal(cw_gen_t * gen);
+#endif
+
+
+
+
+static cw_ret_t cw_rtp_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_rtp_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_rtp_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static int      cw_rtp_connect_internal(const char * destination);
+static bool     cw_rtp_is_valid_opus_duration_internal(unsigned int duration);
+static void     cw_rtp_put_be16_internal(uint8_t * dest, uint16_t value);
+static void     cw_rtp_put_be32_internal(uint8_t * dest, uint32_t value);
+
+
+
+
+/**
+   @brief Configure given generator to work with RTP sound sink
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_rtp_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_RTP;
+	gen->open_and_configure_sound_device = cw_rtp_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_rtp_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_rtp_write_buffer_to_sound_device_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if it is possible to send RTP stream to given destinations
+
+   All destinations in the list have to be valid and resolvable.
+   Nothing is sent.
+
+   @param[in] device_name comma-separated list of destinations, "host:port" or "[address]:port" (may be NULL or empty, then a default destination is used)
+
+   @return true if all destinations can be resolved
+   @return false otherwise
+*/
+bool cw_is_rtp_possible(const char * device_name)
+{
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	cw_gen_pick_device_name_internal(device_name, CW_AUDIO_RTP,
+					 picked_device_name, sizeof (picked_device_name));
+
+	int n_destinations = 0;
+	char * saveptr = NULL;
+	for (char * destination = strtok_r(picked_device_name, ",", &saveptr);
+	     NULL != destination;
+	     destination = strtok_r(NULL, ",", &saveptr)) {
+
+		struct addrinfo * result = NULL;
+		const int rv = cw_resolve_address_internal(destination, SOCK_DGRAM, false, &result);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "is possible: can't resolve '%s': %s", destination, gai_strerror(rv));
+			return false;
+		}
+		freeaddrinfo(result);
+		n_destinations++;
+	}
+
+	return n_destinations > 0 && n_destinations <= CW_RTP_DESTINATIONS_MAX;
+}
+
+
+
+
+/**
+   @brief Open sockets for RTP stream of given generator
+
+   Also validate format of stream, and set size of generator's buffer
+   to size of one packet.
+
+   @param[in] gen generator for which to open the sockets
+   @param[in] gen_conf configuration of generator: destinations, payload, sample rate, duration of packet
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rtp_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (gen->sound_device_is_open) {
+		/* Ignore the call if the device is already open. */
+		return CW_SUCCESS;
+	}
+
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	rtp->payload = gen_conf->rtp_payload;
+
+	unsigned int sample_rate = 0;
+	const unsigned int duration = 0 != gen_conf->rtp_packet_duration ? gen_conf->rtp_packet_duration : CW_RTP_PACKET_DURATION;
+	if (CW_RTP_PAYLOAD_L16 == rtp->payload) {
+		sample_rate = 0 != gen_conf->rtp_sample_rate ? gen_conf->rtp_sample_rate : CW_RTP_SAMPLE_RATE_L16;
+		if (sample_rate < CW_RTP_SAMPLE_RATE_MIN || sample_rate > CW_RTP_SAMPLE_RATE_MAX) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: invalid sample rate %u", sample_rate);
+			return CW_FAILURE;
+		}
+	} else if (CW_RTP_PAYLOAD_OPUS == rtp->payload) {
+		sample_rate = CW_RTP_SAMPLE_RATE_OPUS;
+		if (!cw_rtp_is_valid_opus_duration_internal(duration) || gen->n_sound_channels > 2) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: Opus can't encode %u us of %d channel(s) in a packet", duration, gen->n_sound_channels);
+			return CW_FAILURE;
+		}
+	} else {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: invalid payload %d", rtp->payload);
+		return CW_FAILURE;
+	}
+
+	/* Packet must hold whole count of samples, so that pacing of
+	   packets in microseconds follows sample clock exactly. */
+	if (duration < CW_RTP_PACKET_DURATION_MIN || duration > CW_RTP_PACKET_DURATION_MAX
+	    || 0 != ((uint64_t) sample_rate * duration) % CW_USECS_PER_SEC) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: invalid duration of packet %u us at %u Hz", duration, sample_rate);
+		return CW_FAILURE;
+	}
+	const int n_frames = (int) (((uint64_t) sample_rate * duration) / CW_USECS_PER_SEC);
+	if (CW_RTP_PAYLOAD_L16 == rtp->payload
+	    && (size_t) n_frames * (size_t) gen->n_sound_channels * CW_RTP_BYTES_PER_SAMPLE > CW_RTP_PAYLOAD_SIZE_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: %u us of L16 samples at %u Hz don't fit in a packet", duration, sample_rate);
+		return CW_FAILURE;
+	}
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	char destinations[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(destinations, sizeof (destinations), "%s", gen->picked_device_name);
+	rtp->n_sockets = 0;
+	char * saveptr = NULL;
+	for (char * destination = strtok_r(destinations, ",", &saveptr);
+	     NULL != destination;
+	     destination = strtok_r(NULL, ",", &saveptr)) {
+
+		if (CW_RTP_DESTINATIONS_MAX == rtp->n_sockets) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: too many destinations, limit is %d", CW_RTP_DESTINATIONS_MAX);
+			cw_rtp_close_sound_device_internal(gen);
+			return CW_FAILURE;
+		}
+		const int fd = cw_rtp_connect_internal(destination);
+		if (-1 == fd) {
+			cw_rtp_close_sound_device_internal(gen);
+			return CW_FAILURE;
+		}
+		rtp->sockets[rtp->n_sockets++] = fd;
+	}
+	if (0 == rtp->n_sockets) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: no destinations in '%s'", gen->picked_device_name);
+		return CW_FAILURE;
+	}
+
+	gen->sample_rate = sample_rate;
+	gen->buffer_n_samples = n_frames;
+
+	if (CW_RTP_PAYLOAD_OPUS == rtp->payload) {
+#ifdef LIBCW_WITH_OPUS
+		if (CW_SUCCESS != cw_rtp_opus_open_internal(gen)) {
+			cw_rtp_close_sound_device_internal(gen);
+			return CW_FAILURE;
+		}
+#else
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: Opus payload has been disabled during compilation");
+		cw_rtp_close_sound_device_internal(gen);
+		return CW_FAILURE;
+#endif
+	}
+
+	/* RFC 3550 recommends random initial values of SSRC, sequence
+	   number and timestamp. */
+	unsigned int seed = (unsigned int) (cw_clock_now_internal() ^ ((int64_t) getpid() << 16));
+	rtp->ssrc = ((uint32_t) rand_r(&seed) << 16) ^ (uint32_t) rand_r(&seed);
+	rtp->sequence_number = (uint16_t) rand_r(&seed);
+	rtp->timestamp = ((uint32_t) rand_r(&seed) << 16) ^ (uint32_t) rand_r(&seed);
+	rtp->next_packet_time = 0;
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close sockets of RTP stream of given generator
+
+   @param[in] gen generator for which to close its sockets
+*/
+static void cw_rtp_close_sound_device_internal(cw_gen_t * gen)
+{
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+
+	for (int i = 0; i < rtp->n_sockets; i++) {
+		close(rtp->sockets[i]);
+	}
+	rtp->n_sockets = 0;
+
+#ifdef LIBCW_WITH_OPUS
+	if (NULL != rtp->opus_encoder) {
+		g_cw_opus_lib_handle.opus_encoder_destroy(rtp->opus_encoder);
+		rtp->opus_encoder = NULL;
+	}
+#endif
+
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Send generated samples as one RTP packet
+
+   The packet is sent to all destinations. A destination that doesn't
+   receive the stream (ICMP port unreachable), or a socket with full
+   buffer, only loses the packet.
+
+   @param[in] gen generator that will send the packet
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if the packet couldn't be encoded, or couldn't be sent to any destination
+*/
+static cw_ret_t cw_rtp_write_buffer_to_sound_device_internal(cw_gen_t * gen)
+{
+	assert (gen);
+	assert (gen->sound_system == CW_AUDIO_RTP);
+
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	const int n_frames = gen->buffer_write_n_samples;
+	/* RTP sink accepts only 16-bit samples, see cw_gen_new(). */
+	const cw_sample_t * frames = (const cw_sample_t *) cw_gen_frames_internal(gen);
+
+	size_t n_bytes = 0;
+	if (CW_RTP_PAYLOAD_OPUS == rtp->payload) {
+#ifdef LIBCW_WITH_OPUS
+		const opus_int32 rv = g_cw_opus_lib_handle.opus_encode(rtp->opus_encoder, frames, n_frames,
+								       rtp->packet_payload, CW_RTP_PAYLOAD_SIZE_MAX);
+		if (rv < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: opus_encode(): %d", (int) rv);
+			return CW_FAILURE;
+		}
+		n_bytes = (size_t) rv;
+#endif
+	} else {
+		const int n_samples = n_frames * gen->n_sound_channels;
+		for (int i = 0; i < n_samples; i++) {
+			cw_rtp_put_be16_internal(rtp->packet_payload + CW_RTP_BYTES_PER_SAMPLE * i, (uint16_t) frames[i]);
+		}
+		n_bytes = CW_RTP_BYTES_PER_SAMPLE * (size_t) n_samples;
+	}
+
+	/* Generator has been idle before this packet: the packet begins
+	   a talkspurt (RFC 3551, section 4.1). RTP timestamp follows
+	   sample clock over the idle time too, so receivers don't take
+	   the silence for lost packets. */
+	bool marker = false;
+	if (0 == gen->pacing.deadline) {
+		marker = true;
+		const int64_t now = cw_monotonic_usecs_internal();
+		if (0 != rtp->next_packet_time && now > rtp->next_packet_time) {
+			rtp->timestamp += (uint32_t) (((now - rtp->next_packet_time) * gen->sample_rate) / CW_USECS_PER_SEC);
+		}
+	}
+
+	rtp->header[0] = 0x80; /* Version 2, no padding, no extension, no CSRCs. */
+	rtp->header[1] = (uint8_t) ((marker ? 0x80 : 0x00) | CW_RTP_PAYLOAD_TYPE);
+	cw_rtp_put_be16_internal(rtp->header + 2, rtp->sequence_number);
+	cw_rtp_put_be32_internal(rtp->header + 4, rtp->timestamp);
+	cw_rtp_put_be32_internal(rtp->header + 8, rtp->ssrc);
+
+	struct iovec iov[2] = {
+		{ .iov_base = rtp->header,         .iov_len = CW_RTP_HEADER_SIZE },
+		{ .iov_base = rtp->packet_payload, .iov_len = n_bytes }
+	};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof (msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	int n_failed = 0;
+	for (int i = 0; i < rtp->n_sockets; i++) {
+		if (-1 == sendmsg(rtp->sockets[i], &msg, MSG_NOSIGNAL)) {
+			if (ECONNREFUSED == errno || EAGAIN == errno || EWOULDBLOCK == errno) {
+				/* Destination is not listening right now, or
+				   is too slow. */
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "write: sendmsg() to destination #%d: %s", i, strerror(errno));
+			n_failed++;
+		}
+	}
+
+	rtp->sequence_number++;
+	rtp->timestamp += (uint32_t) n_frames;
+
+	cw_gen_pace_tone_internal(gen, (int) (((int64_t) n_frames * CW_USECS_PER_SEC) / gen->sample_rate));
+	rtp->next_packet_time = gen->pacing.deadline;
+
+	return n_failed == rtp->n_sockets ? CW_FAILURE : CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Open UDP socket connected to destination of RTP stream
+
+   The socket is non-blocking: a packet that can't be sent right away
+   is lost, instead of delaying the stream.
+
+   @param[in] destination "host:port" or "[address]:port"
+
+   @return socket on success
+   @return -1 on failure
+*/
+static int cw_rtp_connect_internal(const char * destination)
+{
+	struct addrinfo * result = NULL;
+	const int rv = cw_resolve_address_internal(destination, SOCK_DGRAM, false, &result);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: can't resolve '%s': %s", destination, gai_strerror(rv));
+		return -1;
+	}
+
+	int fd = -1;
+	for (struct addrinfo * ai = result; NULL != ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+
+	if (-1 == fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: can't open socket for '%s': %s", destination, strerror(errno));
+	}
+	return fd;
+}
+
+
+
+
+/**
+   @brief Check if Opus can encode a packet of given duration
+
+   Opus encodes frames of 2.5, 5, 10, 20, 40 or 60 ms.
+
+   @param[in] duration duration of packet [us]
+
+   @return true if the duration is a duration of Opus frame
+   @return false otherwise
+*/
+static bool cw_rtp_is_valid_opus_duration_internal(unsigned int duration)
+{
+	return 2500 == duration || 5000 == duration || 10000 == duration
+		|| 20000 == duration || 40000 == duration || 60000 == duration;
+}
+
+
+
+
+#ifdef LIBCW_WITH_OPUS
+
+
+
+
+/**
+   @brief Load libopus and resolve its symbols, if not done yet
+
+   On success the symbols are available in g_cw_opus_lib_handle until
+   end of process.
+
+   @return CW_SUCCESS if symbols of libopus are available
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rtp_opus_load_library_internal(void)
+{
+	pthread_mutex_lock(&g_cw_opus_lib_handle_mutex);
+	if (NULL != g_cw_opus_lib_handle.lib_handle) {
+		pthread_mutex_unlock(&g_cw_opus_lib_handle_mutex);
+		return CW_SUCCESS;
+	}
+
+	const char * const library_name[] = {
+		"libopus.so.0",
+		"libopus.so",
+		NULL,
+	};
+	cw_opus_lib_handle_t lib = { 0 };
+	for (int i = 0; NULL != library_name[i]; i++) {
+		if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &lib.lib_handle)) {
+			break;
+		}
+	}
+	if (NULL == lib.lib_handle) {
+		pthread_mutex_unlock(&g_cw_opus_lib_handle_mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: can't open 'libopus' library");
+		return CW_FAILURE;
+	}
+
+	*(void **) &lib.opus_encoder_create  = dlsym(lib.lib_handle, "opus_encoder_create");
+	*(void **) &lib.opus_encode          = dlsym(lib.lib_handle, "opus_encode");
+	*(void **) &lib.opus_encoder_destroy = dlsym(lib.lib_handle, "opus_encoder_destroy");
+	if (NULL == lib.opus_encoder_create
+	    || NULL == lib.opus_encode
+	    || NULL == lib.opus_encoder_destroy) {
+
+		dlclose(lib.lib_handle);
+		pthread_mutex_unlock(&g_cw_opus_lib_handle_mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: failed to resolve Opus symbols");
+		return CW_FAILURE;
+	}
+
+	g_cw_opus_lib_handle = lib;
+	pthread_mutex_unlock(&g_cw_opus_lib_handle_mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Load libopus and create Opus encoder for generator
+
+   @param[in] gen generator with configured sample rate
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rtp_opus_open_internal(cw_gen_t * gen)
+{
+	if (CW_SUCCESS != cw_rtp_opus_load_library_internal()) {
+		return CW_FAILURE;
+	}
+
+	int error = OPUS_OK;
+	gen->rtp_data.opus_encoder = g_cw_opus_lib_handle.opus_encoder_create((opus_int32) gen->sample_rate, gen->n_sound_channels,
+									      OPUS_APPLICATION_AUDIO, &error);
+	if (NULL == gen->rtp_data.opus_encoder) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: opus_encoder_create(): %d", error);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+#endif /* #ifdef LIBCW_WITH_OPUS */
+
+
+
+
+static void cw_rtp_put_be16_internal(uint8_t * dest, uint16_t value)
+{
+	dest[0] = (uint8_t) ((value >> 8) & 0xFFU);
+	dest[1] = (uint8_t) (value & 0xFFU);
+}
+
+
+
+
+static void cw_rtp_put_be32_internal(uint8_t * dest, uint32_t value)
+{
+	dest[0] = (uint8_t) ((value >> 24) & 0xFFU);
+	dest[1] = (uint8_t) ((value >> 16) & 0xFFU);
+	dest[2] = (uint8_t) ((value >> 8) & 0xFFU);
+	dest[3] = (uint8_t) (value & 0xFFU);
+}
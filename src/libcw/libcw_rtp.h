@@ -0,0 +1,76 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_RTP
+#define H_LIBCW_RTP
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcw2.h"
+
+
+
+
+/* Size of RTP header without CSRC list and without extensions. */
+enum { CW_RTP_HEADER_SIZE = 12 };
+
+/* Largest payload of a packet. With RTP, UDP and IPv6 headers, the
+   packet still fits in Ethernet's MTU. */
+enum { CW_RTP_PAYLOAD_SIZE_MAX = 1400 };
+
+/* Count of destinations to which a stream can be sent. */
+enum { CW_RTP_DESTINATIONS_MAX = 32 };
+
+
+
+
+typedef struct cw_rtp_data_struct {
+	cw_rtp_payload_t payload;
+
+	/* One connected UDP socket per destination. */
+	int sockets[CW_RTP_DESTINATIONS_MAX];
+	int n_sockets;
+
+	/* Header of next packet is built here. Payload is built
+	   in separate buffer, and both are sent with one sendmsg(). */
+	uint8_t header[CW_RTP_HEADER_SIZE];
+	uint8_t packet_payload[CW_RTP_PAYLOAD_SIZE_MAX];
+
+	uint32_t ssrc;
+	uint16_t sequence_number; /* Sequence number of next packet. */
+	uint32_t timestamp;       /* RTP timestamp of next packet. */
+
+	/* Monotonic time at which samples of last packet end [us], for
+	   advancing RTP timestamp over periods in which generator has
+	   been idle. Zero before first packet. */
+	int64_t next_packet_time;
+
+	/* Opus encoder, for CW_RTP_PAYLOAD_OPUS. */
+	struct OpusEncoder * opus_encoder;
+} cw_rtp_data_t;
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_rtp_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_RTP */
@@ -0,0 +1,384 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+
+
+
+/**
+   @file libcw_sched.c
+
+   @brief Scheduler. Many generators driven by small pool of threads.
+
+   Generator started with cw_gen_start() has its own thread, and the
+   thread spends most of its time blocked in writes to sound device
+   or waiting for tones. With hundreds of generators (e.g. sessions of
+   a simulator) that is hundreds of mostly idle threads.
+
+   Generator started with cw_gen_start_with_sched() doesn't have a
+   thread. It is a job of scheduler: each worker thread of scheduler
+   repeatedly picks the generator with the earliest deadline, and lets
+   the generator dequeue tones and write one buffer of samples (see
+   cw_gen_sched_step_internal()). The generator tells when its next
+   buffer is due: right away when output isn't paced to real time,
+   after duration of the buffer when it is, and after duration of the
+   buffer when there was nothing to play.
+
+   The write must not block, so only generators with File sound
+   system can be scheduled. Pacing to real time (file_realtime) is
+   done by the deadlines, not by sleeping in the sound sink.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_sched.h"
+#include "libcw_signal.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/sched: "
+
+
+
+
+/* Worker waiting for a deadline wakes up at least this often, to
+   notice generators added in the meantime. [ns] */
+#define CW_SCHED_POLL_NSECS (5 * 1000 * 1000)
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void * cw_sched_worker_internal(void * arg);
+static cw_gen_t * cw_sched_pick_gen_internal(const cw_sched_t * sched);
+
+
+
+
+/**
+   @brief Create new scheduler
+
+   Worker threads of the scheduler are started by the function. They
+   wait for generators started with cw_gen_start_with_sched().
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] n_workers count of worker threads, between 1 and CW_SCHED_N_WORKERS_MAX
+
+   @return freshly allocated scheduler on success
+   @return NULL pointer on failure
+*/
+cw_sched_t * cw_sched_new(int n_workers)
+{
+	if (n_workers < 1 || n_workers > CW_SCHED_N_WORKERS_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid count of workers %d", n_workers);
+		errno = EINVAL;
+		return (cw_sched_t *) NULL;
+	}
+
+	cw_sched_t * sched = (cw_sched_t *) calloc(1, sizeof (cw_sched_t));
+	if (NULL == sched) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_sched_t *) NULL;
+	}
+	pthread_mutex_init(&sched->mutex, NULL);
+	pthread_cond_init(&sched->cond, NULL);
+
+	sched->workers = (pthread_t *) calloc((size_t) n_workers, sizeof (pthread_t));
+	if (NULL == sched->workers) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_sched_delete(&sched);
+		return (cw_sched_t *) NULL;
+	}
+
+	for (int i = 0; i < n_workers; i++) {
+		const int rv = pthread_create(&sched->workers[i], NULL, cw_sched_worker_internal, sched);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "new: pthread_create(): %s", strerror(rv));
+			cw_sched_delete(&sched);
+			errno = rv;
+			return (cw_sched_t *) NULL;
+		}
+		sched->n_workers++;
+	}
+
+	return sched;
+}
+
+
+
+
+/**
+   @brief Delete scheduler
+
+   Worker threads are stopped. Generators should be stopped with
+   cw_gen_stop() before the scheduler is deleted. Generators that are
+   still scheduled are detached from the scheduler and don't play
+   anymore. Pointer to @p sched is set to NULL.
+
+   @param[in] sched pointer to scheduler to delete
+*/
+void cw_sched_delete(cw_sched_t ** sched)
+{
+	if (NULL == sched || NULL == *sched) {
+		return;
+	}
+
+	pthread_mutex_lock(&(*sched)->mutex);
+	(*sched)->quit = true;
+	pthread_cond_broadcast(&(*sched)->cond);
+	pthread_mutex_unlock(&(*sched)->mutex);
+
+	for (int i = 0; i < (*sched)->n_workers; i++) {
+		pthread_join((*sched)->workers[i], NULL);
+	}
+
+	for (int i = 0; i < (*sched)->n_gens; i++) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "delete: generator is still scheduled");
+		(*sched)->gens[i]->scheduling.sched = (cw_sched_t *) NULL;
+	}
+
+	free((*sched)->gens);
+	free((*sched)->workers);
+	pthread_cond_destroy(&(*sched)->cond);
+	pthread_mutex_destroy(&(*sched)->mutex);
+
+	free(*sched);
+	*sched = (cw_sched_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get count of generators driven by scheduler
+
+   @param[in] sched scheduler
+
+   @return count of generators
+   @return zero for NULL @p sched
+*/
+int cw_sched_get_n_gens(cw_sched_t * sched)
+{
+	if (NULL == sched) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&sched->mutex);
+	const int n_gens = sched->n_gens;
+	pthread_mutex_unlock(&sched->mutex);
+
+	return n_gens;
+}
+
+
+
+
+/**
+   @brief Add generator to scheduler
+
+   First buffer of the generator is due right away.
+
+   @param[in] sched scheduler
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_sched_add_gen_internal(cw_sched_t * sched, cw_gen_t * gen)
+{
+	pthread_mutex_lock(&sched->mutex);
+
+	if (sched->n_gens == sched->gens_capacity) {
+		const int capacity = 0 == sched->gens_capacity ? 16 : 2 * sched->gens_capacity;
+		cw_gen_t ** gens = (cw_gen_t **) realloc(sched->gens, (size_t) capacity * sizeof (cw_gen_t *));
+		if (NULL == gens) {
+			pthread_mutex_unlock(&sched->mutex);
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc()");
+			return CW_FAILURE;
+		}
+		sched->gens = gens;
+		sched->gens_capacity = capacity;
+	}
+
+	gen->scheduling.deadline = cw_clock_now_internal();
+	gen->scheduling.busy = false;
+	sched->gens[sched->n_gens++] = gen;
+
+	pthread_cond_broadcast(&sched->cond);
+	pthread_mutex_unlock(&sched->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Remove generator from scheduler
+
+   If a worker is in the middle of a step of the generator, the
+   function waits for end of the step. After the function returns no
+   worker touches the generator.
+
+   @param[in] sched scheduler
+   @param[in] gen generator
+*/
+void cw_sched_remove_gen_internal(cw_sched_t * sched, cw_gen_t * gen)
+{
+	pthread_mutex_lock(&sched->mutex);
+	while (gen->scheduling.busy) {
+		cw_virtual_clock_wait_begin_internal();
+		pthread_cond_wait(&sched->cond, &sched->mutex);
+		cw_virtual_clock_wait_end_internal();
+	}
+
+	for (int i = 0; i < sched->n_gens; i++) {
+		if (sched->gens[i] == gen) {
+			/* Order of generators doesn't matter. */
+			sched->gens[i] = sched->gens[sched->n_gens - 1];
+			sched->n_gens--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sched->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Find generator with the earliest deadline
+
+   Generators handled by other workers are skipped. Caller must hold
+   mutex of @p sched.
+
+   @param[in] sched scheduler
+
+   @return generator on success
+   @return NULL if there is no generator available
+*/
+static cw_gen_t * cw_sched_pick_gen_internal(const cw_sched_t * sched)
+{
+	cw_gen_t * picked = (cw_gen_t *) NULL;
+	for (int i = 0; i < sched->n_gens; i++) {
+		cw_gen_t * gen = sched->gens[i];
+		if (gen->scheduling.busy) {
+			continue;
+		}
+		if (NULL == picked || gen->scheduling.deadline < picked->scheduling.deadline) {
+			picked = gen;
+		}
+	}
+
+	return picked;
+}
+
+
+
+
+/**
+   @brief Thread function of worker of scheduler
+
+   @param[in] arg scheduler (cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_sched_worker_internal(void * arg)
+{
+	cw_sched_t * sched = (cw_sched_t *) arg;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "sched", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "sched");
+#endif
+
+	cw_virtual_clock_thread_begin_internal();
+
+	pthread_mutex_lock(&sched->mutex);
+	while (!sched->quit) {
+		cw_gen_t * gen = cw_sched_pick_gen_internal(sched);
+		if (NULL == gen) {
+			cw_virtual_clock_wait_begin_internal();
+			pthread_cond_wait(&sched->cond, &sched->mutex);
+			cw_virtual_clock_wait_end_internal();
+			continue;
+		}
+
+		const int64_t now = cw_clock_now_internal();
+		if (gen->scheduling.deadline > now) {
+			/* Generator with earlier deadline may be added or
+			   released by other worker in the meantime. */
+			const int64_t wake_up = gen->scheduling.deadline < now + CW_SCHED_POLL_NSECS
+				? gen->scheduling.deadline
+				: now + CW_SCHED_POLL_NSECS;
+			pthread_mutex_unlock(&sched->mutex);
+			cw_clock_sleep_until_internal(wake_up);
+			pthread_mutex_lock(&sched->mutex);
+			continue;
+		}
+
+		gen->scheduling.busy = true;
+		const int64_t deadline = gen->scheduling.deadline;
+		pthread_mutex_unlock(&sched->mutex);
+
+		const int64_t next_deadline = cw_gen_sched_step_internal(gen, deadline, now);
+
+		pthread_mutex_lock(&sched->mutex);
+		gen->scheduling.deadline = next_deadline;
+		gen->scheduling.busy = false;
+		/* cw_sched_remove_gen_internal() may be waiting for the
+		   generator. */
+		pthread_cond_broadcast(&sched->cond);
+	}
+	pthread_mutex_unlock(&sched->mutex);
+
+	cw_virtual_clock_thread_end_internal();
+
+	return NULL;
+}
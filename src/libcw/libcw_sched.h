@@ -0,0 +1,52 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SCHED
+#define H_LIBCW_SCHED
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+struct cw_sched_struct {
+	/* Protects all fields below, and fields of
+	   cw_gen_t::scheduling of scheduled generators. */
+	pthread_mutex_t mutex;
+
+	/* Signalled when a generator is added, when a worker has
+	   finished a step of a generator, and when workers should
+	   quit. */
+	pthread_cond_t cond;
+
+	/* Generators driven by the scheduler. */
+	cw_gen_t ** gens;
+	int n_gens;
+	int gens_capacity;
+
+	pthread_t * workers;
+	int n_workers;
+	bool quit;
+};
+
+
+
+
+cw_ret_t cw_sched_add_gen_internal(cw_sched_t * sched, cw_gen_t * gen);
+void     cw_sched_remove_gen_internal(cw_sched_t * sched, cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_SCHED */
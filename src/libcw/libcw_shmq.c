@@ -0,0 +1,1084 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_shmq.c
+
+   @brief Tone queue shared between processes.
+
+   Ring of tones lives in shared memory object. Clients (proxy
+   generators, see cw_gen_config_t::tq_shared_name) write tones
+   directly into slots of the ring, under a process-shared mutex, and
+   publish them by advancing the tail. A thread in server process
+   takes tones from the head of the ring and enqueues them to server's
+   generator, keeping at most CW_SHMQ_LOOKAHEAD tones in generator's
+   own queue. The rest stays in the ring, so client's flush can drop
+   it.
+
+   Processes wait for each other on two events (futex words) in
+   shared memory: server's thread waits for new tones, flush requests
+   and for generator's queue running low (signalled by generator's
+   queue after each dequeue, see cw_shmq_notify_dequeue_internal());
+   clients wait for changes of state of server. A futex is woken up
+   only if someone waits on it, so an enqueue usually costs no system
+   call.
+
+   The shared memory object is created in /dev/shm directly instead
+   of with shm_open(), which on older C libraries needs librt. It's
+   the same object that shm_open() would create; futexes restrict the
+   code to Linux anyway.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_shmq.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/shmq: "
+
+/* Directory in which shm_open() creates shared memory objects. */
+#define CW_SHMQ_DIR "/dev/shm/"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+static cw_ret_t cw_shmq_path_internal(const char * name, char * path, size_t size, char * short_name);
+static size_t   cw_shmq_map_size_internal(size_t capacity);
+static void     cw_shmq_signal_internal(cw_shmq_event_t * event);
+static void     cw_shmq_wait_internal(cw_shmq_event_t * event, uint32_t seq, int timeout);
+static cw_ret_t cw_shmq_lock_producers_internal(cw_shmq_shared_t * shared);
+static void     cw_shmq_publish_internal(cw_shmq_t * shmq);
+static bool     cw_shmq_take_flush_internal(cw_shmq_t * shmq);
+static bool     cw_shmq_take_tones_internal(cw_shmq_t * shmq);
+static void *   cw_shmq_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Create shared tone queue for given generator
+
+   The queue is created as shared memory object with name @p name
+   ("name" or "/name", see shm_open(3)), with room for @p capacity
+   tones. Processes that connect to the queue with proxy generators
+   (see cw_gen_config_t::tq_shared_name) can enqueue tones once the
+   object exists; the tones are played by @p gen after the queue is
+   started with cw_shmq_start().
+
+   The queue must be deleted before @p gen is deleted.
+
+   @exception EINVAL @p gen is NULL, @p name is invalid or @p capacity is out of range
+   @exception EEXIST shared memory object with this name already exists
+
+   @param[in] gen generator that will play tones from the queue
+   @param[in] name name of shared memory object
+   @param[in] capacity count of tones that can wait in the queue
+
+   @return freshly allocated queue on success
+   @return NULL pointer on failure
+*/
+cw_shmq_t * cw_shmq_new(cw_gen_t * gen, const char * name, int capacity)
+{
+	if (NULL == gen || NULL == name || capacity < 1 || capacity > CW_SHMQ_CAPACITY_MAX
+	    || NULL != gen->tq->shmq_producer) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid generator, name or capacity %d", capacity);
+		errno = EINVAL;
+		return (cw_shmq_t *) NULL;
+	}
+
+	cw_shmq_t * shmq = (cw_shmq_t *) calloc(1, sizeof (cw_shmq_t));
+	if (NULL == shmq) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_shmq_t *) NULL;
+	}
+	char path[sizeof (CW_SHMQ_DIR) + CW_SHMQ_NAME_SIZE];
+	if (CW_SUCCESS != cw_shmq_path_internal(name, path, sizeof (path), shmq->name)) {
+		free(shmq);
+		return (cw_shmq_t *) NULL;
+	}
+	shmq->is_server = true;
+	shmq->gen = gen;
+	shmq->capacity = (size_t) capacity;
+	shmq->map_size = cw_shmq_map_size_internal(shmq->capacity);
+
+	const int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+	if (-1 == fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: open(%s): %s", path, strerror(saved_errno));
+		free(shmq);
+		errno = saved_errno;
+		return (cw_shmq_t *) NULL;
+	}
+	void * map = MAP_FAILED;
+	if (0 == ftruncate(fd, (off_t) shmq->map_size)) {
+		map = mmap(NULL, shmq->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	const int saved_errno = errno;
+	close(fd);
+	if (MAP_FAILED == map) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: can't map %s: %s", path, strerror(saved_errno));
+		unlink(path);
+		free(shmq);
+		errno = saved_errno;
+		return (cw_shmq_t *) NULL;
+	}
+	shmq->shared = (cw_shmq_shared_t *) map;
+
+	/* ftruncate() has zeroed all fields. */
+	cw_shmq_shared_t * shared = shmq->shared;
+	shared->version = CW_SHMQ_VERSION;
+	shared->header_size = (uint32_t) sizeof (cw_shmq_shared_t);
+	shared->capacity = (uint32_t) capacity;
+	shared->server_idle = 1;
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&shared->producer_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	/* Clients check the magic first, so it's set last. */
+	__atomic_store_n(&shared->magic, CW_SHMQ_MAGIC, __ATOMIC_RELEASE);
+
+	return shmq;
+}
+
+
+
+
+/**
+   @brief Delete shared tone queue
+
+   The queue is stopped if it's running, and its shared memory object
+   is removed. Clients that are still connected keep their mapping of
+   the memory, but their tones won't be played. Pointer to @p shmq is
+   set to NULL.
+
+   @param[in] shmq pointer to queue to delete
+*/
+void cw_shmq_delete(cw_shmq_t ** shmq)
+{
+	if (NULL == shmq || NULL == *shmq) {
+		return;
+	}
+
+	cw_shmq_stop(*shmq);
+
+	char path[sizeof (CW_SHMQ_DIR) + CW_SHMQ_NAME_SIZE];
+	snprintf(path, sizeof (path), CW_SHMQ_DIR "%s", (*shmq)->name);
+	unlink(path);
+	munmap((*shmq)->shared, (*shmq)->map_size);
+
+	free(*shmq);
+	*shmq = (cw_shmq_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Start playing tones from shared tone queue
+
+   A thread moving tones from shared memory to queue's generator is
+   started. Generator itself must be started by client code.
+
+   @exception EINVAL @p shmq is NULL
+   @exception EBUSY the queue is already started
+
+   @param[in] shmq queue to start
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_shmq_start(cw_shmq_t * shmq)
+{
+	if (NULL == shmq || !shmq->is_server) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (shmq->thread_running) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	cw_tone_queue_t * tq = shmq->gen->tq;
+	/* Dequeue in SPSC mode checks the pointer without the mutex. */
+	pthread_mutex_lock(&tq->wait_mutex);
+	__atomic_store_n(&tq->shmq_consumer, shmq, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	__atomic_store_n(&shmq->do_stop, false, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&shmq->shared->server_running, 1, __ATOMIC_SEQ_CST);
+
+	const int rv = pthread_create(&shmq->thread, NULL, cw_shmq_thread_internal, shmq);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "start: pthread_create(): %s", strerror(rv));
+		cw_shmq_stop(shmq);
+		errno = rv;
+		return CW_FAILURE;
+	}
+	shmq->thread_running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop playing tones from shared tone queue
+
+   Tones that have been already moved to generator are still played.
+   Tones waiting in shared memory stay there, and will be played when
+   the queue is started again.
+
+   @exception EINVAL @p shmq is NULL
+
+   @param[in] shmq queue to stop
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_shmq_stop(cw_shmq_t * shmq)
+{
+	if (NULL == shmq || !shmq->is_server) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (shmq->thread_running) {
+		__atomic_store_n(&shmq->do_stop, true, __ATOMIC_SEQ_CST);
+		cw_shmq_signal_internal(&shmq->shared->server_event);
+		pthread_join(shmq->thread, NULL);
+		shmq->thread_running = false;
+	}
+
+	cw_tone_queue_t * tq = shmq->gen->tq;
+	pthread_mutex_lock(&tq->wait_mutex);
+	__atomic_store_n(&tq->shmq_consumer, NULL, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	/* Let clients waiting for confirmation of flush know that it
+	   won't come. */
+	__atomic_store_n(&shmq->shared->server_running, 0, __ATOMIC_SEQ_CST);
+	cw_shmq_signal_internal(&shmq->shared->client_event);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Connect to shared tone queue created by other process
+
+   @exception ENOENT there is no queue with given name
+   @exception EPROTO the object is not a shared tone queue, or it has been created by incompatible version of libcw
+
+   @param[in] name name of shared memory object
+
+   @return queue on success
+   @return NULL pointer on failure
+*/
+cw_shmq_t * cw_shmq_connect_internal(const char * name)
+{
+	cw_shmq_t * shmq = (cw_shmq_t *) calloc(1, sizeof (cw_shmq_t));
+	if (NULL == shmq) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_shmq_t *) NULL;
+	}
+	char path[sizeof (CW_SHMQ_DIR) + CW_SHMQ_NAME_SIZE];
+	if (CW_SUCCESS != cw_shmq_path_internal(name, path, sizeof (path), shmq->name)) {
+		free(shmq);
+		return (cw_shmq_t *) NULL;
+	}
+
+	const int fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+	if (-1 == fd) {
+		const int saved_errno = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect: open(%s): %s", path, strerror(saved_errno));
+		free(shmq);
+		errno = saved_errno;
+		return (cw_shmq_t *) NULL;
+	}
+	struct stat st;
+	void * map = MAP_FAILED;
+	if (0 == fstat(fd, &st) && (size_t) st.st_size >= sizeof (cw_shmq_shared_t)) {
+		shmq->map_size = (size_t) st.st_size;
+		map = mmap(NULL, shmq->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	} else {
+		errno = EPROTO;
+	}
+	const int saved_errno = errno;
+	close(fd);
+	if (MAP_FAILED == map) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect: can't map %s: %s", path, strerror(saved_errno));
+		free(shmq);
+		errno = saved_errno;
+		return (cw_shmq_t *) NULL;
+	}
+	shmq->shared = (cw_shmq_shared_t *) map;
+
+	const cw_shmq_shared_t * shared = shmq->shared;
+	const bool is_initialized = CW_SHMQ_MAGIC == __atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE);
+	shmq->capacity = shared->capacity;
+	if (!is_initialized
+	    || CW_SHMQ_VERSION != shared->version
+	    || sizeof (cw_shmq_shared_t) != shared->header_size
+	    || 0 == shmq->capacity
+	    || cw_shmq_map_size_internal(shmq->capacity) > shmq->map_size) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "connect: %s is not a compatible shared tone queue", path);
+		munmap(shmq->shared, shmq->map_size);
+		free(shmq);
+		errno = EPROTO;
+		return (cw_shmq_t *) NULL;
+	}
+
+	return shmq;
+}
+
+
+
+
+/**
+   @brief Disconnect from shared tone queue
+
+   Tones enqueued by the client stay in the queue. Pointer to @p shmq
+   is set to NULL.
+
+   @param[in] shmq pointer to queue
+*/
+void cw_shmq_disconnect_internal(cw_shmq_t ** shmq)
+{
+	if (NULL == shmq || NULL == *shmq) {
+		return;
+	}
+
+	munmap((*shmq)->shared, (*shmq)->map_size);
+	free(*shmq);
+	*shmq = (cw_shmq_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enqueue tones to shared tone queue
+
+   Either all tones are enqueued, or none of them is. Tones with
+   duration equal to zero are skipped. Caller must validate @p tones.
+
+   Tones already moved to server's generator count against capacity
+   of the queue, so the queue is full exactly when
+   cw_shmq_length_internal() reaches the capacity.
+
+   @exception EAGAIN there is not enough space in the queue
+
+   @param[in] shmq queue
+   @param[in] tones tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_shmq_enqueue_internal(cw_shmq_t * shmq, const cw_tone_t * tones, size_t n_tones)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+
+	size_t n_nonempty = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].duration > 0) {
+			n_nonempty++;
+		}
+	}
+
+	if (CW_SUCCESS != cw_shmq_lock_producers_internal(shared)) {
+		return CW_FAILURE;
+	}
+
+	uint64_t tail = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+	if (cw_shmq_length_internal(shmq) + n_nonempty > shmq->capacity) {
+		pthread_mutex_unlock(&shared->producer_mutex);
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "enqueue: can't enqueue %zu tone(s), queue is full", n_nonempty);
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	for (size_t i = 0; i < n_tones; i++) {
+		if (0 == tones[i].duration) {
+			continue;
+		}
+		cw_shmq_tone_t * slot = &shared->tones[tail % shmq->capacity];
+		slot->frequency = tones[i].frequency;
+		slot->duration = tones[i].duration;
+		slot->slope_mode = (uint8_t) tones[i].slope_mode;
+		slot->is_forever = tones[i].is_forever;
+		slot->is_first = tones[i].is_first;
+		slot->character = tones[i].character;
+		tail++;
+	}
+	__atomic_store_n(&shared->tail, tail, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&shared->producer_mutex);
+
+	cw_shmq_signal_internal(&shared->server_event);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get count of tones in shared tone queue
+
+   The count includes tones that have been already moved to server's
+   generator, but haven't been dequeued by it yet.
+
+   @param[in] shmq queue
+
+   @return count of tones
+*/
+size_t cw_shmq_length_internal(cw_shmq_t * shmq)
+{
+	const cw_shmq_shared_t * shared = shmq->shared;
+
+	/* Server publishes new length of its generator's queue before
+	   it advances the head, so the sum is never too small. */
+	const uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+	const uint64_t tail = __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE);
+	const uint32_t server_len = __atomic_load_n(&shared->server_len, __ATOMIC_ACQUIRE);
+
+	return (size_t) (tail - head) + server_len;
+}
+
+
+
+
+/**
+   @brief Get capacity of shared tone queue
+
+   @param[in] shmq queue
+
+   @return capacity of queue
+*/
+size_t cw_shmq_capacity_internal(const cw_shmq_t * shmq)
+{
+	return shmq->capacity;
+}
+
+
+
+
+/**
+   @brief Drop all tones enqueued to shared tone queue
+
+   Tones waiting in shared memory and in queue of server's generator
+   are dropped. If server is running, the function waits (at most
+   CW_SHMQ_FLUSH_TIMEOUT) until server confirms the flush.
+
+   @param[in] shmq queue
+*/
+void cw_shmq_flush_internal(cw_shmq_t * shmq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+
+	if (CW_SUCCESS != cw_shmq_lock_producers_internal(shared)) {
+		return;
+	}
+	__atomic_store_n(&shared->flush_tail, __atomic_load_n(&shared->tail, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	const uint32_t request = __atomic_add_fetch(&shared->flush_request, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&shared->producer_mutex);
+
+	cw_shmq_signal_internal(&shared->server_event);
+
+	const int64_t deadline = cw_monotonic_usecs_internal() + CW_SHMQ_FLUSH_TIMEOUT;
+	while (true) {
+		const uint32_t seq = __atomic_load_n(&shared->client_event.seq, __ATOMIC_SEQ_CST);
+		if ((int32_t) (__atomic_load_n(&shared->flush_done, __ATOMIC_ACQUIRE) - request) >= 0) {
+			break;
+		}
+		if (!__atomic_load_n(&shared->server_running, __ATOMIC_SEQ_CST)) {
+			/* Server will drop the tones when it is started. */
+			break;
+		}
+		const int64_t remaining = deadline - cw_monotonic_usecs_internal();
+		if (remaining <= 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_WARNING,
+				      MSG_PREFIX "flush: server hasn't confirmed flush");
+			break;
+		}
+		cw_shmq_wait_internal(&shared->client_event, seq, (int) remaining);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait until count of tones in shared tone queue is at or below given level
+
+   @param[in] shmq queue
+   @param[in] level level of queue
+*/
+void cw_shmq_wait_for_level_internal(cw_shmq_t * shmq, size_t level)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+	while (true) {
+		const uint32_t seq = __atomic_load_n(&shared->client_event.seq, __ATOMIC_SEQ_CST);
+		if (cw_shmq_length_internal(shmq) <= level) {
+			break;
+		}
+		cw_shmq_wait_internal(&shared->client_event, seq, 0);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait until server's generator dequeues next tone, or until it has nothing to play
+
+   @param[in] shmq queue
+*/
+void cw_shmq_wait_for_end_of_current_tone_internal(cw_shmq_t * shmq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+	const uint64_t n_dequeued = __atomic_load_n(&shared->server_n_dequeued, __ATOMIC_ACQUIRE);
+	while (true) {
+		const uint32_t seq = __atomic_load_n(&shared->client_event.seq, __ATOMIC_SEQ_CST);
+		if (n_dequeued != __atomic_load_n(&shared->server_n_dequeued, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		if (__atomic_load_n(&shared->server_idle, __ATOMIC_ACQUIRE)
+		    && 0 == cw_shmq_length_internal(shmq)) {
+			break;
+		}
+		cw_shmq_wait_internal(&shared->client_event, seq, 0);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait until server's generator has played all tones from shared tone queue
+
+   @param[in] shmq queue
+*/
+void cw_shmq_wait_for_empty_internal(cw_shmq_t * shmq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+	while (true) {
+		const uint32_t seq = __atomic_load_n(&shared->client_event.seq, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&shared->server_idle, __ATOMIC_ACQUIRE)
+		    && 0 == cw_shmq_length_internal(shmq)) {
+			break;
+		}
+		cw_shmq_wait_internal(&shared->client_event, seq, 0);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Publish state of server's generator queue in shared memory
+
+   Called by queue of server's generator after a dequeue, and by
+   server's thread after it has changed the queue. Caller must hold
+   @p tq's wait_mutex, so that values published by the two threads
+   are not reordered.
+
+   Clients are woken up if anything has changed, and server's thread
+   is woken up if the queue needs more tones.
+
+   @param[in] shmq queue feeding @p tq
+   @param[in] tq queue of server's generator
+*/
+void cw_shmq_notify_dequeue_internal(cw_shmq_t * shmq, cw_tone_queue_t * tq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+
+	const size_t len = __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST);
+	const uint32_t idle = CW_TQ_EMPTY == tq->state;
+	const uint64_t n_dequeued = __atomic_load_n(&tq->n_dequeued, __ATOMIC_SEQ_CST);
+
+	bool changed = false;
+	if ((uint32_t) len != __atomic_load_n(&shared->server_len, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shared->server_len, (uint32_t) len, __ATOMIC_RELEASE);
+		changed = true;
+	}
+	if (idle != __atomic_load_n(&shared->server_idle, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shared->server_idle, idle, __ATOMIC_RELEASE);
+		changed = true;
+	}
+	if (n_dequeued != __atomic_load_n(&shared->server_n_dequeued, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shared->server_n_dequeued, n_dequeued, __ATOMIC_RELEASE);
+		changed = true;
+	}
+	if (changed) {
+		cw_shmq_signal_internal(&shared->client_event);
+	}
+
+	if (len <= CW_SHMQ_REFILL_LEVEL
+	    && __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&shared->head, __ATOMIC_RELAXED)) {
+		cw_shmq_signal_internal(&shared->server_event);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get path of shared memory object with given name
+
+   @exception EINVAL @p name is empty, too long, or contains '/' other than the leading one
+
+   @param[in] name name of shared memory object, with optional leading '/'
+   @param[out] path path of the object
+   @param[in] size size of @p path
+   @param[out] short_name name without leading '/', CW_SHMQ_NAME_SIZE bytes
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_shmq_path_internal(const char * name, char * path, size_t size, char * short_name)
+{
+	if ('/' == name[0]) {
+		name++;
+	}
+	const size_t len = strlen(name);
+	if (0 == len || len >= CW_SHMQ_NAME_SIZE || NULL != strchr(name, '/')
+	    || 0 == strcmp(name, ".") || 0 == strcmp(name, "..")) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid name of shared tone queue '%s'", name);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	snprintf(short_name, CW_SHMQ_NAME_SIZE, "%s", name);
+	snprintf(path, size, CW_SHMQ_DIR "%s", name);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get size of shared memory object of queue with given capacity
+
+   @param[in] capacity capacity of queue
+
+   @return size of object [bytes]
+*/
+static size_t cw_shmq_map_size_internal(size_t capacity)
+{
+	return sizeof (cw_shmq_shared_t) + capacity * sizeof (cw_shmq_tone_t);
+}
+
+
+
+
+/**
+   @brief Signal event in shared memory
+
+   @param[in] event event to signal
+*/
+static void cw_shmq_signal_internal(cw_shmq_event_t * event)
+{
+	__atomic_add_fetch(&event->seq, 1, __ATOMIC_SEQ_CST);
+	if (0 != __atomic_load_n(&event->n_waiters, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &event->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait for event in shared memory
+
+   Caller reads @p seq from the event before it checks its condition.
+   If the event is signalled after that, the function returns
+   immediately. Spurious returns are possible, caller should check its
+   condition again.
+
+   @param[in] event event to wait for
+   @param[in] seq value of event's sequence read by caller
+   @param[in] timeout timeout [us], zero for no timeout
+*/
+static void cw_shmq_wait_internal(cw_shmq_event_t * event, uint32_t seq, int timeout)
+{
+	struct timespec ts = { .tv_sec = timeout / CW_USECS_PER_SEC, .tv_nsec = (timeout % CW_USECS_PER_SEC) * 1000 };
+
+	__atomic_add_fetch(&event->n_waiters, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &event->seq, FUTEX_WAIT, seq, 0 == timeout ? NULL : &ts, NULL, 0);
+	__atomic_sub_fetch(&event->n_waiters, 1, __ATOMIC_SEQ_CST);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Lock mutex serializing clients of shared tone queue
+
+   If the mutex has been held by a client that has died, the mutex
+   is made consistent and locked. Fields protected by the mutex are
+   published with single atomic stores, so they are consistent even
+   then.
+
+   @param[in] shared shared memory of queue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_shmq_lock_producers_internal(cw_shmq_shared_t * shared)
+{
+	const int rv = pthread_mutex_lock(&shared->producer_mutex);
+	if (EOWNERDEAD == rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_WARNING,
+			      MSG_PREFIX "client holding the queue has died");
+		pthread_mutex_consistent(&shared->producer_mutex);
+		return CW_SUCCESS;
+	}
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "can't lock queue: %s", strerror(rv));
+		errno = rv;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Publish state of server's generator queue
+
+   @param[in] shmq queue
+*/
+static void cw_shmq_publish_internal(cw_shmq_t * shmq)
+{
+	cw_tone_queue_t * tq = shmq->gen->tq;
+
+	pthread_mutex_lock(&tq->wait_mutex);
+	cw_shmq_notify_dequeue_internal(shmq, tq);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Handle flush requested by client
+
+   @param[in] shmq queue
+
+   @return true if a flush has been done
+   @return false otherwise
+*/
+static bool cw_shmq_take_flush_internal(cw_shmq_t * shmq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+
+	const uint32_t request = __atomic_load_n(&shared->flush_request, __ATOMIC_ACQUIRE);
+	if (request == __atomic_load_n(&shared->flush_done, __ATOMIC_RELAXED)) {
+		return false;
+	}
+
+	/* Tones enqueued after the request are kept. */
+	const uint64_t flush_tail = __atomic_load_n(&shared->flush_tail, __ATOMIC_RELAXED);
+	if (flush_tail > __atomic_load_n(&shared->head, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shared->head, flush_tail, __ATOMIC_RELEASE);
+	}
+	cw_tq_flush_internal(shmq->gen->tq);
+	cw_shmq_publish_internal(shmq);
+
+	__atomic_store_n(&shared->flush_done, request, __ATOMIC_RELEASE);
+	cw_shmq_signal_internal(&shared->client_event);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Move tones from shared memory to server's generator
+
+   At most CW_SHMQ_LOOKAHEAD tones are kept in queue of the generator.
+
+   @param[in] shmq queue
+
+   @return true if any tones have been taken from shared memory
+   @return false otherwise
+*/
+static bool cw_shmq_take_tones_internal(cw_shmq_t * shmq)
+{
+	cw_shmq_shared_t * shared = shmq->shared;
+	cw_tone_queue_t * tq = shmq->gen->tq;
+
+	const uint64_t tail = __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE);
+	const uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+	const size_t len = cw_tq_length_internal(tq);
+	if (tail == head || len >= CW_SHMQ_LOOKAHEAD) {
+		return false;
+	}
+
+	size_t n_tones = CW_SHMQ_LOOKAHEAD - len;
+	if (n_tones > tail - head) {
+		n_tones = (size_t) (tail - head);
+	}
+	cw_tone_t tones[CW_SHMQ_LOOKAHEAD];
+	for (size_t i = 0; i < n_tones; i++) {
+		const cw_shmq_tone_t * slot = &shared->tones[(head + i) % shmq->capacity];
+		cw_tone_slope_mode_t slope_mode = (cw_tone_slope_mode_t) slot->slope_mode;
+		if (slope_mode > CW_SLOPE_MODE_FALLING_SLOPE) {
+			slope_mode = CW_SLOPE_MODE_STANDARD_SLOPES;
+		}
+		CW_TONE_INIT(&tones[i], slot->frequency, slot->duration, slope_mode);
+		tones[i].is_forever = 0 != slot->is_forever;
+		tones[i].is_first = 0 != slot->is_first;
+		tones[i].character = slot->character;
+	}
+
+	if (CW_SUCCESS != cw_tq_enqueue_batch_internal(tq, tones, n_tones)) {
+		if (EAGAIN == errno) {
+			/* Queue of generator is full. Try again when it
+			   runs low. */
+			return false;
+		}
+		/* Tones written by misbehaving client. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_WARNING,
+			      MSG_PREFIX "dropping %zu invalid tone(s)", n_tones);
+	}
+
+	/* New length of generator's queue must be visible before the
+	   tones disappear from shared memory, see
+	   cw_shmq_length_internal(). */
+	cw_shmq_publish_internal(shmq);
+	__atomic_store_n(&shared->head, head + n_tones, __ATOMIC_RELEASE);
+	cw_shmq_signal_internal(&shared->client_event);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Thread of server moving tones from shared memory to generator
+
+   @param[in] arg shared tone queue
+
+   @return NULL
+*/
+static void * cw_shmq_thread_internal(void * arg)
+{
+	cw_shmq_t * shmq = (cw_shmq_t *) arg;
+	cw_shmq_shared_t * shared = shmq->shared;
+
+	cw_shmq_publish_internal(shmq);
+
+	while (!__atomic_load_n(&shmq->do_stop, __ATOMIC_SEQ_CST)) {
+		const uint32_t seq = __atomic_load_n(&shared->server_event.seq, __ATOMIC_SEQ_CST);
+
+		const bool flushed = cw_shmq_take_flush_internal(shmq);
+		const bool taken = cw_shmq_take_tones_internal(shmq);
+		if (!flushed && !taken) {
+			cw_shmq_wait_internal(&shared->server_event, seq, 0);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_shmq_t * cw_shmq_new(__attribute__((unused)) cw_gen_t * gen, __attribute__((unused)) const char * name, __attribute__((unused)) int capacity)
+{
+	errno = ENOSYS;
+	return (cw_shmq_t *) NULL;
+}
+
+void cw_shmq_delete(__attribute__((unused)) cw_shmq_t ** shmq)
+{
+	return;
+}
+
+cw_ret_t cw_shmq_start(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_ret_t cw_shmq_stop(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+cw_shmq_t * cw_shmq_connect_internal(__attribute__((unused)) const char * name)
+{
+	errno = ENOSYS;
+	return (cw_shmq_t *) NULL;
+}
+
+void cw_shmq_disconnect_internal(__attribute__((unused)) cw_shmq_t ** shmq)
+{
+	return;
+}
+
+cw_ret_t cw_shmq_enqueue_internal(__attribute__((unused)) cw_shmq_t * shmq, __attribute__((unused)) const cw_tone_t * tones, __attribute__((unused)) size_t n_tones)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+size_t cw_shmq_length_internal(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	return 0;
+}
+
+size_t cw_shmq_capacity_internal(__attribute__((unused)) const cw_shmq_t * shmq)
+{
+	return 0;
+}
+
+void cw_shmq_flush_internal(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	return;
+}
+
+void cw_shmq_wait_for_level_internal(__attribute__((unused)) cw_shmq_t * shmq, __attribute__((unused)) size_t level)
+{
+	return;
+}
+
+void cw_shmq_wait_for_end_of_current_tone_internal(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	return;
+}
+
+void cw_shmq_wait_for_empty_internal(__attribute__((unused)) cw_shmq_t * shmq)
+{
+	return;
+}
+
+void cw_shmq_notify_dequeue_internal(__attribute__((unused)) cw_shmq_t * shmq, __attribute__((unused)) cw_tone_queue_t * tq)
+{
+	return;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
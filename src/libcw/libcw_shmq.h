@@ -0,0 +1,169 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SHMQ
+#define H_LIBCW_SHMQ
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_tq.h"
+
+
+
+
+/* Value of cw_shmq_shared_t::magic, "CWSQ". */
+#define CW_SHMQ_MAGIC 0x43575351U
+
+/* Version of layout of shared memory. Bump it on every change of
+   cw_shmq_shared_t or cw_shmq_tone_t. */
+#define CW_SHMQ_VERSION 1
+
+/* Server keeps at most this many tones in queue of its generator. The
+   rest waits in shared memory, where it can be still flushed by
+   client. */
+enum { CW_SHMQ_LOOKAHEAD = 8 };
+
+/* Server's thread is woken up to move more tones to its generator
+   when length of generator's queue drops to this level. */
+enum { CW_SHMQ_REFILL_LEVEL = CW_SHMQ_LOOKAHEAD / 2 };
+
+/* How long client waits for server to confirm a flush [us]. */
+enum { CW_SHMQ_FLUSH_TIMEOUT = 1000000 };
+
+
+
+
+/* Event on which processes sharing the queue can wait. 'seq' is a
+   futex word, incremented on each signal. Waker calls FUTEX_WAKE only
+   if 'n_waiters' is non-zero. */
+typedef struct {
+	uint32_t seq;
+	uint32_t n_waiters;
+} cw_shmq_event_t;
+
+
+
+
+/* Tone in shared memory. Only fields that are set by client code's
+   generator when a tone is enqueued are passed: symbolic durations
+   have been already resolved with client's timing parameters, and
+   count of samples is calculated by server's generator. */
+typedef struct {
+	int32_t frequency; /* [Hz] */
+	int32_t duration;  /* [us] */
+	uint8_t slope_mode;
+	uint8_t is_forever;
+	uint8_t is_first;
+	char character;
+} cw_shmq_tone_t;
+
+
+
+
+/* Layout of shared memory object. Counters of tones are 64-bit and
+   never wrap; slot of n-th tone is tones[n % capacity].
+
+   Fields written by clients are protected by 'producer_mutex'. Fields
+   written by server are written only by its thread (or by its
+   generator with generator queue's mutex held). All fields read by
+   the other side are accessed with atomic operations. */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t capacity;
+
+	/* Process-shared, robust mutex serializing clients. */
+	pthread_mutex_t producer_mutex;
+
+	/* Count of tones enqueued by clients. */
+	uint64_t tail;
+
+	/* Count of tones taken by server (moved to its generator, or
+	   dropped by flush). */
+	uint64_t head;
+
+	/* Flush requested by client: tones before 'flush_tail' are
+	   dropped, and server's generator is flushed. Request is done
+	   when 'flush_done' is equal to 'flush_request'. */
+	uint64_t flush_tail;
+	uint32_t flush_request;
+	uint32_t flush_done;
+
+	/* State of server, see cw_shmq_notify_dequeue_internal(). */
+	uint32_t server_running;
+	uint32_t server_len;        /* Length of queue of server's generator. */
+	uint32_t server_idle;       /* Queue of server's generator is in CW_TQ_EMPTY state. */
+	uint64_t server_n_dequeued; /* Count of tones dequeued by server's generator. */
+
+	/* Wakes up server's thread: new tones, flush request, or
+	   generator's queue running low. */
+	cw_shmq_event_t server_event;
+
+	/* Wakes up clients: server has taken tones, or state of server
+	   has changed. */
+	cw_shmq_event_t client_event;
+
+	cw_shmq_tone_t tones[];
+} cw_shmq_shared_t;
+
+
+
+
+struct cw_shmq_struct {
+	cw_shmq_shared_t * shared;
+	size_t map_size;
+
+	/* Count of slots of shared->tones. Private copy: the mapping is
+	   writable by clients, so its 'capacity' field can't be trusted
+	   after the queue is created or connected to. */
+	size_t capacity;
+
+	/* Name of shared memory object, without leading '/'. */
+	char name[CW_SHMQ_NAME_SIZE];
+
+	/* Queue created by cw_shmq_new() in server process. Otherwise
+	   the queue has been connected to by proxy generator in client
+	   process. */
+	bool is_server;
+
+	/* Server only: generator fed by the queue, and thread moving
+	   tones from shared memory to the generator. */
+	cw_gen_t * gen;
+	pthread_t thread;
+	bool thread_running;
+	volatile bool do_stop;
+};
+
+
+
+
+cw_shmq_t * cw_shmq_connect_internal(const char * name);
+void        cw_shmq_disconnect_internal(cw_shmq_t ** shmq);
+
+cw_ret_t cw_shmq_enqueue_internal(cw_shmq_t * shmq, const cw_tone_t * tones, size_t n_tones);
+size_t   cw_shmq_length_internal(cw_shmq_t * shmq);
+size_t   cw_shmq_capacity_internal(const cw_shmq_t * shmq);
+void     cw_shmq_flush_internal(cw_shmq_t * shmq);
+void     cw_shmq_wait_for_level_internal(cw_shmq_t * shmq, size_t level);
+void     cw_shmq_wait_for_end_of_current_tone_internal(cw_shmq_t * shmq);
+void     cw_shmq_wait_for_empty_internal(cw_shmq_t * shmq);
+
+void     cw_shmq_notify_dequeue_internal(cw_shmq_t * shmq, cw_tone_queue_t * tq);
+
+
+
+
+#endif /* #ifndef H_LIBCW_SHMQ */
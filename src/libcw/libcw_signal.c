@@ -21,7 +21,14 @@
 /**
    \file libcw_signal.c
 
-   \brief Signal handling routines.
+   \brief Signal handling routines, and timer service.
+
+   Internal one-shot timers are served by a dedicated clock thread
+   that sleeps on a condition variable bound to CLOCK_MONOTONIC. Timer
+   callbacks are called in context of that thread, so they don't have
+   to be async-signal-safe, and libcw doesn't take over SIGALRM of
+   client code. SIGALRM and itimer are used only as a fallback, when
+   the clock thread can't be started.
 
    There are some static variables in this file, maybe they should be
    moved to some common structure. I've noticed that these functions
@@ -37,8 +44,12 @@
 
 
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 
 
@@ -98,6 +109,13 @@ static void cw_sigalrm_handlers_caller_internal(int signal_number);
 static int  cw_sigalrm_block_internal(bool block);
 static void cw_signal_main_handler_internal(int signal_number);
 
+static void   cw_timer_service_init_internal(void);
+static void   cw_timer_service_atfork_child_internal(void);
+static bool   cw_timer_service_is_available_internal(void);
+static void * cw_timer_service_thread_internal(void * arg);
+static void   cw_timer_service_arm_internal(int timer_id, int usecs, void (*callback)(void * arg), void * arg);
+static void   cw_timer_legacy_callback_internal(void * arg);
+
 
 
 
@@ -118,6 +136,600 @@ static struct sigaction cw_sigalrm_original_disposition;
 
 
 
+/* Timer service. Slot #0 is reserved for the legacy single timer
+   armed with cw_timer_run_with_handler_internal(); when it expires,
+   all handlers from cw_sigalrm_handlers[] are called, just as if
+   SIGALRM was received. Remaining slots are available through
+   cw_timer_start_internal(). */
+enum { CW_TIMER_SLOTS_MAX = 16 };
+enum { CW_TIMER_LEGACY_ID = 0 };
+
+/* Virtual clock: count of threads that can sleep at the same time;
+   how long (in real time) a sleeping thread waits, after all
+   participating threads went to sleep or started waiting, before it
+   advances virtual time [ns]; and after how long of real time
+   virtual time is advanced even though some participating threads
+   still run (they may be waiting outside of the library) [ns]. */
+enum { CW_VIRTUAL_CLOCK_SLEEPERS_MAX = 8 };
+enum { CW_VIRTUAL_CLOCK_GRACE = 200 * 1000 };
+enum { CW_VIRTUAL_CLOCK_IDLE = 10 * 1000 * 1000 };
+
+typedef struct {
+	/* Slot is taken by a started timer that hasn't expired and
+	   hasn't been cancelled yet. */
+	bool in_use;
+	/* Incremented each time the slot is taken, so that a stale
+	   timer ID doesn't cancel a timer that reuses the slot. */
+	int generation;
+
+	bool armed;
+	int64_t deadline; /* [ns], CLOCK_MONOTONIC. */
+	void (*callback)(void * arg);
+	void * arg;
+} cw_timer_slot_t;
+
+static struct {
+	pthread_once_t once;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+
+	/* Set once the clock thread is running. When false,
+	   cw_timer_run_with_handler_internal() falls back to
+	   SIGALRM. */
+	bool available;
+
+	cw_timer_slot_t slots[CW_TIMER_SLOTS_MAX];
+
+	/* Argument of callback that is being called by clock thread
+	   right now, and condition signalled when the call returns. */
+	bool is_executing;
+	void * executing_arg;
+	pthread_cond_t executed;
+
+	/* Virtual clock, see cw_virtual_clock_enable_internal(). When
+	   enabled, deadlines of timers are in virtual time. */
+	bool virtual_time;
+	int64_t virtual_now; /* [ns] */
+	/* Deadlines of threads sleeping on virtual clock [ns]. Zero
+	   marks a free slot. */
+	int64_t virtual_sleepers[CW_VIRTUAL_CLOCK_SLEEPERS_MAX];
+	/* Incremented on each change that may affect next step of
+	   virtual time: arming and expiration of timers, threads
+	   falling asleep and waking up. */
+	unsigned int virtual_epoch;
+	pthread_cond_t virtual_cond;
+	/* Time of monotonic clock of last advance of virtual time [ns]. */
+	int64_t virtual_advanced_at;
+	/* Threads taking part in virtual time (thread that enabled the
+	   virtual clock, generator threads), and how many of them are
+	   sleeping on virtual clock or waiting for the library. Values
+	   are valid for current session (incremented each time the
+	   virtual clock is enabled or disabled). */
+	unsigned int virtual_session;
+	int virtual_participants;
+	int virtual_waiting;
+} cw_timer_service = {
+	.once = PTHREAD_ONCE_INIT,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.executed = PTHREAD_COND_INITIALIZER,
+	.available = false,
+	.virtual_time = false,
+	.virtual_cond = PTHREAD_COND_INITIALIZER,
+};
+
+
+
+
+/**
+   @brief Get current time of monotonic clock, in nanoseconds
+
+   @return current time [ns]
+*/
+static int64_t cw_timer_real_now_internal(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * CW_NSECS_PER_SEC + ts.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Get current time of timer service, in nanoseconds
+
+   This is time of virtual clock if the virtual clock is enabled, and
+   time of monotonic clock otherwise. Call with mutex of timer
+   service locked.
+
+   @return current time [ns]
+*/
+static int64_t cw_timer_now_internal(void)
+{
+	if (cw_timer_service.virtual_time) {
+		return cw_timer_service.virtual_now;
+	}
+	return cw_timer_real_now_internal();
+}
+
+
+
+
+/**
+   @brief Get earliest deadline of armed timers
+
+   Call with mutex of timer service locked.
+
+   @return deadline [ns], or INT64_MAX if no timer is armed
+*/
+static int64_t cw_timer_service_earliest_internal(void)
+{
+	int64_t earliest = INT64_MAX;
+	for (int i = 0; i < CW_TIMER_SLOTS_MAX; i++) {
+		if (cw_timer_service.slots[i].armed && cw_timer_service.slots[i].deadline < earliest) {
+			earliest = cw_timer_service.slots[i].deadline;
+		}
+	}
+	return earliest;
+}
+
+
+
+
+/* Session of virtual clock in which calling thread is a participant. */
+static __thread unsigned int cw_virtual_clock_thread_session = 0;
+
+
+
+
+/**
+   @brief Notify threads sleeping on virtual clock about a change
+
+   Call with mutex of timer service locked.
+*/
+static void cw_virtual_clock_touch_internal(void)
+{
+	cw_timer_service.virtual_epoch++;
+	pthread_cond_broadcast(&cw_timer_service.virtual_cond);
+	return;
+}
+
+
+
+
+/**
+   @brief Advance virtual time to the nearest deadline
+
+   The deadline is the earliest of deadlines of threads sleeping on
+   virtual clock and of armed timers. Call with mutex of timer
+   service locked.
+*/
+static void cw_virtual_clock_advance_internal(void)
+{
+	int64_t target = cw_timer_service_earliest_internal();
+	for (int i = 0; i < CW_VIRTUAL_CLOCK_SLEEPERS_MAX; i++) {
+		const int64_t deadline = cw_timer_service.virtual_sleepers[i];
+		if (0 != deadline && deadline < target) {
+			target = deadline;
+		}
+	}
+
+	cw_timer_service.virtual_advanced_at = cw_timer_real_now_internal();
+	if (INT64_MAX != target && target > cw_timer_service.virtual_now) {
+		cw_timer_service.virtual_now = target;
+		pthread_cond_signal(&cw_timer_service.cond);
+		cw_virtual_clock_touch_internal();
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current time of given clock, moved by @p delay [ns]
+*/
+static void cw_timer_timespec_internal(struct timespec * ts, clockid_t clock_id, int64_t delay)
+{
+	clock_gettime(clock_id, ts);
+	const int64_t t = (int64_t) ts->tv_sec * CW_NSECS_PER_SEC + ts->tv_nsec + delay;
+	ts->tv_sec = (time_t) (t / CW_NSECS_PER_SEC);
+	ts->tv_nsec = (long) (t % CW_NSECS_PER_SEC);
+	return;
+}
+
+
+
+
+/**
+   @brief Start the clock thread of timer service
+
+   Called exactly once, through pthread_once(). On any failure the
+   service stays unavailable and callers fall back to SIGALRM.
+
+   The clock thread is started with all signals blocked, so that
+   signals of client code are never delivered to it.
+*/
+void cw_timer_service_init_internal(void)
+{
+	pthread_condattr_t attr;
+	if (0 != pthread_condattr_init(&attr)) {
+		return;
+	}
+	if (0 != pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_WARNING,
+			      MSG_PREFIX "timer service: monotonic condition variable not supported, using SIGALRM");
+		pthread_condattr_destroy(&attr);
+		return;
+	}
+	int rv = pthread_cond_init(&cw_timer_service.cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (0 != rv) {
+		return;
+	}
+
+	sigset_t all_signals;
+	sigset_t original_mask;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &original_mask);
+
+	pthread_attr_t thread_attr;
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	rv = pthread_create(&cw_timer_service.thread, &thread_attr, cw_timer_service_thread_internal, NULL);
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_sigmask(SIG_SETMASK, &original_mask, NULL);
+
+	if (0 != rv) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_WARNING,
+			      MSG_PREFIX "timer service: failed to create clock thread: %s, using SIGALRM", strerror(rv));
+		pthread_cond_destroy(&cw_timer_service.cond);
+		return;
+	}
+
+	cw_timer_service.available = true;
+
+	/* Handlers of pthread_atfork() are inherited by child, so the
+	   handler is registered only by the first process. */
+	static bool atfork_registered = false;
+	if (!atfork_registered) {
+		pthread_atfork(NULL, NULL, cw_timer_service_atfork_child_internal);
+		atfork_registered = true;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Reset timer service in child process after fork()
+
+   Child has only the thread that called fork(), so the clock thread
+   of parent doesn't exist in child, and mutex of the service may be
+   held by a thread that doesn't exist there either. The service is
+   brought back to its initial state: clock thread is started on next
+   use, timers armed by parent are dropped, and library runs on real
+   time (child may enable virtual clock for itself).
+*/
+static void cw_timer_service_atfork_child_internal(void)
+{
+	cw_clock_set_internal(NULL);
+
+	const pthread_once_t once = PTHREAD_ONCE_INIT;
+	const pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	const pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+	cw_timer_service.once = once;
+	cw_timer_service.mutex = mutex;
+	cw_timer_service.executed = cond;
+	cw_timer_service.virtual_cond = cond;
+	cw_timer_service.available = false;
+	cw_timer_service.is_executing = false;
+	cw_timer_service.executing_arg = NULL;
+
+	for (int i = 0; i < CW_TIMER_SLOTS_MAX; i++) {
+		cw_timer_service.slots[i].in_use = false;
+		cw_timer_service.slots[i].armed = false;
+	}
+
+	cw_timer_service.virtual_time = false;
+	memset(cw_timer_service.virtual_sleepers, 0, sizeof (cw_timer_service.virtual_sleepers));
+	cw_timer_service.virtual_session++;
+	cw_timer_service.virtual_participants = 0;
+	cw_timer_service.virtual_waiting = 0;
+	cw_virtual_clock_thread_session = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if timer service (the clock thread) is available
+
+   Starts the clock thread on first call.
+
+   @return true if the clock thread is running
+   @return false otherwise
+*/
+bool cw_timer_service_is_available_internal(void)
+{
+	pthread_once(&cw_timer_service.once, cw_timer_service_init_internal);
+	return cw_timer_service.available;
+}
+
+
+
+
+/**
+   @brief Main loop of the clock thread
+
+   The thread sleeps until the earliest deadline of armed timers (or
+   until a timer is armed or cancelled), and calls callbacks of
+   expired timers. With virtual clock enabled the thread waits until
+   virtual time reaches the deadline. A callback is called with the
+   mutex unlocked, so it
+   may re-arm its own timer or start other timers.
+
+   The thread is detached and never ends: it only consumes CPU when
+   there is a timer to serve.
+*/
+void * cw_timer_service_thread_internal(__attribute__((unused)) void * arg)
+{
+	pthread_mutex_lock(&cw_timer_service.mutex);
+
+	for (;;) {
+		const int64_t earliest = cw_timer_service_earliest_internal();
+
+		if (INT64_MAX == earliest) {
+			pthread_cond_wait(&cw_timer_service.cond, &cw_timer_service.mutex);
+			continue;
+		}
+
+		if (cw_timer_service.virtual_time && cw_timer_service.virtual_now < earliest) {
+			/* Virtual time is advanced by threads sleeping on
+			   virtual clock. If it doesn't advance for a while
+			   (e.g. because threads wait in real time), advance
+			   it ourselves. */
+			const int64_t idle_delay = cw_timer_service.virtual_advanced_at + CW_VIRTUAL_CLOCK_IDLE - cw_timer_real_now_internal();
+			if (idle_delay <= 0) {
+				cw_virtual_clock_advance_internal();
+			} else {
+				struct timespec ts = { 0 };
+				cw_timer_timespec_internal(&ts, CLOCK_MONOTONIC, idle_delay);
+				pthread_cond_timedwait(&cw_timer_service.cond, &cw_timer_service.mutex, &ts);
+			}
+			continue;
+		}
+
+		if (cw_timer_now_internal() < earliest) {
+			struct timespec ts = { .tv_sec = earliest / CW_NSECS_PER_SEC, .tv_nsec = earliest % CW_NSECS_PER_SEC };
+			pthread_cond_timedwait(&cw_timer_service.cond, &cw_timer_service.mutex, &ts);
+			/* Deadlines may have changed while we were waiting. */
+			continue;
+		}
+
+		const int64_t now = cw_timer_now_internal();
+		for (int i = 0; i < CW_TIMER_SLOTS_MAX; i++) {
+			cw_timer_slot_t * slot = &cw_timer_service.slots[i];
+			if (!slot->armed || slot->deadline > now) {
+				continue;
+			}
+
+			/* One-shot timer: disarm (and release the slot)
+			   before calling the callback. */
+			slot->armed = false;
+			void (*callback)(void *) = slot->callback;
+			void * callback_arg = slot->arg;
+			if (CW_TIMER_LEGACY_ID != i) {
+				slot->in_use = false;
+			}
+
+			cw_timer_service.is_executing = true;
+			cw_timer_service.executing_arg = callback_arg;
+			pthread_mutex_unlock(&cw_timer_service.mutex);
+			if (callback) {
+				callback(callback_arg);
+			}
+			pthread_mutex_lock(&cw_timer_service.mutex);
+			cw_timer_service.is_executing = false;
+			cw_timer_service.executing_arg = NULL;
+			pthread_cond_broadcast(&cw_timer_service.executed);
+			cw_virtual_clock_touch_internal();
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Arm (or re-arm) timer in given slot
+
+   Arming an already armed timer moves its deadline. Non-positive
+   \p usecs makes the timer expire right away.
+
+   @param timer_id slot of timer service
+   @param usecs delay of expiration, from now [us]
+   @param callback function to call on expiration
+   @param arg argument passed to callback
+*/
+void cw_timer_service_arm_internal(int timer_id, int usecs, void (*callback)(void * arg), void * arg)
+{
+	const int64_t delay = usecs > 0 ? (int64_t) usecs * 1000 : 0;
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	cw_timer_slot_t * slot = &cw_timer_service.slots[timer_id];
+	slot->deadline = cw_timer_now_internal() + delay;
+	slot->callback = callback;
+	slot->arg = arg;
+	slot->armed = true;
+	pthread_cond_signal(&cw_timer_service.cond);
+	cw_virtual_clock_touch_internal();
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Start a one-shot timer
+
+   Call \p callback with \p arg in context of the clock thread of timer
+   service, after \p usecs microseconds. The callback must not block
+   for long, since it delays all other timers.
+
+   The function doesn't use signals. errno is set to EINVAL if \p
+   callback is NULL, to ENOSYS if the timer service is not available,
+   and to ENOMEM if all timer slots are in use.
+
+   @param usecs delay of expiration [us]
+   @param callback function to call on expiration
+   @param arg argument passed to callback
+
+   @return ID of started timer (non-negative) on success
+   @return -1 on failure
+*/
+int cw_timer_start_internal(int usecs, void (*callback)(void * arg), void * arg)
+{
+	if (NULL == callback) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!cw_timer_service_is_available_internal()) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	int slot_index = -1;
+	int generation = 0;
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	for (int i = CW_TIMER_LEGACY_ID + 1; i < CW_TIMER_SLOTS_MAX; i++) {
+		cw_timer_slot_t * slot = &cw_timer_service.slots[i];
+		if (!slot->in_use) {
+			slot_index = i;
+			slot->in_use = true;
+			slot->generation = slot->generation % (INT_MAX / CW_TIMER_SLOTS_MAX - 1) + 1;
+			generation = slot->generation;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	if (-1 == slot_index) {
+		errno = ENOMEM;
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+			      MSG_PREFIX "timer service: no free timer slots");
+		return -1;
+	}
+
+	cw_timer_service_arm_internal(slot_index, usecs, callback, arg);
+
+	return generation * CW_TIMER_SLOTS_MAX + slot_index;
+}
+
+
+
+
+/**
+   @brief Cancel a timer started with cw_timer_start_internal()
+
+   Cancelling a timer that has already expired (or has already been
+   cancelled) is not an error, and has no effect.
+
+   @param timer_id ID of timer returned by cw_timer_start_internal()
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE (with errno set to EINVAL) if \p timer_id is invalid
+*/
+int cw_timer_cancel_internal(int timer_id)
+{
+	const int slot_index = timer_id % CW_TIMER_SLOTS_MAX;
+	const int generation = timer_id / CW_TIMER_SLOTS_MAX;
+	if (timer_id < 0 || CW_TIMER_LEGACY_ID == slot_index || 0 == generation) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!cw_timer_service_is_available_internal()) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	cw_timer_slot_t * slot = &cw_timer_service.slots[slot_index];
+	if (slot->in_use && slot->generation == generation) {
+		slot->armed = false;
+		slot->in_use = false;
+		slot->callback = NULL;
+		slot->arg = NULL;
+		pthread_cond_signal(&cw_timer_service.cond);
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Wait until clock thread stops executing a callback with given argument
+
+   Cancelling a timer doesn't stop its callback if the callback has
+   already been called. Call this function after cancelling all
+   timers with argument \p arg, before freeing \p arg.
+
+   The function doesn't wait when called from a callback (i.e. from
+   the clock thread).
+
+   @param arg argument of callbacks
+*/
+void cw_timer_wait_for_callbacks_internal(void * arg)
+{
+	if (!cw_timer_service_is_available_internal()) {
+		return;
+	}
+	if (pthread_equal(pthread_self(), cw_timer_service.thread)) {
+		return;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	while (cw_timer_service.is_executing && cw_timer_service.executing_arg == arg) {
+		pthread_cond_wait(&cw_timer_service.executed, &cw_timer_service.mutex);
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Callback of legacy timer slot
+
+   Calls all registered lower level handlers, in context of clock
+   thread, in place of SIGALRM signal handler.
+*/
+void cw_timer_legacy_callback_internal(__attribute__((unused)) void * arg)
+{
+	cw_sigalrm_handlers_caller_internal(SIGALRM);
+	return;
+}
+
+
+
+
 
 /**
    \brief Call handlers of SIGALRM signal
@@ -188,14 +800,17 @@ int cw_timer_run_internal(int usecs)
 
 
 /**
-   \brief Register SIGALRM handler(s), and send SIGALRM signal
-
-   Install top level handler of SIGALRM signal (cw_sigalrm_handlers_caller_internal())
-   if it is not already installed.
+   \brief Register timer handler(s), and arm the timer
 
    Register given \p sigalrm_handler lower level handler, if not NULL and
    if not yet registered.
-   Then send SIGALRM signal after delay equal to \p usecs microseconds.
+   Then arm the legacy timer slot of timer service, so that all registered
+   handlers are called by the clock thread after delay equal to \p usecs
+   microseconds.
+
+   If timer service is not available, install top level handler of
+   SIGALRM signal (cw_sigalrm_handlers_caller_internal()) if it is not
+   already installed, and send SIGALRM signal after the delay.
 
    \param usecs - time for itimer
    \param sigalrm_handler - SIGALRM handler to register
@@ -205,8 +820,11 @@ int cw_timer_run_internal(int usecs)
 */
 int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 {
-	if (!cw_sigalrm_install_top_level_handler_internal()) {
-		return CW_FAILURE;
+	const bool use_timer_service = cw_timer_service_is_available_internal();
+	if (!use_timer_service) {
+		if (!cw_sigalrm_install_top_level_handler_internal()) {
+			return CW_FAILURE;
+		}
 	}
 
 	/* If it's not already present, and one was given, add address
@@ -246,8 +864,16 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 	   doesn't happen. */
 	cw_finalization_cancel_internal();
 
-	/* Depending on the value of usec, either set an itimer, or send
-	   ourselves SIGALRM right away. */
+	if (use_timer_service) {
+		/* No signals involved: the clock thread will call the
+		   handlers after given delay, or right away for
+		   non-positive usecs. */
+		cw_timer_service_arm_internal(CW_TIMER_LEGACY_ID, usecs, cw_timer_legacy_callback_internal, NULL);
+		return CW_SUCCESS;
+	}
+
+	/* Fallback. Depending on the value of usec, either set an
+	   itimer, or send ourselves SIGALRM right away. */
 	if (usecs <= 0) {
 		/* Send ourselves SIGALRM immediately. */
 		if (pthread_kill(cw_generator->thread.id, SIGALRM) != 0) {
@@ -302,7 +928,7 @@ int cw_sigalrm_install_top_level_handler_internal(void)
 
 
 /**
-   \brief Uninstall the SIGALRM handler, if installed
+   \brief Cancel the legacy timer, and uninstall the SIGALRM handler, if installed
 
    Restores SIGALRM's disposition for the system to the state we found
    it in before we installed our own SIGALRM handler.
@@ -312,6 +938,14 @@ int cw_sigalrm_install_top_level_handler_internal(void)
 */
 int cw_sigalrm_restore_internal(void)
 {
+	if (cw_timer_service.available) {
+		/* Cancel pending legacy timer of timer service. */
+		pthread_mutex_lock(&cw_timer_service.mutex);
+		cw_timer_service.slots[CW_TIMER_LEGACY_ID].armed = false;
+		pthread_cond_signal(&cw_timer_service.cond);
+		pthread_mutex_unlock(&cw_timer_service.mutex);
+	}
+
 	/* Ignore the call if we haven't installed our handler. */
 	if (cw_is_sigalrm_handlers_caller_installed) {
 		/* Cancel any pending itimer setting. */
@@ -688,3 +1322,343 @@ int cw_unregister_signal_handler(int signal_number)
 
 	return CW_SUCCESS;
 }
+
+
+
+
+/**
+   @brief Get current time of virtual clock
+
+   Callback of cw_clock_t.
+
+   @return current time [ns]
+*/
+static int64_t cw_virtual_clock_now_internal(__attribute__((unused)) void * arg)
+{
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	const int64_t now = cw_timer_now_internal();
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+	return now;
+}
+
+
+
+
+/**
+   @brief Check if calling thread takes part in virtual time
+
+   Call with mutex of timer service locked.
+*/
+static bool cw_virtual_clock_is_participant_internal(void)
+{
+	return cw_timer_service.virtual_time
+		&& cw_virtual_clock_thread_session == cw_timer_service.virtual_session;
+}
+
+
+
+
+/**
+   @brief Sleep until virtual clock reaches given time
+
+   Callback of cw_clock_t.
+
+   The sleeping thread doesn't wait in real time. Once all threads
+   taking part in virtual time sleep on virtual clock or wait for the
+   library (see cw_virtual_clock_wait_begin_internal()), and
+   CW_VIRTUAL_CLOCK_GRACE has passed without anything happening,
+   virtual time jumps to the nearest deadline: of a sleeping thread
+   or of an armed timer. Before time moves past deadline of a timer,
+   the callback of the timer is called by clock thread. So the order
+   of events is the same as in real time, but threads don't spend
+   time waiting for their deadlines.
+
+   A callback of timer that calls this function just moves virtual
+   time forward.
+
+   @param[in] deadline time of virtual clock [ns]
+*/
+static void cw_virtual_clock_sleep_until_internal(__attribute__((unused)) void * arg, int64_t deadline)
+{
+	pthread_mutex_lock(&cw_timer_service.mutex);
+
+	if (pthread_equal(pthread_self(), cw_timer_service.thread)) {
+		if (cw_timer_service.virtual_time && cw_timer_service.virtual_now < deadline) {
+			cw_timer_service.virtual_now = deadline;
+			cw_virtual_clock_touch_internal();
+		}
+		pthread_mutex_unlock(&cw_timer_service.mutex);
+		return;
+	}
+
+	int sleeper = -1;
+	for (int i = 0; i < CW_VIRTUAL_CLOCK_SLEEPERS_MAX; i++) {
+		if (0 == cw_timer_service.virtual_sleepers[i]) {
+			cw_timer_service.virtual_sleepers[i] = deadline;
+			sleeper = i;
+			break;
+		}
+	}
+	const unsigned int session = cw_timer_service.virtual_session;
+	const bool is_participant = cw_virtual_clock_is_participant_internal();
+	if (is_participant) {
+		cw_timer_service.virtual_waiting++;
+	}
+	cw_virtual_clock_touch_internal();
+
+	while (cw_timer_service.virtual_time && cw_timer_service.virtual_now < deadline) {
+		if (cw_timer_service.is_executing || cw_timer_service_earliest_internal() <= cw_timer_service.virtual_now) {
+			/* Let clock thread call callbacks of expired
+			   timers before time moves on. */
+			pthread_cond_wait(&cw_timer_service.virtual_cond, &cw_timer_service.mutex);
+			continue;
+		}
+
+		/* Don't move time while other threads of the library
+		   are running: they may want to sleep for shorter time
+		   than we do, or to look at the library at current
+		   time. Unless the time hasn't moved for long: the
+		   threads may be waiting for something else. */
+		if (cw_timer_service.virtual_waiting < cw_timer_service.virtual_participants) {
+			const int64_t idle_delay = cw_timer_service.virtual_advanced_at + CW_VIRTUAL_CLOCK_IDLE - cw_timer_real_now_internal();
+			if (idle_delay <= 0) {
+				cw_virtual_clock_advance_internal();
+			} else {
+				struct timespec ts = { 0 };
+				cw_timer_timespec_internal(&ts, CLOCK_REALTIME, idle_delay);
+				pthread_cond_timedwait(&cw_timer_service.virtual_cond, &cw_timer_service.mutex, &ts);
+			}
+			continue;
+		}
+
+		/* All of them wait. Give threads that have just been
+		   woken up a chance to resume. */
+		const unsigned int epoch = cw_timer_service.virtual_epoch;
+		struct timespec ts = { 0 };
+		cw_timer_timespec_internal(&ts, CLOCK_REALTIME, CW_VIRTUAL_CLOCK_GRACE);
+		int rv = 0;
+		while (epoch == cw_timer_service.virtual_epoch && ETIMEDOUT != rv) {
+			rv = pthread_cond_timedwait(&cw_timer_service.virtual_cond, &cw_timer_service.mutex, &ts);
+		}
+		if (epoch != cw_timer_service.virtual_epoch || !cw_timer_service.virtual_time) {
+			continue;
+		}
+
+		cw_virtual_clock_advance_internal();
+	}
+
+	if (-1 != sleeper) {
+		cw_timer_service.virtual_sleepers[sleeper] = 0;
+	}
+	if (is_participant && session == cw_timer_service.virtual_session) {
+		cw_timer_service.virtual_waiting--;
+	}
+	cw_virtual_clock_touch_internal();
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calling thread starts to take part in virtual time
+
+   Virtual time doesn't advance (for a while) when a participating
+   thread runs. Threads of the library that sleep on clock of the
+   library (e.g. generator thread) should call the function when they
+   start, and cw_virtual_clock_thread_end_internal() before they end.
+
+   The function does nothing if virtual clock is not enabled.
+*/
+void cw_virtual_clock_thread_begin_internal(void)
+{
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (cw_timer_service.virtual_time && !cw_virtual_clock_is_participant_internal()) {
+		cw_virtual_clock_thread_session = cw_timer_service.virtual_session;
+		cw_timer_service.virtual_participants++;
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calling thread stops taking part in virtual time
+*/
+void cw_virtual_clock_thread_end_internal(void)
+{
+	if (0 == cw_virtual_clock_thread_session) {
+		return;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (cw_virtual_clock_is_participant_internal()) {
+		cw_timer_service.virtual_participants--;
+		cw_virtual_clock_touch_internal();
+	}
+	cw_virtual_clock_thread_session = 0;
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calling thread starts to wait for the library
+
+   Call before waiting for a condition that is changed by other
+   threads of the library (e.g. for dequeueing of tone), so that
+   virtual time can advance while the thread waits. Call
+   cw_virtual_clock_wait_end_internal() when the wait is over.
+
+   The function does nothing for threads that don't take part in
+   virtual time.
+*/
+void cw_virtual_clock_wait_begin_internal(void)
+{
+	if (0 == cw_virtual_clock_thread_session) {
+		return;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (cw_virtual_clock_is_participant_internal()) {
+		cw_timer_service.virtual_waiting++;
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calling thread stops waiting for the library
+*/
+void cw_virtual_clock_wait_end_internal(void)
+{
+	if (0 == cw_virtual_clock_thread_session) {
+		return;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (cw_virtual_clock_is_participant_internal()) {
+		cw_timer_service.virtual_waiting--;
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
+
+
+
+
+static const cw_clock_t cw_virtual_clock = {
+	.now = cw_virtual_clock_now_internal,
+	.sleep_until = cw_virtual_clock_sleep_until_internal,
+	.arg = NULL,
+};
+
+
+
+
+/**
+   @brief Make the library run on virtual clock
+
+   Generator's pacing of tones (of Null, Console and file sound
+   systems), timers of the timer service (used by receiver and iambic
+   keyer), and timestamps taken by the library, will follow virtual
+   time instead of real time. Virtual time starts at current time of
+   monotonic clock, and advances only when threads of the library
+   (or tests calling cw_usleep_internal()) sleep, see
+   cw_virtual_clock_sleep_until_internal(). Playing a minute of Morse
+   code with Null sound system takes a fraction of second of real
+   time.
+
+   Calling thread, and generator threads started later, take part in
+   virtual time: the time doesn't advance while any of them runs.
+
+   Meant for tests. Call the function while the library is idle
+   (before creating generators). Sound systems writing to sound
+   devices are paced by the devices, and don't follow the virtual
+   clock.
+
+   errno is set to ENOSYS if timer service is not available.
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_virtual_clock_enable_internal(void)
+{
+	if (!cw_timer_service_is_available_internal()) {
+		errno = ENOSYS;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (!cw_timer_service.virtual_time) {
+		/* Deadlines of armed timers are still valid. */
+		cw_timer_service.virtual_now = cw_timer_real_now_internal();
+		cw_timer_service.virtual_advanced_at = cw_timer_service.virtual_now;
+		cw_timer_service.virtual_time = true;
+
+		/* Calling thread is the first participant. */
+		cw_timer_service.virtual_session++;
+		cw_timer_service.virtual_participants = 1;
+		cw_timer_service.virtual_waiting = 0;
+		cw_virtual_clock_thread_session = cw_timer_service.virtual_session;
+
+		pthread_cond_signal(&cw_timer_service.cond);
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	cw_clock_set_internal(&cw_virtual_clock);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Go back to real time
+
+   Deadlines of timers armed with virtual clock are moved to real
+   time, preserving the time remaining until their expiration.
+   Threads sleeping on virtual clock are woken up.
+*/
+void cw_virtual_clock_disable_internal(void)
+{
+	cw_clock_set_internal(NULL);
+
+	pthread_mutex_lock(&cw_timer_service.mutex);
+	if (cw_timer_service.virtual_time) {
+		const int64_t shift = cw_timer_real_now_internal() - cw_timer_service.virtual_now;
+		for (int i = 0; i < CW_TIMER_SLOTS_MAX; i++) {
+			if (cw_timer_service.slots[i].armed) {
+				cw_timer_service.slots[i].deadline += shift;
+			}
+		}
+		cw_timer_service.virtual_time = false;
+		cw_timer_service.virtual_session++;
+		cw_timer_service.virtual_participants = 0;
+		cw_timer_service.virtual_waiting = 0;
+		cw_virtual_clock_thread_session = 0;
+		pthread_cond_signal(&cw_timer_service.cond);
+		cw_virtual_clock_touch_internal();
+	}
+	pthread_mutex_unlock(&cw_timer_service.mutex);
+
+	return;
+}
@@ -12,6 +12,8 @@
 
 #include <stdbool.h>
 
+#include "libcw2.h"
+
 
 
 
@@ -22,6 +24,19 @@ int  cw_signal_wait_internal(void);
 int  cw_sigalrm_restore_internal(void);
 int  cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void));
 
+/* Signal-free one-shot timers, served by a clock thread. */
+int  cw_timer_start_internal(int usecs, void (*callback)(void * arg), void * arg);
+int  cw_timer_cancel_internal(int timer_id);
+void cw_timer_wait_for_callbacks_internal(void * arg);
+
+/* Virtual time for tests, see cw_clock_set_internal(). */
+cw_ret_t cw_virtual_clock_enable_internal(void);
+void     cw_virtual_clock_disable_internal(void);
+void     cw_virtual_clock_thread_begin_internal(void);
+void     cw_virtual_clock_thread_end_internal(void);
+void     cw_virtual_clock_wait_begin_internal(void);
+void     cw_virtual_clock_wait_end_internal(void);
+
 
 
 
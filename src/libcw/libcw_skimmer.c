@@ -0,0 +1,1298 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_skimmer.c
+
+   @brief Skimmer. Decode all CW signals found in a passband of PCM sound.
+
+   Input sound (mono, 16 bit) is analyzed by FFT filterbank: frames of
+   fft_size samples, Hann window, overlapping by 3/4. Width of a bin is
+   about CW_SKIMMER_BIN_WIDTH Hz.
+
+   A bin in which magnitude rises well above the bin's noise floor (and
+   which is a local maximum, not too close to a bin of existing
+   channel) gets a channel: a detector (envelope follower with
+   hysteresis, see libcw_detector.c) and a receiver in adaptive mode.
+   Magnitudes of the bin are fed to the detector, and its timestamped
+   marks are passed to the receiver. Receivers of channels are compact
+   receivers (cw_rec_compact_t) sharing parameters of a single
+   cw_rec_t, so that states of many channels fit in cache. Channels that don't receive any
+   mark for CW_SKIMMER_CHANNEL_TIMEOUT are released.
+
+   Input is processed in batches of frames. Filterbank and detection of
+   active bins run in caller's thread; processing of channels for a
+   batch is distributed over a pool of worker threads.
+
+   Decoded characters are collected into a queue of
+   (frequency, timestamp, character) events, ordered by timestamp
+   within a batch. The queue is read with cw_skimmer_get_events().
+
+   Time spent on filterbank and on each channel is measured for every
+   batch. If client code has set a CPU budget, a controller compares
+   the cost of a batch with duration of its sound. Under overload the
+   controller first halves overlap of frames (fewer frames for
+   filterbank and for all channels), then closes channels with the
+   lowest score (strength of signal weighted by share of correctly
+   decoded characters) and limits count of channels that can be
+   opened. When the load stays low for CW_SKIMMER_RECOVERY_TIME, the
+   limit is raised step by step (or removed when open channels don't
+   reach it), and finally the overlap is restored.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t, PRId64 */
+#include <math.h>  /* sqrtf(), cosf(), sinf() */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>  /* clock_gettime() */
+
+#if defined(HAVE_STRING_H)
+# include <string.h>
+#endif
+
+#if defined(HAVE_STRINGS_H)
+# include <strings.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_detector.h"
+#include "libcw_rec.h"
+#include "libcw_skimmer.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/skimmer: "
+
+
+
+
+/* Approximate width of bin of filterbank [Hz]. Actual width depends
+   on sample rate, since size of FFT is a power of two. */
+enum { CW_SKIMMER_BIN_WIDTH = 50 };
+
+/* Channel is released after this long without a mark [us]. */
+enum { CW_SKIMMER_CHANNEL_TIMEOUT = 10000000 };
+
+/* No new channel is created this close (in bins) to existing one. */
+enum { CW_SKIMMER_BIN_GUARD = 2 };
+
+/* Time constants of noise floor of bins [us]. */
+enum { CW_SKIMMER_FLOOR_FALL_TIME = 200000 };
+enum { CW_SKIMMER_FLOOR_RISE_TIME = 1000000 };
+
+/* Magnitude of bin must be this many times above bin's noise floor
+   (15.6 dB) to create a channel, and above this absolute amplitude. */
+#define CW_SKIMMER_ACTIVATION_RATIO      6.0f
+#define CW_SKIMMER_ACTIVATION_AMPLITUDE  16.0f
+
+/* Conditions above must be met in this many consecutive frames.
+   Edge of a mark that falls into a frame spreads over many bins, and
+   would create spurious channels next to real signal. */
+enum { CW_SKIMMER_ACTIVATION_FRAMES = 3 };
+
+/* Inter-word-space is reported after this many dots of space. */
+enum { CW_SKIMMER_EOW_DOTS = 5 };
+
+/* After dropping channels, controller aims at this percentage of
+   CPU budget, to leave some headroom for new load. */
+enum { CW_SKIMMER_BUDGET_TARGET = 75 };
+
+/* Load must stay below half of budget for this long before controller
+   takes back one step of degradation [ns]. */
+#define CW_SKIMMER_RECOVERY_TIME  (2 * (int64_t) CW_NSECS_PER_SEC)
+
+/* Step of raising limit of count of channels during recovery. */
+enum { CW_SKIMMER_RECOVERY_CHANNELS = 4 };
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void    cw_skimmer_fft_internal(cw_skimmer_t * skimmer);
+static void    cw_skimmer_analyze_frame_internal(cw_skimmer_t * skimmer);
+static void    cw_skimmer_find_channels_internal(cw_skimmer_t * skimmer, int frame);
+static cw_ret_t cw_skimmer_channel_open_internal(cw_skimmer_t * skimmer, int bin, int frame);
+static void    cw_skimmer_channel_close_internal(cw_skimmer_t * skimmer, int channel);
+static void    cw_skimmer_channel_process_internal(cw_skimmer_t * skimmer, cw_skimmer_channel_t * channel);
+static void    cw_skimmer_channel_add_event_internal(cw_skimmer_channel_t * channel, int64_t timestamp, char character, bool is_error);
+static void    cw_skimmer_process_batch_internal(cw_skimmer_t * skimmer);
+static void    cw_skimmer_process_channels_internal(cw_skimmer_t * skimmer, int worker, int n_workers);
+static void *  cw_skimmer_worker_internal(void * arg);
+static int     cw_skimmer_event_compare_internal(const void * a, const void * b);
+static int64_t cw_skimmer_sample_timestamp_internal(const cw_skimmer_t * skimmer, int64_t sample);
+static void    cw_skimmer_set_hop_size_internal(cw_skimmer_t * skimmer, int hop_size);
+static void    cw_skimmer_drop_channels_internal(cw_skimmer_t * skimmer, int n_keep);
+static float   cw_skimmer_channel_score_internal(const cw_skimmer_channel_t * channel);
+static int64_t cw_skimmer_now_internal(void);
+static int     cw_skimmer_average_internal(int average, int64_t cost_ns, int64_t duration_ns);
+
+
+
+
+/**
+   @brief Create new skimmer
+
+   Skimmer decodes CW signals with frequencies in range
+   [@p low_frequency, @p high_frequency] in PCM sound with given
+   @p sample_rate.
+
+   Channels are processed by @p n_workers worker threads. If
+   @p n_workers is zero, channels are processed in thread calling
+   cw_skimmer_process().
+
+   On invalid argument the function returns NULL and sets errno to
+   EINVAL.
+
+   @param[in] sample_rate sample rate of input sound [Hz]
+   @param[in] low_frequency lower edge of passband [Hz]
+   @param[in] high_frequency upper edge of passband [Hz]
+   @param[in] n_workers count of worker threads
+
+   @return freshly allocated skimmer on success
+   @return NULL pointer on failure
+*/
+cw_skimmer_t * cw_skimmer_new(int sample_rate, int low_frequency, int high_frequency, int n_workers)
+{
+	if (sample_rate < CW_DETECTOR_SAMPLE_RATE_MIN
+	    || sample_rate > CW_DETECTOR_SAMPLE_RATE_MAX
+	    || low_frequency <= 0
+	    || high_frequency <= low_frequency
+	    || high_frequency >= sample_rate / 2
+	    || n_workers < 0
+	    || n_workers > CW_SKIMMER_WORKERS_MAX) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid argument: sample rate = %d, passband = %d - %d, workers = %d",
+			      sample_rate, low_frequency, high_frequency, n_workers);
+		errno = EINVAL;
+		return (cw_skimmer_t *) NULL;
+	}
+
+	cw_skimmer_t * skimmer = (cw_skimmer_t *) calloc(1, sizeof (cw_skimmer_t));
+	if (NULL == skimmer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_skimmer_t *) NULL;
+	}
+
+	pthread_mutex_init(&skimmer->pool_mutex, NULL);
+	pthread_cond_init(&skimmer->pool_start, NULL);
+	pthread_cond_init(&skimmer->pool_done, NULL);
+
+	skimmer->rec_params = cw_rec_new();
+	if (NULL == skimmer->rec_params) {
+		cw_skimmer_delete(&skimmer);
+		return (cw_skimmer_t *) NULL;
+	}
+	cw_rec_enable_adaptive_mode(skimmer->rec_params);
+
+	skimmer->sample_rate = sample_rate;
+	skimmer->fft_size = 16;
+	while (skimmer->fft_size * CW_SKIMMER_BIN_WIDTH < sample_rate) {
+		skimmer->fft_size *= 2;
+	}
+	skimmer->hop_size = skimmer->fft_size / 4;
+	skimmer->hop_size_normal = skimmer->hop_size;
+	skimmer->hop_size_next = skimmer->hop_size;
+	skimmer->channels_limit = CW_SKIMMER_CHANNELS_MAX;
+
+	const float bin_width = (float) sample_rate / (float) skimmer->fft_size;
+	skimmer->bin_low = (int) ((float) low_frequency / bin_width);
+	skimmer->bin_high = (int) ((float) high_frequency / bin_width + 0.5f);
+	if (skimmer->bin_low < 1) {
+		skimmer->bin_low = 1;
+	}
+	if (skimmer->bin_high > skimmer->fft_size / 2 - 1) {
+		skimmer->bin_high = skimmer->fft_size / 2 - 1;
+	}
+	skimmer->n_bins = skimmer->bin_high - skimmer->bin_low + 1;
+
+	const size_t n = (size_t) skimmer->fft_size;
+	skimmer->window = (float *) calloc(n, sizeof (float));
+	skimmer->twiddle_re = (float *) calloc(n / 2, sizeof (float));
+	skimmer->twiddle_im = (float *) calloc(n / 2, sizeof (float));
+	skimmer->bit_reverse = (int *) calloc(n, sizeof (int));
+	skimmer->history = (float *) calloc(n, sizeof (float));
+	skimmer->fft_re = (float *) calloc(n, sizeof (float));
+	skimmer->fft_im = (float *) calloc(n, sizeof (float));
+	skimmer->bin_floor = (float *) calloc((size_t) skimmer->n_bins, sizeof (float));
+	skimmer->bin_channel = (int *) calloc((size_t) skimmer->n_bins, sizeof (int));
+	skimmer->bin_hits = (int *) calloc((size_t) skimmer->n_bins, sizeof (int));
+	skimmer->frames = (float *) calloc((size_t) skimmer->n_bins * CW_SKIMMER_BATCH_FRAMES, sizeof (float));
+	if (NULL == skimmer->window || NULL == skimmer->twiddle_re || NULL == skimmer->twiddle_im
+	    || NULL == skimmer->bit_reverse || NULL == skimmer->history
+	    || NULL == skimmer->fft_re || NULL == skimmer->fft_im
+	    || NULL == skimmer->bin_floor || NULL == skimmer->bin_channel || NULL == skimmer->bin_hits
+	    || NULL == skimmer->frames) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_skimmer_delete(&skimmer);
+		return (cw_skimmer_t *) NULL;
+	}
+
+	int log2_n = 0;
+	while ((1 << log2_n) < skimmer->fft_size) {
+		log2_n++;
+	}
+	for (int i = 0; i < skimmer->fft_size; i++) {
+		skimmer->window[i] = 0.5f - 0.5f * cosf(2.0f * (float) M_PI * (float) i / (float) skimmer->fft_size);
+
+		int reversed = 0;
+		for (int b = 0; b < log2_n; b++) {
+			reversed |= ((i >> b) & 1) << (log2_n - 1 - b);
+		}
+		skimmer->bit_reverse[i] = reversed;
+	}
+	for (int i = 0; i < skimmer->fft_size / 2; i++) {
+		skimmer->twiddle_re[i] = cosf(2.0f * (float) M_PI * (float) i / (float) skimmer->fft_size);
+		skimmer->twiddle_im[i] = -sinf(2.0f * (float) M_PI * (float) i / (float) skimmer->fft_size);
+	}
+	for (int i = 0; i < skimmer->n_bins; i++) {
+		skimmer->bin_channel[i] = -1;
+	}
+
+	for (int i = 0; i < n_workers; i++) {
+		skimmer->workers[i].skimmer = skimmer;
+		skimmer->workers[i].index = i;
+		int rv = pthread_create(&skimmer->workers[i].thread, NULL, cw_skimmer_worker_internal, &skimmer->workers[i]);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create worker thread: %s", strerror(rv));
+			cw_skimmer_delete(&skimmer);
+			errno = rv;
+			return (cw_skimmer_t *) NULL;
+		}
+		skimmer->n_workers++;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "new: FFT size = %d, bins = %d - %d (%.1f Hz), workers = %d",
+		      skimmer->fft_size, skimmer->bin_low, skimmer->bin_high, (double) bin_width, skimmer->n_workers);
+
+	return skimmer;
+}
+
+
+
+
+/**
+   @brief Delete skimmer
+
+   Stop worker threads, release all channels.
+
+   @param[in,out] skimmer pointer to skimmer
+*/
+void cw_skimmer_delete(cw_skimmer_t ** skimmer)
+{
+	cw_assert (skimmer, MSG_PREFIX "delete: 'skimmer' argument can't be NULL\n");
+
+	if (NULL == skimmer) { /* Graceful handling of invalid argument. */
+		return;
+	}
+	if (NULL == *skimmer) {
+		return;
+	}
+
+	cw_skimmer_t * s = *skimmer;
+
+	pthread_mutex_lock(&s->pool_mutex);
+	s->pool_quit = true;
+	pthread_cond_broadcast(&s->pool_start);
+	pthread_mutex_unlock(&s->pool_mutex);
+	for (int i = 0; i < s->n_workers; i++) {
+		pthread_join(s->workers[i].thread, NULL);
+	}
+	pthread_cond_destroy(&s->pool_done);
+	pthread_cond_destroy(&s->pool_start);
+	pthread_mutex_destroy(&s->pool_mutex);
+
+	for (int i = 0; i < CW_SKIMMER_CHANNELS_MAX; i++) {
+		if (s->channels[i].in_use) {
+			cw_skimmer_channel_close_internal(s, i);
+		}
+	}
+
+	free(s->window);
+	free(s->twiddle_re);
+	free(s->twiddle_im);
+	free(s->bit_reverse);
+	free(s->history);
+	free(s->fft_re);
+	free(s->fft_im);
+	free(s->bin_floor);
+	free(s->bin_channel);
+	free(s->bin_hits);
+	free(s->frames);
+
+	cw_rec_delete(&s->rec_params);
+
+	free(s);
+	*skimmer = (cw_skimmer_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Process block of PCM samples
+
+   Pass @p n_samples samples of mono, 16-bit PCM sound to the skimmer.
+   Semantics of @p timestamp are the same as in cw_detector_process():
+   it's the time of first sample in @p samples [ns], or a negative
+   value to continue skimmer's own timeline.
+
+   Characters decoded from the sound can be read with
+   cw_skimmer_get_events() after the function returns. The function
+   and cw_skimmer_get_events() must not be called concurrently.
+
+   @param[in,out] skimmer skimmer
+   @param[in] samples PCM samples
+   @param[in] n_samples count of samples in @p samples
+   @param[in] timestamp timestamp of first sample [ns]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (errno is set to EINVAL if @p samples is NULL)
+*/
+cw_ret_t cw_skimmer_process(cw_skimmer_t * skimmer, const int16_t * samples, size_t n_samples, int64_t timestamp)
+{
+	if (NULL == samples) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	if (timestamp >= 0) {
+		skimmer->anchor_sample = skimmer->n_samples;
+		skimmer->anchor_timestamp = timestamp;
+	}
+
+	for (size_t i = 0; i < n_samples; i++) {
+		skimmer->history[skimmer->fft_size - skimmer->hop_size + skimmer->history_fill] = (float) samples[i];
+		skimmer->history_fill++;
+		skimmer->n_samples++;
+
+		if (skimmer->history_fill == skimmer->hop_size) {
+			/* Don't analyze frames that are not yet fully
+			   filled with sound. */
+			if (skimmer->n_samples >= skimmer->fft_size) {
+				const int64_t begin = cw_skimmer_now_internal();
+				cw_skimmer_analyze_frame_internal(skimmer);
+				skimmer->filterbank_cost_ns += cw_skimmer_now_internal() - begin;
+				if (CW_SKIMMER_BATCH_FRAMES == skimmer->n_frames) {
+					cw_skimmer_process_batch_internal(skimmer);
+				}
+			}
+			/* History holds a full frame now, so this is the
+			   only place where size of hop can be changed. */
+			if (skimmer->hop_size_next != skimmer->hop_size) {
+				cw_skimmer_set_hop_size_internal(skimmer, skimmer->hop_size_next);
+			}
+			memmove(skimmer->history, skimmer->history + skimmer->hop_size, (size_t) (skimmer->fft_size - skimmer->hop_size) * sizeof (float));
+			skimmer->history_fill = 0;
+		}
+	}
+
+	if (skimmer->n_frames > 0) {
+		cw_skimmer_process_batch_internal(skimmer);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get decoded characters
+
+   Move up to @p capacity oldest events from skimmer's queue to
+   @p events. Character of event is ' ' for inter-word-space.
+
+   The queue holds up to CW_SKIMMER_EVENTS_CAPACITY events; when client
+   code doesn't read the events fast enough, the oldest ones are
+   dropped.
+
+   @param[in,out] skimmer skimmer
+   @param[out] events buffer for events
+   @param[in] capacity size of @p events
+
+   @return count of events copied to @p events
+*/
+int cw_skimmer_get_events(cw_skimmer_t * skimmer, cw_skimmer_event_t * events, int capacity)
+{
+	int n = 0;
+	while (n < capacity && skimmer->events_count > 0) {
+		events[n++] = skimmer->events[skimmer->events_head];
+		skimmer->events_head = (skimmer->events_head + 1) % CW_SKIMMER_EVENTS_CAPACITY;
+		skimmer->events_count--;
+	}
+
+	return n;
+}
+
+
+
+
+/**
+   @brief Get count of channels (signals) currently being decoded
+
+   @param[in] skimmer skimmer
+
+   @return count of channels
+*/
+int cw_skimmer_get_n_channels(const cw_skimmer_t * skimmer)
+{
+	return skimmer->n_channels;
+}
+
+
+
+
+/**
+   @brief Set CPU budget of skimmer
+
+   When processing of sound takes longer than @p budget percent of
+   duration of the sound, the skimmer degrades its work to stay within
+   the budget: it lowers overlap of frames of filterbank, then drops
+   channels with the weakest or least confidently decoded signals and
+   doesn't open new channels above a limit. The skimmer recovers when
+   the load eases.
+
+   Zero @p budget (the default) disables the controller. Degradation
+   already made by the controller is then undone at once.
+
+   @param[in,out] skimmer skimmer
+   @param[in] budget max. processing time as percentage of duration of sound (0 - 100)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid @p budget (errno is set to EINVAL)
+*/
+cw_ret_t cw_skimmer_set_cpu_budget(cw_skimmer_t * skimmer, int budget)
+{
+	if (budget < 0 || budget > 100) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "set cpu budget: invalid budget %d", budget);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	skimmer->budget = budget * (CW_USECS_PER_SEC / 100);
+	skimmer->recovery_time = 0;
+	if (0 == budget) {
+		skimmer->hop_size_next = skimmer->hop_size_normal;
+		skimmer->channels_limit = CW_SKIMMER_CHANNELS_MAX;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get load of skimmer
+
+   @param[in] skimmer skimmer
+   @param[out] load current costs and state of controller of CPU budget
+*/
+void cw_skimmer_get_load(const cw_skimmer_t * skimmer, cw_skimmer_load_t * load)
+{
+	load->cost = skimmer->cost;
+	load->filterbank_cost = skimmer->filterbank_cost;
+	load->channels_cost = skimmer->channels_cost;
+	load->budget = skimmer->budget;
+	load->overlap = 100 - (100 * skimmer->hop_size) / skimmer->fft_size;
+	load->channels_limit = skimmer->channels_limit;
+	load->n_dropped = skimmer->n_dropped;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get costs of channels
+
+   Copy frequency and cost of up to @p capacity open channels to
+   @p costs.
+
+   @param[in] skimmer skimmer
+   @param[out] costs buffer for costs of channels
+   @param[in] capacity size of @p costs
+
+   @return count of items copied to @p costs
+*/
+int cw_skimmer_get_channel_costs(const cw_skimmer_t * skimmer, cw_skimmer_channel_cost_t * costs, int capacity)
+{
+	int n = 0;
+	for (int c = 0; c < CW_SKIMMER_CHANNELS_MAX && n < capacity; c++) {
+		if (skimmer->channels[c].in_use) {
+			costs[n].frequency = skimmer->channels[c].frequency;
+			costs[n].cost = skimmer->channels[c].cost;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+
+
+
+/**
+   @brief Compute magnitudes of bins for current frame
+
+   Window the history of samples, run the FFT, store amplitudes of bins
+   of passband as next frame of current batch, and look for new active
+   bins.
+
+   @param[in,out] skimmer skimmer
+*/
+void cw_skimmer_analyze_frame_internal(cw_skimmer_t * skimmer)
+{
+	const int n = skimmer->fft_size;
+	for (int i = 0; i < n; i++) {
+		const int j = skimmer->bit_reverse[i];
+		skimmer->fft_re[j] = skimmer->history[i] * skimmer->window[i];
+		skimmer->fft_im[j] = 0.0f;
+	}
+	cw_skimmer_fft_internal(skimmer);
+
+	const int frame = skimmer->n_frames;
+	float * magnitudes = skimmer->frames + (size_t) frame * (size_t) skimmer->n_bins;
+	/* Sum of Hann window is n/2; amplitude of a sine equal to A
+	   gives |X| = A * n/4. */
+	const float scale = 4.0f / (float) n;
+	for (int b = 0; b < skimmer->n_bins; b++) {
+		const float re = skimmer->fft_re[skimmer->bin_low + b];
+		const float im = skimmer->fft_im[skimmer->bin_low + b];
+		magnitudes[b] = scale * sqrtf(re * re + im * im);
+	}
+
+	/* Timestamp of middle of the frame. */
+	skimmer->frame_timestamps[frame] = cw_skimmer_sample_timestamp_internal(skimmer, skimmer->n_samples - n / 2);
+	skimmer->n_frames++;
+
+	cw_skimmer_find_channels_internal(skimmer, frame);
+
+	return;
+}
+
+
+
+
+/**
+   @brief In-place iterative radix-2 FFT of fft_re/fft_im
+
+   Input must already be in bit-reversed order.
+
+   @param[in,out] skimmer skimmer
+*/
+void cw_skimmer_fft_internal(cw_skimmer_t * skimmer)
+{
+	const int n = skimmer->fft_size;
+	float * re = skimmer->fft_re;
+	float * im = skimmer->fft_im;
+
+	for (int size = 2; size <= n; size *= 2) {
+		const int half = size / 2;
+		const int step = n / size;
+		for (int start = 0; start < n; start += size) {
+			for (int k = 0; k < half; k++) {
+				const float wr = skimmer->twiddle_re[k * step];
+				const float wi = skimmer->twiddle_im[k * step];
+				const int a = start + k;
+				const int b = a + half;
+				const float tr = re[b] * wr - im[b] * wi;
+				const float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update noise floors of bins, open channels for new signals
+
+   @param[in,out] skimmer skimmer
+   @param[in] frame index of frame in current batch
+*/
+void cw_skimmer_find_channels_internal(cw_skimmer_t * skimmer, int frame)
+{
+	const float * magnitudes = skimmer->frames + (size_t) frame * (size_t) skimmer->n_bins;
+	const int n_bins = skimmer->n_bins;
+
+	if (!skimmer->is_primed) {
+		/* Single frame is a poor estimate of noise floor of a
+		   bin, so start from average of all bins. */
+		float sum = 0.0f;
+		for (int b = 0; b < n_bins; b++) {
+			sum += magnitudes[b];
+		}
+		for (int b = 0; b < n_bins; b++) {
+			skimmer->bin_floor[b] = sum / (float) n_bins;
+		}
+		skimmer->is_primed = true;
+		return;
+	}
+
+	const float hop_duration = (float) skimmer->hop_size * (float) CW_USECS_PER_SEC / (float) skimmer->sample_rate;
+	const float fall = hop_duration / (float) CW_SKIMMER_FLOOR_FALL_TIME;
+	const float rise = hop_duration / (float) CW_SKIMMER_FLOOR_RISE_TIME;
+
+	for (int b = 0; b < n_bins; b++) {
+		const float magnitude = magnitudes[b];
+		const float floor = skimmer->bin_floor[b];
+
+		if (-1 == skimmer->bin_channel[b]
+		    && magnitude > CW_SKIMMER_ACTIVATION_AMPLITUDE
+		    && magnitude > CW_SKIMMER_ACTIVATION_RATIO * floor
+		    && (0 == b || magnitude >= magnitudes[b - 1])
+		    && (n_bins - 1 == b || magnitude >= magnitudes[b + 1])) {
+
+			skimmer->bin_hits[b]++;
+		} else {
+			skimmer->bin_hits[b] = 0;
+		}
+
+		if (skimmer->bin_hits[b] >= CW_SKIMMER_ACTIVATION_FRAMES) {
+
+			bool is_guarded = false;
+			for (int g = b - CW_SKIMMER_BIN_GUARD; g <= b + CW_SKIMMER_BIN_GUARD; g++) {
+				if (g >= 0 && g < n_bins && -1 != skimmer->bin_channel[g]) {
+					is_guarded = true;
+					break;
+				}
+			}
+			if (!is_guarded) {
+				/* Let the channel see the signal from its
+				   beginning, as far as current batch allows. */
+				const int first_frame = frame - (CW_SKIMMER_ACTIVATION_FRAMES - 1);
+				cw_skimmer_channel_open_internal(skimmer, b, first_frame > 0 ? first_frame : 0);
+			}
+			skimmer->bin_hits[b] = 0;
+		}
+
+		skimmer->bin_floor[b] += (magnitude - floor) * (magnitude < floor ? fall : rise);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Open channel for signal in given bin
+
+   @param[in,out] skimmer skimmer
+   @param[in] bin index of bin (relative to lowest bin of passband)
+   @param[in] frame index of first frame of current batch with the signal
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if there are no free channels, or on allocation errors
+*/
+cw_ret_t cw_skimmer_channel_open_internal(cw_skimmer_t * skimmer, int bin, int frame)
+{
+	int c = 0;
+	for (; c < CW_SKIMMER_CHANNELS_MAX; c++) {
+		if (!skimmer->channels[c].in_use) {
+			break;
+		}
+	}
+	if (CW_SKIMMER_CHANNELS_MAX == c || skimmer->n_channels >= skimmer->channels_limit) {
+		return CW_FAILURE;
+	}
+
+	cw_skimmer_channel_t * channel = &skimmer->channels[c];
+	memset(channel, 0, sizeof (cw_skimmer_channel_t));
+
+	const int frequency = (int) (((int64_t) (skimmer->bin_low + bin) * skimmer->sample_rate) / skimmer->fft_size);
+	cw_rec_compact_init_internal(&channel->rec, skimmer->rec_params);
+
+	channel->detector = cw_detector_new_internal(skimmer->sample_rate, frequency, NULL);
+	if (NULL == channel->detector) {
+		return CW_FAILURE;
+	}
+	const int hop_duration = (int) (((int64_t) skimmer->hop_size * CW_USECS_PER_SEC) / skimmer->sample_rate);
+	cw_detector_set_block_duration(channel->detector, hop_duration);
+
+	/* Detector primes its envelope follower with first magnitude,
+	   which is expected to be a space. The signal has just appeared,
+	   so give the detector the noise floor of the bin first. */
+	const int64_t hop_ns = ((int64_t) skimmer->hop_size * CW_NSECS_PER_SEC) / skimmer->sample_rate;
+	cw_detector_process_magnitude_internal(channel->detector, skimmer->bin_floor[bin], skimmer->frame_timestamps[frame] - hop_ns);
+
+	channel->in_use = true;
+	channel->bin = bin;
+	channel->frequency = frequency;
+	channel->first_frame = frame;
+	channel->last_mark_end = skimmer->frame_timestamps[frame];
+	channel->strength = CW_SKIMMER_ACTIVATION_RATIO;
+	skimmer->bin_channel[bin] = c;
+	skimmer->n_channels++;
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "opened channel #%d at %d Hz", c, frequency);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Release channel
+
+   @param[in,out] skimmer skimmer
+   @param[in] c index of channel
+*/
+void cw_skimmer_channel_close_internal(cw_skimmer_t * skimmer, int c)
+{
+	cw_skimmer_channel_t * channel = &skimmer->channels[c];
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "closing channel #%d at %d Hz", c, channel->frequency);
+
+	cw_detector_delete(&channel->detector);
+	skimmer->bin_channel[channel->bin] = -1;
+	channel->in_use = false;
+	skimmer->n_channels--;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Process frames of current batch: decode channels, collect events
+
+   @param[in,out] skimmer skimmer
+*/
+void cw_skimmer_process_batch_internal(cw_skimmer_t * skimmer)
+{
+	const int64_t begin = cw_skimmer_now_internal();
+
+	if (0 == skimmer->n_workers) {
+		cw_skimmer_process_channels_internal(skimmer, 0, 1);
+	} else {
+		pthread_mutex_lock(&skimmer->pool_mutex);
+		skimmer->pool_n_done = 0;
+		skimmer->pool_generation++;
+		pthread_cond_broadcast(&skimmer->pool_start);
+		while (skimmer->pool_n_done < skimmer->n_workers) {
+			pthread_cond_wait(&skimmer->pool_done, &skimmer->pool_mutex);
+		}
+		pthread_mutex_unlock(&skimmer->pool_mutex);
+	}
+
+	/* Merge events of channels, in order of timestamps. */
+	int n_events = 0;
+	for (int c = 0; c < CW_SKIMMER_CHANNELS_MAX; c++) {
+		cw_skimmer_channel_t * channel = &skimmer->channels[c];
+		if (!channel->in_use) {
+			continue;
+		}
+		for (int e = 0; e < channel->n_events; e++) {
+			skimmer->merge[n_events++] = channel->events[e];
+		}
+		channel->n_events = 0;
+	}
+	qsort(skimmer->merge, (size_t) n_events, sizeof (cw_skimmer_event_t), cw_skimmer_event_compare_internal);
+	for (int e = 0; e < n_events; e++) {
+		if (CW_SKIMMER_EVENTS_CAPACITY == skimmer->events_count) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+				      MSG_PREFIX "queue of events is full, dropping oldest event");
+			skimmer->events_head = (skimmer->events_head + 1) % CW_SKIMMER_EVENTS_CAPACITY;
+			skimmer->events_count--;
+		}
+		const int tail = (skimmer->events_head + skimmer->events_count) % CW_SKIMMER_EVENTS_CAPACITY;
+		skimmer->events[tail] = skimmer->merge[e];
+		skimmer->events_count++;
+	}
+
+	/* Release inactive channels, update costs of active ones. */
+	const int64_t duration_ns = ((int64_t) skimmer->n_frames * skimmer->hop_size * CW_NSECS_PER_SEC) / skimmer->sample_rate;
+	const int64_t now = skimmer->frame_timestamps[skimmer->n_frames - 1];
+	for (int c = 0; c < CW_SKIMMER_CHANNELS_MAX; c++) {
+		cw_skimmer_channel_t * channel = &skimmer->channels[c];
+		channel->first_frame = 0;
+		if (!channel->in_use) {
+			continue;
+		}
+		channel->cost = cw_skimmer_average_internal(channel->cost, channel->cost_ns, duration_ns);
+		if (!channel->detector->is_mark
+		    && now - channel->last_mark_end > (int64_t) CW_SKIMMER_CHANNEL_TIMEOUT * 1000) {
+
+			cw_skimmer_channel_close_internal(skimmer, c);
+		}
+	}
+
+	skimmer->n_frames = 0;
+
+	const int64_t channels_cost_ns = cw_skimmer_now_internal() - begin;
+	skimmer->filterbank_cost = cw_skimmer_average_internal(skimmer->filterbank_cost, skimmer->filterbank_cost_ns, duration_ns);
+	skimmer->channels_cost = cw_skimmer_average_internal(skimmer->channels_cost, channels_cost_ns, duration_ns);
+	cw_skimmer_control_internal(skimmer, skimmer->filterbank_cost_ns + channels_cost_ns, duration_ns);
+	skimmer->filterbank_cost_ns = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Process current batch for subset of channels
+
+   Channel number N is processed if (N % @p n_workers) == @p worker.
+
+   @param[in,out] skimmer skimmer
+   @param[in] worker index of worker
+   @param[in] n_workers count of workers
+*/
+void cw_skimmer_process_channels_internal(cw_skimmer_t * skimmer, int worker, int n_workers)
+{
+	for (int c = worker; c < CW_SKIMMER_CHANNELS_MAX; c += n_workers) {
+		if (skimmer->channels[c].in_use) {
+			cw_skimmer_channel_process_internal(skimmer, &skimmer->channels[c]);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Feed frames of current batch to channel's detector, poll channel's receiver
+
+   @param[in] skimmer skimmer
+   @param[in,out] channel channel
+*/
+void cw_skimmer_channel_process_internal(cw_skimmer_t * skimmer, cw_skimmer_channel_t * channel)
+{
+	const int64_t begin = cw_skimmer_now_internal();
+	float peak = 0.0f;
+
+	for (int f = channel->first_frame; f < skimmer->n_frames; f++) {
+		const int64_t timestamp = skimmer->frame_timestamps[f];
+
+		if (!channel->detector->is_mark) {
+			bool is_end_of_word = false;
+			bool is_error = false;
+			if (CW_SUCCESS == cw_rec_compact_poll_internal(&channel->rec, skimmer->rec_params, timestamp, &is_end_of_word, &is_error)) {
+				/* Representation that doesn't match any
+				   character is usually a product of noise
+				   or of interference, so it isn't reported.
+				   Receiver must be reset in either case,
+				   otherwise it would be stuck in EOC/EOW
+				   state. */
+				const int character = cw_representation_hash_to_character_internal(channel->rec.representation_hash);
+				if (0 != character) {
+					cw_skimmer_channel_add_event_internal(channel, timestamp, (char) character, is_error);
+					channel->is_space_pending = true;
+					channel->n_characters++;
+				}
+				if (0 == character || is_error) {
+					channel->n_errors++;
+				}
+				cw_rec_compact_reset_state_internal(&channel->rec);
+			} else if (channel->is_space_pending) {
+				const int64_t dot = (int64_t) (CW_DOT_CALIBRATION * 1000.0f / cw_rec_compact_get_speed_internal(&channel->rec, skimmer->rec_params));
+				if (timestamp - channel->last_mark_end > CW_SKIMMER_EOW_DOTS * dot) {
+					cw_skimmer_channel_add_event_internal(channel, timestamp, ' ', false);
+					channel->is_space_pending = false;
+				}
+			}
+		}
+
+		const bool was_mark = channel->detector->is_mark;
+		const float magnitude = skimmer->frames[(size_t) f * (size_t) skimmer->n_bins + (size_t) channel->bin];
+		if (magnitude > peak) {
+			peak = magnitude;
+		}
+		cw_detector_process_magnitude_internal(channel->detector, magnitude, timestamp);
+		/* Errors reported by receiver (e.g. for noise spikes) are
+		   handled by receiver itself. */
+		if (was_mark && !channel->detector->is_mark) {
+			cw_rec_compact_mark_end_internal(&channel->rec, skimmer->rec_params, timestamp);
+			channel->last_mark_end = timestamp;
+		} else if (!was_mark && channel->detector->is_mark) {
+			cw_rec_compact_mark_begin_internal(&channel->rec, timestamp);
+			channel->is_space_pending = false;
+		}
+	}
+
+	/* Noise floor of the bin is updated only by caller's thread,
+	   between batches. */
+	const float floor = skimmer->bin_floor[channel->bin];
+	if (floor > 0.0f) {
+		channel->strength += (peak / floor - channel->strength) / 4.0f;
+	}
+
+	channel->cost_ns = cw_skimmer_now_internal() - begin;
+
+	return;
+}
+
+
+
+
+void cw_skimmer_channel_add_event_internal(cw_skimmer_channel_t * channel, int64_t timestamp, char character, bool is_error)
+{
+	if (channel->n_events == CW_SKIMMER_CHANNEL_EVENTS_MAX) {
+		return;
+	}
+
+	cw_skimmer_event_t * event = &channel->events[channel->n_events++];
+	event->frequency = channel->frequency;
+	event->timestamp = timestamp;
+	event->character = character;
+	event->is_error = is_error;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Main function of worker thread
+
+   Wait for a batch, process the worker's share of channels, report
+   completion.
+
+   @param[in] arg worker (cw_skimmer_worker_t)
+
+   @return NULL
+*/
+void * cw_skimmer_worker_internal(void * arg)
+{
+	cw_skimmer_worker_t * worker = (cw_skimmer_worker_t *) arg;
+	cw_skimmer_t * skimmer = worker->skimmer;
+	uint64_t generation = 0;
+
+	pthread_mutex_lock(&skimmer->pool_mutex);
+	for (;;) {
+		while (generation == skimmer->pool_generation && !skimmer->pool_quit) {
+			pthread_cond_wait(&skimmer->pool_start, &skimmer->pool_mutex);
+		}
+		if (skimmer->pool_quit) {
+			break;
+		}
+		generation = skimmer->pool_generation;
+		const int n_workers = skimmer->n_workers;
+		pthread_mutex_unlock(&skimmer->pool_mutex);
+
+		cw_skimmer_process_channels_internal(skimmer, worker->index, n_workers);
+
+		pthread_mutex_lock(&skimmer->pool_mutex);
+		skimmer->pool_n_done++;
+		if (skimmer->pool_n_done == n_workers) {
+			pthread_cond_signal(&skimmer->pool_done);
+		}
+	}
+	pthread_mutex_unlock(&skimmer->pool_mutex);
+
+	return NULL;
+}
+
+
+
+
+int cw_skimmer_event_compare_internal(const void * a, const void * b)
+{
+	const cw_skimmer_event_t * event_a = (const cw_skimmer_event_t *) a;
+	const cw_skimmer_event_t * event_b = (const cw_skimmer_event_t *) b;
+
+	if (event_a->timestamp != event_b->timestamp) {
+		return event_a->timestamp < event_b->timestamp ? -1 : 1;
+	}
+	return event_a->frequency - event_b->frequency;
+}
+
+
+
+
+int64_t cw_skimmer_sample_timestamp_internal(const cw_skimmer_t * skimmer, int64_t sample)
+{
+	const int64_t delta = sample - skimmer->anchor_sample;
+	return skimmer->anchor_timestamp + (delta * CW_NSECS_PER_SEC) / skimmer->sample_rate;
+}
+
+
+
+
+/**
+   @brief Controller of CPU budget
+
+   Called after each batch with time of processing of the batch
+   (filterbank and channels) and duration of its sound.
+
+   Skimmer is overloaded when cost of both the last batch and the
+   average cost exceed the budget: a single slow batch (e.g. when
+   the thread was preempted) doesn't degrade the skimmer, and after a
+   step of degradation the next batch shows whether it was enough.
+   Steps of degradation are: halving the overlap of frames, then
+   dropping channels. Steps are taken back in reverse order after the
+   load stays below half of the budget for CW_SKIMMER_RECOVERY_TIME.
+
+   @param[in,out] skimmer skimmer
+   @param[in] cost_ns time of processing of batch [ns]
+   @param[in] duration_ns duration of sound in the batch [ns]
+*/
+void cw_skimmer_control_internal(cw_skimmer_t * skimmer, int64_t cost_ns, int64_t duration_ns)
+{
+	if (duration_ns <= 0) {
+		return;
+	}
+
+	const int cost = (int) ((cost_ns * CW_USECS_PER_SEC) / duration_ns);
+	skimmer->cost = cw_skimmer_average_internal(skimmer->cost, cost_ns, duration_ns);
+
+	if (0 == skimmer->budget) {
+		return;
+	}
+
+	if (cost > skimmer->budget && skimmer->cost > skimmer->budget) {
+		skimmer->recovery_time = 0;
+
+		if (skimmer->hop_size_next == skimmer->hop_size_normal) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+				      MSG_PREFIX "overload: cost = %d us/s, budget = %d us/s, lowering overlap of frames",
+				      skimmer->cost, skimmer->budget);
+			skimmer->hop_size_next = 2 * skimmer->hop_size_normal;
+			return;
+		}
+
+		/* Count of channels that fits in target share of the
+		   budget, assuming that cost is proportional to count
+		   of channels. Drop at least one. */
+		const int64_t target = ((int64_t) skimmer->budget * CW_SKIMMER_BUDGET_TARGET) / 100;
+		int n_keep = (int) (((int64_t) skimmer->n_channels * target) / skimmer->cost);
+		if (n_keep >= skimmer->n_channels) {
+			n_keep = skimmer->n_channels - 1;
+		}
+		if (n_keep < 0) {
+			n_keep = 0;
+		}
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "overload: cost = %d us/s, budget = %d us/s, keeping %d of %d channels",
+			      skimmer->cost, skimmer->budget, n_keep, skimmer->n_channels);
+		cw_skimmer_drop_channels_internal(skimmer, n_keep);
+		skimmer->channels_limit = n_keep;
+
+		/* Next batch has fewer channels, don't let the old
+		   average trigger another drop. */
+		skimmer->cost = cost < skimmer->budget ? cost : skimmer->budget;
+		return;
+	}
+
+	if (cost < skimmer->budget / 2 && skimmer->cost < skimmer->budget / 2) {
+		skimmer->recovery_time += duration_ns;
+	} else {
+		skimmer->recovery_time = 0;
+	}
+
+	if (skimmer->recovery_time < CW_SKIMMER_RECOVERY_TIME) {
+		return;
+	}
+	skimmer->recovery_time = 0;
+
+	if (skimmer->channels_limit < CW_SKIMMER_CHANNELS_MAX) {
+		if (skimmer->n_channels < skimmer->channels_limit) {
+			/* There are fewer signals than the limit allows,
+			   and they fit in the budget. */
+			skimmer->channels_limit = CW_SKIMMER_CHANNELS_MAX;
+		} else {
+			int step = skimmer->channels_limit / 4;
+			if (step < CW_SKIMMER_RECOVERY_CHANNELS) {
+				step = CW_SKIMMER_RECOVERY_CHANNELS;
+			}
+			skimmer->channels_limit += step;
+			if (skimmer->channels_limit > CW_SKIMMER_CHANNELS_MAX) {
+				skimmer->channels_limit = CW_SKIMMER_CHANNELS_MAX;
+			}
+		}
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+			      MSG_PREFIX "recovery: limit of channels raised to %d", skimmer->channels_limit);
+	} else if (skimmer->hop_size_next != skimmer->hop_size_normal) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+			      MSG_PREFIX "recovery: restoring overlap of frames");
+		skimmer->hop_size_next = skimmer->hop_size_normal;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Close all channels except for @p n_keep channels with highest score
+
+   @param[in,out] skimmer skimmer
+   @param[in] n_keep count of channels to keep
+*/
+void cw_skimmer_drop_channels_internal(cw_skimmer_t * skimmer, int n_keep)
+{
+	while (skimmer->n_channels > n_keep) {
+		int weakest = -1;
+		float weakest_score = 0.0f;
+		for (int c = 0; c < CW_SKIMMER_CHANNELS_MAX; c++) {
+			if (!skimmer->channels[c].in_use) {
+				continue;
+			}
+			const float score = cw_skimmer_channel_score_internal(&skimmer->channels[c]);
+			if (-1 == weakest || score < weakest_score) {
+				weakest = c;
+				weakest_score = score;
+			}
+		}
+		cw_skimmer_channel_close_internal(skimmer, weakest);
+		skimmer->n_dropped++;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Score of channel: how much is it worth to keep decoding the channel
+
+   Strength of channel's signal, weighted by share of characters
+   decoded without errors.
+*/
+float cw_skimmer_channel_score_internal(const cw_skimmer_channel_t * channel)
+{
+	const float confidence = (float) (1 + channel->n_characters) / (float) (1 + channel->n_characters + channel->n_errors);
+	return channel->strength * confidence;
+}
+
+
+
+
+/**
+   @brief Change size of hop between frames of filterbank
+
+   Frames of current batch were made with old size of hop, so they
+   are processed first. Detectors of channels are told about new
+   interval between magnitudes.
+
+   @param[in,out] skimmer skimmer
+   @param[in] hop_size new size of hop [samples]
+*/
+void cw_skimmer_set_hop_size_internal(cw_skimmer_t * skimmer, int hop_size)
+{
+	if (skimmer->n_frames > 0) {
+		cw_skimmer_process_batch_internal(skimmer);
+	}
+
+	skimmer->hop_size = hop_size;
+	const int hop_duration = (int) (((int64_t) skimmer->hop_size * CW_USECS_PER_SEC) / skimmer->sample_rate);
+	for (int c = 0; c < CW_SKIMMER_CHANNELS_MAX; c++) {
+		if (skimmer->channels[c].in_use) {
+			cw_detector_set_block_duration(skimmer->channels[c].detector, hop_duration);
+		}
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "size of hop = %d samples", hop_size);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get time of monotonic clock of the system [ns]
+
+   Costs are measured in real time even when the library runs on
+   injected (e.g. virtual) clock.
+*/
+int64_t cw_skimmer_now_internal(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * CW_NSECS_PER_SEC + ts.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Update running average of cost with cost of last batch
+
+   @param[in] average current average [us/s]
+   @param[in] cost_ns time of processing of batch [ns]
+   @param[in] duration_ns duration of sound in the batch [ns]
+
+   @return new average [us/s]
+*/
+int cw_skimmer_average_internal(int average, int64_t cost_ns, int64_t duration_ns)
+{
+	if (duration_ns <= 0) {
+		return average;
+	}
+	const int cost = (int) ((cost_ns * CW_USECS_PER_SEC) / duration_ns);
+	return average + (cost - average) / 4;
+}
@@ -0,0 +1,183 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SKIMMER
+#define H_LIBCW_SKIMMER
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_detector.h"
+#include "libcw_rec.h"
+
+
+
+
+enum { CW_SKIMMER_CHANNELS_MAX = 256 };
+enum { CW_SKIMMER_WORKERS_MAX = 64 };
+enum { CW_SKIMMER_EVENTS_CAPACITY = 4096 };
+
+/* Input is analyzed in batches of at most this many frames of
+   filterbank. Channels are processed by workers once per batch. */
+enum { CW_SKIMMER_BATCH_FRAMES = 64 };
+
+/* Capacity of per-channel buffer of events produced during a batch. */
+enum { CW_SKIMMER_CHANNEL_EVENTS_MAX = 16 };
+
+
+
+
+/* Single decoded signal: a bin of filterbank with its own detector
+   (envelope follower and hysteresis) and compact receiver. */
+typedef struct {
+	bool in_use;
+	int bin;
+	int frequency; /* [Hz] */
+
+	/* Detector only tracks presence of tone, its transitions are
+	   passed to receiver by skimmer. Parameters of receiver are in
+	   skimmer's rec_params. */
+	cw_rec_compact_t rec;
+	cw_detector_t * detector;
+
+	/* Index of frame (in current batch) from which the channel
+	   consumes magnitudes. Non-zero only for channel created during
+	   current batch. */
+	int first_frame;
+
+	/* Timestamp of last end of mark, used for detection of
+	   inter-word-space and of inactive channel [ns]. */
+	int64_t last_mark_end;
+	bool is_space_pending;
+
+	/* Events produced by worker during current batch, merged into
+	   skimmer's queue of events at the end of batch. */
+	cw_skimmer_event_t events[CW_SKIMMER_CHANNEL_EVENTS_MAX];
+	int n_events;
+
+	/* Time of processing of channel in current batch, measured by
+	   worker [ns], and its average per second of sound [us/s]. */
+	int64_t cost_ns;
+	int cost;
+
+	/* Average ratio of peak magnitude of channel's bin in a batch
+	   to noise floor of the bin, and counts of decoded characters
+	   and of errors. Together they tell how much the channel is
+	   worth when the skimmer is overloaded. */
+	float strength;
+	int n_characters;
+	int n_errors;
+} cw_skimmer_channel_t;
+
+
+
+
+typedef struct {
+	cw_skimmer_t * skimmer;
+	int index;
+	pthread_t thread;
+} cw_skimmer_worker_t;
+
+
+
+
+struct cw_skimmer_struct {
+	int sample_rate;
+	int bin_low;
+	int bin_high; /* Inclusive. */
+
+	/* Filterbank. */
+	int fft_size;
+	int hop_size;
+	int hop_size_normal; /* fft_size / 4, used when skimmer is not overloaded. */
+	float * window;      /* fft_size */
+	float * twiddle_re;  /* fft_size / 2 */
+	float * twiddle_im;  /* fft_size / 2 */
+	int * bit_reverse;   /* fft_size */
+	float * history;     /* Last fft_size input samples. */
+	int history_fill;    /* Count of new samples since last frame. */
+	float * fft_re;
+	float * fft_im;
+
+	/* Noise floor of each bin, for finding active bins. */
+	float * bin_floor;
+	bool is_primed;
+
+	/* Magnitudes of bins, for all frames of current batch:
+	   frames[frame * n_bins + (bin - bin_low)]. */
+	int n_bins;
+	float * frames;
+	int64_t frame_timestamps[CW_SKIMMER_BATCH_FRAMES];
+	int n_frames;
+
+	/* Receiver (in adaptive mode) holding parameters shared by
+	   compact receivers of all channels. Only read after creation
+	   of skimmer, so workers don't need to lock it. */
+	cw_rec_t * rec_params;
+
+	/* Channels, and map: bin -> index of channel, or -1. */
+	cw_skimmer_channel_t channels[CW_SKIMMER_CHANNELS_MAX];
+	int n_channels;
+	int * bin_channel;
+
+	/* Count of consecutive frames in which a bin looked like a new
+	   signal. */
+	int * bin_hits;
+
+	/* Timeline of input samples, see cw_detector_t. */
+	int64_t n_samples;
+	int64_t anchor_sample;
+	int64_t anchor_timestamp;
+
+	/* Decoded characters, a ring buffer. */
+	cw_skimmer_event_t events[CW_SKIMMER_EVENTS_CAPACITY];
+	int events_head;
+	int events_count;
+
+	/* Events of all channels from current batch, to be sorted. */
+	cw_skimmer_event_t merge[CW_SKIMMER_CHANNELS_MAX * CW_SKIMMER_CHANNEL_EVENTS_MAX];
+
+	/* Worker pool. Workers process channels of a batch of frames;
+	   channel N is processed by worker (N % n_workers). */
+	int n_workers;
+	cw_skimmer_worker_t workers[CW_SKIMMER_WORKERS_MAX];
+	pthread_mutex_t pool_mutex;
+	pthread_cond_t pool_start;
+	pthread_cond_t pool_done;
+	uint64_t pool_generation;
+	int pool_n_done;
+	bool pool_quit;
+
+	/* Controller of CPU budget, see cw_skimmer_control_internal().
+	   Costs are averages of times of processing per second of
+	   sound [us/s]. */
+	int budget;                  /* [us/s], zero if there is no budget. */
+	int cost;
+	int filterbank_cost;
+	int channels_cost;
+	int64_t filterbank_cost_ns;  /* Time of filterbank since last batch [ns]. */
+	int hop_size_next;           /* Size of hop requested by controller, applied on next boundary of frames. */
+	int channels_limit;          /* New channels are not opened when this many are open. */
+	int n_dropped;
+	int64_t recovery_time;       /* How long the load has been low [ns]. */
+};
+
+
+
+
+void cw_skimmer_control_internal(cw_skimmer_t * skimmer, int64_t cost_ns, int64_t duration_ns);
+
+
+
+
+#endif /* #ifndef H_LIBCW_SKIMMER */
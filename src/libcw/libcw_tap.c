@@ -0,0 +1,566 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_tap.c
+
+   @brief Taps. Samples of one generator played on many sound sinks.
+
+   Generator calculates its samples in a block taken from a pool of
+   blocks shared with its taps: gen->buffer points to samples of the
+   block. When the buffer is full and has been written to generator's
+   own sound device, the block is put (by pointer, with a reference
+   count) into queue of each tap, and generator continues in a free
+   block from the pool. Samples are never copied for taps, and
+   generator never waits for them: if queue of a tap is full, the
+   block is dropped for that tap.
+
+   Each tap has a sink generator that owns the tap's sound device
+   (like output of mixer, its thread is never started), and a thread
+   that takes blocks from the queue and writes them to the sink. When
+   a block holds a whole buffer of the sink, the sink writes straight
+   from the block. Otherwise samples are collected in sink's own
+   buffer until it is full.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_tap.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/tap: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_tap_t * cw_tap_new_internal(const cw_gen_config_t * sink_conf);
+static void cw_tap_delete_internal(cw_tap_t ** tap);
+static cw_ret_t cw_tap_fanout_grow_internal(cw_gen_t * gen, int n_blocks);
+static void cw_tap_block_release_internal(cw_tap_block_t * block);
+static void cw_tap_write_block_internal(cw_tap_t * tap, cw_tap_block_t * block);
+static void cw_tap_write_internal(cw_tap_t * tap, cw_sample_t * samples);
+static void * cw_tap_thread_internal(void * arg);
+
+
+
+
+/**
+   @brief Add a tap to generator
+
+   Samples of @p gen will also be played on a sound sink configured
+   with @p sink_conf. The tap is owned by @p gen and is deleted
+   together with it.
+
+   The function must be called before @p gen is started.
+
+   @exception EINVAL invalid arguments, @p gen or sink work in pull mode, sink doesn't play samples, sink's sample rate is different than generator's
+   @exception EBUSY @p gen has been started
+   @exception ENOSPC @p gen already has CW_GEN_TAPS_MAX taps
+
+   @param[in] gen generator
+   @param[in] sink_conf configuration of sound sink of the tap
+
+   @return new tap on success
+   @return NULL pointer on failure
+*/
+cw_tap_t * cw_gen_add_tap(cw_gen_t * gen, const cw_gen_config_t * sink_conf)
+{
+	if (NULL == gen || NULL == sink_conf || sink_conf->pull_mode
+	    || gen->pull.enabled || NULL == gen->buffer) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "add: invalid generator or configuration of sink");
+		errno = EINVAL;
+		return (cw_tap_t *) NULL;
+	}
+	if (gen->do_dequeue_and_generate || gen->thread.running) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "add: generator has been started");
+		errno = EBUSY;
+		return (cw_tap_t *) NULL;
+	}
+	if (NULL != gen->fanout && gen->fanout->n_taps == CW_GEN_TAPS_MAX) {
+		errno = ENOSPC;
+		return (cw_tap_t *) NULL;
+	}
+
+	cw_tap_t * tap = cw_tap_new_internal(sink_conf);
+	if (NULL == tap) {
+		return (cw_tap_t *) NULL;
+	}
+	if (tap->sink->sample_rate != gen->sample_rate) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "add: sample rate of sink (%u) is different than sample rate of generator (%u)",
+			      tap->sink->sample_rate, gen->sample_rate);
+		cw_tap_delete_internal(&tap);
+		errno = EINVAL;
+		return (cw_tap_t *) NULL;
+	}
+
+	const int n_taps = NULL == gen->fanout ? 1 : gen->fanout->n_taps + 1;
+	if (CW_SUCCESS != cw_tap_fanout_grow_internal(gen, n_taps * CW_TAP_QUEUE_CAPACITY + 1)) {
+		cw_tap_delete_internal(&tap);
+		errno = ENOMEM;
+		return (cw_tap_t *) NULL;
+	}
+
+	const int rv = pthread_create(&tap->thread, NULL, cw_tap_thread_internal, tap);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "add: pthread_create(): %s", strerror(rv));
+		cw_tap_delete_internal(&tap);
+		errno = rv;
+		return (cw_tap_t *) NULL;
+	}
+	tap->thread_running = true;
+
+	gen->fanout->taps[gen->fanout->n_taps] = tap;
+	gen->fanout->n_taps++;
+
+	return tap;
+}
+
+
+
+
+/**
+   @brief Get statistics of tap
+
+   @exception EINVAL @p tap or @p stats is NULL
+
+   @param[in] tap tap
+   @param[out] stats statistics of the tap
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tap_get_stats(const cw_tap_t * tap, cw_tap_stats_t * stats)
+{
+	if (NULL == tap || NULL == stats) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	stats->n_buffers = __atomic_load_n(&tap->n_buffers, __ATOMIC_RELAXED);
+	stats->n_dropped = __atomic_load_n(&tap->n_dropped, __ATOMIC_RELAXED);
+	stats->n_errors = __atomic_load_n(&tap->n_errors, __ATOMIC_RELAXED);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Hand full buffer of generator to all taps of the generator
+
+   Called by generator's thread after gen->buffer has been written to
+   generator's sound device. Block of gen->buffer is put into queue of
+   each tap that has space for it, and gen->buffer is switched to a
+   free block.
+
+   @param[in] gen generator with taps
+*/
+void cw_tap_publish_internal(cw_gen_t * gen)
+{
+	cw_gen_fanout_t * fanout = gen->fanout;
+	cw_tap_block_t * block = fanout->current;
+	block->n_samples = gen->buffer_write_n_samples;
+
+	/* Generator holds the block until it has been queued for all
+	   taps, so that fast tap doesn't free it in the meantime. */
+	__atomic_store_n(&block->refcount, 1, __ATOMIC_RELAXED);
+
+	for (int i = 0; i < fanout->n_taps; i++) {
+		cw_tap_t * tap = fanout->taps[i];
+		const uint32_t tail = __atomic_load_n(&tap->tail, __ATOMIC_ACQUIRE);
+		if (tap->head - tail == CW_TAP_QUEUE_CAPACITY) {
+			__atomic_fetch_add(&tap->n_dropped, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		__atomic_fetch_add(&block->refcount, 1, __ATOMIC_RELAXED);
+		tap->queue[tap->head % CW_TAP_QUEUE_CAPACITY] = block;
+		__atomic_store_n(&tap->head, tap->head + 1, __ATOMIC_RELEASE);
+		sem_post(&tap->sem);
+	}
+
+	cw_tap_block_release_internal(block);
+
+	/* There are more blocks than taps can hold, so a free block
+	   is always found. */
+	cw_tap_block_t * next = (cw_tap_block_t *) NULL;
+	for (int i = 0; i < fanout->n_blocks; i++) {
+		if (0 == __atomic_load_n(&fanout->blocks[i]->refcount, __ATOMIC_ACQUIRE)) {
+			next = fanout->blocks[i];
+			break;
+		}
+	}
+	cw_assert (NULL != next, MSG_PREFIX "no free block of samples");
+	fanout->current = next;
+	gen->buffer = next->samples;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Delete all taps of generator
+
+   Threads of taps are stopped, sinks are closed, and generator gets
+   back its own buffer.
+
+   @param[in] gen generator
+*/
+void cw_tap_delete_all_internal(cw_gen_t * gen)
+{
+	cw_gen_fanout_t * fanout = gen->fanout;
+	if (NULL == fanout) {
+		return;
+	}
+
+	for (int i = 0; i < fanout->n_taps; i++) {
+		cw_tap_delete_internal(&fanout->taps[i]);
+	}
+	for (int i = 0; i < fanout->n_blocks; i++) {
+		free(fanout->blocks[i]);
+	}
+	free(fanout->blocks);
+
+	gen->buffer = fanout->gen_buffer;
+	free(fanout);
+	gen->fanout = (cw_gen_fanout_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Create tap with new sink generator
+
+   Thread of the tap is not started.
+
+   @param[in] sink_conf configuration of sound sink
+
+   @return new tap on success
+   @return NULL pointer on failure
+*/
+static cw_tap_t * cw_tap_new_internal(const cw_gen_config_t * sink_conf)
+{
+	cw_tap_t * tap = (cw_tap_t *) calloc(1, sizeof (cw_tap_t));
+	if (NULL == tap) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return (cw_tap_t *) NULL;
+	}
+	sem_init(&tap->sem, 0, 0);
+
+	tap->sink = cw_gen_new(sink_conf);
+	if (NULL == tap->sink) {
+		cw_tap_delete_internal(&tap);
+		return (cw_tap_t *) NULL;
+	}
+	if (NULL == tap->sink->buffer || tap->sink->pull.enabled) {
+		/* Null and Console sound systems don't play samples,
+		   JACK pulls samples by itself. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: sound system %s can't be used by tap",
+			      cw_get_audio_system_label(tap->sink->sound_system));
+		cw_tap_delete_internal(&tap);
+		errno = EINVAL;
+		return (cw_tap_t *) NULL;
+	}
+
+	return tap;
+}
+
+
+
+
+/**
+   @brief Stop thread of tap and delete the tap
+
+   Blocks queued for the tap are written to its sink before the thread
+   ends.
+
+   @param[in] tap pointer to tap to delete
+*/
+static void cw_tap_delete_internal(cw_tap_t ** tap)
+{
+	if (NULL == tap || NULL == *tap) {
+		return;
+	}
+
+	if ((*tap)->thread_running) {
+		__atomic_store_n(&(*tap)->do_stop, true, __ATOMIC_RELEASE);
+		sem_post(&(*tap)->sem);
+		pthread_join((*tap)->thread, NULL);
+		(*tap)->thread_running = false;
+	}
+	while ((*tap)->tail != (*tap)->head) {
+		cw_tap_block_release_internal((*tap)->queue[(*tap)->tail % CW_TAP_QUEUE_CAPACITY]);
+		(*tap)->tail++;
+	}
+
+	cw_gen_delete(&(*tap)->sink);
+	sem_destroy(&(*tap)->sem);
+
+	free(*tap);
+	*tap = (cw_tap_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Make sure that generator has at least given count of blocks of samples
+
+   On first call generator's own buffer is set aside, and gen->buffer
+   is switched to the first block.
+
+   @param[in] gen generator
+   @param[in] n_blocks count of blocks
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure to allocate memory
+*/
+static cw_ret_t cw_tap_fanout_grow_internal(cw_gen_t * gen, int n_blocks)
+{
+	if (NULL == gen->fanout) {
+		gen->fanout = (cw_gen_fanout_t *) calloc(1, sizeof (cw_gen_fanout_t));
+		if (NULL == gen->fanout) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			return CW_FAILURE;
+		}
+		gen->fanout->gen_buffer = gen->buffer;
+	}
+	cw_gen_fanout_t * fanout = gen->fanout;
+
+	cw_tap_block_t ** blocks = (cw_tap_block_t **) realloc(fanout->blocks, sizeof (cw_tap_block_t *) * (size_t) n_blocks);
+	if (NULL == blocks) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "realloc()");
+		return CW_FAILURE;
+	}
+	fanout->blocks = blocks;
+
+	const size_t block_size = sizeof (cw_tap_block_t) + sizeof (cw_sample_t) * (size_t) gen->buffer_n_samples;
+	while (fanout->n_blocks < n_blocks) {
+		cw_tap_block_t * block = (cw_tap_block_t *) calloc(1, block_size);
+		if (NULL == block) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			return CW_FAILURE;
+		}
+		fanout->blocks[fanout->n_blocks] = block;
+		fanout->n_blocks++;
+	}
+
+	if (NULL == fanout->current) {
+		fanout->current = fanout->blocks[0];
+		gen->buffer = fanout->current->samples;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Release one reference to block
+
+   Block whose last reference has been released can be reused by
+   generator.
+
+   @param[in] block block of samples
+*/
+static void cw_tap_block_release_internal(cw_tap_block_t * block)
+{
+	__atomic_fetch_sub(&block->refcount, 1, __ATOMIC_RELEASE);
+	return;
+}
+
+
+
+
+/**
+   @brief Write samples of block to sink of tap
+
+   Samples are written in buffers of size of sink's buffer. Whole
+   buffers are written straight from the block, the remainder is
+   collected in sink's own buffer.
+
+   @param[in] tap tap
+   @param[in] block block of samples
+*/
+static void cw_tap_write_block_internal(cw_tap_t * tap, cw_tap_block_t * block)
+{
+	cw_gen_t * sink = tap->sink;
+	const int n_samples = sink->buffer_n_samples;
+
+	int pos = 0;
+	while (pos < block->n_samples) {
+		const int available = block->n_samples - pos;
+		if (0 == tap->sink_fill && available >= n_samples) {
+			cw_tap_write_internal(tap, block->samples + pos);
+			pos += n_samples;
+			continue;
+		}
+
+		int n = n_samples - tap->sink_fill;
+		if (n > available) {
+			n = available;
+		}
+		memcpy(sink->buffer + tap->sink_fill, block->samples + pos, sizeof (cw_sample_t) * (size_t) n);
+		tap->sink_fill += n;
+		pos += n;
+		if (tap->sink_fill == n_samples) {
+			cw_tap_write_internal(tap, sink->buffer);
+			tap->sink_fill = 0;
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write one buffer of samples to sink of tap
+
+   @param[in] tap tap
+   @param[in] samples sink->buffer_n_samples mono samples
+*/
+static void cw_tap_write_internal(cw_tap_t * tap, cw_sample_t * samples)
+{
+	cw_gen_t * sink = tap->sink;
+	cw_sample_t * own_buffer = sink->buffer;
+
+	sink->buffer_write_n_samples = sink->buffer_n_samples;
+	if (NULL != sink->frames) {
+		cw_gen_route_samples_internal(samples, sink->buffer_write_n_samples,
+					      sink->sound_channel_volumes, sink->n_sound_channels, sink->sample_format, sink->frames);
+	} else {
+		sink->buffer = samples;
+	}
+
+	const int64_t write_begin = cw_clock_now_internal();
+	const cw_ret_t write_ret = sink->write_buffer_to_sound_device(sink);
+	cw_gen_stats_add_write_internal(sink, write_ret, sink->buffer_write_n_samples, cw_clock_now_internal() - write_begin);
+	sink->buffer = own_buffer;
+
+	if (CW_SUCCESS == write_ret) {
+		__atomic_fetch_add(&tap->n_buffers, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_add(&tap->n_errors, 1, __ATOMIC_RELAXED);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread of tap
+
+   The thread sleeps until generator queues a block, writes all
+   queued blocks to the sink, and releases them. On stop the thread
+   ends after writing blocks that are already queued.
+
+   @param[in] arg tap (cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_tap_thread_internal(void * arg)
+{
+	cw_tap_t * tap = (cw_tap_t *) arg;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "tap", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "tap");
+#endif
+
+	cw_gen_apply_thread_realtime_internal(tap->sink);
+
+	while (true) {
+		while (0 != sem_wait(&tap->sem) && EINTR == errno) {
+			;
+		}
+
+		const uint32_t head = __atomic_load_n(&tap->head, __ATOMIC_ACQUIRE);
+		while (tap->tail != head) {
+			cw_tap_block_t * block = tap->queue[tap->tail % CW_TAP_QUEUE_CAPACITY];
+			cw_tap_write_block_internal(tap, block);
+			cw_tap_block_release_internal(block);
+			__atomic_store_n(&tap->tail, tap->tail + 1, __ATOMIC_RELEASE);
+		}
+
+		/* Blocks queued before stop have been written. */
+		if (__atomic_load_n(&tap->do_stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+	}
+
+	return NULL;
+}
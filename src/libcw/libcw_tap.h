@@ -0,0 +1,107 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_TAP
+#define H_LIBCW_TAP
+
+
+
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Count of buffers that can wait in queue of a tap. When the queue
+   is full, new buffers are dropped for this tap only. */
+enum { CW_TAP_QUEUE_CAPACITY = 16 };
+
+
+
+
+/* Buffer of samples calculated by generator, shared by reference by
+   generator and its taps. Block is free when its refcount is zero. */
+typedef struct {
+	int refcount;
+	int n_samples;
+	cw_sample_t samples[];
+} cw_tap_block_t;
+
+
+
+
+struct cw_tap_struct {
+	/* Generator that owns sound sink of the tap. Its thread is
+	   never started: tap's thread writes buffers to the sink. */
+	cw_gen_t * sink;
+
+	/* Single-producer (generator's thread), single-consumer (tap's
+	   thread) ring of blocks. 'head' and 'tail' are counters that
+	   never wrap; block of n-th item is queue[n % capacity]. */
+	cw_tap_block_t * queue[CW_TAP_QUEUE_CAPACITY];
+	uint32_t head;
+	uint32_t tail;
+
+	/* Posted by generator's thread for each queued block, and on
+	   stop. Posting never blocks the generator. */
+	sem_t sem;
+
+	/* Count of samples collected in sink->buffer, when buffers of
+	   generator and of sink have different sizes. */
+	int sink_fill;
+
+	pthread_t thread;
+	bool thread_running;
+	bool do_stop;
+
+	/* Updated with atomic operations, read by cw_tap_get_stats(). */
+	uint64_t n_buffers;
+	uint64_t n_dropped;
+	uint64_t n_errors;
+};
+
+
+
+
+/* Taps of a generator, and blocks shared by the generator and the
+   taps. */
+typedef struct cw_gen_fanout_struct {
+	cw_tap_t * taps[CW_GEN_TAPS_MAX];
+	int n_taps;
+
+	/* Tap holds at most CW_TAP_QUEUE_CAPACITY blocks (block being
+	   written to sink stays in queue until it is released), so with
+	   n_taps * CW_TAP_QUEUE_CAPACITY + 1 blocks generator always
+	   finds a free one. */
+	cw_tap_block_t ** blocks;
+	int n_blocks;
+
+	/* Block into which generator is calculating samples: gen->buffer
+	   points to its samples. */
+	cw_tap_block_t * current;
+
+	/* Generator's own buffer, given back to generator when taps
+	   are deleted. */
+	cw_sample_t * gen_buffer;
+} cw_gen_fanout_t;
+
+
+
+
+void cw_tap_publish_internal(cw_gen_t * gen);
+void cw_tap_delete_all_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_TAP */
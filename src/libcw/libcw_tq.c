@@ -62,15 +62,40 @@
    Tone queue data type is not visible to user of library's API. Tone
    queue is an integral part of a generator. Generator data type is
    visible to user of library's API.
+
+
+   Single-producer/single-consumer (SPSC) mode:
+
+   By default every enqueue and dequeue takes queue's mutex and broadcasts
+   on queue's condition variable. In SPSC mode (see
+   cw_tq_set_spsc_mode_internal()) the queue's length, head and tail are
+   accessed with atomic operations, and the mutex is taken only when the
+   queue goes from empty to non-empty state (to wake up generator), when
+   the queue becomes empty (to update queue's state), when low water mark
+   is crossed, or when some thread waits for a change of queue's level.
+
+   Operations that modify structure of the queue (flush, removal of last
+   character) still take the mutex, and additionally keep producer and
+   consumer out of their lock-free sections for the duration of the
+   operation.
 */
 
 
 
 
+#include "config.h"
+
 #include <errno.h>
 #include <inttypes.h> /* "PRIu32" */
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
 
 
 
@@ -78,10 +103,15 @@
 #include "libcw2.h"
 #include "libcw.h"
 #include "libcw_debug.h"
+#include "libcw_dispatch.h"
 #include "libcw_gen.h"
+#include "libcw_key.h"
+#include "libcw_shmq.h"
 #include "libcw_signal.h"
 #include "libcw_tq.h"
 #include "libcw_tq_internal.h"
+#include "libcw_trace.h"
+#include "libcw_utils.h"
 
 
 
@@ -102,6 +132,42 @@
 
 
 
+/* Sequentially consistent atomic operations on fields of tone queue that
+   are shared between producer and consumer in SPSC mode. */
+#define CW_TQ_ATOMIC_LOAD(m_var)           __atomic_load_n(&(m_var), __ATOMIC_SEQ_CST)
+#define CW_TQ_ATOMIC_STORE(m_var, m_val)   __atomic_store_n(&(m_var), (m_val), __ATOMIC_SEQ_CST)
+#define CW_TQ_ATOMIC_FETCH_ADD(m_var, m_val) __atomic_fetch_add(&(m_var), (m_val), __ATOMIC_SEQ_CST)
+#define CW_TQ_ATOMIC_FETCH_SUB(m_var, m_val) __atomic_fetch_sub(&(m_var), (m_val), __ATOMIC_SEQ_CST)
+
+
+
+
+static bool cw_tq_spsc_enter_internal(cw_tone_queue_t * tq, volatile int * busy);
+static void cw_tq_spsc_leave_internal(volatile int * busy);
+static void cw_tq_lock_exclusive_internal(cw_tone_queue_t * tq);
+static void cw_tq_unlock_exclusive_internal(cw_tone_queue_t * tq);
+static cw_ret_t cw_tq_enqueue_spsc_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones, size_t n_nonempty);
+static cw_queue_state_t cw_tq_dequeue_spsc_internal(cw_tone_queue_t * tq, cw_tone_t * tone);
+static bool cw_tq_is_low_water_crossed_internal(const cw_tone_queue_t * tq, size_t len_before, size_t len_after);
+static void cw_tq_notify_low_water_internal(cw_tone_queue_t * tq);
+static void cw_tq_signal_event_internal(cw_tone_queue_t * tq);
+static cw_ret_t cw_tq_resize_storage_internal(cw_tone_queue_t * tq, size_t n_slots);
+static cw_ret_t cw_tq_grow_storage_internal(cw_tone_queue_t * tq, size_t n_slots_needed);
+static bool cw_tq_coalesce_tone_internal(volatile cw_tone_t * last, const cw_tone_t * tone);
+static bool cw_tq_add_tone_elements_internal(uint32_t a, uint32_t b, uint32_t * sum);
+static void cw_tq_wait_internal(cw_tone_queue_t * tq, cw_tq_waiter_t * waiter);
+static bool cw_tq_waiter_is_ready_internal(const cw_tone_queue_t * tq, const cw_tq_waiter_t * waiter);
+static void cw_tq_wake_waiters_internal(cw_tone_queue_t * tq);
+static void cw_tq_complete_async_internal(cw_tone_queue_t * tq, cw_tq_waiter_t * waiter);
+static void cw_tq_run_completions_internal(cw_tone_queue_t * tq);
+static cw_tq_char_t * cw_tq_char_at_internal(const cw_tone_queue_t * tq, size_t i);
+static void cw_tq_chars_add_internal(cw_tone_queue_t * tq, uint64_t start, char character);
+static void cw_tq_chars_trim_internal(cw_tone_queue_t * tq);
+static void cw_tq_truncate_internal(cw_tone_queue_t * tq, uint64_t end);
+
+
+
+
 /*
    The CW tone queue functions implement the following state graph:
 
@@ -187,18 +253,38 @@ cw_tone_queue_t * cw_tq_new_internal(void)
 	tq->head = 0;
 	tq->tail = 0;
 	tq->len = 0;
+	tq->len_max = 0;
 	tq->state = CW_TQ_EMPTY;
 
 	tq->low_water_mark = 0;
 	tq->low_water_callback = NULL;
 	tq->low_water_callback_arg = NULL;
+	tq->event_fd = -1;
+	tq->waiters = (cw_tq_waiter_t *) NULL;
+
+	tq->n_enqueued = 0;
+	tq->n_dequeued = 0;
+	tq->chars.records = (cw_tq_char_t *) NULL;
+	tq->chars.n_slots = 0;
+	tq->chars.head = 0;
+	tq->chars.len = 0;
+	tq->chars.next_offset = 0;
 
 	tq->gen = (cw_gen_t *) NULL; /* This field will be set by generator code. */
 
-	cw_ret_t cwret = cw_tq_set_capacity_internal(tq, CW_TONE_QUEUE_CAPACITY_MAX, CW_TONE_QUEUE_HIGH_WATER_MARK_MAX);
-	cw_assert (CW_SUCCESS == cwret, MSG_PREFIX "new: failed to set initial capacity of tq");
+	tq->queue = (volatile cw_tone_t *) NULL;
+	tq->n_slots = 0;
+	tq->lazy_allocation = false;
 
+	/* This also allocates memory for the ring of tones. */
+	cw_ret_t cwret = cw_tq_set_capacity_internal(tq, CW_TONE_QUEUE_CAPACITY_DEFAULT, CW_TONE_QUEUE_HIGH_WATER_MARK_DEFAULT);
 	pthread_mutex_unlock(&tq->wait_mutex);
+	if (CW_SUCCESS != cwret) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: failed to set initial capacity of tq");
+		cw_tq_delete_internal(&tq);
+		return (cw_tone_queue_t *) NULL;
+	}
 
 	return tq;
 }
@@ -249,6 +335,28 @@ void cw_tq_delete_internal(cw_tone_queue_t ** tq)
 	//pthread_cond_destroy(&(*tq)->wait_var);
 	pthread_mutex_destroy(&(*tq)->wait_mutex);
 
+	/* Drop asynchronous waits that haven't been completed. */
+	cw_tq_waiter_t * lists[2] = { (*tq)->waiters, (*tq)->completed };
+	for (size_t i = 0; i < sizeof (lists) / sizeof (lists[0]); i++) {
+		cw_tq_waiter_t * waiter = lists[i];
+		while (NULL != waiter) {
+			cw_tq_waiter_t * next = waiter->next;
+			if (waiter->is_async) {
+				free(waiter);
+			}
+			waiter = next;
+		}
+	}
+
+	cw_shmq_disconnect_internal(&(*tq)->shmq_producer);
+
+	if (-1 != (*tq)->event_fd) {
+		close((*tq)->event_fd);
+	}
+
+	/* Cast through integer type to drop "volatile" qualifier without a warning. */
+	free((void *) (uintptr_t) (*tq)->queue);
+	free((*tq)->chars.records);
 	free(*tq);
 	*tq = (cw_tone_queue_t *) NULL;
 
@@ -269,22 +377,28 @@ void cw_tq_delete_internal(cw_tone_queue_t ** tq)
 */
 void cw_tq_make_empty_internal(cw_tone_queue_t * tq)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
+	cw_tq_lock_exclusive_internal(tq);
 	bool broadcast = false;
 	if (tq->len > 0 || tq->state != CW_TQ_EMPTY) {
 		broadcast = true;
 	}
 
-	tq->head = 0;
-	tq->tail = 0;
-	tq->len = 0;
+	CW_TQ_ATOMIC_STORE(tq->head, 0);
+	CW_TQ_ATOMIC_STORE(tq->tail, 0);
+	CW_TQ_ATOMIC_STORE(tq->len, 0);
 	tq->state = CW_TQ_EMPTY;
 
+	/* Discarded tones count as removed from head of queue. */
+	CW_TQ_ATOMIC_STORE(tq->n_dequeued, tq->n_enqueued);
+	tq->chars.head = 0;
+	tq->chars.len = 0;
+
 	if (broadcast) {
 		//fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'make empty'\n", __func__, __LINE__);
 		pthread_cond_broadcast(&tq->wait_var);
+		cw_tq_wake_waiters_internal(tq);
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_unlock_exclusive_internal(tq);
 
 	return;
 }
@@ -301,18 +415,26 @@ void cw_tq_make_empty_internal(cw_tone_queue_t * tq)
 
    Calling the function *by a client code* for a queue is optional, as
    a queue has these parameters always set to default values
-   (CW_TONE_QUEUE_CAPACITY_MAX and CW_TONE_QUEUE_HIGH_WATER_MARK_MAX)
+   (CW_TONE_QUEUE_CAPACITY_DEFAULT and CW_TONE_QUEUE_HIGH_WATER_MARK_DEFAULT)
    by internal call to cw_tq_new_internal().
 
-   @p capacity must be no larger than CW_TONE_QUEUE_CAPACITY_MAX.
-   @p high_water_mark must be no larger than CW_TONE_QUEUE_HIGH_WATER_MARK_MAX.
+   @p capacity must be no larger than CW_TONE_QUEUE_CAPACITY_LIMIT.
 
    Both values must be larger than zero (this condition is subject to
    changes in future revisions of the library).
 
    @p high_water_mark must be no larger than @p capacity.
 
+   The ring of tones is re-allocated to fit the new capacity (or, if
+   lazy allocation is enabled for @p tq, to fit tones currently in the
+   queue). Tones already in the queue are preserved, so @p capacity
+   can't be smaller than current length of the queue.
+
+   Caller must make sure that neither producer nor consumer access the
+   queue during the call.
+
    @exception EINVAL any of the two parameters (@p capacity or @p high_water_mark) is invalid.
+   @exception ENOMEM failed to allocate memory for the ring of tones
 
    @internal
    @reviewed 2020-07-28
@@ -332,7 +454,7 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 		return CW_FAILURE;
 	}
 
-	if (0 == high_water_mark || high_water_mark > CW_TONE_QUEUE_HIGH_WATER_MARK_MAX) {
+	if (0 == high_water_mark) {
 		/* If we allowed high water mark to be zero, the queue
 		   would not accept any new tones: it would constantly
 		   be full. Any attempt to enqueue any tone would
@@ -342,18 +464,35 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 		return CW_FAILURE;
 	}
 
-	if (0 == capacity || capacity > CW_TONE_QUEUE_CAPACITY_MAX) {
+	if (0 == capacity || capacity > CW_TONE_QUEUE_CAPACITY_LIMIT) {
 		/* Tone queue of capacity zero doesn't make much
 		   sense, so capacity == 0 is not allowed. */
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
 
-	if (high_water_mark > capacity) {
+	if (high_water_mark > capacity || tq->len > capacity) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
 
+	size_t n_slots = capacity;
+	if (tq->lazy_allocation) {
+		if (0 == tq->len) {
+			n_slots = CW_TONE_QUEUE_N_SLOTS_INITIAL;
+		} else {
+			n_slots = tq->n_slots;
+		}
+		if (n_slots > capacity) {
+			n_slots = capacity;
+		}
+	}
+	if (n_slots != tq->n_slots) {
+		if (CW_SUCCESS != cw_tq_resize_storage_internal(tq, n_slots)) {
+			return CW_FAILURE;
+		}
+	}
+
 	tq->capacity = capacity;
 	tq->high_water_mark = high_water_mark;
 
@@ -363,6 +502,141 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 
 
 
+/**
+   @brief Configure capacity and allocation of memory for tone queue
+
+   High water mark of the queue is derived from @p capacity, in the same
+   proportion as in case of default values of the two parameters.
+
+   With @p lazy_allocation set to true the queue allocates only a small
+   ring of tones, and grows the ring (up to @p capacity) when more tones
+   are enqueued. This saves memory in programs that use many generators
+   and rarely fill their queues.
+
+   The function can be called at any time, also when generator is
+   dequeueing tones from the queue.
+
+   @exception EINVAL @p capacity is invalid, or is smaller than current length of queue
+   @exception ENOMEM failed to allocate memory for the ring of tones
+
+   @param[in] tq tone queue to configure
+   @param[in] capacity new capacity of queue
+   @param[in] lazy_allocation whether memory for tones should be allocated on demand
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_configure_capacity_internal(cw_tone_queue_t * tq, size_t capacity, bool lazy_allocation)
+{
+	cw_assert (NULL != tq, MSG_PREFIX "configure capacity: tq is NULL");
+	if (NULL == tq) {
+		return CW_FAILURE;
+	}
+
+	const size_t high_water_mark = capacity - (capacity * (CW_TONE_QUEUE_CAPACITY_DEFAULT - CW_TONE_QUEUE_HIGH_WATER_MARK_DEFAULT)) / CW_TONE_QUEUE_CAPACITY_DEFAULT;
+
+	cw_tq_lock_exclusive_internal(tq);
+
+	const bool lazy_allocation_before = tq->lazy_allocation;
+	tq->lazy_allocation = lazy_allocation;
+	const cw_ret_t cwret = cw_tq_set_capacity_internal(tq, capacity, high_water_mark);
+	if (CW_SUCCESS != cwret) {
+		tq->lazy_allocation = lazy_allocation_before;
+	}
+
+	cw_tq_unlock_exclusive_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Re-allocate ring of tones of a tone queue
+
+   Tones that are currently in the queue are moved to the beginning of a
+   new ring, in the same order.
+
+   Caller must make sure that neither producer nor consumer access the
+   queue during the call.
+
+   @exception ENOMEM failed to allocate memory
+
+   @param[in] tq tone queue
+   @param[in] n_slots count of slots in new ring, no smaller than length of @p tq
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_tq_resize_storage_internal(cw_tone_queue_t * tq, size_t n_slots)
+{
+	cw_tone_t * queue = (cw_tone_t *) calloc(n_slots, sizeof (cw_tone_t));
+	if (NULL == queue) {
+		errno = ENOMEM;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to allocate ring of %zu tones", n_slots);
+		return CW_FAILURE;
+	}
+
+	const size_t len = tq->len;
+	size_t ind = tq->head;
+	for (size_t i = 0; i < len; i++) {
+		queue[i] = tq->queue[ind];
+		ind = cw_tq_next_index_internal(tq, ind);
+	}
+
+	free((void *) (uintptr_t) tq->queue);
+	tq->queue = queue;
+	tq->n_slots = n_slots;
+	tq->head = 0;
+	tq->tail = len == n_slots ? 0 : len;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Make sure that ring of tones of a queue has at least given count of slots
+
+   The ring is grown geometrically, but never above capacity of @p tq.
+
+   Caller must make sure that neither producer nor consumer access the
+   queue during the call.
+
+   @exception ENOMEM failed to allocate memory
+
+   @param[in] tq tone queue
+   @param[in] n_slots_needed count of slots needed, no larger than capacity of @p tq
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_tq_grow_storage_internal(cw_tone_queue_t * tq, size_t n_slots_needed)
+{
+	if (n_slots_needed <= tq->n_slots) {
+		return CW_SUCCESS;
+	}
+
+	size_t n_slots = tq->n_slots;
+	while (n_slots < n_slots_needed) {
+		n_slots *= 2;
+	}
+	if (n_slots > tq->capacity) {
+		n_slots = tq->capacity;
+	}
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "growing ring of tones from %zu to %zu slots", tq->n_slots, n_slots);
+
+	return cw_tq_resize_storage_internal(tq, n_slots);
+}
+
+
+
+
 /**
    @brief Return capacity of a queue
 
@@ -379,6 +653,9 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 size_t cw_tq_capacity_internal(const cw_tone_queue_t * tq)
 {
 	cw_assert (NULL != tq, MSG_PREFIX "get capacity: tone queue is NULL");
+	if (NULL != tq->shmq_producer) {
+		return cw_shmq_capacity_internal(tq->shmq_producer);
+	}
 	return tq->capacity;
 }
 
@@ -421,6 +698,14 @@ size_t cw_tq_get_high_water_mark_internal(const cw_tone_queue_t * tq)
 */
 size_t cw_tq_length_internal(cw_tone_queue_t * tq)
 {
+	if (NULL != tq->shmq_producer) {
+		return cw_shmq_length_internal(tq->shmq_producer);
+	}
+
+	if (tq->spsc.enabled) {
+		return CW_TQ_ATOMIC_LOAD(tq->len);
+	}
+
 	pthread_mutex_lock(&tq->wait_mutex);
 	const size_t len = tq->len;
 	pthread_mutex_unlock(&tq->wait_mutex);
@@ -450,7 +735,7 @@ size_t cw_tq_length_internal(cw_tone_queue_t * tq)
 */
 size_t cw_tq_prev_index_internal(const cw_tone_queue_t * tq, size_t ind)
 {
-	return ind == 0 ? tq->capacity - 1 : ind - 1;
+	return ind == 0 ? tq->n_slots - 1 : ind - 1;
 }
 
 
@@ -475,7 +760,7 @@ size_t cw_tq_prev_index_internal(const cw_tone_queue_t * tq, size_t ind)
 */
 size_t cw_tq_next_index_internal(const cw_tone_queue_t * tq, size_t ind)
 {
-	return ind == tq->capacity - 1 ? 0 : ind + 1;
+	return ind == tq->n_slots - 1 ? 0 : ind + 1;
 }
 
 
@@ -516,9 +801,23 @@ size_t cw_tq_next_index_internal(const cw_tone_queue_t * tq, size_t ind)
 */
 cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 {
+	if (tq->spsc.enabled) {
+		const cw_queue_state_t queue_state = cw_tq_dequeue_spsc_internal(tq, tone);
+		if (NULL != CW_TQ_ATOMIC_LOAD(tq->shmq_consumer)) {
+			pthread_mutex_lock(&tq->wait_mutex);
+			if (NULL != tq->shmq_consumer) {
+				cw_shmq_notify_dequeue_internal(tq->shmq_consumer, tq);
+			}
+			pthread_mutex_unlock(&tq->wait_mutex);
+		}
+		cw_tq_run_completions_internal(tq);
+		return queue_state;
+	}
+
 	pthread_mutex_lock(&tq->wait_mutex);
 
 	bool call_callback = false;
+	bool is_emptied = false;
 	const size_t len_before = tq->len;
 	const cw_queue_state_t state_before = tq->state;
 
@@ -531,6 +830,7 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 		/* There are no more tones to dequeue, but we still need to
 		   update the state. */
 		tq->state = CW_TQ_EMPTY;
+		is_emptied = true;
 		break;
 
 	case CW_TQ_NONEMPTY:
@@ -555,9 +855,20 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 #endif
 
 	if (len_before != tq->len || state_before != tq->state) {
-		//fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'dequeue'\n", __func__, __LINE__);
+		/* Wake up only the threads waiting for a condition that
+		   has become true, not every thread sleeping on tq. */
+		cw_tq_wake_waiters_internal(tq);
+	}
+	if (state_before != tq->state) {
+		/* Change of state is rare enough to let also all
+		   listeners on wait_var know about it. */
 		pthread_cond_broadcast(&tq->wait_var);
 	}
+	if (NULL != tq->shmq_consumer && (len_before != tq->len || state_before != tq->state)) {
+		/* Let clients of shared tone queue know about progress,
+		   and let the shared queue refill this queue. */
+		cw_shmq_notify_dequeue_internal(tq->shmq_consumer, tq);
+	}
 
 	pthread_mutex_unlock(&tq->wait_mutex);
 
@@ -566,8 +877,12 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 	   call the callback *after* we unlock queue's mutexes
 	   in this function. */
 	if (call_callback) {
-		(*(tq->low_water_callback))(tq->low_water_callback_arg);
+		cw_tq_notify_low_water_internal(tq);
 	}
+	if (is_emptied) {
+		cw_tq_signal_event_internal(tq);
+	}
+	cw_tq_run_completions_internal(tq);
 
 	return queue_state;
 }
@@ -628,6 +943,7 @@ bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 	/* Dequeue. We already have the tone, now update tq's state. */
 	tq->head = cw_tq_next_index_internal(tq, tq->head);
 	tq->len--;
+	CW_TQ_ATOMIC_FETCH_ADD(tq->n_dequeued, 1);
 
 	if (tq->len == 0) {
 		/* Verify basic property of empty tq. */
@@ -650,13 +966,31 @@ bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 	cw_assert (!(tone->is_forever && tq_len_before == 1), MSG_PREFIX "dequeue sub: 'forever' tone appears!");
 
 
+	return cw_tq_is_low_water_crossed_internal(tq, tq_len_before, tq->len);
+}
+
+
+
+
+/**
+   @brief Check if low water callback should be called after dequeueing a tone
+
+   @param[in] tq tone queue
+   @param[in] len_before length of queue before dequeueing a tone
+   @param[in] len_after length of queue after dequeueing a tone
+
+   @return true if a condition for calling "low watermark" callback is true
+   @return false otherwise
+*/
+static bool cw_tq_is_low_water_crossed_internal(const cw_tone_queue_t * tq, size_t len_before, size_t len_after)
+{
 	bool call_callback = false;
-	if (tq->low_water_callback) {
+	if (tq->low_water_callback || -1 != CW_TQ_ATOMIC_LOAD(tq->event_fd)) {
 		/* It may seem that the double condition in 'if ()' is
 		   redundant, but for some reason it is necessary. Be
 		   very, very careful when modifying this. */
-		if (tq_len_before > tq->low_water_mark
-		    && tq->len <= tq->low_water_mark) {
+		if (len_before > tq->low_water_mark
+		    && len_after <= tq->low_water_mark) {
 
 			call_callback = true;
 		}
@@ -668,6 +1002,185 @@ bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 
 
 
+/**
+   @brief Tell client code that low water mark has been crossed
+
+   Call client's "low water" callback (if registered), and signal
+   queue's event descriptor (if created). Call the function without
+   queue's mutex locked.
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_notify_low_water_internal(cw_tone_queue_t * tq)
+{
+	if (tq->low_water_callback) {
+		if (tq->gen && tq->gen->dispatch) {
+			cw_dispatch_post_internal(tq->gen->dispatch, CW_DISPATCH_LOW_WATER, 0, cw_clock_now_internal(), 0);
+		} else {
+			(*(tq->low_water_callback))(tq->low_water_callback_arg);
+		}
+	}
+	cw_tq_signal_event_internal(tq);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Signal queue's event descriptor
+
+   The descriptor is an eventfd counter, so signals that haven't been
+   read by client code yet are merged into one.
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_signal_event_internal(cw_tone_queue_t * tq)
+{
+	const int fd = CW_TQ_ATOMIC_LOAD(tq->event_fd);
+	if (-1 == fd) {
+		return;
+	}
+
+	const uint64_t one = 1;
+	if (sizeof (one) != write(fd, &one, sizeof (one))) {
+		/* EAGAIN: the counter is saturated, but it is still
+		   readable, so client code will be woken up anyway. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
+			      MSG_PREFIX "failed to signal event descriptor");
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Dequeue a tone from tone queue working in SPSC mode
+
+   Behaviour of the function, as seen by caller, is the same as behaviour of
+   cw_tq_dequeue_internal().
+
+   As long as there is more than one tone in the queue (or the only tone is
+   a "forever" tone), the tone is dequeued without taking queue's mutex. The
+   mutex is taken only if the dequeue may change queue's state, or if low
+   water mark has been crossed, or if some thread is waiting for change of
+   queue's level.
+
+   @param[in] tq tone queue to dequeue tone from
+   @param[out] tone dequeued tone
+
+   @return current state of tone queue (state after dequeueing current tone)
+*/
+static cw_queue_state_t cw_tq_dequeue_spsc_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
+{
+	if (cw_tq_spsc_enter_internal(tq, &tq->spsc.consumer_busy)) {
+		/* Only consumer modifies head, so the head can be read
+		   without atomic operation. The length can be modified
+		   concurrently by producer, but only upwards. */
+		const size_t len_before = CW_TQ_ATOMIC_LOAD(tq->len);
+		const size_t head = tq->head;
+
+		if (len_before > 1 || (1 == len_before && tq->queue[head].is_forever)) {
+			CW_TONE_COPY(tone, &(tq->queue[head]));
+
+			if (1 == len_before) {
+				/* Last tone in queue is "forever" tone. Don't
+				   remove it from the queue. */
+				cw_tq_spsc_leave_internal(&tq->spsc.consumer_busy);
+				return CW_TQ_NONEMPTY;
+			}
+
+			CW_TQ_ATOMIC_STORE(tq->head, cw_tq_next_index_internal(tq, head));
+			CW_TQ_ATOMIC_FETCH_ADD(tq->n_dequeued, 1);
+			const size_t len_after = CW_TQ_ATOMIC_FETCH_SUB(tq->len, 1) - 1;
+			cw_tq_spsc_leave_internal(&tq->spsc.consumer_busy);
+
+			/* There was more than one tone in the queue, so the
+			   queue is still non-empty and its state didn't
+			   change. Wake up waiters only if there are any. */
+			const bool call_callback = cw_tq_is_low_water_crossed_internal(tq, len_before, len_after);
+			if (CW_TQ_ATOMIC_LOAD(tq->spsc.n_waiters) > 0) {
+				pthread_mutex_lock(&tq->wait_mutex);
+				cw_tq_wake_waiters_internal(tq);
+				pthread_mutex_unlock(&tq->wait_mutex);
+			}
+			if (call_callback) {
+				cw_tq_notify_low_water_internal(tq);
+			}
+
+			return CW_TQ_NONEMPTY;
+		}
+		cw_tq_spsc_leave_internal(&tq->spsc.consumer_busy);
+	}
+
+
+	/* Slow path: the queue is about to become empty, is already empty,
+	   or its structure is being modified by other thread. The state of
+	   the queue is derived from its length, because producer
+	   increments the length before it takes the mutex to update the
+	   state. */
+	pthread_mutex_lock(&tq->wait_mutex);
+
+	bool call_callback = false;
+	bool is_emptied = false;
+	bool wake = false;
+	const size_t len_before = CW_TQ_ATOMIC_LOAD(tq->len);
+	const cw_queue_state_t state_before = tq->state;
+
+	if (len_before > 0) {
+		const size_t head = tq->head;
+		CW_TONE_COPY(tone, &(tq->queue[head]));
+
+		if (tone->is_forever && 1 == len_before) {
+			/* Don't remove "forever" tone that is the last tone in queue. */
+			if (CW_TQ_NONEMPTY != tq->state) {
+				tq->state = CW_TQ_NONEMPTY;
+				wake = true;
+			}
+		} else {
+			CW_TQ_ATOMIC_STORE(tq->head, cw_tq_next_index_internal(tq, head));
+			CW_TQ_ATOMIC_FETCH_ADD(tq->n_dequeued, 1);
+			const size_t len_after = CW_TQ_ATOMIC_FETCH_SUB(tq->len, 1) - 1;
+			call_callback = cw_tq_is_low_water_crossed_internal(tq, len_before, len_after);
+			tq->state = 0 == len_after ? CW_TQ_JUST_EMPTIED : CW_TQ_NONEMPTY;
+			wake = true;
+		}
+	} else {
+		/* There are no more tones to dequeue, but we still need
+		   to update the state. */
+		if (CW_TQ_EMPTY != tq->state) {
+			tq->state = CW_TQ_EMPTY;
+			is_emptied = true;
+			wake = true;
+		}
+	}
+
+	const cw_queue_state_t queue_state = tq->state;
+	if (wake) {
+		cw_tq_wake_waiters_internal(tq);
+	}
+	if (state_before != queue_state) {
+		pthread_cond_broadcast(&tq->wait_var);
+	}
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	/* Call client's callback after unlocking the mutex. */
+	if (call_callback) {
+		cw_tq_notify_low_water_internal(tq);
+	}
+	if (is_emptied) {
+		cw_tq_signal_event_internal(tq);
+	}
+
+	return queue_state;
+}
+
+
+
+
 /**
    @brief Add tone to tone queue
 
@@ -689,6 +1202,7 @@ bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 
    @exception EINVAL invalid values of @p tone
    @exception EAGAIN tone not enqueued because tone queue is full
+   @exception ENOMEM failed to allocate memory for tone in lazily allocated tone queue
 
    @param[in] tq tone queue to enqueue to
    @param[in] tone tone to enqueue
@@ -701,23 +1215,66 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 	cw_assert (tq, MSG_PREFIX "enqueue: tone queue is null");
 	cw_assert (tone, MSG_PREFIX "enqueue: tone is null");
 
+	return cw_tq_enqueue_batch_internal(tq, tone, 1);
+}
+
+
+
+
+/**
+   @brief Add array of tones to tone queue
+
+   All tones from @p tones are added to the queue with single lock of
+   queue's mutex, and generator is signalled only once, after all the tones
+   have been added.
+
+   Either all tones are enqueued, or none of them is: the function first
+   verifies all tones and checks if there is enough free space in the queue
+   for all of them.
+
+   Tones are validated in the same way as in cw_tq_enqueue_internal(). Tones
+   with duration equal to zero are silently skipped.
+
+   @exception EINVAL invalid values of one of @p tones
+   @exception EAGAIN tones not enqueued because there is not enough space in tone queue
+   @exception ENOMEM failed to allocate memory for tones in lazily allocated tone queue
+
+   @param[in] tq tone queue to enqueue to
+   @param[in] tones array of tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_enqueue_batch_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones)
+{
+	cw_assert (tq, MSG_PREFIX "enqueue batch: tone queue is null");
+	cw_assert (tones || 0 == n_tones, MSG_PREFIX "enqueue batch: tones is null");
+
 	/* Check the arguments given for realistic values. */
-	if (tone->frequency < CW_FREQUENCY_MIN
-	    || tone->frequency > CW_FREQUENCY_MAX) {
+	size_t n_nonempty = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].frequency < CW_FREQUENCY_MIN
+		    || tones[i].frequency > CW_FREQUENCY_MAX) {
 
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
 
-	if (tone->duration < 0) {
-		errno = EINVAL;
-		return CW_FAILURE;
+		if (tones[i].duration < 0) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+
+		if (tones[i].duration > 0) {
+			n_nonempty++;
+		}
 	}
 
-	if (tone->duration == 0) {
-		/* Drop empty tone. It won't be played anyway, and for
+	if (0 == n_nonempty) {
+		/* Drop empty tones. They won't be played anyway, and for
 		   now there are no other good reasons to enqueue
-		   it. While it may happen in higher-level code to
+		   them. While it may happen in higher-level code to
 		   create such tone, but there is no need to spend
 		   time on it here. */
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_INFO,
@@ -725,35 +1282,86 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 		return CW_SUCCESS;
 	}
 
+	CW_TRACE(CW_TRACE_EVENT_TQ_ENQUEUE, n_nonempty);
+
+	if (NULL != tq->shmq_producer) {
+		return cw_shmq_enqueue_internal(tq->shmq_producer, tones, n_tones);
+	}
+
+	if (tq->spsc.enabled) {
+		return cw_tq_enqueue_spsc_internal(tq, tones, n_tones, n_nonempty);
+	}
+
 
 	pthread_mutex_lock(&tq->wait_mutex);
 
-	if (tq->len == tq->capacity) {
+	if (tq->len + n_nonempty > tq->capacity) {
 		/* Tone queue is full. */
+		__atomic_add_fetch(&tq->n_rejected, (uint64_t) n_nonempty, __ATOMIC_RELAXED);
 
 		errno = EAGAIN;
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "enqueue: can't enqueue tone, tq is full");
+			      MSG_PREFIX "enqueue: can't enqueue %zu tone(s), tq is full", n_nonempty);
 		pthread_mutex_unlock(&tq->wait_mutex);
 
 		return CW_FAILURE;
 	}
 
+	if (CW_SUCCESS != cw_tq_grow_storage_internal(tq, tq->len + n_nonempty)) {
+		pthread_mutex_unlock(&tq->wait_mutex);
+		return CW_FAILURE;
+	}
+
 
 	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG, MSG_PREFIX "enqueue: enqueue tone %d us, %d Hz", tone->duration, tone->frequency);
 
-	/* Enqueue the new tone.
+	/* Enqueue the new tones.
 
 	   Notice that tail is incremented after adding a tone. This
 	   means that for empty tq new tone is inserted at index
-	   tail == head (which should be kind of obvious). */
-	tq->queue[tq->tail] = *tone;
-
-	tq->tail = cw_tq_next_index_internal(tq, tq->tail);
-	tq->len++;
-	tq->state = CW_TQ_NONEMPTY;
-
-	/*
+	   tail == head (which should be kind of obvious).
+
+	   With coalescing enabled, a tone may be merged into last tone
+	   in the queue. Consumer takes the mutex before looking at any
+	   tone, so the last tone can be safely modified here. */
+	const int64_t enqueue_time = cw_monotonic_usecs_internal();
+	volatile cw_tone_t * last = NULL;
+	if (tq->coalesce && tq->len > 0) {
+		last = &tq->queue[cw_tq_prev_index_internal(tq, tq->tail)];
+	}
+	size_t n_added = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (0 == tones[i].duration) {
+			continue;
+		}
+		if (NULL != last && cw_tq_coalesce_tone_internal(last, &tones[i])) {
+			/* Tone starting inter-word-space may be merged
+			   into last tone, and the space starts with it. */
+			if ('\0' != tones[i].character) {
+				cw_tq_chars_add_internal(tq, tq->n_enqueued + n_added - 1, tones[i].character);
+			}
+			continue;
+		}
+		if (tones[i].is_first || '\0' != tones[i].character) {
+			cw_tq_chars_add_internal(tq, tq->n_enqueued + n_added, tones[i].character);
+		}
+		tq->queue[tq->tail] = tones[i];
+		tq->queue[tq->tail].enqueue_time = enqueue_time;
+		tq->queue[tq->tail].dequeue_time = 0;
+		if (tq->coalesce) {
+			last = &tq->queue[tq->tail];
+		}
+		tq->tail = cw_tq_next_index_internal(tq, tq->tail);
+		n_added++;
+	}
+	tq->n_enqueued += n_added;
+	tq->len += n_added;
+	if (tq->len > tq->len_max) {
+		tq->len_max = tq->len;
+	}
+	tq->state = CW_TQ_NONEMPTY;
+
+	/*
 	  tq->len and perhaps tq->state have changed. Signal this fact
 	  to listeners.
 
@@ -763,6 +1371,9 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 	  there are some new tones in tone queue. We will need to use
 	  pthread_cond_broadcast() to make sure the notification
 	  reaches all listeners.
+
+	  Threads on list of waiters are not woken up: enqueueing can't
+	  make any of their conditions true.
 	*/
 	// fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'enqueue'\n", __func__, __LINE__);
 	pthread_cond_broadcast(&tq->wait_var);
@@ -775,6 +1386,169 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 
 
 
+/**
+   @brief Add tones to tone queue working in SPSC mode
+
+   Caller must validate @p tones before calling this function.
+
+   The tones are added without taking queue's mutex. The mutex is taken
+   (and generator is woken up) only if the queue was empty before the tones
+   were added.
+
+   @exception EAGAIN tones not enqueued because there is not enough space in tone queue
+   @exception ENOMEM failed to allocate memory for tones in lazily allocated tone queue
+
+   @param[in] tq tone queue to enqueue to
+   @param[in] tones array of tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+   @param[in] n_nonempty count of tones in @p tones with non-zero duration
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_tq_enqueue_spsc_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones, size_t n_nonempty)
+{
+	while (1) {
+		while (!cw_tq_spsc_enter_internal(tq, &tq->spsc.producer_busy)) {
+			/* Structure of the queue is being modified. Wait on the
+			   mutex until the modification is completed. */
+			pthread_mutex_lock(&tq->wait_mutex);
+			pthread_mutex_unlock(&tq->wait_mutex);
+		}
+
+		const size_t len = CW_TQ_ATOMIC_LOAD(tq->len);
+		if (len + n_nonempty > tq->capacity) {
+			cw_tq_spsc_leave_internal(&tq->spsc.producer_busy);
+			__atomic_add_fetch(&tq->n_rejected, (uint64_t) n_nonempty, __ATOMIC_RELAXED);
+
+			errno = EAGAIN;
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "enqueue: can't enqueue %zu tone(s), tq is full", n_nonempty);
+			return CW_FAILURE;
+		}
+		if (len + n_nonempty <= tq->n_slots) {
+			break;
+		}
+
+		/* Lazily allocated ring is too small. Growing the ring
+		   moves tones around, so consumer must be kept away. */
+		cw_tq_spsc_leave_internal(&tq->spsc.producer_busy);
+		cw_tq_lock_exclusive_internal(tq);
+		const cw_ret_t cwret = cw_tq_grow_storage_internal(tq, CW_TQ_ATOMIC_LOAD(tq->len) + n_nonempty);
+		cw_tq_unlock_exclusive_internal(tq);
+		if (CW_SUCCESS != cwret) {
+			return CW_FAILURE;
+		}
+	}
+
+	/* Only producer modifies tail, and consumer doesn't look at the
+	   slots starting at tail until the length is incremented.
+
+	   Consumer may be reading tones that are already in the queue, so
+	   with coalescing enabled the tones are merged only with other
+	   tones from @p tones. */
+	size_t tail = tq->tail;
+	const int64_t enqueue_time = cw_monotonic_usecs_internal();
+	volatile cw_tone_t * last = NULL;
+	size_t n_added = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (0 == tones[i].duration) {
+			continue;
+		}
+		if (NULL != last && cw_tq_coalesce_tone_internal(last, &tones[i])) {
+			if ('\0' != tones[i].character) {
+				cw_tq_chars_add_internal(tq, tq->n_enqueued + n_added - 1, tones[i].character);
+			}
+			continue;
+		}
+		if (tones[i].is_first || '\0' != tones[i].character) {
+			cw_tq_chars_add_internal(tq, tq->n_enqueued + n_added, tones[i].character);
+		}
+		tq->queue[tail] = tones[i];
+		tq->queue[tail].enqueue_time = enqueue_time;
+		tq->queue[tail].dequeue_time = 0;
+		if (tq->coalesce) {
+			last = &tq->queue[tail];
+		}
+		tail = cw_tq_next_index_internal(tq, tail);
+		n_added++;
+	}
+	CW_TQ_ATOMIC_STORE(tq->tail, tail);
+	tq->n_enqueued += n_added;
+	const size_t len_before = CW_TQ_ATOMIC_FETCH_ADD(tq->len, n_added);
+	/* Only producer modifies this field (except of reset). */
+	if (len_before + n_added > tq->len_max) {
+		tq->len_max = len_before + n_added;
+	}
+
+	cw_tq_spsc_leave_internal(&tq->spsc.producer_busy);
+
+	if (0 == len_before) {
+		/* Transition from empty to non-empty queue: generator may be
+		   waiting for this. Consumer may have already dequeued the
+		   tones in the meantime, so check the length again. */
+		pthread_mutex_lock(&tq->wait_mutex);
+		if (CW_TQ_ATOMIC_LOAD(tq->len) > 0) {
+			tq->state = CW_TQ_NONEMPTY;
+		}
+		pthread_cond_broadcast(&tq->wait_var);
+		pthread_mutex_unlock(&tq->wait_mutex);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get descriptor signalled on events in tone queue
+
+   The descriptor (eventfd) becomes readable when queue's length
+   falls to low water mark (see
+   cw_tq_register_low_level_callback_internal()), and when the queue
+   becomes empty, i.e. when generator has finished playing last tone
+   from the queue. Client code can wait for the descriptor with
+   poll()/select() instead of periodically checking queue's length,
+   and should read() the descriptor's counter before checking the
+   queue.
+
+   The descriptor is created on first call, and is owned by the
+   queue: don't close it.
+
+   @exception ENOSYS event descriptors are not supported on this platform
+
+   @param[in] tq tone queue
+
+   @return descriptor on success
+   @return -1 on failure
+*/
+int cw_tq_get_event_fd_internal(cw_tone_queue_t * tq)
+{
+#if defined(__linux__)
+	pthread_mutex_lock(&tq->wait_mutex);
+	if (-1 == tq->event_fd) {
+		const int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (-1 == fd) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create event descriptor: %s", strerror(errno));
+		}
+		CW_TQ_ATOMIC_STORE(tq->event_fd, fd);
+	}
+	const int fd = tq->event_fd;
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return fd;
+#else
+	(void) tq;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+
+
+
 /**
    @brief Register callback for low queue state
 
@@ -789,7 +1563,9 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
    If @p level is zero, the behaviour of the mechanism is not guaranteed to
    work correctly.
 
-   If @p callback_func is NULL then the mechanism becomes disabled.
+   If @p callback_func is NULL then the mechanism becomes disabled. Event
+   descriptor of the queue (see cw_tq_get_event_fd_internal()) is still
+   signalled at @p level.
 
    @p callback_arg will be passed to @p callback_func.
 
@@ -843,7 +1619,6 @@ cw_ret_t cw_tq_register_low_level_callback_internal(cw_tone_queue_t * tq, cw_que
 */
 cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
 	/* According to man page, spurious wakeups of pthread_cond_wait() may
 	   occur.  Call the function in loop with two conditions to work
 	   around these wakeups.
@@ -870,12 +1645,15 @@ cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 	   function and in other tq functions allows us to safely get
 	   tq->head. */
 
-	/* Wait for the queue index to change or the dequeue to go completely empty. */
-	const size_t check_tq_head = tq->head;
-	while (tq->head == check_tq_head && tq->state != CW_TQ_EMPTY) {
-		pthread_cond_wait(&tq->wait_var, &tq->wait_mutex);
+	/* Wait for the queue index to change or the dequeue to go
+	   completely empty. The conditions are checked by
+	   cw_tq_waiter_is_ready_internal(). */
+	if (NULL != tq->shmq_producer) {
+		cw_shmq_wait_for_end_of_current_tone_internal(tq->shmq_producer);
+		return CW_SUCCESS;
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_waiter_t waiter = { .condition = CW_TQ_WAIT_TONE_END };
+	cw_tq_wait_internal(tq, &waiter);
 
 
 #if 0   /* Original implementation using signals. */ /* This code has been disabled some time before 2017-01-30. */
@@ -919,11 +1697,12 @@ cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level)
 {
 	/* Wait until the queue length is at or below given level. */
-	pthread_mutex_lock(&tq->wait_mutex);
-	while (tq->len > level) {
-		pthread_cond_wait(&tq->wait_var, &tq->wait_mutex);
+	if (NULL != tq->shmq_producer) {
+		cw_shmq_wait_for_level_internal(tq->shmq_producer, level);
+		return CW_SUCCESS;
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_waiter_t waiter = { .condition = CW_TQ_WAIT_LEVEL, .level = level };
+	cw_tq_wait_internal(tq, &waiter);
 
 
 #if 0   /* Original implementation using signals. */  /* This code has been disabled some time before 2017-01-30. */
@@ -938,6 +1717,319 @@ cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level)
 
 
 
+/**
+   @brief Wait for the tone queue to become completely empty
+
+   Unlike cw_tq_wait_for_level_internal() called with level equal to
+   zero, the function doesn't return while generator is still generating
+   the last tone from the queue. It returns when the queue is in
+   CW_TQ_EMPTY state, i.e. after generator has tried to dequeue a tone
+   following the last one.
+
+   Generator must be running when this function is called.
+
+   @param[in] tq tone queue to wait on
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_tq_wait_for_empty_internal(cw_tone_queue_t * tq)
+{
+	if (NULL != tq->shmq_producer) {
+		cw_shmq_wait_for_empty_internal(tq->shmq_producer);
+		return CW_SUCCESS;
+	}
+	cw_tq_waiter_t waiter = { .condition = CW_TQ_WAIT_EMPTY };
+	cw_tq_wait_internal(tq, &waiter);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Register asynchronous wait on tone queue
+
+   Non-blocking counterpart of cw_tq_wait_internal(). A waiter is
+   allocated and put on queue's list of waiters. When its condition
+   becomes true (possibly already in this function), the waiter is
+   completed: descriptor returned through @p fd is signalled, and
+   @p callback is called by cw_tq_run_completions_internal() after
+   queue's mutex is released.
+
+   @exception EINVAL both @p callback and @p fd are NULL
+   @exception ENOTSUP @p tq is a proxy of shared tone queue
+   @exception ENOSYS @p fd is not NULL, and descriptors are not supported on this platform
+
+   @param[in] tq tone queue to wait on
+   @param[in] condition condition to wait for
+   @param[in] level level of queue, for CW_TQ_WAIT_LEVEL
+   @param[in] key keyer, for CW_TQ_WAIT_KEYER_IDLE
+   @param[in] callback function to call on completion, may be NULL
+   @param[in] callback_arg argument of @p callback
+   @param[out] fd new descriptor signalled on completion, may be NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_wait_async_internal(cw_tone_queue_t * tq, cw_tq_wait_condition_t condition, size_t level, const volatile cw_key_t * key, cw_wait_callback_t callback, void * callback_arg, int * fd)
+{
+	if (NULL == callback && NULL == fd) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (NULL != tq->shmq_producer) {
+		/* State of the shared queue is not tracked by this queue. */
+		errno = ENOTSUP;
+		return CW_FAILURE;
+	}
+
+	cw_tq_waiter_t * waiter = (cw_tq_waiter_t *) calloc(1, sizeof (cw_tq_waiter_t));
+	if (NULL == waiter) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "wait async: calloc()");
+		return CW_FAILURE;
+	}
+	waiter->condition = condition;
+	waiter->level = level;
+	waiter->key = key;
+	waiter->is_async = true;
+	waiter->callback = callback;
+	waiter->callback_arg = callback_arg;
+	waiter->fd = -1;
+
+	if (NULL != fd) {
+#if defined(__linux__)
+		waiter->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (-1 == waiter->fd) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "wait async: failed to create event descriptor: %s", strerror(errno));
+			free(waiter);
+			return CW_FAILURE;
+		}
+		*fd = waiter->fd;
+#else
+		free(waiter);
+		errno = ENOSYS;
+		return CW_FAILURE;
+#endif
+	}
+
+	pthread_mutex_lock(&tq->wait_mutex);
+
+	/* See cw_tq_wait_internal(). The counter is decremented when the
+	   waiter is completed. */
+	CW_TQ_ATOMIC_FETCH_ADD(tq->spsc.n_waiters, 1);
+	waiter->head = CW_TQ_ATOMIC_LOAD(tq->head);
+
+	if (cw_tq_waiter_is_ready_internal(tq, waiter)) {
+		cw_tq_complete_async_internal(tq, waiter);
+	} else {
+		waiter->next = tq->waiters;
+		tq->waiters = waiter;
+	}
+
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	cw_tq_run_completions_internal(tq);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Wait on tone queue until condition of @p waiter is true
+
+   If the condition isn't true at the time of the call, @p waiter is
+   put on queue's list of waiters, and the function sleeps on waiter's
+   own condition variable until cw_tq_wake_waiters_internal() finds that
+   the condition has become true. Other changes of the queue don't wake
+   up the thread.
+
+   @param[in] tq tone queue to wait on
+   @param[in,out] waiter registration of waiting thread, with condition (and level) set by caller
+*/
+static void cw_tq_wait_internal(cw_tone_queue_t * tq, cw_tq_waiter_t * waiter)
+{
+	pthread_mutex_lock(&tq->wait_mutex);
+
+	/* Let consumer working in SPSC mode know that it has to take the
+	   mutex and wake up waiters. The counter is incremented before
+	   the condition is checked, so consumer either sees the counter,
+	   or we see results of its dequeue. */
+	CW_TQ_ATOMIC_FETCH_ADD(tq->spsc.n_waiters, 1);
+	waiter->head = CW_TQ_ATOMIC_LOAD(tq->head);
+
+	if (!cw_tq_waiter_is_ready_internal(tq, waiter)) {
+
+		pthread_cond_init(&waiter->cond, NULL);
+		waiter->is_woken = false;
+		waiter->next = tq->waiters;
+		tq->waiters = waiter;
+
+		/* Loop handles spurious wakeups of pthread_cond_wait(). */
+		cw_virtual_clock_wait_begin_internal();
+		while (!waiter->is_woken) {
+			pthread_cond_wait(&waiter->cond, &tq->wait_mutex);
+		}
+		cw_virtual_clock_wait_end_internal();
+
+		pthread_cond_destroy(&waiter->cond);
+	}
+
+	CW_TQ_ATOMIC_FETCH_SUB(tq->spsc.n_waiters, 1);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if condition of waiter is true
+
+   Caller must hold queue's wait_mutex.
+
+   @param[in] tq tone queue
+   @param[in] waiter registration of waiting thread
+
+   @return true if the waiter can stop waiting
+   @return false otherwise
+*/
+static bool cw_tq_waiter_is_ready_internal(const cw_tone_queue_t * tq, const cw_tq_waiter_t * waiter)
+{
+	switch (waiter->condition) {
+	case CW_TQ_WAIT_LEVEL:
+		return CW_TQ_ATOMIC_LOAD(tq->len) <= waiter->level;
+	case CW_TQ_WAIT_TONE_END:
+		return CW_TQ_ATOMIC_LOAD(tq->head) != waiter->head || CW_TQ_EMPTY == tq->state;
+	case CW_TQ_WAIT_EMPTY:
+		return CW_TQ_EMPTY == tq->state;
+	case CW_TQ_WAIT_KEYER_IDLE:
+		return !cw_key_ik_is_busy_internal(waiter->key);
+	default:
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "unexpected wait condition %d", waiter->condition);
+		return true;
+	}
+}
+
+
+
+
+/**
+   @brief Wake up waiters whose condition has become true
+
+   Waken waiters are removed from the list. Caller must hold queue's
+   wait_mutex, and should call the function after a change of length,
+   head or state of the queue.
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_wake_waiters_internal(cw_tone_queue_t * tq)
+{
+	cw_tq_waiter_t ** link = &tq->waiters;
+	while (NULL != *link) {
+		cw_tq_waiter_t * waiter = *link;
+		if (cw_tq_waiter_is_ready_internal(tq, waiter)) {
+			*link = waiter->next;
+			if (waiter->is_async) {
+				cw_tq_complete_async_internal(tq, waiter);
+			} else {
+				waiter->is_woken = true;
+				pthread_cond_signal(&waiter->cond);
+			}
+		} else {
+			link = &waiter->next;
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Complete asynchronous waiter
+
+   Waiter's descriptor is signalled, and waiter with a callback is put
+   on list of completed waiters. Caller must hold queue's wait_mutex,
+   and must have removed @p waiter from list of waiters.
+
+   @param[in] tq tone queue
+   @param[in] waiter asynchronous waiter whose condition is true
+*/
+static void cw_tq_complete_async_internal(cw_tone_queue_t * tq, cw_tq_waiter_t * waiter)
+{
+	CW_TQ_ATOMIC_FETCH_SUB(tq->spsc.n_waiters, 1);
+
+	if (-1 != waiter->fd) {
+		const uint64_t one = 1;
+		if (sizeof (one) != write(waiter->fd, &one, sizeof (one))) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to signal completion descriptor");
+		}
+	}
+
+	if (NULL == waiter->callback) {
+		free(waiter);
+		return;
+	}
+
+	/* Callbacks are called in order of completion. */
+	cw_tq_waiter_t ** link = &tq->completed;
+	while (NULL != *link) {
+		link = &(*link)->next;
+	}
+	waiter->next = NULL;
+	CW_TQ_ATOMIC_STORE(*link, waiter);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Call callbacks of completed asynchronous waiters
+
+   Caller must not hold queue's wait_mutex, so that the callbacks can
+   call functions of the library. The callbacks are posted to dispatch
+   thread of queue's generator if the generator has one.
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_run_completions_internal(cw_tone_queue_t * tq)
+{
+	if (NULL == CW_TQ_ATOMIC_LOAD(tq->completed)) {
+		return;
+	}
+
+	pthread_mutex_lock(&tq->wait_mutex);
+	cw_tq_waiter_t * waiter = tq->completed;
+	CW_TQ_ATOMIC_STORE(tq->completed, NULL);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	while (NULL != waiter) {
+		cw_tq_waiter_t * next = waiter->next;
+		if (NULL == tq->gen || NULL == tq->gen->dispatch
+		    || !cw_dispatch_post_completion_internal(tq->gen->dispatch, waiter->callback, waiter->callback_arg, cw_clock_now_internal())) {
+			waiter->callback(waiter->callback_arg);
+		}
+		free(waiter);
+		waiter = next;
+	}
+
+	return;
+}
+
+
+
+
 
 /**
    @brief See if the tone queue is full
@@ -957,8 +2049,11 @@ cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level)
 */
 bool cw_tq_is_full_internal(const cw_tone_queue_t * tq)
 {
+	if (NULL != tq->shmq_producer) {
+		return cw_shmq_length_internal(tq->shmq_producer) >= cw_shmq_capacity_internal(tq->shmq_producer);
+	}
 	/* TODO: shouldn't we lock tq when making the comparison? */
-	return tq->len == tq->capacity;
+	return CW_TQ_ATOMIC_LOAD(tq->len) == tq->capacity;
 }
 
 
@@ -981,6 +2076,11 @@ bool cw_tq_is_full_internal(const cw_tone_queue_t * tq)
 */
 void cw_tq_flush_internal(cw_tone_queue_t * tq)
 {
+	if (NULL != tq->shmq_producer) {
+		cw_shmq_flush_internal(tq->shmq_producer);
+		return;
+	}
+
 	/* Force zero length state. */
 	cw_tq_make_empty_internal(tq);
 
@@ -1018,6 +2118,9 @@ void cw_tq_flush_internal(cw_tone_queue_t * tq)
 */
 bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq)
 {
+	if (NULL != tq->shmq_producer) {
+		return 0 != cw_shmq_length_internal(tq->shmq_producer);
+	}
 	/* TODO: shouldn't we lock tq when making the comparison? */
 	return CW_TQ_NONEMPTY == tq->state;
 }
@@ -1028,16 +2131,15 @@ bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq)
 /**
    @brief Attempt to remove all tones constituting full, single character
 
-   Try to remove all tones until and including first tone with ->is_first tone flag set.
+   Remove all tones of last character in the queue, together with
+   inter-word-spaces that follow the character. The start of the character
+   is found in index of characters, so the function doesn't have to look
+   at the tones.
 
    The function removes character's tones only if all the tones, including
    the first tone in the character, are still in tone queue.
 
-   TODO: write tests for this function
-
-   @internal
-   @reviewed 2020-10-17
-   @endinternal
+   @exception ENOENT there is no character that could be removed
 
    @param[in] tq tone queue from which to remove tones
 
@@ -1048,32 +2150,577 @@ cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq)
 {
 	cw_ret_t cwret = CW_FAILURE;
 
-	pthread_mutex_lock(&tq->wait_mutex);
-
-	size_t len = tq->len;
-	size_t idx = tq->tail;
-	bool is_found = false;
+	cw_tq_lock_exclusive_internal(tq);
 
-	while (len > 0) {
-		--len;
-		idx = cw_tq_prev_index_internal(tq, idx);
-		if (tq->queue[idx].is_first) {
-			is_found = true;
-			break;
-		}
+	/* Skip trailing inter-word-spaces. */
+	size_t i = tq->chars.len;
+	while (i > 0 && ' ' == cw_tq_char_at_internal(tq, i - 1)->character) {
+		i--;
 	}
 
-	if (is_found) {
-		tq->len = len;
-		tq->tail = idx;
+	if (i > 0 && cw_tq_char_at_internal(tq, i - 1)->start >= CW_TQ_ATOMIC_LOAD(tq->n_dequeued)) {
+		const cw_tq_char_t * record = cw_tq_char_at_internal(tq, i - 1);
+		tq->chars.next_offset = record->offset;
+		cw_tq_truncate_internal(tq, record->start);
+		tq->chars.len = i - 1;
 		cwret = CW_SUCCESS;
-
-		if (0 == tq->len) {
-			tq->state = CW_TQ_JUST_EMPTIED;
-		}
+	} else {
+		errno = ENOENT;
 	}
 
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_unlock_exclusive_internal(tq);
 
 	return cwret;
 }
+
+
+
+
+/**
+   @brief Attempt to remove all tones constituting last word
+
+   Remove tones of characters enqueued after last inter-word-space that
+   is followed by a character, together with inter-word-spaces that follow
+   the characters. Inter-word-space before the word is not removed.
+
+   The function removes the word only if all its tones are still in tone
+   queue.
+
+   @exception ENOENT there is no word that could be removed
+
+   @param[in] tq tone queue from which to remove tones
+
+   @return CW_SUCCESS if a word has been removed successfully
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_tq_remove_last_word_internal(cw_tone_queue_t * tq)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	cw_tq_lock_exclusive_internal(tq);
+
+	size_t last = tq->chars.len;
+	while (last > 0 && ' ' == cw_tq_char_at_internal(tq, last - 1)->character) {
+		last--;
+	}
+	size_t first = last;
+	while (first > 0 && ' ' != cw_tq_char_at_internal(tq, first - 1)->character) {
+		first--;
+	}
+
+	if (first < last && cw_tq_char_at_internal(tq, first)->start >= CW_TQ_ATOMIC_LOAD(tq->n_dequeued)) {
+		const cw_tq_char_t * record = cw_tq_char_at_internal(tq, first);
+		tq->chars.next_offset = record->offset;
+		cw_tq_truncate_internal(tq, record->start);
+		tq->chars.len = first;
+		cwret = CW_SUCCESS;
+	} else {
+		errno = ENOENT;
+	}
+
+	cw_tq_unlock_exclusive_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Skip remaining tones of character that is being played
+
+   Tones of the character (or of inter-word-space) that is being played,
+   and that are still in the queue, are removed from head of the queue, so
+   that generator continues with next character. The tone that is being
+   generated is not affected.
+
+   @exception ENOENT no known character is being played
+
+   @param[in] tq tone queue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_skip_current_character_internal(cw_tone_queue_t * tq)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	cw_tq_lock_exclusive_internal(tq);
+
+	cw_tq_chars_trim_internal(tq);
+	const uint64_t n_dequeued = CW_TQ_ATOMIC_LOAD(tq->n_dequeued);
+
+	if (CW_TQ_EMPTY != tq->state
+	    && tq->chars.len > 0
+	    && cw_tq_char_at_internal(tq, 0)->start < n_dequeued) {
+
+		/* After trimming, first record is the one of played
+		   character, and second record (if any) starts after
+		   the tone that is being played. */
+		const uint64_t end = tq->chars.len > 1 ? cw_tq_char_at_internal(tq, 1)->start : tq->n_enqueued;
+		const size_t n_skipped = (size_t) (end - n_dequeued);
+
+		CW_TQ_ATOMIC_STORE(tq->head, (tq->head + n_skipped) % tq->n_slots);
+		CW_TQ_ATOMIC_STORE(tq->len, tq->len - n_skipped);
+		CW_TQ_ATOMIC_STORE(tq->n_dequeued, end);
+		if (0 == tq->len && CW_TQ_NONEMPTY == tq->state) {
+			tq->state = CW_TQ_JUST_EMPTIED;
+		}
+		cw_tq_wake_waiters_internal(tq);
+		cwret = CW_SUCCESS;
+	} else {
+		errno = ENOENT;
+	}
+
+	cw_tq_unlock_exclusive_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Get character that is being played
+
+   The character is the one to which belongs the tone that is being
+   generated by generator (the one that has been dequeued last). Sound
+   sink may still play previous character from its buffers.
+
+   @exception ENOENT no known character is being played
+
+   @param[in] tq tone queue
+   @param[out] character character that is being played (' ' for inter-word-space, '\0' if not known), may be NULL
+   @param[out] offset position of the character in text enqueued in the queue, may be NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_get_playing_position_internal(cw_tone_queue_t * tq, char * character, size_t * offset)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	cw_tq_lock_exclusive_internal(tq);
+
+	cw_tq_chars_trim_internal(tq);
+	if (CW_TQ_EMPTY != tq->state
+	    && tq->chars.len > 0
+	    && cw_tq_char_at_internal(tq, 0)->start < CW_TQ_ATOMIC_LOAD(tq->n_dequeued)) {
+
+		const cw_tq_char_t * record = cw_tq_char_at_internal(tq, 0);
+		if (NULL != character) {
+			*character = record->character;
+		}
+		if (NULL != offset) {
+			*offset = record->offset;
+		}
+		cwret = CW_SUCCESS;
+	} else {
+		errno = ENOENT;
+	}
+
+	cw_tq_unlock_exclusive_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Get record from index of characters
+
+   @param[in] tq tone queue
+   @param[in] i position of record, counted from oldest record in index
+
+   @return pointer to record
+*/
+static cw_tq_char_t * cw_tq_char_at_internal(const cw_tone_queue_t * tq, size_t i)
+{
+	return &tq->chars.records[(tq->chars.head + i) % tq->chars.n_slots];
+}
+
+
+
+
+/**
+   @brief Add record of a character to index of characters
+
+   Called by producer. Records of characters that have been played are
+   dropped first, and if the index is still full, it is grown. If memory
+   can't be allocated, oldest record is dropped: the queue remains usable,
+   but the oldest character can't be removed with
+   cw_tq_remove_last_character_internal().
+
+   @param[in] tq tone queue
+   @param[in] start sequence number of first tone of the character
+   @param[in] character the character
+*/
+static void cw_tq_chars_add_internal(cw_tone_queue_t * tq, uint64_t start, char character)
+{
+	cw_tq_chars_trim_internal(tq);
+
+	if (tq->chars.len == tq->chars.n_slots) {
+		const size_t n_slots = 0 == tq->chars.n_slots ? CW_TONE_QUEUE_N_CHARS_INITIAL : 2 * tq->chars.n_slots;
+		cw_tq_char_t * records = (cw_tq_char_t *) malloc(n_slots * sizeof (cw_tq_char_t));
+		if (NULL != records) {
+			for (size_t i = 0; i < tq->chars.len; i++) {
+				records[i] = *cw_tq_char_at_internal(tq, i);
+			}
+			free(tq->chars.records);
+			tq->chars.records = records;
+			tq->chars.n_slots = n_slots;
+			tq->chars.head = 0;
+		} else if (0 == tq->chars.n_slots) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "malloc()");
+			return;
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "malloc(), dropping oldest record of character");
+			tq->chars.head = (tq->chars.head + 1) % tq->chars.n_slots;
+			tq->chars.len--;
+		}
+	}
+
+	cw_tq_char_t * record = cw_tq_char_at_internal(tq, tq->chars.len);
+	record->start = start;
+	record->character = character;
+	record->offset = tq->chars.next_offset++;
+	tq->chars.len++;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Drop records of characters that have been played
+
+   A record is dropped if the next character has already started
+   playing. Record of character that is being played is kept.
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_chars_trim_internal(cw_tone_queue_t * tq)
+{
+	const uint64_t n_dequeued = CW_TQ_ATOMIC_LOAD(tq->n_dequeued);
+	while (tq->chars.len > 1 && cw_tq_char_at_internal(tq, 1)->start < n_dequeued) {
+		tq->chars.head = (tq->chars.head + 1) % tq->chars.n_slots;
+		tq->chars.len--;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Remove tones from end of queue, starting with given tone
+
+   Caller must have exclusive access to the queue, must make sure that
+   tone @p end has not been dequeued yet, and must update index of
+   characters.
+
+   @param[in] tq tone queue
+   @param[in] end sequence number of first tone to remove
+*/
+static void cw_tq_truncate_internal(cw_tone_queue_t * tq, uint64_t end)
+{
+	const size_t len = (size_t) (end - CW_TQ_ATOMIC_LOAD(tq->n_dequeued));
+
+	CW_TQ_ATOMIC_STORE(tq->tail, (tq->head + len) % tq->n_slots);
+	CW_TQ_ATOMIC_STORE(tq->len, len);
+	tq->n_enqueued = end;
+	if (0 == tq->len) {
+		tq->state = CW_TQ_JUST_EMPTIED;
+	}
+	cw_tq_wake_waiters_internal(tq);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enable or disable coalescing of tones in tone queue
+
+   With coalescing enabled, a tone being enqueued is merged with the tone
+   enqueued directly before it if both tones have the same frequency and
+   have no slopes, and if the new tone doesn't start a character. A word
+   end, made of inter-mark-space, inter-character-space and
+   inter-word-space, is then stored in the queue as one silent tone.
+
+   This reduces count of tones that generator has to dequeue, but it also
+   changes the count of tones in the queue, as seen by client code (queue
+   length, low water mark callback). Don't enable coalescing if client
+   code relies on the count of tones in the queue being equal to the count
+   of enqueued tones.
+
+   @param[in] tq tone queue
+   @param[in] enabled whether coalescing should be enabled
+*/
+void cw_tq_set_coalescing_internal(cw_tone_queue_t * tq, bool enabled)
+{
+	pthread_mutex_lock(&tq->wait_mutex);
+	tq->coalesce = enabled;
+	pthread_mutex_unlock(&tq->wait_mutex);
+}
+
+
+
+
+/**
+   @brief Get the largest length of tone queue
+
+   @param[in] tq tone queue
+
+   @return the largest count of tones in the queue observed since the queue was created, or since cw_tq_reset_length_max_internal() was called
+*/
+size_t cw_tq_get_length_max_internal(const cw_tone_queue_t * tq)
+{
+	return tq->len_max;
+}
+
+
+
+
+/**
+   @brief Reset the largest length of tone queue to current length of the queue
+
+   @param[in] tq tone queue
+*/
+void cw_tq_reset_length_max_internal(cw_tone_queue_t * tq)
+{
+	pthread_mutex_lock(&tq->wait_mutex);
+	tq->len_max = CW_TQ_ATOMIC_LOAD(tq->len);
+	pthread_mutex_unlock(&tq->wait_mutex);
+}
+
+
+
+
+/**
+   @brief Merge a tone into last enqueued tone, if possible
+
+   Tones with slopes can't be merged: this would remove the slopes
+   between the tones. Forever tones can't be merged because a forever
+   tone is being played while it still is in the queue. A tone starting a
+   character can't be merged, so that cw_tq_remove_last_character_internal()
+   can find beginning of the character. A tone with symbolic duration can
+   be merged only with another tone with symbolic duration.
+
+   @param[in,out] last last enqueued tone
+   @param[in] tone tone being enqueued
+
+   @return true if @p tone has been merged into @p last
+   @return false otherwise
+*/
+static bool cw_tq_coalesce_tone_internal(volatile cw_tone_t * last, const cw_tone_t * tone)
+{
+	if (last->frequency != tone->frequency
+	    || last->slope_mode != CW_SLOPE_MODE_NO_SLOPES
+	    || tone->slope_mode != CW_SLOPE_MODE_NO_SLOPES
+	    || last->is_forever
+	    || tone->is_forever
+	    || tone->is_first
+	    || last->duration > INT_MAX - tone->duration
+	    || (0 == last->elements) != (0 == tone->elements)) {
+
+		return false;
+	}
+
+	uint32_t elements = 0;
+	if (!cw_tq_add_tone_elements_internal(last->elements, tone->elements, &elements)) {
+		return false;
+	}
+
+	last->duration += tone->duration;
+	last->elements = elements;
+
+	/* Keep pre-calculated count of samples only if it was
+	   pre-calculated for both tones. Otherwise it will be
+	   calculated by generator. */
+	if (last->n_samples > 0 && tone->n_samples > 0) {
+		last->n_samples += tone->n_samples;
+	} else {
+		last->n_samples = 0;
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Add symbolic durations of two tones
+
+   @param[in] a elements of first tone
+   @param[in] b elements of second tone
+   @param[out] sum elements of both tones
+
+   @return true if the sum could be calculated
+   @return false if count of some element would not fit in its bits
+*/
+static bool cw_tq_add_tone_elements_internal(uint32_t a, uint32_t b, uint32_t * sum)
+{
+	*sum = 0;
+	for (unsigned int i = 0; i < CW_TONE_ELEMENT_MAX; i++) {
+		const unsigned int shift = i * CW_TONE_ELEMENT_BITS;
+		const uint32_t count = ((a >> shift) & CW_TONE_ELEMENT_COUNT_MAX) + ((b >> shift) & CW_TONE_ELEMENT_COUNT_MAX);
+		if (count > CW_TONE_ELEMENT_COUNT_MAX) {
+			return false;
+		}
+		*sum |= count << shift;
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Enable or disable single-producer/single-consumer mode of tone queue
+
+   In SPSC mode enqueue and dequeue don't take queue's mutex for every tone
+   (see top-level comment in this file). The mode can be enabled only if
+   tones are enqueued by only one thread at a time, and dequeued by only one
+   thread at a time (generator's thread).
+
+   The mode shall be set before the queue is used by more than one thread,
+   e.g. before generator is started.
+
+   @param[in] tq tone queue to configure
+   @param[in] enabled whether to enable or disable SPSC mode
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_set_spsc_mode_internal(cw_tone_queue_t * tq, bool enabled)
+{
+	cw_assert (NULL != tq, MSG_PREFIX "set spsc mode: tq is NULL");
+	if (NULL == tq) {
+		return CW_FAILURE;
+	}
+
+	cw_tq_lock_exclusive_internal(tq);
+	tq->spsc.enabled = enabled;
+	cw_tq_unlock_exclusive_internal(tq);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Wake up threads waiting for a change in tone queue
+
+   Generator calls this function after it finishes generating a tone. The
+   broadcast reaches functions waiting on wait_var (e.g. iambic keyer's
+   waiting functions). Threads on list of waiters of @p tq have been
+   woken up (if necessary) when the tone was dequeued, except for
+   waiters for idle keyer, which are checked here. In SPSC mode the
+   broadcast (and taking queue's mutex) is skipped if no thread waits on
+   the queue.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_broadcast_internal(cw_tone_queue_t * tq)
+{
+	if (tq->spsc.enabled && 0 == CW_TQ_ATOMIC_LOAD(tq->spsc.n_waiters)) {
+		return;
+	}
+
+	pthread_mutex_lock(&tq->wait_mutex);
+	pthread_cond_broadcast(&tq->wait_var);
+	if (NULL != tq->waiters) {
+		cw_tq_wake_waiters_internal(tq);
+	}
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	cw_tq_run_completions_internal(tq);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enter lock-free section of producer or consumer
+
+   @param[in] tq tone queue
+   @param[in] busy producer's or consumer's "busy" flag
+
+   @return true if caller may continue in lock-free section
+   @return false if structure of queue is being modified and caller must take the mutex
+*/
+static bool cw_tq_spsc_enter_internal(cw_tone_queue_t * tq, volatile int * busy)
+{
+	/* Store to own flag and then load of other side's flag: both
+	   sequentially consistent, so either we see the 'exclusive' flag,
+	   or the thread setting the flag sees our 'busy' flag. */
+	CW_TQ_ATOMIC_STORE(*busy, 1);
+	if (CW_TQ_ATOMIC_LOAD(tq->spsc.exclusive)) {
+		CW_TQ_ATOMIC_STORE(*busy, 0);
+		return false;
+	}
+	return true;
+}
+
+
+
+
+/**
+   @brief Leave lock-free section of producer or consumer
+
+   @param[in] busy producer's or consumer's "busy" flag
+*/
+static void cw_tq_spsc_leave_internal(volatile int * busy)
+{
+	CW_TQ_ATOMIC_STORE(*busy, 0);
+}
+
+
+
+
+/**
+   @brief Get exclusive access to tone queue
+
+   Lock queue's mutex, and wait until producer and consumer leave their
+   lock-free sections (if queue works in SPSC mode).
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_lock_exclusive_internal(cw_tone_queue_t * tq)
+{
+	pthread_mutex_lock(&tq->wait_mutex);
+	CW_TQ_ATOMIC_STORE(tq->spsc.exclusive, 1);
+	while (CW_TQ_ATOMIC_LOAD(tq->spsc.producer_busy) || CW_TQ_ATOMIC_LOAD(tq->spsc.consumer_busy)) {
+		/* Lock-free sections are very short. */
+		sched_yield();
+	}
+}
+
+
+
+
+/**
+   @brief Release exclusive access to tone queue
+
+   @param[in] tq tone queue
+*/
+static void cw_tq_unlock_exclusive_internal(cw_tone_queue_t * tq)
+{
+	CW_TQ_ATOMIC_STORE(tq->spsc.exclusive, 0);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	/* Modification of the queue may have completed asynchronous waits. */
+	cw_tq_run_completions_internal(tq);
+}
@@ -45,17 +45,28 @@ extern "C"
    queue capacity. See if we really handle the capacity correctly. */
 
 enum {
-	/* Default and maximum values of two basic parameters of tone
-	   queue: capacity and high water mark. The parameters can be
-	   modified using suitable function. */
+	/* Default values of two basic parameters of tone queue: capacity
+	   and high water mark. The parameters can be modified using
+	   suitable function. */
 
 	/* Tone queue will accept at most "capacity" tones. */
-	CW_TONE_QUEUE_CAPACITY_MAX = 3000,        /* ~= 5 minutes at 12 WPM */
+	CW_TONE_QUEUE_CAPACITY_DEFAULT = 3000,        /* ~= 5 minutes at 12 WPM */
 
 	/* Tone queue will refuse to accept new tones (TODO: tones or
 	   characters?) if number of tones in queue (queue length) is already
 	   equal or larger than queue's high water mark. */
-	CW_TONE_QUEUE_HIGH_WATER_MARK_MAX = 2900
+	CW_TONE_QUEUE_HIGH_WATER_MARK_DEFAULT = 2900,
+
+	/* Upper limit of capacity that can be configured for tone queue. */
+	CW_TONE_QUEUE_CAPACITY_LIMIT = 1000000,       /* ~= 27 hours at 12 WPM */
+
+	/* Count of slots allocated for queue with lazy allocation of
+	   memory, before the queue grows. */
+	CW_TONE_QUEUE_N_SLOTS_INITIAL = 64,
+
+	/* Count of records initially allocated for index of characters
+	   in the queue. The index grows when necessary. */
+	CW_TONE_QUEUE_N_CHARS_INITIAL = 64
 };
 
 
@@ -112,6 +123,29 @@ typedef enum cw_tone_slope_mode_t {
 
 
 
+/* Timing elements of Morse code. Duration of a tone may be given
+   symbolically, as a sum of the elements. Such duration is resolved with
+   generator's current timing parameters when the tone is dequeued, so
+   changes of speed or gap have effect on tones that are already in tone
+   queue. */
+typedef enum cw_tone_element_t {
+	CW_TONE_ELEMENT_DOT,
+	CW_TONE_ELEMENT_DASH,
+	CW_TONE_ELEMENT_IMS,            /* Inter-mark-space. */
+	CW_TONE_ELEMENT_ICS,            /* Additional 2 Units of inter-character-space, plus gap. */
+	CW_TONE_ELEMENT_IWS_PART,       /* Half of additional 5 Units of inter-word-space. */
+	CW_TONE_ELEMENT_IWS_ADJUSTMENT, /* Inter-word adjustment space (Farnsworth). */
+	CW_TONE_ELEMENT_MAX
+} cw_tone_element_t;
+
+/* Count of elements of one kind is stored in 4 bits of cw_tone_t::elements. */
+#define CW_TONE_ELEMENT_BITS       4
+#define CW_TONE_ELEMENT_COUNT_MAX  ((1U << CW_TONE_ELEMENT_BITS) - 1)
+#define CW_TONE_ELEMENTS(m_element, m_count) ((uint32_t) (m_count) << ((unsigned int) (m_element) * CW_TONE_ELEMENT_BITS))
+
+
+
+
 /* TODO: come up with thought-out, consistent type system for samples
    count and tone duration. The type system should take into
    consideration very long duration of tones in QRSS. */
@@ -127,6 +161,13 @@ typedef struct {
 	/* Duration of a tone, in microseconds. */
 	int duration;
 
+	/* Symbolic duration of a tone: counts of timing elements, see
+	   CW_TONE_ELEMENTS(). Zero if ->duration is absolute. For tones
+	   with symbolic duration, ->duration is only the value valid at
+	   the moment of enqueueing, and Marks get frequency of generator
+	   valid at the moment of dequeueing. */
+	uint32_t elements;
+
 	/* Is this "forever" tone? See libcw_tq.c for more info about
 	   "forever" tones. */
 	bool is_forever;
@@ -135,6 +176,11 @@ typedef struct {
 	   character (all tones constituting a character) from the queue. */
 	bool is_first;
 
+	/* Character that starts with this tone: set in first tone of a
+	   character and in first tone of inter-word-space (' '), '\0'
+	   otherwise. See cw_tone_queue_t::chars. */
+	char character;
+
 	/* Type/mode of slope(s) in a tone. */
 	cw_tone_slope_mode_t slope_mode;
 
@@ -190,6 +236,12 @@ typedef struct {
 
 	/* Useful for marking individual tones during debugging. */
 	char debug_id;
+
+	/* Times (of monotonic clock, in microseconds) at which the tone
+	   has been enqueued, and dequeued by generator. Zero if the tone
+	   has not been (de)queued. Used for latency statistics. */
+	int64_t enqueue_time;
+	int64_t dequeue_time;
 } cw_tone_t;
 
 
@@ -205,14 +257,18 @@ typedef struct {
 #define CW_TONE_INIT(m_tone, m_frequency, m_duration, m_slope_mode) {	\
 		(m_tone)->frequency               = m_frequency;	\
 		(m_tone)->duration                = m_duration;		\
+		(m_tone)->elements                = 0;			\
 		(m_tone)->slope_mode              = m_slope_mode;	\
 		(m_tone)->is_forever              = false;		\
 		(m_tone)->is_first                = false;		\
+		(m_tone)->character               = '\0';		\
 		(m_tone)->n_samples               = 0;			\
 		(m_tone)->sample_iterator         = 0;			\
 		(m_tone)->rising_slope_n_samples  = 0;			\
 		(m_tone)->falling_slope_n_samples = 0;			\
 		(m_tone)->debug_id                = 0;			\
+		(m_tone)->enqueue_time            = 0;			\
+		(m_tone)->dequeue_time            = 0;			\
 	}
 
 
@@ -222,14 +278,18 @@ typedef struct {
 #define CW_TONE_COPY(m_dest, m_source) {				\
 		(m_dest)->frequency               = (m_source)->frequency; \
 		(m_dest)->duration                = (m_source)->duration; \
+		(m_dest)->elements                = (m_source)->elements; \
 		(m_dest)->slope_mode              = (m_source)->slope_mode; \
 		(m_dest)->is_forever              = (m_source)->is_forever; \
 		(m_dest)->is_first                = (m_source)->is_first; \
+		(m_dest)->character               = (m_source)->character; \
 		(m_dest)->n_samples               = (m_source)->n_samples; \
 		(m_dest)->sample_iterator         = (m_source)->sample_iterator;	\
 		(m_dest)->rising_slope_n_samples  = (m_source)->rising_slope_n_samples; \
 		(m_dest)->falling_slope_n_samples = (m_source)->falling_slope_n_samples; \
 		(m_dest)->debug_id                = (m_source)->debug_id; \
+		(m_dest)->enqueue_time            = (m_source)->enqueue_time; \
+		(m_dest)->dequeue_time            = (m_source)->dequeue_time; \
 	};
 
 
@@ -238,8 +298,91 @@ typedef struct {
 
 struct cw_gen_struct;
 
+
+
+
+/* Conditions for which a thread can wait on tone queue. */
+typedef enum {
+	/* Length of queue is at or below given level. */
+	CW_TQ_WAIT_LEVEL,
+
+	/* Tone that was at head of queue has been dequeued, or the queue
+	   is completely empty. */
+	CW_TQ_WAIT_TONE_END,
+
+	/* Queue is in CW_TQ_EMPTY state: the last tone has been dequeued
+	   and generated. */
+	CW_TQ_WAIT_EMPTY,
+
+	/* Iambic keyer using queue's generator is idle. Checked when
+	   generator notifies waiters with cw_tq_broadcast_internal(). */
+	CW_TQ_WAIT_KEYER_IDLE
+} cw_tq_wait_condition_t;
+
+
+
+
+/* Registration of a thread waiting on tone queue. The registration
+   lives on stack of waiting thread, and is linked into queue's list of
+   waiters while the thread waits. Each waiter has its own condition
+   variable, so the queue can wake up only the threads whose condition
+   has become true. All fields are protected by queue's wait_mutex. */
+typedef struct cw_tq_waiter_struct {
+	cw_tq_wait_condition_t condition;
+	size_t level;     /* For CW_TQ_WAIT_LEVEL. */
+	size_t head;      /* For CW_TQ_WAIT_TONE_END: head of queue at the moment of registration. */
+	const volatile cw_key_t * key; /* For CW_TQ_WAIT_KEYER_IDLE. */
+
+	/* Set by thread that wakes up the waiter and removes it from the list. */
+	bool is_woken;
+	pthread_cond_t cond;
+
+	/* Asynchronous waiter, see cw_tq_wait_async_internal(). It is
+	   allocated on heap, and is completed with callback and/or eventfd
+	   instead of condition variable. */
+	bool is_async;
+	cw_wait_callback_t callback;
+	void * callback_arg;
+	int fd;
+
+	struct cw_tq_waiter_struct * next;
+} cw_tq_waiter_t;
+
+
+
+
+/* Record of a character in index of characters of tone queue. */
+typedef struct {
+	/* Sequence number of first tone of the character, see
+	   cw_tone_queue_t::n_enqueued. */
+	uint64_t start;
+
+	/* ' ' for inter-word-space, '\0' if the character is not known
+	   (e.g. tones have been enqueued with is_first flag, but without
+	   a character). */
+	char character;
+
+	/* Position of the character in text enqueued in the queue. */
+	size_t offset;
+} cw_tq_char_t;
+
+
+
+
 typedef struct {
-	volatile cw_tone_t queue[CW_TONE_QUEUE_CAPACITY_MAX];
+	/* Ring of tones, allocated on heap. Tail and head are indices
+	   into this array.
+
+	   n_slots is the count of allocated slots. It is equal to
+	   capacity, unless lazy allocation is enabled: then n_slots starts
+	   small and is increased on demand, up to capacity. */
+	volatile cw_tone_t * queue;
+	size_t n_slots;
+	bool lazy_allocation;
+
+	/* Merge consecutive silent (or constant) tones into one entry. See
+	   cw_tq_set_coalescing_internal(). */
+	bool coalesce;
 
 	/* Tail index of tone queue. Index of last (newest) inserted
 	   tone, index of tone to be dequeued from the list as a last
@@ -259,6 +402,10 @@ typedef struct {
 	size_t high_water_mark;
 	size_t len;
 
+	/* The largest length of the queue observed since creation of the
+	   queue (or since last reset of the value). */
+	size_t len_max;
+
 	/* It's useful to have the tone queue dequeue function call
 	   a client-supplied callback routine when the amount of data
 	   in the queue drops below a defined low water mark.
@@ -267,12 +414,95 @@ typedef struct {
 	void     (* low_water_callback)(void *);
 	void     * low_water_callback_arg;
 
+	/* eventfd signalled when low water mark is crossed and when
+	   the queue becomes empty, see cw_tq_get_event_fd_internal().
+	   -1 until the descriptor is requested by client code. */
+	int event_fd;
 
-	/* Inter-thread communication. Used to broadcast queue events to
-	   waiting functions. */
+
+	/* Inter-thread communication. wait_var is used to broadcast queue
+	   events to generator's thread waiting for new tones and to
+	   iambic keyer's waiting functions. */
 	pthread_cond_t wait_var;
 	pthread_mutex_t wait_mutex;
 
+	/* Threads waiting for level of queue, end of tone or empty queue,
+	   see cw_tq_wake_waiters_internal(). Protected by wait_mutex. */
+	cw_tq_waiter_t * waiters;
+
+	/* Asynchronous waiters that have been completed, but whose
+	   callbacks haven't been called yet, see
+	   cw_tq_run_completions_internal(). Protected by wait_mutex. */
+	cw_tq_waiter_t * completed;
+
+	/* Single-producer/single-consumer mode. See comments for
+	   cw_tq_set_spsc_mode_internal() in libcw_tq.c.
+
+	   In this mode tq->len, tq->head and tq->tail are accessed with
+	   atomic operations, and producer (enqueue) and consumer (dequeue)
+	   take wait_mutex only when queue goes from empty to non-empty,
+	   when it becomes empty, or when it crosses low water mark. */
+	struct {
+		bool enabled;
+
+		/* Non-zero while producer or consumer is inside of its
+		   lock-free section. */
+		volatile int producer_busy;
+		volatile int consumer_busy;
+
+		/* Set (while holding wait_mutex) by code that needs to
+		   modify queue's structure (e.g. flush), to keep producer and
+		   consumer out of their lock-free sections. */
+		volatile int exclusive;
+
+		/* Count of threads on list of waiters, waiting for a
+		   change of queue's length or head. */
+		volatile int n_waiters;
+	} spsc;
+
+	/* Sequence numbers of tones: count of tones enqueued in the queue
+	   (minus tones removed from its end), and count of tones removed
+	   from head of the queue, since creation of the queue. Tone with
+	   sequence number n_dequeued - 1 is the tone that is being
+	   generated. n_dequeued is modified by consumer with atomic
+	   operations. */
+	uint64_t n_enqueued;
+	uint64_t n_dequeued;
+
+	/* Count of tones that haven't been enqueued because the queue
+	   was full. Updated with atomic operations. */
+	uint64_t n_rejected;
+
+	/* Index of characters in the queue: ring of records sorted by
+	   their start. A record is added by enqueue for each tone with
+	   ->is_first flag or ->character set, and records of characters
+	   that have been already played are dropped lazily.
+
+	   Only producer (in enqueue, also in its lock-free section in
+	   SPSC mode) and code with exclusive access to the queue use the
+	   index. Consumer doesn't touch it. */
+	struct {
+		cw_tq_char_t * records;
+		size_t n_slots;
+		size_t head;
+		size_t len;
+
+		/* Offset of next enqueued character. */
+		size_t next_offset;
+	} chars;
+
+	/* Shared tone queue, see libcw_shmq.c.
+
+	   In proxy generator of client process, tones are enqueued to
+	   shmq_producer instead of to this queue, and queries and waits
+	   are forwarded to it. This queue stays empty.
+
+	   In server process, shmq_consumer is the queue feeding this
+	   queue while it is started. Dequeue publishes state of this queue
+	   through it. Protected by wait_mutex. */
+	cw_shmq_t * shmq_producer;
+	cw_shmq_t * shmq_consumer;
+
 	/* Generator associated with a tone queue. */
 	struct cw_gen_struct * gen;
 
@@ -286,18 +516,32 @@ void              cw_tq_delete_internal(cw_tone_queue_t ** tq);
 void              cw_tq_flush_internal(cw_tone_queue_t * tq);
 
 size_t cw_tq_capacity_internal(const cw_tone_queue_t * tq);
+cw_ret_t cw_tq_configure_capacity_internal(cw_tone_queue_t * tq, size_t capacity, bool lazy_allocation);
 size_t cw_tq_length_internal(cw_tone_queue_t * tq);
 cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone);
+cw_ret_t cw_tq_enqueue_batch_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones);
 cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone);
 
 cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level);
+int cw_tq_get_event_fd_internal(cw_tone_queue_t * tq);
 cw_ret_t cw_tq_register_low_level_callback_internal(cw_tone_queue_t * tq, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level);
 bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq);
 cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_wait_for_empty_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_wait_async_internal(cw_tone_queue_t * tq, cw_tq_wait_condition_t condition, size_t level, const volatile cw_key_t * key, cw_wait_callback_t callback, void * callback_arg, int * fd);
 void cw_tq_reset_internal(cw_tone_queue_t * tq);
 bool cw_tq_is_full_internal(const cw_tone_queue_t * tq);
 
 cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_remove_last_word_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_skip_current_character_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_get_playing_position_internal(cw_tone_queue_t * tq, char * character, size_t * offset);
+
+cw_ret_t cw_tq_set_spsc_mode_internal(cw_tone_queue_t * tq, bool enabled);
+void cw_tq_broadcast_internal(cw_tone_queue_t * tq);
+void cw_tq_set_coalescing_internal(cw_tone_queue_t * tq, bool enabled);
+size_t cw_tq_get_length_max_internal(const cw_tone_queue_t * tq);
+void cw_tq_reset_length_max_internal(cw_tone_queue_t * tq);
 
 
 
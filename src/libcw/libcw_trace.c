@@ -0,0 +1,452 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_trace.c
+
+   @brief Binary tracing of events of library, with export to Chrome's trace event format.
+
+   Every thread that records an event gets its own ring of fixed-size
+   records (see CW_TRACE()). The ring is written only by its thread,
+   so recording needs no locks: a record is filled, and then count of
+   records in the ring is incremented with release semantics. Rings
+   are never freed; when a thread exits, its ring is kept for export,
+   and is reused by a new thread only if all CW_TRACE_N_RINGS_MAX rings
+   are in use.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_trace.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/trace: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+typedef struct {
+	/* Count of records written to the ring since its creation.
+	   Written only by owner of the ring. */
+	uint64_t head;
+
+	/* Value of ::head at last cw_trace_clear(). Records before it
+	   are not exported. */
+	uint64_t cleared;
+
+	/* Owner thread has exited, the ring may be reused. */
+	bool is_released;
+
+	int64_t tid;
+	char thread_name[16];
+
+	cw_trace_record_t records[CW_TRACE_RING_CAPACITY];
+} cw_trace_ring_t;
+
+
+
+
+typedef struct {
+	const char * name;
+	const char * phase;    /* Chrome's "ph" field. */
+	const char * arg_name;
+} cw_trace_event_format_t;
+
+
+
+
+/* Indexed with cw_trace_event_t. */
+static const cw_trace_event_format_t cw_trace_event_formats[CW_TRACE_EVENT_MAX] = {
+	[CW_TRACE_EVENT_TQ_ENQUEUE]          = { "enqueue",      "i", "n_tones"     },
+	[CW_TRACE_EVENT_TQ_DEQUEUE]          = { "dequeue",      "i", "duration_us" },
+	[CW_TRACE_EVENT_WRITE_BEGIN]         = { "write",        "B", "n_samples"   },
+	[CW_TRACE_EVENT_WRITE_END]           = { "write",        "E", "success"     },
+	[CW_TRACE_EVENT_IAMBIC_KEYER_VALUE]  = { "iambic keyer", "C", "value"       },
+	[CW_TRACE_EVENT_STRAIGHT_KEY_VALUE]  = { "straight key", "C", "value"       },
+	[CW_TRACE_EVENT_REC_MARK]            = { "mark",         "i", "mark"        },
+	[CW_TRACE_EVENT_USER]                = { "user event",   "i", "id"          },
+};
+
+
+
+
+bool cw_trace_enabled = false;
+
+static cw_trace_ring_t * cw_trace_rings[CW_TRACE_N_RINGS_MAX];
+static unsigned int cw_trace_n_rings = 0;
+#if !defined(__linux__)
+static int64_t cw_trace_next_tid = 1;
+#endif
+
+static pthread_once_t cw_trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cw_trace_key;
+
+/* Serializes exports and clearing. */
+static pthread_mutex_t cw_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread cw_trace_ring_t * cw_trace_thread_ring = NULL;
+static __thread bool cw_trace_thread_is_untraced = false;
+
+
+
+
+static void cw_trace_key_create_internal(void);
+static void cw_trace_ring_release_internal(void * ring);
+static cw_trace_ring_t * cw_trace_get_thread_ring_internal(void);
+static void cw_trace_write_record_internal(FILE * file, int pid, const cw_trace_ring_t * ring, const cw_trace_record_t * record);
+
+
+
+
+/**
+   @brief Start recording of trace events
+*/
+void cw_trace_enable(void)
+{
+	__atomic_store_n(&cw_trace_enabled, true, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Stop recording of trace events
+
+   Records collected so far are kept and can be exported.
+*/
+void cw_trace_disable(void)
+{
+	__atomic_store_n(&cw_trace_enabled, false, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Check if trace events are being recorded
+
+   @return true if tracing is enabled
+   @return false otherwise
+*/
+bool cw_trace_is_enabled(void)
+{
+	return __atomic_load_n(&cw_trace_enabled, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Record event of client code
+
+   @param[in] id ID of event, chosen by client code
+*/
+void cw_trace_user_event(int32_t id)
+{
+	CW_TRACE(CW_TRACE_EVENT_USER, id);
+}
+
+
+
+
+/**
+   @brief Drop all records collected so far
+
+   Rings of threads are kept.
+*/
+void cw_trace_clear(void)
+{
+	pthread_mutex_lock(&cw_trace_mutex);
+	const unsigned int n_rings = __atomic_load_n(&cw_trace_n_rings, __ATOMIC_ACQUIRE);
+	for (unsigned int i = 0; i < n_rings && i < CW_TRACE_N_RINGS_MAX; i++) {
+		cw_trace_ring_t * ring = __atomic_load_n(&cw_trace_rings[i], __ATOMIC_ACQUIRE);
+		if (NULL != ring) {
+			ring->cleared = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		}
+	}
+	pthread_mutex_unlock(&cw_trace_mutex);
+}
+
+
+
+
+/**
+   @brief Add a record to ring of current thread
+
+   Don't call the function directly, use CW_TRACE().
+
+   @param[in] event type of event
+   @param[in] arg argument of event
+*/
+void cw_trace_record_internal(cw_trace_event_t event, int32_t arg)
+{
+	cw_trace_ring_t * ring = cw_trace_get_thread_ring_internal();
+	if (NULL == ring) {
+		return;
+	}
+
+	const uint64_t head = ring->head;
+	cw_trace_record_t * record = &ring->records[head % CW_TRACE_RING_CAPACITY];
+	record->timestamp = cw_clock_now_internal();
+	record->event = (uint32_t) event;
+	record->arg = arg;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+
+
+/**
+   @brief Write all collected records to file in Chrome's trace event format (JSON)
+
+   @exception EINVAL @p path is NULL
+   @exception other errno values set by fopen() or by writes to the file
+
+   @param[in] path path to output file
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_trace_export_chrome_json(const char * path)
+{
+	if (NULL == path) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	FILE * file = fopen(path, "w");
+	if (NULL == file) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "export: fopen(%s): %s", path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	const int pid = (int) getpid();
+	bool is_first = true;
+
+	pthread_mutex_lock(&cw_trace_mutex);
+	fprintf(file, "{\n  \"displayTimeUnit\": \"ns\",\n  \"traceEvents\": [");
+	const unsigned int n_rings = __atomic_load_n(&cw_trace_n_rings, __ATOMIC_ACQUIRE);
+	for (unsigned int i = 0; i < n_rings && i < CW_TRACE_N_RINGS_MAX; i++) {
+		const cw_trace_ring_t * ring = __atomic_load_n(&cw_trace_rings[i], __ATOMIC_ACQUIRE);
+		if (NULL == ring) {
+			/* Ring is being registered by its thread. */
+			continue;
+		}
+
+		fprintf(file, "%s\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %" PRId64 ", \"args\": { \"name\": \"%s\" } }",
+			is_first ? "" : ",", pid, ring->tid, ring->thread_name);
+		is_first = false;
+
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t first = head > CW_TRACE_RING_CAPACITY ? head - CW_TRACE_RING_CAPACITY : 0;
+		if (first < ring->cleared) {
+			first = ring->cleared;
+		}
+		for (uint64_t r = first; r < head; r++) {
+			const cw_trace_record_t record = ring->records[r % CW_TRACE_RING_CAPACITY];
+			if (record.event >= CW_TRACE_EVENT_MAX) {
+				/* Record torn by concurrent write. */
+				continue;
+			}
+			fprintf(file, ",");
+			cw_trace_write_record_internal(file, pid, ring, &record);
+		}
+	}
+	fprintf(file, "\n  ]\n}\n");
+	pthread_mutex_unlock(&cw_trace_mutex);
+
+	const bool write_failed = ferror(file);
+	if (0 != fclose(file) || write_failed) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "export: failed to write %s", path);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write one record as JSON object of Chrome's trace event format
+
+   @param[in] file output file
+   @param[in] pid ID of process
+   @param[in] ring ring of thread that has recorded @p record
+   @param[in] record record to write
+*/
+static void cw_trace_write_record_internal(FILE * file, int pid, const cw_trace_ring_t * ring, const cw_trace_record_t * record)
+{
+	const cw_trace_event_format_t * format = &cw_trace_event_formats[record->event];
+
+	/* Timestamps of Chrome's format are in microseconds. */
+	fprintf(file, "\n    { \"name\": \"%s", format->name);
+	if (CW_TRACE_EVENT_USER == record->event) {
+		fprintf(file, " %" PRId32, record->arg);
+	}
+	fprintf(file, "\", \"ph\": \"%s\", \"ts\": %" PRId64 ".%03d, \"pid\": %d, \"tid\": %" PRId64 ", ",
+		format->phase, record->timestamp / 1000, (int) (record->timestamp % 1000), pid, ring->tid);
+	if (0 == strcmp(format->phase, "i")) {
+		/* Instant event of thread. */
+		fprintf(file, "\"s\": \"t\", ");
+	}
+
+	switch (record->event) {
+	case CW_TRACE_EVENT_WRITE_END:
+		fprintf(file, "\"args\": { \"%s\": %s } }", format->arg_name, CW_SUCCESS == record->arg ? "true" : "false");
+		break;
+	case CW_TRACE_EVENT_REC_MARK:
+		fprintf(file, "\"args\": { \"%s\": \"%s\" } }", format->arg_name,
+			CW_DOT_REPRESENTATION == record->arg ? "." : (CW_DASH_REPRESENTATION == record->arg ? "-" : "unknown"));
+		break;
+	default:
+		fprintf(file, "\"args\": { \"%s\": %" PRId32 " } }", format->arg_name, record->arg);
+		break;
+	}
+}
+
+
+
+
+/**
+   @brief Get ring of current thread, create or reuse the ring on first call in thread
+
+   @return ring of current thread
+   @return NULL if the thread can't be traced (no free rings or no memory)
+*/
+static cw_trace_ring_t * cw_trace_get_thread_ring_internal(void)
+{
+	if (NULL != cw_trace_thread_ring) {
+		return cw_trace_thread_ring;
+	}
+	if (cw_trace_thread_is_untraced) {
+		return NULL;
+	}
+
+	pthread_once(&cw_trace_key_once, cw_trace_key_create_internal);
+
+	cw_trace_ring_t * ring = NULL;
+	if (__atomic_load_n(&cw_trace_n_rings, __ATOMIC_RELAXED) < CW_TRACE_N_RINGS_MAX) {
+		ring = (cw_trace_ring_t *) calloc(1, sizeof (cw_trace_ring_t));
+		if (NULL != ring) {
+			const unsigned int i = __atomic_fetch_add(&cw_trace_n_rings, 1, __ATOMIC_ACQ_REL);
+			if (i < CW_TRACE_N_RINGS_MAX) {
+				__atomic_store_n(&cw_trace_rings[i], ring, __ATOMIC_RELEASE);
+			} else {
+				free(ring);
+				ring = NULL;
+			}
+		}
+	}
+	if (NULL == ring) {
+		/* Reuse ring of a thread that has exited. */
+		for (int i = 0; i < CW_TRACE_N_RINGS_MAX; i++) {
+			cw_trace_ring_t * candidate = __atomic_load_n(&cw_trace_rings[i], __ATOMIC_ACQUIRE);
+			bool expected = true;
+			if (NULL != candidate
+			    && __atomic_compare_exchange_n(&candidate->is_released, &expected, false, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+				ring = candidate;
+				ring->cleared = ring->head;
+				break;
+			}
+		}
+	}
+	if (NULL == ring) {
+		cw_trace_thread_is_untraced = true;
+		return NULL;
+	}
+
+#if defined(__linux__)
+	ring->tid = (int64_t) syscall(SYS_gettid);
+	if (0 != pthread_getname_np(pthread_self(), ring->thread_name, sizeof (ring->thread_name))) {
+		ring->thread_name[0] = '\0';
+	}
+#else
+	ring->tid = __atomic_fetch_add(&cw_trace_next_tid, 1, __ATOMIC_RELAXED);
+	ring->thread_name[0] = '\0';
+#endif
+	/* Name is written to JSON without escaping. */
+	for (char * c = ring->thread_name; *c; c++) {
+		if ('"' == *c || '\\' == *c || (unsigned char) *c < 0x20) {
+			*c = '_';
+		}
+	}
+
+	pthread_setspecific(cw_trace_key, ring);
+	cw_trace_thread_ring = ring;
+
+	return ring;
+}
+
+
+
+
+static void cw_trace_key_create_internal(void)
+{
+	pthread_key_create(&cw_trace_key, cw_trace_ring_release_internal);
+}
+
+
+
+
+/**
+   @brief Mark ring of exiting thread as available for reuse
+
+   @param[in] ring ring of the thread
+*/
+static void cw_trace_ring_release_internal(void * ring)
+{
+	__atomic_store_n(&((cw_trace_ring_t *) ring)->is_released, true, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,70 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_TRACE
+#define H_LIBCW_TRACE
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Capacity of ring of records of one thread, and count of rings. */
+enum { CW_TRACE_RING_CAPACITY = 64 * 1024 };
+enum { CW_TRACE_N_RINGS_MAX = 64 };
+
+
+
+
+typedef enum {
+	CW_TRACE_EVENT_TQ_ENQUEUE,          /* Tones are being enqueued. Argument: count of tones. */
+	CW_TRACE_EVENT_TQ_DEQUEUE,          /* Generator has dequeued a tone. Argument: duration of the tone [us]. */
+	CW_TRACE_EVENT_WRITE_BEGIN,         /* Generator starts writing a buffer to sound system. Argument: count of samples. */
+	CW_TRACE_EVENT_WRITE_END,           /* Write has been completed. Argument: CW_SUCCESS or CW_FAILURE. */
+	CW_TRACE_EVENT_IAMBIC_KEYER_VALUE,  /* Value of iambic keyer has changed. Argument: new value. */
+	CW_TRACE_EVENT_STRAIGHT_KEY_VALUE,  /* Value of straight key has changed. Argument: new value. */
+	CW_TRACE_EVENT_REC_MARK,            /* Receiver has identified a mark. Argument: '.', '-', or 0 if mark wasn't recognized. */
+	CW_TRACE_EVENT_USER,                /* Event of client code. Argument: ID of the event. */
+	CW_TRACE_EVENT_MAX
+} cw_trace_event_t;
+
+
+
+
+typedef struct {
+	int64_t timestamp; /* [ns] */
+	uint32_t event;    /* One of cw_trace_event_t values. */
+	int32_t arg;
+} cw_trace_record_t;
+
+
+
+
+/* Read with atomic load, see CW_TRACE(). */
+extern bool cw_trace_enabled;
+
+void cw_trace_record_internal(cw_trace_event_t event, int32_t arg);
+
+/* Trace point. The only cost of disabled tracing is test of the flag. */
+#define CW_TRACE(event, arg)						\
+	do {								\
+		if (__builtin_expect(__atomic_load_n(&cw_trace_enabled, __ATOMIC_RELAXED), 0)) { \
+			cw_trace_record_internal((event), (int32_t) (arg)); \
+		}							\
+	} while (0)
+
+
+
+
+#endif /* #ifndef H_LIBCW_TRACE */
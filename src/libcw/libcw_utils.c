@@ -30,6 +30,9 @@
    PulseAudio libs, and replace it with run-time dependency.
 
    You will find calls to dlclose() in libcw_alsa.c and libcw_pa.c.
+
+   Another one is cw_probe_sound_systems(), which checks availability
+   of many sound systems at once.
 */
 
 
@@ -41,11 +44,14 @@
 #include <dlfcn.h> /* dlopen() and related symbols */
 #include <errno.h>
 #include <limits.h> /* INT_MAX, for clang. */
+#include <netdb.h> /* getaddrinfo() */
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h> /* strtol() */
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h> /* clock_gettime() */
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -78,6 +84,26 @@
 
 
 
+#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO) || defined(LIBCW_WITH_JACK) || defined(LIBCW_WITH_OPUS))
+/* Capacity of cache of libraries opened with cw_dlopen_internal().
+   Sound systems try only a few libraries. */
+#define CW_DLOPEN_CACHE_CAPACITY 8
+
+/* Cache of libraries opened with cw_dlopen_internal(). The cache
+   keeps one reference to each successfully opened library. */
+static struct {
+	struct {
+		char library_name[32];
+		void * handle; /* NULL if the library couldn't be opened. */
+	} entries[CW_DLOPEN_CACHE_CAPACITY];
+	size_t len;
+	pthread_mutex_t mutex;
+} cw_dlopen_cache = { .len = 0, .mutex = PTHREAD_MUTEX_INITIALIZER };
+#endif
+
+
+
+
 extern cw_debug_t cw_debug_object;
 extern cw_debug_t cw_debug_object_ev;
 extern cw_debug_t cw_debug_object_dev;
@@ -94,7 +120,10 @@ static const char * cw_sound_system_labels[] = {
 	"OSS",
 	"ALSA",
 	"PulseAudio",
-	"Soundcard" };
+	"Soundcard",
+	"File",
+	"JACK",
+	"RTP" };
 
 
 
@@ -265,8 +294,146 @@ void cw_usecs_to_timespec_internal(struct timespec * ts, int usecs)
 
 
 
+/**
+   @brief Get current time of monotonic clock, in microseconds
+
+   Unlike gettimeofday(), the clock is not affected by changes of system
+   time (e.g. by NTP), so the function can be used to measure intervals.
+
+   @return current time of monotonic clock [us]
+*/
+int64_t cw_monotonic_usecs_internal(void)
+{
+	return cw_clock_now_internal() / 1000;
+}
+
+
+
+
+/* Clock injected with cw_clock_set_internal(), or NULL when the
+   library uses monotonic clock of the system. */
+static const cw_clock_t * cw_clock_injected = NULL;
+
+/* Difference between wall-clock time and injected clock at the moment
+   of injection [us]. */
+static int64_t cw_clock_wall_offset = 0;
+
+
+
+
+/**
+   @brief Inject source of time of the library
+
+   Pass NULL to go back to monotonic clock of the system. The
+   structure pointed to by @p clock must stay valid until it is
+   replaced. The clock should be replaced only while the library is
+   idle: deadlines calculated by one clock are meaningless to another.
+
+   @param[in] clock clock to be used by the library, or NULL
+*/
+void cw_clock_set_internal(const cw_clock_t * clock)
+{
+	if (clock) {
+		struct timeval tv = { 0 };
+		gettimeofday(&tv, NULL);
+		cw_clock_wall_offset = (int64_t) tv.tv_sec * CW_USECS_PER_SEC + tv.tv_usec - clock->now(clock->arg) / 1000;
+	}
+	__atomic_store_n(&cw_clock_injected, clock, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current time of the library's clock, in nanoseconds
+
+   @return current time of monotonic clock (or of injected clock) [ns]
+*/
+int64_t cw_clock_now_internal(void)
+{
+	const cw_clock_t * clock = __atomic_load_n(&cw_clock_injected, __ATOMIC_ACQUIRE);
+	if (clock) {
+		return clock->now(clock->arg);
+	}
+
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * CW_NSECS_PER_SEC + ts.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Sleep until the library's clock reaches given time
+
+   @param[in] deadline time of the clock (see cw_clock_now_internal()) [ns]
+*/
+void cw_clock_sleep_until_internal(int64_t deadline)
+{
+	const cw_clock_t * clock = __atomic_load_n(&cw_clock_injected, __ATOMIC_ACQUIRE);
+	if (clock) {
+		clock->sleep_until(clock->arg, deadline);
+		return;
+	}
+
+#if defined(TIMER_ABSTIME)
+	struct timespec ts = { 0 };
+	ts.tv_sec = (time_t) (deadline / CW_NSECS_PER_SEC);
+	ts.tv_nsec = (long) (deadline % CW_NSECS_PER_SEC);
+	/* clock_nanosleep() returns error code instead of setting errno.
+	   Sleep with absolute time can be simply restarted after being
+	   interrupted by signal. */
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+		;
+	}
+#else
+	const int64_t remaining = (deadline - cw_clock_now_internal()) / 1000;
+	if (remaining > 0) {
+		cw_usleep_internal((int) remaining);
+	}
+#endif
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current wall-clock time
+
+   Equivalent of gettimeofday(), except that with injected clock the
+   time advances together with the injected clock.
+
+   @param[out] tv current time
+*/
+void cw_clock_get_timeval_internal(struct timeval * tv)
+{
+	const cw_clock_t * clock = __atomic_load_n(&cw_clock_injected, __ATOMIC_ACQUIRE);
+	if (clock) {
+		const int64_t usecs = clock->now(clock->arg) / 1000 + cw_clock_wall_offset;
+		tv->tv_sec = (time_t) (usecs / CW_USECS_PER_SEC);
+		tv->tv_usec = (suseconds_t) (usecs % CW_USECS_PER_SEC);
+		return;
+	}
+
+	gettimeofday(tv, NULL);
+	return;
+}
+
+
+
+
 void cw_usleep_internal(int usecs)
 {
+	if (__atomic_load_n(&cw_clock_injected, __ATOMIC_ACQUIRE)) {
+		cw_clock_sleep_until_internal(cw_clock_now_internal() + (int64_t) usecs * 1000);
+		return;
+	}
+
 	struct timespec remaining = { 0 };
 	cw_usecs_to_timespec_internal(&remaining, usecs);
 
@@ -286,7 +453,62 @@ void cw_usleep_internal(int usecs)
 
 
 
-#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO))
+/**
+   @brief Resolve address of UDP or TCP socket
+
+   Address is given as "host:port" or "[address]:port" (for IPv6
+   addresses, which have colons of their own). With @p passive set to
+   true, the host may be omitted (":port"), and the result is a
+   wildcard address suitable for bind().
+
+   @param[in] address address to resolve
+   @param[in] socktype SOCK_DGRAM or SOCK_STREAM
+   @param[in] passive whether the address will be bound to
+   @param[out] result list of addresses, to be freed with freeaddrinfo()
+
+   @return 0 on success
+   @return error code of getaddrinfo() otherwise
+*/
+int cw_resolve_address_internal(const char * address, int socktype, bool passive, struct addrinfo ** result)
+{
+	char host[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	const char * host_begin = address;
+	const char * host_end = NULL;
+	const char * port = NULL;
+
+	if ('[' == address[0]) {
+		host_begin = address + 1;
+		host_end = strchr(address, ']');
+		if (NULL == host_end || ':' != host_end[1]) {
+			return EAI_NONAME;
+		}
+		port = host_end + 2;
+	} else {
+		host_end = strrchr(address, ':');
+		if (NULL == host_end) {
+			return EAI_NONAME;
+		}
+		port = host_end + 1;
+	}
+	const size_t host_len = (size_t) (host_end - host_begin);
+	if ((0 == host_len && !passive) || host_len >= sizeof (host) || '\0' == port[0]) {
+		return EAI_NONAME;
+	}
+	memcpy(host, host_begin, host_len);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socktype;
+	hints.ai_flags = AI_NUMERICSERV | (passive ? AI_PASSIVE : 0);
+
+	return getaddrinfo(0 == host_len ? NULL : host, port, &hints, result);
+}
+
+
+
+
+#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO) || defined(LIBCW_WITH_JACK) || defined(LIBCW_WITH_OPUS))
 /**
    @brief Try to dynamically open shared library
 
@@ -295,7 +517,12 @@ void cw_usleep_internal(int usecs)
    via @p handle.
 
    Name of the library should contain ".so" suffix, e.g.: "libasound.so.2",
-   or "libpulse-simple.so".
+   or "libpulse.so".
+
+   Results are cached for whole process: a library that has been
+   opened once stays loaded even if callers dlclose() their handles
+   (e.g. after failed probe of sound system), and a library that
+   couldn't be opened is not searched for again.
 
    @reviewed 2020-08-17
 
@@ -309,27 +536,295 @@ cw_ret_t cw_dlopen_internal(const char * library_name, void ** handle)
 {
 	assert (NULL != library_name);
 
-	dlerror();
-	void * h = dlopen(library_name, RTLD_LAZY);
-	char * e = dlerror();
+	pthread_mutex_lock(&cw_dlopen_cache.mutex);
 
-	if (e) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
-			      MSG_PREFIX "dlopen() fails for library %s with error: %s", library_name, e);
+	size_t i = 0;
+	for (; i < cw_dlopen_cache.len; i++) {
+		if (0 == strcmp(cw_dlopen_cache.entries[i].library_name, library_name)) {
+			break;
+		}
+	}
+	if (i == cw_dlopen_cache.len) {
+		/* First attempt to open the library in this process. */
+		dlerror();
+		void * h = dlopen(library_name, RTLD_LAZY);
+		char * e = dlerror();
+		if (e) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "dlopen() fails for library %s with error: %s", library_name, e);
+			h = NULL;
+		}
+		if (i < CW_DLOPEN_CACHE_CAPACITY) {
+			snprintf(cw_dlopen_cache.entries[i].library_name, sizeof (cw_dlopen_cache.entries[i].library_name), "%s", library_name);
+			cw_dlopen_cache.entries[i].handle = h;
+			cw_dlopen_cache.len++;
+		} else if (NULL != h) {
+			/* Not cached: caller gets the only reference. */
+			pthread_mutex_unlock(&cw_dlopen_cache.mutex);
+			*handle = h;
+			return CW_SUCCESS;
+		}
+		if (NULL == h) {
+			pthread_mutex_unlock(&cw_dlopen_cache.mutex);
+			return CW_FAILURE;
+		}
+	} else if (NULL == cw_dlopen_cache.entries[i].handle) {
+		pthread_mutex_unlock(&cw_dlopen_cache.mutex);
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_STDLIB, CW_DEBUG_DEBUG,
+			      MSG_PREFIX "library %s couldn't be opened before, not trying again", library_name);
 		return CW_FAILURE;
-	} else {
-		*handle = h;
+	}
 
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_STDLIB, CW_DEBUG_DEBUG,
-			      MSG_PREFIX "dlopen() succeeds for library %s", library_name);
-		return CW_SUCCESS;
+	/* The library is already loaded and is kept loaded by the
+	   cache, so this is cheap. Caller gets its own reference,
+	   which it may dlclose(). */
+	void * h = dlopen(library_name, RTLD_LAZY);
+	pthread_mutex_unlock(&cw_dlopen_cache.mutex);
+	if (NULL == h) {
+		return CW_FAILURE;
 	}
+	*handle = h;
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_STDLIB, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "dlopen() succeeds for library %s", library_name);
+	return CW_SUCCESS;
 }
 #endif
 
 
 
 
+/* State of one call to cw_probe_sound_systems(), shared by caller
+   and prober threads. Caller may stop waiting for a slow prober; the
+   last of them to drop its reference frees the state. */
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int n_refs;
+	size_t n_pending;
+
+	char device_name[LIBCW_SOUND_DEVICE_NAME_SIZE];
+	struct {
+		enum cw_audio_systems sound_system;
+		bool possible;
+		bool done;
+	} probes[CW_PROBE_SOUND_SYSTEMS_MAX];
+} cw_probe_set_t;
+
+/* Argument of prober thread. */
+typedef struct {
+	cw_probe_set_t * set;
+	size_t i;
+} cw_probe_arg_t;
+
+/* Sound systems that are being probed by some prober thread. Sound
+   systems keep their libraries' symbols in global variables, so a
+   sound system is never probed by two threads at once. */
+static bool cw_probe_busy[CW_AUDIO_RTP + 1];
+static pthread_mutex_t cw_probe_busy_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+/**
+   @brief Check if sound system is possible, calling its cw_is_*_possible() function
+
+   @param[in] sound_system sound system to check
+   @param[in] device_name name of device to be used by the sound system
+
+   @return value returned by cw_is_*_possible() function
+*/
+static bool cw_probe_sound_system_internal(enum cw_audio_systems sound_system, const char * device_name)
+{
+	switch (sound_system) {
+	case CW_AUDIO_NULL:
+		return cw_is_null_possible(device_name);
+	case CW_AUDIO_CONSOLE:
+		return cw_is_console_possible(device_name);
+	case CW_AUDIO_OSS:
+		return cw_is_oss_possible(device_name);
+	case CW_AUDIO_ALSA:
+		return cw_is_alsa_possible(device_name);
+	case CW_AUDIO_PA:
+		return cw_is_pa_possible(device_name);
+	case CW_AUDIO_FILE:
+		return cw_is_file_possible(device_name);
+	case CW_AUDIO_JACK:
+		return cw_is_jack_possible(device_name);
+	case CW_AUDIO_RTP:
+		return cw_is_rtp_possible(device_name);
+	case CW_AUDIO_NONE:
+	case CW_AUDIO_SOUNDCARD:
+	default:
+		return false;
+	}
+}
+
+
+
+
+/**
+   @brief Drop reference to probe set, free the set if this was the last reference
+
+   Call with set's mutex locked. The function unlocks it.
+
+   @param[in] set probe set
+*/
+static void cw_probe_set_unref_internal(cw_probe_set_t * set)
+{
+	set->n_refs--;
+	const bool is_last = 0 == set->n_refs;
+	pthread_mutex_unlock(&set->mutex);
+
+	if (is_last) {
+		pthread_cond_destroy(&set->cond);
+		pthread_mutex_destroy(&set->mutex);
+		free(set);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread function probing one sound system
+
+   @param[in] arg probe argument (cw_probe_arg_t cast to (void *))
+
+   @return NULL pointer
+*/
+static void * cw_probe_thread_internal(void * arg)
+{
+	cw_probe_arg_t probe_arg = *(cw_probe_arg_t *) arg;
+	free(arg);
+	cw_probe_set_t * set = probe_arg.set;
+	const enum cw_audio_systems sound_system = set->probes[probe_arg.i].sound_system;
+
+	const bool possible = cw_probe_sound_system_internal(sound_system, set->device_name);
+
+	pthread_mutex_lock(&cw_probe_busy_mutex);
+	cw_probe_busy[sound_system] = false;
+	pthread_mutex_unlock(&cw_probe_busy_mutex);
+
+	pthread_mutex_lock(&set->mutex);
+	set->probes[probe_arg.i].possible = possible;
+	set->probes[probe_arg.i].done = true;
+	set->n_pending--;
+	pthread_cond_signal(&set->cond);
+	cw_probe_set_unref_internal(set);
+
+	return NULL;
+}
+
+
+
+
+cw_ret_t cw_probe_sound_systems(const char * device_name, const enum cw_audio_systems * sound_systems, bool * possible, size_t n, int timeout)
+{
+	if (NULL == sound_systems || NULL == possible || n > CW_PROBE_SOUND_SYSTEMS_MAX || timeout < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	for (size_t i = 0; i < n; i++) {
+		possible[i] = false;
+		if ((int) sound_systems[i] < CW_AUDIO_NONE || (int) sound_systems[i] > CW_AUDIO_RTP) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+	}
+
+	cw_probe_set_t * set = (cw_probe_set_t *) calloc(1, sizeof (cw_probe_set_t));
+	if (NULL == set) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return CW_FAILURE;
+	}
+	pthread_mutex_init(&set->mutex, NULL);
+	pthread_cond_init(&set->cond, NULL);
+	set->n_refs = 1;
+	if (NULL != device_name) {
+		snprintf(set->device_name, sizeof (set->device_name), "%s", device_name);
+	}
+
+	pthread_mutex_lock(&set->mutex);
+	for (size_t i = 0; i < n; i++) {
+		set->probes[i].sound_system = sound_systems[i];
+		set->probes[i].done = true; /* Until a prober is started for it. */
+
+		pthread_mutex_lock(&cw_probe_busy_mutex);
+		const bool busy = cw_probe_busy[sound_systems[i]];
+		cw_probe_busy[sound_systems[i]] = true;
+		pthread_mutex_unlock(&cw_probe_busy_mutex);
+		if (busy) {
+			/* A prober from previous call has timed out and
+			   is still running. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "probe: previous probe of sound system %s is still running",
+				      cw_get_audio_system_label(sound_systems[i]));
+			continue;
+		}
+
+		cw_probe_arg_t * arg = (cw_probe_arg_t *) malloc(sizeof (cw_probe_arg_t));
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		pthread_t thread;
+		if (NULL != arg) {
+			arg->set = set;
+			arg->i = i;
+		}
+		if (NULL == arg || 0 != pthread_create(&thread, &attr, cw_probe_thread_internal, arg)) {
+			/* Probe in this thread then. */
+			free(arg);
+			pthread_mutex_unlock(&set->mutex);
+			const bool is_possible = cw_probe_sound_system_internal(sound_systems[i], set->device_name);
+			pthread_mutex_lock(&set->mutex);
+			set->probes[i].possible = is_possible;
+
+			pthread_mutex_lock(&cw_probe_busy_mutex);
+			cw_probe_busy[sound_systems[i]] = false;
+			pthread_mutex_unlock(&cw_probe_busy_mutex);
+		} else {
+			set->probes[i].done = false;
+			set->n_refs++;
+			set->n_pending++;
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (long) (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= CW_NSECS_PER_SEC) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= CW_NSECS_PER_SEC;
+	}
+	while (set->n_pending > 0) {
+		if (ETIMEDOUT == pthread_cond_timedwait(&set->cond, &set->mutex, &deadline)) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (set->probes[i].done) {
+			possible[i] = set->probes[i].possible;
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "probe: probe of sound system %s has timed out",
+				      cw_get_audio_system_label(sound_systems[i]));
+		}
+	}
+	cw_probe_set_unref_internal(set);
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Validate and return timestamp
 
@@ -341,7 +836,8 @@ cw_ret_t cw_dlopen_internal(const char * library_name, void ** handle)
    CW_FAILURE with errno set to EINVAL.
 
    If @p in_timestamp is not given (NULL), get current time (with
-   gettimeofday()), put it in @p out_timestamp and return
+   gettimeofday(), or from clock injected with
+   cw_clock_set_internal()), put it in @p out_timestamp and return
    CW_SUCCESS. If call to gettimeofday() fails, return
    CW_FAILURE. gettimeofday() sets its own errno.
 
@@ -371,6 +867,11 @@ cw_ret_t cw_timestamp_validate_internal(struct timeval * out_timestamp, const st
 			return CW_SUCCESS;
 		}
 	} else {
+		if (__atomic_load_n(&cw_clock_injected, __ATOMIC_ACQUIRE)) {
+			cw_clock_get_timeval_internal(out_timestamp);
+			return CW_SUCCESS;
+		}
+
 		/* TODO: gettimeofday is susceptible to NTP syncs which can
 		   negatively impact measurements of time. */
 		if (0 != gettimeofday(out_timestamp, NULL)) {
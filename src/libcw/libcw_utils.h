@@ -29,12 +29,41 @@ extern "C"
 /* Microseconds in a second. */
 enum { CW_USECS_PER_SEC = 1000000 };
 
+/* Nanoseconds in a second. */
+enum { CW_NSECS_PER_SEC = 1000000000 };
+
 
 
 
 int cw_timestamp_compare_internal(const struct timeval * earlier, const struct timeval * later);
 cw_ret_t cw_timestamp_validate_internal(struct timeval * out_timestamp, const struct timeval * in_timestamp);
 void cw_usecs_to_timespec_internal(struct timespec * ts, int usecs);
+int64_t cw_monotonic_usecs_internal(void);
+
+
+
+
+/**
+   Source of time of the library
+
+   By default the library measures time with monotonic clock of the
+   system, and waits with nanosleep(). Test code may inject another
+   clock (e.g. virtual clock, see cw_virtual_clock_enable_internal()),
+   so that generator's pacing, timers of receiver and of iambic keyer,
+   and timestamps of receiver follow simulated time.
+*/
+typedef struct {
+	/* Current time of the clock [ns]. */
+	int64_t (* now)(void * arg);
+	/* Return when the clock reaches @p deadline [ns]. */
+	void (* sleep_until)(void * arg, int64_t deadline);
+	void * arg;
+} cw_clock_t;
+
+void    cw_clock_set_internal(const cw_clock_t * clock);
+int64_t cw_clock_now_internal(void);
+void    cw_clock_sleep_until_internal(int64_t deadline);
+void    cw_clock_get_timeval_internal(struct timeval * tv);
 
 
 
@@ -57,7 +86,12 @@ void cw_usleep_internal(int usecs);
 
 
 
-#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO))
+struct addrinfo;
+int cw_resolve_address_internal(const char * address, int socktype, bool passive, struct addrinfo ** result);
+
+
+
+#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO) || defined(LIBCW_WITH_JACK) || defined(LIBCW_WITH_OPUS))
 cw_ret_t cw_dlopen_internal(const char * library_name, void ** handle);
 #endif
 
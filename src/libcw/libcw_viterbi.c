@@ -0,0 +1,894 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_viterbi.c
+
+   @brief Probabilistic decoder. Bounded-beam Viterbi search over Marks and Spaces.
+
+   Receiver (libcw_rec.c) makes a hard decision about each Mark and
+   each Space as soon as it ends, by comparing its duration with
+   ranges of durations. A Mark that falls between the ranges makes
+   the whole character an error.
+
+   This decoder keeps several hypotheses (paths) about what has been
+   keyed. Each Mark is both a Dot and a Dash, and each Space is
+   inter-mark-space, inter-character-space and inter-word-space, on
+   different paths. Each interpretation adds to score of path a
+   log-likelihood of the duration, in a log-normal model of durations
+   (with means of tracked durations of Dot and Dash, and of 1, 3 and 7
+   units). Paths are states of a tree
+   of representations, so paths that have reached the same state are
+   merged (only the best one of them is kept), and only
+   CW_VITERBI_BEAM_WIDTH_MAX best paths are kept after each Mark and
+   Space. Work done per Mark or Space is therefore bounded by beam
+   width, and durations are converted to log-likelihoods only once
+   per Mark or Space, not once per path.
+
+   A character is reported when all paths agree on it, or when the
+   disagreement lasts for too many characters (see
+   CW_VITERBI_PENDING_MAX), or at the end of word, when all paths
+   collapse into one.
+
+   Durations of Dot (unit) and of Dash are tracked with moving
+   averages of durations of Marks, interpreted as Dots or Dashes by
+   the best path. Spaces are measured in units.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <inttypes.h> /* int64_t */
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_rec.h"
+#include "libcw_viterbi.h"
+
+
+
+
+#define MSG_PREFIX "libcw/viterbi: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_ev;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Spread of durations of Marks and Spaces around their ideal
+   durations: standard deviation of natural logarithm of ratio of
+   actual and ideal duration. Spaces of hand-sent code vary more than
+   Marks. */
+static const float CW_VITERBI_MARK_SIGMA = 0.30F;
+static const float CW_VITERBI_SPACE_SIGMA = 0.40F;
+
+/* Log-likelihood added to path for a character that is not a known
+   character, or for Marks that can't make one. */
+static const float CW_VITERBI_ERROR_PENALTY = -6.0F;
+
+/* Paths with score this much lower than score of the best path are
+   dropped even when there is room in beam. */
+static const float CW_VITERBI_SCORE_MARGIN = -25.0F;
+
+/* Durations of Space [units] after which the Space can't be
+   inter-mark-space, or can't be anything else than inter-word-space.
+   When the Space reaches them, paths are updated (and characters
+   may be reported) without waiting for next Mark. */
+static const float CW_VITERBI_END_OF_CHARACTER_UNITS = 2.5F;
+static const float CW_VITERBI_END_OF_WORD_UNITS = 5.0F;
+
+/* Weight of new Mark in moving averages of durations of Dot and of Dash. */
+static const float CW_VITERBI_UNIT_TRACKING_WEIGHT = 0.15F;
+
+
+
+
+static void  cw_viterbi_advance_internal(cw_viterbi_t * vit, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void  cw_viterbi_advance_space_internal(cw_viterbi_t * vit, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void  cw_viterbi_apply_mark_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void  cw_viterbi_apply_space_internal(cw_viterbi_t * vit, int64_t space_duration, bool is_final);
+static int   cw_viterbi_step_internal(cw_viterbi_t * vit, const float * log_likelihoods, const cw_viterbi_emission_t * emissions, int n_emissions);
+static void  cw_viterbi_add_candidate_internal(cw_viterbi_t * vit, int * n_candidates, float score, int node, int parent, cw_viterbi_emission_t emission);
+static void  cw_viterbi_path_end_character_internal(const cw_viterbi_t * vit, cw_viterbi_path_t * path, int64_t timestamp);
+static void  cw_viterbi_path_append_internal(cw_viterbi_path_t * path, int64_t timestamp, char character, bool is_error);
+static void  cw_viterbi_report_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg);
+static void  cw_viterbi_end_word_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg);
+static float cw_viterbi_log_likelihood_internal(float duration, float ideal, float sigma);
+
+
+
+
+/**
+   @brief Create new probabilistic decoder
+
+   Decoder starts with speed CW_SPEED_INITIAL, beam width
+   CW_VITERBI_BEAM_WIDTH_INITIAL and noise spike threshold
+   CW_REC_NOISE_THRESHOLD_INITIAL.
+
+   @return freshly allocated decoder on success
+   @return NULL pointer on failure
+*/
+cw_viterbi_t * cw_viterbi_new(void)
+{
+	cw_viterbi_t * vit = (cw_viterbi_t *) calloc(1, sizeof (cw_viterbi_t));
+	if (NULL == vit) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: calloc()");
+		return (cw_viterbi_t *) NULL;
+	}
+
+	vit->beam_width = CW_VITERBI_BEAM_WIDTH_INITIAL;
+	vit->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
+	vit->unit_duration = (float) CW_DOT_CALIBRATION / (float) CW_SPEED_INITIAL;
+	vit->dash_duration = 3.0F * vit->unit_duration;
+
+	/* Tree of representations, from leaves to root. */
+	for (int node = CW_DATA_MAX_REPRESENTATION_HASH; node >= CW_VITERBI_NODE_ROOT; node--) {
+		if (node > CW_VITERBI_NODE_ROOT) {
+			vit->node_character[node] = (char) cw_representation_hash_to_character_internal((unsigned int) node);
+		}
+		bool has_children = false;
+		for (int child = 2 * node; child <= 2 * node + 1 && child <= CW_DATA_MAX_REPRESENTATION_HASH; child++) {
+			has_children = has_children || 0 != vit->node_character[child] || vit->node_has_children[child];
+		}
+		vit->node_has_children[node] = has_children;
+	}
+
+	cw_viterbi_reset_state(vit);
+
+	return vit;
+}
+
+
+
+
+/**
+   @brief Delete probabilistic decoder
+
+   @param[in,out] vit pointer to decoder, set to NULL on return
+*/
+void cw_viterbi_delete(cw_viterbi_t ** vit)
+{
+	if (NULL == vit || NULL == *vit) {
+		return;
+	}
+
+	free(*vit);
+	*vit = (cw_viterbi_t *) NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Reset state of decoder
+
+   All paths and not reported characters are dropped. Tracked speed,
+   beam width and noise spike threshold are not reset.
+
+   @param[in,out] vit decoder
+*/
+void cw_viterbi_reset_state(cw_viterbi_t * vit)
+{
+	vit->paths = vit->paths_buffers[0];
+	vit->paths[0] = (cw_viterbi_path_t) { .score = 0.0F, .node = CW_VITERBI_NODE_ROOT, .is_word_error = false, .n_pending = 0 };
+	vit->n_paths = 1;
+
+	vit->is_mark = false;
+	vit->has_pending_mark = false;
+	vit->has_applied_mark = false;
+	vit->mark_start = 0;
+	vit->mark_end = 0;
+	vit->applied_mark_end = 0;
+	vit->last_timestamp = 0;
+	vit->space_stage = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set speed of decoder
+
+   The speed is only a starting point: decoder tracks speed of
+   received Marks.
+
+   @exception EINVAL @p new_value is out of range
+
+   @param[in,out] vit decoder
+   @param[in] new_value speed [wpm], in range CW_SPEED_MIN-CW_SPEED_MAX
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_viterbi_set_speed(cw_viterbi_t * vit, int new_value)
+{
+	if (new_value < CW_SPEED_MIN || new_value > CW_SPEED_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	vit->unit_duration = (float) CW_DOT_CALIBRATION / (float) new_value;
+	vit->dash_duration = 3.0F * vit->unit_duration;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get speed tracked by decoder
+
+   @param[in] vit decoder
+
+   @return current speed [wpm]
+*/
+float cw_viterbi_get_speed(const cw_viterbi_t * vit)
+{
+	return (float) CW_DOT_CALIBRATION / vit->unit_duration;
+}
+
+
+
+
+/**
+   @brief Set count of paths kept by decoder
+
+   Wider beam makes decoder more robust against sloppy timing, at the
+   cost of more work per Mark and Space.
+
+   @exception EINVAL @p new_value is out of range
+
+   @param[in,out] vit decoder
+   @param[in] new_value width, in range CW_VITERBI_BEAM_WIDTH_MIN-CW_VITERBI_BEAM_WIDTH_MAX
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_viterbi_set_beam_width(cw_viterbi_t * vit, int new_value)
+{
+	if (new_value < CW_VITERBI_BEAM_WIDTH_MIN || new_value > CW_VITERBI_BEAM_WIDTH_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	vit->beam_width = new_value;
+	if (vit->n_paths > new_value) {
+		vit->n_paths = new_value;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Set noise spike threshold of decoder
+
+   Marks shorter than the threshold are ignored, and Spaces shorter
+   than the threshold don't split a Mark. See
+   cw_rec_set_noise_spike_threshold().
+
+   @exception EINVAL @p new_value is negative
+
+   @param[in,out] vit decoder
+   @param[in] new_value threshold [us]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_viterbi_set_noise_spike_threshold(cw_viterbi_t * vit, int new_value)
+{
+	if (new_value < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	vit->noise_spike_threshold = new_value;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Decode a timeline of key events
+
+   Counterpart of cw_rec_process_events(): events and callback have
+   the same meaning. Beginning of a Mark while key is already closed,
+   and end of a Mark while key is open, are ignored.
+
+   @exception EINVAL invalid type of event, negative or decreasing timestamp
+
+   @param[in,out] vit decoder
+   @param[in] events array of events
+   @param[in] n_events count of items in @p events
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS if all events have been processed
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_viterbi_process_events(cw_viterbi_t * vit, const cw_rec_event_t * events, size_t n_events, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == events || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	for (size_t i = 0; i < n_events; i++) {
+		const cw_rec_event_t * event = &events[i];
+
+		if (event->timestamp < 0 || event->timestamp < vit->last_timestamp) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "process events: invalid timestamp of event #%zu: %"PRId64,
+				      i, event->timestamp);
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+
+		switch (event->type) {
+		case CW_REC_EVENT_MARK_BEGIN:
+			cw_viterbi_advance_internal(vit, event->timestamp, callback_func, callback_arg);
+			if (vit->is_mark) {
+				break;
+			}
+			if (vit->has_pending_mark) {
+				/* Short break in a Mark: continue the Mark. */
+				vit->has_pending_mark = false;
+			} else {
+				vit->mark_start = event->timestamp;
+			}
+			vit->is_mark = true;
+			break;
+
+		case CW_REC_EVENT_MARK_END:
+			cw_viterbi_advance_internal(vit, event->timestamp, callback_func, callback_arg);
+			if (!vit->is_mark) {
+				break;
+			}
+			vit->is_mark = false;
+			if ((event->timestamp - vit->mark_start) / 1000 < vit->noise_spike_threshold) {
+				/* Noise spike. Space before it goes on. */
+				break;
+			}
+			vit->has_pending_mark = true;
+			vit->mark_end = event->timestamp;
+			break;
+
+		case CW_REC_EVENT_POLL:
+			cw_viterbi_advance_internal(vit, event->timestamp, callback_func, callback_arg);
+			break;
+
+		default:
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		vit->last_timestamp = event->timestamp;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Update paths with what is known at @p timestamp
+
+   Space after last applied Mark lasts at least until @p timestamp
+   (or until beginning of Mark that is in progress). When it is too
+   long to be inter-mark-space, or anything else than
+   inter-word-space, paths are updated. A pending Mark is applied when
+   Space after it is longer than noise spike threshold.
+
+   @param[in,out] vit decoder
+   @param[in] timestamp current time [ns]
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+static void cw_viterbi_advance_internal(cw_viterbi_t * vit, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	cw_viterbi_advance_space_internal(vit, timestamp, callback_func, callback_arg);
+
+	if (vit->has_pending_mark && (timestamp - vit->mark_end) / 1000 >= vit->noise_spike_threshold) {
+		cw_viterbi_apply_mark_internal(vit, callback_func, callback_arg);
+		/* Space after the Mark. */
+		cw_viterbi_advance_space_internal(vit, timestamp, callback_func, callback_arg);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update paths with Space that lasts at least until @p timestamp
+
+   See cw_viterbi_advance_internal().
+
+   @param[in,out] vit decoder
+   @param[in] timestamp current time [ns]
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+static void cw_viterbi_advance_space_internal(cw_viterbi_t * vit, int64_t timestamp, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (!vit->has_applied_mark) {
+		return;
+	}
+
+	const int64_t space_end = vit->is_mark || vit->has_pending_mark ? vit->mark_start : timestamp;
+	const float space_units = (float) (space_end - vit->applied_mark_end) / 1000.0F / vit->unit_duration;
+
+	if (0 == vit->space_stage && space_units >= CW_VITERBI_END_OF_CHARACTER_UNITS) {
+		cw_viterbi_apply_space_internal(vit, space_end - vit->applied_mark_end, false);
+		vit->space_stage = 1;
+		cw_viterbi_report_internal(vit, callback_func, callback_arg);
+	}
+	if (1 == vit->space_stage && space_units >= CW_VITERBI_END_OF_WORD_UNITS) {
+		cw_viterbi_end_word_internal(vit, callback_func, callback_arg);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Extend paths with pending Mark
+
+   The Space before the Mark is applied first (unless the Mark
+   begins a word).
+
+   @param[in,out] vit decoder
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+static void cw_viterbi_apply_mark_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	if (vit->has_applied_mark) {
+		cw_viterbi_apply_space_internal(vit, vit->mark_start - vit->applied_mark_end, true);
+		cw_viterbi_report_internal(vit, callback_func, callback_arg);
+	}
+
+	const float duration = (float) (vit->mark_end - vit->mark_start) / 1000.0F; /* [us] */
+	const float log_likelihoods[] = {
+		cw_viterbi_log_likelihood_internal(duration, vit->unit_duration, CW_VITERBI_MARK_SIGMA),
+		cw_viterbi_log_likelihood_internal(duration, vit->dash_duration, CW_VITERBI_MARK_SIGMA)
+	};
+	const cw_viterbi_emission_t emissions[] = { CW_VITERBI_EMISSION_DOT, CW_VITERBI_EMISSION_DASH };
+	const int best_emission = cw_viterbi_step_internal(vit, log_likelihoods, emissions, 2);
+
+	/* Track speed with the interpretation of the best path. Ratio
+	   of Dash to Dot is kept in a range that keeps the two
+	   distinguishable. */
+	if (CW_VITERBI_EMISSION_DOT == best_emission) {
+		vit->unit_duration += CW_VITERBI_UNIT_TRACKING_WEIGHT * (duration - vit->unit_duration);
+		const float unit_min = (float) CW_DOT_CALIBRATION / (float) CW_SPEED_MAX;
+		const float unit_max = (float) CW_DOT_CALIBRATION / (float) CW_SPEED_MIN;
+		if (vit->unit_duration < unit_min) {
+			vit->unit_duration = unit_min;
+		} else if (vit->unit_duration > unit_max) {
+			vit->unit_duration = unit_max;
+		}
+	} else {
+		vit->dash_duration += CW_VITERBI_UNIT_TRACKING_WEIGHT * (duration - vit->dash_duration);
+	}
+	if (vit->dash_duration < 2.0F * vit->unit_duration) {
+		vit->dash_duration = 2.0F * vit->unit_duration;
+	} else if (vit->dash_duration > 4.0F * vit->unit_duration) {
+		vit->dash_duration = 4.0F * vit->unit_duration;
+	}
+
+	vit->has_pending_mark = false;
+	vit->has_applied_mark = true;
+	vit->applied_mark_end = vit->mark_end;
+	vit->space_stage = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Extend paths with Space after last applied Mark
+
+   With @p is_final set to false the Space is still going on, but is
+   too long to be inter-mark-space: paths only end their characters.
+
+   @param[in,out] vit decoder
+   @param[in] space_duration duration of Space [ns]
+   @param[in] is_final whether the Space has ended
+*/
+static void cw_viterbi_apply_space_internal(cw_viterbi_t * vit, int64_t space_duration, bool is_final)
+{
+	if (!is_final) {
+		const float log_likelihoods[] = { 0.0F };
+		const cw_viterbi_emission_t emissions[] = { CW_VITERBI_EMISSION_END };
+		cw_viterbi_step_internal(vit, log_likelihoods, emissions, 1);
+		return;
+	}
+
+	const float duration = (float) space_duration / 1000.0F; /* [us] */
+	const float iws_duration = 7.0F * vit->unit_duration;
+	const float log_likelihoods[] = {
+		cw_viterbi_log_likelihood_internal(duration, vit->unit_duration, CW_VITERBI_SPACE_SIGMA),
+		cw_viterbi_log_likelihood_internal(duration, 3.0F * vit->unit_duration, CW_VITERBI_SPACE_SIGMA),
+		/* Pauses between words may be of any length. */
+		duration > iws_duration ? 0.0F : cw_viterbi_log_likelihood_internal(duration, iws_duration, CW_VITERBI_SPACE_SIGMA)
+	};
+	const cw_viterbi_emission_t emissions[] = { CW_VITERBI_EMISSION_IMS, CW_VITERBI_EMISSION_ICS, CW_VITERBI_EMISSION_IWS };
+	cw_viterbi_step_internal(vit, log_likelihoods, emissions, 3);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Extend each path with each of interpretations of Mark or Space, keep the best ones
+
+   An interpretation that isn't possible in a state of path (e.g.
+   inter-mark-space after a character that has already ended) is
+   skipped. Candidates that lead to the same state are merged.
+
+   @param[in,out] vit decoder
+   @param[in] log_likelihoods log-likelihood of each interpretation
+   @param[in] emissions interpretations
+   @param[in] n_emissions count of interpretations
+
+   @return interpretation made by the best path
+*/
+static int cw_viterbi_step_internal(cw_viterbi_t * vit, const float * log_likelihoods, const cw_viterbi_emission_t * emissions, int n_emissions)
+{
+	memset(vit->node_candidate, 0xff, sizeof (vit->node_candidate));
+	int n_candidates = 0;
+
+	for (int p = 0; p < vit->n_paths; p++) {
+		const cw_viterbi_path_t * path = &vit->paths[p];
+		const int node = path->node;
+
+		for (int e = 0; e < n_emissions; e++) {
+			float score = path->score + log_likelihoods[e];
+			int next = node;
+
+			switch (emissions[e]) {
+			case CW_VITERBI_EMISSION_DOT:
+			case CW_VITERBI_EMISSION_DASH:
+				if (CW_VITERBI_NODE_ERROR != node) {
+					next = 2 * node + (CW_VITERBI_EMISSION_DASH == emissions[e] ? 1 : 0);
+					if (next > CW_DATA_MAX_REPRESENTATION_HASH
+					    || (0 == vit->node_character[next] && !vit->node_has_children[next])) {
+						next = CW_VITERBI_NODE_ERROR;
+						score += CW_VITERBI_ERROR_PENALTY;
+					}
+				}
+				break;
+			case CW_VITERBI_EMISSION_IMS:
+				if (CW_VITERBI_NODE_ENDED == node) {
+					continue;
+				}
+				if (CW_VITERBI_NODE_ERROR != node && !vit->node_has_children[node]) {
+					/* No character continues this one. */
+					score += CW_VITERBI_ERROR_PENALTY;
+				}
+				break;
+			case CW_VITERBI_EMISSION_END:
+			case CW_VITERBI_EMISSION_ICS:
+			case CW_VITERBI_EMISSION_IWS:
+				if (CW_VITERBI_NODE_ENDED != node
+				    && (CW_VITERBI_NODE_ERROR == node || 0 == vit->node_character[node])) {
+					score += CW_VITERBI_ERROR_PENALTY;
+				}
+				next = CW_VITERBI_EMISSION_END == emissions[e] ? CW_VITERBI_NODE_ENDED : CW_VITERBI_NODE_ROOT;
+				break;
+			case CW_VITERBI_EMISSIONS_COUNT:
+			default:
+				continue;
+			}
+
+			if (CW_VITERBI_EMISSION_IWS == emissions[e]) {
+				/* Words at the root differ from characters at the
+				   root in pending ' ', so they can't be merged. */
+				next = CW_VITERBI_NODES_COUNT; /* Temporary key, fixed below. */
+			}
+			cw_viterbi_add_candidate_internal(vit, &n_candidates, score, next, p, emissions[e]);
+		}
+	}
+
+	/* Selection of beam_width best candidates, by insertion into
+	   sorted array of indices. */
+	int selected[CW_VITERBI_BEAM_WIDTH_MAX];
+	int n_selected = 0;
+	float best_score = -INFINITY;
+	for (int c = 0; c < n_candidates; c++) {
+		const float score = vit->candidates[c].score;
+		if (score > best_score) {
+			best_score = score;
+		}
+	}
+	for (int c = 0; c < n_candidates; c++) {
+		const float score = vit->candidates[c].score;
+		if (score < best_score + CW_VITERBI_SCORE_MARGIN) {
+			continue;
+		}
+		if (n_selected == vit->beam_width && score <= vit->candidates[selected[n_selected - 1]].score) {
+			continue;
+		}
+		int i = n_selected < vit->beam_width ? n_selected++ : n_selected - 1;
+		while (i > 0 && vit->candidates[selected[i - 1]].score < score) {
+			selected[i] = selected[i - 1];
+			i--;
+		}
+		selected[i] = c;
+	}
+
+	/* New paths, in the other buffer. */
+	cw_viterbi_path_t * new_paths = vit->paths == vit->paths_buffers[0] ? vit->paths_buffers[1] : vit->paths_buffers[0];
+	for (int i = 0; i < n_selected; i++) {
+		const cw_viterbi_candidate_t * candidate = &vit->candidates[selected[i]];
+		cw_viterbi_path_t * path = &new_paths[i];
+		*path = vit->paths[candidate->parent];
+		path->score = candidate->score - best_score;
+
+		switch ((cw_viterbi_emission_t) candidate->emission) {
+		case CW_VITERBI_EMISSION_END:
+		case CW_VITERBI_EMISSION_ICS:
+			cw_viterbi_path_end_character_internal(vit, path, vit->applied_mark_end);
+			break;
+		case CW_VITERBI_EMISSION_IWS:
+			cw_viterbi_path_end_character_internal(vit, path, vit->applied_mark_end);
+			cw_viterbi_path_append_internal(path, vit->applied_mark_end, ' ', path->is_word_error);
+			path->is_word_error = false;
+			break;
+		case CW_VITERBI_EMISSION_DOT:
+		case CW_VITERBI_EMISSION_DASH:
+		case CW_VITERBI_EMISSION_IMS:
+		case CW_VITERBI_EMISSIONS_COUNT:
+		default:
+			break;
+		}
+		path->node = CW_VITERBI_NODES_COUNT == candidate->node ? CW_VITERBI_NODE_ROOT : candidate->node;
+	}
+	vit->paths = new_paths;
+	vit->n_paths = n_selected;
+
+	return vit->candidates[selected[0]].emission;
+}
+
+
+
+
+/**
+   @brief Add candidate for new path, or improve existing candidate with the same state
+
+   @param[in,out] vit decoder
+   @param[in,out] n_candidates count of candidates
+   @param[in] score score of candidate
+   @param[in] node state of candidate; CW_VITERBI_NODES_COUNT: root after end of word
+   @param[in] parent index of extended path
+   @param[in] emission interpretation of Mark or Space
+*/
+static void cw_viterbi_add_candidate_internal(cw_viterbi_t * vit, int * n_candidates, float score, int node, int parent, cw_viterbi_emission_t emission)
+{
+	/* Root after end of word shares slot of node_candidate[] with
+	   ended character: the two never appear in one step. */
+	const int key = CW_VITERBI_NODES_COUNT == node ? CW_VITERBI_NODE_ENDED : node;
+	const int existing = vit->node_candidate[key];
+	if (existing >= 0) {
+		if (vit->candidates[existing].score < score) {
+			vit->candidates[existing] = (cw_viterbi_candidate_t) { score, (uint16_t) node, (uint8_t) parent, (uint8_t) emission };
+		}
+		return;
+	}
+
+	vit->node_candidate[key] = (int16_t) *n_candidates;
+	vit->candidates[(*n_candidates)++] = (cw_viterbi_candidate_t) { score, (uint16_t) node, (uint8_t) parent, (uint8_t) emission };
+
+	return;
+}
+
+
+
+
+/**
+   @brief End character of path
+
+   Unknown character isn't added to pending characters: it only
+   marks current word as erroneous (as in cw_rec_process_events()).
+*/
+static void cw_viterbi_path_end_character_internal(const cw_viterbi_t * vit, cw_viterbi_path_t * path, int64_t timestamp)
+{
+	if (CW_VITERBI_NODE_ENDED == path->node) {
+		return;
+	}
+	const char character = CW_VITERBI_NODE_ERROR == path->node ? 0 : vit->node_character[path->node];
+	if (0 == character) {
+		path->is_word_error = true;
+	} else {
+		cw_viterbi_path_append_internal(path, timestamp, character, false);
+	}
+
+	return;
+}
+
+
+
+
+static void cw_viterbi_path_append_internal(cw_viterbi_path_t * path, int64_t timestamp, char character, bool is_error)
+{
+	/* cw_viterbi_report_internal() leaves room for two more. */
+	path->pending[path->n_pending++] = (cw_rec_output_t) { .timestamp = timestamp, .character = character, .is_error = is_error };
+	return;
+}
+
+
+
+
+/**
+   @brief Report characters that are final
+
+   A character is final when it is the oldest pending character of
+   all paths. When a path has too many pending characters, oldest
+   pending character of the best path is reported, and paths with a
+   different one are dropped.
+
+   @param[in,out] vit decoder
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+static void cw_viterbi_report_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	while (true) {
+		const cw_viterbi_path_t * best = &vit->paths[0];
+
+		bool is_agreed = best->n_pending > 0;
+		bool is_full = false;
+		for (int p = 0; p < vit->n_paths; p++) {
+			const cw_viterbi_path_t * path = &vit->paths[p];
+			is_agreed = is_agreed
+				&& path->n_pending > 0
+				&& path->pending[0].character == best->pending[0].character
+				&& path->pending[0].timestamp == best->pending[0].timestamp;
+			is_full = is_full || path->n_pending > CW_VITERBI_PENDING_MAX - 2;
+		}
+		if (!is_agreed && !is_full) {
+			return;
+		}
+
+		cw_rec_output_t output = { 0 };
+		const bool has_output = best->n_pending > 0;
+		if (has_output) {
+			output = best->pending[0];
+		}
+
+		/* Keep paths that agree with the best one, without the
+		   reported character. */
+		int n_kept = 0;
+		for (int p = 0; p < vit->n_paths; p++) {
+			cw_viterbi_path_t * path = &vit->paths[p];
+			if (has_output) {
+				if (0 == path->n_pending
+				    || path->pending[0].character != output.character
+				    || path->pending[0].timestamp != output.timestamp) {
+					continue;
+				}
+				path->n_pending--;
+				memmove(path->pending, path->pending + 1, path->n_pending * sizeof (path->pending[0]));
+			} else if (path->n_pending > CW_VITERBI_PENDING_MAX - 2) {
+				continue;
+			}
+			if (n_kept != p) {
+				vit->paths[n_kept] = *path;
+			}
+			n_kept++;
+		}
+		vit->n_paths = n_kept;
+
+		if (has_output) {
+			callback_func(callback_arg, output.timestamp, output.character, output.is_error);
+		}
+	}
+}
+
+
+
+
+/**
+   @brief End word on all paths, report characters of the best path
+
+   Space is too long to be anything else than inter-word-space, so all
+   paths meet in root of the tree, and the best one of them is the
+   only one that is left.
+
+   @param[in,out] vit decoder
+   @param[in] callback_func function receiving characters
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+static void cw_viterbi_end_word_internal(cw_viterbi_t * vit, cw_rec_output_callback_t callback_func, void * callback_arg)
+{
+	const float log_likelihoods[] = { 0.0F };
+	const cw_viterbi_emission_t emissions[] = { CW_VITERBI_EMISSION_IWS };
+	cw_viterbi_step_internal(vit, log_likelihoods, emissions, 1);
+
+	cw_viterbi_path_t * path = &vit->paths[0];
+	for (int i = 0; i < path->n_pending; i++) {
+		callback_func(callback_arg, path->pending[i].timestamp, path->pending[i].character, path->pending[i].is_error);
+	}
+	path->n_pending = 0;
+	path->score = 0.0F;
+	vit->n_paths = 1;
+
+	vit->has_applied_mark = false;
+	vit->space_stage = 2;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Log-likelihood of duration of Mark or Space, in log-normal model
+
+   Constant terms are omitted: only differences between
+   log-likelihoods matter.
+
+   @param[in] duration actual duration
+   @param[in] ideal ideal duration (in the same units as @p duration)
+   @param[in] sigma standard deviation of logarithm of ratio of the two
+
+   @return log-likelihood
+*/
+static float cw_viterbi_log_likelihood_internal(float duration, float ideal, float sigma)
+{
+	const float x = logf((duration > 1.0F ? duration : 1.0F) / ideal);
+	return -(x * x) / (2.0F * sigma * sigma);
+}
@@ -0,0 +1,122 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_VITERBI
+#define H_LIBCW_VITERBI
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Count of characters that a path may hold before they are reported.
+   When the oldest pending character of all paths isn't the same after
+   this many characters, the character of the best path is reported
+   and paths that disagree with it are dropped. This bounds latency of
+   decoder to this many characters. */
+enum { CW_VITERBI_PENDING_MAX = 8 };
+
+/* States of path that are not nodes of tree of representations.
+   Nodes of the tree are hashes of representations (see
+   cw_representation_to_hash_internal()): 1 is the root (no Marks
+   yet), children of node N are 2N (Dot) and 2N + 1 (Dash). */
+enum { CW_VITERBI_NODE_ENDED = 0 };  /* Character has ended, type of Space after it is not known yet. */
+enum { CW_VITERBI_NODE_ROOT = 1 };
+enum { CW_VITERBI_NODE_ERROR = 256 }; /* Marks that don't make any known character. */
+enum { CW_VITERBI_NODES_COUNT = 257 };
+
+
+
+
+/* Interpretations of a Mark or of a Space that ended. */
+typedef enum {
+	CW_VITERBI_EMISSION_DOT,
+	CW_VITERBI_EMISSION_DASH,
+	CW_VITERBI_EMISSION_IMS,      /* Inter-mark-space. */
+	CW_VITERBI_EMISSION_ICS,      /* Inter-character-space. */
+	CW_VITERBI_EMISSION_IWS,      /* Inter-word-space. */
+	CW_VITERBI_EMISSION_END,      /* Space that is too long to be inter-mark-space, but may still be any of the other two. */
+	CW_VITERBI_EMISSIONS_COUNT
+} cw_viterbi_emission_t;
+
+
+
+
+/* Path through states of decoder, with characters that have been
+   decoded on the path but not reported yet. */
+typedef struct {
+	float score;     /* Log-likelihood of path, relative to best path. */
+	uint16_t node;
+	bool is_word_error; /* Current word contains unknown character. */
+	uint8_t n_pending;
+	cw_rec_output_t pending[CW_VITERBI_PENDING_MAX];
+} cw_viterbi_path_t;
+
+
+/* Extension of path by one observation, before selection of paths
+   that stay in beam. Kept apart from the paths so that the selection
+   works on a few bytes per candidate. */
+typedef struct {
+	float score;
+	uint16_t node;
+	uint8_t parent;   /* Index of extended path in beam. */
+	uint8_t emission; /* cw_viterbi_emission_t */
+} cw_viterbi_candidate_t;
+
+
+
+
+struct cw_viterbi_struct {
+	int beam_width;
+	int noise_spike_threshold; /* [us] */
+
+	/* Tracked durations of unit (Dot) and of Dash [us]. Dashes of
+	   hand-sent code are often shorter or longer than three units. */
+	float unit_duration;
+	float dash_duration;
+
+	/* Properties of nodes of tree, at index of node: character of
+	   node (zero if none), and whether a known character can be
+	   reached from the node by more Marks. */
+	char node_character[CW_VITERBI_NODES_COUNT];
+	bool node_has_children[CW_VITERBI_NODES_COUNT];
+
+	/* Beam: paths sorted by score, best first. Paths of the other
+	   buffer are built from candidates. */
+	cw_viterbi_path_t paths_buffers[2][CW_VITERBI_BEAM_WIDTH_MAX];
+	cw_viterbi_path_t * paths;
+	int n_paths;
+	cw_viterbi_candidate_t candidates[3 * CW_VITERBI_BEAM_WIDTH_MAX];
+	int16_t node_candidate[CW_VITERBI_NODES_COUNT]; /* Index of candidate with given node, or -1. */
+
+	/* Timeline of key. A Mark is applied to paths only after Space
+	   after it is longer than noise spike threshold, so that short
+	   breaks in a Mark don't split it. */
+	bool is_mark;            /* Key is closed. */
+	bool has_pending_mark;   /* Mark that has ended but hasn't been applied to paths. */
+	bool has_applied_mark;   /* A Mark has been applied since start of word. */
+	int64_t mark_start;      /* [ns] */
+	int64_t mark_end;        /* [ns] */
+	int64_t applied_mark_end; /* End of last applied Mark [ns]. */
+	int64_t last_timestamp;   /* Timestamp of last processed event [ns]. */
+
+	/* 0: Space after last applied Mark may be inter-mark-space, 1:
+	   character has ended, 2: word has ended. */
+	int space_stage;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_VITERBI */
@@ -0,0 +1,312 @@
+#!/bin/awk -f
+#
+# Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+# Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+#
+# AWK script to produce constant lookup tables for main table of
+# characters (CW_TABLE) and for alphabets (CW_TABLE_<NAME>) in
+# libcw_data.c. Reads libcw_data.c, writes C code to be included in
+# libcw_data.c after definitions of the tables.
+#
+# The tables are indexed with code of character, and with hash of
+# representation (see cw_representation_to_hash_internal()). The
+# script fails if the hash is not collision-free for the contents of
+# CW_TABLE.
+#
+# Tables of alphabets are indexed with hash of representation, and
+# with code point modulo size of table. The script looks for the
+# smallest size of table for which the latter is collision-free. In
+# alphabets the first of characters with the same representation is
+# the one that is received.
+#
+
+# Maximal length of representation that can be hashed, see
+# CW_DATA_MAX_REPRESENTATION_LENGTH.
+function max_length() {
+  return 7
+}
+
+
+# Largest table of code points of alphabet that the script is willing
+# to generate.
+function max_slots() {
+  return 1024
+}
+
+
+function fail(message) {
+  printf ("libdata.awk: %s\n", message) > "/dev/stderr"
+  failed = 1
+  exit 1
+}
+
+
+# Convert C character literal (without quotes) to code of character.
+function char_code(literal,    i, n, c) {
+  if (literal ~ /^\\[0-7]+$/)
+    {
+      n = 0
+      for (i = 2; i <= length (literal); i++)
+        n = n * 8 + substr (literal, i, 1)
+      return n
+    }
+  if (literal ~ /^\\.$/)
+    literal = substr (literal, 2, 1)
+  if (!(literal in ord))
+    fail("unsupported character literal '" literal "'")
+  return ord[literal]
+}
+
+
+# Convert hexadecimal number (without "0x") to number.
+function hex(digits,    i, n) {
+  n = 0
+  for (i = 1; i <= length (digits); i++)
+    n = n * 16 + index ("0123456789abcdef", tolower (substr (digits, i, 1))) - 1
+  return n
+}
+
+
+# Inverse of hash().
+function unhash(h,    r) {
+  r = ""
+  while (h > 1)
+    {
+      r = (h % 2 ? "-" : ".") r
+      h = int (h / 2)
+    }
+  return r
+}
+
+
+# Smallest size of table for which code points of alphabet @a don't
+# collide.
+function alphabet_slots(a,    n, i, used, ok) {
+  for (n = alphabet_count[a]; n <= max_slots(); n++)
+    {
+      split ("", used)
+      ok = 1
+      for (i = 0; i < alphabet_count[a]; i++)
+        {
+          if ((alphabet_code[a, i] % n) in used)
+            {
+              ok = 0
+              break
+            }
+          used[alphabet_code[a, i] % n] = 1
+        }
+      if (ok)
+        return n
+    }
+  fail("no collision-free table of code points for alphabet " alphabet_name[a])
+}
+
+
+# Same algorithm as in cw_representation_to_hash_internal().
+function hash(representation,    i, h, c) {
+  if (length (representation) < 1 || length (representation) > max_length())
+    return 0
+  h = 1
+  for (i = 1; i <= length (representation); i++)
+    {
+      c = substr (representation, i, 1)
+      h = h * 2
+      if (c == "-")
+        h = h + 1
+      else if (c != ".")
+        return 0
+    }
+  return h
+}
+
+
+BEGIN {
+  for (i = 32; i < 127; i++)
+    ord[sprintf ("%c", i)] = i
+  in_table = 0
+  count = 0
+  longest = 0
+
+  in_alphabet = 0
+  n_alphabets = 0
+}
+
+
+/^const cw_entry_t CW_TABLE\[\] = / {
+  in_table = 1
+  next
+}
+
+
+in_table && /\{0, NULL\}/ {
+  in_table = 0
+  next
+}
+
+
+/^static const cw_alphabet_entry_t CW_TABLE_[A-Z_]+\[\] = / {
+  name = $4
+  sub (/^CW_TABLE_/, "", name)
+  sub (/\[\]$/, "", name)
+  alphabet_name[n_alphabets] = tolower (name)
+  alphabet_count[n_alphabets] = 0
+  in_alphabet = 1
+  next
+}
+
+
+in_alphabet && /\{0, NULL\}/ {
+  in_alphabet = 0
+  n_alphabets++
+  next
+}
+
+
+in_alphabet {
+  line = $0
+  sub (/\/\*.*$/, "", line)
+  while (match (line, /\{0x[0-9A-Fa-f]+, *"[^"]*" *\}/))
+    {
+      entry = substr (line, RSTART, RLENGTH)
+      line = substr (line, RSTART + RLENGTH)
+
+      literal = entry
+      sub (/^\{0x/, "", literal)
+      sub (/,.*$/, "", literal)
+
+      representation = entry
+      sub (/^[^"]*"/, "", representation)
+      sub (/".*$/, "", representation)
+
+      code = hex(literal)
+      h = hash(representation)
+      if (code < 128 || code > 65535)
+        fail("code point 0x" literal " is out of range of alphabet")
+      if (h == 0)
+        fail("invalid representation \"" representation "\"")
+      key = n_alphabets SUBSEP code
+      if (key in alphabet_by_code)
+        fail("duplicate code point 0x" literal)
+
+      i = alphabet_count[n_alphabets]++
+      alphabet_code[n_alphabets, i] = code
+      alphabet_hash[n_alphabets, i] = h
+      alphabet_representation[n_alphabets, i] = representation
+      alphabet_by_code[key] = i
+      if (!((n_alphabets, h) in alphabet_by_hash))
+        alphabet_by_hash[n_alphabets, h] = i
+    }
+}
+
+
+in_table {
+  line = $0
+  sub (/\/\*.*$/, "", line)
+  while (match (line, /\{'(\\[0-7]+|\\.|[^'\\])', *"[^"]*" *\}/))
+    {
+      entry = substr (line, RSTART, RLENGTH)
+      line = substr (line, RSTART + RLENGTH)
+
+      literal = entry
+      sub (/^\{'/, "", literal)
+      sub (/', *".*$/, "", literal)
+
+      representation = substr (entry, length (literal) + 4)
+      sub (/^, *"/, "", representation)
+      sub (/".*$/, "", representation)
+
+      code = char_code(literal)
+      h = hash(representation)
+      if (h == 0)
+        fail("invalid representation \"" representation "\"")
+      if (code in by_char)
+        fail("duplicate character '" literal "'")
+      if (h in by_hash)
+        fail("duplicate representation \"" representation "\"")
+
+      by_char[code] = count
+      by_hash[h] = count
+      char_literal[count] = literal
+      char_representation[count] = representation
+      if (length (representation) > longest)
+        longest = length (representation)
+      count++
+    }
+}
+
+
+END {
+  if (failed)
+    exit 1
+  if (count == 0)
+    fail("no entries of CW_TABLE found")
+
+  printf ("/* Generated by libdata.awk from CW_TABLE in libcw_data.c. Do not edit. */\n\n\n\n\n")
+
+  printf ("/* Count of characters in main table. */\n")
+  printf ("#define CW_DATA_MAIN_TABLE_CHARACTERS_COUNT %d\n\n", count)
+  printf ("/* Length of the longest representation in main table. */\n")
+  printf ("#define CW_DATA_MAIN_TABLE_MAXIMUM_REPRESENTATION_LENGTH %d\n\n\n\n\n", longest)
+
+  printf ("/* Lookup table: character -> entry of main table. */\n")
+  printf ("static const cw_entry_t * const g_main_table_fast_lookup[UCHAR_MAX + 1] = {\n")
+  for (code = 0; code < 256; code++)
+    if (code in by_char)
+      printf ("\t[0x%02x] = &CW_TABLE[%d], /* '%s' */\n", code, by_char[code], char_literal[by_char[code]])
+  printf ("};\n\n\n\n\n")
+
+  printf ("/* Lookup table: hash of representation -> entry of main table. */\n")
+  printf ("static const cw_entry_t * const g_representation_lookup[CW_DATA_MAX_REPRESENTATION_HASH + 1] = {\n")
+  for (h = 0; h < 256; h++)
+    if (h in by_hash)
+      printf ("\t[0x%02x] = &CW_TABLE[%d], /* \"%s\" */\n", h, by_hash[h], char_representation[by_hash[h]])
+  printf ("};\n\n\n\n\n")
+
+  printf ("/* Lookup table: hash of representation -> representation. */\n")
+  printf ("static const char * const g_hash_representations[CW_DATA_MAX_REPRESENTATION_HASH + 1] = {\n")
+  for (h = 2; h < 256; h++)
+    printf ("\t[0x%02x] = \"%s\",\n", h, unhash(h))
+  printf ("};\n")
+
+  for (a = 0; a < n_alphabets; a++)
+    {
+      name = alphabet_name[a]
+      slots = alphabet_slots(a)
+
+      printf ("\n\n\n\n")
+      printf ("/* Lookup table: hash of representation -> code point of alphabet '%s'. */\n", name)
+      printf ("static const uint16_t g_%s_hash_to_code_point[CW_DATA_MAX_REPRESENTATION_HASH + 1] = {\n", name)
+      for (h = 0; h < 256; h++)
+        if ((a, h) in alphabet_by_hash)
+          printf ("\t[0x%02x] = 0x%04x, /* \"%s\" */\n", h, alphabet_code[a, alphabet_by_hash[a, h]], unhash(h))
+      printf ("};\n\n")
+
+      printf ("/* Lookup table: code point %% %d -> code point of alphabet '%s' and hash of its representation. */\n", slots, name)
+      printf ("static const cw_alphabet_slot_t g_%s_slots[%d] = {\n", name, slots)
+      for (i = 0; i < alphabet_count[a]; i++)
+        printf ("\t[%d] = { 0x%04x, 0x%02x }, /* \"%s\" */\n", alphabet_code[a, i] % slots, alphabet_code[a, i], alphabet_hash[a, i], alphabet_representation[a, i])
+      printf ("};\n\n")
+
+      printf ("static const cw_alphabet_tables_t g_%s_tables = {\n", name)
+      printf ("\t.hash_to_code_point = g_%s_hash_to_code_point,\n", name)
+      printf ("\t.slots = g_%s_slots,\n", name)
+      printf ("\t.n_slots = %d,\n", slots)
+      printf ("\t.characters_count = %d,\n", alphabet_count[a])
+      printf ("};\n")
+    }
+}
@@ -0,0 +1,629 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file libcw_bench.c
+
+   Microbenchmarks of hot paths of libcw: synthesis of samples, tone
+   queue, receiver and lookups of representations.
+
+   Each benchmark is calibrated, warmed up, and then executed in a
+   number of timed repetitions. Results (units per second: median,
+   minimum and maximum over repetitions) are printed as CSV or JSON,
+   so that they can be compared between releases.
+
+   The program is not a part of "make check". Run it with "make bench".
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "libcw_rec.h"
+#include "libcw_rec_internal.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+/* Size of generator's buffer used by synthesis benchmarks [samples]. */
+#define BENCH_BUFFER_N_SAMPLES   1024
+
+/* Count of tones in tone queue in one iteration of tone queue benchmark. */
+#define BENCH_TQ_N_TONES         100
+
+#define BENCH_REPETITIONS_DEFAULT   7
+#define BENCH_DURATION_DEFAULT    200 /* Duration of one repetition [ms]. */
+
+
+
+
+typedef enum {
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON
+} bench_format_t;
+
+
+
+
+typedef struct bench_t bench_t;
+struct bench_t {
+	const char * name;
+	const char * unit;
+
+	/* Prepare the benchmark. */
+	bool (* setup)(bench_t * bench);
+
+	/* Run @p n_iterations iterations. Return count of processed
+	   units (samples, operations, lookups). */
+	int64_t (* run)(bench_t * bench, int64_t n_iterations);
+
+	void (* teardown)(bench_t * bench);
+
+	/* Benchmark-specific parameter and state. */
+	int param;
+	cw_gen_t * gen;
+	cw_tone_queue_t * tq;
+	cw_rec_t * rec;
+};
+
+
+
+
+typedef struct {
+	double median;
+	double min;
+	double max;
+} bench_result_t;
+
+
+
+
+/* Consumer of results of benchmarked calls, to keep compiler from
+   optimizing the calls away. */
+static volatile int64_t bench_sink;
+
+
+
+
+static int64_t bench_now_ns(void);
+static int bench_compare_doubles(const void * a, const void * b);
+static bool bench_execute(bench_t * bench, int repetitions, int duration_ms, bench_result_t * result);
+static void bench_print_usage(const char * program_name);
+
+static bool bench_gen_setup(bench_t * bench);
+static int64_t bench_gen_sine_wave_run(bench_t * bench, int64_t n_iterations);
+static void bench_gen_teardown(bench_t * bench);
+
+static bool bench_tq_setup(bench_t * bench);
+static int64_t bench_tq_run(bench_t * bench, int64_t n_iterations);
+static void bench_tq_teardown(bench_t * bench);
+
+static bool bench_rec_setup(bench_t * bench);
+static int64_t bench_rec_identify_mark_run(bench_t * bench, int64_t n_iterations);
+static int64_t bench_rec_poll_character_run(bench_t * bench, int64_t n_iterations);
+static void bench_rec_teardown(bench_t * bench);
+
+static int64_t bench_representation_to_character_run(bench_t * bench, int64_t n_iterations);
+static int64_t bench_character_to_representation_run(bench_t * bench, int64_t n_iterations);
+
+
+
+
+static bench_t benches[] = {
+	{ "gen_sine_wave_linear",         "samples", bench_gen_setup, bench_gen_sine_wave_run, bench_gen_teardown, CW_TONE_SLOPE_SHAPE_LINEAR,        NULL, NULL, NULL },
+	{ "gen_sine_wave_raised_cosine",  "samples", bench_gen_setup, bench_gen_sine_wave_run, bench_gen_teardown, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, NULL, NULL, NULL },
+	{ "gen_sine_wave_sine",           "samples", bench_gen_setup, bench_gen_sine_wave_run, bench_gen_teardown, CW_TONE_SLOPE_SHAPE_SINE,          NULL, NULL, NULL },
+	{ "gen_sine_wave_rectangular",    "samples", bench_gen_setup, bench_gen_sine_wave_run, bench_gen_teardown, CW_TONE_SLOPE_SHAPE_RECTANGULAR,   NULL, NULL, NULL },
+	{ "tq_enqueue_dequeue",           "tones",   bench_tq_setup,  bench_tq_run,            bench_tq_teardown,  false,                             NULL, NULL, NULL },
+	{ "tq_enqueue_dequeue_spsc",      "tones",   bench_tq_setup,  bench_tq_run,            bench_tq_teardown,  true,                              NULL, NULL, NULL },
+	{ "rec_identify_mark",            "marks",   bench_rec_setup, bench_rec_identify_mark_run, bench_rec_teardown, 0,                             NULL, NULL, NULL },
+	{ "rec_poll_character",           "characters", bench_rec_setup, bench_rec_poll_character_run, bench_rec_teardown, 0,                       NULL, NULL, NULL },
+	{ "data_representation_to_character", "lookups", NULL,        bench_representation_to_character_run, NULL, 0,                            NULL, NULL, NULL },
+	{ "data_character_to_representation", "lookups", NULL,        bench_character_to_representation_run, NULL, 0,                            NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL, 0, NULL, NULL, NULL }
+};
+
+
+
+
+/* Characters and their representations, for lookups and for
+   receiver's benchmarks. */
+static char bench_characters[128];
+static const char * bench_representations[128];
+static int bench_n_characters;
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	bench_format_t format = BENCH_FORMAT_CSV;
+	int repetitions = BENCH_REPETITIONS_DEFAULT;
+	int duration_ms = BENCH_DURATION_DEFAULT;
+	const char * name_filter = NULL;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "f:r:d:n:h"))) {
+		switch (opt) {
+		case 'f':
+			if (0 == strcmp(optarg, "csv")) {
+				format = BENCH_FORMAT_CSV;
+			} else if (0 == strcmp(optarg, "json")) {
+				format = BENCH_FORMAT_JSON;
+			} else {
+				fprintf(stderr, "%s: unknown output format '%s'\n", argv[0], optarg);
+				bench_print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			repetitions = atoi(optarg);
+			break;
+		case 'd':
+			duration_ms = atoi(optarg);
+			break;
+		case 'n':
+			name_filter = optarg;
+			break;
+		case 'h':
+			bench_print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			bench_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || duration_ms < 1) {
+		fprintf(stderr, "%s: repetitions and duration must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char list[128] = { 0 };
+	cw_list_characters(list);
+	for (const char * c = list; *c && bench_n_characters < (int) sizeof (bench_characters); c++) {
+		bench_characters[bench_n_characters] = *c;
+		bench_representations[bench_n_characters] = cw_character_to_representation_internal(*c);
+		bench_n_characters++;
+	}
+
+	if (BENCH_FORMAT_CSV == format) {
+		printf("benchmark,unit,repetitions,median_per_sec,min_per_sec,max_per_sec\n");
+	} else {
+		printf("{\n  \"version\": \"%s\",\n  \"benchmarks\": [", PACKAGE_VERSION);
+	}
+
+	bool failure = false;
+	bool is_first = true;
+	for (bench_t * bench = benches; bench->name; bench++) {
+		if (name_filter && !strstr(bench->name, name_filter)) {
+			continue;
+		}
+
+		bench_result_t result = { 0 };
+		if (!bench_execute(bench, repetitions, duration_ms, &result)) {
+			fprintf(stderr, "%s: benchmark '%s' failed\n", argv[0], bench->name);
+			failure = true;
+			continue;
+		}
+
+		if (BENCH_FORMAT_CSV == format) {
+			printf("%s,%s,%d,%.0f,%.0f,%.0f\n", bench->name, bench->unit, repetitions, result.median, result.min, result.max);
+		} else {
+			printf("%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"repetitions\": %d, \"median_per_sec\": %.0f, \"min_per_sec\": %.0f, \"max_per_sec\": %.0f }",
+			       is_first ? "" : ",", bench->name, bench->unit, repetitions, result.median, result.min, result.max);
+		}
+		fflush(stdout);
+		is_first = false;
+	}
+
+	if (BENCH_FORMAT_JSON == format) {
+		printf("\n  ]\n}\n");
+	}
+
+	return failure ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Print usage of the program
+
+   @param[in] program_name name of the program
+*/
+static void bench_print_usage(const char * program_name)
+{
+	fprintf(stderr, "Usage: %s [-f csv|json] [-r REPETITIONS] [-d MSECS] [-n NAME]\n", program_name);
+	fprintf(stderr, "  -f  output format (default: csv)\n");
+	fprintf(stderr, "  -r  count of timed repetitions of each benchmark (default: %d)\n", BENCH_REPETITIONS_DEFAULT);
+	fprintf(stderr, "  -d  duration of one repetition [ms] (default: %d)\n", BENCH_DURATION_DEFAULT);
+	fprintf(stderr, "  -n  run only benchmarks with NAME in their names\n");
+}
+
+
+
+
+/**
+   @brief Calibrate, warm up and time one benchmark
+
+   Count of iterations is chosen so that one repetition takes
+   approximately @p duration_ms. The calibration doubles as a warm-up.
+
+   @param[in,out] bench benchmark to execute
+   @param[in] repetitions count of timed repetitions
+   @param[in] duration_ms duration of one repetition [ms]
+   @param[out] result speed of benchmarked code [units/s]
+
+   @return true on success
+   @return false if benchmark couldn't be set up
+*/
+static bool bench_execute(bench_t * bench, int repetitions, int duration_ms, bench_result_t * result)
+{
+	if (bench->setup && !bench->setup(bench)) {
+		return false;
+	}
+
+	const int64_t duration_ns = (int64_t) duration_ms * 1000000;
+
+	/* Calibration and warm-up: find count of iterations taking at
+	   least a tenth of requested duration. */
+	int64_t n_iterations = 1;
+	int64_t elapsed = 0;
+	for (;;) {
+		const int64_t start = bench_now_ns();
+		bench->run(bench, n_iterations);
+		elapsed = bench_now_ns() - start;
+		if (elapsed >= duration_ns / 10 || n_iterations > (INT64_MAX / 4)) {
+			break;
+		}
+		n_iterations *= 2;
+	}
+	if (elapsed > 0) {
+		const double scale = (double) duration_ns / (double) elapsed;
+		n_iterations = (int64_t) ((double) n_iterations * scale);
+		if (n_iterations < 1) {
+			n_iterations = 1;
+		}
+	}
+
+	double * speeds = (double *) calloc((size_t) repetitions, sizeof (double));
+	if (NULL == speeds) {
+		if (bench->teardown) {
+			bench->teardown(bench);
+		}
+		return false;
+	}
+	for (int r = 0; r < repetitions; r++) {
+		const int64_t start = bench_now_ns();
+		const int64_t n_units = bench->run(bench, n_iterations);
+		const int64_t rep_elapsed = bench_now_ns() - start;
+		speeds[r] = (double) n_units * 1e9 / (double) (rep_elapsed > 0 ? rep_elapsed : 1);
+	}
+
+	qsort(speeds, (size_t) repetitions, sizeof (double), bench_compare_doubles);
+	result->min = speeds[0];
+	result->max = speeds[repetitions - 1];
+	result->median = repetitions % 2
+		? speeds[repetitions / 2]
+		: (speeds[repetitions / 2 - 1] + speeds[repetitions / 2]) / 2.0;
+	free(speeds);
+
+	if (bench->teardown) {
+		bench->teardown(bench);
+	}
+
+	return true;
+}
+
+
+
+
+static int bench_compare_doubles(const void * a, const void * b)
+{
+	const double x = *(const double *) a;
+	const double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+
+
+
+static int64_t bench_now_ns(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Prepare generator for synthesis of samples
+
+   Generator with Null sound system doesn't have its own buffer, so
+   give it one. PCM cache is disabled: every sample is calculated.
+*/
+static bool bench_gen_setup(bench_t * bench)
+{
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	bench->gen = cw_gen_new(&gen_conf);
+	if (NULL == bench->gen) {
+		return false;
+	}
+	cw_gen_t * gen = bench->gen;
+
+	free(gen->buffer);
+	gen->buffer = calloc(BENCH_BUFFER_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == gen->buffer) {
+		cw_gen_delete(&bench->gen);
+		return false;
+	}
+	gen->buffer_n_samples = BENCH_BUFFER_N_SAMPLES;
+	if (0 == gen->sample_rate) {
+		gen->sample_rate = 48000;
+	}
+
+	cw_gen_set_pcm_cache_internal(gen, false);
+	const int slope_duration = CW_TONE_SLOPE_SHAPE_RECTANGULAR == bench->param ? 0 : CW_AUDIO_SLOPE_DURATION;
+	cw_gen_set_tone_slope(gen, bench->param, slope_duration);
+	cw_gen_sync_parameters_internal(gen);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Synthesize samples of 60 ms tones (a Dot at 20 WPM) with slopes
+
+   One iteration calculates all samples of one tone, in fragments of
+   size of generator's buffer.
+*/
+static int64_t bench_gen_sine_wave_run(bench_t * bench, int64_t n_iterations)
+{
+	cw_gen_t * gen = bench->gen;
+	int64_t n_samples = 0;
+
+	for (int64_t i = 0; i < n_iterations; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, 60000, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_gen_tone_calculate_samples_size_internal(gen, &tone);
+
+		while (tone.sample_iterator < tone.n_samples) {
+			cw_sample_iter_t n = tone.n_samples - tone.sample_iterator;
+			if (n > gen->buffer_n_samples) {
+				n = gen->buffer_n_samples;
+			}
+			gen->buffer_sub_start = 0;
+			gen->buffer_sub_stop = (int) n - 1;
+			n_samples += cw_gen_calculate_sine_wave_internal(gen, &tone);
+		}
+		bench_sink += gen->buffer[0];
+	}
+
+	return n_samples;
+}
+
+
+
+
+static void bench_gen_teardown(bench_t * bench)
+{
+	cw_gen_delete(&bench->gen);
+}
+
+
+
+
+static bool bench_tq_setup(bench_t * bench)
+{
+	bench->tq = cw_tq_new_internal();
+	if (NULL == bench->tq) {
+		return false;
+	}
+	if (bench->param) {
+		cw_tq_set_spsc_mode_internal(bench->tq, true);
+	}
+	return true;
+}
+
+
+
+
+/**
+   @brief Fill tone queue with tones and empty it
+
+   One iteration enqueues and dequeues BENCH_TQ_N_TONES tones. Every
+   second tone is silent, so tones are not coalesced.
+*/
+static int64_t bench_tq_run(bench_t * bench, int64_t n_iterations)
+{
+	cw_tone_queue_t * tq = bench->tq;
+	int64_t n_tones = 0;
+
+	for (int64_t i = 0; i < n_iterations; i++) {
+		for (int t = 0; t < BENCH_TQ_N_TONES; t++) {
+			cw_tone_t tone;
+			CW_TONE_INIT(&tone, t % 2 ? 0 : 800, 60000 + t, CW_SLOPE_MODE_STANDARD_SLOPES);
+			cw_tq_enqueue_internal(tq, &tone);
+		}
+		cw_tone_t tone;
+		while (CW_TQ_EMPTY != cw_tq_dequeue_internal(tq, &tone)) {
+			bench_sink += tone.duration;
+			n_tones++;
+		}
+	}
+
+	/* Empty queue is also dequeued once per iteration; count only
+	   tones, which is a pair of operations (enqueue and dequeue). */
+	return n_tones;
+}
+
+
+
+
+static void bench_tq_teardown(bench_t * bench)
+{
+	cw_tq_delete_internal(&bench->tq);
+}
+
+
+
+
+static bool bench_rec_setup(bench_t * bench)
+{
+	bench->rec = cw_rec_new();
+	if (NULL == bench->rec) {
+		return false;
+	}
+	cw_rec_disable_adaptive_mode(bench->rec);
+	cw_rec_set_speed(bench->rec, 20);
+	return true;
+}
+
+
+
+
+/**
+   @brief Identify Marks of durations around Dot and Dash at 20 WPM
+
+   One iteration identifies one Mark.
+*/
+static int64_t bench_rec_identify_mark_run(bench_t * bench, int64_t n_iterations)
+{
+	static const int durations[] = { 60000, 180000, 55000, 190000, 66000, 170000, 1000, 500000 };
+	const int n_durations = (int) (sizeof (durations) / sizeof (durations[0]));
+
+	for (int64_t i = 0; i < n_iterations; i++) {
+		char mark = 0;
+		cw_rec_identify_mark_internal(bench->rec, durations[i % n_durations], &mark);
+		bench_sink += mark;
+	}
+
+	return n_iterations;
+}
+
+
+
+
+static void bench_timeval_add(struct timeval * tv, int usecs)
+{
+	tv->tv_usec += usecs;
+	while (tv->tv_usec >= CW_USECS_PER_SEC) {
+		tv->tv_usec -= CW_USECS_PER_SEC;
+		tv->tv_sec++;
+	}
+}
+
+
+
+
+/**
+   @brief Key characters into receiver and poll them
+
+   One iteration passes Marks of one character (at 20 WPM, with
+   synthetic timestamps) to receiver, polls the character after
+   inter-character-space, and resets receiver's state.
+*/
+static int64_t bench_rec_poll_character_run(bench_t * bench, int64_t n_iterations)
+{
+	cw_rec_t * rec = bench->rec;
+	const int dot = 60000; /* [us] */
+	struct timeval tv = { .tv_sec = 1000, .tv_usec = 0 };
+	int64_t n_characters = 0;
+
+	for (int64_t i = 0; i < n_iterations; i++) {
+		const char * representation = bench_representations[i % bench_n_characters];
+		for (const char * mark = representation; *mark; mark++) {
+			cw_rec_mark_begin(rec, &tv);
+			bench_timeval_add(&tv, CW_DOT_REPRESENTATION == *mark ? dot : 3 * dot);
+			cw_rec_mark_end(rec, &tv);
+			bench_timeval_add(&tv, dot);
+		}
+		bench_timeval_add(&tv, 2 * dot);
+
+		char c = 0;
+		if (CW_SUCCESS == cw_rec_poll_character(rec, &tv, &c, NULL, NULL)) {
+			n_characters++;
+		}
+		bench_sink += c;
+		cw_rec_reset_state(rec);
+	}
+
+	return n_characters;
+}
+
+
+
+
+static void bench_rec_teardown(bench_t * bench)
+{
+	cw_rec_delete(&bench->rec);
+}
+
+
+
+
+static int64_t bench_representation_to_character_run(__attribute__((unused)) bench_t * bench, int64_t n_iterations)
+{
+	for (int64_t i = 0; i < n_iterations; i++) {
+		bench_sink += cw_representation_to_character_internal(bench_representations[i % bench_n_characters]);
+	}
+	return n_iterations;
+}
+
+
+
+
+static int64_t bench_character_to_representation_run(__attribute__((unused)) bench_t * bench, int64_t n_iterations)
+{
+	for (int64_t i = 0; i < n_iterations; i++) {
+		bench_sink += (intptr_t) cw_character_to_representation_internal(bench_characters[i % bench_n_characters]);
+	}
+	return n_iterations;
+}
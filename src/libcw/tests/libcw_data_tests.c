@@ -236,6 +236,48 @@ int test_cw_representation_to_character_internal(cw_test_executor_t * cte)
 
 
 
+/**
+   Verify that lookup of character by hash of representation (used by
+   receiver, which calculates the hash mark by mark) gives the same
+   results as lookup by representation.
+*/
+int test_cw_representation_hash_to_character_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	bool failure = false;
+
+	for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
+		const unsigned int hash = cw_representation_to_hash_internal(cw_entry->representation);
+		const int character = LIBCW_TEST_FUT(cw_representation_hash_to_character_internal)(hash);
+		if (!cte->expect_op_int_errors_only(cte, character, "==", cw_entry->character, "lookup by hash: '%s'", cw_entry->representation)) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "lookup of valid hashes");
+
+
+	/* Hashes that can't represent any character. */
+	const unsigned int invalid_hashes[] = { 0, 1, CW_DATA_MAX_REPRESENTATION_HASH + 1, UINT_MAX };
+	failure = false;
+	for (size_t i = 0; i < sizeof (invalid_hashes) / sizeof (invalid_hashes[0]); i++) {
+		const int character = LIBCW_TEST_FUT(cw_representation_hash_to_character_internal)(invalid_hashes[i]);
+		if (!cte->expect_op_int_errors_only(cte, character, "==", 0, "lookup by invalid hash %u", invalid_hashes[i])) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "lookup of invalid hashes");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
 /**
    Testing speed gain between function using direct method, and
    function with fast lookup table.  Test is preformed by using timer
@@ -1004,3 +1046,190 @@ int test_validate_representation_internal(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+/**
+   Lookups of characters of alphabets, in both directions, and use of
+   alphabets by generator and receiver.
+*/
+int test_alphabet_lookups_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Test: lookup tables give the same results as direct search of
+	   tables, and each character found by representation is sent with
+	   the same representation. */
+	for (cw_alphabet_t alphabet = CW_ALPHABET_ITU; alphabet < CW_ALPHABET_COUNT; alphabet++) {
+		bool failure = false;
+		for (unsigned int hash = CW_DATA_MIN_REPRESENTATION_HASH; hash <= CW_DATA_MAX_REPRESENTATION_HASH; hash++) {
+			char representation[CW_DATA_MAX_REPRESENTATION_LENGTH + 1] = { 0 };
+			int len = 0;
+			for (unsigned int h = hash; h > 1; h >>= 1U) {
+				len++;
+			}
+			for (int i = len - 1, h = (int) hash; i >= 0; i--, h >>= 1) {
+				representation[i] = (h & 1) ? CW_DASH_REPRESENTATION : CW_DOT_REPRESENTATION;
+			}
+
+			const uint32_t code_point = LIBCW_TEST_FUT(cw_alphabet_representation_to_code_point)(alphabet, representation);
+			const uint32_t expected = cw_alphabet_representation_to_code_point_direct_internal(alphabet, representation);
+			if (!cte->expect_op_int_errors_only(cte, (int) expected, "==", (int) code_point, "alphabet %d: lookup of '%s'", alphabet, representation)) {
+				failure = true;
+				break;
+			}
+			if (0 == code_point) {
+				continue;
+			}
+			const char * looked_up = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, code_point);
+			if (!cte->expect_op_int_errors_only(cte, 0, "==", NULL == looked_up ? -1 : strcmp(looked_up, representation), "alphabet %d: lookup of 0x%04x", alphabet, code_point)) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "alphabet %d: lookups of all hashes", alphabet);
+	}
+
+
+	/* Test: specific characters, lowercase letters, characters sent
+	   with representation of other character, and ASCII characters
+	   of main table. */
+	{
+		struct {
+			cw_alphabet_t alphabet;
+			uint32_t code_point;
+			const char * representation; /* NULL for invalid character. */
+		} data[] = {
+			{ CW_ALPHABET_CYRILLIC,       0x044F, ".-.-"    },  /* я */
+			{ CW_ALPHABET_CYRILLIC,       0x0451, "."       },  /* ё */
+			{ CW_ALPHABET_CYRILLIC,       '5',    "....."   },
+			{ CW_ALPHABET_CYRILLIC,       0x03A9, NULL      },  /* Ω */
+			{ CW_ALPHABET_GREEK,          0x03C2, "..."     },  /* ς */
+			{ CW_ALPHABET_GREEK,          0x03C9, ".--"     },  /* ω */
+			{ CW_ALPHABET_GREEK,          'q',    "--.-"    },
+			{ CW_ALPHABET_WABUN,          0x30A2, "--.--"   },  /* ア */
+			{ CW_ALPHABET_WABUN,          0x3001, ".-.-.-"  },  /* 、 */
+			{ CW_ALPHABET_WABUN,          0x3042, NULL      },  /* Hiragana あ */
+			{ CW_ALPHABET_LATIN_EXTENDED, 0x0142, ".-..-"   },  /* ł */
+			{ CW_ALPHABET_LATIN_EXTENDED, 0x017C, "--..-"   },  /* ż */
+			{ CW_ALPHABET_LATIN_EXTENDED, 0x00E5, ".--.-"   },  /* å */
+			{ CW_ALPHABET_LATIN_EXTENDED, 0x015B, "...-..." },  /* ś */
+			{ CW_ALPHABET_LATIN_EXTENDED, 0x00F7, NULL      },  /* Division sign. */
+			{ CW_ALPHABET_ITU,            'a',    ".-"      },
+			{ CW_ALPHABET_ITU,            0x00C4, NULL      },  /* Ä is in main table only as ISO 8859-1 byte. */
+		};
+		bool failure = false;
+		for (size_t i = 0; i < sizeof (data) / sizeof (data[0]); i++) {
+			const char * representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(data[i].alphabet, data[i].code_point);
+			const bool is_correct = NULL == data[i].representation
+				? NULL == representation && ENOENT == errno
+				: NULL != representation && 0 == strcmp(representation, data[i].representation);
+			if (!cte->expect_op_int_errors_only(cte, true, "==", is_correct, "lookup of 0x%04x", data[i].code_point)) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "lookups of specific characters");
+
+		cte->expect_op_int(cte, 33, "==", cw_alphabet_get_character_count(CW_ALPHABET_CYRILLIC), "count of characters");
+		cte->expect_null_pointer(cte, cw_alphabet_code_point_to_representation(CW_ALPHABET_COUNT, 'A'), "invalid alphabet");
+	}
+
+
+	/* Test: decoding of UTF-8. */
+	{
+		struct {
+			const char * string;
+			int length;
+			uint32_t code_point;
+		} data[] = {
+			{ "A",                      1, 'A'      },
+			{ "\xd0\xaf",               2, 0x042F   },
+			{ "\xe3\x82\xa2",           3, 0x30A2   },
+			{ "\xf0\x9f\x93\xbb",       4, 0x1F4FB  },
+			{ "\xc1\x81",               0, 0        },  /* Overlong. */
+			{ "\xed\xa0\x80",           0, 0        },  /* Surrogate. */
+			{ "\xd0",                   0, 0        },  /* Truncated. */
+			{ "\x80",                   0, 0        },  /* Continuation byte. */
+		};
+		bool failure = false;
+		for (size_t i = 0; i < sizeof (data) / sizeof (data[0]); i++) {
+			uint32_t code_point = 0;
+			const int length = LIBCW_TEST_FUT(cw_utf8_decode_internal)(data[i].string, &code_point);
+			if (!cte->expect_op_int_errors_only(cte, data[i].length, "==", length, "decoding of string %zu", i)
+			    || (0 != length && !cte->expect_op_int_errors_only(cte, (int) data[i].code_point, "==", (int) code_point, "code point of string %zu", i))) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "decoding of UTF-8");
+	}
+
+
+	/* Test: generator accepts text in its alphabet only. */
+	{
+		const char * text = "\xd0\xaf \xd1\x91 5"; /* "Я ё 5" */
+		cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator");
+
+		errno = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, text);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueue in ITU alphabet");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "enqueue in ITU alphabet: errno");
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "enqueue in ITU alphabet: queue length");
+
+		cwret = LIBCW_TEST_FUT(cw_gen_set_alphabet)(gen, CW_ALPHABET_CYRILLIC);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set alphabet");
+		cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, text);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue in Cyrillic alphabet");
+		cte->expect_op_int(cte, 0, "<", (int) cw_gen_get_queue_length(gen), "enqueue in Cyrillic alphabet: queue length");
+
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, "\xd0");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "enqueue of invalid UTF-8");
+		cwret = LIBCW_TEST_FUT(cw_gen_set_alphabet)(gen, CW_ALPHABET_COUNT);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set invalid alphabet");
+
+		cw_gen_delete(&gen);
+	}
+
+
+	/* Test: receiver returns characters of its alphabet. */
+	{
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cw_rec_set_speed(rec, 12);
+		LIBCW_TEST_FUT(cw_rec_set_alphabet)(rec, CW_ALPHABET_GREEK);
+
+		const uint32_t code_points[] = { 0x03A9, 0x03A8, '5' }; /* "ΩΨ5" */
+		const int64_t unit = 100 * 1000 * 1000; /* 12 WPM. [ns] */
+		int64_t timestamp = 0;
+		bool failure = false;
+		for (size_t i = 0; i < sizeof (code_points) / sizeof (code_points[0]); i++) {
+			const char * representation = cw_alphabet_code_point_to_representation(CW_ALPHABET_GREEK, code_points[i]);
+			for (int m = 0; representation[m]; m++) {
+				timestamp += (representation[m] == CW_DOT_REPRESENTATION ? 1 : 3) * unit;
+				cw_rec_add_mark_ns(rec, timestamp, representation[m]);
+				timestamp += unit;
+			}
+			timestamp += 2 * unit;
+
+			uint32_t code_point = 0;
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_poll_code_point_ns)(rec, timestamp, &code_point, NULL, NULL);
+			cw_rec_reset_state(rec);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "poll of character %zu", i)
+			    || !cte->expect_op_int_errors_only(cte, (int) code_points[i], "==", (int) code_point, "code point of character %zu", i)) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "receiving in Greek alphabet");
+
+		cw_rec_delete(&rec);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
@@ -16,6 +16,7 @@
 
 int test_cw_representation_to_hash_internal(cw_test_executor_t * cte);
 int test_cw_representation_to_character_internal(cw_test_executor_t * cte);
+int test_cw_representation_hash_to_character_internal(cw_test_executor_t * cte);
 int test_cw_representation_to_character_internal_speed_gain(cw_test_executor_t * cte);
 
 cwt_retv test_data_main_table_get_count(cw_test_executor_t * cte);
@@ -28,6 +29,7 @@ int test_phonetic_lookups_internal(cw_test_executor_t * cte);
 int test_validate_character_internal(cw_test_executor_t * cte);
 int test_validate_string_internal(cw_test_executor_t * cte);
 int test_validate_representation_internal(cw_test_executor_t * cte);
+int test_alphabet_lookups_internal(cw_test_executor_t * cte);
 
 
 
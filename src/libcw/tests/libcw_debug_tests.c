@@ -26,6 +26,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <inttypes.h> /* "PRIu32" */
+#include <pthread.h>
+#include <string.h>
 
 
 
@@ -39,6 +41,7 @@
 #include "libcw_debug.h"
 #include "libcw_debug_tests.h"
 #include "libcw_key.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
 
@@ -92,3 +95,106 @@ int test_cw_debug_flags_internal(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+static void * test_cw_trace_thread_internal(__attribute__((unused)) void * arg)
+{
+	cw_trace_user_event(3);
+	cw_trace_user_event(3);
+	return NULL;
+}
+
+
+
+
+/* Count occurrences of @p needle in file at @p path. */
+static int test_cw_trace_count_internal(const char * path, const char * needle)
+{
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		return -1;
+	}
+	char buffer[64 * 1024] = { 0 };
+	const size_t n = fread(buffer, 1, sizeof (buffer) - 1, file);
+	fclose(file);
+	buffer[n] = '\0';
+
+	int count = 0;
+	for (const char * cursor = strstr(buffer, needle); NULL != cursor; cursor = strstr(cursor + 1, needle)) {
+		count++;
+	}
+	return count;
+}
+
+
+
+
+/**
+   @brief Test recording of trace events and their export to Chrome's trace event format
+*/
+int test_cw_trace_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[] = "/tmp/libcw_trace_XXXXXX";
+	const int fd = mkstemp(path);
+	cte->assert2(cte, -1 != fd, "failed to create temporary file");
+	close(fd);
+
+	/* Disabled tracing records nothing. */
+	LIBCW_TEST_FUT(cw_trace_disable)();
+	cw_trace_clear();
+	cte->expect_op_int(cte, false, "==", cw_trace_is_enabled(), "tracing is disabled");
+	cw_trace_user_event(1);
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_trace_export_chrome_json)(path);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "export of empty trace");
+	cte->expect_op_int(cte, 0, "==", test_cw_trace_count_internal(path, "\"user event 1\""), "events recorded with disabled tracing");
+
+	/* Events of two threads and of generator. */
+	LIBCW_TEST_FUT(cw_trace_enable)();
+	cte->expect_op_int(cte, true, "==", cw_trace_is_enabled(), "tracing is enabled");
+	cw_trace_user_event(2);
+	cw_trace_user_event(2);
+	cw_trace_user_event(2);
+	pthread_t thread;
+	pthread_create(&thread, NULL, test_cw_trace_thread_internal, NULL);
+	pthread_join(thread, NULL);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	cw_gen_set_speed(gen, CW_SPEED_MAX);
+	cw_gen_start(gen);
+	cw_gen_enqueue_character(gen, 'e');
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	LIBCW_TEST_FUT(cw_trace_disable)();
+
+	cwret = LIBCW_TEST_FUT(cw_trace_export_chrome_json)(path);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "export of trace");
+	cte->expect_op_int(cte, 3, "==", test_cw_trace_count_internal(path, "\"user event 2\""), "events of main thread");
+	cte->expect_op_int(cte, 2, "==", test_cw_trace_count_internal(path, "\"user event 3\""), "events of second thread");
+	cte->expect_op_int(cte, 0, "<", test_cw_trace_count_internal(path, "\"enqueue\""), "enqueue events");
+	cte->expect_op_int(cte, 0, "<", test_cw_trace_count_internal(path, "\"dequeue\""), "dequeue events");
+	cte->expect_op_int(cte, 3, "<=", test_cw_trace_count_internal(path, "\"thread_name\""), "threads in trace");
+	cte->expect_op_int(cte, 1, "==", test_cw_trace_count_internal(path, "\"traceEvents\""), "format of trace");
+
+	/* Cleared trace doesn't contain old events. */
+	LIBCW_TEST_FUT(cw_trace_clear)();
+	cw_trace_export_chrome_json(path);
+	cte->expect_op_int(cte, 0, "==", test_cw_trace_count_internal(path, "\"user event 2\""), "events after clearing");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_trace_export_chrome_json)(NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "export with NULL path");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after export with NULL path");
+
+	unlink(path);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
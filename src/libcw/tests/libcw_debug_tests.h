@@ -15,6 +15,7 @@
 
 
 int test_cw_debug_flags_internal(cw_test_executor_t * cte);
+int test_cw_trace_internal(cw_test_executor_t * cte);
 
 
 
@@ -20,10 +20,21 @@
 
 
 
+#include <math.h>
+#include <sched.h> /* SCHED_FIFO */
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <limits.h> /* UCHAR_MAX */
 #include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <unistd.h>
 
 
@@ -36,8 +47,15 @@
 
 
 #include "libcw_gen.h"
+#include "libcw_gen_internal.h"
 #include "libcw_gen_tests.h"
+#include "libcw_keying.h"
+#include "libcw_mixer.h"
+#include "libcw_rtp.h"
+#include "libcw_shmq.h"
+#include "libcw_tap.h"
 #include "libcw_debug.h"
+#include "libcw_rec.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
 
@@ -55,6 +73,11 @@ static cwt_retv gen_setup(cw_test_executor_t * cte, cw_gen_t ** gen);
 static void gen_destroy(cw_gen_t ** gen);
 static cwt_retv test_cw_gen_new_start_stop_delete_sub(cw_test_executor_t * cte, const char * function_name, bool do_new, bool do_start, bool do_stop, bool do_delete);
 static cwt_retv test_cw_gen_forever_sub(cw_test_executor_t * cte, int seconds);
+static void gen_render_tone(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out);
+static int gen_read_stereo_peaks(int fd, off_t offset, int peaks[2]);
+static int gen_text_source(void * arg);
+static void gen_dispatch_value_callback(void * arg, int value);
+static void gen_dispatch_low_water_callback(void * arg);
 
 
 
@@ -530,6 +553,70 @@ cwt_retv test_cw_gen_set_tone_slope(cw_test_executor_t * cte)
 
 
 
+/**
+   @brief Test sharing of tables of slope amplitudes between generators
+*/
+cwt_retv test_cw_gen_slope_table(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen1 = cw_gen_new(&cte->current_gen_conf);
+	cw_gen_t * gen2 = cw_gen_new(&cte->current_gen_conf);
+	cte->assert2(cte, gen1 && gen2, "failed to create generators");
+
+	/* Generators with the same slope parameters use the same table. */
+	const cw_gen_slope_table_t * table = gen1->tone_slope.table;
+	cte->assert2(cte, NULL != table, "generator has no slope table");
+	cte->expect_op_int(cte, true, "==", table == gen2->tone_slope.table, "generators share slope table");
+	const int n_users = table->n_users;
+	cte->expect_op_int(cte, 2, "<=", n_users, "count of users of shared table");
+
+	bool in_range = true;
+	for (int i = 0; i < table->n_amplitudes; i++) {
+		const float amplitude = (float) table->amplitudes[i] / (float) CW_GEN_AMPLITUDE_ONE;
+		if (amplitude < 0.0F || amplitude > 1.0F) {
+			in_range = false;
+		}
+	}
+	cte->expect_op_int(cte, true, "==", in_range, "amplitudes in table are in range 0.0-1.0");
+
+	/* Volume is applied as a separate gain: change of volume doesn't
+	   replace or modify the table. */
+	const size_t size = sizeof (cw_gen_amplitude_t) * (size_t) table->n_amplitudes;
+	cw_gen_amplitude_t * amplitudes = malloc(size);
+	cte->assert2(cte, amplitudes, "failed to allocate copy of amplitudes");
+	memcpy(amplitudes, table->amplitudes, size);
+	cw_gen_set_volume(gen1, 30);
+	cte->expect_op_int(cte, true, "==", table == gen1->tone_slope.table, "volume change: table is preserved");
+	cte->expect_op_int(cte, 0, "==", memcmp(amplitudes, table->amplitudes, size), "volume change: amplitudes are preserved");
+	free(amplitudes);
+
+	/* Different shape - different table. */
+	cw_gen_set_tone_slope(gen2, CW_TONE_SLOPE_SHAPE_LINEAR, -1);
+	cte->expect_op_int(cte, true, "==", table != gen2->tone_slope.table, "shape change: generator uses another table");
+	cte->expect_op_int(cte, n_users - 1, "==", table->n_users, "shape change: old table has one user less");
+	cte->expect_op_int(cte, true, "==", gen2->tone_slope.table->amplitudes == gen2->tone_slope.amplitudes, "shape change: amplitudes are taken from new table");
+
+	/* Back to the same shape - back to the shared table. */
+	cw_gen_set_tone_slope(gen2, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, -1);
+	cte->expect_op_int(cte, true, "==", table == gen2->tone_slope.table, "shape restored: generators share slope table again");
+
+	/* Rectangular slopes need no table. */
+	cw_gen_set_tone_slope(gen2, CW_TONE_SLOPE_SHAPE_RECTANGULAR, 0);
+	cte->expect_op_int(cte, true, "==", NULL == gen2->tone_slope.table, "rectangular slope: no table");
+	cte->expect_op_int(cte, 0, "==", gen2->tone_slope.n_amplitudes, "rectangular slope: no amplitudes");
+
+	cw_gen_delete(&gen2);
+	cw_gen_delete(&gen1);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
 /**
    @brief Test some assertions about CW_TONE_SLOPE_SHAPE_*
 
@@ -560,27 +647,107 @@ cwt_retv test_cw_gen_tone_slope_shape_enums(cw_test_executor_t * cte)
 
 
 /**
-   It's not a test of a "forever" function, but of "forever"
-   functionality.
+   @brief Compare samples calculated by the two oscillator engines
 
-   Pay attention to CPU usage during execution of this function. I have been
-   experiencing 100% CPU usage on one of cores with ALSA sound system when HW
-   configuration of the ALSA sound system was incorrect.
+   Samples calculated by CW_GEN_OSCILLATOR_SINF must be bit-for-bit
+   identical to samples calculated directly with sinf(). Samples calculated
+   by default CW_GEN_OSCILLATOR_TABLE engine must be very close to them,
+   and must not depend on how the calculation is split into fragments.
 
-   @reviewed on 2020-10-15
+   In fixed-point build values of sinf() are converted to Q15 and
+   multiplied by volume with integer arithmetic.
 */
-cwt_retv test_cw_gen_forever_internal(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_oscillators(cw_test_executor_t * cte)
 {
-	const int loops = cte->get_loops_count(cte);
-	const int seconds = 7;
+	cte->print_test_header(cte, __func__);
 
-	cte->print_test_header(cte, "%s (%d loops, %d seconds)", __func__, loops, seconds);
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		return cwt_retv_err;
+	}
 
-	for (int i = 0; i < loops; i++) {
-		const cwt_retv rv = test_cw_gen_forever_sub(cte, seconds);
-		cte->expect_op_int(cte, cwt_retv_ok, "==", rv, "'forever' test");
+	cte->expect_op_int(cte, CW_GEN_OSCILLATOR_TABLE, "==", gen->oscillator, "default oscillator");
+
+	/* Null and console sound systems don't have their own buffer. Use
+	   our own buffer, the generator will free it on delete. */
+	const int n_samples = 1024;
+	free(gen->buffer);
+	gen->buffer = calloc(n_samples, sizeof (cw_sample_t));
+	gen->buffer_n_samples = n_samples;
+	if (0 == gen->sample_rate) {
+		gen->sample_rate = 48000;
+	}
+	cw_sample_t * reference = calloc(n_samples, sizeof (cw_sample_t));
+	cw_sample_t * whole = calloc(n_samples, sizeof (cw_sample_t));
+	cte->assert2(cte, gen->buffer && reference && whole, "failed to allocate buffers");
+
+	const int frequencies[] = { 0, 100, 800, 1234, CW_FREQUENCY_MAX, -1 };
+	for (int f = 0; frequencies[f] != -1; f++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, frequencies[f], 1000000, CW_SLOPE_MODE_NO_SLOPES);
+		tone.n_samples = n_samples;
+
+		/* Reference engine. */
+		cw_gen_set_oscillator_internal(gen, CW_GEN_OSCILLATOR_SINF);
+		gen->phase_offset = 0.0F;
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = n_samples - 1;
+		tone.sample_iterator = 0;
+		int n = LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+		cte->expect_op_int_errors_only(cte, n_samples, "==", n, "sinf: %d Hz: count of samples", frequencies[f]);
+
+		int mismatches = 0;
+		for (int i = 0; i < n_samples; i++) {
+			const float phase = 2.0F * 3.14159265358979323846F * (float) (frequencies[f] * i) / (float) gen->sample_rate;
+#ifdef LIBCW_FIXED_POINT
+			const cw_sample_t expected = (cw_sample_t) ((gen->volume_abs * (int32_t) lrintf(sinf(phase) * 32767.0F)) >> 15);
+#else
+			const cw_sample_t expected = ((float) gen->volume_abs) * sinf(phase);
+#endif
+			if (expected != gen->buffer[i]) {
+				mismatches++;
+			}
+			reference[i] = gen->buffer[i];
+		}
+		cte->expect_op_int(cte, 0, "==", mismatches, "sinf: %d Hz: bit-for-bit comparison", frequencies[f]);
+
+		/* Default engine, whole buffer in one call. */
+		cw_gen_set_oscillator_internal(gen, CW_GEN_OSCILLATOR_TABLE);
+		gen->phase_accumulator = 0;
+		tone.sample_iterator = 0;
+		n = LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+		cte->expect_op_int_errors_only(cte, n_samples, "==", n, "table: %d Hz: count of samples", frequencies[f]);
+
+		int max_diff = 0;
+		for (int i = 0; i < n_samples; i++) {
+			const int diff = abs(gen->buffer[i] - reference[i]);
+			if (diff > max_diff) {
+				max_diff = diff;
+			}
+			whole[i] = gen->buffer[i];
+		}
+		cte->expect_between_int(cte, 0, max_diff, 2, "table: %d Hz: difference from sinf", frequencies[f]);
+
+		/* Default engine, buffer split into fragments of different sizes. */
+		gen->phase_accumulator = 0;
+		tone.sample_iterator = 0;
+		memset(gen->buffer, 0, n_samples * sizeof (cw_sample_t));
+		const int split_points[] = { 0, 1, 100, 513, 777, n_samples };
+		for (int s = 0; split_points[s] != n_samples; s++) {
+			gen->buffer_sub_start = split_points[s];
+			gen->buffer_sub_stop = split_points[s + 1] - 1;
+			LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+		}
+		cte->expect_op_int(cte, 0, "==", memcmp(whole, gen->buffer, n_samples * sizeof (cw_sample_t)), "table: %d Hz: fragments", frequencies[f]);
 	}
 
+	const cw_ret_t cwret = cw_gen_set_oscillator_internal(gen, (cw_gen_oscillator_t) 100);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "invalid oscillator");
+
+	free(reference);
+	free(whole);
+	gen_destroy(&gen);
+
 	cte->print_test_footer(cte, __func__);
 
 	return cwt_retv_ok;
@@ -590,60 +757,96 @@ cwt_retv test_cw_gen_forever_internal(cw_test_executor_t * cte)
 
 
 /**
-   @reviewed on 2020-05-10
+   @brief Compare block-based envelope with per-sample reference
+
+   Samples calculated by cw_gen_calculate_sine_wave_internal() (which
+   applies envelope of a tone to whole blocks of samples) must be
+   identical to samples calculated with per-sample
+   cw_gen_calculate_sample_amplitude_internal().
+
+   In fixed-point build the amplitude multiplies Q15 value of sinf().
 */
-static cwt_retv test_cw_gen_forever_sub(cw_test_executor_t * cte, __attribute__((unused)) int seconds)
+cwt_retv test_cw_gen_envelope(cw_test_executor_t * cte)
 {
-	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
-	if (NULL == gen) {
-		cte->log_error(cte, "failed to create generator\n");
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
 		return cwt_retv_err;
 	}
 
-	cw_gen_start(gen);
-
-	//sleep(1);
-
-	const int slope_duration = 10000; /* [us] duration of slope that should be 'pleasing' to ear. */
-	const int freq = cte->config->frequency;
-
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, freq, slope_duration, CW_SLOPE_MODE_RISING_SLOPE);
-	const cw_ret_t cwret1 = cw_tq_enqueue_internal(gen->tq, &tone);
-	cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret1, "enqueue first tone"); /* Use "errors only" here because this is not a core part of test. */
+	/* Long enough to span several synthesis blocks. */
+	const int n_samples = 1500;
+	free(gen->buffer);
+	gen->buffer = calloc(n_samples, sizeof (cw_sample_t));
+	gen->buffer_n_samples = n_samples;
+	if (0 == gen->sample_rate) {
+		gen->sample_rate = 48000;
+	}
+	cte->assert2(cte, gen->buffer, "failed to allocate buffer");
 
-	CW_TONE_INIT(&tone, freq, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
-	tone.is_forever = true;
-	tone.debug_id = 'f';
-	const cw_ret_t cwret2 = cw_tq_enqueue_internal(gen->tq, &tone);
-	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret2, "enqueue forever tone");
+	cw_gen_set_oscillator_internal(gen, CW_GEN_OSCILLATOR_SINF);
 
-#ifdef __FreeBSD__  /* Tested on FreeBSD 10. */
-	/* Separate path for FreeBSD because for some reason signals
-	   badly interfere with value returned through second arg to
-	   nanolseep().  Try to run the section in #else under FreeBSD
-	   to see what happens - value returned by nanosleep() through
-	   "rem" will be increasing.  TODO: see if the problem still
-	   persists after moving from signals to conditional
-	   variables. */
-	fprintf(stderr, "enter any character to end \"forever\" tone\n");
-	char c;
-	scanf("%c", &c);
+	bool failure = false;
+	const int shapes[] = { CW_TONE_SLOPE_SHAPE_LINEAR, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, CW_TONE_SLOPE_SHAPE_SINE, CW_TONE_SLOPE_SHAPE_RECTANGULAR };
+	const cw_tone_slope_mode_t modes[] = { CW_SLOPE_MODE_STANDARD_SLOPES, CW_SLOPE_MODE_NO_SLOPES, CW_SLOPE_MODE_RISING_SLOPE, CW_SLOPE_MODE_FALLING_SLOPE };
+	/* Second duration gives a tone shorter than its two slopes. */
+	const int durations[] = { 30000, 7000 };
+	const int first_samples[] = { 0, 17, 239, 240, 300 };
+
+	for (size_t sh = 0; sh < sizeof (shapes) / sizeof (shapes[0]); sh++) {
+		const int slope_duration = shapes[sh] == CW_TONE_SLOPE_SHAPE_RECTANGULAR ? 0 : CW_AUDIO_SLOPE_DURATION;
+		cw_gen_set_tone_slope(gen, shapes[sh], slope_duration);
+
+		for (size_t m = 0; m < sizeof (modes) / sizeof (modes[0]); m++) {
+			for (size_t d = 0; d < sizeof (durations) / sizeof (durations[0]); d++) {
+				for (size_t f = 0; f < sizeof (first_samples) / sizeof (first_samples[0]); f++) {
+
+					cw_tone_t tone;
+					CW_TONE_INIT(&tone, 800, durations[d], modes[m]);
+					/* Plain "n_samples = duration * rate" calculation with slopes of
+					   length given by generator's slope duration. */
+					tone.n_samples = ((int64_t) gen->sample_rate * durations[d]) / 1000000;
+					const int slope_n_samples = gen->tone_slope.n_amplitudes;
+					tone.rising_slope_n_samples = (modes[m] == CW_SLOPE_MODE_STANDARD_SLOPES || modes[m] == CW_SLOPE_MODE_RISING_SLOPE) ? slope_n_samples : 0;
+					tone.falling_slope_n_samples = (modes[m] == CW_SLOPE_MODE_STANDARD_SLOPES || modes[m] == CW_SLOPE_MODE_FALLING_SLOPE) ? slope_n_samples : 0;
+					tone.sample_iterator = first_samples[f];
+
+					gen->phase_offset = 0.0F;
+					gen->buffer_sub_start = 0;
+					gen->buffer_sub_stop = (int) (tone.n_samples - first_samples[f]) - 1;
+					LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+
+					cw_tone_t reference_tone = tone;
+					reference_tone.sample_iterator = first_samples[f];
+					int mismatches = 0;
+					for (int i = 0; i <= gen->buffer_sub_stop; i++) {
+						const float phase = 2.0F * 3.14159265358979323846F * (float) (reference_tone.frequency * i) / (float) gen->sample_rate;
+						const int amplitude = cw_gen_calculate_sample_amplitude_internal(gen, &reference_tone);
+#ifdef LIBCW_FIXED_POINT
+						const cw_sample_t expected = (cw_sample_t) ((amplitude * (int32_t) lrintf(sinf(phase) * 32767.0F)) >> 15);
 #else
-	cw_usleep_internal(seconds * CW_USECS_PER_SEC);
+						const cw_sample_t expected = ((float) amplitude) * sinf(phase);
 #endif
+						if (expected != gen->buffer[i]) {
+							mismatches++;
+						}
+						reference_tone.sample_iterator++;
+					}
+					if (!cte->expect_op_int_errors_only(cte, 0, "==", mismatches,
+									    "shape %d, mode %d, duration %d, first sample %d",
+									    shapes[sh], modes[m], durations[d], first_samples[f])) {
+						failure = true;
+					}
+				}
+			}
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "block-based envelope matches per-sample envelope");
 
-	/* Silence the generator. */
-	CW_TONE_INIT(&tone, freq, slope_duration, CW_SLOPE_MODE_FALLING_SLOPE);
-	tone.debug_id = 'e';
-	const cw_ret_t cwret3 = cw_tq_enqueue_internal(gen->tq, &tone);
-	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret3, "silence the generator");
-
-	cw_gen_wait_for_queue_level(gen, 0);
-	cw_gen_wait_for_end_of_current_tone(gen);
+	gen_destroy(&gen);
 
-	cw_gen_stop(gen);
-	cw_gen_delete(&gen);
+	cte->print_test_footer(cte, __func__);
 
 	return cwt_retv_ok;
 }
@@ -652,189 +855,283 @@ static cwt_retv test_cw_gen_forever_sub(cw_test_executor_t * cte, __attribute__(
 
 
 /**
-   @reviewed on 2020-05-07
+   @brief Test calculation of samples of silent tones
+
+   Silent tone only clears its samples and advances sample iterator,
+   phase of both oscillators is left unchanged.
 */
-cwt_retv test_cw_gen_get_timing_parameters_internal(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_silence(cw_test_executor_t * cte)
 {
 	cte->print_test_header(cte, __func__);
 
-	int initial = -5;
-
-	int dot_duration = initial;
-	int dash_duration = initial;
-	int ims_duration = initial;
-	int ics_duration = initial;
-	int iws_duration = initial;
-	int additional_space_duration = initial;
-	int adjustment_space_duration = initial;
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		return cwt_retv_err;
+	}
 
-	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
-	cw_gen_start(gen);
+	const int n_samples = 700;
+	free(gen->buffer);
+	gen->buffer = calloc(n_samples, sizeof (cw_sample_t));
+	gen->buffer_n_samples = n_samples;
+	if (0 == gen->sample_rate) {
+		gen->sample_rate = 48000;
+	}
+	cte->assert2(cte, gen->buffer, "failed to allocate buffer");
+
+	const cw_gen_oscillator_t oscillators[] = { CW_GEN_OSCILLATOR_TABLE, CW_GEN_OSCILLATOR_SINF };
+	for (size_t o = 0; o < sizeof (oscillators) / sizeof (oscillators[0]); o++) {
+		cw_gen_set_oscillator_internal(gen, oscillators[o]);
+		gen->phase_accumulator = 0x12345678;
+		gen->phase_offset = 1.0F;
+		memset(gen->buffer, 0x55, n_samples * sizeof (cw_sample_t));
+
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 0, 1000000, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone.n_samples = n_samples * 2;
+		tone.rising_slope_n_samples = gen->tone_slope.n_amplitudes;
+		tone.falling_slope_n_samples = gen->tone_slope.n_amplitudes;
+		tone.sample_iterator = 10;
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = n_samples - 1;
+		const int n = LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+
+		int n_non_silent = 0;
+		for (int i = 0; i < n_samples; i++) {
+			n_non_silent += 0 != gen->buffer[i];
+		}
+		cte->expect_op_int(cte, n_samples, "==", n, "oscillator %d: count of samples", oscillators[o]);
+		cte->expect_op_int(cte, 0, "==", n_non_silent, "oscillator %d: samples are cleared", oscillators[o]);
+		cte->expect_op_int(cte, 10 + n_samples, "==", (int) tone.sample_iterator, "oscillator %d: sample iterator", oscillators[o]);
+		if (CW_GEN_OSCILLATOR_TABLE == oscillators[o]) {
+			cte->expect_op_int(cte, true, "==", 0x12345678 == gen->phase_accumulator, "oscillator %d: phase is unchanged", oscillators[o]);
+		} else {
+			/* Exact comparison, without -Wfloat-equal. */
+			const bool unchanged = !(gen->phase_offset < 1.0F || gen->phase_offset > 1.0F);
+			cte->expect_op_int(cte, true, "==", unchanged, "oscillator %d: phase is unchanged", oscillators[o]);
+		}
+	}
 
+	gen_destroy(&gen);
 
-	cw_gen_reset_parameters_internal(gen);
-	/* Reset requires resynchronization. */
-	cw_gen_sync_parameters_internal(gen);
+	cte->print_test_footer(cte, __func__);
 
+	return cwt_retv_ok;
+}
 
-	LIBCW_TEST_FUT(cw_gen_get_timing_parameters_internal)(gen,
-							      &dot_duration,
-							      &dash_duration,
-							      &ims_duration,
-							      &ics_duration,
-							      &iws_duration,
-							      &additional_space_duration,
-							      &adjustment_space_duration);
 
-	bool failure = (dot_duration == initial)
-		|| (dash_duration == initial)
-		|| (ims_duration == initial)
-		|| (ics_duration == initial)
-		|| (iws_duration == initial)
-		|| (additional_space_duration == initial)
-		|| (adjustment_space_duration == initial);
-	cte->expect_op_int(cte, false, "==", failure, "get timing parameters");
 
-	cw_gen_delete(&gen);
 
-	cte->print_test_footer(cte, __func__);
+/**
+   @brief Calculate all samples of @p tone, in fragments of size of generator's buffer
 
-	return cwt_retv_ok;
+   Test helper function.
+*/
+static void gen_render_tone(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * out)
+{
+	tone->sample_iterator = 0;
+	cw_sample_iter_t done = 0;
+	while (done < tone->n_samples) {
+		int n = gen->buffer_n_samples;
+		if (n > tone->n_samples - done) {
+			n = (int) (tone->n_samples - done);
+		}
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = n - 1;
+		LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, tone);
+		memcpy(out + done, gen->buffer, n * sizeof (cw_sample_t));
+		done += n;
+	}
 }
 
 
 
 
 /**
-   @brief Test setting and getting of some basic parameters
+   @brief Test cache of pre-rendered tones
 
-   @reviewed on 2020-05-07
+   Samples of a tone taken from cache must be identical to samples
+   rendered without the cache, and the cache must be invalidated when
+   parameters of generator change.
 */
-cwt_retv test_cw_gen_parameter_getters_setters(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_pcm_cache(cw_test_executor_t * cte)
 {
 	cte->print_test_header(cte, __func__);
 
-	/* No parameter will have value that is larger (for "max"
-	   params) or smaller (for "min" params) than this, so this is
-	   a good initial value. */
-	int off_limits = 10000;
-
-	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
-	/* It shouldn't matter for functions tested here if generator is started or not. */
-	cw_gen_start(gen);
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		return cwt_retv_err;
+	}
 
-	struct {
-		/* There are tree functions that take part in the
-		   test: first gets range of acceptable values,
-		   seconds sets a new value of parameter, and third
-		   reads back the value. */
+	cte->expect_op_int(cte, true, "==", gen->pcm_cache.enabled, "cache is enabled by default");
 
-		void (* get_limits)(int * min, int * max);
-		cw_ret_t (* set_new_value)(cw_gen_t * gen, int new_value);
-		int (* get_value)(cw_gen_t const * gen);
+	const int buffer_n_samples = 512;
+	free(gen->buffer);
+	gen->buffer = calloc(buffer_n_samples, sizeof (cw_sample_t));
+	gen->buffer_n_samples = buffer_n_samples;
+	if (0 == gen->sample_rate) {
+		gen->sample_rate = 48000;
+	}
 
-		const int expected_min;     /* Expected value of minimum. */
-		const int expected_max;     /* Expected value of maximum. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 800, 60000, CW_SLOPE_MODE_STANDARD_SLOPES);
+	tone.n_samples = ((int64_t) gen->sample_rate * tone.duration) / 1000000;
+	tone.rising_slope_n_samples = gen->tone_slope.n_amplitudes;
+	tone.falling_slope_n_samples = gen->tone_slope.n_amplitudes;
+
+	cw_sample_t * first = calloc(tone.n_samples, sizeof (cw_sample_t));
+	cw_sample_t * second = calloc(tone.n_samples, sizeof (cw_sample_t));
+	cw_sample_t * uncached = calloc(tone.n_samples, sizeof (cw_sample_t));
+	cte->assert2(cte, gen->buffer && first && second && uncached, "failed to allocate buffers");
+	const size_t size = tone.n_samples * sizeof (cw_sample_t);
+
+	/* Put generator's oscillator in some random phase, the cached
+	   tone should not depend on it. */
+	gen->phase_accumulator = 0x12345678;
+	gen_render_tone(gen, &tone, first);
+	cte->expect_op_int(cte, 1, "==", (int) gen->pcm_cache.n_misses, "first tone: cache miss");
+
+	gen->phase_accumulator = 0x87654321;
+	gen_render_tone(gen, &tone, second);
+	cte->expect_op_int(cte, 1, "==", (int) gen->pcm_cache.n_misses, "second tone: no new cache misses");
+	cte->expect_op_int(cte, 0, "<", (int) gen->pcm_cache.n_hits, "second tone: cache hits");
+	cte->expect_op_int(cte, 0, "==", memcmp(first, second, size), "second tone: same samples");
+
+	cw_gen_set_pcm_cache_internal(gen, false);
+	gen->phase_accumulator = 0;
+	gen_render_tone(gen, &tone, uncached);
+	cte->expect_op_int(cte, 0, "==", memcmp(first, uncached, size), "uncached tone: same samples");
+	cw_gen_set_pcm_cache_internal(gen, true);
+
+	/* Change of volume results in change of slopes, so the cache
+	   must be invalidated. */
+	cw_gen_set_volume(gen, gen->volume_percent / 2);
+	gen_render_tone(gen, &tone, second);
+	cte->expect_op_int(cte, 2, "==", (int) gen->pcm_cache.n_misses, "after change of volume: cache miss");
+	cte->expect_op_int(cte, 0, "!=", memcmp(first, second, size), "after change of volume: different samples");
+
+	/* Change of speed doesn't change samples of this tone, but
+	   invalidates the cache too. */
+	cw_gen_set_speed(gen, gen->send_speed + 1);
+	gen_render_tone(gen, &tone, first);
+	cte->expect_op_int(cte, 3, "==", (int) gen->pcm_cache.n_misses, "after change of speed: cache miss");
+	cte->expect_op_int(cte, 0, "==", memcmp(first, second, size), "after change of speed: same samples");
+
+	free(first);
+	free(second);
+	free(uncached);
+	gen_destroy(&gen);
 
-		int readback_min;   /* Value returned by 'get_limits()' function. */
-		int readback_max;   /* Value returned by 'get_limits()' function. */
+	cte->print_test_footer(cte, __func__);
 
-		const char * name;
-	} test_data[] = {
-		{ LIBCW_TEST_FUT(cw_get_speed_limits),
-		  LIBCW_TEST_FUT(cw_gen_set_speed),
-		  LIBCW_TEST_FUT(cw_gen_get_speed),         CW_SPEED_MIN,      CW_SPEED_MAX,      off_limits,  -off_limits,  "speed"      },
+	return cwt_retv_ok;
+}
 
-		{ LIBCW_TEST_FUT(cw_get_frequency_limits),
-		  LIBCW_TEST_FUT(cw_gen_set_frequency),
-		  LIBCW_TEST_FUT(cw_gen_get_frequency),     CW_FREQUENCY_MIN,  CW_FREQUENCY_MAX,  off_limits,  -off_limits,  "frequency"  },
 
-		{ LIBCW_TEST_FUT(cw_get_volume_limits),
-		  LIBCW_TEST_FUT(cw_gen_set_volume),
-		  LIBCW_TEST_FUT(cw_gen_get_volume),        CW_VOLUME_MIN,     CW_VOLUME_MAX,     off_limits,  -off_limits,  "volume"     },
 
-		{ LIBCW_TEST_FUT(cw_get_gap_limits),
-		  LIBCW_TEST_FUT(cw_gen_set_gap),
-		  LIBCW_TEST_FUT(cw_gen_get_gap),           CW_GAP_MIN,        CW_GAP_MAX,        off_limits,  -off_limits,  "gap"        },
 
-		{ LIBCW_TEST_FUT(cw_get_weighting_limits),
-		  LIBCW_TEST_FUT(cw_gen_set_weighting),
-		  LIBCW_TEST_FUT(cw_gen_get_weighting),     CW_WEIGHTING_MIN,  CW_WEIGHTING_MAX,  off_limits,  -off_limits,  "weighting"  },
+/**
+   @brief Test offline rendering of text into PCM samples
+*/
+cwt_retv test_cw_gen_render(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
 
-		{ NULL,
-		  NULL,
-		  NULL,                                     0,                 0,                 0,           0,            NULL         }
-	};
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		return cwt_retv_err;
+	}
 
+	/* "PARIS" is 50 Units long, including 7 Units of
+	   inter-word-space. Here we render the word without the
+	   inter-word-space, but with the inter-character-space after
+	   last character. */
+	const char * string = "paris";
+	const int n_units = 50 - 7 + 3;
+	const int64_t unit_n_samples = ((int64_t) gen->sample_rate * (CW_DOT_CALIBRATION / gen->send_speed)) / CW_USECS_PER_SEC;
+
+	cw_sample_t * rendered = NULL;
+	size_t n_rendered = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_render_string)(gen, string, &rendered, &n_rendered);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "render string: cwret");
+	cte->expect_valid_pointer(cte, rendered, "render string: buffer");
+	cte->expect_op_int(cte, (int) (n_units * unit_n_samples), "==", (int) n_rendered, "render string: count of samples");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "render string: queue is empty");
+
+	int n_non_silent = 0;
+	for (size_t i = 0; i < n_rendered; i++) {
+		if (0 != rendered[i]) {
+			n_non_silent++;
+		}
+	}
+	cte->expect_op_int(cte, 0, "<", n_non_silent, "render string: non-silent samples");
 
-	for (int i = 0; test_data[i].get_limits; i++) {
 
-		int value = 0;
-		int cwret = CW_FAILURE;
+	/* The same string, but rendered through tone queue, and retrieved
+	   in small portions. */
+	cwret = cw_gen_enqueue_string(gen, string);
+	cte->assert2(cte, CW_SUCCESS == cwret, "failed to enqueue string");
+	cw_sample_t * chunks = calloc(n_rendered, sizeof (cw_sample_t));
+	cte->assert2(cte, NULL != chunks, "failed to allocate buffer");
 
-		/* Test getting limits of values to be tested. */
-		test_data[i].get_limits(&test_data[i].readback_min, &test_data[i].readback_max);
-		if (!cte->expect_op_int(cte, test_data[i].expected_min, "==", test_data[i].readback_min, "get %s limits: min", test_data[i].name)) {
-			break;
-		}
-		if (!cte->expect_op_int(cte, test_data[i].expected_max, "==", test_data[i].readback_max, "get %s limits: max", test_data[i].name)) {
+	size_t n_total = 0;
+	bool failure = false;
+	while (true) {
+		cw_sample_t chunk[1000];
+		size_t n = 0;
+		cwret = LIBCW_TEST_FUT(cw_gen_render_to_buffer)(gen, chunk, sizeof (chunk) / sizeof (chunk[0]), &n);
+		if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "render to buffer: cwret")) {
+			failure = true;
 			break;
 		}
-
-
-		/* Test setting out-of-range value lower than minimum. */
-		errno = 0;
-		value = test_data[i].readback_min - 1;
-		cwret = test_data[i].set_new_value(gen, value);
-		if (!cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set %s below limit (cwret)", test_data[i].name)) {
+		if (0 == n) {
 			break;
 		}
-		if (!cte->expect_op_int(cte, EINVAL, "==", errno, "set %s below limit (errno)", test_data[i].name)) {
+		if (n_total + n > n_rendered) {
+			failure = true;
 			break;
 		}
+		memcpy(chunks + n_total, chunk, n * sizeof (cw_sample_t));
+		n_total += n;
+	}
+	cte->expect_op_int(cte, false, "==", failure, "render to buffer: retrieving samples");
+	cte->expect_op_int(cte, (int) n_rendered, "==", (int) n_total, "render to buffer: count of samples");
+	cte->expect_op_int(cte, 0, "==", memcmp(rendered, chunks, n_total * sizeof (cw_sample_t)), "render to buffer: samples");
 
 
-		/* Test setting out-of-range value higher than maximum. */
-		errno = 0;
-		value = test_data[i].readback_max + 1;
-		cwret = test_data[i].set_new_value(gen, value);
-		if (!cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set %s above limit (cwret)", test_data[i].name)) {
-			break;
-		}
-		if (!cte->expect_op_int(cte, EINVAL, "==", errno, "set %s above limit (errno)", test_data[i].name)) {
-			break;
-		}
+	/* String that doesn't fit into tone queue. Each 'e' is a Dot,
+	   inter-mark-space and rest of inter-character-space: three tones,
+	   four Units. */
+	{
+		cw_gen_set_speed(gen, CW_SPEED_MAX);
+		const int64_t fast_unit_n_samples = ((int64_t) gen->sample_rate * (CW_DOT_CALIBRATION / gen->send_speed)) / CW_USECS_PER_SEC;
+		const size_t n_characters = CW_TONE_QUEUE_CAPACITY_DEFAULT / 3 + 100;
+		char * long_string = calloc(n_characters + 1, 1);
+		cte->assert2(cte, NULL != long_string, "failed to allocate string");
+		memset(long_string, 'e', n_characters);
+
+		cw_sample_t * long_rendered = NULL;
+		size_t n_long_rendered = 0;
+		cwret = LIBCW_TEST_FUT(cw_gen_render_string)(gen, long_string, &long_rendered, &n_long_rendered);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "render long string: cwret");
+		cte->expect_op_int(cte, (int) (4 * n_characters * fast_unit_n_samples), "==", (int) n_long_rendered, "render long string: count of samples");
+
+		free(long_rendered);
+		free(long_string);
+	}
 
 
+	/* Invalid string. */
+	cw_sample_t * invalid = NULL;
+	size_t n_invalid = 0;
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_render_string)(gen, "%%%", &invalid, &n_invalid);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "invalid string: cwret");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "invalid string: errno");
+	cte->expect_null_pointer(cte, invalid, "invalid string: buffer");
 
-		/* Test setting in-range values. Set with setter and then read back with getter. */
-		bool set_within_range_cwret_failure = false;
-		bool set_within_range_errno_failure = false;
-		bool set_within_range_readback_failure = false;
-		for (int value_to_set = test_data[i].readback_min; value_to_set <= test_data[i].readback_max; value_to_set++) {
-			errno = 0;
-			cwret = test_data[i].set_new_value(gen, value_to_set);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "set %s within limits (cwret) (value to set = %d)", test_data[i].name, value_to_set)) {
-				set_within_range_cwret_failure = true;
-				break;
-			}
-			if (!cte->expect_op_int_errors_only(cte, 0, "==", errno, "set %s within limits (errno) (value to set = %d)", test_data[i].name, value_to_set)) {
-				set_within_range_errno_failure = true;
-				break;
-			}
-
-			const int readback_value = test_data[i].get_value(gen);
-			if (!cte->expect_op_int_errors_only(cte, readback_value, "==", value_to_set, "readback %s within limits (value to set = %d)", test_data[i].name, value_to_set)) {
-				set_within_range_readback_failure = true;
-				break;
-			}
-		}
-		cte->expect_op_int(cte, false, "==", set_within_range_cwret_failure,    "set %s within range (cwret)", test_data[i].name);
-		cte->expect_op_int(cte, false, "==", set_within_range_errno_failure,    "set %s within range (errno)", test_data[i].name);
-		cte->expect_op_int(cte, false, "==", set_within_range_readback_failure, "set %s within range (readback)", test_data[i].name);
-	}
-
-	cw_gen_delete(&gen);
+	free(chunks);
+	free(rendered);
+	gen_destroy(&gen);
 
 	cte->print_test_footer(cte, __func__);
 
@@ -845,149 +1142,128 @@ cwt_retv test_cw_gen_parameter_getters_setters(cw_test_executor_t * cte)
 
 
 /**
-   @brief Test control of generator's volume
-
-   Check that we can set the volume through its entire range.
-
-   @reviewed on 2020-05-05
+   @brief Test File sound system: WAV file by path, raw PCM by file descriptor, custom sample rate
 */
-cwt_retv test_cw_gen_volume_functions(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_file_sink(cw_test_executor_t * cte)
 {
 	cte->print_test_header(cte, __func__);
 
-	const int volume_delta = 1; /* [%] volume change in percent. */
-	const int tone_freq = cte->config->frequency;
-	const int tone_duration = 70000; /* [microseconds] Duration can't be too short, because the loops will run too fast. */
-
-	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
-
-
-
-
-	/* Test: get range of allowed volumes. */
-	int volume_min = -1;
-	int volume_max = -1;
-	{
-		LIBCW_TEST_FUT(cw_get_volume_limits)(&volume_min, &volume_max);
-		const bool failure = volume_min != CW_VOLUME_MIN || volume_max != CW_VOLUME_MAX;
-		cte->expect_op_int(cte, false, "==", failure, "get volume limits: %d, %d", volume_min, volume_max);
-	}
-
-
+	char path[] = "/tmp/libcw_file_sink_XXXXXX";
+	int fd = mkstemp(path);
+	cte->assert2(cte, -1 != fd, "failed to create temporary file");
+	close(fd);
 
 
-	/* Test: decrease volume from max to min. */
+	/* WAV file opened by libcw. Generator is not paced, so a long tone
+	   should be written to the file much faster than in real time. */
 	{
-		/* Few initial tones to make tone queue non-empty. */
-		for (int i = 0; i < 3; i++) {
-			cw_tone_t tone;
-			const int slope_mode = i == 0 ? CW_SLOPE_MODE_RISING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* Rising slope only in first tone in series of tones. */
-			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
-			cw_tq_enqueue_internal(gen->tq, &tone);
-		}
+		const int duration = 500000; /* [us] */
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = -1, .file_format = CW_FILE_FORMAT_WAV };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
 
-		bool set_failure = false;
-		bool get_failure = false;
+		struct timeval start;
+		cw_clock_get_timeval_internal(&start);
 
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
 		cw_gen_start(gen);
 
-		for (int vol = volume_max; vol >= volume_min; vol -= volume_delta) {
-
-			cw_tone_t tone;
-			const int slope_mode = vol == volume_min ? CW_SLOPE_MODE_FALLING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* No slopes in the middle - keep each level of tone constant at the beginning and end. */
-			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
-			cw_tq_enqueue_internal(gen->tq, &tone);
-
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_volume)(gen, vol);
-			if (!cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set volume (down, vol = %d)", vol)) {
-				set_failure = true;
-				break;
-			}
-
-			const int readback_value = LIBCW_TEST_FUT(cw_gen_get_volume)(gen);
-			if (!cte->expect_op_int(cte, readback_value, "==", vol, "get volume (down, vol = %d)", vol)) {
-				get_failure = true;
-				break;
-			}
-			//fprintf(stderr, "len = %zd\n", cw_gen_get_queue_length(gen));
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
 
-			cw_gen_wait_for_queue_level(gen, 1);
-		}
+		struct timeval stop;
+		cw_clock_get_timeval_internal(&stop);
+		const int elapsed = cw_timestamp_compare_internal(&start, &stop);
+		cte->expect_op_int(cte, duration / 2, ">", elapsed, "WAV: generator is not paced to real time");
 
-		cw_gen_wait_for_queue_level(gen, 0);
-		usleep(2 * tone_duration);
 		cw_gen_stop(gen);
+		const unsigned int sample_rate = gen->sample_rate;
+		const int buffer_n_samples = gen->buffer_n_samples;
+		cw_gen_delete(&gen);
 
-		cte->expect_op_int(cte, false, "==", set_failure, "set volume (down)");
-		cte->expect_op_int(cte, false, "==", get_failure, "get volume (down)");
+		uint8_t header[44] = { 0 };
+		FILE * file = fopen(path, "rb");
+		cte->assert2(cte, NULL != file, "failed to open output file");
+		cte->expect_op_int(cte, (int) sizeof (header), "==", (int) fread(header, 1, sizeof (header), file), "WAV: reading header");
+		fseek(file, 0, SEEK_END);
+		const long file_size = ftell(file);
+		fclose(file);
+
+		const uint32_t riff_size = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t) header[7] << 24);
+		const uint32_t rate = header[24] | (header[25] << 8) | (header[26] << 16) | ((uint32_t) header[27] << 24);
+		const uint32_t data_size = header[40] | (header[41] << 8) | (header[42] << 16) | ((uint32_t) header[43] << 24);
+		cte->expect_op_int(cte, 0, "==", memcmp(header, "RIFF", 4), "WAV: RIFF tag");
+		cte->expect_op_int(cte, 0, "==", memcmp(header + 8, "WAVEfmt ", 8), "WAV: WAVE tag");
+		cte->expect_op_int(cte, 0, "==", memcmp(header + 36, "data", 4), "WAV: data tag");
+		cte->expect_op_int(cte, (int) sample_rate, "==", (int) rate, "WAV: sample rate");
+		cte->expect_op_int(cte, (int) (file_size - 8), "==", (int) riff_size, "WAV: RIFF size");
+		cte->expect_op_int(cte, (int) (file_size - 44), "==", (int) data_size, "WAV: data size");
+
+		/* Samples of last, incomplete buffer are not written. Stopping
+		   the generator adds a silencing tone, up to six buffers long. */
+		const int expected_n_samples = (int) (((int64_t) sample_rate * duration) / CW_USECS_PER_SEC);
+		cte->expect_between_int(cte, expected_n_samples - buffer_n_samples, (int) (data_size / 2), expected_n_samples + 7 * buffer_n_samples, "WAV: count of samples");
 	}
 
 
-
-
-	/* Test: increase volume from min to max. */
+	/* Raw PCM written to descriptor provided by client code, paced to
+	   real time, at sample rate requested by client code. */
 	{
-		/* Few initial tones to make tone queue non-empty. */
-		for (int i = 0; i < 3; i++) {
-			cw_tone_t tone;
-			const int slope_mode = i == 0 ? CW_SLOPE_MODE_RISING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* Rising slope only in first tone in series of tones. */
-			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
-			cw_tq_enqueue_internal(gen->tq, &tone);
-		}
+		const int duration = 200000; /* [us] */
+		fd = open(path, O_WRONLY | O_TRUNC);
+		cte->assert2(cte, -1 != fd, "failed to open temporary file");
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW, .file_realtime = true, .file_sample_rate = 22050 };
 
-		bool set_failure = false;
-		bool get_failure = false;
+		struct timeval start;
+		cw_clock_get_timeval_internal(&start);
 
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
 		cw_gen_start(gen);
 
-		for (int vol = volume_min; vol <= volume_max; vol += volume_delta) {
-
-			cw_tone_t tone;
-			const int slope_mode = vol == volume_max ? CW_SLOPE_MODE_FALLING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* No slopes in the middle - keep each level of tone constant at the beginning and end. */
-			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
-			cw_tq_enqueue_internal(gen->tq, &tone);
-
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_volume)(gen, vol);
-			if (!cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set volume (up, vol = %d)", vol)) {
-				set_failure = true;
-				break;
-			}
-
-			const int readback_value = LIBCW_TEST_FUT(cw_gen_get_volume)(gen);
-			if (!cte->expect_op_int(cte, readback_value, "==", vol, "get volume (up, vol = %d)", vol)) {
-				get_failure = true;
-				break;
-			}
-			//fprintf(stderr, "len = %zd\n", cw_gen_get_queue_length(gen));
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
 
-			cw_gen_wait_for_queue_level(gen, 1);
-		}
+		struct timeval stop;
+		cw_clock_get_timeval_internal(&stop);
+		const int elapsed = cw_timestamp_compare_internal(&start, &stop);
+		const int buffer_n_samples = gen->buffer_n_samples;
+		const unsigned int sample_rate = gen->sample_rate;
+		cte->expect_op_int(cte, 22050, "==", (int) sample_rate, "raw: sample rate");
+		const int buffer_duration = (int) (((int64_t) buffer_n_samples * CW_USECS_PER_SEC) / sample_rate);
+		cte->expect_op_int(cte, duration - 2 * buffer_duration, "<", elapsed, "raw: generator is paced to real time");
 
-		cw_gen_wait_for_queue_level(gen, 0);
-		usleep(2 * tone_duration);
 		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
 
-		cte->expect_op_int(cte, false, "==", set_failure, "set volume (up)");
-		cte->expect_op_int(cte, false, "==", get_failure, "get volume (up)");
+		/* Descriptor is owned by client code and is still open. */
+		const off_t file_size = lseek(fd, 0, SEEK_END);
+		cte->expect_op_int(cte, -1, "!=", (int) file_size, "raw: descriptor is still open");
+		close(fd);
+
+		const int expected_n_samples = (int) (((int64_t) sample_rate * duration) / CW_USECS_PER_SEC);
+		cte->expect_between_int(cte, expected_n_samples - buffer_n_samples, (int) (file_size / 2), expected_n_samples + 7 * buffer_n_samples, "raw: count of samples");
 	}
 
-#if 0
-	/*
-	  FIXME: check behaviour of these function for empty tone
-	  queue, particularly if each of the functions is called one
-	  after another, like this:
-	  cw_gen_wait_for_end_of_current_tone(gen);
-	  cw_gen_wait_for_end_of_current_tone(gen);
 
-	  or this:
-	  cw_gen_wait_for_queue_level(gen, 0);
-	  cw_gen_wait_for_queue_level(gen, 0);
-	*/
-	cw_gen_wait_for_end_of_current_tone(gen);
-	cw_gen_wait_for_queue_level(gen, 0);
-#endif
+	/* Sample rate too low for generation of Morse code. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = -1, .file_format = CW_FILE_FORMAT_RAW, .file_sample_rate = 4000 };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_op_int(cte, true, "==", NULL == gen, "invalid sample rate is rejected");
+		if (NULL != gen) {
+			cw_gen_delete(&gen);
+		}
+	}
 
-	cw_gen_delete(&gen);
+	unlink(path);
 
 	cte->print_test_footer(cte, __func__);
 
@@ -998,91 +1274,165 @@ cwt_retv test_cw_gen_volume_functions(cw_test_executor_t * cte)
 
 
 /**
-   @brief Test enqueueing and playing most basic elements of Morse code
-
-   @reviewed on 2020-05-09
+   @brief Test RTP sound system: packets sent to two destinations, pacing, invalid configurations
 */
-cwt_retv test_cw_gen_enqueue_primitives(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_rtp_sink(cw_test_executor_t * cte)
 {
-	const int loops = cte->get_loops_count(cte);
-
-	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+	cte->print_test_header(cte, __func__);
 
-	cw_gen_t * gen = NULL;
-	if (cwt_retv_ok != gen_setup(cte, &gen)) {
-		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
-		return cwt_retv_err;
+	/* Two receivers on loopback interface, on ports picked by
+	   kernel. */
+	int receivers[2] = { -1, -1 };
+	unsigned int ports[2] = { 0 };
+	for (int i = 0; i < 2; i++) {
+		receivers[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		cte->assert2(cte, -1 != receivers[i], "failed to open receiving socket #%d", i);
+		struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		cte->assert2(cte, 0 == bind(receivers[i], (struct sockaddr *) &addr, sizeof (addr)), "failed to bind receiving socket #%d", i);
+		socklen_t addr_len = sizeof (addr);
+		getsockname(receivers[i], (struct sockaddr *) &addr, &addr_len);
+		ports[i] = ntohs(addr.sin_port);
+		/* Tone sent by test doesn't fit in default receive buffer. */
+		const int rcvbuf = 1 << 20;
+		setsockopt(receivers[i], SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
 	}
-	cw_gen_start(gen);
 
-	/* Test: playing dots. */
-	{
-		bool failure = false;
-		for (int i = 0; i < loops; i++) {
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_mark_internal)(gen, CW_DOT_REPRESENTATION, false);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue mark internal(CW_DOT_REPRESENTATION) (i = %d)", i)) {
-				failure = true;
-				break;
-			}
-		}
-		cw_gen_wait_for_queue_level(gen, 0);
 
-		cte->expect_op_int(cte, false, "==", failure, "enqueue mark internal(CW_DOT_REPRESENTATION)");
-	}
+	/* L16 stream, 10 ms per packet at 16 kHz. */
+	{
+		const int duration = 200000; /* [us] */
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_RTP, .rtp_payload = CW_RTP_PAYLOAD_L16, .rtp_sample_rate = 16000, .rtp_packet_duration = 10000 };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "127.0.0.1:%u,127.0.0.1:%u", ports[0], ports[1]);
 
+		struct timeval start;
+		cw_clock_get_timeval_internal(&start);
 
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with RTP sound system");
+		cte->expect_op_int(cte, 16000, "==", (int) gen->sample_rate, "L16: sample rate");
+		cte->expect_op_int(cte, 160, "==", gen->buffer_n_samples, "L16: samples per packet");
+		cw_gen_start(gen);
 
-	/* Test: playing dashes. */
-	{
-		bool failure = false;
-		for (int i = 0; i < loops; i++) {
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_mark_internal)(gen, CW_DASH_REPRESENTATION, false);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue mark internal(CW_DASH_REPRESENTATION) (i = %d)", i)) {
-				failure = true;
-				break;
-			}
-		}
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
 		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
 
-		cte->expect_op_int(cte, false, "==", failure, "enqueue mark internal(CW_DASH_REPRESENTATION)");
-	}
+		struct timeval stop;
+		cw_clock_get_timeval_internal(&stop);
+		const int elapsed = cw_timestamp_compare_internal(&start, &stop);
+		cte->expect_op_int(cte, duration - 2 * 10000, "<", elapsed, "L16: generator is paced to real time");
 
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
 
-	/* Test: playing inter-character-spaces. */
-	{
-		bool failure = false;
-		for (int i = 0; i < loops; i++) {
-			/* TODO: this function adds 2-Unit space, not a
-			   regular 3-Unit inter-character-space. Be aware of
-			   this fact. */
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_2u_ics_internal)(gen);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue ics internal() (i = %d)", i)) {
-				failure = true;
+		/* Packets received on first socket, compared with packets
+		   received on second socket. */
+		uint8_t packet[2][CW_RTP_HEADER_SIZE + CW_RTP_PAYLOAD_SIZE_MAX];
+		int n_packets = 0;
+		bool headers_ok = true;
+		bool sizes_ok = true;
+		bool sequence_ok = true;
+		bool timestamps_ok = true;
+		bool copies_ok = true;
+		bool has_sound = false;
+		bool first_has_marker = false;
+		uint16_t prev_seq = 0;
+		uint32_t prev_ts = 0;
+		uint32_t ssrc = 0;
+		while (true) {
+			const ssize_t n = recv(receivers[0], packet[0], sizeof (packet[0]), 0);
+			if (n <= 0) {
 				break;
 			}
+			const ssize_t n_copy = recv(receivers[1], packet[1], sizeof (packet[1]), 0);
+			if (n_copy != n || 0 != memcmp(packet[0], packet[1], (size_t) n)) {
+				copies_ok = false;
+			}
+
+			const uint8_t * p = packet[0];
+			const uint16_t seq = (uint16_t) ((p[2] << 8) | p[3]);
+			const uint32_t ts = ((uint32_t) p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+			const uint32_t packet_ssrc = ((uint32_t) p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+			if (0x80 != p[0] || 96 != (p[1] & 0x7f)) {
+				headers_ok = false;
+			}
+			if (CW_RTP_HEADER_SIZE + 160 * 2 != n) {
+				sizes_ok = false;
+			}
+			if (0 == n_packets) {
+				first_has_marker = 0 != (p[1] & 0x80);
+				ssrc = packet_ssrc;
+			} else {
+				if ((uint16_t) (prev_seq + 1) != seq) {
+					sequence_ok = false;
+				}
+				/* Within a talkspurt the timestamp grows by count
+				   of samples in packet. Packet with marker bit
+				   starts new talkspurt (e.g. silence added by
+				   cw_gen_stop() after generator has been idle),
+				   and its timestamp also counts the idle time. */
+				const uint32_t ts_diff = ts - prev_ts;
+				const bool is_marked = 0 != (p[1] & 0x80);
+				if ((is_marked ? ts_diff < 160 : ts_diff != 160) || ssrc != packet_ssrc) {
+					timestamps_ok = false;
+				}
+			}
+			for (ssize_t s = CW_RTP_HEADER_SIZE; s < n; s++) {
+				if (0 != p[s]) {
+					has_sound = true;
+					break;
+				}
+			}
+			prev_seq = seq;
+			prev_ts = ts;
+			n_packets++;
 		}
-		cw_gen_wait_for_queue_level(gen, 0);
 
-		cte->expect_op_int(cte, false, "==", failure, "enqueue ics internal()");
+		const int expected_n_packets = duration / 10000;
+		cte->expect_between_int(cte, expected_n_packets - 1, n_packets, expected_n_packets + 7, "L16: count of packets");
+		cte->expect_op_int(cte, true, "==", headers_ok, "L16: version and payload type");
+		cte->expect_op_int(cte, true, "==", sizes_ok, "L16: size of packets");
+		cte->expect_op_int(cte, true, "==", sequence_ok, "L16: sequence numbers");
+		cte->expect_op_int(cte, true, "==", timestamps_ok, "L16: timestamps and SSRC");
+		cte->expect_op_int(cte, true, "==", first_has_marker, "L16: marker bit in first packet");
+		cte->expect_op_int(cte, true, "==", has_sound, "L16: samples of tone");
+		cte->expect_op_int(cte, true, "==", copies_ok, "L16: same packets to second destination");
 	}
 
 
-	/* Test: playing inter-word-spaces. */
+	/* Invalid configurations. */
 	{
-		bool failure = false;
-		for (int i = 0; i < loops; i++) {
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_iws_internal)(gen);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue iws internal() (i = %d)", i)) {
-				failure = true;
-				break;
+		struct {
+			cw_rtp_payload_t payload;
+			unsigned int sample_rate;
+			unsigned int packet_duration;
+			const char * destination;
+			const char * description;
+		} invalid[] = {
+			{ CW_RTP_PAYLOAD_L16,  48000, 60000, "127.0.0.1:5004", "L16 samples don't fit in packet" },
+			{ CW_RTP_PAYLOAD_L16,  11025, 10100, "127.0.0.1:5004", "non-integral count of samples" },
+			{ CW_RTP_PAYLOAD_L16,   4000, 20000, "127.0.0.1:5004", "sample rate too low" },
+			{ CW_RTP_PAYLOAD_OPUS,     0, 15000, "127.0.0.1:5004", "invalid duration of Opus frame" },
+			{ CW_RTP_PAYLOAD_L16,  16000, 20000, "127.0.0.1",      "destination without port" },
+			{ CW_RTP_PAYLOAD_L16,  16000, 20000, "[::1:5004",      "malformed IPv6 destination" },
+		};
+		for (size_t i = 0; i < sizeof (invalid) / sizeof (invalid[0]); i++) {
+			cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_RTP, .rtp_payload = invalid[i].payload,
+						     .rtp_sample_rate = invalid[i].sample_rate, .rtp_packet_duration = invalid[i].packet_duration };
+			snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", invalid[i].destination);
+			cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+			cte->expect_op_int(cte, true, "==", NULL == gen, "invalid configuration is rejected: %s", invalid[i].description);
+			if (NULL != gen) {
+				cw_gen_delete(&gen);
 			}
 		}
-		cw_gen_wait_for_queue_level(gen, 0);
-
-		cte->expect_op_int(cte, false, "==", failure, "enqueue iws internal()");
 	}
 
-	gen_destroy(&gen);
+	close(receivers[0]);
+	close(receivers[1]);
 
 	cte->print_test_footer(cte, __func__);
 
@@ -1093,87 +1443,3016 @@ cwt_retv test_cw_gen_enqueue_primitives(cw_test_executor_t * cte)
 
 
 /**
-   @brief Test playing representations of characters
-
-   @reviewed on 2020-05-09
+   @brief Test collecting of latency statistics in generator, and query of output latency
 */
-cwt_retv test_cw_gen_enqueue_representations(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_latency_stats(cw_test_executor_t * cte)
 {
-	const int loops = cte->get_loops_count(cte);
+	cte->print_test_header(cte, __func__);
 
-	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+	/* Use sound system that writes buffers of samples, without
+	   pacing to real time. */
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
 
-	/* Representation is valid when it contains dots and dashes only.
-	   cw_gen_enqueue_representation*() doesn't check if given
-	   representation represents a supported character. */
+	cw_gen_enqueue_string(gen, "PARIS");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
 
-	cw_gen_t * gen = NULL;
-	if (cwt_retv_ok != gen_setup(cte, &gen)) {
-		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
-		return cwt_retv_err;
+	cw_gen_latency_stats_t stats;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_get_latency_stats)(gen, &stats);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting latency stats");
+	cte->expect_op_int(cte, 0, "<", (int) stats.queue.count, "count of tones measured in queue");
+	cte->expect_op_int(cte, 0, "<", (int) stats.device.count, "count of tones measured in sound system");
+	cte->expect_op_int(cte, (int) stats.device.count, "==", (int) stats.total.count, "count of tones measured end-to-end");
+	cte->expect_op_int(cte, 1, "==", stats.total.sum >= stats.device.sum, "end-to-end latency includes latency in sound system");
+	cte->expect_op_int(cte, 5, "<=", (int) stats.tq_length_max, "largest length of tone queue");
+	cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", (int) stats.tq_capacity, "capacity of tone queue");
+	cte->expect_op_int(cte, 1, "==", (int) stats.n_tq_emptied, "count of emptyings of tone queue");
+
+	/* Rounding of every tone to whole samples is less than one sample. */
+	const double rounding = (double) stats.n_tones_samples * 1e6 / gen->sample_rate - (double) stats.tones_duration;
+	const double max_rounding = (double) stats.queue.count * 1e6 / gen->sample_rate;
+	cte->expect_op_int(cte, 1, "==", rounding > -max_rounding && rounding < max_rounding, "drift caused by rounding of tones (%.0f us)", rounding);
+
+	const cw_latency_histogram_t * histograms[] = { &stats.queue, &stats.device, &stats.total };
+	for (size_t h = 0; h < sizeof (histograms) / sizeof (histograms[0]); h++) {
+		uint64_t n = 0;
+		for (int i = 0; i < CW_LATENCY_HISTOGRAM_N_BUCKETS; i++) {
+			n += histograms[h]->buckets[i];
+		}
+		cte->expect_op_int(cte, (int) histograms[h]->count, "==", (int) n, "sum of buckets of histogram #%zu", h);
+		cte->expect_op_int(cte, 1, "==", histograms[h]->max * histograms[h]->count >= histograms[h]->sum, "max of histogram #%zu", h);
 	}
-	cw_gen_start(gen);
 
-	/* Test: playing valid representations. */
-	{
-		bool failure = false;
-		for (int rep = 0; rep < loops; rep++) {
-			int i = 0;
-			while (NULL != test_valid_representations[i]) {
-				cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation)(gen, test_valid_representations[i]);
-				if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue representation(<valid>) (%d)", i)) {
-					failure = true;
-					break;
-				}
-				cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation_no_ics)(gen, test_valid_representations[i]);
-				if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue representation, no ics(<valid>) (%d)", i)) {
-					failure = true;
-					break;
+	LIBCW_TEST_FUT(cw_gen_reset_latency_stats)(gen);
+	cw_gen_get_latency_stats(gen, &stats);
+	cte->expect_op_int(cte, 0, "==", (int) (stats.queue.count + stats.device.count + stats.total.count), "counts after reset");
+	cte->expect_op_int(cte, 0, "==", (int) stats.tq_length_max, "largest length of tone queue after reset");
+	cte->expect_op_int(cte, 0, "==", (int) (stats.n_tq_emptied + stats.n_tones_samples), "counters after reset");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_latency_stats)(gen, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting latency stats with NULL argument");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting latency stats with NULL argument");
+
+	/* File sound system doesn't report delay of its sink, so
+	   output latency is duration of samples waiting in
+	   generator's buffer (plus zero). */
+	int64_t output_latency = -1;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_output_latency)(gen, &output_latency);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting output latency");
+	const int64_t buffer_duration = (int64_t) gen->buffer_n_samples * CW_USECS_PER_SEC / gen->sample_rate;
+	cte->expect_op_int(cte, true, "==", output_latency >= 0 && output_latency < buffer_duration, "output latency (%"PRId64" us) is within duration of buffer", output_latency);
+
+	cw_gen_latency_set_sound_device_latency_internal(gen, 50000);
+	cw_gen_get_output_latency(gen, &output_latency);
+	cte->expect_op_int(cte, true, "==", output_latency >= 50000 && output_latency < 50000 + buffer_duration, "output latency includes latency reported by sound system");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_output_latency)(gen, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting output latency with NULL argument");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting output latency with NULL argument");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	close(fd);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static cw_ret_t test_cw_gen_stats_failing_write_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	return CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Test counters of writes of generator to sound system
+*/
+cwt_retv test_cw_gen_stats(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+
+	cw_gen_enqueue_string(gen, "PARIS");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
+
+	cw_gen_stats_t stats;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting stats");
+	cte->expect_op_int(cte, 0, "<", (int) stats.n_buffers_written, "count of written buffers");
+	cte->expect_op_int(cte, (int) (stats.n_buffers_written * (uint64_t) gen->buffer_n_samples), "==", (int) stats.n_samples_written, "count of written samples");
+	cte->expect_op_int(cte, 0, "==", (int) (stats.n_xruns + stats.n_recoveries + stats.n_short_writes + stats.n_write_errors), "count of underruns and failed writes");
+
+	/* Failed writes are counted, written samples are not. */
+	gen->write_buffer_to_sound_device = test_cw_gen_stats_failing_write_internal;
+	cw_gen_enqueue_string(gen, "E");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
+
+	cw_gen_stats_t failed_stats;
+	cw_gen_get_stats(gen, &failed_stats);
+	cte->expect_op_int(cte, 0, "<", (int) failed_stats.n_write_errors, "count of failed writes");
+	cte->expect_op_int(cte, (int) stats.n_buffers_written, "==", (int) failed_stats.n_buffers_written, "count of written buffers after failed writes");
+	cte->expect_op_int(cte, (int) stats.n_samples_written, "==", (int) failed_stats.n_samples_written, "count of written samples after failed writes");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_stats)(gen, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting stats with NULL argument");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting stats with NULL argument");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	close(fd);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test generator working in pull mode
+
+   Samples pulled with cw_gen_fill_buffer() should be the same as samples
+   rendered offline from the same text.
+*/
+cwt_retv test_cw_gen_fill_buffer(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * string = "paris";
+
+	/* Reference samples. */
+	cw_gen_config_t render_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * render_gen = cw_gen_new(&render_conf);
+	cte->assert2(cte, NULL != render_gen, "failed to create generator for rendering");
+	cw_sample_t * rendered = NULL;
+	size_t n_rendered = 0;
+	cw_ret_t cwret = cw_gen_render_string(render_gen, string, &rendered, &n_rendered);
+	cte->assert2(cte, CW_SUCCESS == cwret && 0 < n_rendered, "failed to render string");
+	cw_gen_delete(&render_gen);
+
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .pull_mode = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator in pull mode");
+
+	/* Pull more samples than will be generated, and in portions that
+	   don't match sizes of generator's internal chunks. */
+	const size_t chunk_size = 1000;
+	const size_t n_pulled = ((n_rendered / chunk_size) + 2) * chunk_size;
+	cw_sample_t * pulled = malloc(n_pulled * sizeof (cw_sample_t));
+	cte->assert2(cte, NULL != pulled, "failed to allocate buffer");
+
+	/* Generator that is not started gives silence. */
+	memset(pulled, 0x55, chunk_size * sizeof (cw_sample_t));
+	cwret = LIBCW_TEST_FUT(cw_gen_fill_buffer)(gen, pulled, chunk_size);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "fill buffer of stopped generator: cwret");
+	int n_non_silent = 0;
+	for (size_t i = 0; i < chunk_size; i++) {
+		n_non_silent += 0 != pulled[i];
+	}
+	cte->expect_op_int(cte, 0, "==", n_non_silent, "fill buffer of stopped generator: silence");
+
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, string);
+
+	bool failure = false;
+	for (size_t n = 0; n < n_pulled; n += chunk_size) {
+		cwret = LIBCW_TEST_FUT(cw_gen_fill_buffer)(gen, pulled + n, chunk_size);
+		if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "fill buffer: cwret")) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "fill buffer: pulling samples");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "fill buffer: queue is empty");
+	cte->expect_op_int(cte, 0, "==", memcmp(rendered, pulled, n_rendered * sizeof (cw_sample_t)), "fill buffer: samples");
+
+	n_non_silent = 0;
+	for (size_t i = n_rendered; i < n_pulled; i++) {
+		n_non_silent += 0 != pulled[i];
+	}
+	cte->expect_op_int(cte, 0, "==", n_non_silent, "fill buffer: silence after end of tones");
+
+	/* Stopping must not wait for client code to pull samples. */
+	cw_gen_enqueue_string(gen, string);
+	cwret = cw_gen_stop(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "stop generator in pull mode");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue is empty after stop");
+	cw_gen_delete(&gen);
+
+
+	/* Generator that doesn't work in pull mode. */
+	cw_gen_config_t push_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * push_gen = cw_gen_new(&push_conf);
+	cte->assert2(cte, NULL != push_gen, "failed to create generator");
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_fill_buffer)(push_gen, pulled, chunk_size);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "fill buffer of generator not in pull mode: cwret");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "fill buffer of generator not in pull mode: errno");
+	cw_gen_delete(&push_gen);
+
+	free(pulled);
+	free(rendered);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test timing of tones by Null sound system
+
+   Tones are timed with absolute deadlines, so total duration of many
+   tones should be very close to sum of their durations.
+*/
+cwt_retv test_cw_gen_null_pacing(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	cw_gen_start(gen);
+
+	const int n_tones = 50;
+	const int duration = 4000; /* [us] */
+
+	const int64_t start = cw_monotonic_usecs_internal();
+	for (int i = 0; i < n_tones; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, i % 2 ? 0 : 800, duration, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+	}
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
+	const int64_t elapsed = cw_monotonic_usecs_internal() - start;
+
+	const int expected = n_tones * duration;
+	cte->expect_op_int(cte, expected - 1000, "<=", (int) elapsed, "total duration of tones: lower bound");
+	cte->expect_op_int(cte, expected + 20000, ">", (int) elapsed, "total duration of tones: upper bound");
+
+	cw_gen_latency_stats_t stats;
+	cw_gen_get_latency_stats(gen, &stats);
+	cte->expect_op_int(cte, n_tones, "<=", (int) stats.pacing.count, "count of paced tones");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test event descriptor of generator
+
+   The descriptor should become readable when tone queue falls to low
+   water mark, and again when the queue becomes empty.
+*/
+cwt_retv test_cw_gen_event_fd(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+
+	const int fd = LIBCW_TEST_FUT(cw_gen_get_event_fd)(gen);
+#if defined(__linux__)
+	cte->expect_op_int(cte, -1, "!=", fd, "get event descriptor");
+	cte->expect_op_int(cte, fd, "==", cw_gen_get_event_fd(gen), "same descriptor on second call");
+
+	const size_t level = 2;
+	cw_gen_register_low_level_callback(gen, NULL, NULL, level);
+	cw_gen_start(gen);
+
+	for (int i = 0; i < 8; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, i % 2 ? 0 : 800, 5000, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+	}
+
+	/* Descriptor isn't readable while the queue is long. */
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	cte->expect_op_int(cte, 0, "==", poll(&pfd, 1, 0), "descriptor not readable before low water mark");
+
+	int n = poll(&pfd, 1, 1000);
+	cte->expect_op_int(cte, 1, "==", n, "descriptor readable at low water mark");
+	uint64_t counter = 0;
+	cte->expect_op_int(cte, (int) sizeof (counter), "==", (int) read(fd, &counter, sizeof (counter)), "read counter");
+	const size_t len = cw_gen_get_queue_length(gen);
+	cte->expect_op_int(cte, (int) level, ">=", (int) len, "queue length at low water mark: %zu", len);
+
+	n = poll(&pfd, 1, 1000);
+	cte->expect_op_int(cte, 1, "==", n, "descriptor readable when queue is empty");
+	read(fd, &counter, sizeof (counter));
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue is empty");
+
+	cw_gen_stop(gen);
+#else
+	cte->expect_op_int(cte, -1, "==", fd, "event descriptors not supported");
+#endif
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Sizes of buffers "written" by
+   test_cw_gen_low_latency_keying_write_internal(). */
+static int test_low_latency_keying_writes[64];
+static int test_low_latency_keying_n_writes;
+
+static cw_ret_t test_cw_gen_low_latency_keying_write_internal(cw_gen_t * gen)
+{
+	if (test_low_latency_keying_n_writes < (int) (sizeof (test_low_latency_keying_writes) / sizeof (test_low_latency_keying_writes[0]))) {
+		test_low_latency_keying_writes[test_low_latency_keying_n_writes++] = gen->buffer_write_n_samples;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Test writing of "forever" tones in low-latency keying mode
+
+   In low-latency keying mode samples of "forever" tone should be
+   written in sub-blocks ending at sub-block boundaries; without the
+   mode they should be written only in full buffers.
+*/
+cwt_retv test_cw_gen_low_latency_keying(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+
+	for (int mode = 0; mode < 2; mode++) {
+		const bool low_latency = 1 == mode;
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW, .low_latency_keying = low_latency };
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+		gen->write_buffer_to_sound_device = test_cw_gen_low_latency_keying_write_internal;
+		test_low_latency_keying_n_writes = 0;
+
+		/* Previous tone ended in the middle of first sub-block. */
+		const int sub_start = 10;
+		const int n_samples = 100;
+		gen->buffer_sub_start = sub_start;
+
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
+		tone.is_forever = true;
+		tone.n_samples = n_samples;
+		LIBCW_TEST_FUT(cw_gen_write_to_soundcard_internal)(gen, &tone);
+
+		if (low_latency) {
+			/* Samples 0-31, 32-63 and 64-95 of buffer are
+			   written, the rest of the tone stays in buffer. */
+			cte->expect_op_int(cte, 3, "==", test_low_latency_keying_n_writes, "low latency: count of writes");
+			bool correct = true;
+			for (int i = 0; i < test_low_latency_keying_n_writes; i++) {
+				correct = correct && 32 == test_low_latency_keying_writes[i];
+			}
+			cte->expect_op_int(cte, true, "==", correct, "low latency: sizes of writes");
+			cte->expect_op_int(cte, (sub_start + n_samples) % 32, "==", gen->buffer_sub_start, "low latency: samples left in buffer");
+		} else {
+			const int expected = (sub_start + n_samples) / gen->buffer_n_samples;
+			cte->expect_op_int(cte, expected, "==", test_low_latency_keying_n_writes, "regular: count of writes");
+			bool correct = true;
+			for (int i = 0; i < test_low_latency_keying_n_writes; i++) {
+				correct = correct && gen->buffer_n_samples == test_low_latency_keying_writes[i];
+			}
+			cte->expect_op_int(cte, true, "==", correct, "regular: sizes of writes");
+		}
+
+		cw_gen_delete(&gen);
+	}
+
+	close(fd);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test real-time properties of generator
+
+   Whether the properties will be applied depends on privileges of test
+   process, so the test only checks that every requested property has
+   been either applied or rejected with an errno, and that generator
+   works in both cases.
+*/
+#if defined(__linux__)
+/* Size of memory of the process locked with mlock() [kB], -1 if it
+   can't be read. */
+static long test_cw_gen_locked_kb(void)
+{
+	FILE * file = fopen("/proc/self/status", "r");
+	if (NULL == file) {
+		return -1;
+	}
+	long kb = -1;
+	char line[128];
+	while (NULL != fgets(line, sizeof (line), file)) {
+		if (1 == sscanf(line, "VmLck: %ld kB", &kb)) {
+			break;
+		}
+	}
+	fclose(file);
+	return kb;
+}
+#endif
+
+
+
+
+cwt_retv test_cw_gen_realtime_config(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Invalid configurations. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .thread_sched_policy = SCHED_FIFO, .thread_sched_priority = sched_get_priority_max(SCHED_FIFO) + 1 };
+		errno = 0;
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->expect_op_int(cte, true, "==", NULL == gen, "invalid priority: generator");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "invalid priority: errno");
+
+		gen_conf.thread_sched_policy = -1;
+		gen_conf.thread_sched_priority = 0;
+		errno = 0;
+		gen = cw_gen_new(&gen_conf);
+		cte->expect_op_int(cte, true, "==", NULL == gen, "invalid policy: generator");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "invalid policy: errno");
+	}
+
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL,
+				     .thread_sched_policy = SCHED_FIFO,
+				     .thread_sched_priority = sched_get_priority_min(SCHED_FIFO),
+				     .thread_cpu_set = 1, /* CPU 0. */
+				     .lock_memory = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with real-time properties");
+
+	cw_ret_t cwret = cw_gen_start(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "start generator");
+
+	cw_gen_realtime_status_t status = { 0 };
+	cwret = LIBCW_TEST_FUT(cw_gen_get_realtime_status)(gen, &status);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "get real-time status");
+	cte->expect_op_int(cte, true, "==", status.sched_applied != (0 != status.sched_errno), "scheduling: applied or errno");
+	cte->expect_op_int(cte, true, "==", status.cpu_affinity_applied != (0 != status.cpu_affinity_errno), "CPU affinity: applied or errno");
+	cte->expect_op_int(cte, true, "==", status.memory_locked != (0 != status.memory_lock_errno), "memory lock: applied or errno");
+
+	/* Generator works regardless of the properties being applied. */
+	cw_gen_set_speed(gen, 60);
+	cw_gen_enqueue_string(gen, "e");
+	cwret = cw_gen_wait_for_queue_level(gen, 0);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "play tones");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+
+#if defined(__linux__)
+	/* Memory locked for generator is unlocked when the generator is
+	   deleted, so repeated creation of generators doesn't use up
+	   RLIMIT_MEMLOCK. Only the sine table, shared by all generators,
+	   stays locked. */
+	if (status.memory_locked) {
+		const long locked_before = test_cw_gen_locked_kb();
+		bool all_locked = true;
+		for (int i = 0; i < 20; i++) {
+			cw_gen_config_t lock_conf = { .sound_system = CW_AUDIO_NULL, .lock_memory = true };
+			gen = cw_gen_new(&lock_conf);
+			cte->assert2(cte, NULL != gen, "failed to create generator with locked memory");
+			cw_gen_get_realtime_status(gen, &status);
+			all_locked = all_locked && status.memory_locked;
+			cw_gen_delete(&gen);
+		}
+		cte->expect_op_int(cte, true, "==", all_locked, "memory lock: repeated generators");
+		cte->expect_op_int(cte, locked_before, "==", test_cw_gen_locked_kb(), "memory lock: locked memory after deleting generators");
+	}
+#endif
+
+
+	/* No real-time properties requested: nothing applied, no errors. */
+	cw_gen_config_t default_conf = { .sound_system = CW_AUDIO_NULL };
+	gen = cw_gen_new(&default_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	cw_gen_start(gen);
+	cw_gen_get_realtime_status(gen, &status);
+	cte->expect_op_int(cte, false, "==", status.sched_applied || status.cpu_affinity_applied || status.memory_locked, "default: nothing applied");
+	cte->expect_op_int(cte, 0, "==", status.sched_errno + status.cpu_affinity_errno + status.memory_lock_errno, "default: no errors");
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	cwret = LIBCW_TEST_FUT(cw_gen_get_realtime_status)(NULL, &status);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "get real-time status of NULL generator");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   It's not a test of a "forever" function, but of "forever"
+   functionality.
+
+   Pay attention to CPU usage during execution of this function. I have been
+   experiencing 100% CPU usage on one of cores with ALSA sound system when HW
+   configuration of the ALSA sound system was incorrect.
+
+   @reviewed on 2020-10-15
+*/
+cwt_retv test_cw_gen_forever_internal(cw_test_executor_t * cte)
+{
+	const int loops = cte->get_loops_count(cte);
+	const int seconds = 7;
+
+	cte->print_test_header(cte, "%s (%d loops, %d seconds)", __func__, loops, seconds);
+
+	for (int i = 0; i < loops; i++) {
+		const cwt_retv rv = test_cw_gen_forever_sub(cte, seconds);
+		cte->expect_op_int(cte, cwt_retv_ok, "==", rv, "'forever' test");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @reviewed on 2020-05-10
+*/
+static cwt_retv test_cw_gen_forever_sub(cw_test_executor_t * cte, __attribute__((unused)) int seconds)
+{
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "failed to create generator\n");
+		return cwt_retv_err;
+	}
+
+	cw_gen_start(gen);
+
+	//sleep(1);
+
+	const int slope_duration = 10000; /* [us] duration of slope that should be 'pleasing' to ear. */
+	const int freq = cte->config->frequency;
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, freq, slope_duration, CW_SLOPE_MODE_RISING_SLOPE);
+	const cw_ret_t cwret1 = cw_tq_enqueue_internal(gen->tq, &tone);
+	cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret1, "enqueue first tone"); /* Use "errors only" here because this is not a core part of test. */
+
+	CW_TONE_INIT(&tone, freq, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
+	tone.is_forever = true;
+	tone.debug_id = 'f';
+	const cw_ret_t cwret2 = cw_tq_enqueue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret2, "enqueue forever tone");
+
+#ifdef __FreeBSD__  /* Tested on FreeBSD 10. */
+	/* Separate path for FreeBSD because for some reason signals
+	   badly interfere with value returned through second arg to
+	   nanolseep().  Try to run the section in #else under FreeBSD
+	   to see what happens - value returned by nanosleep() through
+	   "rem" will be increasing.  TODO: see if the problem still
+	   persists after moving from signals to conditional
+	   variables. */
+	fprintf(stderr, "enter any character to end \"forever\" tone\n");
+	char c;
+	scanf("%c", &c);
+#else
+	cw_usleep_internal(seconds * CW_USECS_PER_SEC);
+#endif
+
+	/* Silence the generator. */
+	CW_TONE_INIT(&tone, freq, slope_duration, CW_SLOPE_MODE_FALLING_SLOPE);
+	tone.debug_id = 'e';
+	const cw_ret_t cwret3 = cw_tq_enqueue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret3, "silence the generator");
+
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @reviewed on 2020-05-07
+*/
+cwt_retv test_cw_gen_get_timing_parameters_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	int initial = -5;
+
+	int dot_duration = initial;
+	int dash_duration = initial;
+	int ims_duration = initial;
+	int ics_duration = initial;
+	int iws_duration = initial;
+	int additional_space_duration = initial;
+	int adjustment_space_duration = initial;
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	cw_gen_start(gen);
+
+
+	cw_gen_reset_parameters_internal(gen);
+	/* Reset requires resynchronization. */
+	cw_gen_sync_parameters_internal(gen);
+
+
+	LIBCW_TEST_FUT(cw_gen_get_timing_parameters_internal)(gen,
+							      &dot_duration,
+							      &dash_duration,
+							      &ims_duration,
+							      &ics_duration,
+							      &iws_duration,
+							      &additional_space_duration,
+							      &adjustment_space_duration);
+
+	bool failure = (dot_duration == initial)
+		|| (dash_duration == initial)
+		|| (ims_duration == initial)
+		|| (ics_duration == initial)
+		|| (iws_duration == initial)
+		|| (additional_space_duration == initial)
+		|| (adjustment_space_duration == initial);
+	cte->expect_op_int(cte, false, "==", failure, "get timing parameters");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test setting and getting of some basic parameters
+
+   @reviewed on 2020-05-07
+*/
+cwt_retv test_cw_gen_parameter_getters_setters(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* No parameter will have value that is larger (for "max"
+	   params) or smaller (for "min" params) than this, so this is
+	   a good initial value. */
+	int off_limits = 10000;
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	/* It shouldn't matter for functions tested here if generator is started or not. */
+	cw_gen_start(gen);
+
+	struct {
+		/* There are tree functions that take part in the
+		   test: first gets range of acceptable values,
+		   seconds sets a new value of parameter, and third
+		   reads back the value. */
+
+		void (* get_limits)(int * min, int * max);
+		cw_ret_t (* set_new_value)(cw_gen_t * gen, int new_value);
+		int (* get_value)(cw_gen_t const * gen);
+
+		const int expected_min;     /* Expected value of minimum. */
+		const int expected_max;     /* Expected value of maximum. */
+
+		int readback_min;   /* Value returned by 'get_limits()' function. */
+		int readback_max;   /* Value returned by 'get_limits()' function. */
+
+		const char * name;
+	} test_data[] = {
+		{ LIBCW_TEST_FUT(cw_get_speed_limits),
+		  LIBCW_TEST_FUT(cw_gen_set_speed),
+		  LIBCW_TEST_FUT(cw_gen_get_speed),         CW_SPEED_MIN,      CW_SPEED_MAX,      off_limits,  -off_limits,  "speed"      },
+
+		{ LIBCW_TEST_FUT(cw_get_frequency_limits),
+		  LIBCW_TEST_FUT(cw_gen_set_frequency),
+		  LIBCW_TEST_FUT(cw_gen_get_frequency),     CW_FREQUENCY_MIN,  CW_FREQUENCY_MAX,  off_limits,  -off_limits,  "frequency"  },
+
+		{ LIBCW_TEST_FUT(cw_get_volume_limits),
+		  LIBCW_TEST_FUT(cw_gen_set_volume),
+		  LIBCW_TEST_FUT(cw_gen_get_volume),        CW_VOLUME_MIN,     CW_VOLUME_MAX,     off_limits,  -off_limits,  "volume"     },
+
+		{ LIBCW_TEST_FUT(cw_get_gap_limits),
+		  LIBCW_TEST_FUT(cw_gen_set_gap),
+		  LIBCW_TEST_FUT(cw_gen_get_gap),           CW_GAP_MIN,        CW_GAP_MAX,        off_limits,  -off_limits,  "gap"        },
+
+		{ LIBCW_TEST_FUT(cw_get_weighting_limits),
+		  LIBCW_TEST_FUT(cw_gen_set_weighting),
+		  LIBCW_TEST_FUT(cw_gen_get_weighting),     CW_WEIGHTING_MIN,  CW_WEIGHTING_MAX,  off_limits,  -off_limits,  "weighting"  },
+
+		{ NULL,
+		  NULL,
+		  NULL,                                     0,                 0,                 0,           0,            NULL         }
+	};
+
+
+	for (int i = 0; test_data[i].get_limits; i++) {
+
+		int value = 0;
+		int cwret = CW_FAILURE;
+
+		/* Test getting limits of values to be tested. */
+		test_data[i].get_limits(&test_data[i].readback_min, &test_data[i].readback_max);
+		if (!cte->expect_op_int(cte, test_data[i].expected_min, "==", test_data[i].readback_min, "get %s limits: min", test_data[i].name)) {
+			break;
+		}
+		if (!cte->expect_op_int(cte, test_data[i].expected_max, "==", test_data[i].readback_max, "get %s limits: max", test_data[i].name)) {
+			break;
+		}
+
+
+		/* Test setting out-of-range value lower than minimum. */
+		errno = 0;
+		value = test_data[i].readback_min - 1;
+		cwret = test_data[i].set_new_value(gen, value);
+		if (!cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set %s below limit (cwret)", test_data[i].name)) {
+			break;
+		}
+		if (!cte->expect_op_int(cte, EINVAL, "==", errno, "set %s below limit (errno)", test_data[i].name)) {
+			break;
+		}
+
+
+		/* Test setting out-of-range value higher than maximum. */
+		errno = 0;
+		value = test_data[i].readback_max + 1;
+		cwret = test_data[i].set_new_value(gen, value);
+		if (!cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set %s above limit (cwret)", test_data[i].name)) {
+			break;
+		}
+		if (!cte->expect_op_int(cte, EINVAL, "==", errno, "set %s above limit (errno)", test_data[i].name)) {
+			break;
+		}
+
+
+
+		/* Test setting in-range values. Set with setter and then read back with getter. */
+		bool set_within_range_cwret_failure = false;
+		bool set_within_range_errno_failure = false;
+		bool set_within_range_readback_failure = false;
+		for (int value_to_set = test_data[i].readback_min; value_to_set <= test_data[i].readback_max; value_to_set++) {
+			errno = 0;
+			cwret = test_data[i].set_new_value(gen, value_to_set);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "set %s within limits (cwret) (value to set = %d)", test_data[i].name, value_to_set)) {
+				set_within_range_cwret_failure = true;
+				break;
+			}
+			if (!cte->expect_op_int_errors_only(cte, 0, "==", errno, "set %s within limits (errno) (value to set = %d)", test_data[i].name, value_to_set)) {
+				set_within_range_errno_failure = true;
+				break;
+			}
+
+			const int readback_value = test_data[i].get_value(gen);
+			if (!cte->expect_op_int_errors_only(cte, readback_value, "==", value_to_set, "readback %s within limits (value to set = %d)", test_data[i].name, value_to_set)) {
+				set_within_range_readback_failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", set_within_range_cwret_failure,    "set %s within range (cwret)", test_data[i].name);
+		cte->expect_op_int(cte, false, "==", set_within_range_errno_failure,    "set %s within range (errno)", test_data[i].name);
+		cte->expect_op_int(cte, false, "==", set_within_range_readback_failure, "set %s within range (readback)", test_data[i].name);
+	}
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test control of generator's volume
+
+   Check that we can set the volume through its entire range.
+
+   @reviewed on 2020-05-05
+*/
+cwt_retv test_cw_gen_volume_functions(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int volume_delta = 1; /* [%] volume change in percent. */
+	const int tone_freq = cte->config->frequency;
+	const int tone_duration = 70000; /* [microseconds] Duration can't be too short, because the loops will run too fast. */
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+
+
+
+
+	/* Test: get range of allowed volumes. */
+	int volume_min = -1;
+	int volume_max = -1;
+	{
+		LIBCW_TEST_FUT(cw_get_volume_limits)(&volume_min, &volume_max);
+		const bool failure = volume_min != CW_VOLUME_MIN || volume_max != CW_VOLUME_MAX;
+		cte->expect_op_int(cte, false, "==", failure, "get volume limits: %d, %d", volume_min, volume_max);
+	}
+
+
+
+
+	/* Test: decrease volume from max to min. */
+	{
+		/* Few initial tones to make tone queue non-empty. */
+		for (int i = 0; i < 3; i++) {
+			cw_tone_t tone;
+			const int slope_mode = i == 0 ? CW_SLOPE_MODE_RISING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* Rising slope only in first tone in series of tones. */
+			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
+			cw_tq_enqueue_internal(gen->tq, &tone);
+		}
+
+		bool set_failure = false;
+		bool get_failure = false;
+
+		cw_gen_start(gen);
+
+		for (int vol = volume_max; vol >= volume_min; vol -= volume_delta) {
+
+			cw_tone_t tone;
+			const int slope_mode = vol == volume_min ? CW_SLOPE_MODE_FALLING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* No slopes in the middle - keep each level of tone constant at the beginning and end. */
+			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
+			cw_tq_enqueue_internal(gen->tq, &tone);
+
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_volume)(gen, vol);
+			if (!cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set volume (down, vol = %d)", vol)) {
+				set_failure = true;
+				break;
+			}
+
+			const int readback_value = LIBCW_TEST_FUT(cw_gen_get_volume)(gen);
+			if (!cte->expect_op_int(cte, readback_value, "==", vol, "get volume (down, vol = %d)", vol)) {
+				get_failure = true;
+				break;
+			}
+			//fprintf(stderr, "len = %zd\n", cw_gen_get_queue_length(gen));
+
+			cw_gen_wait_for_queue_level(gen, 1);
+		}
+
+		cw_gen_wait_for_queue_level(gen, 0);
+		usleep(2 * tone_duration);
+		cw_gen_stop(gen);
+
+		cte->expect_op_int(cte, false, "==", set_failure, "set volume (down)");
+		cte->expect_op_int(cte, false, "==", get_failure, "get volume (down)");
+	}
+
+
+
+
+	/* Test: increase volume from min to max. */
+	{
+		/* Few initial tones to make tone queue non-empty. */
+		for (int i = 0; i < 3; i++) {
+			cw_tone_t tone;
+			const int slope_mode = i == 0 ? CW_SLOPE_MODE_RISING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* Rising slope only in first tone in series of tones. */
+			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
+			cw_tq_enqueue_internal(gen->tq, &tone);
+		}
+
+		bool set_failure = false;
+		bool get_failure = false;
+
+		cw_gen_start(gen);
+
+		for (int vol = volume_min; vol <= volume_max; vol += volume_delta) {
+
+			cw_tone_t tone;
+			const int slope_mode = vol == volume_max ? CW_SLOPE_MODE_FALLING_SLOPE : CW_SLOPE_MODE_NO_SLOPES; /* No slopes in the middle - keep each level of tone constant at the beginning and end. */
+			CW_TONE_INIT(&tone, tone_freq, tone_duration, slope_mode);
+			cw_tq_enqueue_internal(gen->tq, &tone);
+
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_volume)(gen, vol);
+			if (!cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set volume (up, vol = %d)", vol)) {
+				set_failure = true;
+				break;
+			}
+
+			const int readback_value = LIBCW_TEST_FUT(cw_gen_get_volume)(gen);
+			if (!cte->expect_op_int(cte, readback_value, "==", vol, "get volume (up, vol = %d)", vol)) {
+				get_failure = true;
+				break;
+			}
+			//fprintf(stderr, "len = %zd\n", cw_gen_get_queue_length(gen));
+
+			cw_gen_wait_for_queue_level(gen, 1);
+		}
+
+		cw_gen_wait_for_queue_level(gen, 0);
+		usleep(2 * tone_duration);
+		cw_gen_stop(gen);
+
+		cte->expect_op_int(cte, false, "==", set_failure, "set volume (up)");
+		cte->expect_op_int(cte, false, "==", get_failure, "get volume (up)");
+	}
+
+#if 0
+	/*
+	  FIXME: check behaviour of these function for empty tone
+	  queue, particularly if each of the functions is called one
+	  after another, like this:
+	  cw_gen_wait_for_end_of_current_tone(gen);
+	  cw_gen_wait_for_end_of_current_tone(gen);
+
+	  or this:
+	  cw_gen_wait_for_queue_level(gen, 0);
+	  cw_gen_wait_for_queue_level(gen, 0);
+	*/
+	cw_gen_wait_for_end_of_current_tone(gen);
+	cw_gen_wait_for_queue_level(gen, 0);
+#endif
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test enqueueing and playing most basic elements of Morse code
+
+   @reviewed on 2020-05-09
+*/
+cwt_retv test_cw_gen_enqueue_primitives(cw_test_executor_t * cte)
+{
+	const int loops = cte->get_loops_count(cte);
+
+	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_start(gen);
+
+	/* Test: playing dots. */
+	{
+		bool failure = false;
+		for (int i = 0; i < loops; i++) {
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_mark_internal)(gen, CW_DOT_REPRESENTATION, false);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue mark internal(CW_DOT_REPRESENTATION) (i = %d)", i)) {
+				failure = true;
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+
+		cte->expect_op_int(cte, false, "==", failure, "enqueue mark internal(CW_DOT_REPRESENTATION)");
+	}
+
+
+
+	/* Test: playing dashes. */
+	{
+		bool failure = false;
+		for (int i = 0; i < loops; i++) {
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_mark_internal)(gen, CW_DASH_REPRESENTATION, false);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue mark internal(CW_DASH_REPRESENTATION) (i = %d)", i)) {
+				failure = true;
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+
+		cte->expect_op_int(cte, false, "==", failure, "enqueue mark internal(CW_DASH_REPRESENTATION)");
+	}
+
+
+	/* Test: playing inter-character-spaces. */
+	{
+		bool failure = false;
+		for (int i = 0; i < loops; i++) {
+			/* TODO: this function adds 2-Unit space, not a
+			   regular 3-Unit inter-character-space. Be aware of
+			   this fact. */
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_2u_ics_internal)(gen);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue ics internal() (i = %d)", i)) {
+				failure = true;
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+
+		cte->expect_op_int(cte, false, "==", failure, "enqueue ics internal()");
+	}
+
+
+	/* Test: playing inter-word-spaces. */
+	{
+		bool failure = false;
+		for (int i = 0; i < loops; i++) {
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_iws_internal)(gen);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue iws internal() (i = %d)", i)) {
+				failure = true;
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+
+		cte->expect_op_int(cte, false, "==", failure, "enqueue iws internal()");
+	}
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test playing representations of characters
+
+   @reviewed on 2020-05-09
+*/
+cwt_retv test_cw_gen_enqueue_representations(cw_test_executor_t * cte)
+{
+	const int loops = cte->get_loops_count(cte);
+
+	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+
+	/* Representation is valid when it contains dots and dashes only.
+	   cw_gen_enqueue_representation*() doesn't check if given
+	   representation represents a supported character. */
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_start(gen);
+
+	/* Test: playing valid representations. */
+	{
+		bool failure = false;
+		for (int rep = 0; rep < loops; rep++) {
+			int i = 0;
+			while (NULL != test_valid_representations[i]) {
+				cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation)(gen, test_valid_representations[i]);
+				if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue representation(<valid>) (%d)", i)) {
+					failure = true;
+					break;
+				}
+				cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation_no_ics)(gen, test_valid_representations[i]);
+				if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue representation, no ics(<valid>) (%d)", i)) {
+					failure = true;
+					break;
+				}
+				i++;
+			}
+			if (failure) {
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+		cte->expect_op_int(cte, false, "==", failure, "enqueue representation internal(<valid>)");
+	}
+
+
+	/* Test: trying to play invalid representations. */
+	{
+		bool failure = false;
+		for (int rep = 0; rep < loops; rep++) {
+			int i = 0;
+			while (NULL != test_invalid_representations[i]) {
+				cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation)(gen, test_invalid_representations[i]);
+				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue representation(<invalid>) (%d)", i)) {
+					failure = true;
+					break;
+				}
+				cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation_no_ics)(gen, test_invalid_representations[i]);
+				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue representation, no ics(<invalid>) (%d)", i)) {
+					failure = true;
+					break;
+				}
+				i++;
+			}
+			if (failure) {
+				break;
+			}
+		}
+		cw_gen_wait_for_queue_level(gen, 0);
+		cte->expect_op_int(cte, false, "==", failure, "enqueue representation internal(<invalid>)");
+	}
+
+#if 0
+	/* TODO: remove this. We wait here for generator's queue to
+	   drain completely, and this should be done in some other
+	   way. */
+	cw_usleep_internal(1 * CW_USECS_PER_SEC);
+#endif
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Play all supported characters as individual characters
+
+   @reviewed on 2020-05-09
+*/
+cwt_retv test_cw_gen_enqueue_character(cw_test_executor_t * cte)
+{
+	const int loops = cte->get_loops_count(cte);
+
+	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_start(gen);
+
+	/* Test: play all supported characters as individual characters. */
+	{
+		char charlist[UCHAR_MAX + 1] = { 0 };
+		bool failure = false;
+
+		/* Enqueue all the characters from the charlist individually. */
+		cw_list_characters(charlist);
+		cte->log_info(cte,
+			      "enqueue character(<valid>):\n"
+			      "       ");
+		for (int i = 0; charlist[i] != '\0'; i++) {
+			cte->log_info_cont(cte, "%c", charlist[i]);
+			cte->flush_info(cte);
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, charlist[i]);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue character(<valid>) (i = %d, char = '%c')", i, charlist[i])) {
+				failure = true;
+				break;
+			}
+			cw_gen_wait_for_queue_level(gen, 0); /* TODO: the queue level should be randomized. */
+		}
+		cte->log_info_cont(cte, "\n");
+		cte->flush_info(cte);
+
+		cte->expect_op_int(cte, false, "==", failure, "enqueue character(<valid>)");
+	}
+
+
+	/* Test: trying to play invalid characters. */
+	{
+		bool failure = false;
+		for (int rep = 0; rep < loops; rep++) {
+			const char invalid_characters[] = { 0x00, 0x01 }; /* List of invalid characters to be enqueued. */
+			const int n = sizeof (invalid_characters) / sizeof (invalid_characters[0]);
+
+			for (int i = 0; i < n; i++) {
+				const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, invalid_characters[i]);
+				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue character(<invalid>) (i = %d)", i)) {
+					failure = true;
+					break;
+				}
+			}
+			if (failure) {
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "enqueue character(<invalid>)");
+	}
+
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Enqueue all supported characters as a single string
+
+   @reviewed on 2020-05-09
+*/
+cwt_retv test_cw_gen_enqueue_string(cw_test_executor_t * cte)
+{
+	const int loops = cte->get_loops_count(cte);
+
+	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_start(gen);
+
+	/* Test: playing all supported characters as single string. */
+	{
+		char charlist[UCHAR_MAX + 1] = { 0 };
+		cw_list_characters(charlist);
+
+		/* Enqueue the complete charlist as a single string. */
+		cte->log_info(cte,
+			      "enqueue string(<valid>):\n"
+			      "       %s\n", charlist);
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_string)(gen, charlist);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue string(<valid>)");
+
+
+		while (cw_gen_get_queue_length(gen) > 0) {
+			cte->log_info(cte, "tone queue length %-6zu\r", cw_gen_get_queue_length(gen));
+			cte->flush_info(cte);
+			cw_gen_wait_for_end_of_current_tone(gen);
+		}
+		cte->log_info(cte, "tone queue length %-6zu\n", cw_gen_get_queue_length(gen));
+		cte->flush_info(cte);
+		cw_gen_wait_for_queue_level(gen, 0);
+	}
+
+
+	/* Test: trying to enqueue invalid strings. */
+	{
+		bool failure = false;
+		for (int rep = 0; rep < loops; rep++) {
+			int i = 0;
+			while (NULL != test_invalid_strings[i]) {
+				const char * test_string = test_invalid_strings[i];
+				const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_string)(gen, test_string);
+				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue string(<invalid>) (i = %d, string = '%s')", i, test_string)) {
+					failure = true;
+					break;
 				}
 				i++;
 			}
-			if (failure) {
+			if (failure) {
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "enqueue string(<invalid>)");
+	}
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test enqueueing arrays of tones, and enqueueing of string in batches
+*/
+cwt_retv test_cw_gen_enqueue_tones(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	/* Generator is not started, so tones stay in queue. */
+
+	/* Test: valid tones. Tones with zero duration are ignored. */
+	{
+		const cw_gen_tone_t tones[] = {
+			{ 600, 50000, true },
+			{   0, 50000, false },
+			{ 600,     0, false },
+			{ 600, 150000, false },
+			{   0, 50000, false },
+		};
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, sizeof (tones) / sizeof (tones[0]));
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue valid tones");
+		cte->expect_op_int(cte, 4, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing valid tones");
+	}
+
+	/* Test: one invalid tone in array. None of tones is enqueued. */
+	{
+		const cw_gen_tone_t tones[] = {
+			{ 600, 50000, true },
+			{ CW_FREQUENCY_MAX + 1, 50000, false },
+		};
+		errno = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, sizeof (tones) / sizeof (tones[0]));
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueue invalid tones");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing invalid tones");
+		cte->expect_op_int(cte, 4, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing invalid tones");
+	}
+
+	/* Test: more tones than there is space in queue. None of tones is enqueued. */
+	{
+		const size_t n_tones = CW_TONE_QUEUE_CAPACITY_DEFAULT;
+		cw_gen_tone_t * tones = (cw_gen_tone_t *) calloc(n_tones, sizeof (cw_gen_tone_t));
+		cte->assert2(cte, NULL != tones, "failed to allocate tones");
+		for (size_t i = 0; i < n_tones; i++) {
+			tones[i].frequency = 600;
+			tones[i].duration = 1000;
+		}
+		errno = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, n_tones);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueue too many tones");
+		cte->expect_op_int(cte, EAGAIN, "==", errno, "errno after enqueueing too many tones");
+		cte->expect_op_int(cte, 4, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing too many tones");
+		free(tones);
+	}
+
+	/* Test: string enqueued in batches results in the same tones as
+	   string enqueued character by character. */
+	{
+		const char * string = "PARIS PARIS";
+
+		cw_gen_flush_queue(gen);
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_string)(gen, string);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue string");
+		const size_t string_len = cw_gen_get_queue_length(gen);
+
+		cw_gen_flush_queue(gen);
+		bool failure = false;
+		for (size_t i = 0; i < strlen(string); i++) {
+			if (CW_SUCCESS != cw_gen_enqueue_character(gen, string[i])) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "enqueue characters");
+		const size_t characters_len = cw_gen_get_queue_length(gen);
+
+		cte->expect_op_int(cte, (int) characters_len, "==", (int) string_len, "queue length after enqueueing string and characters");
+	}
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test table of characters compiled into tones
+
+   Tones of a character taken from the table must be the same as tones
+   built from representation of the character, and the table must follow
+   changes of generator's parameters.
+*/
+cwt_retv test_cw_gen_char_tones(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	/* Generator is not started, so tones stay in queue. */
+
+	const int speeds[] = { 12, 40, 40 };
+	const int frequencies[] = { 600, 600, 900 };
+	for (int round = 0; round < 3; round++) {
+		cw_gen_set_speed(gen, speeds[round]);
+		cw_gen_set_frequency(gen, frequencies[round]);
+
+		/* "-.-." from compiled table, and the same representation
+		   built mark by mark. */
+		cw_gen_flush_queue(gen);
+		cw_gen_enqueue_character_no_ics(gen, 'C');
+		cw_gen_enqueue_representation_no_ics(gen, "-.-.");
+		const size_t len = cw_gen_get_queue_length(gen);
+		cte->expect_op_int(cte, 16, "==", (int) len, "queue length (round %d)", round);
+
+		cw_tone_t compiled[8];
+		cw_tone_t built[8];
+		for (int i = 0; i < 8; i++) {
+			cw_tq_dequeue_internal(gen->tq, &compiled[i]);
+		}
+		for (int i = 0; i < 8; i++) {
+			cw_tq_dequeue_internal(gen->tq, &built[i]);
+		}
+
+		bool failure = false;
+		for (int i = 0; i < 8; i++) {
+			/* Tones of compiled character come with samples count calculated. */
+			cw_tone_t expected = built[i];
+			cw_gen_tone_calculate_samples_size_internal(gen, &expected);
+
+			if (compiled[i].frequency != expected.frequency
+			    || compiled[i].duration != expected.duration
+			    || compiled[i].is_first != expected.is_first
+			    || compiled[i].n_samples != expected.n_samples
+			    || compiled[i].rising_slope_n_samples != expected.rising_slope_n_samples
+			    || compiled[i].falling_slope_n_samples != expected.falling_slope_n_samples) {
+
+				cte->log_error(cte, "%s:%d: tone #%d: %d/%d Hz, %d/%d us, %"PRId64"/%"PRId64" samples\n",
+					       __func__, __LINE__, i,
+					       compiled[i].frequency, expected.frequency,
+					       compiled[i].duration, expected.duration,
+					       compiled[i].n_samples, expected.n_samples);
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "compiled tones of character (speed %d, frequency %d)", speeds[round], frequencies[round]);
+	}
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test changes of generator's parameters made after tones have been enqueued
+
+   Tones of characters and spaces have symbolic durations, resolved with
+   parameters valid at the moment of dequeueing. Tones with explicit
+   duration are not affected.
+*/
+cwt_retv test_cw_gen_hot_parameters(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	/* Generator is not started, so tones stay in queue. */
+
+	const cw_gen_tone_t explicit_tone = { .frequency = 700, .duration = 30000, .is_first = true };
+
+	for (int coalesce = 0; coalesce <= 1; coalesce++) {
+		cw_tq_set_coalescing_internal(gen->tq, coalesce);
+
+		cw_gen_set_speed(gen, 12);
+		cw_gen_set_frequency(gen, 600);
+		cw_gen_set_gap(gen, 2);
+		cw_gen_flush_queue(gen);
+
+		cw_gen_enqueue_string(gen, "A ");
+		cw_gen_enqueue_tones(gen, &explicit_tone, 1);
+		const int old_dot_duration = gen->dot_duration;
+
+		/* New parameters, after the tones have been enqueued. */
+		cw_gen_set_speed(gen, 40);
+		cw_gen_set_frequency(gen, 900);
+		cte->expect_op_int(cte, old_dot_duration, "!=", gen->dot_duration, "dot duration has changed (coalescing %d)", coalesce);
+
+		const int ics = gen->ics_duration + gen->additional_space_duration;
+		const int iws_part = gen->iws_duration / 2;
+		const int adjustment = gen->adjustment_space_duration;
+		/* cw_gen_enqueue_string() adds inter-character-space also
+		   after ' '. */
+		int expected_durations[10] = { gen->dot_duration, gen->ims_duration, gen->dash_duration, gen->ims_duration };
+		int expected_frequencies[10] = { 900, 0, 900, 0 };
+		int n_tones = 4;
+		if (coalesce) {
+			/* Silent tones at the end of 'A' and of inter-word-space
+			   are merged in the queue into one tone. */
+			expected_durations[n_tones - 1] += ics + 2 * iws_part + adjustment + ics;
+		} else {
+			expected_durations[n_tones++] = ics;
+			expected_durations[n_tones++] = iws_part;
+			expected_durations[n_tones++] = iws_part;
+			expected_durations[n_tones++] = adjustment;
+			expected_durations[n_tones++] = ics;
+		}
+		expected_frequencies[n_tones] = explicit_tone.frequency;
+		expected_durations[n_tones++] = explicit_tone.duration;
+		cte->expect_op_int(cte, n_tones, "==", (int) cw_gen_get_queue_length(gen), "queue length (coalescing %d)", coalesce);
+
+		bool failure = false;
+		for (int i = 0; i < n_tones; i++) {
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(gen->tq, &tone);
+			LIBCW_TEST_FUT(cw_gen_tone_resolve_elements_internal)(gen, &tone);
+			if (tone.duration != expected_durations[i] || tone.frequency != expected_frequencies[i]) {
+				cte->log_error(cte, "%s:%d: tone #%d: %d/%d Hz, %d/%d us\n",
+					       __func__, __LINE__, i,
+					       tone.frequency, expected_frequencies[i],
+					       tone.duration, expected_durations[i]);
+				failure = true;
+			}
+			/* The count of samples pre-calculated at compilation of
+			   character is no longer valid. */
+			if (tone.elements != 0 && tone.n_samples != 0) {
+				cte->log_error(cte, "%s:%d: tone #%d: count of samples not reset: %"PRId64"\n",
+					       __func__, __LINE__, i, tone.n_samples);
+				failure = true;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "tones use parameters valid at dequeue time (coalescing %d)", coalesce);
+	}
+
+	gen_destroy(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test removing a character from end of enqueued characters
+
+   @reviewed on 2020-08-24
+*/
+cwt_retv test_cw_gen_remove_last_character(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_gen_t * gen = NULL;
+	if (cwt_retv_ok != gen_setup(cte, &gen)) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	const int n = 4;
+	bool failure = false;
+	for (int to_remove = 0; to_remove <= n; to_remove++) {
+		cw_gen_start(gen);
+
+		cte->log_info(cte, "You will now hear 'oooo' followed by %d 's' characters\n", n - to_remove);
+		cw_gen_enqueue_string(gen, "oooo" "ssss");
+
+		/* Remove N characters from end. */
+		for (int i = 0; i < to_remove; i++) {
+			cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_remove_last_character(gen));
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret,
+							    "remove last %d characters, removing %d-th character",
+							    to_remove, i)) {
+				failure = true;
+				break;
+			}
+		}
+
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_usleep_internal(1000 * 1000);
+		cw_gen_stop(gen);
+
+		if (failure) {
+			break;
+		}
+	}
+
+	gen_destroy(&gen);
+
+	cte->expect_op_int(cte, false, "==", failure, "remove last character");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test keying output: arguments checks, deadlines and queue of events
+
+   Devices for keying of transmitter are not available in test
+   environment, so the thread of keying output is not started.
+*/
+cwt_retv test_cw_gen_keying(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Deadlines. */
+	{
+		const int64_t now = 1000000000;
+		cte->expect_op_int(cte, 1000000000 + 30000000, "==", (int) LIBCW_TEST_FUT(cw_keying_deadline_internal)(now, 20000, 10000), "deadline with latency and delay");
+		cte->expect_op_int(cte, 1000000000 + 5000000, "==", (int) LIBCW_TEST_FUT(cw_keying_deadline_internal)(now, 20000, -15000), "deadline with latency and advance");
+		cte->expect_op_int(cte, 1000000000, "==", (int) LIBCW_TEST_FUT(cw_keying_deadline_internal)(now, 20000, -50000), "advance larger than latency");
+	}
+
+	errno = 0;
+	cw_keying_t * keying = LIBCW_TEST_FUT(cw_keying_new)(NULL);
+	cte->expect_null_pointer(cte, keying, "new keying output with NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+
+	keying = LIBCW_TEST_FUT(cw_keying_new)(gen);
+	cte->assert2(cte, NULL != keying, "failed to create keying output");
+
+	/* Arguments checks. */
+	{
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_keying_start)(keying);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "start without device");
+
+		cwret = LIBCW_TEST_FUT(cw_keying_open_serial)(keying, "/dev/null", CW_KEYING_SERIAL_RTS, false);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "serial port that is not a tty");
+
+		cwret = LIBCW_TEST_FUT(cw_keying_open_parport)(keying, "/dev/null", 8, false);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "invalid data pin of parallel port");
+
+		cwret = LIBCW_TEST_FUT(cw_keying_set_offset)(keying, CW_KEYING_OFFSET_MAX + 1);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "offset out of range");
+
+		cwret = LIBCW_TEST_FUT(cw_keying_set_offset)(keying, -CW_KEYING_OFFSET_MAX);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "offset at lower limit");
+		cte->expect_op_int(cte, -CW_KEYING_OFFSET_MAX, "==", LIBCW_TEST_FUT(cw_keying_get_offset)(keying), "get offset");
+	}
+
+	/* Deadlines of queued events never decrease, even if offset
+	   decreases between events. */
+	{
+		cw_keying_set_offset(keying, 100000);
+		const int64_t before = cw_clock_now_internal();
+		LIBCW_TEST_FUT(cw_keying_push_internal)(keying, CW_KEY_VALUE_CLOSED);
+		const int64_t after = cw_clock_now_internal();
+		cw_keying_set_offset(keying, -100000);
+		LIBCW_TEST_FUT(cw_keying_push_internal)(keying, CW_KEY_VALUE_OPEN);
+
+		cte->expect_op_int(cte, 2, "==", keying->events_count, "count of queued events");
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", keying->events[0].value, "value of first event");
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", keying->events[1].value, "value of second event");
+		cte->expect_op_int(cte, 1, "==", keying->events[1].deadline >= keying->events[0].deadline, "order of deadlines");
+
+		/* Deadlines are on the same clock as generator's pacing. */
+		const int64_t latency = cw_gen_latency_get_sound_device_latency_internal(gen);
+		const int64_t earliest = cw_keying_deadline_internal(before, latency, 100000);
+		const int64_t latest = cw_keying_deadline_internal(after, latency, 100000);
+		cte->expect_op_int(cte, 1, "==", keying->events[0].deadline >= earliest && keying->events[0].deadline <= latest, "deadline on library's clock");
+	}
+
+	cw_keying_delete(&keying);
+	cte->expect_null_pointer(cte, keying, "deleted keying output");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test mixer: summing of channels, and playing of many channels through one File sound device
+*/
+cwt_retv test_cw_gen_mixer(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Summing and clipping of samples. */
+	{
+		const cw_sample_t a[4] = { 1000, -1000, 30000, -30000 };
+		const cw_sample_t b[4] = { 2000, -3000, 10000, -10000 };
+		int32_t sum[4] = { 0 };
+		cw_sample_t out[4] = { 0 };
+		const int volumes[1] = { CW_VOLUME_MAX };
+		LIBCW_TEST_FUT(cw_mixer_mix_internal)(a, 4, volumes, 1, sum);
+		LIBCW_TEST_FUT(cw_mixer_mix_internal)(b, 4, volumes, 1, sum);
+		LIBCW_TEST_FUT(cw_mixer_clip_internal)(sum, out, 4, CW_SAMPLE_FORMAT_S16);
+		cte->expect_op_int(cte, 3000, "==", out[0], "sum of positive samples");
+		cte->expect_op_int(cte, -4000, "==", out[1], "sum of negative samples");
+		cte->expect_op_int(cte, INT16_MAX, "==", out[2], "positive sum is clipped");
+		cte->expect_op_int(cte, INT16_MIN, "==", out[3], "negative sum is clipped");
+	}
+
+	/* Arguments checks. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .file_fd = -1 };
+		errno = 0;
+		cw_mixer_t * mixer = LIBCW_TEST_FUT(cw_mixer_new)(&gen_conf, 2);
+		cte->expect_null_pointer(cte, mixer, "mixer with sound system that doesn't play samples");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for invalid sound system");
+
+		gen_conf.sound_system = CW_AUDIO_FILE;
+		gen_conf.file_format = CW_FILE_FORMAT_RAW;
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "/dev/null");
+		mixer = LIBCW_TEST_FUT(cw_mixer_new)(&gen_conf, 0);
+		cte->expect_null_pointer(cte, mixer, "mixer without channels");
+		mixer = LIBCW_TEST_FUT(cw_mixer_new)(&gen_conf, CW_MIXER_N_CHANNELS_MAX + 1);
+		cte->expect_null_pointer(cte, mixer, "mixer with too many channels");
+
+		mixer = LIBCW_TEST_FUT(cw_mixer_new)(&gen_conf, 2);
+		cte->assert2(cte, NULL != mixer, "failed to create mixer");
+		cte->expect_op_int(cte, 2, "==", LIBCW_TEST_FUT(cw_mixer_get_n_channels)(mixer), "count of channels");
+		cte->expect_valid_pointer(cte, LIBCW_TEST_FUT(cw_mixer_get_channel)(mixer, 1), "last channel");
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_mixer_get_channel)(mixer, 2), "channel out of range");
+		cw_mixer_delete(&mixer);
+		cte->expect_null_pointer(cte, mixer, "pointer to deleted mixer");
+	}
+
+	/* Channels with tones of different frequencies and durations are
+	   played at the same time. Output lasts as long as the longest
+	   of the tones. */
+	{
+		char path[] = "/tmp/libcw_mixer_XXXXXX";
+		int fd = mkstemp(path);
+		cte->assert2(cte, -1 != fd, "failed to create temporary file");
+
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+		cw_mixer_t * mixer = cw_mixer_new(&gen_conf, 3);
+		cte->assert2(cte, NULL != mixer, "failed to create mixer with File sound system");
+		const unsigned int sample_rate = mixer->output->sample_rate;
+		const int buffer_n_samples = mixer->output->buffer_n_samples;
+
+		const int durations[3] = { 100000, 300000, 0 }; /* [us] */
+		for (int i = 0; i < 3; i++) {
+			cw_gen_t * channel = cw_mixer_get_channel(mixer, i);
+			cw_gen_set_volume(channel, 30);
+			if (0 != durations[i]) {
+				cw_tone_t tone;
+				CW_TONE_INIT(&tone, 500 + 300 * i, durations[i], CW_SLOPE_MODE_STANDARD_SLOPES);
+				cw_tq_enqueue_internal(channel->tq, &tone);
+			}
+		}
+
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_start)(mixer), "start mixer");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_start)(mixer), "start of started mixer");
+
+		/* Output is not paced, so this shouldn't take long. */
+		bool playing = true;
+		for (int i = 0; i < 500 && playing; i++) {
+			cw_usleep_internal(10000);
+			playing = false;
+			for (int c = 0; c < 3; c++) {
+				const cw_gen_t * channel = cw_mixer_get_channel(mixer, c);
+				playing = playing || channel->pull.tone_in_progress || 0 != cw_tq_length_internal(channel->tq);
+			}
+		}
+		cte->expect_op_int(cte, false, "==", playing, "all channels have been played");
+
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_stop)(mixer), "stop mixer");
+		cw_gen_stats_t stats = { 0 };
+		cw_gen_get_stats(mixer->output, &stats);
+		cw_mixer_delete(&mixer);
+
+		const off_t file_size = lseek(fd, 0, SEEK_END);
+		close(fd);
+		unlink(path);
+
+		const int expected_n_samples = (int) (((int64_t) sample_rate * durations[1]) / CW_USECS_PER_SEC);
+		cte->expect_between_int(cte, expected_n_samples, (int) (file_size / 2), expected_n_samples + 2 * buffer_n_samples, "count of samples of longest channel");
+		cte->expect_op_int(cte, (int) (file_size / 2), "==", (int) stats.n_samples_written, "samples are counted in statistics of output");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Sink of tap that is slower than real time. */
+static cw_ret_t test_cw_gen_tap_slow_write_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_usleep_internal(20000);
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Test taps: samples of generator played on more sound sinks
+*/
+cwt_retv test_cw_gen_tap(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Arguments checks. */
+	{
+		const int fd = open("/dev/null", O_WRONLY);
+		cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+		cw_gen_config_t file_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+		cw_gen_config_t null_conf = { .sound_system = CW_AUDIO_NULL };
+
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(NULL, &file_conf), "tap of NULL generator");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+
+		cw_gen_t * gen = cw_gen_new(&null_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with Null sound system");
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(gen, &file_conf), "tap of generator that doesn't play samples");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for generator that doesn't play samples");
+		cw_gen_delete(&gen);
+
+		gen = cw_gen_new(&file_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(gen, NULL), "tap without configuration");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for tap without configuration");
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(gen, &null_conf), "tap with sink that doesn't play samples");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for sink that doesn't play samples");
+		cw_gen_config_t other_rate_conf = file_conf;
+		other_rate_conf.file_sample_rate = 8000;
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(gen, &other_rate_conf), "tap with different sample rate");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for different sample rate");
+
+		cw_gen_start(gen);
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_add_tap)(gen, &file_conf), "tap of started generator");
+		cte->expect_op_int(cte, EBUSY, "==", errno, "errno for started generator");
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+		close(fd);
+	}
+
+	/* Generator and two taps write the same samples to three files. */
+	{
+		const int duration = 300000; /* [us] */
+		char paths[3][32];
+		int fds[3];
+		cw_gen_config_t confs[3];
+		for (int i = 0; i < 3; i++) {
+			snprintf(paths[i], sizeof (paths[i]), "/tmp/libcw_tap_XXXXXX");
+			fds[i] = mkstemp(paths[i]);
+			cte->assert2(cte, -1 != fds[i], "failed to create temporary file");
+			/* Generator is paced to real time, taps are not: they
+			   always keep up with the generator. */
+			confs[i] = (cw_gen_config_t) { .sound_system = CW_AUDIO_FILE, .file_fd = fds[i], .file_format = CW_FILE_FORMAT_RAW, .file_realtime = 0 == i };
+		}
+
+		cw_gen_t * gen = cw_gen_new(&confs[0]);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+		cw_tap_t * taps[2] = { NULL, NULL };
+		for (int i = 0; i < 2; i++) {
+			taps[i] = LIBCW_TEST_FUT(cw_gen_add_tap)(gen, &confs[i + 1]);
+			cte->expect_valid_pointer(cte, taps[i], "add tap %d", i);
+		}
+		const int buffer_n_samples = gen->buffer_n_samples;
+		const unsigned int sample_rate = gen->sample_rate;
+
+		cw_gen_start(gen);
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 700, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
+		cw_gen_stop(gen);
+
+		cw_tap_stats_t stats[2];
+		for (int i = 0; i < 2; i++) {
+			LIBCW_TEST_FUT(cw_tap_get_stats)(taps[i], &stats[i]);
+		}
+		/* Taps are deleted (and their files are flushed) together
+		   with generator. */
+		cw_gen_delete(&gen);
+
+		off_t sizes[3];
+		for (int i = 0; i < 3; i++) {
+			sizes[i] = lseek(fds[i], 0, SEEK_END);
+		}
+		const int expected_n_samples = (int) (((int64_t) sample_rate * duration) / CW_USECS_PER_SEC);
+		cte->expect_between_int(cte, expected_n_samples, (int) (sizes[1] / 2), (int) (sizes[0] / 2), "count of samples of tap");
+		cte->expect_op_int(cte, (int) sizes[1], "==", (int) sizes[2], "taps have written the same count of samples");
+
+		/* Samples of taps are the samples of generator. */
+		cw_sample_t * samples[3];
+		for (int i = 0; i < 3; i++) {
+			samples[i] = (cw_sample_t *) malloc((size_t) sizes[0]);
+			cte->assert2(cte, NULL != samples[i], "failed to allocate samples");
+			cte->expect_op_int(cte, (int) sizes[i], "==", (int) pread(fds[i], samples[i], (size_t) sizes[i], 0), "reading file %d", i);
+		}
+		cte->expect_op_int(cte, 0, "==", memcmp(samples[0], samples[1], (size_t) sizes[1]), "samples of first tap");
+		cte->expect_op_int(cte, 0, "==", memcmp(samples[0], samples[2], (size_t) sizes[2]), "samples of second tap");
+
+		for (int i = 0; i < 2; i++) {
+			cte->expect_op_int(cte, 0, "==", (int) stats[i].n_dropped, "tap %d: dropped buffers", i);
+			cte->expect_op_int(cte, 0, "==", (int) stats[i].n_errors, "tap %d: failed writes", i);
+			cte->expect_op_int(cte, (int) (sizes[i + 1] / 2 / buffer_n_samples), "==", (int) stats[i].n_buffers, "tap %d: written buffers", i);
+		}
+		for (int i = 0; i < 3; i++) {
+			free(samples[i]);
+			close(fds[i]);
+			unlink(paths[i]);
+		}
+	}
+
+	/* Slow sink doesn't stall generator: buffers that don't fit in
+	   queue of the tap are dropped. */
+	{
+		const int duration = 1000000; /* [us] */
+		const int fd = open("/dev/null", O_WRONLY);
+		cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+		cw_tap_t * tap = cw_gen_add_tap(gen, &gen_conf);
+		cte->assert2(cte, NULL != tap, "failed to add tap");
+		tap->sink->write_buffer_to_sound_device = test_cw_gen_tap_slow_write_internal;
+
+		struct timeval start;
+		cw_clock_get_timeval_internal(&start);
+
+		cw_gen_start(gen);
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 700, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
+
+		struct timeval stop;
+		cw_clock_get_timeval_internal(&stop);
+		const int elapsed = cw_timestamp_compare_internal(&start, &stop);
+
+		cw_gen_stats_t gen_stats = { 0 };
+		cw_gen_get_stats(gen, &gen_stats);
+		const int n_buffers = (int) gen_stats.n_buffers_written;
+		const int slow_duration = n_buffers * 20000;
+		cte->expect_op_int(cte, slow_duration / 2, ">", elapsed, "generator is not stalled by slow tap");
+
+		/* Let the tap write what is left in its queue. */
+		cw_tap_stats_t stats = { 0 };
+		for (int i = 0; i < 200; i++) {
+			cw_tap_get_stats(tap, &stats);
+			if ((int) (stats.n_buffers + stats.n_dropped) >= n_buffers) {
 				break;
 			}
+			cw_usleep_internal(10000);
+		}
+		cte->expect_op_int(cte, 0, "<", (int) stats.n_dropped, "slow tap has dropped buffers");
+		cte->expect_op_int(cte, n_buffers, "==", (int) (stats.n_buffers + stats.n_dropped), "every buffer has been written or dropped");
+
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+		close(fd);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Read interleaved 16-bit samples from file, find peak of each of two channels
+
+   @param[in] fd file descriptor
+   @param[in] offset offset of first sample in file
+   @param[out] peaks peak absolute values of left and right channel
+
+   @return count of frames read
+*/
+static int gen_read_stereo_peaks(int fd, off_t offset, int peaks[2])
+{
+	peaks[0] = 0;
+	peaks[1] = 0;
+	int n_frames = 0;
+	lseek(fd, offset, SEEK_SET);
+	uint8_t frame[4];
+	while (sizeof (frame) == read(fd, frame, sizeof (frame))) {
+		for (int c = 0; c < 2; c++) {
+			const int sample = (int16_t) (frame[2 * c] | (frame[2 * c + 1] << 8));
+			const int value = sample < 0 ? -sample : sample;
+			peaks[c] = value > peaks[c] ? value : peaks[c];
+		}
+		n_frames++;
+	}
+	return n_frames;
+}
+
+
+
+
+/**
+   @brief Test routing of samples to many channels of sound device
+*/
+cwt_retv test_cw_gen_sound_channels(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Routing of samples and mixing to interleaved frames. */
+	{
+		const cw_sample_t samples[2] = { 10000, -20000 };
+		const int volumes[2] = { CW_VOLUME_MAX, 50 };
+		cw_sample_t frames[4] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_route_samples_internal)(samples, 2, volumes, 2, CW_SAMPLE_FORMAT_S16, frames);
+		cte->expect_op_int(cte, 10000, "==", frames[0], "routing: full volume copies sample");
+		cte->expect_op_int(cte, 5000, "==", frames[1], "routing: half volume");
+		cte->expect_op_int(cte, -20000, "==", frames[2], "routing: full volume copies negative sample");
+		cte->expect_op_int(cte, -10000, "==", frames[3], "routing: half volume of negative sample");
+
+		int32_t sum[4] = { 0 };
+		const int left[2] = { CW_VOLUME_MAX, 0 };
+		const int right[2] = { 0, CW_VOLUME_MAX };
+		LIBCW_TEST_FUT(cw_mixer_mix_internal)(samples, 2, left, 2, sum);
+		LIBCW_TEST_FUT(cw_mixer_mix_internal)(samples, 2, right, 2, sum);
+		LIBCW_TEST_FUT(cw_mixer_mix_internal)(samples, 2, volumes, 2, sum);
+		cte->expect_op_int(cte, 20000, "==", sum[0], "mixing: left channel of first frame");
+		cte->expect_op_int(cte, 15000, "==", sum[1], "mixing: right channel of first frame");
+		cte->expect_op_int(cte, -40000, "==", sum[2], "mixing: left channel of second frame");
+		cte->expect_op_int(cte, -30000, "==", sum[3], "mixing: right channel of second frame");
+	}
+
+	/* Arguments checks. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .sound_channels = CW_SOUND_CHANNELS_MAX + 1 };
+		errno = 0;
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_null_pointer(cte, gen, "too many sound channels");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for too many sound channels");
+
+		gen_conf.sound_channels = 2;
+		errno = 0;
+		gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_null_pointer(cte, gen, "many sound channels with sound system that doesn't play samples");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for sound system that doesn't play samples");
+
+		gen_conf.sound_channels = 0;
+		gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with Null sound system");
+		cte->expect_op_int(cte, 1, "==", LIBCW_TEST_FUT(cw_gen_get_sound_channels)(gen), "default count of sound channels");
+
+		const int volumes[2] = { CW_VOLUME_MAX, CW_VOLUME_MAX + 1 };
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_sound_channel_volumes)(gen, volumes, 2), "volume out of range");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for volume out of range");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_sound_channel_volumes)(gen, volumes, 0), "empty list of volumes");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_sound_channel_volumes)(gen, volumes, CW_SOUND_CHANNELS_MAX + 1), "too many volumes");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_set_sound_channel_volumes)(gen, volumes, 1), "valid volumes");
+		cte->expect_op_int(cte, 0, "==", gen->sound_channel_volumes[1], "volumes of channels not given are zero");
+		cw_gen_delete(&gen);
+	}
+
+	/* Stereo WAV file with tone played only in left channel. */
+	{
+		char path[] = "/tmp/libcw_sound_channels_XXXXXX";
+		int fd = mkstemp(path);
+		cte->assert2(cte, -1 != fd, "failed to create temporary file");
+		close(fd);
+
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = -1, .file_format = CW_FILE_FORMAT_WAV, .sound_channels = 2 };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create stereo generator with File sound system");
+		cte->expect_op_int(cte, 2, "==", cw_gen_get_sound_channels(gen), "count of sound channels");
+		const int volumes[1] = { CW_VOLUME_MAX };
+		cw_gen_set_sound_channel_volumes(gen, volumes, 1);
+		cw_gen_start(gen);
+
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, 100000, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+
+		fd = open(path, O_RDONLY);
+		cte->assert2(cte, -1 != fd, "failed to open output file");
+		uint8_t header[44] = { 0 };
+		cte->expect_op_int(cte, (int) sizeof (header), "==", (int) read(fd, header, sizeof (header)), "WAV: reading header");
+		cte->expect_op_int(cte, 2, "==", header[22] | (header[23] << 8), "WAV: count of channels");
+		cte->expect_op_int(cte, 4, "==", header[32] | (header[33] << 8), "WAV: block align");
+
+		int peaks[2];
+		const int n_frames = gen_read_stereo_peaks(fd, sizeof (header), peaks);
+		close(fd);
+		unlink(path);
+		cte->expect_op_int(cte, 0, "<", n_frames, "WAV: frames are written");
+		cte->expect_op_int(cte, 0, "<", peaks[0], "WAV: tone in left channel");
+		cte->expect_op_int(cte, 0, "==", peaks[1], "WAV: silence in right channel");
+	}
+
+	/* Stereo mixer with channel panned to right. */
+	{
+		char path[] = "/tmp/libcw_sound_channels_XXXXXX";
+		int fd = mkstemp(path);
+		cte->assert2(cte, -1 != fd, "failed to create temporary file");
+
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW, .sound_channels = 2 };
+		cw_mixer_t * mixer = cw_mixer_new(&gen_conf, 2);
+		cte->assert2(cte, NULL != mixer, "failed to create stereo mixer");
+
+		const int right[2] = { 0, CW_VOLUME_MAX };
+		cw_gen_t * channel = cw_mixer_get_channel(mixer, 1);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_set_sound_channel_volumes(channel, right, 2), "panning of mixer's channel");
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 600, 100000, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(channel->tq, &tone);
+
+		cw_mixer_start(mixer);
+		for (int i = 0; i < 500 && (channel->pull.tone_in_progress || 0 != cw_tq_length_internal(channel->tq)); i++) {
+			cw_usleep_internal(10000);
+		}
+		cw_mixer_stop(mixer);
+		cw_mixer_delete(&mixer);
+
+		int peaks[2];
+		const int n_frames = gen_read_stereo_peaks(fd, 0, peaks);
+		close(fd);
+		unlink(path);
+		cte->expect_op_int(cte, 0, "<", n_frames, "mixer: frames are written");
+		cte->expect_op_int(cte, 0, "==", peaks[0], "mixer: silence in left channel");
+		cte->expect_op_int(cte, 0, "<", peaks[1], "mixer: tone in right channel");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test scheduler: many generators driven by small pool of worker threads
+*/
+cwt_retv test_cw_gen_sched(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Arguments checks. */
+	{
+		errno = 0;
+		cw_sched_t * sched = LIBCW_TEST_FUT(cw_sched_new)(0);
+		cte->expect_null_pointer(cte, sched, "scheduler without workers");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for scheduler without workers");
+		sched = LIBCW_TEST_FUT(cw_sched_new)(CW_SCHED_N_WORKERS_MAX + 1);
+		cte->expect_null_pointer(cte, sched, "scheduler with too many workers");
+
+		sched = LIBCW_TEST_FUT(cw_sched_new)(1);
+		cte->assert2(cte, NULL != sched, "failed to create scheduler");
+
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with Null sound system");
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_start_with_sched)(gen, sched), "scheduling of generator with blocking sound system");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for blocking sound system");
+		cw_gen_delete(&gen);
+
+		const int fd = open("/dev/null", O_WRONLY);
+		cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+		gen_conf.sound_system = CW_AUDIO_FILE;
+		gen_conf.file_fd = fd;
+		gen_conf.file_format = CW_FILE_FORMAT_RAW;
+		gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_start_with_sched)(gen, NULL), "scheduling without scheduler");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_start_with_sched)(gen, sched), "scheduling of generator");
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_start_with_sched)(gen, sched), "scheduling of started generator");
+		cte->expect_op_int(cte, EBUSY, "==", errno, "errno for started generator");
+		cte->expect_op_int(cte, 1, "==", LIBCW_TEST_FUT(cw_sched_get_n_gens)(sched), "count of scheduled generators");
+		cw_gen_stop(gen);
+		cte->expect_op_int(cte, 0, "==", cw_sched_get_n_gens(sched), "stopped generator is not scheduled");
+		cw_gen_delete(&gen);
+		close(fd);
+
+		LIBCW_TEST_FUT(cw_sched_delete)(&sched);
+		cte->expect_null_pointer(cte, sched, "pointer to deleted scheduler");
+	}
+
+	/* More generators than workers, each writing its own file. All
+	   tones are played, the last one of them paced to real time. */
+	{
+		enum { N_GENS = 8 };
+		const int duration = 200000; /* [us] */
+		cw_sched_t * sched = cw_sched_new(2);
+		cte->assert2(cte, NULL != sched, "failed to create scheduler");
+
+		char paths[N_GENS][32];
+		int fds[N_GENS];
+		cw_gen_t * gens[N_GENS];
+		for (int i = 0; i < N_GENS; i++) {
+			snprintf(paths[i], sizeof (paths[i]), "/tmp/libcw_sched_XXXXXX");
+			fds[i] = mkstemp(paths[i]);
+			cte->assert2(cte, -1 != fds[i], "failed to create temporary file");
+			cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fds[i], .file_format = CW_FILE_FORMAT_RAW, .file_realtime = N_GENS - 1 == i };
+			gens[i] = cw_gen_new(&gen_conf);
+			cte->assert2(cte, NULL != gens[i], "failed to create generator with File sound system");
+		}
+
+		struct timeval start;
+		cw_clock_get_timeval_internal(&start);
+
+		for (int i = 0; i < N_GENS; i++) {
+			cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_start_with_sched(gens[i], sched), "scheduling of generator");
+			cw_tone_t tone;
+			CW_TONE_INIT(&tone, 500 + 50 * i, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+			cw_tq_enqueue_internal(gens[i]->tq, &tone);
+		}
+		cte->expect_op_int(cte, N_GENS, "==", cw_sched_get_n_gens(sched), "count of scheduled generators");
+
+		bool playing = true;
+		for (int i = 0; i < 500 && playing; i++) {
+			cw_usleep_internal(10000);
+			playing = false;
+			for (int g = 0; g < N_GENS; g++) {
+				playing = playing || gens[g]->pull.tone_in_progress || 0 != cw_tq_length_internal(gens[g]->tq);
+			}
 		}
+		cte->expect_op_int(cte, false, "==", playing, "all generators have played their tones");
+
+		struct timeval stop;
+		cw_clock_get_timeval_internal(&stop);
+		const int elapsed = cw_timestamp_compare_internal(&start, &stop);
+		const unsigned int sample_rate = gens[0]->sample_rate;
+		const int buffer_n_samples = gens[0]->buffer_n_samples;
+		const int buffer_duration = (int) (((int64_t) buffer_n_samples * CW_USECS_PER_SEC) / sample_rate);
+		cte->expect_op_int(cte, duration - 2 * buffer_duration, "<", elapsed, "paced generator is paced to real time");
+
+		for (int i = 0; i < N_GENS; i++) {
+			cw_gen_stop(gens[i]);
+			cw_gen_delete(&gens[i]);
+		}
+		cte->expect_op_int(cte, 0, "==", cw_sched_get_n_gens(sched), "no generators are scheduled");
+		cw_sched_delete(&sched);
+
+		const int expected_n_samples = (int) (((int64_t) sample_rate * duration) / CW_USECS_PER_SEC);
+		for (int i = 0; i < N_GENS; i++) {
+			const off_t file_size = lseek(fds[i], 0, SEEK_END);
+			close(fds[i]);
+			unlink(paths[i]);
+			cte->expect_between_int(cte, expected_n_samples, (int) (file_size / 2), expected_n_samples + 8 * buffer_n_samples, "count of samples of generator");
+		}
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test pool of generators, receivers and keys, and reset of objects for reuse
+*/
+cwt_retv test_cw_gen_pool(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+
+	/* Arguments checks. */
+	{
+		errno = 0;
+		cw_pool_t * pool = LIBCW_TEST_FUT(cw_pool_new)(NULL, 1, false);
+		cte->expect_null_pointer(cte, pool, "pool without configuration of generators");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for pool without configuration");
+		pool = LIBCW_TEST_FUT(cw_pool_new)(&gen_conf, 0, false);
+		cte->expect_null_pointer(cte, pool, "pool without capacity");
+		pool = LIBCW_TEST_FUT(cw_pool_new)(&gen_conf, CW_POOL_CAPACITY_MAX + 1, false);
+		cte->expect_null_pointer(cte, pool, "pool with too large capacity");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_reset)(NULL), "reset of NULL generator");
+	}
+
+	/* Generator, receiver and key are reused, and their
+	   parameters are reset. */
+	{
+		cw_pool_t * pool = LIBCW_TEST_FUT(cw_pool_new)(&gen_conf, 1, true);
+		cte->assert2(cte, NULL != pool, "failed to create pool");
+
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_pool_get_gen)(pool);
+		cte->assert2(cte, NULL != gen, "failed to get generator from empty pool");
+		cw_rec_t * rec = LIBCW_TEST_FUT(cw_pool_get_rec)(pool);
+		cte->assert2(cte, NULL != rec, "failed to get receiver from empty pool");
+		cw_key_t * key = LIBCW_TEST_FUT(cw_pool_get_key)(pool);
+		cte->assert2(cte, NULL != key, "failed to get key from empty pool");
+		cw_gen_t * const first_gen = gen;
+		cw_rec_t * const first_rec = rec;
+		cw_key_t * const first_key = key;
+
+		cw_gen_set_speed(gen, CW_SPEED_MAX);
+		cw_gen_set_frequency(gen, CW_FREQUENCY_MIN);
+		cw_gen_set_label(gen, "session");
+		cw_gen_enqueue_string(gen, "PARIS");
+		cw_key_register_generator(key, gen);
+		cw_key_sk_set_value(key, CW_KEY_VALUE_CLOSED);
+		cw_rec_set_speed(rec, CW_SPEED_MAX);
+
+		int n_gens = -1;
+		int n_recs = -1;
+		int n_keys = -1;
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_pool_put_gen)(pool, &gen), "returning generator to pool");
+		cte->expect_null_pointer(cte, gen, "pointer to returned generator");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_pool_put_rec)(pool, &rec), "returning receiver to pool");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_pool_put_key)(pool, &key), "returning key to pool");
+		LIBCW_TEST_FUT(cw_pool_get_counts)(pool, &n_gens, &n_recs, &n_keys);
+		cte->expect_op_int(cte, 1, "==", n_gens, "count of pooled generators");
+		cte->expect_op_int(cte, 1, "==", n_recs, "count of pooled receivers");
+		cte->expect_op_int(cte, 1, "==", n_keys, "count of pooled keys");
+
+		gen = cw_pool_get_gen(pool);
+		rec = cw_pool_get_rec(pool);
+		key = cw_pool_get_key(pool);
+		cte->expect_op_int(cte, true, "==", first_gen == gen, "generator is reused");
+		cte->expect_op_int(cte, true, "==", first_rec == rec, "receiver is reused");
+		cte->expect_op_int(cte, true, "==", first_key == key, "key is reused");
+
+		char label[LIBCW_OBJECT_INSTANCE_LABEL_SIZE] = { 0 };
+		cw_gen_get_label(gen, label, sizeof (label));
+		cte->expect_op_int(cte, CW_SPEED_INITIAL, "==", cw_gen_get_speed(gen), "speed of reused generator");
+		cte->expect_op_int(cte, CW_FREQUENCY_INITIAL, "==", cw_gen_get_frequency(gen), "frequency of reused generator");
+		cte->expect_op_int(cte, 0, "==", (int) strlen(label), "label of reused generator");
+		cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(gen->tq), "tone queue of reused generator");
+		cte->expect_op_int(cte, true, "==", NULL == gen->key, "key of reused generator");
+		cte->expect_op_int(cte, true, "==", gen->do_dequeue_and_generate, "reused generator is started");
+
+		cw_key_value_t key_value = CW_KEY_VALUE_CLOSED;
+		cw_key_sk_get_value(key, &key_value);
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", key_value, "straight key of reused key");
+		cte->expect_op_int(cte, CW_SPEED_INITIAL, "==", (int) cw_rec_get_speed(rec), "speed of reused receiver");
+
+		/* Second generator doesn't fit into the pool. */
+		cw_gen_t * other_gen = cw_pool_get_gen(pool);
+		cte->assert2(cte, NULL != other_gen, "failed to get second generator");
+		cw_pool_put_gen(pool, &gen);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cw_pool_put_gen(pool, &other_gen), "returning generator to full pool");
+		cte->expect_null_pointer(cte, other_gen, "pointer to generator returned to full pool");
+		cw_pool_get_counts(pool, &n_gens, NULL, NULL);
+		cte->expect_op_int(cte, 1, "==", n_gens, "count of generators in full pool");
+
+		cw_pool_put_rec(pool, &rec);
+		cw_pool_put_key(pool, &key);
+		LIBCW_TEST_FUT(cw_pool_delete)(&pool);
+		cte->expect_null_pointer(cte, pool, "pointer to deleted pool");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test pausing and resuming of generator
+*/
+cwt_retv test_cw_gen_pause(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_pause)(gen), "pausing of generator that is not started");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for generator that is not started");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_resume)(NULL), "resuming of NULL generator");
+
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "PARIS");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_pause)(gen), "pausing of generator");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_pause)(gen), "pausing of paused generator");
+	cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(gen->tq), "tones are removed by pause");
+	cte->expect_op_int(cte, true, "==", gen->thread.running, "thread of paused generator is running");
+
+	/* Paused generator doesn't play tones. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 600, 20000, CW_SLOPE_MODE_STANDARD_SLOPES);
+	cw_tq_enqueue_internal(gen->tq, &tone);
+	cw_usleep_internal(100000);
+	cte->expect_op_int(cte, 1, "==", (int) cw_tq_length_internal(gen->tq), "paused generator doesn't dequeue tones");
+
+	struct timeval before;
+	struct timeval after;
+	cw_clock_get_timeval_internal(&before);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_resume)(gen), "resuming of generator");
+	cw_clock_get_timeval_internal(&after);
+	cte->expect_op_int(cte, 10000, ">", cw_timestamp_compare_internal(&before, &after), "duration of resume");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_resume)(gen), "resuming of resumed generator");
+
+	cw_gen_wait_for_queue_level(gen, 0);
+	cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(gen->tq), "resumed generator plays tones");
+
+	/* Paused generator can be stopped. */
+	cw_gen_pause(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_stop(gen), "stopping of paused generator");
+	cte->expect_op_int(cte, false, "==", gen->thread.running, "thread of stopped generator is not running");
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test output of samples in formats other than 16-bit integers
+*/
+cwt_retv test_cw_gen_sample_formats(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Conversion of samples in routing stage and in mixer. */
+	{
+		const cw_sample_t samples[2] = { 16384, INT16_MIN };
+		const int volumes[1] = { CW_VOLUME_MAX };
+
+		int32_t s32[2] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_route_samples_internal)(samples, 2, volumes, 1, CW_SAMPLE_FORMAT_S32, s32);
+		cte->expect_op_int(cte, 16384 * 65536, "==", s32[0], "S32: routing of positive sample");
+		cte->expect_op_int(cte, INT32_MIN, "==", s32[1], "S32: routing of negative sample");
+
+		float f32[2] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_route_samples_internal)(samples, 2, volumes, 1, CW_SAMPLE_FORMAT_FLOAT, f32);
+		cte->expect_op_float(cte, 0.0001F, ">", fabsf(f32[0] - 0.5F), "float: routing of positive sample");
+		cte->expect_op_float(cte, 0.0001F, ">", fabsf(f32[1] + 1.0F), "float: routing of negative sample");
+
+		const int32_t sum[2] = { 40000, -1000 };
+		LIBCW_TEST_FUT(cw_mixer_clip_internal)(sum, s32, 2, CW_SAMPLE_FORMAT_S32);
+		cte->expect_op_int(cte, INT16_MAX * 65536, "==", s32[0], "S32: sum is clipped");
+		cte->expect_op_int(cte, -1000 * 65536, "==", s32[1], "S32: sum is scaled");
+		LIBCW_TEST_FUT(cw_mixer_clip_internal)(sum, f32, 2, CW_SAMPLE_FORMAT_FLOAT);
+		cte->expect_op_float(cte, 1.0F, "<", f32[0], "float: sum is not clipped");
+	}
+
+	/* Arguments checks. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .sample_format = (cw_sample_format_t) 100 };
+		errno = 0;
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_null_pointer(cte, gen, "invalid sample format");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for invalid sample format");
+
+		gen_conf.sample_format = CW_SAMPLE_FORMAT_FLOAT;
+		gen_conf.pull_mode = true;
+		errno = 0;
+		gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_null_pointer(cte, gen, "float samples in pull mode");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for float samples in pull mode");
+
+		gen_conf.pull_mode = false;
+		gen_conf.sound_system = CW_AUDIO_RTP;
+		gen_conf.sample_format = CW_SAMPLE_FORMAT_S32;
+		errno = 0;
+		gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->expect_null_pointer(cte, gen, "S32 samples with RTP sound system");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for S32 samples with RTP sound system");
+	}
+
+	/* WAV files with 32-bit samples. */
+	const struct {
+		cw_sample_format_t format;
+		int format_tag;
+		const char * name;
+	} formats[] = {
+		{ CW_SAMPLE_FORMAT_S32,   1, "S32"   },
+		{ CW_SAMPLE_FORMAT_FLOAT, 3, "float" },
+	};
+	for (size_t f = 0; f < sizeof (formats) / sizeof (formats[0]); f++) {
+		char path[] = "/tmp/libcw_sample_formats_XXXXXX";
+		int fd = mkstemp(path);
+		cte->assert2(cte, -1 != fd, "failed to create temporary file");
+		close(fd);
+
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = -1, .file_format = CW_FILE_FORMAT_WAV, .sample_format = formats[f].format };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+		cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+		cte->assert2(cte, NULL != gen, "%s: failed to create generator with File sound system", formats[f].name);
+		cw_gen_start(gen);
+
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, 100000, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
 		cw_gen_wait_for_queue_level(gen, 0);
-		cte->expect_op_int(cte, false, "==", failure, "enqueue representation internal(<valid>)");
+		cw_gen_wait_for_end_of_current_tone(gen);
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+
+		fd = open(path, O_RDONLY);
+		cte->assert2(cte, -1 != fd, "%s: failed to open output file", formats[f].name);
+		uint8_t header[44] = { 0 };
+		cte->expect_op_int(cte, (int) sizeof (header), "==", (int) read(fd, header, sizeof (header)), "%s: reading header", formats[f].name);
+		cte->expect_op_int(cte, formats[f].format_tag, "==", header[20] | (header[21] << 8), "%s: format tag", formats[f].name);
+		cte->expect_op_int(cte, 4, "==", header[32] | (header[33] << 8), "%s: block align", formats[f].name);
+		cte->expect_op_int(cte, 32, "==", header[34] | (header[35] << 8), "%s: bits per sample", formats[f].name);
+
+		/* Peak of the tone should be close to volume of generator. */
+		double peak = 0.0;
+		int n_samples = 0;
+		uint8_t bytes[4];
+		while (sizeof (bytes) == read(fd, bytes, sizeof (bytes))) {
+			const uint32_t bits = (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+			double value = 0.0;
+			if (CW_SAMPLE_FORMAT_FLOAT == formats[f].format) {
+				float sample = 0.0F;
+				memcpy(&sample, &bits, sizeof (sample));
+				value = sample;
+			} else {
+				value = (int32_t) bits / 2147483648.0;
+			}
+			peak = fabs(value) > peak ? fabs(value) : peak;
+			n_samples++;
+		}
+		close(fd);
+		unlink(path);
+		cte->expect_op_int(cte, 0, "<", n_samples, "%s: samples are written", formats[f].name);
+		cte->expect_op_int(cte, true, "==", peak > 0.1 && peak <= 1.0, "%s: peak of tone is in range: %f", formats[f].name, peak);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test tone queue shared between server generator and proxy generator
+*/
+cwt_retv test_cw_gen_shmq(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char name[CW_SHMQ_NAME_SIZE];
+	snprintf(name, sizeof (name), "/libcw_test_shmq_%ld", (long) getpid());
+
+	cw_gen_config_t server_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * server = cw_gen_new(&server_conf);
+	cte->assert2(cte, NULL != server, "failed to create server generator");
+
+	/* Arguments checks. */
+	{
+		errno = 0;
+		cw_shmq_t * shmq = LIBCW_TEST_FUT(cw_shmq_new)(NULL, name, 10);
+		cte->expect_op_int(cte, true, "==", NULL == shmq, "queue for NULL generator");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+
+		errno = 0;
+		shmq = LIBCW_TEST_FUT(cw_shmq_new)(server, "libcw/shmq", 10);
+		cte->expect_op_int(cte, true, "==", NULL == shmq, "queue with invalid name");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for invalid name");
+
+		errno = 0;
+		shmq = LIBCW_TEST_FUT(cw_shmq_new)(server, name, 0);
+		cte->expect_op_int(cte, true, "==", NULL == shmq, "queue with zero capacity");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for zero capacity");
+
+		cw_gen_config_t proxy_conf = { .sound_system = CW_AUDIO_NULL, .file_fd = -1 };
+		snprintf(proxy_conf.tq_shared_name, sizeof (proxy_conf.tq_shared_name), "%s", name);
+		errno = 0;
+		cw_gen_t * proxy = LIBCW_TEST_FUT(cw_gen_new)(&proxy_conf);
+		cte->expect_op_int(cte, true, "==", NULL == proxy, "proxy of queue that doesn't exist");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno for queue that doesn't exist");
+
+		proxy_conf.sound_system = CW_AUDIO_FILE;
+		errno = 0;
+		proxy = LIBCW_TEST_FUT(cw_gen_new)(&proxy_conf);
+		cte->expect_op_int(cte, true, "==", NULL == proxy, "proxy with File sound system");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for proxy with File sound system");
+	}
+
+	const int capacity = 20;
+	cw_shmq_t * shmq = LIBCW_TEST_FUT(cw_shmq_new)(server, name, capacity);
+	cte->assert2(cte, NULL != shmq, "failed to create shared tone queue");
+	errno = 0;
+	cw_shmq_t * other = LIBCW_TEST_FUT(cw_shmq_new)(server, name, capacity);
+	cte->expect_op_int(cte, true, "==", NULL == other, "second queue with the same name");
+	cte->expect_op_int(cte, EEXIST, "==", errno, "errno for second queue with the same name");
+
+	cw_gen_start(server);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_shmq_start)(shmq), "starting of queue");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_shmq_start)(shmq), "starting of started queue");
+	cte->expect_op_int(cte, EBUSY, "==", errno, "errno for started queue");
+
+	cw_gen_config_t proxy_conf = { .sound_system = CW_AUDIO_NULL };
+	snprintf(proxy_conf.tq_shared_name, sizeof (proxy_conf.tq_shared_name), "%s", name);
+	cw_gen_t * proxy = LIBCW_TEST_FUT(cw_gen_new)(&proxy_conf);
+	cte->assert2(cte, NULL != proxy, "failed to create proxy generator");
+	cw_gen_set_speed(proxy, CW_SPEED_MAX);
+	cte->expect_op_int(cte, capacity, "==", (int) cw_tq_capacity_internal(proxy->tq), "capacity seen by proxy");
+
+	/* Tones of proxy are played by server. */
+	const uint64_t n_dequeued = server->tq->n_dequeued;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_enqueue_string(proxy, "EE"), "enqueueing to proxy");
+	cte->expect_op_int(cte, 0, "<", (int) cw_gen_get_queue_length(proxy), "length of queue seen by proxy");
+	cw_gen_wait_for_queue_level(proxy, 0);
+	cw_tq_wait_for_empty_internal(proxy->tq);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(proxy), "length of drained queue");
+	cte->expect_op_int(cte, n_dequeued, "<", server->tq->n_dequeued, "tones dequeued by server");
+	cte->expect_op_int(cte, 0, "==", (int) proxy->tq->n_dequeued, "tones dequeued by proxy");
+
+	/* Whole batch of tones must fit into the queue. */
+	cw_tone_t tones[21];
+	for (size_t i = 0; i < sizeof (tones) / sizeof (tones[0]); i++) {
+		CW_TONE_INIT(&tones[i], 600, 1000000, CW_SLOPE_MODE_STANDARD_SLOPES);
+	}
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_tq_enqueue_batch_internal(proxy->tq, tones, capacity + 1), "enqueueing of too many tones");
+	cte->expect_op_int(cte, EAGAIN, "==", errno, "errno for too many tones");
+
+	/* Queue is filled while server doesn't take tones from it, so
+	   that its length doesn't change during the checks. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_shmq_stop)(shmq), "stopping of queue before filling it");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_tq_enqueue_batch_internal(proxy->tq, tones, capacity), "enqueueing of long tones");
+	cte->expect_op_int(cte, true, "==", cw_gen_is_queue_full(proxy), "full queue");
+	cte->expect_op_int(cte, capacity, "==", (int) cw_gen_get_queue_length(proxy), "length of full queue");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_tq_enqueue_batch_internal(proxy->tq, tones, 1), "enqueueing to full queue");
+	cte->expect_op_int(cte, EAGAIN, "==", errno, "errno for full queue");
+
+	/* Tones moved to server still count against capacity: free
+	   room is exactly what length of queue says (length can only
+	   decrease while server plays long tones). */
+	cw_shmq_start(shmq);
+	cw_usleep_internal(100000);
+	cte->expect_op_int(cte, 0, "<", (int) cw_tq_length_internal(server->tq), "tones moved to server");
+	const int n_free = capacity - (int) cw_gen_get_queue_length(proxy);
+	cte->expect_op_int(cte, 0, "<", n_free, "room freed by tone being played");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_tq_enqueue_batch_internal(proxy->tq, tones, (size_t) n_free), "enqueueing to free room");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_tq_enqueue_batch_internal(proxy->tq, tones, capacity), "enqueueing beyond capacity");
+	cte->expect_op_int(cte, EAGAIN, "==", errno, "errno for enqueueing beyond capacity");
+
+	/* Flush drops tones from shared memory and from server. */
+	cw_gen_flush_queue(proxy);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(proxy), "length of flushed queue");
+	cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(server->tq), "length of flushed queue of server");
+
+	/* Tones wait in stopped queue. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_shmq_stop)(shmq), "stopping of queue");
+	cw_gen_enqueue_character(proxy, 'E');
+	cw_usleep_internal(100000);
+	cte->expect_op_int(cte, 0, "<", (int) cw_gen_get_queue_length(proxy), "tones in stopped queue");
+	cw_shmq_start(shmq);
+	cw_tq_wait_for_empty_internal(proxy->tq);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(proxy), "tones played by restarted queue");
+
+	/* Shared memory is writable by clients. Capacity in shared memory
+	   changed by client after tones have been enqueued, to zero or to
+	   value too large for the mapping, is not used by server. */
+	const uint32_t corrupted_capacities[] = { 0, UINT32_MAX };
+	for (size_t i = 0; i < sizeof (corrupted_capacities) / sizeof (corrupted_capacities[0]); i++) {
+		cw_shmq_stop(shmq);
+		cw_gen_enqueue_string(proxy, "EE");
+		shmq->shared->capacity = corrupted_capacities[i];
+		cw_shmq_start(shmq);
+		cw_tq_wait_for_empty_internal(proxy->tq);
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(proxy), "tones played with corrupted capacity %" PRIu32, corrupted_capacities[i]);
+		cte->expect_op_int(cte, capacity, "==", (int) cw_shmq_capacity_internal(shmq), "capacity of server with corrupted capacity %" PRIu32, corrupted_capacities[i]);
+	}
+	shmq->shared->capacity = (uint32_t) capacity;
+
+	cw_gen_delete(&proxy);
+	LIBCW_TEST_FUT(cw_shmq_delete)(&shmq);
+	cte->expect_op_int(cte, true, "==", NULL == shmq, "pointer to deleted queue");
+	cw_gen_stop(server);
+	cw_gen_delete(&server);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+/* Callback of asynchronous wait in test_cw_gen_wait_async(). */
+static void gen_wait_async_callback(void * arg)
+{
+	__atomic_add_fetch((int *) arg, 1, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/* Wait (at most 5 seconds) until descriptor becomes readable and
+   counter of calls of gen_wait_async_callback() reaches @p expected. */
+static bool gen_wait_async_completed(int fd, int * counter, int expected)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	if (1 != poll(&pfd, 1, 5000)) {
+		return false;
+	}
+	for (int i = 0; i < 500; i++) {
+		if (expected == __atomic_load_n(counter, __ATOMIC_SEQ_CST)) {
+			return true;
+		}
+		cw_usleep_internal(10000);
+	}
+	return false;
+}
+
+
+
+
+/**
+   @brief Test asynchronous waits on generator
+*/
+cwt_retv test_cw_gen_wait_async(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	int counter = 0;
+	int fd = -1;
+
+	/* Arguments checks. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_wait_for_queue_level_async)(NULL, 0, gen_wait_async_callback, &counter, NULL), "waiting on NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_wait_for_queue_level_async)(gen, 0, NULL, NULL, NULL), "waiting without callback and descriptor");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for no callback and no descriptor");
+
+	/* Condition that is already true completes the wait at once. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_wait_for_queue_level_async)(gen, 0, gen_wait_async_callback, &counter, &fd), "waiting on empty queue");
+	cte->expect_op_int(cte, 1, "==", counter, "callback for empty queue");
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	cte->expect_op_int(cte, 1, "==", poll(&pfd, 1, 0), "descriptor for empty queue");
+	close(fd);
+
+	/* Waits complete when generator plays the tones. */
+	cw_gen_set_speed(gen, CW_SPEED_MAX);
+	cw_gen_enqueue_string(gen, "EEE");
+	counter = 0;
+	int tone_fd = -1;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_wait_for_queue_level_async)(gen, 0, gen_wait_async_callback, &counter, &fd), "waiting for level");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_wait_for_end_of_current_tone_async)(gen, NULL, NULL, &tone_fd), "waiting for end of tone");
+	cte->expect_op_int(cte, 0, "==", counter, "callback of pending wait");
+	pfd.fd = fd;
+	cte->expect_op_int(cte, 0, "==", poll(&pfd, 1, 0), "descriptor of pending wait");
+
+	cw_gen_start(gen);
+	pfd.fd = tone_fd;
+	cte->expect_op_int(cte, 1, "==", poll(&pfd, 1, 5000), "descriptor for end of tone");
+	cte->expect_op_int(cte, true, "==", gen_wait_async_completed(fd, &counter, 1), "completion of wait for level");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "length of queue after completion");
+	close(fd);
+	close(tone_fd);
+
+	/* Pending waits are dropped by deletion of generator. */
+	cw_gen_stop(gen);
+	cw_gen_enqueue_string(gen, "E");
+	counter = 0;
+	cw_gen_wait_for_queue_level_async(gen, 0, gen_wait_async_callback, &counter, NULL);
+	cw_gen_delete(&gen);
+	cte->expect_op_int(cte, 0, "==", counter, "callback of dropped wait");
+
+	/* Callbacks can be called by dispatch thread. */
+	gen_conf.callbacks_in_dispatch_thread = true;
+	gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with dispatch thread");
+	cw_gen_set_speed(gen, CW_SPEED_MAX);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "E");
+	counter = 0;
+	cw_gen_wait_for_queue_level_async(gen, 0, gen_wait_async_callback, &counter, &fd);
+	cte->expect_op_int(cte, true, "==", gen_wait_async_completed(fd, &counter, 1), "completion in dispatch thread");
+	close(fd);
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+/* Text source for test_cw_gen_text_source(). */
+typedef struct {
+	cw_gen_t * gen;
+	const char * text;
+	size_t position;
+	size_t max_queue_length; /* Largest length of queue seen by the source. */
+} gen_text_source_data_t;
+
+static int gen_text_source(void * arg)
+{
+	gen_text_source_data_t * data = (gen_text_source_data_t *) arg;
+	const size_t len = cw_gen_get_queue_length(data->gen);
+	if (len > data->max_queue_length) {
+		data->max_queue_length = len;
+	}
+	return data->text[data->position] ? data->text[data->position++] : '\0';
+}
+
+
+
+
+/**
+   @brief Test pulling of text from source registered in generator
+*/
+cwt_retv test_cw_gen_text_source(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_register_text_source)(NULL, gen_text_source, NULL), "registering source in NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with File sound system");
+	cw_gen_set_speed(gen, CW_SPEED_MAX);
+	cte->assert2(cte, CW_SUCCESS == cw_gen_start(gen), "failed to start generator");
+
+	/* Long text, with a character that can't be sent. */
+	char text[1024] = { 0 };
+	for (int i = 0; i < 50; i++) {
+		strcat(text, "PARIS ");
+	}
+	text[3] = '\x01';
+	gen_text_source_data_t data = { .gen = gen, .text = text, .position = 0, .max_queue_length = 0 };
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_register_text_source)(gen, gen_text_source, &data), "registering text source");
+	cte->expect_op_int(cte, 0, "<", (int) cw_gen_get_queue_length(gen), "first characters are enqueued by registration");
+	cw_gen_wait_for_queue_level(gen, 0);
+
+	cte->expect_op_int(cte, (int) strlen(text), "==", (int) data.position, "all characters of text are pulled");
+	cte->expect_op_int(cte, 2, ">", (int) data.max_queue_length, "queue is kept short");
+	cte->expect_op_int(cte, true, "==", NULL == gen->text_source.source_func, "source is unregistered at end of text");
+
+	/* Unregistering stops pulling. */
+	data.position = 0;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_register_text_source(gen, gen_text_source, &data), "registering text source again");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_register_text_source)(gen, NULL, NULL), "unregistering text source");
+	const size_t position = data.position;
+	cw_gen_wait_for_queue_level(gen, 0);
+	cte->expect_op_int(cte, (int) position, "==", (int) data.position, "no characters are pulled after unregistering");
+	cte->expect_op_int(cte, (int) strlen(text), ">", (int) data.position, "text is not sent after unregistering");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	close(fd);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Data of callbacks of test_cw_gen_dispatch(). */
+typedef struct {
+	cw_gen_t * gen;
+	int n_values;
+	int n_low_water;
+	bool in_generator_thread;   /* A callback has been called by generator's thread. */
+	bool timestamps_ordered;    /* Timestamps of events don't decrease, and are not later than calls. */
+	int64_t last_timestamp;
+} gen_dispatch_data_t;
+
+static void gen_dispatch_check_thread(gen_dispatch_data_t * data)
+{
+	if (pthread_equal(pthread_self(), data->gen->thread.id)) {
+		data->in_generator_thread = true;
+	}
+	const int64_t timestamp = cw_gen_get_callback_timestamp(data->gen);
+	if (timestamp < data->last_timestamp || timestamp > cw_clock_now_internal()) {
+		data->timestamps_ordered = false;
 	}
+	data->last_timestamp = timestamp;
+}
 
+static void gen_dispatch_value_callback(void * arg, __attribute__((unused)) int value)
+{
+	gen_dispatch_data_t * data = (gen_dispatch_data_t *) arg;
+	gen_dispatch_check_thread(data);
+	data->n_values++;
+	/* Slow client code. */
+	cw_usleep_internal(2000);
+}
 
-	/* Test: trying to play invalid representations. */
-	{
-		bool failure = false;
-		for (int rep = 0; rep < loops; rep++) {
-			int i = 0;
-			while (NULL != test_invalid_representations[i]) {
-				cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation)(gen, test_invalid_representations[i]);
-				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue representation(<invalid>) (%d)", i)) {
-					failure = true;
-					break;
-				}
-				cwret = LIBCW_TEST_FUT(cw_gen_enqueue_representation_no_ics)(gen, test_invalid_representations[i]);
-				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue representation, no ics(<invalid>) (%d)", i)) {
-					failure = true;
-					break;
-				}
-				i++;
-			}
-			if (failure) {
-				break;
-			}
-		}
-		cw_gen_wait_for_queue_level(gen, 0);
-		cte->expect_op_int(cte, false, "==", failure, "enqueue representation internal(<invalid>)");
-	}
+static void gen_dispatch_low_water_callback(void * arg)
+{
+	gen_dispatch_data_t * data = (gen_dispatch_data_t *) arg;
+	gen_dispatch_check_thread(data);
+	data->n_low_water++;
+}
 
-#if 0
-	/* TODO: remove this. We wait here for generator's queue to
-	   drain completely, and this should be done in some other
-	   way. */
-	cw_usleep_internal(1 * CW_USECS_PER_SEC);
-#endif
-	gen_destroy(&gen);
+
+
+
+/**
+   @brief Test calling of client's callbacks from dispatch thread
+*/
+cwt_retv test_cw_gen_dispatch(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW, .callbacks_in_dispatch_thread = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator with dispatch thread");
+	cte->expect_valid_pointer(cte, gen->dispatch, "generator has dispatch");
+	cw_gen_set_speed(gen, CW_SPEED_MAX);
+
+	gen_dispatch_data_t data = { .gen = gen, .timestamps_ordered = true };
+	cw_gen_register_value_tracking_callback_internal(gen, gen_dispatch_value_callback, &data);
+	cw_gen_register_low_level_callback(gen, gen_dispatch_low_water_callback, &data, 3);
+	cte->assert2(cte, CW_SUCCESS == cw_gen_start(gen), "failed to start generator");
+
+	/* Ten Marks: twenty changes of value. */
+	cw_gen_enqueue_string(gen, "IIIII");
+	cw_gen_wait_for_queue_level(gen, 0);
+
+	/* Slow value callbacks don't slow down the generator: they are
+	   still being called when all tones have been generated. */
+	cte->expect_op_int(cte, 20, ">", data.n_values, "callbacks lag behind generator");
+
+	cw_gen_stop(gen);
+	/* Deleting generator dispatches all pending notifications. */
+	cw_gen_delete(&gen);
+	close(fd);
+
+	cte->expect_op_int(cte, 20, "<=", data.n_values, "all changes of value are dispatched");
+	cte->expect_op_int(cte, 1, "<=", data.n_low_water, "low water is dispatched");
+	cte->expect_op_int(cte, false, "==", data.in_generator_thread, "callbacks are not called by generator's thread");
+	cte->expect_op_int(cte, true, "==", data.timestamps_ordered, "timestamps of events");
 
 	cte->print_test_footer(cte, __func__);
 
@@ -1183,74 +4462,77 @@ cwt_retv test_cw_gen_enqueue_representations(cw_test_executor_t * cte)
 
 
 
+/* Data of callback of test_cw_gen_timed_value_tracking(). */
+typedef struct {
+	int n_values;
+	int values[8];
+	int64_t timestamps[8];
+} gen_timed_data_t;
+
+static void gen_timed_value_callback(void * arg, int value, int64_t timestamp)
+{
+	gen_timed_data_t * data = (gen_timed_data_t *) arg;
+	if (data->n_values < (int) (sizeof (data->values) / sizeof (data->values[0]))) {
+		data->values[data->n_values] = value;
+		data->timestamps[data->n_values] = timestamp;
+		data->n_values++;
+	}
+}
+
+
+
+
 /**
-   @brief Play all supported characters as individual characters
+   @brief Test timestamps passed to timed value tracking callback
 
-   @reviewed on 2020-05-09
+   Distance between timestamps of beginning and end of a Mark should be
+   equal to duration of the Mark, in sound systems that pace the
+   generator by themselves (Null) and in sound systems that are
+   written to in buffers (File with real-time pacing).
 */
-cwt_retv test_cw_gen_enqueue_character(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_timed_value_tracking(cw_test_executor_t * cte)
 {
-	const int loops = cte->get_loops_count(cte);
+	cte->print_test_header(cte, __func__);
 
-	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_register_timed_value_tracking_callback)(NULL, gen_timed_value_callback, NULL), "registering callback for NULL generator");
 
-	cw_gen_t * gen = NULL;
-	if (cwt_retv_ok != gen_setup(cte, &gen)) {
-		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
-		return cwt_retv_err;
-	}
-	cw_gen_start(gen);
+	const int fd = open("/dev/null", O_WRONLY);
+	cte->assert2(cte, -1 != fd, "failed to open /dev/null");
+	const cw_gen_config_t configs[] = {
+		{ .sound_system = CW_AUDIO_NULL },
+		{ .sound_system = CW_AUDIO_FILE, .file_fd = fd, .file_format = CW_FILE_FORMAT_RAW, .file_realtime = true },
+	};
 
-	/* Test: play all supported characters as individual characters. */
-	{
-		char charlist[UCHAR_MAX + 1] = { 0 };
-		bool failure = false;
+	for (size_t i = 0; i < sizeof (configs) / sizeof (configs[0]); i++) {
+		cw_gen_t * gen = cw_gen_new(&configs[i]);
+		cte->assert2(cte, NULL != gen, "failed to create generator for sound system %d", configs[i].sound_system);
+		cw_gen_set_speed(gen, 30);
 
-		/* Enqueue all the characters from the charlist individually. */
-		cw_list_characters(charlist);
-		cte->log_info(cte,
-			      "enqueue character(<valid>):\n"
-			      "       ");
-		for (int i = 0; charlist[i] != '\0'; i++) {
-			cte->log_info_cont(cte, "%c", charlist[i]);
-			cte->flush_info(cte);
-			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, charlist[i]);
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueue character(<valid>) (i = %d, char = '%c')", i, charlist[i])) {
-				failure = true;
-				break;
-			}
-			cw_gen_wait_for_queue_level(gen, 0); /* TODO: the queue level should be randomized. */
-		}
-		cte->log_info_cont(cte, "\n");
-		cte->flush_info(cte);
+		int dot_duration = 0;
+		cw_gen_get_timing_parameters_internal(gen, &dot_duration, NULL, NULL, NULL, NULL, NULL, NULL);
 
-		cte->expect_op_int(cte, false, "==", failure, "enqueue character(<valid>)");
-	}
+		gen_timed_data_t data = { 0 };
+		LIBCW_TEST_FUT(cw_gen_register_timed_value_tracking_callback)(gen, gen_timed_value_callback, &data);
+		cte->assert2(cte, CW_SUCCESS == cw_gen_start(gen), "failed to start generator");
 
+		cw_gen_enqueue_string(gen, "EE");
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_usleep_internal(200 * 1000);
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
 
-	/* Test: trying to play invalid characters. */
-	{
-		bool failure = false;
-		for (int rep = 0; rep < loops; rep++) {
-			const char invalid_characters[] = { 0x00, 0x01 }; /* List of invalid characters to be enqueued. */
-			const int n = sizeof (invalid_characters) / sizeof (invalid_characters[0]);
+		cte->expect_op_int(cte, 4, "<=", data.n_values, "sound system %d: count of changes of value", configs[i].sound_system);
+		for (int v = 0; v + 1 < data.n_values && v < 4; v += 2) {
+			cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", data.values[v], "sound system %d: value %d", configs[i].sound_system, v);
+			cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", data.values[v + 1], "sound system %d: value %d", configs[i].sound_system, v + 1);
 
-			for (int i = 0; i < n; i++) {
-				const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, invalid_characters[i]);
-				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue character(<invalid>) (i = %d)", i)) {
-					failure = true;
-					break;
-				}
-			}
-			if (failure) {
-				break;
-			}
+			/* Tolerance for late wakeups of the pacing sleeps. */
+			const int mark_duration = (int) ((data.timestamps[v + 1] - data.timestamps[v]) / 1000);
+			cte->expect_between_int(cte, dot_duration - 3000, mark_duration, dot_duration + 3000,
+						"sound system %d: duration of Mark from timestamps", configs[i].sound_system);
 		}
-		cte->expect_op_int(cte, false, "==", failure, "enqueue character(<invalid>)");
 	}
-
-
-	gen_destroy(&gen);
+	close(fd);
 
 	cte->print_test_footer(cte, __func__);
 
@@ -1261,124 +4543,292 @@ cwt_retv test_cw_gen_enqueue_character(cw_test_executor_t * cte)
 
 
 /**
-   @brief Enqueue all supported characters as a single string
+   @brief Test idle mode of generator
 
-   @reviewed on 2020-05-09
+   Generator should enter idle mode when tone queue stays empty, or
+   holds only silent 'forever' tone of straight key, for longer than
+   idle timeout, and should leave the mode when next tone is enqueued.
 */
-cwt_retv test_cw_gen_enqueue_string(cw_test_executor_t * cte)
+cwt_retv test_cw_gen_idle_mode(cw_test_executor_t * cte)
 {
-	const int loops = cte->get_loops_count(cte);
+	cte->print_test_header(cte, __func__);
 
-	cte->print_test_header(cte, "%s (%d)", __func__, loops);
+	const unsigned int idle_timeout = 50 * 1000;
 
-	cw_gen_t * gen = NULL;
-	if (cwt_retv_ok != gen_setup(cte, &gen)) {
-		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
-		return cwt_retv_err;
+	{
+		const cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .idle_timeout = (unsigned int) INT_MAX + 1 };
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_new)(&gen_conf), "creating generator with too large idle timeout");
 	}
-	cw_gen_start(gen);
 
-	/* Test: playing all supported characters as single string. */
+	const cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .idle_timeout = idle_timeout };
+	cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	cw_gen_set_speed(gen, 30);
+	cte->assert2(cte, CW_SUCCESS == cw_gen_start(gen), "failed to start generator");
+	cw_gen_stats_t stats = { 0 };
+
+	/* Queue is empty right from the start. */
+	cw_usleep_internal(3 * idle_timeout);
+	LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, 1, "==", (int) stats.n_idle_periods, "count of idle periods after start");
+	cte->expect_op_int(cte, (int) idle_timeout / 2, "<=", (int) stats.idle_time, "idle time after start");
+
+	/* Tone takes generator out of idle mode, and the timeout is
+	   counted again from the moment the queue is emptied. */
+	cw_gen_enqueue_string(gen, "E");
+	cw_gen_wait_for_queue_level(gen, 0);
+	const uint64_t active_time = stats.active_time;
+	LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, 1, "==", (int) stats.n_idle_periods, "count of idle periods right after tone");
+	cte->expect_op_int(cte, 1, "==", stats.active_time > active_time, "active time grows after tone");
+	cw_usleep_internal(3 * idle_timeout);
+	LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, 2, "==", (int) stats.n_idle_periods, "count of idle periods after tone");
+
+	/* Straight key that stays up leaves silent 'forever' tone in
+	   the queue. */
+	cw_gen_enqueue_begin_space_internal(gen);
+	cw_usleep_internal(3 * idle_timeout);
+	LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, 3, "==", (int) stats.n_idle_periods, "count of idle periods with 'forever' tone");
+	cte->expect_op_int(cte, 1, "==", (int) cw_gen_get_queue_length(gen), "length of queue with 'forever' tone");
+
+	cw_gen_enqueue_string(gen, "E");
+	cw_gen_wait_for_queue_level(gen, 0);
+	LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+	cte->expect_op_int(cte, 3, "==", (int) stats.n_idle_periods, "count of idle periods right after tone following 'forever' tone");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	/* Idle mode is disabled by default. */
 	{
-		char charlist[UCHAR_MAX + 1] = { 0 };
-		cw_list_characters(charlist);
+		const cw_gen_config_t default_conf = { .sound_system = CW_AUDIO_NULL };
+		gen = cw_gen_new(&default_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator");
+		cte->assert2(cte, CW_SUCCESS == cw_gen_start(gen), "failed to start generator");
+		cw_usleep_internal(3 * idle_timeout);
+		LIBCW_TEST_FUT(cw_gen_get_stats)(gen, &stats);
+		cte->expect_op_int(cte, 0, "==", (int) stats.n_idle_periods, "count of idle periods with idle mode disabled");
+		cte->expect_op_int(cte, 0, "==", (int) stats.idle_time, "idle time with idle mode disabled");
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+	}
 
-		/* Enqueue the complete charlist as a single string. */
-		cte->log_info(cte,
-			      "enqueue string(<valid>):\n"
-			      "       %s\n", charlist);
-		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_string)(gen, charlist);
-		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue string(<valid>)");
+	cte->print_test_footer(cte, __func__);
 
+	return cwt_retv_ok;
+}
 
-		while (cw_gen_get_queue_length(gen) > 0) {
-			cte->log_info(cte, "tone queue length %-6zu\r", cw_gen_get_queue_length(gen));
-			cte->flush_info(cte);
-			cw_gen_wait_for_end_of_current_tone(gen);
+
+
+
+/* Pull @p n samples of @p string from a new generator with given
+   impairments (NULL: impairments not set). Empty string gives samples
+   of generator with empty queue. */
+static cw_ret_t test_cw_gen_impairments_pull_internal(const cw_impairments_t * impairments, const char * string, cw_sample_t * samples, size_t n, int * sample_rate)
+{
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .pull_mode = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		return CW_FAILURE;
+	}
+	cw_ret_t cwret = CW_SUCCESS;
+	if (NULL != impairments) {
+		cwret = cw_gen_set_impairments(gen, impairments);
+	}
+	if (CW_SUCCESS == cwret) {
+		cw_gen_start(gen);
+		if ('\0' != string[0]) {
+			cw_gen_enqueue_string(gen, string);
 		}
-		cte->log_info(cte, "tone queue length %-6zu\n", cw_gen_get_queue_length(gen));
-		cte->flush_info(cte);
-		cw_gen_wait_for_queue_level(gen, 0);
+		cwret = cw_gen_fill_buffer(gen, samples, n);
+		cw_gen_stop(gen);
 	}
+	*sample_rate = gen->sample_rate;
+	cw_gen_delete(&gen);
 
+	return cwret;
+}
 
-	/* Test: trying to enqueue invalid strings. */
+
+
+
+/* Count sign changes of samples in range [start, stop). */
+static int test_cw_gen_impairments_zero_crossings_internal(const cw_sample_t * samples, size_t start, size_t stop)
+{
+	int n_crossings = 0;
+	for (size_t i = start + 1; i < stop; i++) {
+		n_crossings += (samples[i - 1] < 0) != (samples[i] < 0);
+	}
+	return n_crossings;
+}
+
+
+
+
+/**
+   @brief Test impairments of radio channel: noise, QSB, QRN and chirp
+*/
+cwt_retv test_cw_gen_impairments(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Dash at default speed, followed by silence. */
+	const char * string = "t";
+	const size_t n = 48000;
+	cw_sample_t * reference = calloc(n, sizeof (cw_sample_t));
+	cw_sample_t * samples = calloc(n, sizeof (cw_sample_t));
+	cw_sample_t * samples2 = calloc(n, sizeof (cw_sample_t));
+	cte->assert2(cte, NULL != reference && NULL != samples && NULL != samples2, "failed to allocate buffers");
+	int sample_rate = 0;
+
+
+	/* Invalid arguments. */
 	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .pull_mode = true };
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, NULL != gen, "failed to create generator");
+
+		const cw_impairments_t invalid[] = {
+			{ .noise_level = CW_IMPAIRMENT_LEVEL_MAX + 1 },
+			{ .noise_level = 10, .noise_bandwidth = CW_IMPAIRMENT_NOISE_BANDWIDTH_MIN - 1 },
+			{ .qsb_depth = 50 },
+			{ .qsb_depth = 50, .qsb_period = CW_IMPAIRMENT_QSB_PERIOD_MAX + 1 },
+			{ .qrn_rate = CW_IMPAIRMENT_QRN_RATE_MAX + 1, .qrn_level = 10 },
+			{ .chirp_depth = -CW_IMPAIRMENT_CHIRP_DEPTH_MAX - 1, .chirp_duration = 100 },
+			{ .chirp_depth = 100, .chirp_duration = -1 },
+		};
 		bool failure = false;
-		for (int rep = 0; rep < loops; rep++) {
-			int i = 0;
-			while (NULL != test_invalid_strings[i]) {
-				const char * test_string = test_invalid_strings[i];
-				const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_string)(gen, test_string);
-				if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "enqueue string(<invalid>) (i = %d, string = '%s')", i, test_string)) {
-					failure = true;
-					break;
-				}
-				i++;
-			}
-			if (failure) {
+		for (size_t i = 0; i < sizeof (invalid) / sizeof (invalid[0]); i++) {
+			errno = 0;
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_impairments)(gen, &invalid[i]);
+			if (!cte->expect_op_int_errors_only(cte, CW_FAILURE, "==", cwret, "set invalid impairments #%zu: cwret", i)
+			    || !cte->expect_op_int_errors_only(cte, EINVAL, "==", errno, "set invalid impairments #%zu: errno", i)) {
+				failure = true;
 				break;
 			}
 		}
-		cte->expect_op_int(cte, false, "==", failure, "enqueue string(<invalid>)");
-	}
+		cte->expect_op_int(cte, false, "==", failure, "set invalid impairments");
 
-	gen_destroy(&gen);
+		errno = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_impairments)(gen, NULL);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "set NULL impairments");
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "set NULL impairments: cwret");
+
+		const cw_impairments_t valid = { .noise_level = 20, .noise_bandwidth = 500, .qsb_depth = 50, .qsb_period = 4000, .chirp_depth = -100, .chirp_duration = 50, .seed = 7 };
+		cwret = LIBCW_TEST_FUT(cw_gen_set_impairments)(gen, &valid);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set valid impairments");
+		cw_impairments_t got = { 0 };
+		cwret = LIBCW_TEST_FUT(cw_gen_get_impairments)(gen, &got);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "get impairments");
+		cte->expect_op_int(cte, 0, "==", memcmp(&valid, &got, sizeof (got)), "get impairments: values");
 
-	cte->print_test_footer(cte, __func__);
+		cw_gen_delete(&gen);
+	}
 
-	return cwt_retv_ok;
-}
 
+	/* No impairments: samples are not changed at all. */
+	{
+		cw_ret_t cwret = test_cw_gen_impairments_pull_internal(NULL, string, reference, n, &sample_rate);
+		cte->assert2(cte, CW_SUCCESS == cwret, "failed to get reference samples");
+		const cw_impairments_t none = { 0 };
+		cwret = test_cw_gen_impairments_pull_internal(&none, string, samples, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "no impairments: cwret");
+		cte->expect_op_int(cte, 0, "==", memcmp(reference, samples, n * sizeof (cw_sample_t)), "no impairments: samples");
+	}
 
+	/* Mark of reference samples. */
+	size_t mark_start = 0;
+	while (mark_start < n && 0 == reference[mark_start]) {
+		mark_start++;
+	}
+	size_t mark_stop = n;
+	while (mark_stop > mark_start && 0 == reference[mark_stop - 1]) {
+		mark_stop--;
+	}
+	cte->assert2(cte, mark_stop - mark_start > (size_t) sample_rate / 10, "failed to find Mark in reference samples");
 
 
-/**
-   @brief Test removing a character from end of enqueued characters
+	/* Noise is heard also when queue is empty. The same seed gives
+	   the same noise. */
+	{
+		const cw_impairments_t noise = { .noise_level = 10, .noise_bandwidth = 500, .seed = 1 };
+		cw_ret_t cwret = test_cw_gen_impairments_pull_internal(&noise, "", samples, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "noise: cwret");
+		size_t n_non_silent = 0;
+		for (size_t i = 0; i < n; i++) {
+			n_non_silent += 0 != samples[i];
+		}
+		cte->expect_op_int(cte, (int) (n / 2), "<", (int) n_non_silent, "noise: empty queue is not silent");
 
-   @reviewed on 2020-08-24
-*/
-cwt_retv test_cw_gen_remove_last_character(cw_test_executor_t * cte)
-{
-	cte->print_test_header(cte, "%s", __func__);
+		cwret = test_cw_gen_impairments_pull_internal(&noise, "", samples2, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "noise again: cwret");
+		cte->expect_op_int(cte, 0, "==", memcmp(samples, samples2, n * sizeof (cw_sample_t)), "noise: the same seed gives the same noise");
 
-	cw_gen_t * gen = NULL;
-	if (cwt_retv_ok != gen_setup(cte, &gen)) {
-		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
-		return cwt_retv_err;
+		const cw_impairments_t noise2 = { .noise_level = 10, .noise_bandwidth = 500, .seed = 2 };
+		cwret = test_cw_gen_impairments_pull_internal(&noise2, "", samples2, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "noise with other seed: cwret");
+		cte->expect_op_int(cte, 0, "!=", memcmp(samples, samples2, n * sizeof (cw_sample_t)), "noise: other seed gives other noise");
 	}
 
-	const int n = 4;
-	bool failure = false;
-	for (int to_remove = 0; to_remove <= n; to_remove++) {
-		cw_gen_start(gen);
 
-		cte->log_info(cte, "You will now hear 'oooo' followed by %d 's' characters\n", n - to_remove);
-		cw_gen_enqueue_string(gen, "oooo" "ssss");
+	/* Crashes: bursts of noise, with silence between them. */
+	{
+		const cw_impairments_t qrn = { .qrn_rate = CW_IMPAIRMENT_QRN_RATE_MAX, .qrn_level = 50, .seed = 1 };
+		const cw_ret_t cwret = test_cw_gen_impairments_pull_internal(&qrn, "", samples, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "qrn: cwret");
+		int peak = 0;
+		size_t n_non_silent = 0;
+		for (size_t i = 0; i < n; i++) {
+			n_non_silent += 0 != samples[i];
+			peak = abs(samples[i]) > peak ? abs(samples[i]) : peak;
+		}
+		cte->expect_op_int(cte, INT16_MAX / 10, "<", peak, "qrn: crashes are loud");
+		cte->expect_op_int(cte, (int) (n / 2), ">", (int) n_non_silent, "qrn: silence between crashes");
+	}
 
-		/* Remove N characters from end. */
-		for (int i = 0; i < to_remove; i++) {
-			cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_remove_last_character(gen));
-			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret,
-							    "remove last %d characters, removing %d-th character",
-							    to_remove, i)) {
-				failure = true;
-				break;
+
+	/* QSB: amplitude of Mark changes. Peaks are measured in 5 ms
+	   windows, away from slopes of Mark. */
+	{
+		const cw_impairments_t qsb = { .qsb_depth = CW_IMPAIRMENT_LEVEL_MAX, .qsb_period = CW_IMPAIRMENT_QSB_PERIOD_MIN, .seed = 1 };
+		const cw_ret_t cwret = test_cw_gen_impairments_pull_internal(&qsb, string, samples, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "qsb: cwret");
+
+		const size_t window = (size_t) sample_rate / 200;
+		int min_peak = INT16_MAX;
+		int max_peak = 0;
+		for (size_t w = mark_start + 2 * window; w + 3 * window < mark_stop; w += window) {
+			int peak = 0;
+			for (size_t i = w; i < w + window; i++) {
+				peak = abs(samples[i]) > peak ? abs(samples[i]) : peak;
 			}
+			min_peak = peak < min_peak ? peak : min_peak;
+			max_peak = peak > max_peak ? peak : max_peak;
 		}
+		cte->expect_op_int(cte, max_peak / 4, "<", max_peak - min_peak, "qsb: amplitude of Mark changes (%d - %d)", min_peak, max_peak);
+	}
 
-		cw_gen_wait_for_queue_level(gen, 0);
-		cw_usleep_internal(1000 * 1000);
-		cw_gen_stop(gen);
 
-		if (failure) {
-			break;
-		}
+	/* Chirp: frequency at start of Mark is higher than at its end. */
+	{
+		const cw_impairments_t chirp = { .chirp_depth = 300, .chirp_duration = 100 };
+		const cw_ret_t cwret = test_cw_gen_impairments_pull_internal(&chirp, string, samples, n, &sample_rate);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "chirp: cwret");
+
+		const size_t window = (size_t) sample_rate / 50;
+		const int n_start = test_cw_gen_impairments_zero_crossings_internal(samples, mark_start, mark_start + window);
+		const int n_stop = test_cw_gen_impairments_zero_crossings_internal(samples, mark_stop - window, mark_stop);
+		const int n_reference = test_cw_gen_impairments_zero_crossings_internal(reference, mark_start, mark_start + window);
+		cte->expect_op_int(cte, n_stop + 4, "<", n_start, "chirp: frequency at start of Mark (%d) is higher than at end (%d)", n_start, n_stop);
+		cte->expect_op_int(cte, n_reference + 4, "<", n_start, "chirp: frequency at start of Mark (%d) is higher than without chirp (%d)", n_start, n_reference);
 	}
 
-	gen_destroy(&gen);
 
-	cte->expect_op_int(cte, false, "==", failure, "remove last character");
+	free(samples2);
+	free(samples);
+	free(reference);
 
 	cte->print_test_footer(cte, __func__);
 
@@ -20,7 +20,37 @@ int test_cw_gen_new_stop_delete(cw_test_executor_t * cte);
 int test_cw_gen_new_start_stop_delete(cw_test_executor_t * cte);
 
 int test_cw_gen_set_tone_slope(cw_test_executor_t * cte);
+int test_cw_gen_slope_table(cw_test_executor_t * cte);
 int test_cw_gen_tone_slope_shape_enums(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_oscillators(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_envelope(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_silence(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_pcm_cache(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_render(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_file_sink(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_rtp_sink(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_latency_stats(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_stats(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_fill_buffer(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_realtime_config(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_low_latency_keying(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_null_pacing(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_event_fd(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_keying(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_mixer(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_tap(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_sound_channels(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_sched(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_pool(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_pause(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_sample_formats(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_shmq(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_wait_async(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_text_source(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_dispatch(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_timed_value_tracking(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_idle_mode(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_impairments(cw_test_executor_t * cte);
 int test_cw_gen_forever_internal(cw_test_executor_t * cte);
 int test_cw_gen_get_timing_parameters_internal(cw_test_executor_t * cte);
 int test_cw_gen_parameter_getters_setters(cw_test_executor_t * cte);
@@ -29,6 +59,9 @@ int test_cw_gen_enqueue_primitives(cw_test_executor_t * cte);
 int test_cw_gen_enqueue_representations(cw_test_executor_t * cte);
 int test_cw_gen_enqueue_character(cw_test_executor_t * cte);
 int test_cw_gen_enqueue_string(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_enqueue_tones(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_char_tones(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_hot_parameters(cw_test_executor_t * cte);
 cwt_retv test_cw_gen_remove_last_character(cw_test_executor_t * cte);
 
 
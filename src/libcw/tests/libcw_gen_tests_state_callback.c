@@ -397,8 +397,10 @@ static void gen_callback_fn(void * callback_arg, int state)
 {
 	callback_data_t * callback_data = (callback_data_t *) callback_arg;
 
+	/* Generator paces tones with library's clock, which may be
+	   virtual clock injected by tests. */
 	struct timeval now_timestamp = { 0 };
-	gettimeofday(&now_timestamp, NULL);
+	cw_clock_get_timeval_internal(&now_timestamp);
 
 	if (callback_data->counter > 0) { /* Don't do anything for zero-th element, for which there is no 'prev timestamp'. */
 		const int diff = cw_timestamp_compare_internal(&callback_data->prev_timestamp, &now_timestamp);
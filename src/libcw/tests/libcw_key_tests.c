@@ -25,6 +25,14 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 
 
@@ -34,9 +42,13 @@
 
 
 
+#include "libcw_data.h"
 #include "libcw_gen.h"
+#include "libcw_input.h"
 #include "libcw_key.h"
 #include "libcw_key_tests.h"
+#include "libcw_keylog.h"
+#include "libcw_netkey.h"
 #include "libcw_debug.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
@@ -359,3 +371,965 @@ int test_straight_key(cw_test_executor_t * cte)
 	return 0;
 }
 
+
+
+
+
+/**
+   Test that timer of iambic keyer is clocked with count of samples
+   of dequeued tones, without accumulating rounding errors.
+*/
+int test_keyer_timer(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = cw_key_new();
+	if (!cte->expect_valid_pointer_errors_only(cte, key, "creating key")) {
+		return -1;
+	}
+
+	struct timeval timer = { 0, 0 };
+	cw_key_ik_register_timer_internal(key, &timer);
+
+	/* Pretend that keyer has left KS_IDLE state at given moment. */
+	key->ik.graph_state = KS_IN_DOT_A;
+	key->ik.ik_timer_anchor.tv_sec = 100;
+	key->ik.ik_timer_anchor.tv_usec = 999990;
+	key->ik.ik_timer_n_samples = 0;
+
+	/* Each tone has 7 samples at 48000 Hz (145.8333 us). With
+	   duration of each tone rounded to whole microseconds the error
+	   would be over 5 ms after 6857 tones. */
+	const int sample_rate = 48000;
+	const int n_tones = 6857;
+	for (int i = 0; i < n_tones; i++) {
+		LIBCW_TEST_FUT(cw_key_ik_increment_timer_internal)(key, 7, sample_rate);
+	}
+
+	const int64_t expected = 100 * (int64_t) CW_USECS_PER_SEC + 999990 + (int64_t) n_tones * 7 * CW_USECS_PER_SEC / sample_rate;
+	const int64_t actual = (int64_t) timer.tv_sec * CW_USECS_PER_SEC + timer.tv_usec;
+	cte->expect_op_int(cte, (int) (expected - 100 * (int64_t) CW_USECS_PER_SEC), "==", (int) (actual - 100 * (int64_t) CW_USECS_PER_SEC), "timer after %d tones", n_tones);
+	cte->expect_op_int(cte, CW_USECS_PER_SEC, ">", (int) timer.tv_usec, "normalized microseconds of timer");
+
+
+	/* Timer of idle keyer is not clocked. */
+	key->ik.graph_state = KS_IDLE;
+	const struct timeval before = timer;
+	LIBCW_TEST_FUT(cw_key_ik_increment_timer_internal)(key, 48000, sample_rate);
+	cte->expect_op_int(cte, 1, "==", before.tv_sec == timer.tv_sec && before.tv_usec == timer.tv_usec, "timer of idle keyer");
+
+	cw_key_delete(&key);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+static void test_key_input_callback(void * callback_arg, __attribute__((unused)) cw_input_line_t line, __attribute__((unused)) cw_key_value_t value, __attribute__((unused)) int64_t timestamp)
+{
+	int * n_calls = (int *) callback_arg;
+	(*n_calls)++;
+}
+
+
+
+
+/**
+   Test arguments checks of key input, and delivery of values of lines
+   to key. Real devices are not available in test environment.
+*/
+int test_key_input(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	errno = 0;
+	cw_input_t * input = LIBCW_TEST_FUT(cw_input_new)(NULL);
+	cte->expect_null_pointer(cte, input, "new key input with NULL key");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL key");
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return -1;
+	}
+
+	input = LIBCW_TEST_FUT(cw_input_new)(key);
+	if (!cte->expect_valid_pointer(cte, input, "new key input")) {
+		key_destroy(&key, &gen);
+		return -1;
+	}
+
+
+	/* Invalid sources. */
+	{
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_input_add_serial)(input, "/dev/null", CW_INPUT_LINE_NONE, CW_INPUT_LINE_NONE);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "serial port without lines");
+
+		cwret = LIBCW_TEST_FUT(cw_input_add_serial)(input, "/dev/null", CW_INPUT_LINE_DOT_PADDLE, CW_INPUT_LINE_DASH_PADDLE);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "serial port that is not a tty");
+
+		cwret = LIBCW_TEST_FUT(cw_input_add_evdev)(input, "/dev/null", 28, CW_INPUT_LINE_STRAIGHT_KEY);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "input device that is not evdev");
+
+		cwret = LIBCW_TEST_FUT(cw_input_add_evdev)(input, "/dev/null", 28, CW_INPUT_LINE_NONE);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "input device without line");
+
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_input_start)(input);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "start without sources");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for start without sources");
+	}
+
+
+	/* Delivery of values of lines to keyer. */
+	{
+		int n_calls = 0;
+		LIBCW_TEST_FUT(cw_input_register_callback)(input, test_key_input_callback, &n_calls);
+
+		cw_key_value_t dot = CW_KEY_VALUE_OPEN;
+		cw_key_value_t dash = CW_KEY_VALUE_OPEN;
+
+		cw_input_set_value_internal(input, CW_INPUT_LINE_DOT_PADDLE, CW_KEY_VALUE_CLOSED, 1000);
+		cw_input_set_value_internal(input, CW_INPUT_LINE_DOT_PADDLE, CW_KEY_VALUE_CLOSED, 2000); /* Repeated value. */
+		cw_key_ik_get_paddles(key, &dot, &dash);
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", dot, "dot paddle closed");
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", dash, "dash paddle open");
+
+		cw_input_set_value_internal(input, CW_INPUT_LINE_DASH_PADDLE, CW_KEY_VALUE_CLOSED, 3000);
+		cw_input_set_value_internal(input, CW_INPUT_LINE_DOT_PADDLE, CW_KEY_VALUE_OPEN, 4000);
+		cw_key_ik_get_paddles(key, &dot, &dash);
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", dot, "dot paddle open");
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", dash, "dash paddle closed");
+
+		cw_input_set_value_internal(input, CW_INPUT_LINE_DASH_PADDLE, CW_KEY_VALUE_OPEN, 5000);
+		cte->expect_op_int(cte, 4, "==", n_calls, "count of calls of callback");
+
+		cw_key_ik_wait_for_keyer(key);
+	}
+
+	cw_input_delete(&input);
+	cte->expect_null_pointer(cte, input, "deleted key input");
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Log of most recent changes replayed by network keying. */
+typedef struct {
+	int n_calls;
+	cw_key_value_t values[16];
+	int64_t timestamps[16]; /* [ns] */
+	int64_t call_times[16]; /* [ns] */
+} test_key_netkey_log_t;
+
+
+
+
+static void test_key_netkey_callback(void * callback_arg, cw_key_value_t value, int64_t timestamp)
+{
+	test_key_netkey_log_t * log = (test_key_netkey_log_t *) callback_arg;
+	const int i = log->n_calls % 16;
+	log->values[i] = value;
+	log->timestamps[i] = timestamp;
+	log->call_times[i] = cw_clock_now_internal();
+	log->n_calls++;
+}
+
+
+
+
+/**
+   Build datagram of network keying with @p n changes, starting with
+   change with sequence number @p first_sequence. Changes alternate
+   between closing and opening of key, starting with value of @p
+   first_closed.
+
+   @return size of datagram
+*/
+static size_t test_key_netkey_datagram(uint8_t * datagram, uint32_t first_sequence, const int64_t * times, size_t n, bool first_closed)
+{
+	datagram[0] = 'C';
+	datagram[1] = 'W';
+	datagram[2] = CW_NETKEY_VERSION;
+	datagram[3] = (uint8_t) n;
+	for (int b = 0; b < 4; b++) {
+		datagram[4 + b] = (uint8_t) (first_sequence >> (24 - 8 * b));
+	}
+	for (size_t i = 0; i < n; i++) {
+		const bool closed = (0 == i % 2) == first_closed;
+		const uint32_t raw = ((uint32_t) times[i] & 0x7fffffff) | (closed ? 0x80000000 : 0);
+		for (int b = 0; b < 4; b++) {
+			datagram[8 + 4 * i + (size_t) b] = (uint8_t) (raw >> (24 - 8 * b));
+		}
+	}
+	return 8 + 4 * n;
+}
+
+
+
+
+/**
+   Test arguments checks of network keying, jitter buffer (with
+   datagrams passed directly to it), and replay of datagrams received
+   over loopback interface.
+*/
+int test_key_netkey(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	errno = 0;
+	cw_netkey_t * netkey = LIBCW_TEST_FUT(cw_netkey_new)(NULL);
+	cte->expect_null_pointer(cte, netkey, "new network keying with NULL key");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL key");
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return -1;
+	}
+
+	netkey = LIBCW_TEST_FUT(cw_netkey_new)(key);
+	if (!cte->expect_valid_pointer(cte, netkey, "new network keying")) {
+		key_destroy(&key, &gen);
+		return -1;
+	}
+
+
+	/* Invalid arguments. */
+	{
+		errno = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_netkey_start)(netkey);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "start without socket");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for start without socket");
+
+		cwret = LIBCW_TEST_FUT(cw_netkey_bind)(netkey, "127.0.0.1");
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "bind to address without port");
+		cwret = LIBCW_TEST_FUT(cw_netkey_bind)(netkey, "[::1:7373");
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "bind to malformed IPv6 address");
+
+		cwret = LIBCW_TEST_FUT(cw_netkey_set_delay_range)(netkey, 50000, 40000);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "delay range with min > max");
+		cwret = LIBCW_TEST_FUT(cw_netkey_set_delay_range)(netkey, -1, 40000);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "delay range with negative min");
+	}
+
+
+	/* Jitter buffer, with datagrams and times of their arrival given
+	   by test. Sender's clock is ahead of local clock by 1 s. */
+	{
+		test_key_netkey_log_t log = { 0 };
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_netkey_register_callback)(netkey, test_key_netkey_callback, &log), "register callback");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_netkey_set_delay_range)(netkey, 20000, 200000), "set delay range");
+
+		const int64_t clock_offset = 1000000; /* [us] */
+		uint8_t datagram[8 + 4 * CW_NETKEY_EVENTS_MAX];
+		cw_netkey_stats_t stats;
+
+		/* Mark of 60 ms, reported by two datagrams. Second datagram
+		   repeats the closing change, and is delayed by 10 ms more
+		   than first one. */
+		const int64_t times[] = { 2000000, 2060000, 2120000, 2300000 };
+		size_t n = test_key_netkey_datagram(datagram, 0, times, 1, true);
+		cw_netkey_process_datagram_internal(netkey, datagram, n, (times[0] - clock_offset + 5000) * 1000);
+		n = test_key_netkey_datagram(datagram, 0, times, 2, true);
+		cw_netkey_process_datagram_internal(netkey, datagram, n, (times[1] - clock_offset + 15000) * 1000);
+		/* Duplicate. */
+		cw_netkey_process_datagram_internal(netkey, datagram, n, (times[1] - clock_offset + 16000) * 1000);
+
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_op_int(cte, 3, "==", (int) stats.n_datagrams, "count of datagrams");
+		cte->expect_op_int(cte, 2, "==", (int) stats.n_events, "count of changes (repeated changes are not counted)");
+		cte->expect_op_int(cte, 20000, "==", stats.delay, "delay of first talkspurt is minimal delay");
+
+		cw_netkey_replay_internal(netkey, (times[1] - clock_offset + 1000000) * 1000);
+		cte->expect_op_int(cte, 2, "==", log.n_calls, "replayed changes");
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", log.values[0], "first change closes key");
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", log.values[1], "second change opens key");
+		/* Smallest transit time (5 ms) plus delay. */
+		cte->expect_op_int(cte, (int) ((times[0] - clock_offset + 5000 + 20000) / 1000), "==", (int) (log.timestamps[0] / 1000000), "time of replay of first change [ms]");
+		cte->expect_op_int(cte, 60000000, "==", (int) (log.timestamps[1] - log.timestamps[0]), "mark keeps its duration despite jitter");
+
+		/* Lost change: sequence number 2 (closing at times[2]) is
+		   never received, so opening change 3 is dropped as well. */
+		n = test_key_netkey_datagram(datagram, 3, times + 3, 1, false);
+		cw_netkey_process_datagram_internal(netkey, datagram, n, (times[3] - clock_offset + 5000) * 1000);
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_op_int(cte, 1, "==", (int) stats.n_lost, "count of lost changes");
+		cw_netkey_replay_internal(netkey, (times[3] - clock_offset + 1000000) * 1000);
+		cte->expect_op_int(cte, 2, "==", log.n_calls, "change with value of key is not replayed");
+
+		/* Network with large jitter: closing changes of a long
+		   series of dots have transit time of 5 ms, and opening
+		   changes have transit time of 45 ms. */
+		uint32_t sequence = 4;
+		int64_t t = 3000000;
+		for (int i = 0; i < 40; i++) {
+			const int64_t mark[2] = { t, t + 50000 };
+			n = test_key_netkey_datagram(datagram, sequence, mark + 0, 1, true);
+			cw_netkey_process_datagram_internal(netkey, datagram, n, (mark[0] - clock_offset + 5000) * 1000);
+			n = test_key_netkey_datagram(datagram, sequence + 1, mark + 1, 1, false);
+			cw_netkey_process_datagram_internal(netkey, datagram, n, (mark[1] - clock_offset + 45000) * 1000);
+			cw_netkey_replay_internal(netkey, (mark[1] - clock_offset + 1000000) * 1000);
+			sequence += 2;
+			t += 1000000;
+		}
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_between_int(cte, 35000, stats.jitter, 40000, "estimate of jitter");
+		cte->expect_between_int(cte, 140000, stats.delay, 160000, "delay follows jitter");
+		cte->expect_op_int(cte, 0, "<", (int) stats.n_late, "some changes were late while delay was short");
+		cte->expect_op_int(cte, 2 + 80, "==", log.n_calls, "replayed changes of series of dots");
+		/* Last eight dots, replayed with adapted delay. */
+		bool durations_ok = true;
+		for (int i = 0; i < 16; i += 2) {
+			if (CW_KEY_VALUE_CLOSED != log.values[i] || 50000000 != log.timestamps[i + 1] - log.timestamps[i]) {
+				durations_ok = false;
+			}
+		}
+		cte->expect_op_int(cte, true, "==", durations_ok, "dots keep their durations");
+
+		/* Change that arrives after its playout time is replayed
+		   right away. */
+		const unsigned int n_late = stats.n_late;
+		const int64_t mark[2] = { t, t + 50000 };
+		n = test_key_netkey_datagram(datagram, sequence, mark, 1, true);
+		cw_netkey_process_datagram_internal(netkey, datagram, n, (mark[0] - clock_offset + 5000) * 1000);
+		n = test_key_netkey_datagram(datagram, sequence, mark, 2, true);
+		const int64_t late_arrival = (mark[1] - clock_offset + 5000 + 300000) * 1000;
+		cw_netkey_process_datagram_internal(netkey, datagram, n, late_arrival);
+		cw_netkey_replay_internal(netkey, late_arrival + 1000000000);
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_op_int(cte, (int) n_late + 1, "==", (int) stats.n_late, "count of late changes");
+		cte->expect_op_int(cte, 84, "==", log.n_calls, "replayed changes of last mark");
+		cte->expect_op_int(cte, true, "==", late_arrival == log.timestamps[83 % 16], "late change is replayed at time of its arrival");
+
+		/* Malformed datagrams. */
+		cw_netkey_process_datagram_internal(netkey, datagram, n - 1, late_arrival);
+		datagram[0] = 'X';
+		cw_netkey_process_datagram_internal(netkey, datagram, n, late_arrival);
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_op_int(cte, 2, "==", (int) stats.n_invalid, "count of malformed datagrams");
+		cw_netkey_register_callback(netkey, NULL, NULL);
+	}
+
+	cw_netkey_delete(&netkey);
+	cte->expect_null_pointer(cte, netkey, "deleted network keying");
+
+
+	/* Datagrams received over loopback interface. Each datagram
+	   repeats up to three preceding changes. */
+	{
+		test_key_netkey_log_t log = { 0 };
+		netkey = cw_netkey_new(key);
+		cw_netkey_register_callback(netkey, test_key_netkey_callback, &log);
+		/* Delay is long enough not to be exceeded on busy test
+		   machine. */
+		cw_netkey_set_delay_range(netkey, 100000, 200000);
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_netkey_bind)(netkey, "127.0.0.1:0");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "bind to loopback interface");
+		const int port = LIBCW_TEST_FUT(cw_netkey_get_port)(netkey);
+		cte->expect_op_int(cte, 0, "<", port, "port picked by kernel");
+		cwret = LIBCW_TEST_FUT(cw_netkey_start)(netkey);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "start");
+
+		const int sender = socket(AF_INET, SOCK_DGRAM, 0);
+		struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t) port) };
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		connect(sender, (struct sockaddr *) &addr, sizeof (addr));
+
+		/* "s", with sender's clock in microseconds. */
+		int64_t times[6];
+		uint8_t datagram[8 + 4 * 4];
+		for (int i = 0; i < 6; i++) {
+			times[i] = cw_clock_now_internal() / 1000 + 1000000;
+			const int first = i >= 3 ? i - 3 : 0;
+			const size_t n = test_key_netkey_datagram(datagram, (uint32_t) first, times + first, (size_t) (i - first + 1), 0 == first % 2);
+			send(sender, datagram, n, 0);
+			cw_usleep_internal(40000);
+		}
+		cw_usleep_internal(300000);
+		close(sender);
+
+		cwret = LIBCW_TEST_FUT(cw_netkey_stop)(netkey);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "stop");
+
+		cw_netkey_stats_t stats;
+		cw_netkey_get_stats(netkey, &stats);
+		cte->expect_op_int(cte, 6, "==", (int) stats.n_datagrams, "count of received datagrams");
+		cte->expect_op_int(cte, 6, "==", log.n_calls, "count of replayed changes");
+		bool timing_ok = true;
+		bool values_ok = true;
+		for (int i = 0; i < 6 && i < log.n_calls; i++) {
+			if ((0 == i % 2 ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN) != log.values[i]) {
+				values_ok = false;
+			}
+			if (i > 0 && (times[i] - times[i - 1]) * 1000 != log.timestamps[i] - log.timestamps[i - 1]) {
+				timing_ok = false;
+			}
+			if (log.call_times[i] < log.timestamps[i]) {
+				timing_ok = false;
+			}
+		}
+		cte->expect_op_int(cte, true, "==", values_ok, "replayed values of key");
+		cte->expect_op_int(cte, true, "==", timing_ok, "relative timing of changes is kept");
+
+		cw_netkey_delete(&netkey);
+	}
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+/**
+   Find value of metric @p name of object with label @p label in
+   text of metrics.
+
+   @return true if the metric has been found
+*/
+static bool test_key_metrics_value(const char * text, const char * name, const char * label, double * value)
+{
+	char suffix[64];
+	snprintf(suffix, sizeof (suffix), "label=\"%s\"} ", label);
+	const size_t name_len = strlen(name);
+	for (const char * line = text; NULL != line && '\0' != *line; line = strchr(line, '\n'), line = NULL == line ? NULL : line + 1) {
+		if (0 != strncmp(line, name, name_len) || '{' != line[name_len]) {
+			continue;
+		}
+		const char * end = strchr(line, '\n');
+		const char * found = strstr(line, suffix);
+		if (NULL != found && (NULL == end || found < end)) {
+			*value = strtod(found + strlen(suffix), NULL);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+/**
+   Send @p request to exporter of metrics over socket @p fd, and read
+   the whole response into @p response.
+*/
+static void test_key_metrics_request(int fd, const char * request, char * response, size_t size)
+{
+	send(fd, request, strlen(request), MSG_NOSIGNAL);
+	size_t len = 0;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	while (len < size - 1 && poll(&pfd, 1, 5000) > 0) {
+		const ssize_t n = recv(fd, response + len, size - 1 - len, 0);
+		if (n <= 0) {
+			break;
+		}
+		len += (size_t) n;
+	}
+	response[len] = '\0';
+	close(fd);
+}
+
+
+
+
+/**
+   Test metrics of key, receiver and generator, and their export over
+   TCP and Unix sockets.
+*/
+int test_key_metrics(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	errno = 0;
+	int n = LIBCW_TEST_FUT(cw_metrics_write)(NULL, 10);
+	cte->expect_op_int(cte, -1, "==", n, "write to NULL buffer");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL buffer");
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return -1;
+	}
+	cw_rec_t * rec = cw_rec_new();
+	if (!cte->expect_valid_pointer(cte, rec, "new receiver")) {
+		key_destroy(&key, &gen);
+		return -1;
+	}
+	cw_key_set_label(key, "metrics_key");
+	cw_gen_set_label(gen, "metrics_gen");
+	cw_rec_set_label(rec, "metrics_rec");
+
+	cw_key_sk_set_value(key, CW_KEY_VALUE_CLOSED);
+	usleep(50000);
+	cw_key_sk_set_value(key, CW_KEY_VALUE_OPEN);
+
+	cw_rec_set_speed(rec, 20);
+	int64_t t = cw_clock_now_internal();
+	cw_rec_add_mark_ns(rec, t, CW_DOT_REPRESENTATION);
+	cw_rec_add_mark_ns(rec, t + 200000000, CW_DASH_REPRESENTATION);
+	cw_rec_add_mark_ns(rec, t + 400000000, CW_DOT_REPRESENTATION);
+
+
+	/* Text of metrics. */
+	{
+		const int len = LIBCW_TEST_FUT(cw_metrics_write)(NULL, 0);
+		cte->expect_op_int(cte, 0, "<", len, "length of text");
+
+		/* Counters of running generator may grow between calls. */
+		const size_t size = (size_t) len + 4096;
+		char * text = (char *) malloc(size);
+		n = LIBCW_TEST_FUT(cw_metrics_write)(text, size);
+		cte->expect_op_int(cte, true, "==", n > 0 && (size_t) n < size && (size_t) n == strlen(text), "text fits into buffer");
+
+		double value = 0.0;
+		bool found = test_key_metrics_value(text, "libcw_key_sk_changes_total", "metrics_key", &value);
+		cte->expect_op_int(cte, true, "==", found && 2 == (int) value, "changes of straight key");
+		found = test_key_metrics_value(text, "libcw_rec_dots_total", "metrics_rec", &value);
+		cte->expect_op_int(cte, true, "==", found && 2 == (int) value, "dots of receiver");
+		found = test_key_metrics_value(text, "libcw_rec_dashes_total", "metrics_rec", &value);
+		cte->expect_op_int(cte, true, "==", found && 1 == (int) value, "dashes of receiver");
+		found = test_key_metrics_value(text, "libcw_rec_speed_wpm", "metrics_rec", &value);
+		cte->expect_op_int(cte, true, "==", found && 20 == (int) value, "speed of receiver");
+		found = test_key_metrics_value(text, "libcw_tq_enqueued_total", "metrics_gen", &value);
+		cte->expect_op_int(cte, true, "==", found && value >= 1.0, "tones enqueued by straight key");
+		found = test_key_metrics_value(text, "libcw_tq_capacity", "metrics_gen", &value);
+		cte->expect_op_int(cte, true, "==", found && value > 0.0, "capacity of tone queue");
+		cte->expect_valid_pointer(cte, strstr(text, "# TYPE libcw_gen_queue_latency_seconds histogram\n"), "type of latency histogram");
+		cte->expect_valid_pointer(cte, strstr(text, "label=\"metrics_gen\",le=\"+Inf\"}"), "last bucket of latency histogram");
+
+		/* Truncated text is terminated, and its full length is
+		   returned. */
+		char small[16];
+		n = LIBCW_TEST_FUT(cw_metrics_write)(small, sizeof (small));
+		cte->expect_op_int(cte, true, "==", n > (int) sizeof (small) && strlen(small) == sizeof (small) - 1, "truncated text");
+
+		free(text);
+	}
+
+
+	/* Deleted object is not exported. */
+	{
+		cw_rec_delete(&rec);
+		char text[64 * 1024];
+		cw_metrics_write(text, sizeof (text));
+		cte->expect_null_pointer(cte, strstr(text, "metrics_rec"), "metrics of deleted receiver");
+	}
+
+
+	/* Exporter on TCP socket. */
+	{
+		cw_metrics_t * metrics = LIBCW_TEST_FUT(cw_metrics_new)();
+		cte->expect_valid_pointer(cte, metrics, "new exporter");
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_metrics_start)(metrics);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "start without socket");
+		cwret = LIBCW_TEST_FUT(cw_metrics_bind)(metrics, "127.0.0.1");
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "bind to address without port");
+
+		cwret = LIBCW_TEST_FUT(cw_metrics_bind)(metrics, "127.0.0.1:0");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "bind to loopback interface");
+		const int port = LIBCW_TEST_FUT(cw_metrics_get_port)(metrics);
+		cte->expect_op_int(cte, 0, "<", port, "port picked by kernel");
+		cwret = LIBCW_TEST_FUT(cw_metrics_start)(metrics);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "start");
+
+		struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t) port) };
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		char response[64 * 1024];
+
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		connect(fd, (struct sockaddr *) &addr, sizeof (addr));
+		test_key_metrics_request(fd, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response, sizeof (response));
+		cte->expect_op_int(cte, 0, "==", strncmp(response, "HTTP/1.0 200 OK\r\n", strlen("HTTP/1.0 200 OK\r\n")), "status of response");
+		cte->expect_valid_pointer(cte, strstr(response, "libcw_key_sk_changes_total{key="), "metrics in response");
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		connect(fd, (struct sockaddr *) &addr, sizeof (addr));
+		test_key_metrics_request(fd, "POST /metrics HTTP/1.0\r\n\r\n", response, sizeof (response));
+		cte->expect_op_int(cte, 0, "==", strncmp(response, "HTTP/1.0 405 ", strlen("HTTP/1.0 405 ")), "status of response to POST");
+
+		cwret = LIBCW_TEST_FUT(cw_metrics_stop)(metrics);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "stop");
+		cw_metrics_delete(&metrics);
+		cte->expect_null_pointer(cte, metrics, "deleted exporter");
+	}
+
+
+	/* Exporter on Unix socket. */
+	{
+		char path[64];
+		snprintf(path, sizeof (path), "/tmp/libcw_metrics_test_%ld.sock", (long) getpid());
+		char address[80];
+		snprintf(address, sizeof (address), "unix:%s", path);
+
+		cw_metrics_t * metrics = cw_metrics_new();
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_metrics_bind)(metrics, address);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "bind to Unix socket");
+		cte->expect_op_int(cte, -1, "==", cw_metrics_get_port(metrics), "port of Unix socket");
+		cw_metrics_start(metrics);
+
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+		snprintf(addr.sun_path, sizeof (addr.sun_path), "%s", path);
+		char response[64 * 1024];
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		connect(fd, (struct sockaddr *) &addr, sizeof (addr));
+		test_key_metrics_request(fd, "GET / HTTP/1.0\r\n\r\n", response, sizeof (response));
+		cte->expect_valid_pointer(cte, strstr(response, "label=\"metrics_key\"} 2\n"), "metrics over Unix socket");
+
+		cw_metrics_delete(&metrics);
+		cte->expect_op_int(cte, -1, "==", access(path, F_OK), "Unix socket is removed by delete");
+	}
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+
+typedef struct {
+	char text[64];
+	int n_errors;
+} test_key_keylog_output_t;
+
+
+
+
+static void test_key_keylog_callback(void * callback_arg, __attribute__((unused)) int64_t timestamp, char character, bool is_error)
+{
+	test_key_keylog_output_t * output = (test_key_keylog_output_t *) callback_arg;
+	const size_t len = strlen(output->text);
+	if (len < sizeof (output->text) - 1) {
+		output->text[len] = character;
+	}
+	output->n_errors += is_error ? 1 : 0;
+}
+
+
+
+
+/**
+   Record @p text keyed on straight key at 20 WPM, starting at @p
+   start [ns]. A closing and opening of dot paddle is recorded in
+   first inter-mark-space (to be skipped by replay).
+
+   @return count of recorded changes
+*/
+static int test_key_keylog_record_text(cw_keylog_t * keylog, const char * text, int64_t start, int64_t * end)
+{
+	const int64_t dot = 60 * 1000 * 1000; /* [ns] */
+	int64_t t = start;
+	int n = 0;
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			t += 4 * dot;
+			continue;
+		}
+		for (const char * mark = cw_character_to_representation_internal(*c); *mark; mark++) {
+			cw_keylog_record(keylog, CW_KEYLOG_SOURCE_STRAIGHT_KEY, CW_KEY_VALUE_CLOSED, t);
+			t += (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * dot;
+			cw_keylog_record(keylog, CW_KEYLOG_SOURCE_STRAIGHT_KEY, CW_KEY_VALUE_OPEN, t);
+			n += 2;
+			if (2 == n) {
+				cw_keylog_record(keylog, CW_KEYLOG_SOURCE_DOT_PADDLE, CW_KEY_VALUE_CLOSED, t + dot / 4);
+				cw_keylog_record(keylog, CW_KEYLOG_SOURCE_DOT_PADDLE, CW_KEY_VALUE_OPEN, t + dot / 2);
+				n += 2;
+			}
+			t += dot;
+		}
+		t += 2 * dot;
+	}
+	*end = t;
+	return n;
+}
+
+
+
+
+/**
+   Test recording of keying log (by client code, and by key and
+   generator attached to the log), reading of the log, and its replay
+   into receiver.
+*/
+int test_key_keylog(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	char path[] = "/tmp/libcw_keylog_XXXXXX";
+	int fd = mkstemp(path);
+	cte->assert2(cte, -1 != fd, "failed to create temporary file");
+	close(fd);
+
+
+	/* Recording and reading. */
+	{
+		cw_keylog_t * keylog = LIBCW_TEST_FUT(cw_keylog_new_writer)(path);
+		cte->assert2(cte, NULL != keylog, "failed to create keying log");
+
+		const int64_t start = (int64_t) 1000 * 1000 * 1000 * 1000;
+		int64_t end = 0;
+		const int n_changes = test_key_keylog_record_text(keylog, "PARIS CQ", start, &end);
+		/* Timestamp that is not a multiple of resolution of the log. */
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_keylog_record)(keylog, CW_KEYLOG_SOURCE_GENERATOR, CW_KEY_VALUE_CLOSED, end - 1500);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "record change of generator");
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_keylog_record)(keylog, CW_KEYLOG_SOURCE_GENERATOR, (cw_key_value_t) 5, end);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "record invalid value");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for invalid value");
+		cw_keylog_delete(&keylog);
+		cte->expect_null_pointer(cte, keylog, "deleted keying log");
+
+		FILE * file = fopen(path, "rb");
+		fseek(file, 0, SEEK_END);
+		const long file_size = ftell(file);
+		fclose(file);
+		/* At 20 WPM dots take three bytes, dashes take four
+		   bytes. First change has large difference from zero. */
+		cte->expect_op_int(cte, (int) (CW_KEYLOG_HEADER_SIZE + 4 * (n_changes + 1) + 8), ">=", (int) file_size, "size of keying log (%d changes)", n_changes + 1);
+
+		keylog = LIBCW_TEST_FUT(cw_keylog_new_reader)(path);
+		cte->assert2(cte, NULL != keylog, "failed to open keying log");
+		cw_keylog_event_t event;
+		int n_read = 0;
+		int n_paddle = 0;
+		bool order_ok = true;
+		int64_t prev = 0;
+		while (CW_SUCCESS == LIBCW_TEST_FUT(cw_keylog_read)(keylog, &event)) {
+			if (0 == n_read) {
+				cte->expect_op_int(cte, true, "==", start == event.timestamp, "timestamp of first change");
+				cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", event.value, "value of first change");
+			}
+			if (CW_KEYLOG_SOURCE_STRAIGHT_KEY == event.source && event.timestamp < prev) {
+				order_ok = false;
+			}
+			if (CW_KEYLOG_SOURCE_DOT_PADDLE == event.source) {
+				n_paddle++;
+			}
+			if (CW_KEYLOG_SOURCE_GENERATOR == event.source) {
+				cte->expect_op_int(cte, true, "==", end - 2000 == event.timestamp, "timestamp of change of generator (resolution of 1 us)");
+			}
+			prev = event.timestamp;
+			n_read++;
+		}
+		cte->expect_op_int(cte, ENODATA, "==", errno, "errno at end of keying log");
+		cte->expect_op_int(cte, n_changes + 1, "==", n_read, "count of read changes");
+		cte->expect_op_int(cte, 2, "==", n_paddle, "count of changes of paddle");
+		cte->expect_op_int(cte, true, "==", order_ok, "order of changes of straight key");
+		cw_keylog_delete(&keylog);
+	}
+
+
+	/* Replay as fast as possible. A long log is replayed in chunks. */
+	{
+		cw_keylog_t * keylog = cw_keylog_new_writer(path);
+		cte->assert2(cte, NULL != keylog, "failed to create keying log");
+		int64_t t = (int64_t) 1000 * 1000 * 1000 * 1000;
+		char expected[64] = { 0 };
+		for (int i = 0; i < 6; i++) {
+			test_key_keylog_record_text(keylog, "PARIS ", t, &t);
+			strcat(expected, "PARIS ");
+		}
+		cw_keylog_delete(&keylog);
+
+		keylog = cw_keylog_new_reader(path);
+		cw_rec_t * rec = cw_rec_new();
+		cw_rec_disable_adaptive_mode(rec);
+		cw_rec_set_speed(rec, 20);
+
+		errno = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_keylog_replay)(keylog, rec, CW_KEYLOG_SOURCE_DOT_PADDLE, false, test_key_keylog_callback, NULL);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "replay of paddle");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for replay of paddle");
+
+		test_key_keylog_output_t output = { { 0 }, 0 };
+		struct timeval begin;
+		cw_clock_get_timeval_internal(&begin);
+		cwret = LIBCW_TEST_FUT(cw_keylog_replay)(keylog, rec, CW_KEYLOG_SOURCE_STRAIGHT_KEY, false, test_key_keylog_callback, &output);
+		struct timeval finish;
+		cw_clock_get_timeval_internal(&finish);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "fast replay");
+		cte->expect_op_int(cte, 0, "==", strcmp(expected, output.text), "fast replay: text '%s'", output.text);
+		cte->expect_op_int(cte, 0, "==", output.n_errors, "fast replay: errors");
+		cte->expect_op_int(cte, 1000000, ">", cw_timestamp_compare_internal(&begin, &finish), "fast replay is faster than real time");
+
+		cw_rec_delete(&rec);
+		cw_keylog_delete(&keylog);
+	}
+
+
+	/* Replay in real time. */
+	{
+		cw_keylog_t * keylog = cw_keylog_new_writer(path);
+		cte->assert2(cte, NULL != keylog, "failed to create keying log");
+		int64_t end = 0;
+		const int64_t start = 5000;
+		test_key_keylog_record_text(keylog, "TE", start, &end);
+		cw_keylog_delete(&keylog);
+
+		keylog = cw_keylog_new_reader(path);
+		cw_rec_t * rec = cw_rec_new();
+		cw_rec_disable_adaptive_mode(rec);
+		cw_rec_set_speed(rec, 20);
+
+		test_key_keylog_output_t output = { { 0 }, 0 };
+		struct timeval begin;
+		cw_clock_get_timeval_internal(&begin);
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_keylog_replay)(keylog, rec, CW_KEYLOG_SOURCE_STRAIGHT_KEY, true, test_key_keylog_callback, &output);
+		struct timeval finish;
+		cw_clock_get_timeval_internal(&finish);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "real time replay");
+		cte->expect_op_int(cte, 0, "==", strcmp("TE ", output.text), "real time replay: text '%s'", output.text);
+		/* Last change (end of last mark) is 3 dots before end of
+		   recording. */
+		const int duration = (int) ((end - start) / 1000) - 3 * 60000;
+		cte->expect_op_int(cte, duration, "<=", cw_timestamp_compare_internal(&begin, &finish), "real time replay takes time of recording");
+
+		cw_rec_delete(&rec);
+		cw_keylog_delete(&keylog);
+	}
+
+
+	/* Changes of key and of generator attached to keying log. */
+	{
+		cw_key_t * key = NULL;
+		cw_gen_t * gen = NULL;
+		if (0 != key_setup(cte, &key, &gen)) {
+			unlink(path);
+			return -1;
+		}
+		cw_keylog_t * keylog = cw_keylog_new_writer(path);
+		cte->assert2(cte, NULL != keylog, "failed to create keying log");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_keylog_attach_key)(keylog, key), "attach key");
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_keylog_attach_generator)(keylog, gen), "attach generator");
+
+		cw_key_sk_set_value(key, CW_KEY_VALUE_CLOSED);
+		usleep(50000);
+		cw_key_sk_set_value(key, CW_KEY_VALUE_OPEN);
+		usleep(100000);
+		cw_key_ik_notify_dot_paddle_event(key, CW_KEY_VALUE_CLOSED);
+		cw_key_ik_notify_dot_paddle_event(key, CW_KEY_VALUE_CLOSED); /* Repeated value. */
+		cw_key_ik_notify_dot_paddle_event(key, CW_KEY_VALUE_OPEN);
+		cw_key_ik_wait_for_keyer(key);
+
+		/* Generator is deleted before keying log. */
+		key_destroy(&key, &gen);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_keylog_flush)(keylog), "flush");
+		cw_keylog_delete(&keylog);
+
+		keylog = cw_keylog_new_reader(path);
+		int counts[4] = { 0 };
+		cw_keylog_event_t event;
+		while (CW_SUCCESS == cw_keylog_read(keylog, &event)) {
+			counts[event.source]++;
+		}
+		cte->expect_op_int(cte, 2, "==", counts[CW_KEYLOG_SOURCE_STRAIGHT_KEY], "recorded changes of straight key");
+		cte->expect_op_int(cte, 2, "==", counts[CW_KEYLOG_SOURCE_DOT_PADDLE], "recorded changes of dot paddle");
+		cte->expect_op_int(cte, 0, "==", counts[CW_KEYLOG_SOURCE_DASH_PADDLE], "recorded changes of dash paddle");
+		cte->expect_op_int(cte, 4, "<=", counts[CW_KEYLOG_SOURCE_GENERATOR], "recorded changes of generator");
+		cw_keylog_delete(&keylog);
+	}
+
+
+	/* Invalid and damaged logs. */
+	{
+		FILE * file = fopen(path, "wb");
+		fputs("not a keying log", file);
+		fclose(file);
+		errno = 0;
+		cw_keylog_t * keylog = LIBCW_TEST_FUT(cw_keylog_new_reader)(path);
+		cte->expect_null_pointer(cte, keylog, "file that is not a keying log");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno for file that is not a keying log");
+
+		file = fopen(path, "wb");
+		const uint8_t truncated[] = { 'C', 'W', 'K', 'L', 1, 0, 0, 0, 0x81, 0x82 };
+		fwrite(truncated, 1, sizeof (truncated), file);
+		fclose(file);
+		keylog = cw_keylog_new_reader(path);
+		cte->assert2(cte, NULL != keylog, "failed to open keying log");
+		cw_keylog_event_t event;
+		errno = 0;
+		const cw_ret_t cwret = cw_keylog_read(keylog, &event);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "read from truncated log");
+		cte->expect_op_int(cte, EILSEQ, "==", errno, "errno for truncated log");
+		cw_keylog_delete(&keylog);
+	}
+
+	unlink(path);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Callback of asynchronous wait in test_key_wait_async(). */
+static void key_wait_async_callback(void * arg)
+{
+	__atomic_add_fetch((int *) arg, 1, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+   @brief Test asynchronous wait for iambic keyer
+*/
+int test_key_wait_async(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return -1;
+	}
+
+	int counter = 0;
+	int fd = -1;
+
+	/* Idle keyer completes the wait at once. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_key_ik_wait_for_keyer_async)(key, key_wait_async_callback, &counter, NULL), "waiting for idle keyer");
+	cte->expect_op_int(cte, 1, "==", counter, "callback for idle keyer");
+
+	/* Wait would never complete while a paddle is closed. */
+	cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_OPEN);
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_key_ik_wait_for_keyer_async)(key, key_wait_async_callback, &counter, NULL), "waiting with closed paddle");
+	cte->expect_op_int(cte, EDEADLK, "==", errno, "errno for closed paddle");
+
+	/* Wait completes at the end of keyer's cycle. */
+	cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+	counter = 0;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_key_ik_wait_for_keyer_async)(key, key_wait_async_callback, &counter, &fd), "waiting for busy keyer");
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	cte->expect_op_int(cte, 1, "==", poll(&pfd, 1, 5000), "descriptor for end of keyer's cycle");
+	for (int i = 0; i < 500 && 0 == __atomic_load_n(&counter, __ATOMIC_SEQ_CST); i++) {
+		usleep(10000);
+	}
+	cte->expect_op_int(cte, 1, "==", counter, "callback for end of keyer's cycle");
+	cte->expect_op_int(cte, false, "==", cw_key_ik_is_busy_internal(key), "keyer is idle");
+	close(fd);
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
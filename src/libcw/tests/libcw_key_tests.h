@@ -16,6 +16,12 @@
 
 int test_keyer(cw_test_executor_t * cte);
 int test_straight_key(cw_test_executor_t * cte);
+int test_keyer_timer(cw_test_executor_t * cte);
+int test_key_input(cw_test_executor_t * cte);
+int test_key_netkey(cw_test_executor_t * cte);
+int test_key_metrics(cw_test_executor_t * cte);
+int test_key_keylog(cw_test_executor_t * cte);
+int test_key_wait_async(cw_test_executor_t * cte);
 
 
 
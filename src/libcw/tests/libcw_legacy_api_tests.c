@@ -50,6 +50,7 @@
 #include "libcw_tq.h"
 #include "libcw_utils.h"
 #include "libcw_gen.h"
+#include "libcw_signal.h"
 #include "libcw_legacy_api_tests.h"
 #include "libcw_key_tests.h"
 
@@ -130,9 +131,9 @@ int legacy_api_standalone_test_setup(cw_test_executor_t * cte, bool start_gen)
 */
 int legacy_api_standalone_test_teardown(__attribute__((unused)) cw_test_executor_t * cte)
 {
-	sleep(1);
+	cw_usleep_internal(CW_USECS_PER_SEC);
 	cw_generator_stop();
-	sleep(1);
+	cw_usleep_internal(CW_USECS_PER_SEC);
 	cw_generator_delete();
 
 	return 0;
@@ -323,6 +324,86 @@ int legacy_api_test_parameter_ranges(cw_test_executor_t * cte)
 
 
 
+/**
+   Test that contexts of legacy API are independent from each other and
+   from default context.
+*/
+int legacy_api_test_contexts(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+	legacy_api_standalone_test_setup(cte, false);
+
+	cte->expect_op_int(cte, true, "==", cw_context_get_default() == cw_context_get_default(), "default context is always the same");
+
+	cw_context_t * contexts[2] = { NULL, NULL };
+	for (int i = 0; i < 2; i++) {
+		contexts[i] = LIBCW_TEST_FUT(cw_context_new)();
+		cte->assert2(cte, NULL != contexts[i], "cw_context_new() #%d", i);
+		cte->expect_op_int(cte, true, "==", contexts[i] != cw_context_get_default(), "new context #%d is not default context", i);
+
+		/* Null sound system is enough to test independence of
+		   contexts, and it can be opened many times. */
+		const int cwret = LIBCW_TEST_FUT(cw_context_generator_new)(contexts[i], CW_AUDIO_NULL, NULL);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "cw_context_generator_new() #%d", i);
+	}
+
+
+	/* Send speed set in one context doesn't leak to other contexts. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_context_set_send_speed(contexts[0], 12), "set send speed in context #0");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_context_set_send_speed(contexts[1], 40), "set send speed in context #1");
+	cte->expect_op_int(cte, 12, "==", LIBCW_TEST_FUT(cw_context_get_send_speed)(contexts[0]), "send speed in context #0");
+	cte->expect_op_int(cte, 40, "==", LIBCW_TEST_FUT(cw_context_get_send_speed)(contexts[1]), "send speed in context #1");
+	cte->expect_op_int(cte, 30, "==", cw_get_send_speed(), "send speed in default context");
+
+	/* Same for receiver. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_context_set_receive_speed(contexts[0], 20), "set receive speed in context #0");
+	cw_context_enable_adaptive_receive(contexts[1]);
+	cte->expect_op_int(cte, 20, "==", LIBCW_TEST_FUT(cw_context_get_receive_speed)(contexts[0]), "receive speed in context #0");
+	cte->expect_op_int(cte, 30, "==", cw_get_receive_speed(), "receive speed in default context");
+	cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_context_get_adaptive_receive_state)(contexts[1]), "adaptive receive in context #1");
+	cte->expect_op_int(cte, false, "==", cw_context_get_adaptive_receive_state(contexts[0]), "adaptive receive in context #0");
+	cte->expect_op_int(cte, false, "==", cw_get_adaptive_receive_state(), "adaptive receive in default context");
+
+	/* And for key. */
+	cw_context_enable_iambic_curtis_mode_b(contexts[0]);
+	cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_context_get_iambic_curtis_mode_b_state)(contexts[0]), "Curtis mode B in context #0");
+	cte->expect_op_int(cte, false, "==", cw_context_get_iambic_curtis_mode_b_state(contexts[1]), "Curtis mode B in context #1");
+	cte->expect_op_int(cte, false, "==", cw_get_iambic_curtis_mode_b_state(), "Curtis mode B in default context");
+	cw_context_disable_iambic_curtis_mode_b(contexts[0]);
+
+	/* Tones enqueued in one context go only to tone queue of
+	   that context. Generators are not started, so the tones stay
+	   in the queue. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_context_send_character)(contexts[0], 'E'), "send character in context #0");
+	cte->expect_op_int(cte, 0, "<", cw_context_get_tone_queue_length(contexts[0]), "tone queue length in context #0");
+	cte->expect_op_int(cte, 0, "==", cw_context_get_tone_queue_length(contexts[1]), "tone queue length in context #1");
+	cte->expect_op_int(cte, 0, "==", cw_get_tone_queue_length(), "tone queue length in default context");
+
+	/* Legacy functions and their context variants operating on
+	   default context are equivalent. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_context_set_send_speed(cw_context_get_default(), 25), "set send speed in default context");
+	cte->expect_op_int(cte, 25, "==", cw_get_send_speed(), "send speed in default context, read with legacy function");
+
+
+	for (int i = 0; i < 2; i++) {
+		LIBCW_TEST_FUT(cw_context_delete)(&contexts[i]);
+		cte->expect_null_pointer(cte, contexts[i], "cw_context_delete() #%d", i);
+	}
+
+	/* Default context can't be deleted. */
+	cw_context_t * default_context = cw_context_get_default();
+	cw_context_delete(&default_context);
+	cte->expect_op_int(cte, 25, "==", cw_get_send_speed(), "default context after attempt to delete it");
+
+	legacy_api_standalone_test_teardown(cte);
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
 /**
    Fill a queue and then wait for each tone separately - repeat until
    all tones are dequeued.
@@ -332,6 +413,15 @@ int legacy_api_test_parameter_ranges(cw_test_executor_t * cte)
 int legacy_api_test_cw_wait_for_tone(cw_test_executor_t * cte)
 {
 	cte->print_test_header(cte, __func__);
+
+	/* Length of queue is checked between ends of tones. On virtual
+	   clock the time may move to end of next tone before this
+	   thread gets to check the length, so this test must run in
+	   real time. */
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_disable_internal();
+	}
+
 	legacy_api_standalone_test_setup(cte, false);
 
 	int cwret;
@@ -428,6 +518,11 @@ int legacy_api_test_cw_wait_for_tone(cw_test_executor_t * cte)
 	}
 
 	legacy_api_standalone_test_teardown(cte);
+
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_enable_internal();
+	}
+
 	cte->print_test_footer(cte, __func__);
 
 	return 0;
@@ -626,7 +721,7 @@ int legacy_api_test_empty_tone_queue(cw_test_executor_t * cte)
 	/* Test. */
 	{
 		const int capacity = LIBCW_TEST_FUT(cw_get_tone_queue_capacity)();
-		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_MAX, "==", capacity, "cw_get_tone_queue_capacity()");
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", capacity, "cw_get_tone_queue_capacity()");
 
 		const int len_empty = LIBCW_TEST_FUT(cw_get_tone_queue_length)();
 		cte->expect_op_int(cte, 0, "==", len_empty, "cw_get_tone_queue_length() when tq is empty");
@@ -682,11 +777,11 @@ int legacy_api_test_full_tone_queue(cw_test_executor_t * cte)
 	*/
 	{
 		const int capacity = LIBCW_TEST_FUT(cw_get_tone_queue_capacity)();
-		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_MAX, "==", capacity, "cw_get_tone_queue_capacity()");
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", capacity, "cw_get_tone_queue_capacity()");
 
 		const int len_full = LIBCW_TEST_FUT(cw_get_tone_queue_length)();
 		cte->log_info(cte, "*** you may now see \"EE: can't enqueue tone, tq is full\" message ***\n");
-		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_MAX, "==", len_full, "cw_get_tone_queue_length() when tq is full");
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", len_full, "cw_get_tone_queue_length() when tq is full");
 	}
 
 	/*
@@ -717,7 +812,7 @@ int legacy_api_test_full_tone_queue(cw_test_executor_t * cte)
 		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "cw_wait_for_tone_queue() after flushing");
 
 		const int capacity = LIBCW_TEST_FUT(cw_get_tone_queue_capacity)();
-		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_MAX, "==", capacity, "cw_get_tone_queue_capacity() after flushing");
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", capacity, "cw_get_tone_queue_capacity() after flushing");
 
 		/* Test that the tq is really empty after
 		   cw_wait_for_tone_queue() has returned. */
@@ -762,7 +857,7 @@ int legacy_api_test_tone_queue_callback(cw_test_executor_t * cte)
 
 		int cwret = LIBCW_TEST_FUT(cw_register_tone_queue_low_callback)(test_helper_tq_callback, (void *) &data, level);
 		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "cw_register_tone_queue_low_callback(): threshold = %d:", level);
-		sleep(1);
+		cw_usleep_internal(CW_USECS_PER_SEC);
 
 
 		/* Add a lot of tones to tone queue. "a lot" means three times more than a value of trigger level. */
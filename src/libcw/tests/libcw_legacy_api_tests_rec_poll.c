@@ -25,6 +25,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h> /* FreeBSD 12.1 */
@@ -49,6 +50,7 @@
 
 #include "libcw_gen.h"
 #include "libcw_key.h"
+#include "libcw_signal.h"
 #include "libcw_tq.h"
 #include "libcw_utils.h"
 
@@ -110,6 +112,10 @@ static int easy_rec_test_on_space_c_r(cw_easy_receiver_t * easy_rec, cw_rec_data
 */
 void receiver_poll_receiver(cw_easy_receiver_t * easy_rec)
 {
+	/* Key events are queued by generator's thread, pass them to
+	   receiver in this thread. */
+	cw_easy_receiver_process_events(easy_rec);
+
 	if (easy_rec->libcw_receive_errno != 0) {
 		receiver_poll_report_error(easy_rec);
 	}
@@ -499,6 +505,90 @@ cwt_retv legacy_api_test_rec_poll(cw_test_executor_t * cte)
 
 
 
+/**
+   Test ring of key events of easy receiver: events pushed by keying
+   event handler reach libcw's receiver only when easy receiver is
+   polled, overflow of the ring is reported, clearing easy receiver
+   discards queued events, and events timestamped in future wait in
+   the ring.
+*/
+cwt_retv legacy_api_test_rec_poll_events(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_easy_receiver_t * easy_rec = cw_easy_receiver_new();
+	cte->assert2(cte, NULL != easy_rec, "failed to create easy receiver");
+
+	cw_clear_receive_buffer();
+	cw_disable_adaptive_receive();
+	cw_set_receive_speed(20); /* Dot: 60 ms. */
+
+	/* Key 'A' well in the past, so that the character is complete
+	   when it's polled "now". */
+	struct timeval base;
+	gettimeofday(&base, NULL);
+	base.tv_sec -= 2;
+	const struct { int key_state; int offset_ms; } keying[] = {
+		{ 1,   0 }, { 0,  60 },  /* Dot. */
+		{ 1, 120 }, { 0, 300 },  /* Dash. */
+	};
+	for (size_t i = 0; i < sizeof (keying) / sizeof (keying[0]); i++) {
+		easy_rec->main_timer = base;
+		easy_rec->main_timer.tv_usec += keying[i].offset_ms * 1000;
+		if (easy_rec->main_timer.tv_usec >= 1000000) {
+			easy_rec->main_timer.tv_sec++;
+			easy_rec->main_timer.tv_usec -= 1000000;
+		}
+		LIBCW_TEST_FUT(cw_easy_receiver_handle_libcw_keying_event)(easy_rec, keying[i].key_state);
+	}
+	cte->expect_op_int(cte, 0, "==", (int) cw_get_receive_buffer_length(), "events are queued, not passed to receiver");
+
+	cw_rec_data_t erd = { 0 };
+	const bool received = LIBCW_TEST_FUT(cw_easy_receiver_poll_character)(easy_rec, &erd);
+	cte->expect_op_int(cte, true, "==", received, "poll character");
+	cte->expect_op_int(cte, 'A', "==", erd.character, "polled character");
+	cw_easy_receiver_clear(easy_rec);
+
+
+	/* Overflow of the ring. */
+	for (int i = 0; i < CW_EASY_RECEIVER_EVENTS_CAPACITY + 10; i++) {
+		gettimeofday(&easy_rec->main_timer, NULL);
+		cw_easy_receiver_handle_libcw_keying_event(easy_rec, (i + 1) % 2);
+	}
+	LIBCW_TEST_FUT(cw_easy_receiver_process_events)(easy_rec);
+	cte->expect_op_int(cte, ENOSPC, "==", cw_easy_receiver_get_libcw_errno(easy_rec), "overflow of ring is reported");
+	cte->expect_op_int(cte, easy_rec->events_head, "==", easy_rec->events_tail, "ring is empty after processing");
+	cw_easy_receiver_clear(easy_rec);
+
+
+	/* Clearing easy receiver discards queued events. */
+	gettimeofday(&easy_rec->main_timer, NULL);
+	cw_easy_receiver_handle_libcw_keying_event(easy_rec, 1);
+	LIBCW_TEST_FUT(cw_easy_receiver_clear)(easy_rec);
+	cte->expect_op_int(cte, easy_rec->events_head, "==", easy_rec->events_tail, "ring is empty after clearing");
+	cte->expect_op_int(cte, 0, "==", cw_easy_receiver_get_libcw_errno(easy_rec), "no error after clearing");
+
+
+	/* Event that will happen in future is left in the ring. */
+	struct timespec monotonic;
+	clock_gettime(CLOCK_MONOTONIC, &monotonic);
+	const int64_t future = ((int64_t) monotonic.tv_sec + 10) * 1000000000 + monotonic.tv_nsec;
+	LIBCW_TEST_FUT(cw_easy_receiver_handle_libcw_timed_keying_event)(easy_rec, 1, future);
+	cw_easy_receiver_process_events(easy_rec);
+	cte->expect_op_int(cte, easy_rec->events_head, "!=", easy_rec->events_tail, "future event is not processed");
+	cw_easy_receiver_clear(easy_rec);
+
+	cw_easy_receiver_delete(&easy_rec);
+	cw_clear_receive_buffer();
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
 static cwt_retv legacy_api_test_rec_poll_inner(cw_test_executor_t * cte, bool get_representation)
 {
 	cte->print_test_header(cte, __func__);
@@ -509,6 +599,12 @@ static cwt_retv legacy_api_test_rec_poll_inner(cw_test_executor_t * cte, bool ge
 		cte->log_info(cte, "Test mode: poll character, verify by polling representation\n");
 	}
 
+	/* Easy receiver and the tester measure time with
+	   gettimeofday(), so this test must run in real time. */
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_disable_internal();
+	}
+
 	if (CW_SUCCESS != cw_generator_new(cte->current_gen_conf.sound_system, cte->current_gen_conf.sound_device)) {
 		fprintf(stderr, "failed to create generator\n");
 		return cwt_retv_err;
@@ -590,6 +686,10 @@ static cwt_retv legacy_api_test_rec_poll_inner(cw_test_executor_t * cte, bool ge
 	cw_generator_stop();
 	cw_generator_delete();
 
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_enable_internal();
+	}
+
 
 	cte->print_test_footer(cte, __func__);
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file libcw_rec_corpus.c
+
+   Accuracy and speed of receiver on a corpus of reference recordings
+   (keying logs or sound, each with expected text, see
+   cw_rec_tester_corpus()). For every recording the program reports
+   character and word error rates, latency of reception and count of
+   decoded events per second, and compares them with a baseline: an
+   output of earlier run of the program.
+
+   Exit status is non-zero if any of recordings has failed.
+
+   The program is not a part of "make check". Run it with "make
+   corpus", e.g.:
+   make corpus CORPUS_DIR=recordings CORPUS_FLAGS="-b baseline.txt"
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+
+
+#include "libcw2.h"
+#include "cw_rec_tester.h"
+
+
+
+
+static void corpus_print_usage(const char * program_name);
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	cw_rec_tester_corpus_config_t config = {
+		.directory = NULL,
+		.speed = CW_SPEED_INITIAL,
+		.tolerance = CW_TOLERANCE_INITIAL,
+		.adaptive = true,
+		.frequency = CW_FREQUENCY_INITIAL,
+		.afc_range = 0,
+		.poll_interval = 5000,
+		.max_error_rate_percent = 5.0F,
+		.baseline = NULL,
+		.max_regression_percent = 0.5F,
+		.n_threads = 0,
+		.beam_width = 0
+	};
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:t:a:f:F:p:e:b:r:j:v:h"))) {
+		switch (opt) {
+		case 's':
+			config.speed = atoi(optarg);
+			break;
+		case 't':
+			config.tolerance = atoi(optarg);
+			break;
+		case 'a':
+			config.adaptive = 0 != atoi(optarg);
+			break;
+		case 'f':
+			config.frequency = atoi(optarg);
+			break;
+		case 'F':
+			config.afc_range = atoi(optarg);
+			break;
+		case 'p':
+			config.poll_interval = atoi(optarg);
+			break;
+		case 'e':
+			config.max_error_rate_percent = strtof(optarg, NULL);
+			break;
+		case 'b':
+			config.baseline = optarg;
+			break;
+		case 'r':
+			config.max_regression_percent = strtof(optarg, NULL);
+			break;
+		case 'j':
+			config.n_threads = atoi(optarg);
+			break;
+		case 'v':
+			config.beam_width = atoi(optarg);
+			break;
+		case 'h':
+			corpus_print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			corpus_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		corpus_print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	config.directory = argv[optind];
+
+	if (config.speed < CW_SPEED_MIN || config.speed > CW_SPEED_MAX) {
+		fprintf(stderr, "%s: speed %d out of range\n", argv[0], config.speed);
+		return EXIT_FAILURE;
+	}
+	if (config.tolerance < CW_TOLERANCE_MIN || config.tolerance > CW_TOLERANCE_MAX) {
+		fprintf(stderr, "%s: tolerance %d out of range\n", argv[0], config.tolerance);
+		return EXIT_FAILURE;
+	}
+	if (0 != config.beam_width
+	    && (config.beam_width < CW_VITERBI_BEAM_WIDTH_MIN || config.beam_width > CW_VITERBI_BEAM_WIDTH_MAX)) {
+		fprintf(stderr, "%s: beam width %d out of range\n", argv[0], config.beam_width);
+		return EXIT_FAILURE;
+	}
+
+	cw_rec_tester_corpus_file_t * files = NULL;
+	size_t n_files = 0;
+	struct timespec begin;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	const int result = cw_rec_tester_corpus(&config, &files, &n_files);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (0 != result) {
+		return EXIT_FAILURE;
+	}
+
+	const size_t n_failed = cw_rec_tester_corpus_print(stdout, files, n_files);
+
+	double recorded = 0.0;
+	for (size_t i = 0; i < n_files; i++) {
+		recorded += files[i].recording_duration;
+	}
+	const double elapsed = (double) (end.tv_sec - begin.tv_sec) + (double) (end.tv_nsec - begin.tv_nsec) / 1e9;
+	fprintf(stderr, "[II] %zd recordings, %.0f s of recordings received in %.2f s\n", n_files, recorded, elapsed);
+
+	free(files);
+
+	return 0 == n_failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Print usage of the program
+
+   @param[in] program_name name of the program
+*/
+static void corpus_print_usage(const char * program_name)
+{
+	fprintf(stderr, "Usage: %s [-s SPEED] [-t TOLERANCE] [-a MODE] [-f FREQUENCY] [-F RANGE] [-p INTERVAL] [-e CER] [-b BASELINE] [-r CER] [-j THREADS] [-v WIDTH] DIRECTORY\n", program_name);
+	fprintf(stderr, "  DIRECTORY has recordings NAME.cwkl (keying log) or NAME.wav (mono 16-bit PCM), with expected text in NAME.txt\n");
+	fprintf(stderr, "  -s  initial receive speed [wpm] (default: %d)\n", CW_SPEED_INITIAL);
+	fprintf(stderr, "  -t  receive tolerance [%%] (default: %d)\n", CW_TOLERANCE_INITIAL);
+	fprintf(stderr, "  -a  0: fixed speed, 1: adaptive (default: 1)\n");
+	fprintf(stderr, "  -f  frequency of tone in sound recordings [Hz] (default: %d)\n", CW_FREQUENCY_INITIAL);
+	fprintf(stderr, "  -F  range of automatic frequency control [Hz] (default: 0, disabled)\n");
+	fprintf(stderr, "  -p  interval of polling of receiver [us] (default: 5000)\n");
+	fprintf(stderr, "  -e  highest acceptable character error rate of a recording [%%] (default: 5)\n");
+	fprintf(stderr, "  -b  output of earlier run to compare with\n");
+	fprintf(stderr, "  -r  highest acceptable increase of character error rate over baseline [percentage points] (default: 0.5)\n");
+	fprintf(stderr, "  -j  count of threads (default: count of online CPUs)\n");
+	fprintf(stderr, "  -v  decode with probabilistic decoder of given beam width (%d-%d) instead of receiver; -t and -a are ignored\n", CW_VITERBI_BEAM_WIDTH_MIN, CW_VITERBI_BEAM_WIDTH_MAX);
+}
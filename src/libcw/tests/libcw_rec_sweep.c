@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file libcw_rec_sweep.c
+
+   Accuracy of receiver over a grid of speed x tolerance x noise x
+   adaptive mode. Keying is synthesized offline (see
+   cw_rec_tester_sweep()), so the whole grid is processed in seconds
+   instead of being played in real time by a generator.
+
+   The program is not a part of "make check". Run it with "make sweep".
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+
+
+#include "libcw2.h"
+#include "cw_rec_tester.h"
+
+
+
+
+#define SWEEP_VALUES_MAX 128
+
+
+
+
+typedef struct {
+	int values[SWEEP_VALUES_MAX];
+	size_t n_values;
+} sweep_list_t;
+
+
+
+
+static bool sweep_parse_list(const char * string, sweep_list_t * list);
+static void sweep_print_usage(const char * program_name);
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	sweep_list_t speeds = { { 0 }, 0 };
+	sweep_list_t tolerances = { { 0 }, 0 };
+	sweep_list_t noises = { { 0 }, 0 };
+	sweep_list_t adaptive = { { 0 }, 0 };
+	sweep_parse_list("6-40:2", &speeds);
+	sweep_parse_list("30-70:10", &tolerances);
+	sweep_parse_list("0-30:5", &noises);
+	sweep_parse_list("0,1", &adaptive);
+
+	cw_rec_tester_sweep_config_t config = {
+		.weighting = CW_WEIGHTING_INITIAL,
+		.gap = CW_GAP_INITIAL,
+		.text = NULL,
+		.seed = 1,
+		.n_threads = 0
+	};
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:t:n:a:w:g:j:r:h"))) {
+		sweep_list_t * list = NULL;
+		switch (opt) {
+		case 's':
+			list = &speeds;
+			break;
+		case 't':
+			list = &tolerances;
+			break;
+		case 'n':
+			list = &noises;
+			break;
+		case 'a':
+			list = &adaptive;
+			break;
+		case 'w':
+			config.weighting = atoi(optarg);
+			break;
+		case 'g':
+			config.gap = atoi(optarg);
+			break;
+		case 'j':
+			config.n_threads = atoi(optarg);
+			break;
+		case 'r':
+			config.seed = (unsigned int) strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			sweep_print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			sweep_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		if (list && !sweep_parse_list(optarg, list)) {
+			fprintf(stderr, "%s: invalid list of values '%s'\n", argv[0], optarg);
+			sweep_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool adaptive_modes[SWEEP_VALUES_MAX];
+	for (size_t i = 0; i < adaptive.n_values; i++) {
+		adaptive_modes[i] = 0 != adaptive.values[i];
+	}
+
+	config.speeds = speeds.values;
+	config.n_speeds = speeds.n_values;
+	config.tolerances = tolerances.values;
+	config.n_tolerances = tolerances.n_values;
+	config.noises = noises.values;
+	config.n_noises = noises.n_values;
+	config.adaptive_modes = adaptive_modes;
+	config.n_adaptive_modes = adaptive.n_values;
+
+	for (size_t i = 0; i < speeds.n_values; i++) {
+		if (speeds.values[i] < CW_SPEED_MIN || speeds.values[i] > CW_SPEED_MAX) {
+			fprintf(stderr, "%s: speed %d out of range\n", argv[0], speeds.values[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	for (size_t i = 0; i < tolerances.n_values; i++) {
+		if (tolerances.values[i] < CW_TOLERANCE_MIN || tolerances.values[i] > CW_TOLERANCE_MAX) {
+			fprintf(stderr, "%s: tolerance %d out of range\n", argv[0], tolerances.values[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	const size_t n_cells = cw_rec_tester_sweep_n_cells(&config);
+	cw_rec_tester_sweep_cell_t * cells = (cw_rec_tester_sweep_cell_t *) calloc(n_cells ? n_cells : 1, sizeof (cw_rec_tester_sweep_cell_t));
+	if (NULL == cells) {
+		fprintf(stderr, "%s: failed to allocate %zd cells\n", argv[0], n_cells);
+		return EXIT_FAILURE;
+	}
+
+	struct timespec begin;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	const int result = cw_rec_tester_sweep(&config, cells, n_cells);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (0 == result) {
+		cw_rec_tester_sweep_print(stdout, cells, n_cells);
+
+		double keyed = 0.0;
+		for (size_t i = 0; i < n_cells; i++) {
+			keyed += cells[i].keying_duration;
+		}
+		const double elapsed = (double) (end.tv_sec - begin.tv_sec) + (double) (end.tv_nsec - begin.tv_nsec) / 1e9;
+		fprintf(stderr, "[II] %zd cells, %.0f s of keying received in %.2f s\n", n_cells, keyed, elapsed);
+	}
+
+	free(cells);
+
+	return 0 == result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Parse list of integer values
+
+   List is a comma-separated sequence of values or of ranges of values
+   in form "FIRST-LAST" or "FIRST-LAST:STEP", e.g. "5,10-20:5".
+
+   @param[in] string string to parse
+   @param[out] list parsed values
+
+   @return true on success
+   @return false if string is invalid or has too many values
+*/
+static bool sweep_parse_list(const char * string, sweep_list_t * list)
+{
+	list->n_values = 0;
+
+	const char * cursor = string;
+	while (*cursor) {
+		char * end = NULL;
+		const long first = strtol(cursor, &end, 10);
+		if (end == cursor) {
+			return false;
+		}
+		long last = first;
+		long step = 1;
+		cursor = end;
+		if ('-' == *cursor) {
+			last = strtol(cursor + 1, &end, 10);
+			if (end == cursor + 1) {
+				return false;
+			}
+			cursor = end;
+			if (':' == *cursor) {
+				step = strtol(cursor + 1, &end, 10);
+				if (end == cursor + 1 || step < 1) {
+					return false;
+				}
+				cursor = end;
+			}
+		}
+		if (last < first) {
+			return false;
+		}
+
+		for (long value = first; value <= last; value += step) {
+			if (list->n_values == SWEEP_VALUES_MAX) {
+				return false;
+			}
+			list->values[list->n_values++] = (int) value;
+		}
+
+		if (',' == *cursor) {
+			cursor++;
+		} else if ('\0' != *cursor) {
+			return false;
+		}
+	}
+
+	return 0 != list->n_values;
+}
+
+
+
+
+/**
+   @brief Print usage of the program
+
+   @param[in] program_name name of the program
+*/
+static void sweep_print_usage(const char * program_name)
+{
+	fprintf(stderr, "Usage: %s [-s SPEEDS] [-t TOLERANCES] [-n NOISES] [-a MODES] [-w WEIGHTING] [-g GAP] [-j THREADS] [-r SEED]\n", program_name);
+	fprintf(stderr, "  lists have form of e.g. \"5,10-20:5\" (values 5, 10, 15, 20)\n");
+	fprintf(stderr, "  -s  receive speeds [wpm] (default: 6-40:2)\n");
+	fprintf(stderr, "  -t  receive tolerances [%%] (default: 30-70:10)\n");
+	fprintf(stderr, "  -n  jitter of durations of marks and spaces [%%] (default: 0-30:5)\n");
+	fprintf(stderr, "  -a  adaptive modes, 0: fixed speed, 1: adaptive (default: 0,1)\n");
+	fprintf(stderr, "  -w  weighting of keying (default: %d)\n", CW_WEIGHTING_INITIAL);
+	fprintf(stderr, "  -g  Farnsworth gap of keying and of receiver [dots] (default: %d)\n", CW_GAP_INITIAL);
+	fprintf(stderr, "  -j  count of threads (default: count of online CPUs)\n");
+	fprintf(stderr, "  -r  seed of jitter (default: 1)\n");
+}
@@ -23,10 +23,16 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 
 
 
@@ -37,14 +43,18 @@
 
 
 
+#include "libcw_capture.h"
 #include "libcw_debug.h"
 #include "libcw_key.h"
 #include "libcw_rec.h"
 #include "libcw_rec_internal.h"
+#include "libcw_data.h"
 #include "libcw_rec_tests.h"
+#include "libcw_skimmer.h"
 #include "libcw_tq.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
+#include "cw_rec_tester.h"
 
 
 
@@ -1564,3 +1574,2795 @@ int test_cw_rec_parameter_getters_setters_2(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+/**
+   @brief Test receiver's functions taking nanosecond timestamps
+
+   Receive a character using timestamps of monotonic clock given in
+   nanoseconds.
+*/
+int test_cw_rec_ns_timestamps(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, 12);
+
+	const int64_t dot = 100 * 1000 * 1000; /* Duration of dot at 12 WPM [ns]. */
+
+	/* Timestamps of monotonic clock don't need to be related to
+	   wall clock, and may have sub-microsecond part. */
+	int64_t t = (int64_t) 1000 * 1000 * 1000 * 1000 + 123;
+
+	/* 'a' = ".-" */
+	cw_ret_t cwret = CW_SUCCESS;
+	bool failure = false;
+	failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_begin_ns)(rec, t);
+	t += dot;
+	failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_end_ns)(rec, t);
+	t += dot;
+	failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_begin_ns)(rec, t);
+	t += 3 * dot;
+	failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_end_ns)(rec, t);
+	cte->expect_op_int(cte, false, "==", failure, "%s: marks of character", __func__);
+
+	/* Inter-mark-space: too early to poll. */
+	char character = 0;
+	bool is_end_of_word = false;
+	bool is_error = false;
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_character_ns)(rec, t + dot / 2, &character, &is_end_of_word, &is_error);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: poll in inter-mark-space (cwret)", __func__);
+	cte->expect_op_int(cte, EAGAIN, "==", errno, "%s: poll in inter-mark-space (errno)", __func__);
+
+	/* Inter-character-space. */
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_character_ns)(rec, t + 3 * dot, &character, &is_end_of_word, &is_error);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: poll character (cwret)", __func__);
+	cte->expect_op_int(cte, 'A', "==", character, "%s: poll character (character)", __func__);
+	cte->expect_op_int(cte, false, "==", is_end_of_word, "%s: poll character (end of word)", __func__);
+	cte->expect_op_int(cte, false, "==", is_error, "%s: poll character (error)", __func__);
+
+	/* Added mark. */
+	cw_rec_reset_state(rec);
+	t += 10 * dot;
+	cwret = LIBCW_TEST_FUT(cw_rec_add_mark_ns)(rec, t, CW_DASH_REPRESENTATION);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: add mark", __func__);
+	char representation[CW_REC_REPRESENTATION_CAPACITY + 1] = { 0 };
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_representation_ns)(rec, t + 10 * dot, representation, &is_end_of_word, &is_error);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: poll representation (cwret)", __func__);
+	cte->expect_op_int(cte, 0, "==", strcmp(representation, "-"), "%s: poll representation (representation)", __func__);
+	cte->expect_op_int(cte, true, "==", is_end_of_word, "%s: poll representation (end of word)", __func__);
+
+	/* Invalid timestamp. */
+	cw_rec_reset_state(rec);
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_rec_mark_begin_ns)(rec, -1);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: negative timestamp (cwret)", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: negative timestamp (errno)", __func__);
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test constant-time duration statistics of receiver
+
+   Statistics calculated from running sums must be the same as
+   statistics calculated by scanning the circular buffer, also after the
+   buffer wraps around, and after reset.
+*/
+int test_cw_rec_duration_stats(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_set_speed(rec, 20);
+
+	const stat_type_t types[] = { CW_REC_STAT_DOT, CW_REC_STAT_DASH, CW_REC_STAT_INTER_MARK_SPACE, CW_REC_STAT_INTER_CHARACTER_SPACE };
+	const int n_types = (int) (sizeof (types) / sizeof (types[0]));
+
+	bool failure = false;
+	for (int round = 0; round < 2; round++) {
+		uint32_t seed = 1234;
+		/* 3 times capacity of buffer: the buffer wraps around. */
+		for (int i = 0; i < 3 * CW_REC_DURATION_STATS_CAPACITY; i++) {
+			seed = seed * 1103515245 + 12345;
+			const stat_type_t type = types[(seed >> 16) % (uint32_t) n_types];
+			const int duration = 40000 + (int) ((seed >> 8) % 200000);
+			LIBCW_TEST_FUT(cw_rec_duration_stats_update_internal)(rec, type, duration);
+
+			for (int t = 0; t < n_types; t++) {
+				double sum_of_squares = 0.0;
+				int count = 0;
+				for (int j = 0; j < CW_REC_DURATION_STATS_CAPACITY; j++) {
+					if (rec->duration_stats[j].type == types[t]) {
+						sum_of_squares += (double) rec->duration_stats[j].duration_delta * rec->duration_stats[j].duration_delta;
+						count++;
+					}
+				}
+				const float expected = 0 == count ? 0.0F : (float) sqrt(sum_of_squares / count);
+
+				float result = -1.0F;
+				LIBCW_TEST_FUT(cw_rec_duration_stats_get_internal)(rec, types[t], &result);
+				if (fabsf(result - expected) > 0.01F * (expected + 1.0F)) {
+					failure = true;
+				}
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "%s: round %d: stats match buffer contents", __func__, round);
+
+		LIBCW_TEST_FUT(cw_rec_reset_statistics)(rec);
+		float dot_sd = -1.0F;
+		float dash_sd = -1.0F;
+		float ims_sd = -1.0F;
+		float ics_sd = -1.0F;
+		LIBCW_TEST_FUT(cw_rec_get_statistics_internal)(rec, &dot_sd, &dash_sd, &ims_sd, &ics_sd);
+		cte->expect_op_int(cte, true, "==", dot_sd + dash_sd + ims_sd + ics_sd < 0.001F,
+				   "%s: round %d: stats after reset", __func__, round);
+	}
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Check closed-form update of parameters of adaptive receiver
+
+   Receiver in adaptive mode updates its speed and derived durations
+   after each Mark without full re-synchronization of parameters. Key
+   Marks with speeds drifting over and beyond the range of allowed
+   speeds, and after each Mark compare receiver's parameters with
+   parameters calculated by full re-synchronization (followed by the
+   two extra re-synchronizations if the speed had to be clamped) of a
+   reference receiver.
+*/
+int test_cw_rec_adaptive_update(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cw_rec_t * ref = cw_rec_new();
+	if (NULL == rec || NULL == ref) {
+		cte->log_error(cte, "%s: failed to create receivers\n", __func__);
+		cw_rec_delete(&rec);
+		cw_rec_delete(&ref);
+		return -1;
+	}
+	cw_rec_set_speed(rec, 20);
+	cw_rec_set_gap(rec, 2);
+	cw_rec_enable_adaptive_mode(rec);
+	cw_rec_set_gap(ref, 2);
+	cw_rec_enable_adaptive_mode(ref);
+
+	/* From 20 WPM up over CW_SPEED_MAX, then down under CW_SPEED_MIN. */
+	const int speeds[] = { 20, 30, 45, 60, 70, 80, 80, 50, 25, 10, 5, 3, 2, 2, 8, 20 };
+	const int n_speeds = (int) (sizeof (speeds) / sizeof (speeds[0]));
+
+	int64_t timestamp = 1000 * (int64_t) CW_NSECS_PER_SEC;
+	int n_marks = 0;
+	int n_clamped = 0;
+	int n_mismatches = 0;
+	for (int s = 0; s < n_speeds; s++) {
+		const int64_t unit = (int64_t) (CW_DOT_CALIBRATION / speeds[s]) * 1000; /* [ns] */
+		for (int c = 0; c < 4; c++) {
+			/* "Q": two Dashes, Dot, Dash. */
+			const char * representation = "--.-";
+			for (size_t m = 0; '\0' != representation[m]; m++) {
+				const float speed_before = rec->speed;
+
+				cw_rec_mark_begin_ns(rec, timestamp);
+				timestamp += CW_DOT_REPRESENTATION == representation[m] ? unit : 3 * unit;
+				cw_rec_mark_end_ns(rec, timestamp);
+				timestamp += unit;
+				n_marks++;
+
+				/* Reference: the averages are already updated in
+				   receiver under test. */
+				const int avg_dot_duration = rec->dot_averaging.average;
+				const int avg_dash_duration = rec->dash_averaging.average;
+				ref->speed = speed_before;
+				ref->adaptive_speed_threshold = (avg_dash_duration - avg_dot_duration) / 2 + avg_dot_duration;
+				ref->parameters_in_sync = false;
+				cw_rec_sync_parameters_internal(ref);
+				if (ref->speed < CW_SPEED_MIN || ref->speed > CW_SPEED_MAX) {
+					n_clamped++;
+					ref->speed = ref->speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
+					ref->is_adaptive_receive_mode = false;
+					ref->parameters_in_sync = false;
+					cw_rec_sync_parameters_internal(ref);
+					ref->is_adaptive_receive_mode = true;
+					ref->parameters_in_sync = false;
+					cw_rec_sync_parameters_internal(ref);
+				}
+
+				if (fabsf(ref->speed - rec->speed) > 0.0F
+				    || ref->adaptive_speed_threshold != rec->adaptive_speed_threshold
+				    || ref->dot_duration_ideal != rec->dot_duration_ideal
+				    || ref->dot_duration_min != rec->dot_duration_min
+				    || ref->dot_duration_max != rec->dot_duration_max
+				    || ref->dash_duration_ideal != rec->dash_duration_ideal
+				    || ref->dash_duration_min != rec->dash_duration_min
+				    || ref->dash_duration_max != rec->dash_duration_max
+				    || ref->ims_duration_ideal != rec->ims_duration_ideal
+				    || ref->ims_duration_min != rec->ims_duration_min
+				    || ref->ims_duration_max != rec->ims_duration_max
+				    || ref->ics_duration_ideal != rec->ics_duration_ideal
+				    || ref->ics_duration_min != rec->ics_duration_min
+				    || ref->ics_duration_max != rec->ics_duration_max
+				    || ref->additional_delay != rec->additional_delay
+				    || ref->adjustment_delay != rec->adjustment_delay
+				    || !rec->parameters_in_sync) {
+
+					cte->log_error(cte, "%s: mismatch after mark %d at %d WPM: speed %f/%f, threshold %d/%d\n",
+						       __func__, n_marks, speeds[s],
+						       (double) rec->speed, (double) ref->speed,
+						       rec->adaptive_speed_threshold, ref->adaptive_speed_threshold);
+					n_mismatches++;
+				}
+			}
+			timestamp += 2 * unit;
+			cw_rec_reset_state(rec);
+		}
+	}
+
+	cte->expect_op_int(cte, 0, "==", n_mismatches, "%s: parameters match full re-synchronization after %d marks", __func__, n_marks);
+	cte->expect_op_int(cte, 0, "<", n_clamped, "%s: speed was clamped (%d times)", __func__, n_clamped);
+	cte->expect_op_int(cte, true, "==", rec->speed >= CW_SPEED_MIN && rec->speed <= CW_SPEED_MAX, "%s: final speed in range: %f", __func__, (double) rec->speed);
+
+	cw_rec_delete(&rec);
+	cw_rec_delete(&ref);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Check that averages of receiver are reset to current durations
+
+   Switching receiver to adaptive mode resets averages of Dots and
+   Dashes to receiver's current durations. Not only the tables and
+   sums of the averages are reset, but also the averaged durations
+   themselves, which are read before next Mark updates them.
+*/
+int test_cw_rec_reset_average(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == rec) {
+		cte->log_error(cte, "%s: failed to create receiver\n", __func__);
+		return -1;
+	}
+
+	/* Second speed checks that averages don't keep durations from
+	   previous switch to adaptive mode. */
+	const int speeds[] = { 20, 40 };
+	for (size_t i = 0; i < sizeof (speeds) / sizeof (speeds[0]); i++) {
+		cw_rec_disable_adaptive_mode(rec);
+		cw_rec_set_speed(rec, speeds[i]);
+		cw_rec_enable_adaptive_mode(rec);
+
+		cte->expect_op_int(cte, rec->dot_duration_ideal, "==", rec->dot_averaging.average, "%s: %d WPM: average of Dots", __func__, speeds[i]);
+		cte->expect_op_int(cte, rec->dash_duration_ideal, "==", rec->dash_averaging.average, "%s: %d WPM: average of Dashes", __func__, speeds[i]);
+		cte->expect_op_int(cte, rec->dot_duration_ideal * CW_REC_AVERAGING_DURATIONS_COUNT, "==", rec->dot_averaging.sum, "%s: %d WPM: sum of Dots", __func__, speeds[i]);
+	}
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	char text[64];
+	int n_errors;
+} test_cw_rec_process_events_output_t;
+
+
+
+
+static void test_cw_rec_process_events_callback(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	(void) timestamp;
+	test_cw_rec_process_events_output_t * output = (test_cw_rec_process_events_output_t *) callback_arg;
+	const size_t len = strlen(output->text);
+	if (len < sizeof (output->text) - 1) {
+		output->text[len] = character;
+	}
+	output->n_errors += is_error ? 1 : 0;
+}
+
+
+
+
+/**
+   @brief Test decoding of a timeline of key events in one pass
+
+   Timeline of "PARIS CQ" at 20 WPM, with a noise spike, is decoded
+   at once, and then in small chunks. Results must be the same.
+*/
+int test_cw_rec_process_events(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int64_t dot = 60 * 1000 * 1000; /* Duration of dot at 20 WPM [ns]. */
+	const char * text = "PARIS CQ";
+	const char * expected = "PARIS CQ ";
+
+	cw_rec_event_t events[128];
+	size_t n_events = 0;
+	int64_t t = (int64_t) 1000 * 1000 * 1000 * 1000;
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			t += 4 * dot;
+			continue;
+		}
+		for (const char * mark = cw_character_to_representation_internal(*c); *mark; mark++) {
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_BEGIN, t };
+			t += (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * dot;
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_END, t };
+			t += dot;
+
+			if (2 == n_events) {
+				/* 1 ms noise spike in first inter-mark-space. */
+				events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_BEGIN, t - dot / 2 };
+				events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_END, t - dot / 2 + 1000 * 1000 };
+			}
+		}
+		t += 2 * dot;
+	}
+	events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_POLL, t + 10 * dot };
+
+	for (size_t chunk = n_events; chunk >= 1; chunk = chunk > 3 ? 3 : chunk - 1) {
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+		cw_rec_disable_adaptive_mode(rec);
+		cw_rec_set_speed(rec, 20);
+
+		test_cw_rec_process_events_output_t output = { { 0 }, 0 };
+		bool failure = false;
+		for (size_t i = 0; i < n_events; i += chunk) {
+			const size_t n = n_events - i < chunk ? n_events - i : chunk;
+			failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_process_events)(rec, events + i, n, test_cw_rec_process_events_callback, &output);
+		}
+		cte->expect_op_int(cte, false, "==", failure, "%s: chunks of %zu events: process", __func__, chunk);
+		cte->expect_op_int(cte, 0, "==", strcmp(output.text, expected), "%s: chunks of %zu events: text '%s'", __func__, chunk, output.text);
+		cte->expect_op_int(cte, 0, "==", output.n_errors, "%s: chunks of %zu events: errors", __func__, chunk);
+
+		cw_rec_delete(&rec);
+	}
+
+	/* Invalid events. */
+	{
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+		test_cw_rec_process_events_output_t output = { { 0 }, 0 };
+		cw_ret_t cwret = CW_SUCCESS;
+
+		const cw_rec_event_t invalid_type[] = { { (cw_rec_event_type_t) 77, 1000 } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_rec_process_events)(rec, invalid_type, 1, test_cw_rec_process_events_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: invalid type (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: invalid type (errno)", __func__);
+
+		const cw_rec_event_t decreasing[] = { { CW_REC_EVENT_MARK_BEGIN, 2 * dot }, { CW_REC_EVENT_MARK_END, dot } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_rec_process_events)(rec, decreasing, 2, test_cw_rec_process_events_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: decreasing timestamps (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: decreasing timestamps (errno)", __func__);
+
+		cw_rec_reset_state(rec);
+		const cw_rec_event_t unexpected[] = { { CW_REC_EVENT_MARK_END, dot } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_rec_process_events)(rec, unexpected, 1, test_cw_rec_process_events_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: end of mark without beginning (cwret)", __func__);
+		cte->expect_op_int(cte, ERANGE, "==", errno, "%s: end of mark without beginning (errno)", __func__);
+
+		cw_rec_delete(&rec);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	char text[256];
+	int n_errors;
+	int64_t now;          /* Timestamp of event being processed [ns]. */
+	int64_t max_latency;  /* [ns] */
+} test_cw_viterbi_output_t;
+
+
+
+
+static void test_cw_viterbi_callback(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	test_cw_viterbi_output_t * output = (test_cw_viterbi_output_t *) callback_arg;
+	const size_t len = strlen(output->text);
+	if (len < sizeof (output->text) - 1) {
+		output->text[len] = character;
+	}
+	output->n_errors += is_error ? 1 : 0;
+	if (output->now - timestamp > output->max_latency) {
+		output->max_latency = output->now - timestamp;
+	}
+}
+
+
+
+
+/* Levenshtein distance of two short strings. */
+static int test_cw_viterbi_edit_distance(const char * a, const char * b)
+{
+	const size_t len_b = strlen(b);
+	int row[256 + 1];
+	for (size_t j = 0; j <= len_b; j++) {
+		row[j] = (int) j;
+	}
+	for (size_t i = 1; '\0' != a[i - 1]; i++) {
+		int diagonal = row[0];
+		row[0] = (int) i;
+		for (size_t j = 1; j <= len_b; j++) {
+			const int substitution = diagonal + (a[i - 1] == b[j - 1] ? 0 : 1);
+			diagonal = row[j];
+			const int deletion = row[j] + 1;
+			const int insertion = row[j - 1] + 1;
+			row[j] = substitution < deletion ? substitution : deletion;
+			row[j] = row[j] < insertion ? row[j] : insertion;
+		}
+	}
+	return row[len_b];
+}
+
+
+
+
+/**
+   @brief Build timeline of hand-sent @p text
+
+   Durations [units] of Marks and Spaces are randomly spread around
+   their ideal durations by up to @p sloppiness percents, and Dashes
+   and inter-character-spaces are shortened by @p sloppiness / 2
+   percents, as they often are in hand-sent code.
+*/
+static size_t test_cw_viterbi_timeline(const char * text, int64_t unit, int sloppiness, cw_rec_event_t * events, size_t capacity)
+{
+	unsigned short xsubi[3] = { 1, 2, 3 };
+	const double spread = sloppiness / 100.0;
+	size_t n_events = 0;
+	int64_t t = (int64_t) 1000 * 1000 * 1000 * 1000;
+
+	for (const char * c = text; *c && n_events + 3 < capacity; c++) {
+		if (' ' == *c) {
+			t += (int64_t) ((double) (4 * unit) * (1.0 + spread * erand48(xsubi)));
+			continue;
+		}
+		for (const char * mark = cw_character_to_representation_internal(*c); *mark; mark++) {
+			const double ideal = CW_DOT_REPRESENTATION == *mark ? 1.0 : 3.0 * (1.0 - spread / 2);
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_BEGIN, t };
+			t += (int64_t) ((double) unit * ideal * (1.0 + spread * (2.0 * erand48(xsubi) - 1.0)));
+			events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_MARK_END, t };
+			t += (int64_t) ((double) unit * (1.0 + spread * (2.0 * erand48(xsubi) - 1.0)));
+		}
+		t += (int64_t) ((double) (2 * unit) * (1.0 - spread / 2) * (1.0 + spread * (2.0 * erand48(xsubi) - 1.0)));
+	}
+	events[n_events++] = (cw_rec_event_t) { CW_REC_EVENT_POLL, t + 20 * unit };
+
+	return n_events;
+}
+
+
+
+
+/**
+   @brief Test probabilistic decoder
+
+   Clean keying must be decoded without errors, regardless of how
+   timeline is split into chunks, and with bounded latency. Sloppy
+   hand-sent keying must be decoded with fewer errors than receiver
+   makes.
+*/
+int test_cw_viterbi_process_events(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int64_t unit = 60 * 1000 * 1000; /* Duration of dot at 20 WPM [ns]. */
+	cw_rec_event_t events[1024];
+
+	/* Clean keying. */
+	{
+		const char * text = "PARIS CQ 73";
+		const size_t n_events = test_cw_viterbi_timeline(text, unit, 0, events, sizeof (events) / sizeof (events[0]));
+
+		for (size_t chunk = n_events; chunk >= 1; chunk = chunk > 3 ? 3 : chunk - 1) {
+			cw_viterbi_t * vit = cw_viterbi_new();
+			cte->assert2(cte, vit, "%s: failed to create new decoder", __func__);
+			cw_viterbi_set_speed(vit, 20);
+
+			test_cw_viterbi_output_t output = { .text = { 0 } };
+			bool failure = false;
+			for (size_t i = 0; i < n_events; i += chunk) {
+				const size_t n = n_events - i < chunk ? n_events - i : chunk;
+				if (1 == chunk) {
+					/* Poll decoder during Spaces, as client code would. */
+					for (int64_t t = i ? events[i - 1].timestamp + unit / 4 : events[i].timestamp; t < events[i].timestamp; t += unit / 4) {
+						const cw_rec_event_t poll = { CW_REC_EVENT_POLL, t };
+						output.now = t;
+						failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_viterbi_process_events)(vit, &poll, 1, test_cw_viterbi_callback, &output);
+					}
+				}
+				output.now = events[i + n - 1].timestamp;
+				failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_viterbi_process_events)(vit, events + i, n, test_cw_viterbi_callback, &output);
+			}
+			cte->expect_op_int(cte, false, "==", failure, "%s: clean, chunks of %zu events: process", __func__, chunk);
+			cte->expect_op_int(cte, 0, "==", strcmp(output.text, "PARIS CQ 73 "), "%s: clean, chunks of %zu events: text '%s'", __func__, chunk, output.text);
+			cte->expect_op_int(cte, 0, "==", output.n_errors, "%s: clean, chunks of %zu events: errors", __func__, chunk);
+			if (1 == chunk) {
+				/* Character is reported at latest when Space after it becomes inter-word-space. */
+				cte->expect_op_int(cte, 6 * unit, ">=", output.max_latency, "%s: clean: latency: %"PRId64" ms", __func__, output.max_latency / 1000000);
+			}
+
+			cw_viterbi_delete(&vit);
+		}
+	}
+
+	/* Sloppy keying. */
+	{
+		const char * text = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 0123456789";
+		char expected[128];
+		snprintf(expected, sizeof (expected), "%s ", text);
+		const size_t n_events = test_cw_viterbi_timeline(text, unit, 35, events, sizeof (events) / sizeof (events[0]));
+
+		cw_viterbi_t * vit = cw_viterbi_new();
+		cte->assert2(cte, vit, "%s: failed to create new decoder", __func__);
+		cw_viterbi_set_speed(vit, 20);
+		test_cw_viterbi_output_t vit_output = { .text = { 0 } };
+		cw_viterbi_process_events(vit, events, n_events, test_cw_viterbi_callback, &vit_output);
+		cw_viterbi_delete(&vit);
+
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+		cw_rec_set_speed(rec, 20);
+		cw_rec_enable_adaptive_mode(rec);
+		test_cw_viterbi_output_t rec_output = { .text = { 0 } };
+		cw_rec_process_events(rec, events, n_events, test_cw_viterbi_callback, &rec_output);
+		cw_rec_delete(&rec);
+
+		const int vit_errors = test_cw_viterbi_edit_distance(expected, vit_output.text);
+		const int rec_errors = test_cw_viterbi_edit_distance(expected, rec_output.text);
+		cte->log_info(cte, "%s: sloppy: decoder: '%s' (%d errors), receiver: '%s' (%d errors)\n",
+			      __func__, vit_output.text, vit_errors, rec_output.text, rec_errors);
+		cte->expect_op_int(cte, rec_errors, ">", vit_errors, "%s: sloppy: fewer errors than receiver", __func__);
+		cte->expect_op_int(cte, 1, ">=", vit_errors, "%s: sloppy: errors", __func__);
+	}
+
+	/* Invalid events and parameters. */
+	{
+		cw_viterbi_t * vit = cw_viterbi_new();
+		cte->assert2(cte, vit, "%s: failed to create new decoder", __func__);
+		test_cw_viterbi_output_t output = { .text = { 0 } };
+		cw_ret_t cwret = CW_SUCCESS;
+
+		const cw_rec_event_t invalid_type[] = { { (cw_rec_event_type_t) 77, 1000 } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_viterbi_process_events)(vit, invalid_type, 1, test_cw_viterbi_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: invalid type (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: invalid type (errno)", __func__);
+
+		const cw_rec_event_t decreasing[] = { { CW_REC_EVENT_MARK_BEGIN, 2 * unit }, { CW_REC_EVENT_MARK_END, unit } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_viterbi_process_events)(vit, decreasing, 2, test_cw_viterbi_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: decreasing timestamps (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: decreasing timestamps (errno)", __func__);
+
+		cte->expect_op_int(cte, CW_FAILURE, "==", cw_viterbi_set_beam_width(vit, CW_VITERBI_BEAM_WIDTH_MAX + 1), "%s: beam width too large", __func__);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cw_viterbi_set_speed(vit, CW_SPEED_MAX + 1), "%s: speed too high", __func__);
+
+		cw_viterbi_delete(&vit);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test ensemble decoding
+
+   Clean keying must be decoded without errors regardless of how
+   timeline is split into chunks and of repeated events. Sloppy
+   keying must be decoded with no more errors than the best member
+   makes alone. A member that doesn't decode anything must not hold
+   back the others.
+*/
+int test_cw_ensemble_process_events(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int64_t unit = 60 * 1000 * 1000; /* Duration of dot at 20 WPM [ns]. */
+	cw_rec_event_t events[1024];
+
+	cw_rec_t * adaptive = cw_rec_new();
+	cw_rec_t * fixed = cw_rec_new();
+	cw_rec_t * silent = cw_rec_new();
+	cw_viterbi_t * vit = cw_viterbi_new();
+	cw_viterbi_t * narrow = cw_viterbi_new();
+	cte->assert2(cte, adaptive && fixed && silent && vit && narrow, "%s: failed to create members", __func__);
+	cw_rec_set_speed(adaptive, 20);
+	cw_rec_enable_adaptive_mode(adaptive);
+	cw_rec_set_speed(fixed, 20);
+	cw_rec_set_tolerance(fixed, 70);
+	/* Fixed speed receiver at the lowest speed rejects every Mark. */
+	cw_rec_set_speed(silent, CW_SPEED_MIN);
+	cw_rec_set_tolerance(silent, CW_TOLERANCE_MIN);
+	cw_viterbi_set_speed(vit, 20);
+	cw_viterbi_set_speed(narrow, 20);
+	cw_viterbi_set_beam_width(narrow, 4);
+
+	/* Clean keying, with repeated events. */
+	{
+		const char * text = "PARIS CQ 73";
+		const size_t n_clean = test_cw_viterbi_timeline(text, unit, 0, events, sizeof (events) / sizeof (events[0]) / 2);
+		size_t n_events = 0;
+		cw_rec_event_t repeated[1024];
+		for (size_t i = 0; i < n_clean; i++) {
+			repeated[n_events++] = events[i];
+			if (0 == i % 5) {
+				repeated[n_events++] = events[i];
+			}
+		}
+
+		for (size_t chunk = n_events; chunk >= 1; chunk = chunk > 3 ? 3 : chunk - 1) {
+			cw_ensemble_t * ens = cw_ensemble_new();
+			cte->assert2(cte, ens, "%s: failed to create new ensemble", __func__);
+			cw_ensemble_add_receiver(ens, adaptive, 1);
+			cw_ensemble_add_receiver(ens, fixed, 1);
+			cw_ensemble_add_viterbi(ens, vit, 1);
+
+			test_cw_viterbi_output_t output = { .text = { 0 } };
+			bool failure = false;
+			for (size_t i = 0; i < n_events; i += chunk) {
+				const size_t n = n_events - i < chunk ? n_events - i : chunk;
+				failure = failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_ensemble_process_events)(ens, repeated + i, n, test_cw_viterbi_callback, &output);
+			}
+			cte->expect_op_int(cte, false, "==", failure, "%s: clean, chunks of %zu events: process", __func__, chunk);
+			cte->expect_op_int(cte, 0, "==", strcmp(output.text, "PARIS CQ 73 "), "%s: clean, chunks of %zu events: text '%s'", __func__, chunk, output.text);
+			cte->expect_op_int(cte, 0, "==", output.n_errors, "%s: clean, chunks of %zu events: errors", __func__, chunk);
+
+			cw_ensemble_delete(&ens);
+		}
+	}
+
+	/* Sloppy keying. */
+	{
+		const char * text = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 0123456789";
+		char expected[128];
+		snprintf(expected, sizeof (expected), "%s ", text);
+		const size_t n_events = test_cw_viterbi_timeline(text, unit, 40, events, sizeof (events) / sizeof (events[0]));
+
+		int best_member_errors = INT_MAX;
+		for (int m = 0; m < 4; m++) {
+			test_cw_viterbi_output_t output = { .text = { 0 } };
+			switch (m) {
+			case 0:
+				cw_rec_reset_state(adaptive);
+				cw_rec_process_events(adaptive, events, n_events, test_cw_viterbi_callback, &output);
+				break;
+			case 1:
+				cw_rec_reset_state(fixed);
+				cw_rec_process_events(fixed, events, n_events, test_cw_viterbi_callback, &output);
+				break;
+			case 2:
+				cw_viterbi_reset_state(vit);
+				cw_viterbi_process_events(vit, events, n_events, test_cw_viterbi_callback, &output);
+				break;
+			default:
+				cw_viterbi_reset_state(narrow);
+				cw_viterbi_process_events(narrow, events, n_events, test_cw_viterbi_callback, &output);
+				break;
+			}
+			const int errors = test_cw_viterbi_edit_distance(expected, output.text);
+			best_member_errors = errors < best_member_errors ? errors : best_member_errors;
+		}
+
+		cw_ensemble_t * ens = cw_ensemble_new();
+		cte->assert2(cte, ens, "%s: failed to create new ensemble", __func__);
+		cw_ensemble_add_receiver(ens, adaptive, 1);
+		cw_ensemble_add_receiver(ens, fixed, 1);
+		cw_ensemble_add_viterbi(ens, vit, 1);
+		cw_ensemble_add_viterbi(ens, narrow, 1);
+		test_cw_viterbi_output_t output = { .text = { 0 } };
+		cw_ensemble_process_events(ens, events, n_events, test_cw_viterbi_callback, &output);
+		cw_ensemble_delete(&ens);
+
+		const int errors = test_cw_viterbi_edit_distance(expected, output.text);
+		cte->log_info(cte, "%s: sloppy: ensemble: '%s' (%d errors), best member: %d errors\n",
+			      __func__, output.text, errors, best_member_errors);
+		cte->expect_op_int(cte, best_member_errors, ">=", errors, "%s: sloppy: no more errors than best member", __func__);
+	}
+
+	/* Member that doesn't decode anything. */
+	{
+		const size_t n_events = test_cw_viterbi_timeline("CQ DE SP5", unit, 0, events, sizeof (events) / sizeof (events[0]));
+
+		cw_ensemble_t * ens = cw_ensemble_new();
+		cte->assert2(cte, ens, "%s: failed to create new ensemble", __func__);
+		cw_ensemble_add_receiver(ens, silent, 1);
+		cw_ensemble_add_receiver(ens, adaptive, 1);
+		cw_ensemble_add_viterbi(ens, vit, 1);
+		test_cw_viterbi_output_t output = { .text = { 0 } };
+		cw_ensemble_process_events(ens, events, n_events, test_cw_viterbi_callback, &output);
+		cte->expect_op_int(cte, 0, "==", strcmp(output.text, "CQ DE SP5 "), "%s: silent member: text '%s'", __func__, output.text);
+		cw_ensemble_delete(&ens);
+	}
+
+	/* Invalid events and parameters. */
+	{
+		cw_ensemble_t * ens = cw_ensemble_new();
+		cte->assert2(cte, ens, "%s: failed to create new ensemble", __func__);
+		test_cw_viterbi_output_t output = { .text = { 0 } };
+		cw_ret_t cwret = CW_SUCCESS;
+
+		cte->expect_op_int(cte, CW_FAILURE, "==", cw_ensemble_add_receiver(ens, adaptive, 0), "%s: zero weight", __func__);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cw_ensemble_add_receiver(ens, NULL, 1), "%s: NULL receiver", __func__);
+		for (int i = 0; i < CW_ENSEMBLE_MEMBERS_MAX; i++) {
+			cw_ensemble_add_viterbi(ens, vit, 1);
+		}
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_ensemble_add_viterbi)(ens, vit, 1);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: too many members (cwret)", __func__);
+		cte->expect_op_int(cte, ENOMEM, "==", errno, "%s: too many members (errno)", __func__);
+
+		const cw_rec_event_t invalid_type[] = { { (cw_rec_event_type_t) 77, 1000 } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_ensemble_process_events)(ens, invalid_type, 1, test_cw_viterbi_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: invalid type (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: invalid type (errno)", __func__);
+
+		const cw_rec_event_t decreasing[] = { { CW_REC_EVENT_MARK_BEGIN, 2 * unit }, { CW_REC_EVENT_MARK_END, unit } };
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_ensemble_process_events)(ens, decreasing, 2, test_cw_viterbi_callback, &output);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "%s: decreasing timestamps (cwret)", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: decreasing timestamps (errno)", __func__);
+
+		cw_ensemble_delete(&ens);
+	}
+
+	cw_rec_delete(&adaptive);
+	cw_rec_delete(&fixed);
+	cw_rec_delete(&silent);
+	cw_viterbi_delete(&vit);
+	cw_viterbi_delete(&narrow);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test offline sweep of receiver parameters
+
+   Clean keying must be received without errors at any speed, and
+   results of the sweep must not depend on count of threads.
+*/
+int test_cw_rec_tester_sweep(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int speeds[] = { 6, 20, 40 };
+	const int tolerances[] = { 50 };
+	const int noises[] = { 0, 25 };
+	const bool adaptive_modes[] = { false, true };
+	cw_rec_tester_sweep_config_t config = {
+		.speeds = speeds,                 .n_speeds = sizeof (speeds) / sizeof (speeds[0]),
+		.tolerances = tolerances,         .n_tolerances = sizeof (tolerances) / sizeof (tolerances[0]),
+		.noises = noises,                 .n_noises = sizeof (noises) / sizeof (noises[0]),
+		.adaptive_modes = adaptive_modes, .n_adaptive_modes = sizeof (adaptive_modes) / sizeof (adaptive_modes[0]),
+		.weighting = CW_WEIGHTING_INITIAL,
+		.gap = CW_GAP_INITIAL,
+		.text = "paris cq 0123456789",
+		.seed = 1
+	};
+
+	const size_t n_cells = cw_rec_tester_sweep_n_cells(&config);
+	cte->expect_op_int(cte, 12, "==", (int) n_cells, "%s: count of cells", __func__);
+
+	cw_rec_tester_sweep_cell_t one_thread[12];
+	cw_rec_tester_sweep_cell_t many_threads[12];
+
+	config.n_threads = 1;
+	int result = LIBCW_TEST_FUT(cw_rec_tester_sweep)(&config, one_thread, n_cells);
+	cte->expect_op_int(cte, 0, "==", result, "%s: sweep with one thread", __func__);
+
+	config.n_threads = 4;
+	result = LIBCW_TEST_FUT(cw_rec_tester_sweep)(&config, many_threads, n_cells);
+	cte->expect_op_int(cte, 0, "==", result, "%s: sweep with many threads", __func__);
+
+	bool clean_failure = false;
+	bool threads_failure = false;
+	for (size_t i = 0; i < n_cells; i++) {
+		const cw_rec_tester_sweep_cell_t * cell = &one_thread[i];
+		if (0 == cell->noise && (0 != cell->n_errors || 19 != cell->n_sent)) {
+			cte->log_error(cte, "%s: clean keying: speed %d, adaptive %d: %zd errors in %zd characters\n",
+				       __func__, cell->speed, cell->adaptive, cell->n_errors, cell->n_sent);
+			clean_failure = true;
+		}
+		if (cell->speed != many_threads[i].speed
+		    || cell->noise != many_threads[i].noise
+		    || cell->adaptive != many_threads[i].adaptive
+		    || cell->n_received != many_threads[i].n_received
+		    || cell->n_errors != many_threads[i].n_errors) {
+			threads_failure = true;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", clean_failure, "%s: clean keying", __func__);
+	cte->expect_op_int(cte, false, "==", threads_failure, "%s: same results for different counts of threads", __func__);
+
+	/* Jitter of 100% would shrink some marks and spaces to nothing. */
+	const int invalid_noises[] = { 100 };
+	config.noises = invalid_noises;
+	config.n_noises = 1;
+	result = LIBCW_TEST_FUT(cw_rec_tester_sweep)(&config, one_thread, cw_rec_tester_sweep_n_cells(&config));
+	cte->expect_op_int(cte, -1, "==", result, "%s: invalid noise", __func__);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Dot at 20 WPM [ns]. */
+#define TEST_CORPUS_DOT ((int64_t) 60 * 1000 * 1000)
+
+
+
+
+/**
+   Call @p fn for each mark of @p text keyed at 20 WPM: with time of
+   beginning and end of the mark [ns], counted from zero.
+
+   @return duration of keyed text [ns]
+*/
+static int64_t test_cw_rec_tester_corpus_key(const char * text, void (* fn)(void * arg, int64_t begin, int64_t end), void * arg)
+{
+	int64_t t = 0;
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			t += 4 * TEST_CORPUS_DOT;
+			continue;
+		}
+		for (const char * mark = cw_character_to_representation_internal(*c); *mark; mark++) {
+			const int64_t duration = (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * TEST_CORPUS_DOT;
+			fn(arg, t, t + duration);
+			t += duration + TEST_CORPUS_DOT;
+		}
+		t += 2 * TEST_CORPUS_DOT;
+	}
+	return t;
+}
+
+
+
+
+static void test_cw_rec_tester_corpus_keylog_mark(void * arg, int64_t begin, int64_t end)
+{
+	const int64_t start = (int64_t) 1000 * 1000 * 1000;
+	cw_keylog_record((cw_keylog_t *) arg, CW_KEYLOG_SOURCE_STRAIGHT_KEY, CW_KEY_VALUE_CLOSED, start + begin);
+	cw_keylog_record((cw_keylog_t *) arg, CW_KEYLOG_SOURCE_STRAIGHT_KEY, CW_KEY_VALUE_OPEN, start + end);
+}
+
+
+
+
+static void test_cw_rec_tester_corpus_no_mark(__attribute__((unused)) void * arg, __attribute__((unused)) int64_t begin, __attribute__((unused)) int64_t end)
+{
+	return;
+}
+
+
+
+
+typedef struct {
+	int16_t * samples;
+	int sample_rate;
+} test_cw_rec_tester_corpus_sound_t;
+
+
+
+
+static void test_cw_rec_tester_corpus_sound_mark(void * arg, int64_t begin, int64_t end)
+{
+	test_cw_rec_tester_corpus_sound_t * sound = (test_cw_rec_tester_corpus_sound_t *) arg;
+	/* Half a second of silence before first mark. */
+	const int64_t first = begin * sound->sample_rate / 1000000000 + sound->sample_rate / 2;
+	const int64_t last = end * sound->sample_rate / 1000000000 + sound->sample_rate / 2;
+	for (int64_t i = first; i < last; i++) {
+		sound->samples[i] = (int16_t) (10000.0 * sin(2.0 * M_PI * 800.0 * (double) i / sound->sample_rate));
+	}
+}
+
+
+
+
+static void test_cw_rec_tester_corpus_write(const char * directory, const char * name, const char * contents)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof (path), "%s/%s", directory, name);
+	FILE * file = fopen(path, "w");
+	if (NULL != file) {
+		fputs(contents, file);
+		fclose(file);
+	}
+}
+
+
+
+
+static const cw_rec_tester_corpus_file_t * test_cw_rec_tester_corpus_find(const cw_rec_tester_corpus_file_t * files, size_t n_files, const char * name)
+{
+	for (size_t i = 0; i < n_files; i++) {
+		if (0 == strcmp(name, files[i].name)) {
+			return &files[i];
+		}
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Test receiving of corpus of reference recordings
+
+   Corpus has a keying log and a sound recording that must be received
+   without errors, a keying log with wrong expected text, and a keying
+   log without expected text (to be skipped).
+*/
+int test_cw_rec_tester_corpus(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char directory[] = "/tmp/libcw_corpus_XXXXXX";
+	const bool created = NULL != mkdtemp(directory);
+	cte->assert2(cte, created, "%s: failed to create temporary directory", __func__);
+
+	const char * names[] = { "a_paris.cwkl", "b_tone.wav", "c_wrong.cwkl", "d_orphan.cwkl" };
+	const char * texts[] = { "paris cq 73", "cq test", "paris", "e" };
+	char path[PATH_MAX];
+	for (int i = 0; i < 4; i++) {
+		snprintf(path, sizeof (path), "%s/%s", directory, names[i]);
+		if (1 == i) {
+			test_cw_rec_tester_corpus_sound_t sound = { .samples = NULL, .sample_rate = 8000 };
+			const int64_t duration = test_cw_rec_tester_corpus_key(texts[i], test_cw_rec_tester_corpus_no_mark, NULL);
+			const uint32_t n_samples = (uint32_t) (duration * sound.sample_rate / 1000000000 + sound.sample_rate);
+			sound.samples = (int16_t *) calloc(n_samples, sizeof (int16_t));
+			test_cw_rec_tester_corpus_key(texts[i], test_cw_rec_tester_corpus_sound_mark, &sound);
+
+			const uint32_t n_bytes = 2 * n_samples;
+			const uint32_t rate = (uint32_t) sound.sample_rate;
+			const uint8_t header[44] = {
+				'R', 'I', 'F', 'F', (uint8_t) (n_bytes + 36), (uint8_t) ((n_bytes + 36) >> 8), (uint8_t) ((n_bytes + 36) >> 16), (uint8_t) ((n_bytes + 36) >> 24),
+				'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+				(uint8_t) rate, (uint8_t) (rate >> 8), (uint8_t) (rate >> 16), (uint8_t) (rate >> 24),
+				(uint8_t) (2 * rate), (uint8_t) ((2 * rate) >> 8), (uint8_t) ((2 * rate) >> 16), (uint8_t) ((2 * rate) >> 24),
+				2, 0, 16, 0, 'd', 'a', 't', 'a',
+				(uint8_t) n_bytes, (uint8_t) (n_bytes >> 8), (uint8_t) (n_bytes >> 16), (uint8_t) (n_bytes >> 24)
+			};
+			FILE * file = fopen(path, "wb");
+			fwrite(header, 1, sizeof (header), file);
+			for (uint32_t s = 0; s < n_samples; s++) {
+				const uint8_t bytes[2] = { (uint8_t) sound.samples[s], (uint8_t) ((uint16_t) sound.samples[s] >> 8) };
+				fwrite(bytes, 1, sizeof (bytes), file);
+			}
+			fclose(file);
+			free(sound.samples);
+		} else {
+			cw_keylog_t * keylog = cw_keylog_new_writer(path);
+			test_cw_rec_tester_corpus_key(texts[i], test_cw_rec_tester_corpus_keylog_mark, keylog);
+			cw_keylog_delete(&keylog);
+		}
+	}
+	/* Expected texts may span many lines, letter case doesn't matter. */
+	test_cw_rec_tester_corpus_write(directory, "a_paris.txt", "PARIS\nCQ  73\n");
+	test_cw_rec_tester_corpus_write(directory, "b_tone.txt", "cq test");
+	test_cw_rec_tester_corpus_write(directory, "c_wrong.txt", "parts");
+
+	cw_rec_tester_corpus_config_t config = {
+		.directory = directory,
+		.speed = 20,
+		.tolerance = CW_TOLERANCE_INITIAL,
+		.adaptive = false,
+		.frequency = 800,
+		.afc_range = 0,
+		.poll_interval = 5000,
+		.max_error_rate_percent = 5.0F,
+		.baseline = NULL,
+		.max_regression_percent = 0.5F,
+		.n_threads = 2
+	};
+	cw_rec_tester_corpus_file_t * files = NULL;
+	size_t n_files = 0;
+	int result = LIBCW_TEST_FUT(cw_rec_tester_corpus)(&config, &files, &n_files);
+	cte->expect_op_int(cte, 0, "==", result, "%s: run over corpus", __func__);
+	cte->expect_op_int(cte, 3, "==", (int) n_files, "%s: count of recordings with expected text", __func__);
+
+	const cw_rec_tester_corpus_file_t * a = test_cw_rec_tester_corpus_find(files, n_files, "a_paris.cwkl");
+	const cw_rec_tester_corpus_file_t * b = test_cw_rec_tester_corpus_find(files, n_files, "b_tone.wav");
+	const cw_rec_tester_corpus_file_t * c = test_cw_rec_tester_corpus_find(files, n_files, "c_wrong.cwkl");
+	if (NULL == a || NULL == b || NULL == c) {
+		cte->log_error(cte, "%s: missing results\n", __func__);
+		free(files);
+		return -1;
+	}
+
+	cte->expect_op_int(cte, true, "==", a->loaded && a->passed, "%s: keying log: passed", __func__);
+	cte->expect_op_int(cte, 11, "==", (int) a->n_sent, "%s: keying log: count of characters", __func__);
+	cte->expect_op_int(cte, 0, "==", (int) a->n_errors, "%s: keying log: errors", __func__);
+	cte->expect_op_int(cte, 3, "==", (int) a->n_words, "%s: keying log: count of words", __func__);
+	cte->expect_op_int(cte, 0, "==", (int) a->n_word_errors, "%s: keying log: word errors", __func__);
+	/* "paris cq 73": 5 + 2 + 2 characters with 4 + 2 + 3 + 2 + 3 + 4 + 4 + 5 + 5 marks. */
+	cte->expect_op_int(cte, 2 * 32, "==", (int) a->n_events, "%s: keying log: count of events", __func__);
+	/* Character is received when space after it is longer than two
+	   dots (at 50% tolerance), polled every 5 ms. */
+	const int latency_ms = (int) (a->latency * 1000.0 + 0.5);
+	cte->expect_op_int(cte, 120, "<=", latency_ms, "%s: keying log: latency (lower bound)", __func__);
+	cte->expect_op_int(cte, 200, ">=", latency_ms, "%s: keying log: latency (upper bound)", __func__);
+	cte->expect_op_int(cte, true, "==", a->events_per_second > 0.0, "%s: keying log: events per second", __func__);
+
+	cte->expect_op_int(cte, true, "==", b->loaded && b->passed, "%s: sound: passed", __func__);
+	cte->expect_op_int(cte, 0, "==", (int) b->n_errors, "%s: sound: errors", __func__);
+	cte->expect_op_int(cte, 2 * 14, "==", (int) b->n_events, "%s: sound: count of events", __func__);
+
+	cte->expect_op_int(cte, true, "==", c->loaded && !c->passed, "%s: wrong text: failed", __func__);
+	cte->expect_op_int(cte, 1, "==", (int) c->n_errors, "%s: wrong text: errors", __func__);
+	cte->expect_op_int(cte, 1, "==", (int) c->n_word_errors, "%s: wrong text: word errors", __func__);
+
+	/* Results of run are a baseline of next run. */
+	char baseline[PATH_MAX];
+	snprintf(baseline, sizeof (baseline), "%s/baseline", directory);
+	FILE * file = fopen(baseline, "w");
+	const size_t n_failed = cw_rec_tester_corpus_print(file, files, n_files);
+	fclose(file);
+	cte->expect_op_int(cte, 1, "==", (int) n_failed, "%s: count of failed recordings", __func__);
+	free(files);
+
+	config.baseline = baseline;
+	config.max_error_rate_percent = 50.0F;
+	result = LIBCW_TEST_FUT(cw_rec_tester_corpus)(&config, &files, &n_files);
+	cte->expect_op_int(cte, 0, "==", result, "%s: run with baseline", __func__);
+	c = test_cw_rec_tester_corpus_find(files, n_files, "c_wrong.cwkl");
+	if (NULL == c) {
+		cte->log_error(cte, "%s: missing results\n", __func__);
+		free(files);
+		return -1;
+	}
+	cte->expect_op_int(cte, true, "==", c->has_baseline && c->passed, "%s: no regression", __func__);
+	cte->expect_op_int(cte, 20, "==", (int) (c->baseline_error_rate_percent + 0.5F), "%s: CER of baseline", __func__);
+	free(files);
+
+	/* Baseline in which the recording with wrong text was received
+	   without errors. */
+	test_cw_rec_tester_corpus_write(directory, "baseline", "c_wrong.cwkl 5 0 0.00 1 0.00 150.0 18 100000 - - pass\n");
+	result = LIBCW_TEST_FUT(cw_rec_tester_corpus)(&config, &files, &n_files);
+	cte->expect_op_int(cte, 0, "==", result, "%s: run with worse baseline", __func__);
+	a = test_cw_rec_tester_corpus_find(files, n_files, "a_paris.cwkl");
+	c = test_cw_rec_tester_corpus_find(files, n_files, "c_wrong.cwkl");
+	if (NULL == a || NULL == c) {
+		cte->log_error(cte, "%s: missing results\n", __func__);
+		free(files);
+		return -1;
+	}
+	cte->expect_op_int(cte, true, "==", !a->has_baseline && a->passed, "%s: recording without baseline", __func__);
+	cte->expect_op_int(cte, true, "==", c->has_baseline && !c->passed, "%s: regression", __func__);
+	free(files);
+
+	/* The same recordings, received with probabilistic decoder. */
+	config.baseline = NULL;
+	config.max_error_rate_percent = 5.0F;
+	config.beam_width = CW_VITERBI_BEAM_WIDTH_INITIAL;
+	result = LIBCW_TEST_FUT(cw_rec_tester_corpus)(&config, &files, &n_files);
+	cte->expect_op_int(cte, 0, "==", result, "%s: run with probabilistic decoder", __func__);
+	a = test_cw_rec_tester_corpus_find(files, n_files, "a_paris.cwkl");
+	b = test_cw_rec_tester_corpus_find(files, n_files, "b_tone.wav");
+	if (NULL == a || NULL == b) {
+		cte->log_error(cte, "%s: missing results\n", __func__);
+		free(files);
+		return -1;
+	}
+	cte->expect_op_int(cte, true, "==", a->passed && 0 == a->n_errors, "%s: probabilistic decoder: keying log: passed", __func__);
+	cte->expect_op_int(cte, true, "==", b->passed && 0 == b->n_errors, "%s: probabilistic decoder: sound: passed", __func__);
+	free(files);
+	config.beam_width = 0;
+
+	config.directory = "/nonexistent/libcw/corpus";
+	result = LIBCW_TEST_FUT(cw_rec_tester_corpus)(&config, &files, &n_files);
+	cte->expect_op_int(cte, -1, "==", result, "%s: missing directory", __func__);
+
+	const char * all_names[] = { "a_paris.cwkl", "b_tone.wav", "c_wrong.cwkl", "d_orphan.cwkl", "a_paris.txt", "b_tone.txt", "c_wrong.txt", "baseline" };
+	for (size_t i = 0; i < sizeof (all_names) / sizeof (all_names[0]); i++) {
+		snprintf(path, sizeof (path), "%s/%s", directory, all_names[i]);
+		unlink(path);
+	}
+	rmdir(directory);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	char text[16];
+	int64_t last_call; /* Monotonic time of last call of callback [ns]. */
+} test_cw_rec_output_callback_output_t;
+
+
+
+
+static int64_t test_cw_rec_output_callback_now(void)
+{
+	/* Clock of the library, which may be virtual. */
+	return cw_clock_now_internal();
+}
+
+
+
+
+static void test_cw_rec_output_callback_callback(void * callback_arg, int64_t timestamp, char character, bool is_error)
+{
+	(void) timestamp;
+	(void) is_error;
+	test_cw_rec_output_callback_output_t * output = (test_cw_rec_output_callback_output_t *) callback_arg;
+	pthread_mutex_lock(&output->mutex);
+	const size_t len = strlen(output->text);
+	if (len < sizeof (output->text) - 1) {
+		output->text[len] = character;
+	}
+	output->last_call = test_cw_rec_output_callback_now();
+	pthread_cond_broadcast(&output->cond);
+	pthread_mutex_unlock(&output->mutex);
+}
+
+
+
+
+/* Key Marks of given representation in real time. */
+static bool test_cw_rec_output_callback_key(cw_rec_t * rec, const char * representation, int dot_usecs)
+{
+	bool failure = false;
+	for (const char * mark = representation; *mark; mark++) {
+		failure = failure || CW_SUCCESS != cw_rec_mark_begin_ns(rec, test_cw_rec_output_callback_now());
+		cw_usleep_internal((CW_DOT_REPRESENTATION == *mark ? 1 : 3) * dot_usecs);
+		failure = failure || CW_SUCCESS != cw_rec_mark_end_ns(rec, test_cw_rec_output_callback_now());
+		if (mark[1]) {
+			cw_usleep_internal(dot_usecs);
+		}
+	}
+	return failure;
+}
+
+
+
+
+/**
+   @brief Test push-style reporting of received characters
+
+   Key "CQ" in real time without polling the receiver. Characters and
+   inter-word-space must be reported by the callback, shortly after
+   the Spaces become long enough.
+*/
+int test_cw_rec_output_callback(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int dot_usecs = 30000; /* 40 WPM */
+	test_cw_rec_output_callback_output_t output = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, 40);
+
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_register_output_callback)(rec, test_cw_rec_output_callback_callback, &output);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: register callback", __func__);
+
+	bool failure = test_cw_rec_output_callback_key(rec, "-.-.", dot_usecs);
+	cw_usleep_internal(3 * dot_usecs);
+	failure = failure || test_cw_rec_output_callback_key(rec, "--.-", dot_usecs);
+	const int64_t end_of_mark = test_cw_rec_output_callback_now();
+	cte->expect_op_int(cte, false, "==", failure, "%s: keying", __func__);
+
+	/* Wait for "C", "Q" and inter-word-space. */
+	pthread_mutex_lock(&output.mutex);
+	const int64_t deadline = end_of_mark + CW_NSECS_PER_SEC;
+	while (strlen(output.text) < 3 && test_cw_rec_output_callback_now() < deadline) {
+		struct timespec ts = { 0 };
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 10 * 1000 * 1000;
+		if (ts.tv_nsec >= CW_NSECS_PER_SEC) {
+			ts.tv_sec++;
+			ts.tv_nsec -= CW_NSECS_PER_SEC;
+		}
+		pthread_cond_timedwait(&output.cond, &output.mutex, &ts);
+	}
+	const int64_t last_call = output.last_call;
+	pthread_mutex_unlock(&output.mutex);
+	cte->expect_op_int(cte, 0, "==", strcmp(output.text, "CQ "), "%s: received text: '%s'", __func__, output.text);
+
+	/* Inter-word-space must be reported soon after it becomes
+	   longer than longest inter-character-space. */
+	int ics_max = 0;
+	cw_rec_get_parameters_internal(rec, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &ics_max, NULL, NULL);
+	const int latency = (int) ((last_call - end_of_mark) / 1000) - ics_max;
+	cte->expect_op_int(cte, 20000, ">", latency, "%s: latency of inter-word-space: %d us", __func__, latency);
+
+	/* Unregistered callback is not called. */
+	cwret = LIBCW_TEST_FUT(cw_rec_register_output_callback)(rec, NULL, NULL);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: unregister callback", __func__);
+	cw_rec_reset_state(rec);
+	failure = test_cw_rec_output_callback_key(rec, ".", dot_usecs);
+	cw_usleep_internal(10 * dot_usecs);
+	cte->expect_op_int(cte, 0, "==", strcmp(output.text, "CQ "), "%s: no calls after unregistering", __func__);
+
+	/* Receiver with running timer can be deleted. */
+	cw_rec_reset_state(rec);
+	cw_rec_register_output_callback(rec, test_cw_rec_output_callback_callback, &output);
+	failure = failure || test_cw_rec_output_callback_key(rec, ".", dot_usecs);
+	cte->expect_op_int(cte, false, "==", failure, "%s: keying", __func__);
+	cw_rec_delete(&rec);
+	cw_usleep_internal(10 * dot_usecs);
+	cte->expect_op_int(cte, 0, "==", strcmp(output.text, "CQ "), "%s: no calls after deleting", __func__);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test event descriptor of receiver that is polled by client code
+
+   Key "C" in real time. The descriptor should become readable when
+   the character can be polled, and again when inter-word-space can
+   be polled.
+*/
+int test_cw_rec_event_fd(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int dot_usecs = 30000; /* 40 WPM */
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, 40);
+
+	const int fd = LIBCW_TEST_FUT(cw_rec_get_event_fd)(rec);
+#if defined(__linux__)
+	cte->expect_op_int(cte, -1, "!=", fd, "%s: get event descriptor", __func__);
+
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	bool failure = test_cw_rec_output_callback_key(rec, "-.-.", dot_usecs);
+	cte->expect_op_int(cte, false, "==", failure, "%s: keying", __func__);
+	cte->expect_op_int(cte, 0, "==", poll(&pfd, 1, 0), "%s: descriptor not readable right after end of Mark", __func__);
+
+	char character = 0;
+	bool is_end_of_word = true;
+	uint64_t counter = 0;
+	int n = poll(&pfd, 1, 1000);
+	cte->expect_op_int(cte, 1, "==", n, "%s: descriptor readable after character", __func__);
+	cte->expect_op_int(cte, (int) sizeof (counter), "==", (int) read(fd, &counter, sizeof (counter)), "%s: read counter", __func__);
+	cw_ret_t cwret = cw_rec_poll_character_ns(rec, test_cw_rec_output_callback_now(), &character, &is_end_of_word, NULL);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: poll character", __func__);
+	cte->expect_op_int(cte, 'C', "==", character, "%s: received character", __func__);
+	cte->expect_op_int(cte, false, "==", is_end_of_word, "%s: not end of word yet", __func__);
+
+	n = poll(&pfd, 1, 1000);
+	cte->expect_op_int(cte, 1, "==", n, "%s: descriptor readable after inter-word-space", __func__);
+	cte->expect_op_int(cte, (int) sizeof (counter), "==", (int) read(fd, &counter, sizeof (counter)), "%s: read counter", __func__);
+	cwret = cw_rec_poll_character_ns(rec, test_cw_rec_output_callback_now(), &character, &is_end_of_word, NULL);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: poll inter-word-space", __func__);
+	cte->expect_op_int(cte, true, "==", is_end_of_word, "%s: end of word", __func__);
+
+	/* Nothing more to signal. */
+	cte->expect_op_int(cte, 0, "==", poll(&pfd, 1, 5 * dot_usecs / 1000), "%s: no more events", __func__);
+#else
+	cte->expect_op_int(cte, -1, "==", fd, "%s: event descriptors not supported", __func__);
+#endif
+
+	/* Receiver with running timer can be deleted. */
+	cw_rec_reset_state(rec);
+	test_cw_rec_output_callback_key(rec, ".", dot_usecs);
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	cw_rec_t * rec;
+	cw_rec_compact_t crec;
+	const cw_rec_t * params;
+
+	char received[64];
+	char received_compact[64];
+	int n_mismatches;
+} test_cw_rec_compact_data_t;
+
+
+
+
+/* Poll both receivers at @p timestamp, compare results. */
+static void test_cw_rec_compact_poll(test_cw_rec_compact_data_t * data, int64_t timestamp)
+{
+	char representation[CW_REC_REPRESENTATION_CAPACITY + 1] = { 0 };
+	bool is_end_of_word = false;
+	bool is_error = false;
+	const cw_ret_t cwret = cw_rec_poll_representation_ns(data->rec, timestamp, representation, &is_end_of_word, &is_error);
+
+	bool is_end_of_word_compact = false;
+	bool is_error_compact = false;
+	const cw_ret_t cwret_compact = cw_rec_compact_poll_internal(&data->crec, data->params, timestamp, &is_end_of_word_compact, &is_error_compact);
+
+	if (cwret != cwret_compact) {
+		data->n_mismatches++;
+		return;
+	}
+	if (CW_SUCCESS != cwret) {
+		return;
+	}
+	if (is_end_of_word != is_end_of_word_compact || is_error != is_error_compact) {
+		data->n_mismatches++;
+	}
+
+	const int character = cw_representation_to_character_internal(representation);
+	const int character_compact = cw_representation_hash_to_character_internal(data->crec.representation_hash);
+	size_t len = strlen(data->received);
+	if (len < sizeof (data->received) - 1) {
+		data->received[len] = 0 == character ? '?' : (char) character;
+	}
+	len = strlen(data->received_compact);
+	if (len < sizeof (data->received_compact) - 1) {
+		data->received_compact[len] = 0 == character_compact ? '?' : (char) character_compact;
+	}
+
+	cw_rec_reset_state(data->rec);
+	cw_rec_compact_reset_state_internal(&data->crec);
+
+	return;
+}
+
+
+
+
+/* Pass @p text, keyed at speeds from @p speeds (one per character),
+   to both receivers. */
+static void test_cw_rec_compact_key(test_cw_rec_compact_data_t * data, const char * text, const int * speeds)
+{
+	int64_t timestamp = 1000 * (int64_t) CW_NSECS_PER_SEC; /* [ns] */
+
+	for (size_t i = 0; '\0' != text[i]; i++) {
+		if (' ' == text[i]) {
+			continue;
+		}
+		const int64_t unit = (int64_t) (CW_DOT_CALIBRATION / speeds[i]) * 1000; /* [ns] */
+		const char * representation = cw_character_to_representation_internal(text[i]);
+
+		for (size_t m = 0; '\0' != representation[m]; m++) {
+			const int64_t duration = CW_DOT_REPRESENTATION == representation[m] ? unit : 3 * unit;
+			const cw_ret_t begin = cw_rec_mark_begin_ns(data->rec, timestamp);
+			const cw_ret_t begin_compact = cw_rec_compact_mark_begin_internal(&data->crec, timestamp);
+			timestamp += duration;
+			const cw_ret_t end = cw_rec_mark_end_ns(data->rec, timestamp);
+			const cw_ret_t end_compact = cw_rec_compact_mark_end_internal(&data->crec, data->params, timestamp);
+			if (begin != begin_compact || end != end_compact) {
+				data->n_mismatches++;
+			}
+			if ((int) (cw_rec_get_speed(data->rec) * 1000) != (int) (cw_rec_compact_get_speed_internal(&data->crec, data->params) * 1000)) {
+				data->n_mismatches++;
+			}
+
+			/* Poll during Space, like a client would do. */
+			const bool is_last = '\0' == representation[m + 1];
+			const int64_t space = is_last ? (' ' == text[i + 1] ? 7 : 3) * unit : unit;
+			for (int64_t t = unit / 2; t < space; t += unit / 2) {
+				test_cw_rec_compact_poll(data, timestamp + t);
+			}
+			timestamp += space;
+		}
+	}
+	test_cw_rec_compact_poll(data, timestamp + 100 * (int64_t) CW_NSECS_PER_SEC);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Test compact receiver
+
+   Pass the same Marks to regular receiver and to compact receiver, and
+   check that both receivers identify Marks and Spaces in the same way,
+   track the same speed and receive the same characters.
+*/
+int test_cw_rec_compact(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cte->expect_op_int(cte, 64, ">=", (int) sizeof (cw_rec_compact_t), "%s: size of compact receiver", __func__);
+
+	const char * text = "PARIS CQ DE SP5ABC TEST 73 SOS";
+	int speeds[32] = { 0 };
+
+
+	/* Adaptive mode, speed going up and down. */
+	{
+		for (size_t i = 0; i < strlen(text); i++) {
+			speeds[i] = i < 15 ? 12 + (int) i : 26 - (int) (i - 15);
+		}
+
+		cw_rec_t * params = cw_rec_new();
+		cw_rec_enable_adaptive_mode(params);
+		test_cw_rec_compact_data_t data = { .rec = cw_rec_new(), .params = params };
+		cw_rec_enable_adaptive_mode(data.rec);
+		cw_rec_compact_init_internal(&data.crec, params);
+
+		test_cw_rec_compact_key(&data, text, speeds);
+		cte->expect_op_int(cte, 0, "==", data.n_mismatches, "%s: adaptive: mismatches between receivers", __func__);
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, data.received_compact), "%s: adaptive: received text: '%s' / '%s'", __func__, data.received, data.received_compact);
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, "PARISCQDESP5ABCTEST73SOS"), "%s: adaptive: received text: '%s'", __func__, data.received);
+
+		cw_rec_delete(&data.rec);
+		cw_rec_delete(&params);
+	}
+
+
+	/* Fixed speed mode, with part of text keyed too slowly. */
+	{
+		for (size_t i = 0; i < strlen(text); i++) {
+			speeds[i] = (i >= 6 && i < 10) ? 10 : 20;
+		}
+
+		cw_rec_t * params = cw_rec_new();
+		cw_rec_set_speed(params, 20);
+		test_cw_rec_compact_data_t data = { .rec = cw_rec_new(), .params = params };
+		cw_rec_set_speed(data.rec, 20);
+		cw_rec_compact_init_internal(&data.crec, params);
+
+		test_cw_rec_compact_key(&data, text, speeds);
+		cte->expect_op_int(cte, 0, "==", data.n_mismatches, "%s: fixed: mismatches between receivers", __func__);
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, data.received_compact), "%s: fixed: received text: '%s' / '%s'", __func__, data.received, data.received_compact);
+		/* Characters keyed too slowly are received as errors. */
+		cte->expect_op_int(cte, true, "==", 0 == strncmp(data.received, "PARIS?", 6) && NULL != strstr(data.received, "?ESP5ABCTEST73SOS"), "%s: fixed: received text: '%s'", __func__, data.received);
+
+		cw_rec_delete(&data.rec);
+		cw_rec_delete(&params);
+	}
+
+
+	/* Noise spike, unexpected events, too long representation. */
+	{
+		cw_rec_t * params = cw_rec_new();
+		cw_rec_compact_t crec;
+		cw_rec_compact_init_internal(&crec, params);
+		const int64_t t = 5 * (int64_t) CW_NSECS_PER_SEC;
+
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_compact_mark_end_internal)(&crec, params, t), "%s: end of mark in idle state", __func__);
+		cte->expect_op_int(cte, ERANGE, "==", errno, "%s: end of mark in idle state (errno)", __func__);
+
+		cw_rec_compact_mark_begin_internal(&crec, t);
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", cw_rec_compact_mark_end_internal(&crec, params, t + 1000 * (int64_t) cw_rec_get_noise_spike_threshold(params)), "%s: noise spike", __func__);
+		cte->expect_op_int(cte, EAGAIN, "==", errno, "%s: noise spike (errno)", __func__);
+		cte->expect_op_int(cte, RS_IDLE, "==", crec.state, "%s: state after noise spike", __func__);
+
+		const int64_t dot = (int64_t) (CW_DOT_CALIBRATION / CW_SPEED_INITIAL) * 1000;
+		int64_t timestamp = t;
+		for (int i = 0; i < CW_DATA_MAX_REPRESENTATION_LENGTH + 1; i++) {
+			cw_rec_compact_mark_begin_internal(&crec, timestamp);
+			cw_rec_compact_mark_end_internal(&crec, params, timestamp + dot);
+			timestamp += 2 * dot;
+		}
+		bool is_end_of_word = false;
+		bool is_error = true;
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_compact_poll_internal)(&crec, params, timestamp + 3 * dot, &is_end_of_word, &is_error), "%s: poll long representation", __func__);
+		cte->expect_op_int(cte, false, "==", is_error, "%s: long representation: error flag", __func__);
+		cte->expect_op_int(cte, 0, "==", crec.representation_hash, "%s: long representation: hash", __func__);
+
+		cw_rec_delete(&params);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test acquisition of speed by adaptive receivers
+
+   Regular and compact receivers in adaptive mode start at
+   CW_SPEED_INITIAL and receive text keyed at much higher speed. The
+   speed should be acquired from first Marks of first character, so
+   that all characters, including the first one, are received
+   correctly.
+*/
+int test_cw_rec_adaptive_acquisition(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * text = "PARIS CQ DE SP5ABC";
+	const int station_speeds[] = { 35, 50 };
+	int speeds[32] = { 0 };
+
+	for (size_t s = 0; s < sizeof (station_speeds) / sizeof (station_speeds[0]); s++) {
+		for (size_t i = 0; i < strlen(text); i++) {
+			speeds[i] = station_speeds[s];
+		}
+
+		cw_rec_t * params = cw_rec_new();
+		cw_rec_enable_adaptive_mode(params);
+		test_cw_rec_compact_data_t data = { .rec = cw_rec_new(), .params = params };
+		cw_rec_enable_adaptive_mode(data.rec);
+		cw_rec_compact_init_internal(&data.crec, params);
+		cte->expect_op_int(cte, CW_SPEED_INITIAL, "==", (int) cw_rec_get_speed(data.rec), "%s: %d WPM: initial speed", __func__, station_speeds[s]);
+
+		test_cw_rec_compact_key(&data, text, speeds);
+		cte->expect_op_int(cte, 0, "==", data.n_mismatches, "%s: %d WPM: mismatches between receivers", __func__, station_speeds[s]);
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, "PARISCQDESP5ABC"), "%s: %d WPM: received text: '%s'", __func__, station_speeds[s], data.received);
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, data.received_compact), "%s: %d WPM: received text: '%s' / '%s'", __func__, station_speeds[s], data.received, data.received_compact);
+		cte->expect_op_int(cte, true, "==", fabsf(cw_rec_get_speed(data.rec) - (float) station_speeds[s]) < 1.0F, "%s: %d WPM: acquired speed: %f", __func__, station_speeds[s], (double) cw_rec_get_speed(data.rec));
+
+		cw_rec_delete(&data.rec);
+		cw_rec_delete(&params);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Key @p text at @p speed into @p rec, starting at @p timestamp,
+   polling the receiver at the beginning of each Mark and at the end.
+   Received characters are appended to @p received. Return timestamp
+   of end of the text. */
+static int64_t test_cw_rec_snapshot_key(cw_rec_t * rec, const char * text, int speed, int64_t timestamp, char * received, size_t size)
+{
+	const int64_t unit = (int64_t) (CW_DOT_CALIBRATION / speed) * 1000; /* [ns] */
+
+	for (size_t i = 0; '\0' != text[i]; i++) {
+		if (' ' == text[i]) {
+			timestamp += 4 * unit;
+			continue;
+		}
+		const char * representation = cw_character_to_representation_internal(text[i]);
+		for (size_t m = 0; '\0' != representation[m]; m++) {
+			char character = 0;
+			if (CW_SUCCESS == cw_rec_poll_character_ns(rec, timestamp, &character, NULL, NULL)) {
+				const size_t len = strlen(received);
+				if (len < size - 1) {
+					received[len] = character;
+				}
+				cw_rec_reset_state(rec);
+			}
+			cw_rec_mark_begin_ns(rec, timestamp);
+			timestamp += CW_DOT_REPRESENTATION == representation[m] ? unit : 3 * unit;
+			cw_rec_mark_end_ns(rec, timestamp);
+			timestamp += unit;
+		}
+		timestamp += 2 * unit;
+	}
+
+	return timestamp;
+}
+
+
+
+
+/**
+   @brief Test saving and restoring state of receiver
+
+   Receiver adapts to a fast signal, its state is saved in the middle
+   of a character and restored into a new receiver. Both receivers
+   must then receive the rest of the text in the same way, without
+   re-adapting.
+*/
+int test_cw_rec_snapshot(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int speed = 35;
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create receiver", __func__);
+	cw_rec_set_speed(rec, 30);
+	cw_rec_enable_adaptive_mode(rec);
+	cw_rec_set_tolerance(rec, 40);
+
+	char received[32] = { 0 };
+	int64_t timestamp = test_cw_rec_snapshot_key(rec, "PARIS PARIS", speed, 1000 * (int64_t) CW_NSECS_PER_SEC, received, sizeof (received));
+	cte->expect_op_int(cte, 0, "==", strcmp(received, "PARISPARI"), "%s: received before snapshot: '%s'", __func__, received);
+
+	/* Two Marks of 'Q'. */
+	const int64_t unit = (int64_t) (CW_DOT_CALIBRATION / speed) * 1000;
+	char character = 0;
+	cw_rec_poll_character_ns(rec, timestamp, &character, NULL, NULL);
+	cw_rec_reset_state(rec);
+	for (int i = 0; i < 2; i++) {
+		cw_rec_mark_begin_ns(rec, timestamp);
+		timestamp += 3 * unit;
+		cw_rec_mark_end_ns(rec, timestamp);
+		timestamp += unit;
+	}
+
+
+	uint8_t buffer[CW_REC_SNAPSHOT_SIZE_MAX];
+	size_t n_bytes = 0;
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_snapshot)(rec, buffer, 100, &n_bytes), "%s: snapshot to small buffer", __func__);
+	cte->expect_op_int(cte, ENOSPC, "==", errno, "%s: snapshot to small buffer (errno)", __func__);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_snapshot)(rec, buffer, sizeof (buffer), &n_bytes), "%s: snapshot", __func__);
+
+	cw_rec_t * restored = cw_rec_new();
+	cte->assert2(cte, restored, "%s: failed to create receiver", __func__);
+
+	/* Invalid snapshots don't change receiver. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_restore)(restored, buffer, n_bytes - 1), "%s: restore truncated snapshot", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: restore truncated snapshot (errno)", __func__);
+	buffer[0] ^= 0xff;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_restore)(restored, buffer, n_bytes), "%s: restore corrupted snapshot", __func__);
+	buffer[0] ^= 0xff;
+	cte->expect_op_int(cte, false, "==", cw_rec_get_adaptive_mode(restored), "%s: receiver not modified by invalid snapshot", __func__);
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_restore)(restored, buffer, n_bytes), "%s: restore", __func__);
+	cte->expect_op_int(cte, true, "==", cw_rec_get_adaptive_mode(restored), "%s: restored adaptive mode", __func__);
+	cte->expect_op_int(cte, 40, "==", cw_rec_get_tolerance(restored), "%s: restored tolerance", __func__);
+	cte->expect_op_int(cte, (int) (cw_rec_get_speed(rec) * 1000), "==", (int) (cw_rec_get_speed(restored) * 1000), "%s: restored speed", __func__);
+
+	float sd[2][4] = { { 0 } };
+	cw_rec_get_statistics_internal(rec, &sd[0][0], &sd[0][1], &sd[0][2], &sd[0][3]);
+	cw_rec_get_statistics_internal(restored, &sd[1][0], &sd[1][1], &sd[1][2], &sd[1][3]);
+	for (int i = 0; i < 4; i++) {
+		cte->expect_op_int(cte, (int) sd[0][i], "==", (int) sd[1][i], "%s: restored statistics #%d", __func__, i);
+	}
+
+	/* Rest of 'Q' and more text, in both receivers. */
+	char received_original[32] = { 0 };
+	char received_restored[32] = { 0 };
+	char rest[2][8] = { { 0 } };
+	cw_rec_t * recs[2] = { rec, restored };
+	for (int r = 0; r < 2; r++) {
+		int64_t t = timestamp;
+		cw_rec_mark_begin_ns(recs[r], t);
+		t += unit;
+		cw_rec_mark_end_ns(recs[r], t);
+		t += unit;
+		cw_rec_mark_begin_ns(recs[r], t);
+		t += 3 * unit;
+		cw_rec_mark_end_ns(recs[r], t);
+		cw_rec_poll_character_ns(recs[r], t + 3 * unit, &rest[r][0], NULL, NULL);
+		cw_rec_reset_state(recs[r]);
+		test_cw_rec_snapshot_key(recs[r], " CQ TEST", speed, t + 7 * unit, 0 == r ? received_original : received_restored, sizeof (received_original));
+	}
+	cte->expect_op_int(cte, 'Q', "==", rest[1][0], "%s: character split by snapshot: '%c'", __func__, rest[1][0]);
+	cte->expect_op_int(cte, rest[0][0], "==", rest[1][0], "%s: character split by snapshot, both receivers", __func__);
+	cte->expect_op_int(cte, 0, "==", strcmp(received_original, received_restored), "%s: received after restore: '%s' / '%s'", __func__, received_original, received_restored);
+	cte->expect_op_int(cte, 0, "==", strcmp(received_restored, "CQTES"), "%s: received after restore: '%s'", __func__, received_restored);
+
+	cw_rec_delete(&restored);
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test getting all characters received as of given time
+
+   Key two words without polling the receiver between characters, and
+   get the characters with few calls to cw_rec_poll_characters_ns().
+*/
+int test_cw_rec_poll_characters(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create receiver", __func__);
+	const int speed = 20;
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+
+	cw_rec_output_t outputs[CW_REC_DRAINED_CAPACITY];
+	size_t n_outputs = 1;
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_poll_characters_ns)(rec, 0, outputs, 4, NULL), "%s: NULL count", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: NULL count (errno)", __func__);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_poll_characters_ns)(rec, 0, NULL, 4, &n_outputs), "%s: NULL outputs", __func__);
+
+	/* Empty receiver. */
+	int64_t timestamp = 1000 * (int64_t) CW_NSECS_PER_SEC;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_poll_characters_ns)(rec, timestamp, outputs, 4, &n_outputs), "%s: empty receiver", __func__);
+	cte->expect_op_int(cte, 0, "==", (int) n_outputs, "%s: empty receiver (count)", __func__);
+
+	const int64_t unit = (int64_t) (CW_DOT_CALIBRATION / speed) * 1000; /* [ns] */
+	const char * text = "PARIS PARIS";
+	int64_t last_mark_end = 0;
+	for (size_t i = 0; '\0' != text[i]; i++) {
+		if (' ' == text[i]) {
+			timestamp += 4 * unit;
+			continue;
+		}
+		const char * representation = cw_character_to_representation_internal(text[i]);
+		for (size_t m = 0; '\0' != representation[m]; m++) {
+			cte->expect_op_int(cte, CW_SUCCESS, "==", cw_rec_mark_begin_ns(rec, timestamp), "%s: mark begin in '%c'", __func__, text[i]);
+			timestamp += CW_DOT_REPRESENTATION == representation[m] ? unit : 3 * unit;
+			cw_rec_mark_end_ns(rec, timestamp);
+			last_mark_end = timestamp;
+			timestamp += unit;
+		}
+		timestamp += 2 * unit;
+	}
+
+	/* Right after last inter-character-space, the last character is
+	   already final, inter-word-space isn't. Get characters in
+	   portions smaller than the text. */
+	char received[32] = { 0 };
+	size_t len = 0;
+	for (int i = 0; i < 10; i++) {
+		cw_rec_poll_characters_ns(rec, timestamp, outputs, 3, &n_outputs);
+		for (size_t o = 0; o < n_outputs && len < sizeof (received) - 1; o++) {
+			received[len++] = outputs[o].character;
+		}
+	}
+	cte->expect_op_int(cte, 0, "==", strcmp(received, "PARIS PARIS"), "%s: received: '%s'", __func__, received);
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_poll_characters_ns)(rec, timestamp + 10 * unit, outputs, CW_REC_DRAINED_CAPACITY, &n_outputs), "%s: inter-word-space", __func__);
+	cte->expect_op_int(cte, 1, "==", (int) n_outputs, "%s: inter-word-space (count)", __func__);
+	cte->expect_op_int(cte, ' ', "==", outputs[0].character, "%s: inter-word-space (character)", __func__);
+	cte->expect_op_int(cte, false, "==", outputs[0].is_error, "%s: inter-word-space (error)", __func__);
+	cte->expect_op_int(cte, 0, "==", (int) ((last_mark_end - outputs[0].timestamp) / 1000), "%s: inter-word-space (timestamp)", __func__);
+
+	/* Each Space is reported only once. */
+	cw_rec_poll_characters_ns(rec, timestamp + 100 * unit, outputs, CW_REC_DRAINED_CAPACITY, &n_outputs);
+	cte->expect_op_int(cte, 0, "==", (int) n_outputs, "%s: nothing more to receive", __func__);
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test tone detector feeding a receiver
+
+   Synthesize "PARIS" at 20 WPM as a noisy 700 Hz tone sampled at 48 kHz,
+   pass the sound to detector in 10 ms chunks, and poll the receiver for
+   characters. Check also that the detector is cheap enough to run in
+   real time.
+*/
+int test_cw_detector(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 48000;
+	const int frequency = 700;
+	const int dot_n_samples = sample_rate * 60 / 1000; /* 60 ms: dot at 20 WPM. */
+	const char * representations[] = { ".--.", ".-", ".-.", "..", "...", NULL };
+
+	/* Upper bound on length of the sound. */
+	const size_t capacity = (size_t) dot_n_samples * 130;
+	int16_t * samples = (int16_t *) calloc(capacity, sizeof (int16_t));
+	cte->assert2(cte, samples, "%s: failed to allocate samples", __func__);
+
+	/* Sound starts with a space: leading noise. */
+	uint32_t noise = 12345;
+	size_t n_samples = 0;
+	for (int i = 0; i < dot_n_samples * 10; i++) {
+		noise = noise * 1103515245 + 12345;
+		samples[n_samples++] = (int16_t) ((int) ((noise >> 16) & 0x7ff) - 0x400);
+	}
+
+	double phase = 0.0;
+	for (int c = 0; representations[c]; c++) {
+		for (const char * mark = representations[c]; *mark; mark++) {
+			const int mark_n_samples = dot_n_samples * (CW_DOT_REPRESENTATION == *mark ? 1 : 3);
+			const int space_n_samples = dot_n_samples * (*(mark + 1) ? 1 : 3);
+			for (int i = 0; i < mark_n_samples + space_n_samples; i++) {
+				noise = noise * 1103515245 + 12345;
+				double sample = ((int) ((noise >> 16) & 0x7ff) - 0x400); /* Noise, +/-1024. */
+				if (i < mark_n_samples) {
+					sample += 8000.0 * sin(phase);
+				}
+				phase += 2.0 * M_PI * frequency / sample_rate;
+				samples[n_samples++] = (int16_t) sample;
+			}
+		}
+	}
+	n_samples += (size_t) dot_n_samples * 7; /* Trailing silence. */
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, 20);
+
+	cw_detector_t * detector = LIBCW_TEST_FUT(cw_detector_new)(sample_rate, frequency, rec);
+	cte->assert2(cte, detector, "%s: failed to create new detector", __func__);
+
+	char received[16] = { 0 };
+	size_t n_received = 0;
+	bool process_failure = false;
+	const size_t chunk = (size_t) sample_rate / 100;
+	for (size_t i = 0; i < n_samples; i += chunk) {
+		const size_t n = i + chunk <= n_samples ? chunk : n_samples - i;
+		/* Timestamp is given only once, detector continues its own
+		   timeline afterwards. */
+		const int64_t timestamp = 0 == i ? (int64_t) 1000 * 1000 * 1000 : -1;
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_detector_process)(detector, samples + i, n, timestamp)) {
+			process_failure = true;
+			break;
+		}
+
+		char character = 0;
+		bool is_end_of_word = false;
+		bool is_error = false;
+		if (CW_SUCCESS == cw_rec_poll_character_ns(rec, LIBCW_TEST_FUT(cw_detector_get_timestamp)(detector), &character, &is_end_of_word, &is_error)) {
+			if (n_received < sizeof (received) - 1) {
+				received[n_received++] = character;
+			}
+			cw_rec_reset_state(rec);
+		}
+	}
+	cte->expect_op_int(cte, false, "==", process_failure, "%s: process samples", __func__);
+	cte->expect_op_int(cte, 0, "==", strcmp(received, "PARIS"), "%s: received text: '%s'", __func__, received);
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_detector_new)(sample_rate, sample_rate / 2, rec), "%s: frequency above Nyquist", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: frequency above Nyquist (errno)", __func__);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_detector_set_thresholds)(detector, 40, 60), "%s: inverted thresholds", __func__);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_detector_set_block_duration)(detector, 0), "%s: zero block duration", __func__);
+
+	/* Cost: 60 seconds of sound must be processed in much less
+	   than 1% of 60 seconds. The cost doesn't depend on contents of
+	   sound, so use just noise to keep the receiver quiet. */
+	cw_detector_reset(detector);
+	cw_rec_reset_state(rec);
+	for (size_t i = 0; i < (size_t) sample_rate; i++) {
+		noise = noise * 1103515245 + 12345;
+		samples[i] = (int16_t) ((int) ((noise >> 16) & 0x7ff) - 0x400);
+	}
+	struct timespec begin = { 0 };
+	struct timespec end = { 0 };
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
+	const int n_seconds = 60;
+	for (int second = 0; second < n_seconds; second++) {
+		for (size_t i = 0; i + chunk <= (size_t) sample_rate; i += chunk) {
+			cw_detector_process(detector, samples + i, chunk, -1);
+		}
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+	const int64_t cpu_usecs = (end.tv_sec - begin.tv_sec) * CW_USECS_PER_SEC + (end.tv_nsec - begin.tv_nsec) / 1000;
+	cte->expect_op_int(cte, n_seconds * CW_USECS_PER_SEC / 100, ">", (int) cpu_usecs, "%s: CPU time of %d s of sound: %d us", __func__, n_seconds, (int) cpu_usecs);
+
+	LIBCW_TEST_FUT(cw_detector_delete)(&detector);
+	cte->expect_op_int(cte, true, "==", NULL == detector, "%s: delete", __func__);
+	cw_rec_delete(&rec);
+	free(samples);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test automatic frequency control of tone detector
+
+   Synthesize "PARIS" at 20 WPM as a noisy tone that starts 100 Hz above
+   detector's frequency and drifts further up by 10 Hz per second.
+   Detector with AFC must decode the text and report the pitch of the
+   tone.
+*/
+int test_cw_detector_afc(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 48000;
+	const int frequency = 700;
+	const double start_frequency = 800.0;
+	const double drift = 10.0; /* [Hz/s] */
+	const int dot_n_samples = sample_rate * 60 / 1000; /* 60 ms: dot at 20 WPM. */
+	const char * representations[] = { ".--.", ".-", ".-.", "..", "...", NULL };
+
+	const size_t capacity = (size_t) dot_n_samples * 130;
+	int16_t * samples = (int16_t *) calloc(capacity, sizeof (int16_t));
+	cte->assert2(cte, samples, "%s: failed to allocate samples", __func__);
+
+	/* Leading noise, then the text, then trailing silence. Tone
+	   frequency drifts linearly over whole sound. */
+	uint32_t noise = 12345;
+	size_t n_samples = 0;
+	for (int i = 0; i < dot_n_samples * 10; i++) {
+		noise = noise * 1103515245 + 12345;
+		samples[n_samples++] = (int16_t) ((int) ((noise >> 16) & 0x7ff) - 0x400);
+	}
+	double phase = 0.0;
+	for (int c = 0; representations[c]; c++) {
+		for (const char * mark = representations[c]; *mark; mark++) {
+			const int mark_n_samples = dot_n_samples * (CW_DOT_REPRESENTATION == *mark ? 1 : 3);
+			const int space_n_samples = dot_n_samples * (*(mark + 1) ? 1 : 3);
+			for (int i = 0; i < mark_n_samples + space_n_samples; i++) {
+				noise = noise * 1103515245 + 12345;
+				double sample = ((int) ((noise >> 16) & 0x7ff) - 0x400); /* Noise, +/-1024. */
+				if (i < mark_n_samples) {
+					sample += 8000.0 * sin(phase);
+				}
+				const double tone_frequency = start_frequency + drift * (double) n_samples / sample_rate;
+				phase += 2.0 * M_PI * tone_frequency / sample_rate;
+				samples[n_samples++] = (int16_t) sample;
+			}
+		}
+	}
+	const double end_frequency = start_frequency + drift * (double) n_samples / sample_rate;
+	n_samples += (size_t) dot_n_samples * 7;
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, 20);
+
+	cw_detector_t * detector = cw_detector_new(sample_rate, frequency, rec);
+	cte->assert2(cte, detector, "%s: failed to create new detector", __func__);
+	cte->expect_op_int(cte, frequency, "==", LIBCW_TEST_FUT(cw_detector_get_frequency)(detector), "%s: initial frequency", __func__);
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_detector_set_afc_range)(detector, 200);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: set AFC range", __func__);
+
+	char received[16] = { 0 };
+	int pitches[16] = { 0 };
+	size_t n_received = 0;
+	const size_t chunk = (size_t) sample_rate / 100;
+	for (size_t i = 0; i < n_samples; i += chunk) {
+		const size_t n = i + chunk <= n_samples ? chunk : n_samples - i;
+		cw_detector_process(detector, samples + i, n, 0 == i ? (int64_t) 1000 * 1000 * 1000 : -1);
+
+		char character = 0;
+		bool is_end_of_word = false;
+		bool is_error = false;
+		if (CW_SUCCESS == cw_rec_poll_character_ns(rec, cw_detector_get_timestamp(detector), &character, &is_end_of_word, &is_error)) {
+			if (n_received < sizeof (received) - 1) {
+				pitches[n_received] = LIBCW_TEST_FUT(cw_detector_get_frequency)(detector);
+				received[n_received++] = character;
+			}
+			cw_rec_reset_state(rec);
+		}
+	}
+	cte->expect_op_int(cte, 0, "==", strcmp(received, "PARIS"), "%s: received text: '%s'", __func__, received);
+	const int last_pitch = n_received > 0 ? pitches[n_received - 1] : 0;
+	cte->expect_between_int(cte, (int) end_frequency - 20, last_pitch, (int) end_frequency + 20, "%s: pitch of last character: %d Hz", __func__, last_pitch);
+
+	/* Reset brings detector back to its frequency. */
+	cw_detector_reset(detector);
+	cte->expect_op_int(cte, frequency, "==", cw_detector_get_frequency(detector), "%s: frequency after reset", __func__);
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_detector_set_afc_range)(detector, -1), "%s: negative range", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: negative range (errno)", __func__);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_detector_set_afc_range)(detector, frequency), "%s: range reaching 0 Hz", __func__);
+
+	/* Cost: AFC adds only a fraction of cost of detector. 60 seconds
+	   of sound must still be processed in much less than 1% of 60
+	   seconds. */
+	cw_detector_reset(detector);
+	cw_rec_reset_state(rec);
+	for (size_t i = 0; i < (size_t) sample_rate; i++) {
+		noise = noise * 1103515245 + 12345;
+		samples[i] = (int16_t) ((int) ((noise >> 16) & 0x7ff) - 0x400);
+	}
+	struct timespec begin = { 0 };
+	struct timespec end = { 0 };
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
+	const int n_seconds = 60;
+	for (int second = 0; second < n_seconds; second++) {
+		for (size_t i = 0; i + chunk <= (size_t) sample_rate; i += chunk) {
+			cw_detector_process(detector, samples + i, chunk, -1);
+		}
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+	const int64_t cpu_usecs = (end.tv_sec - begin.tv_sec) * CW_USECS_PER_SEC + (end.tv_nsec - begin.tv_nsec) / 1000;
+	cte->expect_op_int(cte, n_seconds * CW_USECS_PER_SEC / 100, ">", (int) cpu_usecs, "%s: CPU time of %d s of sound: %d us", __func__, n_seconds, (int) cpu_usecs);
+
+	cw_detector_delete(&detector);
+	cw_rec_delete(&rec);
+	free(samples);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Add to @p sound a signal keyed with Morse code of @p text.
+
+   If @p sound_q is not NULL, the signal is complex: its in-phase
+   component is added to @p sound and quadrature component to
+   @p sound_q. @p frequency may then be negative.
+
+   @return position (in samples) of end of the signal
+*/
+static size_t test_cw_skimmer_add_signal(float * sound, float * sound_q, size_t capacity, size_t position, int sample_rate, int frequency, float amplitude, int speed, const char * text)
+{
+	const size_t dot = (size_t) ((int64_t) sample_rate * CW_DOT_CALIBRATION / speed / CW_USECS_PER_SEC);
+	const double step = 2.0 * M_PI * frequency / sample_rate;
+	const size_t ramp = (size_t) sample_rate / 200; /* 5 ms */
+
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			position += 4 * dot; /* 3 dots of inter-character-space are already there. */
+			continue;
+		}
+		const char * representation = cw_character_to_representation_internal(*c);
+		for (const char * mark = representation; mark && *mark; mark++) {
+			const size_t mark_len = (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * dot;
+			for (size_t i = 0; i < mark_len && position + i < capacity; i++) {
+				/* Raised-cosine edges, as in a real transmitter. */
+				const size_t from_edge = i < mark_len - i ? i : mark_len - i;
+				const double shape = from_edge < ramp ? 0.5 - 0.5 * cos(M_PI * (double) from_edge / (double) ramp) : 1.0;
+				if (sound_q) {
+					sound[position + i] += amplitude * (float) (shape * cos(step * (double) (position + i)));
+					sound_q[position + i] += amplitude * (float) (shape * sin(step * (double) (position + i)));
+				} else {
+					sound[position + i] += amplitude * (float) (shape * sin(step * (double) (position + i)));
+				}
+			}
+			position += mark_len + dot;
+		}
+		position += 2 * dot;
+	}
+
+	return position;
+}
+
+
+
+
+/**
+   Convert float sound to samples, with added noise.
+*/
+static void test_cw_skimmer_to_samples(const float * sound, int16_t * samples, size_t n_samples, int noise_amplitude)
+{
+	uint32_t noise = 4321;
+	for (size_t i = 0; i < n_samples; i++) {
+		noise = noise * 1103515245 + 12345;
+		float sample = sound[i] + (float) ((int) ((noise >> 16) % (uint32_t) (2 * noise_amplitude + 1)) - noise_amplitude);
+		if (sample > 32767.0f) {
+			sample = 32767.0f;
+		} else if (sample < -32768.0f) {
+			sample = -32768.0f;
+		}
+		samples[i] = (int16_t) sample;
+	}
+}
+
+
+
+
+/**
+   @brief Test skimmer decoding several signals at once
+
+   Three signals with different frequencies, speeds and texts in 3 kHz
+   passband. Each signal must be decoded by its own channel.
+*/
+int test_cw_skimmer(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 8000;
+	const size_t n_samples = (size_t) sample_rate * 12;
+	float * sound = (float *) calloc(n_samples, sizeof (float));
+	int16_t * samples = (int16_t *) calloc(n_samples, sizeof (int16_t));
+	cte->assert2(cte, sound && samples, "%s: failed to allocate sound", __func__);
+
+	struct {
+		int frequency;
+		int speed;
+		const char * text;
+		size_t start;
+		char received[64];
+	} signals[] = {
+		{  600, 12, "PARIS PARIS",  (size_t) sample_rate / 2,     { 0 } },
+		{ 1100, 14, "CQ CQ DE SP5", (size_t) sample_rate * 3 / 4, { 0 } },
+		{ 1900, 16, "TEST TEST",    (size_t) sample_rate,         { 0 } },
+	};
+	const int n_signals = (int) (sizeof (signals) / sizeof (signals[0]));
+	for (int i = 0; i < n_signals; i++) {
+		test_cw_skimmer_add_signal(sound, NULL, n_samples, signals[i].start, sample_rate, signals[i].frequency, 4000.0f, signals[i].speed, signals[i].text);
+	}
+	test_cw_skimmer_to_samples(sound, samples, n_samples, 512);
+
+	cw_skimmer_t * skimmer = LIBCW_TEST_FUT(cw_skimmer_new)(sample_rate, 300, 2700, 2);
+	cte->assert2(cte, skimmer, "%s: failed to create new skimmer", __func__);
+
+	bool process_failure = false;
+	int max_channels = 0;
+	const size_t chunk = (size_t) sample_rate / 50;
+	for (size_t i = 0; i + chunk <= n_samples; i += chunk) {
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + i, chunk, -1)) {
+			process_failure = true;
+			break;
+		}
+		const int n_channels = LIBCW_TEST_FUT(cw_skimmer_get_n_channels)(skimmer);
+		if (n_channels > max_channels) {
+			max_channels = n_channels;
+		}
+
+		cw_skimmer_event_t events[16];
+		const int n_events = LIBCW_TEST_FUT(cw_skimmer_get_events)(skimmer, events, 16);
+		for (int e = 0; e < n_events; e++) {
+			for (int s = 0; s < n_signals; s++) {
+				if (abs(events[e].frequency - signals[s].frequency) <= 40) {
+					const size_t len = strlen(signals[s].received);
+					if (len < sizeof (signals[s].received) - 1) {
+						signals[s].received[len] = events[e].character;
+					}
+				}
+			}
+		}
+	}
+	cte->expect_op_int(cte, false, "==", process_failure, "%s: process samples", __func__);
+	cte->expect_op_int(cte, n_signals, "==", max_channels, "%s: count of channels", __func__);
+	for (int s = 0; s < n_signals; s++) {
+		cte->expect_op_int(cte, true, "==", NULL != strstr(signals[s].received, signals[s].text),
+				   "%s: signal at %d Hz: '%s'", __func__, signals[s].frequency, signals[s].received);
+	}
+
+	errno = 0;
+	cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_skimmer_new)(sample_rate, 2700, 300, 2), "%s: inverted passband", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: inverted passband (errno)", __func__);
+
+	LIBCW_TEST_FUT(cw_skimmer_delete)(&skimmer);
+	cte->expect_op_int(cte, true, "==", NULL == skimmer, "%s: delete", __func__);
+	free(samples);
+	free(sound);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test skimmer with more than a hundred signals
+
+   120 signals in 48 kHz sound, each repeating "T". All of them must be
+   decoded, faster than real time.
+*/
+int test_cw_skimmer_many_signals(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 48000;
+	const int n_signals = 120;
+	const int n_seconds = 4;
+	const size_t n_samples = (size_t) sample_rate * (size_t) n_seconds;
+	float * sound = (float *) calloc(n_samples, sizeof (float));
+	int16_t * samples = (int16_t *) calloc(n_samples, sizeof (int16_t));
+	cte->assert2(cte, sound && samples, "%s: failed to allocate sound", __func__);
+
+	for (int s = 0; s < n_signals; s++) {
+		/* Staggered starts, so that signals don't key in sync. */
+		size_t position = (size_t) sample_rate / 4 + (size_t) s * (size_t) sample_rate / 200;
+		while (position < n_samples - (size_t) sample_rate) {
+			position = test_cw_skimmer_add_signal(sound, NULL, n_samples, position, sample_rate, 1000 + s * 150, 200.0f, 12, "T ");
+		}
+	}
+	test_cw_skimmer_to_samples(sound, samples, n_samples, 64);
+
+	cw_skimmer_t * skimmer = LIBCW_TEST_FUT(cw_skimmer_new)(sample_rate, 500, 20000, 4);
+	cte->assert2(cte, skimmer, "%s: failed to create new skimmer", __func__);
+
+	bool decoded[120] = { false };
+	int max_channels = 0;
+
+	struct timespec begin = { 0 };
+	struct timespec end = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	const size_t chunk = (size_t) sample_rate / 50;
+	for (size_t i = 0; i + chunk <= n_samples; i += chunk) {
+		LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + i, chunk, -1);
+		const int n_channels = cw_skimmer_get_n_channels(skimmer);
+		if (n_channels > max_channels) {
+			max_channels = n_channels;
+		}
+		cw_skimmer_event_t events[256];
+		const int n_events = LIBCW_TEST_FUT(cw_skimmer_get_events)(skimmer, events, 256);
+		for (int e = 0; e < n_events; e++) {
+			const int s = (events[e].frequency - 1000 + 75) / 150;
+			if ('T' == events[e].character && s >= 0 && s < n_signals) {
+				decoded[s] = true;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const int64_t usecs = (end.tv_sec - begin.tv_sec) * CW_USECS_PER_SEC + (end.tv_nsec - begin.tv_nsec) / 1000;
+
+	int n_decoded = 0;
+	for (int s = 0; s < n_signals; s++) {
+		n_decoded += decoded[s] ? 1 : 0;
+	}
+	cte->expect_op_int(cte, n_signals, "==", max_channels, "%s: count of channels", __func__);
+	cte->expect_op_int(cte, n_signals, "==", n_decoded, "%s: count of decoded signals", __func__);
+	cte->expect_op_int(cte, n_seconds * CW_USECS_PER_SEC, ">", (int) usecs, "%s: time of processing %d s of sound: %d us", __func__, n_seconds, (int) usecs);
+
+	cw_skimmer_delete(&skimmer);
+	free(samples);
+	free(sound);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Count channels of skimmer that have frequency within 40 Hz of
+   @p frequency (zero or one).
+*/
+static int test_cw_skimmer_has_channel(const cw_skimmer_t * skimmer, int frequency)
+{
+	cw_skimmer_channel_cost_t costs[CW_SKIMMER_CHANNELS_MAX];
+	const int n = cw_skimmer_get_channel_costs(skimmer, costs, CW_SKIMMER_CHANNELS_MAX);
+	int result = 0;
+	for (int i = 0; i < n; i++) {
+		if (abs(costs[i].frequency - frequency) <= 40) {
+			result++;
+		}
+	}
+	return result;
+}
+
+
+
+
+/**
+   @brief Test controller of CPU budget of skimmer
+
+   Overload is simulated by passing large costs of batches to the
+   controller: the skimmer must lower overlap of frames, then drop
+   the weakest channels and not admit new ones. With real (low) costs
+   the skimmer must recover.
+*/
+int test_cw_skimmer_cpu_budget(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 8000;
+	const int n_signals = 6;
+	const size_t n_samples = (size_t) sample_rate * 16;
+	float * sound = (float *) calloc(n_samples, sizeof (float));
+	int16_t * samples = (int16_t *) calloc(n_samples, sizeof (int16_t));
+	cte->assert2(cte, sound && samples, "%s: failed to allocate sound", __func__);
+
+	/* Signal with higher frequency is stronger. */
+	for (int s = 0; s < n_signals; s++) {
+		size_t position = (size_t) sample_rate / 4 + (size_t) s * (size_t) sample_rate / 10;
+		while (position < n_samples - (size_t) sample_rate) {
+			position = test_cw_skimmer_add_signal(sound, NULL, n_samples, position, sample_rate, 600 + s * 300, 500.0f * (float) (s + 1), 18, "TEST ");
+		}
+	}
+	test_cw_skimmer_to_samples(sound, samples, n_samples, 128);
+
+	cw_skimmer_t * skimmer = LIBCW_TEST_FUT(cw_skimmer_new)(sample_rate, 300, 2700, 0);
+	cte->assert2(cte, skimmer, "%s: failed to create new skimmer", __func__);
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_skimmer_set_cpu_budget)(skimmer, 101), "%s: invalid budget", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: invalid budget (errno)", __func__);
+
+	const size_t chunk = (size_t) sample_rate / 50;
+	size_t position = 0;
+	cw_skimmer_event_t events[64];
+
+	/* No budget: all signals get channels. */
+	for (; position + chunk <= (size_t) sample_rate * 3; position += chunk) {
+		LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + position, chunk, -1);
+		cw_skimmer_get_events(skimmer, events, 64);
+	}
+	cte->expect_op_int(cte, n_signals, "==", cw_skimmer_get_n_channels(skimmer), "%s: channels without budget", __func__);
+
+	cw_skimmer_load_t load;
+	LIBCW_TEST_FUT(cw_skimmer_get_load)(skimmer, &load);
+	cte->expect_op_int(cte, 75, "==", load.overlap, "%s: initial overlap", __func__);
+	cte->expect_op_int(cte, 0, "<", load.cost, "%s: cost is measured", __func__);
+	cte->expect_op_int(cte, n_signals, "==", LIBCW_TEST_FUT(cw_skimmer_get_channel_costs)(skimmer, (cw_skimmer_channel_cost_t[8]) { 0 }, 8), "%s: costs of channels", __func__);
+
+	/* Simulated overload: cost of a batch is twice the budget. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_skimmer_set_cpu_budget)(skimmer, 20), "%s: set budget", __func__);
+	const int64_t duration_ns = 100 * 1000 * 1000;
+	for (int i = 0; i < 20 && 75 == load.overlap; i++) {
+		LIBCW_TEST_FUT(cw_skimmer_control_internal)(skimmer, duration_ns * 2 / 5, duration_ns);
+		/* Overlap is changed on next boundary of frames. */
+		LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + position, chunk, -1);
+		position += chunk;
+		LIBCW_TEST_FUT(cw_skimmer_get_load)(skimmer, &load);
+	}
+	cte->expect_op_int(cte, 50, "==", load.overlap, "%s: overlap under overload", __func__);
+	cte->expect_op_int(cte, n_signals, "==", cw_skimmer_get_n_channels(skimmer), "%s: channels after lowering overlap", __func__);
+
+	for (int i = 0; i < 20 && n_signals == cw_skimmer_get_n_channels(skimmer); i++) {
+		LIBCW_TEST_FUT(cw_skimmer_control_internal)(skimmer, duration_ns * 2 / 5, duration_ns);
+	}
+	const int n_kept = cw_skimmer_get_n_channels(skimmer);
+	LIBCW_TEST_FUT(cw_skimmer_get_load)(skimmer, &load);
+	cte->expect_between_int(cte, 1, n_kept, n_signals - 1, "%s: channels under overload", __func__);
+	cte->expect_op_int(cte, n_kept, "==", load.channels_limit, "%s: limit of channels", __func__);
+	cte->expect_op_int(cte, n_signals - n_kept, "==", load.n_dropped, "%s: count of dropped channels", __func__);
+	cte->expect_op_int(cte, 1, "==", test_cw_skimmer_has_channel(skimmer, 600 + (n_signals - 1) * 300), "%s: strongest channel is kept", __func__);
+	cte->expect_op_int(cte, 0, "==", test_cw_skimmer_has_channel(skimmer, 600), "%s: weakest channel is dropped", __func__);
+
+	/* Dropped signals are still there, but are not admitted
+	   before the load stays low for some time. */
+	const size_t admission_end = position + (size_t) sample_rate;
+	int max_channels = 0;
+	for (; position + chunk <= admission_end; position += chunk) {
+		LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + position, chunk, -1);
+		cw_skimmer_get_events(skimmer, events, 64);
+		if (cw_skimmer_get_n_channels(skimmer) > max_channels) {
+			max_channels = cw_skimmer_get_n_channels(skimmer);
+		}
+	}
+	cte->expect_op_int(cte, n_kept, "==", max_channels, "%s: admission of channels under overload", __func__);
+
+	/* Real costs are far below the budget: skimmer recovers. */
+	for (; position + chunk <= n_samples; position += chunk) {
+		LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, samples + position, chunk, -1);
+		cw_skimmer_get_events(skimmer, events, 64);
+	}
+	LIBCW_TEST_FUT(cw_skimmer_get_load)(skimmer, &load);
+	cte->expect_op_int(cte, 75, "==", load.overlap, "%s: overlap after recovery", __func__);
+	cte->expect_op_int(cte, CW_SKIMMER_CHANNELS_MAX, "==", load.channels_limit, "%s: limit of channels after recovery", __func__);
+	cte->expect_op_int(cte, n_signals, "==", cw_skimmer_get_n_channels(skimmer), "%s: channels after recovery", __func__);
+
+	cw_skimmer_delete(&skimmer);
+	free(samples);
+	free(sound);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test IQ front-end
+
+   Two signals in 192 kHz IQ: "PARIS" at +12 kHz and "CQ" at -30 kHz
+   from center. Each must be decoded by its channel, and the first one
+   also by a skimmer fed with audio from the front-end. Check also that
+   the front-end is cheap enough to run in real time.
+*/
+int test_cw_iq(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int sample_rate = 192000;
+	const int decimation = 24;
+	const size_t n_frames = (size_t) sample_rate * 5;
+	float * sound_i = (float *) calloc(n_frames, sizeof (float));
+	float * sound_q = (float *) calloc(n_frames, sizeof (float));
+	int16_t * samples = (int16_t *) calloc(2 * n_frames, sizeof (int16_t));
+	cte->assert2(cte, sound_i && sound_q && samples, "%s: failed to allocate sound", __func__);
+
+	struct {
+		int frequency;
+		int speed;
+		const char * text;
+		cw_rec_t * rec;
+		char received[16];
+	} signals[] = {
+		{  12000, 16, "PARIS", NULL, { 0 } },
+		{ -30000, 20, "CQ",    NULL, { 0 } },
+	};
+	const int n_signals = (int) (sizeof (signals) / sizeof (signals[0]));
+	for (int s = 0; s < n_signals; s++) {
+		test_cw_skimmer_add_signal(sound_i, sound_q, n_frames, (size_t) sample_rate / 2, sample_rate, signals[s].frequency, 4000.0f, signals[s].speed, signals[s].text);
+	}
+	uint32_t noise = 4321;
+	for (size_t i = 0; i < n_frames; i++) {
+		noise = noise * 1103515245 + 12345;
+		samples[2 * i] = (int16_t) (sound_i[i] + (float) ((int) ((noise >> 16) & 0x3ff) - 0x200));
+		noise = noise * 1103515245 + 12345;
+		samples[2 * i + 1] = (int16_t) (sound_q[i] + (float) ((int) ((noise >> 16) & 0x3ff) - 0x200));
+	}
+
+	cw_iq_t * iq = LIBCW_TEST_FUT(cw_iq_new)(sample_rate, decimation);
+	cte->assert2(cte, iq, "%s: failed to create new IQ front-end", __func__);
+	const int output_sample_rate = LIBCW_TEST_FUT(cw_iq_get_output_sample_rate)(iq);
+	cte->expect_op_int(cte, sample_rate / decimation, "==", output_sample_rate, "%s: output sample rate", __func__);
+
+	for (int s = 0; s < n_signals; s++) {
+		signals[s].rec = cw_rec_new();
+		cte->assert2(cte, signals[s].rec, "%s: failed to create new receiver", __func__);
+		cw_rec_disable_adaptive_mode(signals[s].rec);
+		cw_rec_set_speed(signals[s].rec, signals[s].speed);
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_iq_add_channel)(iq, signals[s].frequency, signals[s].rec);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: add channel at %d Hz", __func__, signals[s].frequency);
+	}
+
+	/* First signal should be heard by skimmer at 1500 Hz. */
+	const int center_frequency = signals[0].frequency + output_sample_rate / 4 - 1500;
+	cw_skimmer_t * skimmer = cw_skimmer_new(output_sample_rate, output_sample_rate / 8, output_sample_rate * 3 / 8, 0);
+	cte->assert2(cte, skimmer, "%s: failed to create new skimmer", __func__);
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_iq_attach_skimmer)(iq, center_frequency, skimmer);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "%s: attach skimmer", __func__);
+	char skimmed[64] = { 0 };
+
+	bool process_failure = false;
+	const size_t chunk = (size_t) sample_rate / 100;
+	for (size_t i = 0; i + chunk <= n_frames; i += chunk) {
+		const int64_t timestamp = 0 == i ? (int64_t) 1000 * 1000 * 1000 : -1;
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_iq_process)(iq, samples + 2 * i, chunk, timestamp)) {
+			process_failure = true;
+			break;
+		}
+
+		for (int s = 0; s < n_signals; s++) {
+			char character = 0;
+			bool is_end_of_word = false;
+			bool is_error = false;
+			if (CW_SUCCESS == cw_rec_poll_character_ns(signals[s].rec, LIBCW_TEST_FUT(cw_iq_get_timestamp)(iq), &character, &is_end_of_word, &is_error)) {
+				const size_t len = strlen(signals[s].received);
+				if (len < sizeof (signals[s].received) - 1) {
+					signals[s].received[len] = character;
+				}
+				cw_rec_reset_state(signals[s].rec);
+			}
+		}
+
+		cw_skimmer_event_t events[16];
+		const int n_events = cw_skimmer_get_events(skimmer, events, 16);
+		for (int e = 0; e < n_events; e++) {
+			const size_t len = strlen(skimmed);
+			if (abs(events[e].frequency - 1500) <= 40 && len < sizeof (skimmed) - 1) {
+				skimmed[len] = events[e].character;
+			}
+		}
+	}
+	cte->expect_op_int(cte, false, "==", process_failure, "%s: process frames", __func__);
+	for (int s = 0; s < n_signals; s++) {
+		cte->expect_op_int(cte, 0, "==", strcmp(signals[s].received, signals[s].text),
+				   "%s: channel at %d Hz: '%s'", __func__, signals[s].frequency, signals[s].received);
+	}
+	cte->expect_op_int(cte, true, "==", NULL != strstr(skimmed, signals[0].text), "%s: skimmer: '%s'", __func__, skimmed);
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_iq_new)(sample_rate, 25), "%s: odd decimation", __func__);
+	cte->expect_op_int(cte, EINVAL, "==", errno, "%s: odd decimation (errno)", __func__);
+	cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_iq_new)(sample_rate, 96), "%s: output sample rate too low", __func__);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_iq_add_channel)(iq, sample_rate / 2, signals[0].rec), "%s: channel above Nyquist", __func__);
+	cw_skimmer_t * skimmer_48k = cw_skimmer_new(48000, 300, 3000, 0);
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_iq_attach_skimmer)(iq, 0, skimmer_48k), "%s: skimmer with wrong sample rate", __func__);
+	cw_skimmer_delete(&skimmer_48k);
+
+	/* Cost: few channels at 192 kHz must be processed in much less
+	   than real time. */
+	struct timespec begin = { 0 };
+	struct timespec end = { 0 };
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
+	for (size_t i = 0; i + chunk <= n_frames; i += chunk) {
+		cw_iq_process(iq, samples + 2 * i, chunk, -1);
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+	const int64_t cpu_usecs = (end.tv_sec - begin.tv_sec) * CW_USECS_PER_SEC + (end.tv_nsec - begin.tv_nsec) / 1000;
+	const int n_seconds = (int) (n_frames / (size_t) sample_rate);
+	cte->expect_op_int(cte, n_seconds * CW_USECS_PER_SEC / 10, ">", (int) cpu_usecs, "%s: CPU time of %d s of IQ frames: %d us", __func__, n_seconds, (int) cpu_usecs);
+
+	LIBCW_TEST_FUT(cw_iq_delete)(&iq);
+	cte->expect_op_int(cte, true, "==", NULL == iq, "%s: delete", __func__);
+	cw_skimmer_delete(&skimmer);
+	for (int s = 0; s < n_signals; s++) {
+		cw_rec_delete(&signals[s].rec);
+	}
+	free(samples);
+	free(sound_q);
+	free(sound_i);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	cw_rec_t * rec;
+	int sample_rate;
+	char received[16];
+	size_t n_received;
+
+	size_t n_samples;
+	int n_blocks;
+	int max_block_n_samples;
+	int16_t first_sample;
+	int16_t last_sample;
+	int64_t next_timestamp; /* Expected timestamp of next block [ns]. */
+	bool timestamps_continuous;
+} test_cw_capture_data_t;
+
+
+
+
+/* Called by capture's thread after each block of samples has been
+   passed to detector: poll the receiver, like client code would do. */
+static void test_cw_capture_callback(void * arg, const int16_t * samples, size_t n_samples, int64_t timestamp)
+{
+	test_cw_capture_data_t * data = (test_cw_capture_data_t *) arg;
+
+	if (0 == data->n_blocks) {
+		data->first_sample = samples[0];
+	} else if (llabs(timestamp - data->next_timestamp) > 1) {
+		data->timestamps_continuous = false;
+	}
+	data->last_sample = samples[n_samples - 1];
+	data->n_samples += n_samples;
+	data->n_blocks++;
+	if ((int) n_samples > data->max_block_n_samples) {
+		data->max_block_n_samples = (int) n_samples;
+	}
+	/* File capture calculates timestamps from count of all samples,
+	   which may differ from this sum by rounding (hence the 1 ns of
+	   tolerance above). */
+	data->next_timestamp = timestamp + ((int64_t) n_samples * CW_NSECS_PER_SEC) / data->sample_rate;
+
+	if (NULL == data->rec) {
+		return;
+	}
+	char character = 0;
+	bool is_end_of_word = false;
+	bool is_error = false;
+	if (CW_SUCCESS == cw_rec_poll_character_ns(data->rec, data->next_timestamp, &character, &is_end_of_word, &is_error)) {
+		if (data->n_received < sizeof (data->received) - 1) {
+			data->received[data->n_received++] = character;
+		}
+		cw_rec_reset_state(data->rec);
+	}
+}
+
+
+
+
+/* Start capture, wait until it reaches the end of file, stop it. */
+static bool test_cw_capture_run(cw_capture_t * capture)
+{
+	if (CW_SUCCESS != LIBCW_TEST_FUT(cw_capture_start)(capture)) {
+		return false;
+	}
+	for (int i = 0; i < 500 && LIBCW_TEST_FUT(cw_capture_is_running)(capture); i++) {
+		usleep(10000);
+	}
+	const bool finished = !cw_capture_is_running(capture);
+	LIBCW_TEST_FUT(cw_capture_stop)(capture);
+	return finished;
+}
+
+
+
+
+/**
+   @brief Test sound capture feeding a tone detector
+
+   Generator writes "PARIS" to WAV file, and capture reads the file
+   back (with sample rate taken from WAV header) into tone detector.
+   Receiver is polled from capture's callback. Raw file is used to
+   check blocks and timestamps of captured samples.
+*/
+int test_cw_capture(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[] = "/tmp/libcw_capture_XXXXXX";
+	int fd = mkstemp(path);
+	cte->assert2(cte, -1 != fd, "%s: failed to create temporary file", __func__);
+	close(fd);
+
+	const int sample_rate = 22050;
+	const int frequency = 700;
+
+
+	/* WAV file with Morse code. */
+	{
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_FILE, .file_fd = -1, .file_format = CW_FILE_FORMAT_WAV, .file_sample_rate = sample_rate };
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		cte->assert2(cte, gen, "%s: failed to create generator", __func__);
+		cw_gen_set_speed(gen, 20);
+		cw_gen_set_frequency(gen, frequency);
+		cw_gen_start(gen);
+		/* Detector, like receiver, needs silence before first mark. */
+		cw_gen_enqueue_string(gen, " PARIS");
+		cw_gen_wait_for_queue_level(gen, 0);
+		cw_gen_wait_for_end_of_current_tone(gen);
+		cw_gen_stop(gen);
+		cw_gen_delete(&gen);
+
+		cw_capture_t * capture = LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_FILE, path, 0, 0);
+		cte->assert2(cte, capture, "%s: failed to create new capture", __func__);
+		cte->expect_op_int(cte, sample_rate, "==", LIBCW_TEST_FUT(cw_capture_get_sample_rate)(capture), "%s: sample rate from WAV header", __func__);
+
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, rec, "%s: failed to create new receiver", __func__);
+		cw_rec_disable_adaptive_mode(rec);
+		cw_rec_set_speed(rec, 20);
+		cw_detector_t * detector = cw_detector_new(sample_rate, frequency, rec);
+		cte->assert2(cte, detector, "%s: failed to create new detector", __func__);
+
+		test_cw_capture_data_t data = { .rec = rec, .sample_rate = sample_rate, .timestamps_continuous = true };
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_capture_attach_detector)(capture, detector), "%s: attach detector", __func__);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_capture_register_callback)(capture, test_cw_capture_callback, &data), "%s: register callback", __func__);
+
+		const bool finished = test_cw_capture_run(capture);
+		cte->expect_op_int(cte, true, "==", finished, "%s: capture stops at the end of file", __func__);
+
+		/* Generator's stop tone ends the file, there may be not
+		   enough silence after last character. */
+		char character = 0;
+		if (CW_SUCCESS == cw_rec_poll_character_ns(rec, data.next_timestamp + CW_NSECS_PER_SEC, &character, NULL, NULL)
+		    && data.n_received < sizeof (data.received) - 1) {
+			data.received[data.n_received++] = character;
+		}
+		cte->expect_op_int(cte, 0, "==", strcmp(data.received, "PARIS"), "%s: received text: '%s'", __func__, data.received);
+		cte->expect_op_int(cte, true, "==", data.timestamps_continuous, "%s: timestamps of blocks", __func__);
+		cte->expect_op_int(cte, sample_rate * CW_CAPTURE_PERIOD_DURATION_DEFAULT / CW_USECS_PER_SEC, "==", data.max_block_n_samples, "%s: size of block", __func__);
+
+		/* Detector with different sample rate can't be attached. */
+		cw_detector_t * other_detector = cw_detector_new(48000, frequency, rec);
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_capture_attach_detector)(capture, other_detector), "%s: attach detector with different sample rate", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: attach detector with different sample rate (errno)", __func__);
+		cw_detector_delete(&other_detector);
+
+		LIBCW_TEST_FUT(cw_capture_delete)(&capture);
+		cte->expect_op_int(cte, true, "==", NULL == capture, "%s: delete", __func__);
+		cw_detector_delete(&detector);
+		cw_rec_delete(&rec);
+	}
+
+
+	/* Raw file: 500 samples and an incomplete one, read in blocks of
+	   2 ms. */
+	{
+		uint8_t bytes[1001] = { 0 };
+		for (int i = 0; i < 500; i++) {
+			bytes[2 * i] = (uint8_t) (i & 0xff);
+			bytes[2 * i + 1] = (uint8_t) ((i >> 8) & 0xff);
+		}
+		fd = open(path, O_WRONLY | O_TRUNC);
+		cte->assert2(cte, -1 != fd, "%s: failed to open temporary file", __func__);
+		cte->expect_op_int(cte, (int) sizeof (bytes), "==", (int) write(fd, bytes, sizeof (bytes)), "%s: write raw file", __func__);
+		close(fd);
+
+		cw_capture_t * capture = LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_FILE, path, 8000, 2000);
+		cte->assert2(cte, capture, "%s: failed to create new capture of raw file", __func__);
+		cte->expect_op_int(cte, 8000, "==", cw_capture_get_sample_rate(capture), "%s: sample rate of raw file", __func__);
+
+		test_cw_capture_data_t data = { .sample_rate = 8000, .timestamps_continuous = true };
+		cw_capture_register_callback(capture, test_cw_capture_callback, &data);
+		const bool finished = test_cw_capture_run(capture);
+		cte->expect_op_int(cte, true, "==", finished, "%s: raw: capture stops at the end of file", __func__);
+		cte->expect_op_int(cte, 500, "==", (int) data.n_samples, "%s: raw: count of samples", __func__);
+		cte->expect_op_int(cte, 16, "==", data.max_block_n_samples, "%s: raw: size of block", __func__);
+		cte->expect_op_int(cte, 32, "==", data.n_blocks, "%s: raw: count of blocks", __func__);
+		cte->expect_op_int(cte, 0, "==", data.first_sample, "%s: raw: first sample", __func__);
+		cte->expect_op_int(cte, 499, "==", data.last_sample, "%s: raw: last sample", __func__);
+		cte->expect_op_int(cte, true, "==", data.timestamps_continuous, "%s: raw: timestamps of blocks", __func__);
+
+		/* Capture can't be started twice, and callback can't be
+		   changed while capture is running. */
+		cw_capture_start(capture);
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_capture_start)(capture), "%s: start twice", __func__);
+		cte->expect_op_int(cte, EBUSY, "==", errno, "%s: start twice (errno)", __func__);
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_capture_register_callback)(capture, NULL, NULL), "%s: register callback while running", __func__);
+		cw_capture_stop(capture);
+
+		cw_capture_delete(&capture);
+	}
+
+
+	/* Invalid arguments. */
+	{
+		errno = 0;
+		cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_NULL, path, 0, 0), "%s: sound system without capture", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: sound system without capture (errno)", __func__);
+		errno = 0;
+		cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_FILE, path, 4000, 0), "%s: sample rate too low", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: sample rate too low (errno)", __func__);
+		errno = 0;
+		cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_FILE, path, 0, 10), "%s: period too short", __func__);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "%s: period too short (errno)", __func__);
+		unlink(path);
+		cte->expect_op_int(cte, true, "==", NULL == LIBCW_TEST_FUT(cw_capture_new)(CW_AUDIO_FILE, path, 0, 0), "%s: file doesn't exist", __func__);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
@@ -24,6 +24,28 @@ int test_cw_rec_test_with_varying_speeds(cw_test_executor_t * cte);
 int test_cw_rec_get_receive_parameters(cw_test_executor_t * cte);
 int test_cw_rec_parameter_getters_setters_1(cw_test_executor_t * cte);
 int test_cw_rec_parameter_getters_setters_2(cw_test_executor_t * cte);
+int test_cw_rec_ns_timestamps(cw_test_executor_t * cte);
+int test_cw_rec_duration_stats(cw_test_executor_t * cte);
+int test_cw_rec_adaptive_update(cw_test_executor_t * cte);
+int test_cw_rec_reset_average(cw_test_executor_t * cte);
+int test_cw_rec_process_events(cw_test_executor_t * cte);
+int test_cw_viterbi_process_events(cw_test_executor_t * cte);
+int test_cw_ensemble_process_events(cw_test_executor_t * cte);
+int test_cw_rec_tester_sweep(cw_test_executor_t * cte);
+int test_cw_rec_tester_corpus(cw_test_executor_t * cte);
+int test_cw_rec_output_callback(cw_test_executor_t * cte);
+int test_cw_rec_event_fd(cw_test_executor_t * cte);
+int test_cw_rec_compact(cw_test_executor_t * cte);
+int test_cw_rec_adaptive_acquisition(cw_test_executor_t * cte);
+int test_cw_rec_snapshot(cw_test_executor_t * cte);
+int test_cw_rec_poll_characters(cw_test_executor_t * cte);
+int test_cw_detector(cw_test_executor_t * cte);
+int test_cw_detector_afc(cw_test_executor_t * cte);
+int test_cw_skimmer(cw_test_executor_t * cte);
+int test_cw_skimmer_many_signals(cw_test_executor_t * cte);
+int test_cw_skimmer_cpu_budget(cw_test_executor_t * cte);
+int test_cw_iq(cw_test_executor_t * cte);
+int test_cw_capture(cw_test_executor_t * cte);
 
 
 
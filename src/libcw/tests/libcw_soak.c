@@ -0,0 +1,696 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file libcw_soak.c
+
+   Long-duration soak test of generator (and optionally of iambic
+   keyer and receiver).
+
+   The program plays text for a long time (hours), in segments: one
+   segment for every combination of sound system and speed, repeated
+   in a number of rounds. Generator's tone queue is kept filled by low
+   water mark callback, so that generator should never be starved of
+   tones. For every segment the program reports:
+   - underruns of sound device and failed writes to sound system,
+   - starvations of generator (emptying of its tone queue while the
+     queue was being filled),
+   - drift of durations of tones caused by rounding them to whole
+     samples,
+   - drift of clock of sound device (or, for Null and Console sound
+     systems, of generator's pacing) against monotonic clock,
+   - growth of resident memory,
+   - percentiles of latencies measured by generator.
+
+   The program is not a part of "make check". Run it with "make soak".
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#define SOAK_SPEEDS_MAX             32
+#define SOAK_DURATION_DEFAULT      600 /* Duration of one segment [s]. */
+
+/* Tone queue is refilled when it holds fewer tones than this. */
+#define SOAK_TQ_LOW_LEVEL           10
+
+/* Count of characters enqueued by one call of low level callback. */
+#define SOAK_CHARACTERS_PER_REFILL   2
+
+
+
+
+typedef enum {
+	SOAK_FORMAT_CSV,
+	SOAK_FORMAT_JSON
+} soak_format_t;
+
+
+
+
+typedef struct {
+	cw_gen_t * gen;
+	cw_rec_t * rec;
+
+	/* Text is played in a loop. Position in text is protected by
+	   mutex: the text is enqueued by main thread and by generator's
+	   thread (in low level callback). */
+	const char * text;
+	size_t text_i;
+	pthread_mutex_t mutex;
+
+	/* Counters. Characters are counted by generator's thread and
+	   by receiver's timer. */
+	uint64_t n_sent;
+	uint64_t n_received;
+	uint64_t n_rec_errors;
+} soak_feeder_t;
+
+
+
+
+typedef struct {
+	char sound_system;
+	int speed;
+
+	double elapsed;          /* Duration of playing text [s]. */
+	uint64_t n_sent;
+	uint64_t n_received;
+	uint64_t n_rec_errors;
+
+	unsigned int n_underruns;
+	unsigned int n_write_errors;
+	unsigned int n_starvations;
+
+	double rounding_drift;   /* [us] */
+	double clock_drift;      /* [ms] */
+	double clock_drift_ppm;
+
+	long rss_begin;          /* [kB] */
+	long rss_end;            /* [kB] */
+
+	cw_gen_latency_stats_t stats;
+} soak_segment_t;
+
+
+
+
+static const char * soak_text = "the quick brown fox jumps over the lazy dog 0123456789 paris ";
+
+static volatile sig_atomic_t soak_interrupted = 0;
+
+
+
+
+static void soak_signal_handler(int signal_number);
+static long soak_rss_kb(void);
+static int soak_sound_system(char letter);
+static uint64_t soak_histogram_percentile(const cw_latency_histogram_t * histogram, double percentile);
+static void soak_sleep(double seconds);
+static void soak_feed_callback(void * arg);
+static void soak_value_tracking_callback(void * arg, int key_value);
+static void soak_rec_output_callback(void * arg, int64_t timestamp, char character, bool is_error);
+static bool soak_run_segment(char sound_system, const char * device, int speed, double duration, bool use_keyer, bool use_receiver, soak_segment_t * segment);
+static void soak_print_segment(const soak_segment_t * segment, soak_format_t format, bool is_first);
+static void soak_print_usage(const char * program_name);
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	const char * systems = "n";
+	int speeds[SOAK_SPEEDS_MAX] = { 12, 25, 40 };
+	size_t n_speeds = 3;
+	double duration = SOAK_DURATION_DEFAULT;
+	int rounds = 1;
+	bool use_keyer = false;
+	bool use_receiver = false;
+	const char * device = "";
+	soak_format_t format = SOAK_FORMAT_CSV;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "S:w:t:l:krd:f:h"))) {
+		switch (opt) {
+		case 'S':
+			systems = optarg;
+			break;
+		case 'w': {
+			n_speeds = 0;
+			char * cursor = optarg;
+			while (*cursor) {
+				char * end = NULL;
+				const long speed = strtol(cursor, &end, 10);
+				if (end == cursor || n_speeds == SOAK_SPEEDS_MAX
+				    || speed < CW_SPEED_MIN || speed > CW_SPEED_MAX) {
+					fprintf(stderr, "%s: invalid list of speeds '%s'\n", argv[0], optarg);
+					return EXIT_FAILURE;
+				}
+				speeds[n_speeds++] = (int) speed;
+				cursor = ',' == *end ? end + 1 : end;
+			}
+			break;
+		}
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'l':
+			rounds = atoi(optarg);
+			break;
+		case 'k':
+			use_keyer = true;
+			break;
+		case 'r':
+			use_receiver = true;
+			break;
+		case 'd':
+			device = optarg;
+			break;
+		case 'f':
+			if (0 == strcmp(optarg, "csv")) {
+				format = SOAK_FORMAT_CSV;
+			} else if (0 == strcmp(optarg, "json")) {
+				format = SOAK_FORMAT_JSON;
+			} else {
+				fprintf(stderr, "%s: unknown output format '%s'\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			soak_print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			soak_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (duration <= 0 || rounds <= 0 || 0 == n_speeds) {
+		fprintf(stderr, "%s: duration, rounds and speeds must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (const char * s = systems; *s; s++) {
+		if (CW_AUDIO_NONE == soak_sound_system(*s)) {
+			fprintf(stderr, "%s: unknown sound system '%c'\n", argv[0], *s);
+			return EXIT_FAILURE;
+		}
+	}
+
+	signal(SIGINT, soak_signal_handler);
+	signal(SIGTERM, soak_signal_handler);
+
+	if (SOAK_FORMAT_CSV == format) {
+		printf("round,system,speed,elapsed_s,sent,received,rec_errors,underruns,write_errors,starvations,"
+		       "rounding_drift_us,clock_drift_ms,clock_drift_ppm,rss_begin_kb,rss_end_kb,"
+		       "queue_p50_us,queue_p99_us,queue_max_us,device_p50_us,device_p99_us,device_max_us,"
+		       "total_p50_us,total_p99_us,total_max_us,pacing_p50_us,pacing_p99_us,pacing_max_us\n");
+	} else {
+		printf("{\n  \"version\": \"%s\",\n  \"segments\": [", PACKAGE_VERSION);
+	}
+
+	bool success = true;
+	bool is_first = true;
+	const long rss_begin = soak_rss_kb();
+	for (int round = 0; round < rounds && !soak_interrupted; round++) {
+		for (const char * s = systems; *s && !soak_interrupted; s++) {
+			for (size_t i = 0; i < n_speeds && !soak_interrupted; i++) {
+				soak_segment_t segment;
+				if (!soak_run_segment(*s, device, speeds[i], duration, use_keyer, use_receiver, &segment)) {
+					fprintf(stderr, "%s: segment with sound system '%c' at %d WPM failed\n", argv[0], *s, speeds[i]);
+					success = false;
+					continue;
+				}
+				if (SOAK_FORMAT_CSV == format) {
+					printf("%d,", round);
+				}
+				soak_print_segment(&segment, format, is_first);
+				fflush(stdout);
+				is_first = false;
+			}
+		}
+	}
+
+	if (SOAK_FORMAT_JSON == format) {
+		printf("\n  ]\n}\n");
+	}
+	fprintf(stderr, "[II] growth of resident memory over all segments: %ld kB\n", soak_rss_kb() - rss_begin);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Print usage of the program
+
+   @param[in] program_name name of the program
+*/
+static void soak_print_usage(const char * program_name)
+{
+	fprintf(stderr, "Usage: %s [-S SYSTEMS] [-w SPEEDS] [-t SECONDS] [-l ROUNDS] [-k] [-r] [-d DEVICE] [-f csv|json]\n", program_name);
+	fprintf(stderr, "  -S  sound systems: n (Null), c (Console), o (OSS), a (ALSA), p (PulseAudio) (default: n)\n");
+	fprintf(stderr, "  -w  comma-separated speeds [wpm] (default: 12,25,40)\n");
+	fprintf(stderr, "  -t  duration of one segment [s] (default: %d)\n", SOAK_DURATION_DEFAULT);
+	fprintf(stderr, "  -l  count of rounds over all sound systems and speeds (default: 1)\n");
+	fprintf(stderr, "  -k  key second half of every segment with iambic keyer\n");
+	fprintf(stderr, "  -r  receive played text with receiver\n");
+	fprintf(stderr, "  -d  sound device (default: default device of sound system)\n");
+	fprintf(stderr, "  -f  output format (default: csv)\n");
+}
+
+
+
+
+/**
+   @brief Play one segment of soak test and collect its results
+
+   @param[in] sound_system letter of sound system
+   @param[in] device name of sound device, empty for default device
+   @param[in] speed speed of generator (and of receiver)
+   @param[in] duration duration of the segment [s]
+   @param[in] use_keyer whether to key second half of the segment with iambic keyer
+   @param[in] use_receiver whether to receive played text
+   @param[out] segment results
+
+   @return true on success
+   @return false on failure
+*/
+static bool soak_run_segment(char sound_system, const char * device, int speed, double duration, bool use_keyer, bool use_receiver, soak_segment_t * segment)
+{
+	memset(segment, 0, sizeof (soak_segment_t));
+	segment->sound_system = sound_system;
+	segment->speed = speed;
+	segment->rss_begin = soak_rss_kb();
+
+	cw_gen_config_t gen_conf = { .sound_system = soak_sound_system(sound_system) };
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", device);
+
+	soak_feeder_t feeder = { .text = soak_text, .mutex = PTHREAD_MUTEX_INITIALIZER };
+	feeder.gen = cw_gen_new(&gen_conf);
+	if (NULL == feeder.gen) {
+		return false;
+	}
+	cw_gen_set_speed(feeder.gen, speed);
+
+	if (use_receiver) {
+		feeder.rec = cw_rec_new();
+		if (NULL == feeder.rec) {
+			cw_gen_delete(&feeder.gen);
+			return false;
+		}
+		cw_rec_set_speed(feeder.rec, speed);
+		cw_rec_disable_adaptive_mode(feeder.rec);
+		cw_rec_register_output_callback(feeder.rec, soak_rec_output_callback, &feeder);
+		cw_gen_register_value_tracking_callback_internal(feeder.gen, soak_value_tracking_callback, &feeder);
+	}
+
+	cw_key_t * key = NULL;
+	if (use_keyer) {
+		key = cw_key_new();
+		if (NULL == key) {
+			cw_rec_delete(&feeder.rec);
+			cw_gen_delete(&feeder.gen);
+			return false;
+		}
+		cw_key_register_generator(key, feeder.gen);
+	}
+
+	if (CW_SUCCESS != cw_gen_start(feeder.gen)) {
+		cw_key_delete(&key);
+		cw_rec_delete(&feeder.rec);
+		cw_gen_delete(&feeder.gen);
+		return false;
+	}
+
+	/* Text phase: generator is never expected to empty its queue. */
+	const double text_duration = use_keyer ? duration / 2 : duration;
+	cw_gen_reset_latency_stats(feeder.gen);
+	const int64_t begin = cw_clock_now_internal();
+	cw_tq_register_low_level_callback_internal(feeder.gen->tq, soak_feed_callback, &feeder, SOAK_TQ_LOW_LEVEL);
+	soak_feed_callback(&feeder);
+	soak_feed_callback(&feeder);
+
+	soak_sleep(text_duration);
+
+	/* Stop feeding and let generator play all enqueued tones. The
+	   queue is emptied once at the end of text; every other emptying
+	   is a starvation. */
+	cw_tq_register_low_level_callback_internal(feeder.gen->tq, NULL, NULL, 0);
+	cw_gen_wait_for_queue_level(feeder.gen, 0);
+	cw_gen_wait_for_end_of_current_tone(feeder.gen);
+
+	cw_gen_latency_stats_t text_stats;
+	cw_gen_get_latency_stats(feeder.gen, &text_stats);
+	cw_gen_stats_t text_io_stats;
+	cw_gen_get_stats(feeder.gen, &text_io_stats);
+	const int64_t end = cw_clock_now_internal();
+	segment->elapsed = (double) (end - begin) / 1e9;
+	segment->n_starvations = text_stats.n_tq_emptied > 0 ? text_stats.n_tq_emptied - 1 : 0;
+
+	/* Samples written to sound device are played with latency of
+	   sound device. Any difference over that is drift of clock of
+	   sound device against monotonic clock. Null and Console sound
+	   systems are timed by generator with monotonic clock, compare
+	   durations of played tones. */
+	double played = 0.0;
+	if (0 != text_io_stats.n_samples_written) {
+		played = (double) text_io_stats.n_samples_written / feeder.gen->sample_rate;
+	} else {
+		played = (double) text_stats.tones_duration / 1e6;
+	}
+	segment->clock_drift = (played - segment->elapsed - (double) text_stats.sound_device_latency / 1e6) * 1000.0;
+	segment->clock_drift_ppm = segment->clock_drift / 1000.0 / segment->elapsed * 1e6;
+	if (0 != text_stats.n_tones_samples) {
+		segment->rounding_drift = (double) text_stats.n_tones_samples * 1e6 / feeder.gen->sample_rate - (double) text_stats.tones_duration;
+	}
+
+	if (use_receiver) {
+		/* Give receiver time to recognize end of last character. */
+		soak_sleep(0.5);
+		cw_gen_register_value_tracking_callback_internal(feeder.gen, NULL, NULL);
+	}
+
+	if (use_keyer) {
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_CLOSED);
+		soak_sleep(duration - text_duration);
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+		cw_key_ik_wait_for_keyer(key);
+		cw_gen_wait_for_queue_level(feeder.gen, 0);
+	}
+
+	/* Underruns and errors are counted over whole segment. */
+	cw_gen_get_latency_stats(feeder.gen, &segment->stats);
+	cw_gen_stats_t io_stats;
+	cw_gen_get_stats(feeder.gen, &io_stats);
+	segment->n_underruns = (unsigned int) io_stats.n_xruns;
+	segment->n_write_errors = (unsigned int) io_stats.n_write_errors;
+
+	cw_gen_stop(feeder.gen);
+	if (use_receiver) {
+		cw_rec_register_output_callback(feeder.rec, NULL, NULL);
+	}
+	segment->n_sent = feeder.n_sent;
+	segment->n_received = feeder.n_received;
+	segment->n_rec_errors = feeder.n_rec_errors;
+
+	cw_key_delete(&key);
+	cw_rec_delete(&feeder.rec);
+	cw_gen_delete(&feeder.gen);
+
+	segment->rss_end = soak_rss_kb();
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Enqueue next characters of text
+
+   Low level callback of generator's tone queue.
+
+   @param[in] arg feeder
+*/
+static void soak_feed_callback(void * arg)
+{
+	soak_feeder_t * feeder = (soak_feeder_t *) arg;
+
+	pthread_mutex_lock(&feeder->mutex);
+	for (int i = 0; i < SOAK_CHARACTERS_PER_REFILL; i++) {
+		if (CW_SUCCESS != cw_gen_enqueue_character(feeder->gen, feeder->text[feeder->text_i])) {
+			break;
+		}
+		if (' ' != feeder->text[feeder->text_i]) {
+			__atomic_add_fetch(&feeder->n_sent, 1, __ATOMIC_RELAXED);
+		}
+		feeder->text_i++;
+		if ('\0' == feeder->text[feeder->text_i]) {
+			feeder->text_i = 0;
+		}
+	}
+	pthread_mutex_unlock(&feeder->mutex);
+}
+
+
+
+
+/**
+   @brief Pass changes of generator's value to receiver
+
+   @param[in] arg feeder
+   @param[in] key_value new value of generator
+*/
+static void soak_value_tracking_callback(void * arg, int key_value)
+{
+	soak_feeder_t * feeder = (soak_feeder_t *) arg;
+	const int64_t now = cw_clock_now_internal();
+	if (CW_KEY_VALUE_CLOSED == key_value) {
+		cw_rec_mark_begin_ns(feeder->rec, now);
+	} else {
+		cw_rec_mark_end_ns(feeder->rec, now);
+	}
+}
+
+
+
+
+/**
+   @brief Count characters received by receiver
+
+   Inter-word-spaces are not counted, the same as spaces of sent text.
+
+   @param[in] arg feeder
+   @param[in] timestamp unused
+   @param[in] character received character
+   @param[in] is_error whether receiver has failed to recognize a character
+*/
+static void soak_rec_output_callback(void * arg, __attribute__((unused)) int64_t timestamp, char character, bool is_error)
+{
+	soak_feeder_t * feeder = (soak_feeder_t *) arg;
+	if (is_error) {
+		__atomic_add_fetch(&feeder->n_rec_errors, 1, __ATOMIC_RELAXED);
+	} else if (' ' != character) {
+		__atomic_add_fetch(&feeder->n_received, 1, __ATOMIC_RELAXED);
+	}
+}
+
+
+
+
+/**
+   @brief Print results of one segment
+
+   @param[in] segment results of segment
+   @param[in] format output format
+   @param[in] is_first whether this is the first printed segment
+*/
+static void soak_print_segment(const soak_segment_t * segment, soak_format_t format, bool is_first)
+{
+	const cw_latency_histogram_t * histograms[] = {
+		&segment->stats.queue,
+		&segment->stats.device,
+		&segment->stats.total,
+		&segment->stats.pacing
+	};
+	const char * names[] = { "queue", "device", "total", "pacing" };
+
+	if (SOAK_FORMAT_CSV == format) {
+		printf("%c,%d,%.1f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u,%u,%u,%.0f,%.3f,%.1f,%ld,%ld",
+		       segment->sound_system, segment->speed, segment->elapsed,
+		       segment->n_sent, segment->n_received, segment->n_rec_errors,
+		       segment->n_underruns, segment->n_write_errors, segment->n_starvations,
+		       segment->rounding_drift, segment->clock_drift, segment->clock_drift_ppm,
+		       segment->rss_begin, segment->rss_end);
+		for (size_t i = 0; i < sizeof (histograms) / sizeof (histograms[0]); i++) {
+			printf(",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+			       soak_histogram_percentile(histograms[i], 0.50),
+			       soak_histogram_percentile(histograms[i], 0.99),
+			       histograms[i]->max);
+		}
+		printf("\n");
+	} else {
+		printf("%s\n    { \"system\": \"%c\", \"speed\": %d, \"elapsed_s\": %.1f, \"sent\": %" PRIu64 ", \"received\": %" PRIu64 ", \"rec_errors\": %" PRIu64 ", "
+		       "\"underruns\": %u, \"write_errors\": %u, \"starvations\": %u, "
+		       "\"rounding_drift_us\": %.0f, \"clock_drift_ms\": %.3f, \"clock_drift_ppm\": %.1f, \"rss_begin_kb\": %ld, \"rss_end_kb\": %ld",
+		       is_first ? "" : ",",
+		       segment->sound_system, segment->speed, segment->elapsed,
+		       segment->n_sent, segment->n_received, segment->n_rec_errors,
+		       segment->n_underruns, segment->n_write_errors, segment->n_starvations,
+		       segment->rounding_drift, segment->clock_drift, segment->clock_drift_ppm,
+		       segment->rss_begin, segment->rss_end);
+		for (size_t i = 0; i < sizeof (histograms) / sizeof (histograms[0]); i++) {
+			printf(", \"%s_us\": { \"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 " }",
+			       names[i],
+			       soak_histogram_percentile(histograms[i], 0.50),
+			       soak_histogram_percentile(histograms[i], 0.90),
+			       soak_histogram_percentile(histograms[i], 0.99),
+			       histograms[i]->max);
+		}
+		printf(" }");
+	}
+}
+
+
+
+
+/**
+   @brief Get approximate percentile of latencies from histogram
+
+   The result is upper bound of bucket in which the percentile lies,
+   limited by the longest measured latency.
+
+   @param[in] histogram histogram of latencies
+   @param[in] percentile percentile, in range 0.0-1.0
+
+   @return latency [us], zero if histogram is empty
+*/
+static uint64_t soak_histogram_percentile(const cw_latency_histogram_t * histogram, double percentile)
+{
+	if (0 == histogram->count) {
+		return 0;
+	}
+
+	const uint64_t threshold = (uint64_t) (percentile * (double) histogram->count);
+	uint64_t cumulative = 0;
+	for (int i = 0; i < CW_LATENCY_HISTOGRAM_N_BUCKETS - 1; i++) {
+		cumulative += histogram->buckets[i];
+		if (cumulative > threshold) {
+			const uint64_t upper = 1ULL << i;
+			return upper < histogram->max ? upper : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+
+
+
+/**
+   @brief Get size of resident memory of the process
+
+   @return size of resident memory [kB]; on systems without /proc
+   this is the peak size
+*/
+static long soak_rss_kb(void)
+{
+#if defined(__linux__)
+	FILE * statm = fopen("/proc/self/statm", "r");
+	if (NULL != statm) {
+		long size = 0;
+		long resident = 0;
+		const int n = fscanf(statm, "%ld %ld", &size, &resident);
+		fclose(statm);
+		if (2 == n) {
+			return resident * (sysconf(_SC_PAGESIZE) / 1024);
+		}
+	}
+#endif
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+
+
+
+/**
+   @brief Convert letter of sound system into sound system
+
+   @param[in] letter letter used in command line
+
+   @return sound system, CW_AUDIO_NONE for unknown letter
+*/
+static int soak_sound_system(char letter)
+{
+	switch (letter) {
+	case 'n':
+		return CW_AUDIO_NULL;
+	case 'c':
+		return CW_AUDIO_CONSOLE;
+	case 'o':
+		return CW_AUDIO_OSS;
+	case 'a':
+		return CW_AUDIO_ALSA;
+	case 'p':
+		return CW_AUDIO_PA;
+	default:
+		return CW_AUDIO_NONE;
+	}
+}
+
+
+
+
+/**
+   @brief Sleep, waking up every second to check if the program has been interrupted
+
+   @param[in] seconds duration of sleep
+*/
+static void soak_sleep(double seconds)
+{
+	const int64_t deadline = cw_clock_now_internal() + (int64_t) (seconds * 1e9);
+	while (!soak_interrupted) {
+		const int64_t now = cw_clock_now_internal();
+		if (now >= deadline) {
+			break;
+		}
+		const int64_t step = deadline - now < 1000000000 ? deadline - now : 1000000000;
+		cw_clock_sleep_until_internal(now + step);
+	}
+}
+
+
+
+
+static void soak_signal_handler(__attribute__((unused)) int signal_number)
+{
+	soak_interrupted = 1;
+}
@@ -0,0 +1,793 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2021  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file libcw_spectrum.c
+
+   Benchmark of spectral purity and of timing of generator's output.
+
+   The program renders text offline, through the same synthesis path
+   that is used for playing (tone queue, slopes, oscillator), once
+   for every combination of shape and duration of slopes. For every
+   combination the program reports:
+   - occupied bandwidth (bandwidth containing 99% of power of
+     signal),
+   - levels of key-click sidebands: the strongest component of
+     spectrum at given distance (or further) from frequency of tone,
+     relative to the tone,
+   - errors of positions and durations of Marks, compared with
+     durations calculated by cw_gen_calculate_durations_internal()
+     and cw_gen_get_timing_parameters_internal(),
+   - error of count of all rendered samples,
+   - throughput of synthesis (samples per second, and ratio to real
+     time).
+
+   The program exits with failure if timing of any combination is
+   incorrect, if shaped slopes don't produce narrower spectrum than
+   rectangular slopes, or if a longer slope of given shape produces
+   stronger key-clicks than a shorter slope of the same shape.
+
+   The program is not a part of "make check". Run it with "make spectrum".
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+#define SPECTRUM_FFT_SIZE           4096
+#define SPECTRUM_WORDS_DEFAULT        20
+#define SPECTRUM_VOLUME               70
+
+/* Occupied bandwidth is bandwidth containing this part of power. */
+#define SPECTRUM_OBW_PART          0.99
+
+/* Sidebands are measured at these distances from frequency of tone. [Hz] */
+#define SPECTRUM_N_OFFSETS             3
+static const int spectrum_offsets[SPECTRUM_N_OFFSETS] = { 250, 500, 1000 };
+
+/* Index of offset used for comparing levels of key-clicks. */
+#define SPECTRUM_CLICK_OFFSET_I        1
+
+/* Allowed increase of key-clicks for longer slope of the same shape. [dB] */
+#define SPECTRUM_CLICK_MARGIN        1.0
+
+
+
+
+typedef enum {
+	SPECTRUM_FORMAT_CSV,
+	SPECTRUM_FORMAT_JSON
+} spectrum_format_t;
+
+
+
+
+typedef struct {
+	int shape;
+	int slope_duration;      /* [us] */
+
+	size_t n_samples;
+	long samples_error;      /* Count of samples minus expected count. */
+	int n_marks;
+	int n_marks_expected;
+	int max_start_error;     /* Largest error of position of start of Mark. [samples] */
+	int max_duration_error;  /* Largest error of duration of Mark. [samples] */
+	bool timing_ok;
+
+	double obw;              /* Occupied bandwidth. [Hz] */
+	double sidebands[SPECTRUM_N_OFFSETS]; /* [dBc] */
+
+	double render_time;      /* [s] */
+	double samples_per_second;
+	double realtime_factor;
+} spectrum_result_t;
+
+
+
+
+/* Expected Mark: position of its first sample and its duration. */
+typedef struct {
+	size_t start;
+	size_t n_samples;
+} spectrum_mark_t;
+
+
+
+
+static const int spectrum_slope_durations[] = { 2000, 5000, 10000 };
+static const char * spectrum_word = "PARIS ";
+
+
+
+
+static bool spectrum_run(int speed, int frequency, int n_words, int shape, int slope_duration, spectrum_result_t * result);
+static bool spectrum_measure(cw_gen_t * gen, const char * text, const cw_sample_t * samples, spectrum_result_t * result);
+static size_t spectrum_duration_to_samples(int sample_rate, int duration);
+static int spectrum_expected_marks(cw_gen_t * gen, const char * text, spectrum_mark_t * marks, int capacity, size_t * n_samples);
+static int spectrum_detected_marks(const cw_sample_t * samples, size_t n_samples, size_t max_gap, spectrum_mark_t * marks, int capacity);
+static bool spectrum_check_timing(const spectrum_mark_t * expected, int n_expected, const spectrum_mark_t * detected, int n_detected, int tolerance, spectrum_result_t * result);
+static void spectrum_psd(const cw_sample_t * samples, size_t n_samples, double * psd);
+static void spectrum_fft(double * re, double * im, int n);
+static void spectrum_analyze_psd(const double * psd, int sample_rate, int frequency, spectrum_result_t * result);
+static double spectrum_seconds(void);
+static const char * spectrum_shape_label(int shape);
+static void spectrum_print_result(const spectrum_result_t * result, spectrum_format_t format, bool is_first);
+static void spectrum_print_usage(const char * program_name);
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	int speed = 25;
+	int frequency = 700;
+	int n_words = SPECTRUM_WORDS_DEFAULT;
+	spectrum_format_t format = SPECTRUM_FORMAT_CSV;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:q:n:f:h"))) {
+		switch (opt) {
+		case 's':
+			speed = atoi(optarg);
+			break;
+		case 'q':
+			frequency = atoi(optarg);
+			break;
+		case 'n':
+			n_words = atoi(optarg);
+			break;
+		case 'f':
+			if (0 == strcmp(optarg, "csv")) {
+				format = SPECTRUM_FORMAT_CSV;
+			} else if (0 == strcmp(optarg, "json")) {
+				format = SPECTRUM_FORMAT_JSON;
+			} else {
+				fprintf(stderr, "%s: unknown output format '%s'\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			spectrum_print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			spectrum_print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (speed < CW_SPEED_MIN || speed > CW_SPEED_MAX) {
+		fprintf(stderr, "%s: speed must be in range %d-%d\n", argv[0], CW_SPEED_MIN, CW_SPEED_MAX);
+		return EXIT_FAILURE;
+	}
+	if (frequency <= CW_FREQUENCY_MIN || frequency > CW_FREQUENCY_MAX) {
+		fprintf(stderr, "%s: frequency must be in range %d-%d\n", argv[0], CW_FREQUENCY_MIN + 1, CW_FREQUENCY_MAX);
+		return EXIT_FAILURE;
+	}
+	if (n_words <= 0) {
+		fprintf(stderr, "%s: count of words must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (SPECTRUM_FORMAT_CSV == format) {
+		printf("shape,slope_us,samples,samples_error,marks,marks_expected,max_start_error,max_duration_error,timing_ok,"
+		       "obw_hz,sideband_%d_dbc,sideband_%d_dbc,sideband_%d_dbc,render_s,samples_per_s,realtime_factor\n",
+		       spectrum_offsets[0], spectrum_offsets[1], spectrum_offsets[2]);
+	} else {
+		printf("{\n  \"version\": \"%s\",\n  \"speed\": %d,\n  \"frequency\": %d,\n  \"results\": [", PACKAGE_VERSION, speed, frequency);
+	}
+
+	bool success = true;
+
+	/* Rectangular slopes are the reference for all shaped slopes. */
+	spectrum_result_t rectangular;
+	if (!spectrum_run(speed, frequency, n_words, CW_TONE_SLOPE_SHAPE_RECTANGULAR, 0, &rectangular)) {
+		fprintf(stderr, "%s: rendering with rectangular slopes failed\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	spectrum_print_result(&rectangular, format, true);
+	success = success && rectangular.timing_ok;
+
+	const int shapes[] = { CW_TONE_SLOPE_SHAPE_LINEAR, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, CW_TONE_SLOPE_SHAPE_SINE };
+	const size_t n_durations = sizeof (spectrum_slope_durations) / sizeof (spectrum_slope_durations[0]);
+
+	for (size_t s = 0; s < sizeof (shapes) / sizeof (shapes[0]); s++) {
+		spectrum_result_t previous = { 0 };
+		for (size_t d = 0; d < n_durations; d++) {
+			spectrum_result_t result;
+			if (!spectrum_run(speed, frequency, n_words, shapes[s], spectrum_slope_durations[d], &result)) {
+				fprintf(stderr, "%s: rendering with %s slopes of %d us failed\n", argv[0], spectrum_shape_label(shapes[s]), spectrum_slope_durations[d]);
+				success = false;
+				continue;
+			}
+			spectrum_print_result(&result, format, false);
+
+			if (!result.timing_ok) {
+				fprintf(stderr, "[EE] %s slopes of %d us: incorrect timing\n", spectrum_shape_label(shapes[s]), result.slope_duration);
+				success = false;
+			}
+			if (result.obw >= rectangular.obw
+			    || result.sidebands[SPECTRUM_CLICK_OFFSET_I] >= rectangular.sidebands[SPECTRUM_CLICK_OFFSET_I]) {
+				fprintf(stderr, "[EE] %s slopes of %d us: spectrum is not narrower than with rectangular slopes\n", spectrum_shape_label(shapes[s]), result.slope_duration);
+				success = false;
+			}
+			if (d > 0 && result.sidebands[SPECTRUM_CLICK_OFFSET_I] > previous.sidebands[SPECTRUM_CLICK_OFFSET_I] + SPECTRUM_CLICK_MARGIN) {
+				fprintf(stderr, "[EE] %s slopes of %d us: key-clicks stronger than with slopes of %d us\n",
+					spectrum_shape_label(shapes[s]), result.slope_duration, previous.slope_duration);
+				success = false;
+			}
+			previous = result;
+		}
+	}
+
+	if (SPECTRUM_FORMAT_JSON == format) {
+		printf("\n  ]\n}\n");
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Print usage of the program
+
+   @param[in] program_name name of the program
+*/
+static void spectrum_print_usage(const char * program_name)
+{
+	fprintf(stderr, "Usage: %s [-s SPEED] [-q FREQUENCY] [-n WORDS] [-f csv|json]\n", program_name);
+	fprintf(stderr, "  -s  speed of generator [wpm] (default: 25)\n");
+	fprintf(stderr, "  -q  frequency of tone [Hz] (default: 700)\n");
+	fprintf(stderr, "  -n  count of rendered words \"PARIS\" (default: %d)\n", SPECTRUM_WORDS_DEFAULT);
+	fprintf(stderr, "  -f  output format (default: csv)\n");
+}
+
+
+
+
+/**
+   @brief Render text with given slopes, and measure the samples
+
+   @param[in] speed speed of generator [wpm]
+   @param[in] frequency frequency of tone [Hz]
+   @param[in] n_words count of rendered words
+   @param[in] shape shape of slopes
+   @param[in] slope_duration duration of slopes [us]
+   @param[out] result results of measurements
+
+   @return true on success
+   @return false on failure
+*/
+static bool spectrum_run(int speed, int frequency, int n_words, int shape, int slope_duration, spectrum_result_t * result)
+{
+	memset(result, 0, sizeof (spectrum_result_t));
+	result->shape = shape;
+	result->slope_duration = slope_duration;
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		return false;
+	}
+
+	/* Measure synthesis of every tone, not copying of tones from
+	   generator's cache. */
+	cw_gen_set_pcm_cache_internal(gen, false);
+
+	const size_t word_len = strlen(spectrum_word);
+	char * text = (char *) calloc(word_len * (size_t) n_words + 1, 1);
+	cw_sample_t * samples = NULL;
+	bool success = false;
+
+	if (NULL != text
+	    && CW_SUCCESS == cw_gen_set_speed(gen, speed)
+	    && CW_SUCCESS == cw_gen_set_frequency(gen, frequency)
+	    && CW_SUCCESS == cw_gen_set_volume(gen, SPECTRUM_VOLUME)
+	    && CW_SUCCESS == cw_gen_set_tone_slope(gen, shape, slope_duration)) {
+
+		for (int i = 0; i < n_words; i++) {
+			memcpy(text + (size_t) i * word_len, spectrum_word, word_len);
+		}
+
+		const double begin = spectrum_seconds();
+		if (CW_SUCCESS == cw_gen_render_string(gen, text, &samples, &result->n_samples)) {
+			result->render_time = spectrum_seconds() - begin;
+			if (result->render_time > 0) {
+				result->samples_per_second = (double) result->n_samples / result->render_time;
+				result->realtime_factor = result->samples_per_second / gen->sample_rate;
+			}
+			success = spectrum_measure(gen, text, samples, result);
+		}
+	}
+
+	free(samples);
+	free(text);
+	cw_gen_delete(&gen);
+
+	return success;
+}
+
+
+
+
+/**
+   @brief Measure timing and spectrum of rendered samples
+
+   @param[in] gen generator that rendered the samples
+   @param[in] text text rendered by generator
+   @param[in] samples rendered samples
+   @param[in/out] result results of measurements
+
+   @return true on success
+   @return false on failure
+*/
+static bool spectrum_measure(cw_gen_t * gen, const char * text, const cw_sample_t * samples, spectrum_result_t * result)
+{
+	/* Each character of text can produce at most seven Marks
+	   (e.g. '$'). */
+	const int capacity = 7 * (int) strlen(text);
+	spectrum_mark_t * expected = (spectrum_mark_t *) calloc((size_t) capacity, sizeof (spectrum_mark_t));
+	spectrum_mark_t * detected = (spectrum_mark_t *) calloc((size_t) capacity + 1, sizeof (spectrum_mark_t));
+	double * psd = (double *) calloc(SPECTRUM_FFT_SIZE / 2 + 1, sizeof (double));
+
+	if (NULL == expected || NULL == detected || NULL == psd) {
+		free(psd);
+		free(detected);
+		free(expected);
+		return false;
+	}
+
+	size_t n_expected_samples = 0;
+	const int n_expected = spectrum_expected_marks(gen, text, expected, capacity, &n_expected_samples);
+	result->samples_error = (long) result->n_samples - (long) n_expected_samples;
+
+	/* Samples of tone cross zero twice in every period, and samples
+	   at the very beginning and end of shaped slopes may be rounded
+	   down to zero. Both may shift detected edges of Marks by less
+	   than one period of tone. */
+	const int sample_rate = gen->sample_rate;
+	const int frequency = cw_gen_get_frequency(gen);
+	const int period = (sample_rate + frequency - 1) / frequency;
+	const int n_detected = spectrum_detected_marks(samples, result->n_samples, (size_t) period, detected, capacity + 1);
+	spectrum_check_timing(expected, n_expected, detected, n_detected, period + 2, result);
+
+	spectrum_psd(samples, result->n_samples, psd);
+	spectrum_analyze_psd(psd, sample_rate, frequency, result);
+
+	free(psd);
+	free(detected);
+	free(expected);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Convert duration to count of samples
+
+   The conversion is done in the same way as in generator.
+
+   @param[in] sample_rate sample rate
+   @param[in] duration duration [us]
+
+   @return count of samples
+*/
+static size_t spectrum_duration_to_samples(int sample_rate, int duration)
+{
+	return (size_t) (((sample_rate / 100) * duration) / 10000);
+}
+
+
+
+
+/**
+   @brief Calculate expected Marks of text played by generator
+
+   Durations of Marks are calculated with
+   cw_gen_calculate_durations_internal(), and durations of spaces are
+   taken from generator's timing parameters.
+
+   @param[in] gen generator
+   @param[in] text text played by generator
+   @param[out] marks expected Marks
+   @param[in] capacity size of @p marks
+   @param[out] n_samples expected count of samples of whole text
+
+   @return count of expected Marks
+*/
+static int spectrum_expected_marks(cw_gen_t * gen, const char * text, spectrum_mark_t * marks, int capacity, size_t * n_samples)
+{
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_calculate_durations_internal(&durations, cw_gen_get_speed(gen), cw_gen_get_weighting(gen));
+	const int dash_duration = 3 * durations.dot_duration;
+
+	int ims_duration = 0;
+	int ics_duration = 0;
+	int iws_duration = 0;
+	cw_gen_get_timing_parameters_internal(gen, NULL, NULL, &ims_duration, &ics_duration, &iws_duration, NULL, NULL);
+
+	const int sample_rate = gen->sample_rate;
+	size_t position = 0;
+	int n_marks = 0;
+	for (const char * c = text; *c; c++) {
+		if (' ' == *c) {
+			/* Generator treats ' ' like other characters:
+			   inter-character-space is added after it. */
+			position += spectrum_duration_to_samples(sample_rate, iws_duration);
+		} else {
+			char * representation = cw_character_to_representation(*c);
+			if (NULL == representation) {
+				continue;
+			}
+			for (const char * r = representation; *r && n_marks < capacity; r++) {
+				marks[n_marks].start = position;
+				marks[n_marks].n_samples = spectrum_duration_to_samples(sample_rate, CW_DOT_REPRESENTATION == *r ? durations.dot_duration : dash_duration);
+				position += marks[n_marks].n_samples + spectrum_duration_to_samples(sample_rate, ims_duration);
+				n_marks++;
+			}
+			free(representation);
+		}
+		position += spectrum_duration_to_samples(sample_rate, ics_duration);
+	}
+
+	*n_samples = position;
+	return n_marks;
+}
+
+
+
+
+/**
+   @brief Find Marks in rendered samples
+
+   A Mark is a run of non-zero samples. Runs of zero samples shorter
+   than @p max_gap are treated as a part of Mark.
+
+   @param[in] samples rendered samples
+   @param[in] n_samples count of samples
+   @param[in] max_gap longest run of zero samples inside of Mark
+   @param[out] marks detected Marks
+   @param[in] capacity size of @p marks
+
+   @return count of detected Marks
+*/
+static int spectrum_detected_marks(const cw_sample_t * samples, size_t n_samples, size_t max_gap, spectrum_mark_t * marks, int capacity)
+{
+	int n_marks = 0;
+	size_t i = 0;
+	while (i < n_samples && n_marks < capacity) {
+		while (i < n_samples && 0 == samples[i]) {
+			i++;
+		}
+		if (i == n_samples) {
+			break;
+		}
+		const size_t start = i;
+		size_t last = i;
+		while (i < n_samples && i - last <= max_gap) {
+			if (0 != samples[i]) {
+				last = i;
+			}
+			i++;
+		}
+		marks[n_marks].start = start;
+		marks[n_marks].n_samples = last - start + 1;
+		n_marks++;
+		i = last + 1;
+	}
+
+	return n_marks;
+}
+
+
+
+
+/**
+   @brief Compare detected Marks with expected Marks
+
+   @param[in] expected expected Marks
+   @param[in] n_expected count of expected Marks
+   @param[in] detected detected Marks
+   @param[in] n_detected count of detected Marks
+   @param[in] tolerance largest acceptable error of edge of Mark [samples]
+   @param[in/out] result results of measurements
+
+   @return true if timing is correct
+   @return false otherwise
+*/
+static bool spectrum_check_timing(const spectrum_mark_t * expected, int n_expected, const spectrum_mark_t * detected, int n_detected, int tolerance, spectrum_result_t * result)
+{
+	result->n_marks = n_detected;
+	result->n_marks_expected = n_expected;
+	result->max_start_error = 0;
+	result->max_duration_error = 0;
+
+	const int n = n_detected < n_expected ? n_detected : n_expected;
+	for (int i = 0; i < n; i++) {
+		const int start_error = abs((int) detected[i].start - (int) expected[i].start);
+		const int duration_error = abs((int) detected[i].n_samples - (int) expected[i].n_samples);
+		if (start_error > result->max_start_error) {
+			result->max_start_error = start_error;
+		}
+		if (duration_error > result->max_duration_error) {
+			result->max_duration_error = duration_error;
+		}
+	}
+
+	result->timing_ok = n_detected == n_expected
+		&& 0 == result->samples_error
+		&& result->max_start_error <= tolerance
+		&& result->max_duration_error <= tolerance;
+
+	return result->timing_ok;
+}
+
+
+
+
+/**
+   @brief Calculate power spectral density of samples
+
+   Welch's method: average of periodograms of overlapping segments
+   with Hann window.
+
+   @param[in] samples samples
+   @param[in] n_samples count of samples
+   @param[out] psd power spectral density, SPECTRUM_FFT_SIZE / 2 + 1 bins
+*/
+static void spectrum_psd(const cw_sample_t * samples, size_t n_samples, double * psd)
+{
+	static double window[SPECTRUM_FFT_SIZE];
+	static double re[SPECTRUM_FFT_SIZE];
+	static double im[SPECTRUM_FFT_SIZE];
+
+	for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+		window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / SPECTRUM_FFT_SIZE);
+	}
+	memset(psd, 0, (SPECTRUM_FFT_SIZE / 2 + 1) * sizeof (double));
+
+	const size_t step = SPECTRUM_FFT_SIZE / 2;
+	int n_segments = 0;
+	for (size_t begin = 0; begin + SPECTRUM_FFT_SIZE <= n_samples; begin += step) {
+		for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+			re[i] = window[i] * samples[begin + (size_t) i];
+			im[i] = 0.0;
+		}
+		spectrum_fft(re, im, SPECTRUM_FFT_SIZE);
+		for (int i = 0; i <= SPECTRUM_FFT_SIZE / 2; i++) {
+			psd[i] += re[i] * re[i] + im[i] * im[i];
+		}
+		n_segments++;
+	}
+
+	for (int i = 0; n_segments > 0 && i <= SPECTRUM_FFT_SIZE / 2; i++) {
+		psd[i] /= n_segments;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief In-place radix-2 FFT
+
+   @param[in/out] re real parts
+   @param[in/out] im imaginary parts
+   @param[in] n size of transform, power of two
+*/
+static void spectrum_fft(double * re, double * im, int n)
+{
+	for (int i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			double tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+			tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+		}
+	}
+
+	for (int len = 2; len <= n; len <<= 1) {
+		const double angle = -2.0 * M_PI / len;
+		const double w_re = cos(angle);
+		const double w_im = sin(angle);
+		for (int i = 0; i < n; i += len) {
+			double u_re = 1.0;
+			double u_im = 0.0;
+			for (int k = 0; k < len / 2; k++) {
+				const int a = i + k;
+				const int b = i + k + len / 2;
+				const double t_re = re[b] * u_re - im[b] * u_im;
+				const double t_im = re[b] * u_im + im[b] * u_re;
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+				const double next_re = u_re * w_re - u_im * w_im;
+				u_im = u_re * w_im + u_im * w_re;
+				u_re = next_re;
+			}
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Measure occupied bandwidth and key-click sidebands
+
+   @param[in] psd power spectral density, SPECTRUM_FFT_SIZE / 2 + 1 bins
+   @param[in] sample_rate sample rate
+   @param[in] frequency frequency of tone [Hz]
+   @param[in/out] result results of measurements
+*/
+static void spectrum_analyze_psd(const double * psd, int sample_rate, int frequency, spectrum_result_t * result)
+{
+	const int n_bins = SPECTRUM_FFT_SIZE / 2 + 1;
+	const double bin_width = (double) sample_rate / SPECTRUM_FFT_SIZE;
+
+	double total = 0.0;
+	for (int i = 0; i < n_bins; i++) {
+		total += psd[i];
+	}
+
+	/* Occupied bandwidth: cut off (1 - SPECTRUM_OBW_PART) / 2 of
+	   power on each side of spectrum. */
+	const double cut = total * (1.0 - SPECTRUM_OBW_PART) / 2.0;
+	int low = 0;
+	for (double sum = 0.0; low < n_bins - 1 && sum + psd[low] < cut; low++) {
+		sum += psd[low];
+	}
+	int high = n_bins - 1;
+	for (double sum = 0.0; high > low && sum + psd[high] < cut; high--) {
+		sum += psd[high];
+	}
+	result->obw = (high - low + 1) * bin_width;
+
+	/* Level of tone: the strongest bin near frequency of tone. */
+	const int tone_bin = (int) lround(frequency / bin_width);
+	double carrier = 0.0;
+	for (int i = tone_bin - 2; i <= tone_bin + 2; i++) {
+		if (i >= 0 && i < n_bins && psd[i] > carrier) {
+			carrier = psd[i];
+		}
+	}
+
+	for (int k = 0; k < SPECTRUM_N_OFFSETS; k++) {
+		const double offset = spectrum_offsets[k];
+		double strongest = 0.0;
+		for (int i = 0; i < n_bins; i++) {
+			if (fabs(i * bin_width - frequency) >= offset && psd[i] > strongest) {
+				strongest = psd[i];
+			}
+		}
+		result->sidebands[k] = (carrier > 0.0 && strongest > 0.0) ? 10.0 * log10(strongest / carrier) : -200.0;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current time of monotonic clock [s]
+*/
+static double spectrum_seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+
+
+/**
+   @brief Get label of shape of slopes, used in output of the program
+*/
+static const char * spectrum_shape_label(int shape)
+{
+	switch (shape) {
+	case CW_TONE_SLOPE_SHAPE_LINEAR:
+		return "linear";
+	case CW_TONE_SLOPE_SHAPE_RAISED_COSINE:
+		return "raised_cosine";
+	case CW_TONE_SLOPE_SHAPE_SINE:
+		return "sine";
+	case CW_TONE_SLOPE_SHAPE_RECTANGULAR:
+		return "rectangular";
+	default:
+		return "unknown";
+	}
+}
+
+
+
+
+/**
+   @brief Print results of measurements of one shape and duration of slopes
+
+   @param[in] result results to print
+   @param[in] format output format
+   @param[in] is_first whether this is the first printed result
+*/
+static void spectrum_print_result(const spectrum_result_t * result, spectrum_format_t format, bool is_first)
+{
+	if (SPECTRUM_FORMAT_CSV == format) {
+		printf("%s,%d,%zu,%ld,%d,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.4f,%.0f,%.1f\n",
+		       spectrum_shape_label(result->shape), result->slope_duration,
+		       result->n_samples, result->samples_error,
+		       result->n_marks, result->n_marks_expected,
+		       result->max_start_error, result->max_duration_error, result->timing_ok ? 1 : 0,
+		       result->obw, result->sidebands[0], result->sidebands[1], result->sidebands[2],
+		       result->render_time, result->samples_per_second, result->realtime_factor);
+	} else {
+		printf("%s\n    { \"shape\": \"%s\", \"slope_us\": %d, \"samples\": %zu, \"samples_error\": %ld, "
+		       "\"marks\": %d, \"marks_expected\": %d, \"max_start_error\": %d, \"max_duration_error\": %d, \"timing_ok\": %s, "
+		       "\"obw_hz\": %.1f, \"sidebands_dbc\": { \"%d\": %.1f, \"%d\": %.1f, \"%d\": %.1f }, "
+		       "\"render_s\": %.4f, \"samples_per_s\": %.0f, \"realtime_factor\": %.1f }",
+		       is_first ? "" : ",",
+		       spectrum_shape_label(result->shape), result->slope_duration,
+		       result->n_samples, result->samples_error,
+		       result->n_marks, result->n_marks_expected,
+		       result->max_start_error, result->max_duration_error, result->timing_ok ? "true" : "false",
+		       result->obw,
+		       spectrum_offsets[0], result->sidebands[0],
+		       spectrum_offsets[1], result->sidebands[1],
+		       spectrum_offsets[2], result->sidebands[2],
+		       result->render_time, result->samples_per_second, result->realtime_factor);
+	}
+	fflush(stdout);
+}
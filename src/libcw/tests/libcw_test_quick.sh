@@ -1,2 +1,2 @@
 #!/bin/sh
-./libcw_tests -Q -S n -L 1 | grep "Test result: success"
+./libcw_tests -Q -S n -L 1 -U | grep "Test result: success"
@@ -27,6 +27,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 
 
 
@@ -42,6 +44,7 @@
 #include "libcw_tq_internal.h"
 #include "libcw_tq_tests.h"
 #include "libcw_debug.h"
+#include "libcw_signal.h"
 #include "test_framework.h"
 
 
@@ -62,6 +65,10 @@ static void enqueue_tone_low_level(cw_test_executor_t * cte, cw_tone_queue_t * t
 static cw_tone_queue_t * test_cw_tq_capacity_test_init(cw_test_executor_t * cte, size_t capacity, size_t high_water_mark, int head_shift);
 static void test_helper_tq_callback(void * data);
 static cwt_retv test_helper_fill_queue(cw_test_executor_t * cte, cw_tone_queue_t * tq, size_t count);
+static void * test_helper_spsc_producer(void * arg);
+static void * test_helper_waiter(void * arg);
+static int test_helper_count_waiters(cw_tone_queue_t * tq);
+static void test_helper_enqueue_character(cw_tone_queue_t * tq, char character);
 
 
 
@@ -701,7 +708,7 @@ cwt_retv test_cw_tq_is_full_internal_while_dequeueing(cw_test_executor_t * cte)
 int test_cw_tq_test_capacity_A(cw_test_executor_t * cte)
 {
 	/* We don't need to check tq with capacity ==
-	   CW_TONE_QUEUE_CAPACITY_MAX (yet). Let's test a smaller
+	   CW_TONE_QUEUE_CAPACITY_DEFAULT (yet). Let's test a smaller
 	   queue capacity. */
 	const size_t capacity = (lrand48() % 40) + 30;
 	const size_t watermark = capacity - (capacity * 0.2);
@@ -818,7 +825,7 @@ int test_cw_tq_test_capacity_A(cw_test_executor_t * cte)
 int test_cw_tq_test_capacity_B(cw_test_executor_t * cte)
 {
 	/* We don't need to check tq with capacity ==
-	   CW_TONE_QUEUE_CAPACITY_MAX (yet). Let's test a smaller
+	   CW_TONE_QUEUE_CAPACITY_DEFAULT (yet). Let's test a smaller
 	   queue. */
 	const size_t capacity = (lrand48() % 40) + 30;
 	const size_t watermark = capacity - (capacity * 0.2);
@@ -992,7 +999,7 @@ cw_tone_queue_t * test_cw_tq_capacity_test_init(cw_test_executor_t * cte, size_t
 	/* Initialize *all* tones with known value. Do this manually,
 	   to be 100% sure that all tones in queue table have been
 	   initialized. */
-	for (int i = 0; i < CW_TONE_QUEUE_CAPACITY_MAX; i++) {
+	for (size_t i = 0; i < tq->n_slots; i++) {
 		CW_TONE_INIT(&tq->queue[i], 10000 + i, 1, CW_SLOPE_MODE_STANDARD_SLOPES);
 	}
 
@@ -1134,6 +1141,14 @@ cwt_retv test_cw_tq_wait_for_level_internal(cw_test_executor_t * cte)
 
 	cw_gen_t * gen = NULL;
 
+	/* The queue is filled and its length is checked while the
+	   generator dequeues tones of 10 ms. On virtual clock the
+	   tones may end while this thread is still enqueueing, so this
+	   test must run in real time. */
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_disable_internal();
+	}
+
 	for (int i = 0; i < loops; i++) {
 		gen = cw_gen_new(&cte->current_gen_conf);
 		cte->assert2(cte, gen, "failed to create a tone queue\n");
@@ -1141,6 +1156,9 @@ cwt_retv test_cw_tq_wait_for_level_internal(cw_test_executor_t * cte)
 
 		if (cwt_retv_ok != test_helper_fill_queue(cte, gen->tq, loops)) {
 			cte->log_error(cte, "%s:%d: failed to fill tone queue\n", __func__, __LINE__);
+			if (cte->config->test_virtual_time) {
+				cw_virtual_clock_enable_internal();
+			}
 			return cwt_retv_err;
 		}
 
@@ -1183,6 +1201,10 @@ cwt_retv test_cw_tq_wait_for_level_internal(cw_test_executor_t * cte)
 		cw_gen_delete(&gen);
 	}
 
+	if (cte->config->test_virtual_time) {
+		cw_virtual_clock_enable_internal();
+	}
+
 	cte->print_test_footer(cte, __func__);
 
 	return cwt_retv_ok;
@@ -1501,7 +1523,7 @@ cwt_retv test_cw_tq_properties_empty(cw_test_executor_t * cte)
 		/* Capacity of queue should always be the same. */
 		const int capacity = LIBCW_TEST_FUT(cw_tq_capacity_internal)(tq);
 		if (!cte->expect_op_int_errors_only(cte,
-						    CW_TONE_QUEUE_CAPACITY_MAX, "==", capacity,
+						    CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", capacity,
 						    "%s:%d: empty queue's capacity",
 						    __func__, __LINE__)) {
 			failure_capacity = true;
@@ -1598,14 +1620,14 @@ cwt_retv test_cw_tq_properties_full(cw_test_executor_t * cte)
 
 	const size_t capacity = LIBCW_TEST_FUT(cw_tq_capacity_internal)(tq);
 	cte->expect_op_int(cte,
-			   CW_TONE_QUEUE_CAPACITY_MAX, "==", capacity,
+			   CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", capacity,
 			   "%s:%d: full queue's capacity",
 			   __func__, __LINE__);
 
 
 	const size_t len_full = LIBCW_TEST_FUT(cw_tq_length_internal)(tq);
 	cte->expect_op_int(cte,
-			   CW_TONE_QUEUE_CAPACITY_MAX, "==", len_full,
+			   CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", len_full,
 			   "%s:%d: full queue's length",
 			   __func__, __LINE__);
 
@@ -1839,3 +1861,614 @@ cwt_retv test_cw_tq_dequeue_internal_returns(cw_test_executor_t * cte)
 	return cwt_retv_ok;
 }
 
+
+
+
+
+/**
+   @brief Test enqueueing of array of tones with single call
+
+   Either all tones from array are enqueued, or none of them.
+*/
+cwt_retv test_cw_tq_enqueue_batch_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	for (int spsc = 0; spsc <= 1; spsc++) {
+		cw_tone_queue_t * tq = cw_tq_new_internal();
+		cte->assert2(cte, tq, "failed to create new tone queue");
+		cw_tq_set_spsc_mode_internal(tq, spsc);
+
+		cw_tone_t tones[10];
+		for (int i = 0; i < 10; i++) {
+			CW_TONE_INIT(&tones[i], 100 + i, 1000 * (i + 1), CW_SLOPE_MODE_NO_SLOPES);
+		}
+		tones[3].duration = 0; /* This tone should be skipped. */
+
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_enqueue_batch_internal)(tq, tones, 10);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueue batch of valid tones (spsc = %d)", spsc);
+		cte->expect_op_int(cte, 9, "==", (int) cw_tq_length_internal(tq), "length after enqueueing batch (spsc = %d)", spsc);
+		cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", tq->state, "state after enqueueing batch (spsc = %d)", spsc);
+
+		/* Invalid tone in batch: nothing is enqueued. */
+		tones[5].frequency = CW_FREQUENCY_MAX + 1;
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_tq_enqueue_batch_internal)(tq, tones, 10);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueue batch with invalid tone (spsc = %d)", spsc);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing batch with invalid tone (spsc = %d)", spsc);
+		cte->expect_op_int(cte, 9, "==", (int) cw_tq_length_internal(tq), "length after enqueueing batch with invalid tone (spsc = %d)", spsc);
+		tones[5].frequency = 105;
+
+		/* Batch that doesn't fit into queue: nothing is enqueued. */
+		cw_tq_set_capacity_internal(tq, 12, 12);
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_tq_enqueue_batch_internal)(tq, tones, 10);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueue batch into too short queue (spsc = %d)", spsc);
+		cte->expect_op_int(cte, EAGAIN, "==", errno, "errno after enqueueing batch into too short queue (spsc = %d)", spsc);
+		cte->expect_op_int(cte, 9, "==", (int) cw_tq_length_internal(tq), "length after enqueueing batch into too short queue (spsc = %d)", spsc);
+
+		/* Tones are dequeued in order in which they were in batch. */
+		bool failure = false;
+		for (int i = 0; i < 10; i++) {
+			if (3 == i) {
+				continue;
+			}
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(tq, &tone);
+			if (tone.frequency != 100 + i) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "order of dequeued tones (spsc = %d)", spsc);
+
+		cw_tq_delete_internal(&tq);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test configuration of capacity and lazy allocation of tone queue
+
+   Lazily allocated ring of tones must grow when tones are enqueued, and
+   tones must be dequeued in correct order also when the ring grows while
+   its contents are wrapped around end of the ring.
+*/
+cwt_retv test_cw_tq_configure_capacity_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	const size_t capacity = 10000;
+	const int n_tones = 5000;
+	const int n_dequeued_early = 30;
+
+	for (int spsc = 0; spsc <= 1; spsc++) {
+		cw_tone_queue_t * tq = cw_tq_new_internal();
+		cte->assert2(cte, tq, "failed to create new tone queue");
+		cw_tq_set_spsc_mode_internal(tq, spsc);
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", (int) tq->n_slots, "default count of slots (spsc = %d)", spsc);
+
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_configure_capacity_internal)(tq, CW_TONE_QUEUE_CAPACITY_LIMIT + 1, true);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "configuring too large capacity (spsc = %d)", spsc);
+		cte->expect_op_int(cte, CW_TONE_QUEUE_CAPACITY_DEFAULT, "==", (int) cw_tq_capacity_internal(tq), "capacity after failed configuration (spsc = %d)", spsc);
+
+		cwret = LIBCW_TEST_FUT(cw_tq_configure_capacity_internal)(tq, capacity, true);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "configuring lazy allocation (spsc = %d)", spsc);
+		cte->expect_op_int(cte, (int) capacity, "==", (int) cw_tq_capacity_internal(tq), "capacity after configuration (spsc = %d)", spsc);
+		cte->expect_op_int(cte, CW_TONE_QUEUE_N_SLOTS_INITIAL, "==", (int) tq->n_slots, "initial count of slots (spsc = %d)", spsc);
+
+		/* Move head away from beginning of the ring, so that tones
+		   are wrapped around end of the ring when the ring grows. */
+		int n_enqueued = 0;
+		int n_expected = 0;
+		bool failure = false;
+		for (; n_enqueued < CW_TONE_QUEUE_N_SLOTS_INITIAL - 5; n_enqueued++) {
+			cw_tone_t tone;
+			CW_TONE_INIT(&tone, 500, n_enqueued + 1, CW_SLOPE_MODE_NO_SLOPES);
+			if (CW_SUCCESS != cw_tq_enqueue_internal(tq, &tone)) {
+				failure = true;
+			}
+		}
+		for (; n_expected < n_dequeued_early; n_expected++) {
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(tq, &tone);
+			if (tone.duration != n_expected + 1) {
+				failure = true;
+			}
+		}
+		for (; n_enqueued < n_tones; n_enqueued++) {
+			cw_tone_t tone;
+			CW_TONE_INIT(&tone, 500, n_enqueued + 1, CW_SLOPE_MODE_NO_SLOPES);
+			if (CW_SUCCESS != LIBCW_TEST_FUT(cw_tq_enqueue_internal)(tq, &tone)) {
+				failure = true;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "enqueueing tones to lazily allocated queue (spsc = %d)", spsc);
+		cte->expect_op_int(cte, n_tones - n_dequeued_early, "==", (int) cw_tq_length_internal(tq), "length of grown queue (spsc = %d)", spsc);
+		cte->expect_op_int(cte, (int) tq->n_slots, ">=", n_tones - n_dequeued_early, "count of slots of grown queue (spsc = %d)", spsc);
+		cte->expect_op_int(cte, (int) tq->n_slots, "<=", (int) capacity, "count of slots of grown queue (spsc = %d)", spsc);
+
+		/* Queue with this many tones can't be shrunk below its length. */
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_tq_configure_capacity_internal)(tq, 100, true);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "configuring capacity smaller than length (spsc = %d)", spsc);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after configuring capacity smaller than length (spsc = %d)", spsc);
+
+		for (; n_expected < n_tones; n_expected++) {
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(tq, &tone);
+			if (tone.duration != n_expected + 1) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "order of tones dequeued from grown queue (spsc = %d)", spsc);
+
+		/* Without lazy allocation the ring has all slots up front. */
+		cwret = LIBCW_TEST_FUT(cw_tq_configure_capacity_internal)(tq, capacity, false);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "configuring eager allocation (spsc = %d)", spsc);
+		cte->expect_op_int(cte, (int) capacity, "==", (int) tq->n_slots, "count of slots with eager allocation (spsc = %d)", spsc);
+
+		cw_tq_delete_internal(&tq);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test coalescing of consecutive tones in tone queue
+
+   Silent tones at the end of a character should be merged into one tone,
+   but a tone starting a character, or tones with slopes, should not.
+*/
+cwt_retv test_cw_tq_coalescing_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	for (int spsc = 0; spsc <= 1; spsc++) {
+		cw_tone_queue_t * tq = cw_tq_new_internal();
+		cte->assert2(cte, tq, "failed to create new tone queue");
+		cw_tq_set_spsc_mode_internal(tq, spsc);
+		LIBCW_TEST_FUT(cw_tq_set_coalescing_internal)(tq, true);
+
+		/* Two characters, each with two marks. Every mark is
+		   followed by inter-mark-space, and every character is
+		   followed by inter-character-space. */
+		const int n = 12;
+		cw_tone_t tones[12];
+		for (int c = 0; c < 2; c++) {
+			cw_tone_t * t = &tones[c * 6];
+			CW_TONE_INIT(&t[0], 600, 100, CW_SLOPE_MODE_STANDARD_SLOPES);
+			t[0].is_first = true;
+			CW_TONE_INIT(&t[1], 0, 100, CW_SLOPE_MODE_NO_SLOPES);
+			CW_TONE_INIT(&t[2], 600, 300, CW_SLOPE_MODE_STANDARD_SLOPES);
+			CW_TONE_INIT(&t[3], 0, 100, CW_SLOPE_MODE_NO_SLOPES);
+			CW_TONE_INIT(&t[4], 0, 200, CW_SLOPE_MODE_NO_SLOPES);
+			CW_TONE_INIT(&t[5], 0, 0, CW_SLOPE_MODE_NO_SLOPES); /* Ignored empty tone. */
+		}
+
+		/* Enqueue first character in one batch, and second
+		   character tone by tone. */
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_enqueue_batch_internal)(tq, tones, 6);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing first character (spsc = %d)", spsc);
+		cte->expect_op_int(cte, 4, "==", (int) cw_tq_length_internal(tq), "length after enqueueing first character (spsc = %d)", spsc);
+		for (int i = 6; i < n; i++) {
+			cwret = LIBCW_TEST_FUT(cw_tq_enqueue_internal)(tq, &tones[i]);
+			cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueueing tone #%d (spsc = %d)", i, spsc);
+		}
+		/* In SPSC mode tones from separate calls are not merged. */
+		const int expected_len = spsc ? 9 : 8;
+		cte->expect_op_int(cte, expected_len, "==", (int) cw_tq_length_internal(tq), "length after enqueueing second character (spsc = %d)", spsc);
+
+		/* Remove second character, and check that first one is
+		   intact: marks with slopes are kept separate, and spaces
+		   are merged. */
+		const int expected_durations[4] = { 100, 100, 300, 300 };
+		cwret = LIBCW_TEST_FUT(cw_tq_remove_last_character_internal)(tq);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "removing last character (spsc = %d)", spsc);
+		cte->expect_op_int(cte, 4, "==", (int) cw_tq_length_internal(tq), "length after removing last character (spsc = %d)", spsc);
+
+		bool failure = false;
+		for (int i = 0; i < 4; i++) {
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(tq, &tone);
+			if (tone.duration != expected_durations[i]) {
+				cte->log_error(cte, "tone #%d: unexpected duration %d != %d\n", i, tone.duration, expected_durations[i]);
+				failure = true;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "durations of dequeued tones (spsc = %d)", spsc);
+
+		cw_tq_delete_internal(&tq);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Count of tones passed from producer to consumer in SPSC test. The count is
+   larger than capacity of queue, so that indices of queue wrap around few
+   times, and producer sometimes finds the queue full. */
+#define TEST_SPSC_N_TONES (5 * CW_TONE_QUEUE_CAPACITY_DEFAULT)
+
+
+
+
+typedef struct {
+	cw_tone_queue_t * tq;
+	int n_enqueue_failures; /* Failures other than "tq is full". */
+} test_spsc_producer_t;
+
+
+
+
+/**
+   @brief Producer thread for SPSC test: enqueue tones with consecutive durations
+*/
+static void * test_helper_spsc_producer(void * arg)
+{
+	test_spsc_producer_t * producer = (test_spsc_producer_t *) arg;
+
+	for (int i = 1; i <= TEST_SPSC_N_TONES; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 100, i, CW_SLOPE_MODE_NO_SLOPES);
+		while (CW_SUCCESS != cw_tq_enqueue_internal(producer->tq, &tone)) {
+			if (EAGAIN != errno) {
+				producer->n_enqueue_failures++;
+				break;
+			}
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Test tone queue working in single-producer/single-consumer mode
+
+   Tones enqueued by one thread must be dequeued by other thread in the
+   same order, without losses, and queue must go through the same states as
+   in default mode.
+*/
+cwt_retv test_cw_tq_spsc_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_tone_queue_t * tq = cw_tq_new_internal();
+	cte->assert2(cte, tq, "failed to create new tone queue");
+	const cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_set_spsc_mode_internal)(tq, true);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enabling SPSC mode");
+
+
+	/* States of queue: the same as in default mode. */
+	{
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 100, 100, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(tq, &tone);
+		cw_tq_enqueue_internal(tq, &tone);
+		cte->expect_op_int(cte, 2, "==", (int) cw_tq_length_internal(tq), "length after enqueueing two tones");
+
+		cw_queue_state_t state = LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", state, "state after dequeueing first of two tones");
+		state = LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		cte->expect_op_int(cte, CW_TQ_JUST_EMPTIED, "==", state, "state after dequeueing last tone");
+		state = LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		cte->expect_op_int(cte, CW_TQ_EMPTY, "==", state, "state after dequeueing from just emptied queue");
+
+		/* "Forever" tone stays in queue. */
+		tone.is_forever = true;
+		cw_tq_enqueue_internal(tq, &tone);
+		state = LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", state, "state after dequeueing 'forever' tone (1)");
+		state = LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", state, "state after dequeueing 'forever' tone (2)");
+		cte->expect_op_int(cte, 1, "==", (int) cw_tq_length_internal(tq), "length of queue with 'forever' tone");
+
+		/* Flush works in SPSC mode too. */
+		cw_tq_flush_internal(tq);
+		cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(tq), "length after flush");
+		cte->expect_op_int(cte, CW_TQ_EMPTY, "==", tq->state, "state after flush");
+	}
+
+
+	/* Concurrent producer and consumer. */
+	{
+		test_spsc_producer_t producer = { .tq = tq, .n_enqueue_failures = 0 };
+		pthread_t thread_id;
+		pthread_create(&thread_id, NULL, test_helper_spsc_producer, &producer);
+
+		int n_dequeued = 0;
+		int n_out_of_order = 0;
+		while (n_dequeued < TEST_SPSC_N_TONES) {
+			cw_tone_t tone;
+			const cw_queue_state_t state = cw_tq_dequeue_internal(tq, &tone);
+			if (CW_TQ_EMPTY == state) {
+				/* Nothing was dequeued. */
+				sched_yield();
+				continue;
+			}
+			n_dequeued++;
+			if (tone.duration != n_dequeued) {
+				n_out_of_order++;
+			}
+		}
+		pthread_join(thread_id, NULL);
+
+		cte->expect_op_int(cte, 0, "==", producer.n_enqueue_failures, "enqueue failures in producer thread");
+		cte->expect_op_int(cte, 0, "==", n_out_of_order, "tones dequeued out of order");
+		cte->expect_op_int(cte, 0, "==", (int) cw_tq_length_internal(tq), "length of queue after dequeueing all tones");
+
+		cw_tone_t tone;
+		cw_queue_state_t state = cw_tq_dequeue_internal(tq, &tone);
+		if (CW_TQ_JUST_EMPTIED == state) {
+			state = cw_tq_dequeue_internal(tq, &tone);
+		}
+		cte->expect_op_int(cte, CW_TQ_EMPTY, "==", state, "final state of queue");
+	}
+
+	cw_tq_delete_internal(&tq);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+typedef struct {
+	cw_tone_queue_t * tq;
+	cw_tq_wait_condition_t condition;
+	size_t level;
+} test_waiter_t;
+
+
+
+
+/**
+   @brief Thread waiting on tone queue for condition given in @p arg
+*/
+static void * test_helper_waiter(void * arg)
+{
+	test_waiter_t * waiter = (test_waiter_t *) arg;
+
+	switch (waiter->condition) {
+	case CW_TQ_WAIT_LEVEL:
+		cw_tq_wait_for_level_internal(waiter->tq, waiter->level);
+		break;
+	case CW_TQ_WAIT_TONE_END:
+		cw_tq_wait_for_end_of_current_tone_internal(waiter->tq);
+		break;
+	case CW_TQ_WAIT_KEYER_IDLE: /* Not used by tests of tone queue. */
+	case CW_TQ_WAIT_EMPTY:
+	default:
+		cw_tq_wait_for_empty_internal(waiter->tq);
+		break;
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Get count of threads on list of waiters of tone queue
+*/
+static int test_helper_count_waiters(cw_tone_queue_t * tq)
+{
+	int count = 0;
+	pthread_mutex_lock(&tq->wait_mutex);
+	for (const cw_tq_waiter_t * waiter = tq->waiters; NULL != waiter; waiter = waiter->next) {
+		count++;
+	}
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return count;
+}
+
+
+
+
+/**
+   @brief Test that dequeueing wakes up only the waiters whose condition became true
+
+   Waiters are removed from list of waiters of a queue (under queue's
+   mutex) at the moment they are woken up, so the list can be inspected
+   right after each dequeue.
+*/
+cwt_retv test_cw_tq_targeted_wakeups_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_tone_queue_t * tq = cw_tq_new_internal();
+	cte->assert2(cte, tq, "failed to create new tone queue");
+
+	/* Waiting for condition that is already true doesn't block. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_tq_wait_for_empty_internal)(tq), "wait for empty on empty queue");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_tq_wait_for_level_internal)(tq, 0), "wait for level on empty queue");
+	cte->expect_op_int(cte, 0, "==", test_helper_count_waiters(tq), "count of waiters after non-blocking waits");
+
+	const int n_tones = 5;
+	for (int i = 0; i < n_tones; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 100, 100, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(tq, &tone);
+	}
+
+	test_waiter_t waiters[] = {
+		{ .tq = tq, .condition = CW_TQ_WAIT_LEVEL, .level = 2 },
+		{ .tq = tq, .condition = CW_TQ_WAIT_TONE_END },
+		{ .tq = tq, .condition = CW_TQ_WAIT_EMPTY }
+	};
+	const int n_waiters = (int) (sizeof (waiters) / sizeof (waiters[0]));
+	pthread_t thread_ids[sizeof (waiters) / sizeof (waiters[0])];
+	for (int i = 0; i < n_waiters; i++) {
+		pthread_create(&thread_ids[i], NULL, test_helper_waiter, &waiters[i]);
+	}
+	while (test_helper_count_waiters(tq) != n_waiters) {
+		sched_yield();
+	}
+
+	/* Enqueueing doesn't make any condition true. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 100, 100, CW_SLOPE_MODE_NO_SLOPES);
+	cw_tq_enqueue_internal(tq, &tone);
+	cte->expect_op_int(cte, n_waiters, "==", test_helper_count_waiters(tq), "count of waiters after enqueue");
+
+	/* Expected count of waiters left on the list after each dequeue:
+	   first dequeue ends current tone, dequeue down to level 2 wakes up
+	   level waiter, and dequeue from just emptied queue wakes up the
+	   last one. */
+	const int expected[] = { 2, 2, 2, 1, 1, 1, 0 };
+	bool failure = false;
+	for (size_t i = 0; i < sizeof (expected) / sizeof (expected[0]); i++) {
+		cw_tq_dequeue_internal(tq, &tone);
+		const int count = test_helper_count_waiters(tq);
+		if (!cte->expect_op_int_errors_only(cte, expected[i], "==", count, "count of waiters after dequeue #%zu", i)) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "waiters woken up by dequeues");
+	cte->expect_op_int(cte, CW_TQ_EMPTY, "==", tq->state, "state of queue after dequeues");
+
+	if (failure) {
+		/* Don't leave threads waiting forever. */
+		cw_tq_flush_internal(tq);
+	}
+	for (int i = 0; i < n_waiters; i++) {
+		pthread_join(thread_ids[i], NULL);
+	}
+
+	cw_tq_delete_internal(&tq);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Enqueue tones of one character (or of inter-word-space) in tone queue
+
+   A character is a mark followed by a space, inter-word-space is a single
+   space. First tone of the character is marked with the character.
+*/
+static void test_helper_enqueue_character(cw_tone_queue_t * tq, char character)
+{
+	cw_tone_t tones[2];
+	size_t n_tones = 0;
+
+	if (' ' != character) {
+		CW_TONE_INIT(&tones[n_tones], 600, 100, CW_SLOPE_MODE_NO_SLOPES);
+		n_tones++;
+	}
+	CW_TONE_INIT(&tones[n_tones], 0, 100, CW_SLOPE_MODE_NO_SLOPES);
+	n_tones++;
+
+	tones[0].is_first = true;
+	tones[0].character = character;
+	cw_tq_enqueue_batch_internal(tq, tones, n_tones);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Test index of characters in tone queue
+
+   Removing last character or word, getting position of played character
+   and skipping of played character are all done with the index.
+*/
+cwt_retv test_cw_tq_char_index_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	for (int spsc = 0; spsc <= 1; spsc++) {
+		cw_tone_queue_t * tq = cw_tq_new_internal();
+		cte->assert2(cte, tq, "failed to create new tone queue");
+		cw_tq_set_spsc_mode_internal(tq, spsc);
+
+		/* "ab c ": 2 + 2 + 1 + 2 + 1 tones. */
+		const char * text = "ab c ";
+		for (size_t i = 0; i < strlen(text); i++) {
+			test_helper_enqueue_character(tq, text[i]);
+		}
+		cte->expect_op_int(cte, 8, "==", (int) cw_tq_length_internal(tq), "spsc = %d: length after enqueueing text", spsc);
+
+		char character = '\0';
+		size_t offset = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_get_playing_position_internal)(tq, &character, &offset);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "spsc = %d: playing position before playing", spsc);
+
+		/* Word and trailing inter-word-space are removed, space before the word is kept. */
+		cwret = LIBCW_TEST_FUT(cw_tq_remove_last_word_internal)(tq);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "spsc = %d: remove last word", spsc);
+		cte->expect_op_int(cte, 5, "==", (int) cw_tq_length_internal(tq), "spsc = %d: length after removing last word", spsc);
+
+		test_helper_enqueue_character(tq, 'd');
+		cwret = LIBCW_TEST_FUT(cw_tq_remove_last_character_internal)(tq);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "spsc = %d: remove last character", spsc);
+		cte->expect_op_int(cte, 5, "==", (int) cw_tq_length_internal(tq), "spsc = %d: length after removing last character", spsc);
+
+		/* Dequeue tones of 'a' and first tone of 'b'. */
+		const char expected_characters[] = { 'a', 'a', 'b' };
+		for (int i = 0; i < 3; i++) {
+			cw_tone_t tone;
+			cw_tq_dequeue_internal(tq, &tone);
+			cwret = LIBCW_TEST_FUT(cw_tq_get_playing_position_internal)(tq, &character, &offset);
+			cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "spsc = %d: get playing position after %d dequeues", spsc, i + 1);
+			cte->expect_op_int(cte, expected_characters[i], "==", character, "spsc = %d: playing character after %d dequeues", spsc, i + 1);
+			cte->expect_op_int(cte, i < 2 ? 0 : 1, "==", (int) offset, "spsc = %d: playing offset after %d dequeues", spsc, i + 1);
+		}
+
+		/* Skip the rest of 'b': next tone is the inter-word-space. */
+		cwret = LIBCW_TEST_FUT(cw_tq_skip_current_character_internal)(tq);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "spsc = %d: skip current character", spsc);
+		cte->expect_op_int(cte, 1, "==", (int) cw_tq_length_internal(tq), "spsc = %d: length after skipping", spsc);
+
+		cw_tone_t tone;
+		cw_tq_dequeue_internal(tq, &tone);
+		cte->expect_op_int(cte, ' ', "==", tone.character, "spsc = %d: tone dequeued after skipping", spsc);
+		cwret = cw_tq_get_playing_position_internal(tq, &character, &offset);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "spsc = %d: get playing position after skipping", spsc);
+		cte->expect_op_int(cte, ' ', "==", character, "spsc = %d: playing character after skipping", spsc);
+		cte->expect_op_int(cte, 2, "==", (int) offset, "spsc = %d: playing offset after skipping", spsc);
+
+		/* Character that has started playing can't be removed. */
+		cwret = cw_tq_remove_last_character_internal(tq);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "spsc = %d: remove played character", spsc);
+		cwret = cw_tq_remove_last_word_internal(tq);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "spsc = %d: remove played word", spsc);
+
+		cw_tq_delete_internal(&tq);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -40,6 +40,12 @@ cwt_retv test_cw_tq_properties_empty(cw_test_executor_t * cte);
 cwt_retv test_cw_tq_properties_full(cw_test_executor_t * cte);
 
 cwt_retv test_cw_tq_dequeue_internal_returns(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_enqueue_batch_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_configure_capacity_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_coalescing_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_spsc_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_targeted_wakeups_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_char_index_internal(cw_test_executor_t * cte);
 
 
 
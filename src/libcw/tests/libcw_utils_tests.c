@@ -20,12 +20,20 @@
 
 
 
+#include "config.h"
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO) || defined(LIBCW_WITH_JACK))
+#include <dlfcn.h> /* dlclose() */
+#endif
 
 
 
@@ -37,7 +45,9 @@
 
 
 #include "libcw_debug.h"
+#include "libcw_gen.h"
 #include "libcw_key.h"
+#include "libcw_signal.h"
 #include "libcw_utils.h"
 #include "libcw_utils_tests.h"
 #include "test_framework.h"
@@ -103,9 +113,10 @@ int test_cw_timestamp_validate_internal(cw_test_executor_t * cte)
 
 	/* Test 1 - get current time. */
 	{
-		/* Get reference time through gettimeofday(). */
+		/* Get reference time through gettimeofday() (or from
+		   virtual clock, if tests run on virtual clock). */
 		struct timeval ref_timestamp = { 0, 0 }; /* Reference timestamp. */
-		cte->assert2(cte, 0 == gettimeofday(&ref_timestamp, NULL), "failed to get reference time");
+		cw_clock_get_timeval_internal(&ref_timestamp);
 
 		/* Get current time through libcw function. */
 		struct timeval out_timestamp = { 0, 0 };
@@ -303,3 +314,231 @@ int test_cw_license_internal(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+typedef struct {
+	int order[4];
+	int n_calls;
+} timer_service_test_data_t;
+
+typedef struct {
+	timer_service_test_data_t * data;
+	int label;
+} timer_service_test_arg_t;
+
+static void test_cw_timer_service_callback(void * arg)
+{
+	timer_service_test_arg_t * test_arg = (timer_service_test_arg_t *) arg;
+	if (test_arg->data->n_calls < 4) {
+		test_arg->data->order[test_arg->data->n_calls] = test_arg->label;
+	}
+	test_arg->data->n_calls++;
+}
+
+
+
+
+/**
+   Several timers of timer service run concurrently, expire in order
+   of their deadlines, can be cancelled, and don't touch SIGALRM.
+*/
+int test_cw_timer_service_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	struct sigaction before;
+	sigaction(SIGALRM, NULL, &before);
+
+	timer_service_test_data_t data = { .order = { 0 }, .n_calls = 0 };
+	timer_service_test_arg_t args[4] = { { &data, 1 }, { &data, 2 }, { &data, 3 }, { &data, 4 } };
+
+	/* Started in different order than the order of expiration. */
+	const int id3 = LIBCW_TEST_FUT(cw_timer_start_internal)(30000, test_cw_timer_service_callback, &args[2]);
+	const int id1 = LIBCW_TEST_FUT(cw_timer_start_internal)(10000, test_cw_timer_service_callback, &args[0]);
+	const int id2 = LIBCW_TEST_FUT(cw_timer_start_internal)(20000, test_cw_timer_service_callback, &args[1]);
+	const int id4 = LIBCW_TEST_FUT(cw_timer_start_internal)(40000, test_cw_timer_service_callback, &args[3]);
+	cte->expect_op_int(cte, 0, "<=", id1, "start timer 1");
+	cte->expect_op_int(cte, 0, "<=", id2, "start timer 2");
+	cte->expect_op_int(cte, 0, "<=", id3, "start timer 3");
+	cte->expect_op_int(cte, 0, "<=", id4, "start timer 4");
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_timer_cancel_internal)(id4), "cancel timer 4");
+
+	usleep(150000);
+
+	cte->expect_op_int(cte, 3, "==", data.n_calls, "number of expired timers");
+	cte->expect_op_int(cte, 1, "==", data.order[0], "first expired timer");
+	cte->expect_op_int(cte, 2, "==", data.order[1], "second expired timer");
+	cte->expect_op_int(cte, 3, "==", data.order[2], "third expired timer");
+
+	/* Cancelling an expired timer is not an error. Cancelling a
+	   timer with invalid ID is. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_timer_cancel_internal)(id1), "cancel expired timer");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_timer_cancel_internal)(-1), "cancel invalid timer");
+	cte->expect_op_int(cte, -1, "==", LIBCW_TEST_FUT(cw_timer_start_internal)(1000, NULL, NULL), "start timer without callback");
+
+	struct sigaction after;
+	sigaction(SIGALRM, NULL, &after);
+	cte->expect_op_int(cte, true, "==", before.sa_handler == after.sa_handler, "SIGALRM disposition is not modified");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+static int64_t test_cw_virtual_clock_real_usecs(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * CW_USECS_PER_SEC + ts.tv_nsec / 1000;
+}
+
+
+
+
+/**
+   With virtual clock, timers, sleeps, timestamps and pacing of Null
+   generator follow virtual time, and don't wait in real time.
+*/
+int test_cw_virtual_clock_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cte->assert2(cte, CW_SUCCESS == LIBCW_TEST_FUT(cw_virtual_clock_enable_internal)(), "failed to enable virtual clock");
+
+	/* Timers expire in order of their deadlines while the test
+	   sleeps for a long (virtual) time.
+
+	   The timers are started in order of their deadlines: clock
+	   thread advances virtual time by itself when it hasn't moved
+	   for a while in real time, so on a busy machine it may move
+	   between two starts. The order of expiration is then kept, and
+	   all timers expire during the sleep. */
+	const int64_t real_begin = test_cw_virtual_clock_real_usecs();
+
+	timer_service_test_data_t data = { .order = { 0 }, .n_calls = 0 };
+	timer_service_test_arg_t args[3] = { { &data, 1 }, { &data, 2 }, { &data, 3 } };
+	cw_timer_start_internal(10 * CW_USECS_PER_SEC, test_cw_timer_service_callback, &args[0]);
+	cw_timer_start_internal(20 * CW_USECS_PER_SEC, test_cw_timer_service_callback, &args[1]);
+	cw_timer_start_internal(30 * CW_USECS_PER_SEC, test_cw_timer_service_callback, &args[2]);
+	int64_t virtual_begin = cw_monotonic_usecs_internal();
+	cw_usleep_internal(35 * CW_USECS_PER_SEC);
+
+	cte->expect_op_int(cte, 3, "==", data.n_calls, "number of expired timers");
+	cte->expect_op_int(cte, 1, "==", data.order[0], "first expired timer");
+	cte->expect_op_int(cte, 2, "==", data.order[1], "second expired timer");
+	cte->expect_op_int(cte, 3, "==", data.order[2], "third expired timer");
+	int64_t virtual_elapsed = cw_monotonic_usecs_internal() - virtual_begin;
+	cte->expect_op_int(cte, 35, "==", (int) (virtual_elapsed / CW_USECS_PER_SEC), "virtual time of sleep: %lld us", (long long) virtual_elapsed);
+
+	/* Timestamps taken by library follow virtual clock. */
+	struct timeval before = { 0 };
+	struct timeval after = { 0 };
+	cw_timestamp_validate_internal(&before, NULL);
+	cw_usleep_internal(CW_USECS_PER_SEC);
+	cw_timestamp_validate_internal(&after, NULL);
+	const int delta = cw_timestamp_compare_internal(&before, &after);
+	cte->expect_op_int(cte, CW_USECS_PER_SEC, "==", delta, "difference of timestamps: %d us", delta);
+
+	/* Ten seconds of tones played by Null generator. */
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cte->assert2(cte, NULL != gen, "failed to create generator");
+	cw_gen_start(gen);
+
+	virtual_begin = cw_monotonic_usecs_internal();
+	const int n_tones = 20;
+	const int tone_duration = CW_USECS_PER_SEC / 2;
+	for (int i = 0; i < n_tones; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, i % 2 ? 0 : 800, tone_duration, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(gen->tq, &tone);
+	}
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_wait_for_end_of_current_tone(gen);
+	virtual_elapsed = cw_monotonic_usecs_internal() - virtual_begin;
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	const int expected = n_tones * tone_duration;
+	cte->expect_op_int(cte, expected * 99 / 100, "<=", (int) virtual_elapsed, "virtual time of playback (lower bound): %lld us", (long long) virtual_elapsed);
+	cte->expect_op_int(cte, expected * 11 / 10, ">=", (int) virtual_elapsed, "virtual time of playback (upper bound): %lld us", (long long) virtual_elapsed);
+
+	/* 46 seconds of virtual time took much less of real time. */
+	const int64_t real_elapsed = test_cw_virtual_clock_real_usecs() - real_begin;
+	cte->expect_op_int(cte, 5 * CW_USECS_PER_SEC, ">", (int) real_elapsed, "real time of test: %lld us", (long long) real_elapsed);
+
+	if (!cte->config->test_virtual_time) {
+		/* The whole test program doesn't run on virtual clock,
+		   go back to real time. */
+		LIBCW_TEST_FUT(cw_virtual_clock_disable_internal)();
+
+		const int64_t real_sleep_begin = test_cw_virtual_clock_real_usecs();
+		cw_usleep_internal(20000);
+		const int64_t real_sleep = test_cw_virtual_clock_real_usecs() - real_sleep_begin;
+		cte->expect_op_int(cte, 20000, "<=", (int) real_sleep, "real time of sleep after disabling virtual clock");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test concurrent probing of sound systems
+*/
+int test_cw_probe_sound_systems(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	enum cw_audio_systems too_many[CW_PROBE_SOUND_SYSTEMS_MAX + 1] = { CW_AUDIO_NULL };
+	bool too_many_possible[CW_PROBE_SOUND_SYSTEMS_MAX + 1] = { false };
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_probe_sound_systems)(NULL, too_many, too_many_possible, CW_PROBE_SOUND_SYSTEMS_MAX + 1, 1000);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "probing too many sound systems");
+	cwret = LIBCW_TEST_FUT(cw_probe_sound_systems)(NULL, NULL, too_many_possible, 1, 1000);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "probing NULL sound systems");
+
+	/* SOUNDCARD is not a distinct sound system, it is never possible. */
+	const enum cw_audio_systems sound_systems[] = { CW_AUDIO_NULL, CW_AUDIO_SOUNDCARD, CW_AUDIO_FILE };
+	bool possible[] = { false, true, false };
+	cwret = LIBCW_TEST_FUT(cw_probe_sound_systems)("/dev/null", sound_systems, possible, 3, CW_PROBE_SOUND_SYSTEMS_TIMEOUT);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "probing sound systems");
+	cte->expect_op_int(cte, true, "==", possible[0], "Null sound system is possible");
+	cte->expect_op_int(cte, false, "==", possible[1], "SOUNDCARD is not possible");
+	cte->expect_op_int(cte, cw_is_file_possible("/dev/null"), "==", possible[2], "result of probing File sound system");
+
+	/* Probes that don't make it before deadline are reported as failed. */
+	cwret = LIBCW_TEST_FUT(cw_probe_sound_systems)(NULL, sound_systems, possible, 1, 0);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "probing with zero timeout");
+	/* Let the prober thread finish. */
+	cw_usleep_internal(100 * 1000);
+
+#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO) || defined(LIBCW_WITH_JACK))
+	/* Failed opening of library is cached, successful opening
+	   gives caller its own handle. */
+	void * handle = NULL;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_dlopen_internal)("libcw_no_such_library.so", &handle), "opening missing library");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_dlopen_internal)("libcw_no_such_library.so", &handle), "opening missing library again");
+	for (int i = 0; i < 3; i++) {
+		handle = NULL;
+		cwret = LIBCW_TEST_FUT(cw_dlopen_internal)("libm.so.6", &handle);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "opening library, attempt %d", i);
+		if (NULL != handle) {
+			dlclose(handle);
+		}
+	}
+#endif
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
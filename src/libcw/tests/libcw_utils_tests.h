@@ -19,6 +19,9 @@ int test_cw_timestamp_validate_internal(cw_test_executor_t * cte);
 int test_cw_usecs_to_timespec_internal(cw_test_executor_t * cte);
 int test_cw_version_internal(cw_test_executor_t * cte);
 int test_cw_license_internal(cw_test_executor_t * cte);
+int test_cw_timer_service_internal(cw_test_executor_t * cte);
+int test_cw_virtual_clock_internal(cw_test_executor_t * cte);
+int test_cw_probe_sound_systems(cw_test_executor_t * cte);
 
 
 
@@ -44,6 +44,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #ifndef __FreeBSD__
 #include <sys/sysinfo.h>
@@ -62,6 +64,7 @@
 
 #include "libcw.h"
 #include "libcw_debug.h"
+#include "libcw_signal.h"
 #include "cw_cmdline.h"
 
 #include "test_framework.h"
@@ -135,6 +138,10 @@ static bool cw_test_sound_system_is_member(cw_test_executor_t * cte, cw_sound_sy
 static cwt_retv cw_test_main_test_loop(cw_test_executor_t * cte, cw_test_set_t * test_sets);
 static unsigned int cw_test_get_total_errors_count(cw_test_executor_t * cte);
 
+static cwt_retv cw_test_resources_file_open(cw_test_executor_t * cte);
+static void cw_test_resources_file_append(cw_test_executor_t * cte, const char * test_name, const resource_meas_report_t * report);
+static void cw_test_resources_file_close(cw_test_executor_t * cte);
+
 
 
 
@@ -142,6 +149,31 @@ static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * te
 static cwt_retv iterate_over_sound_systems(cw_test_executor_t * cte, cw_test_set_t * test_set, int topic);
 static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_object_t * test_objects, int topic, cw_sound_system sound_system);
 
+static cwt_retv cw_test_main_test_loop_parallel(cw_test_executor_t * cte, cw_test_set_t * test_sets);
+static bool cw_test_set_has_topic(cw_test_executor_t * cte, cw_test_set_t * test_set, int topic);
+static bool cw_test_set_has_sound_system(cw_test_executor_t * cte, cw_test_set_t * test_set, cw_sound_system sound_system);
+
+
+
+
+/* Pair of (test set, sound system) executed by worker process in
+   parallel mode of main test loop. */
+typedef struct {
+	int set;                     /* Index of test set in array of test sets. */
+	cw_sound_system sound_system;
+	pid_t pid;                   /* Zero if worker is not running. */
+	bool done;
+	int result_fd;               /* Read end of pipe on which worker sends its cw_test_worker_result_t. */
+	FILE * log;                  /* Everything that the worker prints to stdout and stderr. */
+} cw_test_worker_t;
+
+/* Message sent by worker to parent process right before the worker
+   exits. It is small enough to be written atomically to a pipe. */
+typedef struct {
+	cwt_retv retv;
+	cw_test_stats_t stats[LIBCW_TEST_TOPIC_MAX];
+} cw_test_worker_result_t;
+
 
 
 
@@ -737,6 +769,9 @@ bool cw_test_sound_system_was_requested(cw_test_executor_t * self, cw_sound_syst
 
 	case CW_AUDIO_NONE:
 	case CW_AUDIO_SOUNDCARD:
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_JACK:
+	case CW_AUDIO_RTP:
 	default:
 		fprintf(stderr, "Unexpected sound system %d\n", sound_system);
 		exit(EXIT_FAILURE);
@@ -845,6 +880,7 @@ static void cw_test_set_current_topic_and_gen_config(cw_test_executor_t * self,
 {
 	self->current_topic = topic;
 	self->current_gen_conf.sound_system = sound_system;
+	self->current_gen_conf.file_fd = -1;
 
 	/* TODO: we have to somehow organize copying of these values from
 	   program config to test executor config. For now this is ad-hoc
@@ -868,6 +904,9 @@ static void cw_test_set_current_topic_and_gen_config(cw_test_executor_t * self,
 		break;
 	case CW_AUDIO_NONE:
 	case CW_AUDIO_SOUNDCARD:
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_JACK:
+	case CW_AUDIO_RTP:
 	default:
 		/* Technically speaking this is an error, but we shouldn't
 		   get here because test binary won't accept such sound
@@ -1170,6 +1209,9 @@ void cw_test_print_sound_systems(cw_test_executor_t * self, cw_sound_system * so
 		case CW_AUDIO_SOUNDCARD:
 			/* Handled in 'if' before this switch. */
 			break;
+		case CW_AUDIO_FILE:
+		case CW_AUDIO_JACK:
+		case CW_AUDIO_RTP:
 		default:
 			self->log_info_cont(self, "unknown! ");
 			break;
@@ -1247,6 +1289,18 @@ void cw_test_print_test_options(cw_test_executor_t * self)
 		self->log_info(self, "Single function to be tested: '%s'\n", self->config->test_function_name);
 	}
 
+	if (self->config->test_virtual_time) {
+		self->log_info(self, "Virtual time: yes\n");
+	}
+
+	if (strlen(self->config->test_resources_file)) {
+		self->log_info(self, "Measurements of resources saved to: '%s'\n", self->config->test_resources_file);
+	}
+
+	if (self->config->test_jobs > 1) {
+		self->log_info(self, "Parallel workers: %d\n", self->config->test_jobs);
+	}
+
 	fflush(self->file_out);
 }
 
@@ -1304,30 +1358,445 @@ cwt_retv cw_test_main_test_loop(cw_test_executor_t * cte, cw_test_set_t * test_s
 	sysinfo(&sys_info);
 	cte->uptime_begin = sys_info.uptime;
 #endif
+	if (cte->config->test_jobs > 1) {
+		if (0 != strlen(cte->config->test_resources_file)) {
+			/* Workers would be writing to the same file at
+			   the same time, and would be competing for CPU
+			   time that is being measured. */
+			cte->log_error(cte, "Measurements of resources can't be done when tests are executed in parallel\n");
+			return cwt_retv_err;
+		}
+		return cw_test_main_test_loop_parallel(cte, test_sets);
+	}
+
+	if (cwt_retv_ok != cw_test_resources_file_open(cte)) {
+		return cwt_retv_err;
+	}
+
 	int set = 0;
 	while (LIBCW_TEST_SET_VALID == test_sets[set].set_valid) {
 		cw_test_set_t * test_set = &test_sets[set];
 		if (cwt_retv_ok != iterate_over_topics(cte, test_set)) {
 			cte->log_error(cte, "Test framework failed for set %d\n", set);
+			cw_test_resources_file_close(cte);
 			return cwt_retv_err;
 		}
 		set++;
 	}
 
+	cw_test_resources_file_close(cte);
+
 	return cwt_retv_ok;
 }
 
 
 
 
-static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * test_set)
+/**
+   @brief Open file for measurements of resources, if it was requested in command line
+
+   Requesting the file turns on measurements of resources.
+*/
+static cwt_retv cw_test_resources_file_open(cw_test_executor_t * cte)
 {
-	for (int topic = LIBCW_TEST_TOPIC_TQ; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
-		if (!cte->test_topic_was_requested(cte, topic)) {
+	if (0 == strlen(cte->config->test_resources_file)) {
+		return cwt_retv_ok;
+	}
+
+	cte->resources_file = fopen(cte->config->test_resources_file, "w");
+	if (NULL == cte->resources_file) {
+		cte->log_error(cte, "Failed to open file '%s' for measurements of resources: %s\n",
+			       cte->config->test_resources_file, strerror(errno));
+		return cwt_retv_err;
+	}
+	cte->use_resource_meas = true;
+	cte->resources_file_has_entries = false;
+
+	fprintf(cte->resources_file, "{\n  \"version\": \"%s\",\n  \"meas_interval_msecs\": %d,\n  \"tests\": [",
+		PACKAGE_VERSION, LIBCW_TEST_MEAS_CPU_MEAS_INTERVAL_MSECS);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Append measurements of resources of one test function to file with measurements
+
+   One JSON object per execution of test function (for given topic
+   and sound system).
+*/
+static void cw_test_resources_file_append(cw_test_executor_t * cte, const char * test_name, const resource_meas_report_t * report)
+{
+	if (NULL == cte->resources_file) {
+		return;
+	}
+
+	fprintf(cte->resources_file,
+		"%s\n    {\n"
+		"      \"name\": \"%s\", \"topic\": \"%s\", \"sound_system\": \"%s\", \"duration_msecs\": %ld,\n"
+		"      \"cpu_percent\": { \"last\": %d, \"max\": %d },\n"
+		"      \"rss_kb\": { \"last\": %ld, \"max\": %ld, \"peak\": %ld },\n"
+		"      \"ctx_switches\": { \"voluntary\": %ld, \"involuntary\": %ld },\n"
+		"      \"gen_threads\": %d,\n"
+		"      \"gen_cpu_percent\": { \"last\": %d, \"max\": %d },\n"
+		"      \"gen_ctx_switches\": { \"voluntary\": %ld, \"involuntary\": %ld },\n"
+		"      \"gen_wakeups_per_sec\": { \"last\": %d, \"max\": %d, \"average\": %d }\n"
+		"    }",
+		cte->resources_file_has_entries ? "," : "",
+		test_name, cte->get_current_topic_label(cte), cte->get_current_sound_system_label(cte), report->meas_duration_msecs,
+		report->current_cpu_usage, report->maximal_cpu_usage,
+		report->current_rss_kb, report->maximal_rss_kb, report->peak_rss_kb,
+		report->voluntary_ctx_switches, report->involuntary_ctx_switches,
+		report->n_gen_threads,
+		report->current_gen_cpu_usage, report->maximal_gen_cpu_usage,
+		report->gen_voluntary_ctx_switches, report->gen_involuntary_ctx_switches,
+		report->current_gen_wakeups_per_sec, report->maximal_gen_wakeups_per_sec, report->average_gen_wakeups_per_sec);
+	fflush(cte->resources_file);
+
+	cte->resources_file_has_entries = true;
+}
+
+
+
+
+static void cw_test_resources_file_close(cw_test_executor_t * cte)
+{
+	if (NULL == cte->resources_file) {
+		return;
+	}
+
+	fprintf(cte->resources_file, "\n  ]\n}\n");
+	fclose(cte->resources_file);
+	cte->resources_file = NULL;
+}
+
+
+
+
+/**
+   @brief Does given test set have test functions for given topic that should be executed?
+*/
+static bool cw_test_set_has_topic(cw_test_executor_t * cte, cw_test_set_t * test_set, int topic)
+{
+	if (!cte->test_topic_was_requested(cte, topic)) {
+		return false;
+	}
+	const int topics_max = sizeof (test_set->tested_areas) / sizeof (test_set->tested_areas[0]);
+	return cw_test_test_topic_is_member(cte, topic, test_set->tested_areas, topics_max);
+}
+
+
+
+
+/**
+   @brief Should test functions from given test set be executed for given sound system?
+*/
+static bool cw_test_set_has_sound_system(cw_test_executor_t * cte, cw_test_set_t * test_set, cw_sound_system sound_system)
+{
+	if (!cte->sound_system_was_requested(cte, sound_system)) {
+		return false;
+	}
+	const int systems_max = sizeof (test_set->tested_sound_systems) / sizeof (test_set->tested_sound_systems[0]);
+	return cw_test_sound_system_is_member(cte, sound_system, test_set->tested_sound_systems, systems_max);
+}
+
+
+
+
+/**
+   @brief Body of worker process executing one test set for one sound system
+
+   Output of the worker goes to @p log_fd. Statistics of tests are
+   sent to parent through @p result_fd. The function doesn't return:
+   worker exits with _exit() so that atexit() handlers registered by
+   parent (e.g. printing of statistics) are not called in the worker.
+*/
+static void cw_test_worker_main(cw_test_executor_t * cte, cw_test_set_t * test_set, cw_sound_system sound_system, int log_fd, int result_fd)
+{
+	fflush(cte->file_out);
+	fflush(cte->file_err);
+	dup2(log_fd, STDOUT_FILENO);
+	dup2(log_fd, STDERR_FILENO);
+	close(log_fd);
+
+	cw_test_worker_result_t result;
+	memset(&result, 0, sizeof (result));
+	result.retv = cwt_retv_ok;
+
+	/* Virtual clock is enabled here and not inherited from parent,
+	   because thread of timer service that drives the clock is not
+	   copied by fork(). */
+	if (cte->config->test_virtual_time && CW_SUCCESS != cw_virtual_clock_enable_internal()) {
+		cte->log_error(cte, "Failed to enable virtual clock in worker\n");
+		result.retv = cwt_retv_err;
+	}
+
+	for (int topic = LIBCW_TEST_TOPIC_TQ; cwt_retv_ok == result.retv && topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+		if (!cw_test_set_has_topic(cte, test_set, topic)) {
+			continue;
+		}
+		if (cwt_retv_ok != iterate_over_test_objects(cte, test_set->test_objects, topic, sound_system)) {
+			cte->log_error(cte, "Test framework failed for topic %d, sound system %d\n", topic, sound_system);
+			result.retv = cwt_retv_err;
+			break;
+		}
+	}
+
+	for (int topic = 0; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+		result.stats[topic] = cte->all_stats[sound_system][topic];
+	}
+
+	fflush(cte->file_out);
+	fflush(cte->file_err);
+
+	const ssize_t n = write(result_fd, &result, sizeof (result));
+	_exit(n == (ssize_t) sizeof (result) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+
+
+
+/**
+   @brief Start worker process for given pair of (test set, sound system)
+*/
+static cwt_retv cw_test_worker_start(cw_test_executor_t * cte, cw_test_set_t * test_sets, cw_test_worker_t * worker)
+{
+	worker->log = tmpfile();
+	if (NULL == worker->log) {
+		cte->log_error(cte, "Failed to create log file for worker: %s\n", strerror(errno));
+		return cwt_retv_err;
+	}
+
+	int fds[2] = { -1, -1 };
+	if (0 != pipe(fds)) {
+		cte->log_error(cte, "Failed to create pipe for worker: %s\n", strerror(errno));
+		fclose(worker->log);
+		worker->log = NULL;
+		return cwt_retv_err;
+	}
+
+	/* Don't let the worker inherit and print contents of
+	   parent's buffers. */
+	fflush(cte->file_out);
+	fflush(cte->file_err);
+
+	const pid_t pid = fork();
+	if (-1 == pid) {
+		cte->log_error(cte, "Failed to fork worker: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		fclose(worker->log);
+		worker->log = NULL;
+		return cwt_retv_err;
+	}
+	if (0 == pid) {
+		close(fds[0]);
+		cw_test_worker_main(cte, &test_sets[worker->set], worker->sound_system, fileno(worker->log), fds[1]);
+	}
+
+	close(fds[1]);
+	worker->result_fd = fds[0];
+	worker->pid = pid;
+
+	cte->log_info(cte, "Started worker %d: test set %d, sound system %s\n",
+		      (int) pid, worker->set, cw_get_audio_system_label(worker->sound_system));
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Collect output and statistics of worker that has exited
+
+   @return cwt_retv_ok if worker has sent its statistics and its
+   test framework worked correctly
+   @return cwt_retv_err otherwise
+*/
+static cwt_retv cw_test_worker_collect(cw_test_executor_t * cte, cw_test_set_t * test_sets, cw_test_worker_t * worker, int status)
+{
+	cw_test_worker_result_t result;
+	memset(&result, 0, sizeof (result));
+	const ssize_t n = read(worker->result_fd, &result, sizeof (result));
+	close(worker->result_fd);
+	worker->result_fd = -1;
+	const bool has_result = n == (ssize_t) sizeof (result);
+
+	/* Print output of the worker in one piece, so that outputs
+	   of workers running at the same time are not interleaved. */
+	cte->log_info(cte, "Output of worker %d: test set %d, sound system %s\n",
+		      (int) worker->pid, worker->set, cw_get_audio_system_label(worker->sound_system));
+	fflush(cte->file_out);
+	fseek(worker->log, 0, SEEK_SET);
+	char buf[4096];
+	size_t n_read = 0;
+	while (0 != (n_read = fread(buf, 1, sizeof (buf), worker->log))) {
+		fwrite(buf, 1, n_read, cte->file_out);
+	}
+	fclose(worker->log);
+	worker->log = NULL;
+
+	cw_test_set_t * test_set = &test_sets[worker->set];
+	if (has_result) {
+		for (int topic = 0; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+			cte->all_stats[worker->sound_system][topic].successes += result.stats[topic].successes;
+			cte->all_stats[worker->sound_system][topic].failures += result.stats[topic].failures;
+		}
+	} else {
+		/* Worker crashed or has called exit() before sending
+		   statistics. Make this visible in report as a failure
+		   in each topic that the worker was testing. */
+		if (WIFSIGNALED(status)) {
+			cte->log_error(cte, "Worker %d has been terminated by signal %d\n", (int) worker->pid, WTERMSIG(status));
+		} else {
+			cte->log_error(cte, "Worker %d has exited without sending statistics, exit status %d\n", (int) worker->pid, WEXITSTATUS(status));
+		}
+		for (int topic = LIBCW_TEST_TOPIC_TQ; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+			if (cw_test_set_has_topic(cte, test_set, topic)) {
+				cte->all_stats[worker->sound_system][topic].failures++;
+			}
+		}
+	}
+
+	worker->pid = 0;
+	worker->done = true;
+
+	return (has_result && cwt_retv_ok == result.retv) ? cwt_retv_ok : cwt_retv_err;
+}
+
+
+
+
+/**
+   @brief Execute test sets in worker processes, config->test_jobs workers at a time
+
+   Each pair of (test set, sound system) is executed in its own
+   process, so failures and global state of one test set don't
+   affect other test sets. Two workers using the same real sound
+   system are never running at the same time, because they would be
+   competing for the same sound device. Workers using Null sound
+   system are not limited in this way.
+*/
+static cwt_retv cw_test_main_test_loop_parallel(cw_test_executor_t * cte, cw_test_set_t * test_sets)
+{
+	int n_sets = 0;
+	while (LIBCW_TEST_SET_VALID == test_sets[n_sets].set_valid) {
+		n_sets++;
+	}
+
+	cw_test_worker_t * workers = calloc((size_t) n_sets * (CW_SOUND_SYSTEM_LAST + 1), sizeof (cw_test_worker_t));
+	if (NULL == workers) {
+		cte->log_error(cte, "Failed to allocate workers\n");
+		return cwt_retv_err;
+	}
+
+	int n_workers = 0;
+	for (int set = 0; set < n_sets; set++) {
+		cw_test_set_t * test_set = &test_sets[set];
+		bool has_topics = false;
+		for (int topic = LIBCW_TEST_TOPIC_TQ; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+			if (cw_test_set_has_topic(cte, test_set, topic)) {
+				has_topics = true;
+				break;
+			}
+		}
+		if (!has_topics) {
 			continue;
 		}
-		const int topics_max = sizeof (test_set->tested_areas) / sizeof (test_set->tested_areas[0]);
-		if (!cw_test_test_topic_is_member(cte, topic, test_set->tested_areas, topics_max)) {
+		for (cw_sound_system sound_system = CW_SOUND_SYSTEM_FIRST; sound_system <= CW_SOUND_SYSTEM_LAST; sound_system++) {
+			if (cw_test_set_has_sound_system(cte, test_set, sound_system)) {
+				workers[n_workers].set = set;
+				workers[n_workers].sound_system = sound_system;
+				workers[n_workers].result_fd = -1;
+				n_workers++;
+			}
+		}
+	}
+
+	cte->log_info(cte, "Executing %d pairs of test set and sound system in up to %d parallel workers\n",
+		      n_workers, cte->config->test_jobs);
+
+	cwt_retv retv = cwt_retv_ok;
+	int n_running = 0;
+	int n_done = 0;
+	while (n_done < n_workers) {
+
+		for (int i = 0; i < n_workers && n_running < cte->config->test_jobs; i++) {
+			if (workers[i].done || 0 != workers[i].pid) {
+				continue;
+			}
+			bool sound_system_busy = false;
+			if (CW_AUDIO_NULL != workers[i].sound_system) {
+				for (int j = 0; j < n_workers; j++) {
+					if (0 != workers[j].pid && workers[j].sound_system == workers[i].sound_system) {
+						sound_system_busy = true;
+						break;
+					}
+				}
+			}
+			if (sound_system_busy) {
+				continue;
+			}
+
+			if (cwt_retv_ok != cw_test_worker_start(cte, test_sets, &workers[i])) {
+				/* Don't start new workers, but collect
+				   the ones that are running. */
+				retv = cwt_retv_err;
+				for (int j = 0; j < n_workers; j++) {
+					if (!workers[j].done && 0 == workers[j].pid) {
+						workers[j].done = true;
+						n_done++;
+					}
+				}
+				break;
+			}
+			n_running++;
+		}
+
+		if (0 == n_running) {
+			break;
+		}
+
+		int status = 0;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if (-1 == pid) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cte->log_error(cte, "Failed to wait for workers: %s\n", strerror(errno));
+			retv = cwt_retv_err;
+			break;
+		}
+
+		for (int i = 0; i < n_workers; i++) {
+			if (workers[i].pid != pid) {
+				continue;
+			}
+			if (cwt_retv_ok != cw_test_worker_collect(cte, test_sets, &workers[i], status)) {
+				cte->log_error(cte, "Test framework failed for set %d, sound system %d\n", workers[i].set, workers[i].sound_system);
+				retv = cwt_retv_err;
+			}
+			n_running--;
+			n_done++;
+			break;
+		}
+	}
+
+	free(workers);
+
+	return retv;
+}
+
+
+
+
+static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * test_set)
+{
+	for (int topic = LIBCW_TEST_TOPIC_TQ; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+		if (!cw_test_set_has_topic(cte, test_set, topic)) {
 			continue;
 		}
 
@@ -1346,11 +1815,7 @@ static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * te
 static cwt_retv iterate_over_sound_systems(cw_test_executor_t * cte, cw_test_set_t * test_set, int topic)
 {
 	for (cw_sound_system sound_system = CW_SOUND_SYSTEM_FIRST; sound_system <= CW_SOUND_SYSTEM_LAST; sound_system++) {
-		if (!cte->sound_system_was_requested(cte, sound_system)) {
-			continue;
-		}
-		const int systems_max = sizeof (test_set->tested_sound_systems) / sizeof (test_set->tested_sound_systems[0]);
-		if (!cw_test_sound_system_is_member(cte, sound_system, test_set->tested_sound_systems, systems_max)) {
+		if (!cw_test_set_has_sound_system(cte, test_set, sound_system)) {
 			continue;
 		}
 
@@ -1416,6 +1881,14 @@ static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_obje
 			const int max_cpu_usage = resource_meas_get_maximal_cpu_usage(&cte->resource_meas);
 			cte->log_info(cte, "CPU usage: last = "CWTEST_CPU_FMT", max = "CWTEST_CPU_FMT"\n",
 				      current_cpu_usage, max_cpu_usage);
+
+			resource_meas_report_t report;
+			resource_meas_get_report(&cte->resource_meas, &report);
+			cte->log_info(cte, "Generator threads: %d, CPU usage: max = "CWTEST_CPU_FMT", wakeups/s: max = %d, avg = %d; RSS: max = %ld kB\n",
+				      report.n_gen_threads, report.maximal_gen_cpu_usage,
+				      report.maximal_gen_wakeups_per_sec, report.average_gen_wakeups_per_sec,
+				      report.maximal_rss_kb);
+			cw_test_resources_file_append(cte, test_obj->name ? test_obj->name : "", &report);
 			if (max_cpu_usage > LIBCW_TEST_MEAS_CPU_OK_THRESHOLD_PERCENT) {
 				cte->stats->failures++;
 				cte->log_error(cte, "Registered high CPU usage "CWTEST_CPU_FMT" during execution of '%s'\n",
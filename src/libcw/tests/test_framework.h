@@ -86,6 +86,11 @@ typedef struct cw_test_executor_t {
 	resource_meas resource_meas;
 	bool use_resource_meas;
 
+	/* File with measurements of resources saved as JSON (see "-R"
+	   command line option), or NULL. */
+	FILE * resources_file;
+	bool resources_file_has_entries;
+
 #ifndef __FreeBSD__
 	/* TODO: add calculation of test duration on BSD. */
 	/* Uptime at begin and end of tests. Used to measure duration
@@ -389,6 +394,11 @@ typedef struct cw_test_executor_t {
 	   @test_sets and executes all test function specified in
 	   @param test_sets
 
+	   If test_jobs field of config is larger than one, each pair
+	   of (test set, sound system) is executed in separate worker
+	   process, and statistics sent by workers are merged into
+	   ::all_stats[][] of @param cte.
+
 	   @return cwt_retv_ok if test framework worked correctly
 	   @return cwt_retv_err if test framework failed at some point
 	*/
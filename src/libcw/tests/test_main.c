@@ -49,6 +49,7 @@
 
 
 #include "libcw_debug.h"
+#include "libcw_signal.h"
 #include "test_framework.h"
 
 
@@ -111,6 +112,9 @@ int main(int argc, char * const argv[])
 	cte->config->has_feature_test_name = true;
 	cte->config->has_feature_test_quick_only = true;
 	cte->config->has_feature_test_random_seed = true;
+	cte->config->has_feature_test_virtual_time = true;
+	cte->config->has_feature_test_resources = true;
+	cte->config->has_feature_test_jobs = true;
 	cte->config->test_loops = 5;
 
 	/* May cause exit on errors or "-h" option. */
@@ -118,6 +122,16 @@ int main(int argc, char * const argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	/* With worker processes the virtual clock is enabled by each
+	   worker: thread of timer service driving the clock doesn't
+	   survive fork(). */
+	if (cte->config->test_virtual_time && cte->config->test_jobs < 2) {
+		if (CW_SUCCESS != cw_virtual_clock_enable_internal()) {
+			cte->log_error(cte, "Failed to enable virtual clock\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	cte->print_test_options(cte);
 	/* Let the test options be clearly visible for few seconds
 	   before screen is filled with testcase debugs. */
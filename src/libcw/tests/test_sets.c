@@ -113,6 +113,7 @@ cw_test_set_t cw_test_sets[] = {
 		{
 			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_low_level_gen_parameters, true),
 			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_parameter_ranges, true),
+			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_contexts, true),
 			//LIBCW_TEST_FUNCTION_INSERT(legacy_api_cw_test_delayed_release, true),
 			//LIBCW_TEST_FUNCTION_INSERT(legacy_api_cw_test_signal_handling, true), /* FIXME - not sure why this test fails :( */
 
@@ -143,6 +144,7 @@ cw_test_set_t cw_test_sets[] = {
 		{
 			/* This test does its own generator setup and deconfig. */
 			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_rec_poll, false),
+			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_rec_poll_events, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -162,9 +164,13 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_usecs_to_timespec_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_version_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_license_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_timer_service_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_virtual_clock_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_probe_sound_systems, true),
 
 			/* cw_debug topic */
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_debug_flags_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_trace_internal, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -180,6 +186,7 @@ cw_test_set_t cw_test_sets[] = {
 			/* cw_data topic */
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_representation_to_hash_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_representation_to_character_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_representation_hash_to_character_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_representation_to_character_internal_speed_gain, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_data_main_table_get_count, true),
@@ -192,6 +199,7 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_character_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_string_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_representation_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_alphabet_lookups_internal, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -231,6 +239,12 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_properties_full, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_dequeue_internal_returns, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_enqueue_batch_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_configure_capacity_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_coalescing_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_spsc_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_targeted_wakeups_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_char_index_internal, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -249,7 +263,37 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_new_start_stop_delete, false),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_set_tone_slope, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_slope_table, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_tone_slope_shape_enums, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_oscillators, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_envelope, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_silence, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_pcm_cache, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_render, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_file_sink, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_rtp_sink, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_latency_stats, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_stats, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_fill_buffer, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_realtime_config, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_low_latency_keying, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_null_pacing, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_event_fd, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_keying, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_mixer, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_tap, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_sound_channels, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_sched, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_pool, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_pause, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_sample_formats, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_shmq, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_wait_async, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_text_source, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_dispatch, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_timed_value_tracking, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_idle_mode, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_impairments, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_timing_parameters_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_parameter_getters_setters, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_volume_functions, false),
@@ -257,6 +301,9 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_representations, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_character, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_string, false),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_tones, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_char_tones, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_hot_parameters, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_remove_last_character, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_forever_internal, false),
 
@@ -275,6 +322,12 @@ cw_test_set_t cw_test_sets[] = {
 		{
 			LIBCW_TEST_FUNCTION_INSERT(test_keyer, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_straight_key, false),
+			LIBCW_TEST_FUNCTION_INSERT(test_keyer_timer, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_input, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_netkey, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_metrics, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_keylog, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_wait_async, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -293,6 +346,28 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_identify_mark_internal,      true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_test_with_constant_speeds,   true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_test_with_varying_speeds,    true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_ns_timestamps,              true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_duration_stats,             true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_adaptive_update,            true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_reset_average,              true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_process_events,             true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_viterbi_process_events,         true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_ensemble_process_events,        true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_tester_sweep,               true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_tester_corpus,              true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_output_callback,            true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_event_fd,                   true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_compact,                    true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_adaptive_acquisition,       true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_snapshot,                   true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_poll_characters,            true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_detector,                       true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_detector_afc,                   true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_skimmer,                        true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_skimmer_many_signals,           true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_skimmer_cpu_budget,             true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_iq,                             true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_capture,                        true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true) /* Guard. */
 		}
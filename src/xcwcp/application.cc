@@ -19,8 +19,11 @@
 #include "config.h"
 
 #include <cerrno>
+#include <cstdint>
 #include <iostream>
 
+#include <unistd.h>
+
 #include <QToolBar>
 #include <QLabel>
 #include <QStatusBar>
@@ -305,6 +308,7 @@ void Application::start()
 
 	sender->clear();
 	receiver->clear();
+	receiver->set_receiving(current_mode()->is_receive());
 #ifdef XCWCP_WITH_REC_TEST
 	if (current_mode()->is_receiver_test()) {
 		receiver->start_test_code();
@@ -323,10 +327,16 @@ void Application::start()
 
 	clear_status();
 
-	/* At 60WPM, a dot is 20ms, so polling for the maximum speed
-	   library needs a 10ms timeout. */
-	poll_timer->setSingleShot(false);
-	poll_timer->start(10);
+	if (!enable_event_notifiers()) {
+		/* At 60WPM, a dot is 20ms, so polling for the maximum speed
+		   library needs a 10ms timeout. */
+		poll_timer->setSingleShot(false);
+		poll_timer->start(10);
+	}
+
+	/* Start sending in dictionary mode. Further polls are
+	   triggered by libcw's events. */
+	poll_timer_event();
 
 	return;
 }
@@ -350,7 +360,9 @@ void Application::stop()
 	is_using_libcw = false;
 
 	poll_timer->stop();
+	disable_event_notifiers();
 	sender->clear();
+	receiver->set_receiving(false);
 	receiver->clear();
 #ifdef XCWCP_WITH_REC_TEST
 	if (current_mode()->is_receiver_test()) {
@@ -568,6 +580,11 @@ void Application::change_mode()
 
 	/* Keep the ModeSet synchronized to mode_combo changes. */
 	modeset.set_current(mode_combo->currentIndex());
+	receiver->set_receiving(is_using_libcw && new_mode->is_receive());
+
+	/* Flushed tone queue doesn't signal its event descriptor,
+	   so start sending in new mode here. */
+	poll_timer_event();
 
 	return;
 }
@@ -678,7 +695,9 @@ void Application::colors()
 /**
    Handle a timer event from the QTimer we set up on initialization.
    This timer is used for regular polling for sender tone queue low
-   and completed receive characters.
+   and completed receive characters when libcw's event descriptors
+   are not available. The function is also called directly to poll
+   both of them at once.
 */
 void Application::poll_timer_event()
 {
@@ -694,6 +713,100 @@ void Application::poll_timer_event()
 
 
 
+/**
+   Handle activity on event descriptor of libcw's tone queue: the
+   queue is short enough to be refilled, or has been emptied.
+*/
+void Application::sender_event()
+{
+	uint64_t counter = 0;
+	if (sizeof (counter) != read((int) sender_notifier->socket(), &counter, sizeof (counter))) {
+		/* Spurious wakeup. */
+		return;
+	}
+
+	if (is_using_libcw) {
+		sender->poll(modeset.get_current());
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   Handle activity on event descriptor of receiver: receiver's worker
+   thread has posted characters, inter-word-spaces or errors.
+*/
+void Application::receiver_event()
+{
+	uint64_t counter = 0;
+	if (sizeof (counter) != read((int) receiver_notifier->socket(), &counter, sizeof (counter))) {
+		return;
+	}
+
+	if (is_using_libcw) {
+		receiver->poll(modeset.get_current());
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Start watching libcw's event descriptors
+
+   \return true if the descriptors are watched
+   \return false if the descriptors are not available
+*/
+bool Application::enable_event_notifiers(void)
+{
+	if (!sender_notifier) {
+		const int sender_fd = cw_get_tone_queue_event_fd();
+		const int receiver_fd = receiver->get_event_fd();
+		if (-1 == sender_fd || -1 == receiver_fd) {
+			return false;
+		}
+
+		sender_notifier = new QSocketNotifier(sender_fd, QSocketNotifier::Read, this);
+		connect(sender_notifier, SIGNAL (activated(int)), SLOT (sender_event()));
+		receiver_notifier = new QSocketNotifier(receiver_fd, QSocketNotifier::Read, this);
+		connect(receiver_notifier, SIGNAL (activated(int)), SLOT (receiver_event()));
+	}
+
+	/* Sender::poll() refills the tone queue when it holds at
+	   most one tone. The level is shared by all instances. */
+	cw_register_tone_queue_low_callback(NULL, NULL, 1);
+
+	sender_notifier->setEnabled(true);
+	receiver_notifier->setEnabled(true);
+
+	return true;
+}
+
+
+
+
+
+void Application::disable_event_notifiers(void)
+{
+	if (sender_notifier) {
+		sender_notifier->setEnabled(false);
+		receiver_notifier->setEnabled(false);
+	}
+
+	return;
+}
+
+
+
+
+
 /**
    \brief Handle key event from a keyboard
 
@@ -725,6 +838,9 @@ void Application::key_event(QKeyEvent *event)
 		if (modeset.get_current()->is_keyboard()) {
 			//fprintf(stderr, "---------- key event: keyboard mode\n");
 			sender->handle_key_event(event);
+			/* Idle tone queue won't signal its event
+			   descriptor, start playing now. */
+			sender->poll(modeset.get_current());
 		} else if (modeset.get_current()->is_receive()) {
 			//fprintf(stderr, "---------- key event: receiver mode mode\n");
 			receiver->handle_key_event(event, reverse_paddles_action->isChecked());
@@ -1077,6 +1193,9 @@ void Application::make_auxiliaries_begin(void)
 	saved_receive_speed = cw_get_receive_speed();
 	play = false;
 
+	sender_notifier = NULL;
+	receiver_notifier = NULL;
+
 	/* Create a timer for polling send and receive. */
 	poll_timer = new QTimer(this);
 	connect(poll_timer, SIGNAL (timeout()), SLOT (poll_timer_event()));
@@ -1113,6 +1232,11 @@ void Application::make_auxiliaries_end(void)
 
 	cw_easy_receiver_start(receiver->easy_rec);
 
+	/* Keying and receiving are done in receiver's own thread, so
+	   that they aren't delayed by repaints of GUI. If the thread
+	   can't be started, they are done in GUI thread. */
+	receiver->start_worker();
+
 	QString label("Output: ");
 	label += cw_generator_get_audio_system_label();
 	QLabel *sound_system = new QLabel(label);
@@ -1125,6 +1249,22 @@ void Application::make_auxiliaries_end(void)
 
 
 
+/**
+   \brief Set limit of lines of text kept in main display
+
+   \param lines - count of lines
+*/
+void Application::set_scrollback(int lines)
+{
+	textarea->set_max_lines(lines);
+
+	return;
+}
+
+
+
+
+
 void Application::check_sound_system(cw_config_t *config)
 {
 	if (config->gen_conf.sound_system == CW_AUDIO_ALSA
@@ -27,6 +27,7 @@
 #include <QToolButton>
 #include <QComboBox>
 #include <QSpinBox>
+#include <QSocketNotifier>
 
 #include <string>
 #include <deque>
@@ -67,6 +68,7 @@ namespace cw {
 		void key_event(QKeyEvent *event);
 		void mouse_event(QMouseEvent *event);
 		void check_sound_system(cw_config_t * config);
+		void set_scrollback(int lines);
 
 		void show_status(const QString &status);
 		void clear_status();
@@ -89,6 +91,8 @@ namespace cw {
 		void colors();
 		void toggle_toolbar();
 		void poll_timer_event();
+		void sender_event();
+		void receiver_event();
 
 		/* These Qt widget callback functions interact with
 		   libcw. */
@@ -158,9 +162,18 @@ namespace cw {
 
 		TextArea *textarea;
 
-		/* Poll timer, used to ensure that all of the
-		   application processing can be handled in the
-		   foreground, rather than in the signal handling
+		/* Notifiers of libcw's event descriptors: sender is
+		   polled when tone queue is (almost) empty, receiver is
+		   polled when a key event has been queued or a
+		   character has been received. Main loop sleeps between
+		   the events. NULL until first start(). */
+		QSocketNotifier *sender_notifier;
+		QSocketNotifier *receiver_notifier;
+
+		/* Poll timer, used instead of the notifiers when libcw's
+		   event descriptors are not available. It ensures that
+		   all of the application processing can be handled in
+		   the foreground, rather than in the signal handling
 		   context of a libcw tone queue low callback. */
 		QTimer *poll_timer;
 
@@ -193,6 +206,9 @@ namespace cw {
 		void make_auxiliaries_begin(void);
 		void make_auxiliaries_end(void);
 
+		bool enable_event_notifiers(void);
+		void disable_event_notifiers(void);
+
 
 		/* Prevent unwanted operations. */
 		Application(const Application &);
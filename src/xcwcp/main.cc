@@ -111,6 +111,7 @@ int main(int argc, char **argv)
 		config->has_feature_sound_system = true;
 		config->has_feature_generator = true;
 		config->has_feature_dot_dash_params = true;
+		config->has_feature_scrollback = true;
 
 		if (CW_SUCCESS != cw_process_program_arguments(argc, argv, config)) {
 			fprintf(stderr, _("%s: failed to parse command line args\n"), config->program_name);
@@ -165,6 +166,7 @@ int main(int argc, char **argv)
 		q_application.connect(&q_application, SIGNAL (lastWindowClosed ()),
 				      &q_application, SLOT (quit ()));
 
+		application->set_scrollback(config->scrollback_lines);
 		application->check_sound_system(config);
 		// Enter the application event loop.
 		int rv = q_application.exec();
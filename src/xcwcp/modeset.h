@@ -89,6 +89,7 @@ namespace cw {
 			dictionary (dict) { }
 
 		std::string get_random_word_group() const;
+		inline const cw_dictionary_t *get_dictionary() const { return dictionary; };
 
 		inline virtual bool is_dictionary() const { return true; };
 		inline virtual const DictionaryMode *get_dmode() const { return this; };
@@ -24,6 +24,11 @@
 #include <cerrno>
 #include <sstream>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
 
 #include "application.h"
 #include "receiver.h"
@@ -42,9 +47,109 @@ namespace cw {
 
 
 
+#define RECEIVER_ATOMIC_LOAD(m_var)          __atomic_load_n(&(m_var), __ATOMIC_ACQUIRE)
+#define RECEIVER_ATOMIC_STORE(m_var, m_val)  __atomic_store_n(&(m_var), (m_val), __ATOMIC_RELEASE)
+
+
+
+
+/* Interval of polling of libcw's receiver by worker thread when
+   event descriptors are not available [ms]. At 60WPM, a dot is
+   20ms. */
+static const int RECEIVER_POLL_INTERVAL = 10;
+
+
+
+
+static int64_t receiver_now(void);
+static void receiver_signal_fd(int fd);
+
+
+
+
+Receiver::~Receiver()
+{
+	if (worker_running) {
+		RECEIVER_ATOMIC_STORE(worker_quit, true);
+		receiver_signal_fd(inputs_fd);
+		pthread_join(worker, NULL);
+	}
+	if (-1 != inputs_fd) {
+		close(inputs_fd);
+	}
+	if (-1 != results_fd) {
+		close(results_fd);
+	}
+
+	cw_easy_receiver_delete(&easy_rec);
+}
+
+
+
+
+
 /**
-   \brief Poll the CW library receive buffer and handle anything found
-   in the buffer
+   \brief Start receiver's worker thread
+
+   Without the worker thread, key events and polls of libcw's
+   receiver are handled in GUI thread.
+
+   \return true if the thread has been started
+   \return false otherwise
+*/
+bool Receiver::start_worker()
+{
+	inputs_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	results_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (-1 == inputs_fd || -1 == results_fd) {
+		/* GUI thread wouldn't know when to show results. */
+		if (-1 != inputs_fd) {
+			close(inputs_fd);
+			inputs_fd = -1;
+		}
+		if (-1 != results_fd) {
+			close(results_fd);
+			results_fd = -1;
+		}
+		return false;
+	}
+
+	if (0 != pthread_create(&worker, NULL, worker_main, this)) {
+		return false;
+	}
+	worker_running = true;
+
+	return true;
+}
+
+
+
+
+
+/**
+   \brief Enable or disable receiving
+
+   Call the function when application starts or stops using libcw, or
+   when mode changes.
+
+   \param receiving whether receive mode is active
+*/
+void Receiver::set_receiving(bool new_receiving)
+{
+	RECEIVER_ATOMIC_STORE(receiving, new_receiving);
+	receiver_signal_fd(inputs_fd);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Show characters, spaces and errors received by worker thread
+
+   All results posted since last call are shown at once.
 
    \param current_mode
 */
@@ -54,35 +159,50 @@ void Receiver::poll(const Mode *current_mode)
 		return;
 	}
 
-	if (cw_easy_receiver_get_libcw_errno(easy_rec) != 0) {
-		poll_report_error();
+	if (!worker_running) {
+		worker_poll();
 	}
 
-	if (cw_easy_receiver_is_pending_inter_word_space(easy_rec)) {
-
-		/**
-		   If we received a character on an earlier poll, check again to see
-		   if we need to revise the decision about whether it is the end of a
-		   word too.
-		*/
-		/* Check if receiver received the pending inter-word
-		   space. */
-		cw_rec_data_t erd = { };
-		if (cw_easy_receiver_poll_space(easy_rec, &erd)) {
-			//fprintf(stderr, "End of word '%c'\n\n", c);
-			textarea->append(' ');
+	QString status;
+	unsigned int tail = results_tail; /* Written only by us. */
+	const unsigned int head = RECEIVER_ATOMIC_LOAD(results_head);
+	while (tail != head) {
+		const ReceiverResult *result = &results[tail & (RECEIVER_RING_CAPACITY - 1)];
+		if (result->generation == generation) {
+			switch (result->kind) {
+			case ReceiverResult::Character:
+				textarea->append(result->character);
+
+				/* Put the received char at the end of
+				   string to avoid "jumping" of whole
+				   string when width of glyph of received
+				   char changes at variable font width. */
+				status = QString(_("Received at %1 WPM: '%2'")).arg(result->speed).arg(result->character);
+				break;
+			case ReceiverResult::Space:
+				textarea->append(' ');
+				break;
+			case ReceiverResult::UnknownCharacter:
+				textarea->append('?');
+				status = QString(_("Unknown character received at %1 WPM")).arg(result->speed);
+				break;
+			case ReceiverResult::TimestampError:
+				textarea->append('?');
+				status = QString(_("Internal error"));
+				break;
+			case ReceiverResult::ReceiveError:
+				status = receive_error_status(result->errno_val);
+				break;
+			default:
+				break;
+			}
 		}
+		tail++;
+		RECEIVER_ATOMIC_STORE(results_tail, tail);
+	}
 
-		if (!cw_easy_receiver_is_pending_inter_word_space(easy_rec)) {
-			/* We received the pending space. After it the
-			   receiver may have received another
-			   character.  Try to get it too. */
-			poll_character();
-		}
-	} else {
-		/* Not awaiting a possible space, so just poll the
-		   next possible received character. */
-		poll_character();
+	if (!status.isEmpty()) {
+		app->show_status(status);
 	}
 
 	return;
@@ -204,7 +324,7 @@ void Receiver::handle_mouse_event(QMouseEvent *event, bool is_reverse_paddles)
 */
 void Receiver::sk_event(bool is_down)
 {
-	cw_easy_receiver_sk_event(this->easy_rec, is_down);
+	push_input(ReceiverInput::StraightKey, is_down, false);
 	return;
 }
 
@@ -220,7 +340,7 @@ void Receiver::sk_event(bool is_down)
 */
 void Receiver::ik_left_event(bool is_down, bool is_reverse_paddles)
 {
-	cw_easy_receiver_ik_left_event(this->easy_rec, is_down, is_reverse_paddles);
+	push_input(ReceiverInput::LeftPaddle, is_down, is_reverse_paddles);
 	return;
 }
 
@@ -236,7 +356,7 @@ void Receiver::ik_left_event(bool is_down, bool is_reverse_paddles)
 */
 void Receiver::ik_right_event(bool is_down, bool is_reverse_paddles)
 {
-	cw_easy_receiver_ik_right_event(this->easy_rec, is_down, is_reverse_paddles);
+	push_input(ReceiverInput::RightPaddle, is_down, is_reverse_paddles);
 	return;
 }
 
@@ -245,10 +365,60 @@ void Receiver::ik_right_event(bool is_down, bool is_reverse_paddles)
 
 /**
    \brief Clear the library receive buffer and our own flags
+
+   Results that worker thread has posted before the clear are not
+   shown, and key events queued before the clear are discarded.
 */
 void Receiver::clear()
 {
-	cw_easy_receiver_clear(easy_rec);
+	RECEIVER_ATOMIC_STORE(generation, generation + 1);
+
+	if (worker_running) {
+		receiver_signal_fd(inputs_fd);
+	} else {
+		worker_sync_generation();
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Queue input event for worker thread
+
+   The event is timestamped now, as close to its delivery to
+   application as possible.
+
+   \param kind
+   \param is_down
+   \param is_reverse_paddles
+*/
+void Receiver::push_input(ReceiverInput::Kind kind, bool is_down, bool is_reverse_paddles)
+{
+	ReceiverInput input = { };
+	input.kind = kind;
+	input.is_down = is_down;
+	input.is_reverse_paddles = is_reverse_paddles;
+	input.timestamp = receiver_now();
+	input.generation = generation;
+
+	if (!worker_running) {
+		worker_handle_input(&input);
+		return;
+	}
+
+	const unsigned int head = inputs_head; /* Written only by us. */
+	if (head - RECEIVER_ATOMIC_LOAD(inputs_tail) >= RECEIVER_RING_CAPACITY) {
+		/* Worker thread doesn't keep up. */
+		return;
+	}
+	inputs[head & (RECEIVER_RING_CAPACITY - 1)] = input;
+	RECEIVER_ATOMIC_STORE(inputs_head, head + 1);
+	receiver_signal_fd(inputs_fd);
+
 	return;
 }
 
@@ -257,31 +427,171 @@ void Receiver::clear()
 
 
 /**
-   \brief Handle any error registered when handling a libcw keying event
+   \brief Main function of receiver's worker thread
+
+   The thread passes queued input events to keyer and to libcw's
+   receiver, and polls the receiver. It sleeps until an input event
+   is queued or libcw's receiver signals its descriptor.
+
+   \param arg receiver
 */
-void Receiver::poll_report_error()
+void *Receiver::worker_main(void *arg)
 {
-	/* Handle any receive errors detected on tone end but delayed until here. */
+	Receiver *receiver = (Receiver *) arg;
+
+	struct pollfd fds[2];
+	fds[0].fd = receiver->inputs_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = cw_easy_receiver_get_event_fd(receiver->easy_rec);
+	fds[1].events = POLLIN;
+	const int timeout = (-1 == fds[0].fd || -1 == fds[1].fd) ? RECEIVER_POLL_INTERVAL : -1;
+
+	while (!RECEIVER_ATOMIC_LOAD(receiver->worker_quit)) {
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		if (-1 == ::poll(fds, 2, timeout) && EINTR != errno) {
+			break;
+		}
+		for (int i = 0; i < 2; i++) {
+			uint64_t counter = 0;
+			if (fds[i].revents & POLLIN
+			    && sizeof (counter) != read(fds[i].fd, &counter, sizeof (counter))) {
+				; /* Spurious wakeup. */
+			}
+		}
 
-	switch (cw_easy_receiver_get_libcw_errno(easy_rec)) {
-	case ENOMEM:
-		app->show_status(_("Representation buffer too small"));
-		break;
-	case ERANGE:
-		app->show_status(_("Internal error"));
+		const unsigned int results_before = receiver->results_head;
+
+		receiver->worker_sync_generation();
+
+		unsigned int tail = receiver->inputs_tail; /* Written only by us. */
+		const unsigned int head = RECEIVER_ATOMIC_LOAD(receiver->inputs_head);
+		while (tail != head) {
+			const ReceiverInput *input = &receiver->inputs[tail & (RECEIVER_RING_CAPACITY - 1)];
+			if (input->generation != receiver->worker_generation) {
+				/* Event queued after a clear that we
+				   haven't executed yet, or before a
+				   clear that we have executed. */
+				receiver->worker_sync_generation();
+			}
+			if (input->generation == receiver->worker_generation) {
+				receiver->worker_handle_input(input);
+			}
+			tail++;
+			RECEIVER_ATOMIC_STORE(receiver->inputs_tail, tail);
+		}
+
+		if (RECEIVER_ATOMIC_LOAD(receiver->receiving)) {
+			receiver->worker_poll();
+		}
+
+		if (receiver->results_head != results_before) {
+			/* One wakeup of GUI thread per batch of results. */
+			receiver_signal_fd(receiver->results_fd);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+
+/**
+   \brief Pass input event to keyer and libcw's receiver
+
+   Called in worker thread, or in GUI thread if there is no worker
+   thread.
+
+   \param input
+*/
+void Receiver::worker_handle_input(const ReceiverInput *input)
+{
+	switch (input->kind) {
+	case ReceiverInput::StraightKey:
+		cw_easy_receiver_sk_timed_event(this->easy_rec, input->is_down, input->timestamp);
 		break;
-	case EINVAL:
-		app->show_status(_("Internal timestamp error"));
+	case ReceiverInput::LeftPaddle:
+		cw_easy_receiver_ik_left_timed_event(this->easy_rec, input->is_down, input->is_reverse_paddles, input->timestamp);
 		break;
-	case ENOENT:
-		app->show_status(_("Badly formed CW element"));
+	case ReceiverInput::RightPaddle:
+		cw_easy_receiver_ik_right_timed_event(this->easy_rec, input->is_down, input->is_reverse_paddles, input->timestamp);
 		break;
 	default:
-		app->show_status(_("Internal problem"));
 		break;
 	}
 
-	cw_easy_receiver_clear_libcw_errno(easy_rec);
+	return;
+}
+
+
+
+
+
+/**
+   \brief Execute clear requested by GUI thread, if there is a new one
+
+   Called in worker thread, or in GUI thread if there is no worker
+   thread.
+*/
+void Receiver::worker_sync_generation()
+{
+	const unsigned int current = RECEIVER_ATOMIC_LOAD(generation);
+	if (current != worker_generation) {
+		cw_easy_receiver_clear(this->easy_rec);
+		worker_generation = current;
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Poll the CW library receive buffer and post anything found
+   in the buffer
+*/
+void Receiver::worker_poll()
+{
+	/* Pass queued key events to libcw's receiver, so that errors
+	   detected on them are reported below. */
+	cw_easy_receiver_process_events(easy_rec);
+
+	if (cw_easy_receiver_get_libcw_errno(easy_rec) != 0) {
+		/* Handle any receive errors detected on tone end but
+		   delayed until here. */
+		worker_post_result(ReceiverResult::ReceiveError, 0, cw_easy_receiver_get_libcw_errno(easy_rec));
+		cw_easy_receiver_clear_libcw_errno(easy_rec);
+	}
+
+	if (cw_easy_receiver_is_pending_inter_word_space(easy_rec)) {
+
+		/**
+		   If we received a character on an earlier poll, check again to see
+		   if we need to revise the decision about whether it is the end of a
+		   word too.
+		*/
+		/* Check if receiver received the pending inter-word
+		   space. */
+		cw_rec_data_t erd = { };
+		if (cw_easy_receiver_poll_space(easy_rec, &erd)) {
+			worker_post_result(ReceiverResult::Space, ' ', 0);
+		}
+
+		if (!cw_easy_receiver_is_pending_inter_word_space(easy_rec)) {
+			/* We received the pending space. After it the
+			   receiver may have received another
+			   character.  Try to get it too. */
+			worker_poll_character();
+		}
+	} else {
+		/* Not awaiting a possible space, so just poll the
+		   next possible received character. */
+		worker_poll_character();
+	}
 
 	return;
 }
@@ -293,40 +603,28 @@ void Receiver::poll_report_error()
 /**
    \brief Receive any new character from the CW library.
 */
-void Receiver::poll_character()
+void Receiver::worker_poll_character()
 {
 	cw_rec_data_t erd = { };
 	if (cw_easy_receiver_poll_character(this->easy_rec, &erd)) {
-		/* Receiver stores full, well formed
-		   character. Display it. */
-		textarea->append(erd.character);
-
-		/* Update the status bar to show the character
-		   received.  Put the received char at the end of
-		   string to avoid "jumping" of whole string when
-		   width of glyph of received char changes at variable
-		   font width. */
-		QString status = _("Received at %1 WPM: '%2'");
-		app->show_status(status.arg(cw_get_receive_speed()).arg(erd.character));
-		//fprintf(stderr, "Received character '%c'\n", erd.character);
+		/* Receiver stores full, well formed character. */
+		worker_post_result(ReceiverResult::Character, erd.character, 0);
 
 	} else {
 		/* Handle receive error detected on trying to read a character. */
 		switch (erd.errno_val) {
 		case ENOENT:
 			/* Invalid character in receiver's buffer. */
-			textarea->append('?');
-			app->show_status(QString(_("Unknown character received at %1 WPM")).arg(cw_get_receive_speed()));
+			worker_post_result(ReceiverResult::UnknownCharacter, '?', 0);
 			break;
 
 		case EINVAL:
 			/* Timestamp error. */
-			textarea->append('?');
-			app->show_status(QString(_("Internal error")));
+			worker_post_result(ReceiverResult::TimestampError, '?', 0);
 			break;
 
 		default:
-			return;
+			break;
 		}
 	}
 
@@ -336,6 +634,90 @@ void Receiver::poll_character()
 
 
 
+
+/**
+   \brief Post result for GUI thread
+
+   If GUI thread doesn't keep up, the result is lost.
+*/
+void Receiver::worker_post_result(ReceiverResult::Kind kind, char character, int errno_val)
+{
+	const unsigned int head = results_head; /* Written only by us. */
+	if (head - RECEIVER_ATOMIC_LOAD(results_tail) >= RECEIVER_RING_CAPACITY) {
+		return;
+	}
+
+	ReceiverResult *result = &results[head & (RECEIVER_RING_CAPACITY - 1)];
+	result->kind = kind;
+	result->character = character;
+	result->errno_val = errno_val;
+	result->speed = cw_get_receive_speed();
+	result->generation = worker_generation;
+	RECEIVER_ATOMIC_STORE(results_head, head + 1);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Get status bar message for error registered when handling a libcw keying event
+*/
+QString Receiver::receive_error_status(int errno_val)
+{
+	switch (errno_val) {
+	case ENOMEM:
+		return _("Representation buffer too small");
+	case ERANGE:
+		return _("Internal error");
+	case EINVAL:
+		return _("Internal timestamp error");
+	case ENOENT:
+		return _("Badly formed CW element");
+	default:
+		return _("Internal problem");
+	}
+}
+
+
+
+
+
+/**
+   \brief Get current time of monotonic clock [ns]
+*/
+static int64_t receiver_now(void)
+{
+	struct timespec now = { };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+
+
+
+/**
+   \brief Wake up thread waiting on eventfd
+*/
+static void receiver_signal_fd(int fd)
+{
+	if (-1 == fd) {
+		return;
+	}
+	const uint64_t one = 1;
+	if (sizeof (one) != write(fd, &one, sizeof (one))) {
+		; /* Counter is saturated, descriptor is readable anyway. */
+	}
+
+	return;
+}
+
+
+
+
 #ifdef XCWCP_WITH_REC_TEST
 
 
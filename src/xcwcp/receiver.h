@@ -19,6 +19,10 @@
 #ifndef H_XCWCP_RECEIVER
 #define H_XCWCP_RECEIVER
 
+#include <cstdint>
+
+#include <pthread.h>
+
 #include <QMouseEvent>
 #include <QKeyEvent>
 
@@ -45,11 +49,51 @@ namespace cw {
 
 
 
+	/* Capacity of rings of input events and of results passed
+	   between GUI thread and receiver's worker thread. Must be a
+	   power of two. */
+	enum { RECEIVER_RING_CAPACITY = 256 };
+
+
+
+
+	/* Key or paddle event, timestamped when it has been delivered
+	   to GUI thread. */
+	struct ReceiverInput {
+		enum Kind { StraightKey, LeftPaddle, RightPaddle } kind;
+		bool is_down;
+		bool is_reverse_paddles;
+		int64_t timestamp;          /* CLOCK_MONOTONIC [ns]. */
+		unsigned int generation;    /* Events from before last Clear are discarded. */
+	};
+
+
+
+
+	/* Character, space or error received by worker thread, to be
+	   shown by GUI thread. */
+	struct ReceiverResult {
+		enum Kind { Character, Space, UnknownCharacter, TimestampError, ReceiveError } kind;
+		char character;
+		int errno_val;              /* For ReceiveError. */
+		int speed;                  /* Receive speed at the time [WPM]. */
+		unsigned int generation;    /* Results from before last Clear are discarded. */
+	};
+
+
+
+
 	/* Class Receiver encapsulates the main application receiver
 	   data and functions.  Receiver abstracts states associated
 	   with receiving, event handling, libcw keyer event handling,
 	   and data passed between signal handler and foreground
-	   contexts. */
+	   contexts.
+
+	   Key and paddle events are only timestamped and queued by
+	   GUI thread. Keyer and libcw's receiver are driven by
+	   receiver's worker thread, which posts received characters
+	   back to GUI thread in batches, so that timing of keying
+	   doesn't depend on load of GUI. */
 	class Receiver {
 	public:
 		Receiver(Application *a, TextArea *t) :
@@ -57,11 +101,21 @@ namespace cw {
 		textarea (t)
 			{ easy_rec = cw_easy_receiver_new(); }
 
-		~Receiver() { cw_easy_receiver_delete(&easy_rec); }
+		~Receiver();
+
+		/* Start worker thread. */
+		bool start_worker();
 
-		/* Poll timeout handler. */
+		/* Enable or disable receiving in worker thread. */
+		void set_receiving(bool receiving);
+
+		/* Show results received by worker thread. */
 		void poll(const Mode *current_mode);
 
+		/* Descriptor signalled by worker thread when it has
+		   posted results, -1 if there is none. */
+		int get_event_fd() const { return worker_running ? results_fd : -1; }
+
 		/* Keyboard key event handler. */
 		void handle_key_event(QKeyEvent *event, bool is_reverse_paddles);
 
@@ -91,10 +145,46 @@ namespace cw {
 		Application *app = nullptr;
 		TextArea *textarea = nullptr;
 
-		/* Poll primitives to handle receive errors,
-		   characters, and inter-word spaces. */
-		void poll_report_error();
-		void poll_character();
+		/* Single-producer, single-consumer rings. Inputs are
+		   produced by GUI thread, results by worker thread.
+		   Indices are free-running counters, accessed with
+		   atomic builtins. */
+		ReceiverInput inputs[RECEIVER_RING_CAPACITY] = {};
+		unsigned int inputs_head = 0;
+		unsigned int inputs_tail = 0;
+		ReceiverResult results[RECEIVER_RING_CAPACITY] = {};
+		unsigned int results_head = 0;
+		unsigned int results_tail = 0;
+
+		/* eventfds waking up worker thread and GUI thread. The
+		   worker thread is not started without them. */
+		int inputs_fd = -1;
+		int results_fd = -1;
+
+		pthread_t worker;
+		bool worker_running = false;
+		bool worker_quit = false;
+		bool receiving = false;
+
+		/* Incremented by clear() in GUI thread, and read
+		   directly by worker thread, which executes the clear
+		   when it sees a new value. Clear never goes through
+		   the ring of inputs, so it can't be dropped when the
+		   ring is full. */
+		unsigned int generation = 0;
+		unsigned int worker_generation = 0;
+
+		void push_input(ReceiverInput::Kind kind, bool is_down, bool is_reverse_paddles);
+
+		/* Worker thread's functions. */
+		static void *worker_main(void *arg);
+		void worker_handle_input(const ReceiverInput *input);
+		void worker_sync_generation();
+		void worker_poll();
+		void worker_poll_character();
+		void worker_post_result(ReceiverResult::Kind kind, char character, int errno_val);
+
+		static QString receive_error_status(int errno_val);
 
 		/* Prevent unwanted operations. */
 		Receiver(const Receiver &);
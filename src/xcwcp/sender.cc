@@ -44,6 +44,15 @@ namespace cw {
 
 
 
+Sender::~Sender()
+{
+	cw_practice_delete(&practice);
+}
+
+
+
+
+
 /**
    \brief Get more characters to send
 
@@ -61,7 +70,7 @@ void Sender::poll(const Mode *current_mode)
 			   queue. */
 			if (current_mode->is_dictionary() && queue.empty()) {
 				enqueue_string(std::string(1, ' ')
-					       + current_mode->get_dmode()->get_random_word_group());
+					       + get_practice_group(current_mode->get_dmode()));
 			}
 
 			dequeue_and_play_character();
@@ -210,6 +219,36 @@ void Sender::enqueue_string(const std::string &s)
 
 
 
+/**
+   \brief Get next group of practice text of dictionary mode
+
+   Groups are generated ahead of time by background thread, so the
+   function doesn't wait for dictionary. Producer of groups is
+   (re)started when dictionary mode is used for the first time.
+
+   \param dmode - current dictionary mode
+*/
+std::string Sender::get_practice_group(const DictionaryMode *dmode)
+{
+	const cw_dictionary_t *dict = dmode->get_dictionary();
+	if (!practice || cw_practice_get_dictionary(practice) != dict) {
+		cw_practice_delete(&practice);
+		practice = cw_practice_new(dict);
+		if (!practice) {
+			return dmode->get_random_word_group();
+		}
+	}
+
+	char group[CW_PRACTICE_GROUP_SIZE];
+	cw_practice_get_group(practice, group, sizeof (group));
+
+	return std::string(group);
+}
+
+
+
+
+
 /**
    \brief Delete last character from queue
 
@@ -28,6 +28,8 @@
 #include <string>
 #include <deque>
 
+#include "cw_practice.h"
+
 
 
 
@@ -49,6 +51,7 @@ namespace cw {
 	class Application;
 	class TextArea;
 	class Mode;
+	class DictionaryMode;
 
 
 
@@ -59,7 +62,9 @@ namespace cw {
 		Sender(Application *a, TextArea *t) :
 			app (a),
 			textarea (t),
-			is_queue_idle (true) { }
+			is_queue_idle (true),
+			practice (NULL) { }
+		~Sender();
 
 		/* Poll timeout handler, and keypress event
 		   handler. */
@@ -76,6 +81,7 @@ namespace cw {
 		void dequeue_and_play_character();
 		void enqueue_string(const std::string &word);
 		void delete_character();
+		std::string get_practice_group(const DictionaryMode *dmode);
 
 
 		Application *app;
@@ -84,6 +90,10 @@ namespace cw {
 		bool is_queue_idle;
 		std::deque<char> queue;
 
+		/* Practice text of current dictionary mode, generated
+		   ahead of time by background thread. */
+		cw_practice_t *practice;
+
 
 		/* Prevent unwanted operations. */
 		Sender(const Sender &);
@@ -26,12 +26,16 @@
 #include <QKeyEvent>
 #include <QMenu>
 #include <QPoint>
+#include <QScrollBar>
+#include <QTextCursor>
+#include <QTextDocument>
 
 #include <string>
 
 #include "application.h"
 #include "textarea.h"
 #include "i18n.h"
+#include "cw_config.h"
 
 
 
@@ -42,6 +46,12 @@ namespace cw {
 
 
 
+/* Period of insertions of appended text into the widget [ms]. */
+static const int FRAME_PERIOD = 1000 / 30;
+
+
+
+
 
 const QString DISPLAY_WHATSTHIS =
 	_("This is the main display for Xcwcp.  The random CW characters that "
@@ -57,7 +67,8 @@ const QString DISPLAY_WHATSTHIS =
 
 TextArea::TextArea(Application *a, QWidget *parent) :
 	QTextEdit (parent),
-	app (a)
+	app (a),
+	max_lines (CW_SCROLLBACK_LINES_INITIAL)
 {
 	/* Block context menu in text area, this is to make right mouse
 	   button work as correct sending key (paddle).
@@ -87,6 +98,10 @@ TextArea::TextArea(Application *a, QWidget *parent) :
 
 	setFontWeight(QFont::Bold);
 
+	/* Hard limit for text with many newlines; text without newlines
+	   is limited by trim(). */
+	document()->setMaximumBlockCount(max_lines);
+
 	setFocus();
 	setWhatsThis("DISPLAY_WHATSTHIS");
 
@@ -204,10 +219,134 @@ QMenu *TextArea::createPopupMenu()
 
 /**
    \brief Append a character at the current notional cursor position.
+
+   The character is not inserted into the widget right away: all
+   characters appended during one frame are inserted at once, so
+   that the widget does its layout once per frame, and not once
+   per character.
 */
 void TextArea::append(char c)
 {
-	this->insertPlainText(QString(QChar(c)));
+	pending.append(QChar(c));
+	if (!frame_timer.isActive()) {
+		frame_timer.start(FRAME_PERIOD, this);
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Insert characters appended since last frame into the widget
+*/
+void TextArea::flush()
+{
+	frame_timer.stop();
+	if (pending.isEmpty()) {
+		return;
+	}
+
+	this->insertPlainText(pending);
+	pending.clear();
+	trim();
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Clear the widget, including text not inserted yet
+*/
+void TextArea::clear()
+{
+	frame_timer.stop();
+	pending.clear();
+	QTextEdit::clear();
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Set limit of lines of text kept in the widget
+
+   \param lines - count of lines
+*/
+void TextArea::set_max_lines(int lines)
+{
+	max_lines = lines;
+	document()->setMaximumBlockCount(max_lines);
+	trim();
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Remove oldest text if there is more of it than limit of lines allows
+
+   Text in the widget is usually one long paragraph, so the limit of
+   count of blocks of the document isn't enough. Length of a line is
+   estimated from width of the widget. Text is removed in chunks of
+   a tenth of the limit, so the (costly) removal doesn't happen on
+   every frame.
+*/
+void TextArea::trim()
+{
+	const int char_width = fontMetrics().averageCharWidth();
+	const int columns = char_width > 0 ? qMax(1, viewport()->width() / char_width) : 80;
+	const int max_chars = max_lines * columns;
+
+	QTextDocument *doc = document();
+	const int count = doc->characterCount();
+	if (count <= max_chars + max_chars / 10) {
+		return;
+	}
+
+	/* Keep the view still if the user has scrolled back. */
+	QScrollBar *scroll_bar = verticalScrollBar();
+	const bool at_bottom = scroll_bar->value() == scroll_bar->maximum();
+
+	QTextCursor cursor(doc);
+	cursor.movePosition(QTextCursor::Start);
+	cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor, count - max_chars);
+	/* Don't leave a part of a word at the beginning. */
+	cursor.movePosition(QTextCursor::NextWord, QTextCursor::KeepAnchor);
+	cursor.removeSelectedText();
+
+	if (at_bottom) {
+		scroll_bar->setValue(scroll_bar->maximum());
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Insert pending text at the end of a frame
+*/
+void TextArea::timerEvent(QTimerEvent *event)
+{
+	if (event->timerId() == frame_timer.timerId()) {
+		flush();
+	} else {
+		QTextEdit::timerEvent(event);
+	}
 
 	return;
 }
@@ -224,6 +363,12 @@ void TextArea::append(char c)
 */
 void TextArea::backspace()
 {
+	/* The character may not have made it to the widget yet. */
+	if (!pending.isEmpty()) {
+		pending.chop(1);
+		return;
+	}
+
 	QKeyEvent *keyEvent = new QKeyEvent(QEvent::KeyPress, Qt::Key_Backspace, Qt::NoModifier);
 	QTextEdit::keyPressEvent(keyEvent);
 
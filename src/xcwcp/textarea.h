@@ -20,6 +20,9 @@
 #include <QTextEdit>
 #include <QEvent>
 #include <QMenu>
+#include <QBasicTimer>
+#include <QTimerEvent>
+#include <QString>
 
 
 
@@ -37,6 +40,9 @@ namespace cw {
 
 		void append(char c);
 		void backspace();
+		void flush();
+		void clear();
+		void set_max_lines(int lines);
 
 	protected:
 		// Functions overridden to catch events from the parent class.
@@ -48,11 +54,22 @@ namespace cw {
 		// Are these necessary after adding fontPointSize() in constructor?
 		virtual QMenu *createPopupMenu(const QPoint &);
 		virtual QMenu *createPopupMenu();
+		void timerEvent(QTimerEvent *event);
 
 	private:
 		// Application to forward key and mouse events to.
 		Application *app;
 
+		// Characters appended since last frame, inserted into
+		// the document all at once by flush().
+		QString pending;
+		QBasicTimer frame_timer;
+
+		// Limit of lines of text kept in the widget.
+		int max_lines;
+
+		void trim();
+
 		// Prevent unwanted operations.
 		TextArea(const TextArea &);
 		TextArea &operator=(const TextArea &);